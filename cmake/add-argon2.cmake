@@ -0,0 +1,13 @@
+# libargon2 for argon2id password hashes, found through pkg-config
+find_package(PkgConfig REQUIRED)
+pkg_check_modules(ARGON2 REQUIRED IMPORTED_TARGET libargon2)
+
+target_link_libraries(mantisbase
+        PUBLIC PkgConfig::ARGON2
+)
+
+target_compile_definitions(mantisbase PRIVATE MB_ARGON2_ENABLED=1)
+if(TARGET mantisbase-dll)
+    target_link_libraries(mantisbase-dll PUBLIC PkgConfig::ARGON2)
+    target_compile_definitions(mantisbase-dll PRIVATE MB_ARGON2_ENABLED=1)
+endif()
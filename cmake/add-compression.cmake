@@ -0,0 +1,36 @@
+# Encoders for response compression, and zstd for `compress` fields too.
+# gzip comes with zlib (already a Drogon dependency); brotli and zstd are
+# used when found and skipped otherwise.
+set(MB_COMPRESSION_TARGETS mantisbase)
+if(TARGET mantisbase-dll)
+    list(APPEND MB_COMPRESSION_TARGETS mantisbase-dll)
+endif()
+
+list(APPEND CMAKE_MODULE_PATH "${CMAKE_CURRENT_SOURCE_DIR}/cmake")
+find_package(ZSTD QUIET)
+if(ZSTD_FOUND)
+    message("-- Response compression: zstd ${ZSTD_VERSION}")
+endif()
+
+find_path(BROTLI_INCLUDE_DIR brotli/encode.h)
+find_library(BROTLI_ENC_LIBRARY NAMES brotlienc)
+if(BROTLI_INCLUDE_DIR AND BROTLI_ENC_LIBRARY)
+    message("-- Response compression: brotli")
+endif()
+
+foreach(target ${MB_COMPRESSION_TARGETS})
+    if(TARGET ZLIB::ZLIB)
+        target_link_libraries(${target} PRIVATE ZLIB::ZLIB)
+    endif()
+
+    if(ZSTD_FOUND)
+        target_link_libraries(${target} PRIVATE ZSTD::ZSTD)
+        target_compile_definitions(${target} PRIVATE MB_HAVE_ZSTD=1)
+    endif()
+
+    if(BROTLI_INCLUDE_DIR AND BROTLI_ENC_LIBRARY)
+        target_include_directories(${target} PRIVATE ${BROTLI_INCLUDE_DIR})
+        target_link_libraries(${target} PRIVATE ${BROTLI_ENC_LIBRARY})
+        target_compile_definitions(${target} PRIVATE MB_HAVE_BROTLI=1)
+    endif()
+endforeach()
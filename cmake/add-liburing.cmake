@@ -0,0 +1,13 @@
+# liburing for upload writes and unlinks through io_uring, found through pkg-config
+find_package(PkgConfig REQUIRED)
+pkg_check_modules(URING REQUIRED IMPORTED_TARGET liburing)
+
+target_link_libraries(mantisbase
+        PUBLIC PkgConfig::URING
+)
+
+target_compile_definitions(mantisbase PRIVATE MB_IO_URING_ENABLED=1)
+if(TARGET mantisbase-dll)
+    target_link_libraries(mantisbase-dll PUBLIC PkgConfig::URING)
+    target_compile_definitions(mantisbase-dll PRIVATE MB_IO_URING_ENABLED=1)
+endif()
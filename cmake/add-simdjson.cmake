@@ -0,0 +1,20 @@
+# SIMD JSON front end for request bodies and change payloads. Used when
+# simdjson is found and MB_SIMDJSON is on; parseJson() falls back to
+# nlohmann's parser otherwise.
+option(MB_SIMDJSON "Parse JSON with simdjson when it is available" ON)
+
+set(MB_SIMDJSON_TARGETS mantisbase)
+if(TARGET mantisbase-dll)
+    list(APPEND MB_SIMDJSON_TARGETS mantisbase-dll)
+endif()
+
+if(MB_SIMDJSON)
+    find_package(simdjson CONFIG QUIET)
+    if(simdjson_FOUND)
+        message("-- JSON parsing: simdjson ${simdjson_VERSION}")
+        foreach(target ${MB_SIMDJSON_TARGETS})
+            target_link_libraries(${target} PRIVATE simdjson::simdjson)
+            target_compile_definitions(${target} PRIVATE MB_HAVE_SIMDJSON=1)
+        endforeach()
+    endif()
+endif()
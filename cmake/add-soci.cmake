@@ -38,6 +38,18 @@ endif(MB_HAS_POSTGRESQL)
 # Add SOCI subdirectory - this should generate soci-config.h
 add_subdirectory ( ${CMAKE_CURRENT_SOURCE_DIR}/3rdParty/soci )
 
+# Searchable entity fields are indexed with FTS5, and geo_point fields with
+# an R*Tree, which the bundled SQLite leaves out unless asked for
+if(TARGET soci_sqlite3)
+    get_target_property ( MB_SOCI_SQLITE3_TARGET soci_sqlite3 ALIASED_TARGET )
+    if(NOT MB_SOCI_SQLITE3_TARGET)
+        set ( MB_SOCI_SQLITE3_TARGET soci_sqlite3 )
+    endif()
+    target_compile_definitions ( ${MB_SOCI_SQLITE3_TARGET} PRIVATE SQLITE_ENABLE_FTS5 SQLITE_ENABLE_RTREE )
+    # Public, as sqlite3.h only declares the hook with it; MB_SQLITE_CAPTURE=hooks
+    target_compile_definitions ( ${MB_SOCI_SQLITE3_TARGET} PUBLIC SQLITE_ENABLE_PREUPDATE_HOOK )
+endif()
+
 target_link_libraries ( mantisbase
         PUBLIC
         soci_core
@@ -0,0 +1,13 @@
+# libvips for image thumbnails, found through pkg-config
+find_package(PkgConfig REQUIRED)
+pkg_check_modules(VIPS REQUIRED IMPORTED_TARGET vips)
+
+target_link_libraries(mantisbase
+        PUBLIC PkgConfig::VIPS
+)
+
+target_compile_definitions(mantisbase PRIVATE MB_THUMBNAILS_ENABLED=1)
+if(TARGET mantisbase-dll)
+    target_link_libraries(mantisbase-dll PUBLIC PkgConfig::VIPS)
+    target_compile_definitions(mantisbase-dll PRIVATE MB_THUMBNAILS_ENABLED=1)
+endif()
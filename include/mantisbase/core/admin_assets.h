@@ -0,0 +1,76 @@
+/**
+ * @file admin_assets.h
+ * @brief The embedded admin dashboard, indexed once at startup.
+ *
+ * Every file of the bundle gets its MIME type, ETag, Cache-Control and
+ * compressed variants worked out when the router starts, so a dashboard
+ * request is one hash lookup plus copying the prepared bytes out.
+ * @see Router, Compression
+ */
+
+#ifndef MANTISBASE_ADMIN_ASSETS_H
+#define MANTISBASE_ADMIN_ASSETS_H
+
+#include <array>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <drogon/HttpRequest.h>
+#include <drogon/HttpResponse.h>
+
+#include "compression.h"
+
+namespace mb {
+    /**
+     * @brief Immutable path → asset table over the embedded `/public` bundle.
+     *
+     * Unknown paths resolve to `index.html`, so client-side routes of the
+     * dashboard load it. Variants shipped in the bundle as `.br`/`.gz`/`.zst`
+     * siblings are used as they are; the others are compressed here, once,
+     * at the best level.
+     */
+    class AdminAssets {
+    public:
+        /// Number of Compression::Encoding values, identity included
+        static constexpr std::size_t ENCODINGS = 4;
+
+        struct Asset {
+            std::string_view body;          ///> Into the embedded bundle
+            std::string mime;
+            std::string cacheControl;
+            /// Per Compression::Encoding; empty where there is no variant smaller than the body
+            std::array<std::string_view, ENCODINGS> encoded{};
+            /// Strong, per variant; identity's is the bare content hash
+            std::array<std::string, ENCODINGS> etags{};
+        };
+
+        /// @param mime_of MIME type of a bundle path, e.g. `application/javascript` for `.js`
+        explicit AdminAssets(const std::function<std::string(const std::string &)> &mime_of);
+
+        AdminAssets(const AdminAssets &) = delete;
+        AdminAssets &operator=(const AdminAssets &) = delete;
+
+        /**
+         * @brief The asset for `path`, relative to `/mb`.
+         * @return `index.html` for `/`, empty and unknown paths; nullptr only if the bundle has none
+         */
+        [[nodiscard]] const Asset *find(std::string_view path) const;
+
+        /// @brief Answer a dashboard request under `/mb`: the negotiated variant, or 304 when `If-None-Match` matches.
+        [[nodiscard]] drogon::HttpResponsePtr respond(const drogon::HttpRequestPtr &req) const;
+
+        [[nodiscard]] std::size_t size() const { return m_assets.size(); }
+
+    private:
+        void index(const std::string &dir, const std::function<std::string(const std::string &)> &mime_of);
+
+        std::unordered_map<std::string, Asset> m_assets;   ///> Keyed by path under `/public`, e.g. `/index.html`
+        std::deque<std::string> m_compressed;               ///> Owns the variants compressed at startup
+        const Asset *m_index = nullptr;
+    };
+}
+
+#endif // MANTISBASE_ADMIN_ASSETS_H
@@ -0,0 +1,149 @@
+/**
+ * @file admission.h
+ * @brief Adaptive concurrency limits for database-bound routes.
+ *
+ * When the database slows down, requests on RouteExec::DbWorker routes
+ * queue on the workers and the pool until they time out. With admission
+ * on, each route pattern runs at most a limit of requests at once, and the
+ * limit follows observed latency: it grows while latency holds steady and
+ * shrinks as it climbs. A request over the limit is told `503` with
+ * `Retry-After` at once, before reading its body. Admin, health and
+ * metrics routes are never limited and go to the front of the worker queue.
+ * @see Router::dispatch(), WorkerPool
+ */
+
+#ifndef MANTISBASE_ADMISSION_H
+#define MANTISBASE_ADMISSION_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace mb {
+    class MetricsWriter;
+
+    /**
+     * @brief In-flight limit of one route, adapted by latency gradient.
+     *
+     * A short and a long moving average of latency are kept. Their ratio is
+     * the gradient: near 1 while the database keeps up, below 1 once
+     * requests start queueing. Each sample moves the limit towards
+     * `limit * gradient + sqrt(limit)`, so it probes upwards by a little
+     * headroom and backs off in proportion to the latency rise. Samples
+     * taken while less than half the limit was in use don't move it; the
+     * route wasn't pushing against it.
+     *
+     * @code
+     * auto permit = limit.acquire();
+     * if (!permit) return reply503();
+     * run([permit] { ... }); // released, and its latency sampled, with the last copy
+     * @endcode
+     */
+    class ConcurrencyLimit {
+    public:
+        struct Options {
+            std::size_t min = 4;
+            std::size_t max = 256;
+            std::size_t initial = 32;
+            double tolerance = 2.0; ///> Latency rise over the long average tolerated before backing off
+        };
+
+        /// @brief One admitted request; releases its slot when destroyed.
+        class Permit {
+        public:
+            /// @param inflight Requests in flight with this one, as acquire() counted them
+            Permit(ConcurrencyLimit &limit, std::size_t inflight);
+            ~Permit();
+
+            Permit(const Permit &) = delete;
+            Permit &operator=(const Permit &) = delete;
+
+        private:
+            ConcurrencyLimit &m_limit;
+            std::size_t m_inflight;
+            std::chrono::steady_clock::time_point m_started;
+        };
+
+        explicit ConcurrencyLimit(Options options);
+
+        /// @return A permit, or null (and a rejection counted) if the limit is in use
+        std::shared_ptr<Permit> acquire();
+
+        /**
+         * @brief Feed one request's latency into the limit.
+         * @param inflight Requests in flight when it was admitted, itself included
+         */
+        void sample(std::chrono::nanoseconds latency, std::size_t inflight);
+
+        [[nodiscard]] std::size_t limit() const { return m_limit.load(std::memory_order_relaxed); }
+        [[nodiscard]] std::size_t inflight() const { return m_inflight.load(std::memory_order_relaxed); }
+        [[nodiscard]] std::uint64_t rejected() const { return m_rejected.load(std::memory_order_relaxed); }
+
+    private:
+        const Options m_options;
+        std::atomic<std::size_t> m_limit;
+        std::atomic<std::size_t> m_inflight{0};
+        std::atomic<std::uint64_t> m_rejected{0};
+
+        std::mutex m_mutex;      ///> Guards the averages below
+        double m_estimate;       ///> The limit before rounding
+        double m_short = 0;      ///> Seconds
+        double m_long = 0;       ///> Seconds
+        std::uint64_t m_samples = 0;
+    };
+
+    /**
+     * @brief A ConcurrencyLimit per route pattern, when MB_ADMISSION=1.
+     *
+     * Routes are registered once, when their handler is, like Metrics; the
+     * handler keeps the returned limit and takes permits from it directly.
+     */
+    class Admission {
+    public:
+        struct Options {
+            bool enabled = false;
+            ConcurrencyLimit::Options limit;
+
+            /// @brief Read MB_ADMISSION, MB_ADMISSION_MIN and MB_ADMISSION_MAX.
+            static Options fromEnv();
+        };
+
+        explicit Admission(Options options);
+
+        [[nodiscard]] bool enabled() const { return m_options.enabled; }
+
+        /// @brief Limit for `method route`, created on first use. The reference stays valid.
+        ConcurrencyLimit &route(const std::string &method, const std::string &route);
+
+        /// @brief Admin, debug, health and metrics routes: never limited, and first in the worker queue.
+        static bool isPriority(std::string_view route);
+
+        /// @brief `mb_admission_limit`, `mb_admission_inflight` and `mb_admission_rejected_total`, per route.
+        void writeMetrics(MetricsWriter &out) const;
+
+    private:
+        struct Entry {
+            Entry(std::string method, std::string route, const ConcurrencyLimit::Options &options)
+                : method(std::move(method)), route(std::move(route)), limit(options) {}
+
+            std::string method;
+            std::string route;
+            ConcurrencyLimit limit;
+        };
+
+        const Options m_options;
+        mutable std::mutex m_mutex;
+        std::vector<std::unique_ptr<Entry>> m_routes;
+        std::unordered_map<std::string, Entry *> m_routeIndex;
+    };
+}
+
+#endif // MANTISBASE_ADMISSION_H
@@ -5,6 +5,8 @@
 #include <optional>
 #include <nlohmann/json.hpp>
 
+#include "keyset_page.h"
+
 namespace mb {
     using json = nlohmann::json;
 
@@ -23,14 +25,46 @@ namespace mb {
                           const std::string &label, const json &permissions = json::array(),
                           const std::string &expires_at = "");
 
-        static json list(const std::string &entity_name, const std::string &user_id);
+        /**
+         * @brief A page of the keys of `entity_name`, in id order; never the raw keys.
+         *
+         * @param user_id Owner of the keys, or empty for every owner's
+         * @param filters `label`: that label only; `active`: true leaves expired keys out
+         * @return KeysetPage::envelope() of the keys
+         */
+        static json list(const std::string &entity_name, const std::string &user_id,
+                         const KeysetPage &page = {}, const json &filters = json::object());
 
         static bool revoke(const std::string &key_id, const std::string &entity_name,
                           const std::string &user_id);
 
+        /**
+         * @brief Resolve an API key by its hash.
+         *
+         * Served from an in-memory cache keyed by `key_hash` (entries live for
+         * KEY_CACHE_TTL_SECS or until revoked). The `last_used` touch is only
+         * recorded in memory; see flushLastUsed().
+         */
         static std::optional<json> lookupByHash(const std::string &key_hash);
 
-        static json listAdmin();
+        /**
+         * @brief Write the coalesced `last_used` timestamps in a single transaction.
+         *
+         * Called every LAST_USED_FLUSH_INTERVAL_SECS while the server runs and
+         * once more on shutdown. On failure the timestamps are re-queued.
+         * @return Number of keys updated.
+         */
+        static std::size_t flushLastUsed();
+
+        /// @brief Drop all cached key lookups.
+        static void clearCache();
+
+        static constexpr int KEY_CACHE_TTL_SECS = 60;
+        static constexpr std::size_t KEY_CACHE_CAPACITY = 10000;
+        static constexpr double LAST_USED_FLUSH_INTERVAL_SECS = 5.0;
+
+        /// @brief list() of the admins' keys; `filters` may add `user_id` to keep to one admin's.
+        static json listAdmin(const KeysetPage &page = {}, const json &filters = json::object());
 
         static json createAdmin(const std::string &user_id, const std::string &label,
                                const json &permissions = json::array(),
@@ -0,0 +1,174 @@
+/**
+ * @file app_kv.h
+ * @brief Application key-value pairs with TTLs, counters and compare-and-set.
+ *
+ * For counters, feature flags and small caches that would otherwise need a
+ * Redis next to the server. Pairs are served from a sharded in-memory map
+ * and written behind to `mb_kv`: a background thread stores the keys that
+ * changed every MB_KV_FLUSH_MS, and the map is loaded back at start.
+ * Each node answers from its own memory, so a pair written on one node is
+ * seen by another only after it restarts.
+ * @see Router::registerKvRoutes()
+ */
+
+#ifndef MANTISBASE_APP_KV_H
+#define MANTISBASE_APP_KV_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <nlohmann/json.hpp>
+
+#ifdef MB_SCRIPTING_ENABLED
+#include <dukglue/dukglue.h>
+#endif
+
+namespace mb {
+    /**
+     * @brief Key-value pairs in memory, written behind to the database.
+     *
+     * Every call is atomic for its key. Before start(), and after stop(),
+     * changes are written right away, as the CLI and tests expect.
+     *
+     * @code
+     * auto &kv = app.kv();
+     * kv.set("flags:beta", true);
+     * const auto hits = kv.incr("hits:" + path, 1, std::chrono::hours(1));
+     * kv.cas("leader", nullptr, node_id, std::chrono::seconds(30)); // only if unset
+     * @endcode
+     */
+    class AppKv {
+    public:
+        using Clock = std::chrono::system_clock;
+
+        struct Options {
+            std::chrono::milliseconds flushInterval{100}; ///> How often changed keys are written
+            std::size_t maxKeys = 100000;                  ///> 0 for no limit
+            std::size_t maxValueBytes = 64 * 1024;         ///> Of the value as JSON
+
+            /// @brief Read MB_KV_FLUSH_MS, MB_KV_MAX_KEYS and MB_KV_MAX_VALUE_BYTES.
+            static Options fromEnv();
+        };
+
+        struct Entry {
+            nlohmann::json value;
+            std::int64_t expiresAt = 0; ///> Unix ms, 0 for never
+        };
+
+        explicit AppKv(Options options);
+        ~AppKv();
+
+        AppKv(const AppKv &) = delete;
+        AppKv &operator=(const AppKv &) = delete;
+
+        /// @brief Load the stored pairs, then start the writer thread.
+        void start();
+
+        /// @brief Write what changed, then stop the thread. Idempotent.
+        void stop();
+
+        /// @brief The pair at `key`, unless absent or expired.
+        [[nodiscard]] std::optional<Entry> get(const std::string &key);
+
+        /**
+         * @brief Store `value` at `key`, replacing any TTL.
+         * @param ttl Lifetime, zero for none
+         * @throw MantisException (400) for a bad key, (413) for a value over maxValueBytes,
+         *        (507) for a new key past maxKeys
+         */
+        void set(const std::string &key, nlohmann::json value, std::chrono::milliseconds ttl = {});
+
+        /// @return True if `key` was there
+        bool remove(const std::string &key);
+
+        /**
+         * @brief Add `by` to the integer at `key`, starting from 0 if it's unset.
+         * @param ttl Sets a new lifetime if non-zero, otherwise the pair keeps its own
+         * @return The value after the add
+         * @throw MantisException (409) if the value there isn't an integer
+         */
+        std::int64_t incr(const std::string &key, std::int64_t by = 1, std::chrono::milliseconds ttl = {});
+
+        /**
+         * @brief Store `desired` at `key` only if it holds `expected`; `null` expects it unset.
+         * @return Whether it was stored
+         */
+        bool cas(const std::string &key, const nlohmann::json &expected, nlohmann::json desired,
+                 std::chrono::milliseconds ttl = {});
+
+        /// @brief Pairs held, including expired ones not swept yet.
+        [[nodiscard]] std::size_t size() const { return m_size.load(); }
+
+        /// @brief Write every changed key now. Called by the thread; public for tests.
+        /// @return Keys written or deleted
+        std::size_t flush();
+
+        /// @brief Replace what is held with the unexpired rows of `mb_kv`. Called by start(); public for tests.
+        /// @return Pairs loaded
+        std::size_t load();
+
+#ifdef MB_SCRIPTING_ENABLED
+        /// @brief Register `app.kv()` methods: get, set, remove, incr and cas (TTLs in ms).
+        static void registerDuktapeMethods();
+
+        duk_ret_t get_JS(duk_context *ctx);
+        duk_ret_t set_JS(duk_context *ctx);
+        duk_ret_t remove_JS(duk_context *ctx);
+        duk_ret_t incr_JS(duk_context *ctx);
+        duk_ret_t cas_JS(duk_context *ctx);
+#endif
+
+    private:
+        static constexpr std::size_t SHARDS = 16;
+
+        struct Shard {
+            std::mutex mutex;
+            std::unordered_map<std::string, Entry> entries;
+            std::unordered_set<std::string> dirty; ///> Changed since the last flush
+        };
+
+        Shard &shardFor(const std::string &key);
+
+        /// Drops `key` if it has expired; call with the shard locked
+        std::unordered_map<std::string, Entry>::iterator live(Shard &shard, const std::string &key,
+                                                             std::int64_t now);
+
+        /// Store `entry` at `key` with the shard locked; throws before changing anything
+        void put(Shard &shard, const std::string &key, Entry entry);
+
+        /// Mark `key` changed; call with the shard locked
+        void touch(Shard &shard, const std::string &key);
+
+        /// Write right away when the thread isn't running
+        void afterChange();
+
+        /// Drop expired pairs from memory; the database skips them on load
+        void sweep();
+
+        void loop();
+
+        const Options m_options;
+        std::array<Shard, SHARDS> m_shards;
+        std::atomic<std::size_t> m_size{0};
+        std::atomic<bool> m_dirty{false};
+
+        std::mutex m_flushMutex; ///> One flush at a time, so writes land in order
+
+        std::mutex m_mutex; ///> Guards the thread state below
+        std::condition_variable m_cv;
+        bool m_running = false;
+        bool m_stopping = false;
+        std::thread m_thread;
+    };
+}
+
+#endif // MANTISBASE_APP_KV_H
@@ -0,0 +1,81 @@
+/**
+ * @file async_handler.h
+ * @brief Awaiting blocking work from a coroutine route.
+ *
+ * A route added with Router::GetAsync() and friends runs on its IO loop.
+ * Database calls block, so they go to the DB worker pool through
+ * onDbWorker(); the coroutine resumes on its loop once they return, and
+ * the loop serves other requests meanwhile.
+ * @see Router::offload()
+ */
+
+#ifndef MANTISBASE_ASYNC_HANDLER_H
+#define MANTISBASE_ASYNC_HANDLER_H
+
+#include "http.h"
+#include "router.h"
+#include "../mantisbase.h"
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace mb {
+    /// What `co_await onDbWorker(req, work)` suspends on; `work()`'s result or exception comes back
+    template<typename T>
+    class DbWorkAwaiter {
+    public:
+        DbWorkAwaiter(MantisRequest &req, std::function<T()> work) : m_req(req), m_work(std::move(work)) {}
+
+        [[nodiscard]] bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            m_req.mApp().router().offload(m_req, [this] {
+                try {
+                    if constexpr (std::is_void_v<T>) {
+                        m_work();
+                        m_result.emplace();
+                    } else {
+                        m_result.emplace(m_work());
+                    }
+                } catch (...) {
+                    m_error = std::current_exception();
+                }
+            }, [handle] { handle.resume(); });
+        }
+
+        T await_resume() {
+            if (m_error) std::rethrow_exception(m_error);
+            if constexpr (!std::is_void_v<T>) return std::move(*m_result);
+        }
+
+    private:
+        MantisRequest &m_req;
+        std::function<T()> m_work;
+        std::optional<std::conditional_t<std::is_void_v<T>, std::monostate, T>> m_result;
+        std::exception_ptr m_error;
+    };
+
+    /**
+     * @brief Run `work` on a DB worker, in the request's tenant and replica scope.
+     *
+     * @code
+     * router.GetAsync("/api/v1/stats", [](MantisRequest &req, MantisResponse &res) -> drogon::Task<> {
+     *     const auto count = co_await onDbWorker(req, [] {
+     *         return MantisBase::instance().entity("posts").countRecords();
+     *     });
+     *     res.sendJSON(200, {{"posts", count}});
+     * });
+     * @endcode
+     */
+    template<typename F>
+    auto onDbWorker(MantisRequest &req, F work) {
+        return DbWorkAwaiter<std::invoke_result_t<F>>(req, std::move(work));
+    }
+}
+
+#endif // MANTISBASE_ASYNC_HANDLER_H
@@ -11,9 +11,15 @@
 #include <string>
 #include <wolfssl/wolfio.h>
 #include "../utils/utils.h"
+#include "session_cache.h"
+#include "auth_user_cache.h"
+#include "token_verifier.h"
+#include "keyset_page.h"
 
 namespace mb
 {
+    class RevocationFilter;
+
     /**
      * @brief JWT token creation and verification utilities.
      *
@@ -47,12 +53,40 @@ namespace mb
          */
         static std::string createToken(const json& claims_params, int timeout = -1);
 
+        /**
+         * @brief Verify token signature/claims and that its session is still active.
+         *
+         * Session state is served from sessionCache() when possible; only a
+         * cache miss queries `mb_sessions`.
+         */
         static json verifyToken(const std::string& token);
 
+        /// @brief Delete a session and mark it revoked in the session cache.
         static bool deleteSession(const std::string& session_id);
 
         static json refreshSession(const std::string& old_session_id, const std::string& entity_name,
                                    const std::string& user_id);
+
+        /**
+         * @brief A page of the unexpired sessions in `mb_sessions`, by id; never their token hashes.
+         *
+         * Sessions still queued in the SessionStore aren't listed until written.
+         * @param filters `entity_name` and `user_id` to keep to
+         * @return KeysetPage::envelope() of the sessions
+         */
+        static json listSessions(const KeysetPage& page = {}, const json& filters = json::object());
+
+        /// @brief Process-wide cache of verified sessions.
+        static SessionCache& sessionCache();
+
+        /// @brief Signing keys and verifiers, rebuilt only when the key configuration changes.
+        static TokenVerifier& tokenVerifier();
+
+        /// @brief Sessions revoked lately, checked instead of `mb_sessions` by stateless verification.
+        static RevocationFilter& revocations();
+
+        /// @brief Process-wide cache of user records used to hydrate `auth.user`.
+        static AuthUserCache& userCache();
     };
 } // mb
 
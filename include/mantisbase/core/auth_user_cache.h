@@ -0,0 +1,97 @@
+/**
+ * @file auth_user_cache.h
+ * @brief Short-lived cache of authenticated user records.
+ *
+ * Backs `auth.user` hydration so authenticated requests don't each pay a
+ * `SELECT *` on the users table.
+ */
+
+#ifndef MANTISBASE_AUTH_USER_CACHE_H
+#define MANTISBASE_AUTH_USER_CACHE_H
+
+#include <array>
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <nlohmann/json.hpp>
+
+namespace mb {
+    /**
+     * @brief Bounded, sharded cache of user records keyed by (entity, id).
+     *
+     * Entries expire after a short TTL and are dropped early when the
+     * realtime change stream reports an UPDATE or DELETE on the row (see
+     * onChanges()). Cached records never contain the `password` field.
+     *
+     * @code
+     * auto &cache = Auth::userCache();
+     * auto user = cache.get("users", id);
+     * if (!user) {
+     *     user = entity.read(id);
+     *     if (user) cache.put("users", id, *user);
+     * }
+     * @endcode
+     */
+    class AuthUserCache {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        /**
+         * @param capacity Maximum number of cached users across all shards
+         * @param ttl Lifetime of a cached record
+         */
+        explicit AuthUserCache(std::size_t capacity = 20000,
+                               std::chrono::seconds ttl = std::chrono::seconds(15));
+
+        /// @brief Cached record for `user_id` in `entity`, if present and fresh.
+        [[nodiscard]] std::optional<nlohmann::json> get(const std::string &entity, const std::string &user_id);
+
+        /// @brief Cache `user` (its `password` field is stripped).
+        void put(const std::string &entity, const std::string &user_id, nlohmann::json user);
+
+        /// @brief Drop a single cached record.
+        void invalidate(const std::string &entity, const std::string &user_id);
+
+        /// @brief Drop all cached records of `entity` (e.g. after a schema change).
+        void invalidateEntity(const std::string &entity);
+
+        /// @brief Drop all entries.
+        void clear();
+
+        /**
+         * @brief Apply a batch of realtime change events.
+         *
+         * Each event carries `type`, `entity` and `row_id`; UPDATE and DELETE
+         * events evict the matching record.
+         * @param events JSON array of change events, as passed to an RtCallback
+         */
+        void onChanges(const nlohmann::json &events);
+
+        /// @brief Number of cached entries, including not yet purged expired ones.
+        [[nodiscard]] std::size_t size() const;
+
+    private:
+        static constexpr std::size_t SHARD_COUNT = 16;
+
+        struct Entry {
+            nlohmann::json user;
+            Clock::time_point expiresAt;
+        };
+
+        struct Shard {
+            mutable std::mutex mutex;
+            std::unordered_map<std::string, Entry> entries;
+        };
+
+        static std::string key(const std::string &entity, const std::string &user_id);
+        Shard &shardFor(const std::string &key);
+
+        std::size_t m_shardCapacity;
+        std::chrono::seconds m_ttl;
+        std::array<Shard, SHARD_COUNT> m_shards;
+    };
+}
+
+#endif // MANTISBASE_AUTH_USER_CACHE_H
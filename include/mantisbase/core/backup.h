@@ -0,0 +1,118 @@
+/**
+ * @file backup.h
+ * @brief Online, consistent backups of the SQLite databases and the files directory.
+ *
+ * Copies `mantis.db` and `mantis_logs.db` with the SQLite online backup API
+ * while the server keeps serving. The copy is taken from one read
+ * transaction, so it is a single consistent snapshot even under WAL writes,
+ * and it is made a bounded number of pages at a time with a pause between
+ * steps so writers and checkpoints are not starved. Optionally snapshots
+ * `files/`, hard-linking files unchanged since the previous snapshot.
+ * Used by `mantisbase backup` and `POST /api/v1/sys/backup`.
+ */
+
+#ifndef MANTISBASE_BACKUP_H
+#define MANTISBASE_BACKUP_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+#include <nlohmann/json.hpp>
+
+namespace mb {
+    using json = nlohmann::json;
+
+    /**
+     * @brief Writes backups into `<root>/<UTC timestamp>/`.
+     *
+     * The static functions do the work on the calling thread (the CLI);
+     * an instance runs one backup at a time on its own thread (the endpoint).
+     *
+     * @code
+     * const auto summary = Backup::run(app.dataDir(), Backup::rootFromEnv(app.dataDir()), true,
+     *                                  Backup::Options::fromEnv());
+     * @endcode
+     */
+    class Backup {
+    public:
+        struct Options {
+            int pagesPerStep = 256;              ///> Pages copied by one sqlite3_backup_step()
+            std::chrono::milliseconds pause{10}; ///> Sleep between steps, and after a busy step
+
+            /// @brief Read MB_BACKUP_PAGES and MB_BACKUP_PAUSE_MS.
+            static Options fromEnv();
+        };
+
+        struct FileStats {
+            std::uint64_t copied = 0; ///> Files new or changed since the previous snapshot
+            std::uint64_t linked = 0; ///> Files hard-linked to the previous snapshot
+            std::uint64_t bytes = 0;  ///> Bytes copied
+        };
+
+        /// @brief What a copy holds, read in the transaction it was copied from.
+        struct SnapshotInfo {
+            long long schemaVersion = 0; ///> `PRAGMA schema_version`
+            long long changeId = 0;      ///> Newest `mb_change_log` id, 0 if none yet
+        };
+
+        /// @brief MB_BACKUP_DIR, or `<data_dir>/backups`.
+        [[nodiscard]] static std::filesystem::path rootFromEnv(const std::string &data_dir);
+
+        /**
+         * @brief Copy the SQLite database `src` to `dest`, `pagesPerStep` pages at
+         * a time. Written to `<dest>.part` and renamed once complete.
+         * @param info If set, filled in with what the copy holds (see Replication)
+         * @return Pages copied
+         * @throws MantisException when either file cannot be opened, a step
+         * fails, or `cancel` is set.
+         */
+        static int copyDatabase(const std::filesystem::path &src, const std::filesystem::path &dest,
+                                const Options &options, const std::atomic<bool> *cancel = nullptr,
+                                SnapshotInfo *info = nullptr);
+
+        /**
+         * @brief Copy the tree under `src` to `dest`. A file whose size and
+         * modification time match its copy under `previous` is hard-linked to
+         * it instead. Top-level dot directories (upload staging) are skipped.
+         */
+        static FileStats snapshotFiles(const std::filesystem::path &src, const std::filesystem::path &dest,
+                                       const std::filesystem::path &previous = {});
+
+        /**
+         * @brief Back up `data_dir` into a new `<root>/<UTC timestamp>/`.
+         * @param files Also snapshot `<data_dir>/files`, against the newest earlier snapshot
+         * @return Summary: `path`, per database `pages`, `files` stats and `ms`
+         */
+        static json run(const std::filesystem::path &data_dir, const std::filesystem::path &root, bool files,
+                        const Options &options, const std::atomic<bool> *cancel = nullptr);
+
+        Backup(std::filesystem::path data_dir, std::filesystem::path root, Options options);
+        ~Backup();
+
+        Backup(const Backup &) = delete;
+        Backup &operator=(const Backup &) = delete;
+
+        /// @brief Start a backup on the background thread; false if one is already running.
+        bool start(bool files);
+
+        /// @brief `running`, plus the summary or `error` of the last backup, if any.
+        [[nodiscard]] json status() const;
+
+    private:
+        const std::filesystem::path m_dataDir;
+        const std::filesystem::path m_root;
+        const Options m_options;
+
+        mutable std::mutex m_mutex;
+        bool m_running = false; ///> Guarded by m_mutex
+        json m_last;            ///> Guarded by m_mutex
+        std::atomic<bool> m_cancel{false};
+        std::thread m_thread;
+    };
+}
+
+#endif // MANTISBASE_BACKUP_H
@@ -0,0 +1,111 @@
+/**
+ * @file blob_store.h
+ * @brief Content-addressed storage behind entity files.
+ *
+ * Each distinct upload is stored once, in the configured StorageBackend.
+ * Locally that is `<files>/.blobs/<aa>/<sha256>`, and the file an entity
+ * record names, `<files>/<entity>/<filename>`, is a hard link to the blob,
+ * so serving, renaming and the `file`/`files` field values are unchanged.
+ * `mb_file_refs` maps each entity file to its hash and `mb_file_blobs`
+ * counts the references to every blob.
+ * @see Files, Storage
+ */
+
+#ifndef MANTISBASE_BLOB_STORE_H
+#define MANTISBASE_BLOB_STORE_H
+
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <string>
+
+namespace mb {
+    /**
+     * @brief Deduplicated, reference-counted file blobs.
+     *
+     * Reference counts change in the same transaction as the mapping rows,
+     * and a blob is only removed once its count reaches zero, so deleting
+     * one record's file never removes data another record still points at.
+     * With local storage, entity files are hard links, which keeps their
+     * data readable even while the blob itself is being dropped. Where hard
+     * links aren't available the blob is copied instead, which loses the
+     * dedup but not correctness. With a remote backend there is no entity
+     * file; downloads are redirected to the blob.
+     *
+     * Files stored before the blob store (not in `mb_file_refs`) keep
+     * working; release() just reports them as untracked.
+     *
+     * @code
+     * BlobStore::put("posts", "abc_photo.png", staged_path, sha256);
+     * BlobStore::link("posts", "abc_photo.png", "drafts", "def_photo.png"); // no data copied
+     * BlobStore::release("posts", "abc_photo.png");
+     * @endcode
+     */
+    class BlobStore {
+    public:
+        /// @brief Directory holding local blobs, `<files>/.blobs`.
+        static std::filesystem::path blobsDir();
+
+        /// @brief Path of the blob for `sha256`, whether or not it exists.
+        static std::filesystem::path blobPath(const std::string &sha256);
+
+        /**
+         * @brief Store a staged upload as `entity/filename`.
+         *
+         * Moves the staged file into the store if the content is new, or
+         * drops it in favour of the existing blob, then links the entity
+         * file to the blob and takes a reference.
+         *
+         * @param entity_name Entity/table name
+         * @param filename File name within the entity directory
+         * @param staged_path File holding the content; consumed on success
+         * @param sha256 Hex digest of the content
+         * @param content_type Content-Type to store with a new blob, for backends that keep one
+         * @throws MantisException (500) if the file can't be placed or recorded, (502) if the backend failed
+         */
+        static void put(const std::string &entity_name, const std::string &filename,
+                        const std::filesystem::path &staged_path, const std::string &sha256,
+                        const std::string &content_type = "");
+
+        /**
+         * @brief Give `to_entity/to_filename` the content of `from_entity/from_filename` without copying it.
+         * @throws MantisException (404) if the source isn't in the store
+         */
+        static void link(const std::string &from_entity, const std::string &from_filename,
+                         const std::string &to_entity, const std::string &to_filename);
+
+        /**
+         * @brief Drop the reference held by `entity/filename`, deleting the blob once unreferenced.
+         *
+         * Does not remove the entity file itself; Files::removeFile() does.
+         *
+         * @return The blob's hash, or std::nullopt if the file isn't tracked
+         */
+        static std::optional<std::string> release(const std::string &entity_name, const std::string &filename);
+
+        /**
+         * @brief Remove a blob from the backend if nothing references it (any more).
+         *
+         * What Storage runs for each scheduled removal. Re-checks the count
+         * under the same lock put() takes, so a concurrent upload of the same
+         * content keeps its blob.
+         *
+         * @return false if the backend failed and the removal should be retried
+         */
+        static bool dropIfUnreferenced(const std::string &sha256);
+
+        /// @brief Drop every reference held by an entity's files, for Files::deleteDir().
+        static void releaseEntity(const std::string &entity_name);
+
+        /// @brief Point an entity's references at its new name, for Files::renameDir().
+        static void renameEntity(const std::string &old_entity_name, const std::string &new_entity_name);
+
+        /// @brief Hash stored for `entity/filename`, or std::nullopt if untracked.
+        static std::optional<std::string> hashOf(const std::string &entity_name, const std::string &filename);
+
+        /// @brief Current reference count of a blob, 0 if unknown.
+        static std::size_t refCount(const std::string &sha256);
+    };
+}
+
+#endif // MANTISBASE_BLOB_STORE_H
@@ -0,0 +1,123 @@
+/**
+ * @file cache_budget.h
+ * @brief One byte budget shared by the record and response caches of the whole process.
+ *
+ * Each cache has a cap of its own, and with MB_TENANTS every open tenant
+ * brings its own entity cache, so the caps add up with the tenants. With
+ * MB_CACHE_BUDGET_MB set, the entity caches of the application and of every
+ * tenant, and the response cache, also draw on one process-wide budget.
+ * A put that takes the total past it sheds from whichever cache holds the
+ * most, least recently used entries first, so a hot tenant can take room
+ * back from idle ones. Off (0) by default: each cache is held to its own cap only.
+ */
+
+#ifndef MANTISBASE_CACHE_BUDGET_H
+#define MANTISBASE_CACHE_BUDGET_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mb {
+    class MetricsWriter;
+
+    /**
+     * @brief Sums the bytes of the caches joined to it, and makes the largest shed past its limit.
+     *
+     * Thread-safe. A cache joins once and holds its Account while it lives;
+     * it charges and releases bytes as entries come and go, from under its
+     * own lock, and calls enforce() once that lock is released.
+     *
+     * @code
+     * m_account = budget.join("records", [this](std::size_t bytes) { return shed(bytes); });
+     * {
+     *     std::lock_guard lock(m_mutex);
+     *     insert(entry);
+     *     m_account->charge(entry.bytes);
+     * }
+     * budget.enforce();
+     * @endcode
+     */
+    class CacheBudget {
+    public:
+        struct Options {
+            std::size_t maxBytes = 0; ///> MB_CACHE_BUDGET_MB; 0 leaves the caches to their own caps
+
+            /// @brief Read MB_CACHE_BUDGET_MB.
+            static Options fromEnv();
+        };
+
+        /// Evict about `bytes` of the cache's least recently used entries; the bytes freed
+        using Shed = std::function<std::size_t(std::size_t bytes)>;
+
+        /// One cache's share of the budget
+        class Account {
+        public:
+            Account(CacheBudget &budget, std::string kind, Shed shed);
+
+            Account(const Account &) = delete;
+            Account &operator=(const Account &) = delete;
+
+            void charge(std::size_t bytes);
+            void release(std::size_t bytes);
+
+            [[nodiscard]] std::size_t bytes() const { return m_bytes.load(std::memory_order_relaxed); }
+            [[nodiscard]] const std::string &kind() const { return m_kind; }
+
+        private:
+            friend class CacheBudget;
+
+            CacheBudget &m_budget;
+            const std::string m_kind; ///> `records`, `responses`: the label of its metrics
+            const Shed m_shed;
+            std::atomic<std::size_t> m_bytes{0};
+        };
+
+        explicit CacheBudget(Options options);
+
+        CacheBudget(const CacheBudget &) = delete;
+        CacheBudget &operator=(const CacheBudget &) = delete;
+
+        /// @brief The budget of the process, from Options::fromEnv().
+        static CacheBudget &shared();
+
+        [[nodiscard]] bool enabled() const { return m_options.maxBytes > 0; }
+        [[nodiscard]] std::size_t maxBytes() const { return m_options.maxBytes; }
+
+        /// @brief The budget to hand a cache's Options: shared() if enabled, else nullptr.
+        static CacheBudget *fromEnv();
+
+        /// @brief Register a cache; pass the account to leave() before the cache goes.
+        std::shared_ptr<Account> join(std::string kind, Shed shed);
+
+        /// @brief Unregister `account`, giving its bytes back. No shed runs on it once this returns.
+        void leave(const std::shared_ptr<Account> &account);
+
+        /**
+         * @brief While over the limit, shed from the account holding the most.
+         * Called without any cache lock held; a call finding another one at it returns.
+         */
+        void enforce();
+
+        [[nodiscard]] std::size_t bytes() const { return m_bytes.load(std::memory_order_relaxed); }
+        [[nodiscard]] std::uint64_t shedBytes() const { return m_shed.load(std::memory_order_relaxed); }
+
+        /// @brief `mb_cache_budget_bytes` per cache kind, `mb_cache_budget_limit_bytes` and `mb_cache_budget_shed_bytes_total`.
+        void writeMetrics(MetricsWriter &out) const;
+
+    private:
+        const Options m_options;
+        std::atomic<std::size_t> m_bytes{0};
+        std::atomic<std::uint64_t> m_shed{0};
+
+        mutable std::mutex m_mutex; ///> Held while shedding, so leave() waits for a shed in progress
+        std::vector<std::shared_ptr<Account>> m_accounts; ///> Guarded by m_mutex
+    };
+}
+
+#endif // MANTISBASE_CACHE_BUDGET_H
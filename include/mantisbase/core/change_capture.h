@@ -0,0 +1,116 @@
+/**
+ * @file change_capture.h
+ * @brief Change capture only for the entities someone is following.
+ *
+ * Every write to an entity runs its change trigger, which serializes the row
+ * (twice, for an update) into `mb_change_log`. With MB_RT_CAPTURE=lazy the
+ * triggers first look for a lease in `mb_rt_capture` and do nothing without
+ * one. A node leases an entity while it has a reason to hear its changes:
+ * a realtime topic with subscribers, a cache or view that pins it, or, for
+ * every entity (`*`), replication, delta sync and script record hooks. The
+ * lease is renewed while held and runs out MB_RT_CAPTURE_GRACE_S after the
+ * last holder let go, so subscribers that come and go don't flap it.
+ * @see realtime.h
+ */
+
+#ifndef MANTISBASE_CHANGE_CAPTURE_H
+#define MANTISBASE_CHANGE_CAPTURE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace soci {
+    class session;
+}
+
+namespace mb {
+    /**
+     * @brief Counts the holders of each entity and keeps their leases renewed, on its own thread.
+     *
+     * Thread-safe and non-blocking for holders: hold() only counts and wakes
+     * the thread, which writes the leases through the injected `renew`. A
+     * change committed between an entity's first hold() and its lease landing
+     * is not captured; on SQLite the change journal still delivers CRUD writes.
+     *
+     * @code
+     * ChangeCapture capture([&](const auto &entities, auto ttl) {
+     *     db.write([&](soci::session &sql) { ChangeCapture::lease(sql, node, entities, ttl); });
+     * }, ChangeCapture::Options::current());
+     * capture.start();
+     * capture.hold("posts", true);
+     * @endcode
+     */
+    class ChangeCapture {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        /// Writes leases for `entities`, good for `ttl` on the database clock
+        using Renew = std::function<void(const std::vector<std::string> &entities, std::chrono::seconds ttl)>;
+
+        struct Options {
+            bool lazy = false;               ///> Gate the triggers on leases; off captures everything
+            std::chrono::seconds grace{60};   ///> How long a lease outlives its last holder
+
+            /// @brief Read MB_RT_CAPTURE (`always` or `lazy`) and MB_RT_CAPTURE_GRACE_S.
+            static Options fromEnv();
+
+            /// @brief fromEnv(), read once; trigger DDL depends on it.
+            static const Options &current();
+        };
+
+        ChangeCapture(Renew renew, Options options);
+        ~ChangeCapture();
+
+        ChangeCapture(const ChangeCapture &) = delete;
+        ChangeCapture &operator=(const ChangeCapture &) = delete;
+
+        void start();
+
+        /// @brief Stop the thread. Idempotent; leases run out by themselves.
+        void stop();
+
+        /**
+         * @brief Take (or, with `on` false, drop) one hold on `entity`; `*` is every entity.
+         * The first hold on an entity has its lease written at once.
+         */
+        void hold(const std::string &entity, bool on);
+
+        /// @brief Whether this node may still have a lease on `entity` (or `*`) out.
+        [[nodiscard]] bool captured(const std::string &entity, Clock::time_point now = Clock::now()) const;
+
+        /// @brief Renew the leases due, once. Called by the thread; public for tests.
+        void tick(Clock::time_point now = Clock::now());
+
+        /// @brief Create `mb_rt_capture`, if missing.
+        static void createTable(soci::session &sql);
+
+        /// @brief Upsert this node's leases on `entities`, good for `ttl`, and drop lapsed ones.
+        static void lease(soci::session &sql, const std::string &node, const std::vector<std::string> &entities,
+                          std::chrono::seconds ttl);
+
+        /// @brief SQL true while `entity` (as logged) is leased; for SQLite trigger `WHEN` clauses.
+        [[nodiscard]] static std::string sqliteCondition(const std::string &entity);
+
+    private:
+        void loop();
+
+        Renew m_renew;
+        const Options m_options;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_cv;
+        std::unordered_map<std::string, int> m_holds;                  ///> Entity -> open holds
+        std::unordered_map<std::string, Clock::time_point> m_leases;   ///> Entity -> when our lease lapses
+        bool m_wake = false;                                           ///> A first hold wants its lease now
+        bool m_stopping = false;
+        std::thread m_thread;
+    };
+}
+
+#endif // MANTISBASE_CHANGE_CAPTURE_H
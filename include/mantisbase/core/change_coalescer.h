@@ -0,0 +1,86 @@
+/**
+ * @file change_coalescer.h
+ * @brief Merges bursts of changes to the same row before they are broadcast.
+ *
+ * A bulk import that updates one row a thousand times would otherwise reach
+ * every subscriber as a thousand events. With a coalescing window
+ * (MB_REALTIME_COALESCE_MS), SSEMgr holds each `entity:row_id` for that long
+ * after its first change and broadcasts only the latest state.
+ * @see sse.h, realtime.h
+ */
+
+#ifndef MANTISBASE_CHANGE_COALESCER_H
+#define MANTISBASE_CHANGE_COALESCER_H
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace mb {
+    using json = nlohmann::json;
+
+    /**
+     * @brief Per-row coalescing of change events over a fixed window.
+     *
+     * The window starts at a row's first pending change, so a row that keeps
+     * changing is still delivered every `window`. Merging keeps the meaning of
+     * the sequence:
+     * - INSERT then UPDATEs  -> INSERT with the latest row
+     * - UPDATEs              -> UPDATE with the latest row (first `old_data`)
+     * - INSERT/UPDATE then DELETE -> DELETE (an INSERT+DELETE pair is dropped)
+     * - DELETE then INSERT   -> not merged; the DELETE is released at once
+     *
+     * Not thread-safe; SSEMgr guards it.
+     */
+    class ChangeCoalescer {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        /// @param window Hold time per row; zero disables coalescing
+        explicit ChangeCoalescer(std::chrono::milliseconds window = std::chrono::milliseconds(0));
+
+        /// @brief Window from MB_REALTIME_COALESCE_MS (0 when unset).
+        static std::chrono::milliseconds windowFromEnv();
+
+        [[nodiscard]] bool enabled() const { return m_window.count() > 0; }
+
+        [[nodiscard]] std::chrono::milliseconds window() const { return m_window; }
+
+        /// @brief Hold `change` (an object with `type`, `entity`, `row_id`, ...) until its row's window ends.
+        void add(json change, Clock::time_point now = Clock::now());
+
+        /// @brief Changes due for delivery at `now`, oldest first.
+        std::vector<json> drain(Clock::time_point now = Clock::now());
+
+        /// @brief Every pending change, regardless of its window.
+        std::vector<json> flush();
+
+        /// @brief When the next pending change falls due; std::nullopt if none is pending.
+        [[nodiscard]] std::optional<Clock::time_point> nextDeadline() const;
+
+        [[nodiscard]] std::size_t pending() const { return m_ready.size() + m_order.size(); }
+
+        /// @brief Changes absorbed into a pending one so far.
+        [[nodiscard]] std::uint64_t merged() const { return m_merged; }
+
+    private:
+        struct Pending {
+            std::string key;
+            json change;
+            Clock::time_point due;
+        };
+
+        std::chrono::milliseconds m_window;
+        std::list<Pending> m_order;    ///> Held changes in due order
+        std::unordered_map<std::string, std::list<Pending>::iterator> m_byKey;
+        std::vector<json> m_ready;     ///> Released early, delivered on the next drain
+        std::uint64_t m_merged = 0;
+    };
+}
+
+#endif // MANTISBASE_CHANGE_COALESCER_H
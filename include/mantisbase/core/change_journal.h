@@ -0,0 +1,106 @@
+/**
+ * @file change_journal.h
+ * @brief In-process journal of changes made through the CRUD layer.
+ *
+ * Entity::create/update/remove already hold the written row as JSON, so
+ * they publish it here and the realtime worker delivers it without reading
+ * `mb_change_log` back and re-parsing `old_data`/`new_data`. The trigger
+ * path still records every write (it must, for writes from other processes
+ * and FK cascades); ChangeDeduplicator drops the copy that arrives second.
+ * @see realtime.h
+ */
+
+#ifndef MANTISBASE_CHANGE_JOURNAL_H
+#define MANTISBASE_CHANGE_JOURNAL_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <nlohmann/json.hpp>
+
+namespace mb {
+    using json = nlohmann::json;
+
+    /**
+     * @brief Bounded lock-free multi-producer ring buffer of change events.
+     *
+     * Any request thread may publish(); the realtime worker is the consumer.
+     * When the ring is full publish() fails and the change is delivered from
+     * the trigger path instead, so nothing is lost.
+     */
+    class ChangeJournal {
+    public:
+        /// @param capacity Slot count, rounded up to a power of two
+        explicit ChangeJournal(std::size_t capacity = 4096);
+
+        ChangeJournal(const ChangeJournal &) = delete;
+        ChangeJournal &operator=(const ChangeJournal &) = delete;
+
+        /// @brief Append an event; false if the ring is full.
+        bool publish(json event);
+
+        /// @brief Take the oldest event; false if the ring is empty.
+        bool consume(json &event);
+
+        [[nodiscard]] std::size_t capacity() const { return m_mask + 1; }
+
+        /**
+         * @brief Build a change event in the shape emitted by the trigger path.
+         * @param type INSERT, UPDATE or DELETE
+         * @param old_data Previous row, or null
+         * @param new_data Written row, or null
+         */
+        static json makeEvent(const std::string &type, const std::string &entity, const std::string &row_id,
+                              json old_data, json new_data);
+
+    private:
+        struct Cell {
+            std::atomic<std::size_t> sequence;
+            json event;
+        };
+
+        std::size_t m_mask;
+        std::unique_ptr<Cell[]> m_cells;
+        alignas(64) std::atomic<std::size_t> m_head{0}; ///> Next slot to publish into
+        alignas(64) std::atomic<std::size_t> m_tail{0}; ///> Next slot to consume from
+    };
+
+    /**
+     * @brief Drops the second copy of a change seen on both the journal and the trigger path.
+     *
+     * Keys are `type`, `entity`, `row_id`. Whichever copy arrives first is
+     * delivered; a matching copy from the other source is then skipped.
+     * Unmatched entries (writes from other processes, full journal) expire
+     * after `ttl`. Not thread-safe; owned by the realtime worker thread.
+     */
+    class ChangeDeduplicator {
+    public:
+        using Clock = std::chrono::steady_clock;
+        enum class Source { Journal, Log };
+
+        explicit ChangeDeduplicator(std::chrono::seconds ttl = std::chrono::seconds(30));
+
+        /// @brief True if this copy should be delivered, false if it duplicates one already delivered.
+        bool accept(Source source, const std::string &type, const std::string &entity, const std::string &row_id);
+
+        /// @brief Drop expired entries.
+        void purge();
+
+        [[nodiscard]] std::size_t size() const { return m_pending.size(); }
+
+    private:
+        struct Pending {
+            int journal = 0;             ///> Delivered from the journal, log copy still expected
+            int log = 0;                 ///> Delivered from the log, journal copy may still come
+            Clock::time_point touched;
+        };
+
+        std::chrono::seconds m_ttl;
+        std::unordered_map<std::string, Pending> m_pending;
+    };
+}
+
+#endif // MANTISBASE_CHANGE_JOURNAL_H
@@ -0,0 +1,178 @@
+/**
+ * @file channels.h
+ * @brief Ephemeral realtime channels: client messages and presence that never touch a table.
+ *
+ * A channel topic is `@<name>`, e.g. `@room:42`, subscribed to over SSE or
+ * WebSocket like any entity topic. Clients publish to it (WS `publish`
+ * message or POST /api/v1/realtime/publish) and every subscriber gets the
+ * message from memory. With `MB_SHARED_STATE=db` on PostgreSQL, messages
+ * reach the other nodes over a NOTIFY channel, like session revocations.
+ *
+ * Channels are declared with rules: `MB_REALTIME_CHANNELS` for the
+ * `public`/`auth`/`admin` modes, or define() for custom expressions, which
+ * see the channel name as `record.channel`. Channels named `mb:...` are
+ * the server's own: admins subscribe to them, and only the server sends
+ * on them (announce()), e.g. `@mb:schemas` after every schema change.
+ * `@mb:settings` is the one anyone may subscribe to.
+ * @see sse.h, ws.h, shared_state.h
+ */
+
+#ifndef MANTISBASE_CHANNELS_H
+#define MANTISBASE_CHANNELS_H
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "models/access_rules.h"
+
+namespace mb {
+    using json = nlohmann::json;
+    class EncodedEvent;
+    struct RealtimeAuth;
+
+    /**
+     * @brief Channel rules, presence and fan-out of ephemeral messages.
+     *
+     * Delivery to subscribers goes through the sink SSEMgr installs; presence
+     * calls (joined() / left()) must be made outside the managers' locks,
+     * since they deliver `presence` frames right away.
+     *
+     * @code
+     * Channels::instance().define("room:*", {AccessRule("auth"), AccessRule("auth"), true});
+     * Channels::instance().publish("room:42", {{"x", 10}}, who);
+     * @endcode
+     */
+    class Channels {
+    public:
+        static constexpr char PREFIX = '@';
+
+        /// NOTIFY channel messages and presence changes are passed to the other nodes on
+        static constexpr std::string_view NOTIFY_CHANNEL = "mb_channels";
+
+        /// Names of the server's own channels start with this
+        static constexpr std::string_view SYSTEM_PREFIX = "mb:";
+        /// `schema_changed` with the schema listing's new `version` and the `entities` changed
+        static constexpr std::string_view SCHEMAS = "mb:schemas";
+        /// `settings_changed` with the new `etag` of the public settings, see KeyValStore::Snapshot
+        static constexpr std::string_view SETTINGS = "mb:settings";
+
+        struct Rules {
+            AccessRule subscribe{"auth"}; ///> Also checked for listing members
+            AccessRule publish{"auth"};
+            bool presence = false;        ///> Send `join` / `leave` and keep a member list
+        };
+
+        /// Delivers a frame to the local subscribers of a `@<name>` topic.
+        using Sink = std::function<void(const std::string &topic, const std::shared_ptr<const EncodedEvent> &event)>;
+        /// Hands a notification to the other nodes; empty to stay on this node.
+        using Forward = std::function<void(const std::string &notification)>;
+
+        Channels();
+
+        static Channels &instance();
+
+        /// @brief Whether `topic` is a channel topic, valid or not.
+        static bool isChannel(std::string_view topic) { return !topic.empty() && topic.front() == PREFIX; }
+
+        /// @brief The channel of `@<name>`; std::nullopt for other topics and malformed names.
+        static std::optional<std::string> nameOf(std::string_view topic);
+
+        static std::string topicOf(std::string_view name);
+
+        /**
+         * @brief Declare channels; `pattern` is a name, or a prefix ending in `*`.
+         *
+         * An exact name wins over prefixes, and the longest prefix over shorter ones.
+         */
+        void define(const std::string &pattern, Rules rules);
+
+        /**
+         * @brief Read MB_REALTIME_CHANNELS: `<pattern>=<subscribe>[/<publish>][+presence]`
+         * entries, comma-separated, each mode `public`, `auth` or `admin`.
+         */
+        void loadEnv();
+
+        /// @brief Rules of channel `name`; null if no pattern declares it.
+        [[nodiscard]] std::shared_ptr<const Rules> rules(std::string_view name) const;
+
+        [[nodiscard]] bool canSubscribe(const std::string &name, const RealtimeAuth &who) const;
+
+        /**
+         * @brief Deliver `data` to the channel's subscribers, here and on the other nodes.
+         * @throws MantisException 404 for an undeclared channel, 403 if `who`
+         *         may not publish or it is a system channel, 413 past MB_REALTIME_CHANNEL_MAX_BYTES
+         */
+        void publish(const std::string &name, const json &data, const RealtimeAuth &who);
+
+        /**
+         * @brief Deliver a server event to the local subscribers of system channel `name`.
+         *
+         * `payload` gains `topic` and `channel`; its `type` names the event. Each
+         * node announces its own changes, so nothing is forwarded.
+         */
+        void announce(std::string_view name, json payload);
+
+        /// @brief Local connection `connection` subscribed to `name` as `who`.
+        void joined(const std::string &name, const RealtimeAuth &who, const std::string &connection);
+
+        void left(const std::string &name, const RealtimeAuth &who, const std::string &connection);
+
+        /// @brief Members present on channel `name`, on this node or announced by others.
+        [[nodiscard]] json members(const std::string &name) const;
+
+        /// @brief A notification another node forwarded; its own are ignored.
+        void receive(std::string_view notification);
+
+        void setSink(Sink sink);
+
+        void setForward(Forward forward);
+
+        /// @brief This node's id in forwarded notifications (MB_NODE_ID, or random).
+        [[nodiscard]] const std::string &node() const { return m_node; }
+
+        /// @brief Largest `data` publish() takes, dumped (MB_REALTIME_CHANNEL_MAX_BYTES, default 4096).
+        [[nodiscard]] std::size_t maxBytes() const { return m_maxBytes; }
+
+        /// @brief Drop every declaration and member; for tests.
+        void reset();
+
+    private:
+        struct Member {
+            json info;
+            std::set<std::string> connections; ///> Local subscribers as this member
+            std::set<std::string> nodes;       ///> Other nodes that announced it
+        };
+
+        static std::string memberKey(const RealtimeAuth &who, const std::string &connection);
+        static json memberInfo(const RealtimeAuth &who, const std::string &key);
+
+        /// This node's first connection as `member` joined, or its last one left; `visible` if that changed who is present
+        void presenceChanged(const std::string &name, const json &member, bool joined, bool visible);
+
+        /// To the local subscribers if `local`, to the other nodes if `forward`
+        void deliver(const std::string &name, json payload, std::string key, bool local, bool forward);
+
+        std::string m_node;
+        std::size_t m_maxBytes = 4096;
+
+        mutable std::mutex m_rulesMutex;
+        std::unordered_map<std::string, std::shared_ptr<const Rules>> m_exact, m_prefixes;
+
+        mutable std::mutex m_membersMutex;
+        std::unordered_map<std::string, std::unordered_map<std::string, Member>> m_members; ///> name -> key -> member
+
+        mutable std::mutex m_sinkMutex;
+        Sink m_sink;
+        Forward m_forward;
+    };
+}
+
+#endif // MANTISBASE_CHANNELS_H
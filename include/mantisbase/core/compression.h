@@ -0,0 +1,74 @@
+/**
+ * @file compression.h
+ * @brief Negotiated response compression: zstd, brotli and gzip.
+ *
+ * API responses are compressed after the middleware chain, on the thread
+ * that ran the route, before they go back to the IO loop. gzip is always
+ * available; brotli and zstd when their libraries were found at configure
+ * time. Routes that must not be compressed register noCompression().
+ * @see Router
+ */
+
+#ifndef MANTISBASE_COMPRESSION_H
+#define MANTISBASE_COMPRESSION_H
+
+#include <array>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace mb {
+    /**
+     * @brief Content-coding negotiation and encoders.
+     *
+     * @code
+     * const auto enc = Compression::negotiate(req.getHeaderValue("Accept-Encoding"));
+     * if (enc != Compression::Encoding::Identity && Compression::isCompressible("application/json"))
+     *     body = Compression::compress(enc, body);
+     * @endcode
+     */
+    class Compression {
+    public:
+        enum class Encoding { Identity, Gzip, Brotli, Zstd };
+
+        /// Server preference when the client weighs several the same, best first
+        static constexpr std::array<Encoding, 3> PREFERENCE{Encoding::Zstd, Encoding::Brotli, Encoding::Gzip};
+
+        struct Options {
+            bool enabled = true;
+            std::size_t minSize = 1024;   ///> Smaller bodies aren't worth the CPU or the headers
+
+            /// @brief Read MB_COMPRESSION (`0` turns it off) and MB_COMPRESSION_MIN_SIZE (bytes).
+            static Options fromEnv();
+        };
+
+        /// @brief Whether this build has an encoder for `encoding`.
+        static bool available(Encoding encoding);
+
+        /// @brief The `Content-Encoding` token, e.g. `br`; empty for identity.
+        static std::string_view token(Encoding encoding);
+
+        /// @brief File suffix of a precompressed asset, e.g. `.br`; empty for identity.
+        static std::string_view suffix(Encoding encoding);
+
+        /**
+         * @brief Pick the best available encoding an `Accept-Encoding` value allows.
+         *
+         * Highest q-value wins, ties go by PREFERENCE, `q=0` rules a coding
+         * out and `*` stands for any coding not named.
+         */
+        static Encoding negotiate(std::string_view accept_encoding);
+
+        /// @brief Whether a body of this Content-Type gains from compression (text, JSON, JS, SVG, ...).
+        static bool isCompressible(std::string_view content_type);
+
+        /**
+         * @brief Compress `data`.
+         * @param best Spend the time for the smallest output, for assets compressed once
+         * @return The encoded bytes, or empty if the encoder failed or isn't available
+         */
+        static std::string compress(Encoding encoding, std::string_view data, bool best = false);
+    };
+}
+
+#endif // MANTISBASE_COMPRESSION_H
@@ -0,0 +1,77 @@
+/**
+ * @file connection_warmup.h
+ * @brief Prepares the pooled connections' statements before the first requests.
+ *
+ * Every pooled connection has its own prepared statement cache, filled by
+ * the first request that runs a statement on it. After a restart the first
+ * reads of each entity pay for the prepares, and for reading their indexes
+ * from disk, on every connection in turn. With MB_DB_WARMUP=1 listen()
+ * runs each entity's point read and existence check on every open pooled
+ * connection, and counts each entity once. `GET /api/v1/health` answers
+ * `503` until it is done, so a load balancer sends traffic only once it is.
+ * @see Database::queryRowCached(), Entity::prepareStatements()
+ */
+
+#ifndef MANTISBASE_CONNECTION_WARMUP_H
+#define MANTISBASE_CONNECTION_WARMUP_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace mb {
+    class Entity;
+    class MantisBase;
+    class MetricsWriter;
+
+    /**
+     * @brief Warms the primary's connection pool on a thread of its own.
+     *
+     * Read replicas and server connections opened later, past the pool's
+     * minimum, fill their caches as they are used.
+     */
+    class ConnectionWarmup {
+    public:
+        struct Options {
+            bool enabled = false;
+            bool counts = true; ///> Also count each entity, filling the count cache and reading its id index
+
+            /// MB_DB_WARMUP (`1` to warm up), MB_DB_WARMUP_COUNTS (`0` skips the counts)
+            static Options fromEnv();
+        };
+
+        ConnectionWarmup(const MantisBase &app, Options options);
+        ~ConnectionWarmup();
+
+        ConnectionWarmup(const ConnectionWarmup &) = delete;
+        ConnectionWarmup &operator=(const ConnectionWarmup &) = delete;
+
+        /// @brief Warm up for `entities` in the background; not ready() until done. No-op if disabled or running.
+        void start(std::vector<std::shared_ptr<const Entity>> entities);
+
+        /// @brief Stop after the statement in progress and wait for it. Idempotent.
+        void stop();
+
+        [[nodiscard]] bool enabled() const { return m_options.enabled; }
+
+        /// @brief False from start() until the warmup is done or stopped; true when disabled.
+        [[nodiscard]] bool ready() const { return m_ready.load(std::memory_order_acquire); }
+
+        void writeMetrics(MetricsWriter &out) const;
+
+    private:
+        void run(const std::vector<std::shared_ptr<const Entity>> &entities);
+
+        const MantisBase &mApp;
+        const Options m_options;
+        std::thread m_thread;
+        std::atomic<bool> m_ready{true};
+        std::atomic<bool> m_stopping{false};
+        std::atomic<std::uint64_t> m_connections{0}, m_statements{0}, m_errors{0};
+        std::atomic<std::int64_t> m_durationMs{-1}; ///> -1 until it finished
+    };
+}
+
+#endif // MANTISBASE_CONNECTION_WARMUP_H
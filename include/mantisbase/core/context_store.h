@@ -5,6 +5,9 @@
 #ifndef MANTISAPP_CONTEXTSTORE_H
 #define MANTISAPP_CONTEXTSTORE_H
 
+#include <functional>
+#include <memory>
+#include <type_traits>
 #include <nlohmann/json.hpp>
 #include "../utils/utils.h"
 
@@ -17,6 +20,8 @@ namespace mb
     /// Shorten JSON namespace
     using json = nlohmann::json;
 
+    class Entity;
+
     /**
      * The `ContextStore` class provides a means to set/get a key-value data that can be shared uniquely between middlewares
      * and the handler functions. This allows sending data down the chain from the first to the last handler.
@@ -50,14 +55,69 @@ namespace mb
      *
      * Additionally, we have a @see get_or() method that takes in a key and a default value if the key is missing. This
      * unlike @see get() method, returns a `T&` instead of `T*` depending on the usage needs.
+     *
+     * State every request carries has a typed slot of its own instead of a map entry: the auth principal,
+     * its token verification and the resolved entity. Middlewares reach them through auth(), verification()
+     * and entity() by reference, so nothing is looked up, boxed or copied. The `auth` and `verification`
+     * keys still resolve to their slots, for scripts and for `getOr<json>("auth", ...)`.
+     *
+     * Resolving who is asking can wait: deferAuth() leaves a resolver that runs on the first read of
+     * either slot, so requests that never look (public rules, health checks) never pay for it.
+     * @code
+     * ctx.auth()["type"] = "user";
+     * ctx.getOr<json>("auth", json::object())["type"]; // "user", the same slot
+     * @endcode
      */
     class ContextStore
     {
         std::unordered_map<std::string, std::any> data;
         std::string __class_name__ = "mb::ContextStore";
 
+    public:
+        /// Fills in the auth principal and its verification; see deferAuth()
+        using AuthResolver = std::function<void(json& auth, json& verification)>;
+
+    private:
+        /// Null until set; holds no allocation until then. Mutable: a const read may run the resolver
+        mutable json m_auth;
+        mutable json m_verification;
+        mutable AuthResolver m_authResolver;
+        std::shared_ptr<const Entity> m_entity;
+
+        /// Run the pending resolver, if any, exactly once
+        void resolveAuth() const;
+
+        /// The typed slot behind `key`, if it has one
+        json* jsonSlot(const std::string& key);
+        const json* jsonSlot(const std::string& key) const;
+
+        static const json& emptyObject();
+
     public:
         ContextStore() = default;
+
+        /// @brief The auth principal (`type`, `token`, `id`, `entity`, `user`); an empty object until set.
+        json& auth();
+        [[nodiscard]] const json& auth() const;
+
+        /// @brief Outcome of verifying the auth token (`verified`, `claims`, `error`); an empty object until set.
+        json& verification();
+        [[nodiscard]] const json& verification() const;
+
+        /**
+         * @brief Resolve auth() and verification() with `resolve`, on the first read of either.
+         *
+         * Reads through the `auth`/`verification` keys count, as do scripts. `resolve` receives
+         * the slots as they are now and runs at most once.
+         */
+        void deferAuth(AuthResolver resolve);
+
+        /// @brief Whether a deferAuth() resolver is still waiting for its first read.
+        [[nodiscard]] bool authPending() const { return static_cast<bool>(m_authResolver); }
+
+        /// @brief The entity the route resolved, shared with the router's cache; null until set.
+        std::shared_ptr<const Entity>& entity() { return m_entity; }
+
         /**
          * @brief Convenience method for dumping context data for debugging.
          */
@@ -80,6 +140,14 @@ namespace mb
         template <typename T>
         void set(const std::string& key, T value)
         {
+            if constexpr (std::is_same_v<T, json>)
+            {
+                if (auto* slot = jsonSlot(key))
+                {
+                    *slot = std::move(value);
+                    return;
+                }
+            }
             data[key] = std::move(value);
         }
 
@@ -93,6 +161,11 @@ namespace mb
         template <typename T>
         std::optional<T*> get(const std::string& key)
         {
+            if constexpr (std::is_same_v<T, json>)
+            {
+                if (auto* slot = jsonSlot(key))
+                    return slot->is_null() ? std::nullopt : std::optional<T*>{slot};
+            }
             const auto it = data.find(key);
             if (it != data.end())
                 return std::any_cast<T>(&it->second);
@@ -111,6 +184,14 @@ namespace mb
         template <typename T>
         T& getOr(const std::string& key, T default_value)
         {
+            if constexpr (std::is_same_v<T, json>)
+            {
+                if (auto* slot = jsonSlot(key))
+                {
+                    if (slot->is_null()) *slot = std::move(default_value);
+                    return *slot;
+                }
+            }
             if (const auto it = data.find(key); it == data.end())
             {
                 data[key] = std::move(default_value);
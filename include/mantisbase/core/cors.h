@@ -0,0 +1,65 @@
+/**
+ * @file cors.h
+ * @brief Which origins may read the API's responses from a browser.
+ *
+ * Everything a CORS header holds is computed once, at startup; per request
+ * only the `Origin` is looked up. See Router::corsPreRoutingAdvice() and
+ * Router::corsPostHandlingAdvice().
+ */
+
+#ifndef MANTISBASE_CORS_H
+#define MANTISBASE_CORS_H
+
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace mb {
+    /**
+     * @brief An origin allowlist, or `*` for any origin.
+     *
+     * Thread-safe: read-only once built.
+     *
+     * @code
+     * const CorsPolicy cors(CorsPolicy::Options::fromEnv());
+     * if (const auto allow = cors.allowOrigin(req->getHeader("origin")); !allow.empty())
+     *     resp->addHeader("Access-Control-Allow-Origin", std::string(allow));
+     * @endcode
+     */
+    class CorsPolicy {
+    public:
+        static constexpr std::string_view allowMethods = "GET, POST, PUT, PATCH, DELETE, OPTIONS";
+        static constexpr std::string_view allowHeaders =
+                "Content-Type, Authorization, X-Requested-With, X-Server-Timing, traceparent, If-Match";
+
+        struct Options {
+            std::vector<std::string> origins{"*"}; ///> `scheme://host[:port]` each, or `*`
+            int maxAge = 86400;                    ///> Seconds a browser may reuse a preflight answer
+
+            /// @brief Read MB_CORS_ORIGINS (comma separated, default `*`) and MB_CORS_MAX_AGE.
+            static Options fromEnv();
+        };
+
+        explicit CorsPolicy(const Options &options);
+
+        /**
+         * @brief The `Access-Control-Allow-Origin` answering a request from `origin`:
+         * `*` when any origin may, `origin` itself when it is on the list, else empty.
+         */
+        [[nodiscard]] std::string_view allowOrigin(const std::string &origin) const;
+
+        /// @brief True for `*`; responses then don't vary by `Origin`.
+        [[nodiscard]] bool anyOrigin() const { return m_any; }
+
+        /// @brief `Access-Control-Max-Age`, formatted.
+        [[nodiscard]] const std::string &maxAge() const { return m_maxAge; }
+
+    private:
+        bool m_any = false;
+        std::unordered_set<std::string> m_origins; ///> Lowercased, without a trailing `/`
+        std::string m_maxAge;
+    };
+}
+
+#endif // MANTISBASE_CORS_H
@@ -0,0 +1,94 @@
+/**
+ * @file count_cache.h
+ * @brief Cached record counts per entity and filter.
+ *
+ * Backs list totals so a page request on a large table doesn't pay a full
+ * `COUNT` scan each time. See Entity::countRecords().
+ */
+
+#ifndef MANTISBASE_COUNT_CACHE_H
+#define MANTISBASE_COUNT_CACHE_H
+
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <nlohmann/json.hpp>
+
+namespace mb {
+    /**
+     * @brief Record counts keyed by (entity, filter), kept current from the change stream.
+     *
+     * Unfiltered totals follow INSERT and DELETE events (see onChanges()), so
+     * they stay valid between refreshes. A filtered count can't tell whether a
+     * changed row matches, so any change to the entity drops its filtered
+     * counts. Every entry is recounted at least once per TTL, which bounds the
+     * drift from writes that were in flight while it was counted.
+     *
+     * Thread-safe.
+     *
+     * @code
+     * auto &cache = Entity::countCache();
+     * auto total = cache.get("posts", filter);
+     * if (!total) {
+     *     total = runCount(filter);
+     *     cache.put("posts", filter, *total);
+     * }
+     * @endcode
+     */
+    class CountCache {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        /**
+         * @param ttl Lifetime of a cached count; zero disables the cache
+         * @param max_filters Filtered counts kept per entity
+         */
+        explicit CountCache(std::chrono::seconds ttl = std::chrono::seconds(60), std::size_t max_filters = 256);
+
+        /// @brief Cached count of `entity` rows matching `filter` (empty for all rows), if fresh.
+        [[nodiscard]] std::optional<long long> get(const std::string &entity, const std::string &filter = "",
+                                                   Clock::time_point now = Clock::now());
+
+        /// @brief Cache `count` rows of `entity` matching `filter`.
+        void put(const std::string &entity, const std::string &filter, long long count,
+                 Clock::time_point now = Clock::now());
+
+        /// @brief Drop all counts of `entity` (e.g. after a schema change).
+        void invalidateEntity(const std::string &entity);
+
+        /// @brief Drop all entries.
+        void clear();
+
+        /**
+         * @brief Apply a batch of realtime change events.
+         *
+         * INSERT and DELETE events adjust the entity's total and an IMPORT
+         * drops it; any event drops its filtered counts.
+         * @param events JSON array of change events, as passed to an RtCallback
+         */
+        void onChanges(const nlohmann::json &events);
+
+        /// @brief Number of cached counts, including not yet purged expired ones.
+        [[nodiscard]] std::size_t size() const;
+
+    private:
+        struct Count {
+            long long value = 0;
+            Clock::time_point expiresAt;
+        };
+
+        struct Counts {
+            std::optional<Count> total;                      ///< Unfiltered
+            std::unordered_map<std::string, Count> filtered; ///< By filter expression
+        };
+
+        std::chrono::seconds m_ttl;
+        std::size_t m_maxFilters;
+        mutable std::mutex m_mutex;
+        std::unordered_map<std::string, Counts> m_entities;
+    };
+}
+
+#endif // MANTISBASE_COUNT_CACHE_H
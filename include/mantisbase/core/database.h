@@ -6,7 +6,16 @@
 #ifndef DATABASE_H
 #define DATABASE_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
 #include <soci/soci.h>
 #include <nlohmann/json.hpp>
 #include <mantisbase/core/private-impl/soci_custom_types.hpp>
@@ -18,6 +27,14 @@
 #include "../mantisbase.h"
 #include "../utils/utils.h"
 #include "logger/logger.h"
+#include "pool_metrics.h"
+#include "request_deadline.h"
+#include "slow_query_log.h"
+#include "sqlite_change_hooks.h"
+#include "sqlite_profile.h"
+#include "tracing.h"
+#include "wal_checkpointer.h"
+#include "write_queue.h"
 
 namespace mb {
     using json = nlohmann::json;
@@ -46,6 +63,21 @@ namespace mb {
          */
         explicit Database(const MantisBase &app);
 
+        /**
+         * @brief Construct the database of one tenant, see Tenants.
+         *
+         * connect() then opens `<dataDir>/tenants/<tenant_id>.db` with SQLite,
+         * or the connection string's database with `search_path` set to
+         * tenantSchema() with PostgreSQL, on a fixed pool of `pool_size`
+         * connections. Single-writer mode, background checkpoints and read
+         * replicas are left to the application's own database. A non-empty
+         * `file` opens that SQLite file instead, as EntityShards does.
+         */
+        Database(const MantisBase &app, std::string tenant_id, int pool_size, std::string file = {});
+
+        /// @brief PostgreSQL schema holding the tables of `tenant_id`: `tenant_` and the id, dashes as underscores.
+        static std::string tenantSchema(const std::string &tenant_id);
+
         /**
          * @brief Destructor (disconnects from database).
          */
@@ -75,7 +107,13 @@ namespace mb {
 
         /**
          * @brief Get a database session from the connection pool.
-         * @return Shared pointer to soci::session
+         *
+         * Waits at most MB_DB_ACQUIRE_TIMEOUT_MS (default 30000, 0 waits
+         * forever) for a free session. With PostgreSQL or MySQL, a free slot
+         * whose connection is not open yet (or was closed for being idle) is
+         * connected here, which is how the pool grows back toward its size.
+         * @return Shared pointer to soci::session; releasing it returns the session to the pool
+         * @throws MantisException (503) on timeout, or if a new connection cannot be opened
          * @code
          * auto sql = db.session();
          * *sql << "SELECT * FROM users WHERE id = :id", soci::use(id), soci::into(row);
@@ -83,6 +121,117 @@ namespace mb {
          */
         [[nodiscard]] std::shared_ptr<soci::session> session() const;
 
+        /**
+         * @brief Get a session for a read that may run on a read replica.
+         *
+         * With PostgreSQL read replicas (`--db-replica-url`), leases from the
+         * next healthy replica in turn. Falls back to session() on the primary
+         * when there is no healthy replica, or when this request already wrote:
+         * its reads must see its own writes (see RequestScope).
+         * @throws MantisException (503) on timeout, as session() does
+         */
+        [[nodiscard]] std::shared_ptr<soci::session> readSession() const;
+
+        /**
+         * @brief Read routing state of one request.
+         *
+         * The request starts unpinned; writeSession() and write() pin the rest
+         * of it to the primary. The previous state is restored on exit. Code
+         * running outside any scope stays pinned on its thread once it writes.
+         */
+        class RequestScope {
+        public:
+            /// @param pinned Start pinned, for a request continued from a scope where it wrote
+            explicit RequestScope(bool pinned = false);
+            ~RequestScope();
+
+            RequestScope(const RequestScope &) = delete;
+            RequestScope &operator=(const RequestScope &) = delete;
+
+        private:
+            bool m_pinned;
+        };
+
+        /// @brief True if this request's reads go to the primary.
+        [[nodiscard]] static bool pinnedToPrimary();
+
+        /**
+         * @brief Get the session to write on.
+         *
+         * Same as session(), except in SQLite single-writer mode
+         * (MB_SQLITE_SINGLE_WRITER=1), where the pooled sessions are read-only
+         * and this leases the one writer connection. The lease is exclusive
+         * until the returned pointer is released, and re-entrant on the
+         * holding thread.
+         */
+        [[nodiscard]] std::shared_ptr<soci::session> writeSession() const;
+
+        /**
+         * @brief Run `job` as one atomic write and wait for it to commit.
+         *
+         * In single-writer mode the job is queued for the writer connection
+         * and may be group-committed with other writes (see WriteQueue);
+         * otherwise it runs in a transaction on a pooled session. The job must
+         * not open a transaction itself. Errors thrown by the job are rethrown
+         * here, after its changes were rolled back.
+         * @code
+         * db.write([&](soci::session &sql) {
+         *     sql << "DELETE FROM posts WHERE id = :id", soci::use(id);
+         * });
+         * @endcode
+         */
+        void write(const std::function<void(soci::session &)> &job) const;
+
+        /// @brief True if SQLite runs with read-only pooled sessions and one writer connection.
+        [[nodiscard]] bool singleWriter() const { return m_writer != nullptr; }
+
+        /// @brief True if PostgreSQL read replicas are configured, healthy or not.
+        [[nodiscard]] bool hasReplicas() const { return !m_replicas.empty(); }
+
+        /// @brief Group commit counters; std::nullopt unless in single-writer mode.
+        [[nodiscard]] std::optional<WriteQueue::Stats> writeQueueStats() const;
+
+        /// @brief Pooled connections kept open: all of them on SQLite, MB_DB_POOL_MIN on server databases.
+        [[nodiscard]] size_t poolMin() const { return m_poolMin; }
+
+        /// @brief Lease wait times, sessions in use and timeouts of the connection pool.
+        [[nodiscard]] PoolMetrics::Snapshot poolStats() const;
+
+        /// @brief Background checkpoint counters; std::nullopt unless SQLite runs the checkpointer.
+        [[nodiscard]] std::optional<WalCheckpointer::Stats> checkpointStats() const;
+
+        /// @brief The change hooks standing in for the change triggers; null unless MB_SQLITE_CAPTURE=hooks took effect.
+        [[nodiscard]] SqliteChangeHooks *changeHooks() const { return m_changeHooks.get(); }
+
+        /**
+         * @brief Pool, statement cache, write queue and checkpoint counters as one
+         * object, served by `GET /api/v1/sys/database`.
+         */
+        [[nodiscard]] json metrics() const;
+
+        /**
+         * @brief The plan of `sql`, one array item per plan row, for the slow-query log.
+         *
+         * SQLite's `EXPLAIN QUERY PLAN` details, PostgreSQL's
+         * `EXPLAIN (GENERIC_PLAN)` lines (PostgreSQL 16 and later, as the
+         * statement's parameters are not bound) or MySQL's `EXPLAIN FORMAT=JSON`.
+         * @throws soci::soci_error if the database cannot explain it
+         */
+        [[nodiscard]] json explain(const std::string &sql) const;
+
+        /// @brief The SQLite tuning profile the connections run with.
+        [[nodiscard]] SqliteProfile sqliteProfile() const;
+
+        /**
+         * @brief Store `profile` in `mb_store` and apply it to every connection.
+         *
+         * Each connection picks it up on its next lease, so no connection is
+         * touched while another thread uses it. `page_size` is stored but only
+         * affects a database file created later.
+         * @throws MantisException (400) if the database is not SQLite
+         */
+        void setSqliteProfile(const SqliteProfile &profile);
+
         /**
          * @brief Get access to the underlying connection pool.
          * @return Reference to soci::connection_pool
@@ -95,6 +244,66 @@ namespace mb {
          */
         [[nodiscard]] bool isConnected() const;
 
+        // --------------- PREPARED STATEMENT CACHE ------------------ //
+        /// Hit/miss counters for the per-connection prepared statement cache.
+        struct StatementCacheStats {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            uint64_t evictions = 0;
+            uint64_t invalidations = 0;
+            size_t size = 0; ///< Statements currently cached across all connections
+        };
+
+        /**
+         * @brief Run a cached single-row query on the connection `sql` leases.
+         *
+         * Statements are prepared once per pooled connection and keyed by SQL
+         * text, so repeated point reads skip the parse/plan step. The query may
+         * reference at most one bound value, named `:p`.
+         *
+         * @param sql Session leased from this database's pool
+         * @param table Table the statement reads, used for invalidation
+         * @param query SQL text (the cache key)
+         * @param param Value bound to `:p`, if the query has one
+         * @param on_row Called with the fetched row, if any
+         * @return true if a row was fetched
+         * @code
+         * db.queryRowCached(*sql, "users", "SELECT * FROM users WHERE id = :p", id,
+         *                   [&](const soci::row &r) { record = sociRow2Json(r, codec); });
+         * @endcode
+         */
+        bool queryRowCached(soci::session &sql, const std::string &table, const std::string &query,
+                            const std::optional<std::string> &param,
+                            const std::function<void(const soci::row &)> &on_row) const;
+
+        /**
+         * @brief Run a cached query returning a single integer (e.g. `COUNT`).
+         * @return The value, or std::nullopt if no row / NULL
+         */
+        std::optional<long long> queryScalarCached(soci::session &sql, const std::string &table,
+                                                   const std::string &query,
+                                                   const std::optional<std::string> &param = std::nullopt) const;
+
+        /**
+         * @brief Execute a cached statement that returns no rows (e.g. `DELETE`).
+         * @return Number of affected rows
+         */
+        long long execCached(soci::session &sql, const std::string &table, const std::string &query,
+                             const std::optional<std::string> &param = std::nullopt) const;
+
+        /**
+         * @brief Drop cached statements that reference `table`, on all connections.
+         *
+         * Called when a table's schema changes or it is dropped, so no statement
+         * keeps a stale column layout.
+         */
+        void invalidateStatements(const std::string &table) const;
+
+        /**
+         * @brief Snapshot of the prepared statement cache counters.
+         */
+        [[nodiscard]] StatementCacheStats statementCacheStats() const;
+
 #ifdef MB_SCRIPTING_ENABLED
         static void registerDuktapeMethods();
 #endif
@@ -118,6 +327,30 @@ namespace mb {
          */
 #ifdef MB_SCRIPTING_ENABLED
         duk_ret_t query(duk_context *ctx);
+
+        /**
+         * @brief Run a query and hand its rows to JS in chunks, rather than as one array.
+         *
+         * @code
+         * const cur = db.cursor("SELECT * FROM posts WHERE author = :a", {a: id});
+         * for (let rows; (rows = cur.next(500));) rows.forEach(handle);
+         * @endcode
+         *
+         * The cursor holds a pooled session until its rows run out, `close()` is called or
+         * it is garbage collected.
+         */
+        duk_ret_t cursor(duk_context *ctx);
+
+        /**
+         * @brief Run one statement for every bind object of an array, in one transaction.
+         *
+         * @code
+         * db.execMany("INSERT INTO tags(id, name) VALUES (:id, :name)", [{id: "1", name: "a"}, {id: "2", name: "b"}]);
+         * @endcode
+         *
+         * @return Rows affected in total; nothing is written if any row fails
+         */
+        duk_ret_t execMany(duk_context *ctx);
 #endif
 
         /**
@@ -127,8 +360,153 @@ namespace mb {
 
         static void seedOAuthPresets(soci::session &sql);
 
+        /// Open the checkpoint connection, hook every writable connection and start the thread.
+        void startCheckpointer(size_t pool_size);
+
+        /// Open a PostgreSQL/MySQL session on `conn_str`; false if the backend was not built in.
+        bool openServerSession(soci::session &sql, const std::string &conn_str) const;
+
+        /**
+         * Lease a slot of `pool`, waiting up to `timeout_ms` (negative waits
+         * forever), and open its connection if it has none. `last_used`, if
+         * given, gets the hand-back time per slot. nullptr on timeout.
+         */
+        std::shared_ptr<soci::session> leaseFrom(soci::connection_pool &pool, PoolMetrics &metrics,
+                                                 const std::string &conn_str,
+                                                 std::atomic<PoolMetrics::Clock::rep> *last_used,
+                                                 int timeout_ms) const;
+
+        /// Acquire timeout as try_lease() takes it.
+        [[nodiscard]] int acquireTimeoutMs() const;
+
+        /// Close open pool slots above m_poolMin that sat unused for m_poolIdle.
+        void closeIdleSessions();
+
+        /// Probe each replica; mark it healthy or not and record its lag.
+        void checkReplicas();
+
+        /// Thread body: closes idle sessions and checks replicas until disconnect().
+        void runPoolMonitor();
+
+        /// Profile at startup: MB_SQLITE_PROFILE, else the stored one, else the defaults.
+        SqliteProfile resolveSqliteProfile(soci::session &sql) const;
+
+        /// Re-run the profile PRAGMAs on `sql` if it was leased since the last change.
+        void refreshSqliteProfile(soci::session &sql) const;
+
+        /// Max prepared statements kept per pooled connection.
+        static constexpr size_t STATEMENT_CACHE_CAPACITY = 64;
+
+        enum class StatementKind { Row, Scalar, Exec };
+
+        /// A statement prepared on a pooled connection, with the storage its
+        /// use/into elements are bound to.
+        struct CachedStatement {
+            std::string table;
+            StatementKind kind = StatementKind::Exec;
+            std::string param;
+            soci::row row;
+            long long scalar = 0;
+            soci::indicator scalarInd = soci::i_null;
+            std::unique_ptr<soci::statement> stmt;
+            std::list<std::string>::iterator lruPos;
+        };
+
+        /// Statement cache of one pooled connection. The mutex is only
+        /// contended by invalidation: the owning connection is leased to a
+        /// single thread at a time.
+        struct ConnStatementCache {
+            std::mutex mutex;
+            std::list<std::string> lru; ///< Most recently used at the front
+            std::unordered_map<std::string, std::unique_ptr<CachedStatement>> entries;
+            /// Tables invalidated since this connection was last used. Entries
+            /// are dropped by the thread leasing the connection, never from
+            /// another thread (a PG statement's cleanup talks to the server).
+            std::vector<std::string> staleTables;
+        };
+
+        /**
+         * @brief Find or prepare the cached statement for `query` and run `fn` on it
+         * under the connection's cache lock.
+         */
+        template<typename Fn>
+        auto withCachedStatement(soci::session &sql, const std::string &table, const std::string &query,
+                                 StatementKind kind, bool has_param, Fn &&fn) const;
+
+        /// Drop all cached statements; must run before the pooled sessions close.
+        void clearStatementCaches() const;
+
+        /// Drop the cached statements of one slot, leased by the caller or idle.
+        void clearStatementCache(size_t slot) const;
+
         std::string m_connStr;
         std::unique_ptr<soci::connection_pool> m_connPool;
+        const std::string m_tenant; ///< Empty for the application's own database
+        const int m_tenantPoolSize = 0;
+        const std::string m_file; ///< SQLite file overriding the tenant's, see EntityShards
+
+        /// Pool sizing and lease accounting. Server databases start with
+        /// m_poolMin open connections, open more on demand up to the pool
+        /// size, and the monitor thread closes the ones idle past m_poolIdle.
+        std::chrono::milliseconds m_acquireTimeout{30000}; ///< 0 waits forever
+        size_t m_poolMin = 0;
+        std::chrono::milliseconds m_poolIdle{60000};
+        mutable PoolMetrics m_poolMetrics;
+        std::unique_ptr<std::atomic<PoolMetrics::Clock::rep>[]> m_slotLastUsed; ///< Last hand-back, per slot
+
+        /// A PostgreSQL read replica: its own fixed pool and statement cache
+        /// slots, and the outcome of the monitor's last probe.
+        struct Replica {
+            std::string connStr;
+            std::unique_ptr<soci::connection_pool> pool;
+            size_t firstSlot = 0;                  ///< Its first statement cache slot
+            std::atomic<bool> healthy{false};
+            std::atomic<int64_t> lagMs{-1};        ///< Replay lag at the last probe, -1 if unknown
+            std::atomic<uint64_t> reads{0}, failedChecks{0};
+            PoolMetrics metrics;
+        };
+        std::vector<std::unique_ptr<Replica>> m_replicas;
+        mutable std::atomic<size_t> m_nextReplica{0};
+        std::chrono::milliseconds m_replicaCheck{5000};
+        std::chrono::milliseconds m_replicaMaxLag{0}; ///< 0 ignores the lag
+
+        /// Closes idle sessions and probes replicas
+        std::thread m_poolMonitor;
+        std::mutex m_monitorMutex;
+        std::condition_variable m_monitorCv;
+        bool m_monitorStop = false;
+
+        /// SQLite single-writer mode: the writer connection, the lock leasing
+        /// it (held by writeSession() callers and by the queue's writer thread
+        /// for each group) and the queue feeding it.
+        std::unique_ptr<soci::session> m_writer;
+        mutable std::recursive_mutex m_writerMutex;
+        mutable std::atomic<std::thread::id> m_writerOwner{};
+        mutable int m_writerDepth = 0; ///< Lease depth on the owning thread
+        std::unique_ptr<WriteQueue> m_writeQueue;
+
+        /// Background WAL checkpoints (SQLite), on their own connection.
+        std::unique_ptr<soci::session> m_checkpointConn;
+        std::unique_ptr<WalCheckpointer> m_checkpointer;
+
+        /// SQLite change capture from connection hooks (MB_SQLITE_CAPTURE=hooks)
+        std::unique_ptr<SqliteChangeHooks> m_changeHooks;
+
+        /// SQLite profile, its generation, and the generation each slot (pool
+        /// slots, then the writer) last applied. Slots are only updated by the
+        /// thread leasing them; m_profileStale counts the ones behind.
+        mutable std::mutex m_profileMutex;
+        SqliteProfile m_sqliteProfile;
+        uint64_t m_profileGen = 0;
+        mutable std::vector<uint64_t> m_profileApplied;
+        mutable std::atomic<size_t> m_profileStale{0};
+
+        /// One statement cache per pool slot, indexed like the pool, plus the
+        /// session -> slot map used to find the slot a leased session uses.
+        /// Keyed by session rather than backend: a reopened slot gets a new backend.
+        std::vector<std::unique_ptr<ConnStatementCache>> m_stmtCaches;
+        std::unordered_map<const soci::session *, size_t> m_sessionSlots;
+        mutable std::atomic<uint64_t> m_stmtHits{0}, m_stmtMisses{0}, m_stmtEvictions{0}, m_stmtInvalidations{0};
         const MantisBase &mbApp;
     };
 
@@ -139,12 +517,33 @@ namespace mb {
     class MantisLoggerImpl : public soci::logger_impl {
     public:
         /**
-         * @brief Called before query is executed by soci, we can log the query here.
+         * @param timed Time statements for the slow-query log here; SQLite
+         *              connections have their own profile hook for it
+         */
+        explicit MantisLoggerImpl(const bool timed = false) : m_timed(timed) {}
+
+        /**
+         * @brief Called before query is executed by soci, we can log and trace the query here.
          * @param query SQL Query to be executed
          */
         void start_query(std::string const &query) override {
+            // A request past its deadline, or whose client left, runs no further statements
+            RequestDeadline::check();
             logger_impl::start_query(query);
-            LogOrigin::dbTrace(fmt::format("$ sql << {}", query));
+            MB_LOG_TRACE(LogOrigin::dbTrace, fmt::format("$ sql << {}", query));
+            Tracer::statement(query);
+            if (m_timed) SlowQueryLog::statement(query);
+        }
+
+        /// @brief A value bound to the query; its shape goes in the slow-query log.
+        void add_query_parameter(std::string name, std::string value) override {
+            SlowQueryLog::parameter(value);
+            logger_impl::add_query_parameter(std::move(name), std::move(value));
+        }
+
+        void clear_query_parameters() override {
+            SlowQueryLog::clearParameters();
+            logger_impl::clear_query_parameters();
         }
 
     private:
@@ -153,8 +552,10 @@ namespace mb {
          * @return Logger implementation pointer
          */
         logger_impl *do_clone() const override {
-            return new MantisLoggerImpl();
+            return new MantisLoggerImpl(m_timed);
         }
+
+        const bool m_timed;
     };
 } // mb
 
@@ -0,0 +1,103 @@
+/**
+ * @file delta_sync.h
+ * @brief "What changed since" for clients coming back online, off `mb_change_log`.
+ *
+ * With MB_SYNC_RETAIN_S set, the change log keeps delivered rows that long
+ * and `GET /api/v1/sync?since=<cursor>&entities=a,b` answers from it: the
+ * changes after the cursor, compacted to one upsert or tombstone per row.
+ * Upserts are the rows as they are now, read under the list rule as
+ * `GET /api/v1/entities/<entity>` would, so a sync costs as much as the
+ * changes do, not the dataset. A client starts by asking without `since`
+ * for a cursor, then downloads what it needs; rows changed in between come
+ * again on its first sync, which is harmless since upserts are whole rows.
+ * @see realtime.h, replication.h
+ */
+
+#ifndef MANTISBASE_DELTA_SYNC_H
+#define MANTISBASE_DELTA_SYNC_H
+
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace soci {
+    class session;
+}
+
+namespace mb {
+    using json = nlohmann::json;
+
+    /**
+     * @brief Compacts and serves the retained change log to syncing clients.
+     *
+     * A cursor names the last change a client has and the database time of
+     * the changes after it. Changes older than MB_SYNC_RETAIN_S are pruned,
+     * so a cursor that old gets a `410` and the client downloads afresh.
+     */
+    class DeltaSync {
+    public:
+        struct Options {
+            std::chrono::seconds retain{0}; ///> How long delivered changes are kept; 0 leaves sync off
+            int batch = 1000;               ///> Change log rows read per request, at most
+
+            /// @brief Read MB_SYNC_RETAIN_S and MB_SYNC_BATCH.
+            static Options fromEnv();
+
+            [[nodiscard]] bool enabled() const { return retain.count() > 0; }
+        };
+
+        struct Cursor {
+            long long changeId = 0; ///> Last `mb_change_log` id covered
+            long long at = 0;       ///> Unix seconds (database clock) no later than any change after it
+
+            /// @brief `<changeId>.<at>`, opaque to clients.
+            [[nodiscard]] std::string encode() const;
+
+            /// @brief nullopt unless `cursor` is one encode() made.
+            static std::optional<Cursor> decode(const std::string &cursor);
+        };
+
+        /// @brief The fold of one row's changes after a cursor.
+        struct RowChange {
+            std::string entity, rowId;
+            bool inserted = false; ///> Its first change created it, so the client can't hold it
+            bool deleted = false;  ///> Its last change removed it
+        };
+
+        /// @brief One `mb_change_log` row, as compact() reads it.
+        struct LogEntry {
+            std::string type, entity, rowId;
+        };
+
+        /**
+         * @brief Fold `entries` (in id order) to one RowChange per row, in order of first change.
+         *
+         * Rows created and removed within the window are dropped. Entities
+         * with changes no row stands for (the `IMPORT` summary) go in `resync`.
+         */
+        static std::vector<RowChange> compact(const std::vector<LogEntry> &entries, std::set<std::string> &resync);
+
+        /**
+         * @brief The changes to `entities` after `since` (or just a cursor, without one).
+         *
+         * @param entities Names of the entities the caller may list
+         * @param read Reads the named rows of an entity that the caller may
+         *        see, e.g. Entity::readMany() with the caller's `auth`
+         * @return `cursor` to sync from next, `more` if the change log goes on
+         *         past it, `upserts` and `deletes` (ids) by entity, and `resync`:
+         *         entities the client must download afresh
+         * @throws MantisException 410 if changes after `since` were pruned
+         */
+        static json changesSince(soci::session &sql, const std::optional<Cursor> &since,
+                                 const std::vector<std::string> &entities, const Options &options,
+                                 const std::function<std::vector<json>(const std::string &entity,
+                                                                       const std::vector<std::string> &ids)> &read);
+    };
+}
+
+#endif // MANTISBASE_DELTA_SYNC_H
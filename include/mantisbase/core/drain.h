@@ -0,0 +1,106 @@
+/**
+ * @file drain.h
+ * @brief Graceful shutdown: stop taking requests, let those in flight finish.
+ *
+ * On SIGTERM or Router::close() the router starts draining. From then every
+ * new request, health checks included, is answered `503` with `Retry-After`
+ * and the connection is closed, so load balancers and clients move to a
+ * sibling process. Requests already in flight get the grace period
+ * (MB_SHUTDOWN_GRACE_MS) to finish before the server stops. Realtime
+ * clients are then told to `reconnect` after a random delay of up to
+ * MB_SHUTDOWN_RECONNECT_JITTER_MS, with the event id to resume from, so
+ * they don't all come back at once.
+ *
+ * For a restart without downtime, run the new process with `--reuse-port`
+ * on the same port as the old one, wait for its health check, then send the
+ * old one SIGTERM: the kernel spreads new connections over both listeners
+ * until the old one stops.
+ * @see Router::drain(), SSEMgr::sendReconnect()
+ */
+
+#ifndef MANTISBASE_DRAIN_H
+#define MANTISBASE_DRAIN_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace mb {
+    class MetricsWriter;
+
+    /**
+     * @brief Counts requests in flight and turns new ones away once draining.
+     *
+     * @code
+     * auto ticket = drain.enter();
+     * if (!ticket) return reply503();
+     * run([ticket] { ... }); // leaves the count with the last copy
+     *
+     * drain.begin();
+     * drain.wait();          // at most the grace period
+     * @endcode
+     */
+    class Drain {
+    public:
+        struct Options {
+            std::chrono::milliseconds grace{10000};          ///> In-flight requests get this long to finish
+            std::chrono::milliseconds reconnectJitter{5000}; ///> Realtime clients come back within this
+
+            /// @brief Read MB_SHUTDOWN_GRACE_MS and MB_SHUTDOWN_RECONNECT_JITTER_MS.
+            static Options fromEnv();
+        };
+
+        /// @brief One admitted request; leaves the in-flight count when destroyed.
+        class Ticket {
+        public:
+            explicit Ticket(Drain &drain) : m_drain(drain) {}
+            ~Ticket();
+
+            Ticket(const Ticket &) = delete;
+            Ticket &operator=(const Ticket &) = delete;
+
+        private:
+            Drain &m_drain;
+        };
+
+        explicit Drain(Options options);
+
+        [[nodiscard]] const Options &options() const { return m_options; }
+
+        /// @return A ticket, or null (and a refusal counted) once draining
+        std::shared_ptr<Ticket> enter();
+
+        /// @brief Start draining. @return False if already draining
+        bool begin();
+
+        /// @brief Block until no request is in flight or the grace period ends. @return True if none is left
+        bool wait();
+
+        /// @brief A random delay in [0, reconnectJitter] for one realtime client.
+        [[nodiscard]] std::chrono::milliseconds reconnectDelay() const;
+
+        [[nodiscard]] bool draining() const { return m_draining.load(); }
+        [[nodiscard]] std::size_t inflight() const { return m_inflight.load(); }
+        [[nodiscard]] std::uint64_t refused() const { return m_refused.load(); }
+
+        /// @brief `mb_http_inflight`, `mb_http_draining` and `mb_http_drain_refused_total`.
+        void writeMetrics(MetricsWriter &out) const;
+
+    private:
+        void leave();
+
+        const Options m_options;
+        std::atomic<bool> m_draining{false};
+        std::atomic<std::size_t> m_inflight{0};
+        std::atomic<std::uint64_t> m_refused{0};
+
+        std::mutex m_mutex; ///> Pairs with m_cv, so the last leave() is never missed by wait()
+        std::condition_variable m_cv;
+    };
+}
+
+#endif // MANTISBASE_DRAIN_H
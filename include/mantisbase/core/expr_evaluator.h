@@ -6,6 +6,7 @@
 #ifndef EXPR_EVALUATOR_H
 #define EXPR_EVALUATOR_H
 
+#include <memory>
 #include <string>
 #include <nlohmann/json_fwd.hpp>
 #include "../utils/utils.h"
@@ -26,6 +27,48 @@ namespace mb
          */
         static bool eval(const std::string& expr, const nlohmann::json& vars = {});
     };
+
+    /**
+     * @brief Access rule expression parsed once and evaluated many times.
+     *
+     * Rules made only of `@var.path` lookups, string/number/bool/null
+     * literals, comparisons (`== != < <= > >=`), `!`, `&&`, `||` and
+     * parentheses are evaluated natively against the bound variables.
+     * Anything else — other syntax, or a lookup that hits a missing/null
+     * value or mixes types — is handed to Expr::eval() so results always
+     * match the script engine.
+     *
+     * @code
+     * const auto rule = CompiledExpr::compile("@auth.id == @req.body.owner");
+     * if (rule->eval(vars)) { ... }
+     * @endcode
+     */
+    class CompiledExpr
+    {
+    public:
+        struct Node;
+
+        /**
+         * @brief Parse `expr`. Never throws; unsupported syntax just disables the native path.
+         */
+        static std::shared_ptr<const CompiledExpr> compile(const std::string& expr);
+
+        /// @brief Evaluate against `vars`; same result as `Expr::eval(source(), vars)`.
+        [[nodiscard]] bool eval(const nlohmann::json& vars) const;
+
+        /// @brief Whether the expression is evaluated without the script engine.
+        [[nodiscard]] bool isNative() const { return m_root != nullptr; }
+
+        [[nodiscard]] const std::string& source() const { return m_source; }
+
+        ~CompiledExpr();
+
+    private:
+        explicit CompiledExpr(std::string source);
+
+        std::string m_source;
+        std::unique_ptr<Node> m_root;
+    };
 } // mb
 
 #endif //EXPR_EVALUATOR_H
@@ -0,0 +1,58 @@
+/**
+ * @file field_compression.h
+ * @brief The stored form of `string`, `xml` and `json` fields marked `compress`.
+ *
+ * A value of at least MIN_BYTES is stored as a zstd frame in base64, behind
+ * PREFIX, when that comes out shorter. Smaller values, and values that
+ * don't compress, are stored as they are. Reads tell the two forms apart
+ * by the prefix. Turning `compress` on or off leaves stored values as they
+ * were, so a column may hold both forms. Only SQLite stores compressed
+ * values. PostgreSQL already compresses large values (TOAST), and a `json`
+ * column there must hold JSON.
+ * @see RowCodec
+ */
+
+#ifndef MANTISBASE_FIELD_COMPRESSION_H
+#define MANTISBASE_FIELD_COMPRESSION_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+#include <nlohmann/json.hpp>
+
+namespace mb {
+    class MetricsWriter;
+
+    class FieldCompression {
+    public:
+        /// Starts every compressed value; no JSON text starts with a control character
+        static constexpr std::string_view PREFIX = "\x01zstd:";
+
+        /// Smaller values are stored as they are; a frame and base64 cost more than they save there
+        static constexpr std::size_t MIN_BYTES = 512;
+
+        /// @brief Whether this build has zstd; without it, values are stored as they are.
+        [[nodiscard]] static bool available();
+
+        /// @brief Whether `stored` is a compressed value.
+        [[nodiscard]] static bool compressed(const std::string_view stored) { return stored.starts_with(PREFIX); }
+
+        /// @brief The stored form of `value`: compressed if it is large enough and shrinks, else `value`.
+        [[nodiscard]] static std::string deflate(std::string value);
+
+        /**
+         * @brief The value behind a stored form; anything not compressed(), as it is.
+         * @throws MantisException (500) for a corrupt value, or one this build can't decompress
+         */
+        [[nodiscard]] static std::string inflate(std::string stored);
+
+        /// @brief Inflate the string members of `row`, a record as the change triggers serialize it; corrupt ones stay as stored.
+        static void inflateMembers(nlohmann::json &row);
+
+        /// @brief `mb_field_compression_values_total`, and `mb_field_compression_bytes_total` raw and stored.
+        static void writeMetrics(MetricsWriter &out);
+    };
+}
+
+#endif // MANTISBASE_FIELD_COMPRESSION_H
@@ -0,0 +1,121 @@
+/**
+ * @file file_cleanup.h
+ * @brief Durable, background removal of files dropped from records.
+ *
+ * Updating or deleting a record queues the files it no longer names in
+ * `mb_file_deletions`, inside the same transaction as the row change, and
+ * a background thread removes them in batches after the commit. A crash
+ * between the two leaves the queue behind, not orphaned files: it is
+ * drained again on the next start. A periodic sweep reconciles each
+ * entity's files on disk (and its `mb_file_refs` rows) against its
+ * `file`/`files` columns, for whatever was left behind some other way.
+ * @see Files, BlobStore
+ */
+
+#ifndef MANTISBASE_FILE_CLEANUP_H
+#define MANTISBASE_FILE_CLEANUP_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace soci {
+    class session;
+}
+
+namespace mb {
+    /**
+     * @brief Drains `mb_file_deletions` and sweeps for orphaned files.
+     *
+     * A file the sweep finds unreferenced is only queued if the previous
+     * sweep found it unreferenced too. Uploads are placed before their
+     * record commits, so this keeps a sweep from taking a file whose record
+     * is still being written.
+     *
+     * @code
+     * app.db().write([&](soci::session &sql) {
+     *     sql << "DELETE FROM ...";
+     *     FileCleanup::enqueue(sql, "posts", {"abc_photo.png"});
+     * });
+     * app.fileCleanup().notify();
+     * @endcode
+     */
+    class FileCleanup {
+    public:
+        struct Options {
+            std::size_t batch = 100;                 ///> Files removed per drain
+            std::chrono::seconds poll{30};           ///> How often the queue is checked without a notify()
+            std::chrono::seconds sweepInterval{3600}; ///> 0 turns the sweep off
+
+            /// @brief Read MB_FILE_DELETE_BATCH and MB_FILE_SWEEP_INTERVAL (seconds, at least 60, `0` for off).
+            static Options fromEnv();
+        };
+
+        explicit FileCleanup(Options options);
+        ~FileCleanup();
+
+        FileCleanup(const FileCleanup &) = delete;
+        FileCleanup &operator=(const FileCleanup &) = delete;
+
+        /// @brief Start the thread, which first drains whatever an earlier run left queued.
+        void start();
+
+        /// @brief Stop the thread. Idempotent; queued files stay queued.
+        void stop();
+
+        /**
+         * @brief Queue `files` of `entity_name` for removal, inside the caller's write.
+         *
+         * The files are only removed once that write commits; call notify()
+         * afterwards to have it happen right away.
+         */
+        static void enqueue(soci::session &sql, const std::string &entity_name,
+                            const std::vector<std::string> &files);
+
+        /// @brief Wake the thread to drain the queue.
+        void notify();
+
+        /// @brief Remove up to one batch of queued files. Called by the thread; public for tests.
+        /// @return Files taken off the queue
+        std::size_t drain();
+
+        /// @brief Queue files found unreferenced in this and the previous sweep. Public for tests.
+        /// @return Files queued
+        std::size_t sweep();
+
+        /// @brief Files waiting in `mb_file_deletions`.
+        [[nodiscard]] std::size_t pending() const;
+
+        [[nodiscard]] std::size_t removed() const { return m_removed.load(); }
+
+    private:
+        struct FileColumn {
+            std::string name;
+            bool many = false;   ///> A `files` column, holding a JSON array
+        };
+
+        void loop();
+
+        /// `entity/filename` of every file this entity holds but no record names
+        static std::vector<std::string> unreferenced(const std::string &entity_name,
+                                                     const std::vector<FileColumn> &columns);
+
+        const Options m_options;
+        std::atomic<std::size_t> m_removed{0};
+        std::unordered_set<std::string> m_suspects;   ///> Unreferenced at the last sweep, as `entity/filename`; sweep() only
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_cv;
+        bool m_stopping = false;
+        bool m_wake = false;
+        std::thread m_thread;
+    };
+}
+
+#endif // MANTISBASE_FILE_CLEANUP_H
@@ -0,0 +1,152 @@
+/**
+ * @file file_io.h
+ * @brief Asynchronous file writes and unlinks, off the HTTP IO loops.
+ *
+ * Uploads are staged as they stream in, on the IO loop that reads them.
+ * On a network volume a single write can take milliseconds, and every
+ * connection on that loop waits for it. FileIo takes the writes and the
+ * removal of discarded staging files: with io_uring (built with
+ * MB_IO_URING_ENABLED, on Linux) they are submitted to the kernel, and
+ * otherwise run on a few threads of its own. Downloads stay on drogon's
+ * sendfile() path, which doesn't copy through user space.
+ * @see MultipartUpload, Router::registerDrogonHandlerWithReader()
+ */
+
+#ifndef MANTISBASE_FILE_IO_H
+#define MANTISBASE_FILE_IO_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace mb {
+    class MetricsWriter;
+
+    /**
+     * @brief Sequential writers and batched unlinks over io_uring or a thread pool.
+     *
+     * Thread-safe. Before start() and after stop(), everything runs inline
+     * on the caller's thread, as blocking calls.
+     *
+     * @code
+     * auto file = io.open(path);
+     * file->write(chunk.data(), chunk.size()); // returns once queued
+     * file->close([](std::error_code ec) { ... }); // on an IO thread, once it's all on disk
+     * @endcode
+     */
+    class FileIo {
+    public:
+        struct Options {
+            bool enabled = true;
+            bool uring = true;                          ///> io_uring when built in; threads if it can't be set up
+            std::size_t threads = 2;                    ///> Thread fallback
+            unsigned queueDepth = 256;                  ///> io_uring submission queue entries
+            std::size_t maxPending = 8 * 1024 * 1024;   ///> Bytes one writer queues before write() waits for the disk
+
+            /// MB_FILE_IO (`0` keeps writes inline), MB_FILE_IO_URING, MB_FILE_IO_THREADS, MB_FILE_IO_PENDING_MB
+            static Options fromEnv();
+        };
+
+        /**
+         * @brief Writes to one file, in order, queued from any thread.
+         *
+         * Each write() copies its data and returns; only past `maxPending`
+         * queued bytes does it wait for the disk. The first failed write
+         * fails the rest, and close() reports it.
+         */
+        class Writer : public std::enable_shared_from_this<Writer> {
+        public:
+            Writer(FileIo &io, int fd, std::filesystem::path path);
+            ~Writer();
+
+            Writer(const Writer &) = delete;
+            Writer &operator=(const Writer &) = delete;
+
+            void write(const char *data, std::size_t size);
+
+            /**
+             * @brief Close the file once the queued writes are done.
+             * @param done Called once, on whichever thread finished the last write
+             */
+            void close(std::function<void(std::error_code)> done);
+
+            [[nodiscard]] std::error_code error() const;
+            [[nodiscard]] const std::filesystem::path &path() const { return m_path; }
+
+        private:
+            /// Next chunk to hand to the engine, if one is queued and none is in flight; under the lock
+            std::shared_ptr<std::string> take();
+            void submit(std::shared_ptr<std::string> chunk, std::size_t from);
+            void completed(const std::shared_ptr<std::string> &chunk, std::size_t from, long result);
+            /// Under the lock; the callback to run once it's released
+            std::function<void()> finishClose();
+
+            FileIo &m_io;
+            int m_fd;
+            const std::filesystem::path m_path;
+            mutable std::mutex m_mutex;
+            std::condition_variable m_drained;
+            std::deque<std::shared_ptr<std::string>> m_queue;
+            std::size_t m_pending = 0;   ///> Queued and in-flight bytes
+            std::uint64_t m_offset = 0;
+            bool m_inFlight = false;
+            bool m_closing = false;
+            std::error_code m_error;
+            std::function<void(std::error_code)> m_onClosed;
+        };
+
+        explicit FileIo(Options options);
+        ~FileIo();
+
+        FileIo(const FileIo &) = delete;
+        FileIo &operator=(const FileIo &) = delete;
+
+        /// @brief Set up io_uring, or start the threads. No-op if disabled or running.
+        void start();
+
+        /// @brief Wait for what's in flight and stop. Idempotent.
+        void stop();
+
+        [[nodiscard]] bool enabled() const { return m_options.enabled; }
+        [[nodiscard]] bool running() const;
+
+        /// @brief `io_uring`, `threads`, or `inline` before start().
+        [[nodiscard]] const char *engineName() const;
+
+        /**
+         * @brief Create or truncate `path` for writing.
+         * @throws MantisException 500 if it can't be opened
+         */
+        std::shared_ptr<Writer> open(const std::filesystem::path &path);
+
+        /// @brief Remove `paths` in the background; missing ones are fine, other failures are logged.
+        void remove(std::vector<std::string> paths);
+
+        void writeMetrics(MetricsWriter &out) const;
+
+        /// Where operations go: io_uring or threads; defined in file_io.cpp
+        class Engine;
+        /// One operation's result: bytes done, or `-errno`
+        using Completion = std::function<void(long result)>;
+
+    private:
+        /// The engine if running, else null for inline
+        [[nodiscard]] std::shared_ptr<Engine> engine() const;
+
+        const Options m_options;
+        mutable std::mutex m_mutex;
+        std::shared_ptr<Engine> m_engine;
+        std::atomic<std::uint64_t> m_writes{0}, m_bytes{0}, m_unlinks{0}, m_errors{0};
+    };
+}
+
+#endif // MANTISBASE_FILE_IO_H
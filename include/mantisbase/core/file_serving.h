@@ -0,0 +1,111 @@
+/**
+ * @file file_serving.h
+ * @brief HTTP caching and range rules for `GET /api/v1/files/:entity/:file`.
+ *
+ * Pure request/header logic kept apart from the router so it can be tested
+ * without a server: byte ranges, conditional requests and the per-entity
+ * `Cache-Control` policy. The bytes themselves go out through
+ * MantisResponse::sendFile(), which uses sendfile() for large bodies.
+ * @see Router::fileServingHandler()
+ */
+
+#ifndef MANTISBASE_FILE_SERVING_H
+#define MANTISBASE_FILE_SERVING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace mb {
+    /**
+     * @brief Caching and range decisions for served entity files.
+     *
+     * ETags are strong and come from the stored SHA-256 of the file (see
+     * Files::contentHash()), so they stay valid across restarts and are the
+     * same on every node sharing the data directory.
+     *
+     * @code
+     * const auto range = FileServing::parseRange(req.getHeaderValue("Range"), size);
+     * if (range.kind == FileServing::Range::Unsatisfiable) ... // 416
+     * @endcode
+     */
+    class FileServing {
+    public:
+        struct Range {
+            enum Kind { Full, Partial, Unsatisfiable };
+
+            Kind kind = Full;
+            std::size_t offset = 0;
+            std::size_t length = 0;   ///> Bytes to send; the whole file for `Full`
+        };
+
+        /**
+         * @brief Per-entity `Cache-Control` values.
+         *
+         * Read from MB_FILES_CACHE_CONTROL as `entity=value` pairs separated by
+         * `;`, with `*` setting the fallback, e.g.
+         * `posts=public, max-age=86400;*=private, max-age=60`.
+         * Entities without an entry get `no-cache`, so clients revalidate
+         * with the ETag and a hit costs a 304.
+         */
+        struct CachePolicy {
+            std::string fallback = "no-cache";
+            std::unordered_map<std::string, std::string> entities;
+
+            static CachePolicy parse(std::string_view spec);
+            static CachePolicy fromEnv();
+
+            [[nodiscard]] const std::string &forEntity(const std::string &entity) const;
+        };
+
+        /**
+         * @brief Resolve a `Range` header against a file of `size` bytes.
+         *
+         * Only single `bytes=` ranges are honoured (`a-b`, `a-`, `-n`). Anything
+         * else, multi-range requests included, is served in full, which the
+         * RFC allows. A well-formed range outside the file is unsatisfiable.
+         */
+        static Range parseRange(std::string_view header, std::size_t size);
+
+        /// @brief Strong ETag for a content hash, quoted.
+        static std::string etag(std::string_view sha256);
+
+        /**
+         * @brief Whether an `If-None-Match` list matches `etag`.
+         * Uses the weak comparison, as the RFC requires for this header.
+         */
+        static bool ifNoneMatch(std::string_view header, std::string_view etag);
+
+        /**
+         * @brief Whether a conditional GET can be answered with 304.
+         *
+         * `If-None-Match` wins when present; `If-Modified-Since` is only
+         * consulted without it. Times are seconds since the epoch, and a
+         * negative `if_modified_since` means the header was absent or invalid.
+         */
+        static bool isNotModified(std::string_view if_none_match, std::int64_t if_modified_since,
+                                  std::string_view etag, std::int64_t last_modified);
+
+        /**
+         * @brief Whether a `Range` may be honoured given `If-Range`.
+         *
+         * An ETag must match strongly. A date must equal `last_modified_http`,
+         * the Last-Modified value sent for the file. An empty header always
+         * allows the range.
+         */
+        static bool ifRangeAllows(std::string_view header, std::string_view etag,
+                                  std::string_view last_modified_http);
+
+        /**
+         * @brief Whether a build tool put a content hash in `filename`, e.g. `index-B3x9kQ1z.js`.
+         *
+         * Such files never change under the same name, so they can be cached
+         * as `immutable`.
+         */
+        static bool isFingerprinted(std::string_view filename);
+    };
+}
+
+#endif // MANTISBASE_FILE_SERVING_H
@@ -175,6 +175,40 @@ namespace mb
          * @return Filesystem path to the base files directory
          */
         static fs::path filesBaseDir();
+
+        /**
+         * @brief Get the directory uploads are staged in while they stream in.
+         *
+         * Lives under filesBaseDir(), on the same filesystem as the entity
+         * directories, so a staged file is moved into place with a rename.
+         * Created if missing.
+         *
+         * @return Filesystem path to `<files>/.uploads`
+         */
+        static fs::path stagingDir();
+
+        /**
+         * @brief Get the SHA-256 of a stored file, as lowercase hex.
+         *
+         * Read from the file's sidecar (`.<filename>.sha256` next to it), which
+         * also records the size and modification time it was computed for. A
+         * missing or stale sidecar is rebuilt by hashing the file.
+         *
+         * @param entity_name Entity/table name
+         * @param filename File name
+         * @return Hex digest, or an empty string if the file can't be read
+         */
+        static std::string contentHash(const std::string& entity_name, const std::string& filename);
+
+        /**
+         * @brief Record the SHA-256 of a file just written, so serving it doesn't rehash.
+         *
+         * @param entity_name Entity/table name
+         * @param filename File name
+         * @param sha256 Hex digest of the file's content
+         */
+        static void storeContentHash(const std::string& entity_name, const std::string& filename,
+                                     const std::string& sha256);
     };
 } // mb
 
@@ -9,9 +9,15 @@
 #endif
 
 #include "context_store.h"
+#include "multipart_upload.h"
+#include "request_arena.h"
 #include "../utils/utils.h"
 #include "types.h"
+#include "wire_format.h"
+#include <array>
+#include <cstdint>
 #include <fstream>
+#include <string_view>
 #include <unordered_map>
 #include <drogon/HttpRequest.h>
 #include <drogon/HttpResponse.h>
@@ -27,24 +33,105 @@ namespace mb {
         static duk_ret_t nativeConsoleTable(duk_context *ctx);
     };
 
+    /**
+     * @brief Calls into the global hook functions scripts define.
+     *
+     * Hooks run on the heap they are given; pass MantisBase::ctx(), the
+     * calling thread's. `before...` hooks run in the request and can reject
+     * the write; the `onRecord...` ones run after commit, from RecordHooks.
+     */
     class ScriptingHooks {
     public:
         static void fireOnServerStart(duk_context *ctx);
-        static void fireOnRecordCreated(duk_context *ctx, const std::string &entity, const std::string &recordId);
-        static void fireOnRecordUpdated(duk_context *ctx, const std::string &entity, const std::string &recordId);
+
+        /// @brief `onRecordCreated(entity, id, record)`. False if the hook threw.
+        static bool fireOnRecordCreated(duk_context *ctx, const std::string &entity, const std::string &recordId,
+                                        const nlohmann::json &record = nullptr);
+        /// @brief `onRecordUpdated(entity, id, record)`. False if the hook threw.
+        static bool fireOnRecordUpdated(duk_context *ctx, const std::string &entity, const std::string &recordId,
+                                        const nlohmann::json &record = nullptr);
+        /// @brief `onRecordDeleted(entity, id, oldRecord)`. False if the hook threw.
+        static bool fireOnRecordDeleted(duk_context *ctx, const std::string &entity, const std::string &recordId,
+                                        const nlohmann::json &record = nullptr);
+        /// @brief `onRecordsChanged(events)`, once per delivered batch. False if the hook threw.
+        static bool fireOnRecordsChanged(duk_context *ctx, const nlohmann::json &events);
+
+        /**
+         * @brief `beforeRecordCreate(entity, record)`.
+         * @return Why the hook rejected the write: it returned `false` or a message, or threw
+         */
+        static std::optional<std::string> beforeRecordCreate(duk_context *ctx, const std::string &entity,
+                                                             const nlohmann::json &record);
+        /// @brief `beforeRecordUpdate(entity, id, changes)`; as beforeRecordCreate().
+        static std::optional<std::string> beforeRecordUpdate(duk_context *ctx, const std::string &entity,
+                                                             const std::string &recordId,
+                                                             const nlohmann::json &changes);
+
+        /// @brief Whether the scripts define a global function `name`.
+        static bool defines(duk_context *ctx, const char *name);
+
+        /// @brief Whether any after-commit hook is defined, i.e. whether RecordHooks has work to do.
+        static bool definesRecordHooks(duk_context *ctx);
+
+        /**
+         * @brief The jobs of the global `jobs` object, `{name: {schedule, jitter, leased, run}}`.
+         * @return `{name: {schedule, jitter, leased}}` of each entry with a `run` function
+         */
+        static nlohmann::json scheduledJobs(duk_context *ctx);
+
+        /// @brief `jobs[name].run()`. False if it threw or there is no such job.
+        static bool runJob(duk_context *ctx, const std::string &name);
     };
 #endif
 
+    /// @brief Request methods the router serves; MantisRequest::method().
+    enum class RequestMethod : std::uint8_t { Get, Post, Put, Delete, Patch, Options, Head, Unknown };
+
+    /**
+     * @brief The `:name` segments of a route path, found once when the route is registered.
+     *
+     * A request's path params are then views into its own path, by ordinal.
+     */
+    struct PathPattern {
+        /// Most params a route may have; a request keeps their values inline
+        static constexpr std::size_t MAX_PARAMS = 8;
+
+        struct Param {
+            std::string name;
+            std::size_t segment = 0; ///< Index of its `/`-separated segment, counting the empty one before the first `/`
+        };
+
+        std::vector<Param> params;
+
+        /// @throws MantisException (500) for more than MAX_PARAMS params
+        explicit PathPattern(std::string_view path);
+    };
+
     class MantisRequest {
         drogon::HttpRequestPtr m_req;
         ContextStore m_store;
-        std::unordered_map<std::string, std::string> m_pathParams;
+
+        /// Names of the route's params, and their values as views into the path drogon holds
+        std::shared_ptr<const PathPattern> m_pattern;
+        std::array<std::string_view, PathPattern::MAX_PARAMS> m_pathValues{};
+        /// Set by setPathParam(), ahead of the route's; rarely any
+        std::vector<std::pair<std::string, std::string>> m_extraParams;
+
+        /// Resolved on first use; middlewares ask for the client address more than once
+        mutable std::optional<std::optional<IpAddress>> m_remoteIp;
+        mutable std::optional<std::string> m_remoteAddr;
 
         /// Lazily-parsed, cached request body. getBodyAsJson() is called
-        /// several times per request (access-rule evaluation, then the
-        /// handler), so the body is parsed once and reused.
+        /// several times per request (access-rule evaluation, the content
+        /// reader, then the handler), so the body is parsed once and reused.
         mutable std::optional<std::pair<nlohmann::json, std::string>> m_bodyJsonCache;
 
+        /// Body read off a request stream, which drogon doesn't keep
+        std::optional<std::string> m_body;
+
+        /// Backs the ArenaJson documents of this request; see arena()
+        mutable RequestArena m_arena;
+
         /// Owning application, injected by the Router when the request is
         /// wrapped. Request-path code reaches shared services (db, router,
         /// realtime, config) via app() instead of the global singleton.
@@ -53,22 +140,44 @@ namespace mb {
     public:
         explicit MantisRequest(const MantisBase& mb, const drogon::HttpRequestPtr &_req);
         const MantisBase& mApp() const { return m_app; }
+        /// @brief Memory freed with the request, current while its middleware chain runs.
+        RequestArena &arena() const { return m_arena; }
 
         void setPathParam(const std::string &key, const std::string &value);
         void setPathParams(const std::unordered_map<std::string, std::string> &params);
+        /// @brief Take the path params of `pattern` from the request path, without copying them.
+        void setPathParams(std::shared_ptr<const PathPattern> pattern);
 
+        [[nodiscard]] RequestMethod method() const;
+        /// @brief `GET`, `POST`, ... or `UNKNOWN`; static storage.
+        [[nodiscard]] std::string_view methodName() const;
         std::string getMethod() const;
-        std::string getPath() const;
+        /// @brief The path, as drogon holds it; valid while the request is.
+        const std::string &getPath() const;
         std::string getBody() const;
-        std::string getRemoteAddr() const;
+        /// @brief The body without copying it; valid while the request is.
+        std::string_view bodyView() const;
+        /// @brief Use `body` as the request body, for streamed requests whose body drogon doesn't buffer.
+        void setBody(std::string body);
+        /// @brief Client address in canonical form (see IpAddress::toString()); the peer's as is if unparsable.
+        const std::string &getRemoteAddr() const;
+        /// @brief Client address: the first `X-Forwarded-For` entry if valid, else the peer's. Parsed once.
+        const std::optional<IpAddress> &remoteIp() const;
         int getRemotePort() const;
         std::string getLocalAddr() const;
         int getLocalPort() const;
 
-        bool hasHeader(const std::string &key) const;
-        std::string getHeaderValue(const std::string &key, const char *def = "", size_t id = 0) const;
-        size_t getHeaderValueU64(const std::string &key, size_t def = 0, size_t id = 0) const;
-        size_t getHeaderValueCount(const std::string &key) const;
+        bool hasHeader(std::string_view key) const;
+        /**
+         * @brief Header `key`, any case, without copying it; empty if absent. Valid while the request is.
+         *
+         * Allocates nothing: a short lower-case `key` is hashed as is, any
+         * other is compared against each header name.
+         */
+        [[nodiscard]] std::string_view header(std::string_view key) const;
+        std::string getHeaderValue(std::string_view key, const char *def = "", size_t id = 0) const;
+        size_t getHeaderValueU64(std::string_view key, size_t def = 0, size_t id = 0) const;
+        size_t getHeaderValueCount(std::string_view key) const;
 
         bool hasQueryParam(const std::string &key) const;
         std::string getQueryParamValue(const std::string &key) const;
@@ -77,6 +186,10 @@ namespace mb {
 
         bool hasPathParams() const;
         bool hasPathParam(const std::string &key) const;
+        /// @brief Path param `key` without copying it, empty if absent; valid while the request is.
+        [[nodiscard]] std::string_view pathParam(std::string_view key) const;
+        /// @brief The route's `ordinal`-th path param, empty past the last.
+        [[nodiscard]] std::string_view pathParam(std::size_t ordinal) const;
         std::string getPathParamValue(const std::string &key) const;
         size_t getPathParamValueCount(const std::string &key) const;
 
@@ -86,7 +199,11 @@ namespace mb {
 
         bool hasKey(const std::string &key) const;
         std::string getBearerTokenAuth() const;
-        std::pair<nlohmann::json, std::string> getBodyAsJson() const;
+        /**
+         * @brief The body parsed as JSON, once per request.
+         * @return `{json, ""}`, with an empty object for an empty body, or `{{}, error}` if it isn't JSON
+         */
+        const std::pair<nlohmann::json, std::string> &getBodyAsJson() const;
 
         const drogon::HttpRequestPtr& drogonRequest() const { return m_req; }
 
@@ -97,9 +214,23 @@ namespace mb {
 
         template<typename T>
         T &getOr(const std::string &key, T default_value) {
-            return m_store.getOr<T>(key, default_value);
+            return m_store.getOr<T>(key, std::move(default_value));
         }
 
+        /// @brief The auth principal set by getAuthToken() / hydrateContextData(); @see ContextStore::auth()
+        json &auth() { return m_store.auth(); }
+        [[nodiscard]] const json &auth() const { return m_store.auth(); }
+
+        /// @brief The auth token's verification; @see ContextStore::verification()
+        json &verification() { return m_store.verification(); }
+        [[nodiscard]] const json &verification() const { return m_store.verification(); }
+
+        /// @brief Resolve auth() and verification() on first read; @see ContextStore::deferAuth()
+        void deferAuth(ContextStore::AuthResolver resolve) { m_store.deferAuth(std::move(resolve)); }
+
+        /// @brief The entity resolved for this request, if any; @see requestEntity()
+        std::shared_ptr<const Entity> &entity() { return m_store.entity(); }
+
     private:
 #ifdef MB_SCRIPTING_ENABLED
         DukValue get_duk(const std::string &key);
@@ -110,6 +241,7 @@ namespace mb {
 
     class MantisResponse {
         drogon::HttpResponsePtr m_res;
+        WireFormat::Format m_format = WireFormat::Format::Json; ///> What sendJSON() encodes to
 
         const std::string __class_name__ = "mb::MantisResponse";
 
@@ -151,8 +283,47 @@ namespace mb {
         void setFileContent(const std::string &path, const std::string &content_type) const;
         void setFileContent(const std::string &path) const;
 
+        /**
+         * @brief Send `length` bytes of a file from `offset`, without reading it into memory.
+         *
+         * Replaces the underlying response with a file response, keeping the
+         * headers set so far; large bodies go out with sendfile(). A partial
+         * response gets status 206 and a `Content-Range` header.
+         *
+         * @param path File to send
+         * @param offset First byte to send
+         * @param length Bytes to send, 0 for the rest of the file
+         * @param content_type Content-Type header value
+         * @param partial Whether this answers a `Range` request
+         */
+        void sendFile(const std::string &path, size_t offset, size_t length,
+                      const std::string &content_type, bool partial = false);
+
+        /**
+         * @brief Send a body of unknown length, pulled from `reader` as the client takes it.
+         *
+         * Replaces the underlying response with a chunked stream response,
+         * keeping the headers set so far. `reader` fills the buffer it is
+         * given and returns the bytes written, 0 at the end; it runs on the
+         * IO loop, and is called once with nullptr when the stream is done.
+         *
+         * @param reader Body source
+         * @param content_type Content-Type header value
+         * @param filename If set, a `Content-Disposition: attachment` name
+         */
+        void sendStream(std::function<std::size_t(char *, std::size_t)> reader, const std::string &content_type,
+                        const std::string &filename = "");
+
         void send(int statusCode, const std::string &data = "", const std::string &content_type = "text/plain") const;
+        /// @brief The encoding sendJSON() uses; set from the request's `Accept` before the route runs.
+        void setWireFormat(WireFormat::Format format) { m_format = format; }
+        [[nodiscard]] WireFormat::Format wireFormat() const { return m_format; }
+
+        /// Send `data` as JSON, or MessagePack/CBOR if the client asked for it.
         void sendJSON(int statusCode = 200, const json &data = json::object()) const;
+        /// Send an already-serialized JSON body without re-parsing or copying it;
+        /// re-encoded (and so parsed) only for a binary wire format.
+        void sendRawJSON(int statusCode, std::string &&body) const;
 #ifdef MB_SCRIPTING_ENABLED
         void sendJson(int statusCode, const DukValue &data) const;
 #endif
@@ -163,23 +334,26 @@ namespace mb {
         static void registerDuktapeMethods();
     };
 
-    struct FormDataItem {
-        std::string name;
-        std::string content;
-        std::string filename;
-        std::string content_type;
-    };
-
     class MantisContentReader {
         const MantisRequest &m_req;
 
         std::vector<FormDataItem> m_formData;
+        std::vector<std::string> m_writtenFiles; ///> Moved into the entity directory by writeFiles()
         json m_json{}, m_filesMetadata{};
         bool m_parsed = false;
 
     public:
         explicit MantisContentReader(const MantisRequest &req);
 
+        /// @brief Reader over a multipart body already received as `form_data`, file parts staged on disk.
+        MantisContentReader(const MantisRequest &req, std::vector<FormDataItem> form_data);
+
+        /// Removes staged files writeFiles() didn't move into place
+        ~MantisContentReader();
+
+        MantisContentReader(const MantisContentReader &) = delete;
+        MantisContentReader &operator=(const MantisContentReader &) = delete;
+
         [[nodiscard]] bool isMultipartFormData() const;
 
         [[nodiscard]] const std::vector<FormDataItem> &formData() const;
@@ -199,6 +373,7 @@ namespace mb {
     private:
         void read();
         void readMultipart();
+        void appendQueryParameters();
         void readJSON();
         static json getValueFromType(const std::string& type, const std::string& value);
     };
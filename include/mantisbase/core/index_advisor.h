@@ -0,0 +1,126 @@
+/**
+ * @file index_advisor.h
+ * @brief Index suggestions from the list queries the server actually runs.
+ *
+ * Indexes are created only when a schema declares them, and few do. Every
+ * list page whose filter and sort no index serves is recorded here, under
+ * the index that would serve it, with its query time. Admins read the
+ * suggestions from `GET /api/v1/sys/indexes`; with MB_INDEX_AUTO=1, a
+ * pattern that is both frequent and slow gets its index built in the
+ * background (`CONCURRENTLY` on PostgreSQL) and added to the schema.
+ * @see Entity::listIndexRecommendation()
+ */
+
+#ifndef MANTISBASE_INDEX_ADVISOR_H
+#define MANTISBASE_INDEX_ADVISOR_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <nlohmann/json.hpp>
+#include "models/entity_schema_field.h"
+
+namespace mb {
+    /**
+     * @brief Aggregates unindexed list queries per suggested index.
+     *
+     * @code
+     * // Entity::listRows(), after the query
+     * if (const auto idx = listIndexRecommendation(filter.get(), sort_field))
+     *     app.indexAdvisor().record(name(), *idx, took);
+     * // GET /api/v1/sys/indexes
+     * auto top = app.indexAdvisor().suggestions(); // slowest in total first
+     * @endcode
+     */
+    class IndexAdvisor {
+    public:
+        struct Options {
+            bool autoCreate = false;              ///> Build an index once its pattern crosses both thresholds
+            std::size_t minQueries = 1000;        ///> Pages a pattern has served
+            std::chrono::milliseconds minAvg{20}; ///> Their mean query time
+            std::size_t capacity = 256;           ///> Patterns tracked; new ones are ignored past it
+            std::chrono::seconds poll{60};        ///> How often thresholds are checked
+
+            /// @brief Read MB_INDEX_AUTO, MB_INDEX_AUTO_QUERIES and MB_INDEX_AUTO_MS.
+            static Options fromEnv();
+        };
+
+        explicit IndexAdvisor(Options options);
+        ~IndexAdvisor();
+
+        IndexAdvisor(const IndexAdvisor &) = delete;
+        IndexAdvisor &operator=(const IndexAdvisor &) = delete;
+
+        /// @brief Start the thread building indexes. No-op unless Options::autoCreate.
+        void start();
+
+        /// @brief Stop the thread, after the index being built if any. Idempotent.
+        void stop();
+
+        /**
+         * @brief Count one list page `index` would have served.
+         * @param took Time spent running the query and reading its rows
+         */
+        void record(const std::string &entity, const IndexDefinition &index, std::chrono::nanoseconds took);
+
+        /**
+         * @brief `[{"entity", "index", "ddl", "queries", "avg_ms", "max_ms", "total_ms", "error"}]`, highest `total_ms` first.
+         *
+         * `error` is set if building the index automatically failed; it isn't retried.
+         */
+        [[nodiscard]] nlohmann::json suggestions() const;
+
+        /// @brief Drop the patterns of `entity`; its indexes may have changed. Called on schema changes.
+        void forget(const std::string &entity);
+
+        /**
+         * @brief Build `index` on `entity` and add it to the entity's schema.
+         *
+         * PostgreSQL builds it `CONCURRENTLY`, so writes go on meanwhile.
+         * SQLite can't, and holds the write lock while the index is built.
+         * @throw MantisException (404) for an unknown entity, or the database's error
+         */
+        static void createIndex(const std::string &entity, const IndexDefinition &index);
+
+        /**
+         * @brief Build the index of one pattern over both thresholds.
+         * Called by the thread; public for tests.
+         * @return False when no pattern qualifies
+         */
+        bool step();
+
+        [[nodiscard]] std::size_t created() const { return m_created.load(); }
+
+        const Options &options() const { return m_options; }
+
+    private:
+        struct Pattern {
+            std::string entity;
+            IndexDefinition index;
+            std::size_t queries = 0;
+            std::chrono::nanoseconds total{0};
+            std::chrono::nanoseconds max{0};
+            bool attempted = false;   ///> Picked by step(); never picked again
+            std::string error;
+        };
+
+        void loop();
+
+        const Options m_options;
+        std::atomic<std::size_t> m_created{0};
+
+        mutable std::mutex m_mutex;
+        std::map<std::string, Pattern> m_patterns;  ///> By index name, which includes the entity's
+        std::condition_variable m_cv;
+        bool m_stopping = false;
+        bool m_wake = false;
+        std::thread m_thread;
+    };
+}
+
+#endif // MANTISBASE_INDEX_ADVISOR_H
@@ -0,0 +1,61 @@
+/**
+ * @file keyset_page.h
+ * @brief `limit` and `after` of the system listings: API keys, sessions, OAuth accounts and providers, schemas.
+ *
+ * Rather than every row of their table at once, these listings answer a
+ * page by id: rows in id order, at most `limit` of them, after the id given
+ * as `after`, so each page is an index range seek however deep into the
+ * table it is. Keys, sessions and accounts have ids leading with their
+ * creation time, so those come roughly oldest first. A page's `cursor` is
+ * the last id on it, empty on the last page.
+ */
+
+#ifndef MANTISBASE_KEYSET_PAGE_H
+#define MANTISBASE_KEYSET_PAGE_H
+
+#include <string>
+#include <nlohmann/json.hpp>
+
+namespace mb {
+    using json = nlohmann::json;
+    class MantisRequest;
+
+    /**
+     * @brief One page of a listing ordered by id.
+     *
+     * @code
+     * const auto page = KeysetPage::fromQuery(req);
+     * *sql << "... WHERE id > :after ORDER BY id LIMIT :n", soci::use(page.after), soci::use(page.fetch());
+     * return page.envelope(std::move(items)); // {"items", "cursor", "items_count", "limit"}
+     * @endcode
+     */
+    struct KeysetPage {
+        static constexpr int DEFAULT_LIMIT = 100;
+        static constexpr int MAX_LIMIT = 1000;
+
+        int limit = DEFAULT_LIMIT; ///> Rows on the page, 1 to MAX_LIMIT
+        std::string after;         ///> Id of the previous page's last row; empty for the first page
+
+        /**
+         * @brief Read the `limit` and `after` query parameters of `req`.
+         * @throws MantisException (400) if `limit` isn't a number from 1 to MAX_LIMIT
+         */
+        static KeysetPage fromQuery(const MantisRequest &req);
+
+        /// @brief True if `req` asks for a page, with `limit` or `after`.
+        static bool requested(const MantisRequest &req);
+
+        /// @brief Rows to ask the database for: one more than `limit`, telling whether a next page exists.
+        [[nodiscard]] int fetch() const { return limit + 1; }
+
+        /**
+         * @brief Wrap the rows read with fetch() as a page.
+         *
+         * Drops the extra row, and sets `cursor` to the `id` of the last kept
+         * row if there was one, so the last page has an empty `cursor`.
+         */
+        [[nodiscard]] json envelope(json items) const;
+    };
+}
+
+#endif // MANTISBASE_KEYSET_PAGE_H
@@ -4,6 +4,17 @@
  *
  * Manages application-wide settings stored in the database with
  * REST API endpoints for configuration management.
+ *
+ * The settings live in `mb_store` (key `configs`) and are read once, at
+ * setupRoutes(). Readers then get an immutable Snapshot through an atomic
+ * pointer, without locks or database reads; an update stores the new
+ * values, swaps in the next snapshot and tells every subscriber. reload()
+ * does the same for a row changed behind the store's back.
+ *
+ * GET /api/v1/settings hands clients the public subset without auth. It is
+ * serialized once per snapshot, with a strong ETag that only changes with
+ * that subset, and each change of it is announced on `@mb:settings`, so a
+ * client can keep its copy until told otherwise.
  */
 
 #ifndef KV_STORE_H
@@ -11,6 +22,14 @@
 
 #include <mantisbase/core/route_registry.h>
 #include <nlohmann/json.hpp>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
 #include "../utils/utils.h"
 #include "http.h"
 
@@ -20,10 +39,28 @@ namespace mb
 
     /**
      * @brief Manages application settings
+     *
+     * @code
+     * const auto settings = app.settings().snapshot();   // lock-free
+     * const int timeout = settings->values.value("sessionTimeout", 86400);
+     *
+     * app.settings().subscribe([](const KeyValStore::Snapshot& s) { ... s.version ... });
+     * @endcode
      */
     class KeyValStore
     {
     public:
+        /// Settings as of one change; never modified once published
+        struct Snapshot
+        {
+            json values = json::object();
+            std::uint64_t version = 0; ///> 0 until loaded, then bumped on every change
+            std::string publicBody;    ///> GET /api/v1/settings response, publicValues() of `values`
+            std::string publicEtag;    ///> Strong ETag of publicBody; the same across versions it didn't change in
+        };
+
+        using Listener = std::function<void(const Snapshot&)>;
+
         /**
          * @brief Construct the settings store bound to an application.
          * @param app Owning application (db + router access). Stored by
@@ -41,7 +78,7 @@ namespace mb
         bool setupRoutes();
 
         /**
-         * @brief Initialize migration, create base data for setting fields
+         * @brief Load the settings from `mb_store`, storing the defaults if there are none yet.
          */
         void migrate();
 
@@ -59,28 +96,63 @@ namespace mb
 
         // Getter sections
         /**
-         * @brief Get the current config data instance.
+         * @brief Get the current config data.
          *
-         * @return Config data as a JSON object
+         * @return Config data as a JSON object, copied from snapshot()
          */
-        json& configs();
+        json configs() const;
+
+        /// @brief The current settings, shared with whoever else holds them.
+        std::shared_ptr<const Snapshot> snapshot() const;
+
+        /**
+         * @brief Apply the known keys of `patch`, store the result and publish it.
+         * @return The new snapshot
+         * @throw MantisException (400) if `patch` isn't an object
+         */
+        std::shared_ptr<const Snapshot> update(const json& patch);
 
-    private:
         /**
-         * @brief Fetch config data from database, initializing it to defaults if not existing yet!
+         * @brief Read `mb_store` again and publish it if it differs from the current snapshot,
+         * e.g. after another node or a migration changed the row.
+         * @return Whether a new snapshot was published
+         */
+        bool reload();
+
+        /**
+         * @brief Call `listener` with the current snapshot now, and with each new one.
          *
-         * @return json object having the config, or empty json object.
+         * Listeners run on the thread that made the change, after it is
+         * visible through snapshot(); they must not call subscribe() themselves.
+         * @return Id for unsubscribe()
          */
-        json initSettingsConfig();
+        std::size_t subscribe(Listener listener);
+        void unsubscribe(std::size_t id);
+
+        /// @brief Settings a new database starts with.
+        static json defaults();
+
+        /// @brief What anyone may read of `values`: the app's name, URL and the limits clients keep to.
+        static json publicValues(const json& values);
+
+    private:
+        /// The stored settings over the defaults; std::nullopt if there are none yet
+        std::optional<json> stored() const;
+
+        /// Swap in `values` as the next version and notify the listeners
+        std::shared_ptr<const Snapshot> publish(json values);
 
         /**
          * @brief Called by @see setupRoutes() to initialize routes specific to settings config only!
          */
         void setupConfigRoutes();
 
-        // Cache settings config on create/read/update cycles to reduce database reads
-        // may not be that significant though...!
-        json m_configs;
+        std::atomic<std::shared_ptr<const Snapshot>> m_snapshot{std::make_shared<const Snapshot>()};
+
+        std::mutex m_writeMutex; ///> Serializes update(), so versions follow the stored order
+        mutable std::mutex m_listenersMutex;
+        std::vector<std::pair<std::size_t, Listener>> m_listeners;
+        std::size_t m_nextListener = 1;
 
         MantisBase &mApp; ///< Owning application (injected)
     };
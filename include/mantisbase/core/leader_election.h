@@ -0,0 +1,127 @@
+/**
+ * @file leader_election.h
+ * @brief One leader among the nodes sharing a PostgreSQL database.
+ *
+ * Leased jobs run once per tick, on whichever node takes the tick first, so
+ * the work moves between nodes from one tick to the next. Singleton jobs
+ * run only on the leader instead: the node holding the row of
+ * `mb_leader_lease`. The leader renews it every third of MB_LEADER_TTL_SECS;
+ * once it stops, because the node died or lost the database, another node
+ * takes it over within the TTL, and at once when it steps down on shutdown.
+ * Expiry is read on the database's clock, so the nodes' clocks don't have
+ * to agree. On SQLite there is one node and it always leads.
+ * @see Scheduler::Job::singleton
+ */
+
+#ifndef MANTISBASE_LEADER_ELECTION_H
+#define MANTISBASE_LEADER_ELECTION_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <nlohmann/json.hpp>
+
+namespace soci {
+    class session;
+}
+
+namespace mb {
+    class MetricsWriter;
+
+    using json = nlohmann::json;
+
+    /**
+     * @brief Takes and renews this node's lease on the leadership, on its own thread.
+     *
+     * isLeader() answers from memory. It turns false as soon as a renewal
+     * is a full interval late, ahead of the row expiring for the others,
+     * so two nodes never both think they lead.
+     *
+     * @code
+     * scheduler.setLeadership([&leader] { return leader.isLeader(); });
+     * leader.start(app.dbType() == "postgresql");
+     * @endcode
+     */
+    class LeaderElection {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        /// A session on the database the nodes share
+        using Connect = std::function<std::shared_ptr<soci::session>()>;
+
+        struct Options {
+            bool enabled = true;             ///> Off, every node leads and singleton jobs run everywhere
+            std::chrono::seconds ttl{15};    ///> How long a lease lasts without renewal
+            std::string node;                ///> This node's name on the lease
+
+            /// MB_LEADER_ELECTION (`0` turns it off), MB_LEADER_TTL_SECS (at least 3), MB_NODE_ID (a random id if unset)
+            static Options fromEnv();
+        };
+
+        /// @param connect By default a write session of the application database
+        explicit LeaderElection(Options options, Connect connect = {});
+        ~LeaderElection();
+
+        LeaderElection(const LeaderElection &) = delete;
+        LeaderElection &operator=(const LeaderElection &) = delete;
+
+        /**
+         * @brief Start competing for the lease. No-op if running.
+         * @param shared Whether other nodes may share the database; if not, or disabled, this node leads at once
+         */
+        void start(bool shared);
+
+        /// @brief Stop renewing and, when leading, give the lease up for the next node. Idempotent.
+        void stop();
+
+        [[nodiscard]] const Options &options() const { return m_options; }
+
+        /// @brief Whether this node leads now.
+        [[nodiscard]] bool isLeader() const;
+
+        /// @brief Take or renew the lease once. Called by the thread; public for tests.
+        bool renew();
+
+        /// @brief `{"node", "leader", "holder"}`; `holder` is the node leading as of the last renewal, if any.
+        [[nodiscard]] json status() const;
+
+        /// @brief `mb_leader`, `mb_leader_changes_total` and `mb_leader_errors_total`.
+        void writeMetrics(MetricsWriter &out) const;
+
+        /// @brief Take or renew `node`'s lease on `sql` for `ttl` if it's free or already `node`'s.
+        /// @return The node holding it afterwards; empty if none does
+        static std::string claim(soci::session &sql, const std::string &node, std::chrono::seconds ttl);
+
+        /// @brief Let `node`'s lease on `sql` run out now; a no-op if another node holds it.
+        static void release(soci::session &sql, const std::string &node);
+
+    private:
+        void loop();
+
+        /// Between renewals; a third of the TTL
+        [[nodiscard]] Clock::duration interval() const;
+
+        const Options m_options;
+        const Connect m_connect;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_cv;
+        std::string m_holder;  ///> Guarded by m_mutex
+        bool m_stopping = false;
+        std::thread m_thread;
+
+        std::atomic<bool> m_always{false};  ///> Leads without a lease: disabled, or alone on the database
+        std::atomic<bool> m_leading{false};
+        std::atomic<Clock::rep> m_validUntil{0}; ///> Leading until then, unless renewed
+        std::atomic<std::uint64_t> m_changes{0}, m_errors{0};
+    };
+}
+
+#endif // MANTISBASE_LEADER_ELECTION_H
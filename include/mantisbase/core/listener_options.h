@@ -0,0 +1,68 @@
+/**
+ * @file listener_options.h
+ * @brief Connection reuse, connection limits and TLS of the HTTP listener.
+ *
+ * Resolved once, when the server starts: the `http` setting, then the
+ * `serve` flags, then MB_HTTP_* / MB_TLS_* environment variables, each
+ * overriding the one before. See Router::listen().
+ */
+
+#ifndef MANTISBASE_LISTENER_OPTIONS_H
+#define MANTISBASE_LISTENER_OPTIONS_H
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace mb {
+    using json = nlohmann::json;
+
+    /**
+     * @brief What the HTTP listener is configured with.
+     *
+     * @code
+     * ListenerOptions options;
+     * options.merge(settings.values.value("http", json::object()));
+     * options.merge(flags);
+     * options.mergeEnv();
+     * @endcode
+     */
+    struct ListenerOptions {
+        std::chrono::seconds idleTimeout{60}; ///> Close a connection idle this long, keep-alive included; 0 = never
+        std::size_t keepAliveRequests = 0;    ///> Requests served on one connection before it is closed; 0 = no limit
+        std::size_t maxConnections = 100000;  ///> Connections open at once; more are refused
+        std::size_t maxConnectionsPerIp = 0;  ///> Connections open at once from one client address; 0 = no limit
+        std::string tlsCert;                  ///> PEM certificate (chain); with tlsKey, the listener speaks HTTPS
+        std::string tlsKey;                   ///> PEM private key
+        bool tlsSessionTickets = true;        ///> Let clients resume TLS sessions from tickets
+
+        /**
+         * @brief Overlay the keys `values` holds: `idleTimeout` (seconds),
+         * `keepAliveRequests`, `maxConnections`, `maxConnectionsPerIp`,
+         * `tlsCert`, `tlsKey` and `tlsSessionTickets`.
+         * @throws MantisException (400) naming a key of the wrong type, or a negative count
+         */
+        void merge(const json &values);
+
+        /**
+         * @brief Overlay MB_HTTP_IDLE_TIMEOUT, MB_HTTP_KEEPALIVE_REQUESTS,
+         * MB_HTTP_MAX_CONNECTIONS, MB_HTTP_MAX_CONNECTIONS_PER_IP, MB_TLS_CERT,
+         * MB_TLS_KEY and MB_TLS_SESSION_TICKETS, where set.
+         */
+        void mergeEnv();
+
+        /// @brief True if both a certificate and a key are set.
+        [[nodiscard]] bool tls() const { return !tlsCert.empty() && !tlsKey.empty(); }
+
+        /// @brief `SSL_CONF_cmd` pairs for the TLS listener.
+        [[nodiscard]] std::vector<std::pair<std::string, std::string>> sslConfCommands() const;
+
+        /// @brief The connection settings, as the `http` setting stores them (no TLS files).
+        [[nodiscard]] json toJSON() const;
+    };
+}
+
+#endif // MANTISBASE_LISTENER_OPTIONS_H
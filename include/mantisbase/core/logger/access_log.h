@@ -0,0 +1,122 @@
+/**
+ * @file access_log.h
+ * @brief Sampling, rate limiting and counters for the HTTP access log.
+ *
+ * Every request used to write an info line to the console and to
+ * `mantis_logs.db`. AccessLog decides which requests are written and counts
+ * all of them, so traffic sampled away still shows up in the numbers served
+ * by `GET /api/v1/sys/logs` under `access`.
+ * @see Router::loggerPostHandlingAdvice()
+ */
+
+#ifndef MB_ACCESS_LOG_H
+#define MB_ACCESS_LOG_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace mb {
+    /**
+     * @brief Decides which finished requests are logged, and counts them all.
+     *
+     * A request is logged if it is slow, otherwise with the sample rate of
+     * its status: `errorSampleRate` for 4xx/5xx, else `sampleRate` or the
+     * rate of the longest matching route prefix. Logged lines are then capped
+     * at `maxPerSecond`.
+     *
+     * Thread-safe; record() is a few relaxed atomic operations. The rolling
+     * minute is kept in per-second buckets, and a bucket being reused for a
+     * new second may lose the counts of requests racing with the reset.
+     *
+     * @code
+     * if (accessLog.record(req->path(), status, latency))
+     *     LogOrigin::info("HTTP", line);
+     * @endcode
+     */
+    class AccessLog {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        struct Options {
+            double sampleRate = 1.0;              ///> Share of 1xx-3xx requests logged
+            double errorSampleRate = 1.0;         ///> Share of 4xx/5xx requests logged
+            std::chrono::milliseconds slow{1000}; ///> Always log requests this slow; zero disables
+            std::uint32_t maxPerSecond = 0;       ///> Most lines per second; zero is unlimited
+            std::vector<std::pair<std::string, double>> routes; ///> (path prefix, sampleRate) overrides
+
+            /**
+             * @brief Read MB_ACCESS_LOG_SAMPLE, MB_ACCESS_LOG_ERROR_SAMPLE, MB_ACCESS_LOG_SLOW_MS,
+             * MB_ACCESS_LOG_MAX_PER_SEC and MB_ACCESS_LOG_ROUTES.
+             */
+            static Options fromEnv();
+
+            /// @brief Parse `prefix=rate,prefix=rate`; malformed pairs are skipped.
+            static std::vector<std::pair<std::string, double>> parseRoutes(const std::string &spec);
+        };
+
+        struct Counts {
+            std::uint64_t requests = 0;
+            std::uint64_t logged = 0;
+            std::uint64_t sampledOut = 0;  ///> Not logged by sampling
+            std::uint64_t rateLimited = 0; ///> Sampled in, but over maxPerSecond
+            std::uint64_t slow = 0;
+            std::array<std::uint64_t, 5> byClass{}; ///> 1xx..5xx
+            double totalMs = 0;
+        };
+
+        struct Snapshot {
+            Counts total;
+            Counts lastMinute; ///> The 60 seconds up to the snapshot
+        };
+
+        AccessLog();
+        explicit AccessLog(Options options);
+
+        /// @brief Count a finished request; true if it should be logged.
+        bool record(std::string_view path, int status, std::chrono::microseconds latency,
+                    Clock::time_point now = Clock::now());
+
+        [[nodiscard]] Snapshot snapshot(Clock::time_point now = Clock::now()) const;
+
+        [[nodiscard]] const Options &options() const { return m_options; }
+
+    private:
+        enum class Outcome { Logged, SampledOut, RateLimited };
+
+        struct Counters {
+            std::atomic<std::uint64_t> requests{0}, logged{0}, sampledOut{0}, rateLimited{0}, slow{0};
+            std::array<std::atomic<std::uint64_t>, 5> byClass{};
+            std::atomic<std::uint64_t> totalUs{0};
+
+            void add(int status_class, bool slow_request, std::chrono::microseconds latency, Outcome outcome);
+            void reset();
+            void addTo(Counts &counts) const;
+        };
+
+        struct Bucket {
+            std::atomic<std::int64_t> second{-1};
+            Counters counters;
+        };
+
+        static constexpr std::size_t kWindow = 60;
+
+        [[nodiscard]] double rateFor(std::string_view path, int status) const;
+        bool allowLine(std::int64_t second);
+
+        const Options m_options;
+        const Clock::time_point m_epoch;
+
+        Counters m_total;
+        std::array<Bucket, kWindow> m_buckets;
+        std::atomic<std::int64_t> m_limitSecond{-1};
+        std::atomic<std::uint32_t> m_limitCount{0};
+    };
+}
+
+#endif // MB_ACCESS_LOG_H
@@ -3,7 +3,10 @@
  * @brief SQLite database manager for application logs.
  *
  * Manages a separate SQLite database for storing application logs with
- * automatic cleanup of old records.
+ * automatic cleanup of old records. Logs are stored in one table per UTC day
+ * (`mb_logs_YYYYMMDD`), so retention drops whole tables instead of deleting rows.
+ * Each batch also adds its counts per minute, level, origin and route to
+ * `mb_log_rollups`, so charts and error-rate alerts never scan the logs.
  */
 
 #ifndef MB_LOG_DATABASE_H
@@ -11,12 +14,14 @@
 
 #include <string>
 #include <memory>
-#include <thread>
 #include <atomic>
-#include <condition_variable>
 #include <mutex>
+#include <set>
+#include <vector>
 #include <nlohmann/json.hpp>
 
+#include "log_queue.h"
+
 namespace soci {
     class session;
 }
@@ -28,10 +33,20 @@ namespace mb {
      * @brief Manages SQLite database for application logs.
      *
      * Provides methods to store logs in a separate SQLite database,
-     * with automatic cleanup of logs older than 5 days.
+     * with automatic cleanup of logs older than 5 days. Inserts are queued
+     * and written in batches by a background thread (see LogQueue).
      */
     class LogDatabase {
     public:
+        /// Entries of one minute, level, origin and route (the route pattern of HTTP lines, else empty)
+        struct Rollup {
+            long long minute = 0; ///> Unix seconds, a multiple of 60
+            std::string level;
+            std::string origin;
+            std::string route;
+            long long count = 0;
+        };
+
         /**
          * @brief Construct LogDatabase instance.
          */
@@ -49,28 +64,33 @@ namespace mb {
         bool init(const std::string& data_dir = "");
 
         /**
-         * @brief Insert a log entry into the database.
+         * @brief Queue a log entry for the database.
+         *
+         * Returns once the entry is queued; the writer thread stores it
+         * within MB_LOG_FLUSH_MS.
          * @param level Log level (trace, debug, info, warn, critical)
          * @param origin Component/system origin (System, Auth, Database, Entity, EntitySchema, etc.)
          * @param message Short message (e.g., "Auth Failed", "Database Connected")
          * @param details Long description of the message
          * @param data Optional JSON data associated with the log
-         * @return true if insert successful, false otherwise
+         * @return true if queued, false if the database isn't open or the entry was dropped
          */
         bool insertLog(const std::string& level, const std::string& origin, const std::string& message, 
-                       const std::string& details, const json& data = json::object());
+                       const std::string& details, const json& data = json());
 
         /**
          * @brief Get logs with cursor-based pagination, filtering, and sorting.
-         * @param after Cursor ID to fetch records after (empty = start from beginning)
+         * @param after `cursor` of the previous page (empty = start from beginning)
          * @param limit Maximum number of records to return (default 50, max 1000)
          * @param level_filter Optional level filter (empty = all levels)
-         * @param search_filter Optional message search filter (empty = no filter)
+         * @param search_filter Optional words to find in message or details, matched as
+         *                      prefixes through the full-text index (empty = no filter)
          * @param start_date Optional start date filter (ISO 8601 format, empty = no filter)
          * @param end_date Optional end date filter (ISO 8601 format, empty = no filter)
          * @param sort_by Sort field (default: "timestamp")
          * @param sort_order Sort order ("asc" or "desc", default: "desc")
          * @return JSON object with logs and cursor info
+         * @throws MantisException 400 for a malformed cursor
          */
         json getLogs(const std::string& after = "", int limit = 50,
                      const std::string& level_filter = "",
@@ -79,36 +99,107 @@ namespace mb {
                      const std::string& end_date = "",
                      const std::string& sort_by = "timestamp",
                      const std::string& sort_order = "desc");
-    private:
+
         /**
-         * @brief Shutdown and clean up log database.
+         * @brief Store one slow-query log entry in `mb_slow_queries`, see SlowQueryLog.
+         * @param entry `created_at`, `fingerprint`, `query`, `sql`, `params`,
+         *              `duration_ms`, `rows` and `plan`
          */
-        void shutdown();
+        void insertSlowQuery(const json& entry);
 
         /**
-         * @brief Create the logs table if it doesn't exist.
+         * @brief Slow queries summed up by fingerprint, the most time spent first.
+         *
+         * Each item has the normalized `query`, `count`, `total_ms`, `avg_ms`,
+         * `max_ms` and `last_seen` over the retained days, with the `sql` and
+         * `params` of the slowest run and the latest captured `plan`.
+         * @param limit Maximum number of fingerprints (1 to 1000)
+         * @param since Only entries created at or after this Unix time (0 = all)
          */
-        void createTable() const;
+        json slowQueries(int limit = 50, long long since = 0);
+
+        /**
+         * @brief Entry counts from the rollups, per `bucket` seconds and value of `by`.
+         * @param by `level`, `origin` or `route`
+         * @param since,until Unix seconds, `until` excluded
+         * @param bucket Seconds per point, a multiple of 60
+         * @param level Only entries of this level (empty = all)
+         * @return `[{"time", "key", "count"}]`, oldest first
+         * @throws MantisException 400 for an unknown `by`, a bad bucket, or more than 10000 buckets
+         */
+        json rollups(const std::string& by, long long since, long long until, long long bucket = 60,
+                     const std::string& level = "");
+
+        /**
+         * @brief Origins logging `critical` entries at `per_minute` or more over the last `window` seconds.
+         * @return `[{"origin", "count", "per_minute"}]`, the busiest first
+         */
+        json alerts(long long window, double per_minute);
+
+        /// @brief The rollup rows a batch adds to, counted.
+        static std::vector<Rollup> rollup(const std::vector<LogQueue::Entry>& batch);
+
+        /// @brief Write every queued entry now, on the calling thread.
+        void flush();
+
+        /// @brief Queue and writer counters: `queued`, `written`, `batches`, `dropped`, `failed`, `capacity`.
+        [[nodiscard]] json stats() const;
 
         /**
-         * @brief Background thread function to delete old logs.
+         * @brief Turn search input into an FTS5 MATCH expression.
+         *
+         * Every whitespace-separated word becomes a quoted prefix term
+         * (`"word"*`), all of which must match.
+         * @return Empty if `search` has no words
          */
-        void cleanupThread();
+        static std::string ftsQuery(const std::string& search);
+
+        /// @brief Partition table holding entries created at `created_at` (Unix seconds, UTC day).
+        static std::string partitionName(long long created_at);
+
+        /// @brief Partition table for the day of an ISO 8601 date; empty if `date` doesn't start with one.
+        static std::string partitionForDate(const std::string& date);
 
         /**
-         * @brief Delete logs older than specified days.
+         * @brief Drop the partitions of days that ended more than `days` ago,
+         * and slow queries and rollups as old.
+         * Run hourly by the `log-retention` job, see Scheduler.
          * @param days Number of days to keep (default: 5)
          */
         void deleteOldLogs(int days = 5);
 
+    private:
+        /**
+         * @brief Shutdown and clean up log database.
+         */
+        void shutdown();
+
+        /**
+         * @brief Load the existing partitions, moving rows of an unpartitioned `mb_logs` into them.
+         */
+        void createTable();
+
+        /// @brief Create partition `name` with its indexes, unless it exists.
+        void ensurePartition(const std::string& name);
+
+        /// @brief Move rows of the pre-partitioning `mb_logs` table into day partitions, then drop it.
+        void migrateLegacyTable();
+
+        /// @brief Create `mb_log_rollups`, counting the entries already stored when it is new.
+        void createRollups();
+
         static std::string buildMinLogWhereCondition(const std::string& level);
 
+        /// @brief Insert a batch of entries in one transaction; the LogQueue writer.
+        void writeBatch(std::vector<LogQueue::Entry> &batch);
+
         std::string m_dataDir;
         std::unique_ptr<soci::session> m_session;
-        std::thread m_cleanupThread;
+        std::unique_ptr<LogQueue> m_queue;
         std::atomic<bool> m_running;
-        std::condition_variable m_cv;
         std::mutex m_dbMutexLock;
+        bool m_hasFts = false; ///> Partitions have a `_fts` index; search falls back to LIKE otherwise
+        std::set<std::string> m_partitions; ///> Partition tables, oldest first; guarded by m_dbMutexLock
 
         inline static const std::vector<std::string> m_logLevels{ "critical", "warn", "info", "debug", "trace"};
     };
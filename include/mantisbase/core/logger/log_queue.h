@@ -0,0 +1,141 @@
+/**
+ * @file log_queue.h
+ * @brief Bounded queue and background writer for database log entries.
+ *
+ * Logging used to insert each entry into `mantis_logs.db` on the calling
+ * thread, so every request paid a SQLite write for its access log. LogQueue
+ * takes the entry instead, and a writer thread stores the queued entries in
+ * batches, one transaction each, every `flush` interval or as soon as a
+ * batch is full.
+ * @see log_database.h
+ */
+
+#ifndef MB_LOG_QUEUE_H
+#define MB_LOG_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mb {
+    /**
+     * @brief Bounded lock-free multi-producer log queue with a batching writer thread.
+     *
+     * Any thread may push(). When the queue is full, the Policy decides which
+     * entry is lost, and every lost entry is counted in Stats::dropped.
+     *
+     * @code
+     * LogQueue queue([&](std::vector<LogQueue::Entry> &batch) { insertAll(batch); },
+     *                LogQueue::Options::fromEnv());
+     * queue.start();
+     * queue.push(std::move(entry));
+     * // ... on shutdown, writes what is still queued:
+     * queue.stop();
+     * @endcode
+     */
+    class LogQueue {
+    public:
+        /// A log row, formatted by the producer so the writer only binds it.
+        struct Entry {
+            std::string id;
+            std::string timestamp;  ///> ISO 8601, UTC, milliseconds
+            std::string level;
+            std::string origin;
+            std::string message;
+            std::string details;
+            std::string data;       ///> Serialized JSON, empty if none
+            long long createdAt = 0; ///> Unix seconds
+            std::string route;      ///> `data.route`, for the rollups; empty if none
+        };
+
+        /// What push() does when the queue is full.
+        enum class Policy {
+            DropNewest, ///> Drop the entry being pushed
+            DropOldest, ///> Make room by dropping the oldest queued entry
+            Block       ///> Wait for the writer to make room
+        };
+
+        /// Stores one batch; throws to count the whole batch as failed.
+        using Writer = std::function<void(std::vector<Entry> &)>;
+
+        struct Options {
+            std::size_t capacity = 8192;         ///> Queue slots, rounded up to a power of two
+            std::size_t batch = 256;             ///> Most entries written per transaction
+            std::chrono::milliseconds flush{200}; ///> Longest an entry waits to be written
+            Policy policy = Policy::DropNewest;
+
+            /// @brief Read MB_LOG_QUEUE_SIZE, MB_LOG_BATCH_SIZE, MB_LOG_FLUSH_MS and MB_LOG_DROP_POLICY.
+            static Options fromEnv();
+        };
+
+        struct Stats {
+            std::uint64_t queued = 0;  ///> Entries waiting to be written
+            std::uint64_t written = 0; ///> Entries stored
+            std::uint64_t batches = 0; ///> Transactions committed
+            std::uint64_t dropped = 0; ///> Entries lost to a full queue
+            std::uint64_t failed = 0;  ///> Entries in batches the writer threw on
+            std::uint64_t capacity = 0; ///> Queue slots, after rounding up
+        };
+
+        LogQueue(Writer writer, Options options);
+        ~LogQueue();
+
+        LogQueue(const LogQueue &) = delete;
+        LogQueue &operator=(const LogQueue &) = delete;
+
+        void start();
+
+        /// @brief Stop the writer thread and write what is still queued. Idempotent.
+        void stop();
+
+        /// @brief Queue an entry; false if it, or under DropOldest another one, was dropped.
+        bool push(Entry entry);
+
+        /// @brief Write everything queued so far on the calling thread.
+        void flush();
+
+        /// @brief Write up to one batch; returns the entries taken. Called by the thread; public for tests.
+        std::size_t drain();
+
+        [[nodiscard]] Stats stats() const;
+
+    private:
+        struct Cell {
+            std::atomic<std::size_t> sequence;
+            Entry entry;
+        };
+
+        bool tryPush(Entry &entry);
+        bool tryPop(Entry &entry);
+        void loop();
+
+        Writer m_writer;
+        const Options m_options;
+
+        std::size_t m_mask;
+        std::unique_ptr<Cell[]> m_cells;
+        alignas(64) std::atomic<std::size_t> m_head{0}; ///> Next slot to push into
+        alignas(64) std::atomic<std::size_t> m_tail{0}; ///> Next slot to pop from
+        std::atomic<std::size_t> m_size{0};
+
+        std::atomic<std::uint64_t> m_written{0}, m_batches{0}, m_dropped{0}, m_failed{0};
+
+        std::mutex m_drainMutex;            ///> One batch writer at a time
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        bool m_stopping = false;
+        bool m_wake = false;                ///> A full batch is waiting
+        std::atomic<bool> m_running{false};
+        std::thread m_thread;
+    };
+}
+
+#endif // MB_LOG_QUEUE_H
@@ -11,7 +11,11 @@
 #include <iostream>
 #include <nlohmann/json.hpp>
 #include <spdlog/spdlog.h>
+#include <spdlog/async_logger.h>
 #include <spdlog/sinks/basic_file_sink.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 
 #include "log_database.h"
@@ -40,21 +44,67 @@ namespace mb {
      */
     class Logger {
         std::unique_ptr<LogDatabase> m_logsDb;
+        std::shared_ptr<spdlog::details::thread_pool> m_consolePool; ///> Writer of an async console, else null
 
     public:
+        /**
+         * @brief How lines reach the console.
+         *
+         * Async by default: a logging thread only queues its line and a
+         * writer thread formats and writes it, so a slow stdout reader holds
+         * up that thread instead of the requests. With `json`, each line is
+         * one object (`time`, `level`, `origin`, `message`, plus `details`
+         * and `data` when set) for log collectors.
+         */
+        struct ConsoleOptions {
+            bool async = true;
+            std::size_t queueSize = 8192; ///> Lines the writer may fall behind by
+            spdlog::async_overflow_policy overflow = spdlog::async_overflow_policy::block;
+            bool json = false;
+
+            /// @brief Read MB_LOG_CONSOLE_ASYNC, MB_LOG_CONSOLE_QUEUE_SIZE, MB_LOG_CONSOLE_POLICY and MB_LOG_FORMAT.
+            static ConsoleOptions fromEnv();
+        };
+
         Logger();
-        ~Logger() { std::cout << "Logger Des()" << std::endl; }
+        explicit Logger(const ConsoleOptions &console);
+        ~Logger();
 
         inline static std::atomic<bool> isDbInitialized = false;
 
         static void setLogLevel(const LogLevel &level = LogLevel::INFO);
 
+        /**
+         * @brief Whether messages at `level` are logged at all.
+         *
+         * The level methods below check this before formatting, but their
+         * arguments are built by the caller; guard call sites that format or
+         * dump JSON on a hot path with it (or use MB_LOG_TRACE/MB_LOG_DEBUG).
+         */
+        static bool enabled(const LogLevel level) {
+            return spdlog::default_logger_raw()->should_log(toSpdlog(level));
+        }
+
+        static constexpr spdlog::level::level_enum toSpdlog(const LogLevel level) {
+            switch (level) {
+                case LogLevel::TRACE: return spdlog::level::trace;
+                case LogLevel::DEBUG: return spdlog::level::debug;
+                case LogLevel::INFO: return spdlog::level::info;
+                case LogLevel::WARN: return spdlog::level::warn;
+                case LogLevel::CRITICAL: return spdlog::level::critical;
+            }
+            return spdlog::level::info;
+        }
+
         /**
          * @brief Get the log database instance (for API access).
          * @return Pointer to LogDatabase instance, or nullptr if not initialized
          */
         [[nodiscard]] LogDatabase &logsDb() const;
 
+        /// @brief Console lines lost to a full queue (async console without `block`).
+        [[nodiscard]] std::uint64_t consoleDropped() const;
+
         /**
          * @brief Initialize database connection.
          */
@@ -68,59 +118,43 @@ namespace mb {
         static void trace(const std::string &origin,
                           const std::string &message,
                           const std::string &details = "",
-                          const json &data = json::object());
+                          const json &data = json());
 
         static void info(const std::string &origin,
                          const std::string &message,
                          const std::string &details = "",
-                         const json &data = json::object());
+                         const json &data = json());
 
         static void debug(const std::string &origin,
                           const std::string &message,
                           const std::string &details = "",
-                          const json &data = json::object());
+                          const json &data = json());
 
         static void warn(const std::string &origin,
                          const std::string &message,
                          const std::string &details = "",
-                         const json &data = json::object());
+                         const json &data = json());
 
         static void critical(const std::string &origin,
                              const std::string &message,
                              const std::string &details = "",
-                             const json &data = json::object());
+                             const json &data = json());
 
     private:
-        template<typename... Args>
-        static void trace_spdlog(fmt::format_string<Args...> msg, Args &&... args) {
-            spdlog::trace(msg, std::forward<Args>(args)...);
-        }
-
-        template<typename... Args>
-        static void info_spdlog(fmt::format_string<Args...> msg, Args &&... args) {
-            spdlog::info(msg, std::forward<Args>(args)...);
-        }
+        inline static std::atomic<bool> s_jsonConsole = false;
 
-        template<typename... Args>
-        static void debug_spdlog(fmt::format_string<Args...> msg, Args &&... args) {
-            spdlog::debug(msg, std::forward<Args>(args)...);
-        }
-
-        template<typename... Args>
-        static void warn_spdlog(fmt::format_string<Args...> msg, Args &&... args) {
-            spdlog::warn(msg, std::forward<Args>(args)...);
-        }
-
-        template<typename... Args>
-        static void critical_spdlog(fmt::format_string<Args...> msg, Args &&... args) {
-            spdlog::critical(msg, std::forward<Args>(args)...);
-        }
+        /// Write the entry to the console, as text or JSON per ConsoleOptions
+        static void toConsole(LogLevel level,
+                              const std::string &origin,
+                              const std::string &message,
+                              const std::string &details,
+                              const json &data);
 
         static void logToDatabase(const std::string &level,
                                   const std::string &origin,
                                   const std::string &message,
                                   const std::string &details,
-                                  const json &data = json::object());
+                                  const json &data = json());
     };
 
     namespace logEntry {
@@ -128,35 +162,35 @@ namespace mb {
         inline void trace(const std::string &origin,
                           const std::string &message,
                           const std::string &details = "",
-                          const json &data = json::object()) {
+                          const json &data = json()) {
             Logger::trace(origin, message, details, data);
         }
 
         inline void info(const std::string &origin,
                          const std::string &message,
                          const std::string &details = "",
-                         const json &data = json::object()) {
+                         const json &data = json()) {
             Logger::info(origin, message, details, data);
         }
 
         inline void debug(const std::string &origin,
                           const std::string &message,
                           const std::string &details = "",
-                          const json &data = json::object()) {
+                          const json &data = json()) {
             Logger::debug(origin, message, details, data);
         }
 
         inline void warn(const std::string &origin,
                          const std::string &message,
                          const std::string &details = "",
-                         const json &data = json::object()) {
+                         const json &data = json()) {
             Logger::warn(origin, message, details, data);
         }
 
         inline void critical(const std::string &origin,
                              const std::string &message,
                              const std::string &details = "",
-                             const json &data = json::object()) {
+                             const json &data = json()) {
             Logger::critical(origin, message, details, data);
         }
     }
@@ -169,155 +203,155 @@ namespace mb {
         // System logging
         inline void trace(const std::string &message,
                           const std::string &details = "",
-                          const json &data = json::object()) {
+                          const json &data = json()) {
             Logger::trace("System", message, details, data);
         }
 
         inline void info(const std::string &message,
                          const std::string &details = "",
-                         const json &data = json::object()) {
+                         const json &data = json()) {
             Logger::info("System", message, details, data);
         }
 
         inline void debug(const std::string &message,
                           const std::string &details = "",
-                          const json &data = json::object()) {
+                          const json &data = json()) {
             Logger::debug("System", message, details, data);
         }
 
         inline void warn(const std::string &message,
                          const std::string &details = "",
-                         const json &data = json::object()) {
+                         const json &data = json()) {
             Logger::warn("System", message, details, data);
         }
 
         inline void critical(const std::string &message,
                              const std::string &details = "",
-                             const json &data = json::object()) {
+                             const json &data = json()) {
             Logger::critical("System", message, details, data);
         }
 
         // Auth logging
         inline void authTrace(const std::string &message,
                               const std::string &details = "",
-                              const json &data = json::object()) {
+                              const json &data = json()) {
             Logger::trace("Auth", message, details, data);
         }
 
         inline void authInfo(const std::string &message,
                              const std::string &details = "",
-                             const json &data = json::object()) {
+                             const json &data = json()) {
             Logger::info("Auth", message, details, data);
         }
 
         inline void authDebug(const std::string &message,
                               const std::string &details = "",
-                              const json &data = json::object()) {
+                              const json &data = json()) {
             Logger::debug("Auth", message, details, data);
         }
 
         inline void authWarn(const std::string &message,
                              const std::string &details = "",
-                             const json &data = json::object()) {
+                             const json &data = json()) {
             Logger::warn("Auth", message, details, data);
         }
 
         inline void authCritical(const std::string &message,
                                  const std::string &details = "",
-                                 const json &data = json::object()) {
+                                 const json &data = json()) {
             Logger::critical("Auth", message, details, data);
         }
 
         // Database logging
         inline void dbTrace(const std::string &message,
                             const std::string &details = "",
-                            const json &data = json::object()) {
+                            const json &data = json()) {
             Logger::trace("Database", message, details, data);
         }
 
         inline void dbInfo(const std::string &message,
                            const std::string &details = "",
-                           const json &data = json::object()) {
+                           const json &data = json()) {
             Logger::info("Database", message, details, data);
         }
 
         inline void dbDebug(const std::string &message,
                             const std::string &details = "",
-                            const json &data = json::object()) {
+                            const json &data = json()) {
             Logger::debug("Database", message, details, data);
         }
 
         inline void dbWarn(const std::string &message,
                            const std::string &details = "",
-                           const json &data = json::object()) {
+                           const json &data = json()) {
             Logger::warn("Database", message, details, data);
         }
 
         inline void dbCritical(const std::string &message,
                                const std::string &details = "",
-                               const json &data = json::object()) {
+                               const json &data = json()) {
             Logger::critical("Database", message, details, data);
         }
 
         // Entity logging
         inline void entityTrace(const std::string &message,
                                 const std::string &details = "",
-                                const json &data = json::object()) {
+                                const json &data = json()) {
             Logger::trace("Entity", message, details, data);
         }
 
         inline void entityInfo(const std::string &message,
                                const std::string &details = "",
-                               const json &data = json::object()) {
+                               const json &data = json()) {
             Logger::info("Entity", message, details, data);
         }
 
         inline void entityDebug(const std::string &message,
                                 const std::string &details = "",
-                                const json &data = json::object()) {
+                                const json &data = json()) {
             Logger::debug("Entity", message, details, data);
         }
 
         inline void entityWarn(const std::string &message,
                                const std::string &details = "",
-                               const json &data = json::object()) {
+                               const json &data = json()) {
             Logger::warn("Entity", message, details, data);
         }
 
         inline void entityCritical(const std::string &message,
                                    const std::string &details = "",
-                                   const json &data = json::object()) {
+                                   const json &data = json()) {
             Logger::critical("Entity", message, details, data);
         }
 
         // EntitySchema logging
         inline void entitySchemaTrace(const std::string &message,
                                       const std::string &details = "",
-                                      const json &data = json::object()) {
+                                      const json &data = json()) {
             Logger::trace("EntitySchema", message, details, data);
         }
 
         inline void entitySchemaInfo(const std::string &message,
                                      const std::string &details = "",
-                                     const json &data = json::object()) {
+                                     const json &data = json()) {
             Logger::info("EntitySchema", message, details, data);
         }
 
         inline void entitySchemaDebug(const std::string &message,
                                       const std::string &details = "",
-                                      const json &data = json::object()) {
+                                      const json &data = json()) {
             Logger::debug("EntitySchema", message, details, data);
         }
 
         inline void entitySchemaWarn(const std::string &message,
                                      const std::string &details = "",
-                                     const json &data = json::object()) {
+                                     const json &data = json()) {
             Logger::warn("EntitySchema", message, details, data);
         }
 
         inline void entitySchemaCritical(const std::string &message,
                                          const std::string &details = "",
-                                         const json &data = json::object()) {
+                                         const json &data = json()) {
             Logger::critical("EntitySchema", message, details, data);
         }
     }
@@ -328,11 +362,24 @@ namespace mb {
      */
     class FuncLogger {
     public:
-        explicit FuncLogger(std::string msg);
+        /// Copies `msg` only if trace logging is enabled.
+        explicit FuncLogger(const std::string &msg);
+
+        /// Calls `make` for the message only if trace logging is enabled.
+        template<typename F> requires std::is_invocable_r_v<std::string, F>
+        explicit FuncLogger(F &&make) : m_enabled(Logger::enabled(LogLevel::TRACE)) {
+            if (m_enabled) {
+                m_msg = std::forward<F>(make)();
+                enter();
+            }
+        }
 
         ~FuncLogger();
 
     private:
+        void enter() const;
+
+        bool m_enabled;
         std::string m_msg;
     };
 }
@@ -345,8 +392,14 @@ inline std::string getFile(const std::string &path) {
 
 #define MB_FUNC() std::format("{} - {}()", getFile(__FILE__), __FUNCTION__)
 #define TRACE_FUNC(x) mb::FuncLogger _logger(x);
-#define TRACE_MB_FUNC() try{ mb::FuncLogger _logger(MB_FUNC()); } catch(...){}
-#define TRACE_CLASS_METHOD() mb::FuncLogger _logger(std::format("{} {}::{}()", getFile(__FILE__), "", __FUNCTION__));
-#define TRACE_METHOD() mb::FuncLogger _logger(std::format("{} {}()", getFile(__FILE__), __FUNCTION__));
+// The names are captured outside the lambdas, where __FUNCTION__ would be "operator()"
+#define TRACE_MB_FUNC() try{ mb::FuncLogger _logger([fn = __FUNCTION__] { return std::format("{} - {}()", getFile(__FILE__), fn); }); } catch(...){}
+#define TRACE_CLASS_METHOD() mb::FuncLogger _logger([fn = __FUNCTION__] { return std::format("{} {}::{}()", getFile(__FILE__), "", fn); });
+#define TRACE_METHOD() mb::FuncLogger _logger([fn = __FUNCTION__] { return std::format("{} {}()", getFile(__FILE__), fn); });
+
+// Call a LogOrigin/logEntry function only when its level is enabled, so the
+// arguments (fmt::format, json dumps) aren't evaluated otherwise.
+#define MB_LOG_TRACE(fn, ...) do { if (mb::Logger::enabled(mb::LogLevel::TRACE)) fn(__VA_ARGS__); } while (0)
+#define MB_LOG_DEBUG(fn, ...) do { if (mb::Logger::enabled(mb::LogLevel::DEBUG)) fn(__VA_ARGS__); } while (0)
 
 #endif // MB_LOGGER_H
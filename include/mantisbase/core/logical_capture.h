@@ -0,0 +1,108 @@
+/**
+ * @file logical_capture.h
+ * @brief PostgreSQL change capture from a logical replication slot instead of triggers.
+ *
+ * The `mb_notify_changes()` trigger runs for every written row: it builds
+ * the row as JSON, inserts it into `mb_change_log` and calls `pg_notify`,
+ * all inside the writer's transaction, and NOTIFY serializes commits on a
+ * global lock. With MB_PG_CAPTURE=logical the entity tables get no
+ * triggers. The realtime worker reads committed changes from a logical
+ * slot (wal2json) in batches instead, so a write pays for nothing but its
+ * WAL, and the slot keeps the worker's position across reconnects.
+ *
+ * Changes are taken off the slot as they are read; a node that dies with a
+ * batch in hand loses it, as it would its NOTIFYs. Whatever reads
+ * `mb_change_log` keeps the triggers: with delta sync the setting is ignored.
+ * @see realtime.h
+ */
+
+#ifndef MANTISBASE_LOGICAL_CAPTURE_H
+#define MANTISBASE_LOGICAL_CAPTURE_H
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <nlohmann/json.hpp>
+
+namespace soci {
+    class session;
+}
+
+namespace mb {
+    using json = nlohmann::json;
+
+    /**
+     * @brief Settings, SQL and wal2json decoding for logical change capture.
+     *
+     * Stateless; the realtime worker owns the connection reading the slot.
+     * Entity tables are marked `REPLICA IDENTITY FULL`, which puts the whole
+     * old row in the WAL (as the triggers send it) and tells them apart from
+     * the other tables the slot sees.
+     *
+     * @code
+     * // SELECT data FROM pg_logical_slot_get_changes(...) with LogicalCapture::changesSql()
+     * if (auto change = LogicalCapture::decode(data); change && isEntityTable(change->table))
+     *     batch.push_back(std::move(change->event));
+     * @endcode
+     */
+    class LogicalCapture {
+    public:
+        struct Options {
+            bool logical = false;                 ///> MB_PG_CAPTURE=logical; off keeps the triggers
+            std::string slot = "mb_rt";           ///> One per node; a node's slot holds WAL until it reads it
+            std::chrono::milliseconds poll{200};  ///> Slot read interval while no NOTIFY wakes the worker
+            int batch = 1000;                     ///> Changes read per query, past which it reads again at once
+
+            /// @brief Read MB_PG_CAPTURE, MB_PG_SLOT, MB_PG_CAPTURE_POLL_MS and MB_PG_CAPTURE_BATCH.
+            static Options fromEnv();
+
+            /// @brief fromEnv(), read once; trigger DDL depends on it.
+            static const Options &current();
+        };
+
+        /// One decoded row change, or a mute()/unmute() message
+        struct Change {
+            enum class Kind { Row, Mute, Unmute };
+
+            Kind kind = Kind::Row;
+            std::uint64_t xid = 0;      ///> The writing transaction; its changes come together, in commit order
+            std::string schema, table;  ///> For a message, the entity named, lowercased as table names are
+            json event;                 ///> ChangeJournal::makeEvent() object; null for a message
+        };
+
+        /**
+         * @brief Options::current() asks for logical capture and nothing needs
+         * `mb_change_log` filled. Read once; SQLite ignores it.
+         */
+        static bool enabled();
+
+        /// @brief Create `slot` with the wal2json plugin, unless it exists. Fails unless `wal_level=logical`.
+        static void createSlot(soci::session &sql, const std::string &slot);
+
+        /// @brief Take up to `$2` changes off slot `$1`, one wal2json (format 2) object per row in `data`.
+        static std::string changesSql();
+
+        /**
+         * @brief Leave the rest of this transaction's changes to `entity`
+         * undelivered (until unmute()), as an import without realtime drops
+         * the triggers for the length of its transaction. A transactional
+         * logical message, so it is read in line with the changes.
+         */
+        static void mute(soci::session &sql, const std::string &entity);
+
+        static void unmute(soci::session &sql, const std::string &entity);
+
+        /**
+         * @brief One wal2json format-version 2 row as the change event the
+         * trigger would have sent: bytea columns left out, json(b) parsed,
+         * and an update's unchanged TOASTed columns filled from its old row.
+         * @return std::nullopt for begin/commit/truncate rows, other messages and anything unreadable
+         */
+        static std::optional<Change> decode(std::string_view data);
+    };
+}
+
+#endif // MANTISBASE_LOGICAL_CAPTURE_H
@@ -0,0 +1,120 @@
+/**
+ * @file materialized_views.h
+ * @brief Keeps materialized `view` entities current from the change stream.
+ *
+ * A plain view runs its query on every read, aggregations included. A
+ * materialized one (`"materialized": true`) copies the query's rows into a
+ * table named after the entity, which reads hit instead, and refreshes it
+ * when its source entities change:
+ *
+ * - With a `refresh_key`, the view column holding the `id` of its one source
+ *   row, only the rows of changed ids are deleted and re-selected.
+ * - Otherwise the whole table is replaced, at most once per debounce window.
+ *
+ * A `refresh_interval` adds a full refresh on a schedule, for queries reading
+ * what the change stream doesn't carry (other views, `CURRENT_DATE`, ...).
+ * @see ViewMaterialization
+ */
+
+#ifndef MANTISBASE_MATERIALIZED_VIEWS_H
+#define MANTISBASE_MATERIALIZED_VIEWS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <nlohmann/json.hpp>
+#include "models/entity_schema.h"
+
+namespace mb {
+    /**
+     * @brief Refreshes materialized views on a thread of its own.
+     *
+     * @code
+     * views.track(schema);   // on every schema cache change, see Router
+     * app.rt().subscribe([&](const json &events) { views.onChanges(events); });
+     * views.start();         // refreshes everything once, for changes made while down
+     * @endcode
+     */
+    class MaterializedViews {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        struct Options {
+            std::chrono::milliseconds debounce{500}; ///> Changes are gathered this long before a refresh
+            std::size_t maxKeys = 1000;              ///> Changed ids past which an incremental refresh goes full
+
+            /// @brief Read MB_MATVIEW_DEBOUNCE_MS and MB_MATVIEW_MAX_KEYS.
+            static Options fromEnv();
+        };
+
+        explicit MaterializedViews(Options options);
+        ~MaterializedViews();
+
+        MaterializedViews(const MaterializedViews &) = delete;
+        MaterializedViews &operator=(const MaterializedViews &) = delete;
+
+        /// @brief Start the thread, with a full refresh of every tracked view queued.
+        void start();
+
+        /// @brief Stop the thread after the current refresh. Idempotent.
+        void stop();
+
+        /// @brief Follow the view in `schema`, or stop following it if it no longer is materialized.
+        void track(const nlohmann::json &schema);
+
+        void untrack(const std::string &view);
+
+        /// @brief Queue the refreshes a batch of change events calls for. Thread-safe.
+        void onChanges(const nlohmann::json &events);
+
+        /**
+         * @brief Replace the table of `view` with the query's current rows.
+         * @throw MantisException (404) if `view` isn't tracked, or the database's error
+         */
+        void refresh(const std::string &view);
+
+        /**
+         * @brief Run the refreshes due by `now`.
+         * Called by the thread; public for tests.
+         * @return When the next one is due, Clock::time_point::max() if none is queued
+         */
+        Clock::time_point step(Clock::time_point now = Clock::now());
+
+        [[nodiscard]] std::size_t fullRefreshes() const { return m_full.load(); }
+        [[nodiscard]] std::size_t incrementalRefreshes() const { return m_incremental.load(); }
+
+    private:
+        struct View {
+            ViewMaterialization options;
+            std::set<std::string> reads;                   ///> Entities whose changes refresh it
+            bool full = false;                             ///> A full refresh is queued
+            std::set<std::string> keys;                    ///> Changed source ids, for an incremental one
+            Clock::time_point due = Clock::time_point::max();
+            Clock::time_point scheduled = Clock::time_point::max();
+        };
+
+        /// Write `keys`' current rows, or all of them when null, in one write
+        void apply(const std::string &view, const std::string &key, const std::set<std::string> *keys);
+
+        void loop();
+
+        const Options m_options;
+        std::atomic<std::size_t> m_full{0};
+        std::atomic<std::size_t> m_incremental{0};
+
+        mutable std::mutex m_mutex;
+        std::map<std::string, View> m_views;
+        std::condition_variable m_cv;
+        bool m_stopping = false;
+        bool m_wake = false;
+        std::thread m_thread;
+    };
+}
+
+#endif // MANTISBASE_MATERIALIZED_VIEWS_H
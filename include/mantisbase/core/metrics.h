@@ -0,0 +1,172 @@
+/**
+ * @file metrics.h
+ * @brief Low-overhead counters and histograms, and their Prometheus text format.
+ *
+ * Request latency and status counts are recorded per route on every
+ * response, so the counters are split across cache lines by thread and only
+ * summed when `GET /api/v1/metrics` is scraped.
+ * @see Router::handleMetrics()
+ */
+
+#ifndef MANTISBASE_METRICS_H
+#define MANTISBASE_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace mb {
+    /**
+     * @brief Counter with one cache line per thread slot.
+     *
+     * Threads are assigned slots round-robin on first use; add() is one
+     * relaxed increment that rarely shares a line with another thread.
+     */
+    class ShardedCounter {
+    public:
+        static constexpr std::size_t SHARDS = 16;
+
+        void add(const std::uint64_t n = 1) {
+            m_shards[shard()].value.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]] std::uint64_t value() const;
+
+        /// @brief The calling thread's slot, in [0, SHARDS).
+        static std::size_t shard();
+
+    private:
+        struct alignas(64) Shard {
+            std::atomic<std::uint64_t> value{0};
+        };
+
+        std::array<Shard, SHARDS> m_shards;
+    };
+
+    /// @brief Latency histogram, sharded like ShardedCounter.
+    class LatencyHistogram {
+    public:
+        /// Bucket upper bounds in seconds; a last bucket counts everything slower.
+        static constexpr std::array<double, 12> BUCKETS = {
+            0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5
+        };
+
+        struct Snapshot {
+            std::array<std::uint64_t, BUCKETS.size() + 1> counts{}; ///> Per bucket, not cumulative
+            std::uint64_t count = 0;
+            double sum = 0; ///> Seconds
+        };
+
+        void observe(std::chrono::nanoseconds latency);
+
+        [[nodiscard]] Snapshot snapshot() const;
+
+        [[nodiscard]] static std::size_t bucketFor(std::chrono::nanoseconds latency);
+
+    private:
+        struct alignas(64) Shard {
+            std::array<std::atomic<std::uint64_t>, BUCKETS.size() + 1> counts{};
+            std::atomic<std::uint64_t> sumNs{0};
+        };
+
+        std::array<Shard, ShardedCounter::SHARDS> m_shards;
+    };
+
+    /**
+     * @brief Builds a Prometheus text exposition (format 0.0.4).
+     *
+     * @code
+     * MetricsWriter out;
+     * out.family("mb_sse_subscribers", "Open SSE sessions", "gauge");
+     * out.sample("mb_sse_subscribers", {}, 3);
+     * res.send(200, out.str(), MetricsWriter::CONTENT_TYPE);
+     * @endcode
+     */
+    class MetricsWriter {
+    public:
+        using Labels = std::vector<std::pair<std::string_view, std::string_view>>;
+
+        static constexpr auto CONTENT_TYPE = "text/plain; version=0.0.4; charset=utf-8";
+
+        /// @brief `# HELP` and `# TYPE` lines; call once per metric name, before its samples.
+        void family(std::string_view name, std::string_view help, std::string_view type);
+
+        void sample(std::string_view name, const Labels &labels, double value);
+
+        /**
+         * @brief `_bucket`, `_sum` and `_count` samples of a histogram.
+         * @param bounds Bucket upper bounds
+         * @param counts Per-bucket counts, not cumulative, with one more entry (+Inf) than `bounds`
+         */
+        void histogram(std::string_view name, const Labels &labels, std::span<const double> bounds,
+                       std::span<const std::uint64_t> counts, double sum);
+
+        [[nodiscard]] const std::string &str() const { return m_out; }
+
+        /// @brief Escape a label value (backslash, quote, newline).
+        static std::string escape(std::string_view value);
+
+    private:
+        void writeLabels(const Labels &labels, std::string_view extra_key = {}, std::string_view extra_value = {});
+
+        std::string m_out;
+    };
+
+    /**
+     * @brief Request metrics per route, and script execution times.
+     *
+     * Routes are registered once, when their handler is; the handler keeps
+     * the returned series and records into it without a lookup.
+     */
+    class Metrics {
+    public:
+        struct RouteSeries {
+            std::string method;
+            std::string route;                      ///> Registered pattern, e.g. `/api/v1/entities/:entity_name`
+            LatencyHistogram latency;
+            std::array<ShardedCounter, 5> byClass;  ///> 1xx..5xx
+        };
+
+        Metrics();
+
+        /// @brief Series for `method route`, created on first use. The reference stays valid.
+        RouteSeries &route(const std::string &method, const std::string &route);
+
+        /// @brief Series for requests no registered route handled (404s, static files, ...).
+        RouteSeries &unmatched() { return m_unmatched; }
+
+        static void recordRequest(RouteSeries &series, int status, std::chrono::nanoseconds latency);
+
+        /// @brief Time spent running script `hook` (a file or a hook function).
+        void recordScript(const std::string &hook, std::chrono::nanoseconds duration);
+
+        /// @brief Script `hook` was stopped for running past its time budget.
+        void recordScriptTimeout(const std::string &hook);
+
+        /// @brief `mb_http_request_duration_seconds` and `mb_http_requests_total`.
+        void writeRequests(MetricsWriter &out) const;
+
+        /// @brief `mb_script_duration_seconds` and `mb_script_timeouts_total`.
+        void writeScripts(MetricsWriter &out) const;
+
+    private:
+        mutable std::mutex m_mutex;
+        std::vector<std::unique_ptr<RouteSeries>> m_routes;
+        std::unordered_map<std::string, RouteSeries *> m_routeIndex;
+        RouteSeries m_unmatched;
+        std::unordered_map<std::string, std::unique_ptr<LatencyHistogram>> m_scripts;
+        std::unordered_map<std::string, std::uint64_t> m_scriptTimeouts;
+    };
+}
+
+#endif // MANTISBASE_METRICS_H
@@ -10,15 +10,16 @@
 #define MANTISBASE_MIDDLEWARES_H
 
 #include <functional>
+#include <memory>
 #include <string>
 #include "types.h"
 #include "models/entity.h"
 
 namespace mb {
     /**
-     * @brief Extract and validate JWT token from Authorization header.
+     * @brief Extract the Bearer token (JWT or API key) from the Authorization header.
      *
-     * Parses Bearer token from request headers and stores user info in context.
+     * Sets `auth` to a guest principal carrying the token; hydrateContextData() resolves it.
      * @return Middleware function
      */
     std::function<HandlerResponse(MantisRequest&, MantisResponse&)> getAuthToken();
@@ -26,7 +27,9 @@ namespace mb {
     /**
      * @brief Hydrate request context with additional data.
      *
-     * Populates context store with request metadata and user information.
+     * Verifies the token and loads the user, lazily: the work runs the first
+     * time `auth` or `verification` is read (a non-public rule, a handler, a
+     * script), so requests that never ask who is calling skip it.
      * @return Middleware function
      */
     std::function<HandlerResponse(MantisRequest&, MantisResponse&)> hydrateContextData();
@@ -56,6 +59,16 @@ namespace mb {
      */
     std::function<HandlerResponse(MantisRequest&, MantisResponse&)> resolveEntity();
 
+    /**
+     * @brief The entity `entity_name`, looked up once per request.
+     *
+     * The first call stores the cache snapshot in the request context; the
+     * middlewares and handler after it reuse that one, so a request sees a
+     * single schema throughout.
+     * @throw MantisException 404 if there is no such entity
+     */
+    std::shared_ptr<const Entity> requestEntity(MantisRequest &req, const std::string &entity_name);
+
     /**
      * @brief Reject POST, PATCH, and DELETE requests against view-type entities.
      * @return Middleware function
@@ -68,6 +81,29 @@ namespace mb {
      */
     std::function<HandlerResponse(MantisRequest&, MantisResponse&)> hasEntityAccess();
 
+    /**
+     * @brief Whether the request passes `rule`, checked as hasEntityAccess() does, without responding.
+     *
+     * For handlers that read other entities on the caller's behalf, such as `?expand=`.
+     */
+    bool hasRuleAccess(MantisRequest &req, const AccessRule &rule);
+
+    /**
+     * @brief Set `opts["auth"]` for Entity reads to apply `rule`'s row filter; verified admins see every row.
+     *
+     * Entity::list(), read() and readMany() filter by it.
+     */
+    void setRuleAuth(MantisRequest &req, const AccessRule &rule, json &opts);
+
+    /**
+     * @brief Check access rules for a batch write (POST .../:entity_name/batch).
+     *
+     * The request must pass the create, update and delete rules of every kind
+     * of op present in its `ops` array.
+     * @return Middleware function that validates access rules
+     */
+    std::function<HandlerResponse(MantisRequest&, MantisResponse&)> hasBatchAccess();
+
     /**
      * @brief Check if request has access to entity based on access rules.
      * @param entity_name Entity/table name to check access for
@@ -126,6 +162,8 @@ namespace mb {
      * @param window_seconds Time window duration in seconds
      * @param use_user_id If true, rate limit by authenticated user ID; if false, use IP address.
      *                    Falls back to IP if user ID is not available.
+     * @param scope Names this limit in the shared store (`MB_SHARED_STATE=db`), where limits with the
+     *              same scope share budgets; defaults to `<max_requests>/<window_seconds>`
      * @return Middleware function that enforces rate limits
      * 
      * @note The login endpoint uses this middleware with 5 requests per 60 seconds by IP.
@@ -146,8 +184,46 @@ namespace mb {
     std::function<HandlerResponse(MantisRequest&, MantisResponse&)> rateLimit(
         int max_requests, 
         int window_seconds, 
-        bool use_user_id = false
+        bool use_user_id = false,
+        const std::string &scope = ""
     );
+
+    /**
+     * @brief Keep this route's responses uncompressed, whatever the client accepts.
+     *
+     * For bodies that are already compressed, or that must reach the client
+     * byte for byte (e.g. ones it checksums).
+     *
+     * @code
+     * router.Get("/api/v1/export", handler, {requireAdminAuth(), noCompression()});
+     * @endcode
+     */
+    std::function<HandlerResponse(MantisRequest&, MantisResponse&)> noCompression();
+
+    /**
+     * @brief Refuse writes on a read replica (see Replication).
+     *
+     * Answers anything but GET, HEAD and OPTIONS with a 405 naming the
+     * primary, in the error and in an `X-Mb-Primary` header. Realtime topic
+     * updates (`POST /api/v1/realtime`) still go through.
+     * @param primary Base URL of the primary
+     */
+    std::function<HandlerResponse(MantisRequest&, MantisResponse&)> replicaReadOnly(const std::string &primary);
+
+    /**
+     * @brief Leave the pre-routing middlewares (getAuthToken(), hydrateContextData()) out of this route.
+     *
+     * For routes that never look at who is asking. The marker is taken out
+     * when the route is registered and never runs; `req.auth()` stays empty.
+     *
+     * @code
+     * router.Get("/api/v1/health", healthCheckHandler(), {noAuthContext()});
+     * @endcode
+     */
+    std::function<HandlerResponse(MantisRequest&, MantisResponse&)> noAuthContext();
+
+    /// @brief Whether `middleware` is the noAuthContext() marker.
+    bool isNoAuthContext(const MiddlewareFn &middleware);
 }
 
 #endif //MANTISBASE_MIDDLEWARES_H
\ No newline at end of file
@@ -9,10 +9,13 @@
 #ifndef MANTISBASE_ACCESS_RULES_H
 #define MANTISBASE_ACCESS_RULES_H
 
+#include <memory>
 #include <string>
 #include <nlohmann/json.hpp>
 
 namespace mb {
+    class CompiledExpr;
+
     /**
      * @brief Access control rule for entity permissions.
      *
@@ -26,7 +29,15 @@ namespace mb {
      *
      * // Create rule: admins only
      * AccessRule adminRule("", "auth.entity == \"mb_admins\"");
+     *
+     * // Any user may list, but only sees the records they own
+     * AccessRule ownRule("auth", "", "owner = @auth.id");
      * @endcode
+     *
+     * The optional `filter` is a row condition in `?filter=` syntax, whose
+     * values may be `@auth.<field>`. For the `list` and `get` rules it is
+     * compiled into the SQL of each read (see EntityFilter::compileRule()),
+     * so callers only ever see the rows it matches; admins see them all.
      */
     class AccessRule {
     public:
@@ -34,18 +45,19 @@ namespace mb {
          * @brief Construct access rule.
          * @param mode Rule mode (currently unused, reserved for future use)
          * @param expr Expression string to evaluate (e.g., "auth.id != \"\"")
+         * @param filter Row filter, for any mode (e.g., "owner = @auth.id")
          */
-        explicit AccessRule(const std::string &mode = "", const std::string &expr = "");
+        explicit AccessRule(const std::string &mode = "", const std::string &expr = "", const std::string &filter = "");
 
         /**
          * @brief Convert rule to JSON representation.
-         * @return JSON object with mode and expr fields
+         * @return JSON object with mode and expr fields, and filter if set
          */
         [[nodiscard]] nlohmann::json toJSON() const;
         
         /**
          * @brief Create rule from JSON object.
-         * @param j JSON object with mode and expr fields
+         * @param j JSON object with mode and expr fields, and an optional filter
          * @return AccessRule instance
          */
         static AccessRule fromJSON(const nlohmann::json &j);
@@ -74,8 +86,33 @@ namespace mb {
          */
         void setExpr(const std::string& _expr);
 
+        /**
+         * @brief Get row filter.
+         * @return Filter string, empty if the rule doesn't filter rows
+         */
+        [[nodiscard]] std::string filter() const;
+
+        /**
+         * @brief Set row filter.
+         * @param _filter Filter string (e.g., "owner = @auth.id")
+         */
+        void setFilter(const std::string& _filter);
+
+        /**
+         * @brief Evaluate the `custom` expression against request variables.
+         *
+         * Uses the expression compiled when the rule was built, so only the
+         * variables are bound per call.
+         * @param vars Variables such as `auth` and `req`
+         * @return True if access is granted; false for non-custom rules
+         */
+        [[nodiscard]] bool evaluate(const nlohmann::json& vars) const;
+
     private:
-        std::string m_mode, m_expr;
+        void recompile();
+
+        std::string m_mode, m_expr, m_filter;
+        std::shared_ptr<const CompiledExpr> m_compiled; ///> Set for `custom` rules only
     };
 } // mb
 
@@ -9,16 +9,32 @@
 #ifndef MANTISBASE_ENTITY_H
 #define MANTISBASE_ENTITY_H
 
+#include <cstdint>
 #include <string>
+#include <functional>
+#include <iosfwd>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_set>
 #include "mantisbase/mantis.h"
 #include "mantisbase/core/exceptions.h"
 #include "mantisbase/utils/soci_wrappers.h"
 #include "../types.h"
 #include "access_rules.h"
+#include "entity_filter.h"
+#include "entity_geo.h"
+#include "entity_search.h"
+#include "mantisbase/core/count_cache.h"
+#include "mantisbase/core/read_coalescer.h"
+#include "mantisbase/core/record_cache.h"
+#include "mantisbase/core/vector_index.h"
 
 namespace mb {
     class MantisBase; // forward declaration; Entity holds a non-owning pointer to it
+    class Database;
+    class EntityQuery;
+    struct ValidationPlan;
 
     using Record = nlohmann::json;  ///< Single database record as JSON object
     using Records = std::vector<Record>;  ///< Collection of database records
@@ -28,6 +44,52 @@ namespace mb {
     /// unbounded query or response allocation.
     inline constexpr int MAX_LIST_PAGE_SIZE = 500;
 
+    /// Upper bound on `k`, the records a `near` list() returns.
+    inline constexpr int MAX_NEAR_RESULTS = 100;
+
+    /// Upper bound on the number of operations accepted by a single batch().
+    inline constexpr std::size_t MAX_BATCH_OPS = 1000;
+
+    /// Upper bound on the reads accepted by a single `POST /api/v1/batch`.
+    inline constexpr std::size_t MAX_BATCH_READS = 50;
+
+    /**
+     * @brief Keyset cursor of a list page: the sort value and `id` of its last record.
+     *
+     * The next page starts after `(value, id)` in `ORDER BY field, id`, so
+     * records sharing a sort value are neither skipped nor repeated. Encoded
+     * as base64url JSON; clients treat it as opaque and pass it back as
+     * `after`. It names the sort it was made for.
+     *
+     * @code
+     * const auto page = entity.listInto(body, {{"pagination", {{"sort", "-created"}}}});
+     * entity.listInto(next, {{"pagination", {{"sort", "-created"}, {"after", page.cursor}}}});
+     * @endcode
+     */
+    struct ListCursor {
+        std::string field = "id"; ///< Sort field
+        bool desc = false;        ///< Descending sort
+        json value;               ///< Sort value of the last record; null sorts first
+        std::string id;           ///< `id` of the last record, the tie-breaker
+
+        /// `field` of a `search` page in match order; `value` is then the rank
+        static constexpr auto RANK = "@rank";
+
+        /// `field` of a `near` page; it has no next page, so it is never encoded
+        static constexpr auto NEAR = "@near";
+
+        /// `field` of a `geo` page nearest first; `value` is then the distance, see EntityGeo::Query
+        static constexpr auto DISTANCE = "@distance";
+
+        /// @brief Whether `value` is listRows()' to fill in, as no column carries it.
+        [[nodiscard]] bool ranked() const { return field == RANK || field == DISTANCE; }
+
+        [[nodiscard]] std::string encode() const;
+
+        /// @brief Parse an encode() result; std::nullopt for anything else, such as a bare id.
+        static std::optional<ListCursor> decode(const std::string &cursor);
+    };
+
     /**
      * @brief Represents a database table/entity with schema and CRUD operations.
      *
@@ -100,6 +162,12 @@ namespace mb {
          */
         [[nodiscard]] bool hasApi() const;
 
+        /**
+         * @brief SQLite files the rows are spread over by id, see EntityShards.
+         * @return 1 unless the schema sets `shards`
+         */
+        [[nodiscard]] int shards() const;
+
         /**
          * @brief Get SQL query for view type entities.
          * @return View SQL query string
@@ -119,13 +187,52 @@ namespace mb {
          * @return Optional field JSON object if found
          */
         [[nodiscard]] std::optional<json> field(const std::string& field_name) const;
+
+        /**
+         * @brief Field definition by name, without copying it.
+         *
+         * Looked up in a name index built once per schema. The pointer is into
+         * the shared schema and stays valid as long as this Entity or a copy.
+         * @return nullptr if there is no such field
+         */
+        [[nodiscard]] const json *fieldDef(const std::string &field_name) const;
         
         /**
          * @brief Check if field exists by name.
          * @param field_name Field name to check
-         * @return Optional field JSON if exists, nullopt otherwise
+         * @return true if the schema has a field of that name
          */
-        [[nodiscard]] std::optional<json> hasField(const std::string& field_name) const;
+        [[nodiscard]] bool hasField(const std::string& field_name) const;
+
+        /**
+         * @brief Get the precompiled row decoder for this entity's fields.
+         * @return Reference to the codec shared across copies of this entity
+         */
+        [[nodiscard]] const RowCodec &rowCodec() const;
+
+        /**
+         * @brief Get the field constraints compiled for request body validation.
+         * @return Reference to the plan shared across copies of this entity
+         */
+        [[nodiscard]] const ValidationPlan &validationPlan() const;
+
+        /**
+         * @brief Compile (or fetch the cached compiled form of) a list filter.
+         * @param filter Filter expression, see EntityFilter for the grammar
+         * @return Compiled WHERE clause and its bound values
+         * @throws MantisException (400) on invalid filters
+         */
+        [[nodiscard]] std::shared_ptr<const CompiledFilter> compileFilter(const std::string &filter) const;
+
+        /**
+         * @brief Compile the filters `previous` has cached, so the first requests
+         * after a schema change don't pay for it.
+         *
+         * Filters the new schema rejects (a removed field, say) are skipped;
+         * requests using them get their 400 as before.
+         * @param previous The entity this one replaces
+         */
+        void prewarm(const Entity &previous) const;
 
         /**
          * @brief Get all access rules.
@@ -137,31 +244,38 @@ namespace mb {
          * @brief Get list access rule (for GET /api/v1/entities/{table}).
          * @return AccessRule for listing records
          */
-        [[nodiscard]] AccessRule listRule() const;
+        [[nodiscard]] const AccessRule &listRule() const;
 
         /**
          * @brief Get read access rule (for GET /api/v1/entities/{table}/:id).
          * @return AccessRule for reading a record
          */
-        [[nodiscard]] AccessRule getRule() const;
+        [[nodiscard]] const AccessRule &getRule() const;
+
+        /**
+         * @brief Row filters of the list and get rules, compiled with their `@auth` variables unbound.
+         * @return nullptr if the rule has no `filter`
+         */
+        [[nodiscard]] const CompiledFilter *listFilter() const;
+        [[nodiscard]] const CompiledFilter *getFilter() const;
 
         /**
          * @brief Get create access rule (for POST /api/v1/entities/{table}).
          * @return AccessRule for creating records
          */
-        [[nodiscard]] AccessRule addRule() const;
+        [[nodiscard]] const AccessRule &addRule() const;
 
         /**
          * @brief Get update access rule (for PATCH /api/v1/entities/{table}/:id).
          * @return AccessRule for updating records
          */
-        [[nodiscard]] AccessRule updateRule() const;
+        [[nodiscard]] const AccessRule &updateRule() const;
 
         /**
          * @brief Get delete access rule (for DELETE /api/v1/entities/{table}/:id).
          * @return AccessRule for deleting records
          */
-        [[nodiscard]] AccessRule deleteRule() const;
+        [[nodiscard]] const AccessRule &deleteRule() const;
 
         // --------------- DB CRUD OPS ------------------ //
         /**
@@ -178,33 +292,288 @@ namespace mb {
 
         /**
          * @brief List all records in the entity table.
-         * @param opts Optional parameters (currently unused)
+         * @param opts `pagination` {limit, after, sort}, an optional `filter`
+         *             expression (see EntityFilter) and `fields` (see
+         *             projection()). `sort` is a field name, `-` prefixed for
+         *             descending; `after` a ListCursor, or for the `id` sort a
+         *             bare id. The sort field is returned with `fields` too.
+         *             `search` keeps the records holding every word in their
+         *             searchFields() (see EntitySearch), best matches first
+         *             unless `sort` is given. `near` {vector, k, field} returns
+         *             the `k` records (default 20, at most MAX_NEAR_RESULTS)
+         *             whose `vector` field is closest to `vector` by cosine
+         *             distance, nearest first, as one page (see VectorIndex);
+         *             `field` is needed when the entity has several. `geo`
+         *             {near: {lat, lng}, radius, bbox, field} keeps the records
+         *             whose `geo_point` is within `radius` km of `near` and in
+         *             `bbox` ([west, south, east, north]), nearest first unless
+         *             `sort` is given (see EntityGeo).
          * @return Vector of record JSON objects
+         * @throws MantisException (400) if `after` is a cursor for another sort,
+         *         `fields` names an unknown field, `search` is given for an
+         *         entity without searchable fields, `near` names no vector
+         *         field, has the wrong length, or comes with `sort`, `search`,
+         *         `geo` or `after`, or `geo` names no geo field or comes with `search`
          */
         [[nodiscard]] Records list(const json &opts = json::object()) const;
 
+        /// Summary of a page serialized by listInto().
+        struct ListPage {
+            std::size_t count = 0; ///< Number of records written
+            std::string cursor; ///< ListCursor after the last record, empty if none
+        };
+
+        /// @brief list(), also reporting the page's record count and next-page cursor in `page`.
+        [[nodiscard]] Records list(const json &opts, ListPage &page) const;
+
+        /**
+         * @brief Serialize a page of records straight into a JSON array.
+         *
+         * Same query and options as list(), but rows are written from the
+         * rowset into `out` without building intermediate json objects.
+         * Passwords are left out for auth entities.
+         *
+         * @param out Buffer the JSON array is appended to
+         * @param opts Same options as list()
+         * @return Record count and next-page cursor
+         */
+        ListPage listInto(std::string &out, const json &opts = json::object()) const;
+
+        /**
+         * @brief Run the list() query and hand each row of the page to `on_row`.
+         *
+         * What listInto() and EntityQuery read their pages from; rows hold
+         * the selected fields plus the sort field, as the database returns them.
+         * @return The resolved sort, for the caller to build the next cursor with
+         */
+        ListCursor listRows(const json &opts, const std::function<void(const soci::row &)> &on_row) const;
+
+        /**
+         * @brief A typed query over this entity, see EntityQuery.
+         * @code
+         * auto posts = app.entity("posts").query().where("views > 10").limit(20).fetch<Post>();
+         * @endcode
+         */
+        [[nodiscard]] EntityQuery query() const;
+
+        /// Encodings exportRecords() writes.
+        enum class ExportFormat { Ndjson, Csv };
+
+        /// Fills a buffer with the next bytes of an export; 0 once it is done.
+        using ExportReader = std::function<std::size_t(char *, std::size_t)>;
+
+        /**
+         * @brief Every record matching `opts["filter"]`, in `id` order, read off a single cursor.
+         *
+         * There is no page limit. Rows are fetched and encoded as the reader
+         * is called, so memory does not grow with the table; the database
+         * session is held until the reader is destroyed. NDJSON is one
+         * record object per line, CSV a header line then one line per record.
+         * Passwords are left out for auth entities.
+         *
+         * @param format Output encoding
+         * @param opts `filter` and `fields`, as for list(); `pagination` is ignored
+         * @return Reader for drogon's stream responses
+         * @throws MantisException (400) for an invalid filter or an unknown field
+         */
+        [[nodiscard]] ExportReader exportRecords(ExportFormat format, const json &opts = json::object()) const;
+
+        /// The bytes of a `blob` field, handed out as the client takes them.
+        struct BlobReader {
+            std::int64_t size = 0;
+            ExportReader read; ///> Same contract as exportRecords()' reader
+        };
+
+        /**
+         * @brief Stream the `blob` field `field` of record `id`, a chunk per call.
+         *
+         * SQLite reads it through `sqlite3_blob_read()`, PostgreSQL a `bytea`
+         * slice per chunk in one repeatable-read transaction; neither holds the
+         * whole value in memory. The database session is held until the reader
+         * is destroyed.
+         *
+         * @param opts `auth`, as for read(): a record the get rule's row filter hides isn't read
+         * @return std::nullopt if there is no such record or the field is NULL
+         * @throws MantisException (400) if `field` isn't a blob field
+         */
+        [[nodiscard]] std::optional<BlobReader> readBlob(const std::string &id, const std::string &field,
+                                                         const json &opts = json::object()) const;
+
+        /**
+         * @brief Replace the `blob` field `field` of record `id` with `size` bytes read from `in`.
+         *
+         * Written in chunks on SQLite (`zeroblob()`, then `sqlite3_blob_write()`),
+         * bound as one binary parameter on PostgreSQL; either way in one write,
+         * bumping `updated`. Blob fields can only be set this way; record
+         * bodies may only clear them, with null.
+         *
+         * @return The updated record, the blob as its length
+         * @throws MantisException (404) if there is no such record, (400) if
+         *         `field` isn't a blob field or `in` ends early
+         */
+        Record writeBlob(const std::string &id, const std::string &field, std::istream &in,
+                         std::int64_t size) const;
+
+        /**
+         * @brief Resolve foreign key fields of `records` into each record's `expand` object.
+         *
+         * Each referenced entity and column is looked up with one
+         * `WHERE <column> IN (...)` query for all records, however many
+         * reference it, and relations with the same target share the lookup.
+         * A null or dangling reference gets no entry.
+         *
+         * @param records Records of this entity, updated in place
+         * @param relations Foreign key field names, e.g. {"author", "category"}
+         * @param list_opts The caller's list() options for a referenced entity, their `auth` applying its
+         *        list rule's row filter; std::nullopt if the caller may not list it, leaving its relations out
+         * @throws MantisException (400) if a relation isn't a foreign key field of this entity
+         */
+        void expand(Records &records, const std::vector<std::string> &relations,
+                    const std::function<std::optional<json>(const Entity &)> &list_opts = {}) const;
+
         /**
          * @brief Read a single record by ID.
+         *
+         * Concurrent reads of the same record and fields share one query (see
+         * readFlights()), unless this request wrote: it reads its own writes.
+         * Entities in recordCache() are read whole and answered from it,
+         * projected to `fields` after the lookup.
          * @param id Record identifier
-         * @param opts Optional parameters (currently unused)
+         * @param opts Optional `fields` (see projection()), `keep_passwords`
+         *        and `auth`, to apply the get rule's row filter (as for list())
          * @return Optional record JSON if found, nullopt otherwise
          */
         [[nodiscard]] std::optional<Record> read(const std::string &id, const json &opts = json::object()) const;
 
+        /**
+         * @brief Read the records of `ids` that exist on `sql`, in no particular order.
+         *
+         * One `id IN (...)` query per batch of ids, past the caches, so rows
+         * are no older than what `sql` last saw committed. Passwords are left out.
+         * @param opts Optional `auth`, to apply the list rule's row filter (as for list())
+         */
+        [[nodiscard]] Records readMany(soci::session &sql, const std::vector<std::string> &ids,
+                                       const json &opts = json::object()) const;
+
+        /**
+         * @brief The records matching `opts["filter"]` on `sql`, in `id` order, at most `limit` of them.
+         *
+         * One statement, past the caches, as readMany() reads; what a
+         * realtime snapshot is taken with. Passwords are left out.
+         * @param opts Optional `filter` and `auth`, as for list(); `pagination` is ignored
+         * @param limit Rows read at most; ask for one more to tell a larger set apart
+         * @throws MantisException (400) for an invalid filter
+         */
+        [[nodiscard]] Records readAll(soci::session &sql, const json &opts, std::size_t limit) const;
+
         /**
          * @brief Update an existing record by ID.
          * @param id Record identifier
          * @param data JSON object with fields to update
-         * @param opts Optional parameters (currently unused)
+         * @param opts Optional `if_match`, an `If-Match` list the record's recordTag() must be in
          * @return Updated record JSON
+         * @throws MantisException 412 if the record doesn't match `if_match`
          */
         [[nodiscard]] Record update(const std::string &id, const json &data, const json &opts = json::object()) const;
 
         /**
          * @brief Delete a record by ID.
          * @param id Record identifier to delete
+         * @param opts Optional `if_match`, as for update()
+         * @throws MantisException 404 for a missing record, 412 if it doesn't match `if_match`
+         */
+        void remove(const std::string &id, const json &opts = json::object()) const;
+
+        /**
+         * @brief The ETag `If-Match` compares against: the record's `version`, or a digest of the record.
+         *
+         * An `int` field named `version` makes an entity versioned: every update
+         * adds 1 to it and clients can't set it. Other entities are tagged by
+         * their field values (`password` aside), which any change alters.
+         * @return std::nullopt for a record missing fields, e.g. left out by `fields`
          */
-        void remove(const std::string &id) const;
+        [[nodiscard]] std::optional<std::string> recordTag(const json &record) const;
+
+        /**
+         * @brief Apply a list of create/update/delete operations in one transaction.
+         *
+         * Each op is `{"op": "create", "data": {...}}`,
+         * `{"op": "update", "id": "...", "data": {...}}` or
+         * `{"op": "delete", "id": "..."}`. Consecutive creates sharing a column
+         * set become multi-row `INSERT ... RETURNING *` statements and
+         * consecutive deletes one `DELETE ... WHERE id IN (...)`; updates run
+         * one statement each. Either every op is applied or none is, and the
+         * committed changes reach realtime subscribers as a single batch.
+         *
+         * Bodies are not validated here (see Validators::validateRequestBody()).
+         * File fields can't be changed, as there is no upload to go with them.
+         *
+         * @param ops JSON array of at most MAX_BATCH_OPS operations
+         * @return One entry per op, in order: the written record for create and
+         *         update, `{"id": ...}` for delete
+         * @throws MantisException 400 for a malformed op, 404 if an update or
+         *         delete targets a missing record (the batch is rolled back)
+         */
+        [[nodiscard]] Records batch(const json &ops) const;
+
+        /// Checks one resolved transaction op before it's written; an error message rolls the transaction back.
+        using TransactionCheck = std::function<std::optional<std::string>(std::size_t index, const Entity &entity,
+                                                                          const json &op)>;
+
+        /**
+         * @brief Apply ops across entities as one atomic write, in order.
+         *
+         * Each op is a batch() op naming its entity, `{"entity": "posts",
+         * "op": "create", "data": {...}}`, optionally with a `ref` name. The
+         * `id` and top-level `data` values of an op may be
+         * `{"$ref": "<op>.<field>"}`, the `field` of an earlier op's result,
+         * where `<op>` is its `ref` or index: `{"$ref": "order.id"}`. Refs are
+         * resolved as the ops run, then `check` sees the op; either every op
+         * is applied or none is.
+         *
+         * @param app Owning application, whose (tenant's) database is written
+         * @param entities The entity of each op, in order
+         * @param ops JSON array of at most MAX_BATCH_OPS operations
+         * @param check Run on every op before it is written (see Validators::validateRequestBody())
+         * @return One entry per op, as from batch()
+         * @throws MantisException 400 for a malformed op or `$ref`, a view
+         *         entity or a rejected op, 404 if an update or delete targets
+         *         a missing record (the transaction is rolled back)
+         */
+        [[nodiscard]] static Records transaction(const MantisBase &app,
+                                                 const std::vector<std::shared_ptr<const Entity>> &entities,
+                                                 const json &ops, const TransactionCheck &check = {});
+
+        /// Checks one import record before it's written; an error message rejects the import.
+        using ImportCheck = std::function<std::optional<std::string>(const json &)>;
+
+        /**
+         * @brief Create a record from every line of `in`, in one transaction.
+         *
+         * Takes what exportRecords() writes: NDJSON is one record object per
+         * line, CSV a header line naming the fields then one record per line,
+         * its cells read by the field's type (an unquoted empty cell is null).
+         * `id`, `created` and `updated` are set here, as for create(), and
+         * unknown fields are ignored. Records are read as they are written, so
+         * memory doesn't grow with the input. Consecutive records sharing a
+         * column set go in as one `COPY ... FROM STDIN` on PostgreSQL, and as
+         * multi-row INSERTs of up to 900 parameters otherwise.
+         *
+         * With `opts["realtime"]` false the entity's change triggers are
+         * dropped for the load and restored before it commits, and
+         * subscribers get one `IMPORT` event with the record count instead of
+         * an INSERT per record.
+         *
+         * @param format Input encoding
+         * @param in Input stream, read to the end
+         * @param opts Optional `realtime` (default true)
+         * @param check Run on every record before it is written (see Validators::validateRequestBody())
+         * @return `{"imported": <count>}`
+         * @throws MantisException 400 naming the line of a malformed or rejected
+         *         record, or of a value for a file field (the import is rolled back)
+         */
+        [[nodiscard]] json importRecords(ExportFormat format, std::istream &in, const json &opts = json::object(),
+                                         const ImportCheck &check = {}) const;
 
         // --------------- SCHEMA OPS ------------------ //
         /**
@@ -214,10 +583,53 @@ namespace mb {
         [[nodiscard]] const json &schema() const;
 
         /**
-         * @brief Count total records in the entity table.
-         * @return Number of records
+         * @brief Count records in the entity table.
+         *
+         * Counts are served from countCache() while fresh. With `approx`, an
+         * unfiltered count that isn't cached comes from the planner statistics
+         * (`pg_class.reltuples`, `sqlite_stat1`, `information_schema.tables`),
+         * falling back to an exact count when the table was never analyzed.
+         *
+         * A `search` count is neither cached nor approximated.
+         *
+         * @param opts Optional `filter` (a `?filter=` expression), `search`
+         *        (as for list()) and `approx` (bool)
+         * @return Number of matching records
+         * @throws MantisException 400 for an invalid filter
+         */
+        [[nodiscard]] int countRecords(const json &opts = json::object()) const;
+
+        /// Most `group` fields, and most `sum`/`avg`/`min`/`max` fields in all, in one aggregate().
+        static constexpr std::size_t MAX_AGGREGATE_FIELDS = 8;
+
+        /**
+         * @brief Count and total records per group, in one `GROUP BY` query.
+         *
+         * Fields are checked against the schema: `sum` and `avg` take `int` and
+         * `double` fields, `min` and `max` those and `string` and `date` ones,
+         * and `group` any of these or `bool`.
+         *
+         * @param opts `group`, `sum`, `avg`, `min`, `max` (arrays of field names),
+         *        `filter` (a `?filter=` expression), `sort` (`count`, a group
+         *        field, `-` first for descending; default the group fields) and
+         *        `limit` (groups, 1 to 1000, default 100)
+         * @return `{"groups": [{"key": {<field>: <value>}, "count": n, "sum": {<field>: n}, ...}],
+         *         "truncated": bool}`; truncated when more groups than `limit` exist
+         * @throws MantisException 400 for an unknown or unfit field, or an invalid filter
          */
-        [[nodiscard]] int countRecords() const;
+        [[nodiscard]] json aggregate(const json &opts) const;
+
+        /// @brief Record counts shared by all entities, kept current from the realtime change stream.
+        static CountCache &countCache();
+
+        /// @brief Record reads in flight, shared by all entities; see read().
+        static ReadCoalescer &readFlights();
+
+        /// @brief Records of opted-in entities, read through by read().
+        static RecordCache &recordCache();
+
+        /// @brief Similarity indexes of `vector` fields, shared by all entities; see list().
+        static VectorIndexes &vectorIndexes();
 
         /**
          * @brief Check if entity table is empty.
@@ -233,6 +645,15 @@ namespace mb {
          */
         [[nodiscard]] bool recordExists(const std::string &id) const;
 
+        /**
+         * @brief Prepare the statements read() and recordExists() run, in `sql`'s statement cache.
+         *
+         * Runs them for an id no record has, so past the prepares only the top
+         * of the id index is read; see ConnectionWarmup.
+         * @param sql Session leased from the primary's pool
+         */
+        void prepareStatements(soci::session &sql) const;
+
         /**
          * @brief Find field definition by name (alias for field()).
          * @param field_name Field name to find
@@ -249,7 +670,167 @@ namespace mb {
         [[nodiscard]] std::optional<json> queryFromCols(const std::string &value,
                                                         const std::vector<std::string> &columns) const;
 
+        /**
+         * @brief Columns named by a comma-separated `?fields=` list.
+         *
+         * `id` is always included, first; `password` is left out on auth
+         * entities, as it is never returned.
+         * @return Deduplicated column names, empty if `fields` is blank
+         * @throws MantisException (400) for a field not in the schema
+         */
+        [[nodiscard]] std::vector<std::string> projection(const std::string &fields) const;
+
+        /**
+         * @brief The select list of a whole record: `*`, unless there are blob fields.
+         *
+         * Blob fields are read as their length in bytes, so records never
+         * carry the blob itself; readBlob() streams that.
+         */
+        [[nodiscard]] const std::string &recordColumns() const;
+
+        /// @brief True if list() can sort by `field`: `id`, or a string, date, int, double or bool field.
+        [[nodiscard]] bool isSortable(const std::string &field) const;
+
+        /// @brief Fields marked `searchable`, in schema order; what list()'s `search` matches.
+        [[nodiscard]] std::vector<std::string> searchFields() const;
+
+        /**
+         * @brief Index that would serve list pages sorted by `field`.
+         *
+         * Keyset pages filter and order on `(field, id)`; without an index
+         * leading with `field`, every page sorts the whole table.
+         * @return An `(field, id)` index, or std::nullopt if `field` is `id`,
+         *         not sortable, or already leads an index
+         */
+        [[nodiscard]] std::optional<IndexDefinition> sortIndexRecommendation(const std::string &field) const;
+
+        /**
+         * @brief Index that would serve list pages matching `filter` and sorted by `sort_field`.
+         *
+         * Its columns are the filter's equality fields, then `sort_field`
+         * (or, sorting by `id`, the first range field), then `id`.
+         * @param filter Compiled `?filter=`, nullptr for none
+         * @return The index, or std::nullopt if there is nothing to seek on or
+         *         an index already starts with those columns
+         */
+        [[nodiscard]] std::optional<IndexDefinition> listIndexRecommendation(
+            const CompiledFilter *filter, const std::string &sort_field) const;
+
     private:
+        /// A batch op with its shape checked, and the schema columns it writes.
+        struct PlannedOp {
+            std::string kind;
+            std::string id;
+            std::vector<std::string> columns;
+        };
+
+        /// What a committed write hands on: change events, changed auth users and queued file removals.
+        struct WriteEffects {
+            json events = json::array();
+            std::vector<std::pair<std::string, std::string>> users; ///> Entity and id of changed auth records
+            bool filesQueued = false;
+        };
+
+        /// @brief Check the shape of every op, naming bad ones `ops[<base + index>]`.
+        [[nodiscard]] std::vector<PlannedOp> planOps(const json &ops, std::size_t base) const;
+
+        /**
+         * @brief Write the planned ops on `sql`, inside the caller's transaction.
+         * @param bound_ops The ops bound, their passwords hashed unless `hash_in_bind`
+         * @param results Sized for `plan`; gets one entry per op
+         */
+        void writeOps(soci::session &sql, const std::vector<PlannedOp> &plan, const json &bound_ops,
+                      bool hash_in_bind, std::size_t base, Records &results, WriteEffects &effects) const;
+
+        /**
+         * @brief writeOps() for the plain updates `plan[first, end)`, of distinct ids, on PostgreSQL.
+         *
+         * The updates go out in one PgPipeline and return their ids; the
+         * updated rows are then read back in one `SELECT`.
+         */
+        void pipelineUpdates(soci::session &sql, const std::vector<PlannedOp> &plan, const json &bound_ops,
+                             bool hash_in_bind, std::size_t first, std::size_t end, std::size_t base,
+                             Records &results, WriteEffects &effects) const;
+
+        /// @brief Whether the entity has an `int` `version` field, see recordTag().
+        [[nodiscard]] bool isVersioned() const;
+
+        /**
+         * @brief The shard database of record `id`, for an EntityShards::Scope over its reads and writes.
+         * @return nullptr for an entity that isn't sharded, or within a Scope already
+         */
+        [[nodiscard]] std::shared_ptr<Database> shardFor(const std::string &id) const;
+
+        /// @brief list() of a sharded entity: each shard's page, merged in sort order and cut to the limit.
+        [[nodiscard]] Records listShards(const json &opts, ListPage &page) const;
+
+        /// @throws MantisException (400) if the entity is sharded; `what` names the operation
+        void rejectSharded(const char *what) const;
+
+        /**
+         * @brief Whether the get rule's row filter, bound for `opts["auth"]`, matches record `id` of `from`.
+         *
+         * Record reads are shared by all requesters, so the filter is its own query. True when the rule
+         * has no filter or `opts` no `auth` (an admin, or a rule-less internal read).
+         */
+        [[nodiscard]] bool getFilterMatches(soci::session &sql, const std::string &from, const std::string &id,
+                                            const json &opts) const;
+
+        /**
+         * @brief Read record `id` inside a write, locking its row where the database can.
+         * @throws MantisException 404 for a missing record
+         */
+        [[nodiscard]] Record readForWrite(soci::session &sql, const std::string &id) const;
+
+        /**
+         * @brief readForWrite(), checking the record is still the version the client read.
+         * @throws MantisException 404 for a missing record, 412 unless its recordTag() is in `if_match`
+         */
+        [[nodiscard]] Record readIfMatch(soci::session &sql, const std::string &id, const std::string &if_match) const;
+
+        /// @brief Hand a committed write's effects to realtime, the user cache and the file cleaner.
+        static void publishEffects(const MantisBase &app, WriteEffects &effects);
+
+        /**
+         * @brief EntitySearch parts for `opts["search"]`, its words bound into `vals` as `:search`.
+         * @return std::nullopt when there is nothing to search for
+         * @throws MantisException (400) if the entity has no searchable fields
+         */
+        [[nodiscard]] std::optional<EntitySearch::Query> searchQuery(const json &opts, soci::values &vals) const;
+
+        /**
+         * @brief EntityGeo parts for `opts["geo"]`, their values bound into `vals`.
+         * @return std::nullopt without `geo`
+         * @throws MantisException (400) if it names no `geo_point` field, or an invalid point, box or radius
+         */
+        [[nodiscard]] std::optional<EntityGeo::Query> geoQuery(const json &opts, soci::values &vals) const;
+
+        /**
+         * @brief The `filter` of `opts`, and the list rule's row filter bound for `opts["auth"]`, as one.
+         * @return nullptr when neither applies
+         * @throws MantisException (400) on an invalid `filter`
+         */
+        [[nodiscard]] std::shared_ptr<const CompiledFilter> queryFilter(const json &opts) const;
+
+        /**
+         * @brief Ids of the `candidates` records nearest `near["vector"]`, nearest first.
+         * @throws MantisException (400) for a `near` list() rejects
+         */
+        [[nodiscard]] std::vector<std::string> nearIds(const json &near, soci::session &sql,
+                                                       std::size_t candidates) const;
+
+        /// @brief read()'s cached point read of `columns`; the text is its statement cache key.
+        [[nodiscard]] std::string pointReadSql(const std::string &columns) const;
+
+        /// @brief recordExists()'s cached statement.
+        [[nodiscard]] std::string existsSql() const;
+
+        /// @brief SELECT column list for `opts["fields"]` plus `extra`, `*` without `fields`.
+        [[nodiscard]] std::string selectList(const json &opts, const std::string &extra = "") const;
+
+        /// @brief Row count from the planner statistics, std::nullopt if there are none yet.
+        [[nodiscard]] std::optional<long long> estimateCount(soci::session &sql) const;
+
         /**
          * @brief Owning application for DB/realtime access.
          *
@@ -265,6 +846,40 @@ namespace mb {
         /// threads.
         std::shared_ptr<const nlohmann::json> m_schema;
 
+        /// Compiled `?filter=` expressions for this schema, shared across copies.
+        std::shared_ptr<EntityFilterCache> m_filterCache;
+
+        /// Columns leading an index (plus `id`), every index's columns, and the
+        /// recommendations already logged; shared across copies.
+        struct SortIndexes {
+            std::unordered_set<std::string> leading;
+            std::vector<std::vector<std::string>> columns;
+            std::mutex mutex;
+            std::unordered_set<std::string> reported;
+        };
+        std::shared_ptr<SortIndexes> m_sortIndexes;
+
+        struct Rules {
+            AccessRule list, get, add, update, del;
+        };
+
+        /// Row decoder compiled from the schema fields and access rules parsed
+        /// (custom expressions compiled), once per schema and on first use, so
+        /// loading every schema at boot skips entities no request reaches yet.
+        /// Shared across copies like m_schema.
+        struct Compiled {
+            std::once_flag once;
+            std::shared_ptr<const RowCodec> codec;
+            std::shared_ptr<const Rules> rules;
+            std::string columns; ///> recordColumns()
+            std::shared_ptr<const CompiledFilter> listFilter, getFilter; ///> Row filters of the list and get rules
+            std::unordered_map<std::string_view, const json *> fieldIndex; ///> Field name -> definition in m_schema, first wins
+            std::shared_ptr<const ValidationPlan> validation; ///> validationPlan()
+        };
+        std::shared_ptr<Compiled> m_compiled;
+
+        const Compiled &compiled() const;
+
         /// Non-owning pointer to the owning application, set from the constructor
         /// reference. A raw pointer (rather than a reference) keeps Entity
         /// copy/move-assignable, which the router's entity cache relies on; it is
@@ -0,0 +1,105 @@
+/**
+ * @file entity_archive.h
+ * @brief Moving an entity's old rows out of its table, see ArchivePolicy.
+ *
+ * With `"archive": {"field": "created", "after_days": 90}`, a background job
+ * moves rows whose `created` is more than 90 days old to `<entity>_mb_archive`,
+ * on the leader only. The archive has the entity's columns and no index but
+ * `id`, so the live table and its indexes hold only recent rows. Reads leave
+ * archived rows out unless asked with `include_archived=true`, which runs the
+ * same query over `UNION ALL` of both tables. Moved rows leave the change
+ * stream as deletes. On PostgreSQL the archive compresses its rows sooner
+ * than other tables do (`toast_tuple_target`); on SQLite, `compress` fields
+ * stay compressed as stored.
+ */
+
+#ifndef MANTISBASE_ENTITY_ARCHIVE_H
+#define MANTISBASE_ENTITY_ARCHIVE_H
+
+#include <cstddef>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace soci {
+    class session;
+}
+
+namespace mb {
+    class Entity;
+    class EntitySchema;
+    class MetricsWriter;
+
+    /**
+     * @brief Archive DDL, the moves, and the table reads with `include_archived` select from.
+     *
+     * @code
+     * EntityArchive::sync(schema, *sql); // with the schema's DDL
+     *
+     * const auto from = EntityArchive::source(entity, *sql);
+     * // SELECT * FROM <from> WHERE ... ORDER BY ... LIMIT 50
+     * @endcode
+     */
+    class EntityArchive {
+    public:
+        /// Rows per move, well under the bound-parameter limits
+        static constexpr std::size_t BATCH = 500;
+
+        /// Moves per entity and run; what is left waits for the next run
+        static constexpr std::size_t MAX_BATCHES = 200;
+
+        /**
+         * @brief Create the archive of `schema` if it archives, and add the columns it lacks.
+         *
+         * An archive outlives its policy: turning `archive` off stops the
+         * moves, and its rows stay readable. Run in the schema change's
+         * transaction, after the table DDL.
+         */
+        static void sync(const EntitySchema &schema, soci::session &sql);
+
+        /// @brief Rename the archive of `from`, if any, along with its entity.
+        static void rename(const std::string &from, const std::string &to, soci::session &sql);
+
+        /// @brief Rename column `from` of the archive of `entity`, if it has one, along with the field.
+        static void renameField(const std::string &entity, const std::string &from, const std::string &to,
+                                soci::session &sql);
+
+        /// @brief Drop the archive of `entity`, if any.
+        static void drop(const std::string &entity, soci::session &sql);
+
+        /// @brief The columns of `table` and their types as declared; empty if it doesn't exist.
+        static std::vector<std::pair<std::string, std::string>> columns(soci::session &sql,
+                                                                        const std::string &table);
+
+        /**
+         * @brief What reads of `entity` select from with `include_archived`.
+         * @return Its live and archived rows as one table of its name, or just its table if it has no archive
+         */
+        static std::string source(const Entity &entity, soci::session &sql);
+
+        /**
+         * @brief Move up to `limit` rows of `entity` older than `cutoff` into its archive, oldest first.
+         *
+         * Run in a write transaction; the archive must exist, see sync().
+         * @return The rows moved; fewer than `limit` once none are left
+         */
+        static std::size_t move(const Entity &entity, soci::session &sql, const std::tm &cutoff,
+                                std::size_t limit = BATCH);
+
+        /**
+         * @brief Archive what is due in each of `entities`, in batches of their own transaction.
+         *
+         * Entities another one references by foreign key are skipped, as
+         * moving their rows would trip `on_delete`.
+         * @return The rows moved
+         */
+        static std::size_t run(const std::vector<std::shared_ptr<const Entity>> &entities);
+
+        /// @brief `mb_archived_rows_total` and `mb_archive_errors_total`.
+        static void writeMetrics(MetricsWriter &out);
+    };
+}
+
+#endif // MANTISBASE_ENTITY_ARCHIVE_H
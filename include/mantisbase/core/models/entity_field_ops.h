@@ -0,0 +1,58 @@
+/**
+ * @file entity_field_ops.h
+ * @brief Update operators that change a field in place: `$inc`, `$push` and `$pull`.
+ *
+ * A PATCH value `{"views": {"$inc": 1}}` compiles to `views = COALESCE(views, 0) + :views`,
+ * so concurrent increments never read a stale count. `$push` and `$pull` append
+ * to and remove from a `json` array with the database's JSON functions. See
+ * Entity::update() and Entity::batch().
+ */
+
+#ifndef MANTISBASE_ENTITY_FIELD_OPS_H
+#define MANTISBASE_ENTITY_FIELD_OPS_H
+
+#include <optional>
+#include <string>
+#include <nlohmann/json.hpp>
+
+namespace soci {
+    class values;
+}
+
+namespace mb {
+    /**
+     * @brief Type checks field operators and compiles them to `SET` expressions.
+     *
+     * @code
+     * // {"tags": {"$push": "x"}}
+     * const auto expr = FieldOps::assignment("sqlite3", "posts", field, value, "tags", vals);
+     * // UPDATE posts SET tags = <expr> WHERE id = :id, with `:tags` bound to `"x"`
+     * @endcode
+     */
+    class FieldOps {
+    public:
+        /// @brief Whether `value` is an operator object: `$inc`, `$push` or `$pull` and its operand.
+        static bool isOperator(const nlohmann::json &value);
+
+        /**
+         * @brief Why `field` (its schema JSON) can't take the operator `value`, an isOperator() object.
+         *
+         * `$inc` takes a number, an integer for `int` fields, on `int` and
+         * `double` fields; `$push` and `$pull` take any JSON value on `json` fields.
+         * @return std::nullopt if it can
+         */
+        static std::optional<std::string> check(const nlohmann::json &field, const nlohmann::json &value);
+
+        /**
+         * @brief The expression assigning `field` of `table` the result of the operator `value`.
+         * @param param Name its operand is bound to in `vals`
+         * @throws MantisException (400) for an operator check() rejects, or
+         *         `$pull` on a database other than SQLite and PostgreSQL
+         */
+        static std::string assignment(const std::string &db_type, const std::string &table,
+                                      const nlohmann::json &field, const nlohmann::json &value,
+                                      const std::string &param, soci::values &vals);
+    };
+}
+
+#endif // MANTISBASE_ENTITY_FIELD_OPS_H
@@ -0,0 +1,218 @@
+/**
+ * @file entity_filter.h
+ * @brief Compiles `?filter=` expressions into parameterized SQL.
+ *
+ * Filters are validated against the entity's fields and turned into a
+ * WHERE clause with named placeholders, so no user input is ever spliced
+ * into the query text. A field may also be a path into a `json` or `list`
+ * field (`meta.country`), compiled to the database's JSON extraction, which
+ * an index declared on the same path serves.
+ */
+
+#ifndef MANTISBASE_ENTITY_FILTER_H
+#define MANTISBASE_ENTITY_FILTER_H
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace mb {
+    class RowCodec;
+
+    /**
+     * @brief A compiled filter as a predicate tree, for matching rows in memory.
+     *
+     * Leaves name their values by index into CompiledFilter::params, so
+     * EntityFilter::bindVariables() applies to both forms at once.
+     */
+    struct FilterNode {
+        enum class Kind { And, Or, Compare, In, NotIn, IsNull, NotNull, Like, NotLike };
+
+        Kind kind = Kind::And;
+        std::string field;                ///< Leaves only; `meta.country` for a JSON path
+        std::string op;                   ///< Compare only: `=`, `<>`, `<`, `<=`, `>` or `>=`
+        std::vector<std::size_t> params;  ///< Leaves only: the values compared with
+        std::vector<FilterNode> children; ///< And / Or only
+    };
+
+    /**
+     * @brief Result of compiling a filter expression.
+     *
+     * `where` references its parameters as `:f0`, `:f1`, ... in the order
+     * they appear in `params`.
+     */
+    struct CompiledFilter {
+        std::string where; ///< SQL boolean expression, without the `WHERE` keyword
+        std::vector<std::pair<std::string, nlohmann::json>> params; ///< Placeholder name -> bound value
+        std::vector<std::string> indexedFields; ///< Filtered fields covered by an entity index
+        /// Fields an index could seek on: those compared with `=`, `IN` or
+        /// `IS NULL` (first) and with a range, outside any `OR`
+        std::vector<std::string> seekFields;
+        std::size_t seekEquals = 0; ///< How many of seekFields are compared for equality
+        /// Placeholder name -> request variable (`auth.id`) it takes its value
+        /// from; rule filters only, see EntityFilter::bindVariables()
+        std::vector<std::pair<std::string, std::string>> variables;
+        /// The same expression, for EntityFilter::matches()
+        std::shared_ptr<const FilterNode> tree;
+    };
+
+    /**
+     * @brief Filter expression compiler.
+     *
+     * Grammar (keywords are case-insensitive):
+     * @code
+     * expr    := term (('||' | OR) term)*
+     * term    := factor (('&&' | AND) factor)*
+     * factor  := '(' expr ')' | field op value | field [NOT] IN list
+     * field   := name ('.' key)*
+     * op      := = | != | > | >= | < | <= | ~ | !~
+     * list    := '[' value (',' value)* ']'  |  '(' value (',' value)* ')'
+     * value   := 'string' | "string" | number | true | false | null
+     * @endcode
+     *
+     * `~` / `!~` map to `LIKE` / `NOT LIKE`; values without a `%` are wrapped
+     * as `%value%`. `= null` and `!= null` map to `IS NULL` / `IS NOT NULL`.
+     * Predicates are emitted as plain `column op :param` so the database can
+     * use any index on the column.
+     *
+     * `meta.country` reads key `country` of the `json` field `meta`; numeric
+     * keys (`tags.0`) index arrays. The path is compiled by jsonPathSql():
+     * `json_extract()` on SQLite, `#>>` on PostgreSQL, `JSON_EXTRACT()` on
+     * MySQL. A value that isn't there, or is JSON null, is SQL NULL. On
+     * PostgreSQL, where the path reads as text, comparing with a number or a
+     * boolean reads it as a number instead, matching only numbers and booleans.
+     *
+     * @code
+     * auto f = EntityFilter::compile("status = 'draft' && (views > 10 || title ~ 'intro')",
+     *                                entity.rowCodec(), {"status"});
+     * // f.where: (status = :f0 AND (views > :f1 OR title LIKE :f2))
+     * @endcode
+     */
+    class EntityFilter {
+    public:
+        /// Upper bound on filter string length, to keep parse work bounded.
+        static constexpr std::size_t MAX_FILTER_LENGTH = 2048;
+        /// Upper bound on the number of bound values in one filter.
+        static constexpr std::size_t MAX_FILTER_PARAMS = 100;
+
+        /**
+         * @brief Compile a filter expression for an entity.
+         * @param filter Filter expression
+         * @param codec Row codec of the entity, used to validate field names
+         * @param indexed Names of columns covered by an entity index
+         * @param db_type Backend the SQL is for (`sqlite3`, `postgresql`, `mysql`); it differs only for JSON paths
+         * @return Compiled filter
+         * @throws MantisException (400) on syntax errors or unknown fields
+         */
+        static CompiledFilter compile(const std::string &filter,
+                                      const RowCodec &codec,
+                                      const std::unordered_set<std::string> &indexed = {},
+                                      const std::string &db_type = "sqlite3");
+
+        /**
+         * @brief Compile an access rule's row filter.
+         *
+         * Same grammar as compile(), but a value may also be a request
+         * variable, `@auth.<field>`, bound per request by bindVariables().
+         * Placeholders are `:r0`, `:r1`, ... so the result can be joined to a
+         * `?filter=` with conjoin().
+         * @code
+         * auto rule = EntityFilter::compileRule("owner = @auth.id || shared = true", entity.rowCodec());
+         * auto bound = EntityFilter::bindVariables(rule, {{"auth", req.auth()}});
+         * // bound.where: (owner = :r0 OR shared = :r1), :r0 is the caller's id
+         * @endcode
+         * @throws MantisException (400) on syntax errors, unknown fields or variables
+         */
+        static CompiledFilter compileRule(const std::string &filter,
+                                          const RowCodec &codec,
+                                          const std::unordered_set<std::string> &indexed = {},
+                                          const std::string &db_type = "sqlite3");
+
+        /**
+         * @brief `filter` with each variable's value looked up in `vars`.
+         *
+         * Unset variables, and ones holding objects or arrays, bind as SQL
+         * NULL, which no comparison matches: a guest's `@auth.id` matches no row.
+         */
+        static CompiledFilter bindVariables(const CompiledFilter &filter, const nlohmann::json &vars);
+
+        /// @brief Rows matching both `a` and `b`, whose placeholders must not clash.
+        static CompiledFilter conjoin(const CompiledFilter &a, const CompiledFilter &b);
+
+        /**
+         * @brief Whether `row` (a record as JSON) matches `filter`, evaluated
+         * in memory as the database would evaluate its `where`.
+         *
+         * A missing or null field matches only `= null`. Numbers and booleans
+         * compare as numbers, strings as bytes, and `~` is SQLite's LIKE:
+         * `%`/`_` wildcards, ASCII case folded. Anything else compared (a
+         * string with a number, a whole JSON field) doesn't match; JSON paths
+         * are followed into the field's object or array. For realtime
+         * subscriptions, which see changed rows rather than run a query.
+         */
+        [[nodiscard]] static bool matches(const CompiledFilter &filter, const nlohmann::json &row);
+
+        /**
+         * @brief SQL reading `path` (`address.city`) out of the json field `field`.
+         *
+         * Filters and index DDL both spell paths through this, so an
+         * expression index on a path serves filters on it.
+         * @param numeric PostgreSQL only: read the value as a number, see the class notes
+         * @throws MantisException (400) if a key isn't letters, digits and `_`
+         */
+        static std::string jsonPathSql(const std::string &db_type, const std::string &field,
+                                       const std::string &path, bool numeric = false);
+
+        /// @brief An index column: a plain column, or `field.path` as an expression on the path.
+        static std::string indexColumnSql(const std::string &db_type, const std::string &column);
+    };
+
+    /**
+     * @brief Bounded per-entity cache of compiled filters.
+     *
+     * Keyed by the raw filter string so repeated dashboard queries skip
+     * re-parsing. Lives alongside the entity's row codec, so a schema change
+     * (which rebuilds the Entity) drops stale entries with it.
+     */
+    class EntityFilterCache {
+    public:
+        /**
+         * @param indexed Names of columns covered by an entity index
+         * @param capacity Maximum number of cached filter strings
+         * @param db_type Backend the filters are compiled for
+         */
+        explicit EntityFilterCache(std::unordered_set<std::string> indexed = {}, std::size_t capacity = 256,
+                                   std::string db_type = "sqlite3");
+
+        /**
+         * @brief Get the compiled form of `filter`, compiling on a miss.
+         * @throws MantisException (400) if the filter does not compile
+         */
+        std::shared_ptr<const CompiledFilter> get(const std::string &filter, const RowCodec &codec);
+
+        /// @brief The cached filter strings, most recently used first.
+        [[nodiscard]] std::vector<std::string> filters() const;
+
+    private:
+        using LruList = std::list<std::string>;
+
+        struct Slot {
+            std::shared_ptr<const CompiledFilter> compiled;
+            LruList::iterator lruPos;
+        };
+
+        mutable std::mutex m_mutex;
+        const std::unordered_set<std::string> m_indexed;
+        std::size_t m_capacity;
+        const std::string m_dbType;
+        LruList m_lru; ///< Most recently used at the front
+        std::unordered_map<std::string, Slot> m_entries;
+    };
+}
+
+#endif // MANTISBASE_ENTITY_FILTER_H
@@ -0,0 +1,123 @@
+/**
+ * @file entity_geo.h
+ * @brief Bounding-box and radius queries over an entity's `geo_point` fields.
+ *
+ * A `geo_point` is stored as JSON text, `{"lat": .., "lng": ..}`. On SQLite
+ * an R*Tree `mb_<entity>_geo` holds every point of the entity, keyed by the
+ * row's rowid and the field's slot, and kept current by triggers. On
+ * PostgreSQL each field gets a GiST index `mb_<entity>_geo_<field>` over
+ * `point(lng, lat)`, so no PostGIS is needed. MySQL reads the points from
+ * the JSON, unindexed. See Entity::list() for `geo`.
+ */
+
+#ifndef MANTISBASE_ENTITY_GEO_H
+#define MANTISBASE_ENTITY_GEO_H
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace soci {
+    class session;
+}
+
+namespace mb {
+    using json = nlohmann::json;
+    class EntitySchema;
+
+    /**
+     * @brief Geo DDL, point values and the query parts that find points in an area.
+     *
+     * Distances are measured on a flat projection around the `near` point,
+     * which is within a fraction of a percent of the great-circle distance
+     * for radii up to a few hundred km; areas don't wrap the antimeridian.
+     *
+     * @code
+     * EntityGeo::sync(schema, *sql); // with the schema's DDL
+     *
+     * EntityGeo::Area area;
+     * area.near = EntityGeo::Point{-1.29, 36.82};
+     * area.radiusKm = 5;
+     * const auto q = EntityGeo::query(db_type, "shops", "location", 0, area);
+     * // SELECT shops.* FROM shops<q.join> WHERE <q.where> ORDER BY <q.distance>, id LIMIT 20
+     * // with q.params bound
+     * @endcode
+     */
+    class EntityGeo {
+    public:
+        /// Geo fields an entity can have, the R*Tree keys taking 4 bits of slot
+        static constexpr std::size_t MAX_FIELDS = 16;
+
+        /// Kilometres per degree of latitude, on a sphere of the Earth's mean radius
+        static constexpr double KM_PER_DEGREE = 111.195;
+
+        struct Point {
+            double lat = 0;
+            double lng = 0;
+        };
+
+        /// Degrees, as in a GeoJSON `bbox`: west, south, east, north
+        struct Box {
+            double west = -180, south = -90, east = 180, north = 90;
+        };
+
+        /// What a list() is restricted to and ordered by
+        struct Area {
+            std::optional<Point> near;     ///< Orders by distance from it
+            std::optional<double> radiusKm; ///< Within this of `near`
+            std::optional<Box> box;
+        };
+
+        /// Parts of a SELECT from the entity restricted to, and ordered by, an Area.
+        struct Query {
+            std::string join;     ///< Appended to `FROM <entity>`; holds every placeholder
+            std::string where;    ///< Condition to AND in, placeholder-free
+            std::string distance; ///< Placeholder-free; smaller is nearer. Empty without `near`.
+            std::vector<std::pair<std::string, double>> params; ///< Values for `join`'s placeholders
+        };
+
+        /**
+         * @brief Validate a `geo_point` value.
+         * @param value `{"lat": .., "lng": ..}`, in degrees
+         * @throws MantisException (400) naming `field` if it's anything else, or out of range
+         */
+        static Point parse(const json &value, const std::string &field);
+
+        /// @brief The stored text of `point`, `{"lat":..,"lng":..}`.
+        static std::string encode(const Point &point);
+
+        /**
+         * @brief Parse `count` comma-separated numbers, as in `near=lat,lng` or `bbox=w,s,e,n`.
+         * @throws MantisException (400) naming `param` unless there are exactly `count`
+         */
+        static std::vector<double> parseNumbers(std::string_view text, std::size_t count, const std::string &param);
+
+        /// @brief `box` as put in list() opts, `[west, south, east, north]`; throws 400 if it's out of range.
+        static Box parseBox(const json &box);
+
+        /**
+         * @brief Create, rebuild or drop what querying `schema`'s geo fields needs.
+         *
+         * A no-op when its R*Tree or indexes are current; otherwise they are
+         * (re)built from the rows already in the table. Run in the schema
+         * change's transaction, after the table DDL.
+         */
+        static void sync(const EntitySchema &schema, soci::session &sql);
+
+        /// @brief Drop the R*Tree of `entity` and its triggers (SQLite); PostgreSQL indexes go with the table.
+        static void drop(const std::string &entity, soci::session &sql);
+
+        /**
+         * @brief The query parts for `area` on `entity`'s `field`, its `slot`-th geo field.
+         * @throws MantisException (400) for a radius without `near`, or a negative one
+         */
+        static Query query(const std::string &db_type, const std::string &entity, const std::string &field,
+                           std::size_t slot, const Area &area);
+    };
+}
+
+#endif // MANTISBASE_ENTITY_GEO_H
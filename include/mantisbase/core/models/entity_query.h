@@ -0,0 +1,395 @@
+/**
+ * @file entity_query.h
+ * @brief Typed queries for code embedding MantisBase, without JSON or HTTP in between.
+ *
+ * A struct is mapped to an entity's fields once, at compile time, by
+ * specializing RecordFields. Queries then select only the mapped columns
+ * and read each row straight into the struct. Reads go through the same
+ * Entity as the REST API, so its compiled filters, record cache, and replica
+ * routing apply. Writes go through Entity::create() and update(), so
+ * validation, record hooks and realtime events happen as they do for HTTP.
+ * Access rules are skipped unless the query is run as() a caller.
+ *
+ * @code
+ * struct Post {
+ *     std::string id;
+ *     std::string title;
+ *     int views = 0;
+ *     std::optional<std::string> summary;
+ * };
+ *
+ * template<> struct mb::RecordFields<Post> {
+ *     static constexpr auto fields = std::make_tuple(
+ *         mb::recordField("id", &Post::id), mb::recordField("title", &Post::title),
+ *         mb::recordField("views", &Post::views), mb::recordField("summary", &Post::summary));
+ * };
+ *
+ * auto posts = app.entity("posts").query().where("views > 10").sort("-views").limit(20).fetch<Post>();
+ * @endcode
+ */
+
+#ifndef MANTISBASE_ENTITY_QUERY_H
+#define MANTISBASE_ENTITY_QUERY_H
+
+#include <array>
+#include <concepts>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "entity.h"
+
+namespace mb {
+    /// @brief One mapped member: the record field `name` read into and written from `member`.
+    template<typename T, typename M>
+    struct RecordField {
+        const char *name;
+        M T::*member;
+    };
+
+    template<typename T, typename M>
+    constexpr RecordField<T, M> recordField(const char *name, M T::*member) {
+        return {name, member};
+    }
+
+    /**
+     * @brief Field mapping of `T`; specialize with a `static constexpr` tuple of recordField()s named `fields`.
+     *
+     * Fields left out of the mapping are neither selected nor written.
+     */
+    template<typename T>
+    struct RecordFields;
+
+    namespace entity_query {
+        template<typename M>
+        struct IsOptional : std::false_type {};
+
+        template<typename M>
+        struct IsOptional<std::optional<M>> : std::true_type {};
+
+        template<typename M>
+        struct Unwrapped { using type = M; };
+
+        template<typename M>
+        struct Unwrapped<std::optional<M>> { using type = M; };
+
+        /// Member types a record field is read into, each optionally a std::optional
+        template<typename M>
+        concept Value = std::same_as<M, std::string> || std::same_as<M, bool> || std::is_arithmetic_v<M> ||
+                        std::same_as<M, json> || std::same_as<M, std::vector<float>>;
+
+        template<typename M>
+        concept Member = Value<typename Unwrapped<M>::type>;
+
+        template<typename Field>
+        struct MemberOf;
+
+        template<typename T, typename M>
+        struct MemberOf<RecordField<T, M>> { using type = M; };
+
+        template<typename Tuple, std::size_t... I>
+        constexpr bool membersSupported(std::index_sequence<I...>) {
+            return (Member<typename MemberOf<std::tuple_element_t<I, Tuple>>::type> && ...);
+        }
+
+        /// @brief Whether `kind` columns convert to `M`; what a mapping is checked against once per query.
+        template<typename M>
+        bool holds(const RowCodec::Kind kind) {
+            using Kind = RowCodec::Kind;
+            using V = typename Unwrapped<M>::type;
+            if constexpr (std::same_as<V, json>) return kind != Kind::Unknown;
+            else if constexpr (std::same_as<V, std::string>)
+                return kind == Kind::Text || kind == Kind::File || kind == Kind::Date || kind == Kind::Json ||
+                       kind == Kind::Files || kind == Kind::Vector || kind == Kind::GeoPoint;
+            else if constexpr (std::same_as<V, bool>) return kind == Kind::Bool;
+            else if constexpr (std::same_as<V, std::vector<float>>) return kind == Kind::Vector;
+            else return kind == Kind::Int || kind == Kind::Double || kind == Kind::Bool || kind == Kind::Blob;
+        }
+
+        /// @brief An `int` column at its schema precision, as RowCodec reads it.
+        std::int64_t readInt(const soci::row &row, std::size_t i, int precision);
+
+        /// @brief A `blob` column, selected as its length.
+        std::int64_t readLength(const soci::row &row, std::size_t i);
+
+        /// @brief The text of a `date`, `json`, `list`, `files` or `vector` column; JSON text for the structured ones.
+        std::string readText(const soci::row &row, std::size_t i, const RowCodec::Column &col);
+
+        /// @brief Read the non-null cell `i` into `out`, holds() having allowed it.
+        template<typename V>
+        void read(const soci::row &row, const std::size_t i, const RowCodec::Column &col, V &out) {
+            using Kind = RowCodec::Kind;
+            if constexpr (std::same_as<V, json>) {
+                if (col.decode) out = col.decode(row, i);
+            } else if constexpr (std::same_as<V, std::string>) {
+                if (col.kind == Kind::Text || col.kind == Kind::File) out = row.get<std::string>(i, "");
+                else out = readText(row, i, col);
+            } else if constexpr (std::same_as<V, bool>) {
+                out = row.get<bool>(i);
+            } else if constexpr (std::same_as<V, std::vector<float>>) {
+                out = VectorIndex::decode(row.get<std::string>(i, ""));
+            } else {
+                switch (col.kind) {
+                    case Kind::Double: out = static_cast<V>(row.get<double>(i)); break;
+                    case Kind::Bool: out = static_cast<V>(row.get<bool>(i)); break;
+                    case Kind::Blob: out = static_cast<V>(readLength(row, i)); break;
+                    default: out = static_cast<V>(readInt(row, i, col.precision));
+                }
+            }
+        }
+
+        /// @brief The record field of `value`, for Entity::create() and update().
+        template<typename M>
+        json write(const M &value) {
+            if constexpr (IsOptional<M>::value) return value ? write(*value) : json();
+            else if constexpr (std::same_as<M, std::vector<float>>) return value.empty() ? json() : json(value);
+            else return value;
+        }
+
+        /// @brief A record's field into `out`; nulls and missing fields leave it as it was.
+        template<typename M>
+        void readJson(const json &record, const char *name, M &out) {
+            const auto it = record.find(name);
+            if constexpr (IsOptional<M>::value) {
+                if (it == record.end() || it->is_null()) {
+                    out.reset();
+                    return;
+                }
+                typename M::value_type value{};
+                readJson(record, name, value);
+                out = std::move(value);
+            } else {
+                if (it == record.end() || it->is_null()) return;
+                if constexpr (std::same_as<M, json>) out = *it;
+                else if constexpr (std::same_as<M, std::string>) out = it->is_string() ? it->get<std::string>() : it->dump();
+                else out = it->get<M>();
+            }
+        }
+    }
+
+    /// @brief A type with a RecordFields mapping whose members are all readable.
+    template<typename T>
+    concept MappedRecord = std::is_default_constructible_v<T> && requires {
+        typename std::tuple_size<std::remove_cvref_t<decltype(RecordFields<T>::fields)>>::type;
+    } && entity_query::membersSupported<std::remove_cvref_t<decltype(RecordFields<T>::fields)>>(
+        std::make_index_sequence<std::tuple_size_v<std::remove_cvref_t<decltype(RecordFields<T>::fields)>>>{});
+
+    /**
+     * @brief A list() query built step by step and read into structs, see the file overview.
+     *
+     * Cheap to copy; each call reads its own snapshot of the entity, taken
+     * when Entity::query() was called.
+     */
+    class EntityQuery {
+    public:
+        /// One page of typed records, and the `after()` cursor of the next
+        template<typename T>
+        struct Page {
+            std::vector<T> records;
+            std::string cursor; ///> Empty on the last page
+        };
+
+        explicit EntityQuery(Entity entity);
+
+        /// @brief Keep records matching an EntityFilter expression; several where()s must all match.
+        EntityQuery &where(const std::string &filter);
+
+        /// @brief Sort by a field, `-` prefixed for descending; `id` by default.
+        EntityQuery &sort(const std::string &field);
+
+        /// @brief Records per page, 50 by default and at most MAX_LIST_PAGE_SIZE.
+        EntityQuery &limit(int limit);
+
+        /// @brief Continue after the cursor of an earlier page().
+        EntityQuery &after(const std::string &cursor);
+
+        /// @brief Keep records holding every word in their search fields, see EntitySearch.
+        EntityQuery &search(const std::string &words);
+
+        /**
+         * @brief Apply the entity's access rules for `auth`, as the REST API would for that caller.
+         *
+         * `auth` is `{id, entity, user}`: the user's id, their auth entity
+         * (`mb_admins` for admins, who pass every rule) and their record.
+         * Without as() no rule is checked.
+         */
+        EntityQuery &as(const json &auth);
+
+        /**
+         * @brief The page of records matching the query, read straight from the rows.
+         *
+         * Null columns leave their members as they were default constructed,
+         * or std::nullopt for optional ones.
+         * @throws MantisException (400) for a bad filter or cursor, or a mapped field the entity lacks
+         * @throws MantisException (403) if as() was given and the list rule denies it
+         * @throws MantisException (500) if a mapped member can't hold its field's type
+         */
+        template<MappedRecord T>
+        [[nodiscard]] Page<T> page() const {
+            constexpr auto &fields = RecordFields<T>::fields;
+            constexpr auto count = std::tuple_size_v<std::remove_cvref_t<decltype(fields)>>;
+            const auto names = std::apply([](const auto &...field) {
+                return std::array<std::string_view, count>{field.name...};
+            }, fields);
+            const auto holders = std::apply([](const auto &...field) {
+                return std::array<Holds, count>{
+                    &entity_query::holds<typename entity_query::MemberOf<std::remove_cvref_t<decltype(field)>>::type>...
+                };
+            }, fields);
+            checkFields(names, holders);
+
+            Page<T> page;
+            std::array<std::size_t, count> at{};
+            std::array<const RowCodec::Column *, count> columns{};
+            std::optional<RowPlan> plan;
+
+            const auto sort = m_entity.listRows(options(names), [&](const soci::row &row) {
+                if (!plan) plan = planRow(row, names, at, columns);
+                T record{};
+                [&]<std::size_t... I>(std::index_sequence<I...>) {
+                    (readCell(row, at[I], columns[I], record.*(std::get<I>(fields).member)), ...);
+                }(std::make_index_sequence<count>{});
+                page.records.push_back(std::move(record));
+                track(row, *plan);
+            });
+            page.cursor = plan ? nextCursor(sort, *plan) : std::string{};
+            return page;
+        }
+
+        /// @brief page()'s records alone.
+        template<MappedRecord T>
+        [[nodiscard]] std::vector<T> fetch() const {
+            return page<T>().records;
+        }
+
+        /// @brief The first matching record, if any.
+        template<MappedRecord T>
+        [[nodiscard]] std::optional<T> first() const {
+            auto one = *this;
+            auto records = one.limit(1).template page<T>().records;
+            if (records.empty()) return std::nullopt;
+            return std::move(records.front());
+        }
+
+        /**
+         * @brief Record `id`, through Entity::read() and so the record cache; where() and sort() don't apply.
+         * @throws MantisException (403) if as() was given and the get rule denies it
+         */
+        template<MappedRecord T>
+        [[nodiscard]] std::optional<T> get(const std::string &id) const {
+            const auto record = readRecord(id);
+            if (!record) return std::nullopt;
+            return fromRecord<T>(*record);
+        }
+
+        /**
+         * @brief Create a record of the mapped fields, with hooks and realtime events as over HTTP.
+         * @return The created record, with its generated fields
+         * @throws MantisException as Entity::create(), and 403 if as() was given and the add rule denies it
+         */
+        template<MappedRecord T>
+        [[nodiscard]] T create(const T &record) const {
+            return fromRecord<T>(createRecord(toRecord(record)));
+        }
+
+        /**
+         * @brief Update record `id` with the mapped fields, see create().
+         *
+         * `id`, `created` and `updated` are never written.
+         */
+        template<MappedRecord T>
+        [[nodiscard]] T update(const std::string &id, const T &record) const {
+            return fromRecord<T>(updateRecord(id, toRecord(record)));
+        }
+
+        /// @brief The mapped members of `record` as a record object; unset optionals and empty vectors are null.
+        template<MappedRecord T>
+        static json toRecord(const T &record) {
+            auto out = json::object();
+            std::apply([&](const auto &...field) {
+                ((out[field.name] = entity_query::write(record.*(field.member))), ...);
+            }, RecordFields<T>::fields);
+            return out;
+        }
+
+        /// @brief A record object read into a `T`, as page() reads a row.
+        template<MappedRecord T>
+        static T fromRecord(const json &record) {
+            T out{};
+            std::apply([&](const auto &...field) {
+                (entity_query::readJson(record, field.name, out.*(field.member)), ...);
+            }, RecordFields<T>::fields);
+            return out;
+        }
+
+    private:
+        using Holds = bool (*)(RowCodec::Kind);
+
+        /// Where a page's rows hold `id` and the sort field, and their values in the last row so far
+        struct RowPlan {
+            std::size_t idAt = std::string::npos;
+            std::size_t sortAt = std::string::npos;
+            const RowCodec::Column *sortColumn = nullptr;
+            std::string id;
+            json value;
+        };
+
+        /**
+         * @brief Check the mapped fields against the schema before any query runs.
+         * @param holds Per mapped member, whether it can hold a field of a given kind
+         */
+        void checkFields(std::span<const std::string_view> names, std::span<const Holds> holds) const;
+
+        /// @brief list() options selecting `names` and `id`, with the query's filter, sort, page and rule auth.
+        [[nodiscard]] json options(std::span<const std::string_view> names) const;
+
+        /// @brief Resolve the row ordinal and column of each mapped field, and of `id` and the sort field.
+        [[nodiscard]] RowPlan planRow(const soci::row &row, std::span<const std::string_view> names,
+                                      std::span<std::size_t> at, std::span<const RowCodec::Column *> columns) const;
+
+        /// @brief Keep the row's id and sort value, which the next page's cursor is made of.
+        static void track(const soci::row &row, RowPlan &plan);
+
+        [[nodiscard]] static std::string nextCursor(ListCursor sort, const RowPlan &plan);
+
+        [[nodiscard]] std::optional<json> readRecord(const std::string &id) const;
+        [[nodiscard]] json createRecord(const json &record) const;
+        [[nodiscard]] json updateRecord(const std::string &id, json record) const;
+
+        /// @brief Throw 403 unless the as() caller passes `rule`, `body` being what it writes; no-op without as().
+        void checkRule(const AccessRule &rule, const json &body = json::object()) const;
+
+        template<typename M>
+        static void readCell(const soci::row &row, const std::size_t i, const RowCodec::Column *col, M &out) {
+            if (i == std::string::npos || !col) return;
+            if constexpr (entity_query::IsOptional<M>::value) {
+                if (row.get_indicator(i) == soci::i_null) {
+                    out.reset();
+                    return;
+                }
+                typename M::value_type value{};
+                entity_query::read(row, i, *col, value);
+                out = std::move(value);
+            } else {
+                if (row.get_indicator(i) == soci::i_null) return;
+                entity_query::read(row, i, *col, out);
+            }
+        }
+
+        Entity m_entity;
+        std::vector<std::string> m_filters;
+        std::string m_sort;
+        std::string m_after;
+        std::string m_search;
+        int m_limit = 50;
+        std::optional<json> m_auth; ///> as() caller; rules apply only when set
+    };
+}
+
+#endif // MANTISBASE_ENTITY_QUERY_H
@@ -11,9 +11,18 @@
 namespace mb {
     HandlerFn entityGetManyHandler();
     HandlerFn entityGetOneHandler();
+    HandlerFn entityExportHandler();
+    HandlerFn entityAggregateHandler();
     HandlerWithContentReaderFn entityPostHandler();
     HandlerWithContentReaderFn entityPatchHandler();
     HandlerFn entityDeleteHandler();
+    HandlerFn entityBatchHandler();
+    HandlerFn entityTransactionHandler();
+    /// `POST /api/v1/batch`: up to MAX_BATCH_READS gets, lists and aggregates, run side by side on the DB workers
+    AsyncHandlerFn entityBatchReadHandler();
+    HandlerWithContentReaderFn entityImportHandler();
+    HandlerFn entityBlobGetHandler();
+    HandlerWithContentReaderFn entityBlobPatchHandler();
 
     void registerAdminEntityRoutes();
 }
@@ -18,6 +18,48 @@
 #include "access_rules.h"
 
 namespace mb {
+    /**
+     * @brief How a `view` entity keeps its rows in a table, see MaterializedViews.
+     *
+     * The query lives in a plain view, `<name>_mb_source`, and its rows are
+     * copied into a table named after the entity, which reads hit.
+     */
+    struct ViewMaterialization {
+        bool enabled = false;
+        std::string refreshKey;            ///> View column holding the `id` of its one source row; enables incremental refresh
+        int refreshInterval = 0;           ///> Seconds between full refreshes, 0 to refresh on source changes only
+        std::vector<std::string> sources;  ///> Entities the query reads; empty to match any entity the query names
+
+        /// @brief `{"materialized", "refresh_key", "refresh_interval", "sources"}`, keys already in `into` kept unless `j` has them.
+        static ViewMaterialization fromJSON(const nlohmann::json &j, ViewMaterialization into = {});
+
+        void toJSON(nlohmann::json &j) const;
+
+        /// @brief The view holding the query of materialized view `view_name`.
+        static std::string sourceOf(const std::string &view_name) { return view_name + "_mb_source"; }
+    };
+
+    /**
+     * @brief When a `base` or `auth` entity moves old rows out of its table, see EntityArchive.
+     *
+     * Rows whose `field` is more than `afterDays` days old go to the table
+     * `<name>_mb_archive`, read only with `include_archived=true`.
+     */
+    struct ArchivePolicy {
+        std::string field = "created"; ///> A `date` field the age is read from
+        int afterDays = 0;             ///> 0 keeps every row in the table
+
+        [[nodiscard]] bool enabled() const { return afterDays > 0; }
+
+        /// @brief The `archive` key of `j`: `{"field", "after_days"}`, or null to turn archival off; `into` if absent.
+        static ArchivePolicy fromJSON(const nlohmann::json &j, ArchivePolicy into = {});
+
+        void toJSON(nlohmann::json &j) const;
+
+        /// @brief The table holding the archived rows of `entity_name`.
+        static std::string tableOf(const std::string &entity_name) { return entity_name + "_mb_archive"; }
+    };
+
     /**
      * @brief Builder class for creating and managing database table schemas.
      *
@@ -228,6 +270,21 @@ namespace mb {
 
         EntitySchema &setViewQuery(const std::string &viewQuery);
 
+        /// @brief Materialization of a `view` entity; disabled for plain views and tables.
+        [[nodiscard]] const ViewMaterialization &materialization() const;
+
+        EntitySchema &setMaterialization(const ViewMaterialization &materialization);
+
+        /// @brief Archival of old rows; disabled unless the schema sets `archive`.
+        [[nodiscard]] const ArchivePolicy &archive() const;
+
+        EntitySchema &setArchive(const ArchivePolicy &archive);
+
+        /// @brief SQLite files the rows are spread over by id, see EntityShards; 1 unless the schema sets `shards`.
+        [[nodiscard]] int shards() const;
+
+        EntitySchema &setShards(int shards);
+
         [[nodiscard]] const std::vector<IndexDefinition> &indexes() const;
 
         EntitySchema &addIndex(const IndexDefinition &index);
@@ -253,6 +310,14 @@ namespace mb {
          */
         [[nodiscard]] std::string toDDL() const;
 
+        /**
+         * @brief Statements creating a materialized view's table, run after toDDL().
+         *
+         * toDDL() creates the source view; this fills the table from it and
+         * indexes the refresh key. Empty unless materialized.
+         */
+        [[nodiscard]] std::vector<std::string> materializedDDL() const;
+
         [[nodiscard]] std::vector<std::string> indexDDL() const;
 
         /**
@@ -272,8 +337,8 @@ namespace mb {
         // ----------- SCHEMA CRUD ----------- //
         /**
          * @brief List all tables from database.
-         * @param opts Optional parameters (pagination, etc.)
-         * @return JSON array of table schemas
+         * @param opts `{"pagination": {"limit", "after"}}` for one KeysetPage of them, by id
+         * @return JSON array of table schemas, or KeysetPage::envelope() of them when paged
          */
         static nlohmann::json listTables(const MantisBase &app, const nlohmann::json &opts = nlohmann::json::object());
 
@@ -376,6 +441,9 @@ namespace mb {
         std::string m_name;
         std::string m_type;
         std::string m_viewSqlQuery;
+        ViewMaterialization m_materialization;
+        ArchivePolicy m_archive;
+        int m_shards = 1;
         bool m_isSystem = false;
         bool m_hasApi = true;
         std::vector<EntitySchemaField> m_fields;
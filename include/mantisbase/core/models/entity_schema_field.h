@@ -89,6 +89,17 @@ namespace mb {
 
         EntitySchemaField &setPrecision(int precision);
 
+        /// @brief Components of a `vector` field, 0 for other types.
+        [[nodiscard]] int dim() const;
+
+        /**
+         * @brief Set the components of a `vector` field (fluent interface).
+         * @param dim 1 to VectorIndex::MAX_DIM
+         * @return Reference to self for chaining
+         * @throws MantisException (400) outside that range
+         */
+        EntitySchemaField &setDim(int dim);
+
         /**
          * @brief Check if field is required.
          * @return true if required
@@ -141,6 +152,37 @@ namespace mb {
          */
         EntitySchemaField &setIsUnique(bool unique);
 
+        /**
+         * @brief Check if `?search=` matches this field's text.
+         * @return true if searchable
+         */
+        [[nodiscard]] bool isSearchable() const;
+
+        /**
+         * @brief Include the field in the entity's full-text search (fluent
+         * interface). Only `string` and `xml` fields may be searchable.
+         * @param searchable Searchable flag
+         * @return Reference to self for chaining
+         * @see EntitySearch
+         */
+        EntitySchemaField &setIsSearchable(bool searchable);
+
+        /**
+         * @brief Check if large values are stored compressed.
+         * @return true if compressed
+         */
+        [[nodiscard]] bool compress() const;
+
+        /**
+         * @brief Store large values zstd-compressed (fluent interface). Only
+         * `string`, `xml` and `json` fields may be compressed, and they can't
+         * then be filtered or sorted on.
+         * @param compress Compress flag
+         * @return Reference to self for chaining
+         * @see FieldCompression
+         */
+        EntitySchemaField &setCompress(bool compress);
+
         /**
          * @brief Check if field is a foreign key.
          * @return true if foreign key
@@ -262,8 +304,9 @@ namespace mb {
 
     private:
         std::string m_id, m_name, m_type;
-        int m_precision = 32;
-        bool m_required = false, m_primaryKey = false, m_isSystem = false, m_isUnique = false;
+        int m_precision = 32, m_dim = 0;
+        bool m_required = false, m_primaryKey = false, m_isSystem = false, m_isUnique = false,
+             m_isSearchable = false, m_compress = false;
         nlohmann::json m_constraints{}, m_foreignKey{};
     };
 } // mb
@@ -14,6 +14,9 @@ namespace mb {
     HandlerFn schemaPostHandler();
     HandlerFn schemaPatchHandler();
     HandlerFn schemaDeleteHandler();
+    HandlerFn schemaMigrationGetHandler();     ///> Progress of an online migration, see SchemaMigrations
+    HandlerFn schemaMigrationDeleteHandler();  ///> Cancel it, or forget a finished one
+    HandlerFn schemaRefreshHandler();          ///> Refresh a materialized view now, see MaterializedViews
 }
 
 #endif // MANTISBASE_ENTITY_SCHEMA_ROUTES_H
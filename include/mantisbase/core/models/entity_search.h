@@ -0,0 +1,74 @@
+/**
+ * @file entity_search.h
+ * @brief Full-text search over an entity's `searchable` fields.
+ *
+ * On SQLite, an FTS5 table `mb_<entity>_fts` indexes the fields, reading
+ * their text from the entity's own table and kept current by triggers. On
+ * PostgreSQL, a GIN index `mb_<entity>_search` covers `to_tsvector` of the
+ * fields, so nothing else needs maintaining. See Entity::list() for `search`.
+ */
+
+#ifndef MANTISBASE_ENTITY_SEARCH_H
+#define MANTISBASE_ENTITY_SEARCH_H
+
+#include <string>
+#include <vector>
+
+namespace soci {
+    class session;
+}
+
+namespace mb {
+    class EntitySchema;
+
+    /**
+     * @brief Search DDL and the query parts that match and rank records.
+     *
+     * @code
+     * EntitySearch::sync(schema, *sql); // with the schema's DDL
+     *
+     * const auto q = EntitySearch::query(db_type, "posts", {"title", "body"});
+     * // SELECT posts.* FROM posts<q.join> [WHERE <q.where>] ORDER BY <q.rank>, id LIMIT 20
+     * // with `:search` bound to EntitySearch::bindValue(db_type, text)
+     * @endcode
+     */
+    class EntitySearch {
+    public:
+        /// Parts of a SELECT from the entity restricted to, and ranked by, `:search`.
+        struct Query {
+            std::string join;  ///< Appended to `FROM <entity>`
+            std::string where; ///< Condition to AND in, empty if `join` already restricts
+            std::string rank;  ///< Lower is a better match; `ORDER BY rank ASC`
+        };
+
+        /**
+         * @brief Create, rebuild or drop what searching `schema` needs.
+         *
+         * A no-op when its search table or index is current; otherwise it is
+         * (re)built from the rows already in the table. Run in the schema
+         * change's transaction, after the table DDL.
+         */
+        static void sync(const EntitySchema &schema, soci::session &sql);
+
+        /// @brief Drop the search table (SQLite) or index (PostgreSQL) of `entity`.
+        static void drop(const std::string &entity, soci::session &sql);
+
+        /**
+         * @brief The query parts for `entity` searched over `fields`.
+         * @throws MantisException (400) on databases other than SQLite and PostgreSQL
+         */
+        static Query query(const std::string &db_type, const std::string &entity,
+                           const std::vector<std::string> &fields);
+
+        /**
+         * @brief What `:search` is bound to for the words of `text`.
+         *
+         * Records match when they hold every word. For FTS5 each word is
+         * quoted, so operators and punctuation in `text` are never query syntax.
+         * @return Empty if `text` holds no words
+         */
+        static std::string bindValue(const std::string &db_type, const std::string &text);
+    };
+}
+
+#endif // MANTISBASE_ENTITY_SEARCH_H
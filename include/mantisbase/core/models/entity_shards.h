@@ -0,0 +1,132 @@
+/**
+ * @file entity_shards.h
+ * @brief The rows of one entity spread over several SQLite files, see EntitySchema::shards().
+ *
+ * A SQLite file takes one writer at a time. A `base` entity created with
+ * `"shards": 4` keeps its rows in four tables of the same name: shard 0 in
+ * the application's database, shards 1 to 3 in `<dataDir>/shards/<entity>.<n>.db`,
+ * each with a writer of its own, so writes landing on different shards don't
+ * queue behind each other. A row's shard is a hash of its `id`: reads,
+ * updates and deletes of one record go to that shard alone, while lists and
+ * counts ask every shard and merge them by the sort key, so cursors read as
+ * for any entity. Rows written to shards 1 and up reach realtime through the
+ * change journal, not `mb_change_log`.
+ *
+ * What can't hold across files is refused when the schema is validated:
+ * unique fields and indexes, relations to or from the entity, `file`, `files`,
+ * searchable, `geo_point` and `vector` fields, and archival. Batches,
+ * transactions, imports, exports, aggregates and EntityQuery of a sharded
+ * entity answer 400, and its fields, name and shard count are fixed once created.
+ */
+
+#ifndef MANTISBASE_ENTITY_SHARDS_H
+#define MANTISBASE_ENTITY_SHARDS_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace mb {
+    class Database;
+    class EntitySchema;
+    class MantisBase;
+
+    /**
+     * @brief Opens the shard databases of sharded entities, and routes MantisBase::db() to one.
+     *
+     * Thread-safe. Shard databases open on first use, with a small pool each,
+     * and stay open until their entity is dropped or the application closes.
+     * Entity code reaches a shard by a Scope over the work on that shard.
+     *
+     * @code
+     * const EntityShards::Scope scope(shards.db("events", EntityShards::shardOf(id, 4)));
+     * app.db(); // shard `shardOf(id, 4)` of `events` until the scope ends
+     * @endcode
+     */
+    class EntityShards {
+    public:
+        /// Upper bound on EntitySchema::shards()
+        static constexpr int MAX_SHARDS = 64;
+
+        struct Options {
+            int poolSize = 4; ///> MB_SHARD_POOL_SIZE: connections per shard database
+
+            /// @brief Read MB_SHARD_POOL_SIZE.
+            static Options fromEnv();
+        };
+
+        /// Sets the shard database of the calling thread, restoring the previous one on exit
+        class Scope {
+        public:
+            /// @param db The shard, or nullptr to leave the calling thread's as it is
+            explicit Scope(std::shared_ptr<Database> db);
+            ~Scope();
+
+            Scope(const Scope &) = delete;
+            Scope &operator=(const Scope &) = delete;
+
+        private:
+            std::shared_ptr<Database> m_db; ///> Held, so a drop never closes it under the scope
+            Database *m_previous;
+        };
+
+        EntityShards(const MantisBase &app, Options options);
+        ~EntityShards();
+
+        EntityShards(const EntityShards &) = delete;
+        EntityShards &operator=(const EntityShards &) = delete;
+
+        /// @brief The shard of row `id` among `shards`: FNV-1a of the id, the same in every process.
+        static int shardOf(std::string_view id, int shards);
+
+        /// @brief The file of shard `index` (1 and up) of `entity`, under `<data_dir>/shards`, per tenant if `tenant`.
+        static std::string fileOf(const std::string &data_dir, const std::string &tenant, const std::string &entity,
+                                  int index);
+
+        /**
+         * @brief Why `schema` can't be spread over its shards(), if it can't.
+         * @return std::nullopt for a schema that can
+         */
+        static std::optional<std::string> validate(const EntitySchema &schema);
+
+        /**
+         * @brief Shard `index` of `entity` in the calling thread's tenant.
+         *
+         * Shard 0 is the database MantisBase::db() returns outside a Scope;
+         * the others are opened on first use.
+         * @throws MantisException (500) if the shard's database fails to open
+         */
+        std::shared_ptr<Database> db(const std::string &entity, int index);
+
+        /**
+         * @brief Create the table and indexes of `schema` in its shards 1 and up.
+         *
+         * Run by EntitySchema::createTable() before its transaction commits; a
+         * throw leaves no shard file behind.
+         * @throws MantisException (500) if a shard fails to open or take the DDL
+         */
+        void create(const EntitySchema &schema);
+
+        /// @brief Close shards 1 and up of `entity`, out of `shards`, and delete their files.
+        void drop(const std::string &entity, int shards);
+
+        /// @brief Close every shard database; scopes holding one keep it until they end.
+        void closeAll();
+
+        /// @brief The calling thread's shard database, or nullptr outside a Scope.
+        static Database *current();
+
+    private:
+        const MantisBase &m_app;
+        const Options m_options;
+
+        mutable std::mutex m_mutex;
+        std::unordered_map<std::string, std::shared_ptr<Database>> m_open; ///> By fileOf()
+    };
+}
+
+#endif // MANTISBASE_ENTITY_SHARDS_H
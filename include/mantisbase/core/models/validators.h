@@ -9,7 +9,11 @@
 #ifndef MANTISBASE_VALIDATORS_H
 #define MANTISBASE_VALIDATORS_H
 
+#include <optional>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 #include "mantisbase/core/database.h"
 #include "mantisbase/core/models/entity.h"
@@ -21,8 +25,25 @@ namespace mb {
 
     class Validators {
     public:
+        /**
+         * @brief A built-in field validator, e.g. `@email`.
+         *
+         * `regex` documents the format; values are checked by `match`, a
+         * hand-written single pass over the value, so no input can make a
+         * check backtrack.
+         */
+        struct Preset {
+            std::string regex;
+            std::string error;
+            bool (*match)(std::string_view value);
+        };
+
+        /// @brief `regex` and `error` of the preset named `key`, with or without the leading `@`.
         static std::optional<json> findPreset(const std::string &key);
 
+        /// @brief The preset named `key`, or nullptr. Presets are built once, at startup.
+        static const Preset *preset(std::string_view key);
+
         static std::optional<std::string> validatePreset(const std::string &key, const std::string &value);
 
         static std::optional<std::string> minimumConstraintCheck(const json &field, const json &body);
@@ -39,12 +60,51 @@ namespace mb {
 
         static std::optional<std::string> validateTableSchema(const json &entity_schema);
 
+        /**
+         * @brief Check a create body against the entity's ValidationPlan.
+         *
+         * Only fields present in `body`, and required fields missing from it,
+         * are checked; keys naming no field are left to the insert.
+         */
         static std::optional<std::string> validateRequestBody(const Entity &entity, const json &body);
 
+        /// @brief Check an update body field by field; unknown keys are an error.
         static std::optional<std::string> validateUpdateRequestBody(const Entity &entity, const json &body);
 
     private:
-        static std::unordered_map<std::string, json> presets;
+        static const std::unordered_map<std::string_view, Preset> presets;
+    };
+
+    /**
+     * @brief The constraints of an entity's fields, read out of the schema once.
+     *
+     * Built on first use per schema version (see Entity::validationPlan()) so
+     * validating a body doesn't re-read `required`, `constraints` and
+     * `validator` per field per record; a batch import checks thousands of
+     * records against one plan.
+     */
+    struct ValidationPlan {
+        struct Check {
+            const json *field = nullptr; ///> Definition inside the entity schema
+            std::string_view name;       ///> Views `field`'s name
+            enum class Type { Other, String, Number } type = Type::Other;
+            bool required = false;       ///> Required, and without a database default
+            std::optional<double> min, max;
+            const Validators::Preset *preset = nullptr; ///> `validator` preset of a string field
+            std::string refEntity, refField;            ///> Foreign key target; no key if refEntity is empty
+        };
+
+        std::vector<Check> checks;                                  ///> Schema order; `id`, `created`, `updated` left out
+        std::vector<std::size_t> required;                          ///> Indices of the required checks
+        std::unordered_map<std::string_view, std::size_t> index;   ///> Field name -> check, first wins
+
+        /// @param fields Outlive the plan, which points into them
+        static ValidationPlan compile(const std::vector<json> &fields);
+
+        [[nodiscard]] const Check *find(std::string_view name) const;
+
+        /// @brief The required, min, max, validator and foreign key checks of `check` on `value`, in that order.
+        static std::optional<std::string> run(const Check &check, const json &value);
     };
 } // mb
 
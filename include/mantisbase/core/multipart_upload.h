@@ -0,0 +1,147 @@
+/**
+ * @file multipart_upload.h
+ * @brief Spools multipart uploads to disk as they arrive.
+ *
+ * File parts are written to a staging file under Files::stagingDir() and
+ * hashed while they stream in, so an upload holds one network chunk in
+ * memory whatever the file size. MantisContentReader::writeFiles() renames
+ * the staged files into the entity's directory once the record is saved.
+ * Given a FileIo, the writes go through it and the IO loop reading the
+ * body doesn't wait for the disk.
+ * @see Router::registerDrogonHandlerWithReader()
+ */
+
+#ifndef MANTISBASE_MULTIPART_UPLOAD_H
+#define MANTISBASE_MULTIPART_UPLOAD_H
+
+#include "file_io.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace trantor {
+    class EventLoop;
+}
+
+namespace mb {
+    class Sha256Hasher;
+
+    struct FormDataItem {
+        std::string name;
+        std::string content;      ///> Value of a non-file field
+        std::string filename;
+        std::string content_type;
+        std::string staged_path;  ///> File parts: staging file holding the data, empty once moved into place
+        std::size_t size = 0;     ///> Bytes in the part
+        std::string sha256;       ///> File parts: hex digest of the data
+    };
+
+    /**
+     * @brief Receives a multipart body part by part.
+     *
+     * Non-file fields are kept in memory, up to `maxField` each. File parts go
+     * straight to a staging file. Limits are checked as the data arrives, so
+     * an oversized upload fails without being stored first. Staged files not
+     * handed over by finish() are removed on destruction. Not thread-safe.
+     *
+     * @code
+     * MultipartUpload upload(Files::stagingDir(), MultipartUpload::Limits::fromEnv());
+     * upload.beginPart("avatar", "me.png", "image/png");
+     * upload.append(chunk.data(), chunk.size());
+     * auto parts = upload.finish();
+     * @endcode
+     *
+     * With a FileIo, hand the parts over from whenWritten(), once the
+     * staged data is on disk, rather than have finish() wait for it.
+     */
+    class MultipartUpload {
+    public:
+        struct Limits {
+            std::size_t maxBody = 1024 * 1024;          ///> Non-multipart request body
+            std::size_t maxUpload = 64 * 1024 * 1024;   ///> Whole multipart body
+            std::size_t maxFile = 64 * 1024 * 1024;     ///> One file part
+            std::size_t maxField = 1024 * 1024;         ///> One non-file field
+
+            /**
+             * @brief Read MB_MAX_BODY_SIZE, MB_MAX_UPLOAD_SIZE and MB_MAX_FILE_SIZE (bytes).
+             * The file limit defaults to the upload limit.
+             */
+            static Limits fromEnv();
+        };
+
+        /// @param io Takes the staging writes and unlinks while it runs; null writes them inline
+        MultipartUpload(std::filesystem::path staging_dir, Limits limits, FileIo *io = nullptr);
+        ~MultipartUpload();
+
+        MultipartUpload(const MultipartUpload &) = delete;
+        MultipartUpload &operator=(const MultipartUpload &) = delete;
+
+        /// @brief Start the next part; one with a filename is a file part and is staged on disk.
+        void beginPart(std::string name, std::string filename, std::string content_type);
+
+        /**
+         * @brief Append data to the current part.
+         * @throws MantisException 413 past a limit, 500 if the staging file can't be written
+         */
+        void append(const char *data, std::size_t size);
+
+        /**
+         * @brief End the last part and hand over all parts, staged files included.
+         *
+         * Waits for staging writes still in flight.
+         * @throws MantisException 500 if one of them failed
+         */
+        [[nodiscard]] std::vector<FormDataItem> finish();
+
+        /// @brief End the last part and call `done` once every staged file is on disk, on this upload's IO loop.
+        void whenWritten(std::function<void()> done);
+
+        /// @brief Drop every part received so far, removing their staging files.
+        void abort();
+
+        /// @brief Bytes received so far.
+        [[nodiscard]] std::size_t bytes() const { return m_bytes; }
+
+        [[nodiscard]] const Limits &limits() const { return m_limits; }
+
+        /// @brief Remove the staging files still held by `items`; in the background with a running `io`.
+        static void discard(std::vector<FormDataItem> &items, FileIo *io = nullptr);
+
+    private:
+        /// Staged files whose writes are still in flight, shared with their close callbacks
+        struct Staging {
+            std::mutex mutex;
+            std::condition_variable closed;
+            std::size_t open = 0;
+            std::error_code error;              ///> The first failed write
+            std::function<void()> whenWritten;
+            std::vector<std::string> orphans;   ///> Aborted: removed once their writes are done
+        };
+
+        void endPart();
+        /// Close the current part's writer; counted in `m_staging` until its writes are done
+        void closeWriter();
+
+        const std::filesystem::path m_dir;
+        const Limits m_limits;
+        FileIo *const m_io;
+        trantor::EventLoop *const m_loop;       ///> Where whenWritten() calls back; null off a loop
+        std::shared_ptr<Staging> m_staging = std::make_shared<Staging>();
+        std::shared_ptr<FileIo::Writer> m_writer;
+        std::vector<FormDataItem> m_items;
+        std::ofstream m_file;
+        std::unique_ptr<Sha256Hasher> m_hasher;
+        bool m_inPart = false;
+        std::size_t m_bytes = 0;
+    };
+}
+
+#endif // MANTISBASE_MULTIPART_UPLOAD_H
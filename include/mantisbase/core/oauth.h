@@ -5,6 +5,8 @@
 #include <optional>
 #include <nlohmann/json.hpp>
 
+#include "keyset_page.h"
+
 namespace mb {
     using json = nlohmann::json;
 
@@ -29,15 +31,24 @@ namespace mb {
                                  const std::string &user_id,
                                  const std::string &provider_name);
 
+        /// @brief listAccounts() of one user's links.
         static json getLinkedAccounts(const std::string &entity_name,
-                                     const std::string &user_id);
+                                     const std::string &user_id, const KeysetPage &page = {});
+
+        /**
+         * @brief A page of linked accounts, in id order; never their tokens.
+         * @param filters Any of `entity_name`, `user_id` and `provider` (name) to keep to
+         * @return KeysetPage::envelope() of the accounts
+         */
+        static json listAccounts(const KeysetPage &page = {}, const json &filters = json::object());
 
         static json getProviders(const std::string &entity_name);
 
         static json addProvider(const json &provider_data);
         static json updateProvider(const std::string &provider_id, const json &updates);
         static bool removeProvider(const std::string &provider_id);
-        static json listProviders();
+        /// @brief A page of the providers by id, never their secrets; `filters` may hold `enabled`.
+        static json listProviders(const KeysetPage &page = {}, const json &filters = json::object());
 
         static json enableProviderForEntity(const std::string &entity_name,
                                            const std::string &provider_id);
@@ -0,0 +1,165 @@
+/**
+ * @file oauth_client.h
+ * @brief HTTP to OAuth providers: reused connections and cached documents.
+ *
+ * Requests run on an event loop of the client's own, like S3Storage's, so
+ * a slow provider never stalls the IO loop a request arrived on. One
+ * HttpClient is kept per provider origin, so a token exchange reuses the
+ * connection and TLS session of the previous one instead of opening its
+ * own. Documents that rarely change (OIDC discovery, JWKS) are cached for
+ * their `Cache-Control: max-age`, or Options::ttl without one.
+ */
+
+#ifndef MANTISBASE_OAUTH_CLIENT_H
+#define MANTISBASE_OAUTH_CLIENT_H
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace drogon {
+    class HttpClient;
+}
+
+namespace trantor {
+    class EventLoopThread;
+}
+
+namespace mb {
+    /**
+     * @brief Sends provider requests asynchronously, with blocking wrappers for handler code.
+     *
+     * @code
+     * auto &http = OAuthClient::instance();
+     * http.documentAsync(discovery_url, [](const OAuthClient::Document &doc) { ... }); // on the client's loop
+     * const auto oidc = http.document(discovery_url);  // waits; cached after the first call
+     * @endcode
+     *
+     * The blocking calls are meant for RouteExec::DbWorker handlers; called
+     * on the client's own loop they would wait on themselves, and throw.
+     */
+    class OAuthClient {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        struct Options {
+            std::chrono::seconds ttl{3600};   ///> Documents without a max-age are kept this long
+            std::chrono::seconds maxTtl{86400}; ///> Cap on a provider's max-age
+            double documentTimeout = 5.0;     ///> Seconds, per discovery or JWKS request
+            double tokenTimeout = 10.0;       ///> Seconds, per token exchange
+
+            /// @brief Read MB_OAUTH_CACHE_TTL (seconds).
+            static Options fromEnv();
+        };
+
+        struct Response {
+            int status = 0; ///> 0 if the request never got an answer
+            std::string body;
+            std::string cacheControl;
+        };
+
+        /// A fetched or cached document, or why there is none
+        struct Document {
+            std::optional<nlohmann::json> json;
+            std::string error;
+        };
+
+        using ResponseCallback = std::function<void(const Response &)>;
+        using DocumentCallback = std::function<void(const Document &)>;
+
+        explicit OAuthClient(Options options);
+        ~OAuthClient();
+
+        OAuthClient(const OAuthClient &) = delete;
+        OAuthClient &operator=(const OAuthClient &) = delete;
+
+        /// @brief The client OAuthManager uses, built from Options::fromEnv().
+        static OAuthClient &instance();
+
+        /// @brief GET `url`; `done` runs on the client's loop.
+        void getAsync(const std::string &url, double timeout, ResponseCallback done);
+
+        /// @brief POST a form to `url`, asking for JSON back; `done` runs on the client's loop.
+        void postFormAsync(const std::string &url, const std::string &form, double timeout, ResponseCallback done);
+
+        /**
+         * @brief The JSON at `url`, from the cache while fresh; concurrent misses share one request.
+         *
+         * If refreshing an expired document fails, the stale copy is answered
+         * rather than the error, so a provider's hiccup doesn't fail logins.
+         */
+        void documentAsync(const std::string &url, DocumentCallback done);
+
+        /**
+         * @brief documentAsync(), waited for.
+         * @throw MantisException (502) if the provider didn't answer with JSON
+         */
+        nlohmann::json document(const std::string &url);
+
+        /**
+         * @brief postFormAsync(), waited for.
+         * @throw MantisException (502) if the provider didn't answer
+         */
+        Response postForm(const std::string &url, const std::string &form);
+
+        /// @brief Cache `doc` for `url` for `ttl`, as a fetch would have.
+        void remember(const std::string &url, nlohmann::json doc, std::chrono::seconds ttl);
+
+        /// @brief Drop every cached document.
+        void clear();
+
+        /// @brief Cached documents, fresh or not.
+        [[nodiscard]] std::size_t cached() const;
+
+        /// @brief Origins with a client so far.
+        [[nodiscard]] std::size_t clients() const;
+
+        [[nodiscard]] const Options &options() const { return m_opts; }
+
+        /**
+         * @brief `scheme://host[:port]` and the rest of `url`, `/` if there is none.
+         * @throw MantisException (400) if `url` isn't http(s)
+         */
+        static std::pair<std::string, std::string> splitUrl(const std::string &url);
+
+        /// @brief The `max-age` of a Cache-Control value, 0 for `no-store`/`no-cache`, none if it has neither.
+        static std::optional<std::chrono::seconds> maxAge(const std::string &cache_control);
+
+    private:
+        struct Entry {
+            nlohmann::json doc;
+            Clock::time_point expires;
+        };
+
+        /// The client for `origin`, created on first use
+        std::shared_ptr<drogon::HttpClient> clientFor(const std::string &origin);
+
+        /// A GET, or a form POST if `form` is set
+        void sendAsync(const std::string &url, const std::optional<std::string> &form, double timeout,
+                       ResponseCallback done);
+
+        /// Answer everyone waiting on `url`
+        void settle(const std::string &url, const Document &doc);
+
+        /// Throws if called on the loop the callbacks run on
+        void assertNotOnLoop() const;
+
+        const Options m_opts;
+        std::unique_ptr<trantor::EventLoopThread> m_loop;
+
+        mutable std::mutex m_mutex;
+        std::map<std::string, std::shared_ptr<drogon::HttpClient>> m_clients;
+        std::map<std::string, Entry> m_documents;
+        std::map<std::string, std::vector<DocumentCallback>> m_waiting; ///> Requests in flight, by URL
+    };
+}
+
+#endif // MANTISBASE_OAUTH_CLIENT_H
@@ -0,0 +1,155 @@
+/**
+ * @file password_hasher.h
+ * @brief Bounded pool for password hashing and verification.
+ *
+ * Each bcrypt call is tens of milliseconds of pure CPU. Run on whatever
+ * thread asked, a burst of logins or signups takes every core the HTTP and
+ * database workers have. hashPassword() and verifyPassword() queue the work
+ * here instead: a few threads, and a cap on what may wait for them, past
+ * which callers get a 429 rather than queueing without bound.
+ *
+ * The cost is tuned when the pool starts, so one hash takes about
+ * Options::target on this machine rather than whatever the library default
+ * costs here. Hashes stored with other parameters still verify, and are
+ * rehashed in the background on the next successful login. argon2id, with
+ * a fixed memory bound, is available in builds with `MB_ARGON2_ENABLED`.
+ */
+
+#ifndef MANTISBASE_PASSWORD_HASHER_H
+#define MANTISBASE_PASSWORD_HASHER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace mb {
+    class WorkerPool;
+
+    /**
+     * @brief Runs bcrypt on a pool of its own, see hashPassword() and verifyPassword().
+     *
+     * @code
+     * PasswordHasher::instance().start();   // Router::listen()
+     * const auto ok = verifyPassword(input, stored);  // waits for a worker, or throws 429
+     * PasswordHasher::instance().stop();    // runs what is queued, then inline work again
+     * @endcode
+     *
+     * While stopped (CLI commands, before the server listens) the work runs
+     * on the calling thread, as it always did.
+     */
+    class PasswordHasher {
+    public:
+        struct Options {
+            std::size_t workers = 2;      ///> Threads; bcrypt uses one core each
+            std::size_t maxQueued = 64;   ///> Calls waiting for a worker before new ones are refused
+
+            std::string algorithm = "bcrypt";      ///> For new hashes: `bcrypt`, or `argon2id` if argon2Available()
+            std::chrono::milliseconds target{50};  ///> What one hash should take here, see calibrate()
+            unsigned bcryptCost = 0;               ///> log2 rounds; 0 to calibrate
+            std::uint32_t argon2MemoryKiB = 19456; ///> Memory each argon2id hash and check takes
+            std::uint32_t argon2Iterations = 0;    ///> Passes over that memory; 0 to calibrate
+            std::uint32_t argon2Parallelism = 1;
+
+            /**
+             * @brief Read MB_PASSWORD_WORKERS, MB_PASSWORD_QUEUE, MB_PASSWORD_ALGO,
+             * MB_PASSWORD_TARGET_MS, MB_BCRYPT_COST, MB_ARGON2_MEMORY_KB and MB_ARGON2_ITERATIONS.
+             */
+            static Options fromEnv();
+        };
+
+        static constexpr unsigned MIN_BCRYPT_COST = 10;       ///> The library default; calibration never goes lower
+        static constexpr unsigned MAX_BCRYPT_COST = 16;
+        static constexpr std::uint32_t MIN_ARGON2_ITERATIONS = 2;
+        static constexpr std::uint32_t MAX_ARGON2_ITERATIONS = 10;
+
+        explicit PasswordHasher(Options options);
+        ~PasswordHasher();
+
+        PasswordHasher(const PasswordHasher &) = delete;
+        PasswordHasher &operator=(const PasswordHasher &) = delete;
+
+        /// @brief The pool hashPassword() and verifyPassword() use, built from Options::fromEnv().
+        static PasswordHasher &instance();
+
+        /// @brief Calibrate the cost, then start the workers.
+        void start();
+        void stop();
+
+        /**
+         * @brief Time a cheap hash and scale the costs left at 0 to Options::target.
+         *
+         * bcrypt doubles its time per cost step; argon2id grows linearly
+         * with its passes. Both stay within the MIN_ and MAX_ bounds.
+         */
+        void calibrate();
+
+        /// @brief Whether this build can hash and verify argon2id.
+        static bool argon2Available();
+
+        /**
+         * @brief Hash of `password`, with the algorithm and cost new hashes use.
+         * @throw MantisException (429) if too many calls are waiting already
+         */
+        std::string hash(const std::string &password);
+
+        /**
+         * @brief Whether `password` matches `stored_hash`.
+         * @throw MantisException (429) if too many calls are waiting already
+         */
+        bool verify(const std::string &password, const std::string &stored_hash);
+
+        /// @brief Whether `stored_hash` uses another algorithm or other parameters than new hashes do.
+        [[nodiscard]] bool needsRehash(const std::string &stored_hash) const;
+
+        /**
+         * @brief After a successful login, replace an outdated `stored_hash` of `entity` row `id` in the background.
+         *
+         * Skipped while stopped or busy; the next login tries again. The row
+         * is left alone if its password changed meanwhile.
+         */
+        void rehashLater(const std::string &entity, const std::string &id, const std::string &password,
+                         const std::string &stored_hash);
+
+        [[nodiscard]] unsigned bcryptCost() const { return m_bcryptCost.load(); }
+        [[nodiscard]] std::uint32_t argon2Iterations() const { return m_argon2Iterations.load(); }
+
+        /// @brief Stored hashes replaced by rehashLater() so far.
+        [[nodiscard]] std::size_t rehashed() const { return m_rehashed.load(); }
+
+        /// @brief Calls queued or running now.
+        [[nodiscard]] std::size_t inFlight() const { return m_inFlight.load(); }
+
+        /// @brief Calls refused with a 429 so far.
+        [[nodiscard]] std::size_t rejected() const { return m_rejected.load(); }
+
+        [[nodiscard]] const Options &options() const { return m_opts; }
+
+    private:
+        /// Run `work` on a worker and wait for it, or inline while stopped
+        template<typename T>
+        T run(std::function<T()> work);
+
+        /// Reserve a slot for one call, false if none is left
+        bool admit();
+
+        /// New hashes are argon2id; Options::algorithm asks for it in a build that has it
+        bool useArgon2() const;
+
+        std::string hashNow(const std::string &password) const;
+        bool verifyNow(const std::string &password, const std::string &stored_hash) const;
+
+        const Options m_opts;
+        std::unique_ptr<WorkerPool> m_pool;
+        std::atomic<unsigned> m_bcryptCost;
+        std::atomic<std::uint32_t> m_argon2Iterations;
+        std::atomic<std::size_t> m_inFlight{0};
+        std::atomic<std::size_t> m_rejected{0};
+        std::atomic<std::size_t> m_rehashed{0};
+    };
+}
+
+#endif // MANTISBASE_PASSWORD_HASHER_H
@@ -0,0 +1,59 @@
+/**
+ * @file pg_pipeline.h
+ * @brief Runs of PostgreSQL statements sent in one round trip.
+ *
+ * SOCI sends a statement and waits for its result before the next, so a
+ * batch of N updates waits on the network N times. PgPipeline writes them
+ * all through libpq's pipeline mode on the session's own connection, and
+ * so inside its transaction, then reads the results back in order. Each
+ * statement text is prepared once per connection under a name of its own.
+ * Needs libpq 14 or newer; MB_PG_PIPELINE=0 turns it off.
+ * @see Entity::batch()
+ */
+
+#ifndef MANTISBASE_PG_PIPELINE_H
+#define MANTISBASE_PG_PIPELINE_H
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace soci {
+    class session;
+}
+
+namespace mb {
+    class MetricsWriter;
+
+    class PgPipeline {
+    public:
+        struct Statement {
+            std::string sql; ///> With `$1`..`$n` placeholders; the key it is prepared under
+            std::vector<std::optional<std::string>> params; ///> Text format, std::nullopt for NULL
+        };
+
+        /// Statements per sync; bounds what either side buffers before the other reads
+        static constexpr std::size_t MAX_DEPTH = 256;
+
+        /// Prepared statement names kept per connection; past it, statements go unnamed
+        static constexpr std::size_t MAX_PREPARED = 128;
+
+        /// @brief Whether `sql` is a PostgreSQL session that can pipeline, and MB_PG_PIPELINE isn't `0`.
+        [[nodiscard]] static bool available(soci::session &sql);
+
+        /**
+         * @brief Run `statements` in order, on `sql`'s connection.
+         *
+         * After a failed statement the rest are skipped by the server; inside
+         * a transaction it is aborted, for the caller to roll back.
+         * @return Per statement, the first column of each row it returned
+         * @throws std::runtime_error with the server's message for the first one that failed
+         */
+        static std::vector<std::vector<std::string>> run(soci::session &sql, const std::vector<Statement> &statements);
+
+        static void writeMetrics(MetricsWriter &out);
+    };
+}
+
+#endif // MANTISBASE_PG_PIPELINE_H
@@ -0,0 +1,87 @@
+/**
+ * @file pool_metrics.h
+ * @brief Connection pool counters: lease wait times, sessions in use, timeouts.
+ *
+ * Database records every lease and hand-back here, so the time a request
+ * spends waiting for a session can be told apart from the time it spends in
+ * the database. Served by `GET /api/v1/sys/database` under `pool`.
+ * @see database.h
+ */
+
+#ifndef MANTISBASE_POOL_METRICS_H
+#define MANTISBASE_POOL_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace mb {
+    /**
+     * @brief Lock-free counters for a connection pool.
+     *
+     * Thread-safe; every record*() call is a handful of relaxed atomic
+     * operations, cheap enough for each lease.
+     *
+     * @code
+     * const auto started = PoolMetrics::Clock::now();
+     * if (!pool.try_lease(pos, timeout_ms)) { metrics.recordTimeout(PoolMetrics::Clock::now() - started); ... }
+     * metrics.recordAcquire(PoolMetrics::Clock::now() - started);
+     * // ... on give_back(pos):
+     * metrics.recordRelease();
+     * @endcode
+     */
+    class PoolMetrics {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        /// Upper bounds of the wait histogram buckets; a last bucket counts everything slower.
+        static constexpr std::array<std::chrono::microseconds, 8> WAIT_BUCKETS = {
+            std::chrono::microseconds(100), std::chrono::milliseconds(1), std::chrono::milliseconds(5),
+            std::chrono::milliseconds(10), std::chrono::milliseconds(50), std::chrono::milliseconds(100),
+            std::chrono::milliseconds(500), std::chrono::seconds(1)
+        };
+
+        struct Snapshot {
+            std::uint64_t acquired = 0;    ///> Leases handed out
+            std::uint64_t timeouts = 0;    ///> Leases given up after the acquire timeout
+            std::int64_t inUse = 0;        ///> Sessions leased right now
+            std::int64_t maxInUse = 0;     ///> Most sessions leased at once
+            std::int64_t open = 0;         ///> Connections currently open
+            std::uint64_t opened = 0;      ///> Connections opened on demand after startup
+            std::uint64_t closed = 0;      ///> Idle connections closed to shrink the pool
+            double totalWaitMs = 0;        ///> Summed wait of the leases handed out
+            double maxWaitMs = 0;          ///> Longest wait, including timed out leases
+            std::array<std::uint64_t, WAIT_BUCKETS.size() + 1> waitBuckets{}; ///> Leases per wait bucket
+        };
+
+        /// @brief A lease was handed out after waiting `wait`.
+        void recordAcquire(Clock::duration wait);
+
+        /// @brief A leased session was given back.
+        void recordRelease();
+
+        /// @brief A lease gave up after waiting `wait`.
+        void recordTimeout(Clock::duration wait);
+
+        /// @brief `count` connections were opened; `on_demand` when growing past the startup size.
+        void recordOpen(std::size_t count = 1, bool on_demand = true);
+
+        /// @brief An idle connection was closed.
+        void recordClose();
+
+        /// @brief Index into Snapshot::waitBuckets for a lease that waited `wait`.
+        [[nodiscard]] static std::size_t bucketFor(Clock::duration wait);
+
+        [[nodiscard]] Snapshot snapshot() const;
+
+    private:
+        std::atomic<std::uint64_t> m_acquired{0}, m_timeouts{0}, m_opened{0}, m_closed{0};
+        std::atomic<std::int64_t> m_inUse{0}, m_maxInUse{0}, m_open{0};
+        std::atomic<std::int64_t> m_totalWaitNs{0}, m_maxWaitNs{0};
+        std::array<std::atomic<std::uint64_t>, WAIT_BUCKETS.size() + 1> m_waitBuckets{};
+    };
+}
+
+#endif // MANTISBASE_POOL_METRICS_H
@@ -0,0 +1,78 @@
+/**
+ * @file profiler.h
+ * @brief In-process sampling CPU profiler and allocator statistics.
+ *
+ * Backs `GET /api/v1/debug/profile` and `GET /api/v1/debug/heap`, so a
+ * production instance can be profiled without attaching tools to it.
+ * CPU time of all threads is sampled with `SIGPROF` (ITIMER_PROF), each
+ * sample being the stack of the thread that was running. The profile is
+ * written in the gperftools CPU profile format, which `pprof` reads along
+ * with the executable: `pprof -top ./mantisbase profile.prof`. Linux only.
+ */
+
+#ifndef MANTISBASE_PROFILER_H
+#define MANTISBASE_PROFILER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace mb {
+    /**
+     * @brief Samples the process' stacks for a while; one profile at a time.
+     *
+     * @code
+     * const auto profile = Profiler::collect(std::chrono::seconds(30));
+     * res.send(200, Profiler::toPprof(profile), "application/octet-stream");
+     * @endcode
+     */
+    class Profiler {
+    public:
+        static constexpr int MAX_DEPTH = 64;           ///> Frames kept per sample
+        static constexpr std::size_t MAX_SAMPLES = 1 << 14; ///> Samples kept per profile; later ones are counted as dropped
+        static constexpr int MAX_HZ = 1000;
+
+        struct Profile {
+            std::chrono::microseconds period{0};                 ///> Between samples, in CPU time
+            std::map<std::vector<void *>, std::uint64_t> stacks; ///> Innermost frame first -> samples
+            std::uint64_t samples = 0;
+            std::uint64_t dropped = 0;
+        };
+
+        /// @brief True if this build can profile.
+        static bool supported();
+
+        /**
+         * @brief Sample for `duration`, `hz` times per second of CPU time, and return what was seen.
+         *
+         * Blocks the calling thread throughout; it isn't sampled while waiting.
+         * @throws MantisException 409 while another profile runs, 501 where unsupported
+         */
+        static Profile collect(std::chrono::milliseconds duration, int hz = 100);
+
+        /// @brief `profile` in the gperftools CPU profile format, followed by this process' memory map.
+        static std::string toPprof(const Profile &profile);
+
+        /**
+         * @brief The `top` functions seen most, as `self` (innermost) and `total` (anywhere on the stack) samples.
+         *
+         * Names come from the dynamic symbol table; functions it lacks show
+         * as `<module>+0x<offset>`, to be resolved with addr2line or pprof.
+         */
+        static nlohmann::json summary(const Profile &profile, std::size_t top = 30);
+
+        /**
+         * @brief The allocator's view of the heap and the resident set size, in bytes.
+         *
+         * `arena`, `in_use`, `free` and `mmap` from glibc's mallinfo2(),
+         * and `rss` from /proc/self/statm; keys the platform lacks are absent.
+         */
+        static nlohmann::json allocatorStats();
+    };
+}
+
+#endif // MANTISBASE_PROFILER_H
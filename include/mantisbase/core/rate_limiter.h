@@ -0,0 +1,134 @@
+/**
+ * @file rate_limiter.h
+ * @brief GCRA rate limiting with sharded, fixed-size per-key state.
+ *
+ * Backs the rateLimit() middleware. Each route gets its own limiter, so the
+ * login and setup limits don't share a budget. A key costs one integer no
+ * matter how fast it sends, and idle keys are evicted in the background.
+ * With a RateLimitStore installed, nodes behind a load balancer count into
+ * one budget instead of a budget each.
+ */
+
+#ifndef MANTISBASE_RATE_LIMITER_H
+#define MANTISBASE_RATE_LIMITER_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+namespace mb {
+    /**
+     * @brief TATs kept outside the process, shared by every node.
+     *
+     * Implementations run one GCRA step per call, atomically on their side,
+     * and on their own clock, so nodes whose clocks drift still agree.
+     * @see DbRateLimitStore
+     */
+    class RateLimitStore {
+    public:
+        /// Outcome of one step; times in nanoseconds on the store's clock
+        struct Step {
+            bool allowed = false;
+            std::int64_t tat = 0;   ///> The advanced TAT if allowed, the standing one if not
+            std::int64_t now = 0;
+        };
+
+        virtual ~RateLimitStore() = default;
+
+        /**
+         * @brief Count one request for `key` if its TAT is at most `tolerance` ahead of now.
+         * @return nullopt if the store can't be reached; the limiter then counts locally
+         */
+        virtual std::optional<Step> step(const std::string &key, std::int64_t interval, std::int64_t tolerance) = 0;
+
+        /// @brief Drop keys whose bucket has filled up again; called by the background sweep.
+        virtual void evictIdle() {}
+    };
+
+    /**
+     * @brief `limit` requests per `window` and key, as a generic cell rate algorithm.
+     *
+     * Equivalent to a token bucket of `limit` tokens refilled evenly over
+     * `window`. Per key, only the theoretical arrival time (TAT) is stored,
+     * and it is advanced with a compare-and-swap. Keys are spread over shards.
+     * A request takes a shard's lock shared, or exclusively only when it adds
+     * a key, so concurrent requests contend on neither one mutex nor the map.
+     *
+     * Thread-safe. Keys whose bucket has filled up again carry no state and
+     * are dropped by a background sweep every minute; see evictIdle().
+     *
+     * @code
+     * const auto limiter = RateLimiter::create(5, std::chrono::seconds(60));
+     * if (const auto d = limiter->acquire(ip); !d.allowed) return tooManyRequests(d.retryAfter);
+     * @endcode
+     */
+    class RateLimiter {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        struct Decision {
+            bool allowed = false;
+            int remaining = 0;                   ///> Requests left right now
+            std::chrono::seconds retryAfter{0};  ///> When denied: wait before the next one is allowed
+            std::chrono::seconds reset{0};       ///> Until the bucket is full again
+        };
+
+        /**
+         * @brief A limiter, registered with the background sweep for as long as it lives.
+         * @param scope Names the limiter's keys in a shared store; limiters with the same scope share budgets
+         */
+        static std::shared_ptr<RateLimiter> create(int limit, std::chrono::seconds window,
+                                                   const std::string &scope = "");
+
+        RateLimiter(int limit, std::chrono::seconds window, std::string scope = "");
+
+        RateLimiter(const RateLimiter &) = delete;
+        RateLimiter &operator=(const RateLimiter &) = delete;
+
+        /// @brief Count one request for `key`, unless it is over the limit; in the shared store if one is set.
+        Decision acquire(const std::string &key, Clock::time_point now = Clock::now());
+
+        /// @brief Count into `store` from now on, or locally again for nullptr. Process-wide, thread-safe.
+        static void setStore(std::shared_ptr<RateLimitStore> store);
+
+        [[nodiscard]] static std::shared_ptr<RateLimitStore> store();
+
+        /// @brief Drop keys with a full bucket; @return How many were dropped
+        std::size_t evictIdle(Clock::time_point now = Clock::now());
+
+        /// @brief Keys currently tracked.
+        [[nodiscard]] std::size_t size() const;
+
+        [[nodiscard]] int limit() const { return m_limit; }
+        [[nodiscard]] std::chrono::seconds window() const { return m_window; }
+
+    private:
+        static constexpr std::size_t SHARDS = 32;
+
+        struct Shard {
+            mutable std::shared_mutex mutex;
+            /// Key -> TAT, in steady-clock nanoseconds; nodes don't move, so the atomics stay put
+            std::unordered_map<std::string, std::atomic<std::int64_t>> tats;
+        };
+
+        Shard &shardOf(const std::string &key);
+        Decision acquireLocal(const std::string &key, Clock::time_point now);
+        /// `tat` after the step if allowed, before it if not
+        [[nodiscard]] Decision decide(bool allowed, std::int64_t tat, std::int64_t now) const;
+
+        const int m_limit;
+        const std::chrono::seconds m_window;
+        const std::int64_t m_interval;    ///> Nanoseconds one request uses up: window / limit
+        const std::int64_t m_tolerance;   ///> How far the TAT may run ahead of now: window - interval
+        const std::string m_scope;        ///> Prefixes keys in the shared store
+        std::array<Shard, SHARDS> m_shards;
+    };
+}
+
+#endif // MANTISBASE_RATE_LIMITER_H
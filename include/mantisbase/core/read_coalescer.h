@@ -0,0 +1,100 @@
+/**
+ * @file read_coalescer.h
+ * @brief Single-flight record reads: identical concurrent reads share one query.
+ *
+ * When a popular record changes, every subscriber re-fetches it at once.
+ * Instead of one query each, the first read runs and the others wait for
+ * its result. See Entity::read().
+ */
+
+#ifndef MANTISBASE_READ_COALESCER_H
+#define MANTISBASE_READ_COALESCER_H
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <nlohmann/json.hpp>
+
+namespace mb {
+    /**
+     * @brief Reads in flight keyed by (entity, id, projection).
+     *
+     * A read joins one that is still running under the same key, and gets a
+     * copy of its result or its exception. Nothing is kept once the read
+     * ends, so this is no cache. A read that started before a change to its
+     * row committed may not answer readers who came after: forget() (called
+     * by local writes) and onChanges() (the change stream) detach such reads,
+     * and the next reader starts a fresh one.
+     *
+     * Access rules are checked before the read and the record does not
+     * depend on who asks, so the key holds no principal.
+     *
+     * Thread-safe.
+     *
+     * @code
+     * auto record = Entity::readFlights().read("posts", id, columns, [&] { return query(id); });
+     * @endcode
+     */
+    class ReadCoalescer {
+    public:
+        using Result = std::optional<nlohmann::json>;
+
+        struct Stats {
+            std::uint64_t led = 0;    ///> Reads that ran their query
+            std::uint64_t joined = 0; ///> Reads served by another one's query
+        };
+
+        /// @param enabled False runs every read on its own (MB_READ_COALESCING=0)
+        explicit ReadCoalescer(bool enabled = true);
+
+        /**
+         * @brief Run `fetch`, or wait for the identical read already running.
+         * @param projection What the read selects; reads only join equal ones
+         * @throws Whatever `fetch` threw, in every read that waited on it
+         */
+        Result read(const std::string &entity, const std::string &id, const std::string &projection,
+                    const std::function<Result()> &fetch);
+
+        /// @brief Let no later reader join reads of row `id` now running (after a write to it).
+        void forget(const std::string &entity, const std::string &id);
+
+        /// @brief Let no later reader join reads of `entity` now running.
+        void invalidateEntity(const std::string &entity);
+
+        /**
+         * @brief Apply a batch of realtime change events: forget() each
+         * changed row, the whole entity for events without a row (`IMPORT`).
+         * @param events JSON array of change events, as passed to an RtCallback
+         */
+        void onChanges(const nlohmann::json &events);
+
+        [[nodiscard]] Stats stats() const;
+
+        /// @brief Reads running that a new reader could still join.
+        [[nodiscard]] std::size_t inFlight() const;
+
+    private:
+        struct Flight {
+            std::string entity;
+            std::string id;
+            std::shared_future<Result> result;
+        };
+
+        using Flights = std::unordered_map<std::string, std::shared_ptr<Flight>>;
+
+        /// Detach the flights `match` accepts; m_mutex held
+        void detachLocked(const std::function<bool(const Flight &)> &match);
+
+        const bool m_enabled;
+        mutable std::mutex m_mutex;
+        Flights m_flights; ///> Guarded by m_mutex
+        Stats m_stats;     ///> Guarded by m_mutex
+    };
+}
+
+#endif // MANTISBASE_READ_COALESCER_H
@@ -0,0 +1,120 @@
+/**
+ * @file readiness_probe.h
+ * @brief Deep readiness checks, refreshed in the background for `GET /api/v1/health/ready`.
+ *
+ * `GET /api/v1/health` only says the process answers. The readiness probe
+ * measures what a request would run into: a `SELECT 1` round trip on each
+ * connection pool, how much of the primary pool is leased, how far the
+ * realtime worker trails `mb_change_log`, how full the log queue is, and the
+ * free space left in the data directory. A thread of its own takes the
+ * readings every MB_READY_PROBE_MS and keeps the rendered report, so the
+ * endpoint serves it without touching the database however often it is
+ * polled.
+ * @see ConnectionWarmup, Database::poolStats(), RtDbWorker
+ */
+
+#ifndef MANTISBASE_READINESS_PROBE_H
+#define MANTISBASE_READINESS_PROBE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <nlohmann/json.hpp>
+
+namespace mb {
+    using json = nlohmann::json;
+
+    class MantisBase;
+
+    /**
+     * @brief Takes the readiness readings on a thread of its own and caches the report.
+     *
+     * @code
+     * ReadinessProbe probe(app, ReadinessProbe::Options::fromEnv());
+     * probe.start();                    // Router::listen()
+     * const auto report = probe.report(); // on a request, never blocks on a reading
+     * res.send(report->status, report->body, "application/json");
+     * @endcode
+     */
+    class ReadinessProbe {
+    public:
+        struct Options {
+            std::chrono::milliseconds interval{2000};  ///> Between probe rounds
+            std::chrono::milliseconds dbLatency{500};  ///> A slower round trip fails the pool's check
+            double poolSaturation = 0.9;               ///> Share of the primary pool leased that fails the check
+            long long workerLag = 10000;               ///> `mb_change_log` rows undelivered that fail the check
+            double logQueueFill = 0.9;                 ///> Share of the log queue filled that fails the check
+            std::uint64_t diskMinBytes = 256ull << 20; ///> Free space in `dataDir` below which the check fails
+
+            /// @brief Read MB_READY_PROBE_MS, MB_READY_DB_MS, MB_READY_POOL_PCT, MB_READY_RT_LAG,
+            /// MB_READY_LOG_QUEUE_PCT and MB_READY_DISK_MIN_MB.
+            static Options fromEnv();
+        };
+
+        /// One round of readings; -1 where a reading could not be taken
+        struct Sample {
+            std::map<std::string, double> dbMs; ///> Round trip per pool (`primary`, `replica`, `writer`), -1 on error
+            std::int64_t poolInUse = 0;         ///> Primary pool sessions leased, ahead of the probe's own lease
+            std::int64_t poolSize = 0;
+            long long workerLag = -1;           ///> -1 while the realtime worker is not running
+            std::int64_t logQueued = -1;        ///> -1 without the logs database
+            std::int64_t logCapacity = 0;
+            std::int64_t diskFree = -1;         ///> Bytes
+        };
+
+        /// A rendered report: `200` or `503` and its JSON body
+        struct Report {
+            int status = 503;
+            std::string body;
+        };
+
+        ReadinessProbe(const MantisBase &app, Options options);
+        ~ReadinessProbe();
+
+        ReadinessProbe(const ReadinessProbe &) = delete;
+        ReadinessProbe &operator=(const ReadinessProbe &) = delete;
+
+        [[nodiscard]] const Options &options() const { return m_options; }
+
+        /// @brief Start the thread, which probes at once and then every interval. No-op if running.
+        void start();
+
+        /// @brief Stop the thread after the reading in progress. Idempotent.
+        void stop();
+
+        /// @brief Take a round of readings and replace the report; the thread body, public for tests.
+        void refresh();
+
+        /// @brief The last report; `503` with status `STARTING` until the first round is done.
+        [[nodiscard]] std::shared_ptr<const Report> report() const;
+
+        /**
+         * @brief Judge a round of readings against the thresholds.
+         * @return `{"ready", "checks"}`, each check with `ok` and its readings
+         */
+        [[nodiscard]] static json assess(const Sample &sample, const Options &options);
+
+    private:
+        [[nodiscard]] Sample sample() const;
+
+        void loop();
+
+        const MantisBase &mApp;
+        const Options m_options;
+
+        mutable std::mutex m_reportMutex;
+        std::shared_ptr<const Report> m_report; ///> Guarded by m_reportMutex; swapped whole by refresh()
+
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        bool m_stopping = false;
+        std::thread m_thread;
+    };
+}
+
+#endif // MANTISBASE_READINESS_PROBE_H
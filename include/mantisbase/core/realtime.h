@@ -19,10 +19,17 @@
 #include <memory>
 #include <mutex>
 #include <string>
+#include <string_view>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "mantisbase/mantis.h"
 #include "nlohmann/json.hpp"
+#include "change_capture.h"
+#include "change_journal.h"
+#include "tracing.h"
 
 #if MB_HAS_POSTGRESQL
 #include <soci/postgresql/soci-postgresql.h>
@@ -66,6 +73,14 @@ namespace mb {
         /** Register change hooks for an entity on a given session (static, for schema creation). */
         static void addDbHooks(const Entity &entity, const std::shared_ptr<soci::session> &sess);
 
+        /**
+         * Run addDbHooks() on each of `entities` at boot, so tables created
+         * under another capture mode (MB_SQLITE_CAPTURE, MB_PG_CAPTURE) are switched over,
+         * and the TEMP triggers of an attachedChangeLog() exist on the new writer.
+         * Current ones are left alone; a failure is logged and skipped.
+         */
+        void syncDbHooks(const std::vector<std::shared_ptr<const Entity>> &entities) const;
+
         /** Remove change hooks for an entity by name. */
         void dropDbHooks(const std::string &entity_name) const;
 
@@ -75,6 +90,12 @@ namespace mb {
         /** Start the realtime worker; callback receives change events. */
         void runWorker(const RtCallback &callback);
 
+        /**
+         * Register an additional consumer of change events (e.g. cache
+         * invalidation). May be called before or after runWorker(). Thread-safe.
+         */
+        void subscribe(const RtCallback &callback);
+
         /** Stop the realtime worker. */
         void stopWorker() const;
 
@@ -85,7 +106,120 @@ namespace mb {
          */
         void notifyChange() const;
 
+        /**
+         * Publish a committed CRUD write straight to the worker (see ChangeJournal)
+         * and wake it. The worker delivers it without reading it back from
+         * `mb_change_log`; the trigger copy is deduplicated. Falls back to the
+         * trigger path if the journal is unavailable or full. The event is
+         * stamped `committed_at` (epoch microseconds), as are those of
+         * publishAll() and publishCaptured(); changes read back from
+         * `mb_change_log` or NOTIFY carry none. Thread-safe.
+         * @param type INSERT, UPDATE or DELETE
+         * @param old_data Previous row, or null
+         * @param new_data Written row, or null
+         */
+        void publish(const std::string &type, const std::string &entity, const std::string &row_id,
+                     json old_data, json new_data) const;
+
+        /**
+         * Publish several committed writes (ChangeJournal::makeEvent() objects)
+         * with a single wake-up, so the worker delivers them to subscribers as
+         * one batch. Used by Entity::batch(). Thread-safe.
+         */
+        void publishAll(json events) const;
+
+        /**
+         * Deliver the changes SqliteChangeHooks captured in one commit. With
+         * MB_SQLITE_CAPTURE=hooks they stand in for both the trigger rows and
+         * publish()/publishAll(), which then do nothing. Called from the
+         * committing connection's WAL hook; only queues and wakes the worker.
+         */
+        void publishCaptured(json events) const;
+
+        /**
+         * Record a change no trigger sees (e.g. the `IMPORT` summary of
+         * Entity::importRecords()) on `mb_change_log`, in the caller's
+         * transaction, and NOTIFY on PostgreSQL as the triggers do. Delivered
+         * once it commits; call notifyChange() after, for SQLite.
+         */
+        static void logChange(soci::session &sql, const std::string &type, const std::string &entity,
+                              const std::string &row_id, const json &new_data);
+
+        /**
+         * Highest `mb_change_log` id delivered to subscribers, or -1 if the
+         * worker is not running. Compared with the newest id for worker lag.
+         */
+        [[nodiscard]] long long deliveredChangeId() const;
+
+        /**
+         * Delete the `mb_change_log` rows already delivered to subscribers.
+         * Run every few seconds by the `change-log-prune` job, see Scheduler.
+         * No-op if the worker is not running.
+         */
+        void pruneChangeLog() const;
+
+        /**
+         * Whether changes go out on one NOTIFY channel per entity
+         * (`MB_RT_CHANNELS=entity`, PostgreSQL only) rather than on the shared
+         * `mb_db_changes`. Read once.
+         */
+        [[nodiscard]] static bool entityChannels();
+
+        /**
+         * Whether `mb_change_log` lives in a file of its own
+         * (`MB_SQLITE_CHANGE_LOG=attached`), attached to every connection as
+         * `mb_log` with its own WAL, so logging a change and pruning the log
+         * never touch `mantis.db` or its WAL. Needs MB_SQLITE_SINGLE_WRITER=1,
+         * where the triggers run on the one writer as TEMP triggers, and is
+         * off with replication and delta sync, which read the log in step
+         * with the rows. Read once; PostgreSQL ignores it.
+         */
+        [[nodiscard]] static bool attachedChangeLog();
+
+        /// The file holding `mb_change_log` when attachedChangeLog() is on, in the data directory
+        static constexpr auto CHANGE_LOG_FILE = "mantis_changes.db";
+
+        /** The NOTIFY channel of `entity` when entityChannels() is on. */
+        [[nodiscard]] static std::string channelOf(std::string_view entity);
+
+        /** The entity a subscription topic (`posts`, `posts:*`, `posts:<id>`, `posts?<filter>`) follows. */
+        [[nodiscard]] static std::string_view topicEntity(std::string_view topic);
+
+        /**
+         * Receive changes of `entity` while at least one watch() on it is
+         * open, e.g. while a topic on it has subscribers. With
+         * MB_RT_CAPTURE=lazy this keeps its triggers capturing (see
+         * ChangeCapture), and with entityChannels() the node listening on its
+         * channel. Without either, every change is received anyway and these
+         * are no-ops. Thread-safe and non-blocking; the worker applies the
+         * LISTEN/UNLISTEN.
+         */
+        void watch(const std::string &entity);
+
+        /** Close one watch() on `entity`. */
+        void unwatch(const std::string &entity);
+
+        /** Receive changes of `entity` for as long as the process runs (a node-wide cache reads them). Idempotent. */
+        void pin(const std::string &entity);
+
+        /**
+         * Keep change capture on for every entity for as long as the process
+         * runs, for consumers of the whole stream (e.g. script record hooks).
+         * Replication and delta sync take it themselves. A no-op unless
+         * MB_RT_CAPTURE=lazy, see ChangeCapture.
+         */
+        void captureAll();
+
     private:
+        /// Callers hold m_subscribersMutex
+        void listenLocked(const std::string &entity, bool on) const;
+
+        /// Follow `entity` (capture lease, then channel) or stop; callers hold m_subscribersMutex
+        void followLocked(const std::string &entity, bool on) const;
+
+        /// Whether watch() and pin() have anything to switch on
+        [[nodiscard]] bool selective() const;
+
 #if MB_HAS_POSTGRESQL
         // Create the notification trigger function
         static void createNotifyFunction(soci::session &sql);
@@ -94,19 +228,29 @@ namespace mb {
         static std::string buildTriggerObject(const Entity &entity, const std::string &action /*"NEW" or "OLD"*/);
 
         const MantisBase &mApp;
+        std::unique_ptr<ChangeCapture> m_capture; // Only with MB_RT_CAPTURE=lazy
         std::unique_ptr<RtDbWorker> m_rtDbWorker;
+        std::vector<RtCallback> m_subscribers; // Added to the worker once it starts
+        std::unordered_map<std::string, int> m_watched; // Entity -> open watch() calls
+        std::unordered_set<std::string> m_pinned;
+        bool m_capturingAll = false; // captureAll() was called
+        std::mutex m_subscribersMutex; // Also guards m_watched, m_pinned and m_capturingAll
     };
 
     /** Internal worker that polls (SQLite) or listens (PostgreSQL) for DB changes. */
     class RtDbWorker {
     public:
-        /** @param app Owning application (used for db access/config). Stored by reference. */
-        explicit RtDbWorker(const MantisBase &app);
+        /**
+         * @param app Owning application (used for db access/config). Stored by reference.
+         * @param capture Leases in force with MB_RT_CAPTURE=lazy, or null
+         */
+        explicit RtDbWorker(const MantisBase &app, const ChangeCapture *capture = nullptr);
 
         ~RtDbWorker();
 
         [[nodiscard]] bool isDbRunning() const;
 
+        /** Add a consumer of change batches; all consumers receive every batch. */
         void addCallback(const RtCallback &cb);
 
         void stopWorker();
@@ -114,6 +258,28 @@ namespace mb {
         /** Signal the worker (SQLite) to wake and drain the change log now. */
         void notify();
 
+        /** Queue an app-layer change on the journal (SQLite only) and wake the worker. */
+        void publish(json event);
+
+        /** Queue every event in the `events` array, then wake the worker once. */
+        void publishAll(json events);
+
+        /** Queue a commit's hook-captured events, unbounded and never deduplicated, then wake the worker. */
+        void publishCaptured(json events);
+
+        /**
+         * Start (or stop) receiving the changes of `entity` on its own channel.
+         * Queued and applied by the worker thread, which owns the connection;
+         * kept across reconnects. Thread-safe.
+         */
+        void listen(const std::string &entity, bool on);
+
+        /** Highest mb_change_log id whose batch emit() has delivered. Thread-safe. */
+        [[nodiscard]] long long deliveredId() const { return m_deliveredId.load(std::memory_order_relaxed); }
+
+        /** Prune mb_change_log up to deliveredId(), unless already pruned that far. Thread-safe. */
+        void pruneDelivered();
+
     private:
         void run();
 
@@ -126,27 +292,64 @@ namespace mb {
         bool initSQLite();
 
 #if MB_HAS_POSTGRESQL
-        bool initPSQL();
+        bool initPSQL(); // Connect and LISTEN; on first connect, start after the newest mb_change_log id
+
+        bool reconnectPSQL(); // Fresh connection with LISTEN restored, then recoverPSQL()
+
+        void recoverPSQL(); // Emit mb_change_log rows after last_id missed while disconnected
+
+        void hydratePSQL(json &batch); // Fill in payloads sent as `truncated` references
+
+        bool applyListens(); // Run the LISTEN/UNLISTEN that listen() queued; false if none was sent
+
+        bool execListen(const std::string &entity, bool on); // One LISTEN/UNLISTEN on psql
+
+        void readSlotPSQL(); // MB_PG_CAPTURE=logical: deliver the changes on the slot, a batch per query
+
+        void resolveTablesPSQL(const std::vector<std::string> &tables); // Which `schema.table`s are entities'
 #endif
 
         void pruneChangeLog(int up_to_id); // Delete consumed rows from mb_change_log (SQLite)
 
+        // Deliver a batch to every registered callback, traced under the first
+        // of `origins` (the spans that published journaled events, and when)
+        void emit(const json &events, const std::vector<std::pair<TraceContext, std::uint64_t>> &origins = {});
+
+        void drainJournal(); // Emit journaled (and hook-captured) changes not yet seen on the trigger path
+
         const MantisBase &mApp; // Owning application (injected)
+        const ChangeCapture *m_capture; // Journaled changes it doesn't capture get no log copy to deduplicate
         int last_id = -1; // Last db ID to be queried, only query newer than this
-        int m_lastPrunedId = 0; // Highest mb_change_log id already pruned
+        std::atomic<int> m_lastPrunedId{0}; // Highest mb_change_log id already pruned
+        std::atomic<long long> m_deliveredId{-1}; // last_id as of the end of the last emit(), for metrics
         std::string last_ts = getCurrentTimestampUTC(); // When last is not set, use timestamp value in UTC
 
         std::string m_db_type;
-        RtCallback m_callback;
+        std::vector<RtCallback> m_callbacks;
+        std::mutex m_callbacksMutex;
         std::atomic<bool> m_running;
         bool m_notified = false; // set by notify(); guarded by mtx
         std::thread th;
         std::mutex mtx;
         std::condition_variable cv;
         std::unique_ptr<soci::session> sql_ro;
+        std::mutex m_pruneMutex;
+        std::unique_ptr<soci::session> m_logWriter; // Prunes an attached change log; guarded by m_pruneMutex
+        std::unique_ptr<ChangeJournal> m_journal; // App-layer changes (SQLite only)
+        ChangeDeduplicator m_dedup; // Journal vs trigger copies; worker thread only
+        std::mutex m_capturedMutex;
+        std::vector<json> m_captured; // From SqliteChangeHooks; no log copy to fall back on, so not on the ring
 
 #if MB_HAS_POSTGRESQL
         std::unique_ptr<PGconn, decltype(&PQfinish)> psql{nullptr, &PQfinish};
+        std::mutex m_listenMutex;
+        std::vector<std::pair<std::string, bool>> m_pendingListens; // Guarded by m_listenMutex
+        std::unordered_set<std::string> m_listening; // Entity channels to be on; worker thread only
+        int m_wakePipe[2] = {-1, -1}; // listen() writes a byte so select() returns at once
+        bool m_logical = false; // LogicalCapture::enabled(): changes come off the slot, not NOTIFY
+        std::unordered_map<std::string, bool> m_entityTables; // `schema.table` -> FULL replica identity; worker thread only
+        std::uint64_t m_mutedXid = 0; // Transaction m_muted belongs to
+        std::unordered_set<std::string> m_muted; // Tables LogicalCapture::mute()d in it
 #endif
     };
 }
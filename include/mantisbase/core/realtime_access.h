@@ -0,0 +1,110 @@
+/**
+ * @file realtime_access.h
+ * @brief Per-event access checks for realtime subscribers.
+ *
+ * Subscriptions are validated once when they are made (see SSEMgr); this
+ * re-checks each change event against the entity's `list`/`get` rule, and
+ * its row filter, for the subscriber's auth context, so rows a client may
+ * not read are never pushed to it.
+ * @see sse.h, ws.h, access_rules.h
+ */
+
+#ifndef MANTISBASE_REALTIME_ACCESS_H
+#define MANTISBASE_REALTIME_ACCESS_H
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <nlohmann/json.hpp>
+
+namespace mb {
+    using json = nlohmann::json;
+    class AccessRule;
+    class MantisRequest;
+    struct CompiledFilter;
+
+    /**
+     * @brief Auth context captured when a realtime subscriber connects.
+     */
+    struct RealtimeAuth {
+        json auth = guestAuth();           ///> Same shape as the request `auth` context var
+        json req = json::object();         ///> `req` var (addresses/ports; empty body)
+        bool verified = false;             ///> Token verified and user record found
+        std::string principal = "guest";   ///> `guest` or `<entity>:<id>`, used as memo key
+
+        /// @brief Capture `auth`, `verification` and request info hydrated by the pre-routing middlewares.
+        static RealtimeAuth fromRequest(MantisRequest &req);
+
+        static json guestAuth();
+    };
+
+    /**
+     * @brief Evaluates access rules for realtime events, memoizing results.
+     *
+     * Custom rules that don't reference `record` only depend on the
+     * subscriber, so their result is memoized per (rule, principal) for a
+     * short TTL; fan-out to many sessions of few users stays a map lookup.
+     * Rules referencing `record` are evaluated per event with the row bound
+     * as `record` (the compiled expression is reused).
+     *
+     * @code
+     * const auto &rule = subscribed_to_row ? entity.getRule() : entity.listRule();
+     * const auto *filter = subscribed_to_row ? entity.getFilter() : entity.listFilter();
+     * if (RealtimeAccess::instance().allows(rule, session->authContext(), row, filter))
+     *     session->enqueue(event, frame);
+     * @endcode
+     */
+    class RealtimeAccess {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        /**
+         * @param capacity Maximum memoized (rule, principal) results
+         * @param ttl Lifetime of a memoized result
+         */
+        explicit RealtimeAccess(std::size_t capacity = 20000,
+                                std::chrono::seconds ttl = std::chrono::seconds(5));
+
+        /// @brief Process-wide instance shared by the SSE and WS managers.
+        static RealtimeAccess &instance();
+
+        /**
+         * @brief Whether `who` may receive a change on `record` under `rule`.
+         *
+         * Mirrors the subscription-time checks: `public` allows everyone,
+         * empty and `auth` modes need a verified user, admins bypass custom
+         * rules, and `custom` evaluates the expression with `auth`, `req`
+         * and `record` bound. The rule's `row_filter`, if any, must match
+         * `record` with `who`'s `@auth` values too, as it would a list or get
+         * of the row; admins bypass it.
+         */
+        [[nodiscard]] bool allows(const AccessRule &rule, const RealtimeAuth &who, const json &record,
+                                  const CompiledFilter *row_filter = nullptr);
+
+        /// @brief True if the rule expression references the `record` variable.
+        [[nodiscard]] static bool dependsOnRecord(const AccessRule &rule);
+
+        /// @brief Drop all memoized results.
+        void clear();
+
+        /// @brief Number of memoized results, including not yet purged expired ones.
+        [[nodiscard]] std::size_t size() const;
+
+    private:
+        struct Entry {
+            bool allowed;
+            Clock::time_point expiresAt;
+        };
+
+        static bool evaluate(const AccessRule &rule, const RealtimeAuth &who, const json &record);
+        static bool filterMatches(const CompiledFilter &filter, const RealtimeAuth &who, const json &record);
+
+        std::size_t m_capacity;
+        std::chrono::seconds m_ttl;
+        mutable std::mutex m_mutex;
+        std::unordered_map<std::string, Entry> m_memo;
+    };
+}
+
+#endif // MANTISBASE_REALTIME_ACCESS_H
@@ -0,0 +1,179 @@
+/**
+ * @file realtime_event.h
+ * @brief Wire encodings of a realtime change event, built once per change.
+ *
+ * A single EncodedEvent is shared (by `shared_ptr`) between every SSE
+ * session and WebSocket connection receiving the change, so the payload is
+ * dumped once no matter how many subscribers a hot entity has.
+ * @see sse.h, ws.h
+ */
+
+#ifndef MANTISBASE_REALTIME_EVENT_H
+#define MANTISBASE_REALTIME_EVENT_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "wire_format.h"
+
+namespace mb {
+    using json = nlohmann::json;
+
+    /**
+     * @brief Immutable, lazily encoded change event.
+     *
+     * Holds the normalized payload (`topic`, `action`, `timestamp`, `row_id`,
+     * `entity`, `data`, plus `event_id` and `committed_at` when set) and
+     * renders each wire form at most once:
+     * - data(false) / data(true): payload JSON with the entity / `entity:<row_id>` topic
+     * - sse(false): SSE frame whose topic is the entity name
+     * - sse(true):  SSE frame whose topic is `entity:<row_id>`
+     * - ws():       WebSocket text frame (payload plus `"type": "change"`)
+     *
+     * Subscribers on MessagePack or CBOR get the same payloads in that format
+     * from the overloads taking a WireFormat::Format, also cached per event.
+     * Encodings are produced on first use and are safe to request from any thread.
+     *
+     * @code
+     * const auto ev = EncodedEvent::encode(change_event);
+     * session->sendFrame(ev->sse(session_has_row_topic));
+     * conn->send(ev->ws());
+     * @endcode
+     */
+    class EncodedEvent {
+    public:
+        /// Row fields a subscriber asked for, sorted and unique; empty means the whole row.
+        using FieldSet = std::vector<std::string>;
+
+        /**
+         * @brief Build the shared event from a raw change record.
+         * @param change_event Object with `type`, `entity`, `row_id`, `timestamp` and `new_data`
+         * @param id Monotonic event id (see ReplayBuffer); 0 leaves the frames without one
+         */
+        static std::shared_ptr<const EncodedEvent> encode(const json &change_event, std::uint64_t id = 0);
+
+        explicit EncodedEvent(const json &change_event, std::uint64_t id = 0);
+
+        /**
+         * @brief A frame of an ephemeral channel (see Channels), not tied to any row.
+         *
+         * `payload` is sent as is, its `type` naming the SSE event and the WS
+         * message type; it is never projected, given an id or replayed. Under
+         * Overflow::Coalesce, pending frames with the same `key` are merged.
+         */
+        static std::shared_ptr<const EncodedEvent> ephemeral(json payload, std::string key);
+
+        /// @brief Parse a comma-separated `fields` parameter into a FieldSet.
+        static FieldSet parseFields(const std::string &csv);
+
+        /**
+         * @brief `event` with `data` cut down to `fields` (plus `id`).
+         *
+         * Returns `event` itself when `fields` is empty. Each distinct field set is
+         * encoded once per event and shared by every subscriber asking for it;
+         * record() keeps the full row, so access rules still see every column.
+         */
+        static std::shared_ptr<const EncodedEvent> project(const std::shared_ptr<const EncodedEvent> &event,
+                                                           const FieldSet &fields);
+
+        /**
+         * @brief `event` with `data` cut down to the fields an update changed (plus `id`).
+         *
+         * Compares `new_data` with the `old_data` of the change record; a field
+         * left out of `new_data` is sent as `null`. The payload gains
+         * `"delta": true`. Encoded once per event; for an insert, a delete, or
+         * an update without `old_data`, returns `event` itself. Apply before
+         * project().
+         */
+        static std::shared_ptr<const EncodedEvent> delta(const std::shared_ptr<const EncodedEvent> &event);
+
+        /// @brief Built by ephemeral() rather than from a change.
+        [[nodiscard]] bool isEphemeral() const { return m_ephemeral; }
+
+        /// @brief Event id, sent as the SSE `id:` field and `event_id`; 0 if unassigned.
+        [[nodiscard]] std::uint64_t id() const { return m_id; }
+
+        /// @brief Entity (table) the change belongs to.
+        [[nodiscard]] const std::string &entity() const { return m_entity; }
+
+        /// @brief Primary key of the changed row.
+        [[nodiscard]] const std::string &rowId() const { return m_rowId; }
+
+        /// @brief `entity:<row_id>`, the topic of row-level subscribers.
+        [[nodiscard]] const std::string &rowTopic() const { return m_rowTopic; }
+
+        /// @brief Lowercased operation: insert, update or delete.
+        [[nodiscard]] const std::string &action() const { return m_action; }
+
+        /// @brief Changed row: `new_data`, or `old_data` for deletes; empty object if neither is set.
+        [[nodiscard]] const json &record() const { return m_record; }
+
+        /// @brief The row an update replaced (`old_data`); null for other changes or without it.
+        [[nodiscard]] const json &previous() const { return m_previous; }
+
+        /// @brief Serialized payload, the `data:` of the SSE frame; `row_topic` as for sse().
+        [[nodiscard]] const std::string &data(bool row_topic = false) const;
+
+        /// @brief SSE `event: change` frame; `row_topic` selects the `entity:<row_id>` topic variant.
+        [[nodiscard]] const std::string &sse(bool row_topic = false) const;
+
+        /// @brief WebSocket text frame.
+        [[nodiscard]] const std::string &ws() const;
+
+        /// @brief The payload sse() carries, as JSON; for building `batch` frames.
+        [[nodiscard]] json dataJson(bool row_topic = false) const;
+
+        /// @brief The payload ws() carries, as JSON; for building `batch` frames.
+        [[nodiscard]] json wsJson() const;
+
+        /// @brief sse() with the payload in `format`, base64 encoded past JSON since SSE is text.
+        [[nodiscard]] const std::string &sse(bool row_topic, WireFormat::Format format) const;
+
+        /// @brief ws() in `format`; a binary frame for anything but JSON.
+        [[nodiscard]] const std::string &ws(WireFormat::Format format) const;
+
+    private:
+        EncodedEvent(const EncodedEvent &base, const FieldSet &fields);
+
+        struct DeltaTag {};
+        EncodedEvent(const EncodedEvent &base, DeltaTag);
+
+        struct EphemeralTag {};
+        EncodedEvent(json payload, std::string key, EphemeralTag);
+
+        std::uint64_t m_id;
+        std::string m_event = "change"; ///> SSE `event:` and WS `type`
+        bool m_ephemeral = false;
+        std::string m_entity;
+        std::string m_rowId;
+        std::string m_rowTopic;
+        std::string m_action;
+        json m_record;
+        json m_previous; ///> `old_data` of an update, for delta(); null otherwise
+        json m_payload;
+
+        mutable std::once_flag m_dataOnce, m_dataRowOnce, m_sseOnce, m_sseRowOnce, m_wsOnce;
+        mutable std::string m_data, m_dataRow, m_sse, m_sseRow, m_ws;
+
+        enum class Variant { Sse, SseRow, Ws };
+
+        /// The binary encodings, made once per variant and format
+        const std::string &binary(Variant variant, WireFormat::Format format) const;
+
+        mutable std::mutex m_binaryMutex;
+        mutable std::map<std::pair<Variant, WireFormat::Format>, std::string> m_binary;
+
+        mutable std::once_flag m_deltaOnce;
+        mutable std::shared_ptr<const EncodedEvent> m_delta;
+
+        mutable std::mutex m_projectionsMutex;
+        mutable std::map<std::string, std::shared_ptr<const EncodedEvent>> m_projections;
+    };
+}
+
+#endif // MANTISBASE_REALTIME_EVENT_H
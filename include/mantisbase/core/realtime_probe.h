@@ -0,0 +1,132 @@
+/**
+ * @file realtime_probe.h
+ * @brief Measures commit-to-delivery latency of the realtime pipeline from inside the server.
+ *
+ * With MB_RT_PROBE_MS set, a probe row in the hidden `mb_rt_probe` entity is
+ * written that often, through Entity::update() like any API write. An
+ * internal SSE session subscribed to the entity times each change from its
+ * `committed_at` stamp to the moment its frame reaches the session's stream,
+ * so the figure covers the journal, the worker, the fan-out, framing and the
+ * send queue's hop to the IO loop. A probe not delivered within the timeout
+ * counts as lost.
+ * Exported as `mb_realtime_probe_latency_seconds` and `mb_realtime_probe_total`.
+ * @see RtDbWorker::publish(), SSEMgr
+ */
+
+#ifndef MANTISBASE_REALTIME_PROBE_H
+#define MANTISBASE_REALTIME_PROBE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "metrics.h"
+
+namespace mb {
+    /**
+     * @brief Writes probe rows on a thread of its own and times their delivery.
+     *
+     * @code
+     * RealtimeProbe probe(RealtimeProbe::Options::fromEnv());
+     * probe.start();           // Router::listen(), does nothing while disabled
+     * probe.writeMetrics(out); // on a scrape
+     * @endcode
+     */
+    class RealtimeProbe {
+    public:
+        /// Hidden system entity the probe writes to; only admins may follow it
+        static constexpr auto ENTITY = "mb_rt_probe";
+
+        struct Options {
+            std::chrono::milliseconds interval{0};    ///> Between probe writes; 0 turns the probe off
+            std::chrono::milliseconds timeout{5000};  ///> Undelivered this long after its write, a probe is lost
+
+            /// @brief Read MB_RT_PROBE_MS and MB_RT_PROBE_TIMEOUT_MS.
+            static Options fromEnv();
+        };
+
+        explicit RealtimeProbe(Options options);
+
+        ~RealtimeProbe();
+
+        RealtimeProbe(const RealtimeProbe &) = delete;
+
+        RealtimeProbe &operator=(const RealtimeProbe &) = delete;
+
+        [[nodiscard]] bool enabled() const { return m_options.interval.count() > 0; }
+
+        [[nodiscard]] const Options &options() const { return m_options; }
+
+        /// @brief Create the probe entity if missing and start the thread; nothing while disabled.
+        void start();
+
+        /// @brief Stop the thread and close the probe's session. Idempotent.
+        void stop();
+
+        /**
+         * @brief Time the probe changes in a chunk of the session's stream.
+         * Called by the probe's stream; public for tests.
+         * @param now_us Delivery time, epoch microseconds
+         * @return Probes delivered by the chunk
+         */
+        std::size_t onFrames(std::string_view chunk, std::int64_t now_us = nowUs());
+
+        /**
+         * @brief Wait for the change of probe `seq`, written at `written_us` (epoch microseconds).
+         * Called after each write; public for tests.
+         */
+        void expect(std::int64_t seq, std::int64_t written_us = nowUs());
+
+        /// @brief Count as lost the probes still undelivered a timeout after their write.
+        std::size_t expire(std::int64_t now_us = nowUs());
+
+        [[nodiscard]] std::uint64_t sent() const { return m_sent.load(); }
+
+        [[nodiscard]] std::uint64_t delivered() const { return m_delivered.load(); }
+
+        [[nodiscard]] std::uint64_t lost() const { return m_lost.load(); }
+
+        [[nodiscard]] LatencyHistogram::Snapshot latency() const { return m_latency.snapshot(); }
+
+        /// @brief `mb_realtime_probe_latency_seconds` and `mb_realtime_probe_total`.
+        void writeMetrics(MetricsWriter &out) const;
+
+        /// @brief Wall clock in epoch microseconds, the unit of `committed_at`.
+        static std::int64_t nowUs();
+
+    private:
+        /// Create or join the probe's SSE session, on an IO loop once the server runs
+        void subscribe();
+
+        /// Write the next probe to the probe row, created on first use
+        void write();
+
+        void loop();
+
+        const Options m_options;
+        LatencyHistogram m_latency;
+        std::atomic<std::uint64_t> m_sent{0};
+        std::atomic<std::uint64_t> m_delivered{0};
+        std::atomic<std::uint64_t> m_lost{0};
+
+        std::mutex m_pendingMutex;
+        std::map<std::int64_t, std::int64_t> m_pending; ///> Probe seq -> write time, epoch microseconds
+
+        std::string m_rowId;     ///> The probe row, thread only
+        std::int64_t m_seq = 0;  ///> Last probe written, thread only
+        std::string m_sessionId; ///> The probe's SSE session, thread only
+
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        bool m_stopping = false;
+        std::thread m_thread;
+    };
+}
+
+#endif // MANTISBASE_REALTIME_PROBE_H
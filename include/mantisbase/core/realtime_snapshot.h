@@ -0,0 +1,86 @@
+/**
+ * @file realtime_snapshot.h
+ * @brief Current rows of a `snapshot=true` subscription, seamed onto its live events.
+ *
+ * The rows are read on the primary after noting the newest event id. Every
+ * change with an id up to it had committed before the read, so the rows
+ * show it; the changes after it are replayed from the ReplayBuffer, less
+ * the ones the rows already show. The client gets each row's state once,
+ * then every change to it, without listing the entity itself.
+ * @see sse.h, ws.h, replay_buffer.h
+ */
+
+#ifndef MANTISBASE_REALTIME_SNAPSHOT_H
+#define MANTISBASE_REALTIME_SNAPSHOT_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "realtime_event.h"
+
+namespace mb {
+    using json = nlohmann::json;
+
+    /**
+     * @brief The rows of each subscribed topic, as of event id `at`.
+     *
+     * @code
+     * RealtimeSnapshot snapshot(replay.lastId());
+     * for (const auto &row: rows) snapshot.add(topic, entity, row);
+     * const auto shown = snapshot.covered(events_after_at);
+     * @endcode
+     */
+    class RealtimeSnapshot {
+    public:
+        struct Options {
+            std::size_t maxRows = 1000; ///> Rows one subscription may take, over all its topics
+
+            /// @brief Read MB_REALTIME_SNAPSHOT_MAX.
+            static Options fromEnv();
+        };
+
+        explicit RealtimeSnapshot(std::uint64_t at = 0);
+
+        /// @brief Newest event id issued before the rows were read; live events continue after it.
+        [[nodiscard]] std::uint64_t at() const { return m_at; }
+
+        /// @brief Start `topic` with no rows, so it still gets a (empty) frame.
+        void topic(const std::string &topic);
+
+        /// @brief Add `row` of `entity` to `topic`.
+        void add(const std::string &topic, const std::string &entity, json row);
+
+        /// @brief Rows over all topics; a row on two topics counts twice.
+        [[nodiscard]] std::size_t size() const { return m_size; }
+
+        /**
+         * @brief Which of `events` (oldest first, all after at()) the rows already show.
+         *
+         * Per row, each change up to the last one that leaves it as read
+         * (gone, for a row not read), since replaying those would only
+         * bring the client back to the same state.
+         */
+        [[nodiscard]] std::vector<bool> covered(const std::vector<const EncodedEvent *> &events) const;
+
+        /**
+         * @brief The frame payload of each topic, in the order they were started.
+         *
+         * `{"topic", "records", "last_event_id"}`, rows cut down to `fields`
+         * (plus `id`) as change payloads are.
+         */
+        [[nodiscard]] std::vector<json> frames(const EncodedEvent::FieldSet &fields = {}) const;
+
+    private:
+        static std::string keyOf(const std::string &entity, const std::string &row_id);
+
+        std::uint64_t m_at;
+        std::size_t m_size = 0;
+        std::vector<std::pair<std::string, json>> m_topics; ///> Topic -> its rows
+        std::unordered_map<std::string, json> m_rows;       ///> `entity:<row_id>` -> the row as read
+    };
+}
+
+#endif // MANTISBASE_REALTIME_SNAPSHOT_H
@@ -0,0 +1,141 @@
+/**
+ * @file record_cache.h
+ * @brief Decoded records by id, read through by Entity::read().
+ *
+ * Opt-in per entity. Point reads come from handlers, auth hydration, file
+ * handling in updates, relation expansion and scripts alike; with the cache
+ * on, the first read of a row stores its full decoded record and the rest
+ * are answered from memory, projected after the lookup.
+ */
+
+#ifndef MANTISBASE_RECORD_CACHE_H
+#define MANTISBASE_RECORD_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <nlohmann/json.hpp>
+
+#include "cache_budget.h"
+
+namespace mb {
+    /**
+     * @brief Whole records keyed by (entity, id), an LRU of its own per entity.
+     *
+     * Local writes forget() their rows as they commit, and rows changed
+     * elsewhere go with the change stream (onChanges()). A record read while
+     * a change to its entity was in flight is not stored: put() takes the
+     * generation() read before the query and is a no-op if the entity changed
+     * since. Each entity's records are capped in bytes, by an estimate of
+     * their in-memory size, least recently used going first, and with a
+     * CacheBudget the caches of all tenants also share one total.
+     *
+     * Thread-safe.
+     *
+     * @code
+     * auto &cache = Entity::recordCache();
+     * if (auto hit = cache.get("posts", id)) return project(*hit);
+     * const auto generation = cache.generation("posts");
+     * auto record = query(id);
+     * cache.put("posts", id, generation, record);
+     * @endcode
+     */
+    class RecordCache {
+    public:
+        struct Options {
+            std::unordered_set<std::string> entities; ///> Entities opted in
+            bool all = false;                         ///> `*`: every entity
+            std::size_t maxBytes = 16 * 1024 * 1024;  ///> Records kept, per entity
+            std::size_t maxEntryBytes = 64 * 1024;    ///> Larger records aren't cached
+            CacheBudget *budget = nullptr;            ///> Shared with the other caches, if any
+
+            /// @brief Read MB_RECORD_CACHE (`posts,tags` or `*`), MB_RECORD_CACHE_MAX_MB and MB_CACHE_BUDGET_MB.
+            static Options fromEnv();
+        };
+
+        explicit RecordCache(Options options);
+        ~RecordCache();
+
+        RecordCache(const RecordCache &) = delete;
+        RecordCache &operator=(const RecordCache &) = delete;
+
+        /// @brief Whether `entity` opted in.
+        [[nodiscard]] bool enabledFor(const std::string &entity) const;
+
+        /// @brief Whether any entity opted in.
+        [[nodiscard]] bool enabled() const;
+
+        /// @brief A copy of the cached record `id` of `entity`, if any.
+        [[nodiscard]] std::optional<nlohmann::json> get(const std::string &entity, const std::string &id);
+
+        /// @brief Changes seen for `entity` so far; read before querying, pass to put().
+        [[nodiscard]] std::uint64_t generation(const std::string &entity) const;
+
+        /// @brief Cache `record` as row `id`, unless `entity` changed since `generation`.
+        void put(const std::string &entity, const std::string &id, std::uint64_t generation,
+                 const nlohmann::json &record);
+
+        /// @brief Drop row `id` (after a write to it).
+        void forget(const std::string &entity, const std::string &id);
+
+        /// @brief Drop all records of `entity` (e.g. after a schema change).
+        void invalidateEntity(const std::string &entity);
+
+        /**
+         * @brief Apply a batch of realtime change events: forget() each
+         * changed row, the whole entity for events without a row (`IMPORT`).
+         * @param events JSON array of change events, as passed to an RtCallback
+         */
+        void onChanges(const nlohmann::json &events);
+
+        /// @brief Drop all entries.
+        void clear();
+
+        /// @brief Evict least recently used records, of the entities holding the most, until `bytes` are freed.
+        /// @return The bytes freed; less if the cache ran empty
+        std::size_t shed(std::size_t bytes);
+
+        [[nodiscard]] std::size_t size() const;
+        [[nodiscard]] std::size_t bytes() const;
+        [[nodiscard]] std::size_t hits() const { return m_hits.load(); }
+        [[nodiscard]] std::size_t misses() const { return m_misses.load(); }
+
+        /// @brief Estimated heap footprint of `value`: its nodes, strings and keys.
+        static std::size_t approxBytes(const nlohmann::json &value);
+
+    private:
+        struct Slot {
+            std::string id;
+            nlohmann::json record;
+            std::size_t bytes = 0;
+        };
+        using Lru = std::list<Slot>;
+
+        struct Entity {
+            std::uint64_t generation = 0;
+            Lru lru; ///> Most recently used first
+            std::unordered_map<std::string, Lru::iterator> rows;
+            std::size_t bytes = 0;
+        };
+
+        /// Callers hold m_mutex
+        void eraseLocked(Entity &state, Lru::iterator slot);
+        void changedLocked(const std::string &entity, const std::string &row_id);
+
+        const Options m_options;
+        std::shared_ptr<CacheBudget::Account> m_account; ///> Its share of Options::budget, if any
+        mutable std::mutex m_mutex;
+        std::unordered_map<std::string, Entity> m_entities;
+        std::atomic<std::size_t> m_hits{0};
+        std::atomic<std::size_t> m_misses{0};
+    };
+}
+
+#endif // MANTISBASE_RECORD_CACHE_H
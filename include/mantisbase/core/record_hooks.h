@@ -0,0 +1,102 @@
+/**
+ * @file record_hooks.h
+ * @brief After-commit record hooks, delivered off the request path.
+ *
+ * The change stream that feeds realtime also feeds these: every batch of
+ * committed changes is queued and handed, in chunks, to a pool of its own,
+ * so a slow hook costs the client nothing. A chunk whose hook fails is
+ * retried, so a hook may see an event more than once and should be
+ * idempotent. Sync `before...` hooks, which can still reject a write, run
+ * in the request instead; see ScriptingHooks.
+ * @see RealtimeDB::subscribe(), ScriptingHooks
+ */
+
+#ifndef MANTISBASE_RECORD_HOOKS_H
+#define MANTISBASE_RECORD_HOOKS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <nlohmann/json.hpp>
+
+namespace mb {
+    class WorkerPool;
+    class MetricsWriter;
+
+    /**
+     * @brief Queues change batches and delivers them with retries.
+     *
+     * @code
+     * RecordHooks hooks(RecordHooks::Options::fromEnv(), [](const json &events) {
+     *     return runHooks(events); // the events that failed, to be retried
+     * });
+     * hooks.start();
+     * app.rt().subscribe([&](const json &events) { hooks.onChanges(events); });
+     * @endcode
+     */
+    class RecordHooks {
+    public:
+        /**
+         * Runs the hooks for a chunk of change events, on a hook worker.
+         * Returns the events whose hook failed (an array, empty when all went through).
+         */
+        using Deliver = std::function<nlohmann::json(const nlohmann::json &events)>;
+
+        struct Options {
+            std::size_t workers = 2;
+            std::size_t batchSize = 100;                   ///> Events handed to one delivery at most
+            std::size_t maxAttempts = 3;                   ///> Per event, the first delivery included
+            std::chrono::milliseconds retryDelay{200};     ///> Times the attempt number before a retry
+
+            /// @brief Read MB_HOOK_WORKERS, MB_HOOK_BATCH and MB_HOOK_ATTEMPTS.
+            static Options fromEnv();
+        };
+
+        RecordHooks(Options options, Deliver deliver);
+        ~RecordHooks();
+
+        RecordHooks(const RecordHooks &) = delete;
+        RecordHooks &operator=(const RecordHooks &) = delete;
+
+        void start();
+
+        /// @brief Deliver what is queued, retries included, then join the workers.
+        void stop();
+
+        [[nodiscard]] bool isRunning() const;
+
+        /**
+         * @brief Queue a batch of change events. No-op while stopped.
+         * @param events JSON array of change events, as passed to an RtCallback
+         */
+        void onChanges(const nlohmann::json &events);
+
+        [[nodiscard]] std::size_t pending() const { return m_pending.load(); }     ///> Events queued or running
+        [[nodiscard]] std::size_t delivered() const { return m_delivered.load(); }
+        [[nodiscard]] std::size_t retried() const { return m_retried.load(); }
+        [[nodiscard]] std::size_t dropped() const { return m_dropped.load(); }     ///> Out of attempts
+
+        /// @brief `mb_record_hook_events_total` and `mb_record_hook_pending`.
+        void writeMetrics(MetricsWriter &out) const;
+
+        const Options &options() const { return m_opts; }
+
+    private:
+        /// Deliver `events` on a worker; `attempt` counts from 1. False if the pool is stopped
+        bool submit(nlohmann::json events, std::size_t attempt);
+
+        void run(const nlohmann::json &events, std::size_t attempt);
+
+        const Options m_opts;
+        const Deliver m_deliver;
+        std::unique_ptr<WorkerPool> m_pool;
+        std::atomic<std::size_t> m_pending{0};
+        std::atomic<std::size_t> m_delivered{0};
+        std::atomic<std::size_t> m_retried{0};
+        std::atomic<std::size_t> m_dropped{0};
+    };
+}
+
+#endif // MANTISBASE_RECORD_HOOKS_H
@@ -0,0 +1,115 @@
+/**
+ * @file replay_buffer.h
+ * @brief Retention window of recent realtime events for resuming subscribers.
+ *
+ * Every change broadcast by SSEMgr gets a monotonic id here and is kept for
+ * a bounded count and age. A reconnecting client passes the last id it saw
+ * (SSE `Last-Event-ID`, WS `resume_from`) and only receives the events after
+ * it. The window is written to the data directory on shutdown and reloaded on
+ * start, so a deploy doesn't force every client into a full reload.
+ * @see sse.h, ws.h, realtime_event.h
+ */
+
+#ifndef MANTISBASE_REPLAY_BUFFER_H
+#define MANTISBASE_REPLAY_BUFFER_H
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <nlohmann/json.hpp>
+
+#include "realtime_event.h"
+
+namespace mb {
+    using json = nlohmann::json;
+
+    /**
+     * @brief Bounded, id-ordered log of encoded change events.
+     *
+     * Ids strictly increase across restarts: a reloaded window continues from
+     * its last id, and a fresh one starts at the current time in microseconds.
+     * Thread-safe.
+     *
+     * @code
+     * ReplayBuffer replay(ReplayBuffer::Options::fromEnv());
+     * const auto ev = replay.append(change_event);          // ev->id() assigned
+     * const auto upto = replay.since(last_id, [&](const auto &e) { ... });
+     * if (!upto) { // events after last_id are gone; tell the client to reload }
+     * @endcode
+     */
+    class ReplayBuffer {
+    public:
+        using Clock = std::chrono::system_clock;
+        using Visitor = std::function<void(const std::shared_ptr<const EncodedEvent> &)>;
+
+        struct Options {
+            std::size_t capacity = 10000;              ///> Max retained events; 0 disables replay
+            std::chrono::seconds retention{300};       ///> Max age of a retained event
+
+            /// @brief Read MB_REALTIME_REPLAY_SIZE and MB_REALTIME_REPLAY_SECS.
+            static Options fromEnv();
+        };
+
+        ReplayBuffer();
+        explicit ReplayBuffer(Options options);
+
+        ReplayBuffer(const ReplayBuffer &) = delete;
+        ReplayBuffer &operator=(const ReplayBuffer &) = delete;
+
+        /// @brief Assign the next id to `change_event`, retain it and return its encoding.
+        std::shared_ptr<const EncodedEvent> append(const json &change_event);
+
+        /**
+         * @brief Visit retained events with id greater than `after`, oldest first.
+         * @return Id of the newest event at the time of the call, or std::nullopt
+         *         if events after `after` were already evicted (or `after` is
+         *         unknown to this server) and the client must reload.
+         */
+        std::optional<std::uint64_t> since(std::uint64_t after, const Visitor &visit) const;
+
+        /// @brief Whether since(`after`) would find the events after it, without visiting them.
+        [[nodiscard]] bool retains(std::uint64_t after) const;
+
+        /// @brief Id of the newest event issued.
+        [[nodiscard]] std::uint64_t lastId() const;
+
+        /// @brief Number of retained events.
+        [[nodiscard]] std::size_t size() const;
+
+        [[nodiscard]] const Options &options() const { return m_options; }
+
+        /// @brief Write the window to `path`; false on I/O failure.
+        bool save(const std::filesystem::path &path) const;
+
+        /**
+         * @brief Replace the window with the one saved at `path` and remove the file.
+         *
+         * The file is consumed so that, after a crash, a stale window can't be
+         * reloaded and reissue ids clients have already seen.
+         * @return false if there was no readable window to load
+         */
+        bool load(const std::filesystem::path &path);
+
+    private:
+        struct Entry {
+            std::shared_ptr<const EncodedEvent> event;
+            json change;            ///> Raw change record, kept for save()
+            Clock::time_point at;
+        };
+
+        void evictLocked(Clock::time_point now);
+
+        Options m_options;
+        mutable std::mutex m_mutex;
+        std::deque<Entry> m_entries;
+        std::uint64_t m_lastId;     ///> Newest id issued
+        std::uint64_t m_floor;      ///> Newest id no longer retained; resuming from below it is a gap
+    };
+}
+
+#endif // MANTISBASE_REPLAY_BUFFER_H
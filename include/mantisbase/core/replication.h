@@ -0,0 +1,171 @@
+/**
+ * @file replication.h
+ * @brief Read replicas for SQLite, fed from the primary's `mb_change_log`.
+ *
+ * A primary with MB_REPLICATION_KEY set keeps its change log for
+ * MB_REPLICATION_RETAIN_S and serves it, with consistent snapshots of
+ * `mantis.db`, under `/api/v1/sys/replication/`. A follower (MB_REPLICA_OF)
+ * starts from a snapshot and then applies the change log in order, so its
+ * own triggers feed its realtime subscribers. It refuses writes; they go to
+ * the primary. Files are not shipped: use shared storage for them.
+ * @see realtime.h, backup.h
+ */
+
+#ifndef MANTISBASE_REPLICATION_H
+#define MANTISBASE_REPLICATION_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include <nlohmann/json.hpp>
+
+namespace soci {
+    class session;
+}
+
+namespace trantor {
+    class EventLoopThread;
+}
+
+namespace drogon {
+    class HttpClient;
+}
+
+namespace mb {
+    class MantisBase;
+
+    using json = nlohmann::json;
+
+    /**
+     * @brief Serves the change stream on a primary, or follows one.
+     *
+     * The static functions are the two ends of the stream, on a session of
+     * either side. An instance on a follower runs the pull loop on its own
+     * thread: it polls for changes after its cursor, applies each batch in
+     * one write with the cursor, and takes a new snapshot when the primary's
+     * schema changed or the changes it needs were pruned (`410`).
+     */
+    class Replication {
+    public:
+        struct Options {
+            std::string primary;                  ///> Base URL of the primary; set on followers only
+            std::string key;                      ///> Shared secret, sent as `X-Replication-Key`
+            std::chrono::milliseconds poll{250};  ///> Wait between polls once caught up
+            int batch = 500;                      ///> Changes per poll
+            std::chrono::seconds retain{3600};    ///> How long a primary keeps consumed changes
+
+            /**
+             * @brief Read MB_REPLICA_OF, MB_REPLICATION_KEY, MB_REPLICA_POLL_MS,
+             * MB_REPLICA_BATCH and MB_REPLICATION_RETAIN_S.
+             */
+            static Options fromEnv();
+
+            [[nodiscard]] bool follower() const { return !primary.empty(); }
+
+            /// @brief Serving the stream: a key, and not following anyone.
+            [[nodiscard]] bool serving() const { return primary.empty() && !key.empty(); }
+        };
+
+        /// @brief Where a follower is in the primary's stream.
+        struct Cursor {
+            long long changeId = 0;      ///> Last `mb_change_log` id applied
+            long long schemaVersion = 0; ///> The primary's `PRAGMA schema_version` it was applied under
+        };
+
+        /**
+         * @brief Up to `limit` changes with ids above `after`, on the primary.
+         * @return `changes` (id, type, entity, row_id, new_data), `last_id`,
+         * `head` (newest id) and `schema_version`
+         * @throws MantisException 410 if changes after `after` were already pruned
+         */
+        static json changesAfter(soci::session &sql, long long after, int limit);
+
+        /// @brief `PRAGMA schema_version`, bumped by every DDL statement.
+        static long long schemaVersion(soci::session &sql);
+
+        /**
+         * @brief Apply `changes` (from changesAfter()) on a follower: inserts
+         * and updates are upserted from `new_data`, deletes by `row_id`.
+         * Other types (e.g. `IMPORT` summaries) are skipped. Call it inside a
+         * write, with saveCursor().
+         */
+        static void apply(soci::session &sql, const json &changes);
+
+        /// @brief The follower's cursor, if it has synced from a snapshot yet.
+        static std::optional<Cursor> loadCursor(soci::session &sql);
+
+        static void saveCursor(soci::session &sql, const Cursor &cursor);
+
+        Replication(const MantisBase &app, Options options);
+        ~Replication();
+
+        Replication(const Replication &) = delete;
+        Replication &operator=(const Replication &) = delete;
+
+        [[nodiscard]] const Options &options() const { return m_options; }
+
+        /// @brief Start following; no-op unless options().follower().
+        void start();
+
+        /// @brief Stop the pull loop. Idempotent.
+        void stop();
+
+        /**
+         * @brief Copy `mantis.db` for a follower to download, on the primary.
+         * @return `id` to fetch it by, `size`, and the `change_id` and `schema_version` it reflects
+         */
+        [[nodiscard]] json createSnapshot() const;
+
+        /// @brief Path of snapshot `id`; a 404 if there is no such snapshot (or `id` is not one of ours).
+        [[nodiscard]] std::filesystem::path snapshotPath(const std::string &id) const;
+
+        /// @brief Role, cursor and counters, served by `GET /api/v1/sys/replication`.
+        [[nodiscard]] json status() const;
+
+    private:
+        void loop();
+
+        /// Apply one batch; false once caught up
+        bool pull();
+
+        /// Replace the local database with a fresh snapshot of the primary's
+        void resync();
+
+        /// Send `method` `path` to the primary and return the body; throws unless it answers 2xx
+        std::string request(const std::string &method, const std::string &path) const;
+
+        /// Load the snapshot at `file` into the live database, then set the cursor to `cursor`
+        void restore(const std::filesystem::path &file, const Cursor &cursor) const;
+
+        [[nodiscard]] std::filesystem::path snapshotDir() const;
+
+        const MantisBase &mApp;
+        const Options m_options;
+
+        std::unique_ptr<trantor::EventLoopThread> m_loop; ///> Runs the HTTP client; follower only
+        std::shared_ptr<drogon::HttpClient> m_client;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_cv;
+        bool m_stopping = false;
+        std::thread m_thread;
+
+        mutable std::mutex m_statsMutex;
+        std::optional<Cursor> m_cursor;     ///> Guarded by m_statsMutex
+        long long m_head = 0;               ///> Primary's newest id at the last poll
+        std::uint64_t m_applied = 0, m_resyncs = 0;
+        std::string m_lastError;
+        std::string m_lastSync;             ///> When the last poll succeeded
+        mutable std::mutex m_snapshotMutex; ///> One createSnapshot() at a time
+    };
+}
+
+#endif // MANTISBASE_REPLICATION_H
@@ -0,0 +1,113 @@
+/**
+ * @file request_arena.h
+ * @brief Per-request monotonic memory for JSON documents that die with the request.
+ *
+ * A document built, encoded and dropped within one request has no need to
+ * take node after node from the global heap, whose locks the request
+ * threads contend on. ArenaJson takes its objects and arrays from the arena
+ * of the request being handled on the thread instead, all released at once
+ * when the request ends.
+ * @see Router::executeMiddlewareChain()
+ */
+
+#ifndef MANTISBASE_REQUEST_ARENA_H
+#define MANTISBASE_REQUEST_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory_resource>
+#include <new>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace mb {
+    /**
+     * @brief Memory owned by one request, freed in one go with it.
+     *
+     * The first few KiB are inline; past them blocks come from the heap in
+     * growing sizes. Not thread-safe: a request runs on one thread at a time.
+     *
+     * @code
+     * const RequestArena::Scope scope(&req.arena());
+     * ArenaJson doc = ArenaJson::parse(body); // nodes on the request's arena
+     * @endcode
+     */
+    class RequestArena {
+    public:
+        RequestArena();
+
+        RequestArena(const RequestArena &) = delete;
+        RequestArena &operator=(const RequestArena &) = delete;
+
+        [[nodiscard]] std::pmr::memory_resource *resource() { return &m_resource; }
+
+        /// @brief The arena of the request being handled on this thread, or nullptr.
+        static RequestArena *current();
+
+        /// @brief Makes `arena` current on this thread until destroyed; nullptr for the heap.
+        class Scope {
+        public:
+            explicit Scope(RequestArena *arena);
+            ~Scope();
+
+            Scope(const Scope &) = delete;
+            Scope &operator=(const Scope &) = delete;
+
+        private:
+            RequestArena *m_previous;
+        };
+
+    private:
+        static constexpr std::size_t INLINE_BYTES = 4096;
+
+        alignas(std::max_align_t) std::byte m_inline[INLINE_BYTES];
+        std::pmr::monotonic_buffer_resource m_resource;
+    };
+
+    /**
+     * @brief Allocates from RequestArena::current(), or the heap outside of a request.
+     *
+     * nlohmann default-constructs its allocator wherever a value is destroyed,
+     * so every block carries a header naming where it came from; a heap
+     * block is freed alike in or out of a request, an arena block is left to
+     * its arena. Values must not outlive the request whose arena holds them.
+     */
+    template<typename T>
+    class ArenaAllocator {
+        struct alignas(std::max_align_t) Header {
+            std::pmr::memory_resource *arena; ///> nullptr for the heap
+        };
+
+    public:
+        using value_type = T;
+
+        ArenaAllocator() noexcept = default;
+
+        template<typename U>
+        ArenaAllocator(const ArenaAllocator<U> &) noexcept {}
+
+        T *allocate(const std::size_t n) {
+            const auto bytes = sizeof(Header) + n * sizeof(T);
+            auto *arena = RequestArena::current();
+            auto *resource = arena ? arena->resource() : nullptr;
+            void *raw = resource ? resource->allocate(bytes, alignof(Header)) : ::operator new(bytes);
+            return reinterpret_cast<T *>(::new(raw) Header{resource} + 1);
+        }
+
+        void deallocate(T *p, std::size_t) noexcept {
+            auto *header = reinterpret_cast<Header *>(p) - 1;
+            if (!header->arena) ::operator delete(header);
+        }
+
+        template<typename U>
+        bool operator==(const ArenaAllocator<U> &) const noexcept { return true; }
+    };
+
+    /// nlohmann::json with its objects and arrays on the request's arena; strings stay on the heap
+    using ArenaJson = nlohmann::basic_json<std::map, std::vector, std::string, bool, std::int64_t, std::uint64_t,
+        double, ArenaAllocator>;
+}
+
+#endif // MANTISBASE_REQUEST_ARENA_H
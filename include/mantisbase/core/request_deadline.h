@@ -0,0 +1,97 @@
+/**
+ * @file request_deadline.h
+ * @brief Per-request deadline and cancellation, checked by database calls.
+ *
+ * A request gets a deadline from MB_REQUEST_TIMEOUT_MS or its own
+ * `X-Request-Timeout` header, counted from its arrival, and is cancelled
+ * when its client disconnects. The thread running its middleware chain
+ * has it current; every SQL statement checks it before it starts, SQLite
+ * statements are interrupted while they run, and PostgreSQL sessions get
+ * a `statement_timeout` of the time left. Work a client has given up on
+ * stops holding pool sessions and workers.
+ * @see Router::executeMiddlewareChain(), MantisLoggerImpl
+ */
+
+#ifndef MANTISBASE_REQUEST_DEADLINE_H
+#define MANTISBASE_REQUEST_DEADLINE_H
+
+#include <chrono>
+#include <functional>
+#include <string>
+
+namespace mb {
+    /**
+     * @brief When one request must be done by, and whether its client is still there.
+     *
+     * @code
+     * RequestDeadline deadline(arrived + 5s, [req] { return req->connected(); });
+     * const RequestDeadline::Scope scope(&deadline);
+     * RequestDeadline::check(); // throws 504 past the deadline, 499 once the client left
+     * @endcode
+     */
+    class RequestDeadline {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        /// Request header asking for a shorter deadline, in milliseconds
+        static constexpr auto REQUEST_HEADER = "X-Request-Timeout";
+
+        /// Status of a request whose client closed the connection, as nginx logs it
+        static constexpr int CLIENT_CLOSED = 499;
+
+        struct Options {
+            std::chrono::milliseconds timeout{0}; ///> 0 for no deadline unless the client asks for one
+            bool cancelOnClose = true;            ///> Stop a request's work once its client disconnects
+
+            /// @brief Read MB_REQUEST_TIMEOUT_MS and MB_REQUEST_CANCEL_ON_CLOSE.
+            static Options fromEnv();
+
+            /**
+             * @brief The timeout of a request sending `header` (REQUEST_HEADER's value).
+             *
+             * The shorter of the two when both are set, since a client may
+             * only give up sooner than the server would. 0 for none.
+             */
+            [[nodiscard]] std::chrono::milliseconds timeoutFor(const std::string &header) const;
+        };
+
+        /**
+         * @param at Deadline; Clock::time_point::max() for none
+         * @param alive Whether the client is still connected; empty if not watched
+         */
+        explicit RequestDeadline(Clock::time_point at, std::function<bool()> alive = {});
+
+        /// @brief The deadline of the request running on this thread, or nullptr.
+        static RequestDeadline *current();
+
+        /// @brief Throw MantisException with status() if the current request may not go on. No-op without one.
+        static void check();
+
+        /// @brief 0 while the request may go on, else 504 (past its deadline) or CLIENT_CLOSED.
+        [[nodiscard]] int status() const;
+
+        /// @brief Time left, zero once past; Clock::duration::max() without a deadline.
+        [[nodiscard]] Clock::duration remaining() const;
+
+        [[nodiscard]] bool bounded() const { return m_at != Clock::time_point::max(); }
+
+        /// @brief Makes `deadline` current on this thread until destroyed; nullptr lifts it.
+        class Scope {
+        public:
+            explicit Scope(RequestDeadline *deadline);
+            ~Scope();
+
+            Scope(const Scope &) = delete;
+            Scope &operator=(const Scope &) = delete;
+
+        private:
+            RequestDeadline *m_previous;
+        };
+
+    private:
+        Clock::time_point m_at;
+        std::function<bool()> m_alive;
+    };
+}
+
+#endif // MANTISBASE_REQUEST_DEADLINE_H
@@ -0,0 +1,143 @@
+/**
+ * @file response_cache.h
+ * @brief Serialized list/get responses of public entities, kept current from the change stream.
+ *
+ * Opt-in per entity. Only routes whose rule is `public` are cached, since
+ * their body can't depend on who asks. See handleGetMany() / handleGetOne().
+ */
+
+#ifndef MANTISBASE_RESPONSE_CACHE_H
+#define MANTISBASE_RESPONSE_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <nlohmann/json.hpp>
+
+#include "cache_budget.h"
+
+namespace mb {
+    /**
+     * @brief Response bodies and ETags keyed by (entity, normalized query).
+     *
+     * Any change to an entity drops its list pages; a row change also drops
+     * the responses for that row. A body read while a change to its entity
+     * was in flight is not stored: put() takes the generation() read before
+     * the query and is a no-op if the entity changed since. The total size of
+     * the bodies is capped, least recently used going first, and may be held
+     * to less by a CacheBudget shared with the entity caches.
+     *
+     * Thread-safe.
+     *
+     * @code
+     * auto &cache = app.router().responseCache();
+     * if (const auto hit = cache.get("posts", key)) return send(*hit->body, hit->etag);
+     * const auto generation = cache.generation("posts");
+     * auto body = render();
+     * const auto etag = cache.put("posts", key, generation, body);
+     * @endcode
+     */
+    class ResponseCache {
+    public:
+        struct Options {
+            std::unordered_set<std::string> entities;   ///> Entities opted in
+            bool all = false;                           ///> `*`: every entity
+            std::size_t maxBytes = 64 * 1024 * 1024;    ///> Bodies kept, in total
+            std::size_t maxEntryBytes = 1024 * 1024;    ///> Larger bodies aren't cached
+            CacheBudget *budget = nullptr;              ///> Shared with the other caches, if any
+
+            /// @brief Read MB_RESPONSE_CACHE (`posts,tags` or `*`), MB_RESPONSE_CACHE_MAX_MB and MB_CACHE_BUDGET_MB.
+            static Options fromEnv();
+        };
+
+        struct Entry {
+            std::shared_ptr<const std::string> body;
+            std::string etag;   ///> Strong, quoted
+        };
+
+        explicit ResponseCache(Options options);
+        ~ResponseCache();
+
+        ResponseCache(const ResponseCache &) = delete;
+        ResponseCache &operator=(const ResponseCache &) = delete;
+
+        /// @brief Whether `entity` opted in.
+        [[nodiscard]] bool enabledFor(const std::string &entity) const;
+
+        /// @brief The cached response for `key`, if any.
+        [[nodiscard]] std::optional<Entry> get(const std::string &entity, const std::string &key);
+
+        /// @brief Changes seen for `entity` so far; read before querying, pass to put().
+        [[nodiscard]] std::uint64_t generation(const std::string &entity) const;
+
+        /**
+         * @brief Cache `body` under `key`, unless `entity` changed since `generation`.
+         * @param row_id The record a get response holds; empty for list pages
+         * @param served_tag ETag to serve it under (see Entity::recordTag()); the body's own when empty
+         * @return The ETag, whether or not it was stored
+         */
+        std::string put(const std::string &entity, const std::string &key, std::uint64_t generation,
+                        std::string body, const std::string &row_id = "", const std::string &served_tag = "");
+
+        /// @brief Drop all responses of `entity` (e.g. after a schema change).
+        void invalidateEntity(const std::string &entity);
+
+        /**
+         * @brief Apply a batch of realtime change events.
+         * @param events JSON array of change events, as passed to an RtCallback
+         */
+        void onChanges(const nlohmann::json &events);
+
+        /// @brief Drop all entries.
+        void clear();
+
+        /// @brief Evict least recently used bodies until `bytes` are freed.
+        /// @return The bytes freed; less if the cache ran empty
+        std::size_t shed(std::size_t bytes);
+
+        [[nodiscard]] std::size_t size() const;
+        [[nodiscard]] std::size_t bytes() const;
+        [[nodiscard]] std::size_t hits() const { return m_hits.load(); }
+        [[nodiscard]] std::size_t misses() const { return m_misses.load(); }
+
+        /// @brief Strong ETag of a response body.
+        static std::string etag(std::string_view body);
+
+    private:
+        struct Slot {
+            std::string entity;
+            std::string key;
+            std::string rowId;   ///> Empty for list pages
+            Entry entry;
+        };
+        using Lru = std::list<Slot>;
+
+        struct Entity {
+            std::uint64_t generation = 0;
+            std::unordered_map<std::string, Lru::iterator> entries;   ///> By key
+            std::unordered_multimap<std::string, std::string> rows;   ///> Row id -> key of its get responses
+        };
+
+        /// Callers hold m_mutex
+        void eraseLocked(Entity &state, Lru::iterator slot);
+        void changedLocked(const std::string &entity, const std::string &row_id);
+
+        const Options m_options;
+        std::shared_ptr<CacheBudget::Account> m_account; ///> Its share of Options::budget, if any
+        mutable std::mutex m_mutex;
+        Lru m_lru;   ///> Most recently used first
+        std::unordered_map<std::string, Entity> m_entities;
+        std::size_t m_bytes = 0;
+        std::atomic<std::size_t> m_hits{0};
+        std::atomic<std::size_t> m_misses{0};
+    };
+}
+
+#endif // MANTISBASE_RESPONSE_CACHE_H
@@ -0,0 +1,87 @@
+/**
+ * @file revocation_filter.h
+ * @brief Bloom filter of revoked session ids, for stateless token checks.
+ *
+ * With `MB_JWT_STATELESS=1` a token whose session isn't cached is accepted
+ * on its signature and `exp` alone, unless this filter may hold its
+ * `session_id`; only then is `mb_sessions` asked. The same filter is served
+ * at `GET /api/v1/auth/revocations`, so edge proxies checking ES256 tokens
+ * against the JWKS can refuse logged-out sessions too. A false positive
+ * costs one database lookup here, and is the proxy's to forward.
+ */
+
+#ifndef MANTISBASE_REVOCATION_FILTER_H
+#define MANTISBASE_REVOCATION_FILTER_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace mb {
+    /**
+     * @brief Revoked ids in two generations of one `window` each.
+     *
+     * An id stays in the filter at least `window` after it was added, and at
+     * most twice that; the window has to cover the longest token lifetime.
+     * Bit `i` of the filter is bit `i % 8` of byte `i / 8`. An id sets bits
+     * `(h1 + j * h2) % bits` for `j < hashes`, where `h1` and `h2` are the
+     * first two big-endian 64-bit words of its SHA-256.
+     *
+     * @code
+     * Auth::revocations().add(session_id);     // on logout, refresh, and revocations from other nodes
+     * if (!Auth::revocations().mayContain(sid)) accept(); else checkDatabase();
+     * @endcode
+     */
+    class RevocationFilter {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        struct Options {
+            std::size_t bits = 1 << 20;          ///> 128 KiB; ~100k ids at 1% false positives
+            unsigned hashes = 7;
+            std::chrono::seconds window{900};    ///> At least the stateless token lifetime
+
+            /// @brief `window` from MB_JWT_ACCESS_TTL (seconds), bits from MB_JWT_REVOCATION_BITS.
+            static Options fromEnv();
+        };
+
+        explicit RevocationFilter(Options options);
+
+        void add(const std::string &session_id);
+
+        /// @brief False if `session_id` was surely not added in the last `window`.
+        [[nodiscard]] bool mayContain(const std::string &session_id);
+
+        /// @brief Bumped on every add() and rotation, for ETags.
+        [[nodiscard]] std::uint64_t version();
+
+        /**
+         * @brief `{"version", "bits", "hashes", "window", "filter"}`, `filter` being
+         * base64url of both generations OR-ed together.
+         */
+        [[nodiscard]] nlohmann::json toJSON();
+
+        /// @brief The double-hashing pair of `session_id`, see the class notes.
+        static std::pair<std::uint64_t, std::uint64_t> hashesOf(const std::string &session_id);
+
+        /// @brief Start a new generation if `now` is a window past the last one.
+        void rotate(Clock::time_point now = Clock::now());
+
+    private:
+        /// Callers hold m_mutex
+        void rotateLocked(Clock::time_point now);
+
+        const Options m_opts;
+        std::mutex m_mutex;
+        std::vector<std::uint8_t> m_current, m_previous;
+        Clock::time_point m_started;
+        std::uint64_t m_version = 0;
+    };
+}
+
+#endif // MANTISBASE_REVOCATION_FILTER_H
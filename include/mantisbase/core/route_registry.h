@@ -21,8 +21,10 @@ namespace mb
 
     struct RouteHandler
     {
+        /// The full chain: pre-routing middlewares, unless left out, then the route's own; see Router::routeChain()
         std::vector<MiddlewareFn> middlewares;
-        std::variant<HandlerFn, HandlerWithContentReaderFn> handler;
+        std::variant<HandlerFn, HandlerWithContentReaderFn, AsyncHandlerFn> handler;
+        RouteExec exec = RouteExec::IoLoop;
     };
 
     class RouteRegistry
@@ -33,11 +35,18 @@ namespace mb
         void add(const std::string& method,
                  const std::string& path,
                  const HandlerFn &handler,
-                 const Middlewares& middlewares);
+                 const Middlewares& middlewares,
+                 RouteExec exec = RouteExec::IoLoop);
 
         void add(const std::string& method,
                  const std::string& path,
                  const HandlerWithContentReaderFn &handler,
+                 const Middlewares& middlewares,
+                 RouteExec exec = RouteExec::IoLoop);
+
+        void add(const std::string& method,
+                 const std::string& path,
+                 const AsyncHandlerFn &handler,
                  const Middlewares& middlewares);
 
         const RouteHandler* find(const std::string& method, const std::string& path) const;
@@ -1,92 +1,300 @@
 #ifndef MB_ROUTER_H
 #define MB_ROUTER_H
 
+#include <cstdint>
 #include <memory>
 #include <vector>
 #include <atomic>
-#include <shared_mutex>
+#include <mutex>
+#include <unordered_map>
 #include <nlohmann/json.hpp>
 
 #include "route_registry.h"
 #include "models/entity.h"
 #include "../utils/utils.h"
 #include "types.h"
+#include "logger/access_log.h"
+#include "admin_assets.h"
+#include "admission.h"
+#include "backup.h"
+#include "replication.h"
+#include "request_deadline.h"
+#include "compression.h"
+#include "connection_warmup.h"
+#include "cors.h"
+#include "drain.h"
+#include "leader_election.h"
+#include "metrics.h"
+#include "multipart_upload.h"
+#include "response_cache.h"
+#include "server_timing.h"
+#include "static_cache.h"
+#include "thumbnails.h"
+#include "tracing.h"
+#include "usage_quotas.h"
 #include "drogon/drogon_callbacks.h"
-#include "mantisbase/utils/snowflake.hpp"
 
 namespace mb {
     class SSEMgr;
+    class WorkerPool;
+    class RecordHooks;
+    class Webhooks;
+    class ReadinessProbe;
 
     class Router {
     public:
+        using EntityMap = std::unordered_map<std::string, std::shared_ptr<const Entity>>;
+
+        /// Entity schema cache, read on every request and replaced by the schema
+        /// CRUD endpoints. Readers load the current map without locking; writers
+        /// copy it, change the copy and swap it in under `mutex`, so a snapshot
+        /// a request holds is never modified under it.
+        struct EntityCache {
+            std::atomic<std::shared_ptr<const EntityMap>> map{std::make_shared<const EntityMap>()};
+            std::atomic<std::uint64_t> version{0}; ///> Bumped after each new map
+            std::mutex mutex; ///> Serializes writers only
+
+            /// `GET /api/v1/schemas` as of one version: serialized once, then served from memory
+            struct Listing {
+                std::uint64_t version = 0;
+                std::string body; ///> The whole response, `data` holding the `mb_tables` rows
+                std::string etag;
+            };
+            std::atomic<std::shared_ptr<const Listing>> listing;
+
+            /// Swap in `next`; writers hold `mutex`
+            void publish(std::shared_ptr<const EntityMap> next) {
+                map.store(std::move(next));
+                version.fetch_add(1);
+            }
+        };
+
         explicit Router(const MantisBase& app);
         ~Router();
 
         bool init();
         bool listen();
+
+        /**
+         * @brief Turn new requests away, wait out those in flight for the
+         * grace period and tell realtime clients to reconnect; see Drain.
+         * close() drains first; SIGTERM drains, then quits the server.
+         * @return False if requests were still in flight when the grace period ended
+         */
+        bool drain();
+
         void close();
 
+#ifdef MB_SCRIPTING_ENABLED
+        /**
+         * @brief Called by MantisBase::reloadScripts(): schedule the jobs the scripts now
+         * declare and drop those they no longer do.
+         */
+        void scriptsReloaded();
+#endif
+
         SSEMgr& sseMgr() const;
 
-        void Get(const std::string &path, const HandlerFn &handler, const Middlewares &middlewares = {});
-        void Post(const std::string &path, const HandlerWithContentReaderFn &handler, const Middlewares &middlewares = {});
-        void Post(const std::string &path, const HandlerFn &handler, const Middlewares &middlewares = {});
-        void Patch(const std::string &path, const HandlerWithContentReaderFn &handler, const Middlewares &middlewares = {});
-        void Patch(const std::string &path, const HandlerFn &handler, const Middlewares &middlewares = {});
-        void Delete(const std::string &path, const HandlerFn &handler, const Middlewares &middlewares = {});
+        // Route registration. Pass RouteExec::DbWorker for routes that block on
+        // the database so they run on the DB worker pool, not the IO loop.
+        void Get(const std::string &path, const HandlerFn &handler, const Middlewares &middlewares = {},
+                 RouteExec exec = RouteExec::IoLoop);
+        void Post(const std::string &path, const HandlerWithContentReaderFn &handler, const Middlewares &middlewares = {},
+                  RouteExec exec = RouteExec::IoLoop);
+        void Post(const std::string &path, const HandlerFn &handler, const Middlewares &middlewares = {},
+                  RouteExec exec = RouteExec::IoLoop);
+        void Patch(const std::string &path, const HandlerWithContentReaderFn &handler, const Middlewares &middlewares = {},
+                   RouteExec exec = RouteExec::IoLoop);
+        void Patch(const std::string &path, const HandlerFn &handler, const Middlewares &middlewares = {},
+                   RouteExec exec = RouteExec::IoLoop);
+        void Delete(const std::string &path, const HandlerFn &handler, const Middlewares &middlewares = {},
+                    RouteExec exec = RouteExec::IoLoop);
+
+        /**
+         * @brief Coroutine routes: `handler` runs on the IO loop and may `co_await`.
+         *
+         * The middlewares run first, as for any route. While the handler waits
+         * on a `co_await`, its IO thread serves other requests. Blocking work,
+         * such as Entity calls, goes through `co_await onDbWorker(req, ...)`
+         * (see async_handler.h), and drogon's HttpClient has `sendRequestCoro()`.
+         * Bodies are read in full before the chain runs, as for HandlerFn routes.
+         */
+        void GetAsync(const std::string &path, const AsyncHandlerFn &handler, const Middlewares &middlewares = {});
+        void PostAsync(const std::string &path, const AsyncHandlerFn &handler, const Middlewares &middlewares = {});
+        void PatchAsync(const std::string &path, const AsyncHandlerFn &handler, const Middlewares &middlewares = {});
+        void DeleteAsync(const std::string &path, const AsyncHandlerFn &handler, const Middlewares &middlewares = {});
+
+        /**
+         * @brief Run `work` on the DB worker pool in `req`'s tenant and replica scope, then `done` on the calling loop.
+         *
+         * What onDbWorker() awaits. A write in `work` pins the rest of the
+         * request to the primary. Both run inline when the pool is stopped.
+         * `work` never touches `req`'s attributes, so a request may have
+         * several offloads in flight.
+         */
+        void offload(MantisRequest &req, std::function<void()> work, std::function<void()> done) const;
 
-        const json &schemaCache(const std::string &table_name) const;
+        json schemaCache(const std::string &table_name) const;
         bool hasSchemaCache(const std::string &table_name) const;
         Entity schemaCacheEntity(const std::string &table_name) const;
+
+        /**
+         * @brief The cached entity, shared rather than copied.
+         *
+         * The snapshot stays valid, and unchanged, after a concurrent schema
+         * change replaces it in the cache.
+         * @throw MantisException 404 if there is no such entity
+         */
+        std::shared_ptr<const Entity> entitySnapshot(const std::string &table_name) const;
+
+        /**
+         * @brief The schema listing of the request's entity cache, read from `mb_tables`
+         * on `app` once per cache version. Its ETag changes with the schemas, and on
+         * every change of the application's own entities `@mb:schemas` is told.
+         */
+        std::shared_ptr<const EntityCache::Listing> schemaListing(const MantisBase &app) const;
+
         void addSchemaCache(const nlohmann::json &entity_schema);
         void updateSchemaCache(const std::string &old_entity_name, const json &new_schema);
         void removeSchemaCache(const std::string &entity_name) const;
 
-        void addSchemaCacheLocked(const nlohmann::json &entity_schema) const;
+        /**
+         * @brief Rebuild the cached entities from `mb_tables`, e.g. after a
+         * replica loaded a new snapshot. Every entity is rebuilt, so the
+         * caches over their rows are dropped too.
+         */
+        void reloadSchemaCache();
 
-        void removeSchemaCacheLocked(const std::string &entity_name) const;
+        /**
+         * @brief Build the entities of `mb_tables` on app.db(), with the
+         * `mb_admins` and `mb_service_acc` system entities. Used by init(),
+         * and by Tenants for a tenant's own cache.
+         */
+        std::shared_ptr<const EntityMap> loadEntities() const;
 
         bool isRunning() const;
 
         const std::vector<MiddlewareFn> &preRoutingMiddlewares() const { return m_preRoutingMiddlewares; }
 
+        /// @brief Access log sampling and request counters, see AccessLog.
+        const AccessLog &accessLog() const { return *m_accessLog; }
+
+        /// @brief Per-route request metrics and script timings, served by `GET /api/v1/metrics`.
+        Metrics &metrics() const { return *m_metrics; }
+
+        Admission &admission() const { return *m_admission; }
+
+        /// @brief In-flight requests and the shutdown state, see Drain.
+        Drain &drainState() const { return *m_drain; }
+
+        /// @brief The in-memory public directory, see StaticCache.
+        StaticCache &staticCache() const { return *m_staticCache; }
+
+        /// @brief Per-key and per-user quotas, checked by hydrateContextData(); see UsageQuotas.
+        UsageQuotas &usageQuotas() const { return *m_usageQuotas; }
+
+        /// @brief Where streamed uploads are written and discarded staging files removed, see FileIo.
+        FileIo &fileIo() const { return *m_fileIo; }
+
+        /// @brief The startup warmup of the pooled connections, see ConnectionWarmup; off unless MB_DB_WARMUP=1.
+        ConnectionWarmup &warmup() const { return *m_warmup; }
+
+        /// @brief Which node of the cluster runs the singleton jobs, see LeaderElection.
+        LeaderElection &leader() const { return *m_leader; }
+
+        /// @brief Trace contexts and span export, see Tracer; disabled unless MB_OTLP_ENDPOINT is set.
+        Tracer &tracer() const { return *m_tracer; }
+
+        /// @brief Image derivatives for `?thumb=` file requests, see Thumbnailer.
+        Thumbnailer &thumbnails() const { return *m_thumbnails; }
+
+        /// @brief Cached list/get responses of public entities, see ResponseCache; off unless MB_RESPONSE_CACHE is set.
+        ResponseCache &responseCache() const { return *m_responseCache; }
+
+        /// @brief SQLite replication, serving the change stream or following a primary; see Replication.
+        Replication &replication() const { return *m_replication; }
+
+        /// @brief After-commit record hooks, see RecordHooks; started by listen() if the scripts define any.
+        RecordHooks &recordHooks() const { return *m_recordHooks; }
+
+        /// @brief Change events POSTed to subscribed URLs, see Webhooks; delivered by the leader.
+        Webhooks &webhooks() const { return *m_webhooks; }
+
+        /// @brief Background checks behind `GET /api/v1/health/ready`, see ReadinessProbe.
+        ReadinessProbe &readiness() const { return *m_readiness; }
+
     private:
         void registerDrogonHandler(const std::string &method, const std::string &path) const;
+        /// Streams the body: multipart file parts to staging files, anything else into memory
         void registerDrogonHandlerWithReader(const std::string &method, const std::string &path);
 
         static std::string convertPathToDrogon(const std::string &httplib_path);
-        static std::vector<std::string> extractParamNames(const std::string &httplib_path);
 
-        void executeMiddlewareChain(MantisRequest &req, MantisResponse &res, const RouteHandler *route) const;
+        /// @brief Run the chain, adding a `Server-Timing` header if the request asked for one.
+        void executeMiddlewareChain(MantisRequest &req, MantisResponse &res, const RouteHandler *route,
+                                    MantisContentReader *reader = nullptr) const;
+
+        ///> The route's composed chain and handler, then post-routing
+        void runMiddlewareChain(MantisRequest &req, MantisResponse &res, const RouteHandler *route,
+                                MantisContentReader *reader) const;
+
+        ///> executeMiddlewareChain() for an AsyncHandlerFn route; thread-bound scopes cover the middlewares only
+        drogon::Task<> executeAsyncChain(MantisRequest &req, MantisResponse &res, const RouteHandler *route) const;
+
+        void registerAsync(const std::string &method, const std::string &path, const AsyncHandlerFn &handler,
+                           const Middlewares &middlewares);
+
+        ///> Compose a route's chain once, at registration: pre-routing middlewares (unless it has noAuthContext()), then `middlewares`
+        Middlewares routeChain(const Middlewares &middlewares) const;
+
+        ///> Encode the body per `Accept-Encoding`, unless the route opted out with noCompression()
+        void compressResponse(MantisRequest &req, const MantisResponse &res) const;
+
+        ///> Add `Vary: Accept` to JSON/MessagePack/CBOR responses, weakening the ETag of binary ones
+        static void varyWireFormat(const MantisResponse &res);
+
+        /**
+         * @brief Run `work` per the route's execution policy, then `done`.
+         *
+         * For RouteExec::DbWorker, `work` runs on the DB worker pool and `done`
+         * (which hands the response to Drogon) is queued back onto the IO loop
+         * the request arrived on. `urgent` work goes ahead of the queued routes.
+         */
+        void dispatch(RouteExec exec, std::function<void()> work, std::function<void()> done,
+                      bool urgent = false) const;
 
         void generateMiscEndpoints();
         void registerEntityRoutes();
         void registerSchemaRoutes();
         void registerAuthRoutes();
         void registerApiKeyRoutes();
+        void registerKvRoutes();
+        void registerWebhookRoutes();
         void registerOAuthRoutes();
+        void registerReplicationRoutes();
+        void registerSyncRoutes();
 
         static std::string getMimeType(const std::string &path);
 
-        static std::function<void(const MantisRequest &, MantisResponse &)> handleAdminDashboardRoute();
         static std::function<void(const MantisRequest &, MantisResponse &)> fileServingHandler();
         static std::function<void(const MantisRequest &, MantisResponse &)> healthCheckHandler();
+        static std::function<void(const MantisRequest &, MantisResponse &)> readinessHandler();
 
-        ///> Sync Advice to return handler that generates unique IDs per request
+        ///> Sync Advice to return handler that generates unique IDs per request, continuing any `traceparent`
         const std::function<drogon::HttpResponsePtr(const drogon::HttpRequestPtr &)> reqIdSyncAdvice();
 
-        ///> Returns handler logger func for all requests before they return
+        ///> Returns handler logger func for all requests before they return; sampled per AccessLog
         std::function<void(const drogon::HttpRequestPtr &req, const drogon::HttpResponsePtr &resp)> loggerPostHandlingAdvice() const;
 
-        ///> Register CORS pre-routing advice
-        static std::function<void(const drogon::HttpRequestPtr &,
-                                  drogon::AdviceCallback &&,
-                                  drogon::AdviceChainCallback &&
-        )> corsPreRoutingAdvice();
+        ///> Register CORS pre-routing advice, answering preflights per m_cors
+        std::function<void(const drogon::HttpRequestPtr &,
+                           drogon::AdviceCallback &&,
+                           drogon::AdviceChainCallback &&
+        )> corsPreRoutingAdvice() const;
 
         ///> Register post-routing advice for CORS headers on all responses
-        static std::function<void(const drogon::HttpRequestPtr &,
-                                  const drogon::HttpResponsePtr &resp)> corsPostHandlingAdvice();
+        std::function<void(const drogon::HttpRequestPtr &,
+                           const drogon::HttpResponsePtr &resp)> corsPostHandlingAdvice() const;
 
         ///> Get default 404 handler
         static drogon::HttpResponsePtr default404Response();
@@ -99,20 +307,75 @@ namespace mb {
 
         static std::function<void(const MantisRequest &, MantisResponse &)> handleLogs();
 
+        ///> Public token keys as a JWK Set, see TokenVerifier::jwks()
+        static std::function<void(const MantisRequest &, MantisResponse &)> handleJwks();
+
+        ///> The RevocationFilter, for edge proxies verifying tokens without the database
+        static std::function<void(const MantisRequest &, MantisResponse &)> handleRevocations();
+
+        ///> Prometheus text exposition of request, pool, queue and realtime metrics
+        static std::function<void(const MantisRequest &, MantisResponse &)> handleMetrics();
+
+        ///> GET/PATCH the SQLite tuning profile, see SqliteProfile
+        static std::function<void(const MantisRequest &, MantisResponse &)> handleGetSqliteProfile();
+        static std::function<void(const MantisRequest &, MantisResponse &)> handlePatchSqliteProfile();
+
+        ///> POST `/api/v1/sys/reload`: the scripts and settings again, without a restart
+        static std::function<void(const MantisRequest &, MantisResponse &)> handleReload();
+
+#ifdef MB_SCRIPTING_ENABLED
+        /// Schedule the scripts' `jobs`, replacing the ones scheduled before
+        void scheduleScriptJobs();
+#endif
+
         const MantisBase &mApp;
         RouteRegistry m_routeRegistry;
         std::unique_ptr<SSEMgr> m_sseMgr;
+        std::unique_ptr<WorkerPool> m_dbWorkers; ///> Runs RouteExec::DbWorker routes
+        std::unique_ptr<AccessLog> m_accessLog;  ///> Decides which requests loggerPostHandlingAdvice() writes
+        std::unique_ptr<Metrics> m_metrics;      ///> Recorded into by loggerPostHandlingAdvice()
+        std::unique_ptr<Admission> m_admission;  ///> Per-route limits on DbWorker routes, taken before dispatch()
+        std::unique_ptr<Drain> m_drain;          ///> Tickets taken by every handler, see drain()
+        ServerTiming::Mode m_serverTiming;       ///> Who may ask for a Server-Timing header
+        const RequestDeadline::Options m_deadlines; ///> Request timeout and cancel-on-close, see executeMiddlewareChain()
+        std::unique_ptr<Tracer> m_tracer;        ///> Started by listen(), stopped by close()
+        std::unique_ptr<Thumbnailer> m_thumbnails; ///> Own pool, so image work never queues behind DB routes
+        std::unique_ptr<RecordHooks> m_recordHooks; ///> Own pool too, so a slow hook never holds up a request
+        const MultipartUpload::Limits m_uploadLimits; ///> Body and upload size limits, checked as bodies stream in
+        std::unique_ptr<FileIo> m_fileIo;             ///> Staging writes off the IO loops; started by listen()
+        std::unique_ptr<ConnectionWarmup> m_warmup;   ///> Started by listen(); holds the health check until done
+        std::unique_ptr<LeaderElection> m_leader;     ///> Started by listen() ahead of the scheduler; steps down on close()
+        std::unique_ptr<Webhooks> m_webhooks;         ///> Fed from the change stream; stopped by close() ahead of m_leader
+        std::unique_ptr<ReadinessProbe> m_readiness;  ///> Started by listen(); its cached report answers `/api/v1/health/ready`
+        std::atomic<std::size_t> m_maxFileSetting{0}; ///> From the `maxFileSize` setting, in bytes; 0 for env only
+        const Compression::Options m_compression;     ///> Response compression, applied by executeMiddlewareChain()
+        std::unique_ptr<ResponseCache> m_responseCache; ///> Kept current from the change stream, see listen()
+        std::unique_ptr<CorsPolicy> m_cors;           ///> MB_CORS_ORIGINS, read once by the CORS advices
+        std::unique_ptr<AdminAssets> m_adminAssets;   ///> Built by generateMiscEndpoints(), served from by the `/mb` route
+        std::unique_ptr<StaticCache> m_staticCache;   ///> MB_PUBLIC_CACHE: `publicDir` from memory, ahead of the document root
+        std::unique_ptr<UsageQuotas> m_usageQuotas;   ///> MB_QUOTA_*: loaded and flushed behind by listen()
+        std::unique_ptr<Replication> m_replication;   ///> Started by listen() on a follower
+        std::unique_ptr<Backup> m_backup;             ///> Runs `/api/v1/sys/backup` requests, one at a time; SQLite only
         std::vector<MiddlewareFn> m_preRoutingMiddlewares;
         std::vector<HandlerFn> m_postRoutingMiddlewares;
+        std::vector<std::string> m_scriptJobs; ///> Names scheduleScriptJobs() last scheduled
 
-        /// Entity schema cache. Read on every request by the httplib worker
-        /// threads and mutated at runtime by the schema CRUD endpoints, so all
-        /// access must be synchronized via m_entityMapMutex.
-        mutable std::unordered_map<std::string, Entity> m_entityMap;
-        std::atomic<bool> m_running{false};
-        mutable std::shared_mutex m_entityMapMutex;
+        /// The cache of the request's tenant (see Tenants), else m_entities
+        EntityCache &entityCache() const;
+
+        /// Publish `map` in `cache`, whose mutex the caller holds; `changed` names the entities for `@mb:schemas`
+        void publishEntities(EntityCache &cache, std::shared_ptr<const EntityMap> map,
+                             const std::vector<std::string> &changed) const;
+
+        /// Callers hold the cache's mutex and publish `map` afterwards
+        void addSchemaCacheLocked(EntityMap &map, std::shared_ptr<const Entity> entity) const;
 
-        Snowflake<1534832906275L> m_sfId;
+        /// With per-entity realtime channels, keep receiving changes the auth user and response caches need
+        void pinForCaches(const Entity &entity) const;
+        static void removeSchemaCacheLocked(EntityMap &map, const std::string &entity_name);
+
+        mutable EntityCache m_entities; ///> The application's own entities
+        std::atomic<bool> m_running{false};
     };
 } // mb
 
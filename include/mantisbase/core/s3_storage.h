@@ -0,0 +1,140 @@
+/**
+ * @file s3_storage.h
+ * @brief StorageBackend for S3 and S3-compatible object stores (MinIO, R2, ...).
+ *
+ * Requests are signed with AWS Signature Version 4 and sent with drogon's
+ * HttpClient on the backend's own event loop, so blocking on them from a
+ * request handler can't stall an IO thread's loop.
+ * @see Storage
+ */
+
+#ifndef MANTISBASE_S3_STORAGE_H
+#define MANTISBASE_S3_STORAGE_H
+
+#include "storage.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace drogon {
+    class HttpClient;
+}
+
+namespace trantor {
+    class EventLoopThread;
+}
+
+namespace mb {
+    /**
+     * @brief Blobs as objects `<prefix>blobs/<aa>/<sha256>` in one bucket.
+     *
+     * Files up to `partSize` go up in a single PUT. Larger ones use a
+     * multipart upload with up to `concurrency` parts in flight, each read
+     * from disk as it is sent, so memory stays at `partSize * concurrency`.
+     * A failed multipart upload is aborted so its parts aren't billed.
+     */
+    class S3Storage final : public StorageBackend {
+    public:
+        struct Options {
+            std::string endpoint;            ///> `https://s3.us-east-1.amazonaws.com`, `http://minio:9000`, ...
+            std::string bucket;
+            std::string region = "us-east-1";
+            std::string accessKey;
+            std::string secretKey;
+            std::string prefix;              ///> Prepended to every object key, e.g. `prod/`
+            bool pathStyle = true;           ///> `endpoint/bucket/key`, else `bucket.endpoint/key`
+            std::size_t partSize = 8 * 1024 * 1024;
+            std::size_t concurrency = 4;
+            std::chrono::seconds presignTtl{300};
+            double timeout = 60.0;           ///> Per request, in seconds
+
+            /**
+             * @brief Read MB_S3_ENDPOINT, MB_S3_BUCKET, MB_S3_REGION, MB_S3_ACCESS_KEY,
+             * MB_S3_SECRET_KEY, MB_S3_PREFIX, MB_S3_PATH_STYLE, MB_S3_PART_SIZE (bytes,
+             * at least 5 MiB), MB_S3_UPLOAD_CONCURRENCY and MB_S3_PRESIGN_TTL (seconds).
+             * @throws MantisException (500) if the endpoint, bucket or keys are missing
+             */
+            static Options fromEnv();
+
+            /// @brief `scheme://host[:port]` requests go to.
+            [[nodiscard]] std::string baseUrl() const;
+            /// @brief Host header value, as signed.
+            [[nodiscard]] std::string host() const;
+            /// @brief URI-encoded request path for an object key.
+            [[nodiscard]] std::string objectPath(const std::string &key) const;
+        };
+
+        explicit S3Storage(Options options);
+        ~S3Storage() override;
+
+        [[nodiscard]] std::string name() const override { return "s3"; }
+        [[nodiscard]] bool isLocal() const override { return false; }
+        [[nodiscard]] bool hasBlob(const std::string &sha256) override;
+        void putBlob(const std::string &sha256, const std::filesystem::path &file,
+                     const std::string &content_type) override;
+        bool removeBlob(const std::string &sha256) override;
+        [[nodiscard]] std::optional<std::string> presignGet(const std::string &sha256,
+                                                            const std::string &filename,
+                                                            const std::string &content_type) override;
+
+        [[nodiscard]] std::string objectKey(const std::string &sha256) const;
+
+        /// @brief Percent-encode per SigV4: everything but `A-Za-z0-9-_.~`, and `/` unless `keep_slash`.
+        static std::string uriEncode(std::string_view s, bool keep_slash = false);
+
+        /// @brief `YYYYMMDDTHHMMSSZ` for `tp`.
+        static std::string amzDate(std::chrono::system_clock::time_point tp);
+
+        /**
+         * @brief Sign a request, returning its `Authorization` header.
+         *
+         * Adds `host`, `x-amz-date` and `x-amz-content-sha256` to `headers`,
+         * whose keys must be lowercase; all of them are signed.
+         *
+         * @param canonical_uri URI-encoded path, as sent
+         * @param query Decoded query parameters
+         * @param payload_sha256 Hex SHA-256 of the body
+         * @param amz_date Request time, from amzDate()
+         */
+        static std::string sign(const Options &o, const std::string &method, const std::string &canonical_uri,
+                                const std::map<std::string, std::string> &query,
+                                std::map<std::string, std::string> &headers,
+                                const std::string &payload_sha256, const std::string &amz_date);
+
+        /// @brief Presigned URL for `method` on `key`, valid for `expires` from `amz_date`.
+        static std::string presign(const Options &o, const std::string &method, const std::string &key,
+                                   std::map<std::string, std::string> query, const std::string &amz_date,
+                                   std::chrono::seconds expires);
+
+    private:
+        struct Response {
+            int status = 0;   ///> 0 if the request never got an answer
+            std::string body;
+            std::string etag;
+        };
+
+        /// @brief Send a signed request and wait for it.
+        Response send(const std::string &method, const std::string &key,
+                      const std::map<std::string, std::string> &query, std::string body,
+                      std::map<std::string, std::string> headers = {});
+
+        void putSingle(const std::string &key, const std::filesystem::path &file, const std::string &content_type);
+        void putMultipart(const std::string &key, const std::filesystem::path &file, std::size_t size,
+                          const std::string &content_type);
+
+        const std::shared_ptr<drogon::HttpClient> &nextClient();
+
+        const Options m_opts;
+        std::unique_ptr<trantor::EventLoopThread> m_loop;
+        std::vector<std::shared_ptr<drogon::HttpClient>> m_clients;   ///> One connection per upload slot
+        std::atomic<std::size_t> m_next{0};
+    };
+}
+
+#endif // MANTISBASE_S3_STORAGE_H
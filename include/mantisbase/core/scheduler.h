@@ -0,0 +1,189 @@
+/**
+ * @file scheduler.h
+ * @brief Periodic jobs on cron schedules, run by one small worker pool.
+ *
+ * Housekeeping (log retention, change log pruning, API key `last_used`
+ * writes) and the jobs scripts declare run here instead of on threads of
+ * their own. A job marked `leased` runs on one node per tick, whichever
+ * takes the tick's lease in `mb_job_leases` first, so a cluster sharing a
+ * database sends one digest email rather than one per node. A job marked
+ * `singleton` runs only on the cluster leader, every tick, see LeaderElection.
+ * @see CronSchedule
+ */
+
+#ifndef MANTISBASE_SCHEDULER_H
+#define MANTISBASE_SCHEDULER_H
+
+#include <bitset>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mb {
+    class MetricsWriter;
+    class WorkerPool;
+
+    /**
+     * @brief A parsed cron expression, in UTC.
+     *
+     * Five fields, `minute hour day-of-month month day-of-week`, each `*`,
+     * a value, a range `a-b`, a list `a,b`, and any of these stepped with
+     * `/n`. Months and weekdays may be named (`jan`, `mon`); Sunday is 0 or
+     * 7. When both day fields are restricted, a day matching either fires,
+     * as in Vixie cron. Also `@yearly`, `@monthly`, `@weekly`, `@daily`,
+     * `@hourly`, and `@every <n>s|m|h` for a fixed interval, whose ticks are
+     * multiples of it since the epoch so every node agrees on them.
+     *
+     * @code
+     * const auto nightly = CronSchedule::parse("30 2 * * *");
+     * const auto at = nightly.next(std::chrono::system_clock::now()); // next 02:30 UTC
+     * @endcode
+     */
+    class CronSchedule {
+    public:
+        using Clock = std::chrono::system_clock;
+
+        /// @throws MantisException (400) for a malformed expression
+        static CronSchedule parse(const std::string &expr);
+
+        /// @brief The first tick after `after`, or Clock::time_point::max() if there is none.
+        [[nodiscard]] Clock::time_point next(Clock::time_point after) const;
+
+    private:
+        std::bitset<60> m_minutes;
+        std::bitset<24> m_hours;
+        std::bitset<32> m_days;     ///> 1-31
+        std::bitset<13> m_months;   ///> 1-12
+        std::bitset<7> m_weekdays;  ///> 0 (Sunday) - 6
+        bool m_anyDay = true, m_anyWeekday = true;
+        std::chrono::seconds m_every{0}; ///> `@every`; the fields are unused then
+    };
+
+    /**
+     * @brief Fires jobs when their schedule comes due and runs them on a bounded pool.
+     *
+     * A job never overlaps itself: a tick arriving while the previous run is
+     * still going is skipped. Ticks missed while stopped aren't made up.
+     *
+     * @code
+     * app.scheduler().add({"digest", "0 8 * * *", [] { sendDigests(); }, std::chrono::seconds(60), true});
+     * app.scheduler().start();
+     * @endcode
+     */
+    class Scheduler {
+    public:
+        using Clock = CronSchedule::Clock;
+
+        struct Job {
+            std::string name;
+            std::string schedule;           ///> See CronSchedule
+            std::function<void()> run;      ///> Throws to count the run as failed
+            std::chrono::seconds jitter{0}; ///> Each run starts up to this late, spreading load
+            bool leased = false;            ///> One node per tick across a cluster sharing the database
+            bool singleton = false;         ///> Only on the node that leads, see setLeadership()
+        };
+
+        /**
+         * Takes the lease of `job` for the tick at `tick` (Unix seconds).
+         * True if this node is to run it; false if another node already has.
+         */
+        using Lease = std::function<bool(const std::string &job, std::int64_t tick)>;
+
+        /// Whether this node leads the cluster now
+        using Leadership = std::function<bool()>;
+
+        struct Options {
+            std::size_t workers = 2; ///> Jobs run at once, at most
+            std::string node;        ///> This node's name on the leases it takes
+
+            /// @brief Read MB_JOB_WORKERS and MB_NODE_ID (a random id if unset).
+            static Options fromEnv();
+        };
+
+        struct JobStats {
+            std::string name, schedule;
+            bool leased = false, singleton = false, running = false;
+            std::uint64_t runs = 0, failures = 0;
+            std::uint64_t skipped = 0;   ///> Ticks passed over while the previous run went on
+            std::uint64_t elsewhere = 0; ///> Ticks another node held the lease of, or led at
+            double lastMs = 0, maxMs = 0;
+            Clock::time_point next;
+        };
+
+        /// @param lease Leases of `leased` jobs; by default rows of `mb_job_leases`, see takeLease()
+        explicit Scheduler(Options options, Lease lease = {});
+        ~Scheduler();
+
+        Scheduler(const Scheduler &) = delete;
+        Scheduler &operator=(const Scheduler &) = delete;
+
+        /**
+         * @brief Schedule `job`, replacing a job of the same name.
+         * @throws MantisException (400) for an unnamed job, or a schedule that is malformed or never fires
+         */
+        void add(Job job);
+
+        /// @brief Unschedule job `name`; a run in progress finishes. False if there was none.
+        bool remove(const std::string &name);
+
+        /// @brief Where `singleton` jobs ask whether to run; without one, they run on every node.
+        void setLeadership(Leadership leadership);
+
+        void start();
+
+        /// @brief Stop firing jobs and wait for the running ones. Idempotent.
+        void stop();
+
+        [[nodiscard]] bool isRunning() const;
+
+        /// @brief Hand the jobs due at `now` to the pool. Called by the thread; public for tests.
+        std::size_t tick(Clock::time_point now = Clock::now());
+
+        [[nodiscard]] std::vector<JobStats> stats() const;
+
+        /// @brief `mb_job_runs_total`, `mb_job_last_duration_seconds` and `mb_job_running`, per job.
+        void writeMetrics(MetricsWriter &out) const;
+
+        /// @brief The default Lease: take `job`'s row in the application database for `tick`, if it is older.
+        static bool takeLease(const std::string &job, std::int64_t tick, const std::string &node);
+
+    private:
+        struct Entry {
+            Job job;
+            CronSchedule cron;
+            Clock::time_point tick; ///> Next tick
+            Clock::time_point at;   ///> When it runs: the tick, plus jitter
+            std::uint64_t generation = 0; ///> Tells a replaced job's finishing run from the new job
+            JobStats stats;
+        };
+
+        void loop();
+
+        /// Run the tick of `name` at `tick` on a worker, then record how it went
+        void run(const std::string &name, std::uint64_t generation, Clock::time_point tick);
+
+        /// `tick` plus up to `jitter` of random delay
+        static Clock::time_point jittered(Clock::time_point tick, std::chrono::seconds jitter);
+
+        const Options m_options;
+        const Lease m_lease;
+        Leadership m_leadership; ///> Guarded by m_mutex
+        std::unique_ptr<WorkerPool> m_pool;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_cv;
+        std::map<std::string, Entry> m_jobs; ///> Guarded by m_mutex
+        std::uint64_t m_generation = 0;      ///> Guarded by m_mutex
+        bool m_stopping = false, m_wake = false;
+        std::thread m_thread;
+    };
+}
+
+#endif // MANTISBASE_SCHEDULER_H
@@ -0,0 +1,132 @@
+/**
+ * @file schema_migrations.h
+ * @brief Online schema changes: shadow table, batched copy, atomic swap.
+ *
+ * A regular schema update runs its ALTER statements inside the request,
+ * holding the table for as long as they take, and SQLite can't alter
+ * foreign keys at all. An online migration instead creates the new table
+ * beside the old one (the "shadow"), puts triggers on the old table that
+ * mirror every write into the shadow, and copies the existing rows over in
+ * small batches from a background thread. Once the copy is through, one
+ * short transaction drops the old table and puts the shadow in its place.
+ *
+ * Progress is kept in `mb_schema_migrations`, in the same transaction as
+ * each batch, so a restart picks the copy up where it stopped.
+ * @see EntitySchema::updateTable()
+ */
+
+#ifndef MANTISBASE_SCHEMA_MIGRATIONS_H
+#define MANTISBASE_SCHEMA_MIGRATIONS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <nlohmann/json.hpp>
+
+namespace mb {
+    /**
+     * @brief Runs online migrations, one batch at a time.
+     *
+     * Columns are carried over by name: removed fields are left behind and
+     * added ones take their default. Renames aren't supported online.
+     * Writes to the entity keep going to the old table until the swap, and
+     * a write the new schema rejects (say, one breaking a unique constraint
+     * being added) fails while the migration runs.
+     *
+     * @code
+     * // PATCH /api/v1/schemas/posts?online=true
+     * auto status = app.schemaMigrations().begin(table_id, new_schema);
+     * // GET /api/v1/schemas/posts/migration
+     * auto progress = SchemaMigrations::status(table_id); // {"state": "copying", "copied": 120000, ...}
+     * @endcode
+     */
+    class SchemaMigrations {
+    public:
+        struct Options {
+            std::size_t batch = 1000;               ///> Rows copied per transaction
+            std::chrono::milliseconds pause{50};    ///> Between batches, to leave room for other writes
+            std::chrono::seconds poll{10};          ///> How often new migrations are looked for without a notify
+
+            /// @brief Read MB_MIGRATION_BATCH and MB_MIGRATION_PAUSE_MS.
+            static Options fromEnv();
+        };
+
+        explicit SchemaMigrations(Options options);
+        ~SchemaMigrations();
+
+        SchemaMigrations(const SchemaMigrations &) = delete;
+        SchemaMigrations &operator=(const SchemaMigrations &) = delete;
+
+        /// @brief Start the thread, which first resumes whatever an earlier run left copying.
+        void start();
+
+        /// @brief Stop the thread after the current batch. Idempotent.
+        void stop();
+
+        /**
+         * @brief Stage an online migration of entity `table_id` to `new_schema`.
+         *
+         * Creates the shadow table and the triggers feeding it, then leaves
+         * the copy to the thread.
+         * @param new_schema Same body as a regular schema update; renaming the
+         * entity or changing its type isn't supported here
+         * @return The migration's status()
+         * @throw MantisException 404 for an unknown entity, 400 for an invalid or unsupported change,
+         * 409 if the entity is already migrating or (PostgreSQL) other tables or views depend on it
+         */
+        nlohmann::json begin(const std::string &table_id, const nlohmann::json &new_schema);
+
+        /**
+         * @brief `{"entity", "state", "copied", "total", "progress", "error", "created", "updated"}`.
+         *
+         * `state` is `copying`, `done` or `failed`. `total` is the row count
+         * when the migration began, so `progress` is an estimate.
+         * @throw MantisException (404) if the entity has no migration on record
+         */
+        static nlohmann::json status(const std::string &table_id);
+
+        /// @brief True while `table_id` is copying; schema updates and drops wait for it.
+        static bool active(const std::string &table_id);
+
+        /**
+         * @brief Drop the shadow table and triggers of a running migration, or just
+         * forget a finished one.
+         * @throw MantisException (404) if the entity has no migration on record
+         */
+        void cancel(const std::string &table_id);
+
+        /// @brief Wake the thread to look for work.
+        void notify();
+
+        /**
+         * @brief Copy one batch of the oldest running migration, swapping it in after the last.
+         * Called by the thread; public for tests.
+         * @return False when nothing is left to copy
+         */
+        bool step();
+
+        [[nodiscard]] std::size_t completed() const { return m_completed.load(); }
+
+    private:
+        void loop();
+
+        /// Drop the shadow and triggers, and record `error` on the migration
+        static void fail(const std::string &table_id, const std::string &entity, const std::string &error);
+
+        const Options m_options;
+        std::atomic<std::size_t> m_completed{0};
+        std::mutex m_stepMutex;   ///> A test's step() and the thread's don't copy the same batch twice
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_cv;
+        bool m_stopping = false;
+        bool m_wake = false;
+        std::thread m_thread;
+    };
+}
+
+#endif // MANTISBASE_SCHEMA_MIGRATIONS_H
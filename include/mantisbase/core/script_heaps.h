@@ -0,0 +1,221 @@
+/**
+ * @file script_heaps.h
+ * @brief One Duktape heap per thread, all running the same scripts.
+ *
+ * A Duktape heap must only be used by one thread at a time, so hooks and
+ * script-backed routes running on the Drogon IO threads each get their own.
+ * A script is compiled once, when it is loaded; every heap runs the bytecode
+ * of that compile instead of parsing the source again. With a cache
+ * directory, the bytecode is also kept on disk, keyed by a hash of the
+ * source, so a restart with unchanged scripts skips the compile as well.
+ *
+ * reload() swaps in a new set of scripts without a restart. They are loaded
+ * on a fresh heap first, taking unchanged scripts' bytecode from the cache;
+ * only if all load cleanly do they replace the old set. Each thread then
+ * rebuilds its heap at its next checkpoint(), between requests, so a
+ * request runs on one set of scripts from start to end.
+ *
+ * Hooks and routes run under a time budget (ScriptHeaps::Budget): Duktape
+ * polls the heap's deadline every so many bytecode instructions and throws
+ * a RangeError past it, one no `try` in the script can get around.
+ * @see MantisBase::ctx(), ScriptingHooks
+ */
+
+#ifndef MANTISBASE_SCRIPT_HEAPS_H
+#define MANTISBASE_SCRIPT_HEAPS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <duktape.h>
+
+namespace mb {
+    /**
+     * @brief Lazily created per-thread heaps, initialized alike and fed the same bytecode.
+     *
+     * The first current() on a thread creates its heap, runs the init
+     * function on it (bindings: `app`, `console`, ...) and then every script
+     * loaded so far, in load order. Scripts loaded later reach a heap the
+     * next time its thread calls current().
+     *
+     * Global JS state is per heap: a value one hook stores on `globalThis`
+     * is not seen by a hook running on another thread.
+     *
+     * @code
+     * ScriptHeaps heaps([](duk_context *ctx) { registerBindings(ctx); }, dataDir / "scripts-cache");
+     * heaps.load("index.mantis.js", source);                // compiled and run here
+     * ScriptingHooks::fireOnServerStart(heaps.current());   // this thread's heap
+     * @endcode
+     */
+    class ScriptHeaps {
+    public:
+        using Init = std::function<void(duk_context *)>;
+
+        /// @brief How long one hook or route invocation may run, by name.
+        struct Budgets {
+            std::chrono::milliseconds fallback{1000};   ///> 0 for no limit
+            std::unordered_map<std::string, std::chrono::milliseconds> overrides;
+
+            /// @brief Budget for hook or route `name`.
+            [[nodiscard]] std::chrono::milliseconds of(const std::string &name) const;
+
+            /**
+             * @brief Read MB_SCRIPT_BUDGET_MS and MB_SCRIPT_BUDGETS, e.g.
+             * `beforeRecordCreate=200,onRecordsChanged=5000`. Malformed entries are skipped.
+             */
+            static Budgets fromEnv();
+        };
+
+        /// Per heap; Duktape's execution-timeout check reads it on the owning thread only
+        struct Deadline {
+            std::chrono::steady_clock::time_point at = std::chrono::steady_clock::time_point::max();
+            bool expired = false;
+        };
+
+        /**
+         * @brief Bounds the scripts run on `ctx` while it lives.
+         *
+         * Nests: an inner budget never extends the outer one, and the outer one
+         * is back in force once the inner one ends. A no-op on heaps that weren't
+         * made by a ScriptHeaps.
+         * @code
+         * ScriptHeaps::Budget budget(ctx, heaps.budgets().of("beforeRecordCreate"));
+         * const auto veto = ScriptingHooks::beforeRecordCreate(ctx, entity, record);
+         * if (budget.exceeded()) throw MantisException(503, "...");
+         * @endcode
+         */
+        class Budget {
+        public:
+            /// @param limit 0 for no limit of its own
+            Budget(duk_context *ctx, std::chrono::milliseconds limit);
+            ~Budget();
+
+            Budget(const Budget &) = delete;
+            Budget &operator=(const Budget &) = delete;
+
+            /// @brief Whether Duktape stopped a script for running past the budget.
+            [[nodiscard]] bool exceeded() const;
+
+        private:
+            Deadline *m_deadline = nullptr;
+            Deadline m_outer;
+        };
+
+        /// @param cache_dir Where compiled scripts are kept across restarts; empty to compile every time
+        explicit ScriptHeaps(Init init, std::filesystem::path cache_dir = {});
+
+        /// @param budgets What Budget limits hooks and routes to; load() itself has none
+        ScriptHeaps(Init init, std::filesystem::path cache_dir, Budgets budgets);
+        ~ScriptHeaps();
+
+        ScriptHeaps(const ScriptHeaps &) = delete;
+        ScriptHeaps &operator=(const ScriptHeaps &) = delete;
+
+        /**
+         * @brief The calling thread's heap, created and brought up to date if need be.
+         * @return nullptr if Duktape could not allocate a heap
+         */
+        [[nodiscard]] duk_context *current();
+
+        /**
+         * @brief Compile `source`, or take its bytecode from the cache, and run it on the calling
+         * thread's heap; other heaps run it too.
+         *
+         * A script that fails to compile or throws is not handed to other heaps.
+         * @param name Shown in stack traces, e.g. `index.mantis.js`
+         * @throw MantisException (500) with the JS error
+         */
+        void load(const std::string &name, const std::string &source);
+
+        /**
+         * @brief Replace every script with the ones `load_all` loads, e.g. the start script again.
+         *
+         * `load_all` runs on a fresh heap of the calling thread, and the load() calls it
+         * makes go to that heap. If one of them fails, the old scripts stay in place.
+         * Otherwise they are replaced at once: the calling thread's heap becomes the
+         * fresh one, and other threads rebuild theirs at their next checkpoint().
+         * Not to be called from a script. One reload runs at a time.
+         * @return Scripts every heap now runs
+         * @throw MantisException (500) with the first JS error, or if no heap could be made
+         */
+        std::size_t reload(const std::function<void()> &load_all);
+
+        /**
+         * @brief Rebuild the calling thread's heap if a reload() happened since it was made.
+         * Call where no script of this thread is running, such as before a request.
+         */
+        void checkpoint();
+
+        /// @brief Times reload() replaced the scripts.
+        [[nodiscard]] std::uint64_t generation() const { return m_generation.load(); }
+
+        /// @brief Heaps created so far, at most one per thread that used scripting.
+        [[nodiscard]] std::size_t size() const;
+
+        /// @brief Scripts every heap runs.
+        [[nodiscard]] std::size_t scripts() const;
+
+        /// @brief Scripts load() had to compile, i.e. that weren't in the cache.
+        [[nodiscard]] std::size_t compiles() const { return m_compiles.load(); }
+
+        [[nodiscard]] const Budgets &budgets() const { return m_budgets; }
+
+    private:
+        struct Heap {
+            Heap() = default;
+            ~Heap();
+            Heap(const Heap &) = delete;
+            Heap &operator=(const Heap &) = delete;
+
+            std::thread::id owner;
+            duk_context *ctx = nullptr;
+            std::size_t loaded = 0;   ///> Scripts run on it so far; only the owner touches this
+            std::uint64_t generation = 0; ///> The reload() its scripts come from
+            bool busy = false;        ///> Initializing or catching up; nested current() calls don't recurse
+            Deadline deadline;        ///> The heap's udata
+        };
+
+        struct Script {
+            std::string name;
+            std::string bytecode;
+        };
+
+        struct Staging;
+
+        /// A new heap owned by the calling thread, not yet initialized; nullptr if Duktape could not allocate one
+        static std::unique_ptr<Heap> makeHeap();
+
+        /// Run the scripts `heap` hasn't run yet
+        void catchUp(Heap &heap);
+
+        /// Bytecode of `source`, from the cache or compiled on `ctx` (and then cached)
+        std::string bytecodeOf(duk_context *ctx, const std::string &name, const std::string &source);
+
+        const Init m_init;
+        const std::filesystem::path m_cacheDir;
+        const Budgets m_budgets;
+        const std::uint64_t m_id;   ///> Tells a thread's cached heap of a destroyed pool from ours
+        std::atomic<std::size_t> m_compiles{0};
+
+        mutable std::mutex m_mutex;
+        std::vector<std::unique_ptr<Heap>> m_heaps;
+        std::deque<std::shared_ptr<const Script>> m_scripts;   ///> In load order; shared, as a reload replaces them
+        std::atomic<std::size_t> m_count{0};   ///> m_scripts.size(), read without the lock
+        std::atomic<std::uint64_t> m_generation{0}; ///> Bumped with m_scripts under m_mutex
+
+        std::mutex m_reloadMutex; ///> One reload() at a time
+    };
+}
+
+#endif // MANTISBASE_SCRIPT_HEAPS_H
@@ -0,0 +1,146 @@
+/**
+ * @file send_queue.h
+ * @brief Bounded per-subscriber outbound queue for realtime delivery.
+ *
+ * Each SSE session and WebSocket connection owns one SendQueue. The
+ * realtime worker only enqueues; frames are written on the subscriber's
+ * own event loop, so a slow client can't hold up delivery to the others.
+ * @see sse.h, ws.h, realtime_event.h
+ */
+
+#ifndef MANTISBASE_SEND_QUEUE_H
+#define MANTISBASE_SEND_QUEUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "realtime_event.h"
+
+namespace trantor {
+    class EventLoop;
+}
+
+namespace mb {
+    /**
+     * @brief Bounded FIFO of encoded change events drained on an executor.
+     *
+     * When the queue is full, the configured Overflow policy decides what
+     * happens to a new event:
+     * - DropOldest: discard the oldest pending event
+     * - Coalesce:   replace a pending event for the same row (falls back to DropOldest)
+     * - Disconnect: drop everything and close the subscriber
+     *
+     * With Options::batch, up to DRAIN_BATCH events pending when a drain runs
+     * are written as one `batch` frame instead of one frame each.
+     *
+     * @code
+     * auto q = std::make_shared<SendQueue>(SendQueue::Options::fromEnv(),
+     *                                      SendQueue::onLoop(loop),
+     *                                      [conn](const std::string &f) { conn->send(f); return true; },
+     *                                      [conn] { conn->forceClose(); });
+     * q->push(event, SendQueue::Frame::Ws);
+     * @endcode
+     */
+    class SendQueue : public std::enable_shared_from_this<SendQueue> {
+    public:
+        enum class Overflow { DropOldest, Coalesce, Disconnect };
+
+        /// Which encoding of the EncodedEvent this subscriber receives.
+        enum class Frame { SseEntity, SseRow, Ws };
+
+        struct Options {
+            std::size_t capacity = 256;           ///> Max pending events per subscriber
+            Overflow overflow = Overflow::DropOldest;
+            bool batch = false;                   ///> Subscriber opted into batch frames
+            WireFormat::Format format = WireFormat::Format::Json; ///> Payload encoding the subscriber asked for
+
+            /// @brief Read MB_REALTIME_QUEUE_SIZE and MB_REALTIME_OVERFLOW.
+            static Options fromEnv();
+        };
+
+        /// Counters shared by all queues of one manager.
+        struct Counters {
+            std::atomic<std::uint64_t> dropped{0};   ///> Events discarded by DropOldest
+            std::atomic<std::uint64_t> coalesced{0}; ///> Events merged into a pending one
+            std::atomic<std::uint64_t> evicted{0};   ///> Subscribers closed by Disconnect
+        };
+
+        using Task = std::function<void()>;
+        using Executor = std::function<void(Task)>;
+        /// Writes one frame; returns false once the subscriber is gone.
+        using Writer = std::function<bool(const std::string &)>;
+        using Closer = std::function<void()>;
+
+        /**
+         * @param options Capacity and overflow policy
+         * @param executor Runs drain tasks (typically on the subscriber's loop);
+         *                 if empty, frames are written inline by push()
+         * @param writer Sends a frame to the subscriber
+         * @param closer Closes the subscriber (used by Overflow::Disconnect)
+         * @param counters Optional shared metrics
+         */
+        SendQueue(Options options, Executor executor, Writer writer, Closer closer,
+                  std::shared_ptr<Counters> counters = nullptr);
+
+        /**
+         * @brief Enqueue an event and schedule a drain if none is pending.
+         * @return false if the queue is closed (subscriber gone or evicted)
+         */
+        bool push(std::shared_ptr<const EncodedEvent> event, Frame frame);
+
+        /// @brief Drop pending events and refuse further pushes.
+        void close();
+
+        [[nodiscard]] bool isClosed() const;
+
+        /// @brief Number of pending events.
+        [[nodiscard]] std::size_t depth() const;
+
+        /// @brief Executor that queues tasks on `loop`; runs inline when `loop` is null.
+        static Executor onLoop(trantor::EventLoop *loop);
+
+        static Overflow parseOverflow(const std::string &name, Overflow fallback = Overflow::DropOldest);
+        static std::string overflowName(Overflow overflow);
+
+    private:
+        /// Events written per drain task before yielding back to the loop.
+        static constexpr std::size_t DRAIN_BATCH = 64;
+
+        struct Item {
+            std::shared_ptr<const EncodedEvent> event;
+            Frame frame;
+        };
+
+        void schedule();
+        void drain();
+        void drainBatch();
+        const std::string &encode(const Item &item) const;
+
+        /**
+         * One frame carrying several events, oldest first.
+         * SSE: `id: <newest id>`, `event: batch`, `data: [<payload>, ...]`.
+         * WS:  `{"type": "batch", "events": [<change frame>, ...]}`.
+         * In a binary format the array (SSE, base64) or object (WS) is encoded whole.
+         */
+        std::string encodeBatch(const std::vector<Item> &items) const;
+
+        Options m_options;
+        Executor m_executor;
+        Writer m_writer;
+        Closer m_closer;
+        std::shared_ptr<Counters> m_counters;
+
+        mutable std::mutex m_mutex;
+        std::deque<Item> m_items;
+        bool m_scheduled = false;
+        bool m_closed = false;
+    };
+}
+
+#endif // MANTISBASE_SEND_QUEUE_H
@@ -0,0 +1,98 @@
+/**
+ * @file server_timing.h
+ * @brief Per-request timing breakdown returned in a `Server-Timing` header.
+ *
+ * A request that sends `X-Server-Timing: 1` gets a ServerTiming for the
+ * thread running its middleware chain. Spans along the way (auth, hydration,
+ * access rules, DB leases, serialization) add to it; with no timing active a
+ * span costs one thread-local read.
+ * @see Router::executeMiddlewareChain()
+ */
+
+#ifndef MANTISBASE_SERVER_TIMING_H
+#define MANTISBASE_SERVER_TIMING_H
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mb {
+    /**
+     * @brief Durations of one request's phases, summed by name.
+     *
+     * @code
+     * {
+     *     const ServerTiming::Span span("rules");
+     *     // ... evaluate the rule
+     * }
+     * @endcode
+     */
+    class ServerTiming {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        /// Who may ask for the header
+        enum class Mode {
+            Off,   ///> Never sent
+            Admin, ///> Sent to admins that ask for it (default)
+            All    ///> Sent to anyone that asks for it
+        };
+
+        /// Request header that asks for a `Server-Timing` response header
+        static constexpr auto REQUEST_HEADER = "X-Server-Timing";
+
+        /// @brief Read MB_SERVER_TIMING: `off`, `admin` or `all`.
+        static Mode modeFromEnv();
+
+        /// @brief The timing being recorded on this thread, or nullptr.
+        static ServerTiming *current();
+
+        /// @brief Add `duration` to the span `name`; `name` must outlive the timing (a literal).
+        void add(std::string_view name, Clock::duration duration);
+
+        /**
+         * @brief The header value, e.g. `auth;dur=0.021, db;dur=1.402, total;dur=2.310`.
+         * Spans are in the order first recorded; durations are milliseconds.
+         */
+        [[nodiscard]] std::string header(Clock::duration total) const;
+
+        /// @brief Makes `timing` current on this thread until destroyed; nullptr records nothing.
+        class Scope {
+        public:
+            explicit Scope(ServerTiming *timing);
+            ~Scope();
+
+            Scope(const Scope &) = delete;
+            Scope &operator=(const Scope &) = delete;
+
+        private:
+            ServerTiming *m_previous;
+        };
+
+        /// @brief Times its own lifetime into the current timing, if any.
+        class Span {
+        public:
+            explicit Span(std::string_view name);
+            ~Span();
+
+            Span(const Span &) = delete;
+            Span &operator=(const Span &) = delete;
+
+        private:
+            ServerTiming *m_timing;
+            std::string_view m_name;
+            Clock::time_point m_start;
+        };
+
+    private:
+        struct Entry {
+            std::string_view name;
+            Clock::duration duration{};
+        };
+
+        std::vector<Entry> m_entries;
+    };
+}
+
+#endif // MANTISBASE_SERVER_TIMING_H
@@ -0,0 +1,105 @@
+/**
+ * @file session_cache.h
+ * @brief In-memory cache of verified JWT sessions.
+ *
+ * Keeps the `mb_sessions` lookup off the hot path of authenticated requests.
+ */
+
+#ifndef MANTISBASE_SESSION_CACHE_H
+#define MANTISBASE_SESSION_CACHE_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace mb {
+    /**
+     * @brief Bounded, sharded cache of session states keyed by `session_id`.
+     *
+     * Valid entries live until the token expires; revoked entries are kept
+     * for a short negative TTL so replayed tokens of a logged-out session
+     * don't hit the database either. Entries are dropped explicitly on
+     * logout, refresh and revocation.
+     *
+     * A revocation can land between checking `mb_sessions` and caching the
+     * answer; putValid() never replaces a Revoked entry, and given the
+     * generation() read before the check, skips caching if anything was
+     * revoked or erased since.
+     *
+     * @code
+     * auto &cache = Auth::sessionCache();
+     * const auto seen = cache.generation(sid);
+     * if (cache.lookup(sid) == SessionCache::State::Unknown) {
+     *     // check mb_sessions, then
+     *     cache.putValid(sid, token_expiry, seen);
+     * }
+     * @endcode
+     */
+    class SessionCache {
+    public:
+        using Clock = std::chrono::system_clock;
+
+        enum class State { Unknown, Valid, Revoked };
+
+        /**
+         * @param capacity Maximum number of cached sessions across all shards
+         * @param negative_ttl How long a revoked/missing session is remembered
+         */
+        explicit SessionCache(std::size_t capacity = 50000,
+                              std::chrono::seconds negative_ttl = std::chrono::seconds(30));
+
+        /// @brief Cached state of `session_id`; expired entries read as Unknown.
+        [[nodiscard]] State lookup(const std::string &session_id);
+
+        /// @brief Revocations and erasures so far among the sessions sharing `session_id`'s shard.
+        [[nodiscard]] std::uint64_t generation(const std::string &session_id);
+
+        /**
+         * @brief Remember `session_id` as valid until `expires_at`, unless it is cached as Revoked.
+         * @param since generation() read before the session was checked; caching is
+         *        skipped if it has moved on, as the check may predate a revocation
+         */
+        void putValid(const std::string &session_id, Clock::time_point expires_at,
+                      std::optional<std::uint64_t> since = std::nullopt);
+
+        /// @brief Remember `session_id` as revoked for the negative TTL.
+        void putRevoked(const std::string &session_id);
+
+        /// @brief Forget `session_id` entirely.
+        void erase(const std::string &session_id);
+
+        /// @brief Drop all entries.
+        void clear();
+
+        /// @brief Number of cached entries, including not yet purged expired ones.
+        [[nodiscard]] std::size_t size() const;
+
+    private:
+        static constexpr std::size_t SHARD_COUNT = 16;
+
+        struct Entry {
+            State state;
+            Clock::time_point expiresAt;
+        };
+
+        struct Shard {
+            mutable std::mutex mutex;
+            std::unordered_map<std::string, Entry> entries;
+            std::uint64_t generation = 0; ///> Bumped by putRevoked() and erase()
+        };
+
+        Shard &shardFor(const std::string &session_id);
+        /// Insert or replace `entry`, making room if the shard is full; `shard.mutex` held
+        void insertLocked(Shard &shard, const std::string &session_id, Entry entry);
+
+        std::size_t m_shardCapacity;
+        std::chrono::seconds m_negativeTtl;
+        std::array<Shard, SHARD_COUNT> m_shards;
+    };
+}
+
+#endif // MANTISBASE_SESSION_CACHE_H
@@ -0,0 +1,120 @@
+/**
+ * @file session_store.h
+ * @brief Group-committed `mb_sessions` inserts and the sweep of expired ones.
+ *
+ * Issuing a token used to INSERT its session before the login answered.
+ * Sessions are queued here instead, and a background thread writes what
+ * arrives within MB_SESSION_FLUSH_MS as one transaction. Until then this
+ * node knows the session from the queue (and the SessionCache), so the
+ * token verifies at once; other nodes see it once the group commits.
+ * The same thread deletes expired sessions in bounded chunks, so the table
+ * stops growing with every login ever made.
+ * @see Auth, SessionCache
+ */
+
+#ifndef MANTISBASE_SESSION_STORE_H
+#define MANTISBASE_SESSION_STORE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace mb {
+    /**
+     * @brief Writes queued sessions in groups and sweeps expired ones.
+     *
+     * Before start(), and after stop(), add() writes right away, as the
+     * CLI and tests expect.
+     *
+     * @code
+     * app.sessionStore().add({session_id, "users", user_id, sha256Hex(token), expires_at, now});
+     * if (app.sessionStore().pending(session_id)) { ... not in mb_sessions yet, but valid ... }
+     * @endcode
+     */
+    class SessionStore {
+    public:
+        struct Options {
+            std::chrono::milliseconds flushInterval{20}; ///> How long a group waits for more sessions
+            std::size_t maxGroup = 256;                  ///> Sessions written per transaction
+            std::chrono::seconds sweepInterval{300};     ///> 0 turns the sweep off
+            std::size_t sweepBatch = 500;                ///> Expired rows deleted per statement
+
+            /// @brief Read MB_SESSION_FLUSH_MS, MB_SESSION_SWEEP_INTERVAL (seconds, `0` for off) and MB_SESSION_SWEEP_BATCH.
+            static Options fromEnv();
+        };
+
+        /// A row of `mb_sessions`; timestamps as getCurrentTimestampUTC() writes them
+        struct Session {
+            std::string id;
+            std::string entityName;
+            std::string userId;
+            std::string tokenHash;
+            std::string expiresAt;
+            std::string created;
+        };
+
+        explicit SessionStore(Options options);
+        ~SessionStore();
+
+        SessionStore(const SessionStore &) = delete;
+        SessionStore &operator=(const SessionStore &) = delete;
+
+        /// @brief Start the thread.
+        void start();
+
+        /// @brief Write what is queued, then stop the thread. Idempotent.
+        void stop();
+
+        /// @brief Queue `session` for the next group, or write it now if the thread isn't running.
+        void add(Session session);
+
+        /// @brief True if `session_id` was added but isn't committed yet.
+        [[nodiscard]] bool pending(const std::string &session_id) const;
+
+        /**
+         * @brief Drop `session_id` from the queue, for a logout that beat its write.
+         *
+         * Waits out a group already being written, so a DELETE issued after
+         * this returns can't be undone by a late INSERT.
+         * @return True if it was still queued and will not be written
+         */
+        bool cancel(const std::string &session_id);
+
+        /// @brief Write everything queued now. Called by the thread; public for tests.
+        /// @return Sessions written
+        std::size_t flush();
+
+        /// @brief Delete expired sessions, `sweepBatch` rows per statement. Public for tests.
+        /// @return Rows deleted
+        std::size_t sweep();
+
+        [[nodiscard]] std::size_t written() const { return m_written.load(); }
+        [[nodiscard]] std::size_t swept() const { return m_swept.load(); }
+
+    private:
+        void loop();
+
+        /// Write one group; failed groups go back to the queue
+        std::size_t writeGroup(std::vector<Session> &group);
+
+        const Options m_options;
+        std::atomic<std::size_t> m_written{0}, m_swept{0};
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_cv;         ///> Wakes the thread when a group fills up
+        std::condition_variable m_flushed;    ///> Signals the end of a group being written
+        std::unordered_map<std::string, Session> m_queue;
+        std::unordered_map<std::string, Session> m_writing; ///> The group being written
+        bool m_running = false;
+        bool m_stopping = false;
+        std::thread m_thread;
+    };
+}
+
+#endif // MANTISBASE_SESSION_STORE_H
@@ -0,0 +1,77 @@
+/**
+ * @file shared_state.h
+ * @brief State that several nodes behind one load balancer have to agree on.
+ *
+ * Off by default: a single node keeps rate limits and session revocations in
+ * process. With `MB_SHARED_STATE=db` on PostgreSQL, rate limit TATs live in
+ * `mb_rate_limits`, and revocations and ephemeral channel messages (see
+ * Channels) are broadcast on NOTIFY channels that the realtime worker of
+ * every node listens on. Realtime change events need
+ * nothing extra: the change triggers NOTIFY every node already.
+ * @see RateLimiter, SessionCache, RtDbWorker
+ */
+
+#ifndef MANTISBASE_SHARED_STATE_H
+#define MANTISBASE_SHARED_STATE_H
+
+#include <string>
+#include <string_view>
+
+#include "rate_limiter.h"
+
+namespace mb {
+    class MantisBase;
+
+    /**
+     * @brief GCRA state in the `mb_rate_limits` table (PostgreSQL).
+     *
+     * One statement per request: the TAT is read, checked and advanced in a
+     * single upsert, on the database's clock.
+     */
+    class DbRateLimitStore : public RateLimitStore {
+    public:
+        explicit DbRateLimitStore(const MantisBase &app);
+
+        std::optional<Step> step(const std::string &key, std::int64_t interval, std::int64_t tolerance) override;
+
+        void evictIdle() override;
+
+    private:
+        const MantisBase &mApp;
+    };
+
+    /**
+     * @brief Wires the shared backends in at startup and broadcasts to the other nodes.
+     *
+     * @code
+     * SharedState::init(app);   // before the router listens
+     * Auth::deleteSession(sid); // publishRevocation(sid) reaches every node
+     * @endcode
+     */
+    class SharedState {
+    public:
+        /// NOTIFY channel a revoked `session_id` is published on
+        static constexpr std::string_view REVOCATION_CHANNEL = "mb_session_revoked";
+
+        struct Options {
+            bool database = false;   ///> `MB_SHARED_STATE=db`
+
+            /// @brief Read MB_SHARED_STATE (`local`, the default, or `db`).
+            static Options fromEnv();
+        };
+
+        /**
+         * @brief Create `mb_rate_limits` and install DbRateLimitStore if the options ask for it.
+         * @return Whether shared state is on; SQLite stays local, with a warning
+         */
+        static bool init(const MantisBase &app, const Options &options = Options::fromEnv());
+
+        /// @brief Whether init() turned shared state on.
+        [[nodiscard]] static bool enabled();
+
+        /// @brief Tell the other nodes to drop `session_id` from their SessionCache. No-op when local.
+        static void publishRevocation(const std::string &session_id);
+    };
+}
+
+#endif // MANTISBASE_SHARED_STATE_H
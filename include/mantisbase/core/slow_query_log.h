@@ -0,0 +1,150 @@
+/**
+ * @file slow_query_log.h
+ * @brief Statements slower than MB_SLOW_QUERY_MS, with their plans, in the log database.
+ *
+ * SQLite statements are timed by the connection's profile hook, exactly,
+ * from first step to done. PostgreSQL and MySQL statements are timed by
+ * the SOCI logger, from one statement's start to the next one's or to the
+ * session's release, so the time spent reading rows is in it. A slow
+ * statement is written to `mb_slow_queries` in `mantis_logs.db` with its
+ * normalized text, the shapes of its bound values, its duration and, for
+ * SQLite writes, the rows it changed. A background thread runs `EXPLAIN`
+ * for it first, once per fingerprint every few minutes, and the entry
+ * carries the plan when it did.
+ * `GET /api/v1/sys/slow-queries` sums them up by fingerprint.
+ * @see MantisLoggerImpl, LogDatabase::slowQueries()
+ */
+
+#ifndef MANTISBASE_SLOW_QUERY_LOG_H
+#define MANTISBASE_SLOW_QUERY_LOG_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace mb {
+    /**
+     * @brief Times statements and hands the slow ones to a writer thread.
+     *
+     * The static hooks cost a thread-local check until start(), and keep
+     * costing little after: only a statement over the threshold is copied.
+     *
+     * @code
+     * SlowQueryLog log(options, [&](const std::string &sql) { return db.explain(sql); },
+     *                  [&](const json &entry) { logs.insertSlowQuery(entry); });
+     * log.start();
+     * SlowQueryLog::statement("SELECT * FROM posts WHERE id = :id"); // MantisLoggerImpl
+     * SlowQueryLog::endStatement(); // the session's release
+     * @endcode
+     */
+    class SlowQueryLog {
+    public:
+        using Clock = std::chrono::steady_clock;
+        /// Plan of a statement, as a JSON array of plan rows
+        using Explain = std::function<nlohmann::json(const std::string &sql)>;
+        /// Write one entry to the log database
+        using Store = std::function<void(const nlohmann::json &entry)>;
+
+        struct Options {
+            std::chrono::milliseconds threshold{500}; ///> 0 turns the log off
+            bool explain = true;                      ///> Capture plans
+            std::chrono::seconds explainEvery{300};   ///> A fingerprint's plan is reused for this long
+            std::size_t queue = 256;                  ///> Slow statements waiting; more are dropped
+
+            /// @brief Read MB_SLOW_QUERY_MS and MB_SLOW_QUERY_EXPLAIN.
+            static Options fromEnv();
+        };
+
+        /// One statement over the threshold
+        struct Sample {
+            std::string sql;
+            std::vector<std::string> params; ///> Shapes, see shapeOf()
+            std::chrono::nanoseconds duration{0};
+            std::optional<long long> rows;   ///> Rows changed, where the backend tells
+        };
+
+        SlowQueryLog(Options options, Explain explain, Store store);
+        ~SlowQueryLog();
+
+        SlowQueryLog(const SlowQueryLog &) = delete;
+        SlowQueryLog &operator=(const SlowQueryLog &) = delete;
+
+        /// @brief Start the writer and make this the log the hooks record into. No-op if the threshold is 0.
+        void start();
+
+        /// @brief Stop recording, write what is queued, and join the writer. Idempotent.
+        void stop();
+
+        /// @brief True if a statement that took `duration` goes in the log.
+        static bool slow(std::chrono::nanoseconds duration);
+
+        /// @brief Queue a slow statement; dropped if the queue is full or this is the writer thread.
+        static void record(Sample sample);
+
+        /// @brief A timed statement starts on this thread, ending the previous one.
+        static void statement(std::string_view sql);
+
+        /// @brief End this thread's timed statement, if any, and record it if it was slow.
+        static void endStatement();
+
+        /// @brief A value bound to the statement about to run, as SOCI formats it.
+        static void parameter(std::string_view value);
+
+        /// @brief The statement about to run binds a new set of values.
+        static void clearParameters();
+
+        /// @brief Bound values of the statement about to run, as shapes.
+        static std::vector<std::string> parameters();
+
+        /**
+         * @brief `sql` with literals and placeholders replaced by `?` and runs of blanks by one space.
+         *
+         * Lists of values, e.g. `IN (?, ?, ?)`, become `(?+)`, so their
+         * length doesn't make a new fingerprint.
+         */
+        static std::string normalize(std::string_view sql);
+
+        /// @brief Stable 16-digit hex hash of normalize()'s result.
+        static std::string fingerprint(std::string_view normalized);
+
+        /// @brief `null`, `int`, `real` or `text(<length>)` for a value as SOCI formats it.
+        static std::string shapeOf(std::string_view value);
+
+        /// @brief True for the statements that can be explained: SELECT, WITH, INSERT, UPDATE, DELETE.
+        static bool explainable(std::string_view sql);
+
+        /// @brief Slow statements dropped on a full queue.
+        [[nodiscard]] std::size_t dropped() const;
+
+        const Options &options() const { return m_options; }
+
+    private:
+        void push(Sample sample);
+        void loop();
+        void write(const Sample &sample, std::chrono::system_clock::time_point at);
+
+        const Options m_options;
+        const Explain m_explain;
+        const Store m_store;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_cv;
+        std::deque<std::pair<Sample, std::chrono::system_clock::time_point>> m_queue;
+        std::size_t m_dropped = 0;
+        bool m_stopping = false;
+        std::thread m_thread;
+        std::unordered_map<std::string, Clock::time_point> m_explained; ///> Fingerprint -> last plan; writer thread only
+    };
+}
+
+#endif // MANTISBASE_SLOW_QUERY_LOG_H
@@ -0,0 +1,145 @@
+/**
+ * @file sqlite_change_hooks.h
+ * @brief SQLite change capture from connection hooks instead of triggers.
+ *
+ * The change triggers build `json_object(...)` of every column inside the
+ * write and insert it into `mb_change_log`, which the realtime worker then
+ * reads back and parses. With MB_SQLITE_CAPTURE=hooks the entity tables get
+ * no triggers; a preupdate hook on each writable connection copies the
+ * changed row's columns, as typed values, into a per-connection buffer. A
+ * rollback drops the buffer, and once a commit is in the WAL its rows go to
+ * the ChangeJournal as change events, written nowhere.
+ *
+ * Nothing reaches `mb_change_log`, so writes from other processes go unseen
+ * and whatever reads the log keeps the triggers: a replication primary or
+ * follower and delta sync. Needs SQLite built with SQLITE_ENABLE_PREUPDATE_HOOK.
+ * @see change_journal.h, realtime.h
+ */
+
+#ifndef MANTISBASE_SQLITE_CHANGE_HOOKS_H
+#define MANTISBASE_SQLITE_CHANGE_HOOKS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace soci {
+    class session;
+}
+
+namespace mb {
+    using json = nlohmann::json;
+
+    class WalCheckpointer;
+
+    /**
+     * @brief Captures committed row changes of entity tables on the connections it is attached to.
+     *
+     * Tables are captured once describe()d, from the next change on. An
+     * attached connection's WAL hook belongs to it; pass the checkpointer the
+     * hook would otherwise report to, or none to keep `wal_autocheckpoint`
+     * working. Thread-safe, though each connection's
+     * buffer is only touched by the thread using the connection.
+     *
+     * @code
+     * SqliteChangeHooks hooks([&](json events) { rt.publishCaptured(std::move(events)); });
+     * hooks.attach(sql, checkpointer);
+     * hooks.describe("posts", SqliteChangeHooks::Layout{{"id", "created", "updated", "title"}, {}, 0});
+     * @endcode
+     */
+    class SqliteChangeHooks {
+    public:
+        /// A column value as the preupdate hook reads it; blobs and NULLs are empty
+        using Value = std::variant<std::monostate, std::int64_t, double, std::string>;
+
+        /// Receives each commit's changes, ChangeJournal::makeEvent() objects in write order
+        using Publish = std::function<void(json events)>;
+
+        /// An entity table's columns in table order, as the hook numbers them
+        struct Layout {
+            std::vector<std::string> columns;
+            std::vector<bool> skip; ///> Left out of events, as the triggers leave blob fields out; may be empty
+            std::size_t id = 0;     ///> Index of `id` in `columns`
+        };
+
+        /// One changed row, as buffered until its commit
+        struct RowImage {
+            int op = 0;                            ///> SQLITE_INSERT, SQLITE_UPDATE or SQLITE_DELETE
+            std::string entity;
+            std::shared_ptr<const Layout> layout;  ///> As described when the row changed
+            std::vector<Value> before, after;      ///> Empty for an insert and a delete respectively
+        };
+
+        /// @brief SQLite here was built with the preupdate hook.
+        static bool available();
+
+        /**
+         * @brief MB_SQLITE_CAPTURE=hooks, the hook is available(), and neither
+         * replication nor delta sync needs the change log. Read once.
+         */
+        static bool enabled();
+
+        explicit SqliteChangeHooks(Publish publish);
+        ~SqliteChangeHooks();
+
+        SqliteChangeHooks(const SqliteChangeHooks &) = delete;
+        SqliteChangeHooks &operator=(const SqliteChangeHooks &) = delete;
+
+        /**
+         * @brief Install the preupdate, commit, rollback and WAL hooks on `sql`.
+         * @param checkpointer Told each commit's WAL size, as its own WAL hook would be; if null, the
+         * connection checkpoints at its `wal_autocheckpoint` as SQLite's default hook does
+         */
+        void attach(soci::session &sql, WalCheckpointer *checkpointer = nullptr);
+
+        /// @brief Capture `table` with `layout`, replacing any earlier one.
+        void describe(const std::string &table, Layout layout);
+
+        /// @brief Stop capturing `table`, e.g. once it is dropped.
+        void forget(const std::string &table);
+
+        /**
+         * @brief Leave changes to `table` made on `sql` uncaptured until its
+         * transaction ends or unmute(), as an import without realtime drops
+         * the triggers for the length of its transaction.
+         */
+        static void mute(soci::session &sql, const std::string &table);
+
+        static void unmute(soci::session &sql, const std::string &table);
+
+        /// @brief Rows buffered on `sql` so far, for rewind() after a `ROLLBACK TO`.
+        static std::size_t mark(soci::session &sql);
+
+        /// @brief Drop the rows buffered on `sql` since `mark`; a savepoint was rolled back.
+        static void rewind(soci::session &sql, std::size_t mark);
+
+        /// @brief The event the triggers would have logged for `row`.
+        static json toEvent(const RowImage &row);
+
+    private:
+        struct Connection;
+
+        [[nodiscard]] std::shared_ptr<const Layout> layoutOf(const std::string &table) const;
+
+        static Connection *find(soci::session &sql);
+
+        Publish m_publish;
+
+        mutable std::shared_mutex m_layoutsMutex;
+        std::unordered_map<std::string, std::shared_ptr<const Layout>> m_layouts;
+
+        std::mutex m_connectionsMutex;
+        std::vector<std::unique_ptr<Connection>> m_connections;
+    };
+}
+
+#endif // MANTISBASE_SQLITE_CHANGE_HOOKS_H
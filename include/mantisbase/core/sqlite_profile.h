@@ -0,0 +1,81 @@
+/**
+ * @file sqlite_profile.h
+ * @brief Per-connection SQLite tuning: mmap, page cache, temp store, busy timeout.
+ *
+ * The profile lives in the `mb_store` key-value table (key `sqlite_profile`)
+ * and is applied by Database to every pooled connection, and to the writer in
+ * single-writer mode. `MB_SQLITE_PROFILE` (a preset name or a JSON object)
+ * overrides the stored value at startup. Changing it at runtime through
+ * `PATCH /api/v1/sys/settings/sqlite` re-applies it to each connection on
+ * its next lease.
+ * @see database.h
+ */
+
+#ifndef MANTISBASE_SQLITE_PROFILE_H
+#define MANTISBASE_SQLITE_PROFILE_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace mb {
+    using json = nlohmann::json;
+
+    /**
+     * @brief PRAGMA values applied to each SQLite connection.
+     *
+     * Presets:
+     * - `default`     : SQLite's own defaults plus the 30 s busy timeout
+     * - `read-heavy`  : 256 MiB mmap, 32 MiB cache per connection, in-memory temp store
+     * - `write-heavy` : 64 MiB mmap, 16 MiB cache, in-memory temp store, 60 s busy timeout
+     *
+     * `page_size` only takes effect when the database file is created.
+     *
+     * @code
+     * auto p = SqliteProfile::fromJson({{"preset", "read-heavy"}, {"cache_size", -65536}});
+     * for (const auto &pragma: p.pragmas()) sql << pragma;
+     * @endcode
+     */
+    struct SqliteProfile {
+        std::string name = "default";   ///> Preset the values started from
+        std::int64_t mmapSize = 0;      ///> PRAGMA mmap_size, in bytes; 0 disables memory mapping
+        int cacheSize = -2000;          ///> PRAGMA cache_size; negative is KiB, positive is pages
+        int tempStore = 0;              ///> PRAGMA temp_store: 0 default, 1 file, 2 memory
+        int busyTimeoutMs = 30000;      ///> PRAGMA busy_timeout
+        int pageSize = 4096;            ///> PRAGMA page_size, for new databases
+
+        /// @brief Names of the built-in presets.
+        static const std::vector<std::string> &presetNames();
+
+        /// @brief The built-in preset `name`, or std::nullopt if there is none.
+        static std::optional<SqliteProfile> preset(std::string_view name);
+
+        /**
+         * @brief Parse a preset name, or an object of a `preset` plus overrides.
+         *
+         * Override keys are `mmap_size`, `cache_size`, `temp_store`
+         * (`default`, `file` or `memory`), `busy_timeout` and `page_size`.
+         * @throws MantisException (400) on an unknown preset, key or out-of-range value
+         */
+        static SqliteProfile fromJson(const json &value);
+
+        /// @brief Profile from MB_SQLITE_PROFILE, or std::nullopt when unset.
+        static std::optional<SqliteProfile> fromEnv();
+
+        /// @brief Object form, accepted back by fromJson().
+        [[nodiscard]] json toJson() const;
+
+        /// @brief Statements to run on every connection, in order.
+        [[nodiscard]] std::vector<std::string> pragmas() const;
+
+        /// @brief The `PRAGMA page_size`, to run on the first connection before any table exists.
+        [[nodiscard]] std::string pageSizePragma() const;
+
+        bool operator==(const SqliteProfile &) const = default;
+    };
+}
+
+#endif // MANTISBASE_SQLITE_PROFILE_H
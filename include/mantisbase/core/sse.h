@@ -5,27 +5,47 @@
  * Exposes GET and POST /api/v1/realtime:
  * - **GET /api/v1/realtime?topics=...** — Opens an SSE connection with a comma-separated
  *   list of topics (entity names or entity:row_id). Returns a session (client_id) and
- *   streams events: connected, ping, change (insert/update/delete).
+ *   streams events: connected, ping, change (insert/update/delete), reset. A
+ *   `Last-Event-ID` header (or `last_event_id` query param) replays missed changes,
+ *   and `snapshot=true` sends the topics' current rows first (see realtime_snapshot.h).
  * - **POST /api/v1/realtime** — Updates topics for an existing session (JSON body:
  *   client_id, topics). Clearing topics disconnects the SSE session.
  *
  * Change events are driven by realtime.h (SQLite/PostgreSQL). Access control uses
- * entity list/get rules for the requested topics.
+ * entity list/get rules for the requested topics. Keepalive pings and idle reaping
+ * run on each session's own IO loop, from a timing wheel per loop.
  * @see realtime.h
  */
 
 #ifndef MANTISBASE_SSE_H
 #define MANTISBASE_SSE_H
 
+#include <chrono>
 #include <functional>
 #include <mutex>
+#include <optional>
 #include <set>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <nlohmann/json.hpp>
 #include <drogon/HttpResponse.h>
 
 #include "realtime.h"
+#include "realtime_event.h"
+#include "send_queue.h"
+#include "realtime_access.h"
+#include "replay_buffer.h"
+#include "change_coalescer.h"
+#include "topic_filter.h"
+#include "topic_index.h"
+#include "channels.h"
+#include "realtime_snapshot.h"
+#include "stream_limits.h"
+
+namespace trantor {
+    class TimingWheel;
+}
 
 namespace mb {
     using json = nlohmann::json;
@@ -34,30 +54,53 @@ namespace mb {
     /** Per-client SSE session: holds subscribed topics and a Drogon async stream for zero-thread event delivery. */
     class SSESession {
         std::string m_clientID;
-        std::set<std::string> m_topics;
+        std::vector<TopicId> m_topics; ///> Ids in SSEMgr's topic index
         drogon::ResponseStreamPtr m_stream;
+        std::mutex m_streamMutex;
         mutable std::mutex m_topicsMutex;
+        std::shared_ptr<SendQueue> m_queue;
+        std::shared_ptr<const RealtimeAuth> m_authCtx;
+        mutable std::mutex m_authMutex;
+        EncodedEvent::FieldSet m_fields;
+        std::shared_ptr<StreamLimits::Ticket> m_ticket; ///> Under m_streamMutex; dropped on close()
 
         std::atomic<bool> m_isActive;
-        std::chrono::steady_clock::time_point m_lastActivity;
+        std::atomic<std::chrono::steady_clock::time_point> m_lastActivity;
 
     public:
         SSESession(std::string client_id,
-                   const std::set<std::string> &topics,
                    drogon::ResponseStreamPtr stream);
 
         /** Send an SSE-formatted event through the async stream. Returns false if stream is closed. */
         bool sendEvent(const std::string &eventType, const json &data);
 
-        /** True if this session is subscribed to the topic implied by change_event. */
-        bool isInterestedIn(const json &change_event) const;
+        /** Send a frame built by buildFrame(); lets one serialized event go to many sessions. */
+        bool sendFrame(const std::string &frame);
 
-        /** Format a change event for SSE (topic, action, entity, row_id, data, timestamp). */
-        json formatEvent(const json &change_event) const;
+        /** Attach the outbound queue that enqueue() feeds; set once by SSEMgr::createSession(). */
+        void attachQueue(std::shared_ptr<SendQueue> queue);
 
-        void updateActivity();
+        /** Row fields change payloads are cut down to (see EncodedEvent::project()); set before the session is shared. */
+        void setFields(EncodedEvent::FieldSet fields);
+
+        /** Queue a change event for delivery on the session's loop; sends inline if no queue is attached. */
+        bool enqueue(const std::shared_ptr<const EncodedEvent> &event, SendQueue::Frame frame);
+
+        /** Number of change events waiting in the outbound queue. */
+        std::size_t queueDepth() const;
+
+        /** Auth context change events are filtered against; guest until set. */
+        std::shared_ptr<const RealtimeAuth> authContext() const;
+
+        void setAuthContext(std::shared_ptr<const RealtimeAuth> auth);
+
+        /** Hold the session's StreamLimits ticket until close(). */
+        void holdTicket(std::shared_ptr<StreamLimits::Ticket> ticket);
 
-        void updateTopics(const std::set<std::string> &topics);
+        /** Build the `event: ...\ndata: ...\n\n` wire frame for an event. Change events use EncodedEvent::sse(). */
+        static std::string buildFrame(const std::string &eventType, const json &data);
+
+        void updateActivity();
 
         std::chrono::steady_clock::time_point getLastActivity() const;
 
@@ -68,44 +111,164 @@ namespace mb {
 
         const std::string &getClientID() const;
 
-        std::set<std::string> getTopics() const;
+        /** Ids of the subscribed topics; names are kept by SSEMgr. */
+        std::vector<TopicId> getTopics() const;
+
+        void setTopics(std::vector<TopicId> topics);
 
-        void setTopics(const std::set<std::string> &topics);
+        bool hasTopics() const;
     };
 
     /** Manages SSE sessions, WebSocket connections, routes realtime change events, and registers GET/POST /api/v1/realtime. */
     class SSEMgr {
         std::unordered_map<std::string, std::shared_ptr<SSESession>> m_sessions;
+        /// Topic -> subscribed sessions; kept in step with m_sessions under m_sessions_mutex.
+        TopicIndex<std::shared_ptr<SSESession>> m_topics;
+        TopicFilters m_filters; ///> The `entity?<filter>` topics of m_topics, under m_sessions_mutex
         std::mutex m_sessions_mutex;
-        std::condition_variable m_cv;
-        std::thread m_cleanup_thread;
         std::atomic<bool> m_running{true};
+        ReplayBuffer m_replay;
+        ChangeCoalescer m_coalescer;        ///> Guarded by m_coalesceMutex
+        std::mutex m_coalesceMutex;
+        std::condition_variable m_coalesceCv;
+        std::thread m_coalesce_thread;
         std::unique_ptr<WSMgr> m_wsMgr;
+        SendQueue::Options m_queueOptions;
+        std::shared_ptr<SendQueue::Counters> m_queueCounters;
+        RealtimeSnapshot::Options m_snapshotOptions;
+        std::unique_ptr<StreamLimits> m_limits; ///> Per-IP and per-user caps, shared with WS connections
         const MantisBase& m_app;
 
+        struct Keepalive;
+        std::shared_ptr<Keepalive> m_keepalive; ///> Timing wheels per IO loop, outliving this manager in their callbacks
+
     public:
+        struct KeepaliveOptions {
+            std::chrono::seconds ping{60};  ///> Quiet time before a session is sent a `ping`
+            std::chrono::seconds idle{600}; ///> Time without any frame sent before a session is dropped
+
+            /// @brief Read MB_REALTIME_PING_SECS and MB_REALTIME_IDLE_SECS.
+            static KeepaliveOptions fromEnv();
+        };
+
+        /** A retained change a resuming subscriber may read; `rowTopic` selects the `get` rule and row frame. */
+        struct ReplayItem {
+            std::shared_ptr<const EncodedEvent> event;
+            bool rowTopic;
+        };
+
+        struct Replay {
+            std::uint64_t upto;             ///> Newest event id the subscriber is caught up to after replay
+            std::vector<ReplayItem> items;
+        };
+
         explicit SSEMgr(const MantisBase&);
         ~SSEMgr();
 
         /** Register GET and POST /api/v1/realtime routes. */
         void createRoutes();
-        /** Create a new SSE session with the given topics and stream; returns client_id. */
+        /**
+         * Create a new SSE session with the given topics, stream and subscriber auth context,
+         * and send its `connected` event; returns client_id. With `resume_from`, changes after
+         * that event id are queued first, or a `reset` event is sent if they are no longer retained.
+         * `batch` opts the session into `batch` frames (see SendQueue::Options::batch), and a
+         * non-empty `fields` limits change payloads to those row fields. A binary `format`
+         * sends change payloads base64 encoded in their `data:`; other events stay JSON.
+         * A `snapshot` (see takeSnapshot()) is sent as `snapshot` events in place of a
+         * resume, followed by the changes after it that its rows don't already show.
+         * The `ticket` from limits() is held by the session, and closes it if evicted.
+         */
         std::string createSession(const std::set<std::string> &initial_topics,
-                                  drogon::ResponseStreamPtr stream);
+                                  drogon::ResponseStreamPtr stream,
+                                  std::shared_ptr<const RealtimeAuth> auth = nullptr,
+                                  std::optional<std::uint64_t> resume_from = std::nullopt,
+                                  bool batch = false,
+                                  EncodedEvent::FieldSet fields = {},
+                                  WireFormat::Format format = WireFormat::Format::Json,
+                                  std::optional<RealtimeSnapshot> snapshot = std::nullopt,
+                                  std::shared_ptr<StreamLimits::Ticket> ticket = nullptr);
 
         std::shared_ptr<SSESession> fetchSession(const std::string &session_id);
         /** Remove session and close it (disconnect). */
         void removeSession(const std::string &session_id);
 
+        /**
+         * Replace a session's topics and re-index it; `auth`, if given, replaces the context
+         * events are filtered against. Returns false if the session is unknown.
+         */
+        bool updateTopics(const std::string &session_id, const std::set<std::string> &topics,
+                          std::shared_ptr<const RealtimeAuth> auth = nullptr);
+
         void updateActivity(const std::string &session_id);
         std::shared_ptr<mb::SSESession> getSession(const std::string &sessionId);
 
-        /** Push a change event to all SSE sessions and WS connections interested in its topic. */
+        /**
+         * Push a change event to all SSE sessions and WS connections interested in its topic.
+         * Recipients come from the topic index and are filtered per event against the entity
+         * `list` rule (`get` for row topics) in their auth context (see RealtimeAccess).
+         * Each frame variant is serialized once and queued outside the sessions lock.
+         * Dead sessions are reaped by keepalive() at their next tick.
+         */
         void broadcastChange(const json &change_event);
+
+        /**
+         * Queue a channel frame (see Channels) for the SSE sessions and WS connections
+         * subscribed to `topic`, without any rule check or replay id.
+         */
+        void deliverEphemeral(const std::string &topic, const std::shared_ptr<const EncodedEvent> &event);
+
         size_t getSessionCount();
 
+        /**
+         * Tell every SSE session and WS connection the server is going away, with a
+         * `reconnect` event carrying `retry_ms`, one draw of `delay` per client, and the
+         * newest `last_event_id` issued. SSE frames also set `retry:`, so EventSource waits
+         * that long and resumes with its Last-Event-ID by itself; WS connections are then
+         * closed with 1001. Returns the clients told. See Router::drain().
+         */
+        std::size_t sendReconnect(const std::function<std::chrono::milliseconds()> &delay);
+
+        /**
+         * Retained changes after `after` on `topics` that `auth` may read, oldest first.
+         * std::nullopt if the subscriber has to reload instead: the events were evicted,
+         * or more than `limit` of them match.
+         */
+        std::optional<Replay> collectReplay(std::uint64_t after, const std::set<std::string> &topics,
+                                            const RealtimeAuth &auth, std::size_t limit) const;
+
+        /**
+         * Read the current rows of `topics` on the primary, each checked against the entity
+         * `list` rule (`get` for row topics) in `auth`'s context as change events are.
+         * Channel topics and unknown entities have none.
+         * Throws MantisException (413) past MB_REALTIME_SNAPSHOT_MAX rows in all, (400) for
+         * a filter that doesn't compile.
+         */
+        RealtimeSnapshot takeSnapshot(const std::set<std::string> &topics, const RealtimeAuth &auth) const;
+
+        /**
+         * collectReplay() from the snapshot's event id, less the changes its rows already show
+         * (see RealtimeSnapshot::covered()).
+         */
+        std::optional<Replay> collectAfterSnapshot(const RealtimeSnapshot &snapshot,
+                                                   const std::set<std::string> &topics,
+                                                   const RealtimeAuth &auth, std::size_t limit) const;
+
+        /** Retention window change event ids are issued from. */
+        const ReplayBuffer &replay() const;
+
+        /**
+         * Outbound queue metrics for SSE and WS subscribers: subscriber count, total and
+         * max queue depth, dropped/coalesced events and evicted subscribers, plus the
+         * change coalescing window, pending and merged counts.
+         * Served on GET /api/v1/sys/realtime (admin only).
+         */
+        json queueStats();
+
         WSMgr &wsMgr() const;
 
+        /** Caps on the SSE sessions and WS connections one address or user holds open. */
+        StreamLimits &limits() const;
+
         void start();
         void stop();
         bool isRunning() const;
@@ -121,7 +284,28 @@ namespace mb {
 
         static std::string generateClientID();
 
-        void cleanupIdleSessions();
+        /** Parse a `Last-Event-ID` / `resume_from` value; std::nullopt if empty or not a number. */
+        static std::optional<std::uint64_t> parseEventId(const std::string &value);
+
+        std::filesystem::path replayPath() const;
+
+        /**
+         * Ping `session` if it has been quiet for a ping interval, or drop it if it is dead,
+         * idle or has no topics; then schedule its next tick. Runs on the session's loop.
+         */
+        void keepalive(trantor::TimingWheel &wheel, const std::shared_ptr<SSESession> &session);
+
+        /** The `ping` frame, built once and shared by every session. */
+        static const std::string &pingFrame();
+
+        /** Broadcast coalesced changes as their windows end; runs on m_coalesce_thread. */
+        void runCoalescer();
+
+        void indexTopicsLocked(const std::shared_ptr<SSESession> &session, const std::set<std::string> &topics);
+        void unindexTopicsLocked(const std::shared_ptr<SSESession> &session);
+
+        /// The `@<channel>` names among the session's topics; under m_sessions_mutex
+        std::set<std::string> channelsLocked(const SSESession &session) const;
     };
 }
 
@@ -0,0 +1,132 @@
+/**
+ * @file static_cache.h
+ * @brief The public directory, held in memory with its compressed variants.
+ *
+ * With MB_PUBLIC_CACHE=1, the files under `publicDir` are read at startup,
+ * up to MB_PUBLIC_CACHE_MAX_MB (default 64) of bodies and variants, and
+ * answered from memory like the admin dashboard (see AdminAssets): a
+ * content-hash ETag, `304` on `If-None-Match`, gzip/brotli/zstd variants
+ * compressed once, and long-lived `Cache-Control` for fingerprinted names.
+ * Files past the budget are still served from disk.
+ *
+ * On Linux the directory is watched with inotify. A change reloads the
+ * table, reusing every file whose size and modification time are the same,
+ * and swaps it in at once. Elsewhere changes show after a restart.
+ * @see Router::generateMiscEndpoints()
+ */
+
+#ifndef MANTISBASE_STATIC_CACHE_H
+#define MANTISBASE_STATIC_CACHE_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include <drogon/HttpRequest.h>
+#include <drogon/HttpResponse.h>
+
+#include "compression.h"
+
+namespace mb {
+    class MetricsWriter;
+
+    /**
+     * @brief Path → file table over the public directory, replaced whole on every change.
+     *
+     * @code
+     * StaticCache cache(StaticCache::Options::fromEnv(), &Router::getMimeType);
+     * cache.load(publicDir);
+     * cache.watch(publicDir);
+     * if (auto resp = cache.respond(req)) return callback(resp); // else on to disk
+     * @endcode
+     */
+    class StaticCache {
+    public:
+        /// Number of Compression::Encoding values, identity included
+        static constexpr std::size_t ENCODINGS = 4;
+
+        struct Options {
+            bool enabled = false;                 ///> MB_PUBLIC_CACHE=1
+            std::size_t maxBytes = 64 * 1024 * 1024; ///> MB_PUBLIC_CACHE_MAX_MB: bodies and variants together
+
+            static Options fromEnv();
+        };
+
+        struct Asset {
+            std::string body;
+            std::string mime;
+            std::string cacheControl;
+            /// Per Compression::Encoding; empty where there is no variant smaller than the body
+            std::array<std::string, ENCODINGS> encoded{};
+            /// Strong, per variant; identity's is the bare content hash
+            std::array<std::string, ENCODINGS> etags{};
+            std::uintmax_t size = 0;                       ///> On disk, with `mtime` to tell a file changed
+            std::filesystem::file_time_type mtime{};
+
+            [[nodiscard]] std::size_t bytes() const;
+        };
+
+        using Table = std::unordered_map<std::string, std::shared_ptr<const Asset>>;
+
+        StaticCache(Options options, std::function<std::string(const std::string &)> mime_of);
+        ~StaticCache();
+
+        StaticCache(const StaticCache &) = delete;
+        StaticCache &operator=(const StaticCache &) = delete;
+
+        [[nodiscard]] bool enabled() const { return m_options.enabled; }
+
+        /**
+         * @brief Read `dir` into a new table and swap it in.
+         * @return Files cached; the rest, over the budget, are left to disk
+         */
+        std::size_t load(const std::filesystem::path &dir);
+
+        /// @brief On Linux, load() again whenever a file under `dir` changes. No-op elsewhere.
+        void watch(const std::filesystem::path &dir);
+
+        void stop();
+
+        /// @brief The file for a request path; `/` and paths ending in `/` name their `index.html`.
+        [[nodiscard]] std::shared_ptr<const Asset> find(std::string_view path) const;
+
+        /// @brief Answer a GET or HEAD: the negotiated variant, or 304. Null if the path isn't cached.
+        [[nodiscard]] drogon::HttpResponsePtr respond(const drogon::HttpRequestPtr &req) const;
+
+        [[nodiscard]] std::size_t files() const { return m_table.load()->size(); }
+        [[nodiscard]] std::size_t bytes() const { return m_bytes.load(); }
+
+        /// @brief `mb_public_cache_files`, `mb_public_cache_bytes`, `mb_public_cache_skipped` and `mb_public_cache_reloads_total`.
+        void writeMetrics(MetricsWriter &out) const;
+
+    private:
+        /// Build one file's entry, or reuse `previous` when the file is unchanged
+        std::shared_ptr<const Asset> build(const std::filesystem::path &file, std::uintmax_t size,
+                                           std::filesystem::file_time_type mtime,
+                                           const std::shared_ptr<const Asset> &previous) const;
+
+        void loop(std::filesystem::path dir);
+
+        const Options m_options;
+        const std::function<std::string(const std::string &)> m_mimeOf;
+
+        std::atomic<std::shared_ptr<const Table>> m_table{std::make_shared<const Table>()};
+        std::atomic<std::size_t> m_bytes{0};
+        std::atomic<std::size_t> m_skipped{0};
+        std::atomic<std::uint64_t> m_reloads{0};
+        std::mutex m_loadMutex; ///> One load() at a time
+
+        std::atomic<bool> m_stopping{false};
+        std::thread m_watcher;
+    };
+}
+
+#endif // MANTISBASE_STATIC_CACHE_H
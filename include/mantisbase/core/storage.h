@@ -0,0 +1,142 @@
+/**
+ * @file storage.h
+ * @brief Where file blobs live: local disk or an S3-compatible object store.
+ *
+ * BlobStore keeps the hash-to-record mapping in the database and hands the
+ * bytes to a StorageBackend. The local backend is the default and keeps the
+ * layout described in blob_store.h. With an object store, the bytes never
+ * pass through our HTTP threads on download: file requests are redirected
+ * to a presigned URL.
+ * @see BlobStore, S3Storage
+ */
+
+#ifndef MANTISBASE_STORAGE_H
+#define MANTISBASE_STORAGE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace mb {
+    /**
+     * @brief Byte storage for content-addressed blobs.
+     *
+     * Blobs are keyed by their SHA-256 and never change once written, so
+     * implementations don't need to handle overwrites or partial updates.
+     * Calls block and may come from any thread.
+     */
+    class StorageBackend {
+    public:
+        virtual ~StorageBackend() = default;
+
+        /// @brief Short name for logs, e.g. `local` or `s3`.
+        [[nodiscard]] virtual std::string name() const = 0;
+
+        /// @brief Whether blobs are files under Files::filesBaseDir() that entity files can link to.
+        [[nodiscard]] virtual bool isLocal() const = 0;
+
+        /// @brief Whether the blob for `sha256` is stored.
+        [[nodiscard]] virtual bool hasBlob(const std::string &sha256) = 0;
+
+        /**
+         * @brief Store `file` as the blob for `sha256`; the file is consumed.
+         * @throws MantisException (500/502) if the blob couldn't be stored
+         */
+        virtual void putBlob(const std::string &sha256, const std::filesystem::path &file,
+                             const std::string &content_type) = 0;
+
+        /// @brief Remove a blob. A missing blob counts as removed.
+        /// @return false on a failure worth retrying
+        virtual bool removeBlob(const std::string &sha256) = 0;
+
+        /**
+         * @brief A time-limited URL a client can download the blob from directly.
+         * @param filename Name to report in `Content-Disposition`
+         * @param content_type Content-Type the download should carry
+         * @return The URL, or std::nullopt if this backend serves files itself
+         */
+        [[nodiscard]] virtual std::optional<std::string> presignGet(const std::string &sha256,
+                                                                    const std::string &filename,
+                                                                    const std::string &content_type) = 0;
+    };
+
+    /// @brief Blobs as files under `<files>/.blobs`, the default backend.
+    class LocalStorage final : public StorageBackend {
+    public:
+        [[nodiscard]] std::string name() const override { return "local"; }
+        [[nodiscard]] bool isLocal() const override { return true; }
+        [[nodiscard]] bool hasBlob(const std::string &sha256) override;
+        void putBlob(const std::string &sha256, const std::filesystem::path &file,
+                     const std::string &content_type) override;
+        bool removeBlob(const std::string &sha256) override;
+        [[nodiscard]] std::optional<std::string> presignGet(const std::string &, const std::string &,
+                                                            const std::string &) override {
+            return std::nullopt;
+        }
+    };
+
+    /**
+     * @brief Owns the configured backend and the queue that deletes from it.
+     *
+     * MB_STORAGE selects the backend: `local` (default) or `s3`, configured
+     * as described in S3Storage::Options. Unreferenced blobs on a remote
+     * backend are deleted by a background thread, so dropping a record never
+     * waits on the object store; a failed delete is retried with backoff.
+     * Local blobs are unlinked inline, which costs less than the hand-off.
+     */
+    class Storage {
+    public:
+        /// @brief Called for each queued hash; returns false to retry later.
+        using Remover = std::function<bool(const std::string &sha256)>;
+
+        Storage(std::unique_ptr<StorageBackend> backend, Remover remover);
+        ~Storage();
+
+        Storage(const Storage &) = delete;
+        Storage &operator=(const Storage &) = delete;
+
+        /// @brief Build the backend MB_STORAGE asks for.
+        static std::unique_ptr<StorageBackend> backendFromEnv();
+
+        [[nodiscard]] StorageBackend &backend() const { return *m_backend; }
+
+        /// @brief Remove the blob once nothing references it, in the background for remote backends.
+        void scheduleRemoval(const std::string &sha256);
+
+        /// @brief Removals queued and not yet done.
+        [[nodiscard]] std::size_t pendingRemovals() const;
+
+        /// @brief Make one last attempt at every queued removal and stop the worker.
+        void close();
+
+        static constexpr int MAX_REMOVAL_ATTEMPTS = 5;
+
+    private:
+        struct Pending {
+            std::string sha256;
+            int attempts = 0;
+            std::chrono::steady_clock::time_point due;
+        };
+
+        void run();
+
+        std::unique_ptr<StorageBackend> m_backend;
+        Remover m_remover;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_cv;
+        std::deque<Pending> m_queue;
+        bool m_stopping = false;
+        std::thread m_worker;   ///> Started on the first remote removal
+    };
+}
+
+#endif // MANTISBASE_STORAGE_H
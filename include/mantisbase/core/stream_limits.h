@@ -0,0 +1,125 @@
+/**
+ * @file stream_limits.h
+ * @brief Caps on the realtime streams one client address or user holds open.
+ *
+ * Each SSE session and WebSocket connection takes a ticket against its
+ * client address and, once signed in, its principal; the two transports
+ * share the counts. Past a cap the new stream is refused, or with the
+ * `evict_oldest` policy the key's oldest stream is closed to make room.
+ * Both are a map lookup and a list splice.
+ * @see sse.h, ws.h
+ */
+
+#ifndef MANTISBASE_STREAM_LIMITS_H
+#define MANTISBASE_STREAM_LIMITS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include <nlohmann/json.hpp>
+
+namespace mb {
+    class MetricsWriter;
+
+    using json = nlohmann::json;
+
+    /**
+     * @brief Counts open realtime streams per client address and per principal.
+     *
+     * Thread-safe. A ticket lives as long as its stream: drop it when the
+     * stream is gone. Tickets may outlive the StreamLimits.
+     *
+     * @code
+     * auto ticket = limits.acquire(req.getRemoteAddr(), auth->principal);
+     * if (!ticket) return reject(429);
+     * ticket->bind([weak] { if (auto c = weak.lock()) c->shutdown(); }); // how to close it if evicted
+     * @endcode
+     */
+    class StreamLimits {
+    public:
+        enum class Policy { Reject, EvictOldest };
+
+        struct Options {
+            std::size_t perIp = 0;   ///> Streams per client address; 0 for no cap
+            std::size_t perUser = 0; ///> Streams per signed-in principal; 0 for no cap
+            Policy policy = Policy::Reject;
+
+            /// MB_REALTIME_MAX_PER_IP, MB_REALTIME_MAX_PER_USER, MB_REALTIME_LIMIT_POLICY (`reject`, `evict_oldest`)
+            static Options fromEnv();
+
+            [[nodiscard]] bool enabled() const { return perIp > 0 || perUser > 0; }
+        };
+
+        /// The state tickets share with the StreamLimits; defined in stream_limits.cpp
+        struct State;
+
+        /// @brief One open stream, counted until it is destroyed.
+        class Ticket {
+        public:
+            Ticket(std::shared_ptr<State> state, std::string ip, std::string user);
+            ~Ticket();
+
+            Ticket(const Ticket &) = delete;
+            Ticket &operator=(const Ticket &) = delete;
+
+            /**
+             * @brief How to close the stream if a newer one evicts it; called once, on the evicting thread.
+             *
+             * Called straight away if it was evicted before it was bound.
+             */
+            void bind(std::function<void()> close);
+
+        private:
+            friend class StreamLimits;
+
+            std::shared_ptr<State> m_state;
+            const std::string m_ip, m_user; ///> Empty if not counted against that cap
+            std::list<Ticket *>::iterator m_ipPos, m_userPos;
+            std::function<void()> m_close;
+            bool m_counted = false; ///> In the lists, and in the counts
+            bool m_evicted = false; ///> Closed to admit a newer stream
+        };
+
+        /// Which cap refused a stream, for the response and the metrics
+        enum class Refusal { Ip, User };
+
+        explicit StreamLimits(Options options);
+        ~StreamLimits();
+
+        StreamLimits(const StreamLimits &) = delete;
+        StreamLimits &operator=(const StreamLimits &) = delete;
+
+        /**
+         * @brief Count a new stream of `ip` and `principal`.
+         *
+         * Under `evict_oldest`, the streams it displaces are closed here,
+         * after the counts were updated and outside any lock of ours.
+         * @param principal As RealtimeAuth::principal; `guest` isn't capped per user
+         * @param refusal Set to the cap that refused it, when the result is null
+         * @return The ticket, or null if a cap refused it; always a ticket when disabled
+         */
+        std::unique_ptr<Ticket> acquire(const std::string &ip, const std::string &principal,
+                                        Refusal *refusal = nullptr);
+
+        [[nodiscard]] const Options &options() const { return m_options; }
+
+        /// @brief `{"active", "rejected_ip", "rejected_user", "evicted", "per_ip", "per_user", "policy"}`.
+        [[nodiscard]] json stats() const;
+
+        void writeMetrics(MetricsWriter &out) const;
+
+    private:
+        const Options m_options;
+        std::shared_ptr<State> m_state;
+    };
+}
+
+#endif // MANTISBASE_STREAM_LIMITS_H
@@ -0,0 +1,166 @@
+/**
+ * @file tenants.h
+ * @brief A database per tenant, in one process.
+ *
+ * With MB_TENANTS set, each request names a tenant by its Host subdomain or a
+ * header, and the entity, schema and auth routes run against that tenant's
+ * own database: a SQLite file under `<dataDir>/tenants/`, or a schema of the
+ * PostgreSQL database. Tenant databases are opened on first use, with a small
+ * pool, and the least recently used ones are closed past MB_TENANT_MAX_OPEN.
+ * Requests naming no tenant are served by the application's own database.
+ * @see Router::runMiddlewareChain()
+ */
+
+#ifndef MANTISBASE_TENANTS_H
+#define MANTISBASE_TENANTS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <nlohmann/json.hpp>
+
+#include "auth_user_cache.h"
+#include "count_cache.h"
+#include "read_coalescer.h"
+#include "record_cache.h"
+#include "router.h"
+#include "vector_index.h"
+
+namespace mb {
+    class Database;
+    class MantisBase;
+
+    /**
+     * @brief Resolves request tenants and keeps their databases open, least recently used first out.
+     *
+     * A tenant carries everything that would otherwise mix its rows with
+     * another tenant's under the same entity name: its database, entity
+     * cache, and the count, read, vector and user caches. Writes in a tenant
+     * update those caches directly, as they aren't on the change stream.
+     * Realtime, online migrations, materialized views, the response cache
+     * and the `/api/v1/sys` routes (admins aside) stay with the application.
+     *
+     * @code
+     * // Router::runMiddlewareChain()
+     * if (const auto id = tenants.resolve(req.getHeaderValue("Host"), req.getHeaderValue(header)))
+     *     scope.emplace(tenants.acquire(*id));
+     * app.db(); // the tenant's database until the scope ends
+     * @endcode
+     */
+    class Tenants {
+    public:
+        enum class Mode { Off, Host, Header };
+
+        struct Options {
+            Mode mode = Mode::Off;
+            std::string header = "X-Tenant-Id"; ///> Header naming the tenant, in Header mode
+            std::string domain;                 ///> In Host mode, tenants are its subdomains
+            std::size_t maxOpen = 256;          ///> Tenant databases kept open
+            int poolSize = 2;                   ///> Connections per tenant database
+            bool autoCreate = false;            ///> Create a tenant's database on its first request
+
+            /// @brief Read MB_TENANTS (`host` or `header`), MB_TENANT_HEADER, MB_TENANT_DOMAIN,
+            /// MB_TENANT_MAX_OPEN, MB_TENANT_POOL_SIZE and MB_TENANT_AUTO_CREATE.
+            static Options fromEnv();
+        };
+
+        /// @brief One open tenant; held by each request scoped to it, so eviction never closes it under one.
+        struct Tenant : std::enable_shared_from_this<Tenant> {
+            explicit Tenant(std::string tenant_id);
+            ~Tenant();
+
+            /// @brief Hand `events` (ChangeJournal::makeEvent() objects) to this tenant's caches.
+            void onChanges(const nlohmann::json &events);
+
+            const std::string id;
+            std::unique_ptr<Database> db;
+            Router::EntityCache entities;
+            CountCache counts;
+            ReadCoalescer flights;
+            RecordCache records;
+            VectorIndexes vectors;
+            AuthUserCache users;
+        };
+
+        /// Sets the tenant of the calling thread, restoring the previous one on exit
+        class Scope {
+        public:
+            /// @param tenant The tenant, or nullptr for the application's own database
+            explicit Scope(std::shared_ptr<Tenant> tenant);
+            ~Scope();
+
+            Scope(const Scope &) = delete;
+            Scope &operator=(const Scope &) = delete;
+
+        private:
+            std::shared_ptr<Tenant> m_tenant;
+            Tenant *m_previous;
+        };
+
+        struct Stats {
+            std::size_t open = 0;
+            std::uint64_t opened = 0, evicted = 0;
+        };
+
+        Tenants(const MantisBase &app, Options options);
+        ~Tenants();
+
+        Tenants(const Tenants &) = delete;
+        Tenants &operator=(const Tenants &) = delete;
+
+        [[nodiscard]] bool enabled() const { return m_options.mode != Mode::Off; }
+        [[nodiscard]] const Options &options() const { return m_options; }
+
+        /**
+         * @brief The tenant a request names, from its `host` or `header` value per the mode.
+         * @return std::nullopt if it names none
+         * @throws MantisException (400) for a malformed tenant id
+         */
+        [[nodiscard]] std::optional<std::string> resolve(std::string_view host, std::string_view header) const;
+
+        /// @brief The subdomain label of `host` (port aside) under `domain`, if it is one.
+        static std::optional<std::string> subdomainOf(std::string_view host, std::string_view domain);
+
+        /// @brief 1 to 63 lowercase letters, digits and inner dashes, like a DNS label.
+        static bool isValidId(std::string_view id);
+
+        /// @brief Whether a request to `path` may be scoped to a tenant.
+        static bool servesPath(std::string_view path);
+
+        /**
+         * @brief The open tenant `id`, opening its database if it isn't.
+         * @throws MantisException (404) for a tenant without a database, unless
+         *         Options::autoCreate; (500) if its database fails to open
+         */
+        std::shared_ptr<Tenant> acquire(const std::string &id);
+
+        /// @brief Close every tenant database; requests holding one keep it until they end.
+        void closeAll();
+
+        [[nodiscard]] Stats stats() const;
+
+        /// @brief The calling thread's tenant, or nullptr outside a tenant scope.
+        static Tenant *current();
+
+    private:
+        /// Open, create if allowed, and load the entities of tenant `id`
+        std::shared_ptr<Tenant> open(const std::string &id) const;
+
+        const MantisBase &m_app;
+        Options m_options;
+
+        mutable std::mutex m_mutex;
+        std::list<std::string> m_lru; ///> Most recently used first
+        std::unordered_map<std::string, std::pair<std::shared_ptr<Tenant>, std::list<std::string>::iterator>> m_open;
+        std::uint64_t m_opened = 0, m_evicted = 0; ///> Guarded by m_mutex
+    };
+}
+
+#endif // MANTISBASE_TENANTS_H
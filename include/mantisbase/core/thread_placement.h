@@ -0,0 +1,120 @@
+/**
+ * @file thread_placement.h
+ * @brief Optional CPU affinity for the IO loops, the database workers and background threads.
+ *
+ * On multi-socket hosts the scheduler moves threads across NUMA nodes, and
+ * their memory traffic crosses the interconnect. Each CPU set below is off
+ * unless set, and leaves its threads where the kernel puts them:
+ *
+ * - `MB_CPU_IO`: Drogon's IO loops, loop `i` pinned to the set's `i`-th CPU
+ * - `MB_CPU_DB`: The `db` workers, worker `i` confined to the CPUs of the
+ *   set on its NUMA node, the nodes taken in turn
+ * - `MB_CPU_BACKGROUND`: The thread starting MantisBase, before it starts
+ *   any other, so the realtime worker, the log writer, the scheduler and
+ *   other housekeeping threads inherit it. The IO loops and `db` workers
+ *   get all CPUs back unless their own set is given.
+ *
+ * Sets are CPU lists as in `/sys/devices/system/cpu/online`: `0-7,16-23`.
+ * Each placement is exported as `mb_thread_placement`. Linux only; elsewhere
+ * the sets are read and ignored.
+ */
+
+#ifndef MANTISBASE_THREAD_PLACEMENT_H
+#define MANTISBASE_THREAD_PLACEMENT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mb {
+    class MetricsWriter;
+
+    /**
+     * @brief Pins the calling thread by its role, and keeps what was pinned where.
+     *
+     * @code
+     * ThreadPlacement::instance().pin(ThreadPlacement::Role::Io, loop_index);
+     * @endcode
+     */
+    class ThreadPlacement {
+    public:
+        enum class Role { Io, Db, Background };
+
+        using CpuSet = std::vector<int>;
+
+        struct Options {
+            CpuSet io;         ///> MB_CPU_IO
+            CpuSet db;         ///> MB_CPU_DB
+            CpuSet background; ///> MB_CPU_BACKGROUND
+
+            /// @brief Read MB_CPU_IO, MB_CPU_DB and MB_CPU_BACKGROUND; a malformed list is ignored with a warning.
+            static Options fromEnv();
+        };
+
+        /// One pinned thread
+        struct Placement {
+            Role role;
+            std::size_t index;
+            CpuSet cpus;
+            int node = -1; ///> NUMA node of the CPUs, -1 if they span several
+        };
+
+        ThreadPlacement(Options options, std::vector<CpuSet> nodes);
+
+        ThreadPlacement(const ThreadPlacement &) = delete;
+        ThreadPlacement &operator=(const ThreadPlacement &) = delete;
+
+        /// @brief The placement built from Options::fromEnv() and the host's NUMA nodes.
+        static ThreadPlacement &instance();
+
+        [[nodiscard]] const Options &options() const { return m_options; }
+
+        /// @brief True if any CPU set is given.
+        [[nodiscard]] bool enabled() const;
+
+        /**
+         * @brief Pin the calling thread as thread `index` of `role`.
+         * @return false if the role has no set, or the kernel refused it (counted as a failure)
+         */
+        bool pin(Role role, std::size_t index = 0);
+
+        /// @brief CPUs of thread `index` of `role`; empty to leave it be. Pure, public for tests.
+        [[nodiscard]] CpuSet cpusFor(Role role, std::size_t index) const;
+
+        /// @brief NUMA node holding all of `cpus`, -1 if none does.
+        [[nodiscard]] int nodeOf(const CpuSet &cpus) const;
+
+        [[nodiscard]] std::vector<Placement> placements() const;
+
+        /// @brief `mb_thread_placement` per pinned thread and `mb_thread_pin_failures_total`.
+        void writeMetrics(MetricsWriter &out) const;
+
+        /// @brief `0-3,8` as {0, 1, 2, 3, 8}, sorted and unique.
+        /// @throws std::invalid_argument for anything else
+        static CpuSet parseCpuList(const std::string &list);
+
+        /// @brief {0, 1, 2, 3, 8} as `0-3,8`.
+        static std::string formatCpuList(const CpuSet &cpus);
+
+        /// @brief CPUs of each node under `sysfs`; one node of all online CPUs if it lists none.
+        static std::vector<CpuSet> numaNodes(const std::string &sysfs = "/sys/devices/system/node");
+
+        static const char *roleName(Role role);
+
+    private:
+        /// All CPUs if MB_CPU_BACKGROUND is set, for the IO and db threads without a set of their own
+        [[nodiscard]] CpuSet unconfined() const;
+
+        const Options m_options;
+        const std::vector<CpuSet> m_nodes;
+
+        mutable std::mutex m_mutex;
+        std::vector<Placement> m_placements; ///> Guarded by m_mutex
+        std::atomic<std::uint64_t> m_failures{0};
+    };
+}
+
+#endif // MANTISBASE_THREAD_PLACEMENT_H
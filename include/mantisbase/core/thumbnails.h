@@ -0,0 +1,136 @@
+/**
+ * @file thumbnails.h
+ * @brief Resized and re-encoded image derivatives for `GET /api/v1/files/...?thumb=WxH`.
+ *
+ * A derivative is generated once, on a small pool of its own, and kept on
+ * disk next to the original as `<entity>/.<filename>.thumbs/<spec>.<ext>`,
+ * so every later request is served like any other file. Image work needs
+ * libvips and is compiled in with `-DMB_THUMBNAILS_ENABLED=ON`; without it
+ * thumbnail requests get the original file.
+ * @see FileServing
+ */
+
+#ifndef MANTISBASE_THUMBNAILS_H
+#define MANTISBASE_THUMBNAILS_H
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mb {
+    class WorkerPool;
+
+    /**
+     * @brief A requested derivative, parsed from the `thumb` and `format` query parameters.
+     *
+     * `thumb` is `WxH` (crop to fill, centred), `WxHf` (fit inside the box),
+     * or `Wx0`/`0xH` (scale to one side, keeping the aspect ratio). `format`
+     * is `webp`, `avif`, `jpeg` or `png`; without it the original's format
+     * is kept.
+     */
+    struct ThumbSpec {
+        enum class Mode { Crop, Fit };
+
+        int width = 0;    ///> 0 to follow the height
+        int height = 0;   ///> 0 to follow the width
+        Mode mode = Mode::Crop;
+        std::string format;   ///> Output extension: `webp`, `avif`, `jpg` or `png`
+
+        /// @brief Bounds on what may be requested, to keep the cache from being filled with arbitrary sizes.
+        struct Limits {
+            int maxDimension = 2048;
+            std::vector<std::string> sizes;   ///> Allowed `thumb` values; empty for any within maxDimension
+
+            /// @brief Read MB_THUMB_MAX_DIM and MB_THUMB_SIZES (comma separated, e.g. `100x100,640x0`).
+            static Limits fromEnv();
+        };
+
+        /**
+         * @brief Parse a request for a derivative of `filename`.
+         * @param thumb The `thumb` query value
+         * @param format The `format` query value, may be empty
+         * @param filename Original file name; its extension decides the default format
+         * @return The spec, or std::nullopt if `filename` isn't an image we can resize
+         * @throws MantisException (400) for a malformed or disallowed size or format
+         */
+        static std::optional<ThumbSpec> parse(const std::string &thumb, const std::string &format,
+                                              const std::string &filename, const Limits &limits);
+
+        /// @brief Cache file name, e.g. `100x100.webp` or `640x0f.jpg`.
+        [[nodiscard]] std::string fileName() const;
+
+        /// @brief Content-Type of the output.
+        [[nodiscard]] std::string mimeType() const;
+    };
+
+    /**
+     * @brief Generates derivatives on a bounded pool and coalesces duplicate requests.
+     *
+     * The first request for a derivative queues its generation; requests for
+     * the same derivative that arrive meanwhile wait on that one job instead
+     * of starting their own. Callers wait at most `wait`; the job keeps
+     * running and its result is cached for the retry.
+     */
+    class Thumbnailer {
+    public:
+        struct Options {
+            std::size_t workers = 2;
+            std::size_t maxQueued = 64;   ///> Distinct derivatives pending before new ones are refused
+            std::chrono::seconds wait{30};
+
+            /// @brief Read MB_THUMB_WORKERS, MB_THUMB_QUEUE and MB_THUMB_WAIT (seconds).
+            static Options fromEnv();
+        };
+
+        explicit Thumbnailer(Options options);
+        ~Thumbnailer();
+
+        Thumbnailer(const Thumbnailer &) = delete;
+        Thumbnailer &operator=(const Thumbnailer &) = delete;
+
+        void start();
+        void stop();
+
+        /// @brief Whether this build can resize images at all.
+        static bool enabled();
+
+        /// @brief Directory holding the derivatives of `entity/filename`.
+        static std::filesystem::path cacheDir(const std::string &entity_name, const std::string &filename);
+
+        /**
+         * @brief Path of the derivative of `original`, generating it first if needed.
+         *
+         * A cached derivative older than the original is regenerated.
+         *
+         * @throws MantisException (503) if the queue is full or generation took longer than the wait,
+         * (422) if the original couldn't be decoded or the derivative written
+         */
+        std::filesystem::path get(const std::filesystem::path &original, const std::string &entity_name,
+                                  const std::string &filename, const ThumbSpec &spec);
+
+        /// @brief Derivatives being generated or queued.
+        [[nodiscard]] std::size_t inFlight() const;
+
+        const Options &options() const { return m_opts; }
+
+    private:
+        /// @brief Decode, resize and encode `src` into `dst`; empty on success, else the reason.
+        static std::string render(const std::filesystem::path &src, const std::filesystem::path &dst,
+                                  const ThumbSpec &spec);
+
+        const Options m_opts;
+        std::unique_ptr<WorkerPool> m_pool;
+
+        mutable std::mutex m_mutex;
+        std::unordered_map<std::string, std::shared_future<std::string>> m_inFlight; ///> Keyed by derivative path
+    };
+}
+
+#endif // MANTISBASE_THUMBNAILS_H
@@ -0,0 +1,144 @@
+/**
+ * @file token_verifier.h
+ * @brief The signing keys and JWT verifiers, built once per configuration.
+ *
+ * Every authenticated request verifies a token. Building a jwt-cpp
+ * verifier, and keying HMAC with the secret, for each of them is work that
+ * only changes when the keys or the issuer/audience settings do; here it
+ * is done once, and redone only then.
+ *
+ * Tokens are HS256 under MB_JWT_SECRET by default. With
+ * `MB_JWT_ALGORITHM=ES256` they are signed with a P-256 key instead, and
+ * anyone holding the public keys served at `/.well-known/jwks.json` can
+ * check them; each token names its key in `kid`, so keys rotate without
+ * logging anyone out.
+ */
+
+#ifndef MANTISBASE_TOKEN_VERIFIER_H
+#define MANTISBASE_TOKEN_VERIFIER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace mb {
+    class HmacSha256Key;
+
+    /**
+     * @brief jwt-cpp algorithm for HS256 under a precomputed key.
+     *
+     * Usable wherever jwt::algorithm::hs256 is: builder `sign()` and
+     * verifier `allow_algorithm()`.
+     */
+    struct KeyedHs256 {
+        std::shared_ptr<const HmacSha256Key> key;
+
+        std::string sign(const std::string &data, std::error_code &ec) const;
+        void verify(const std::string &data, const std::string &signature, std::error_code &ec) const;
+        [[nodiscard]] std::string name() const { return "HS256"; }
+    };
+
+    /// @brief The algorithm and key new tokens are signed with, for jwt-cpp's builder `sign()`.
+    struct TokenSigner {
+        std::string alg;   ///> `HS256` or `ES256`
+        std::string keyId; ///> The `kid` header to set; empty for HS256
+        std::function<std::string(const std::string &, std::error_code &)> signData;
+
+        std::string sign(const std::string &data, std::error_code &ec) const { return signData(data, ec); }
+        [[nodiscard]] std::string name() const { return alg; }
+    };
+
+    /// The claims Auth reads from a verified token
+    struct TokenClaims {
+        std::string id;
+        std::string entity;
+        std::string sessionId; ///> Empty for tokens without a session
+        std::optional<std::chrono::system_clock::time_point> expiresAt;
+
+        /// @brief `{"id", "entity"[, "session_id"]}`, as `verification["claims"]` holds them.
+        [[nodiscard]] nlohmann::json toJSON() const;
+    };
+
+    /**
+     * @brief Verifies tokens against the current keys, see Auth::verifyToken().
+     *
+     * @code
+     * const auto result = Auth::tokenVerifier().verify(token, TokenVerifier::Config::current());
+     * if (result.claims) { ... result.claims->id ... }
+     * @endcode
+     */
+    class TokenVerifier {
+    public:
+        struct Config {
+            std::string algorithm = "HS256";     ///> `HS256`, or `ES256` with privateKey
+            std::string secret;                  ///> HS256 key
+            std::string privateKey;              ///> ES256: PEM of the P-256 key new tokens are signed with
+            std::vector<std::string> publicKeys; ///> ES256: PEMs of earlier keys, whose tokens still verify
+            std::string issuer;                  ///> Required `iss`, unless empty
+            std::string audience;                ///> Required `aud`, unless empty
+            bool stateless = false;              ///> Skip `mb_sessions` unless the RevocationFilter may hold the session
+            std::chrono::seconds accessTtl{900}; ///> Longest token lifetime when stateless
+
+            /**
+             * @brief From MB_JWT_ALGORITHM, MB_JWT_SECRET, MB_JWT_PRIVATE_KEY_FILE,
+             * MB_JWT_PUBLIC_KEY_FILES (comma-separated), MB_JWT_STATELESS and MB_JWT_ACCESS_TTL.
+             *
+             * Key files are read when those variables change, not per call.
+             * @throw MantisException (500) if a key file can't be read
+             */
+            static Config current();
+
+            bool operator==(const Config &) const = default;
+        };
+
+        struct Result {
+            std::optional<TokenClaims> claims; ///> Set if the token verified
+            std::string error;
+        };
+
+        TokenVerifier() = default;
+
+        TokenVerifier(const TokenVerifier &) = delete;
+        TokenVerifier &operator=(const TokenVerifier &) = delete;
+
+        /// @brief Check the signature, `exp`/`nbf`/`iat`, issuer and audience, and read the claims.
+        Result verify(const std::string &token, const Config &config);
+
+        /// @brief What to sign tokens for `config` with, sharing the verifier's key.
+        TokenSigner signer(const Config &config);
+
+        /**
+         * @brief `{"keys": [...]}` of the ES256 public keys, current first; none for HS256.
+         * @throw MantisException (500) if a key isn't a P-256 EC key
+         */
+        nlohmann::json jwks(const Config &config);
+
+        /// @brief Times the keys and verifiers were (re)built, for tests.
+        [[nodiscard]] std::size_t builds() const { return m_builds.load(); }
+
+        /// @brief The JWK of a P-256 PEM key, public part only, with its RFC 7638 thumbprint as `kid`.
+        static nlohmann::json ecJwk(const std::string &pem);
+
+    private:
+        struct State;
+
+        /// The state for `config`, rebuilt if that is not the one held
+        std::shared_ptr<const State> state(const Config &config);
+
+        static std::shared_ptr<const State> build(const Config &config);
+
+        std::atomic<std::shared_ptr<const State>> m_state;
+        std::mutex m_buildMutex;
+        std::atomic<std::size_t> m_builds{0};
+    };
+}
+
+#endif // MANTISBASE_TOKEN_VERIFIER_H
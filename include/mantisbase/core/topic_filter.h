@@ -0,0 +1,82 @@
+/**
+ * @file topic_filter.h
+ * @brief Realtime topics that follow only the rows matching a filter.
+ *
+ * Besides `entity`, `entity:*` and `entity:<row_id>`, a subscriber may ask
+ * for `entity?<filter>`, e.g. `orders?status = 'open' && region = 'eu'`,
+ * in the `?filter=` syntax of list queries (see EntityFilter). The filter
+ * is compiled once, the topic is checked against the `list` rule, and
+ * every subscriber on the same topic shares one evaluation per event.
+ * @see sse.h, ws.h, entity_filter.h
+ */
+
+#ifndef MANTISBASE_TOPIC_FILTER_H
+#define MANTISBASE_TOPIC_FILTER_H
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "models/entity_filter.h"
+
+namespace mb {
+    class EncodedEvent;
+
+    /**
+     * @brief The filter topics subscribed to, grouped by entity.
+     *
+     * Counted: each add() of a topic needs a remove(). Not thread-safe;
+     * SSEMgr and WSMgr each keep one under their subscriptions lock.
+     *
+     * @code
+     * if (const auto parsed = TopicFilters::parse(topic))
+     *     filters.add(topic, app.entity(parsed->entity).compileFilter(parsed->filter));
+     * for (const auto &topic: filters.matching(*event)) // then the subscribers of each
+     * @endcode
+     */
+    class TopicFilters {
+    public:
+        struct Parsed {
+            std::string entity;
+            std::string filter; ///< Trimmed
+        };
+
+        /// @brief `entity?<filter>` split at the `?`; std::nullopt for a topic without a filter.
+        static std::optional<Parsed> parse(std::string_view topic);
+
+        /// @brief `entity?<filter>` with the filter trimmed, the key subscribers on it are grouped by.
+        static std::string topicOf(std::string_view entity, std::string_view filter);
+
+        /**
+         * @brief Split a comma-separated `topics` query parameter, leaving
+         * commas inside quotes and brackets (`status IN ['a', 'b']`) alone.
+         */
+        static std::vector<std::string> splitTopics(std::string_view csv);
+
+        /// @brief Whether `filter` matches the event's row or, for an update, the row it replaced.
+        static bool matches(const CompiledFilter &filter, const EncodedEvent &event);
+
+        /// @brief One more subscriber on filter `topic`; the first one's `filter` is kept.
+        void add(const std::string &topic, std::shared_ptr<const CompiledFilter> filter);
+
+        void remove(const std::string &topic);
+
+        /// @brief The filter topics on the event's entity that matches(), each filter evaluated once.
+        [[nodiscard]] std::vector<std::string> matching(const EncodedEvent &event) const;
+
+        [[nodiscard]] bool empty() const { return m_entities.empty(); }
+
+    private:
+        struct Group {
+            std::shared_ptr<const CompiledFilter> filter;
+            std::size_t subscribers = 0;
+        };
+
+        std::unordered_map<std::string, std::unordered_map<std::string, Group>> m_entities; ///> entity -> topic -> group
+    };
+}
+
+#endif // MANTISBASE_TOPIC_FILTER_H
@@ -0,0 +1,200 @@
+/**
+ * @file topic_index.h
+ * @brief Realtime topics interned to ids, with the subscribers of each.
+ *
+ * A topic string is looked up once, when it is subscribed to; from then on
+ * a subscriber holds its TopicId, and routing a change goes from the
+ * event's entity and row id straight to the subscriber lists of
+ * `entity:<row_id>`, `entity` and `entity:*` without building any string.
+ * @see sse.h, ws.h, topic_filter.h
+ */
+
+#ifndef MANTISBASE_TOPIC_INDEX_H
+#define MANTISBASE_TOPIC_INDEX_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mb {
+    using TopicId = std::uint32_t;
+
+    /**
+     * @brief Subscriber lists by interned topic id.
+     *
+     * Ids of topics whose last subscriber left are reused. A subscriber is
+     * added to a topic at most once; callers check their own topic list
+     * first. Not thread-safe; SSEMgr and WSMgr each keep one under their
+     * subscriptions lock.
+     *
+     * @code
+     * const auto [id, first] = index.add(topic, session);
+     * if (first) rt.watch(entity);
+     * const auto route = index.route(event.entity(), event.rowId());
+     * @endcode
+     */
+    template<typename Subscriber>
+    class TopicIndex {
+    public:
+        struct Added {
+            TopicId id;
+            bool first; ///< The topic had no subscribers before
+        };
+
+        /// @brief The subscribers of the three plain topics an event on a row is routed to; null if none.
+        struct Route {
+            const std::vector<Subscriber> *row = nullptr;
+            const std::vector<Subscriber> *entity = nullptr;
+            const std::vector<Subscriber> *wildcard = nullptr;
+        };
+
+        Added add(const std::string_view topic, Subscriber subscriber) {
+            auto it = m_ids.find(topic);
+            const bool first = it == m_ids.end();
+            if (first) it = m_ids.emplace(std::string(topic), intern(topic)).first;
+            m_slots[it->second].subscribers.push_back(std::move(subscriber));
+            return {it->second, first};
+        }
+
+        /// @return The topic's name if that was its last subscriber; its id is free again then
+        std::optional<std::string> remove(const TopicId id, const Subscriber &subscriber) {
+            if (id >= m_slots.size()) return std::nullopt;
+            auto &subscribers = m_slots[id].subscribers;
+            const auto it = std::ranges::find(subscribers, subscriber);
+            if (it == subscribers.end()) return std::nullopt;
+            // Order among subscribers doesn't matter
+            *it = std::move(subscribers.back());
+            subscribers.pop_back();
+            if (!subscribers.empty()) return std::nullopt;
+            return release(id);
+        }
+
+        [[nodiscard]] std::optional<TopicId> find(const std::string_view topic) const {
+            const auto it = m_ids.find(topic);
+            if (it == m_ids.end()) return std::nullopt;
+            return it->second;
+        }
+
+        [[nodiscard]] const std::string &name(const TopicId id) const { return m_slots[id].name; }
+
+        [[nodiscard]] const std::vector<Subscriber> &subscribers(const TopicId id) const {
+            return m_slots[id].subscribers;
+        }
+
+        [[nodiscard]] Route route(const std::string_view entity, const std::string_view row_id) const {
+            Route route;
+            const auto eit = m_entities.find(entity);
+            if (eit == m_entities.end()) return route;
+            const auto &routes = eit->second;
+            if (const auto rit = routes.rows.find(row_id); rit != routes.rows.end())
+                route.row = &m_slots[rit->second].subscribers;
+            if (routes.entity != npos) route.entity = &m_slots[routes.entity].subscribers;
+            if (routes.wildcard != npos) route.wildcard = &m_slots[routes.wildcard].subscribers;
+            return route;
+        }
+
+        /// @brief Topics with at least one subscriber.
+        [[nodiscard]] std::size_t size() const { return m_ids.size(); }
+
+    private:
+        static constexpr TopicId npos = static_cast<TopicId>(-1);
+
+        struct Hash {
+            using is_transparent = void;
+            std::size_t operator()(const std::string_view s) const noexcept {
+                return std::hash<std::string_view>{}(s);
+            }
+        };
+
+        template<typename V>
+        using Map = std::unordered_map<std::string, V, Hash, std::equal_to<>>;
+
+        struct Slot {
+            std::string name;
+            std::vector<Subscriber> subscribers;
+        };
+
+        /// The plain topics of an entity; `entity?<filter>` and `@<channel>` topics are found by name
+        struct Routes {
+            TopicId entity = npos;
+            TopicId wildcard = npos;
+            Map<TopicId> rows;
+
+            [[nodiscard]] bool empty() const { return entity == npos && wildcard == npos && rows.empty(); }
+        };
+
+        struct Parts {
+            std::string_view entity, row;
+            enum class Kind { Entity, Wildcard, Row, Named } kind;
+        };
+
+        static Parts split(const std::string_view topic) {
+            if (topic.starts_with('@')) return {{}, {}, Parts::Kind::Named};
+            const auto mark = topic.find_first_of(":?");
+            if (mark == std::string_view::npos) return {topic, {}, Parts::Kind::Entity};
+            const auto entity = topic.substr(0, mark), rest = topic.substr(mark + 1);
+            if (topic[mark] == '?') return {entity, {}, Parts::Kind::Named};
+            return {entity, rest, rest == "*" ? Parts::Kind::Wildcard : Parts::Kind::Row};
+        }
+
+        TopicId intern(const std::string_view topic) {
+            TopicId id;
+            if (!m_free.empty()) {
+                id = m_free.back();
+                m_free.pop_back();
+                m_slots[id].name = topic;
+            } else {
+                id = static_cast<TopicId>(m_slots.size());
+                m_slots.push_back({std::string(topic), {}});
+            }
+
+            const auto parts = split(topic);
+            if (parts.kind == Parts::Kind::Named) return id;
+            auto eit = m_entities.find(parts.entity);
+            if (eit == m_entities.end()) eit = m_entities.emplace(std::string(parts.entity), Routes{}).first;
+            auto &routes = eit->second;
+            switch (parts.kind) {
+                case Parts::Kind::Entity: routes.entity = id; break;
+                case Parts::Kind::Wildcard: routes.wildcard = id; break;
+                default: routes.rows.emplace(std::string(parts.row), id); break;
+            }
+            return id;
+        }
+
+        std::string release(const TopicId id) {
+            auto name = std::move(m_slots[id].name);
+            m_slots[id].name.clear();
+            m_slots[id].subscribers.shrink_to_fit();
+            m_free.push_back(id);
+            if (const auto it = m_ids.find(name); it != m_ids.end()) m_ids.erase(it);
+
+            if (const auto parts = split(name); parts.kind != Parts::Kind::Named) {
+                if (const auto eit = m_entities.find(parts.entity); eit != m_entities.end()) {
+                    auto &routes = eit->second;
+                    switch (parts.kind) {
+                        case Parts::Kind::Entity: routes.entity = npos; break;
+                        case Parts::Kind::Wildcard: routes.wildcard = npos; break;
+                        default:
+                            if (const auto rit = routes.rows.find(parts.row); rit != routes.rows.end())
+                                routes.rows.erase(rit);
+                            break;
+                    }
+                    if (routes.empty()) m_entities.erase(eit);
+                }
+            }
+            return name;
+        }
+
+        std::vector<Slot> m_slots;   ///> By id
+        std::vector<TopicId> m_free; ///> Slots without subscribers, reused first
+        Map<TopicId> m_ids;          ///> Topic -> id, for topics with subscribers
+        Map<Routes> m_entities;      ///> Entity -> its plain topics
+    };
+}
+
+#endif // MANTISBASE_TOPIC_INDEX_H
@@ -0,0 +1,205 @@
+/**
+ * @file tracing.h
+ * @brief Distributed tracing: W3C trace context, spans and OTLP export.
+ *
+ * Each HTTP request continues the trace of its `traceparent` header, or
+ * starts one. The request's context is made current on the thread running
+ * its middleware chain, so spans further down (SQL statements, file IO)
+ * find their parent without it being passed around. Sampled spans are
+ * batched and exported as OTLP/HTTP JSON on a background thread.
+ * @see Router::reqIdSyncAdvice()
+ */
+
+#ifndef MANTISBASE_TRACING_H
+#define MANTISBASE_TRACING_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace mb {
+    /// @brief W3C trace context of one span (version 00 `traceparent`).
+    struct TraceContext {
+        std::array<std::uint8_t, 16> traceId{};
+        std::array<std::uint8_t, 8> spanId{};
+        bool sampled = false;
+
+        /// @brief Parse `00-<32 hex trace id>-<16 hex span id>-<2 hex flags>`; nullopt if malformed or all-zero.
+        static std::optional<TraceContext> parse(std::string_view traceparent);
+
+        [[nodiscard]] std::string traceparent() const;
+        [[nodiscard]] std::string traceIdHex() const;
+        [[nodiscard]] std::string spanIdHex() const;
+    };
+
+    enum class SpanKind { Internal = 1, Server = 2, Client = 3 };
+
+    /// @brief A finished span, as exported.
+    struct SpanData {
+        TraceContext context;
+        std::array<std::uint8_t, 8> parentSpanId{}; ///> All zero for a root span
+        std::string name;
+        SpanKind kind = SpanKind::Internal;
+        std::uint64_t startNs = 0; ///> Unix epoch nanoseconds
+        std::uint64_t endNs = 0;
+        std::vector<std::pair<std::string, std::string>> attributes;
+        std::vector<TraceContext> links; ///> Spans this one follows from, e.g. the writes a delivery carries
+        bool error = false;
+    };
+
+    /**
+     * @brief Creates trace contexts and exports sampled spans in batches.
+     *
+     * Sampling is parent-based: a request with a `traceparent` follows its
+     * sampled flag, a new trace is sampled with probability `sampleRatio`.
+     * Unsampled contexts are still propagated, but record nothing.
+     *
+     * Spans are queued up to `maxQueue`, beyond which they're dropped, and
+     * exported `batch` at a time or every `flush`.
+     */
+    class Tracer {
+    public:
+        /// Send one OTLP/HTTP JSON request body; false if it failed
+        using Exporter = std::function<bool(const std::string &body)>;
+
+        struct Options {
+            std::string endpoint;            ///> OTLP/HTTP base URL, e.g. `http://localhost:4318`; empty disables export
+            double sampleRatio = 1.0;        ///> Share of new traces sampled
+            std::string serviceName = "mantisbase";
+            std::size_t maxQueue = 4096;
+            std::size_t batch = 512;
+            std::chrono::milliseconds flush{2000};
+
+            /**
+             * @brief Read MB_OTLP_ENDPOINT (or OTEL_EXPORTER_OTLP_ENDPOINT), MB_TRACE_SAMPLE
+             * and MB_SERVICE_NAME (or OTEL_SERVICE_NAME).
+             */
+            static Options fromEnv();
+        };
+
+        struct Stats {
+            std::uint64_t exported = 0; ///> Spans sent
+            std::uint64_t dropped = 0;  ///> Spans lost to a full queue
+            std::uint64_t failed = 0;   ///> Spans in requests the exporter failed
+            std::size_t queued = 0;
+        };
+
+        /// @brief Tracer exporting with `exporter`; without one, OTLP/HTTP to `options.endpoint`.
+        explicit Tracer(Options options, Exporter exporter = {});
+        ~Tracer();
+
+        Tracer(const Tracer &) = delete;
+        Tracer &operator=(const Tracer &) = delete;
+
+        /// @brief True if spans are exported anywhere; when false, no contexts are created.
+        [[nodiscard]] bool enabled() const { return static_cast<bool>(m_exporter); }
+
+        /// @brief Start the export thread.
+        void start();
+
+        /// @brief Export what's queued and stop the export thread.
+        void stop();
+
+        /// @brief A new span context: a child of `parent`, or a new trace (sampled per sampleRatio).
+        [[nodiscard]] TraceContext childOf(const std::optional<TraceContext> &parent) const;
+
+        /// @brief Queue a finished span for export; unsampled spans are ignored.
+        void record(SpanData span);
+
+        /// @brief Export everything queued, on the calling thread.
+        void flush();
+
+        [[nodiscard]] Stats stats() const;
+
+        [[nodiscard]] const Options &options() const { return m_options; }
+
+        /// @brief OTLP/HTTP JSON body (`ExportTraceServiceRequest`) for `spans`.
+        static std::string toOtlpJson(const std::vector<SpanData> &spans, const std::string &service_name);
+
+        /// @brief Exporter POSTing to `<endpoint>/v1/traces`.
+        static Exporter otlpHttpExporter(const std::string &endpoint);
+
+        static std::uint64_t nowNs();
+
+        /// @brief The current span context on this thread, or nullptr.
+        static const TraceContext *current();
+
+        /// @brief Makes `context` current on this thread until destroyed; an unsampled or null tracer records nothing.
+        class Scope {
+        public:
+            Scope(Tracer *tracer, const TraceContext &context);
+            ~Scope();
+
+            Scope(const Scope &) = delete;
+            Scope &operator=(const Scope &) = delete;
+
+        private:
+            Tracer *m_prevTracer;
+            TraceContext m_prevContext;
+            bool m_prevActive;
+        };
+
+        /**
+         * @brief A child of the current span, current itself while alive.
+         * Records nothing (and costs one thread-local read) unless the current context is sampled.
+         */
+        class Span {
+        public:
+            explicit Span(std::string name, SpanKind kind = SpanKind::Internal);
+            ~Span();
+
+            Span(const Span &) = delete;
+            Span &operator=(const Span &) = delete;
+
+            [[nodiscard]] bool recording() const { return m_tracer != nullptr; }
+
+            void setAttribute(std::string key, std::string value);
+            void setError() { m_data.error = true; }
+
+        private:
+            Tracer *m_tracer = nullptr;
+            SpanData m_data;
+            TraceContext m_prevContext;
+        };
+
+        /**
+         * @brief Open a span for SQL `statement`, ending the thread's previous one.
+         *
+         * SOCI only reports when a statement starts, so a statement span ends
+         * when the next one starts, its connection goes back to the pool
+         * (endStatement()), or the request scope ends.
+         */
+        static void statement(std::string_view statement);
+
+        /// @brief End the thread's open statement span, if any.
+        static void endStatement();
+
+    private:
+        void loop();
+        std::size_t exportBatch();
+
+        const Options m_options;
+        const Exporter m_exporter;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_cv;
+        std::vector<SpanData> m_queue;
+        bool m_stopping = false;
+        std::thread m_thread;
+
+        std::mutex m_exportMutex; ///> One export at a time
+        std::atomic<std::uint64_t> m_exported{0}, m_dropped{0}, m_failed{0};
+    };
+}
+
+#endif // MANTISBASE_TRACING_H
@@ -6,6 +6,7 @@
 #include <string>
 #include <vector>
 #include <filesystem>
+#include <drogon/utils/coroutine.h>
 
 namespace mb {
     class MantisBase;
@@ -31,9 +32,17 @@ namespace mb {
         Unhandled
     };
 
+    /// Where a route's middlewares and handler execute.
+    enum class RouteExec {
+        IoLoop, ///< Inline on the Drogon event loop that received the request
+        DbWorker ///< On the database worker pool; the response resumes on the IO loop
+    };
+
     using HandlerFn = std::function<void(MantisRequest&, MantisResponse&)>;
     using HandlerWithContentReaderFn = std::function<void(MantisRequest&, MantisResponse&,
                                                                  MantisContentReader&)>;
+    /// A coroutine handler, see Router::GetAsync(); it runs on the IO loop and may `co_await`
+    using AsyncHandlerFn = std::function<drogon::Task<void>(MantisRequest&, MantisResponse&)>;
     using MiddlewareFn = std::function<HandlerResponse(MantisRequest&, MantisResponse&)>;
     using Middlewares = std::vector<MiddlewareFn>;
     using Method = std::string;
@@ -0,0 +1,166 @@
+/**
+ * @file usage_quotas.h
+ * @brief Request and bandwidth quotas per API key and per user.
+ *
+ * With MB_QUOTA_REQUESTS or MB_QUOTA_MB set, every authenticated caller
+ * gets that much per window of MB_QUOTA_WINDOW_SECS, counted per API key
+ * for key requests and per user for token requests. hydrateContextData()
+ * checks the quota as soon as it knows who is calling, before the user is
+ * loaded or the route runs; a caller over it is told `429` with
+ * `Retry-After` until the window turns. Counts live in memory and are
+ * written to `mb_usage` in batches, so metering costs no write per request.
+ * Limits for one key or user, set in `mb_usage_limits`, replace the
+ * defaults. Admins and guests are not metered; rateLimit() covers the latter.
+ * @see Router::listen(), resolveAuth()
+ */
+
+#ifndef MANTISBASE_USAGE_QUOTAS_H
+#define MANTISBASE_USAGE_QUOTAS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace mb {
+    using json = nlohmann::json;
+    class MetricsWriter;
+
+    /**
+     * @brief Per-subject usage in fixed windows, checked in memory and flushed behind.
+     *
+     * A subject is `key:<id>` or `user:<entity>:<id>`. Windows are aligned to
+     * the epoch, so every node agrees on when one starts. Subjects are spread
+     * over shards, each with its own lock, so concurrent requests for
+     * different callers don't contend.
+     *
+     * @code
+     * if (const auto d = quotas.admit(UsageQuotas::keySubject(id)); !d.allowed)
+     *     throw MantisException(429, d.reason);
+     * quotas.addBytes(subject, resp->body().size());
+     * @endcode
+     */
+    class UsageQuotas {
+    public:
+        using Clock = std::chrono::system_clock;
+
+        struct Options {
+            std::uint64_t requests = 0;          ///> Per subject and window; 0 for no limit
+            std::uint64_t bytes = 0;             ///> Request and response bodies, per subject and window; 0 for no limit
+            std::chrono::seconds window{86400};
+
+            /// MB_QUOTA_REQUESTS, MB_QUOTA_MB, MB_QUOTA_WINDOW_SECS
+            static Options fromEnv();
+        };
+
+        /// One subject's limits; 0 for none
+        struct Limits {
+            std::uint64_t requests = 0;
+            std::uint64_t bytes = 0;
+        };
+
+        struct Decision {
+            bool allowed = true;
+            std::string reason;                  ///> When denied: which quota is used up
+            std::chrono::seconds retryAfter{0};  ///> When denied: until the window turns
+        };
+
+        explicit UsageQuotas(Options options);
+
+        UsageQuotas(const UsageQuotas &) = delete;
+        UsageQuotas &operator=(const UsageQuotas &) = delete;
+
+        /// Metering is on when any limit is set
+        [[nodiscard]] bool enabled() const { return m_options.requests > 0 || m_options.bytes > 0; }
+
+        [[nodiscard]] const Options &options() const { return m_options; }
+
+        static std::string keySubject(const std::string &key_id);
+        static std::string userSubject(const std::string &entity, const std::string &user_id);
+
+        /// @brief Count one request for `subject`, unless it has used up a quota this window.
+        Decision admit(const std::string &subject, Clock::time_point now = Clock::now());
+
+        /// @brief Count `bytes` of bandwidth against `subject`'s current window.
+        void addBytes(const std::string &subject, std::uint64_t bytes, Clock::time_point now = Clock::now());
+
+        /// @brief Replace the defaults for `subject`, in memory; see saveLimits() to keep them.
+        void setLimits(const std::string &subject, std::optional<Limits> limits);
+
+        /// @brief The limits `subject` is held to.
+        [[nodiscard]] Limits limitsOf(const std::string &subject) const;
+
+        /// @brief Set `subject`'s limits and store them in `mb_usage_limits`, or drop them for nullopt.
+        void saveLimits(const std::string &subject, std::optional<Limits> limits);
+
+        /**
+         * @brief Read the current window's counts from `mb_usage`, and the limits from `mb_usage_limits`.
+         *
+         * Called before the server listens, so a restart doesn't hand out a
+         * fresh quota. Counts are added to what's already recorded.
+         */
+        void load(Clock::time_point now = Clock::now());
+
+        /**
+         * @brief Add the counts since the last flush to `mb_usage`, in one transaction.
+         *
+         * Called every FLUSH_INTERVAL_SECS while the server runs and once more
+         * on shutdown. On failure the counts are kept for the next flush.
+         * @return Number of subjects written.
+         */
+        std::size_t flush();
+
+        /// @brief The current window's counts and limits, one object per subject.
+        [[nodiscard]] json usage(Clock::time_point now = Clock::now()) const;
+
+        /// @brief Subjects counted in memory.
+        [[nodiscard]] std::size_t size() const;
+
+        void writeMetrics(MetricsWriter &out) const;
+
+        static constexpr int FLUSH_INTERVAL_SECS = 10;
+
+    private:
+        static constexpr std::size_t SHARDS = 32;
+
+        struct Counter {
+            std::int64_t window = 0;             ///> Start of the window counted, in unix seconds
+            std::uint64_t requests = 0, bytes = 0;
+            std::uint64_t pendingRequests = 0, pendingBytes = 0; ///> Of this window, not in `mb_usage` yet
+            std::optional<Limits> limits;        ///> From `mb_usage_limits`
+        };
+
+        /// Counts of a window that turned before they were flushed
+        struct Carried {
+            std::string subject;
+            std::int64_t window = 0;
+            std::uint64_t requests = 0, bytes = 0;
+        };
+
+        struct Shard {
+            mutable std::mutex mutex;
+            std::unordered_map<std::string, Counter> counters;
+            std::vector<Carried> carried;
+        };
+
+        Shard &shardOf(const std::string &subject);
+        [[nodiscard]] const Shard &shardOf(const std::string &subject) const;
+        [[nodiscard]] std::int64_t windowOf(Clock::time_point now) const;
+        /// `counter` moved on to `window`; pending counts of the previous one are carried to flush()
+        static void roll(Shard &shard, const std::string &subject, Counter &counter, std::int64_t window);
+        [[nodiscard]] Limits limitsOf(const Counter &counter) const;
+
+        const Options m_options;
+        std::array<Shard, SHARDS> m_shards;
+        std::atomic<std::uint64_t> m_deniedRequests{0}, m_deniedBytes{0}, m_flushFailures{0};
+    };
+}
+
+#endif // MANTISBASE_USAGE_QUOTAS_H
@@ -0,0 +1,206 @@
+/**
+ * @file vector_index.h
+ * @brief Approximate nearest-neighbour search over `vector` fields.
+ *
+ * A `vector` field holds `dim` float32 components, stored as the base64url
+ * text of their little-endian bytes: a quarter of the JSON text, and the same
+ * column type on every backend, with no database extension needed. `?near=`
+ * list queries are answered from an in-memory HNSW graph per field, built on
+ * first use and kept current from the realtime change stream. See
+ * Entity::list().
+ */
+
+#ifndef MANTISBASE_VECTOR_INDEX_H
+#define MANTISBASE_VECTOR_INDEX_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace mb {
+    /**
+     * @brief An HNSW graph over unit vectors, ranked by cosine distance.
+     *
+     * Vectors are normalized as they are added, so a distance is one dot
+     * product. Removed vectors stay in the graph as tombstones, still routing
+     * searches but never returned, until they outnumber the live ones and
+     * the graph is rebuilt. All-zero vectors have no direction and aren't indexed.
+     *
+     * Thread-safe: searches share the graph, writes take it exclusively.
+     *
+     * @code
+     * VectorIndex index(3);
+     * index.upsert("a", std::vector<float>{1, 0, 0});
+     * const auto hits = index.search(std::vector<float>{0.9f, 0.1f, 0}, 10); // [{"a", 0.006}]
+     * @endcode
+     */
+    class VectorIndex {
+    public:
+        /// Largest `dim` a `vector` field may have.
+        static constexpr std::size_t MAX_DIM = 4096;
+
+        struct Options {
+            std::size_t m = 16;               ///> Links per node and layer (twice that on layer 0)
+            std::size_t efConstruction = 200; ///> Candidates considered when linking a new node
+            std::size_t efSearch = 64;        ///> Candidates considered per search, at least `k`
+
+            /// @brief Read MB_VECTOR_M, MB_VECTOR_EF_CONSTRUCTION and MB_VECTOR_EF_SEARCH.
+            static Options fromEnv();
+        };
+
+        struct Hit {
+            std::string id;
+            float distance; ///> `1 - cosine similarity`, 0 to 2
+        };
+
+        explicit VectorIndex(std::size_t dim);
+
+        VectorIndex(std::size_t dim, const Options &options);
+
+        /// @brief Add `vector` as `id`, replacing the one `id` had.
+        void upsert(const std::string &id, std::span<const float> vector);
+
+        /// @brief Drop `id`; false if it wasn't indexed.
+        bool remove(const std::string &id);
+
+        /// @brief Up to `k` ids nearest `query`, nearest first.
+        [[nodiscard]] std::vector<Hit> search(std::span<const float> query, std::size_t k) const;
+
+        /// @brief Vectors indexed, tombstones aside.
+        [[nodiscard]] std::size_t size() const;
+
+        [[nodiscard]] std::size_t dim() const { return m_dim; }
+
+        /**
+         * @brief The components of a JSON array of `dim` finite numbers.
+         * @throws MantisException (400) for anything else
+         */
+        static std::vector<float> parse(const nlohmann::json &value, std::size_t dim);
+
+        /// @brief The stored text of `vector`.
+        static std::string encode(std::span<const float> vector);
+
+        /// @brief A stored text's components; empty if it isn't one.
+        static std::vector<float> decode(std::string_view text);
+
+        /// @brief A stored text as the JSON array of its components; null if it isn't one.
+        static nlohmann::json toJSON(std::string_view text);
+
+        /// @brief `a · b` over `n` components, with AVX2/FMA or NEON where the CPU has them.
+        static float dot(const float *a, const float *b, std::size_t n);
+
+    private:
+        using Node = std::uint32_t;
+        using Scored = std::pair<float, Node>;
+
+        [[nodiscard]] const float *vectorOf(const Node node) const { return m_data.data() + node * m_dim; }
+
+        [[nodiscard]] float distance(const float *a, const float *b) const { return 1.f - dot(a, b, m_dim); }
+
+        /// Link `node`, already stored, into the graph; m_mutex held exclusively
+        void insertLocked(Node node, int level);
+
+        /// Closest node to `q` on `level` reachable greedily from `entry`; m_mutex held
+        [[nodiscard]] Node greedyLocked(const float *q, Node entry, int level) const;
+
+        /// The `ef` closest nodes to `q` on `level` found from `entry`, by distance; m_mutex held
+        [[nodiscard]] std::vector<Scored> searchLayerLocked(const float *q, Node entry, std::size_t ef,
+                                                            int level) const;
+
+        /// Up to `m` of `candidates` (by distance), preferring ones not closer to an already chosen one
+        [[nodiscard]] std::vector<Node> selectLocked(const std::vector<Scored> &candidates, std::size_t m) const;
+
+        /// Relink the live nodes alone; m_mutex held exclusively
+        void rebuildLocked();
+
+        const std::size_t m_dim;
+        const Options m_options;
+        const double m_levelFactor;
+
+        mutable std::shared_mutex m_mutex;
+        std::mt19937 m_rng{0x5eed};                     ///> Guarded by m_mutex
+        std::vector<float> m_data;                      ///> Node vectors, `m_dim` each
+        std::vector<std::string> m_ids;                 ///> Node ids
+        std::vector<std::uint8_t> m_dead;               ///> Tombstones
+        std::vector<std::vector<std::vector<Node>>> m_links; ///> Per node, its neighbours on each of its levels
+        std::unordered_map<std::string, Node> m_live;   ///> Live node of each id
+        Node m_entry = 0;
+        int m_top = -1;                                 ///> Entry point's level, -1 when empty
+    };
+
+    /**
+     * @brief The VectorIndex of each (entity, vector field), built on first use.
+     *
+     * Indexes follow the realtime change stream: a changed row is re-read
+     * the next time its index is acquired, and an event without a row
+     * (`IMPORT`) rebuilds the whole index then. Changes are applied before a
+     * search, not as they arrive, so idle indexes cost no queries.
+     *
+     * Thread-safe.
+     *
+     * @code
+     * const auto index = Entity::vectorIndexes().acquire("posts", "embedding", 384, [&](const auto *ids) {
+     *     return query(ids); // (id, stored text) of the rows in `ids`, all rows if null
+     * });
+     * @endcode
+     */
+    class VectorIndexes {
+    public:
+        /// (id, stored vector text) pairs
+        using Rows = std::vector<std::pair<std::string, std::string>>;
+        /// Reads the rows with the given ids, or every row with a vector for nullptr
+        using Loader = std::function<Rows(const std::vector<std::string> *ids)>;
+
+        /// Pending changed rows past which an index is rebuilt instead
+        static constexpr std::size_t MAX_DIRTY = 10000;
+
+        explicit VectorIndexes(const VectorIndex::Options &options = {});
+
+        /**
+         * @brief The index of `entity`.`field`, brought up to date through `load`.
+         * @throws Whatever `load` threw; the changes are retried on the next call
+         */
+        std::shared_ptr<const VectorIndex> acquire(const std::string &entity, const std::string &field,
+                                                   std::size_t dim, const Loader &load);
+
+        /// @brief Drop the indexes of `entity` (its schema changed or it was removed).
+        void invalidateEntity(const std::string &entity);
+
+        /**
+         * @brief Apply a batch of realtime change events: each changed row is
+         * re-read later, and an entity's event without a row rebuilds its indexes.
+         * @param events JSON array of change events, as passed to an RtCallback
+         */
+        void onChanges(const nlohmann::json &events);
+
+        /// @brief Indexes built.
+        [[nodiscard]] std::size_t loaded() const;
+
+    private:
+        struct Slot {
+            std::string entity;
+            std::size_t dim = 0;
+            std::mutex load;                      ///> Held while the index is brought up to date
+            std::shared_ptr<VectorIndex> index;   ///> Guarded by `load`
+            bool stale = true;                    ///> Guarded by m_mutex
+            std::unordered_set<std::string> dirty; ///> Guarded by m_mutex
+        };
+
+        const VectorIndex::Options m_options;
+        mutable std::mutex m_mutex;
+        std::unordered_map<std::string, std::shared_ptr<Slot>> m_slots; ///> By `entity\0field`; guarded by m_mutex
+    };
+}
+
+#endif // MANTISBASE_VECTOR_INDEX_H
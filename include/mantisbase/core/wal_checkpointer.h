@@ -0,0 +1,127 @@
+/**
+ * @file wal_checkpointer.h
+ * @brief Background WAL checkpoints for SQLite, off the request threads.
+ *
+ * With `wal_autocheckpoint`, the commit that crosses the threshold runs the
+ * checkpoint inline and its request pays for it. WalCheckpointer replaces the
+ * auto-checkpoint hook on every connection with one that only records the
+ * WAL size. A background thread then checkpoints: PASSIVE once writes have
+ * been idle for a while, RESTART or TRUNCATE when the WAL grows past its
+ * limits. Disabled with MB_SQLITE_CHECKPOINT=0.
+ * @see database.h
+ */
+
+#ifndef MANTISBASE_WAL_CHECKPOINTER_H
+#define MANTISBASE_WAL_CHECKPOINTER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+namespace mb {
+    /**
+     * @brief Decides when and how hard to checkpoint the WAL, and runs it on its own thread.
+     *
+     * Thread-safe. The checkpoint itself is injected, so Database runs it on a
+     * dedicated connection with a short busy timeout. A RESTART that cannot
+     * wait out the readers then gives up quickly instead of stalling writers,
+     * and is retried on the next tick.
+     *
+     * @code
+     * WalCheckpointer ckpt([&](auto mode) { return runCheckpoint(conn, mode); }, page_size,
+     *                      WalCheckpointer::Options::fromEnv());
+     * // from each connection's sqlite3_wal_hook(): ckpt.noteCommit(wal_frames);
+     * ckpt.start();
+     * @endcode
+     */
+    class WalCheckpointer {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        enum class Mode { Passive, Restart, Truncate };
+
+        /// Outcome of `PRAGMA wal_checkpoint(...)`.
+        struct Result {
+            bool busy = false;    ///> Could not finish because of readers or a writer
+            int walFrames = 0;    ///> Frames in the WAL
+            int checkpointed = 0; ///> Frames copied back to the database
+        };
+
+        using Checkpoint = std::function<Result(Mode)>;
+
+        struct Options {
+            std::chrono::milliseconds poll{500};        ///> How often the WAL size is looked at
+            std::chrono::milliseconds idle{1000};       ///> Write pause before a PASSIVE checkpoint
+            std::int64_t restartBytes = 64ll << 20;     ///> WAL size that escalates to RESTART
+            std::int64_t truncateBytes = 256ll << 20;   ///> WAL size that escalates to TRUNCATE
+
+            /// @brief Read MB_SQLITE_CHECKPOINT_IDLE_MS, MB_SQLITE_WAL_RESTART_MB and MB_SQLITE_WAL_TRUNCATE_MB.
+            static Options fromEnv();
+
+            /// @brief False when MB_SQLITE_CHECKPOINT=0, leaving checkpoints to `wal_autocheckpoint`.
+            static bool enabledFromEnv();
+        };
+
+        struct Stats {
+            std::uint64_t passive = 0, restart = 0, truncate = 0; ///> Checkpoints run, per mode
+            std::uint64_t busy = 0;       ///> Checkpoints that could not finish
+            std::uint64_t failed = 0;     ///> Checkpoints that threw
+            std::uint64_t frames = 0;     ///> Frames copied back to the database
+            std::int64_t walBytes = 0;    ///> WAL size at the last commit
+            double lastMs = 0, maxMs = 0; ///> Checkpoint durations
+        };
+
+        WalCheckpointer(Checkpoint checkpoint, int page_size, Options options);
+        ~WalCheckpointer();
+
+        WalCheckpointer(const WalCheckpointer &) = delete;
+        WalCheckpointer &operator=(const WalCheckpointer &) = delete;
+
+        void start();
+
+        /// @brief Stop the thread. Idempotent; the final checkpoint is left to the caller.
+        void stop();
+
+        /// @brief Record a commit that left `wal_frames` frames in the WAL; called from `sqlite3_wal_hook()`.
+        void noteCommit(int wal_frames, Clock::time_point now = Clock::now());
+
+        /**
+         * @brief The checkpoint due for a WAL of `wal_bytes`, `pending_bytes` of
+         * them not yet copied back, last written `since_commit` ago.
+         */
+        [[nodiscard]] static std::optional<Mode> due(const Options &options, std::int64_t wal_bytes,
+                                                     std::int64_t pending_bytes,
+                                                     std::chrono::milliseconds since_commit);
+
+        /// @brief Run the checkpoint due now, if any. Called by the thread; public for tests.
+        std::optional<Mode> tick(Clock::time_point now = Clock::now());
+
+        [[nodiscard]] Stats stats() const;
+
+    private:
+        void loop();
+
+        Checkpoint m_checkpoint;
+        const std::int64_t m_pageSize;
+        const Options m_options;
+
+        std::atomic<int> m_walFrames{0};     ///> From the last commit
+        std::atomic<int> m_backfilled{0};    ///> Frames already checkpointed in the current WAL
+        std::atomic<Clock::rep> m_lastCommit{0};
+        std::atomic<bool> m_escalationBusy{false}; ///> Last RESTART/TRUNCATE could not finish
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_cv;
+        bool m_stopping = false;
+        bool m_wake = false;                 ///> A commit crossed the RESTART size
+        std::thread m_thread;
+        Stats m_stats;                       ///> Guarded by m_mutex
+    };
+}
+
+#endif // MANTISBASE_WAL_CHECKPOINTER_H
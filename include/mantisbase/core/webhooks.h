@@ -0,0 +1,197 @@
+/**
+ * @file webhooks.h
+ * @brief Outbound webhooks: change events POSTed to subscribed endpoints.
+ *
+ * A webhook subscribes an http(s) URL to topics, as realtime clients do:
+ * `*`, `<entity>`, `<entity>:*` or `<entity>:<row_id>`. The change stream
+ * that feeds realtime also feeds these. Each batch of committed changes
+ * is written to the outbox table, `mb_webhook_outbox`, once for every
+ * webhook it matches. A thread of the leader sends the outbox in order,
+ * with up to `batch` events per POST. A delivery fails on anything but a
+ * 2xx answer. It is tried again after an exponentially growing delay,
+ * from the outbox, so a restart doesn't lose it. An endpoint has at most
+ * `concurrency` POSTs in flight, so a slow receiver only holds up itself.
+ * Delivery is at least once: a receiver should drop events it has seen,
+ * by their `event_id`.
+ * @see RealtimeDB::subscribe(), LeaderElection
+ */
+
+#ifndef MANTISBASE_WEBHOOKS_H
+#define MANTISBASE_WEBHOOKS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+namespace soci {
+    class session;
+}
+
+namespace mb {
+    class MetricsWriter;
+
+    using json = nlohmann::json;
+
+    /**
+     * @brief Writes matching changes to the outbox and delivers it, on a thread of its own.
+     *
+     * @code
+     * webhooks.start([&leader] { return leader.isLeader(); });
+     * app.rt().subscribe([&](const json &events) { webhooks.onChanges(events); });
+     * @endcode
+     */
+    class Webhooks {
+    public:
+        /// A session on the database holding `mb_webhooks` and the outbox
+        using Connect = std::function<std::shared_ptr<soci::session>()>;
+
+        /// Whether this node is the one delivering
+        using Leadership = std::function<bool()>;
+
+        /// One POST to an endpoint
+        struct Request {
+            std::string url;
+            std::string body; ///> `{"webhook", "events"}`
+            std::vector<std::pair<std::string, std::string>> headers;
+        };
+
+        /// Called with the response status, 0 if there was none; from any thread
+        using Done = std::function<void(int status)>;
+
+        /// Send `request`, then call `done`; must not block
+        using Send = std::function<void(const Request &request, Done done)>;
+
+        struct Options {
+            bool enabled = true;                 ///> Off, nothing is written to the outbox or sent
+            std::size_t batch = 100;             ///> Events per POST at most
+            std::size_t concurrency = 2;         ///> POSTs in flight per webhook at most
+            std::size_t maxAttempts = 10;        ///> Per delivery, the first included; then it is dropped
+            std::chrono::seconds retryBase{2};   ///> Doubled for every attempt after the first
+            std::chrono::seconds retryMax{600};  ///> Cap on the delay between attempts
+            double timeout = 10.0;               ///> Seconds per POST
+
+            /// @brief Read MB_WEBHOOKS (`0` turns them off), MB_WEBHOOK_BATCH, MB_WEBHOOK_CONCURRENCY and MB_WEBHOOK_ATTEMPTS.
+            static Options fromEnv();
+        };
+
+        struct Hook {
+            std::string id;
+            std::string url;
+            std::vector<std::string> topics;
+            std::string secret; ///> Signs each body, see signature(); empty for none
+
+            /// @brief Whether a change to `row_id` of `entity` is for this webhook.
+            [[nodiscard]] bool matches(const std::string &entity, const std::string &row_id) const;
+
+            /// @brief `{"id", "url", "topics", "signed"}`; the secret stays in.
+            [[nodiscard]] json toJSON() const;
+        };
+
+        /// @param send By default POSTs with httpSender()
+        /// @param connect By default a write session of the application database
+        explicit Webhooks(Options options, Send send = {}, Connect connect = {});
+        ~Webhooks();
+
+        Webhooks(const Webhooks &) = delete;
+        Webhooks &operator=(const Webhooks &) = delete;
+
+        /// @brief Start delivering, while `leads` answers true; always if unset. No-op if disabled or running.
+        void start(Leadership leads = {});
+
+        /// @brief Stop the thread; what is in flight finishes, and what isn't stays in the outbox. Idempotent.
+        void stop();
+
+        [[nodiscard]] const Options &options() const { return m_options; }
+
+        /**
+         * @brief Subscribe `body`'s `url` to its `topics`, signed with its `secret` if any.
+         * @throws MantisException (400) for a URL that isn't http(s), or topics that aren't a list of strings
+         */
+        Hook create(const json &body);
+
+        [[nodiscard]] std::vector<Hook> list() const;
+
+        /// @brief Unsubscribe webhook `id` and drop its deliveries. False if there was none.
+        bool remove(const std::string &id);
+
+        /// @brief Write `events`, as passed to an RtCallback, to the outbox of each webhook they match.
+        void onChanges(const json &events);
+
+        /**
+         * @brief Settle answered POSTs, then send what is due.
+         * Called by the thread; public for tests.
+         * @return POSTs sent
+         */
+        std::size_t step();
+
+        /// @brief Deliveries waiting in the outbox, in flight ones included.
+        [[nodiscard]] std::size_t pending() const;
+
+        /// @brief `sha256=` and the hex HMAC-SHA256 of `body` under `secret`, for `X-Mantis-Signature`.
+        static std::string signature(const std::string &secret, const std::string &body);
+
+        /// @brief The delay before attempt `attempt` (from 2), grown from `base` and capped at `max`.
+        static std::chrono::seconds backoff(std::size_t attempt, std::chrono::seconds base, std::chrono::seconds max);
+
+        /// @brief Sends on an event loop of its own, one HttpClient per endpoint origin.
+        static Send httpSender(double timeout);
+
+        /// @brief `mb_webhook_deliveries_total{result}`, `mb_webhook_events_total` and `mb_webhook_pending`.
+        void writeMetrics(MetricsWriter &out) const;
+
+    private:
+        /// An answered POST, settled on the thread
+        struct Answer {
+            std::string hook;
+            std::vector<std::string> rows; ///> Outbox ids
+            int status = 0;
+        };
+
+        void loop();
+
+        /// The webhooks, reread once they are older than a few seconds; other nodes may have changed them
+        [[nodiscard]] std::shared_ptr<const std::vector<Hook>> hooks() const;
+
+        /// Write the changes queued by onChanges() to the outbox of each webhook they match
+        void flush(soci::session &sql);
+
+        /// Delete delivered rows, and put failed ones off or drop them
+        void settle(soci::session &sql, const Answer &answer);
+
+        const Options m_options;
+        const Send m_send;
+        const Connect m_connect;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_cv;
+        bool m_stopping = false;
+        bool m_wake = false;
+        std::thread m_thread;
+        Leadership m_leads;
+        std::vector<json> m_incoming;                   ///> Change batches for flush(); guarded by m_mutex
+        std::deque<Answer> m_answers;                   ///> Guarded by m_mutex
+        std::map<std::string, std::size_t> m_inFlight;  ///> POSTs per webhook; guarded by m_mutex
+        std::set<std::string> m_sending;                ///> Outbox rows in flight; guarded by m_mutex
+
+        mutable std::mutex m_hooksMutex;
+        mutable std::shared_ptr<const std::vector<Hook>> m_hooks;      ///> Guarded by m_hooksMutex
+        mutable std::chrono::steady_clock::time_point m_hooksLoaded{}; ///> Guarded by m_hooksMutex
+
+        std::atomic<std::uint64_t> m_delivered{0}, m_failed{0}, m_dropped{0}, m_events{0};
+    };
+}
+
+#endif // MANTISBASE_WEBHOOKS_H
@@ -0,0 +1,67 @@
+/**
+ * @file wire_format.h
+ * @brief JSON, MessagePack and CBOR encodings of API and realtime payloads.
+ *
+ * Responses are encoded as the client's `Accept` header asks, request
+ * bodies are decoded by their `Content-Type`, and realtime subscribers pick
+ * a format with `format=`. All three go through nlohmann's encoders, so a
+ * value means the same in each.
+ * @see MantisResponse::sendJSON(), EncodedEvent
+ */
+
+#ifndef MANTISBASE_WIRE_FORMAT_H
+#define MANTISBASE_WIRE_FORMAT_H
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <nlohmann/json.hpp>
+#include "request_arena.h"
+
+namespace mb {
+    /**
+     * @brief The one serialization interface for payloads leaving (or entering) the server.
+     *
+     * @code
+     * const auto format = WireFormat::negotiate(req.getHeaderValue("Accept", ""));
+     * res.setContent(WireFormat::encode(format, data), std::string(WireFormat::mediaType(format)));
+     * @endcode
+     */
+    class WireFormat {
+    public:
+        enum class Format { Json, MsgPack, Cbor };
+
+        /**
+         * @brief The format an `Accept` value asks for.
+         *
+         * Highest q-value among `application/json`, `application/msgpack`
+         * (or `application/x-msgpack`) and `application/cbor` wins, ties go to
+         * the first listed. Anything else, wildcards included, means JSON.
+         */
+        static Format negotiate(std::string_view accept);
+
+        /// @brief `json`, `msgpack` or `cbor`, as given to `format=`; nullopt for anything else.
+        static std::optional<Format> fromName(std::string_view name);
+
+        /// @brief The format of a request body's `Content-Type`; nullopt if it is none of the three.
+        static std::optional<Format> fromMediaType(std::string_view content_type);
+
+        /// @brief Content-Type of `format`, e.g. `application/msgpack`.
+        static std::string_view mediaType(Format format);
+
+        /// @brief The name fromName() takes.
+        static std::string_view name(Format format);
+
+        /// @brief `value` in `format`; binary for MessagePack and CBOR.
+        static std::string encode(Format format, const nlohmann::json &value);
+        static std::string encode(Format format, const ArenaJson &value);
+
+        /// @brief encode(), with the binary formats in standard base64, for text-only transports like SSE.
+        static std::string encodeText(Format format, const nlohmann::json &value);
+
+        /// @throw nlohmann::json::exception if `bytes` aren't valid `format`
+        static nlohmann::json decode(Format format, std::string_view bytes);
+    };
+}
+
+#endif // MANTISBASE_WIRE_FORMAT_H
@@ -0,0 +1,83 @@
+/**
+ * @file worker_pool.h
+ * @brief Fixed-size thread pool for running blocking work off the HTTP IO loops.
+ */
+
+#ifndef MANTISBASE_WORKER_POOL_H
+#define MANTISBASE_WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mb {
+    /**
+     * @brief Fixed-size pool of worker threads fed from a FIFO queue.
+     *
+     * Used by the Router to run database-bound routes (entity CRUD, auth) so a
+     * slow query blocks one worker instead of a Drogon event loop and every
+     * connection multiplexed on it.
+     *
+     * @code
+     * WorkerPool pool("db");
+     * pool.start(8);
+     * pool.submit([]{ ... blocking work ... });
+     * pool.stop(); // drains queued tasks, then joins
+     * @endcode
+     */
+    class WorkerPool {
+    public:
+        explicit WorkerPool(std::string name);
+        ~WorkerPool();
+
+        WorkerPool(const WorkerPool &) = delete;
+        WorkerPool &operator=(const WorkerPool &) = delete;
+
+        /// Run by each worker thread with its index, before it takes tasks
+        using ThreadInit = std::function<void(size_t)>;
+
+        /**
+         * @brief Spawn `threads` workers. No-op if already running.
+         * @param threads Number of worker threads, clamped to at least 1
+         * @param init Run first on each worker, e.g. to pin it (see ThreadPlacement)
+         */
+        void start(size_t threads, const ThreadInit &init = {});
+
+        /**
+         * @brief Stop accepting tasks, run what is queued, and join the workers.
+         */
+        void stop();
+
+        /**
+         * @brief Queue a task for execution on a worker thread.
+         * @param urgent Queue it ahead of the tasks already waiting
+         * @return false if the pool is not running (the task is not queued)
+         */
+        bool submit(std::function<void()> task, bool urgent = false);
+
+        [[nodiscard]] bool isRunning() const { return m_running.load(); }
+
+        /// Number of worker threads.
+        [[nodiscard]] size_t size() const;
+
+        /// Tasks queued but not yet picked up by a worker.
+        [[nodiscard]] size_t pending() const;
+
+    private:
+        void workerLoop();
+
+        std::string m_name;
+        std::atomic<bool> m_running{false};
+        mutable std::mutex m_mutex;
+        std::condition_variable m_cv;
+        std::deque<std::function<void()>> m_tasks;
+        std::vector<std::thread> m_threads;
+    };
+}
+
+#endif // MANTISBASE_WORKER_POOL_H
@@ -0,0 +1,122 @@
+/**
+ * @file write_queue.h
+ * @brief Group-committing write queue for the single SQLite writer connection.
+ *
+ * In single-writer mode (MB_SQLITE_SINGLE_WRITER=1) the pooled sessions are
+ * read-only and every write runs on one writer connection. Writes submitted
+ * from any thread queue up here; the writer thread takes everything that
+ * arrives within a short window (MB_SQLITE_GROUP_COMMIT_MS) and commits it as
+ * one transaction, so concurrent writers share a single fsync instead of
+ * waiting on each other through SQLite's busy timeout.
+ * @see database.h
+ */
+
+#ifndef MANTISBASE_WRITE_QUEUE_H
+#define MANTISBASE_WRITE_QUEUE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace soci {
+    class session;
+}
+
+namespace mb {
+    /**
+     * @brief MPSC queue of write jobs, executed by one thread in group commits.
+     *
+     * Each job runs inside a SAVEPOINT of the group's transaction: a job that
+     * throws is rolled back on its own and its caller gets the exception, while
+     * the rest of the group still commits. Jobs must not open transactions of
+     * their own. Thread-safe.
+     *
+     * @code
+     * WriteQueue queue([&] { return db.writeSession(); }, WriteQueue::Options::fromEnv());
+     * queue.start();
+     * queue.run([&](soci::session &sql) { sql << "DELETE FROM posts WHERE id = :id", soci::use(id); });
+     * @endcode
+     */
+    class WriteQueue {
+    public:
+        using Job = std::function<void(soci::session &)>;
+        /// Leases the writer session for the duration of a group.
+        using Lease = std::function<std::shared_ptr<soci::session>()>;
+
+        struct Options {
+            std::chrono::milliseconds window{2}; ///> How long a group waits for more jobs; 0 takes only what is queued
+            std::size_t maxGroup = 128;          ///> Max jobs committed together
+
+            /// @brief Read MB_SQLITE_GROUP_COMMIT_MS and MB_SQLITE_GROUP_COMMIT_MAX.
+            static Options fromEnv();
+        };
+
+        struct Stats {
+            std::uint64_t jobs = 0;     ///> Jobs executed
+            std::uint64_t failed = 0;   ///> Jobs rolled back on error
+            std::uint64_t groups = 0;   ///> Transactions committed
+            std::size_t pending = 0;    ///> Jobs waiting for the writer
+        };
+
+        WriteQueue(Lease lease, Options options);
+        ~WriteQueue();
+
+        WriteQueue(const WriteQueue &) = delete;
+        WriteQueue &operator=(const WriteQueue &) = delete;
+
+        /// @brief Start the writer thread.
+        void start();
+
+        /// @brief Run the queued jobs, then stop the writer thread. Idempotent.
+        void stop();
+
+        /**
+         * @brief Queue `job` and wait until its group has committed.
+         * @throws Whatever `job` threw, or the commit error of its group
+         */
+        void run(Job job);
+
+        /**
+         * @brief Run `job` inside a SAVEPOINT on `sql`.
+         *
+         * For a write issued while the writer is already held on this thread
+         * (from within a job, or under a Database::writeSession() lease), which
+         * would otherwise wait on itself in the queue.
+         */
+        static void runNested(soci::session &sql, const Job &job);
+
+        /// @brief True if the calling thread is the writer thread.
+        [[nodiscard]] bool onWriterThread() const;
+
+        [[nodiscard]] Stats stats() const;
+
+    private:
+        struct Pending {
+            Job job;
+            std::promise<void> done;
+        };
+
+        void loop();
+        void commitGroup(std::deque<Pending> &group);
+
+        Lease m_lease;
+        Options m_options;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_cv;
+        std::deque<Pending> m_queue;
+        bool m_stopping = false;
+        std::thread m_thread;
+
+        std::uint64_t m_jobs = 0, m_failed = 0, m_groups = 0; ///> Guarded by m_mutex
+    };
+}
+
+#endif // MANTISBASE_WRITE_QUEUE_H
@@ -1,14 +1,24 @@
 #ifndef MANTISBASE_WS_H
 #define MANTISBASE_WS_H
 
+#include <chrono>
+#include <functional>
 #include <mutex>
-#include <set>
+#include <optional>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <drogon/WebSocketController.h>
 #include <nlohmann/json.hpp>
 #include <mantisbase/mantis.h>
+#include <mantisbase/core/realtime_event.h>
+#include <mantisbase/core/send_queue.h>
+#include <mantisbase/core/realtime_access.h>
+#include <mantisbase/core/topic_filter.h>
+#include <mantisbase/core/topic_index.h>
+#include <mantisbase/core/channels.h>
+#include <mantisbase/core/realtime_snapshot.h>
+#include <mantisbase/core/stream_limits.h>
 
 namespace mb {
     using json = nlohmann::json;
@@ -18,27 +28,98 @@ namespace mb {
         explicit WSMgr(const MantisBase&);
         ~WSMgr() = default;
 
-        void addConnection(const drogon::WebSocketConnectionPtr &conn);
+        /**
+         * Track `conn`; change events are filtered against `auth` (guest if null).
+         * `batch` opts the connection into `batch` frames (see SendQueue::Options::batch), and a
+         * non-empty `fields` limits change payloads to those row fields. A binary `format`
+         * sends change and batch frames as binary messages; control messages stay JSON text.
+         * `delta` sends updates with only the fields they changed (see EncodedEvent::delta()).
+         * The `ticket` from StreamLimits::acquire() is held until the connection is removed,
+         * and shuts it down if a newer stream evicts it.
+         */
+        void addConnection(const drogon::WebSocketConnectionPtr &conn,
+                           std::shared_ptr<const RealtimeAuth> auth = nullptr,
+                           bool batch = false,
+                           EncodedEvent::FieldSet fields = {},
+                           WireFormat::Format format = WireFormat::Format::Json,
+                           bool delta = false,
+                           std::unique_ptr<StreamLimits::Ticket> ticket = nullptr);
         void removeConnection(const drogon::WebSocketConnectionPtr &conn);
 
-        void subscribe(const drogon::WebSocketConnectionPtr &conn,
-                       const std::vector<std::string> &topics);
+        /**
+         * @brief Add `topics` to the connection's subscriptions.
+         *
+         * With `resume_from`, retained changes after that event id on these
+         * topics are queued ahead of any live event, without duplicates. With
+         * a `snapshot` (see SSEMgr::takeSnapshot()), the changes after it that
+         * its rows don't show are queued instead; the caller sends its frames.
+         * @return Event id the connection is caught up to, or std::nullopt if
+         *         the requested changes are no longer retained (client should reload)
+         * @throws MantisException (400) if an `entity?<filter>` topic names no
+         *         entity or its filter does not compile, or a `@<channel>` is not
+         *         declared; (403) if the channel's subscribe rule refuses the
+         *         connection. Nothing is subscribed then
+         */
+        std::optional<std::uint64_t> subscribe(const drogon::WebSocketConnectionPtr &conn,
+                                               const std::vector<std::string> &topics,
+                                               std::optional<std::uint64_t> resume_from = std::nullopt,
+                                               const RealtimeSnapshot *snapshot = nullptr);
         void unsubscribe(const drogon::WebSocketConnectionPtr &conn,
                          const std::vector<std::string> &topics);
 
+        /**
+         * @brief Send a change event to connections subscribed to `entity`,
+         * `entity:<row_id>`, `entity:*` or an `entity?<filter>` the row
+         * matches (see TopicFilters). Recipients are looked up in the
+         * topic index, filtered against the entity `list` rule (`get` for row
+         * topics) in each connection's auth context, and the event is pushed
+         * onto each connection's queue, drained on the connection's own loop.
+         */
         void broadcastChange(const json &change_event);
 
+        /// @brief Same as above, reusing an event already encoded by the caller.
+        void broadcastChange(const std::shared_ptr<const EncodedEvent> &event);
+
+        /// @brief Queue a channel frame for the connections subscribed to `topic` (see SSEMgr::deliverEphemeral()).
+        void deliverEphemeral(const std::string &topic, const std::shared_ptr<const EncodedEvent> &event);
+
+        /// @brief The auth context of `conn`; guest if it isn't tracked.
+        std::shared_ptr<const RealtimeAuth> authOf(const drogon::WebSocketConnectionPtr &conn);
+
+        /// @brief The row fields `conn` asked for; empty for the whole row or if it isn't tracked.
+        EncodedEvent::FieldSet fieldsOf(const drogon::WebSocketConnectionPtr &conn);
+
         size_t connectionCount();
 
+        /// @brief Send each connection a `reconnect` message and close it (see SSEMgr::sendReconnect()).
+        std::size_t sendReconnect(const std::function<std::chrono::milliseconds()> &delay, std::uint64_t last_id);
+
+        /** Outbound queue metrics for WS connections (see SSEMgr::queueStats()). */
+        json queueStats();
+
     private:
-        bool isInterestedIn(const std::set<std::string> &topics, const json &change_event) const;
-        json formatEvent(const json &change_event) const;
+        struct ConnState {
+            std::string id;              ///> Tells its presence apart from the same user's other connections
+            std::vector<TopicId> topics; ///> Ids in m_topics
+            std::shared_ptr<SendQueue> queue;
+            std::shared_ptr<const RealtimeAuth> auth;
+            std::uint64_t replayedUpTo = 0; ///> Live events up to this id were already replayed
+            std::shared_ptr<const EncodedEvent::FieldSet> fields = std::make_shared<const EncodedEvent::FieldSet>();
+            bool delta = false; ///> Updates carry only their changed fields
+            std::unique_ptr<StreamLimits::Ticket> ticket; ///> Its place under the per-IP and per-user caps
+        };
 
         std::mutex m_mutex;
-        std::unordered_map<drogon::WebSocketConnectionPtr,
-                           std::set<std::string>> m_connTopics;
-        std::unordered_map<std::string,
-                           std::unordered_set<drogon::WebSocketConnectionPtr>> m_topicConns;
+        std::unordered_map<drogon::WebSocketConnectionPtr, ConnState> m_conns;
+        /// Topic -> the states of its connections; m_conns never moves them, and unindex() runs before erasing one
+        TopicIndex<ConnState *> m_topics;
+        TopicFilters m_filters; ///> The `entity?<filter>` topics of m_topics, under m_mutex
+
+        /// Drop `state`'s subscription to `id`, unwatching its entity after the last one; under m_mutex.
+        /// Adds the channel it was on, if any, to `left`.
+        void unindex(ConnState &state, TopicId id, std::vector<std::string> &left);
+        SendQueue::Options m_queueOptions;
+        std::shared_ptr<SendQueue::Counters> m_queueCounters;
         const MantisBase& m_app;
     };
 
@@ -18,6 +18,7 @@
 #include "mantisbase.h"
 
 // Core components
+#include "core/async_handler.h"
 #include "core/context_store.h"
 #include "core/database.h"
 #include "core/exceptions.h"
@@ -35,6 +36,7 @@
 // Models and data structures
 #include "core/models/validators.h"
 #include "core/models/entity.h"
+#include "core/models/entity_query.h"
 #include "core/models/entity_schema.h"
 #include "core/models/entity_schema_field.h"
 
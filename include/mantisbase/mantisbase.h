@@ -19,14 +19,28 @@
 #include <argparse/argparse.hpp>
 #ifdef MB_SCRIPTING_ENABLED
 #include <dukglue/dukglue.h>
+#include "core/script_heaps.h"
 #endif
 
 #include "core/types.h"
 #include "core/kv_store.h"
+#include "core/listener_options.h"
 
 namespace mb
 {
     class RealtimeDB;
+    class Storage;
+    class FileCleanup;
+    class SessionStore;
+    class AppKv;
+    class SchemaMigrations;
+    class IndexAdvisor;
+    class SlowQueryLog;
+    class MaterializedViews;
+    class RealtimeProbe;
+    class Tenants;
+    class EntityShards;
+    class Scheduler;
     /**
      * @brief MantisBase entry point.
      *
@@ -89,6 +103,7 @@ namespace mb
          * {
          *     "db": "<db type>",
          *     "db_url": "<connection string>",
+         *     "db_replica_urls": ["<replica connection string>", ...],
          *     "data-dir": "<path to dir>",
          *     "public-dir": "<path to dir>",
          *     "scripts-dir": "<path to dir>",
@@ -98,6 +113,15 @@ namespace mb
          *         "port": <int>,
          *         "host": "<host IP/addr>",
          *         "pool-size": <int>,
+         *         "db-workers": <int>,
+         *         "threads": <int>,
+         *         "reuse-port": <bool>,
+         *         "idle-timeout": <int>,
+         *         "keepalive-requests": <int>,
+         *         "max-connections": <int>,
+         *         "max-connections-per-ip": <int>,
+         *         "tls-cert": "<path to PEM>",
+         *         "tls-key": "<path to PEM>",
          *         "skip-admin-setup": <bool>
          *     },
          *     "admins": {
@@ -178,6 +202,45 @@ namespace mb
          */
         [[nodiscard]] int poolSize() const;
 
+        /**
+         * @brief Number of worker threads running database-bound routes off the
+         * HTTP IO loops (`serve --db-workers`, overridden by MB_DB_WORKERS).
+         * @return Worker count; defaults to the database pool size.
+         */
+        [[nodiscard]] int dbWorkers() const;
+        void setDbWorkers(const int& workers);
+
+        /**
+         * @brief Connection strings of the PostgreSQL read replicas (`--db-replica-url`,
+         * repeatable; overridden by MB_DATABASE_REPLICA_URLS, separated by `;`).
+         * @return Replica URLs; empty when every read goes to the primary.
+         */
+        [[nodiscard]] std::vector<std::string> dbReplicaUrls() const;
+        void setDbReplicaUrls(const std::vector<std::string>& urls);
+
+        /**
+         * @brief Number of HTTP IO event loops (`serve --threads`, overridden by MB_HTTP_THREADS).
+         * A configured value of `0` resolves to the number of hardware threads.
+         * @return Resolved IO thread count, always >= 1.
+         */
+        [[nodiscard]] int httpThreads() const;
+        void setHttpThreads(const int& threads);
+
+        /**
+         * @brief Whether each IO loop binds its own SO_REUSEPORT listener
+         * (`serve --reuse-port`, also MB_HTTP_REUSE_PORT=1).
+         */
+        [[nodiscard]] bool reusePort() const;
+        void setReusePort(bool reuse);
+
+        /**
+         * @brief Connection reuse, limits and TLS of the HTTP listener: the `http`
+         * setting, overridden by the `serve` flags, overridden by MB_HTTP_* / MB_TLS_*.
+         */
+        [[nodiscard]] ListenerOptions listenerOptions() const;
+        /// @brief The `serve` flags' layer, as ListenerOptions::merge() takes it.
+        void setListenerFlags(const json& flags);
+
         /**
          * @brief Retrieve HTTP Server host address. For instance, a host of `127.0.0.1`, `0.0.0.0`, etc.
          * @return HTTP Server Host address.
@@ -269,8 +332,10 @@ namespace mb
         /// Fetch the patch version
         static int appPatchVersion();
 
-        /// Get the database unit object
+        /// Get the database unit object; within a tenant's request, the tenant's database (see Tenants), and within an EntityShards::Scope, that shard
         [[nodiscard]] Database& db() const;
+        /// Get the application's own database, whichever tenant the calling request is scoped to
+        [[nodiscard]] Database& rootDb() const;
         /// Get the commandline parser object
         [[nodiscard]] argparse::ArgumentParser& cmd() const;
         /// Get the router object instance.
@@ -281,6 +346,30 @@ namespace mb
         [[nodiscard]] Logger& logs() const;
         /// Get the realtime unit (SQLite/PostgreSQL change detection for SSE /api/v1/realtime).
         [[nodiscard]] RealtimeDB& rt() const;
+        /// Get the file storage unit (local disk or S3, see MB_STORAGE).
+        [[nodiscard]] Storage& storage() const;
+        /// Get the queue removing files dropped from records, see FileCleanup.
+        [[nodiscard]] FileCleanup& fileCleanup() const;
+        /// Get the group writer and sweeper of `mb_sessions`, see SessionStore.
+        [[nodiscard]] SessionStore& sessionStore() const;
+        /// Get the application key-value pairs behind `/api/v1/kv`, see AppKv.
+        [[nodiscard]] AppKv& kv() const;
+        /// Get the runner of online schema migrations, see SchemaMigrations.
+        [[nodiscard]] SchemaMigrations& schemaMigrations() const;
+        /// Get the recorder of unindexed list queries, see IndexAdvisor.
+        [[nodiscard]] IndexAdvisor& indexAdvisor() const;
+        /// Get the log of statements slower than MB_SLOW_QUERY_MS, see SlowQueryLog.
+        [[nodiscard]] SlowQueryLog& slowQueryLog() const;
+        /// Get the refresher of materialized view entities, see MaterializedViews.
+        [[nodiscard]] MaterializedViews& materializedViews() const;
+        /// Get the commit-to-delivery latency probe of the realtime pipeline, see RealtimeProbe.
+        [[nodiscard]] RealtimeProbe& realtimeProbe() const;
+        /// Get the per-tenant databases, off unless MB_TENANTS is set, see Tenants.
+        [[nodiscard]] Tenants& tenants() const;
+        /// Get the shard databases of entities spread over several SQLite files, see EntityShards.
+        [[nodiscard]] EntityShards& shards() const;
+        /// Get the runner of housekeeping and script jobs on cron schedules, see Scheduler.
+        [[nodiscard]] Scheduler& scheduler() const;
 
         /**
          * @brief Fetch a table schema encapsulated by an `Entity` object from given the table name.
@@ -291,6 +380,17 @@ namespace mb
          */
         [[nodiscard]] Entity entity(const std::string& entity_name) const;
 
+        /**
+         * @brief Like entity(), but shares the cached `Entity` instead of copying it.
+         *
+         * What a request path should use: the snapshot doesn't change under
+         * the caller, even if the schema is updated meanwhile.
+         *
+         * @param entity_name Name of the table of interest
+         * @return Cached entity, never null
+         */
+        [[nodiscard]] std::shared_ptr<const Entity> entitySnapshot(const std::string& entity_name) const;
+
         /**
          * @brief Check if table schema encapsulated by an `Entity` object from given the table name exists.
          * If table does not exist yet, return false.
@@ -300,9 +400,23 @@ namespace mb
          */
         [[nodiscard]] bool hasEntity(const std::string& entity_name) const;
 
-        /// Get the duktape context
+        /// Get the calling thread's duktape context, created on first use
 #ifdef MB_SCRIPTING_ENABLED
         [[nodiscard]] duk_context* ctx() const;
+
+        /// Time budgets for hooks and routes, see ScriptHeaps::Budget
+        [[nodiscard]] const ScriptHeaps::Budgets& scriptBudgets() const;
+
+        /**
+         * @brief Load the start script again on fresh heaps and swap it in, see ScriptHeaps::reload().
+         * Script jobs are scheduled anew; see Router::scriptsReloaded().
+         * @return Scripts now loaded
+         * @throw MantisException (500) if a script fails, the old ones staying in place; (404) without scripting
+         */
+        std::size_t reloadScripts() const;
+
+        /// Rebuild the calling thread's heap after a reloadScripts(); called between requests and jobs
+        void scriptsCheckpoint() const;
 #endif
 
 
@@ -362,6 +476,13 @@ namespace mb
          */
         void initJSEngine();
 
+        /**
+         * @brief Register Mantis functions and objects (`app`, `console`, ...) on a fresh heap.
+         *
+         * @param ctx Heap being set up; ctx() returns it while this runs
+         */
+        void registerJSBindings(duk_context* ctx);
+
         /**
          * @brief Load startup `.js` file `index.mantis.js` from the mantis
          * scripts directory.
@@ -394,6 +515,7 @@ namespace mb
          */
         [[nodiscard]] Database* duk_db() const;
         [[nodiscard]] Router* duk_router() const;
+        [[nodiscard]] AppKv* duk_kv() const;
 #endif
 
         // Store commandline args passed in, to be used in the init phase.
@@ -420,6 +542,11 @@ namespace mb
 
         //
         int m_poolSize = 2;
+        int m_dbWorkers = 0; ///> 0 = follow m_poolSize
+        std::vector<std::string> m_dbReplicaUrls;
+        int m_httpThreads = 4; ///> 0 = all cores
+        bool m_reusePort = false;
+        json m_listenerFlags = json::object();
         bool m_toStartServer = false;
         bool m_launchAdminPanel = false;
         bool m_isDevMode = false;
@@ -430,9 +557,21 @@ namespace mb
         std::unique_ptr<RealtimeDB> m_realtime;
         std::unique_ptr<Router> m_router;
         std::unique_ptr<KeyValStore> m_kvStore;
+        std::unique_ptr<Storage> m_storage;
+        std::unique_ptr<FileCleanup> m_fileCleanup;
+        std::unique_ptr<SessionStore> m_sessionStore;
+        std::unique_ptr<AppKv> m_appKv;
+        std::unique_ptr<SchemaMigrations> m_schemaMigrations;
+        std::unique_ptr<IndexAdvisor> m_indexAdvisor;
+        std::unique_ptr<SlowQueryLog> m_slowQueryLog;
+        std::unique_ptr<MaterializedViews> m_materializedViews;
+        std::unique_ptr<RealtimeProbe> m_realtimeProbe;
+        std::unique_ptr<Tenants> m_tenants;
+        std::unique_ptr<EntityShards> m_shards;
+        std::unique_ptr<Scheduler> m_scheduler;
         std::unique_ptr<argparse::ArgumentParser> m_opts;
 #ifdef MB_SCRIPTING_ENABLED
-        duk_context* m_dukCtx = nullptr;
+        std::unique_ptr<ScriptHeaps> m_scripts; ///> One heap per thread running scripts
 #endif
     };
 }
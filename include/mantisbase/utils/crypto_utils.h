@@ -2,14 +2,67 @@
 #define MANTISBASE_CRYPTO_UTILS_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cstdint>
+#include <memory>
 
 namespace mb {
     std::string generateSecureRandom(size_t length);
 
     std::string sha256Hex(const std::string &input);
 
+    /// @brief Incremental SHA-256, for input that arrives in pieces.
+    class Sha256Hasher {
+    public:
+        Sha256Hasher();
+        ~Sha256Hasher();
+
+        Sha256Hasher(const Sha256Hasher &) = delete;
+        Sha256Hasher &operator=(const Sha256Hasher &) = delete;
+
+        void update(std::string_view data);
+
+        /// @brief Hex digest of everything added; the hasher starts over afterwards.
+        std::string hexDigest();
+
+    private:
+        struct State;
+        std::unique_ptr<State> m_state;
+    };
+
+    /// @brief Raw (binary) HMAC-SHA256 of `data` under `key`.
+    std::string hmacSha256(std::string_view key, std::string_view data);
+
+    /**
+     * @brief HMAC-SHA256 under one key, with the key's padded blocks hashed once.
+     *
+     * hmacSha256() derives and hashes both 64-byte key blocks on every call;
+     * here that is done by the constructor and each sign() resumes from a
+     * copy. Thread-safe once constructed.
+     */
+    class HmacSha256Key {
+    public:
+        explicit HmacSha256Key(std::string_view key);
+        ~HmacSha256Key();
+
+        HmacSha256Key(const HmacSha256Key &) = delete;
+        HmacSha256Key &operator=(const HmacSha256Key &) = delete;
+
+        /// @brief Raw MAC of `data`, as hmacSha256(key, data).
+        [[nodiscard]] std::string sign(std::string_view data) const;
+
+        /// @brief Whether `mac` is the MAC of `data`, compared in constant time.
+        [[nodiscard]] bool verify(std::string_view data, std::string_view mac) const;
+
+    private:
+        struct State;
+        std::unique_ptr<State> m_state;
+    };
+
+    /// @brief Lowercase hex of arbitrary bytes.
+    std::string toHex(std::string_view bytes);
+
     std::string base64UrlEncode(const std::vector<uint8_t> &data);
     std::string base64UrlEncode(const std::string &data);
     std::vector<uint8_t> base64UrlDecode(const std::string &encoded);
@@ -0,0 +1,35 @@
+/**
+ * @file duk_json.h
+ * @brief Values between nlohmann::json and the Duktape value stack, without JSON text.
+ *
+ * Records handed to hooks, context values and bind objects used to be
+ * dumped to text and decoded by Duktape, or the reverse. These walk the
+ * value directly instead. The results are what JSON.stringify() and
+ * JSON.parse() would give: `undefined` and functions are left out of
+ * objects and are `null` in arrays, NaN and Infinity are `null`, and a
+ * whole number comes back as an integer. Values with a `toJSON()` (Dates),
+ * buffers, and values nested past a depth of 64 still go through
+ * duk_json_encode(), so cyclic input raises the same TypeError as before.
+ */
+
+#ifndef MANTISBASE_DUK_JSON_H
+#define MANTISBASE_DUK_JSON_H
+
+#ifdef MB_SCRIPTING_ENABLED
+#include <nlohmann/json.hpp>
+#include <duktape.h>
+#include <dukglue/dukvalue.h>
+
+namespace mb {
+    /// @brief Push `value` onto `ctx`'s stack as a JS value.
+    void dukPushJson(duk_context *ctx, const nlohmann::json &value);
+
+    /// @brief The value at `idx` as JSON; `undefined` and functions are `null`.
+    nlohmann::json dukToJson(duk_context *ctx, duk_idx_t idx);
+
+    /// @brief dukToJson() of a value held outside the stack.
+    nlohmann::json dukToJson(const DukValue &value);
+}
+#endif
+
+#endif // MANTISBASE_DUK_JSON_H
@@ -0,0 +1,32 @@
+/**
+ * @file json_parse.h
+ * @brief JSON parsing for the hot paths: request bodies and realtime change payloads.
+ *
+ * Built with simdjson (MB_HAVE_SIMDJSON), text is parsed by its SIMD front
+ * end and the result rebuilt as nlohmann::json; otherwise, and for anything
+ * simdjson rejects, nlohmann's own parser is used, so the values and the
+ * errors callers see stay the same.
+ */
+
+#ifndef MANTISBASE_JSON_PARSE_H
+#define MANTISBASE_JSON_PARSE_H
+
+#include <string_view>
+#include <nlohmann/json.hpp>
+#include "mantisbase/core/request_arena.h"
+
+namespace mb {
+    /**
+     * @brief Parse `text` as a JSON document.
+     * @throws nlohmann::json::parse_error If `text` isn't valid JSON
+     */
+    nlohmann::json parseJson(std::string_view text);
+
+    /// @brief parseJson(), onto the current request's arena; see RequestArena.
+    ArenaJson parseArenaJson(std::string_view text);
+
+    /// @brief Whether parseJson() goes through simdjson in this build.
+    bool simdJsonEnabled();
+}
+
+#endif // MANTISBASE_JSON_PARSE_H
@@ -0,0 +1,75 @@
+/**
+ * @file request_id.h
+ * @brief Lock-free request ids for the access log.
+ *
+ * Each thread draws ids from its own block: the process start, a slot
+ * taken once per thread, and a local sequence. Nothing is shared between
+ * IO threads per request, and an id is formatted into a buffer on the
+ * stack.
+ */
+
+#ifndef MANTISBASE_REQUEST_ID_H
+#define MANTISBASE_REQUEST_ID_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+namespace mb {
+    /**
+     * @brief `req_` and 16 hex digits: 22 bits of the start time, a 10-bit thread slot, a 32-bit sequence.
+     *
+     * A thread that runs out of sequence takes a new slot, so ids stay
+     * unique within a process; the start time keeps restarts apart.
+     *
+     * @code
+     * const auto id = RequestId::next();
+     * LogOrigin::info("HTTP", fmt::format("... {}", id.view()));
+     * @endcode
+     */
+    class RequestId {
+    public:
+        static constexpr std::size_t LENGTH = 4 + 16;
+
+        /// @brief The next id of the calling thread.
+        static RequestId next() {
+            thread_local std::uint64_t block = takeBlock();
+            thread_local std::uint32_t sequence = 0;
+
+            if (++sequence == 0) block = takeBlock();
+            return RequestId(block | sequence);
+        }
+
+        [[nodiscard]] std::uint64_t value() const { return m_value; }
+
+        /// @brief The formatted id; valid as long as this object.
+        [[nodiscard]] std::string_view view() const { return {m_text.data(), LENGTH}; }
+
+    private:
+        explicit RequestId(const std::uint64_t value) : m_value(value) {
+            static constexpr char HEX[] = "0123456789abcdef";
+            m_text = {'r', 'e', 'q', '_'};
+            for (std::size_t i = 0; i < 16; ++i)
+                m_text[4 + i] = HEX[(value >> (60 - 4 * i)) & 0xF];
+        }
+
+        /// The high 32 bits for a thread's ids; one atomic add per 2^32 ids
+        static std::uint64_t takeBlock() {
+            static const std::uint64_t started = static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::seconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count());
+            static std::atomic<std::uint64_t> slots{0};
+
+            const auto slot = slots.fetch_add(1, std::memory_order_relaxed);
+            // Past 1024 slots the start-time bits take the carry, still unique in-process
+            return ((started & 0x3FFFFF) << 42) + (slot << 32);
+        }
+
+        std::uint64_t m_value;
+        std::array<char, LENGTH> m_text{};
+    };
+}
+
+#endif // MANTISBASE_REQUEST_ID_H
@@ -11,157 +11,659 @@
 
 #include "utils.h"
 #include "../mantisbase.h"
+#include "mantisbase/core/exceptions.h"
+#include "mantisbase/core/field_compression.h"
 #include "mantisbase/core/models/entity_schema_field.h"
+#include "mantisbase/core/models/entity_geo.h"
+#include "mantisbase/core/vector_index.h"
 #include "soci/values.h"
+#include "soci/row.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <iomanip>
+#include <cmath>
+#include <sstream>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 namespace mb {
-    inline soci::values json2SociValue(const json &entity, const json &fields) {
-        if (!fields.is_array()) throw std::invalid_argument("Fields must be an array");
+    /**
+     * @brief Replace a non-empty `password` in `record` with its hash.
+     *
+     * For binds made inside a write; hashing there would hold the
+     * transaction open for tens of milliseconds per record.
+     * @return Whether it was hashed
+     */
+    inline bool hashPasswordField(json &record) {
+        if (!record.is_object() || !record.contains("password") || !record["password"].is_string() ||
+            record["password"].get_ref<const std::string &>().empty())
+            return false;
+        record["password"] = hashPassword(record["password"].get<std::string>());
+        return true;
+    }
 
-        soci::values vals;
-        // Bind parameters dynamically
+    inline int getColumnPrecision(const std::string &column_name, const std::vector<json> &fields) {
         for (const auto &field: fields) {
-            const auto field_name = field.at("name").get<std::string>();
+            if (field.value("name", "") == column_name)
+                return field.value("precision", 32);
+        }
+        return 32;
+    }
+
+    inline std::string getColumnType(const std::string &column_name, const std::vector<json> &fields) {
+        if (column_name.empty()) throw std::invalid_argument("Column name can't be empty!");
 
-            if (field_name == "id" || field_name == "created" || field_name == "updated") {
-                continue;
+        for (const auto &field: fields) {
+            if (field.value("name", "") == column_name)
+                return field.at("type").get<std::string>();
+        }
+
+        throw std::runtime_error("No field type found matching column `" + column_name + "'");
+    }
+
+    /**
+     * @brief Precompiled, schema-indexed decoder for `soci::row` -> JSON.
+     *
+     * Built once from an entity's field list, it maps every column name to its
+     * field type, integer precision and a decode function, so decoding a row
+     * costs one hash lookup per column instead of a linear scan of the schema.
+     * For result sets (where every row has the same shape), `plan()` resolves
+     * the column ordinals once and `decode(row, plan)` skips the lookups
+     * entirely.
+     *
+     * Instances are immutable after construction and safe to share across
+     * threads; Entity keeps one behind a shared pointer.
+     */
+    class RowCodec {
+    public:
+        /// Decodes the (non-null) value at the given ordinal.
+        using DecodeFn = json (*)(const soci::row &, std::size_t);
+
+        /// Field types as decoded and bound; `xml` and `string` are both Text
+        enum class Kind : std::uint8_t { Unknown, Text, File, Double, Date, Int, Json, Bool, Files, Vector, Blob, GeoPoint };
+
+        struct Column {
+            std::string name;
+            std::string type;
+            Kind kind = Kind::Unknown;
+            int precision = 32;
+            int dim = 0; ///< Dimensions of a `vector` field
+            bool system = false; ///< `id`, `created` or `updated`, never bound from a request
+            bool compress = false; ///< Marked `compress`: whole values only, not filtered or sorted on
+            bool secret = false; ///< `password`, stored hashed: never filtered, sorted or aggregated on
+            DecodeFn decode = nullptr; ///< nullptr for unknown types
+            bool valid = true; ///< false when the field type is unknown
+        };
+
+        /// Column ordinal -> decoder, resolved for one result-set shape.
+        using Plan = std::vector<const Column *>;
+
+        RowCodec() = default;
+
+        /// @param deflate Whether bind() stores `compress` fields compressed, see FieldCompression; SQLite only
+        explicit RowCodec(const std::vector<json> &fields, const bool deflate = false) : m_deflate(deflate) {
+            m_columns.reserve(fields.size());
+            m_index.reserve(fields.size());
+            for (const auto &field: fields) {
+                Column col;
+                col.name = field.value("name", "");
+                // First definition wins, matching the previous linear lookup
+                if (col.name.empty() || m_index.contains(col.name)) continue;
+
+                col.type = field.contains("type") && field["type"].is_string()
+                               ? field["type"].get<std::string>()
+                               : "";
+                col.kind = kindOf(col.type);
+                col.precision = field.value("precision", 32);
+                col.dim = field.value("dim", 0);
+                col.system = col.name == "id" || col.name == "created" || col.name == "updated";
+                col.compress = field.value("compress", false);
+                col.secret = col.name == "password";
+                col.valid = !col.type.empty() && EntitySchemaField::isValidFieldType(col.type);
+                col.decode = decoderFor(col.type, col.precision, col.compress);
+
+                m_index.emplace(col.name, m_columns.size());
+                m_columns.push_back(std::move(col));
             }
-            // Skip fields that are not in the JSON object
-            if (!entity.contains(field_name)) continue;
-
-            // For password types, hash before binding (null password = OAuth-only user)
-            if (field_name == "password") {
-                if (entity[field_name].is_null() || (entity[field_name].is_string() && entity[field_name].get<std::string>().empty())) {
-                    std::optional<int> val;
-                    vals.set(field_name, val, soci::i_null);
+        }
+
+        [[nodiscard]] bool empty() const { return m_columns.empty(); }
+
+        /// Every field, in schema order.
+        [[nodiscard]] const std::vector<Column> &columns() const { return m_columns; }
+
+        /**
+         * @brief Find the decoder for a column name.
+         * @return Pointer to the column decoder, or nullptr if not in the schema.
+         */
+        [[nodiscard]] const Column *column(const std::string &name) const {
+            const auto it = m_index.find(name);
+            return it == m_index.end() ? nullptr : &m_columns[it->second];
+        }
+
+        /**
+         * @brief Bind the fields present in `record` into `vals`.
+         *
+         * Each value is bound as `:<field><suffix>`, so several records can share
+         * one statement (e.g. a multi-row INSERT binding `:title0`, `:title1`).
+         * `password` is hashed unless `hash_passwords` is false, for values hashed
+         * already outside the write (see hashPasswordField()).
+         */
+        void bind(soci::values &vals, const json &record, const std::string &suffix = "",
+                  const bool hash_passwords = true) const {
+            for (const auto &col: m_columns) {
+                if (col.system) continue;
+                // Skip fields that are not in the JSON object
+                const auto it = record.find(col.name);
+                if (it == record.end()) continue;
+                const auto &value = *it;
+                const auto param = col.name + suffix;
+
+                // For password types, hash before binding (null password = OAuth-only user)
+                if (col.name == "password") {
+                    if (value.is_null() || (value.is_string() && value.get_ref<const std::string &>().empty())) {
+                        std::optional<int> val;
+                        vals.set(param, val, soci::i_null);
+                        continue;
+                    }
+                    vals.set(param, hash_passwords ? hashPassword(value.get<std::string>()) : value.get<std::string>());
+                    continue;
+                }
+
+                // If the value is null, set i_null and continue
+                if (value.is_null()) {
+                    std::optional<int> val; // Set to optional, no value is set in db
+                    vals.set(param, val, soci::i_null);
                     continue;
                 }
-                auto hashed_password = hashPassword(entity.at(field_name).get<std::string>());
-                vals.set(field_name, hashed_password);
-                continue;
+
+                // Typed reads of the value found above; a mismatched JSON type throws as before
+                switch (col.kind) {
+                    case Kind::Text:
+                        vals.set(param, m_deflate && col.compress ? FieldCompression::deflate(value.get<std::string>())
+                                                                  : value.get<std::string>());
+                        break;
+                    case Kind::File:
+                        vals.set(param, value.get<std::string>());
+                        break;
+                    case Kind::Double:
+                        vals.set(param, value.get<double>());
+                        break;
+                    case Kind::Date: {
+                        const auto &dt_str = value.get_ref<const std::string &>();
+                        if (dt_str.empty()) {
+                            vals.set(param, 0, soci::i_null);
+                            break;
+                        }
+                        std::tm tm{};
+                        if (!parseIsoDateTime(dt_str, tm))
+                            throw MantisException(400, std::format("Field `{}` expects an ISO 8601 date, "
+                                                                   "`YYYY-MM-DDTHH:MM:SS`.", col.name));
+                        vals.set(param, tm);
+                        break;
+                    }
+                    case Kind::Int:
+                        switch (col.precision) {
+                            case 8: vals.set(param, static_cast<int8_t>(value.get<int>())); break;
+                            case 16: vals.set(param, static_cast<int16_t>(value.get<int>())); break;
+                            case 64: vals.set(param, value.get<int64_t>()); break;
+                            default: vals.set(param, value.get<int32_t>()); break;
+                        }
+                        break;
+                    case Kind::Blob:
+                        // Only ever cleared here (null, above); the bytes go through Entity::writeBlob()
+                        throw MantisException(400, std::format("Blob field `{}` is written through "
+                                                               "`/api/v1/entities/<entity>/<id>/blobs/{}`.",
+                                                               col.name, col.name));
+                    case Kind::Json:
+                        if (m_deflate && col.compress) vals.set(param, FieldCompression::deflate(value.dump()));
+                        else vals.set(param, value);
+                        break;
+                    case Kind::Files:
+                        vals.set(param, value);
+                        break;
+                    case Kind::Bool:
+                        vals.set(param, value.get<bool>());
+                        break;
+                    case Kind::Vector:
+                        // Throws 400 unless it's an array of `dim` numbers
+                        vals.set(param, VectorIndex::encode(VectorIndex::parse(value, col.dim)));
+                        break;
+                    case Kind::GeoPoint:
+                        // Throws 400 unless it's a {lat, lng} in range
+                        vals.set(param, EntityGeo::encode(EntityGeo::parse(value, col.name)));
+                        break;
+                    case Kind::Unknown:
+                        break;
+                }
             }
+        }
 
-            // If the value is null, set i_null and continue
-            if (entity[field_name].is_null()) {
-                std::optional<int> val; // Set to optional, no value is set in db
-                vals.set(field_name, val, soci::i_null);
-                continue;
+        /**
+         * @brief The value bind() binds for field `name`, as a PostgreSQL text-format parameter.
+         *
+         * Checked and converted as bind() does, for statements sent past SOCI
+         * (see PgPipeline). Booleans are integer columns there, `1` or `0`.
+         * @return std::nullopt for NULL, and for fields not in the schema
+         */
+        [[nodiscard]] std::optional<std::string> text(const std::string &name, const json &value,
+                                                      const bool hash_passwords = true) const {
+            const auto *col = column(name);
+            if (!col || col->kind == Kind::Unknown || value.is_null()) return std::nullopt;
+            if (col->name == "password") {
+                if (value.is_string() && value.get_ref<const std::string &>().empty()) return std::nullopt;
+                return hash_passwords ? hashPassword(value.get<std::string>()) : value.get<std::string>();
             }
 
-            // For non-null values, set the value accordingly
-            const auto field_type = field.at("type").get<std::string>();
-            if (field_type == "xml" || field_type == "string" || field_type == "file") {
-                vals.set(field_name, entity.value(field_name, ""));
-            } else if (field_type == "double") {
-                vals.set(field_name, entity.value(field_name, 0.0));
-            } else if (field_type == "date") {
-                auto dt_str = entity.value(field_name, "");
-                if (dt_str.empty()) {
-                    vals.set(field_name, 0, soci::i_null);
-                } else {
+            switch (col->kind) {
+                case Kind::Text:
+                case Kind::File:
+                    return value.get<std::string>();
+                case Kind::Double:
+                    return std::format("{}", value.get<double>());
+                case Kind::Date: {
+                    const auto &dt_str = value.get_ref<const std::string &>();
+                    if (dt_str.empty()) return std::nullopt;
                     std::tm tm{};
-                    std::istringstream ss{dt_str};
-                    ss >> std::get_time(&tm, "%Y-%m-%dT%H:%M:%S");
+                    if (!parseIsoDateTime(dt_str, tm))
+                        throw MantisException(400, std::format("Field `{}` expects an ISO 8601 date, "
+                                                               "`YYYY-MM-DDTHH:MM:SS`.", col->name));
+                    return tmToStr(tm);
+                }
+                case Kind::Int:
+                    switch (col->precision) {
+                        case 8: return std::to_string(static_cast<int8_t>(value.get<int>()));
+                        case 16: return std::to_string(static_cast<int16_t>(value.get<int>()));
+                        case 64: return std::to_string(value.get<int64_t>());
+                        default: return std::to_string(value.get<int32_t>());
+                    }
+                case Kind::Blob:
+                    throw MantisException(400, std::format("Blob field `{}` is written through "
+                                                           "`/api/v1/entities/<entity>/<id>/blobs/{}`.",
+                                                           col->name, col->name));
+                case Kind::Json:
+                case Kind::Files:
+                    return value.dump();
+                case Kind::Bool:
+                    return value.get<bool>() ? "1" : "0";
+                case Kind::Vector:
+                    return VectorIndex::encode(VectorIndex::parse(value, col->dim));
+                case Kind::GeoPoint:
+                    return EntityGeo::encode(EntityGeo::parse(value, col->name));
+                case Kind::Unknown:
+                    break;
+            }
+            return std::nullopt;
+        }
+
+        /**
+         * @brief Resolve column ordinals of `row` to decoders.
+         *
+         * Throws if a column is missing from the schema or has an unknown type,
+         * mirroring the checks `sociRow2Json` has always made.
+         *
+         * @param count Resolve only the first `count` columns, for statements
+         *        returning extra columns after the record's
+         */
+        [[nodiscard]] Plan plan(const soci::row &row, const std::size_t count = std::string::npos) const {
+            if (m_columns.empty())
+                throw std::invalid_argument("Reference schema fields can't be empty!");
+
+            const auto n = std::min(count, row.size());
+            Plan p;
+            p.reserve(n);
+            for (std::size_t i = 0; i < n; ++i) {
+                const auto &colName = row.get_properties(i).get_name();
+                if (colName.empty()) throw std::invalid_argument("Column name can't be empty!");
+
+                const auto *col = column(colName);
+                if (!col)
+                    throw std::runtime_error("No field type found matching column `" + colName + "'");
+                if (!col->valid)
+                    throw std::runtime_error(std::format("Unknown column type `{}` for column `{}`",
+                                                         col->type, colName));
+                p.push_back(col);
+            }
+            return p;
+        }
+
+        /// Decode a row whose shape was resolved with `plan()`; columns past the plan are left out.
+        [[nodiscard]] json decode(const soci::row &row, const Plan &plan) const {
+            if (plan.size() > row.size())
+                throw std::runtime_error("Row shape does not match the decode plan");
+
+            json res_json = json::object();
+            for (std::size_t i = 0; i < plan.size(); ++i) {
+                const auto *col = plan[i];
+
+                // Handle null values immediately
+                if (row.get_indicator(i) == soci::i_null) {
+                    res_json[col->name] = nullptr;
+                    continue;
+                }
+
+                if (!col->decode) continue;
+
+                res_json[col->name] = col->decode(row, i);
+            }
+            return res_json;
+        }
+
+        /**
+         * @brief Serialize a row straight into a JSON text buffer.
+         *
+         * Produces the same object `decode()` would, without building a json
+         * DOM for scalar columns; only json/list/files columns round-trip
+         * through nlohmann. Used by list endpoints that stream a whole page
+         * into the response body.
+         *
+         * @param out Buffer to append the JSON object to
+         * @param skip_column Column to leave out (e.g. `password` on auth entities)
+         */
+        void encode(const soci::row &row, const Plan &plan, std::string &out,
+                    const std::string_view skip_column = {}) const {
+            if (plan.size() != row.size())
+                throw std::runtime_error("Row shape does not match the decode plan");
+
+            out.push_back('{');
+            bool first = true;
+            for (std::size_t i = 0; i < plan.size(); ++i) {
+                const auto *col = plan[i];
+                if (!skip_column.empty() && col->name == skip_column) continue;
+
+                const bool is_null = row.get_indicator(i) == soci::i_null;
+                if (!is_null && !col->decode) continue;
 
-                    vals.set(field_name, tm);
+                if (!first) out.push_back(',');
+                first = false;
+                appendJsonString(out, col->name);
+                out.push_back(':');
+
+                if (is_null) {
+                    out.append("null");
+                    continue;
                 }
-            } else if (field_type == "int") {
-                const int prec = field.value("precision", 32);
-                switch (prec) {
-                    case 8: vals.set(field_name, static_cast<int8_t>(entity.value(field_name, 0))); break;
-                    case 16: vals.set(field_name, static_cast<int16_t>(entity.value(field_name, 0))); break;
-                    case 64: vals.set(field_name, static_cast<int64_t>(entity.value(field_name, 0))); break;
-                    default: vals.set(field_name, static_cast<int32_t>(entity.value(field_name, 0))); break;
+
+                switch (col->kind) {
+                    case Kind::Text:
+                        appendJsonString(out, textOf(row, i, col->compress));
+                        break;
+                    case Kind::File:
+                        appendJsonString(out, row.get<std::string>(i, ""));
+                        break;
+                    case Kind::Date:
+                        appendJsonString(out, mb::dbDateToString(row, static_cast<int>(i)));
+                        break;
+                    case Kind::Int:
+                        appendInt(out, row, i, col->precision);
+                        break;
+                    case Kind::Double:
+                        appendDouble(out, row.get<double>(i));
+                        break;
+                    case Kind::Bool:
+                        out.append(row.get<bool>(i) ? "true" : "false");
+                        break;
+                    default:
+                        out.append(col->decode(row, i).dump());
                 }
-            } else if (field_type == "blob") {
-                // TODO implement BLOB type
-                // vals.set(field_name, entity.value(field_name, sql->empty_blob()));
-            } else if (field_type == "json") {
-                vals.set(field_name, entity.value(field_name, json::object()));
-            } else if (field_type == "bool") {
-                vals.set(field_name, entity.value(field_name, false));
-            } else if (field_type == "files") {
-                vals.set(field_name, entity.value(field_name, json::array()));
             }
+            out.push_back('}');
         }
 
-        return vals;
-    }
+        /// Write the column names of `plan` as a CSV header line (RFC 4180, CRLF terminated).
+        static void encodeCsvHeader(const Plan &plan, std::string &out, const std::string_view skip_column = {}) {
+            bool first = true;
+            for (const auto *col: plan) {
+                if ((!skip_column.empty() && col->name == skip_column) || !col->decode) continue;
+                if (!first) out.push_back(',');
+                first = false;
+                appendCsvField(out, col->name);
+            }
+            out.append("\r\n");
+        }
 
-    inline int getColumnPrecision(const std::string &column_name, const std::vector<json> &fields) {
-        for (const auto &field: fields) {
-            if (field.value("name", "") == column_name)
-                return field.value("precision", 32);
+        /**
+         * @brief Serialize a row as one CSV line, in encodeCsvHeader()'s column order.
+         *
+         * NULL (and a non-finite double) is an empty field; json/list/files
+         * columns are their JSON text.
+         * Columns with no decoder are left out, as in encode().
+         */
+        void encodeCsv(const soci::row &row, const Plan &plan, std::string &out,
+                       const std::string_view skip_column = {}) const {
+            if (plan.size() != row.size())
+                throw std::runtime_error("Row shape does not match the decode plan");
+
+            bool first = true;
+            for (std::size_t i = 0; i < plan.size(); ++i) {
+                const auto *col = plan[i];
+                if ((!skip_column.empty() && col->name == skip_column) || !col->decode) continue;
+
+                if (!first) out.push_back(',');
+                first = false;
+                if (row.get_indicator(i) == soci::i_null) continue;
+
+                switch (col->kind) {
+                    case Kind::Text:
+                        appendCsvField(out, textOf(row, i, col->compress));
+                        break;
+                    case Kind::File:
+                        appendCsvField(out, row.get<std::string>(i, ""));
+                        break;
+                    case Kind::Date:
+                        appendCsvField(out, mb::dbDateToString(row, static_cast<int>(i)));
+                        break;
+                    case Kind::Int:
+                        appendInt(out, row, i, col->precision);
+                        break;
+                    case Kind::Double:
+                        if (const auto v = row.get<double>(i); std::isfinite(v)) appendDouble(out, v);
+                        break;
+                    case Kind::Bool:
+                        out.append(row.get<bool>(i) ? "true" : "false");
+                        break;
+                    default:
+                        appendCsvField(out, col->decode(row, i).dump());
+                }
+            }
+            out.append("\r\n");
         }
-        return 32;
-    }
 
-    inline std::string getColumnType(const std::string &column_name, const std::vector<json> &fields) {
-        if (column_name.empty()) throw std::invalid_argument("Column name can't be empty!");
+        /// Append `s` to `out` as a CSV field, quoted only if it has to be.
+        static void appendCsvField(std::string &out, const std::string_view s) {
+            if (s.find_first_of(",\"\r\n") == std::string_view::npos) {
+                out.append(s);
+                return;
+            }
+            out.push_back('"');
+            for (const char ch: s) {
+                if (ch == '"') out.push_back('"');
+                out.push_back(ch);
+            }
+            out.push_back('"');
+        }
 
-        for (const auto &field: fields) {
-            if (field.value("name", "") == column_name)
-                return field.at("type").get<std::string>();
+        /// Append `s` to `out` as a quoted, escaped JSON string.
+        static void appendJsonString(std::string &out, const std::string_view s) {
+            static constexpr char hex[] = "0123456789abcdef";
+            out.push_back('"');
+            for (const char ch: s) {
+                switch (ch) {
+                    case '"': out.append("\\\""); break;
+                    case '\\': out.append("\\\\"); break;
+                    case '\b': out.append("\\b"); break;
+                    case '\f': out.append("\\f"); break;
+                    case '\n': out.append("\\n"); break;
+                    case '\r': out.append("\\r"); break;
+                    case '\t': out.append("\\t"); break;
+                    default:
+                        if (static_cast<unsigned char>(ch) < 0x20) {
+                            out.append("\\u00");
+                            out.push_back(hex[(ch >> 4) & 0x0F]);
+                            out.push_back(hex[ch & 0x0F]);
+                        } else {
+                            out.push_back(ch);
+                        }
+                }
+            }
+            out.push_back('"');
         }
 
-        throw std::runtime_error("No field type found matching column `" + column_name + "'");
-    }
+        /// Decode a single row, resolving its shape on the fly.
+        [[nodiscard]] json decode(const soci::row &row) const {
+            return decode(row, plan(row));
+        }
 
-    inline json sociRow2Json(const soci::row &row, const std::vector<json> &entity_fields) {
-        // Guard against empty reference schema fields
-        if (entity_fields.empty())
-            throw std::invalid_argument("Reference schema fields can't be empty!");
+    private:
+        static Kind kindOf(const std::string &type) {
+            static const std::unordered_map<std::string_view, Kind> kinds = {
+                {"xml", Kind::Text}, {"string", Kind::Text}, {"file", Kind::File}, {"double", Kind::Double},
+                {"date", Kind::Date}, {"int", Kind::Int}, {"json", Kind::Json}, {"list", Kind::Json},
+                {"bool", Kind::Bool}, {"files", Kind::Files}, {"vector", Kind::Vector}, {"blob", Kind::Blob},
+                {"geo_point", Kind::GeoPoint},
+            };
+            const auto it = kinds.find(type);
+            return it == kinds.end() ? Kind::Unknown : it->second;
+        }
 
-        // Build response json object
-        json res_json;
-        for (size_t i = 0; i < row.size(); i++) {
-            const auto colName = row.get_properties(i).get_name();
-            const auto colType = getColumnType(colName, entity_fields);
-
-            // Check column type is valid type
-            if (colType.empty() || !EntitySchemaField::isValidFieldType(colType)) // Or not in expected types
-            {
-                // Throw an error for unknown types
-                throw std::runtime_error(std::format("Unknown column type `{}` for column `{}`", colType, colName));
+        static DecodeFn decoderFor(const std::string &type, const int precision, const bool compress) {
+            // Stored compressed or not, see FieldCompression
+            if (compress && (type == "xml" || type == "string"))
+                return [](const soci::row &r, std::size_t i) -> json {
+                    return FieldCompression::inflate(r.get<std::string>(i, ""));
+                };
+            if (compress && type == "json")
+                return [](const soci::row &r, std::size_t i) -> json {
+                    const auto text = FieldCompression::inflate(r.get<std::string>(i, ""));
+                    if (trim(text).empty()) return json{};
+                    try {
+                        return json::parse(text);
+                    } catch (const std::exception &e) {
+                        throw MantisException(500, "Failed to parse JSON value from DB.", e.what());
+                    }
+                };
+            if (type == "xml" || type == "string")
+                return [](const soci::row &r, std::size_t i) -> json { return r.get<std::string>(i, ""); };
+            if (type == "file")
+                return [](const soci::row &r, std::size_t i) -> json { return r.get<std::string>(i); };
+            if (type == "double")
+                return [](const soci::row &r, std::size_t i) -> json { return r.get<double>(i); };
+            if (type == "date")
+                return [](const soci::row &r, std::size_t i) -> json {
+                    return mb::dbDateToString(r, static_cast<int>(i));
+                };
+            if (type == "int") {
+                switch (precision) {
+                    case 8: return [](const soci::row &r, std::size_t i) -> json { return r.get<int8_t>(i); };
+                    case 16: return [](const soci::row &r, std::size_t i) -> json { return r.get<int16_t>(i); };
+                    case 64: return [](const soci::row &r, std::size_t i) -> json { return r.get<int64_t>(i); };
+                    default: return [](const soci::row &r, std::size_t i) -> json { return r.get<int32_t>(i); };
+                }
             }
+            if (type == "json" || type == "list" || type == "files" || type == "geo_point")
+                return [](const soci::row &r, std::size_t i) -> json { return r.get<json>(i); };
+            if (type == "bool")
+                return [](const soci::row &r, std::size_t i) -> json { return r.get<bool>(i); };
+            if (type == "vector")
+                return [](const soci::row &r, std::size_t i) -> json {
+                    return VectorIndex::toJSON(r.get<std::string>(i, ""));
+                };
+
+            // Selected as `length(col)`, see Entity::recordColumns(); a raw
+            // blob column has no JSON form
+            if (type == "blob")
+                return [](const soci::row &r, std::size_t i) -> json {
+                    switch (r.get_properties(i).get_db_type()) {
+                        case soci::db_int32: return r.get<int32_t>(i);
+                        case soci::db_int64: return r.get<int64_t>(i);
+                        case soci::db_uint64: return r.get<uint64_t>(i);
+                        default: return nullptr;
+                    }
+                };
+
+            // Anything unknown
+            return nullptr;
+        }
+
+        /// A `string` or `xml` column's value, inflated if it's a `compress` field
+        static std::string textOf(const soci::row &row, const std::size_t i, const bool compress) {
+            return compress ? FieldCompression::inflate(row.get<std::string>(i, "")) : row.get<std::string>(i, "");
+        }
 
-            // Handle null values immediately
-            if (row.get_indicator(i) == soci::i_null) {
-                // Handle null value in JSON
-                res_json[colName] = nullptr;
-                continue;
+        static void appendInt(std::string &out, const soci::row &row, const std::size_t i, const int precision) {
+            switch (precision) {
+                case 8: appendNumber(out, static_cast<int64_t>(row.get<int8_t>(i))); break;
+                case 16: appendNumber(out, static_cast<int64_t>(row.get<int16_t>(i))); break;
+                case 64: appendNumber(out, row.get<int64_t>(i)); break;
+                default: appendNumber(out, static_cast<int64_t>(row.get<int32_t>(i))); break;
             }
+        }
 
-            // Handle type conversions
-            if (colType == "xml" || colType == "string") {
-                res_json[colName] = row.get<std::string>(i, "");
-            } else if (colType == "double") {
-                res_json[colName] = row.get<double>(i);
-            } else if (colType == "date") {
-                res_json[colName] = mb::dbDateToString(row, i);
-            } else if (colType == "int") {
-                const int prec = getColumnPrecision(colName, entity_fields);
-                switch (prec) {
-                    case 8: res_json[colName] = row.get<int8_t>(i); break;
-                    case 16: res_json[colName] = row.get<int16_t>(i); break;
-                    case 64: res_json[colName] = row.get<int64_t>(i); break;
-                    default: res_json[colName] = row.get<int32_t>(i); break;
-                }
-            } else if (colType == "blob") {
-                // TODO ? How do we handle BLOB?
-                // j[colName] = row.get<std::string>(i);
-            } else if (colType == "json" || colType == "list") {
-                res_json[colName] = row.get<json>(i);
-            } else if (colType == "bool") {
-                res_json[colName] = row.get<bool>(i);
-            } else if (colType == "file") {
-                res_json[colName] = row.get<std::string>(i);
-            } else if (colType == "files") {
-                res_json[colName] = row.get<json>(i);
+        static void appendNumber(std::string &out, const int64_t v) {
+            char buf[24];
+            const auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), v);
+            out.append(buf, end);
+        }
+
+        static void appendDouble(std::string &out, const double v) {
+            // JSON has no NaN/Inf; nlohmann serializes them as null too
+            if (!std::isfinite(v)) {
+                out.append("null");
+                return;
             }
+            char buf[32];
+            const auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), v);
+            const std::string_view num(buf, end - buf);
+            out.append(num);
+            // Keep doubles recognisable as such, as nlohmann does (1 -> 1.0)
+            if (num.find_first_of(".eE") == std::string_view::npos) out.append(".0");
         }
 
-        return res_json;
+        std::vector<Column> m_columns; ///> Contiguous, in schema order
+        std::unordered_map<std::string, std::size_t> m_index; ///> Name -> position in m_columns
+        bool m_deflate = false;
+    };
+
+    /**
+     * @brief Bind the schema fields present in `entity` into `vals`, see RowCodec::bind().
+     *
+     * Builds a throwaway RowCodec; prefer `Entity::rowCodec().bind()` where the
+     * entity is at hand so the codec is built once per schema.
+     */
+    inline void bindSociValues(soci::values &vals, const json &entity, const json &fields,
+                               const std::string &suffix = "", const bool hash_passwords = true) {
+        if (!fields.is_array()) throw std::invalid_argument("Fields must be an array");
+        RowCodec(fields.get_ref<const std::vector<json> &>()).bind(vals, entity, suffix, hash_passwords);
+    }
+
+    inline soci::values json2SociValue(const json &entity, const json &fields) {
+        soci::values vals;
+        bindSociValues(vals, entity, fields);
+        return vals;
+    }
+
+    /**
+     * @brief Decode a row using a precompiled codec (preferred on hot paths).
+     */
+    inline json sociRow2Json(const soci::row &row, const RowCodec &codec) {
+        return codec.decode(row);
+    }
+
+    /**
+     * @brief Decode a row against a raw field list.
+     *
+     * Builds a throwaway RowCodec; prefer `Entity::rowCodec()` where the
+     * entity is at hand so the codec is built once per schema.
+     */
+    inline json sociRow2Json(const soci::row &row, const std::vector<json> &entity_fields) {
+        // Guard against empty reference schema fields
+        if (entity_fields.empty())
+            throw std::invalid_argument("Reference schema fields can't be empty!");
+
+        return RowCodec(entity_fields).decode(row);
     }
 }
 
@@ -10,7 +10,11 @@
 #define MB_UTILS_H
 
 #include <string>
+#include <array>
+#include <compare>
+#include <cstdint>
 #include <filesystem>
+#include <optional>
 #include <random>
 #include <chrono>
 #include <string_view>
@@ -282,8 +286,11 @@ namespace mb {
     // ----------------------------------------------------------------- //
     /**
      * @brief Digests user password + a generated salt to yield a hashed password.
+     *
+     * Runs on the PasswordHasher pool once the server is listening.
      * @param password Password input to hash.
      * @return A hash string representation of the password + salt.
+     * @throw MantisException (429) if the pool's queue is full
      */
     std::string hashPassword(const std::string &password);
 
@@ -293,9 +300,11 @@ namespace mb {
      * Given a hashed password from the database (`stored_hash`), the method extracts the salt value,
      * hashes the `password` value with the salt then compares the two hashes if they match.
      *
+     * Runs on the PasswordHasher pool once the server is listening.
      * @param password User password input.
      * @param stored_hash Database stored hashed user password.
      * @return boolean indicating whether the verification was successful or not.
+     * @throw MantisException (429) if the pool's queue is full
      */
     bool verifyPassword(const std::string &password, const std::string &stored_hash);
 
@@ -306,11 +315,10 @@ namespace mb {
     /**
      * @brief Thread-safe conversion of an epoch time to a UTC std::tm.
      *
-     * std::gmtime returns a pointer to a shared static std::tm, so calling it
-     * from multiple threads concurrently is a data race. This wrapper
-     * serializes the call and returns a copy. UTC is the canonical timezone
-     * for all persisted timestamps so values are stable regardless of the
-     * server's local timezone or DST.
+     * Computed from the civil calendar rather than std::gmtime, whose shared
+     * static buffer would need a lock around every call. UTC is the canonical
+     * timezone for all persisted timestamps so values are stable regardless
+     * of the server's local timezone or DST.
      *
      * @param t Epoch time value.
      * @return std::tm in UTC.
@@ -334,13 +342,27 @@ namespace mb {
      */
     std::tm toLocalTime(std::time_t t);
 
-    inline std::string getCurrentTimestampUTC() {
-        const std::time_t now = std::time(nullptr);
-        const std::tm utc = toUtcTime(now);
+    /// Characters formatIsoDateTime() writes, `YYYY-MM-DD HH:MM:SS`
+    inline constexpr std::size_t kIsoDateTimeLength = 19;
+
+    /**
+     * @brief Write `t` as `YYYY-MM-DD HH:MM:SS` into `out`, without allocating.
+     * @param out At least kIsoDateTimeLength chars; not null-terminated
+     * @param separator Between the date and the time, `T` for ISO 8601 proper
+     * @return kIsoDateTimeLength
+     */
+    std::size_t formatIsoDateTime(const std::tm &t, char *out, char separator = ' ');
 
-        char buffer[20];
-        std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &utc);
-        return std::string{ buffer };
+    /**
+     * @brief The current UTC second as `YYYY-MM-DD HH:MM:SS`.
+     *
+     * Formatted once per second per thread; the view stays valid on the
+     * calling thread until its next call.
+     */
+    std::string_view currentTimestampUTC();
+
+    inline std::string getCurrentTimestampUTC() {
+        return std::string{currentTimestampUTC()};
     }
 
     /**
@@ -357,6 +379,16 @@ namespace mb {
      */
     std::tm strToTM(const std::string &value);
 
+    /**
+     * @brief Parse `YYYY-MM-DD`, optionally followed by `T` or a space and `HH:MM[:SS]`.
+     *
+     * A fixed-format scan for binding `date` fields, without a stream per
+     * value. Anything after the seconds (fractions, `Z`, an offset) is
+     * ignored, as it always was.
+     * @return false if `value` doesn't start with such a date
+     */
+    bool parseIsoDateTime(std::string_view value, std::tm &out);
+
     /**
      * @brief Convert database date value from SOCI row to string.
      * @param row SOCI row containing the date value
@@ -387,11 +419,49 @@ namespace mb {
     // NETWORK UTILS
     // ----------------------------------------------------------------- //
 
+    /**
+     * @brief An IPv4 or IPv6 address in binary form.
+     *
+     * IPv4 addresses are held IPv4-mapped (`::ffff:a.b.c.d`), so `1.2.3.4` and
+     * `::ffff:1.2.3.4` compare equal, as do differently spelled IPv6
+     * addresses. Key rate limits and allow lists on it, or on toString().
+     */
+    struct IpAddress {
+        std::array<std::uint8_t, 16> bytes{};   ///> Network byte order
+
+        /// @brief Whether this is an IPv4 (or IPv4-mapped) address.
+        [[nodiscard]] bool isV4() const;
+
+        /// @brief Canonical text: dotted quad for IPv4, RFC 5952 for IPv6 (lowercase, longest zero run as `::`).
+        [[nodiscard]] std::string toString() const;
+
+        auto operator<=>(const IpAddress &) const = default;
+    };
+
+    /**
+     * @brief Parse a dotted-quad IPv4 address, as inet_pton() does.
+     *
+     * Exactly four decimal parts of 0-255, without leading zeros (which
+     * some parsers read as octal) or surrounding whitespace.
+     */
+    std::optional<IpAddress> parseIPv4(std::string_view text);
+
+    /**
+     * @brief Parse an IPv6 address, as inet_pton() does.
+     *
+     * Accepts `::` compression once, an embedded IPv4 tail
+     * (`::ffff:192.168.1.1`) and a `%zone` suffix, which is dropped.
+     */
+    std::optional<IpAddress> parseIPv6(std::string_view text);
+
+    /// @brief parseIPv4(), else parseIPv6().
+    std::optional<IpAddress> parseIP(std::string_view text);
+
     /**
      * @brief Validates if a string is a valid IPv4 address.
      *
      * Checks if the input string matches the IPv4 format (e.g., "192.168.1.1").
-     * Does not validate the actual IP range, only the format.
+     * Same as `parseIPv4(ip).has_value()`.
      *
      * @param ip String to validate as IPv4 address
      * @return true if the string is a valid IPv4 format, false otherwise
@@ -408,7 +478,7 @@ namespace mb {
      * @brief Validates if a string is a valid IPv6 address.
      *
      * Checks if the input string matches the IPv6 format (e.g., "2001:0db8::1").
-     * Supports compressed notation (::).
+     * Supports compressed notation (::). Same as `parseIPv6(ip).has_value()`.
      *
      * @param ip String to validate as IPv6 address
      * @return true if the string is a valid IPv6 format, false otherwise
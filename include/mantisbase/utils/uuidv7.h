@@ -3,7 +3,10 @@
  * @brief UUID v7 generation utilities.
  *
  * Provides functions for generating UUID v7 identifiers that are
- * time-ordered and suitable for database primary keys.
+ * time-ordered and suitable for database primary keys. Ids made on one
+ * thread are strictly increasing (RFC 9562, method 1: a 12-bit counter
+ * seeded at random each millisecond), and a batch of them costs one clock
+ * read and one string allocation per id.
  */
 
 #ifndef MANTISAPP_UUIDV7_H
@@ -11,64 +14,138 @@
 
 #include <array>
 #include <chrono>
-#include <iomanip>
-#include <iostream>
+#include <cstddef>
+#include <optional>
 #include <random>
-#include <sstream>
 #include <string>
+#include <string_view>
 #include <cstdint>
-#include <mutex>
+#include <vector>
 
 namespace mb {
+    using Uuid = std::array<uint8_t, 16>;
+
     inline uint64_t now_unix_ms() {
         using namespace std::chrono;
         return static_cast<uint64_t>(duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count());
     }
 
-    inline std::string to_hex_lower(const std::array<uint8_t,16>& b) {
-        std::ostringstream ss;
-        ss << std::hex << std::setfill('0');
-        for (size_t i = 0; i < 16; ++i) {
-            ss << std::setw(2) << static_cast<int>(b[i]);
-            if (i == 3 || i == 5 || i == 7 || i == 9) ss << '-';
+    /// @brief The 36-character `8-4-4-4-12` form of `b`.
+    inline std::string to_hex_lower(const Uuid &b) {
+        static constexpr char HEX[] = "0123456789abcdef";
+        std::string out(36, '-');
+        std::size_t pos = 0;
+        for (std::size_t i = 0; i < 16; ++i) {
+            if (i == 4 || i == 6 || i == 8 || i == 10) ++pos;
+            out[pos++] = HEX[b[i] >> 4];
+            out[pos++] = HEX[b[i] & 0x0F];
         }
-        return ss.str();
+        return out;
     }
 
-    inline std::string generate_uuidv7() {
-        thread_local std::mt19937_64 rng((std::random_device{})());
-        thread_local uint64_t last_ts = 0;
-        thread_local uint16_t counter = 0;
+    /// @brief The 16 bytes of a UUID in its text form (any case); nullopt if `text` isn't one.
+    inline std::optional<Uuid> uuid_from_string(const std::string_view text) {
+        if (text.size() != 36) return std::nullopt;
+        const auto nibble = [](const char c) -> int {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+            return -1;
+        };
+
+        Uuid b{};
+        std::size_t pos = 0;
+        for (std::size_t i = 0; i < 16; ++i) {
+            if (i == 4 || i == 6 || i == 8 || i == 10) {
+                if (text[pos++] != '-') return std::nullopt;
+            }
+            const int hi = nibble(text[pos++]), lo = nibble(text[pos++]);
+            if (hi < 0 || lo < 0) return std::nullopt;
+            b[i] = static_cast<uint8_t>(hi << 4 | lo);
+        }
+        return b;
+    }
+
+    /**
+     * @brief Per-thread UUID v7 state; use generate_uuidv7() and friends.
+     *
+     * Within a millisecond the 12-bit `rand_a` field counts up from a random
+     * start below 2048; if it runs out, the timestamp moves a millisecond
+     * ahead of the clock rather than wrapping. A clock that steps back is
+     * ignored until it catches up, so order holds across that too.
+     */
+    class Uuidv7Generator {
+    public:
+        /// @brief The next id, in binary.
+        Uuid next() { return make(advance(now_unix_ms())); }
+
+        /// @brief `n` consecutive ids, on one reading of the clock.
+        std::vector<Uuid> next(const std::size_t n) {
+            std::vector<Uuid> ids;
+            ids.reserve(n);
+            const auto now = now_unix_ms();
+            for (std::size_t i = 0; i < n; ++i) ids.push_back(make(advance(now)));
+            return ids;
+        }
 
-        const uint64_t ts_ms = now_unix_ms() & 0x0000FFFFFFFFFFFFULL; // 48 bits
+        static Uuidv7Generator &local() {
+            thread_local Uuidv7Generator generator;
+            return generator;
+        }
+
+    private:
+        Uuidv7Generator() : m_rng((std::random_device{})()) {}
 
-        if (ts_ms == last_ts) {
-            ++counter;
-        } else {
-            last_ts = ts_ms;
-            counter = 0;
+        /// Timestamp for the next id; m_counter is its rand_a
+        uint64_t advance(const uint64_t now) {
+            if (now > m_lastTs) {
+                m_lastTs = now;
+                m_counter = static_cast<uint16_t>(m_rng() & 0x07FF);
+            } else if (++m_counter > 0x0FFF) {
+                ++m_lastTs;
+                m_counter = static_cast<uint16_t>(m_rng() & 0x07FF);
+            }
+            return m_lastTs;
         }
 
-        // 12-bit random or counter value (rand_a)
-        const uint16_t rand12 = counter & 0x0FFF; // 12 bits, wraps automatically
+        Uuid make(const uint64_t ts) {
+            const uint64_t ts_ms = ts & 0x0000FFFFFFFFFFFFULL; // 48 bits
+            const uint64_t rand62 = m_rng() >> 2;
+
+            Uuid bytes{};
+            for (int i = 0; i < 6; ++i)
+                bytes[i] = static_cast<uint8_t>((ts_ms >> (8*(5-i))) & 0xFF);
+
+            bytes[6] = static_cast<uint8_t>((7u << 4) | ((m_counter >> 8) & 0x0F)); // version 7
+            bytes[7] = static_cast<uint8_t>(m_counter & 0xFF);
 
-        // 62-bit random (rand_b)
-        std::uniform_int_distribution<uint64_t> dist62(0, ( (1ULL<<62) - 1 ));
-        const uint64_t rand62 = dist62(rng);
+            bytes[8] = static_cast<uint8_t>(0x80 | ((rand62 >> 56) & 0x3F)); // variant
+            for (int i = 0; i < 7; ++i)
+                bytes[9 + i] = static_cast<uint8_t>((rand62 >> (48 - 8*i)) & 0xFF);
+            return bytes;
+        }
 
-        std::array<uint8_t,16> bytes{};
-        for (int i = 0; i < 6; ++i)
-            bytes[i] = static_cast<uint8_t>((ts_ms >> (8*(5-i))) & 0xFF);
+        std::mt19937_64 m_rng;
+        uint64_t m_lastTs = 0;
+        uint16_t m_counter = 0;
+    };
 
-        bytes[6] = static_cast<uint8_t>((7u << 4) | ((rand12 >> 8) & 0x0F)); // version 7
-        bytes[7] = static_cast<uint8_t>(rand12 & 0xFF);
+    inline std::string generate_uuidv7() {
+        return to_hex_lower(Uuidv7Generator::local().next());
+    }
 
-        bytes[8] = static_cast<uint8_t>(0x80 | ((rand62 >> 56) & 0x3F)); // variant
-        for (int i = 0; i < 7; ++i)
-            bytes[9 + i] = static_cast<uint8_t>((rand62 >> (48 - 8*i)) & 0xFF);
+    /// @brief `n` UUID v7s in increasing order, e.g. one per row of a multi-row INSERT.
+    inline std::vector<std::string> generate_uuidv7_batch(const std::size_t n) {
+        std::vector<std::string> ids;
+        ids.reserve(n);
+        for (const auto &id: Uuidv7Generator::local().next(n)) ids.push_back(to_hex_lower(id));
+        return ids;
+    }
 
-        return to_hex_lower(bytes);
+    /// @brief A UUID v7 in its 16-byte form, for BLOB or PostgreSQL `uuid` columns.
+    inline Uuid generate_uuidv7_bytes() {
+        return Uuidv7Generator::local().next();
     }
 }
 
-#endif //MANTISAPP_UUIDV7_H
\ No newline at end of file
+#endif //MANTISAPP_UUIDV7_H
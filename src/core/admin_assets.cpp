@@ -0,0 +1,129 @@
+/**
+ * @file admin_assets.cpp
+ * @brief Implementation for @see admin_assets.h
+ */
+
+#include "../../include/mantisbase/core/admin_assets.h"
+#include "../../include/mantisbase/core/file_serving.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/utils/crypto_utils.h"
+
+#include <cmrc/cmrc.hpp>
+#include <algorithm>
+#include <format>
+
+// Declare a mantis namespace for the embedded FS
+CMRC_DECLARE(mantis);
+
+namespace mb {
+    namespace {
+        constexpr std::string_view ROOT = "/public";
+
+        std::size_t slot(const Compression::Encoding encoding) {
+            return static_cast<std::size_t>(encoding);
+        }
+    }
+
+    AdminAssets::AdminAssets(const std::function<std::string(const std::string &)> &mime_of) {
+        index(std::string(ROOT), mime_of);
+
+        if (const auto it = m_assets.find("/index.html"); it != m_assets.end()) m_index = &it->second;
+        LogOrigin::trace("Admin Assets", fmt::format("Indexed {} admin dashboard file(s).", m_assets.size()));
+    }
+
+    void AdminAssets::index(const std::string &dir, const std::function<std::string(const std::string &)> &mime_of) {
+        const auto fs = cmrc::mantis::get_filesystem();
+        if (!fs.is_directory(dir)) return;
+
+        for (const auto &entry: fs.iterate_directory(dir)) {
+            const auto path = dir + "/" + entry.filename();
+            if (entry.is_directory()) {
+                index(path, mime_of);
+                continue;
+            }
+
+            // `app.js.br` next to `app.js` is a variant of it, not an asset of its own
+            bool variant = false;
+            for (const auto encoding: Compression::PREFERENCE) {
+                const auto suffix = Compression::suffix(encoding);
+                if (path.ends_with(suffix) && fs.is_file(path.substr(0, path.size() - suffix.size()))) variant = true;
+            }
+            if (variant) continue;
+
+            const auto file = fs.open(path);
+            Asset asset;
+            asset.body = std::string_view(file.begin(), file.size());
+            asset.mime = mime_of(path);
+            // Hashed bundle files never change under their name; the rest is revalidated
+            asset.cacheControl = FileServing::isFingerprinted(path) ? "public, max-age=31536000, immutable" : "no-cache";
+
+            const auto hash = sha256Hex(std::string(asset.body));
+            asset.etags[slot(Compression::Encoding::Identity)] = FileServing::etag(hash);
+
+            if (Compression::isCompressible(asset.mime)) {
+                for (const auto encoding: Compression::PREFERENCE) {
+                    std::string_view encoded;
+                    if (const auto sibling = path + std::string(Compression::suffix(encoding)); fs.is_file(sibling)) {
+                        const auto shipped = fs.open(sibling);
+                        encoded = std::string_view(shipped.begin(), shipped.size());
+                    } else if (Compression::available(encoding)) {
+                        encoded = m_compressed.emplace_back(Compression::compress(encoding, asset.body, true));
+                    }
+                    // Not smaller: the body is sent as is
+                    if (encoded.empty() || encoded.size() >= asset.body.size()) continue;
+
+                    asset.encoded[slot(encoding)] = encoded;
+                    asset.etags[slot(encoding)] = FileServing::etag(
+                        std::format("{}-{}", hash, Compression::token(encoding)));
+                }
+            }
+
+            m_assets.emplace(path.substr(ROOT.size()), std::move(asset));
+        }
+    }
+
+    const AdminAssets::Asset *AdminAssets::find(const std::string_view path) const {
+        if (path.empty() || path == "/") return m_index;
+        if (const auto it = m_assets.find(std::string(path)); it != m_assets.end()) return &it->second;
+
+        // Client-side routes of the dashboard
+        MB_LOG_TRACE(LogOrigin::trace, "Path Missing", fmt::format("{} path does not exists", path));
+        return m_index;
+    }
+
+    drogon::HttpResponsePtr AdminAssets::respond(const drogon::HttpRequestPtr &req) const {
+        auto resp = drogon::HttpResponse::newHttpResponse();
+
+        // Strip "/mb"
+        const std::string_view full_path = req->path();
+        const auto *asset = find(full_path.size() > 3 ? full_path.substr(3) : std::string_view{});
+        if (!asset) {
+            resp->setStatusCode(drogon::k404NotFound);
+            return resp;
+        }
+
+        auto encoding = Compression::Encoding::Identity;
+        if (std::ranges::any_of(asset->encoded, [](const auto &variant) { return !variant.empty(); })) {
+            resp->addHeader("Vary", "Accept-Encoding");
+            if (const auto chosen = Compression::negotiate(req->getHeader("accept-encoding"));
+                !asset->encoded[slot(chosen)].empty())
+                encoding = chosen;
+        }
+
+        const auto &etag = asset->etags[slot(encoding)];
+        resp->addHeader("ETag", etag);
+        resp->addHeader("Cache-Control", asset->cacheControl);
+        if (FileServing::ifNoneMatch(req->getHeader("if-none-match"), etag)) {
+            resp->setStatusCode(drogon::k304NotModified);
+            return resp;
+        }
+
+        const auto body = encoding == Compression::Encoding::Identity ? asset->body : asset->encoded[slot(encoding)];
+        if (encoding != Compression::Encoding::Identity)
+            resp->addHeader("Content-Encoding", std::string(Compression::token(encoding)));
+        resp->setBody(std::string(body));
+        resp->setContentTypeString(asset->mime);
+        resp->setStatusCode(drogon::k200OK);
+        return resp;
+    }
+}
@@ -0,0 +1,114 @@
+/**
+ * @file admission.cpp
+ * @brief Implementation for @see admission.h
+ */
+
+#include "../../include/mantisbase/core/admission.h"
+#include "../../include/mantisbase/core/metrics.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace mb {
+    namespace {
+        constexpr double SHORT_WEIGHT = 0.1;   ///> About the last 10 requests
+        constexpr double LONG_WEIGHT = 0.002;  ///> About the last 500
+        constexpr double SMOOTHING = 0.2;      ///> Share of each new estimate taken into the limit
+    }
+
+    ConcurrencyLimit::Permit::Permit(ConcurrencyLimit &limit, const std::size_t inflight)
+        : m_limit(limit), m_inflight(inflight), m_started(std::chrono::steady_clock::now()) {}
+
+    ConcurrencyLimit::Permit::~Permit() {
+        m_limit.m_inflight.fetch_sub(1, std::memory_order_relaxed);
+        m_limit.sample(std::chrono::steady_clock::now() - m_started, m_inflight);
+    }
+
+    ConcurrencyLimit::ConcurrencyLimit(Options options)
+        : m_options([&] {
+              options.min = std::max<std::size_t>(1, options.min);
+              options.max = std::max(options.min, options.max);
+              options.initial = std::clamp(options.initial, options.min, options.max);
+              return options;
+          }()),
+          m_limit(m_options.initial),
+          m_estimate(static_cast<double>(m_options.initial)) {}
+
+    std::shared_ptr<ConcurrencyLimit::Permit> ConcurrencyLimit::acquire() {
+        auto current = m_inflight.load(std::memory_order_relaxed);
+        do {
+            if (current >= m_limit.load(std::memory_order_relaxed)) {
+                m_rejected.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+        } while (!m_inflight.compare_exchange_weak(current, current + 1, std::memory_order_relaxed));
+        return std::make_shared<Permit>(*this, current + 1);
+    }
+
+    void ConcurrencyLimit::sample(const std::chrono::nanoseconds latency, const std::size_t inflight) {
+        const auto seconds = std::max(1e-6, std::chrono::duration<double>(latency).count());
+
+        std::lock_guard lock(m_mutex);
+        if (m_samples++ == 0) {
+            m_short = m_long = seconds;
+            return;
+        }
+        m_short += (seconds - m_short) * SHORT_WEIGHT;
+        m_long += (seconds - m_long) * LONG_WEIGHT;
+        // After a long slow spell, don't wait 500 requests to accept that latency is lower now
+        if (m_long > 2 * m_short) m_long = (m_long + m_short) / 2;
+
+        if (static_cast<double>(inflight) * 2 < m_estimate) return;
+
+        const auto gradient = std::clamp(m_options.tolerance * m_long / m_short, 0.5, 1.0);
+        const auto target = m_estimate * gradient + std::sqrt(m_estimate);
+        m_estimate = std::clamp(m_estimate * (1 - SMOOTHING) + target * SMOOTHING,
+                                static_cast<double>(m_options.min), static_cast<double>(m_options.max));
+        m_limit.store(static_cast<std::size_t>(m_estimate), std::memory_order_relaxed);
+    }
+
+    Admission::Options Admission::Options::fromEnv() {
+        Options options;
+        options.enabled = getEnvOrDefault("MB_ADMISSION", "0") == "1";
+        if (const auto min = safe_stoi(getEnvOrDefault("MB_ADMISSION_MIN", ""), 0); min > 0)
+            options.limit.min = static_cast<std::size_t>(min);
+        if (const auto max = safe_stoi(getEnvOrDefault("MB_ADMISSION_MAX", ""), 0); max > 0)
+            options.limit.max = static_cast<std::size_t>(max);
+        return options;
+    }
+
+    Admission::Admission(Options options) : m_options(std::move(options)) {}
+
+    ConcurrencyLimit &Admission::route(const std::string &method, const std::string &route) {
+        std::lock_guard lock(m_mutex);
+        auto &entry = m_routeIndex[method + " " + route];
+        if (!entry) {
+            m_routes.push_back(std::make_unique<Entry>(method, route, m_options.limit));
+            entry = m_routes.back().get();
+        }
+        return entry->limit;
+    }
+
+    bool Admission::isPriority(const std::string_view route) {
+        return route.starts_with("/api/v1/sys/") || route.starts_with("/api/v1/debug/")
+               || route == "/api/v1/health" || route == "/api/v1/health/ready" || route == "/api/v1/metrics"
+               || route == "/mb" || route.starts_with("/mb/");
+    }
+
+    void Admission::writeMetrics(MetricsWriter &out) const {
+        std::lock_guard lock(m_mutex);
+        out.family("mb_admission_limit", "Concurrent requests admitted per route right now", "gauge");
+        for (const auto &e: m_routes)
+            out.sample("mb_admission_limit", {{"method", e->method}, {"route", e->route}},
+                       static_cast<double>(e->limit.limit()));
+        out.family("mb_admission_inflight", "Admitted requests in flight per route", "gauge");
+        for (const auto &e: m_routes)
+            out.sample("mb_admission_inflight", {{"method", e->method}, {"route", e->route}},
+                       static_cast<double>(e->limit.inflight()));
+        out.family("mb_admission_rejected_total", "Requests turned away with 503 over the route's limit", "counter");
+        for (const auto &e: m_routes)
+            out.sample("mb_admission_rejected_total", {{"method", e->method}, {"route", e->route}},
+                       static_cast<double>(e->limit.rejected()));
+    }
+}
@@ -2,8 +2,76 @@
 #include "mantisbase/mantisbase.h"
 #include "mantisbase/utils/crypto_utils.h"
 #include "mantisbase/utils/utils.h"
+#include "mantisbase/core/database.h"
+#include "mantisbase/core/logger/logger.h"
+
+#include <chrono>
+#include <format>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
 
 namespace mb {
+    namespace {
+        struct CachedKey {
+            json info;
+            std::chrono::steady_clock::time_point cachedAt;
+        };
+
+        /// Lookup cache and pending `last_used` writes, shared by all requests.
+        struct KeyState {
+            std::shared_mutex cacheMutex;
+            std::unordered_map<std::string, CachedKey> byHash;
+
+            std::mutex pendingMutex;
+            std::unordered_map<std::string, std::string> pendingLastUsed; // key id -> timestamp
+        };
+
+        KeyState &keyState() {
+            static KeyState state;
+            return state;
+        }
+
+        void touchLastUsed(const std::string &key_id, const std::string &now) {
+            auto &state = keyState();
+            std::lock_guard lock(state.pendingMutex);
+            state.pendingLastUsed[key_id] = now;
+        }
+
+        void evictKeyId(const std::string &key_id) {
+            auto &state = keyState();
+            std::unique_lock lock(state.cacheMutex);
+            std::erase_if(state.byHash, [&key_id](const auto &kv) {
+                return kv.second.info.value("id", std::string{}) == key_id;
+            });
+        }
+
+        std::optional<json> fromCache(const std::string &key_hash) {
+            auto &state = keyState();
+            std::shared_lock lock(state.cacheMutex);
+            const auto it = state.byHash.find(key_hash);
+            if (it == state.byHash.end() ||
+                std::chrono::steady_clock::now() - it->second.cachedAt >
+                std::chrono::seconds(ApiKeyManager::KEY_CACHE_TTL_SECS))
+                return std::nullopt;
+            return it->second.info;
+        }
+
+        void toCache(const std::string &key_hash, const json &info) {
+            auto &state = keyState();
+            std::unique_lock lock(state.cacheMutex);
+            if (state.byHash.size() >= ApiKeyManager::KEY_CACHE_CAPACITY && !state.byHash.contains(key_hash)) {
+                const auto now = std::chrono::steady_clock::now();
+                std::erase_if(state.byHash, [now](const auto &kv) {
+                    return now - kv.second.cachedAt > std::chrono::seconds(ApiKeyManager::KEY_CACHE_TTL_SECS);
+                });
+                if (state.byHash.size() >= ApiKeyManager::KEY_CACHE_CAPACITY)
+                    state.byHash.erase(state.byHash.begin());
+            }
+            state.byHash.insert_or_assign(key_hash, CachedKey{info, std::chrono::steady_clock::now()});
+        }
+    }
+
     ApiKeyResult ApiKeyManager::generateApiKey() {
         auto random_hex = generateSecureRandom(32);
         std::string raw_key = "mb_sk_" + random_hex;
@@ -23,7 +91,7 @@ namespace mb {
         auto [id, key, key_hash] = generateApiKey();
         auto now = getCurrentTimestampUTC();
 
-        auto sql = MantisBase::instance().db().session();
+        auto sql = MantisBase::instance().db().writeSession();
 
         std::string perms_str = permissions.dump();
         std::string exp = expires_at.empty() ? "" : expires_at;
@@ -51,12 +119,33 @@ namespace mb {
         };
     }
 
-    json ApiKeyManager::list(const std::string &entity_name, const std::string &user_id) {
+    json ApiKeyManager::list(const std::string &entity_name, const std::string &user_id,
+                             const KeysetPage &page, const json &filters) {
+        // Served by idx_api_keys_owner, or idx_api_keys_entity across users, in id order either way
+        std::string where = "entity_name = :entity";
+        soci::values vals;
+        vals.set("entity", entity_name);
+        if (!user_id.empty()) {
+            where += " AND user_id = :uid";
+            vals.set("uid", user_id);
+        }
+        if (!page.after.empty()) {
+            where += " AND id > :after";
+            vals.set("after", page.after);
+        }
+        if (const auto label = filters.value("label", std::string{}); !label.empty()) {
+            where += " AND label = :label";
+            vals.set("label", label);
+        }
+        if (filters.value("active", false)) {
+            where += " AND (expires_at IS NULL OR expires_at > :now)";
+            vals.set("now", getCurrentTimestampUTC());
+        }
+
         auto sql = MantisBase::instance().db().session();
-        soci::rowset<soci::row> rows = (sql->prepare <<
+        soci::rowset<soci::row> rows = (sql->prepare << std::format(
             "SELECT id, entity_name, user_id, label, permissions, last_used, created, expires_at "
-            "FROM mb_api_keys WHERE entity_name = :entity AND user_id = :uid",
-            soci::use(entity_name), soci::use(user_id));
+            "FROM mb_api_keys WHERE {} ORDER BY id LIMIT {}", where, page.fetch()), soci::use(vals));
 
         json result = json::array();
         for (const auto &row : rows) {
@@ -71,58 +160,123 @@ namespace mb {
             item["expires_at"] = row.get_indicator(7) == soci::i_null ? json(nullptr) : json(row.get<std::string>(7));
             result.push_back(item);
         }
-        return result;
+
+        // Overlay touches not flushed yet
+        auto &state = keyState();
+        std::lock_guard lock(state.pendingMutex);
+        for (auto &item: result) {
+            if (const auto it = state.pendingLastUsed.find(item["id"].get<std::string>());
+                it != state.pendingLastUsed.end())
+                item["last_used"] = it->second;
+        }
+        return page.envelope(std::move(result));
     }
 
     bool ApiKeyManager::revoke(const std::string &key_id, const std::string &entity_name,
                                const std::string &user_id) {
-        auto sql = MantisBase::instance().db().session();
+        auto sql = MantisBase::instance().db().writeSession();
         *sql << "DELETE FROM mb_api_keys WHERE id = :id AND entity_name = :entity AND user_id = :uid",
             soci::use(key_id), soci::use(entity_name), soci::use(user_id);
 
+        evictKeyId(key_id);
+
         int affected = 0;
         *sql << "SELECT changes()", soci::into(affected);
         return affected > 0;
     }
 
     std::optional<json> ApiKeyManager::lookupByHash(const std::string &key_hash) {
-        auto sql = MantisBase::instance().db().session();
-        soci::row row;
-        *sql << "SELECT id, entity_name, user_id, label, permissions, last_used, created, expires_at "
-                "FROM mb_api_keys WHERE key_hash = :hash",
-            soci::use(key_hash), soci::into(row);
+        auto now = getCurrentTimestampUTC();
+
+        auto info = fromCache(key_hash);
+        if (!info.has_value()) {
+            auto sql = MantisBase::instance().db().session();
+            soci::row row;
+            *sql << "SELECT id, entity_name, user_id, label, permissions, last_used, created, expires_at "
+                    "FROM mb_api_keys WHERE key_hash = :hash",
+                soci::use(key_hash), soci::into(row);
 
-        if (!sql->got_data()) {
-            return std::nullopt;
+            if (!sql->got_data()) {
+                return std::nullopt;
+            }
+
+            json result;
+            result["id"] = row.get<std::string>(0);
+            result["entity_name"] = row.get<std::string>(1);
+            result["user_id"] = row.get<std::string>(2);
+            result["label"] = row.get<std::string>(3);
+            result["permissions"] = json::parse(row.get<std::string>(4, "[]"));
+            result["created"] = row.get<std::string>(6);
+            result["expires_at"] = row.get_indicator(7) == soci::i_null ? json(nullptr) : json(row.get<std::string>(7));
+
+            toCache(key_hash, result);
+            info = std::move(result);
         }
 
-        auto now = getCurrentTimestampUTC();
-        std::string key_id = row.get<std::string>(0);
-        *sql << "UPDATE mb_api_keys SET last_used = :now WHERE id = :id",
-            soci::use(now), soci::use(key_id);
+        auto &result = info.value();
+        const auto key_id = result["id"].get<std::string>();
+
+        // Coalesced in memory, written by flushLastUsed()
+        touchLastUsed(key_id, now);
 
         // Check expiration
-        if (row.get_indicator(7) != soci::i_null) {
-            std::string exp = row.get<std::string>(7);
+        if (result["expires_at"].is_string()) {
+            const auto exp = result["expires_at"].get<std::string>();
             if (!exp.empty() && exp < now) {
                 return std::nullopt;
             }
         }
 
-        json result;
-        result["id"] = row.get<std::string>(0);
-        result["entity_name"] = row.get<std::string>(1);
-        result["user_id"] = row.get<std::string>(2);
-        result["label"] = row.get<std::string>(3);
-        result["permissions"] = json::parse(row.get<std::string>(4, "[]"));
         result["last_used"] = now;
-        result["created"] = row.get<std::string>(6);
-        result["expires_at"] = row.get_indicator(7) == soci::i_null ? json(nullptr) : json(row.get<std::string>(7));
-        return result;
+        return info;
+    }
+
+    std::size_t ApiKeyManager::flushLastUsed() {
+        auto &state = keyState();
+        std::unordered_map<std::string, std::string> batch;
+        {
+            std::lock_guard lock(state.pendingMutex);
+            batch.swap(state.pendingLastUsed);
+        }
+
+        if (batch.empty()) return 0;
+
+        try {
+            auto sql = MantisBase::instance().db().writeSession();
+            soci::transaction tr(*sql);
+
+            std::string id, ts;
+            soci::statement st = (sql->prepare << "UPDATE mb_api_keys SET last_used = :now WHERE id = :id",
+                                  soci::use(ts), soci::use(id));
+            for (const auto &[key_id, last_used]: batch) {
+                id = key_id;
+                ts = last_used;
+                st.execute(true);
+            }
+
+            tr.commit();
+            return batch.size();
+        } catch (const std::exception &e) {
+            LogOrigin::warn("API Keys", fmt::format("Failed to flush last_used for {} key(s): {}", batch.size(), e.what()));
+
+            // Re-queue, keeping any newer touch that arrived meanwhile
+            std::lock_guard lock(state.pendingMutex);
+            for (auto &[key_id, last_used]: batch) {
+                auto &slot = state.pendingLastUsed[key_id];
+                if (slot < last_used) slot = std::move(last_used);
+            }
+            return 0;
+        }
+    }
+
+    void ApiKeyManager::clearCache() {
+        auto &state = keyState();
+        std::unique_lock lock(state.cacheMutex);
+        state.byHash.clear();
     }
 
-    json ApiKeyManager::listAdmin() {
-        return list("mb_admins", "");
+    json ApiKeyManager::listAdmin(const KeysetPage &page, const json &filters) {
+        return list("mb_admins", filters.value("user_id", std::string{}), page, filters);
     }
 
     json ApiKeyManager::createAdmin(const std::string &user_id, const std::string &label,
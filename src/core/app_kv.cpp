@@ -0,0 +1,425 @@
+/**
+ * @file app_kv.cpp
+ * @brief Implementation for @see app_kv.h
+ */
+
+#include "../../include/mantisbase/core/app_kv.h"
+#include "../../include/mantisbase/core/database.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/utils/utils.h"
+#include "../../include/mantisbase/utils/duk_json.h"
+
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace mb {
+    namespace {
+        constexpr std::size_t MAX_KEY_LENGTH = 256;
+
+        /// How often expired pairs are dropped from memory and from `mb_kv`
+        constexpr auto SWEEP_INTERVAL = std::chrono::seconds(60);
+
+        std::int64_t nowMs() {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(
+                AppKv::Clock::now().time_since_epoch()).count();
+        }
+
+        std::int64_t expiryFor(const std::chrono::milliseconds ttl, const std::int64_t now) {
+            return ttl.count() > 0 ? now + ttl.count() : 0;
+        }
+
+        void checkKey(const std::string &key) {
+            if (key.empty() || key.size() > MAX_KEY_LENGTH)
+                throw MantisException(400, fmt::format("Keys must be 1 to {} characters long.", MAX_KEY_LENGTH));
+        }
+    }
+
+    AppKv::Options AppKv::Options::fromEnv() {
+        Options options;
+        if (const auto ms = safe_stoi(getEnvOrDefault("MB_KV_FLUSH_MS", ""), 0); ms > 0)
+            options.flushInterval = std::chrono::milliseconds(ms);
+        if (const auto keys = safe_stoi(getEnvOrDefault("MB_KV_MAX_KEYS", ""), -1); keys >= 0)
+            options.maxKeys = static_cast<std::size_t>(keys);
+        if (const auto bytes = safe_stoi(getEnvOrDefault("MB_KV_MAX_VALUE_BYTES", ""), 0); bytes > 0)
+            options.maxValueBytes = static_cast<std::size_t>(bytes);
+        return options;
+    }
+
+    AppKv::AppKv(const Options options) : m_options(options) {}
+
+    AppKv::~AppKv() {
+        stop();
+    }
+
+    void AppKv::start() {
+        std::lock_guard lock(m_mutex);
+        if (m_thread.joinable()) return;
+
+        try {
+            load();
+        } catch (const std::exception &e) {
+            LogOrigin::warn("Key-Value", fmt::format("Could not load stored pairs: {}", e.what()));
+        }
+        m_stopping = false;
+        m_running = true;
+        m_thread = std::thread(&AppKv::loop, this);
+    }
+
+    void AppKv::stop() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable()) m_thread.join();
+
+        {
+            std::lock_guard lock(m_mutex);
+            m_running = false;
+        }
+        try {
+            flush();
+        } catch (const std::exception &e) {
+            LogOrigin::warn("Key-Value", fmt::format("Changed pairs were not stored: {}", e.what()));
+        }
+    }
+
+    AppKv::Shard &AppKv::shardFor(const std::string &key) {
+        return m_shards[std::hash<std::string>{}(key) % SHARDS];
+    }
+
+    std::unordered_map<std::string, AppKv::Entry>::iterator AppKv::live(Shard &shard, const std::string &key,
+                                                                        const std::int64_t now) {
+        auto it = shard.entries.find(key);
+        if (it != shard.entries.end() && it->second.expiresAt != 0 && it->second.expiresAt <= now) {
+            shard.entries.erase(it);
+            --m_size;
+            touch(shard, key);
+            return shard.entries.end();
+        }
+        return it;
+    }
+
+    void AppKv::put(Shard &shard, const std::string &key, Entry entry) {
+        if (entry.value.dump().size() > m_options.maxValueBytes)
+            throw MantisException(413, fmt::format("Values are limited to {} bytes of JSON.", m_options.maxValueBytes));
+
+        const auto it = shard.entries.find(key);
+        if (it != shard.entries.end()) {
+            it->second = std::move(entry);
+        } else {
+            if (m_options.maxKeys > 0 && m_size.load() >= m_options.maxKeys)
+                throw MantisException(507, fmt::format("The key-value store is full ({} keys).", m_options.maxKeys));
+            shard.entries.emplace(key, std::move(entry));
+            ++m_size;
+        }
+        touch(shard, key);
+    }
+
+    void AppKv::touch(Shard &shard, const std::string &key) {
+        shard.dirty.insert(key);
+        m_dirty = true;
+    }
+
+    void AppKv::afterChange() {
+        {
+            std::lock_guard lock(m_mutex);
+            if (m_running) return;
+        }
+        flush();
+    }
+
+    std::optional<AppKv::Entry> AppKv::get(const std::string &key) {
+        checkKey(key);
+        auto &shard = shardFor(key);
+        std::lock_guard lock(shard.mutex);
+        const auto it = live(shard, key, nowMs());
+        if (it == shard.entries.end()) return std::nullopt;
+        return it->second;
+    }
+
+    void AppKv::set(const std::string &key, nlohmann::json value, const std::chrono::milliseconds ttl) {
+        checkKey(key);
+        auto &shard = shardFor(key);
+        {
+            std::lock_guard lock(shard.mutex);
+            const auto now = nowMs();
+            put(shard, key, {std::move(value), expiryFor(ttl, now)});
+        }
+        afterChange();
+    }
+
+    bool AppKv::remove(const std::string &key) {
+        checkKey(key);
+        auto &shard = shardFor(key);
+        bool removed = false;
+        {
+            std::lock_guard lock(shard.mutex);
+            if (const auto it = live(shard, key, nowMs()); it != shard.entries.end()) {
+                shard.entries.erase(it);
+                --m_size;
+                touch(shard, key);
+                removed = true;
+            }
+        }
+        if (removed) afterChange();
+        return removed;
+    }
+
+    std::int64_t AppKv::incr(const std::string &key, const std::int64_t by, const std::chrono::milliseconds ttl) {
+        checkKey(key);
+        auto &shard = shardFor(key);
+        std::int64_t result = by;
+        {
+            std::lock_guard lock(shard.mutex);
+            const auto now = nowMs();
+            Entry entry{by, expiryFor(ttl, now)};
+            if (const auto it = live(shard, key, now); it != shard.entries.end()) {
+                const auto &current = it->second.value;
+                if (!current.is_number_integer())
+                    throw MantisException(409, fmt::format("The value at `{}` is not an integer.", key));
+                if (current.is_number_unsigned() &&
+                    current.get<std::uint64_t>() > static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max()))
+                    throw MantisException(409, fmt::format("The value at `{}` is out of range.", key));
+                const auto base = current.get<std::int64_t>();
+                if (by > 0 ? base > std::numeric_limits<std::int64_t>::max() - by
+                           : base < std::numeric_limits<std::int64_t>::min() - by)
+                    throw MantisException(409, fmt::format("Adding {} to `{}` would overflow.", by, key));
+                result = base + by;
+                entry.value = result;
+                if (ttl.count() == 0) entry.expiresAt = it->second.expiresAt;
+            }
+            put(shard, key, std::move(entry));
+        }
+        afterChange();
+        return result;
+    }
+
+    bool AppKv::cas(const std::string &key, const nlohmann::json &expected, nlohmann::json desired,
+                    const std::chrono::milliseconds ttl) {
+        checkKey(key);
+        auto &shard = shardFor(key);
+        {
+            std::lock_guard lock(shard.mutex);
+            const auto now = nowMs();
+            const auto it = live(shard, key, now);
+            const bool matches = it == shard.entries.end() ? expected.is_null() : it->second.value == expected;
+            if (!matches) return false;
+            put(shard, key, {std::move(desired), expiryFor(ttl, now)});
+        }
+        afterChange();
+        return true;
+    }
+
+    std::size_t AppKv::flush() {
+        if (!m_dirty.exchange(false)) return 0;
+        std::lock_guard flushing(m_flushMutex);
+
+        // Each key as it is now; the latest value wins however often it changed
+        std::vector<std::pair<std::string, std::optional<Entry>>> changes;
+        for (auto &shard: m_shards) {
+            std::lock_guard lock(shard.mutex);
+            for (const auto &key: shard.dirty) {
+                const auto it = shard.entries.find(key);
+                changes.emplace_back(key, it == shard.entries.end() ? std::nullopt : std::optional(it->second));
+            }
+            shard.dirty.clear();
+        }
+        if (changes.empty()) return 0;
+
+        try {
+            const auto updated = getCurrentTimestampUTC();
+            MantisBase::instance().db().write([&](soci::session &sql) {
+                std::string id, value;
+                long long expires_at = 0;
+                soci::statement upsert = (sql.prepare <<
+                                          "INSERT INTO mb_kv (id, value, expires_at, updated) "
+                                          "VALUES (:id, :value, :expires_at, :updated) "
+                                          "ON CONFLICT(id) DO UPDATE SET value = excluded.value, "
+                                          "expires_at = excluded.expires_at, updated = excluded.updated",
+                                          soci::use(id), soci::use(value), soci::use(expires_at),
+                                          soci::use(updated));
+                soci::statement remove = (sql.prepare << "DELETE FROM mb_kv WHERE id = :id", soci::use(id));
+
+                for (const auto &[key, entry]: changes) {
+                    id = key;
+                    if (entry) {
+                        value = entry->value.dump();
+                        expires_at = entry->expiresAt;
+                        upsert.execute(true);
+                    } else {
+                        remove.execute(true);
+                    }
+                }
+            });
+        } catch (const std::exception &) {
+            // Marked again, so the next flush writes whatever they hold by then
+            for (const auto &[key, entry]: changes) {
+                auto &shard = shardFor(key);
+                std::lock_guard lock(shard.mutex);
+                touch(shard, key);
+            }
+            throw;
+        }
+        return changes.size();
+    }
+
+    std::size_t AppKv::load() {
+        std::lock_guard flushing(m_flushMutex);
+        std::array<std::unordered_map<std::string, Entry>, SHARDS> loaded;
+        std::size_t count = 0;
+        {
+            const auto sql = MantisBase::instance().db().session();
+            std::string id, value;
+            long long expires_at = 0;
+            const long long now = nowMs();
+            soci::statement st = (sql->prepare <<
+                                  "SELECT id, value, expires_at FROM mb_kv WHERE expires_at = 0 OR expires_at > :now",
+                                  soci::use(now), soci::into(id), soci::into(value), soci::into(expires_at));
+            st.execute();
+            while (st.fetch()) {
+                try {
+                    loaded[std::hash<std::string>{}(id) % SHARDS].emplace(id, Entry{nlohmann::json::parse(value),
+                                                                                    expires_at});
+                    ++count;
+                } catch (const nlohmann::json::parse_error &) {
+                    LogOrigin::warn("Key-Value", fmt::format("Skipping `{}`, its stored value isn't JSON", id));
+                }
+            }
+        }
+
+        for (std::size_t i = 0; i < SHARDS; ++i) {
+            std::lock_guard lock(m_shards[i].mutex);
+            m_shards[i].entries = std::move(loaded[i]);
+            m_shards[i].dirty.clear();
+        }
+        m_size = count;
+        return count;
+    }
+
+    void AppKv::sweep() {
+        const auto now = nowMs();
+        for (auto &shard: m_shards) {
+            std::lock_guard lock(shard.mutex);
+            std::erase_if(shard.entries, [&](const auto &pair) {
+                if (pair.second.expiresAt == 0 || pair.second.expiresAt > now) return false;
+                --m_size;
+                return true;
+            });
+        }
+
+        // Rows rewritten since expiring are newer than `now`, so this can't drop a live pair
+        const long long cutoff = now;
+        MantisBase::instance().db().write([&](soci::session &sql) {
+            sql << "DELETE FROM mb_kv WHERE expires_at > 0 AND expires_at <= :now", soci::use(cutoff);
+        });
+    }
+
+    void AppKv::loop() {
+        auto next_sweep = std::chrono::steady_clock::now() + SWEEP_INTERVAL;
+        std::unique_lock lock(m_mutex);
+        while (!m_stopping) {
+            m_cv.wait_for(lock, m_options.flushInterval, [this] { return m_stopping; });
+            lock.unlock();
+
+            try {
+                flush();
+                if (std::chrono::steady_clock::now() >= next_sweep) {
+                    sweep();
+                    next_sweep = std::chrono::steady_clock::now() + SWEEP_INTERVAL;
+                }
+            } catch (const std::exception &e) {
+                LogOrigin::warn("Key-Value", fmt::format("Writing changed pairs failed, retrying: {}", e.what()));
+                lock.lock();
+                // Give the database a moment before the next try
+                m_cv.wait_for(lock, std::chrono::seconds(1), [this] { return m_stopping; });
+                continue;
+            }
+            lock.lock();
+        }
+    }
+
+#ifdef MB_SCRIPTING_ENABLED
+    namespace {
+        std::string keyArg(duk_context *ctx) {
+            if (!duk_is_string(ctx, 0)) throw std::invalid_argument("Expected a key string as the first argument");
+            return duk_get_string(ctx, 0);
+        }
+
+        nlohmann::json jsonArg(duk_context *ctx, const duk_idx_t idx) {
+            if (idx >= duk_get_top(ctx) || duk_is_undefined(ctx, idx)) return nullptr;
+            return dukToJson(ctx, idx);
+        }
+
+        std::chrono::milliseconds ttlArg(duk_context *ctx, const duk_idx_t idx) {
+            if (idx >= duk_get_top(ctx) || !duk_is_number(ctx, idx)) return {};
+            return std::chrono::milliseconds(static_cast<std::int64_t>(duk_get_number(ctx, idx)));
+        }
+
+        /// Runs `fn`, raising what it throws as a JS error once its locals are gone
+        template<typename Fn>
+        duk_ret_t guarded(duk_context *ctx, Fn &&fn) {
+            bool failed = false;
+            try {
+                fn();
+            } catch (const std::invalid_argument &e) {
+                duk_push_error_object(ctx, DUK_ERR_TYPE_ERROR, "%s", e.what());
+                failed = true;
+            } catch (const std::exception &e) {
+                duk_push_error_object(ctx, DUK_ERR_ERROR, "%s", e.what());
+                failed = true;
+            }
+            if (failed) return duk_throw(ctx);
+            return 1;
+        }
+    }
+
+    void AppKv::registerDuktapeMethods() {
+        const auto ctx = MantisBase::instance().ctx();
+        // `app.kv().get("flags:beta")`, `app.kv().incr("hits", 1, 60000)`, ...
+        dukglue_register_method_varargs(ctx, &AppKv::get_JS, "get");
+        dukglue_register_method_varargs(ctx, &AppKv::set_JS, "set");
+        dukglue_register_method_varargs(ctx, &AppKv::remove_JS, "remove");
+        dukglue_register_method_varargs(ctx, &AppKv::incr_JS, "incr");
+        dukglue_register_method_varargs(ctx, &AppKv::cas_JS, "cas");
+    }
+
+    duk_ret_t AppKv::get_JS(duk_context *ctx) {
+        return guarded(ctx, [&] {
+            const auto entry = get(keyArg(ctx));
+            if (entry) dukPushJson(ctx, entry->value);
+            else duk_push_null(ctx);
+        });
+    }
+
+    duk_ret_t AppKv::set_JS(duk_context *ctx) {
+        return guarded(ctx, [&] {
+            set(keyArg(ctx), jsonArg(ctx, 1), ttlArg(ctx, 2));
+            duk_push_undefined(ctx);
+        });
+    }
+
+    duk_ret_t AppKv::remove_JS(duk_context *ctx) {
+        return guarded(ctx, [&] { duk_push_boolean(ctx, remove(keyArg(ctx))); });
+    }
+
+    duk_ret_t AppKv::incr_JS(duk_context *ctx) {
+        return guarded(ctx, [&] {
+            const auto by = duk_get_top(ctx) > 1 && duk_is_number(ctx, 1)
+                                ? static_cast<std::int64_t>(duk_get_number(ctx, 1))
+                                : 1;
+            duk_push_number(ctx, static_cast<double>(incr(keyArg(ctx), by, ttlArg(ctx, 2))));
+        });
+    }
+
+    duk_ret_t AppKv::cas_JS(duk_context *ctx) {
+        return guarded(ctx, [&] {
+            duk_push_boolean(ctx, cas(keyArg(ctx), jsonArg(ctx, 1), jsonArg(ctx, 2), ttlArg(ctx, 3)));
+        });
+    }
+#endif
+}
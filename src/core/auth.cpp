@@ -1,26 +1,38 @@
 #include "../../../include/mantisbase/core/auth.h"
 #include "../../include/mantisbase/mantisbase.h"
 #include "../../include/mantisbase/utils/crypto_utils.h"
+#include "../../include/mantisbase/core/shared_state.h"
+#include "../../include/mantisbase/core/revocation_filter.h"
+#include "../../include/mantisbase/core/session_store.h"
+#include "../../include/mantisbase/core/tenants.h"
+#include "../../include/mantisbase/core/token_verifier.h"
 
+#include <algorithm>
 #include <cstring>
+#include <format>
 #include <jwt-cpp/traits/nlohmann-json/defaults.h>
 
 namespace mb
 {
     std::string Auth::createToken(const json& claims_params, const int timeout)
     {
-        const auto secretKey = MantisBase::jwtSecretKey();
+        const auto signing = TokenVerifier::Config::current();
         if (claims_params.empty() || !claims_params.contains("id") || !claims_params.contains("entity"))
         {
             throw std::invalid_argument("Missing `id` and/or `entity` fields in token claims.");
         }
 
-        const auto& config = json::object();
-        const int expiry_t = timeout > 0
-                                 ? timeout
-                                 : claims_params.at("entity").get<std::string>() == "mb_admins"
-                                 ? config.value("adminSessionTimeout", 1 * 60 * 60)
-                                 : config.value("sessionTimeout", 24 * 60 * 60);
+        const auto settings = MantisBase::instance().settings().snapshot();
+        const auto& config = settings->values;
+        int expiry_t = timeout > 0
+                           ? timeout
+                           : claims_params.at("entity").get<std::string>() == "mb_admins"
+                           ? config.value("adminSessionTimeout", 1 * 60 * 60)
+                           : config.value("sessionTimeout", 24 * 60 * 60);
+
+        // Stateless tokens are only checked against revocations that recent
+        if (signing.stateless)
+            expiry_t = std::min(expiry_t, static_cast<int>(signing.accessTtl.count()));
 
         // Create a session record
         auto session_id = generateTimeBasedId();
@@ -33,13 +45,19 @@ namespace mb
                              .set_not_before(time)
                              .set_expires_at(time + std::chrono::seconds(expiry_t));
 
-        if (config.value("jwtEnableSetIssuer", false))
+        if (!signing.issuer.empty())
         {
-            token_builder.set_issuer(config.at("appName").get<std::string>());
+            token_builder.set_issuer(signing.issuer);
         }
-        if (config.value("jwtEnableSetAudience", false))
+        if (!signing.audience.empty())
         {
-            token_builder.set_audience(config.at("baseUrl").get<std::string>());
+            token_builder.set_audience(signing.audience);
+        }
+
+        const auto signer = tokenVerifier().signer(signing);
+        if (!signer.keyId.empty())
+        {
+            token_builder.set_key_id(signer.keyId);
         }
 
         // Add session_id to claims
@@ -50,27 +68,22 @@ namespace mb
             token_builder.set_payload_claim(key, value);
         }
 
-        const std::string token = token_builder.sign(jwt::algorithm::hs256{secretKey});
+        const std::string token = token_builder.sign(signer);
 
-        // Store session in database
+        // Queued, so the login doesn't wait on the INSERT; see SessionStore
         try {
-            auto sql = MantisBase::instance().db().session();
-            auto token_hash = sha256Hex(token);
-            auto entity_name = claims_params.at("entity").get<std::string>();
-            auto user_id = claims_params.at("id").get<std::string>();
-
             // Compute expiry timestamp
             auto expiry_time = std::chrono::system_clock::now() + std::chrono::seconds(expiry_t);
             auto expiry_tt = std::chrono::system_clock::to_time_t(expiry_time);
             auto* utc = std::gmtime(&expiry_tt);
             char expires_buf[20];
             std::strftime(expires_buf, sizeof(expires_buf), "%Y-%m-%d %H:%M:%S", utc);
-            std::string expires_at(expires_buf);
 
-            *sql << "INSERT INTO mb_sessions (id, entity_name, user_id, token_hash, expires_at, created) "
-                    "VALUES (:id, :entity, :uid, :hash, :exp, :now)",
-                soci::use(session_id), soci::use(entity_name), soci::use(user_id),
-                soci::use(token_hash), soci::use(expires_at), soci::use(now);
+            MantisBase::instance().sessionStore().add({
+                session_id, claims_params.at("entity").get<std::string>(), claims_params.at("id").get<std::string>(),
+                sha256Hex(token), std::string(expires_buf), now
+            });
+            sessionCache().putValid(session_id, expiry_time);
         } catch (const std::exception& e) {
             LogOrigin::authWarn("Session Creation Failed", fmt::format("Failed to create session: {}", e.what()));
         }
@@ -87,65 +100,72 @@ namespace mb
 
         try
         {
-            const auto decoded = jwt::decode(token);
-            const auto secretKey = MantisBase::jwtSecretKey();
-
-            auto verifier = jwt::verify()
-                .allow_algorithm(jwt::algorithm::hs256{secretKey});
-
-            const auto& config = json::object();
-            if (config.value("jwtEnableSetIssuer", false))
-            {
-                verifier.with_issuer(config.at("appName").get<std::string>());
-            }
-            if (config.value("jwtEnableSetAudience", false))
-            {
-                verifier.with_audience(config.at("baseUrl").get<std::string>());
-            }
-
-            std::error_code ec;
-            verifier.verify(decoded, ec);
-
-            if (ec)
-            {
-                LogOrigin::authTrace("Token Verification Failed", fmt::format("Token verification failed: {}", ec.message()));
-                result["error"] = ec.message();
-                return result;
-            }
-
-            json claims;
-            for (auto& [key, value] : decoded.get_payload_json())
-            {
-                claims[key] = value;
-            }
-
-            if (!claims.contains("id") || !claims.contains("entity"))
+            // Built once per key configuration, see TokenVerifier
+            const auto config = TokenVerifier::Config::current();
+            const auto [verified, error] = tokenVerifier().verify(token, config);
+            if (!verified)
             {
-                result["error"] = "Malformed token: Missing `id` or `entity` claim field.";
+                MB_LOG_TRACE(LogOrigin::authTrace, "Token Verification Failed", fmt::format("Token verification failed: {}", error));
+                result["error"] = error;
                 return result;
             }
+            const auto& claims = *verified;
 
-            // Verify session exists in database
-            if (claims.contains("session_id")) {
+            // Verify session exists, from the cache if we have seen it recently
+            if (!claims.sessionId.empty()) {
                 try {
-                    auto sql = MantisBase::instance().db().session();
-                    auto session_id = claims["session_id"].get<std::string>();
-                    auto now = getCurrentTimestampUTC();
-
-                    int count = 0;
-                    *sql << "SELECT COUNT(*) FROM mb_sessions WHERE id = :id AND expires_at > :now",
-                        soci::use(session_id), soci::use(now), soci::into(count);
-
-                    if (count == 0) {
+                    const auto& session_id = claims.sessionId;
+                    auto& cache = sessionCache();
+                    // Read first, so a logout racing the checks below keeps it out of the cache
+                    const auto seen = cache.generation(session_id);
+
+                    switch (cache.lookup(session_id)) {
+                    case SessionCache::State::Valid:
+                        break;
+                    case SessionCache::State::Revoked:
                         result["error"] = "Session expired or revoked";
                         return result;
+                    case SessionCache::State::Unknown: {
+                        // Stateless: the signature and `exp` suffice, unless the session may be revoked
+                        if (config.stateless && !revocations().mayContain(session_id)) {
+                            if (claims.expiresAt)
+                                cache.putValid(session_id, *claims.expiresAt, seen);
+                            break;
+                        }
+
+                        // Issued here and not written yet
+                        if (MantisBase::instance().sessionStore().pending(session_id)) {
+                            if (claims.expiresAt)
+                                cache.putValid(session_id, *claims.expiresAt, seen);
+                            break;
+                        }
+
+                        // Every tenant's sessions are in the application's `mb_sessions`
+                        auto sql = MantisBase::instance().rootDb().session();
+                        auto now = getCurrentTimestampUTC();
+
+                        int count = 0;
+                        *sql << "SELECT COUNT(*) FROM mb_sessions WHERE id = :id AND expires_at > :now",
+                            soci::use(session_id), soci::use(now), soci::into(count);
+
+                        if (count == 0) {
+                            cache.putRevoked(session_id);
+                            result["error"] = "Session expired or revoked";
+                            return result;
+                        }
+
+                        // The token can't outlive its own `exp`, so that bounds the cache TTL
+                        if (claims.expiresAt)
+                            cache.putValid(session_id, *claims.expiresAt, seen);
+                        break;
+                    }
                     }
                 } catch (const std::exception& e) {
                     LogOrigin::authWarn("Session Validation Error", fmt::format("Failed to validate session: {}", e.what()));
                 }
             }
 
-            result["claims"] = claims;
+            result["claims"] = claims.toJSON();
             result["verified"] = true;
             return result;
         }
@@ -158,8 +178,14 @@ namespace mb
     }
 
     bool Auth::deleteSession(const std::string& session_id) {
+        sessionCache().putRevoked(session_id);
+        revocations().add(session_id);
+        SharedState::publishRevocation(session_id);
+        // Never written, or written before the DELETE below
+        MantisBase::instance().sessionStore().cancel(session_id);
+
         try {
-            auto sql = MantisBase::instance().db().session();
+            auto sql = MantisBase::instance().rootDb().writeSession();
             *sql << "DELETE FROM mb_sessions WHERE id = :id", soci::use(session_id);
             int affected = 0;
             *sql << "SELECT changes()", soci::into(affected);
@@ -169,9 +195,65 @@ namespace mb
         }
     }
 
+    json Auth::listSessions(const KeysetPage& page, const json& filters) {
+        // One user's sessions seek idx_sessions_owner
+        std::string where = "id > :after AND expires_at > :now";
+        soci::values vals;
+        vals.set("after", page.after);
+        vals.set("now", getCurrentTimestampUTC());
+        for (const auto* key : {"entity_name", "user_id"}) {
+            if (const auto value = filters.value(key, std::string{}); !value.empty()) {
+                where += std::format(" AND {0} = :{0}", key);
+                vals.set(key, value);
+            }
+        }
+
+        const auto sql = MantisBase::instance().rootDb().session();
+        const soci::rowset<soci::row> rows = (sql->prepare << std::format(
+            "SELECT id, entity_name, user_id, expires_at, created FROM mb_sessions WHERE {} ORDER BY id LIMIT {}",
+            where, page.fetch()), soci::use(vals));
+
+        json sessions = json::array();
+        for (const auto& row : rows) {
+            sessions.push_back({
+                {"id", row.get<std::string>(0)},
+                {"entity_name", row.get<std::string>(1)},
+                {"user_id", row.get<std::string>(2)},
+                {"expires_at", row.get<std::string>(3)},
+                {"created", row.get<std::string>(4)}
+            });
+        }
+        return page.envelope(std::move(sessions));
+    }
+
+    SessionCache& Auth::sessionCache() {
+        static SessionCache cache;
+        return cache;
+    }
+
+    RevocationFilter& Auth::revocations() {
+        static RevocationFilter filter(RevocationFilter::Options::fromEnv());
+        return filter;
+    }
+
+    TokenVerifier& Auth::tokenVerifier() {
+        static TokenVerifier verifier;
+        return verifier;
+    }
+
+    AuthUserCache& Auth::userCache() {
+        if (auto* tenant = Tenants::current()) return tenant->users;
+        static AuthUserCache cache;
+        return cache;
+    }
+
     json Auth::refreshSession(const std::string& old_session_id, const std::string& entity_name,
                               const std::string& user_id) {
-        auto sql = MantisBase::instance().db().session();
+        // A session issued moments ago may still be queued
+        if (auto& store = MantisBase::instance().sessionStore(); store.pending(old_session_id))
+            store.flush();
+
+        auto sql = MantisBase::instance().rootDb().writeSession();
         auto now = getCurrentTimestampUTC();
 
         // Verify old session exists
@@ -185,6 +267,9 @@ namespace mb
 
         // Delete old session
         *sql << "DELETE FROM mb_sessions WHERE id = :id", soci::use(old_session_id);
+        sessionCache().putRevoked(old_session_id);
+        revocations().add(old_session_id);
+        SharedState::publishRevocation(old_session_id);
 
         // Create new token (which creates a new session)
         auto token = createToken({{"id", user_id}, {"entity", entity_name}});
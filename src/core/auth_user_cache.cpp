@@ -0,0 +1,101 @@
+#include "../../include/mantisbase/core/auth_user_cache.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace mb {
+    AuthUserCache::AuthUserCache(const std::size_t capacity, const std::chrono::seconds ttl)
+        : m_shardCapacity(std::max<std::size_t>(1, capacity / SHARD_COUNT)),
+          m_ttl(ttl) {}
+
+    std::optional<nlohmann::json> AuthUserCache::get(const std::string &entity, const std::string &user_id) {
+        const auto k = key(entity, user_id);
+        auto &shard = shardFor(k);
+        std::lock_guard lock(shard.mutex);
+
+        const auto it = shard.entries.find(k);
+        if (it == shard.entries.end())
+            return std::nullopt;
+
+        if (it->second.expiresAt <= Clock::now()) {
+            shard.entries.erase(it);
+            return std::nullopt;
+        }
+
+        return it->second.user;
+    }
+
+    void AuthUserCache::put(const std::string &entity, const std::string &user_id, nlohmann::json user) {
+        if (m_ttl.count() <= 0) return;
+        if (user.is_object()) user.erase("password");
+
+        const auto k = key(entity, user_id);
+        auto &shard = shardFor(k);
+        std::lock_guard lock(shard.mutex);
+
+        const auto now = Clock::now();
+        if (!shard.entries.contains(k) && shard.entries.size() >= m_shardCapacity) {
+            std::erase_if(shard.entries, [now](const auto &kv) { return kv.second.expiresAt <= now; });
+            if (shard.entries.size() >= m_shardCapacity)
+                shard.entries.erase(shard.entries.begin());
+        }
+
+        shard.entries.insert_or_assign(k, Entry{std::move(user), now + m_ttl});
+    }
+
+    void AuthUserCache::invalidate(const std::string &entity, const std::string &user_id) {
+        const auto k = key(entity, user_id);
+        auto &shard = shardFor(k);
+        std::lock_guard lock(shard.mutex);
+        shard.entries.erase(k);
+    }
+
+    void AuthUserCache::invalidateEntity(const std::string &entity) {
+        const auto prefix = entity + '\x1f';
+        for (auto &shard: m_shards) {
+            std::lock_guard lock(shard.mutex);
+            std::erase_if(shard.entries, [&prefix](const auto &kv) { return kv.first.starts_with(prefix); });
+        }
+    }
+
+    void AuthUserCache::clear() {
+        for (auto &shard: m_shards) {
+            std::lock_guard lock(shard.mutex);
+            shard.entries.clear();
+        }
+    }
+
+    void AuthUserCache::onChanges(const nlohmann::json &events) {
+        if (!events.is_array()) return;
+
+        for (const auto &event: events) {
+            if (!event.is_object()) continue;
+
+            const auto type = event.value("type", std::string{});
+            if (type != "UPDATE" && type != "DELETE") continue;
+
+            const auto &entity = event.value("entity", nlohmann::json{});
+            const auto &row_id = event.value("row_id", nlohmann::json{});
+            if (entity.is_string() && row_id.is_string())
+                invalidate(entity.get<std::string>(), row_id.get<std::string>());
+        }
+    }
+
+    std::size_t AuthUserCache::size() const {
+        std::size_t total = 0;
+        for (const auto &shard: m_shards) {
+            std::lock_guard lock(shard.mutex);
+            total += shard.entries.size();
+        }
+        return total;
+    }
+
+    std::string AuthUserCache::key(const std::string &entity, const std::string &user_id) {
+        // Unit separator can't appear in a valid entity name
+        return entity + '\x1f' + user_id;
+    }
+
+    AuthUserCache::Shard &AuthUserCache::shardFor(const std::string &key) {
+        return m_shards[std::hash<std::string>{}(key) % SHARD_COUNT];
+    }
+}
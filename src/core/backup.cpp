@@ -0,0 +1,245 @@
+#include "../../include/mantisbase/core/backup.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <memory>
+#include <soci/sqlite3/soci-sqlite3.h>
+
+namespace fs = std::filesystem;
+
+namespace mb {
+    namespace {
+        struct SqliteCloser {
+            void operator()(sqlite_api::sqlite3 *db) const { sqlite_api::sqlite3_close_v2(db); }
+        };
+
+        using SqliteHandle = std::unique_ptr<sqlite_api::sqlite3, SqliteCloser>;
+
+        SqliteHandle open(const fs::path &path, const int flags) {
+            sqlite_api::sqlite3 *db = nullptr;
+            const auto rc = sqlite_api::sqlite3_open_v2(path.string().c_str(), &db, flags, nullptr);
+            SqliteHandle handle(db);
+            if (rc != SQLITE_OK)
+                throw MantisException(500, std::format("Could not open `{}` for backup: {}", path.string(),
+                                                       db ? sqlite_api::sqlite3_errmsg(db) : "out of memory"));
+            return handle;
+        }
+
+        // First column of the first row, or 0 (also if `sql` fails, e.g. on a missing table)
+        long long scalar(sqlite_api::sqlite3 *db, const char *sql) {
+            sqlite_api::sqlite3_stmt *stmt = nullptr;
+            long long value = 0;
+            if (sqlite_api::sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK &&
+                sqlite_api::sqlite3_step(stmt) == SQLITE_ROW)
+                value = sqlite_api::sqlite3_column_int64(stmt, 0);
+            sqlite_api::sqlite3_finalize(stmt);
+            return value;
+        }
+
+        // Sortable and unique to the millisecond, e.g. 20261014T101500123Z
+        std::string snapshotName() {
+            const auto now = std::chrono::system_clock::now();
+            const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
+            const std::tm utc = toUtcTime(std::chrono::system_clock::to_time_t(now));
+            char buffer[20];
+            std::strftime(buffer, sizeof(buffer), "%Y%m%dT%H%M%S", &utc);
+            return std::format("{}{:03}Z", buffer, ms);
+        }
+
+        // Newest earlier snapshot that has a files/ tree to link against
+        fs::path previousFiles(const fs::path &root, const fs::path &current) {
+            std::error_code ec;
+            fs::path best;
+            for (const auto &entry: fs::directory_iterator(root, ec)) {
+                if (!entry.is_directory() || entry.path() == current) continue;
+                if (!fs::exists(entry.path() / "files")) continue;
+                if (best.empty() || entry.path().filename() > best.filename()) best = entry.path();
+            }
+            return best.empty() ? best : best / "files";
+        }
+    }
+
+    Backup::Options Backup::Options::fromEnv() {
+        Options options;
+        if (const auto pages = safe_stoi(getEnvOrDefault("MB_BACKUP_PAGES", ""), 0); pages > 0)
+            options.pagesPerStep = pages;
+        if (const auto ms = safe_stoi(getEnvOrDefault("MB_BACKUP_PAUSE_MS", ""), -1); ms >= 0)
+            options.pause = std::chrono::milliseconds(ms);
+        return options;
+    }
+
+    fs::path Backup::rootFromEnv(const std::string &data_dir) {
+        const auto dir = getEnvOrDefault("MB_BACKUP_DIR", "");
+        return dir.empty() ? fs::path(data_dir) / "backups" : fs::path(dir);
+    }
+
+    int Backup::copyDatabase(const fs::path &src, const fs::path &dest, const Options &options,
+                             const std::atomic<bool> *cancel, SnapshotInfo *info) {
+        const auto source = open(src, SQLITE_OPEN_READONLY);
+
+        // Steps taken inside one read transaction all see the same snapshot, so
+        // commits landing in the WAL meanwhile neither restart nor tear the copy
+        if (sqlite_api::sqlite3_exec(source.get(), "BEGIN; SELECT count(*) FROM sqlite_master;",
+                                     nullptr, nullptr, nullptr) != SQLITE_OK)
+            throw MantisException(500, std::format("Could not read `{}` for backup: {}", src.string(),
+                                                   sqlite_api::sqlite3_errmsg(source.get())));
+        if (info) {
+            info->schemaVersion = scalar(source.get(), "PRAGMA schema_version");
+            info->changeId = scalar(source.get(), "SELECT seq FROM sqlite_sequence WHERE name = 'mb_change_log'");
+        }
+
+        auto part = dest;
+        part += ".part";
+        fs::remove(part);
+
+        int pages = 0;
+        {
+            const auto target = open(part, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+            auto *backup = sqlite_api::sqlite3_backup_init(target.get(), "main", source.get(), "main");
+            if (!backup)
+                throw MantisException(500, std::format("Could not start the backup of `{}`: {}", src.string(),
+                                                       sqlite_api::sqlite3_errmsg(target.get())));
+
+            int rc = SQLITE_OK;
+            while (true) {
+                if (cancel && cancel->load(std::memory_order_relaxed)) {
+                    rc = SQLITE_INTERRUPT;
+                    break;
+                }
+                rc = sqlite_api::sqlite3_backup_step(backup, std::max(options.pagesPerStep, 1));
+                if (rc == SQLITE_DONE) break;
+                if (rc != SQLITE_OK && rc != SQLITE_BUSY && rc != SQLITE_LOCKED) break;
+                if (options.pause.count() > 0) std::this_thread::sleep_for(options.pause);
+            }
+
+            pages = sqlite_api::sqlite3_backup_pagecount(backup);
+            sqlite_api::sqlite3_backup_finish(backup);
+
+            if (rc != SQLITE_DONE) {
+                const std::string reason = rc == SQLITE_INTERRUPT ? "cancelled" : sqlite_api::sqlite3_errstr(rc);
+                std::error_code ec;
+                fs::remove(part, ec);
+                throw MantisException(500, std::format("Backup of `{}` failed: {}", src.string(), reason));
+            }
+        }
+        sqlite_api::sqlite3_exec(source.get(), "COMMIT;", nullptr, nullptr, nullptr);
+
+        fs::rename(part, dest);
+        return pages;
+    }
+
+    Backup::FileStats Backup::snapshotFiles(const fs::path &src, const fs::path &dest, const fs::path &previous) {
+        FileStats stats;
+        fs::create_directories(dest);
+        if (!fs::exists(src)) return stats;
+
+        for (auto it = fs::recursive_directory_iterator(src); it != fs::recursive_directory_iterator(); ++it) {
+            const auto &entry = *it;
+            const auto rel = fs::relative(entry.path(), src);
+            if (it.depth() == 0 && entry.path().filename().string().starts_with(".")) {
+                if (entry.is_directory()) it.disable_recursion_pending();
+                continue;
+            }
+
+            const auto target = dest / rel;
+            if (entry.is_directory()) {
+                fs::create_directories(target);
+                continue;
+            }
+            if (!entry.is_regular_file()) continue;
+
+            const auto size = entry.file_size();
+            const auto mtime = entry.last_write_time();
+            if (!previous.empty()) {
+                const auto prior = previous / rel;
+                std::error_code ec;
+                if (fs::is_regular_file(prior, ec) && fs::file_size(prior, ec) == size &&
+                    fs::last_write_time(prior, ec) == mtime) {
+                    // Falls back to a copy across filesystems
+                    fs::create_hard_link(prior, target, ec);
+                    if (!ec) {
+                        ++stats.linked;
+                        continue;
+                    }
+                }
+            }
+
+            fs::copy_file(entry.path(), target, fs::copy_options::overwrite_existing);
+            // The next snapshot compares against this, so keep the source's time
+            fs::last_write_time(target, mtime);
+            ++stats.copied;
+            stats.bytes += size;
+        }
+        return stats;
+    }
+
+    json Backup::run(const fs::path &data_dir, const fs::path &root, const bool files, const Options &options,
+                     const std::atomic<bool> *cancel) {
+        const auto started = std::chrono::steady_clock::now();
+        const auto dir = root / snapshotName();
+        fs::create_directories(dir);
+
+        json summary{{"path", dir.string()}, {"databases", json::object()}};
+        try {
+            for (const auto *name: {"mantis.db", "mantis_logs.db"}) {
+                if (!fs::exists(data_dir / name)) continue;
+                summary["databases"][name] = {{"pages", copyDatabase(data_dir / name, dir / name, options, cancel)}};
+            }
+
+            if (files) {
+                const auto stats = snapshotFiles(data_dir / "files", dir / "files", previousFiles(root, dir));
+                summary["files"] = {{"copied", stats.copied}, {"linked", stats.linked}, {"bytes", stats.bytes}};
+            }
+        } catch (...) {
+            // A partial snapshot must not become the base of the next one
+            std::error_code ec;
+            fs::remove_all(dir, ec);
+            throw;
+        }
+
+        summary["ms"] = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - started).count();
+        return summary;
+    }
+
+    Backup::Backup(fs::path data_dir, fs::path root, const Options options)
+        : m_dataDir(std::move(data_dir)), m_root(std::move(root)), m_options(options) {}
+
+    Backup::~Backup() {
+        m_cancel = true;
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+    bool Backup::start(const bool files) {
+        std::lock_guard lock(m_mutex);
+        if (m_running) return false;
+        if (m_thread.joinable()) m_thread.join();
+
+        m_running = true;
+        m_last = {{"started", getCurrentTimestampUTC()}, {"files", files}};
+        m_thread = std::thread([this, files] {
+            json result;
+            try {
+                result = run(m_dataDir, m_root, files, m_options, &m_cancel);
+                LogOrigin::info("Backup", std::format("Backup written to `{}`", result["path"].get<std::string>()));
+            } catch (const std::exception &e) {
+                result = {{"error", e.what()}};
+                LogOrigin::warn("Backup", std::format("Backup failed: {}", e.what()));
+            }
+
+            std::lock_guard guard(m_mutex);
+            result["started"] = m_last["started"];
+            result["finished"] = getCurrentTimestampUTC();
+            m_last = std::move(result);
+            m_running = false;
+        });
+        return true;
+    }
+
+    json Backup::status() const {
+        std::lock_guard lock(m_mutex);
+        return {{"running", m_running}, {"last", m_last.empty() ? json(nullptr) : m_last}};
+    }
+}
@@ -0,0 +1,227 @@
+/**
+ * @file blob_store.cpp
+ * @brief Implementation for @see blob_store.h
+ */
+
+#include "../../include/mantisbase/core/blob_store.h"
+#include "../../include/mantisbase/core/database.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/files.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/core/storage.h"
+#include "../../include/mantisbase/core/tracing.h"
+#include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <array>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace mb {
+    namespace fs = std::filesystem;
+
+    namespace {
+        /// Serialises placing and unlinking a blob; striped so unrelated uploads don't wait on each other
+        std::mutex &blobLock(const std::string &sha256) {
+            static std::array<std::mutex, 64> stripes;
+            return stripes[std::hash<std::string>{}(sha256) % stripes.size()];
+        }
+
+        bool isSha256Hex(const std::string &s) {
+            return s.size() == 64 && std::ranges::all_of(s, [](const char c) {
+                return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+            });
+        }
+
+        void linkInto(const fs::path &blob, const fs::path &target) {
+            std::error_code ec;
+            fs::remove(target, ec);
+            fs::create_hard_link(blob, target, ec);
+            if (!ec) return;
+
+            // No hard links on this filesystem; a copy still behaves the same
+            fs::copy_file(blob, target, fs::copy_options::overwrite_existing, ec);
+            if (ec)
+                throw MantisException(500, "Failed to store file `" + target.filename().string() + "`: " + ec.message());
+        }
+
+        /// Take one reference on `sha256` for `entity/filename`, inside a write
+        void addRef(soci::session &sql, const std::string &entity_name, const std::string &filename,
+                    const std::string &sha256, const long long size) {
+            long long refs = 0;
+            sql << "SELECT refs FROM mb_file_blobs WHERE hash = :h", soci::use(sha256), soci::into(refs);
+            if (sql.got_data()) {
+                sql << "UPDATE mb_file_blobs SET refs = refs + 1 WHERE hash = :h", soci::use(sha256);
+            } else {
+                const auto now = getCurrentTimestampUTC();
+                sql << "INSERT INTO mb_file_blobs (hash, size, refs, created) VALUES (:h, :s, 1, :c)",
+                        soci::use(sha256), soci::use(size), soci::use(now);
+            }
+            sql << "INSERT INTO mb_file_refs (entity_name, filename, hash) VALUES (:e, :f, :h)",
+                    soci::use(entity_name), soci::use(filename), soci::use(sha256);
+        }
+
+        /// Hand blobs whose last reference went away to the storage for removal
+        void dropUnreferenced(const std::vector<std::string> &hashes) {
+            auto &storage = MantisBase::instance().storage();
+            for (const auto &sha256: hashes) storage.scheduleRemoval(sha256);
+        }
+    }
+
+    fs::path BlobStore::blobsDir() {
+        // Not a valid entity name, so it can't collide with an entity's directory
+        return Files::filesBaseDir() / ".blobs";
+    }
+
+    fs::path BlobStore::blobPath(const std::string &sha256) {
+        return blobsDir() / sha256.substr(0, 2) / sha256;
+    }
+
+    void BlobStore::put(const std::string &entity_name, const std::string &filename,
+                        const fs::path &staged_path, const std::string &sha256,
+                        const std::string &content_type) {
+        if (!isSha256Hex(sha256))
+            throw MantisException(500, "Invalid content hash for `" + filename + "`.");
+
+        const Tracer::Span span("file.blob.put");
+        const fs::path target = Files::filePath(entity_name, filename);
+        auto &backend = MantisBase::instance().storage().backend();
+        const auto size = static_cast<long long>(fs::file_size(staged_path));
+
+        std::lock_guard lock(blobLock(sha256));
+        std::error_code ec;
+        if (backend.hasBlob(sha256)) {
+            // Already stored; the upload's copy isn't needed
+            fs::remove(staged_path, ec);
+        } else {
+            backend.putBlob(sha256, staged_path, content_type);
+        }
+
+        if (backend.isLocal()) linkInto(blobPath(sha256), target);
+
+        try {
+            MantisBase::instance().db().write([&](soci::session &sql) {
+                addRef(sql, entity_name, filename, sha256, size);
+            });
+        } catch (const std::exception &e) {
+            fs::remove(target, ec);
+            if (refCount(sha256) == 0) backend.removeBlob(sha256);
+            throw MantisException(500, "Failed to record `" + filename + "`: " + e.what());
+        }
+    }
+
+    void BlobStore::link(const std::string &from_entity, const std::string &from_filename,
+                         const std::string &to_entity, const std::string &to_filename) {
+        const auto sha256 = hashOf(from_entity, from_filename);
+        if (!sha256.has_value())
+            throw MantisException(404, "File `" + from_filename + "` is not in the blob store.");
+
+        const fs::path source = Files::filePath(from_entity, from_filename);
+        const fs::path target = Files::filePath(to_entity, to_filename);
+        const bool local = MantisBase::instance().storage().backend().isLocal();
+
+        std::lock_guard lock(blobLock(*sha256));
+        // The entity file is itself a link to the blob, and survives the blob being dropped
+        if (local) linkInto(source, target);
+
+        try {
+            const auto size = static_cast<long long>(local ? fs::file_size(source) : 0);
+            MantisBase::instance().db().write([&](soci::session &sql) {
+                addRef(sql, to_entity, to_filename, *sha256, size);
+            });
+        } catch (const std::exception &e) {
+            std::error_code ec;
+            fs::remove(target, ec);
+            throw MantisException(500, "Failed to record `" + to_filename + "`: " + e.what());
+        }
+
+        // Bring a blob lost to a racing release() back, so later uploads dedup against it
+        if (std::error_code ec; local && !fs::exists(blobPath(*sha256))) {
+            fs::create_directories(blobPath(*sha256).parent_path(), ec);
+            fs::create_hard_link(source, blobPath(*sha256), ec);
+        }
+    }
+
+    std::optional<std::string> BlobStore::release(const std::string &entity_name, const std::string &filename) {
+        const Tracer::Span span("file.blob.release");
+        std::optional<std::string> hash;
+        long long refs = 0;
+
+        MantisBase::instance().db().write([&](soci::session &sql) {
+            std::string sha256;
+            sql << "SELECT hash FROM mb_file_refs WHERE entity_name = :e AND filename = :f",
+                    soci::use(entity_name), soci::use(filename), soci::into(sha256);
+            if (!sql.got_data()) return;
+
+            hash = sha256;
+            sql << "DELETE FROM mb_file_refs WHERE entity_name = :e AND filename = :f",
+                    soci::use(entity_name), soci::use(filename);
+            sql << "UPDATE mb_file_blobs SET refs = refs - 1 WHERE hash = :h", soci::use(sha256);
+            sql << "SELECT refs FROM mb_file_blobs WHERE hash = :h", soci::use(sha256), soci::into(refs);
+            if (sql.got_data() && refs <= 0) {
+                sql << "DELETE FROM mb_file_blobs WHERE hash = :h", soci::use(sha256);
+                refs = 0;
+            }
+        });
+
+        if (hash.has_value() && refs == 0) dropUnreferenced({*hash});
+        return hash;
+    }
+
+    void BlobStore::releaseEntity(const std::string &entity_name) {
+        std::vector<std::string> dropped;
+
+        MantisBase::instance().db().write([&](soci::session &sql) {
+            std::map<std::string, long long> counts;
+            const soci::rowset<std::string> rows = (sql.prepare <<
+                "SELECT hash FROM mb_file_refs WHERE entity_name = :e", soci::use(entity_name));
+            for (const auto &sha256: rows) ++counts[sha256];
+
+            sql << "DELETE FROM mb_file_refs WHERE entity_name = :e", soci::use(entity_name);
+            for (const auto &[sha256, n]: counts) {
+                long long refs = 0;
+                sql << "UPDATE mb_file_blobs SET refs = refs - :n WHERE hash = :h", soci::use(n), soci::use(sha256);
+                sql << "SELECT refs FROM mb_file_blobs WHERE hash = :h", soci::use(sha256), soci::into(refs);
+                if (sql.got_data() && refs <= 0) {
+                    sql << "DELETE FROM mb_file_blobs WHERE hash = :h", soci::use(sha256);
+                    dropped.push_back(sha256);
+                }
+            }
+        });
+
+        dropUnreferenced(dropped);
+    }
+
+    void BlobStore::renameEntity(const std::string &old_entity_name, const std::string &new_entity_name) {
+        MantisBase::instance().db().write([&](soci::session &sql) {
+            sql << "UPDATE mb_file_refs SET entity_name = :n WHERE entity_name = :o",
+                    soci::use(new_entity_name), soci::use(old_entity_name);
+        });
+    }
+
+    bool BlobStore::dropIfUnreferenced(const std::string &sha256) {
+        // Under the lock put() holds, so a blob being re-uploaded right now is left alone
+        std::lock_guard lock(blobLock(sha256));
+        if (refCount(sha256) > 0) return true;
+        return MantisBase::instance().storage().backend().removeBlob(sha256);
+    }
+
+    std::optional<std::string> BlobStore::hashOf(const std::string &entity_name, const std::string &filename) {
+        const auto sql = MantisBase::instance().db().session();
+        std::string sha256;
+        *sql << "SELECT hash FROM mb_file_refs WHERE entity_name = :e AND filename = :f",
+                soci::use(entity_name), soci::use(filename), soci::into(sha256);
+        if (!sql->got_data()) return std::nullopt;
+        return sha256;
+    }
+
+    std::size_t BlobStore::refCount(const std::string &sha256) {
+        const auto sql = MantisBase::instance().db().session();
+        long long refs = 0;
+        *sql << "SELECT refs FROM mb_file_blobs WHERE hash = :h", soci::use(sha256), soci::into(refs);
+        if (!sql->got_data() || refs < 0) return 0;
+        return static_cast<std::size_t>(refs);
+    }
+}
@@ -0,0 +1,91 @@
+/**
+ * @file cache_budget.cpp
+ * @brief Implementation for @see cache_budget.h
+ */
+
+#include "../../include/mantisbase/core/cache_budget.h"
+#include "../../include/mantisbase/core/metrics.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <map>
+
+namespace mb {
+    CacheBudget::Options CacheBudget::Options::fromEnv() {
+        Options options;
+        if (const auto mb = safe_stoi(getEnvOrDefault("MB_CACHE_BUDGET_MB", ""), 0); mb > 0)
+            options.maxBytes = static_cast<std::size_t>(mb) * 1024 * 1024;
+        return options;
+    }
+
+    CacheBudget::Account::Account(CacheBudget &budget, std::string kind, Shed shed)
+        : m_budget(budget), m_kind(std::move(kind)), m_shed(std::move(shed)) {}
+
+    void CacheBudget::Account::charge(const std::size_t bytes) {
+        m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        m_budget.m_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    void CacheBudget::Account::release(const std::size_t bytes) {
+        m_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+        m_budget.m_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    CacheBudget::CacheBudget(Options options) : m_options(options) {}
+
+    CacheBudget &CacheBudget::shared() {
+        static CacheBudget budget(Options::fromEnv());
+        return budget;
+    }
+
+    CacheBudget *CacheBudget::fromEnv() {
+        auto &budget = shared();
+        return budget.enabled() ? &budget : nullptr;
+    }
+
+    std::shared_ptr<CacheBudget::Account> CacheBudget::join(std::string kind, Shed shed) {
+        auto account = std::make_shared<Account>(*this, std::move(kind), std::move(shed));
+        std::lock_guard lock(m_mutex);
+        m_accounts.push_back(account);
+        return account;
+    }
+
+    void CacheBudget::leave(const std::shared_ptr<Account> &account) {
+        if (!account) return;
+        std::lock_guard lock(m_mutex);
+        std::erase(m_accounts, account);
+        account->release(account->bytes());
+    }
+
+    void CacheBudget::enforce() {
+        if (!enabled() || bytes() <= m_options.maxBytes) return;
+        // Whoever is shedding already keeps at it while the total is over
+        std::unique_lock lock(m_mutex, std::try_to_lock);
+        if (!lock) return;
+
+        while (bytes() > m_options.maxBytes) {
+            const auto largest = std::ranges::max_element(m_accounts, {}, &Account::bytes);
+            if (largest == m_accounts.end() || (*largest)->bytes() == 0) return;
+
+            const auto freed = (*largest)->m_shed(bytes() - m_options.maxBytes);
+            if (freed == 0) return;
+            m_shed.fetch_add(freed, std::memory_order_relaxed);
+        }
+    }
+
+    void CacheBudget::writeMetrics(MetricsWriter &out) const {
+        std::map<std::string, std::size_t> kinds;
+        {
+            std::lock_guard lock(m_mutex);
+            for (const auto &account: m_accounts) kinds[account->kind()] += account->bytes();
+        }
+
+        out.family("mb_cache_budget_bytes", "Bytes the caches hold against the shared budget, by cache", "gauge");
+        for (const auto &[kind, held]: kinds)
+            out.sample("mb_cache_budget_bytes", {{"cache", kind}}, static_cast<double>(held));
+        out.family("mb_cache_budget_limit_bytes", "The shared cache budget", "gauge");
+        out.sample("mb_cache_budget_limit_bytes", {}, static_cast<double>(m_options.maxBytes));
+        out.family("mb_cache_budget_shed_bytes_total", "Bytes evicted to keep the caches within the budget", "counter");
+        out.sample("mb_cache_budget_shed_bytes_total", {}, static_cast<double>(shedBytes()));
+    }
+}
@@ -0,0 +1,152 @@
+#include "../../include/mantisbase/core/change_capture.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <soci/soci.h>
+
+#include <algorithm>
+
+namespace mb {
+    namespace {
+        /// The database clock in Unix seconds, as the triggers compare leases against
+        const char *epochNow(const bool pg) {
+            return pg ? "CAST(EXTRACT(EPOCH FROM NOW()) AS bigint)" : "CAST(strftime('%s', 'now') AS INTEGER)";
+        }
+    }
+
+    ChangeCapture::Options ChangeCapture::Options::fromEnv() {
+        Options options;
+        auto mode = trim(getEnvOrDefault("MB_RT_CAPTURE", "always"));
+        toLowerCase(mode);
+        options.lazy = mode == "lazy";
+        if (const auto secs = safe_stoi(getEnvOrDefault("MB_RT_CAPTURE_GRACE_S", ""), 0); secs > 0)
+            options.grace = std::chrono::seconds(secs);
+        return options;
+    }
+
+    const ChangeCapture::Options &ChangeCapture::Options::current() {
+        static const Options options = fromEnv();
+        return options;
+    }
+
+    ChangeCapture::ChangeCapture(Renew renew, const Options options)
+        : m_renew(std::move(renew)), m_options(options) {}
+
+    ChangeCapture::~ChangeCapture() {
+        stop();
+    }
+
+    void ChangeCapture::start() {
+        std::lock_guard lock(m_mutex);
+        if (m_thread.joinable()) return;
+        m_stopping = false;
+        m_thread = std::thread(&ChangeCapture::loop, this);
+    }
+
+    void ChangeCapture::stop() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+    void ChangeCapture::hold(const std::string &entity, const bool on) {
+        {
+            std::lock_guard lock(m_mutex);
+            if (!on) {
+                // The lease stays out until it lapses, which is the grace period
+                if (const auto it = m_holds.find(entity); it != m_holds.end() && --it->second <= 0)
+                    m_holds.erase(it);
+                return;
+            }
+            if (++m_holds[entity] > 1) return;
+            m_wake = true;
+        }
+        m_cv.notify_one();
+    }
+
+    bool ChangeCapture::captured(const std::string &entity, const Clock::time_point now) const {
+        std::lock_guard lock(m_mutex);
+        for (const auto &name: {entity, std::string("*")}) {
+            if (m_holds.contains(name)) return true;
+            if (const auto it = m_leases.find(name); it != m_leases.end() && it->second > now) return true;
+        }
+        return false;
+    }
+
+    void ChangeCapture::tick(const Clock::time_point now) {
+        // Renewed a third of the way in, and good for a renewal longer than the
+        // grace period, so a lease outlives its last holder by at least that
+        const auto interval = std::max<std::chrono::seconds>(m_options.grace / 3, std::chrono::seconds(1));
+        const auto ttl = m_options.grace + interval;
+
+        std::vector<std::string> due;
+        {
+            std::lock_guard lock(m_mutex);
+            m_wake = false;
+            std::erase_if(m_leases, [&](const auto &lease) {
+                return lease.second <= now && !m_holds.contains(lease.first);
+            });
+            for (const auto &[entity, _]: m_holds)
+                if (const auto it = m_leases.find(entity); it == m_leases.end() || it->second - now < ttl - interval)
+                    due.push_back(entity);
+        }
+        if (due.empty()) return;
+
+        try {
+            m_renew(due, ttl);
+        } catch (const std::exception &e) {
+            // Retried on the next tick; meanwhile the old leases may lapse
+            LogOrigin::dbWarn("Change Capture", fmt::format("Lease renewal failed: {}", e.what()));
+            return;
+        }
+
+        std::lock_guard lock(m_mutex);
+        for (const auto &entity: due)
+            m_leases[entity] = now + ttl;
+    }
+
+    void ChangeCapture::loop() {
+        const auto interval = std::max<std::chrono::seconds>(m_options.grace / 3, std::chrono::seconds(1));
+        while (true) {
+            {
+                std::unique_lock lock(m_mutex);
+                m_cv.wait_for(lock, interval, [this] { return m_stopping || m_wake; });
+                if (m_stopping) return;
+            }
+            tick();
+        }
+    }
+
+    void ChangeCapture::createTable(soci::session &sql) {
+        // Without WAL on PostgreSQL: a lease lost in a crash is renewed within seconds
+        sql << (sql.get_backend_name() == "postgresql"
+                    ? "CREATE UNLOGGED TABLE IF NOT EXISTS mb_rt_capture (entity TEXT NOT NULL, node TEXT NOT NULL, "
+                    "expires BIGINT NOT NULL, PRIMARY KEY (entity, node))"
+                    : "CREATE TABLE IF NOT EXISTS mb_rt_capture (entity TEXT NOT NULL, node TEXT NOT NULL, "
+                    "expires INTEGER NOT NULL, PRIMARY KEY (entity, node))");
+    }
+
+    void ChangeCapture::lease(soci::session &sql, const std::string &node, const std::vector<std::string> &entities,
+                              const std::chrono::seconds ttl) {
+        const bool pg = sql.get_backend_name() == "postgresql";
+        const int secs = static_cast<int>(ttl.count());
+        for (const auto &entity: entities) {
+            // PostgreSQL triggers see the folded table name
+            auto name = entity;
+            if (pg) toLowerCase(name);
+            sql << std::format("INSERT INTO mb_rt_capture (entity, node, expires) VALUES (:entity, :node, {} + :ttl) "
+                               "ON CONFLICT (entity, node) DO UPDATE SET expires = excluded.expires", epochNow(pg)),
+                    soci::use(name, "entity"), soci::use(node, "node"), soci::use(secs, "ttl");
+        }
+        // Any node's; a lapsed lease gates nothing
+        sql << std::format("DELETE FROM mb_rt_capture WHERE expires < {}", epochNow(pg));
+    }
+
+    std::string ChangeCapture::sqliteCondition(const std::string &entity) {
+        return std::format("EXISTS (SELECT 1 FROM mb_rt_capture WHERE entity IN ('{}', '*') AND expires >= {})",
+                           entity, epochNow(false));
+    }
+}
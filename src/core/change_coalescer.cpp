@@ -0,0 +1,77 @@
+#include "../../include/mantisbase/core/change_coalescer.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+namespace mb {
+    ChangeCoalescer::ChangeCoalescer(const std::chrono::milliseconds window)
+        : m_window(std::max(window, std::chrono::milliseconds(0))) {}
+
+    std::chrono::milliseconds ChangeCoalescer::windowFromEnv() {
+        return std::chrono::milliseconds(std::max(0, safe_stoi(getEnvOrDefault("MB_REALTIME_COALESCE_MS", ""), 0)));
+    }
+
+    void ChangeCoalescer::add(json change, const Clock::time_point now) {
+        auto key = change["entity"].get<std::string>() + ':' + change["row_id"].get<std::string>();
+
+        const auto found = m_byKey.find(key);
+        if (found == m_byKey.end()) {
+            const auto it = m_order.insert(m_order.end(), {key, std::move(change), now + m_window});
+            m_byKey.emplace(std::move(key), it);
+            return;
+        }
+
+        auto &held = found->second->change;
+        const auto held_type = held["type"].get<std::string>();
+        const auto type = change["type"].get<std::string>();
+
+        if (held_type == "DELETE") {
+            // Row re-created: both events matter, in order
+            m_ready.push_back(std::move(held));
+            m_order.erase(found->second);
+            m_byKey.erase(found);
+            add(std::move(change), now);
+            return;
+        }
+
+        if (type == "DELETE") {
+            if (held_type == "INSERT") {
+                // Created and removed within the window; subscribers never saw it
+                m_order.erase(found->second);
+                m_byKey.erase(found);
+                m_merged += 2;
+                return;
+            }
+            held = std::move(change);
+            ++m_merged;
+            return;
+        }
+
+        // INSERT/UPDATE followed by a write: latest row, original operation
+        auto old_data = std::move(held["old_data"]);
+        held = std::move(change);
+        held["type"] = held_type;
+        if (held_type == "UPDATE") held["old_data"] = std::move(old_data);
+        ++m_merged;
+    }
+
+    std::vector<json> ChangeCoalescer::drain(const Clock::time_point now) {
+        auto due = std::move(m_ready);
+        m_ready.clear();
+
+        while (!m_order.empty() && m_order.front().due <= now) {
+            m_byKey.erase(m_order.front().key);
+            due.push_back(std::move(m_order.front().change));
+            m_order.pop_front();
+        }
+        return due;
+    }
+
+    std::vector<json> ChangeCoalescer::flush() {
+        return drain(Clock::time_point::max());
+    }
+
+    std::optional<ChangeCoalescer::Clock::time_point> ChangeCoalescer::nextDeadline() const {
+        if (!m_ready.empty()) return Clock::time_point::min();
+        if (m_order.empty()) return std::nullopt;
+        return m_order.front().due;
+    }
+}
@@ -0,0 +1,98 @@
+#include "../../include/mantisbase/core/change_journal.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace mb {
+    ChangeJournal::ChangeJournal(const std::size_t capacity)
+        : m_mask(std::bit_ceil(std::max<std::size_t>(2, capacity)) - 1),
+          m_cells(std::make_unique<Cell[]>(m_mask + 1)) {
+        for (std::size_t i = 0; i <= m_mask; ++i)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    bool ChangeJournal::publish(json event) {
+        // Bounded MPMC ring (per-cell sequence numbers); producers only race on m_head
+        auto pos = m_head.load(std::memory_order_relaxed);
+        Cell *cell;
+        for (;;) {
+            cell = &m_cells[pos & m_mask];
+            const auto seq = cell->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->event = std::move(event);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool ChangeJournal::consume(json &event) {
+        auto pos = m_tail.load(std::memory_order_relaxed);
+        Cell *cell;
+        for (;;) {
+            cell = &m_cells[pos & m_mask];
+            const auto seq = cell->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0) {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false; // empty
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        event = std::move(cell->event);
+        cell->event = nullptr;
+        cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    json ChangeJournal::makeEvent(const std::string &type, const std::string &entity, const std::string &row_id,
+                                  json old_data, json new_data) {
+        return {
+            {"timestamp", tmToStr(toUtcTime(std::time(nullptr)))},
+            {"type", type},
+            {"entity", entity},
+            {"row_id", row_id},
+            {"old_data", std::move(old_data)},
+            {"new_data", std::move(new_data)}
+        };
+    }
+
+    ChangeDeduplicator::ChangeDeduplicator(const std::chrono::seconds ttl) : m_ttl(ttl) {}
+
+    bool ChangeDeduplicator::accept(const Source source, const std::string &type, const std::string &entity,
+                                    const std::string &row_id) {
+        auto &p = m_pending[type + '\x1f' + entity + '\x1f' + row_id];
+        p.touched = Clock::now();
+
+        auto &mine = source == Source::Journal ? p.journal : p.log;
+        auto &theirs = source == Source::Journal ? p.log : p.journal;
+
+        if (theirs > 0) {
+            --theirs; // Already delivered from the other source
+            return false;
+        }
+
+        ++mine;
+        return true;
+    }
+
+    void ChangeDeduplicator::purge() {
+        const auto cutoff = Clock::now() - m_ttl;
+        std::erase_if(m_pending, [cutoff](const auto &kv) {
+            return kv.second.touched < cutoff || (kv.second.journal == 0 && kv.second.log == 0);
+        });
+    }
+}
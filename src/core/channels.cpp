@@ -0,0 +1,299 @@
+/**
+ * @file channels.cpp
+ * @brief Implementation for @see channels.h
+ */
+
+#include "../../include/mantisbase/core/channels.h"
+#include "../../include/mantisbase/core/realtime_access.h"
+#include "../../include/mantisbase/core/realtime_event.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <cctype>
+
+namespace mb {
+    namespace {
+        constexpr std::size_t MAX_NAME = 128;
+
+        std::optional<AccessRule> ruleOf(std::string mode) {
+            mode = trim(mode);
+            toLowerCase(mode);
+            if (mode == "public" || mode == "auth") return AccessRule(mode);
+            // Admins pass every custom rule
+            if (mode == "admin") return AccessRule("custom", "auth.entity == \"mb_admins\"");
+            return std::nullopt;
+        }
+
+        json idOf(const json &auth, const char *key) {
+            const auto it = auth.find(key);
+            return it != auth.end() && it->is_string() ? *it : json(nullptr);
+        }
+    }
+
+    Channels::Channels() : m_node(getEnvOrDefault("MB_NODE_ID", "")) {
+        if (m_node.empty()) m_node = generateShortId();
+        if (const auto bytes = safe_stoi(getEnvOrDefault("MB_REALTIME_CHANNEL_MAX_BYTES", ""), 0); bytes > 0)
+            m_maxBytes = static_cast<std::size_t>(bytes);
+        define(std::string(SYSTEM_PREFIX) + "*", {*ruleOf("admin"), *ruleOf("admin")});
+        // Clients keep the public settings until told they changed
+        define(std::string(SETTINGS), {*ruleOf("public"), *ruleOf("admin")});
+        loadEnv();
+    }
+
+    Channels &Channels::instance() {
+        static Channels channels;
+        return channels;
+    }
+
+    std::optional<std::string> Channels::nameOf(const std::string_view topic) {
+        if (!isChannel(topic)) return std::nullopt;
+        const auto name = topic.substr(1);
+        if (name.empty() || name.size() > MAX_NAME) return std::nullopt;
+        const bool valid = std::ranges::all_of(name, [](const unsigned char c) {
+            return std::isalnum(c) || c == '_' || c == '-' || c == ':' || c == '.';
+        });
+        if (!valid) return std::nullopt;
+        return std::string(name);
+    }
+
+    std::string Channels::topicOf(const std::string_view name) {
+        return std::string(1, PREFIX) + std::string(name);
+    }
+
+    void Channels::define(const std::string &pattern, Rules rules) {
+        auto shared = std::make_shared<const Rules>(std::move(rules));
+        std::lock_guard lock(m_rulesMutex);
+        if (pattern.ends_with('*'))
+            m_prefixes[pattern.substr(0, pattern.size() - 1)] = std::move(shared);
+        else
+            m_exact[pattern] = std::move(shared);
+    }
+
+    void Channels::loadEnv() {
+        for (const auto &entry: splitString(getEnvOrDefault("MB_REALTIME_CHANNELS", ""), ",")) {
+            if (trim(entry).empty()) continue;
+            const auto eq = entry.find('=');
+            const auto pattern = eq == std::string::npos ? std::string{} : trim(entry.substr(0, eq));
+            auto spec = eq == std::string::npos ? std::string{} : trim(entry.substr(eq + 1));
+
+            Rules rules;
+            if (spec.ends_with("+presence")) {
+                rules.presence = true;
+                spec.resize(spec.size() - std::string_view("+presence").size());
+            }
+            const auto slash = spec.find('/');
+            const auto subscribe = ruleOf(spec.substr(0, slash));
+            const auto publish = slash == std::string::npos ? subscribe : ruleOf(spec.substr(slash + 1));
+            if (pattern.empty() || !subscribe || !publish) {
+                LogOrigin::warn("Realtime Channels", fmt::format("Ignoring MB_REALTIME_CHANNELS entry `{}`", entry));
+                continue;
+            }
+            rules.subscribe = *subscribe;
+            rules.publish = *publish;
+            define(pattern, std::move(rules));
+        }
+    }
+
+    std::shared_ptr<const Channels::Rules> Channels::rules(const std::string_view name) const {
+        std::lock_guard lock(m_rulesMutex);
+        if (const auto it = m_exact.find(std::string(name)); it != m_exact.end()) return it->second;
+
+        std::shared_ptr<const Rules> best;
+        std::size_t longest = 0;
+        for (const auto &[prefix, rules]: m_prefixes) {
+            if (name.starts_with(prefix) && (!best || prefix.size() > longest)) {
+                best = rules;
+                longest = prefix.size();
+            }
+        }
+        return best;
+    }
+
+    bool Channels::canSubscribe(const std::string &name, const RealtimeAuth &who) const {
+        const auto declared = rules(name);
+        return declared && RealtimeAccess::instance().allows(declared->subscribe, who, {{"channel", name}});
+    }
+
+    void Channels::publish(const std::string &name, const json &data, const RealtimeAuth &who) {
+        const auto declared = rules(name);
+        if (!declared)
+            throw MantisException(404, std::format("Channel `{}` is not declared.", name));
+        if (name.starts_with(SYSTEM_PREFIX))
+            throw MantisException(403, std::format("Only the server sends on `{}`.", name));
+        if (!RealtimeAccess::instance().allows(declared->publish, who, {{"channel", name}}))
+            throw MantisException(403, std::format("Not allowed to publish to `{}`.", name));
+        if (data.dump().size() > m_maxBytes)
+            throw MantisException(413, std::format("Message is over {} bytes.", m_maxBytes));
+
+        json payload = {
+            {"type", "message"},
+            {"topic", topicOf(name)},
+            {"channel", name},
+            {"data", data},
+            {"from", memberInfo(who, who.principal)},
+            {"timestamp", tmToStr(toUtcTime(std::time(nullptr)))}
+        };
+        // Under Coalesce, a sender's newer message replaces its pending one (cursors, typing)
+        deliver(name, std::move(payload), topicOf(name) + '\x1e' + who.principal, true, true);
+    }
+
+    void Channels::announce(const std::string_view name, json payload) {
+        payload["topic"] = topicOf(name);
+        payload["channel"] = name;
+        // Under Coalesce, only the newest pending announcement is kept
+        deliver(std::string(name), std::move(payload), topicOf(name), true, false);
+    }
+
+    void Channels::joined(const std::string &name, const RealtimeAuth &who, const std::string &connection) {
+        const auto declared = rules(name);
+        if (!declared || !declared->presence) return;
+
+        const auto key = memberKey(who, connection);
+        json info;
+        bool first_here = false, appeared = false;
+        {
+            std::lock_guard lock(m_membersMutex);
+            auto &member = m_members[name][key];
+            if (member.info.is_null()) member.info = memberInfo(who, key);
+            info = member.info;
+            appeared = member.connections.empty() && member.nodes.empty();
+            first_here = member.connections.empty();
+            member.connections.insert(connection);
+        }
+
+        // Other nodes count this node once, however many connections it has
+        if (first_here) presenceChanged(name, info, true, appeared);
+    }
+
+    void Channels::left(const std::string &name, const RealtimeAuth &who, const std::string &connection) {
+        const auto key = memberKey(who, connection);
+        json info;
+        bool last_here = false, gone = false;
+        {
+            std::lock_guard lock(m_membersMutex);
+            const auto cit = m_members.find(name);
+            if (cit == m_members.end()) return;
+            const auto mit = cit->second.find(key);
+            if (mit == cit->second.end() || mit->second.connections.erase(connection) == 0) return;
+
+            info = mit->second.info;
+            last_here = mit->second.connections.empty();
+            gone = last_here && mit->second.nodes.empty();
+            if (gone) cit->second.erase(mit);
+            if (cit->second.empty()) m_members.erase(cit);
+        }
+
+        if (last_here) presenceChanged(name, info, false, gone);
+    }
+
+    json Channels::members(const std::string &name) const {
+        json list = json::array();
+        std::lock_guard lock(m_membersMutex);
+        if (const auto it = m_members.find(name); it != m_members.end())
+            for (const auto &member: it->second) list.push_back(member.second.info);
+        return list;
+    }
+
+    void Channels::receive(const std::string_view notification) {
+        const auto message = json::parse(notification, nullptr, false);
+        if (!message.is_object() || message.value("node", "") == m_node) return;
+        const auto node = message.value("node", "");
+        auto payload = message.value("event", json::object());
+        const auto name = payload.value("channel", "");
+        if (node.empty() || !nameOf(topicOf(name))) return;
+
+        const auto type = payload.value("type", "");
+        if (type == "message") {
+            const auto from = payload.value("from", json::object()).value("key", "guest");
+            deliver(name, std::move(payload), topicOf(name) + '\x1e' + from, true, false);
+            return;
+        }
+        if (type != "presence") return;
+
+        const auto member = payload.value("member", json::object());
+        const auto key = member.value("key", "");
+        if (key.empty()) return;
+
+        bool changed = false;
+        {
+            std::lock_guard lock(m_membersMutex);
+            if (payload.value("action", "") == "join") {
+                auto &entry = m_members[name][key];
+                if (entry.info.is_null()) entry.info = member;
+                changed = entry.connections.empty() && entry.nodes.empty();
+                entry.nodes.insert(node);
+            } else {
+                const auto cit = m_members.find(name);
+                if (cit == m_members.end()) return;
+                const auto mit = cit->second.find(key);
+                if (mit == cit->second.end() || mit->second.nodes.erase(node) == 0) return;
+                changed = mit->second.connections.empty() && mit->second.nodes.empty();
+                if (changed) cit->second.erase(mit);
+                if (cit->second.empty()) m_members.erase(cit);
+            }
+        }
+        if (changed) deliver(name, std::move(payload), topicOf(name) + '\x1f' + key, true, false);
+    }
+
+    void Channels::setSink(Sink sink) {
+        std::lock_guard lock(m_sinkMutex);
+        m_sink = std::move(sink);
+    }
+
+    void Channels::setForward(Forward forward) {
+        std::lock_guard lock(m_sinkMutex);
+        m_forward = std::move(forward);
+    }
+
+    void Channels::reset() {
+        {
+            std::lock_guard lock(m_rulesMutex);
+            m_exact.clear();
+            m_prefixes.clear();
+        }
+        std::lock_guard lock(m_membersMutex);
+        m_members.clear();
+    }
+
+    std::string Channels::memberKey(const RealtimeAuth &who, const std::string &connection) {
+        // Guests can't be told apart, so each of their connections is its own member
+        return who.verified ? who.principal : "guest:" + connection;
+    }
+
+    json Channels::memberInfo(const RealtimeAuth &who, const std::string &key) {
+        return {
+            {"key", key},
+            {"id", who.verified ? idOf(who.auth, "id") : json(nullptr)},
+            {"entity", who.verified ? idOf(who.auth, "entity") : json(nullptr)}
+        };
+    }
+
+    void Channels::presenceChanged(const std::string &name, const json &member, const bool joined,
+                                   const bool visible) {
+        json payload = {
+            {"type", "presence"},
+            {"topic", topicOf(name)},
+            {"channel", name},
+            {"action", joined ? "join" : "leave"},
+            {"member", member},
+            {"timestamp", tmToStr(toUtcTime(std::time(nullptr)))}
+        };
+        // Subscribers here only hear of a member appearing or going away entirely
+        deliver(name, std::move(payload), topicOf(name) + '\x1f' + member.value("key", ""), visible, true);
+    }
+
+    void Channels::deliver(const std::string &name, json payload, std::string key, const bool local,
+                           const bool forward) {
+        Sink sink;
+        Forward other_nodes;
+        {
+            std::lock_guard lock(m_sinkMutex);
+            if (local) sink = m_sink;
+            if (forward) other_nodes = m_forward;
+        }
+        if (other_nodes) other_nodes(json{{"node", m_node}, {"event", payload}}.dump());
+        if (sink) sink(topicOf(name), EncodedEvent::ephemeral(std::move(payload), std::move(key)));
+    }
+}
@@ -0,0 +1,197 @@
+/**
+ * @file compression.cpp
+ * @brief Implementation for @see compression.h
+ */
+
+#include "../../include/mantisbase/core/compression.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <optional>
+
+#include <zlib.h>
+#ifdef MB_HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+#ifdef MB_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace mb {
+    namespace {
+        std::string_view trimView(std::string_view s) {
+            while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front()))) s.remove_prefix(1);
+            while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back()))) s.remove_suffix(1);
+            return s;
+        }
+
+        bool iequals(const std::string_view a, const std::string_view b) {
+            return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const char x, const char y) {
+                return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+            });
+        }
+
+        /// q-value of one `coding;q=0.5` element, 1 without one
+        double qValue(std::string_view params) {
+            while (!params.empty()) {
+                const auto semi = params.find(';');
+                const auto param = trimView(params.substr(0, semi));
+                params = semi == std::string_view::npos ? std::string_view{} : params.substr(semi + 1);
+                if (param.size() < 2 || std::tolower(static_cast<unsigned char>(param[0])) != 'q' || param[1] != '=')
+                    continue;
+                double q = 0;
+                const auto value = param.substr(2);
+                if (std::from_chars(value.data(), value.data() + value.size(), q).ec != std::errc{}) return 0;
+                return std::clamp(q, 0.0, 1.0);
+            }
+            return 1;
+        }
+
+        std::string gzip(const std::string_view data, const int level) {
+            z_stream zs{};
+            // 15 window bits, +16 for a gzip header and trailer
+            if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return {};
+
+            std::string out(deflateBound(&zs, static_cast<uLong>(data.size())), '\0');
+            zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+            zs.avail_in = static_cast<uInt>(data.size());
+            zs.next_out = reinterpret_cast<Bytef *>(out.data());
+            zs.avail_out = static_cast<uInt>(out.size());
+            const auto rc = deflate(&zs, Z_FINISH);
+            out.resize(zs.total_out);
+            deflateEnd(&zs);
+            return rc == Z_STREAM_END ? out : std::string{};
+        }
+    }
+
+    Compression::Options Compression::Options::fromEnv() {
+        Options options;
+        options.enabled = getEnvOrDefault("MB_COMPRESSION", "1") != "0";
+        if (const auto size = safe_stoi(getEnvOrDefault("MB_COMPRESSION_MIN_SIZE", ""), -1); size >= 0)
+            options.minSize = static_cast<std::size_t>(size);
+        return options;
+    }
+
+    bool Compression::available(const Encoding encoding) {
+        switch (encoding) {
+            case Encoding::Identity:
+            case Encoding::Gzip:
+                return true;
+            case Encoding::Brotli:
+#ifdef MB_HAVE_BROTLI
+                return true;
+#else
+                return false;
+#endif
+            case Encoding::Zstd:
+#ifdef MB_HAVE_ZSTD
+                return true;
+#else
+                return false;
+#endif
+        }
+        return false;
+    }
+
+    std::string_view Compression::token(const Encoding encoding) {
+        switch (encoding) {
+            case Encoding::Gzip: return "gzip";
+            case Encoding::Brotli: return "br";
+            case Encoding::Zstd: return "zstd";
+            default: return "";
+        }
+    }
+
+    std::string_view Compression::suffix(const Encoding encoding) {
+        switch (encoding) {
+            case Encoding::Gzip: return ".gz";
+            case Encoding::Brotli: return ".br";
+            case Encoding::Zstd: return ".zst";
+            default: return "";
+        }
+    }
+
+    Compression::Encoding Compression::negotiate(std::string_view accept_encoding) {
+        // q-value per coding, as the client listed them
+        std::array<std::optional<double>, PREFERENCE.size()> named{};
+        std::optional<double> wildcard;
+
+        while (!accept_encoding.empty()) {
+            const auto comma = accept_encoding.find(',');
+            const auto item = trimView(accept_encoding.substr(0, comma));
+            accept_encoding = comma == std::string_view::npos ? std::string_view{} : accept_encoding.substr(comma + 1);
+
+            const auto semi = item.find(';');
+            const auto coding = trimView(item.substr(0, semi));
+            const auto q = semi == std::string_view::npos ? 1.0 : qValue(item.substr(semi + 1));
+
+            if (coding == "*") {
+                wildcard = q;
+                continue;
+            }
+            for (std::size_t i = 0; i < PREFERENCE.size(); ++i) {
+                // `x-gzip` is the legacy alias
+                if (iequals(coding, token(PREFERENCE[i])) ||
+                    (PREFERENCE[i] == Encoding::Gzip && iequals(coding, "x-gzip")))
+                    named[i] = q;
+            }
+        }
+
+        auto best = Encoding::Identity;
+        double best_q = 0;
+        for (std::size_t i = 0; i < PREFERENCE.size(); ++i) {
+            const auto q = named[i].has_value() ? *named[i] : wildcard.value_or(0);
+            if (q > best_q && available(PREFERENCE[i])) {
+                best = PREFERENCE[i];
+                best_q = q;
+            }
+        }
+        return best;
+    }
+
+    bool Compression::isCompressible(std::string_view content_type) {
+        content_type = trimView(content_type.substr(0, content_type.find(';')));
+        std::string type(content_type);
+        toLowerCase(type);
+
+        if (type.starts_with("text/")) return true;
+        if (type.ends_with("+json") || type.ends_with("+xml")) return true;   // problem+json, svg+xml, ...
+        return type == "application/json" || type == "application/javascript" ||
+               type == "application/xml" || type == "application/wasm" ||
+               type == "application/x-ndjson" || type == "application/msgpack" ||
+               type == "application/cbor" || type == "image/x-icon";
+    }
+
+    std::string Compression::compress(const Encoding encoding, const std::string_view data, const bool best) {
+        switch (encoding) {
+            case Encoding::Gzip:
+                return gzip(data, best ? Z_BEST_COMPRESSION : 5);
+#ifdef MB_HAVE_BROTLI
+            case Encoding::Brotli: {
+                std::string out(BrotliEncoderMaxCompressedSize(data.size()), '\0');
+                auto size = out.size();
+                // Quality 4 is what keeps brotli near gzip's speed on responses built per request
+                if (!BrotliEncoderCompress(best ? BROTLI_MAX_QUALITY : 4, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+                                           data.size(), reinterpret_cast<const uint8_t *>(data.data()), &size,
+                                           reinterpret_cast<uint8_t *>(out.data())))
+                    return {};
+                out.resize(size);
+                return out;
+            }
+#endif
+#ifdef MB_HAVE_ZSTD
+            case Encoding::Zstd: {
+                std::string out(ZSTD_compressBound(data.size()), '\0');
+                const auto size = ZSTD_compress(out.data(), out.size(), data.data(), data.size(), best ? 19 : 3);
+                if (ZSTD_isError(size)) return {};
+                out.resize(size);
+                return out;
+            }
+#endif
+            default:
+                return {};
+        }
+    }
+}
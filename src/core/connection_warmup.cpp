@@ -0,0 +1,115 @@
+/**
+ * @file connection_warmup.cpp
+ * @brief Implementation for @see connection_warmup.h
+ */
+
+#include "../../include/mantisbase/core/connection_warmup.h"
+#include "../../include/mantisbase/core/database.h"
+#include "../../include/mantisbase/core/metrics.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/core/models/entity.h"
+#include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <chrono>
+#include <format>
+
+namespace mb {
+    ConnectionWarmup::Options ConnectionWarmup::Options::fromEnv() {
+        Options options;
+        options.enabled = getEnvOrDefault("MB_DB_WARMUP", "0") == "1";
+        options.counts = getEnvOrDefault("MB_DB_WARMUP_COUNTS", "1") != "0";
+        return options;
+    }
+
+    ConnectionWarmup::ConnectionWarmup(const MantisBase &app, const Options options)
+        : mApp(app), m_options(options) {}
+
+    ConnectionWarmup::~ConnectionWarmup() {
+        stop();
+    }
+
+    void ConnectionWarmup::start(std::vector<std::shared_ptr<const Entity>> entities) {
+        if (!m_options.enabled || m_thread.joinable()) return;
+        m_stopping.store(false);
+        m_ready.store(false, std::memory_order_release);
+        m_thread = std::thread([this, entities = std::move(entities)] {
+            run(entities);
+            m_ready.store(true, std::memory_order_release);
+        });
+    }
+
+    void ConnectionWarmup::stop() {
+        m_stopping.store(true);
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+    void ConnectionWarmup::run(const std::vector<std::shared_ptr<const Entity>> &entities) {
+        const auto began = std::chrono::steady_clock::now();
+        const auto &db = mApp.db();
+
+        // Leased all at once, or the pool would hand back the same free slot each
+        // time; each goes back as soon as it's warm, so requests wait on one at most
+        std::vector<std::shared_ptr<soci::session>> sessions;
+        try {
+            for (std::size_t i = 0; i < db.poolMin() && !m_stopping.load(); ++i)
+                sessions.push_back(db.session());
+        } catch (const std::exception &e) {
+            ++m_errors;
+            LogOrigin::dbWarn("Warmup", std::format("Warming {} of {} connections: {}",
+                                                    sessions.size(), db.poolMin(), e.what()));
+        }
+
+        for (auto &sql: sessions) {
+            for (const auto &entity: entities) {
+                if (m_stopping.load()) return;
+                try {
+                    entity->prepareStatements(*sql);
+                    m_statements += 2;
+                } catch (const std::exception &e) {
+                    ++m_errors;
+                    LogOrigin::dbTrace("Warmup", std::format("Preparing `{}`: {}", entity->name(), e.what()));
+                }
+            }
+            sql.reset();
+            ++m_connections;
+        }
+
+        // Once per entity: the count reads the id index into the cache pages
+        if (m_options.counts) {
+            for (const auto &entity: entities) {
+                if (m_stopping.load()) return;
+                try {
+                    (void) entity->countRecords();
+                } catch (const std::exception &e) {
+                    ++m_errors;
+                    LogOrigin::dbTrace("Warmup", std::format("Counting `{}`: {}", entity->name(), e.what()));
+                }
+            }
+        }
+
+        const auto took = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - began);
+        m_durationMs.store(took.count());
+        LogOrigin::dbInfo("Warmup", std::format("Warmed {} connections for {} entities in {}ms",
+                                                m_connections.load(), entities.size(), took.count()));
+    }
+
+    void ConnectionWarmup::writeMetrics(MetricsWriter &out) const {
+        out.family("mb_db_warmup_ready", "1 once the startup warmup is done", "gauge");
+        out.sample("mb_db_warmup_ready", {}, ready() ? 1 : 0);
+        out.family("mb_db_warmup_connections_total", "Pooled connections the warmup prepared statements on",
+                   "counter");
+        out.sample("mb_db_warmup_connections_total", {},
+                   static_cast<double>(m_connections.load(std::memory_order_relaxed)));
+        out.family("mb_db_warmup_statements_total", "Statements the warmup prepared", "counter");
+        out.sample("mb_db_warmup_statements_total", {},
+                   static_cast<double>(m_statements.load(std::memory_order_relaxed)));
+        out.family("mb_db_warmup_errors_total", "Leases, prepares and counts of the warmup that failed", "counter");
+        out.sample("mb_db_warmup_errors_total", {}, static_cast<double>(m_errors.load(std::memory_order_relaxed)));
+        if (const auto ms = m_durationMs.load(); ms >= 0) {
+            out.family("mb_db_warmup_duration_seconds", "How long the startup warmup took", "gauge");
+            out.sample("mb_db_warmup_duration_seconds", {}, static_cast<double>(ms) / 1000.0);
+        }
+    }
+}
@@ -4,12 +4,79 @@
 
 #ifdef MB_SCRIPTING_ENABLED
     #include <dukglue/dukglue.h>
+    #include "../../include/mantisbase/utils/duk_json.h"
 #endif
 
 namespace mb
 {
+    json* ContextStore::jsonSlot(const std::string& key)
+    {
+        if (key != "auth" && key != "verification") return nullptr;
+        resolveAuth();
+        return key == "auth" ? &m_auth : &m_verification;
+    }
+
+    const json* ContextStore::jsonSlot(const std::string& key) const
+    {
+        return const_cast<ContextStore*>(this)->jsonSlot(key);
+    }
+
+    const json& ContextStore::emptyObject()
+    {
+        static const json empty = json::object();
+        return empty;
+    }
+
+    void ContextStore::resolveAuth() const
+    {
+        if (!m_authResolver) return;
+        // Cleared first: reads of the slots from inside the resolver must not re-enter it
+        const auto resolve = std::move(m_authResolver);
+        m_authResolver = nullptr;
+        resolve(m_auth, m_verification);
+    }
+
+    void ContextStore::deferAuth(AuthResolver resolve)
+    {
+        m_authResolver = std::move(resolve);
+    }
+
+    json& ContextStore::auth()
+    {
+        resolveAuth();
+        if (m_auth.is_null()) m_auth = json::object();
+        return m_auth;
+    }
+
+    const json& ContextStore::auth() const
+    {
+        resolveAuth();
+        return m_auth.is_null() ? emptyObject() : m_auth;
+    }
+
+    json& ContextStore::verification()
+    {
+        resolveAuth();
+        if (m_verification.is_null()) m_verification = json::object();
+        return m_verification;
+    }
+
+    const json& ContextStore::verification() const
+    {
+        resolveAuth();
+        return m_verification.is_null() ? emptyObject() : m_verification;
+    }
+
     void ContextStore::dump()
     {
+        if (!Logger::enabled(LogLevel::DEBUG)) return;
+
+        // Dumping shouldn't be what authenticates the request
+        if (authPending()) LogOrigin::debug("Context Dump", "ContextStore::Dump - auth: <not resolved yet>");
+        else if (!m_auth.is_null()) LogOrigin::debug("Context Dump", fmt::format("ContextStore::Dump - auth: {}", m_auth.dump()));
+        if (!m_verification.is_null())
+            LogOrigin::debug("Context Dump", fmt::format("ContextStore::Dump - verification: {}", m_verification.dump()));
+
         for (const auto& [key, value] : data)
         {
             const auto i = "ContextStore::Dump";
@@ -50,12 +117,23 @@ namespace mb
 
     bool ContextStore::hasKey(const std::string& key) const
     {
+        if (const auto* slot = jsonSlot(key)) return !slot->is_null();
         return data.contains(key);
     }
 
 #ifdef MB_SCRIPTING_ENABLED
     DukValue ContextStore::get_duk(const std::string& key)
     {
+        const auto ctx = MantisBase::instance().ctx();
+
+        if (const auto* slot = jsonSlot(key))
+        {
+            if (slot->is_null()) return {}; // undefined
+
+            dukPushJson(ctx, *slot);
+            return DukValue::take_from_stack(ctx);
+        }
+
         const auto it = data.find(key);
 
         // If no item was found ...
@@ -65,8 +143,6 @@ namespace mb
         // Convert std::any to DukValue based on stored type
         const std::any& value = it->second;
 
-        const auto ctx = MantisBase::instance().ctx();
-
         if (value.type() == typeid(int))
         {
             dukglue_push(ctx, std::any_cast<int>(value));
@@ -85,12 +161,8 @@ namespace mb
         }
         else if (value.type() == typeid(nlohmann::json))
         {
-            const auto& json_obj = std::any_cast<nlohmann::json>(value);
-            const std::string json_str = json_obj.dump();
-
-            // Parse JSON string into JavaScript object
-            duk_push_string(ctx, json_str.c_str());
-            duk_json_decode(ctx, -1);
+            // Built as a JavaScript value directly, without a JSON text in between
+            dukPushJson(ctx, std::any_cast<const nlohmann::json&>(value));
             return DukValue::take_from_stack(ctx);
         }
         else
@@ -118,6 +190,21 @@ namespace mb
     {
         const auto ctx = MantisBase::instance().ctx();
 
+        // `auth` and `verification` only ever hold an object
+        if (auto* slot = jsonSlot(key))
+        {
+            if (value.type() == DukValue::NULLREF || value.type() == DukValue::UNDEFINED)
+            {
+                *slot = nullptr;
+                return;
+            }
+            if (value.type() != DukValue::OBJECT)
+            {
+                LogOrigin::warn("Unsupported Type", fmt::format("Key `{}` only holds an object", key));
+                duk_error(ctx, DUK_ERR_TYPE_ERROR, "Key '%s' only holds an object", key.c_str());
+            }
+        }
+
         // Convert DukValue to std::any based on JavaScript type
         switch (value.type())
         {
@@ -137,12 +224,10 @@ namespace mb
         case DukValue::OBJECT:
             {
                 // Convert JavaScript object to JSON
-                value.push();
-                const char* json_str = duk_json_encode(ctx, -1);
-                nlohmann::json json_obj = nlohmann::json::parse(json_str);
-                duk_pop(ctx);
+                nlohmann::json json_obj = dukToJson(value);
 
-                data[key] = json_obj;
+                if (auto* slot = jsonSlot(key)) *slot = std::move(json_obj);
+                else data[key] = std::move(json_obj);
                 break;
             }
         default:
@@ -0,0 +1,37 @@
+/**
+ * @file cors.cpp
+ * @brief Implementation for @see cors.h
+ */
+
+#include "../../include/mantisbase/core/cors.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+
+namespace mb {
+    CorsPolicy::Options CorsPolicy::Options::fromEnv() {
+        Options options;
+        if (const auto origins = trim(getEnvOrDefault("MB_CORS_ORIGINS", "")); !origins.empty())
+            options.origins = splitString(origins, ",");
+        options.maxAge = std::max(0, safe_stoi(getEnvOrDefault("MB_CORS_MAX_AGE", ""), options.maxAge));
+        return options;
+    }
+
+    CorsPolicy::CorsPolicy(const Options &options) : m_maxAge(std::to_string(std::max(0, options.maxAge))) {
+        for (const auto &entry: options.origins) {
+            auto origin = trim(entry);
+            if (origin == "*") m_any = true;
+            while (!origin.empty() && origin.back() == '/') origin.pop_back();
+            // Browsers send the scheme and host lowercased
+            toLowerCase(origin);
+            if (!origin.empty()) m_origins.insert(std::move(origin));
+        }
+    }
+
+    std::string_view CorsPolicy::allowOrigin(const std::string &origin) const {
+        if (m_any) return "*";
+        if (origin.empty()) return {};
+        const auto it = m_origins.find(origin);
+        return it == m_origins.end() ? std::string_view{} : std::string_view(*it);
+    }
+}
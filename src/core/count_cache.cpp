@@ -0,0 +1,97 @@
+#include "../../include/mantisbase/core/count_cache.h"
+
+#include <algorithm>
+
+namespace mb {
+    CountCache::CountCache(const std::chrono::seconds ttl, const std::size_t max_filters)
+        : m_ttl(ttl), m_maxFilters(std::max<std::size_t>(1, max_filters)) {}
+
+    std::optional<long long> CountCache::get(const std::string &entity, const std::string &filter,
+                                             const Clock::time_point now) {
+        std::lock_guard lock(m_mutex);
+        const auto it = m_entities.find(entity);
+        if (it == m_entities.end())
+            return std::nullopt;
+
+        auto &counts = it->second;
+        if (filter.empty()) {
+            if (!counts.total) return std::nullopt;
+            if (counts.total->expiresAt <= now) {
+                counts.total.reset();
+                return std::nullopt;
+            }
+            return counts.total->value;
+        }
+
+        const auto f = counts.filtered.find(filter);
+        if (f == counts.filtered.end())
+            return std::nullopt;
+        if (f->second.expiresAt <= now) {
+            counts.filtered.erase(f);
+            return std::nullopt;
+        }
+        return f->second.value;
+    }
+
+    void CountCache::put(const std::string &entity, const std::string &filter, const long long count,
+                         const Clock::time_point now) {
+        if (m_ttl.count() <= 0) return;
+
+        std::lock_guard lock(m_mutex);
+        auto &counts = m_entities[entity];
+        const Count entry{count, now + m_ttl};
+        if (filter.empty()) {
+            counts.total = entry;
+            return;
+        }
+
+        auto &filtered = counts.filtered;
+        if (!filtered.contains(filter) && filtered.size() >= m_maxFilters) {
+            std::erase_if(filtered, [now](const auto &kv) { return kv.second.expiresAt <= now; });
+            if (filtered.size() >= m_maxFilters)
+                filtered.erase(filtered.begin());
+        }
+        filtered.insert_or_assign(filter, entry);
+    }
+
+    void CountCache::invalidateEntity(const std::string &entity) {
+        std::lock_guard lock(m_mutex);
+        m_entities.erase(entity);
+    }
+
+    void CountCache::clear() {
+        std::lock_guard lock(m_mutex);
+        m_entities.clear();
+    }
+
+    void CountCache::onChanges(const nlohmann::json &events) {
+        if (!events.is_array()) return;
+
+        std::lock_guard lock(m_mutex);
+        for (const auto &event: events) {
+            if (!event.is_object()) continue;
+
+            const auto &entity = event.value("entity", nlohmann::json{});
+            if (!entity.is_string()) continue;
+            const auto it = m_entities.find(entity.get_ref<const std::string &>());
+            if (it == m_entities.end()) continue;
+
+            auto &counts = it->second;
+            counts.filtered.clear();
+
+            const auto type = event.value("type", std::string{});
+            if (!counts.total) continue;
+            if (type == "INSERT") ++counts.total->value;
+            else if (type == "DELETE") counts.total->value = std::max(0ll, counts.total->value - 1);
+            else if (type == "IMPORT") counts.total.reset(); // One event for many rows
+        }
+    }
+
+    std::size_t CountCache::size() const {
+        std::lock_guard lock(m_mutex);
+        std::size_t total = 0;
+        for (const auto &[_, counts]: m_entities)
+            total += (counts.total ? 1 : 0) + counts.filtered.size();
+        return total;
+    }
+}
@@ -2,8 +2,18 @@
 #include "../../include/mantisbase/mantisbase.h"
 #include "../../include/mantisbase/core/logger/logger.h"
 #include "../../include/mantisbase/core/kv_store.h"
+#include "../../include/mantisbase/core/realtime.h"
+#include "../../include/mantisbase/core/sqlite_change_hooks.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/server_timing.h"
+#include "../../include/mantisbase/core/slow_query_log.h"
+#include "../../include/mantisbase/core/tracing.h"
 #include "../../include/mantisbase/utils/utils.h"
+#include "../../include/mantisbase/utils/duk_json.h"
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
 #include <private/soci-mktime.h>
 #include <soci/sqlite3/soci-sqlite3.h>
 
@@ -18,17 +28,74 @@
 #endif
 
 namespace mb {
+    namespace {
+        /// SQLite VM steps between deadline checks of a running statement
+        constexpr int DEADLINE_CHECK_STEPS = 1000;
+
+        /**
+         * Interrupt statements of requests past their deadline. Only outside
+         * an explicit transaction: an interrupted COMMIT or ROLLBACK would
+         * hand the connection back mid-transaction, so statements inside one
+         * are stopped by the check before the next statement instead.
+         */
+        void watchDeadlines(soci::session &sql) {
+            auto *backend = dynamic_cast<soci::sqlite3_session_backend *>(sql.get_backend());
+            if (!backend) return;
+            sqlite_api::sqlite3_progress_handler(backend->conn_, DEADLINE_CHECK_STEPS, [](void *db) {
+                const auto *deadline = RequestDeadline::current();
+                return deadline && sqlite_api::sqlite3_get_autocommit(static_cast<sqlite_api::sqlite3 *>(db)) &&
+                               deadline->status() != 0
+                           ? 1
+                           : 0;
+            }, backend->conn_);
+        }
+
+        /**
+         * Time each statement for the slow-query log: SQLite reports how long
+         * it ran, from first step to done or reset, when it finishes.
+         */
+        void timeStatements(soci::session &sql) {
+            auto *backend = dynamic_cast<soci::sqlite3_session_backend *>(sql.get_backend());
+            if (!backend) return;
+            sqlite_api::sqlite3_trace_v2(backend->conn_, SQLITE_TRACE_PROFILE, [](unsigned, void *db, void *p, void *x) {
+                const std::chrono::nanoseconds took(*static_cast<sqlite_api::sqlite3_int64 *>(x));
+                if (!SlowQueryLog::slow(took)) return 0;
+                auto *stmt = static_cast<sqlite_api::sqlite3_stmt *>(p);
+                std::optional<long long> rows;
+                if (!sqlite_api::sqlite3_stmt_readonly(stmt))
+                    rows = sqlite_api::sqlite3_changes(static_cast<sqlite_api::sqlite3 *>(db));
+                const auto *text = sqlite_api::sqlite3_sql(stmt);
+                SlowQueryLog::record({text ? text : "", SlowQueryLog::parameters(), took, rows});
+                return 0;
+            }, backend->conn_);
+        }
+    }
+
     Database::Database(const MantisBase &app) : m_connPool(nullptr), mbApp(app) {
     }
 
+    Database::Database(const MantisBase &app, std::string tenant_id, const int pool_size, std::string file)
+        : m_connPool(nullptr), m_tenant(std::move(tenant_id)), m_tenantPoolSize(pool_size), m_file(std::move(file)),
+          mbApp(app) {
+    }
+
+    std::string Database::tenantSchema(const std::string &tenant_id) {
+        auto schema = "tenant_" + tenant_id;
+        std::ranges::replace(schema, '-', '_');
+        return schema;
+    }
+
     Database::~Database() {
         disconnect();
         std::cout << "Database Des()" << std::endl;
     }
 
     bool Database::connect(const std::string &conn_str) {
+        const bool tenant = !m_tenant.empty();
+        const auto configured_pool = tenant ? m_tenantPoolSize : mbApp.poolSize();
+
         // If pool size is invalid, just return
-        if (mbApp.poolSize() <= 0)
+        if (configured_pool <= 0)
             throw std::runtime_error("Session pool size must be greater than 0");
 
         // All databases apart from SQLite should pass in a connection string
@@ -37,16 +104,39 @@ namespace mb {
 
         try {
             // Create connection pool instance
-            m_connPool = std::make_unique<soci::connection_pool>(mbApp.poolSize());
+            m_connPool = std::make_unique<soci::connection_pool>(configured_pool);
 
             const auto db_type = mbApp.dbType();
 
             m_connStr = conn_str;
 
+            // SQLite single-writer mode: pooled sessions only read, and all
+            // writes go through one writer connection fed by a WriteQueue.
+            // Tenant databases skip the threads either would add per database.
+            const bool single_writer = db_type == "sqlite3" && !tenant &&
+                                       getEnvOrDefault("MB_SQLITE_SINGLE_WRITER", "0") == "1";
+            // Checkpoints run on a background thread instead of inside the
+            // commit that crosses `wal_autocheckpoint`
+            const bool bg_checkpoint = db_type == "sqlite3" && !tenant && WalCheckpointer::Options::enabledFromEnv();
+
+            if (tenant && db_type == "postgresql") {
+                // Same database, the tenant's schema first on the search path
+                const auto schema = tenantSchema(m_tenant);
+                if (conn_str.find("://") != std::string::npos)
+                    m_connStr = std::format("{}{}options=-csearch_path%3D{}", conn_str,
+                                            conn_str.find('?') == std::string::npos ? '?' : '&', schema);
+                else
+                    m_connStr = std::format("{} options=-csearch_path={}", conn_str, schema);
+            }
+
             if (db_type=="sqlite3") {
                 // For SQLite, lets explicitly define location and name of the database
                 // we intend to use within the `dataDir`
-                auto sqlite_db_path = joinPaths(mbApp.dataDir(), "mantis.db").string();
+                auto sqlite_db_path = !m_file.empty()
+                                          ? m_file
+                                          : (tenant ? joinPaths(joinPaths(mbApp.dataDir(), "tenants").string(),
+                                                                m_tenant + ".db")
+                                                    : joinPaths(mbApp.dataDir(), "mantis.db")).string();
                 // Private cache (the default) + WAL gives concurrent readers with
                 // a single writer via the connection pool. shared_cache is a
                 // legacy mode discouraged with WAL (adds table-level lock
@@ -56,16 +146,63 @@ namespace mb {
                                            sqlite_db_path);
             }
 
-            auto pool_size = static_cast<size_t>(mbApp.poolSize());
-            // Populate the pools with db connections
-            for (std::size_t i = 0; i < pool_size; ++i) {
+            // MB_SQLITE_CHANGE_LOG=attached: `mb_change_log` in a file and WAL of
+            // its own, on every connection as `mb_log`, see RealtimeDB::attachedChangeLog()
+            const bool attached_log = single_writer && RealtimeDB::attachedChangeLog();
+            const auto attach_log = [&](soci::session &sql) {
+                const auto path = joinPaths(mbApp.dataDir(), RealtimeDB::CHANGE_LOG_FILE).string();
+                sql << "ATTACH DATABASE :path AS mb_log", soci::use(path);
+            };
+
+            if (single_writer) {
+                // Opened first, so the file and its WAL exist for the read-only readers
+                m_writer = std::make_unique<soci::session>(soci::sqlite3, m_connStr);
+                m_writer->set_logger(new MantisLoggerImpl());
+                watchDeadlines(*m_writer);
+                timeStatements(*m_writer);
+                m_writer->set_query_context_logging_mode(mbApp.isDevMode()
+                                                             ? soci::log_context::always
+                                                             : soci::log_context::on_error);
+                // page_size must precede WAL, which fixes the page size of a new file
+                m_sqliteProfile = resolveSqliteProfile(*m_writer);
+                *m_writer << m_sqliteProfile.pageSizePragma();
+                for (const auto &pragma: m_sqliteProfile.pragmas()) *m_writer << pragma;
+                *m_writer << "PRAGMA journal_mode=WAL";
+                if (!bg_checkpoint) *m_writer << "PRAGMA wal_autocheckpoint=500";
+                if (attached_log) {
+                    attach_log(*m_writer);
+                    *m_writer << "PRAGMA mb_log.journal_mode=WAL";
+                    *m_writer << "PRAGMA mb_log.synchronous=NORMAL";
+                }
+            }
+
+            auto pool_size = static_cast<size_t>(configured_pool);
+
+            const auto acquire_ms = safe_stoi(getEnvOrDefault("MB_DB_ACQUIRE_TIMEOUT_MS", "30000"), 30000);
+            m_acquireTimeout = std::chrono::milliseconds(std::max(acquire_ms, 0));
+            // SQLite connections are cheap and carry per-connection PRAGMAs, so
+            // its pool stays fixed; server databases grow and shrink from the minimum
+            m_poolMin = pool_size;
+            if (db_type != "sqlite3" && !tenant) {
+                const auto min = safe_stoi(getEnvOrDefault("MB_DB_POOL_MIN", ""),
+                                           std::max(2, static_cast<int>(pool_size) / 4));
+                m_poolMin = std::clamp<size_t>(static_cast<size_t>(std::max(min, 1)), 1, pool_size);
+                if (const auto idle_ms = safe_stoi(getEnvOrDefault("MB_DB_POOL_IDLE_MS", ""), 0); idle_ms > 0)
+                    m_poolIdle = std::chrono::milliseconds(idle_ms);
+            }
+
+            // Populate the pool with db connections; with server databases the
+            // slots past the minimum are opened on their first lease
+            for (std::size_t i = 0; i < m_poolMin; ++i) {
                 LogOrigin::dbTrace("Session Creation",
                                    fmt::format("Creating db session for index `{}/{}`", i, pool_size));
 
                 if (db_type == "sqlite3") {
                     soci::session &sql = m_connPool->at(i);
-                    sql.open(soci::sqlite3, m_connStr);
+                    sql.open(soci::sqlite3, single_writer ? m_connStr + " readonly=true" : m_connStr);
                     sql.set_logger(new MantisLoggerImpl()); // Set custom query logger
+                    watchDeadlines(sql);
+                    timeStatements(sql);
 
                     // Log SQL insert values in DevMode only!
                     if (mbApp.isDevMode())
@@ -73,51 +210,113 @@ namespace mb {
                     else
                         sql.set_query_context_logging_mode(soci::log_context::on_error);
 
-                    // Open SQLite in WAL mode, helps in enabling multiple readers, single writer
-                    sql << "PRAGMA journal_mode=WAL";
-                    sql << "PRAGMA wal_autocheckpoint=500"; // Checkpoint every 500 pages
-                } else if (db_type == "postgresql") {
-#if MB_HAS_POSTGRESQL
-                    // Connection Options
-                    ///> Basic: "dbname=mydb user=scott password=tiger"
-                    ///> With Host: "host=localhost port=5432 dbname=test user=postgres password=postgres");
-                    ///> With Config: "dbname=mydatabase user=myuser password=mypass singlerows=true"
-
-                    soci::session &sql = m_connPool->at(i);
-                    sql.open(soci::postgresql, m_connStr);
-                    sql.set_logger(new MantisLoggerImpl()); // Set custom query logger
-
-                    // Log SQL insert values in DevMode only!
-                    if (mbApp.isDevMode())
-                        sql.set_query_context_logging_mode(soci::log_context::always);
-                    else
-                        sql.set_query_context_logging_mode(soci::log_context::on_error);
-#else
-                    LogOrigin::dbWarn("PostgreSQL Not Implemented",
-                                      "Database Connection for `PostgreSQL` has not been implemented yet!");
-                    return false;
-#endif
-                } else if (db_type == "mysql") {
-#if MB_HAS_MYSQL
-                    soci::session &sql = m_connPool->at(i);
-                    sql.open(soci::mysql, m_connStr);
-                    sql.set_logger(new MantisLoggerImpl());
-
-                    if (mbApp.isDevMode())
-                        sql.set_query_context_logging_mode(soci::log_context::always);
-                    else
-                        sql.set_query_context_logging_mode(soci::log_context::on_error);
-#else
-                    LogOrigin::dbWarn("MySQL Not Available",
-                                      "MySQL support was not enabled at build time. Rebuild with -DMB_DB_MYSQL=ON");
-                    return false;
-#endif
+                    if (i == 0 && !single_writer) {
+                        // page_size must precede WAL, which fixes the page size of a new file
+                        m_sqliteProfile = resolveSqliteProfile(sql);
+                        sql << m_sqliteProfile.pageSizePragma();
+                    }
+                    for (const auto &pragma: m_sqliteProfile.pragmas()) sql << pragma;
+
+                    // Open SQLite in WAL mode, helps in enabling multiple readers, single writer.
+                    // In single-writer mode the writer already did, and readers can't checkpoint.
+                    if (!single_writer) {
+                        sql << "PRAGMA journal_mode=WAL";
+                        if (!bg_checkpoint)
+                            sql << "PRAGMA wal_autocheckpoint=500"; // Checkpoint every 500 pages
+                    }
+                    if (attached_log) attach_log(sql);
+                } else if (db_type == "postgresql" || db_type == "mysql") {
+                    if (!openServerSession(m_connPool->at(i), m_connStr)) return false;
                 } else {
                     LogOrigin::dbWarn("Database Type Not Implemented",
                                       fmt::format("Database Connection to `{}` Not Implemented Yet!", conn_str));
                     return false;
                 }
             }
+
+            // One prepared statement cache per pool slot
+            m_stmtCaches.clear();
+            m_sessionSlots.clear();
+            m_slotLastUsed = std::make_unique<std::atomic<PoolMetrics::Clock::rep>[]>(pool_size);
+            for (std::size_t i = 0; i < pool_size; ++i) {
+                m_stmtCaches.push_back(std::make_unique<ConnStatementCache>());
+                m_sessionSlots[&m_connPool->at(i)] = i;
+                m_slotLastUsed[i] = PoolMetrics::Clock::now().time_since_epoch().count();
+            }
+            m_poolMetrics.recordOpen(m_poolMin, false);
+            if (m_poolMin < pool_size)
+                LogOrigin::dbInfo("Connection Pool",
+                                  fmt::format("Connection pool: {} to {} connections, idle ones closed after {}ms",
+                                              m_poolMin, pool_size, m_poolIdle.count()));
+            // Every connection now runs with the startup profile
+            m_profileGen = 0;
+            m_profileApplied.assign(m_stmtCaches.size() + (m_writer ? 1 : 0), 0);
+            m_profileStale = 0;
+            if (db_type == "sqlite3")
+                LogOrigin::dbInfo("SQLite Profile", fmt::format("SQLite tuning profile: {}",
+                                                                m_sqliteProfile.toJson().dump()));
+
+            if (bg_checkpoint) startCheckpointer(pool_size);
+
+            // Entity changes straight from the writing connections, in place
+            // of the change triggers; only the main database has realtime
+            if (db_type == "sqlite3" && !tenant && SqliteChangeHooks::enabled()) {
+                m_changeHooks = std::make_unique<SqliteChangeHooks>([this](json events) {
+                    mbApp.rt().publishCaptured(std::move(events));
+                });
+                if (m_writer) m_changeHooks->attach(*m_writer, m_checkpointer.get());
+                else
+                    for (std::size_t i = 0; i < pool_size; ++i)
+                        m_changeHooks->attach(m_connPool->at(i), m_checkpointer.get());
+                LogOrigin::dbInfo("Change Hooks", "SQLite changes captured by connection hooks, not triggers");
+            }
+
+            if (m_writer) {
+                // The writer caches its statements in one extra slot
+                m_stmtCaches.push_back(std::make_unique<ConnStatementCache>());
+                m_sessionSlots[m_writer.get()] = pool_size;
+
+                const auto options = WriteQueue::Options::fromEnv();
+                m_writeQueue = std::make_unique<WriteQueue>([this] { return writeSession(); }, options);
+                m_writeQueue->start();
+                LogOrigin::dbInfo("Single Writer",
+                                  fmt::format("SQLite single-writer mode: {} read-only sessions, group commit "
+                                              "window {}ms", pool_size, options.window.count()));
+            }
+
+            // Read replicas: a fixed pool each, with statement cache slots after the primary's
+            m_replicas.clear();
+            const auto replica_urls = tenant ? std::vector<std::string>{} : mbApp.dbReplicaUrls();
+            if (!replica_urls.empty() && db_type != "postgresql") {
+                LogOrigin::dbWarn("Read Replicas", "Read replicas are only supported with PostgreSQL; ignoring them.");
+            } else if (!replica_urls.empty()) {
+                if (const auto ms = safe_stoi(getEnvOrDefault("MB_DB_REPLICA_CHECK_MS", ""), 0); ms > 0)
+                    m_replicaCheck = std::chrono::milliseconds(ms);
+                m_replicaMaxLag = std::chrono::milliseconds(
+                    std::max(safe_stoi(getEnvOrDefault("MB_DB_REPLICA_MAX_LAG_MS", "0"), 0), 0));
+
+                for (const auto &url: replica_urls) {
+                    auto replica = std::make_unique<Replica>();
+                    replica->connStr = url;
+                    replica->pool = std::make_unique<soci::connection_pool>(pool_size);
+                    replica->firstSlot = m_stmtCaches.size();
+                    for (std::size_t i = 0; i < pool_size; ++i) {
+                        m_stmtCaches.push_back(std::make_unique<ConnStatementCache>());
+                        m_sessionSlots[&replica->pool->at(i)] = replica->firstSlot + i;
+                    }
+                    m_replicas.push_back(std::move(replica));
+                }
+                // Connections open on first lease, once a probe found the replica healthy
+                checkReplicas();
+                LogOrigin::dbInfo("Read Replicas",
+                                  fmt::format("{} read replica(s), checked every {}ms", m_replicas.size(),
+                                              m_replicaCheck.count()));
+            }
+
+            if (m_poolMin < pool_size || !m_replicas.empty()) {
+                m_monitorStop = false;
+                m_poolMonitor = std::thread(&Database::runPoolMonitor, this);
+            }
         } catch (const std::exception &e) {
             LogOrigin::dbCritical("Connection Error", fmt::format("Database Connection error: {}", e.what()));
             return false;
@@ -140,9 +339,25 @@ namespace mb {
             return;
         }
 
+        if (m_poolMonitor.joinable()) {
+            {
+                std::lock_guard lock(m_monitorMutex);
+                m_monitorStop = true;
+            }
+            m_monitorCv.notify_all();
+            m_poolMonitor.join();
+        }
+
+        // Let queued writes commit before anything closes
+        if (m_writeQueue) m_writeQueue->stop();
+        if (m_checkpointer) m_checkpointer->stop();
+
         // Write checkpoint out (may fail if database is already closed, that's ok)
         writeCheckpoint();
 
+        // Cached statements hold handles on the pooled sessions
+        clearStatementCaches();
+
         // Pool size cast - may fail if MantisBase instance is invalid, that's ok
         const auto pool_size = static_cast<size_t>(mbApp.poolSize());
 
@@ -170,11 +385,36 @@ namespace mb {
         // Reset the connection pool
         m_connPool.reset();
 
+        // Replica sessions close with their pools; their statements went above
+        m_replicas.clear();
+
+        if (m_writer) {
+            try {
+                m_writer->close();
+            } catch (...) {
+                // Ignore errors while closing the writer
+            }
+        }
+        m_writeQueue.reset();
+        m_writer.reset();
+
+        // Outlives every connection whose WAL hook points at it
+        if (m_checkpointConn) {
+            try {
+                m_checkpointConn->close();
+            } catch (...) {
+                // Ignore errors while closing the checkpoint connection
+            }
+        }
+        m_checkpointConn.reset();
+        m_checkpointer.reset();
+        m_changeHooks.reset();
+
         LogOrigin::dbDebug("Shutdown Complete", "DB Shutdown: Session disconnection completed.");
     }
 
     bool Database::createSysTables() const {
-        const auto sql = session();
+        const auto sql = writeSession();
         soci::transaction tr{*sql};
 
         try {
@@ -218,6 +458,19 @@ namespace mb {
                     "expires_at TEXT NOT NULL, "
                     "created TEXT NOT NULL"
                     ")";
+            // Covers the per-request check (id, expires_at > now) without touching the row; see SessionStore for the sweep
+            *sql << "CREATE INDEX IF NOT EXISTS idx_sessions_id_expiry ON mb_sessions(id, expires_at)";
+            *sql << "CREATE INDEX IF NOT EXISTS idx_sessions_expiry ON mb_sessions(expires_at)";
+            // Keyset pages of one user's sessions, see Auth::listSessions()
+            *sql << "CREATE INDEX IF NOT EXISTS idx_sessions_owner ON mb_sessions(entity_name, user_id, id)";
+
+            // Application key-value pairs, written behind by AppKv; expires_at in unix ms, 0 for never
+            *sql << "CREATE TABLE IF NOT EXISTS mb_kv ("
+                    "id TEXT PRIMARY KEY, "
+                    "value TEXT NOT NULL, "
+                    "expires_at BIGINT NOT NULL DEFAULT 0, "
+                    "updated TEXT NOT NULL"
+                    ")";
 
             // API keys table
             *sql << "CREATE TABLE IF NOT EXISTS mb_api_keys ("
@@ -232,6 +485,25 @@ namespace mb {
                     "expires_at TEXT"
                     ")";
             *sql << "CREATE INDEX IF NOT EXISTS idx_api_keys_hash ON mb_api_keys(key_hash)";
+            // Keyset pages of one user's keys, or an entity's, see ApiKeyManager::list()
+            *sql << "CREATE INDEX IF NOT EXISTS idx_api_keys_owner ON mb_api_keys(entity_name, user_id, id)";
+            *sql << "CREATE INDEX IF NOT EXISTS idx_api_keys_entity ON mb_api_keys(entity_name, id)";
+
+            // Usage per API key or user and quota window, added to in batches by UsageQuotas
+            *sql << "CREATE TABLE IF NOT EXISTS mb_usage ("
+                    "subject TEXT NOT NULL, "
+                    "window_start BIGINT NOT NULL, "
+                    "requests BIGINT NOT NULL DEFAULT 0, "
+                    "bytes BIGINT NOT NULL DEFAULT 0, "
+                    "updated TEXT NOT NULL, "
+                    "PRIMARY KEY (subject, window_start)"
+                    ")";
+            // Quotas of single keys or users, in place of MB_QUOTA_REQUESTS and MB_QUOTA_MB; 0 for no limit
+            *sql << "CREATE TABLE IF NOT EXISTS mb_usage_limits ("
+                    "subject TEXT PRIMARY KEY, "
+                    "requests BIGINT NOT NULL DEFAULT 0, "
+                    "bytes BIGINT NOT NULL DEFAULT 0"
+                    ")";
 
             // OAuth providers table
             *sql << "CREATE TABLE IF NOT EXISTS mb_oauth_providers ("
@@ -278,6 +550,80 @@ namespace mb {
                     "linked_at TEXT NOT NULL, "
                     "UNIQUE(entity_name, provider_id, provider_user_id)"
                     ")";
+            *sql << "CREATE INDEX IF NOT EXISTS idx_oauth_accounts_owner ON mb_oauth_accounts(entity_name, user_id, id)";
+
+            // Content-addressed file blobs and the entity files pointing at them
+            *sql << "CREATE TABLE IF NOT EXISTS mb_file_blobs ("
+                    "hash TEXT PRIMARY KEY, "
+                    "size BIGINT NOT NULL, "
+                    "refs BIGINT NOT NULL, "
+                    "created TEXT NOT NULL"
+                    ")";
+            *sql << "CREATE TABLE IF NOT EXISTS mb_file_refs ("
+                    "entity_name TEXT NOT NULL, "
+                    "filename TEXT NOT NULL, "
+                    "hash TEXT NOT NULL, "
+                    "PRIMARY KEY(entity_name, filename)"
+                    ")";
+            *sql << "CREATE INDEX IF NOT EXISTS idx_file_refs_hash ON mb_file_refs(hash)";
+
+            // Files dropped from records, removed by FileCleanup once their write commits
+            *sql << "CREATE TABLE IF NOT EXISTS mb_file_deletions ("
+                    "entity_name TEXT NOT NULL, "
+                    "filename TEXT NOT NULL, "
+                    "queued TEXT NOT NULL, "
+                    "PRIMARY KEY(entity_name, filename)"
+                    ")";
+
+            // Online schema migrations, one per entity, see SchemaMigrations
+            *sql << "CREATE TABLE IF NOT EXISTS mb_schema_migrations ("
+                    "id TEXT PRIMARY KEY, "
+                    "entity TEXT NOT NULL, "
+                    "target TEXT NOT NULL, "
+                    "state TEXT NOT NULL, "
+                    "last_id TEXT NOT NULL DEFAULT '', "
+                    "copied BIGINT NOT NULL DEFAULT 0, "
+                    "total BIGINT NOT NULL DEFAULT 0, "
+                    "error TEXT, "
+                    "created TEXT NOT NULL, "
+                    "updated TEXT NOT NULL"
+                    ")";
+
+            // The last tick each leased scheduled job ran for, and on which node, see Scheduler
+            *sql << "CREATE TABLE IF NOT EXISTS mb_job_leases ("
+                    "name TEXT PRIMARY KEY, "
+                    "tick BIGINT NOT NULL, "
+                    "owner TEXT NOT NULL, "
+                    "updated TEXT NOT NULL"
+                    ")";
+
+            // The node leading the cluster, until `expires` (Unix seconds on the database's clock), see LeaderElection
+            *sql << "CREATE TABLE IF NOT EXISTS mb_leader_lease ("
+                    "name TEXT PRIMARY KEY, "
+                    "owner TEXT NOT NULL, "
+                    "expires BIGINT NOT NULL"
+                    ")";
+
+            // URLs the change stream is POSTed to, `topics` a JSON array; see Webhooks
+            *sql << "CREATE TABLE IF NOT EXISTS mb_webhooks ("
+                    "id TEXT PRIMARY KEY, "
+                    "url TEXT NOT NULL, "
+                    "topics TEXT NOT NULL, "
+                    "secret TEXT, "
+                    "created BIGINT NOT NULL"
+                    ")";
+
+            // Deliveries not yet answered with a 2xx: `n` events each, retried from `due` (Unix ms)
+            *sql << "CREATE TABLE IF NOT EXISTS mb_webhook_outbox ("
+                    "id TEXT PRIMARY KEY, "
+                    "hook TEXT NOT NULL, "
+                    "events TEXT NOT NULL, "
+                    "n INTEGER NOT NULL, "
+                    "attempts INTEGER NOT NULL DEFAULT 0, "
+                    "due BIGINT NOT NULL, "
+                    "seq BIGINT NOT NULL"
+                    ")";
+            *sql << "CREATE INDEX IF NOT EXISTS idx_webhook_outbox_hook ON mb_webhook_outbox(hook, due)";
 
             // Seed default OAuth provider presets
             seedOAuthPresets(*sql);
@@ -323,8 +669,493 @@ namespace mb {
         }
     }
 
+    namespace {
+        /// Set once the current request wrote; its reads then stay on the primary
+        thread_local bool t_pinnedToPrimary = false;
+    }
+
     std::shared_ptr<soci::session> Database::session() const {
-        return std::make_shared<soci::session>(*m_connPool);
+        auto sql = leaseFrom(*m_connPool, m_poolMetrics, m_connStr, m_slotLastUsed.get(), acquireTimeoutMs());
+        if (!sql)
+            throw MantisException(503, "Database is busy, try again later.",
+                                  fmt::format("No database session was freed within {}ms", m_acquireTimeout.count()));
+
+        if (m_profileStale.load(std::memory_order_relaxed) > 0) refreshSqliteProfile(*sql);
+        return sql;
+    }
+
+    std::shared_ptr<soci::session> Database::readSession() const {
+        if (m_replicas.empty() || t_pinnedToPrimary) return session();
+
+        // Take a free session from the next healthy replica in turn, else wait on the first healthy one
+        const auto start = m_nextReplica.fetch_add(1, std::memory_order_relaxed);
+        Replica *fallback = nullptr;
+        for (std::size_t i = 0; i < m_replicas.size(); ++i) {
+            auto &replica = *m_replicas[(start + i) % m_replicas.size()];
+            if (!replica.healthy.load(std::memory_order_relaxed)) continue;
+            if (!fallback) fallback = &replica;
+            if (auto sql = leaseFrom(*replica.pool, replica.metrics, replica.connStr, nullptr, 0)) {
+                replica.reads.fetch_add(1, std::memory_order_relaxed);
+                return sql;
+            }
+        }
+        if (!fallback) return session();
+
+        auto sql = leaseFrom(*fallback->pool, fallback->metrics, fallback->connStr, nullptr, acquireTimeoutMs());
+        if (!sql)
+            throw MantisException(503, "Database is busy, try again later.",
+                                  fmt::format("No replica session was freed within {}ms", m_acquireTimeout.count()));
+        fallback->reads.fetch_add(1, std::memory_order_relaxed);
+        return sql;
+    }
+
+    Database::RequestScope::RequestScope(const bool pinned) : m_pinned(t_pinnedToPrimary) {
+        t_pinnedToPrimary = pinned;
+    }
+
+    Database::RequestScope::~RequestScope() {
+        t_pinnedToPrimary = m_pinned;
+    }
+
+    bool Database::pinnedToPrimary() {
+        return t_pinnedToPrimary;
+    }
+
+    int Database::acquireTimeoutMs() const {
+        return m_acquireTimeout.count() > 0 ? static_cast<int>(m_acquireTimeout.count()) : -1;
+    }
+
+    std::shared_ptr<soci::session> Database::leaseFrom(soci::connection_pool &pool, PoolMetrics &metrics,
+                                                       const std::string &conn_str,
+                                                       std::atomic<PoolMetrics::Clock::rep> *last_used,
+                                                       const int timeout_ms) const {
+        const auto started = PoolMetrics::Clock::now();
+        std::size_t pos = 0;
+        if (!pool.try_lease(pos, timeout_ms)) {
+            // A probe that does not wait is not a timeout
+            if (timeout_ms != 0) metrics.recordTimeout(PoolMetrics::Clock::now() - started);
+            return nullptr;
+        }
+        const auto leased = PoolMetrics::Clock::now();
+        metrics.recordAcquire(leased - started);
+        if (auto *timing = ServerTiming::current()) timing->add("db_wait", leased - started);
+
+        // A PostgreSQL statement of a request with a deadline times out with it
+        const auto *deadline = RequestDeadline::current();
+        const bool timed = deadline && deadline->bounded() && mbApp.dbType() == "postgresql";
+
+        // Non-owning; the deleter hands the slot back to the pool
+        std::shared_ptr<soci::session> sql(&pool.at(pos), [&pool, &metrics, last_used, pos, leased, timed](
+                                       soci::session *session) {
+            // Lease held, i.e. queries plus whatever the holder did in between
+            if (auto *timing = ServerTiming::current()) timing->add("db", PoolMetrics::Clock::now() - leased);
+            Tracer::endStatement();
+            SlowQueryLog::endStatement();
+            if (timed && session->get_backend()) {
+                // Whatever the deadline says, and a lost connection must not throw from a deleter
+                const RequestDeadline::Scope unbounded(nullptr);
+                try {
+                    *session << "SET statement_timeout = 0";
+                } catch (const std::exception &) {}
+            }
+            if (last_used)
+                last_used[pos].store(PoolMetrics::Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+            metrics.recordRelease();
+            pool.give_back(pos);
+        });
+
+        // Never opened, or closed while idle: grow the pool by this connection
+        if (!sql->get_backend()) {
+            try {
+                if (!openServerSession(*sql, conn_str))
+                    throw MantisException(503, "Database is unavailable.");
+            } catch (const soci::soci_error &e) {
+                LogOrigin::dbWarn("Connection Pool", fmt::format("Could not open a pooled connection: {}", e.what()));
+                throw MantisException(503, "Database is unavailable.", e.what());
+            }
+            metrics.recordOpen();
+        }
+
+        if (timed) {
+            // Leased right at the deadline still gets a statement a millisecond to fail in
+            const auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline->remaining()).count();
+            *sql << fmt::format("SET statement_timeout = {}", std::max<long long>(left, 1));
+        }
+        return sql;
+    }
+
+    bool Database::openServerSession(soci::session &sql, const std::string &conn_str) const {
+        const auto db_type = mbApp.dbType();
+        if (db_type == "postgresql") {
+#if MB_HAS_POSTGRESQL
+            // Connection Options
+            ///> Basic: "dbname=mydb user=scott password=tiger"
+            ///> With Host: "host=localhost port=5432 dbname=test user=postgres password=postgres");
+            ///> With Config: "dbname=mydatabase user=myuser password=mypass singlerows=true"
+            sql.open(soci::postgresql, conn_str);
+#else
+            LogOrigin::dbWarn("PostgreSQL Not Implemented",
+                              "Database Connection for `PostgreSQL` has not been implemented yet!");
+            return false;
+#endif
+        } else if (db_type == "mysql") {
+#if MB_HAS_MYSQL
+            sql.open(soci::mysql, conn_str);
+#else
+            LogOrigin::dbWarn("MySQL Not Available",
+                              "MySQL support was not enabled at build time. Rebuild with -DMB_DB_MYSQL=ON");
+            return false;
+#endif
+        } else {
+            return false;
+        }
+
+        sql.set_logger(new MantisLoggerImpl(true)); // Set custom query logger, timing statements
+
+        // Log SQL insert values in DevMode only!
+        if (mbApp.isDevMode())
+            sql.set_query_context_logging_mode(soci::log_context::always);
+        else
+            sql.set_query_context_logging_mode(soci::log_context::on_error);
+        return true;
+    }
+
+    void Database::closeIdleSessions() {
+        // try_lease() hands out the lowest free slot first, so load settles on
+        // the low slots and the high ones go idle. Take every free slot at once
+        // (taking them one by one would get the same slot back), return the
+        // busy or low ones right away and close the idle rest.
+        std::vector<std::size_t> leased, idle;
+        std::size_t pos = 0;
+        while (m_connPool->try_lease(pos, 0)) leased.push_back(pos);
+
+        const auto now = PoolMetrics::Clock::now();
+        for (const auto slot: leased) {
+            const PoolMetrics::Clock::time_point last(
+                PoolMetrics::Clock::duration(m_slotLastUsed[slot].load(std::memory_order_relaxed)));
+            if (slot >= m_poolMin && m_connPool->at(slot).get_backend() && now - last >= m_poolIdle)
+                idle.push_back(slot);
+            else
+                m_connPool->give_back(slot);
+        }
+
+        for (const auto slot: idle) {
+            // Its statements belong to the connection going away
+            clearStatementCache(slot);
+            try {
+                m_connPool->at(slot).close();
+            } catch (const std::exception &e) {
+                LogOrigin::dbWarn("Connection Pool", fmt::format("Error closing idle connection: {}", e.what()));
+            }
+            m_poolMetrics.recordClose();
+            m_connPool->give_back(slot);
+        }
+        if (!idle.empty())
+            LogOrigin::dbDebug("Connection Pool", fmt::format("Closed {} idle connection(s)", idle.size()));
+    }
+
+    void Database::checkReplicas() {
+        for (std::size_t r = 0; r < m_replicas.size(); ++r) {
+            auto &replica = *m_replicas[r];
+            const bool was_healthy = replica.healthy.load(std::memory_order_relaxed);
+            bool healthy = false;
+            try {
+                // Busy slots are fine: leased sessions mean the replica is in use
+                if (const auto sql = leaseFrom(*replica.pool, replica.metrics, replica.connStr, nullptr, 0)) {
+                    long long lag_ms = 0;
+                    *sql << "SELECT COALESCE(CAST(EXTRACT(EPOCH FROM (now() - pg_last_xact_replay_timestamp())) "
+                            "* 1000 AS BIGINT), 0)", soci::into(lag_ms);
+                    replica.lagMs.store(lag_ms, std::memory_order_relaxed);
+                    healthy = m_replicaMaxLag.count() == 0 || lag_ms <= m_replicaMaxLag.count();
+                } else {
+                    healthy = was_healthy;
+                }
+            } catch (const std::exception &e) {
+                replica.failedChecks.fetch_add(1, std::memory_order_relaxed);
+                replica.lagMs.store(-1, std::memory_order_relaxed);
+                if (was_healthy)
+                    LogOrigin::dbWarn("Read Replicas", fmt::format("Replica {} failed its check: {}", r, e.what()));
+
+                // Drop its free connections; they reopen on first lease once it is back
+                std::vector<std::size_t> leased;
+                std::size_t pos = 0;
+                while (replica.pool->try_lease(pos, 0)) leased.push_back(pos);
+                for (const auto slot: leased) {
+                    clearStatementCache(replica.firstSlot + slot);
+                    if (replica.pool->at(slot).get_backend()) {
+                        try {
+                            replica.pool->at(slot).close();
+                        } catch (...) {
+                            // Ignore errors while closing a broken connection
+                        }
+                        replica.metrics.recordClose();
+                    }
+                    replica.pool->give_back(slot);
+                }
+            }
+
+            replica.healthy.store(healthy, std::memory_order_relaxed);
+            if (healthy && !was_healthy)
+                LogOrigin::dbInfo("Read Replicas", fmt::format("Replica {} is serving reads", r));
+            else if (!healthy && was_healthy)
+                LogOrigin::dbWarn("Read Replicas", fmt::format("Replica {} taken out of rotation (lag {}ms)", r,
+                                                               replica.lagMs.load(std::memory_order_relaxed)));
+        }
+    }
+
+    void Database::runPoolMonitor() {
+        auto period = std::max<std::chrono::milliseconds>(m_poolIdle / 2, std::chrono::seconds(1));
+        if (!m_replicas.empty()) period = std::min(period, m_replicaCheck);
+
+        std::unique_lock lock(m_monitorMutex);
+        while (!m_monitorCv.wait_for(lock, period, [this] { return m_monitorStop; })) {
+            lock.unlock();
+            if (m_poolMin < static_cast<size_t>(mbApp.poolSize())) closeIdleSessions();
+            checkReplicas();
+            lock.lock();
+        }
+    }
+
+    PoolMetrics::Snapshot Database::poolStats() const {
+        return m_poolMetrics.snapshot();
+    }
+
+    std::shared_ptr<soci::session> Database::writeSession() const {
+        t_pinnedToPrimary = true;
+        if (!m_writer) return session();
+
+        m_writerMutex.lock();
+        if (m_writerDepth++ == 0) {
+            m_writerOwner = std::this_thread::get_id();
+            if (m_profileStale.load(std::memory_order_relaxed) > 0) refreshSqliteProfile(*m_writer);
+        }
+
+        // Non-owning; the deleter only ends the lease
+        return {m_writer.get(), [this](soci::session *) {
+            if (--m_writerDepth == 0) m_writerOwner = std::thread::id{};
+            m_writerMutex.unlock();
+        }};
+    }
+
+    void Database::write(const std::function<void(soci::session &)> &job) const {
+        t_pinnedToPrimary = true;
+        if (!m_writeQueue) {
+            const auto sql = session();
+            soci::transaction tr(*sql);
+            job(*sql);
+            tr.commit();
+            return;
+        }
+
+        // Already writing on this thread: nest instead of queueing behind ourselves
+        if (m_writerOwner.load() == std::this_thread::get_id()) {
+            WriteQueue::runNested(*writeSession(), job);
+            return;
+        }
+
+        m_writeQueue->run(job);
+    }
+
+    SqliteProfile Database::sqliteProfile() const {
+        std::lock_guard lock(m_profileMutex);
+        return m_sqliteProfile;
+    }
+
+    void Database::setSqliteProfile(const SqliteProfile &profile) {
+        if (mbApp.dbType() != "sqlite3")
+            throw MantisException(400, "SQLite profiles only apply to SQLite databases.");
+
+        const auto id = std::to_string(std::hash<std::string>{}("sqlite_profile"));
+        const auto value = profile.toJson();
+        const std::tm now_tm = toUtcTime(time(nullptr));
+        write([&](soci::session &sql) {
+            sql << "INSERT INTO mb_store (id, value, created, updated) VALUES (:id, :value, :created, :updated) "
+                    "ON CONFLICT(id) DO UPDATE SET value = excluded.value, updated = excluded.updated",
+                    soci::use(id), soci::use(value), soci::use(now_tm), soci::use(now_tm);
+        });
+
+        std::lock_guard lock(m_profileMutex);
+        m_sqliteProfile = profile;
+        ++m_profileGen;
+        m_profileStale = m_profileApplied.size();
+        LogOrigin::dbInfo("SQLite Profile", fmt::format("SQLite tuning profile changed: {}", value.dump()));
+    }
+
+    SqliteProfile Database::resolveSqliteProfile(soci::session &sql) const {
+        try {
+            if (auto profile = SqliteProfile::fromEnv()) return *profile;
+        } catch (const std::exception &e) {
+            LogOrigin::dbWarn("SQLite Profile", fmt::format("Ignoring MB_SQLITE_PROFILE: {}", e.what()));
+        }
+
+        try {
+            // Absent on a new database, which then starts with the defaults
+            json stored;
+            const auto id = std::to_string(std::hash<std::string>{}("sqlite_profile"));
+            sql << "SELECT value FROM mb_store WHERE id = :id", soci::use(id), soci::into(stored);
+            if (sql.got_data()) return SqliteProfile::fromJson(stored);
+        } catch (const MantisException &e) {
+            LogOrigin::dbWarn("SQLite Profile", fmt::format("Ignoring stored SQLite profile: {}", e.what()));
+        } catch (const std::exception &) {
+            // No mb_store table yet
+        }
+        return {};
+    }
+
+    void Database::refreshSqliteProfile(soci::session &sql) const {
+        const auto slot = m_sessionSlots.find(&sql);
+        if (slot == m_sessionSlots.end()) return;
+
+        std::lock_guard lock(m_profileMutex);
+        if (m_profileApplied[slot->second] == m_profileGen) return;
+        try {
+            for (const auto &pragma: m_sqliteProfile.pragmas()) sql << pragma;
+        } catch (const std::exception &e) {
+            LogOrigin::dbWarn("SQLite Profile", fmt::format("Could not apply SQLite profile: {}", e.what()));
+        }
+        // Marked done even on failure, so a broken PRAGMA is not retried on every lease
+        m_profileApplied[slot->second] = m_profileGen;
+        --m_profileStale;
+    }
+
+    void Database::startCheckpointer(const size_t pool_size) {
+        // Its own connection, so a checkpoint never holds a pooled session. The
+        // short busy timeout bounds how long a RESTART/TRUNCATE can keep new
+        // writers waiting for readers before it gives up until the next tick.
+        m_checkpointConn = std::make_unique<soci::session>(soci::sqlite3, m_connStr);
+        *m_checkpointConn << "PRAGMA busy_timeout=200";
+        int page_size = 4096;
+        *m_checkpointConn << "PRAGMA page_size", soci::into(page_size);
+
+        const auto options = WalCheckpointer::Options::fromEnv();
+        m_checkpointer = std::make_unique<WalCheckpointer>([this](const WalCheckpointer::Mode mode) {
+            static constexpr const char *pragmas[] = {
+                "PRAGMA wal_checkpoint(PASSIVE)", "PRAGMA wal_checkpoint(RESTART)", "PRAGMA wal_checkpoint(TRUNCATE)"
+            };
+            int busy = 0, log = 0, checkpointed = 0;
+            *m_checkpointConn << pragmas[static_cast<int>(mode)],
+                    soci::into(busy), soci::into(log), soci::into(checkpointed);
+            return WalCheckpointer::Result{busy != 0, log, checkpointed};
+        }, page_size, options);
+
+        // Replaces the auto-checkpoint hook: committing only records the WAL size
+        const auto hook = [this](soci::session &sql) {
+            if (auto *backend = dynamic_cast<soci::sqlite3_session_backend *>(sql.get_backend()))
+                sqlite_api::sqlite3_wal_hook(backend->conn_, [](void *self, sqlite_api::sqlite3 *, const char *schema,
+                                                                const int wal_frames) {
+                    // An attached change log's WAL is the prune's to checkpoint
+                    if (std::strcmp(schema, "main") == 0)
+                        static_cast<WalCheckpointer *>(self)->noteCommit(wal_frames);
+                    return SQLITE_OK;
+                }, m_checkpointer.get());
+        };
+        if (m_writer) hook(*m_writer);
+        else
+            for (std::size_t i = 0; i < pool_size; ++i) hook(m_connPool->at(i));
+
+        m_checkpointer->start();
+        LogOrigin::dbInfo("WAL Checkpoint", fmt::format("Background WAL checkpoints: PASSIVE after {}ms idle, "
+                                                        "RESTART at {} MiB, TRUNCATE at {} MiB",
+                                                        options.idle.count(), options.restartBytes >> 20,
+                                                        options.truncateBytes >> 20));
+    }
+
+    std::optional<WalCheckpointer::Stats> Database::checkpointStats() const {
+        if (!m_checkpointer) return std::nullopt;
+        return m_checkpointer->stats();
+    }
+
+    namespace {
+        json poolJson(const PoolMetrics::Snapshot &pool) {
+            json histogram = json::array();
+            for (std::size_t i = 0; i < pool.waitBuckets.size(); ++i) {
+                histogram.push_back({
+                    {"le_ms", i < PoolMetrics::WAIT_BUCKETS.size()
+                                  ? json(std::chrono::duration<double, std::milli>(PoolMetrics::WAIT_BUCKETS[i]).count())
+                                  : json(nullptr)},
+                    {"count", pool.waitBuckets[i]}
+                });
+            }
+            return {
+                {"open", pool.open}, {"in_use", pool.inUse}, {"max_in_use", pool.maxInUse},
+                {"acquired", pool.acquired}, {"timeouts", pool.timeouts},
+                {"opened", pool.opened}, {"closed", pool.closed},
+                {"wait_ms", {
+                    {"total", pool.totalWaitMs}, {"max", pool.maxWaitMs},
+                    {"avg", pool.acquired ? pool.totalWaitMs / static_cast<double>(pool.acquired) : 0.0}
+                }},
+                {"wait_histogram", histogram}
+            };
+        }
+    }
+
+    json Database::metrics() const {
+        const auto stmt = statementCacheStats();
+        auto pool = poolJson(poolStats());
+        pool["size"] = m_tenant.empty() ? mbApp.poolSize() : m_tenantPoolSize;
+        pool["min"] = m_poolMin;
+        pool["acquire_timeout_ms"] = m_acquireTimeout.count();
+
+        // Replicas by position; their URLs may carry credentials
+        json replicas = json::array();
+        for (const auto &replica: m_replicas) {
+            replicas.push_back({
+                {"healthy", replica->healthy.load(std::memory_order_relaxed)},
+                {"lag_ms", replica->lagMs.load(std::memory_order_relaxed)},
+                {"reads", replica->reads.load(std::memory_order_relaxed)},
+                {"failed_checks", replica->failedChecks.load(std::memory_order_relaxed)},
+                {"pool", poolJson(replica->metrics.snapshot())}
+            });
+        }
+
+        json out = {
+            {"type", mbApp.dbType()},
+            {"pool", pool},
+            {"replicas", replicas},
+            {"statement_cache", {
+                {"hits", stmt.hits}, {"misses", stmt.misses}, {"evictions", stmt.evictions},
+                {"invalidations", stmt.invalidations}, {"size", stmt.size}
+            }},
+            {"write_queue", nullptr},
+            {"checkpoint", nullptr}
+        };
+
+        if (const auto wq = writeQueueStats())
+            out["write_queue"] = {
+                {"jobs", wq->jobs}, {"failed", wq->failed}, {"groups", wq->groups}, {"pending", wq->pending}
+            };
+
+        if (const auto ckpt = checkpointStats())
+            out["checkpoint"] = {
+                {"passive", ckpt->passive}, {"restart", ckpt->restart}, {"truncate", ckpt->truncate},
+                {"busy", ckpt->busy}, {"failed", ckpt->failed}, {"frames", ckpt->frames},
+                {"wal_bytes", ckpt->walBytes}, {"last_ms", ckpt->lastMs}, {"max_ms", ckpt->maxMs}
+            };
+        return out;
+    }
+
+    json Database::explain(const std::string &sql) const {
+        const auto db_type = mbApp.dbType();
+        const auto session = this->session();
+        auto rows = json::array();
+        if (db_type == "sqlite3") {
+            // id, parent, notused, detail
+            const soci::rowset<soci::row> plan = (session->prepare << "EXPLAIN QUERY PLAN " + sql);
+            for (const auto &row: plan) rows.push_back(row.get<std::string>(3));
+        } else if (db_type == "postgresql") {
+            const soci::rowset<std::string> plan = (session->prepare << "EXPLAIN (GENERIC_PLAN) " + sql);
+            for (const auto &line: plan) rows.push_back(line);
+        } else if (db_type == "mysql") {
+            std::string plan;
+            *session << "EXPLAIN FORMAT=JSON " + sql, soci::into(plan);
+            rows.push_back(json::parse(plan, nullptr, false));
+        }
+        return rows;
+    }
+
+    std::optional<WriteQueue::Stats> Database::writeQueueStats() const {
+        if (!m_writeQueue) return std::nullopt;
+        return m_writeQueue->stats();
     }
 
     soci::connection_pool &Database::connectionPool() const {
@@ -338,6 +1169,160 @@ namespace mb {
         return sql->is_connected();
     }
 
+    template<typename Fn>
+    auto Database::withCachedStatement(soci::session &sql, const std::string &table, const std::string &query,
+                                       const StatementKind kind, const bool has_param, Fn &&fn) const {
+        // Cached statements skip the logger, and with it the deadline check in start_query()
+        RequestDeadline::check();
+        const auto slot = m_sessionSlots.find(&sql);
+        if (slot == m_sessionSlots.end())
+            throw MantisException(500, "Session does not belong to this database's connection pool");
+
+        auto &cache = *m_stmtCaches[slot->second];
+        std::lock_guard lock(cache.mutex);
+
+        // Drop statements on tables whose schema changed since our last use
+        if (!cache.staleTables.empty()) {
+            for (auto it = cache.entries.begin(); it != cache.entries.end();) {
+                if (std::ranges::find(cache.staleTables, it->second->table) != cache.staleTables.end()) {
+                    cache.lru.erase(it->second->lruPos);
+                    it = cache.entries.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            cache.staleTables.clear();
+        }
+
+        auto it = cache.entries.find(query);
+        if (it != cache.entries.end()) {
+            ++m_stmtHits;
+            cache.lru.splice(cache.lru.begin(), cache.lru, it->second->lruPos);
+        } else {
+            ++m_stmtMisses;
+            if (cache.entries.size() >= STATEMENT_CACHE_CAPACITY) {
+                cache.entries.erase(cache.lru.back());
+                cache.lru.pop_back();
+                ++m_stmtEvictions;
+            }
+
+            // `sql` is the pooled session itself, which lives as long as the pool does
+            auto entry = std::make_unique<CachedStatement>();
+            entry->table = table;
+            entry->kind = kind;
+            entry->stmt = std::make_unique<soci::statement>(sql);
+            if (has_param)
+                entry->stmt->exchange(soci::use(entry->param, "p"));
+            if (kind == StatementKind::Row)
+                entry->stmt->exchange(soci::into(entry->row));
+            else if (kind == StatementKind::Scalar)
+                entry->stmt->exchange(soci::into(entry->scalar, entry->scalarInd));
+            entry->stmt->alloc();
+            entry->stmt->prepare(query);
+            entry->stmt->define_and_bind();
+
+            cache.lru.push_front(query);
+            entry->lruPos = cache.lru.begin();
+            it = cache.entries.emplace(query, std::move(entry)).first;
+        }
+
+        auto &entry = *it->second;
+        try {
+            // Cached statements skip SOCI's logger, so open their span here
+            const bool timed = mbApp.dbType() != "sqlite3";
+            Tracer::statement(query);
+            SlowQueryLog::clearParameters();
+            if (timed) SlowQueryLog::statement(query);
+            auto result = fn(entry);
+            if (has_param) SlowQueryLog::parameter("'" + entry.param + "'");
+            Tracer::endStatement();
+            if (timed) SlowQueryLog::endStatement();
+
+            // Reset SQLite statements right away: a statement left mid-step
+            // keeps its read transaction (and WAL snapshot) open on the
+            // connection, which would leak into the next request using it.
+            if (mbApp.dbType() == "sqlite3") {
+                if (const auto *be = dynamic_cast<soci::sqlite3_statement_backend *>(entry.stmt->get_backend());
+                    be && be->stmt_)
+                    sqlite_api::sqlite3_reset(be->stmt_);
+            }
+            return result;
+        } catch (...) {
+            // Never reuse a statement that failed mid-execution
+            cache.lru.erase(entry.lruPos);
+            cache.entries.erase(it);
+            throw;
+        }
+    }
+
+    bool Database::queryRowCached(soci::session &sql, const std::string &table, const std::string &query,
+                                  const std::optional<std::string> &param,
+                                  const std::function<void(const soci::row &)> &on_row) const {
+        return withCachedStatement(sql, table, query, StatementKind::Row, param.has_value(),
+                                   [&](CachedStatement &entry) {
+                                       if (param) entry.param = *param;
+                                       const bool got = entry.stmt->execute(true);
+                                       if (got && on_row) on_row(entry.row);
+                                       return got;
+                                   });
+    }
+
+    std::optional<long long> Database::queryScalarCached(soci::session &sql, const std::string &table,
+                                                         const std::string &query,
+                                                         const std::optional<std::string> &param) const {
+        return withCachedStatement(sql, table, query, StatementKind::Scalar, param.has_value(),
+                                   [&](CachedStatement &entry) -> std::optional<long long> {
+                                       if (param) entry.param = *param;
+                                       if (!entry.stmt->execute(true) || entry.scalarInd == soci::i_null)
+                                           return std::nullopt;
+                                       return entry.scalar;
+                                   });
+    }
+
+    long long Database::execCached(soci::session &sql, const std::string &table, const std::string &query,
+                                   const std::optional<std::string> &param) const {
+        return withCachedStatement(sql, table, query, StatementKind::Exec, param.has_value(),
+                                   [&](CachedStatement &entry) {
+                                       if (param) entry.param = *param;
+                                       entry.stmt->execute(true);
+                                       return entry.stmt->get_affected_rows();
+                                   });
+    }
+
+    void Database::invalidateStatements(const std::string &table) const {
+        for (const auto &cache: m_stmtCaches) {
+            std::lock_guard lock(cache->mutex);
+            cache->staleTables.push_back(table);
+        }
+        ++m_stmtInvalidations;
+        MB_LOG_TRACE(LogOrigin::dbTrace, "Statement Cache", fmt::format("Invalidated cached statements for `{}`", table));
+    }
+
+    Database::StatementCacheStats Database::statementCacheStats() const {
+        StatementCacheStats stats;
+        stats.hits = m_stmtHits.load();
+        stats.misses = m_stmtMisses.load();
+        stats.evictions = m_stmtEvictions.load();
+        stats.invalidations = m_stmtInvalidations.load();
+        for (const auto &cache: m_stmtCaches) {
+            std::lock_guard lock(cache->mutex);
+            stats.size += cache->entries.size();
+        }
+        return stats;
+    }
+
+    void Database::clearStatementCaches() const {
+        for (std::size_t slot = 0; slot < m_stmtCaches.size(); ++slot) clearStatementCache(slot);
+    }
+
+    void Database::clearStatementCache(const size_t slot) const {
+        auto &cache = *m_stmtCaches[slot];
+        std::lock_guard lock(cache.mutex);
+        cache.entries.clear();
+        cache.lru.clear();
+        cache.staleTables.clear();
+    }
+
     void Database::writeCheckpoint() const {
         // Make writeCheckpoint() safe to call during shutdown
         if (!m_connPool) {
@@ -350,7 +1335,7 @@ namespace mb {
             if (mbApp.dbType() == "sqlite3") {
                 try {
                     // Write out the WAL data to db file & truncate it
-                    if (const auto sql = session(); sql->is_connected()) {
+                    if (const auto sql = writeSession(); sql->is_connected()) {
                         *sql << "PRAGMA wal_checkpoint(TRUNCATE)";
                     }
                 } catch (std::exception &e) {
@@ -372,6 +1357,8 @@ namespace mb {
         dukglue_register_property(ctx, &Database::isConnected, nullptr, "connected");
         dukglue_register_method(ctx, &Database::session, "session");
         dukglue_register_method_varargs(ctx, &Database::query, "query");
+        dukglue_register_method_varargs(ctx, &Database::cursor, "cursor");
+        dukglue_register_method_varargs(ctx, &Database::execMany, "execMany");
 
         // soci::session methods
         dukglue_register_method(ctx, &soci::session::close, "close");
@@ -392,6 +1379,178 @@ namespace mb {
 
 
 #ifdef MB_SCRIPTING_ENABLED
+    namespace {
+        /// Most rows a cursor's `next(n)` hands over at once
+        constexpr duk_int_t MAX_CURSOR_CHUNK = 10000;
+
+        /**
+         * Add the values of the JS object at `idx` to `vals`, by key.
+         * Throws std::invalid_argument for something that isn't an object or a value SQL can't take;
+         * callers raise it as a JS TypeError once their sessions are released.
+         */
+        void bindJsObject(duk_context *ctx, const duk_idx_t idx, soci::values &vals) {
+            if (!duk_is_object(ctx, idx) || duk_is_array(ctx, idx))
+                throw std::invalid_argument("Bind values must be objects");
+
+            // Read straight off the stack, without a JSON text in between
+            const auto json_obj = dukToJson(ctx, idx);
+            if (!json_obj.is_object())
+                throw std::invalid_argument("Bind values must be plain objects");
+            MB_LOG_TRACE(LogOrigin::dbTrace, "Value Binding", fmt::format("[JS] Binding `{}`", json_obj.dump()));
+
+            for (auto &[key, value]: json_obj.items()) {
+                if (value.is_string()) {
+                    vals.set(key, value.get<std::string>());
+                } else if (value.is_number_integer()) {
+                    // JS numbers reach past int; keep what fits in 32 bits as before
+                    const auto n = value.get<long long>();
+                    if (n >= std::numeric_limits<int>::min() && n <= std::numeric_limits<int>::max())
+                        vals.set(key, static_cast<int>(n));
+                    else
+                        vals.set(key, n);
+                } else if (value.is_number_float()) {
+                    vals.set(key, value.get<double>());
+                } else if (value.is_boolean()) {
+                    vals.set(key, value.get<bool>());
+                } else if (value.is_null()) {
+                    std::optional<int> val;
+                    vals.set(key, val, soci::i_null);
+                } else if (value.is_object() || value.is_array()) {
+                    vals.set(key, value);
+                } else {
+                    throw std::invalid_argument(std::format("Could not cast `{}` to a DB supported type.", key));
+                }
+            }
+        }
+
+        /// Column names of a result set, read once from its first row
+        std::vector<std::string> columnNames(const soci::row &row) {
+            std::vector<std::string> names;
+            names.reserve(row.size());
+            for (std::size_t i = 0; i < row.size(); ++i) names.push_back(row.get_properties(i).get_name());
+            return names;
+        }
+
+        /// Push `row` as a JS object straight from its column types, without a json round trip
+        void pushRow(duk_context *ctx, const soci::row &row, const std::vector<std::string> &names) {
+            duk_push_object(ctx);
+            for (std::size_t i = 0; i < row.size(); ++i) {
+                if (row.get_indicator(i) == soci::i_null) {
+                    duk_push_null(ctx);
+                } else {
+                    switch (row.get_properties(i).get_db_type()) {
+                        case soci::db_string:
+                        case soci::db_xml: {
+                            const auto &text = row.get<std::string>(i);
+                            duk_push_lstring(ctx, text.data(), text.size());
+                            break;
+                        }
+                        case soci::db_double: duk_push_number(ctx, row.get<double>(i)); break;
+                        case soci::db_int8: duk_push_int(ctx, row.get<int8_t>(i)); break;
+                        case soci::db_uint8: duk_push_uint(ctx, row.get<uint8_t>(i)); break;
+                        case soci::db_int16: duk_push_int(ctx, row.get<int16_t>(i)); break;
+                        case soci::db_uint16: duk_push_uint(ctx, row.get<uint16_t>(i)); break;
+                        case soci::db_int32: duk_push_int(ctx, row.get<int32_t>(i)); break;
+                        case soci::db_uint32: duk_push_uint(ctx, row.get<uint32_t>(i)); break;
+                        // Exact up to 2^53, like any JS number
+                        case soci::db_int64: duk_push_number(ctx, static_cast<double>(row.get<int64_t>(i))); break;
+                        case soci::db_uint64: duk_push_number(ctx, static_cast<double>(row.get<uint64_t>(i))); break;
+                        case soci::db_date: {
+                            const auto text = tmToStr(row.get<std::tm>(i));
+                            duk_push_lstring(ctx, text.data(), text.size());
+                            break;
+                        }
+                        default: duk_push_null(ctx); break; // Blobs aren't exposed to scripts
+                    }
+                }
+                duk_put_prop_lstring(ctx, -2, names[i].data(), names[i].size());
+            }
+        }
+
+        /// Session for `query`: anything but a plain read needs the writer in single-writer mode
+        std::shared_ptr<soci::session> sessionFor(const Database &db, const std::string &query) {
+            auto verb = trim(query).substr(0, 6);
+            toLowerCase(verb);
+            return verb.starts_with("select") || verb.starts_with("with") ? db.session() : db.writeSession();
+        }
+
+        /**
+         * An open result set handed to a script. Holds its pooled session until the rows run
+         * out, `close()` is called or the JS object is collected.
+         */
+        struct ScriptCursor {
+            std::shared_ptr<soci::session> sql;
+            soci::values vals;
+            soci::row row;
+            std::unique_ptr<soci::statement> st; ///> Declared last: binds into `vals` and `row`
+            std::vector<std::string> names;
+            bool pending = false; ///> `row` holds a fetched row not handed out yet
+
+            void close() {
+                st.reset();
+                sql.reset();
+                pending = false;
+            }
+        };
+
+        ScriptCursor *cursorOf(duk_context *ctx, const duk_idx_t idx) {
+            duk_get_prop_string(ctx, idx, DUK_HIDDEN_SYMBOL("cursor"));
+            auto *cursor = static_cast<ScriptCursor *>(duk_get_pointer(ctx, -1));
+            duk_pop(ctx);
+            return cursor;
+        }
+
+        void releaseCursor(duk_context *ctx, const duk_idx_t idx) {
+            delete cursorOf(ctx, idx);
+            duk_push_pointer(ctx, nullptr);
+            duk_put_prop_string(ctx, idx, DUK_HIDDEN_SYMBOL("cursor"));
+        }
+
+        /// `cursor.next(n = 100)`: the next rows, at most `n`; null once there are none left
+        duk_ret_t cursorNext(duk_context *ctx) {
+            const auto limit = std::clamp<duk_int_t>(duk_get_int_default(ctx, 0, 100), 1, MAX_CURSOR_CHUNK);
+            duk_push_this(ctx);
+            const auto self = duk_get_top_index(ctx);
+            auto *cursor = cursorOf(ctx, self);
+            if (!cursor || !cursor->pending) {
+                if (cursor) releaseCursor(ctx, self);
+                duk_push_null(ctx);
+                return 1;
+            }
+
+            duk_push_array(ctx);
+            duk_uarridx_t count = 0;
+            bool failed = false;
+            try {
+                while (cursor->pending && count < static_cast<duk_uarridx_t>(limit)) {
+                    pushRow(ctx, cursor->row, cursor->names);
+                    duk_put_prop_index(ctx, -2, count++);
+                    cursor->pending = cursor->st->fetch();
+                }
+            } catch (const std::exception &e) {
+                duk_push_error_object(ctx, DUK_ERR_ERROR, "%s", e.what());
+                failed = true;
+            }
+
+            // Hand the session back as soon as the last row is out
+            if (failed || !cursor->pending) cursor->close();
+            if (failed) return duk_throw(ctx);
+            return 1;
+        }
+
+        /// `cursor.close()`: release the session early
+        duk_ret_t cursorClose(duk_context *ctx) {
+            duk_push_this(ctx);
+            releaseCursor(ctx, duk_get_top_index(ctx));
+            return 0;
+        }
+
+        duk_ret_t cursorFinalize(duk_context *ctx) {
+            releaseCursor(ctx, 0);
+            return 0;
+        }
+    }
+
     duk_ret_t Database::query(duk_context *ctx) {
         // TRACE_CLASS_METHOD();
 
@@ -400,116 +1559,135 @@ namespace mb {
 
         if (nargs < 1) {
             LogOrigin::dbCritical("Invalid Arguments", "[JS] Expected at least 1 argument (query string)");
-            duk_error(ctx, DUK_ERR_TYPE_ERROR, "Expected at least 1 argument (query string)");
-            return DUK_RET_TYPE_ERROR;
+            return duk_error(ctx, DUK_ERR_TYPE_ERROR, "Expected at least 1 argument (query string)");
         }
 
         // First argument is the SQL query
-        const char *query = duk_require_string(ctx, 0);
-        // logEntry::trace("[JS] SQL Query: `{}`", query);
-
-        // Collect remaining arguments (bind parameters)
-        soci::values vals;
+        const std::string query = duk_require_string(ctx, 0);
 
+        // Rows are pushed as they are fetched; the first stays a bare object unless a second follows
+        int rows = 0;
+        bool failed = false;
         try {
-            for (int i = 1; i < nargs; i++) {
-                if (!duk_is_object(ctx, i)) {
-                    LogOrigin::dbCritical("Invalid Arguments", "[JS] Arguments after query must be objects.");
-                    duk_error(ctx, DUK_ERR_TYPE_ERROR, "Arguments after query must be objects");
-                    return DUK_RET_TYPE_ERROR;
-                }
-
-                // Convert JavaScript object to JSON string
-                duk_dup(ctx, i); // Duplicate the object at index i
-                const char *json_char = duk_json_encode(ctx, -1);
-
-                // Create a string out of the char*, else, json::parse throws an exception
-                const std::string json_str = json_char ? std::string(json_char) : std::string();
-
-                duk_pop(ctx); // Pop the encoded string
-
-                nlohmann::json json_obj = json::object();
-                try {
-                    // Parse into nlohmann::json
-                    json_obj = nlohmann::json::parse(json_str);
-                } catch (const std::exception &e) {
-                    LogOrigin::dbCritical("Parsing Exception", fmt::format("[JS] Parsing exception: {}", e.what()));
-                } catch (const char *e) {
-                    LogOrigin::dbCritical("Parsing Exception", "[JS] Unknown Parsing exception");
-                }
-                LogOrigin::dbTrace("Parsing Complete", fmt::format("After Parsing, object? `{}`", json_obj.dump()));
-
-                for (auto &[key, value]: json_obj.items()) {
-                    if (value.is_string()) {
-                        auto str_val = value.get<std::string>();
-                        LogOrigin::dbTrace("Value Binding", fmt::format("[JS] Str Value: `{}` - `{}`", key, str_val));
-                        vals.set(key, str_val);
-                        LogOrigin::dbTrace("Value Binding", "[JS] After Set Value");
-                        LogOrigin::dbTrace("Value Binding",
-                                           fmt::format("[JS] After Set Value To: `{}`", vals.get<std::string>(key)));
-                    } else if (value.is_number_integer()) {
-                        int int_val = value.get<int>();
-                        LogOrigin::dbTrace("Value Binding", fmt::format("[JS] Int Value: `{}`", int_val));
-                        vals.set(key, int_val);
-                    } else if (value.is_number_float()) {
-                        double double_val = value.get<double>();
-                        LogOrigin::dbTrace("Value Binding", fmt::format("[JS] Double Value: `{}`", double_val));
-                        vals.set(key, double_val);
-                    } else if (value.is_boolean()) {
-                        bool bool_val = value.get<bool>();
-                        LogOrigin::dbTrace("Value Binding", fmt::format("[JS] Bool Value: `{}`", bool_val));
-                        vals.set(key, bool_val);
-                    } else if (value.is_null()) {
-                        std::optional<int> val;
-                        LogOrigin::dbTrace("Value Binding", "[JS] Null Value: `null`");
-                        vals.set(key, val, soci::i_null);
-                    } else if (value.is_object() || value.is_array()) {
-                        LogOrigin::dbTrace("Value Binding", fmt::format("[JS] JSON Value: `{}`", value.dump()));
-                        vals.set(key, value);
-                    } else {
-                        auto err = std::format("Could not cast type at {} to DB supported types.", (i - 1));
-                        LogOrigin::dbCritical("Value Casting Error", fmt::format("[JS] Casting Value > {}", err));
-                        duk_error(ctx, DUK_ERR_TYPE_ERROR, err.c_str());
-                        return DUK_RET_TYPE_ERROR;
-                    }
+            // Remaining arguments are objects of bind values
+            soci::values vals;
+            for (int i = 1; i < nargs; i++) bindJsObject(ctx, i, vals);
+
+            const auto sql = sessionFor(*this, query);
+            soci::row data_row;
+            soci::statement st = nargs < 2 // If only the query is provided, no binding values
+                                     ? (sql->prepare << query, soci::into(data_row))
+                                     : (sql->prepare << query, soci::use(vals), soci::into(data_row));
+            st.execute();
+
+            std::vector<std::string> names;
+            while (st.fetch()) {
+                if (names.empty()) names = columnNames(data_row);
+                pushRow(ctx, data_row, names);
+                if (++rows == 2) {
+                    // [first, second] -> [array]
+                    duk_push_array(ctx);
+                    duk_insert(ctx, -3);
+                    duk_put_prop_index(ctx, -3, 1);
+                    duk_put_prop_index(ctx, -2, 0);
+                } else if (rows > 2) {
+                    duk_put_prop_index(ctx, -2, static_cast<duk_uarridx_t>(rows - 1));
                 }
             }
+        } catch (const std::invalid_argument &e) {
+            LogOrigin::dbCritical("Invalid Arguments", fmt::format("[JS] {}", e.what()));
+            duk_push_error_object(ctx, DUK_ERR_TYPE_ERROR, "%s", e.what());
+            failed = true;
         } catch (const std::exception &e) {
-            LogOrigin::dbCritical("Binding Values Failed",
-                                  fmt::format("[JS] Getting Binding Values Failed: Why? {}", e.what()));
+            LogOrigin::dbCritical("Query Failed", fmt::format("[JS] {}", e.what()));
+            duk_push_error_object(ctx, DUK_ERR_ERROR, "%s", e.what());
+            failed = true;
         }
 
-        // Get SQL Session
-        auto sql = session();
-
-        LogOrigin::dbTrace("Value Binding", fmt::format("[JS] soci::value binding? {}", nargs - 1));
+        if (failed) return duk_throw(ctx);
+        if (rows == 0) duk_push_null(ctx); // Return null
+        return 1;
+    }
 
-        // Execute SQL Statement
-        soci::row data_row;
-        soci::statement st = nargs < 2 // If only the query is provided, no binding values
-                                 ? (sql->prepare << query, soci::into(data_row)) // Execute only the query
-                                 : (sql->prepare << query, soci::use(vals), soci::into(data_row));
-        st.execute(); // Execute statement
+    duk_ret_t Database::cursor(duk_context *ctx) {
+        const int nargs = duk_get_top(ctx);
+        if (nargs < 1)
+            return duk_error(ctx, DUK_ERR_TYPE_ERROR, "Expected at least 1 argument (query string)");
+        const std::string query = duk_require_string(ctx, 0);
 
-        json results = json::array();
-        while (st.fetch()) {
-            nlohmann::json obj = rowToJson(data_row);
-            results.push_back(obj);
+        auto *cursor = new ScriptCursor();
+        bool failed = false;
+        try {
+            for (int i = 1; i < nargs; i++) bindJsObject(ctx, i, cursor->vals);
+
+            cursor->sql = sessionFor(*this, query);
+            cursor->st = std::make_unique<soci::statement>(
+                nargs < 2
+                    ? (cursor->sql->prepare << query, soci::into(cursor->row))
+                    : (cursor->sql->prepare << query, soci::use(cursor->vals), soci::into(cursor->row)));
+            cursor->st->execute();
+            cursor->pending = cursor->st->fetch();
+            if (cursor->pending) cursor->names = columnNames(cursor->row);
+            else cursor->close();
+        } catch (const std::invalid_argument &e) {
+            duk_push_error_object(ctx, DUK_ERR_TYPE_ERROR, "%s", e.what());
+            failed = true;
+        } catch (const std::exception &e) {
+            LogOrigin::dbCritical("Query Failed", fmt::format("[JS] {}", e.what()));
+            duk_push_error_object(ctx, DUK_ERR_ERROR, "%s", e.what());
+            failed = true;
+        }
+        if (failed) {
+            delete cursor;
+            return duk_throw(ctx);
         }
 
-        LogOrigin::dbTrace("Query Results", fmt::format("[JS] Results: {}", results.dump()));
+        duk_push_object(ctx);
+        duk_push_pointer(ctx, cursor);
+        duk_put_prop_string(ctx, -2, DUK_HIDDEN_SYMBOL("cursor"));
+        duk_push_c_function(ctx, &cursorNext, 1);
+        duk_put_prop_string(ctx, -2, "next");
+        duk_push_c_function(ctx, &cursorClose, 0);
+        duk_put_prop_string(ctx, -2, "close");
+        duk_push_c_function(ctx, &cursorFinalize, 1);
+        duk_set_finalizer(ctx, -2);
+        return 1;
+    }
 
-        if (results.empty()) {
-            // Return null
-            duk_push_null(ctx);
-            return 1;
+    duk_ret_t Database::execMany(duk_context *ctx) {
+        const std::string query = duk_require_string(ctx, 0);
+        if (!duk_is_array(ctx, 1))
+            return duk_error(ctx, DUK_ERR_TYPE_ERROR, "Expected an array of bind objects after the query");
+        const auto count = duk_get_length(ctx, 1);
+
+        double affected = 0;
+        bool failed = false;
+        try {
+            const auto sql = writeSession();
+            soci::transaction tr(*sql);
+            for (duk_size_t i = 0; i < count; ++i) {
+                soci::values vals;
+                duk_get_prop_index(ctx, 1, static_cast<duk_uarridx_t>(i));
+                bindJsObject(ctx, -1, vals);
+                duk_pop(ctx);
+
+                soci::statement st = (sql->prepare << query, soci::use(vals));
+                st.execute(true);
+                affected += static_cast<double>(st.get_affected_rows());
+            }
+            tr.commit();
+        } catch (const std::invalid_argument &e) {
+            duk_push_error_object(ctx, DUK_ERR_TYPE_ERROR, "%s", e.what());
+            failed = true;
+        } catch (const std::exception &e) {
+            LogOrigin::dbCritical("Batch Execute Failed", fmt::format("[JS] {}", e.what()));
+            duk_push_error_object(ctx, DUK_ERR_ERROR, "%s", e.what());
+            failed = true;
         }
 
-        // Convert nlohmann::json to JavaScript object
-        std::string results_str = results.size() == 1 ? results[0].dump() : results.dump();
-        duk_push_string(ctx, results_str.c_str());
-        duk_json_decode(ctx, -1);
-        return 1; // Return the object
+        if (failed) return duk_throw(ctx);
+        duk_push_number(ctx, affected);
+        return 1;
     }
 #endif
 } // namespace mb
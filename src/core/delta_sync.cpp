@@ -0,0 +1,198 @@
+#include "../../include/mantisbase/core/delta_sync.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <soci/soci.h>
+
+#include <algorithm>
+#include <charconv>
+#include <unordered_map>
+
+namespace mb {
+    namespace {
+        /// Cursors up to this much short of the retention window are refused too, so a prune running alongside
+        /// can't take changes from under the read
+        constexpr long long kRetainSlackS = 60;
+
+        /// A whole-number column; SQLite types computed columns by their first value
+        long long wholeNumber(const soci::row &row, const std::size_t i) {
+            if (row.get_indicator(i) == soci::i_null) return 0;
+            switch (row.get_properties(i).get_db_type()) {
+                case soci::db_int32: return row.get<int32_t>(i);
+                case soci::db_int64: return row.get<int64_t>(i);
+                case soci::db_uint64: return static_cast<long long>(row.get<uint64_t>(i));
+                case soci::db_double: return static_cast<long long>(row.get<double>(i));
+                case soci::db_string: return std::stoll(row.get<std::string>(i));
+                default: throw std::runtime_error("Unexpected column type in mb_change_log");
+            }
+        }
+
+        /// The database clock, in Unix seconds, as `mb_change_log.timestamp` is written by
+        long long databaseNow(soci::session &sql, const bool pg) {
+            long long now = 0;
+            sql << (pg
+                        ? "SELECT CAST(EXTRACT(EPOCH FROM LOCALTIMESTAMP) AS bigint)"
+                        : "SELECT CAST(strftime('%s', 'now') AS INTEGER)"),
+                    soci::into(now);
+            return now;
+        }
+
+        /// The newest id handed out, pruned or not
+        long long headId(soci::session &sql, const bool pg) {
+            long long head = 0;
+            soci::indicator ind = soci::i_null;
+            sql << (pg
+                        ? "SELECT last_value FROM mb_change_log_id_seq"
+                        : "SELECT seq FROM sqlite_sequence WHERE name = 'mb_change_log'"),
+                    soci::into(head, ind);
+            return sql.got_data() && ind == soci::i_ok ? head : 0;
+        }
+    }
+
+    DeltaSync::Options DeltaSync::Options::fromEnv() {
+        Options options;
+        if (const auto secs = safe_stoi(getEnvOrDefault("MB_SYNC_RETAIN_S", ""), -1); secs >= 0)
+            options.retain = std::chrono::seconds(secs);
+        if (const auto batch = safe_stoi(getEnvOrDefault("MB_SYNC_BATCH", ""), 0); batch > 0)
+            options.batch = std::min(batch, 5000);
+        return options;
+    }
+
+    std::string DeltaSync::Cursor::encode() const {
+        return std::format("{}.{}", changeId, at);
+    }
+
+    std::optional<DeltaSync::Cursor> DeltaSync::Cursor::decode(const std::string &cursor) {
+        const auto dot = cursor.find('.');
+        if (dot == std::string::npos) return std::nullopt;
+
+        Cursor c;
+        const auto *begin = cursor.data(), *end = cursor.data() + cursor.size();
+        const auto id = std::from_chars(begin, begin + dot, c.changeId);
+        const auto at = std::from_chars(begin + dot + 1, end, c.at);
+        if (id.ec != std::errc{} || id.ptr != begin + dot || at.ec != std::errc{} || at.ptr != end ||
+            c.changeId < 0 || c.at < 0)
+            return std::nullopt;
+        return c;
+    }
+
+    std::vector<DeltaSync::RowChange> DeltaSync::compact(const std::vector<LogEntry> &entries,
+                                                         std::set<std::string> &resync) {
+        std::vector<RowChange> rows;
+        std::unordered_map<std::string, std::size_t> index; // entity + row id -> its entry in `rows`
+        for (const auto &entry: entries) {
+            if (entry.type != "INSERT" && entry.type != "UPDATE" && entry.type != "DELETE") {
+                resync.insert(entry.entity);
+                continue;
+            }
+
+            const bool deleted = entry.type == "DELETE";
+            const auto [it, fresh] = index.try_emplace(entry.entity + '\x1f' + entry.rowId, rows.size());
+            if (fresh) rows.push_back({entry.entity, entry.rowId, entry.type == "INSERT", deleted});
+            else rows[it->second].deleted = deleted;
+        }
+
+        // Created and gone again: the client never held it
+        std::erase_if(rows, [](const RowChange &row) { return row.inserted && row.deleted; });
+        return rows;
+    }
+
+    json DeltaSync::changesSince(soci::session &sql, const std::optional<Cursor> &since,
+                                 const std::vector<std::string> &entities, const Options &options,
+                                 const std::function<std::vector<json>(const std::string &entity,
+                                                                       const std::vector<std::string> &ids)> &read) {
+        const bool pg = sql.get_backend_name() == "postgresql";
+        const auto now = databaseNow(sql, pg);
+
+        // A first sync only learns where the log is: the client downloads, then syncs from here
+        if (!since) {
+            long long newest = 0;
+            soci::indicator ind = soci::i_null;
+            sql << "SELECT MAX(id) FROM mb_change_log", soci::into(newest, ind);
+            const Cursor cursor{ind == soci::i_ok ? newest : 0, now};
+            return {{"cursor", cursor.encode()}, {"more", false}, {"upserts", json::object()},
+                    {"deletes", json::object()}, {"resync", json::array()}};
+        }
+
+        const auto retain = options.retain.count();
+        if (since->at < now - retain + std::min(kRetainSlackS, retain / 2))
+            throw MantisException(410, "Changes after this cursor were pruned; download afresh");
+        // Ids start over if the log was lost, e.g. PostgreSQL empties unlogged tables after a crash
+        if (since->changeId > headId(sql, pg))
+            throw MantisException(410, "The change log was reset; download afresh");
+
+        // PostgreSQL triggers log the folded table name, the CRUD layer the name as given
+        std::unordered_map<std::string, std::string> names; // As logged -> as asked for
+        for (const auto &entity: entities) {
+            names.emplace(entity, entity);
+            if (pg) {
+                auto folded = entity;
+                toLowerCase(folded);
+                names.emplace(folded, entity);
+            }
+        }
+        if (names.empty()) throw MantisException(400, "Name the `entities` to sync.");
+
+        soci::values vals;
+        std::string in;
+        for (std::size_t i = 0; const auto &[logged, _]: names) {
+            const auto param = "e" + std::to_string(i++);
+            vals.set(param, logged);
+            in += (in.empty() ? ":" : ", :") + param;
+        }
+        const long long after = since->changeId;
+        const int count = std::clamp(options.batch, 1, 5000);
+        vals.set("after", after);
+        vals.set("n", count);
+
+        const soci::rowset<soci::row> rs = (sql.prepare << std::format(
+            "SELECT id, {}, type, entity, row_id FROM mb_change_log WHERE id > :after AND entity IN ({}) "
+            "ORDER BY id LIMIT :n",
+            pg ? "CAST(EXTRACT(EPOCH FROM timestamp) AS bigint)" : "CAST(strftime('%s', timestamp) AS INTEGER)", in),
+            soci::use(vals));
+
+        std::vector<LogEntry> entries;
+        Cursor next{after, now};
+        long long last_at = now;
+        for (const auto &row: rs) {
+            next.changeId = wholeNumber(row, 0);
+            last_at = wholeNumber(row, 1);
+            entries.push_back({row.get<std::string>(2), names.at(row.get<std::string>(3)), row.get<std::string>(4)});
+        }
+
+        // A full page may stop short of the log's end; the rest are no older than its last change
+        const bool more = entries.size() >= static_cast<std::size_t>(count);
+        if (more) next.at = last_at;
+
+        std::set<std::string> resync;
+        const auto rows = compact(entries, resync);
+
+        // Upserts are the rows as they are now, and as the caller may see them
+        std::unordered_map<std::string, std::vector<std::string>> wanted;
+        for (const auto &row: rows)
+            if (!row.deleted) wanted[row.entity].push_back(row.rowId);
+        std::unordered_map<std::string, std::unordered_map<std::string, json>> current;
+        for (const auto &[entity, ids]: wanted)
+            for (auto &record: read(entity, ids)) {
+                auto id = record.value("id", "");
+                current[entity].emplace(std::move(id), std::move(record));
+            }
+
+        json upserts = json::object(), deletes = json::object();
+        for (const auto &row: rows) {
+            if (!row.deleted) {
+                if (const auto it = current[row.entity].find(row.rowId); it != current[row.entity].end()) {
+                    upserts[row.entity].push_back(std::move(it->second));
+                    continue;
+                }
+                // Created since, and already out of the caller's view: nothing to take back
+                if (row.inserted) continue;
+            }
+            // Removed, or no longer the caller's to see
+            deletes[row.entity].push_back(row.rowId);
+        }
+
+        return {{"cursor", next.encode()}, {"more", more}, {"upserts", std::move(upserts)},
+                {"deletes", std::move(deletes)}, {"resync", resync}};
+    }
+}
@@ -0,0 +1,70 @@
+/**
+ * @file drain.cpp
+ * @brief Implementation for @see drain.h
+ */
+
+#include "../../include/mantisbase/core/drain.h"
+#include "../../include/mantisbase/core/metrics.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <random>
+
+namespace mb {
+    Drain::Options Drain::Options::fromEnv() {
+        Options options;
+        if (const auto ms = safe_stoi(getEnvOrDefault("MB_SHUTDOWN_GRACE_MS", ""), -1); ms >= 0)
+            options.grace = std::chrono::milliseconds(ms);
+        if (const auto ms = safe_stoi(getEnvOrDefault("MB_SHUTDOWN_RECONNECT_JITTER_MS", ""), -1); ms >= 0)
+            options.reconnectJitter = std::chrono::milliseconds(ms);
+        return options;
+    }
+
+    Drain::Ticket::~Ticket() {
+        m_drain.leave();
+    }
+
+    Drain::Drain(const Options options) : m_options(options) {}
+
+    std::shared_ptr<Drain::Ticket> Drain::enter() {
+        // Counted before the check, so wait() either sees this request or it sees the drain
+        m_inflight.fetch_add(1);
+        if (m_draining.load()) {
+            leave();
+            m_refused.fetch_add(1);
+            return nullptr;
+        }
+        return std::make_shared<Ticket>(*this);
+    }
+
+    void Drain::leave() {
+        if (m_inflight.fetch_sub(1) != 1 || !m_draining.load()) return;
+        {
+            std::lock_guard lock(m_mutex);
+        }
+        m_cv.notify_all();
+    }
+
+    bool Drain::begin() {
+        return !m_draining.exchange(true);
+    }
+
+    bool Drain::wait() {
+        std::unique_lock lock(m_mutex);
+        return m_cv.wait_for(lock, m_options.grace, [this] { return m_inflight.load() == 0; });
+    }
+
+    std::chrono::milliseconds Drain::reconnectDelay() const {
+        thread_local std::mt19937_64 rng{std::random_device{}()};
+        std::uniform_int_distribution<std::int64_t> delay(0, m_options.reconnectJitter.count());
+        return std::chrono::milliseconds(delay(rng));
+    }
+
+    void Drain::writeMetrics(MetricsWriter &out) const {
+        out.family("mb_http_inflight", "HTTP requests being handled", "gauge");
+        out.sample("mb_http_inflight", {}, static_cast<double>(inflight()));
+        out.family("mb_http_draining", "1 while shutting down and turning new requests away", "gauge");
+        out.sample("mb_http_draining", {}, draining() ? 1 : 0);
+        out.family("mb_http_drain_refused_total", "Requests answered 503 while shutting down", "counter");
+        out.sample("mb_http_drain_refused_total", {}, static_cast<double>(refused()));
+    }
+}
@@ -1,6 +1,9 @@
 #include "../../include/mantisbase/core/expr_evaluator.h"
 
+#include <cctype>
 #include <iostream>
+#include <optional>
+#include <vector>
 #include <nlohmann/json.hpp>
 #include <mbs/script.hpp>
 
@@ -10,4 +13,327 @@ namespace mb {
         const auto res = mbs::eval_true(expr, vars);
         return res.value && res.ok;
     }
+
+    struct CompiledExpr::Node {
+        enum class Kind { Literal, Path, Not, And, Or, Cmp };
+
+        Kind kind;
+        nlohmann::json literal;
+        std::vector<std::string> path;
+        std::string op;
+        std::unique_ptr<Node> lhs, rhs;
+    };
+
+    namespace {
+        using Node = CompiledExpr::Node;
+
+        /// Native evaluation result; Undecided defers to the script engine.
+        enum class Tri { False, True, Undecided };
+
+        struct Tok {
+            enum class Type { Path, Literal, Op, LParen, RParen, End } type;
+            std::string text;
+            nlohmann::json value;
+            std::vector<std::string> path;
+        };
+
+        bool isIdentStart(const char c) { return std::isalpha(static_cast<unsigned char>(c)) || c == '_'; }
+        bool isIdentChar(const char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; }
+
+        std::optional<std::vector<Tok>> tokenize(const std::string &src) {
+            std::vector<Tok> toks;
+            std::size_t i = 0;
+            const auto n = src.size();
+
+            while (i < n) {
+                const char c = src[i];
+                if (std::isspace(static_cast<unsigned char>(c))) { ++i; continue; }
+
+                if (c == '(') { toks.push_back({Tok::Type::LParen, "("}); ++i; continue; }
+                if (c == ')') { toks.push_back({Tok::Type::RParen, ")"}); ++i; continue; }
+
+                if (c == '@') {
+                    Tok t{Tok::Type::Path};
+                    ++i;
+                    while (true) {
+                        if (i >= n || !isIdentStart(src[i])) return std::nullopt;
+                        const auto start = i;
+                        while (i < n && isIdentChar(src[i])) ++i;
+                        t.path.push_back(src.substr(start, i - start));
+                        if (i < n && src[i] == '.') { ++i; continue; }
+                        break;
+                    }
+                    toks.push_back(std::move(t));
+                    continue;
+                }
+
+                if (c == '\'' || c == '"') {
+                    std::string val;
+                    ++i;
+                    bool closed = false;
+                    while (i < n) {
+                        if (src[i] == '\\') return std::nullopt; // leave escapes to the engine
+                        if (src[i] == c) { closed = true; ++i; break; }
+                        val.push_back(src[i++]);
+                    }
+                    if (!closed) return std::nullopt;
+                    toks.push_back({Tok::Type::Literal, "", val});
+                    continue;
+                }
+
+                if (std::isdigit(static_cast<unsigned char>(c))) {
+                    const auto start = i;
+                    bool is_float = false;
+                    while (i < n && (std::isdigit(static_cast<unsigned char>(src[i])) || src[i] == '.')) {
+                        if (src[i] == '.') {
+                            if (is_float) return std::nullopt;
+                            is_float = true;
+                        }
+                        ++i;
+                    }
+                    if (i < n && isIdentChar(src[i])) return std::nullopt;
+                    const auto text = src.substr(start, i - start);
+                    try {
+                        toks.push_back({Tok::Type::Literal, "", is_float
+                                                                    ? nlohmann::json(std::stod(text))
+                                                                    : nlohmann::json(std::stoll(text))});
+                    } catch (...) {
+                        return std::nullopt;
+                    }
+                    continue;
+                }
+
+                if (isIdentStart(c)) {
+                    const auto start = i;
+                    while (i < n && isIdentChar(src[i])) ++i;
+                    const auto word = src.substr(start, i - start);
+                    if (word == "true") toks.push_back({Tok::Type::Literal, "", true});
+                    else if (word == "false") toks.push_back({Tok::Type::Literal, "", false});
+                    else if (word == "null") toks.push_back({Tok::Type::Literal, "", nullptr});
+                    else return std::nullopt; // bare identifiers/functions: engine only
+                    continue;
+                }
+
+                // Two-character operators first
+                if (i + 1 < n) {
+                    const auto two = src.substr(i, 2);
+                    if (two == "==" || two == "!=" || two == "<=" || two == ">=" || two == "&&" || two == "||") {
+                        // `===` / `!==` are left to the engine
+                        if ((two == "==" || two == "!=") && i + 2 < n && src[i + 2] == '=') return std::nullopt;
+                        toks.push_back({Tok::Type::Op, two});
+                        i += 2;
+                        continue;
+                    }
+                }
+                if (c == '<' || c == '>' || c == '!') {
+                    toks.push_back({Tok::Type::Op, std::string(1, c)});
+                    ++i;
+                    continue;
+                }
+
+                return std::nullopt;
+            }
+
+            toks.push_back({Tok::Type::End});
+            return toks;
+        }
+
+        class Parser {
+        public:
+            explicit Parser(std::vector<Tok> toks) : m_toks(std::move(toks)) {}
+
+            std::unique_ptr<Node> run() {
+                auto root = parseOr(0);
+                if (!root || peek().type != Tok::Type::End) return nullptr;
+                return root;
+            }
+
+        private:
+            static constexpr int MAX_DEPTH = 32;
+
+            const Tok &peek() const { return m_toks[m_pos]; }
+            bool peekOp(const char *op) const { return peek().type == Tok::Type::Op && peek().text == op; }
+
+            static std::unique_ptr<Node> binary(Node::Kind kind, std::unique_ptr<Node> l, std::unique_ptr<Node> r,
+                                                std::string op = {}) {
+                if (!l || !r) return nullptr;
+                auto node = std::make_unique<Node>();
+                node->kind = kind;
+                node->op = std::move(op);
+                node->lhs = std::move(l);
+                node->rhs = std::move(r);
+                return node;
+            }
+
+            std::unique_ptr<Node> parseOr(const int depth) {
+                auto lhs = parseAnd(depth);
+                while (lhs && peekOp("||")) {
+                    ++m_pos;
+                    lhs = binary(Node::Kind::Or, std::move(lhs), parseAnd(depth));
+                }
+                return lhs;
+            }
+
+            std::unique_ptr<Node> parseAnd(const int depth) {
+                auto lhs = parseUnary(depth);
+                while (lhs && peekOp("&&")) {
+                    ++m_pos;
+                    lhs = binary(Node::Kind::And, std::move(lhs), parseUnary(depth));
+                }
+                return lhs;
+            }
+
+            std::unique_ptr<Node> parseUnary(const int depth) {
+                if (depth > MAX_DEPTH) return nullptr;
+                if (peekOp("!")) {
+                    ++m_pos;
+                    auto inner = parseUnary(depth + 1);
+                    if (!inner) return nullptr;
+                    auto node = std::make_unique<Node>();
+                    node->kind = Node::Kind::Not;
+                    node->lhs = std::move(inner);
+                    return node;
+                }
+                return parseCmp(depth);
+            }
+
+            std::unique_ptr<Node> parseCmp(const int depth) {
+                auto lhs = parsePrimary(depth);
+                if (!lhs) return nullptr;
+                if (peek().type == Tok::Type::Op) {
+                    const auto op = peek().text;
+                    if (op == "==" || op == "!=" || op == "<" || op == "<=" || op == ">" || op == ">=") {
+                        ++m_pos;
+                        return binary(Node::Kind::Cmp, std::move(lhs), parsePrimary(depth), op);
+                    }
+                }
+                return lhs;
+            }
+
+            std::unique_ptr<Node> parsePrimary(const int depth) {
+                const auto &tok = peek();
+                if (tok.type == Tok::Type::LParen) {
+                    ++m_pos;
+                    auto inner = parseOr(depth + 1);
+                    if (!inner || peek().type != Tok::Type::RParen) return nullptr;
+                    ++m_pos;
+                    return inner;
+                }
+
+                auto node = std::make_unique<Node>();
+                if (tok.type == Tok::Type::Path) {
+                    node->kind = Node::Kind::Path;
+                    node->path = tok.path;
+                } else if (tok.type == Tok::Type::Literal) {
+                    node->kind = Node::Kind::Literal;
+                    node->literal = tok.value;
+                } else {
+                    return nullptr;
+                }
+                ++m_pos;
+                return node;
+            }
+
+            std::vector<Tok> m_toks;
+            std::size_t m_pos = 0;
+        };
+
+        /// Resolve a leaf to a value; nullptr when the engine must decide
+        /// (missing key, null on the way, ...).
+        const nlohmann::json *resolve(const Node &node, const nlohmann::json &vars) {
+            if (node.kind == Node::Kind::Literal) return &node.literal;
+            if (node.kind != Node::Kind::Path || !vars.is_object()) return nullptr;
+
+            const nlohmann::json *cur = &vars;
+            for (const auto &seg: node.path) {
+                if (!cur->is_object()) return nullptr;
+                const auto it = cur->find(seg);
+                if (it == cur->end()) return nullptr;
+                cur = &*it;
+            }
+            return cur->is_null() ? nullptr : cur;
+        }
+
+        Tri toTri(const bool b) { return b ? Tri::True : Tri::False; }
+
+        Tri evalCmp(const Node &node, const nlohmann::json &vars) {
+            const bool lhs_null_lit = node.lhs->kind == Node::Kind::Literal && node.lhs->literal.is_null();
+            const bool rhs_null_lit = node.rhs->kind == Node::Kind::Literal && node.rhs->literal.is_null();
+            const auto *l = lhs_null_lit ? nullptr : resolve(*node.lhs, vars);
+            const auto *r = rhs_null_lit ? nullptr : resolve(*node.rhs, vars);
+
+            // `x == null` / `x != null` on a present, non-null value
+            if (lhs_null_lit != rhs_null_lit && (node.op == "==" || node.op == "!=")) {
+                if ((lhs_null_lit ? r : l) == nullptr) return Tri::Undecided;
+                return toTri(node.op == "!=");
+            }
+
+            if (!l || !r) return Tri::Undecided;
+
+            if (node.op == "==" || node.op == "!=") {
+                const bool same_kind = (l->is_string() && r->is_string()) ||
+                                       (l->is_number() && r->is_number()) ||
+                                       (l->is_boolean() && r->is_boolean());
+                if (!same_kind) return Tri::Undecided;
+                return toTri((*l == *r) == (node.op == "=="));
+            }
+
+            if (!l->is_number() || !r->is_number()) return Tri::Undecided;
+            const auto a = l->get<double>(), b = r->get<double>();
+            if (node.op == "<") return toTri(a < b);
+            if (node.op == "<=") return toTri(a <= b);
+            if (node.op == ">") return toTri(a > b);
+            return toTri(a >= b);
+        }
+
+        Tri evalNode(const Node &node, const nlohmann::json &vars) {
+            switch (node.kind) {
+                case Node::Kind::Literal:
+                case Node::Kind::Path: {
+                    const auto *v = resolve(node, vars);
+                    if (!v || !v->is_boolean()) return Tri::Undecided;
+                    return toTri(v->get<bool>());
+                }
+                case Node::Kind::Not: {
+                    const auto inner = evalNode(*node.lhs, vars);
+                    if (inner == Tri::Undecided) return inner;
+                    return toTri(inner == Tri::False);
+                }
+                case Node::Kind::And:
+                case Node::Kind::Or: {
+                    // Both sides are evaluated so an engine-level error on either
+                    // side is never masked by short-circuiting.
+                    const auto l = evalNode(*node.lhs, vars);
+                    if (l == Tri::Undecided) return l;
+                    const auto r = evalNode(*node.rhs, vars);
+                    if (r == Tri::Undecided) return r;
+                    return node.kind == Node::Kind::And
+                               ? toTri(l == Tri::True && r == Tri::True)
+                               : toTri(l == Tri::True || r == Tri::True);
+                }
+                case Node::Kind::Cmp:
+                    return evalCmp(node, vars);
+            }
+            return Tri::Undecided;
+        }
+    }
+
+    CompiledExpr::CompiledExpr(std::string source) : m_source(std::move(source)) {}
+
+    CompiledExpr::~CompiledExpr() = default;
+
+    std::shared_ptr<const CompiledExpr> CompiledExpr::compile(const std::string &expr) {
+        std::shared_ptr<CompiledExpr> compiled(new CompiledExpr(expr));
+        if (auto toks = tokenize(expr); toks.has_value())
+            compiled->m_root = Parser(std::move(*toks)).run();
+        return compiled;
+    }
+
+    bool CompiledExpr::eval(const nlohmann::json &vars) const {
+        if (m_root) {
+            if (const auto res = evalNode(*m_root, vars); res != Tri::Undecided)
+                return res == Tri::True;
+        }
+        return Expr::eval(m_source, vars);
+    }
 } // mantis
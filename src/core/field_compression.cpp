@@ -0,0 +1,119 @@
+/**
+ * @file field_compression.cpp
+ * @brief Implementation for @see field_compression.h
+ */
+
+#include "../../include/mantisbase/core/field_compression.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/metrics.h"
+#include "../../include/mantisbase/utils/crypto_utils.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#ifdef MB_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace mb {
+    namespace {
+        std::atomic<std::uint64_t> g_values{0}, g_rawBytes{0}, g_storedBytes{0};
+
+#ifdef MB_HAVE_ZSTD
+        /// Level 3, zstd's default: most of the ratio of the higher levels at a fraction of the time
+        constexpr int kLevel = 3;
+
+        /// Per thread; a context costs more to make than most values take to compress
+        ZSTD_CCtx *compressor() {
+            thread_local const std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> ctx(ZSTD_createCCtx(),
+                                                                                         &ZSTD_freeCCtx);
+            return ctx.get();
+        }
+
+        ZSTD_DCtx *decompressor() {
+            thread_local const std::unique_ptr<ZSTD_DCtx, decltype(&ZSTD_freeDCtx)> ctx(ZSTD_createDCtx(),
+                                                                                         &ZSTD_freeDCtx);
+            return ctx.get();
+        }
+#endif
+    }
+
+    bool FieldCompression::available() {
+#ifdef MB_HAVE_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    std::string FieldCompression::deflate(std::string value) {
+#ifdef MB_HAVE_ZSTD
+        if (value.size() < MIN_BYTES) return value;
+
+        std::vector<std::uint8_t> frame(ZSTD_compressBound(value.size()));
+        const auto size = ZSTD_compressCCtx(compressor(), frame.data(), frame.size(), value.data(), value.size(),
+                                            kLevel);
+        if (ZSTD_isError(size)) return value;
+        frame.resize(size);
+
+        auto stored = std::string(PREFIX) + base64UrlEncode(frame);
+        if (stored.size() >= value.size()) return value;
+        ++g_values;
+        g_rawBytes += value.size();
+        g_storedBytes += stored.size();
+        return stored;
+#else
+        return value;
+#endif
+    }
+
+    std::string FieldCompression::inflate(std::string stored) {
+        if (!compressed(stored)) return stored;
+#ifdef MB_HAVE_ZSTD
+        std::vector<std::uint8_t> frame;
+        try {
+            frame = base64UrlDecode(stored.substr(PREFIX.size()));
+        } catch (const std::exception &e) {
+            throw MantisException(500, "A compressed field value is corrupt.", e.what());
+        }
+
+        const auto size = ZSTD_getFrameContentSize(frame.data(), frame.size());
+        if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN)
+            throw MantisException(500, "A compressed field value is corrupt.");
+        std::string value(size, '\0');
+        const auto got = ZSTD_decompressDCtx(decompressor(), value.data(), value.size(), frame.data(), frame.size());
+        if (ZSTD_isError(got) || got != size)
+            throw MantisException(500, "A compressed field value is corrupt.",
+                                  ZSTD_isError(got) ? ZSTD_getErrorName(got) : "short frame");
+        return value;
+#else
+        throw MantisException(500, "A field value is zstd-compressed, and this build has no zstd.");
+#endif
+    }
+
+    void FieldCompression::inflateMembers(nlohmann::json &row) {
+        if (!row.is_object()) return;
+        for (auto &value: row) {
+            if (!value.is_string() || !compressed(value.get_ref<const std::string &>())) continue;
+            try {
+                value = inflate(value.get<std::string>());
+            } catch (const MantisException &) {
+                // Left as stored; the change still goes out
+            }
+        }
+    }
+
+    void FieldCompression::writeMetrics(MetricsWriter &out) {
+        out.family("mb_field_compression_values_total", "Field values stored compressed", "counter");
+        out.sample("mb_field_compression_values_total", {},
+                   static_cast<double>(g_values.load(std::memory_order_relaxed)));
+        out.family("mb_field_compression_bytes_total", "Bytes of the field values stored compressed", "counter");
+        out.sample("mb_field_compression_bytes_total", {{"form", "raw"}},
+                   static_cast<double>(g_rawBytes.load(std::memory_order_relaxed)));
+        out.sample("mb_field_compression_bytes_total", {{"form", "stored"}},
+                   static_cast<double>(g_storedBytes.load(std::memory_order_relaxed)));
+    }
+}
@@ -0,0 +1,249 @@
+/**
+ * @file file_cleanup.cpp
+ * @brief Implementation for @see file_cleanup.h
+ */
+
+#include "../../include/mantisbase/core/file_cleanup.h"
+#include "../../include/mantisbase/core/database.h"
+#include "../../include/mantisbase/core/files.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/core/models/entity_archive.h"
+#include "../../include/mantisbase/core/models/entity_schema.h"
+#include "../../include/mantisbase/core/tracing.h"
+#include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <format>
+#include <utility>
+
+namespace mb {
+    namespace fs = std::filesystem;
+
+    FileCleanup::Options FileCleanup::Options::fromEnv() {
+        Options options;
+        if (const auto batch = safe_stoi(getEnvOrDefault("MB_FILE_DELETE_BATCH", ""), 0); batch > 0)
+            options.batch = static_cast<std::size_t>(batch);
+        if (const auto secs = safe_stoi(getEnvOrDefault("MB_FILE_SWEEP_INTERVAL", ""), -1); secs >= 0) {
+            // Shorter than an upload can take and the grace sweep stops being one
+            options.sweepInterval = std::chrono::seconds(secs == 0 ? 0 : std::max(secs, 60));
+        }
+        return options;
+    }
+
+    FileCleanup::FileCleanup(const Options options) : m_options(options) {}
+
+    FileCleanup::~FileCleanup() {
+        stop();
+    }
+
+    void FileCleanup::start() {
+        std::lock_guard lock(m_mutex);
+        if (m_thread.joinable()) return;
+        m_stopping = false;
+        m_wake = true; // Leftovers from the last run go first
+        m_thread = std::thread(&FileCleanup::loop, this);
+    }
+
+    void FileCleanup::stop() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+    void FileCleanup::enqueue(soci::session &sql, const std::string &entity_name,
+                              const std::vector<std::string> &files) {
+        if (files.empty()) return;
+        const auto now = getCurrentTimestampUTC();
+        for (const auto &filename: files) {
+            if (filename.empty()) continue;
+            int queued = 0;
+            sql << "SELECT 1 FROM mb_file_deletions WHERE entity_name = :e AND filename = :f",
+                    soci::use(entity_name), soci::use(filename), soci::into(queued);
+            if (sql.got_data()) continue;
+            sql << "INSERT INTO mb_file_deletions (entity_name, filename, queued) VALUES (:e, :f, :q)",
+                    soci::use(entity_name), soci::use(filename), soci::use(now);
+        }
+    }
+
+    void FileCleanup::notify() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_wake = true;
+        }
+        m_cv.notify_one();
+    }
+
+    std::size_t FileCleanup::drain() {
+        const auto &db = MantisBase::instance().db();
+
+        std::vector<std::pair<std::string, std::string>> batch;
+        {
+            const auto sql = db.session();
+            const soci::rowset<soci::row> rows = (sql->prepare << std::format(
+                "SELECT entity_name, filename FROM mb_file_deletions ORDER BY queued LIMIT {}", m_options.batch));
+            for (const auto &row: rows)
+                batch.emplace_back(row.get<std::string>(0), row.get<std::string>(1));
+        }
+        if (batch.empty()) return 0;
+
+        const Tracer::Span span("file.cleanup.drain");
+        for (const auto &[entity_name, filename]: batch) {
+            // Logs its own failures; whatever it leaves on disk goes to the sweep
+            [[maybe_unused]] auto _ = Files::removeFile(entity_name, filename);
+        }
+
+        // Per row, not by range: a write that committed late may sit between the ones we took
+        db.write([&](soci::session &sql) {
+            for (const auto &[entity_name, filename]: batch) {
+                sql << "DELETE FROM mb_file_deletions WHERE entity_name = :e AND filename = :f",
+                        soci::use(entity_name), soci::use(filename);
+            }
+        });
+
+        m_removed += batch.size();
+        return batch.size();
+    }
+
+    std::size_t FileCleanup::sweep() {
+        const Tracer::Span span("file.cleanup.sweep");
+
+        // Entities and the columns naming their files
+        std::vector<std::pair<std::string, std::vector<FileColumn>>> entities;
+        {
+            const auto sql = MantisBase::instance().db().session();
+            const soci::rowset<soci::row> rows = (sql->prepare << "SELECT schema FROM mb_tables");
+            for (const auto &row: rows) {
+                const auto schema = row.get<nlohmann::json>("schema");
+                if (schema.value("type", "") == "view") continue;
+
+                std::vector<FileColumn> columns;
+                for (const auto &field: schema.value("fields", json::array())) {
+                    const auto type = field.value("type", "");
+                    if (type == "file" || type == "files") columns.push_back({field.value("name", ""), type == "files"});
+                }
+                entities.emplace_back(schema.value("name", ""), std::move(columns));
+            }
+        }
+
+        std::unordered_set<std::string> suspects;
+        std::vector<std::pair<std::string, std::string>> orphans;
+        for (const auto &[entity_name, columns]: entities) {
+            if (!EntitySchema::isValidEntityName(entity_name)) continue;
+            try {
+                for (auto &key: unreferenced(entity_name, columns)) {
+                    if (m_suspects.contains(key)) {
+                        orphans.emplace_back(entity_name, key.substr(entity_name.size() + 1));
+                    } else {
+                        suspects.insert(std::move(key));
+                    }
+                }
+            } catch (const std::exception &e) {
+                LogOrigin::warn("File Cleanup", fmt::format("Skipping `{}` in the orphan sweep: {}", entity_name,
+                                                            e.what()));
+            }
+        }
+        m_suspects = std::move(suspects);
+
+        if (orphans.empty()) return 0;
+        MantisBase::instance().db().write([&](soci::session &sql) {
+            for (const auto &[entity_name, filename]: orphans) enqueue(sql, entity_name, {filename});
+        });
+        LogOrigin::info("File Cleanup", fmt::format("Queued {} orphaned file(s) for removal.", orphans.size()));
+        notify();
+        return orphans.size();
+    }
+
+    std::vector<std::string> FileCleanup::unreferenced(const std::string &entity_name,
+                                                       const std::vector<FileColumn> &columns) {
+        const auto sql = MantisBase::instance().db().session();
+
+        // Every file name a record holds
+        std::unordered_set<std::string> referenced;
+        if (!columns.empty()) {
+            std::string select;
+            for (const auto &column: columns)
+                select += (select.empty() ? "" : ", ") + sqlIdentifier(column.name);
+            // Archived records keep their files, see EntityArchive
+            const auto table = sqlIdentifier(entity_name), archive = ArchivePolicy::tableOf(table);
+            const auto from = EntityArchive::columns(*sql, archive).empty()
+                                  ? table
+                                  : std::format("(SELECT {0} FROM {1} UNION ALL SELECT {0} FROM {2}) AS t", select,
+                                                table, archive);
+            const soci::rowset<soci::row> rows = (sql->prepare << std::format("SELECT {} FROM {}", select, from));
+            for (const auto &row: rows) {
+                for (std::size_t i = 0; i < columns.size(); ++i) {
+                    if (row.get_indicator(i) == soci::i_null) continue;
+                    const auto value = row.get<std::string>(i);
+                    if (!columns[i].many) {
+                        referenced.insert(value);
+                        continue;
+                    }
+                    const auto list = json::parse(value, nullptr, false);
+                    if (!list.is_array()) continue;
+                    for (const auto &file: list)
+                        if (file.is_string()) referenced.insert(file.get<std::string>());
+                }
+            }
+        }
+
+        // Every file the entity holds: on disk, and in the blob store for remote backends
+        std::unordered_set<std::string> held;
+        std::error_code ec;
+        if (const fs::path dir = Files::dirPath(entity_name); fs::is_directory(dir, ec)) {
+            for (const auto &entry: fs::directory_iterator(dir, ec)) {
+                const auto name = entry.path().filename().string();
+                // Sidecars, thumbnails and other bookkeeping start with a dot
+                if (!name.starts_with('.') && entry.is_regular_file(ec)) held.insert(name);
+            }
+        }
+        const soci::rowset<std::string> refs = (sql->prepare
+            << "SELECT filename FROM mb_file_refs WHERE entity_name = :e", soci::use(entity_name));
+        for (const auto &filename: refs) held.insert(filename);
+
+        std::vector<std::string> result;
+        for (const auto &filename: held) {
+            if (!referenced.contains(filename)) result.push_back(entity_name + "/" + filename);
+        }
+        return result;
+    }
+
+    std::size_t FileCleanup::pending() const {
+        const auto sql = MantisBase::instance().db().session();
+        long long count = 0;
+        *sql << "SELECT COUNT(*) FROM mb_file_deletions", soci::into(count);
+        return static_cast<std::size_t>(count);
+    }
+
+    void FileCleanup::loop() {
+        auto next_sweep = std::chrono::steady_clock::now() + m_options.sweepInterval;
+        std::unique_lock lock(m_mutex);
+        while (!m_stopping) {
+            m_wake = false;
+            lock.unlock();
+
+            try {
+                // A full batch means there may be more
+                while (drain() == m_options.batch) {
+                    std::lock_guard check(m_mutex);
+                    if (m_stopping) break;
+                }
+
+                if (m_options.sweepInterval.count() > 0 && std::chrono::steady_clock::now() >= next_sweep) {
+                    sweep();
+                    next_sweep = std::chrono::steady_clock::now() + m_options.sweepInterval;
+                }
+            } catch (const std::exception &e) {
+                LogOrigin::warn("File Cleanup", fmt::format("File cleanup failed, retrying later: {}", e.what()));
+            }
+
+            lock.lock();
+            auto until = std::chrono::steady_clock::now() + m_options.poll;
+            if (m_options.sweepInterval.count() > 0) until = std::min(until, next_sweep);
+            m_cv.wait_until(lock, until, [this] { return m_stopping || m_wake; });
+        }
+    }
+}
@@ -0,0 +1,409 @@
+/**
+ * @file file_io.cpp
+ * @brief Implementation for @see file_io.h
+ */
+
+#include "../../include/mantisbase/core/file_io.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/metrics.h"
+#include "../../include/mantisbase/core/worker_pool.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef MB_IO_URING_ENABLED
+#include <liburing.h>
+#include <thread>
+#endif
+
+namespace mb {
+    namespace {
+        /// Chunks of one writer are merged up to this size before a write is submitted
+        constexpr std::size_t COALESCE = 256 * 1024;
+
+        long writeAt(const int fd, const std::uint64_t offset, const char *data, const std::size_t size) {
+#ifdef _WIN32
+            // A writer has one write in flight at a time, so seeking first is safe
+            if (_lseeki64(fd, static_cast<__int64>(offset), SEEK_SET) < 0) return -errno;
+            const auto n = _write(fd, data, static_cast<unsigned>(size));
+#else
+            const auto n = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+#endif
+            return n < 0 ? -errno : static_cast<long>(n);
+        }
+
+        long unlinkNow(const std::string &path) {
+            return ::remove(path.c_str()) == 0 ? 0 : -errno;
+        }
+
+        int closeFd(const int fd) {
+#ifdef _WIN32
+            return _close(fd);
+#else
+            return ::close(fd);
+#endif
+        }
+    }
+
+    class FileIo::Engine {
+    public:
+        virtual ~Engine() = default;
+        virtual void write(int fd, std::uint64_t offset, const char *data, std::size_t size, Completion done) = 0;
+        virtual void unlink(const std::string &path, Completion done) = 0;
+        virtual void stop() = 0;
+        [[nodiscard]] virtual const char *name() const = 0;
+    };
+
+    namespace {
+        /// Blocking calls on threads of its own; inline once stopped
+        class ThreadEngine final : public FileIo::Engine {
+        public:
+            explicit ThreadEngine(const std::size_t threads) : m_pool("file-io") { m_pool.start(threads); }
+
+            void write(const int fd, const std::uint64_t offset, const char *data, const std::size_t size,
+                       std::function<void(long)> done) override {
+                if (m_pool.submit([=] { done(writeAt(fd, offset, data, size)); })) return;
+                done(writeAt(fd, offset, data, size));
+            }
+
+            void unlink(const std::string &path, std::function<void(long)> done) override {
+                if (m_pool.submit([path, done] { done(unlinkNow(path)); })) return;
+                done(unlinkNow(path));
+            }
+
+            void stop() override { m_pool.stop(); }
+
+            [[nodiscard]] const char *name() const override { return "threads"; }
+
+        private:
+            WorkerPool m_pool;
+        };
+
+#ifdef MB_IO_URING_ENABLED
+        /// Submitted to the kernel; one thread reaps completions and runs their callbacks
+        class UringEngine final : public FileIo::Engine {
+        public:
+            /// @throws std::system_error if the ring can't be set up (old kernel, seccomp)
+            explicit UringEngine(const unsigned depth) {
+                if (const int rc = io_uring_queue_init(depth, &m_ring, 0); rc < 0)
+                    throw std::system_error(-rc, std::generic_category(), "io_uring_queue_init");
+                m_reaper = std::thread([this] { reap(); });
+            }
+
+            ~UringEngine() override { stop(); }
+
+            void write(const int fd, const std::uint64_t offset, const char *data, const std::size_t size,
+                       std::function<void(long)> done) override {
+                auto *op = new Op{std::move(done), {}};
+                if (!submit(op, [&](io_uring_sqe *sqe) { io_uring_prep_write(sqe, fd, data, size, offset); })) {
+                    const auto result = writeAt(fd, offset, data, size);
+                    std::unique_ptr<Op>(op)->done(result);
+                }
+            }
+
+            void unlink(const std::string &path, std::function<void(long)> done) override {
+                // The path has to outlive the submission
+                auto *op = new Op{std::move(done), path};
+                if (!submit(op, [&](io_uring_sqe *sqe) {
+                    io_uring_prep_unlinkat(sqe, AT_FDCWD, op->path.c_str(), 0);
+                })) {
+                    const auto result = unlinkNow(op->path);
+                    std::unique_ptr<Op>(op)->done(result);
+                }
+            }
+
+            void stop() override {
+                {
+                    std::lock_guard lock(m_mutex);
+                    if (m_stopped) return;
+                    m_stopped = true;
+                    // Reaped after everything submitted before it; tells the reaper to quit
+                    io_uring_sqe *sqe;
+                    while (!(sqe = io_uring_get_sqe(&m_ring))) io_uring_submit(&m_ring);
+                    io_uring_prep_nop(sqe);
+                    io_uring_sqe_set_data(sqe, nullptr);
+                    io_uring_submit(&m_ring);
+                }
+                if (m_reaper.joinable()) m_reaper.join();
+                io_uring_queue_exit(&m_ring);
+            }
+
+            [[nodiscard]] const char *name() const override { return "io_uring"; }
+
+        private:
+            struct Op {
+                std::function<void(long)> done;
+                std::string path;
+            };
+
+            /// Whether `op` went to the ring; if not, the caller runs it inline
+            template<typename Prep>
+            bool submit(Op *op, Prep prep) {
+                std::lock_guard lock(m_mutex);
+                if (m_stopped) return false;
+                auto *sqe = io_uring_get_sqe(&m_ring);
+                if (!sqe) {
+                    // Full: hand what's queued to the kernel and try once more
+                    io_uring_submit(&m_ring);
+                    sqe = io_uring_get_sqe(&m_ring);
+                }
+                if (!sqe) return false;
+                prep(sqe);
+                io_uring_sqe_set_data(sqe, op);
+                ++m_inFlight;
+                // On failure the entry stays queued and goes with the next submit
+                io_uring_submit(&m_ring);
+                return true;
+            }
+
+            void reap() {
+                bool quitting = false;
+                while (true) {
+                    io_uring_cqe *cqe = nullptr;
+                    if (const int rc = io_uring_wait_cqe(&m_ring, &cqe); rc < 0) {
+                        if (rc == -EINTR) continue;
+                        LogOrigin::warn("File IO", std::format("Reaping io_uring completions failed: {}",
+                                                               std::strerror(-rc)));
+                        break;
+                    }
+                    auto *op = static_cast<Op *>(io_uring_cqe_get_data(cqe));
+                    const long result = cqe->res;
+                    io_uring_cqe_seen(&m_ring, cqe);
+
+                    if (!op) {
+                        quitting = true;
+                    } else {
+                        std::unique_ptr<Op>(op)->done(result);
+                        std::lock_guard lock(m_mutex);
+                        --m_inFlight;
+                    }
+                    if (quitting) {
+                        std::lock_guard lock(m_mutex);
+                        if (m_inFlight == 0) break;
+                    }
+                }
+            }
+
+            io_uring m_ring{};
+            std::mutex m_mutex;   ///> The submission queue isn't thread-safe
+            bool m_stopped = false;
+            std::size_t m_inFlight = 0;
+            std::thread m_reaper;
+        };
+#endif
+    }
+
+    FileIo::Options FileIo::Options::fromEnv() {
+        Options options;
+        options.enabled = getEnvOrDefault("MB_FILE_IO", "1") != "0";
+        options.uring = getEnvOrDefault("MB_FILE_IO_URING", "1") != "0";
+        if (const auto threads = safe_stoi(getEnvOrDefault("MB_FILE_IO_THREADS", ""), -1); threads > 0)
+            options.threads = static_cast<std::size_t>(threads);
+        if (const auto mib = safe_stoi(getEnvOrDefault("MB_FILE_IO_PENDING_MB", ""), -1); mib > 0)
+            options.maxPending = static_cast<std::size_t>(mib) * 1024 * 1024;
+        return options;
+    }
+
+    FileIo::FileIo(const Options options) : m_options(options) {}
+
+    FileIo::~FileIo() {
+        stop();
+    }
+
+    void FileIo::start() {
+        std::lock_guard lock(m_mutex);
+        if (!m_options.enabled || m_engine) return;
+#ifdef MB_IO_URING_ENABLED
+        if (m_options.uring) {
+            try {
+                m_engine = std::make_shared<UringEngine>(m_options.queueDepth);
+            } catch (const std::exception &e) {
+                LogOrigin::warn("File IO", std::format("io_uring is unavailable, using threads: {}", e.what()));
+            }
+        }
+#endif
+        if (!m_engine) m_engine = std::make_shared<ThreadEngine>(m_options.threads);
+        LogOrigin::info("File IO", std::format("Upload writes and unlinks go through {}", m_engine->name()));
+    }
+
+    void FileIo::stop() {
+        std::shared_ptr<Engine> engine;
+        {
+            std::lock_guard lock(m_mutex);
+            engine = std::move(m_engine);
+        }
+        // Callers still holding it get their operations run inline
+        if (engine) engine->stop();
+    }
+
+    bool FileIo::running() const {
+        return engine() != nullptr;
+    }
+
+    const char *FileIo::engineName() const {
+        const auto current = engine();
+        return current ? current->name() : "inline";
+    }
+
+    std::shared_ptr<FileIo::Engine> FileIo::engine() const {
+        std::lock_guard lock(m_mutex);
+        return m_engine;
+    }
+
+    std::shared_ptr<FileIo::Writer> FileIo::open(const std::filesystem::path &path) {
+#ifdef _WIN32
+        const int fd = _wopen(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+#endif
+        if (fd < 0)
+            throw MantisException(500, std::format("Failed to open `{}` for writing: {}", path.string(),
+                                                   std::strerror(errno)));
+        return std::make_shared<Writer>(*this, fd, path);
+    }
+
+    void FileIo::remove(std::vector<std::string> paths) {
+        const auto current = engine();
+        for (auto &path: paths) {
+            auto done = [this, path](const long result) {
+                m_unlinks.fetch_add(1, std::memory_order_relaxed);
+                if (result >= 0 || result == -ENOENT) return;
+                m_errors.fetch_add(1, std::memory_order_relaxed);
+                LogOrigin::warn("File IO", std::format("Failed to remove `{}`: {}", path,
+                                                       std::strerror(static_cast<int>(-result))));
+            };
+            if (current) current->unlink(path, std::move(done));
+            else done(unlinkNow(path));
+        }
+    }
+
+    void FileIo::writeMetrics(MetricsWriter &out) const {
+        out.family("mb_file_io_writes_total", "Upload writes handed to the file IO engine", "counter");
+        out.sample("mb_file_io_writes_total", {{"engine", engineName()}},
+                   static_cast<double>(m_writes.load(std::memory_order_relaxed)));
+        out.family("mb_file_io_bytes_total", "Bytes those writes put on disk", "counter");
+        out.sample("mb_file_io_bytes_total", {}, static_cast<double>(m_bytes.load(std::memory_order_relaxed)));
+        out.family("mb_file_io_unlinks_total", "Staged files removed in the background", "counter");
+        out.sample("mb_file_io_unlinks_total", {}, static_cast<double>(m_unlinks.load(std::memory_order_relaxed)));
+        out.family("mb_file_io_errors_total", "Writes and unlinks that failed", "counter");
+        out.sample("mb_file_io_errors_total", {}, static_cast<double>(m_errors.load(std::memory_order_relaxed)));
+    }
+
+    FileIo::Writer::Writer(FileIo &io, const int fd, std::filesystem::path path)
+        : m_io(io), m_fd(fd), m_path(std::move(path)) {}
+
+    FileIo::Writer::~Writer() {
+        // Dropped without close(); nothing is in flight, or it would hold a reference
+        if (m_fd >= 0) closeFd(m_fd);
+    }
+
+    void FileIo::Writer::write(const char *data, const std::size_t size) {
+        if (size == 0) return;
+        std::shared_ptr<std::string> chunk;
+        {
+            std::unique_lock lock(m_mutex);
+            if (m_error || m_closing) return;
+            if (!m_queue.empty() && m_queue.back()->size() + size <= COALESCE) m_queue.back()->append(data, size);
+            else m_queue.push_back(std::make_shared<std::string>(data, size));
+            m_pending += size;
+            chunk = take();
+        }
+        if (chunk) submit(std::move(chunk), 0);
+
+        // Past the budget the caller waits for the disk, as it did before
+        std::unique_lock lock(m_mutex);
+        m_drained.wait(lock, [this] { return m_pending <= m_io.m_options.maxPending || m_error; });
+    }
+
+    std::shared_ptr<std::string> FileIo::Writer::take() {
+        if (m_inFlight || m_queue.empty()) return nullptr;
+        auto chunk = std::move(m_queue.front());
+        m_queue.pop_front();
+        m_inFlight = true;
+        return chunk;
+    }
+
+    void FileIo::Writer::submit(std::shared_ptr<std::string> chunk, const std::size_t from) {
+        m_io.m_writes.fetch_add(1, std::memory_order_relaxed);
+        const auto engine = m_io.engine();
+        const auto offset = m_offset;
+        const auto *data = chunk->data() + from;
+        const auto size = chunk->size() - from;
+        if (!engine) return completed(chunk, from, writeAt(m_fd, offset, data, size));
+        engine->write(m_fd, offset, data, size, [self = shared_from_this(), chunk, from](const long result) {
+            self->completed(chunk, from, result);
+        });
+    }
+
+    void FileIo::Writer::completed(const std::shared_ptr<std::string> &chunk, const std::size_t from,
+                                   const long result) {
+        std::shared_ptr<std::string> next;
+        std::size_t next_from = 0;
+        std::function<void()> closed;
+        {
+            std::lock_guard lock(m_mutex);
+            if (result <= 0) {
+                m_error = std::error_code(result < 0 ? static_cast<int>(-result) : EIO, std::generic_category());
+                m_io.m_errors.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                m_offset += static_cast<std::uint64_t>(result);
+                m_io.m_bytes.fetch_add(static_cast<std::uint64_t>(result), std::memory_order_relaxed);
+            }
+
+            if (!m_error && from + static_cast<std::size_t>(result) < chunk->size()) {
+                // A short write: the rest of the chunk goes next, still in order
+                next = chunk;
+                next_from = from + static_cast<std::size_t>(result);
+            } else {
+                m_pending -= chunk->size();
+                m_inFlight = false;
+                if (m_error) {
+                    m_queue.clear();
+                    m_pending = 0;
+                }
+                next = take();
+                if (!next && m_closing) closed = finishClose();
+            }
+        }
+        m_drained.notify_all();
+        if (next) submit(std::move(next), next_from);
+        if (closed) closed();
+    }
+
+    void FileIo::Writer::close(std::function<void(std::error_code)> done) {
+        std::function<void()> closed;
+        {
+            std::lock_guard lock(m_mutex);
+            if (m_closing) return;
+            m_closing = true;
+            m_onClosed = std::move(done);
+            if (!m_inFlight) closed = finishClose();
+        }
+        if (closed) closed();
+    }
+
+    std::function<void()> FileIo::Writer::finishClose() {
+        if (closeFd(m_fd) != 0 && !m_error) m_error = std::error_code(errno, std::generic_category());
+        m_fd = -1;
+        return [done = std::move(m_onClosed), error = m_error] {
+            if (done) done(error);
+        };
+    }
+
+    std::error_code FileIo::Writer::error() const {
+        std::lock_guard lock(m_mutex);
+        return m_error;
+    }
+}
@@ -0,0 +1,158 @@
+/**
+ * @file file_serving.cpp
+ * @brief Implementation for @see file_serving.h
+ */
+
+#include "../../include/mantisbase/core/file_serving.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+
+namespace mb {
+    namespace {
+        std::string_view trimView(std::string_view s) {
+            constexpr std::string_view ws = " \t";
+            const auto first = s.find_first_not_of(ws);
+            if (first == std::string_view::npos) return {};
+            return s.substr(first, s.find_last_not_of(ws) - first + 1);
+        }
+
+        bool parseSize(const std::string_view s, std::size_t &out) {
+            if (s.empty()) return false;
+            unsigned long long value = 0;
+            const auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+            if (ec != std::errc{} || end != s.data() + s.size()) return false;
+            out = static_cast<std::size_t>(value);
+            return true;
+        }
+
+        std::string_view opaqueTag(std::string_view tag) {
+            if (tag.starts_with("W/")) tag.remove_prefix(2);
+            return tag;
+        }
+    }
+
+    FileServing::CachePolicy FileServing::CachePolicy::parse(const std::string_view spec) {
+        CachePolicy policy;
+        std::size_t start = 0;
+        while (start <= spec.size()) {
+            auto end = spec.find(';', start);
+            if (end == std::string_view::npos) end = spec.size();
+            const auto entry = spec.substr(start, end - start);
+            start = end + 1;
+
+            const auto eq = entry.find('=');
+            if (eq == std::string_view::npos) continue;
+            const auto entity = trimView(entry.substr(0, eq));
+            const auto value = trimView(entry.substr(eq + 1));
+            if (entity.empty() || value.empty()) continue;
+
+            if (entity == "*") policy.fallback = std::string(value);
+            else policy.entities[std::string(entity)] = std::string(value);
+        }
+        return policy;
+    }
+
+    FileServing::CachePolicy FileServing::CachePolicy::fromEnv() {
+        return parse(getEnvOrDefault("MB_FILES_CACHE_CONTROL", ""));
+    }
+
+    const std::string &FileServing::CachePolicy::forEntity(const std::string &entity) const {
+        const auto it = entities.find(entity);
+        return it == entities.end() ? fallback : it->second;
+    }
+
+    FileServing::Range FileServing::parseRange(std::string_view header, const std::size_t size) {
+        Range full{Range::Full, 0, size};
+        header = trimView(header);
+        if (!header.starts_with("bytes=")) return full;
+        header.remove_prefix(6);
+        if (header.find(',') != std::string_view::npos) return full;
+
+        const auto dash = header.find('-');
+        if (dash == std::string_view::npos) return full;
+        const auto first = trimView(header.substr(0, dash));
+        const auto last = trimView(header.substr(dash + 1));
+
+        std::size_t a = 0, b = 0;
+        if (first.empty()) {
+            // Suffix range: the final `b` bytes
+            if (!parseSize(last, b)) return full;
+            if (b == 0 || size == 0) return {Range::Unsatisfiable};
+            if (b >= size) return full;
+            return {Range::Partial, size - b, b};
+        }
+
+        if (!parseSize(first, a)) return full;
+        if (last.empty()) b = size == 0 ? 0 : size - 1;
+        else if (!parseSize(last, b) || b < a) return full;
+
+        if (a >= size) return {Range::Unsatisfiable};
+        b = std::min(b, size - 1);
+        if (a == 0 && b == size - 1) return full;
+        return {Range::Partial, a, b - a + 1};
+    }
+
+    std::string FileServing::etag(const std::string_view sha256) {
+        std::string tag;
+        tag.reserve(sha256.size() + 2);
+        tag.push_back('"');
+        tag.append(sha256);
+        tag.push_back('"');
+        return tag;
+    }
+
+    bool FileServing::ifNoneMatch(const std::string_view header, const std::string_view etag) {
+        if (trimView(header) == "*") return true;
+
+        std::size_t start = 0;
+        while (start < header.size()) {
+            auto end = header.find(',', start);
+            if (end == std::string_view::npos) end = header.size();
+            if (opaqueTag(trimView(header.substr(start, end - start))) == opaqueTag(etag))
+                return true;
+            start = end + 1;
+        }
+        return false;
+    }
+
+    bool FileServing::isNotModified(const std::string_view if_none_match, const std::int64_t if_modified_since,
+                                    const std::string_view etag, const std::int64_t last_modified) {
+        if (!trimView(if_none_match).empty())
+            return ifNoneMatch(if_none_match, etag);
+        return if_modified_since >= 0 && last_modified <= if_modified_since;
+    }
+
+    bool FileServing::ifRangeAllows(std::string_view header, const std::string_view etag,
+                                    const std::string_view last_modified_http) {
+        header = trimView(header);
+        if (header.empty()) return true;
+        if (header.starts_with("W/")) return false;
+        if (header.starts_with('"')) return header == etag;
+        return header == last_modified_http;
+    }
+
+    bool FileServing::isFingerprinted(std::string_view filename) {
+        if (const auto slash = filename.rfind('/'); slash != std::string_view::npos)
+            filename.remove_prefix(slash + 1);
+        const auto ext = filename.rfind('.');
+        if (ext == std::string_view::npos) return false;
+        const auto stem = filename.substr(0, ext);
+
+        // The hash is the last `-` or `.` separated part: `name-<hash>.js`, `name.<hash>.css`
+        const auto sep = stem.find_last_of("-.");
+        if (sep == std::string_view::npos) return false;
+        const auto hash = stem.substr(sep + 1);
+        if (hash.size() < 8) return false;
+
+        bool has_digit = false;
+        for (const char c: hash) {
+            if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_') return false;
+            has_digit |= std::isdigit(static_cast<unsigned char>(c)) != 0;
+        }
+        // A plain word like `-settings` isn't a hash
+        return has_digit;
+    }
+}
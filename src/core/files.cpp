@@ -4,8 +4,12 @@
  */
 
 #include "../../include/mantisbase/core/files.h"
+#include "../../include/mantisbase/core/blob_store.h"
 #include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/core/tracing.h"
+#include "../../include/mantisbase/core/thumbnails.h"
 #include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/utils/crypto_utils.h"
 
 #include <fstream>
 #include <filesystem>
@@ -13,6 +17,23 @@
 namespace mb {
     namespace fs = std::filesystem;
 
+    namespace {
+        fs::path hashSidecar(const fs::path &file) {
+            return file.parent_path() / ("." + file.filename().string() + ".sha256");
+        }
+
+        // Size and mtime the hash was taken at, so a replaced file is noticed
+        std::string fileStamp(const fs::path &file) {
+            return std::format("{} {}", fs::file_size(file),
+                               static_cast<long long>(fs::last_write_time(file).time_since_epoch().count()));
+        }
+
+        void writeSidecar(const fs::path &file, const std::string &sha256) {
+            std::ofstream out(hashSidecar(file), std::ios::trunc);
+            out << sha256 << ' ' << fileStamp(file) << '\n';
+        }
+    }
+
     void Files::createDir(const std::string &entity_name) {
         if (!EntitySchema::isValidEntityName(entity_name)) {
             throw MantisException(500, "Invalid Entity Name",
@@ -52,10 +73,19 @@ namespace mb {
 
         else
             createDir(new_entity_name);
+
+        BlobStore::renameEntity(old_entity_name, new_entity_name);
     }
 
     void Files::deleteDir(const std::string &entity_name) {
         LogOrigin::trace("Directory Deletion", fmt::format("Dropping dir files/{}/* started.", entity_name));
+        try {
+            BlobStore::releaseEntity(entity_name);
+        } catch (const std::exception &e) {
+            // Leaves blobs behind, but never removes one still in use
+            LogOrigin::warn("Blob Release Error", fmt::format("Error releasing blobs of `files/{}`: {}", entity_name,
+                                                              e.what()));
+        }
         fs::remove_all(dirPath(entity_name));
         LogOrigin::trace("Directory Deletion", fmt::format("Dropping dir files/{}/* completed.", entity_name));
     }
@@ -117,14 +147,31 @@ namespace mb {
     }
 
     bool Files::removeFile(const std::string &entity_name, const std::string &filename) {
+        const Tracer::Span span("file.remove");
         try {
+            // Drop its reference first; the blob goes once nothing else points at it
+            bool tracked = false;
+            try {
+                tracked = BlobStore::release(entity_name, filename).has_value();
+            } catch (const std::exception &e) {
+                // A leaked reference only keeps the blob around
+                LogOrigin::warn("Blob Release Error", fmt::format("Error releasing `files/{}/{}`: {}", entity_name,
+                                                                  filename, e.what()));
+            }
+
             // Remove the file, only if it exists
             if (const auto path = filePath(entity_name, filename); fs::exists(path)) {
-                LogOrigin::trace("File Removal", fmt::format("Removing file at `<data dir>/{}/{}`", entity_name, filename));
+                MB_LOG_TRACE(LogOrigin::trace, "File Removal", fmt::format("Removing file at `<data dir>/{}/{}`", entity_name, filename));
                 fs::remove(path);
+                std::error_code ec;
+                fs::remove(hashSidecar(path), ec);
+                fs::remove_all(Thumbnailer::cacheDir(entity_name, filename), ec);
                 return true;
             }
 
+            // Remote blobs have no entity file to remove
+            if (tracked) return true;
+
             LogOrigin::warn("File Missing", fmt::format("Missing file: `files/{}/{}`.", entity_name, filename));
         } catch (const std::exception &e) {
             LogOrigin::critical("File Removal Error", fmt::format("Error removing file\n\t{}", e.what()));
@@ -241,4 +288,53 @@ namespace mb {
     fs::path Files::filesBaseDir() {
         return fs::path(MantisBase::instance().dataDir()) / "files";
     }
+
+    fs::path Files::stagingDir() {
+        // Not a valid entity name, so it can't collide with an entity's directory
+        auto dir = filesBaseDir() / ".uploads";
+        if (!fs::exists(dir)) fs::create_directories(dir);
+        return dir;
+    }
+
+    std::string Files::contentHash(const std::string &entity_name, const std::string &filename) {
+        try {
+            const fs::path path = filePath(entity_name, filename);
+            const auto stamp = fileStamp(path);
+
+            if (std::ifstream in(hashSidecar(path)); in.is_open()) {
+                std::string sha256, line;
+                in >> sha256;
+                std::getline(in >> std::ws, line);
+                if (sha256.size() == 64 && line == stamp) return sha256;
+            }
+
+            const Tracer::Span span("file.hash");
+            std::ifstream file(path, std::ios::binary);
+            if (!file.is_open()) return "";
+            Sha256Hasher hasher;
+            std::string buf(64 * 1024, '\0');
+            while (file.read(buf.data(), static_cast<std::streamsize>(buf.size())) || file.gcount() > 0) {
+                hasher.update({buf.data(), static_cast<std::size_t>(file.gcount())});
+            }
+
+            auto sha256 = hasher.hexDigest();
+            writeSidecar(path, sha256);
+            return sha256;
+        } catch (const std::exception &e) {
+            LogOrigin::warn("File Hash Error", fmt::format("Error hashing `files/{}/{}`: {}", entity_name, filename,
+                                                           e.what()));
+            return "";
+        }
+    }
+
+    void Files::storeContentHash(const std::string &entity_name, const std::string &filename,
+                                 const std::string &sha256) {
+        try {
+            writeSidecar(filePath(entity_name, filename), sha256);
+        } catch (const std::exception &e) {
+            // Not fatal; contentHash() rebuilds it on the first request
+            LogOrigin::warn("File Hash Error", fmt::format("Error storing hash of `files/{}/{}`: {}", entity_name,
+                                                           filename, e.what()));
+        }
+    }
 } // mantis
@@ -2,14 +2,40 @@
 #include "../../include/mantisbase/utils/utils.h"
 #include "../../include/mantisbase/mantisbase.h"
 #include "../../include/mantisbase/core/database.h"
+#include "../../include/mantisbase/core/exceptions.h"
 #include "../../include/mantisbase/core/files.h"
 #include "../../include/mantisbase/core/http.h"
 #include "../../include/mantisbase/core/kv_store.h"
+#include "../../include/mantisbase/core/compression.h"
+#include "../../include/mantisbase/core/server_timing.h"
+#include "../../include/mantisbase/core/worker_pool.h"
+#include "../../include/mantisbase/core/middlewares.h"
+#include "../../include/mantisbase/core/request_deadline.h"
+#include "../../include/mantisbase/core/tenants.h"
 
 #include <drogon/drogon.h>
+#include <drogon/RequestStream.h>
+#include <trantor/net/EventLoop.h>
+#include <algorithm>
+#include <iterator>
+#include <optional>
 #include <regex>
 
 namespace mb {
+    namespace {
+        /// The tenant the request names, if tenants are on and it names one
+        std::shared_ptr<Tenants::Tenant> requestTenant(const MantisBase &app, const MantisRequest &req) {
+            auto &tenants = app.tenants();
+            if (!tenants.enabled()) return nullptr;
+            const auto &header = tenants.options().header;
+            const auto id = tenants.resolve(req.header("host"), req.header(header));
+            if (!id) return nullptr;
+            if (!Tenants::servesPath(req.getPath()))
+                throw MantisException(404, std::format("{} is not served for tenants.", req.getPath()));
+            return tenants.acquire(*id);
+        }
+    }
+
     std::string Router::convertPathToDrogon(const std::string &httplib_path) {
         // Convert httplib path params /:param to Drogon format /{param}
         // Also handle regex patterns like R"(/mb(/.*)?)" -> /mb/{1}
@@ -36,83 +62,339 @@ namespace mb {
         return result;
     }
 
-    std::vector<std::string> Router::extractParamNames(const std::string &httplib_path) {
-        std::vector<std::string> names;
-        for (size_t i = 0; i < httplib_path.size(); ++i) {
-            if (httplib_path[i] == ':' && (i == 0 || httplib_path[i - 1] == '/')) {
-                std::string name;
-                ++i;
-                while (i < httplib_path.size() && httplib_path[i] != '/') {
-                    name += httplib_path[i];
-                    ++i;
-                }
-                names.push_back(name);
+    void Router::executeMiddlewareChain(MantisRequest &req, MantisResponse &res, const RouteHandler *route,
+                                        MantisContentReader *reader) const {
+#ifdef MB_SCRIPTING_ENABLED
+        // Between requests, so no request runs partly on the scripts of before a reload
+        mApp.scriptsCheckpoint();
+#endif
+
+        // Opt-in breakdown for the Server-Timing header; spans record nothing without it
+        std::optional<ServerTiming> timing;
+        const auto started = ServerTiming::Clock::now();
+        if (m_serverTiming != ServerTiming::Mode::Off && req.hasHeader(ServerTiming::REQUEST_HEADER) &&
+            req.header(ServerTiming::REQUEST_HEADER) != "0")
+            timing.emplace();
+
+        // JSON unless the client prefers MessagePack or CBOR
+        res.setWireFormat(WireFormat::negotiate(req.header("accept")));
+
+        // Counted from arrival, so the time spent queued for a worker is part of it
+        std::optional<RequestDeadline> deadline;
+        const auto timeout = m_deadlines.timeoutFor(req.getHeaderValue(RequestDeadline::REQUEST_HEADER, ""));
+        if (timeout.count() > 0 || m_deadlines.cancelOnClose) {
+            const auto &request = req.drogonRequest();
+            auto at = RequestDeadline::Clock::time_point::max();
+            if (timeout.count() > 0) {
+                const auto waited = std::chrono::microseconds(std::max<std::int64_t>(
+                    0, trantor::Date::now().microSecondsSinceEpoch() - request->creationDate().microSecondsSinceEpoch()));
+                at = RequestDeadline::Clock::now() - waited + timeout;
+            }
+            std::function<bool()> alive;
+            if (m_deadlines.cancelOnClose) alive = [request] { return request->connected(); };
+            deadline.emplace(at, std::move(alive));
+        }
+        const auto lapsed = [&res] {
+            try {
+                RequestDeadline::check();
+            } catch (const MantisException &e) {
+                res.sendJSON(e.code(), {
+                                 {"status", e.code()},
+                                 {"data", json::object()},
+                                 {"error", e.what()}
+                             });
+                return true;
+            }
+            return false;
+        };
+
+        {
+            const RequestDeadline::Scope deadline_scope(deadline ? &*deadline : nullptr);
+            const ServerTiming::Scope timing_scope(timing ? &*timing : nullptr);
+            // ArenaJson built by the handlers lives and dies with the request
+            const RequestArena::Scope arena_scope(&req.arena());
+            // The request's span, set by reqIdSyncAdvice(), is the parent of spans further down
+            std::optional<Tracer::Scope> trace_scope;
+            if (const auto attrs = req.drogonRequest()->attributes(); attrs->find("mb_trace"))
+                trace_scope.emplace(m_tracer.get(), attrs->get<TraceContext>("mb_trace"));
+            // Given up on while it waited for a worker: nothing to run it for
+            if (!lapsed()) {
+                runMiddlewareChain(req, res, route, reader);
+                // An interrupted statement fails however the handler reports it, usually as a 500
+                if (static_cast<int>(res.drogonResponse()->statusCode()) >= 500) lapsed();
             }
         }
-        return names;
+
+        varyWireFormat(res);
+
+        // Still on the route's thread, so a DB worker pays for it rather than the IO loop
+        compressResponse(req, res);
+
+        if (!timing) return;
+        if (m_serverTiming == ServerTiming::Mode::Admin) {
+            const auto &auth = req.auth();
+            if (!auth.contains("entity") || auth["entity"] != "mb_admins") return;
+        }
+        res.setHeader("Server-Timing", timing->header(ServerTiming::Clock::now() - started));
     }
 
-    void Router::executeMiddlewareChain(MantisRequest &req, MantisResponse &res, const RouteHandler *route) const {
-        // Execute global pre-routing middlewares
-        for (const auto &g_mw: m_preRoutingMiddlewares) {
-            if (g_mw(req, res) == HandlerResponse::Handled) return;
+    void Router::varyWireFormat(const MantisResponse &res) {
+        const auto &resp = res.drogonResponse();
+        if (!WireFormat::fromMediaType(resp->contentTypeString())) return;
+
+        // The same URL answers in whichever format was asked for
+        const auto vary = resp->getHeader("vary");
+        bool listed = false;
+        for (std::size_t start = 0; start <= vary.size() && !listed;) {
+            const auto end = std::min(vary.find(',', start), vary.size());
+            listed = trim(vary.substr(start, end - start)) == "Accept";
+            start = end + 1;
         }
+        if (vary.empty()) resp->addHeader("Vary", "Accept");
+        else if (!listed) resp->addHeader("Vary", vary + ", Accept");
+
+        // Same meaning as the JSON the tag was made for, not the same bytes
+        if (res.wireFormat() == WireFormat::Format::Json) return;
+        if (const auto etag = resp->getHeader("etag"); etag.starts_with('"')) resp->addHeader("ETag", "W/" + etag);
+    }
+
+    void Router::compressResponse(MantisRequest &req, const MantisResponse &res) const {
+        if (!m_compression.enabled || req.getOr<bool>("mb_no_compression", false)) return;
+
+        const auto &resp = res.drogonResponse();
+        const auto status = static_cast<int>(resp->statusCode());
+        if (req.method() == RequestMethod::Head || status < 200 || status == 204 || status == 206 || status == 304) return;
+        if (!resp->sendfileName().empty() || !resp->getHeader("content-encoding").empty()) return;
+
+        const auto body = resp->body();
+        if (body.size() < m_compression.minSize || !Compression::isCompressible(resp->contentTypeString())) return;
+
+        // Caches must keep the encodings apart, including when this client gets identity
+        if (const auto vary = resp->getHeader("vary"); vary.empty()) resp->addHeader("Vary", "Accept-Encoding");
+        else if (vary.find("Accept-Encoding") == std::string::npos) resp->addHeader("Vary", vary + ", Accept-Encoding");
 
-        // Execute route-specific middlewares
-        if (route) {
-            for (const auto &mw: route->middlewares) {
-                if (mw(req, res) == HandlerResponse::Handled) return;
+        const auto encoding = Compression::negotiate(req.header("accept-encoding"));
+        if (encoding == Compression::Encoding::Identity) return;
+
+        auto encoded = Compression::compress(encoding, body);
+        if (encoded.empty() || encoded.size() >= body.size()) return;
+
+        // A strong ETag names these exact bytes, which the encoding changed
+        if (const auto etag = resp->getHeader("etag"); etag.starts_with('"')) resp->addHeader("ETag", "W/" + etag);
+        resp->setBody(std::move(encoded));
+        resp->addHeader("Content-Encoding", std::string(Compression::token(encoding)));
+    }
+
+    void Router::runMiddlewareChain(MantisRequest &req, MantisResponse &res, const RouteHandler *route,
+                                    MantisContentReader *reader) const {
+        // Reads may go to a replica until this request writes
+        const Database::RequestScope db_scope;
+        // The tenant the request names, if any; its database and entities for the rest of the chain
+        std::optional<Tenants::Scope> tenant_scope;
+        try {
+            if (const auto tenant = requestTenant(mApp, req)) tenant_scope.emplace(tenant);
+
+            {
+                const Tracer::Span trace_span("middleware");
+
+                // Composed at registration, pre-routing middlewares included
+                const auto &chain = route ? route->middlewares : m_preRoutingMiddlewares;
+                for (const auto &mw: chain) {
+                    if (mw(req, res) == HandlerResponse::Handled) return;
+                }
             }
 
-            // Execute the handler
-            if (const auto func = std::get_if<HandlerFn>(&route->handler)) {
-                (*func)(req, res);
+            if (route) {
+                // Execute the handler
+                const ServerTiming::Span span("handler");
+                const Tracer::Span trace_span("handler");
+                if (const auto func = std::get_if<HandlerFn>(&route->handler)) {
+                    (*func)(req, res);
+                } else if (const auto r_func = std::get_if<HandlerWithContentReaderFn>(&route->handler); r_func && reader) {
+                    (*r_func)(req, res, *reader);
+                }
             }
+
+            // Post routing
+            for (const auto &p_mw: m_postRoutingMiddlewares) {
+                p_mw(req, res);
+            }
+        } catch (const MantisException &e) {
+            // Errors a handler or middleware left uncaught, e.g. a 503 from
+            // Database::session() when no pooled session freed up in time
+            res.sendJSON(e.code(), {
+                             {"status", e.code()},
+                             {"data", json::object()},
+                             {"error", e.what()}
+                         });
         }
+    }
 
-        // Post routing
-        for (const auto &p_mw: m_postRoutingMiddlewares) {
-            p_mw(req, res);
+    void Router::dispatch(const RouteExec exec, std::function<void()> work, std::function<void()> done,
+                          const bool urgent) const {
+        if (exec == RouteExec::DbWorker && m_dbWorkers && m_dbWorkers->isRunning()) {
+            // Resume on the loop that owns the connection once the work is done
+            auto *loop = trantor::EventLoop::getEventLoopOfCurrentThread();
+            auto task = std::make_shared<std::pair<std::function<void()>, std::function<void()>>>(
+                std::move(work), std::move(done));
+
+            if (m_dbWorkers->submit([task, loop] {
+                task->first();
+                if (loop) loop->queueInLoop([task] { task->second(); });
+                else task->second();
+            }, urgent))
+                return;
+
+            // Pool stopped between the check and the submit; run inline
+            task->first();
+            task->second();
+            return;
         }
+
+        work();
+        done();
     }
 
-    void Router::Get(const std::string &path, const HandlerFn &handler, const Middlewares &middlewares) {
+    Middlewares Router::routeChain(const Middlewares &middlewares) const {
+        const bool auth_context = std::ranges::none_of(middlewares, isNoAuthContext);
+
+        Middlewares chain;
+        chain.reserve((auth_context ? m_preRoutingMiddlewares.size() : 0) + middlewares.size());
+        if (auth_context) chain.insert(chain.end(), m_preRoutingMiddlewares.begin(), m_preRoutingMiddlewares.end());
+        std::ranges::copy_if(middlewares, std::back_inserter(chain), [](const auto &mw) { return !isNoAuthContext(mw); });
+        return chain;
+    }
+
+    void Router::Get(const std::string &path, const HandlerFn &handler, const Middlewares &middlewares,
+                     const RouteExec exec) {
         LogOrigin::info("Route Created", fmt::format("GET {}", path));
-        m_routeRegistry.add("GET", path, handler, middlewares);
+        m_routeRegistry.add("GET", path, handler, routeChain(middlewares), exec);
         registerDrogonHandler("GET", path);
     }
 
     void Router::Post(const std::string &path, const HandlerWithContentReaderFn &handler,
-                      const Middlewares &middlewares) {
+                      const Middlewares &middlewares, const RouteExec exec) {
         LogOrigin::info("Route Created", fmt::format("POST {}", path));
-        m_routeRegistry.add("POST", path, handler, middlewares);
+        m_routeRegistry.add("POST", path, handler, routeChain(middlewares), exec);
         registerDrogonHandlerWithReader("POST", path);
     }
 
     void Router::Post(const std::string &path, const HandlerFn &handler,
-                      const Middlewares &middlewares) {
+                      const Middlewares &middlewares, const RouteExec exec) {
         LogOrigin::info("Route Created", fmt::format("POST {}", path));
-        m_routeRegistry.add("POST", path, handler, middlewares);
+        m_routeRegistry.add("POST", path, handler, routeChain(middlewares), exec);
         registerDrogonHandler("POST", path);
     }
 
     void Router::Patch(const std::string &path, const HandlerWithContentReaderFn &handler,
-                       const Middlewares &middlewares) {
-        m_routeRegistry.add("PATCH", path, handler, middlewares);
+                       const Middlewares &middlewares, const RouteExec exec) {
+        m_routeRegistry.add("PATCH", path, handler, routeChain(middlewares), exec);
         registerDrogonHandlerWithReader("PATCH", path);
     }
 
     void Router::Patch(const std::string &path, const HandlerFn &handler,
-                       const Middlewares &middlewares) {
-        m_routeRegistry.add("PATCH", path, handler, middlewares);
+                       const Middlewares &middlewares, const RouteExec exec) {
+        m_routeRegistry.add("PATCH", path, handler, routeChain(middlewares), exec);
         registerDrogonHandler("PATCH", path);
     }
 
-    void Router::Delete(const std::string &path, const HandlerFn &handler, const Middlewares &middlewares) {
-        m_routeRegistry.add("DELETE", path, handler, middlewares);
+    void Router::Delete(const std::string &path, const HandlerFn &handler, const Middlewares &middlewares,
+                        const RouteExec exec) {
+        m_routeRegistry.add("DELETE", path, handler, routeChain(middlewares), exec);
         registerDrogonHandler("DELETE", path);
     }
 
+    void Router::registerAsync(const std::string &method, const std::string &path, const AsyncHandlerFn &handler,
+                               const Middlewares &middlewares) {
+        LogOrigin::info("Route Created", fmt::format("{} {}", method, path));
+        m_routeRegistry.add(method, path, handler, routeChain(middlewares));
+        registerDrogonHandler(method, path);
+    }
+
+    void Router::GetAsync(const std::string &path, const AsyncHandlerFn &handler, const Middlewares &middlewares) {
+        registerAsync("GET", path, handler, middlewares);
+    }
+
+    void Router::PostAsync(const std::string &path, const AsyncHandlerFn &handler, const Middlewares &middlewares) {
+        registerAsync("POST", path, handler, middlewares);
+    }
+
+    void Router::PatchAsync(const std::string &path, const AsyncHandlerFn &handler, const Middlewares &middlewares) {
+        registerAsync("PATCH", path, handler, middlewares);
+    }
+
+    void Router::DeleteAsync(const std::string &path, const AsyncHandlerFn &handler, const Middlewares &middlewares) {
+        registerAsync("DELETE", path, handler, middlewares);
+    }
+
+    void Router::offload(MantisRequest &req, std::function<void()> work, std::function<void()> done) const {
+        // Read and written here on the loop, so several offloads of one request may run at once
+        auto pinned = std::make_shared<bool>(req.getOr<bool>("mb_pinned", false));
+        auto tenant = req.getOr<std::shared_ptr<Tenants::Tenant>>("mb_tenant", nullptr);
+        dispatch(RouteExec::DbWorker, [pinned, tenant = std::move(tenant), work = std::move(work)] {
+            // The worker's thread has none of the request's scopes; a write earlier in the request still pins it
+            const Database::RequestScope db_scope(*pinned);
+            std::optional<Tenants::Scope> tenant_scope;
+            if (tenant) tenant_scope.emplace(tenant);
+            work();
+            *pinned = Database::pinnedToPrimary();
+        }, [&req, pinned, done = std::move(done)] {
+            if (*pinned) req.set("mb_pinned", true);
+            done();
+        });
+    }
+
+    drogon::Task<> Router::executeAsyncChain(MantisRequest &req, MantisResponse &res, const RouteHandler *route) const {
+#ifdef MB_SCRIPTING_ENABLED
+        mApp.scriptsCheckpoint();
+#endif
+        res.setWireFormat(WireFormat::negotiate(req.header("accept")));
+
+        try {
+            bool handled = false;
+            {
+                // Thread-bound, so only around the synchronous middlewares; offload() sets them up again
+                const Database::RequestScope db_scope;
+                std::optional<Tenants::Scope> tenant_scope;
+                if (auto tenant = requestTenant(mApp, req)) {
+                    req.set("mb_tenant", tenant);
+                    tenant_scope.emplace(std::move(tenant));
+                }
+                const RequestArena::Scope arena_scope(&req.arena());
+                for (const auto &mw: route->middlewares) {
+                    if (mw(req, res) == HandlerResponse::Handled) {
+                        handled = true;
+                        break;
+                    }
+                }
+                req.set("mb_pinned", Database::pinnedToPrimary());
+            }
+
+            if (!handled) {
+                co_await std::get<AsyncHandlerFn>(route->handler)(req, res);
+                for (const auto &p_mw: m_postRoutingMiddlewares) {
+                    p_mw(req, res);
+                }
+            }
+        } catch (const MantisException &e) {
+            res.sendJSON(e.code(), {
+                             {"status", e.code()},
+                             {"data", json::object()},
+                             {"error", e.what()}
+                         });
+        } catch (const std::exception &e) {
+            // Nothing above the coroutine would catch it
+            res.sendJSON(500, {
+                             {"status", 500},
+                             {"data", json::object()},
+                             {"error", e.what()}
+                         });
+        }
+
+        varyWireFormat(res);
+        compressResponse(req, res);
+    }
+
     static drogon::HttpMethod toDrogonMethod(const std::string &method) {
         if (method == "GET") return drogon::Get;
         if (method == "POST") return drogon::Post;
@@ -123,6 +405,184 @@ namespace mb {
         return drogon::Get;
     }
 
+    namespace {
+        /// Per-request state. Heap-allocated so it can follow the request onto
+        /// a DB worker thread and back.
+        struct RequestCtx {
+            MantisRequest req;
+            MantisResponse res;
+            std::unique_ptr<MantisContentReader> reader;
+            std::optional<std::vector<FormDataItem>> parts; ///> Multipart body, if it was streamed
+            std::shared_ptr<Drain::Ticket> ticket;          ///> Counts the request in flight while it lives
+
+            RequestCtx(const MantisBase &app, const drogon::HttpRequestPtr &r) : req{app, r} {}
+        };
+
+        using Respond = std::function<void(const drogon::HttpResponsePtr &)>;
+        using Fail = std::function<void(int code, const std::string &error)>;
+
+        void sendError(RequestCtx &ctx, const Respond &callback, const int code, const std::string &error) {
+            ctx.res.sendJSON(code, {
+                                 {"status", code},
+                                 {"error", error},
+                                 {"data", json::object()}
+                             });
+            callback(ctx.res.drogonResponse());
+        }
+
+        /// Over the route's admission limit: turned away before any work, told when to come back
+        void sendOverloaded(RequestCtx &ctx, const Respond &callback) {
+            ctx.res.setHeader("Retry-After", "1");
+            sendError(ctx, callback, 503, "Server is busy; retry shortly.");
+        }
+
+        /// Shutting down: turned away before any work, on a connection that then closes (see Router::drain())
+        void sendDraining(RequestCtx &ctx, const Respond &callback) {
+            ctx.res.setHeader("Retry-After", "1");
+            sendError(ctx, callback, 503, "Server is shutting down; retry shortly.");
+        }
+
+        /// Read a non-multipart body into memory, up to `max_body` bytes
+        void streamBody(const drogon::RequestStreamPtr &stream, const std::shared_ptr<RequestCtx> &ctx,
+                        const std::size_t max_body, std::function<void()> run, Fail fail) {
+            auto body = std::make_shared<std::string>();
+            auto too_large = std::make_shared<bool>(false);
+            stream->setStreamReader(drogon::RequestStreamReader::newReader(
+                [body, too_large, max_body](const char *data, const size_t length) {
+                    if (*too_large) return;
+                    if (body->size() + length > max_body) {
+                        *too_large = true;
+                        std::string().swap(*body);
+                        return;
+                    }
+                    body->append(data, length);
+                },
+                [ctx, body, too_large, max_body, run, fail](const std::exception_ptr &ex) {
+                    if (ex) return fail(400, "Request body was not received completely.");
+                    if (*too_large) return fail(413, std::format("Request body is larger than {} bytes.", max_body));
+                    ctx->req.setBody(std::move(*body));
+                    run();
+                }));
+        }
+
+        /**
+         * Spool a multipart body part by part: fields into memory, files into
+         * staging files. The first error is answered right away and the rest
+         * of the body is dropped as it arrives.
+         */
+        void streamMultipart(const drogon::RequestStreamPtr &stream, const drogon::HttpRequestPtr &req,
+                             const std::shared_ptr<RequestCtx> &ctx, const MultipartUpload::Limits &limits,
+                             FileIo *io, std::function<void()> run, Fail fail) {
+            std::shared_ptr<MultipartUpload> upload;
+            try {
+                upload = std::make_shared<MultipartUpload>(Files::stagingDir(), limits, io);
+            } catch (const std::exception &e) {
+                fail(500, e.what());
+                return;
+            }
+
+            auto failed = std::make_shared<bool>(false);
+            const auto guard = [upload, failed, fail](const auto &step) {
+                if (*failed) return;
+                try {
+                    step();
+                    return;
+                } catch (const MantisException &e) {
+                    fail(e.code(), e.what());
+                } catch (const std::exception &e) {
+                    fail(500, e.what());
+                }
+                *failed = true;
+                // Drop what's staged now rather than when the request is released
+                upload->abort();
+            };
+
+            stream->setStreamReader(drogon::RequestStreamReader::newMultipartReader(
+                req,
+                [upload, guard](drogon::MultipartHeader header) {
+                    guard([&] {
+                        upload->beginPart(std::move(header.name), std::move(header.filename),
+                                          std::move(header.contentType));
+                    });
+                },
+                [upload, guard](const char *data, const size_t length) {
+                    guard([&] { upload->append(data, length); });
+                },
+                [ctx, upload, failed, guard, run](const std::exception_ptr &ex) {
+                    if (*failed) return;
+                    guard([&] {
+                        if (ex) throw MantisException(400, "Malformed or incomplete multipart body.");
+                        // Back on this loop once the staged files are on disk
+                        upload->whenWritten([ctx, upload, failed, guard, run] {
+                            guard([&] { ctx->parts = upload->finish(); });
+                            if (!*failed) run();
+                        });
+                    });
+                }));
+        }
+
+        /// True for the NDJSON and CSV bodies of bulk imports and the raw bytes of blob
+        /// writes, which are spooled to disk like uploads
+        bool isBulkBody(const drogon::HttpRequestPtr &req) {
+            const auto &content_type = req->getHeader("Content-Type");
+            auto type = trim(content_type.substr(0, content_type.find(';')));
+            toLowerCase(type);
+            return type == "application/x-ndjson" || type == "application/ndjson" || type == "text/csv" ||
+                   type == "application/octet-stream";
+        }
+
+        /**
+         * Spool a bulk body into one staging file as it arrives, held to the
+         * upload limit rather than to `maxBody`. The handler reads it back
+         * from the reader's single form data item.
+         */
+        void streamBulkBody(const drogon::RequestStreamPtr &stream, const drogon::HttpRequestPtr &req,
+                            const std::shared_ptr<RequestCtx> &ctx, MultipartUpload::Limits limits,
+                            FileIo *io, std::function<void()> run, Fail fail) {
+            std::shared_ptr<MultipartUpload> upload;
+            try {
+                limits.maxFile = limits.maxUpload;
+                upload = std::make_shared<MultipartUpload>(Files::stagingDir(), limits, io);
+                upload->beginPart("body", "body", std::string(req->getHeader("Content-Type")));
+            } catch (const std::exception &e) {
+                fail(500, e.what());
+                return;
+            }
+
+            auto failed = std::make_shared<bool>(false);
+            stream->setStreamReader(drogon::RequestStreamReader::newReader(
+                [upload, failed, fail](const char *data, const size_t length) {
+                    if (*failed) return;
+                    try {
+                        upload->append(data, length);
+                        return;
+                    } catch (const MantisException &e) {
+                        fail(e.code(), e.what());
+                    } catch (const std::exception &e) {
+                        fail(500, e.what());
+                    }
+                    *failed = true;
+                    upload->abort();
+                },
+                [ctx, upload, failed, fail, run](const std::exception_ptr &ex) {
+                    if (*failed) return;
+                    if (ex) {
+                        upload->abort();
+                        return fail(400, "Request body was not received completely.");
+                    }
+                    upload->whenWritten([ctx, upload, fail, run] {
+                        try {
+                            ctx->parts = upload->finish();
+                        } catch (const MantisException &e) {
+                            upload->abort();
+                            return fail(e.code(), e.what());
+                        }
+                        run();
+                    });
+                }));
+        }
+    }
+
     void Router::registerDrogonHandler(const std::string &method, const std::string &path) const {
         const auto drogon_path = convertPathToDrogon(path);
         const auto drogon_method = toDrogonMethod(method);
@@ -130,42 +590,64 @@ namespace mb {
         auto handler = [
                     this,
                     _method = std::string(method),
-                    _path = std::string(path)
+                    _path = std::string(path),
+                    pattern = std::make_shared<const PathPattern>(path),
+                    series = &m_metrics->route(method, path),
+                    urgent = Admission::isPriority(path),
+                    limit = m_admission->enabled() && !Admission::isPriority(path)
+                                ? &m_admission->route(method, path)
+                                : nullptr
                 ](
             const drogon::HttpRequestPtr &req,
             std::function<void(const drogon::HttpResponsePtr &)> &&callback) {
-            MantisRequest ma_req{mApp, req};
-            MantisResponse ma_res{};
-
-            const auto param_names = req->getRoutingParameters();
-
-            // Extract path params from the matched path
-            // Drogon stores them as positional params in the matched pattern
-            if (!param_names.empty()) {
-                // Parse path params by comparing actual path with pattern
-                auto actual_parts = splitString(std::string(req->path()), "/");
-                auto pattern_parts = splitString(_path, "/");
+            req->attributes()->insert("mb_route_series", series);
+            auto ctx = std::make_shared<RequestCtx>(mApp, req);
+            if (!(ctx->ticket = m_drain->enter())) {
+                sendDraining(*ctx, callback);
+                return;
+            }
 
-                for (size_t i = 0; i < pattern_parts.size() && i < actual_parts.size(); ++i) {
-                    if (!pattern_parts[i].empty() && pattern_parts[i][0] == ':') {
-                        ma_req.setPathParam(pattern_parts[i].substr(1), actual_parts[i]);
-                    }
-                }
+            // The server-wide limit is sized for uploads, which only the reader routes take
+            if (req->body().size() > m_uploadLimits.maxBody) {
+                sendError(*ctx, callback, 413, std::format("Request body is larger than {} bytes.",
+                                                           m_uploadLimits.maxBody));
+                return;
             }
 
+            // Views into the matched path, by the ordinals found at registration
+            if (!pattern->params.empty())
+                ctx->req.setPathParams(pattern);
+
             const auto route = m_routeRegistry.find(_method, _path);
             if (!route) {
                 json response;
                 response["status"] = 404;
                 response["error"] = std::format("{} {} Route Not Found", _method, _path);
                 response["data"] = json::object();
-                ma_res.sendJSON(404, response);
-                callback(ma_res.drogonResponse());
+                ctx->res.sendJSON(404, response);
+                callback(ctx->res.drogonResponse());
+                return;
+            }
+
+            // Runs on the IO loop; its database work goes to the workers through offload()
+            if (std::holds_alternative<AsyncHandlerFn>(route->handler)) {
+                drogon::async_run([this, ctx, route, callback = std::move(callback)]() -> drogon::Task<> {
+                    co_await executeAsyncChain(ctx->req, ctx->res, route);
+                    callback(ctx->res.drogonResponse());
+                });
+                return;
+            }
+
+            std::shared_ptr<ConcurrencyLimit::Permit> permit;
+            if (limit && route->exec == RouteExec::DbWorker && !(permit = limit->acquire())) {
+                sendOverloaded(*ctx, callback);
                 return;
             }
 
-            executeMiddlewareChain(ma_req, ma_res, route);
-            callback(ma_res.drogonResponse());
+            dispatch(route->exec,
+                     [this, ctx, route] { executeMiddlewareChain(ctx->req, ctx->res, route); },
+                     [ctx, permit, callback = std::move(callback)] { callback(ctx->res.drogonResponse()); },
+                     urgent);
         };
 
         drogon::app().registerHandler(drogon_path, std::move(handler), {drogon_method});
@@ -173,66 +655,74 @@ namespace mb {
 
     void Router::registerDrogonHandlerWithReader(const std::string &method, const std::string &path) {
         const auto drogon_path = convertPathToDrogon(path);
-        const auto param_names = extractParamNames(path);
+        const auto pattern = std::make_shared<const PathPattern>(path);
         const auto drogon_method = toDrogonMethod(method);
 
-        auto handler = [this, method, path, param_names](
+        auto handler = [this, method, path, pattern, series = &m_metrics->route(method, path),
+                    urgent = Admission::isPriority(path),
+                    limit = m_admission->enabled() && !Admission::isPriority(path)
+                                ? &m_admission->route(method, path)
+                                : nullptr](
             const drogon::HttpRequestPtr &req,
+            drogon::RequestStreamPtr &&stream,
             std::function<void(const drogon::HttpResponsePtr &)> &&callback) {
-            MantisRequest ma_req{mApp, req};
-            MantisResponse ma_res{};
-            MantisContentReader ma_cr{ma_req};
-
-            // Extract path params
-            if (!param_names.empty()) {
-                auto actual_parts = splitString(std::string(req->path()), "/");
-                auto pattern_parts = splitString(path, "/");
-
-                for (size_t i = 0; i < pattern_parts.size() && i < actual_parts.size(); ++i) {
-                    if (!pattern_parts[i].empty() && pattern_parts[i][0] == ':') {
-                        ma_req.setPathParam(pattern_parts[i].substr(1), actual_parts[i]);
-                    }
-                }
+            req->attributes()->insert("mb_route_series", series);
+            auto ctx = std::make_shared<RequestCtx>(mApp, req);
+            if (!(ctx->ticket = m_drain->enter())) {
+                sendDraining(*ctx, callback);
+                return;
             }
 
+            if (!pattern->params.empty())
+                ctx->req.setPathParams(pattern);
+
             const auto route = m_routeRegistry.find(method, path);
             if (!route) {
-                ma_res.sendJSON(404, {
-                                    {"status", 404},
-                                    {"error", std::format("{} {} Route Not Found", method, path)},
-                                    {"data", json::object()}
-                                });
-                callback(ma_res.drogonResponse());
+                // The unread body is dropped once `stream` goes out of scope
+                sendError(*ctx, callback, 404, std::format("{} {} Route Not Found", method, path));
                 return;
             }
 
-            // Execute global middlewares
-            for (const auto &g_mw: m_preRoutingMiddlewares) {
-                if (g_mw(ma_req, ma_res) == HandlerResponse::Handled) {
-                    callback(ma_res.drogonResponse());
-                    return;
-                }
-            }
-
-            // Execute route-specific middlewares
-            for (const auto &mw: route->middlewares) {
-                if (mw(ma_req, ma_res) == HandlerResponse::Handled) {
-                    callback(ma_res.drogonResponse());
-                    return;
-                }
+            // Turned away before the body is read, so a refused upload costs nothing
+            std::shared_ptr<ConcurrencyLimit::Permit> permit;
+            if (limit && route->exec == RouteExec::DbWorker && !(permit = limit->acquire())) {
+                sendOverloaded(*ctx, callback);
+                return;
             }
 
-            // Execute handler with content reader
-            if (const auto func = std::get_if<HandlerWithContentReaderFn>(&route->handler)) {
-                (*func)(ma_req, ma_res, ma_cr);
+            auto fail = [ctx, callback](const int code, const std::string &error) {
+                sendError(*ctx, callback, code, error);
+            };
+            auto run = [this, ctx, route, callback, permit, urgent] {
+                dispatch(route->exec,
+                         [this, ctx, route] {
+                             // Body parsing (JSON/multipart) happens here, on the
+                             // worker for offloaded routes.
+                             ctx->reader = ctx->parts
+                                               ? std::make_unique<MantisContentReader>(ctx->req, std::move(*ctx->parts))
+                                               : std::make_unique<MantisContentReader>(ctx->req);
+                             executeMiddlewareChain(ctx->req, ctx->res, route, ctx->reader.get());
+                         },
+                         [ctx, permit, callback] { callback(ctx->res.drogonResponse()); },
+                         urgent);
+            };
+
+            // Not in stream mode: drogon has buffered the whole body
+            if (!stream) {
+                run();
+                return;
             }
 
-            // Post routing
-            for (const auto &p_mw: m_postRoutingMiddlewares) {
-                p_mw(ma_req, ma_res);
+            if (req->contentType() == drogon::CT_MULTIPART_FORM_DATA) {
+                auto limits = m_uploadLimits;
+                if (const auto setting = m_maxFileSetting.load(std::memory_order_relaxed); setting > 0)
+                    limits.maxFile = std::min(limits.maxFile, setting);
+                streamMultipart(stream, req, ctx, limits, m_fileIo.get(), std::move(run), std::move(fail));
             }
-
-            callback(ma_res.drogonResponse());
+            else if (isBulkBody(req))
+                streamBulkBody(stream, req, ctx, m_uploadLimits, m_fileIo.get(), std::move(run), std::move(fail));
+            else
+                streamBody(stream, ctx, m_uploadLimits.maxBody, std::move(run), std::move(fail));
         };
 
         drogon::app().registerHandler(drogon_path, std::move(handler), {drogon_method});
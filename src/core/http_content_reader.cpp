@@ -1,11 +1,22 @@
 #include "../../include/mantisbase/core/http.h"
 #include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/core/tracing.h"
+#include "../../include/mantisbase/core/blob_store.h"
 #include "drogon/MultiPart.h"
 
 namespace mb {
     MantisContentReader::MantisContentReader(const MantisRequest &req)
         : m_req(req) { read(); }
 
+    MantisContentReader::MantisContentReader(const MantisRequest &req, std::vector<FormDataItem> form_data)
+        : m_req(req), m_formData(std::move(form_data)), m_parsed(true) {
+        appendQueryParameters();
+    }
+
+    MantisContentReader::~MantisContentReader() {
+        MultipartUpload::discard(m_formData);
+    }
+
     bool MantisContentReader::isMultipartFormData() const { return m_req.isMultipartFormData(); }
 
     void MantisContentReader::read() {
@@ -55,7 +66,7 @@ namespace mb {
                     );
                 }
 
-                const auto e_field = EntitySchemaField(entity.field(form_data.name).value());
+                const auto e_field = EntitySchemaField(*entity.fieldDef(form_data.name));
 
                 if (!(e_field.type() == "file" || e_field.type() == "files")) {
                     throw MantisException(
@@ -95,9 +106,8 @@ namespace mb {
                 }
             } else {
                 try {
-                    auto e_field_opt = entity.field(form_data.name);
-                    if (e_field_opt.has_value()) {
-                        auto schema_field = EntitySchemaField(e_field_opt.value());
+                    if (const auto *def = entity.fieldDef(form_data.name)) {
+                        auto schema_field = EntitySchemaField(*def);
 
                         try {
                             const auto &type = schema_field.type();
@@ -142,8 +152,8 @@ namespace mb {
     void MantisContentReader::writeFiles(const std::string &entity_name) {
         if (!isMultipartFormData()) return;
 
-        for (const auto &formData: m_formData) {
-            if (formData.filename.empty()) continue;
+        for (auto &formData: m_formData) {
+            if (formData.filename.empty() || formData.staged_path.empty()) continue;
 
             const auto file_list = m_filesMetadata[formData.name].is_array()
                                        ? m_filesMetadata[formData.name]
@@ -158,25 +168,34 @@ namespace mb {
             }
 
             auto &file_record = *it;
-            const auto filepath = file_record["path"].get<std::string>();
-            if (std::ofstream ofs(filepath, std::ios::binary); ofs.is_open()) {
-                ofs.write(formData.content.data(), formData.content.size());
-                ofs.close();
-            } else {
+            Tracer::Span span("file.write");
+            span.setAttribute("file.size", std::to_string(formData.size));
+
+            // Identical content is stored once; the entity file links to the shared blob
+            const auto filename = file_record["filename"].get<std::string>();
+            try {
+                BlobStore::put(entity_name, filename, formData.staged_path, formData.sha256, formData.content_type);
+            } catch (const MantisException &) {
                 undoWrittenFiles(entity_name);
-                throw MantisException(500, "Failed to open `" + formData.filename + "` file for writing.");
+                throw;
             }
+            formData.staged_path.clear();
+            m_writtenFiles.push_back(filename);
+            // Hashed while streaming in; saves rehashing it for its ETag
+            if (MantisBase::instance().storage().backend().isLocal())
+                Files::storeContentHash(entity_name, filename, formData.sha256);
         }
     }
 
     void MantisContentReader::undoWrittenFiles(const std::string &entity_name) {
         if (!isMultipartFormData()) return;
 
-        for (const auto &file: m_filesMetadata) {
-            if (file.contains("filename")) {
-                [[maybe_unused]] auto _ = Files::removeFile(entity_name, file["filename"].get<std::string>());
-            }
+        // Only what writeFiles() moved into place; the rest is still staged
+        for (const auto &filename: m_writtenFiles) {
+            [[maybe_unused]] auto _ = Files::removeFile(entity_name, filename);
         }
+        m_writtenFiles.clear();
+        MultipartUpload::discard(m_formData);
     }
 
     std::string MantisContentReader::hashMultipartMetadata(const FormDataItem &data) {
@@ -184,7 +203,7 @@ namespace mb {
         const size_t h1 = hasher(data.name);
         const size_t h3 = hasher(data.filename);
         const size_t h4 = hasher(data.content_type);
-        const size_t content_size_hash = hasher(std::to_string(data.content.size()));
+        const size_t content_size_hash = hasher(std::to_string(data.size) + data.sha256);
 
         size_t result = h1;
         result ^= h3 + 0x9e3779b9 + (result << 6) + (result >> 2);
@@ -215,47 +234,42 @@ namespace mb {
     void MantisContentReader::readMultipart() {
         const auto &dReq = m_req.drogonRequest();
 
+        // Drogon has the whole body here already; route the files through the
+        // same staging as streamed uploads so writeFiles() only renames
+        MultipartUpload upload(Files::stagingDir(), MultipartUpload::Limits::fromEnv());
         drogon::MultiPartParser fileUpload;
         if (fileUpload.parse(dReq) == 0) {
-            auto &files = fileUpload.getFiles();
-            // Get uploaded files
-            for (auto &file : files) {
-                FormDataItem item;
-                item.name = file.getItemName();
-                item.filename = file.getFileName();
-                item.content_type = file.getContentType();
-                item.content = std::string(file.fileData(), file.fileLength());
-                m_formData.push_back(std::move(item));
+            for (const auto &file : fileUpload.getFiles()) {
+                upload.beginPart(file.getItemName(), file.getFileName(), "");
+                upload.append(file.fileData(), file.fileLength());
+            }
+            for (const auto &[key, value] : fileUpload.getParameters()) {
+                upload.beginPart(key, "", "");
+                upload.append(value.data(), value.size());
             }
         }
+        m_formData = upload.finish();
+        appendQueryParameters();
+    }
 
-        // Get form parameters (non-file fields)
-        auto params = dReq->parameters();
-        for (const auto &[key, value] : params) {
-            // Skip if this key was already handled as a file upload
-            bool is_file = false;
-            for (const auto &fd : m_formData) {
-                if (fd.name == key && !fd.filename.empty()) {
-                    is_file = true;
-                    break;
-                }
-            }
-            if (is_file) continue;
+    void MantisContentReader::appendQueryParameters() {
+        // Form parameters drogon parsed off the request, unless sent as a part
+        for (const auto &[key, value] : m_req.drogonRequest()->parameters()) {
+            const bool seen = std::ranges::any_of(m_formData, [&](const FormDataItem &fd) { return fd.name == key; });
+            if (seen) continue;
 
             FormDataItem item;
             item.name = key;
             item.content = value;
+            item.size = value.size();
             m_formData.push_back(std::move(item));
         }
     }
 
     void MantisContentReader::readJSON() {
-        std::string body = m_req.getBody();
-        try {
-            if (trim(body).empty()) m_json = json::object();
-            else m_json = json::parse(body);
-        } catch (const std::exception &e) {
-            throw MantisException(400, e.what());
-        }
+        // Shares the request's parse with access rules and handlers
+        const auto &[body, err] = m_req.getBodyAsJson();
+        if (!err.empty()) throw MantisException(400, err);
+        m_json = body;
     }
 }
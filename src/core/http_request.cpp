@@ -1,53 +1,119 @@
 #include "../../include/mantisbase/mantisbase.h"
 #include "../../include/mantisbase/core/http.h"
+#include "../../include/mantisbase/utils/json_parse.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <format>
 
 namespace mb {
 MantisRequest::MantisRequest(const MantisBase& mb, const drogon::HttpRequestPtr &_req)
     : m_req(_req), m_store(ContextStore{}), m_app(mb) {}
 
+PathPattern::PathPattern(const std::string_view path) {
+    std::size_t segment = 0;
+    for (std::size_t i = 0; i < path.size(); ++i) {
+        if (path[i] == '/') {
+            ++segment;
+        } else if (path[i] == ':' && (i == 0 || path[i - 1] == '/')) {
+            const auto end = std::min(path.find('/', i), path.size());
+            params.push_back({std::string(path.substr(i + 1, end - i - 1)), segment});
+            i = end - 1;
+        }
+    }
+    if (params.size() > MAX_PARAMS)
+        throw MantisException(500, std::format("Route `{}` has more than {} path params.", path, MAX_PARAMS));
+}
+
 void MantisRequest::setPathParam(const std::string &key, const std::string &value) {
-    m_pathParams[key] = value;
+    for (auto &[name, val]: m_extraParams)
+        if (name == key) {
+            val = value;
+            return;
+        }
+    m_extraParams.emplace_back(key, value);
 }
 
 void MantisRequest::setPathParams(const std::unordered_map<std::string, std::string> &params) {
-    m_pathParams = params;
+    m_pattern.reset();
+    m_extraParams.assign(params.begin(), params.end());
+}
+
+void MantisRequest::setPathParams(std::shared_ptr<const PathPattern> pattern) {
+    m_pattern = std::move(pattern);
+    m_pathValues.fill({});
+    if (!m_pattern) return;
+
+    // One pass over the path; the params are in segment order
+    const std::string_view path = m_req->path();
+    std::size_t segment = 0, start = 0, next = 0;
+    for (const auto &param: m_pattern->params) {
+        while (segment < param.segment && start <= path.size()) {
+            const auto slash = path.find('/', start);
+            start = slash == std::string_view::npos ? path.size() + 1 : slash + 1;
+            ++segment;
+        }
+        if (start > path.size()) break;
+        const auto end = std::min(path.find('/', start), path.size());
+        m_pathValues[next++] = path.substr(start, end - start);
+    }
 }
 
-std::string MantisRequest::getMethod() const {
+RequestMethod MantisRequest::method() const {
     switch (m_req->method()) {
-        case drogon::Get: return "GET";
-        case drogon::Post: return "POST";
-        case drogon::Put: return "PUT";
-        case drogon::Delete: return "DELETE";
-        case drogon::Patch: return "PATCH";
-        case drogon::Options: return "OPTIONS";
-        case drogon::Head: return "HEAD";
+        case drogon::Get: return RequestMethod::Get;
+        case drogon::Post: return RequestMethod::Post;
+        case drogon::Put: return RequestMethod::Put;
+        case drogon::Delete: return RequestMethod::Delete;
+        case drogon::Patch: return RequestMethod::Patch;
+        case drogon::Options: return RequestMethod::Options;
+        case drogon::Head: return RequestMethod::Head;
+        default: return RequestMethod::Unknown;
+    }
+}
+
+std::string_view MantisRequest::methodName() const {
+    switch (method()) {
+        case RequestMethod::Get: return "GET";
+        case RequestMethod::Post: return "POST";
+        case RequestMethod::Put: return "PUT";
+        case RequestMethod::Delete: return "DELETE";
+        case RequestMethod::Patch: return "PATCH";
+        case RequestMethod::Options: return "OPTIONS";
+        case RequestMethod::Head: return "HEAD";
         default: return "UNKNOWN";
     }
 }
 
-std::string MantisRequest::getPath() const { return m_req->path(); }
+std::string MantisRequest::getMethod() const { return std::string(methodName()); }
 
-std::string MantisRequest::getBody() const { return std::string(m_req->body()); }
+const std::string &MantisRequest::getPath() const { return m_req->path(); }
 
-std::string MantisRequest::getRemoteAddr() const {
-    if (hasHeader("X-Forwarded-For")) {
-        auto forwarded = getHeaderValue("X-Forwarded-For", "", 0);
-        if (const auto first_comma = forwarded.find(',');
-            first_comma != std::string::npos) {
-            forwarded = forwarded.substr(0, first_comma);
-        }
-        if (isValidIP(forwarded)) {
-            return forwarded;
-        }
+std::string MantisRequest::getBody() const { return std::string(bodyView()); }
+
+std::string_view MantisRequest::bodyView() const { return m_body ? std::string_view(*m_body) : m_req->body(); }
+
+void MantisRequest::setBody(std::string body) {
+    m_body = std::move(body);
+    m_bodyJsonCache.reset();
+}
+
+const std::string &MantisRequest::getRemoteAddr() const {
+    if (m_remoteAddr) return *m_remoteAddr;
+    if (const auto &ip = remoteIp()) return m_remoteAddr.emplace(ip->toString());
+    LogOrigin::warn("IP Detection Failed", "Unable to determine valid client IP address");
+    return m_remoteAddr.emplace(m_req->peerAddr().toIp());
+}
+
+const std::optional<IpAddress> &MantisRequest::remoteIp() const {
+    if (m_remoteIp) return *m_remoteIp;
+    if (const auto header = this->header("x-forwarded-for"); !header.empty()) {
+        const auto forwarded = header.substr(0, header.find(','));
+        if (auto ip = parseIP(forwarded)) return m_remoteIp.emplace(ip);
         LogOrigin::warn("Invalid IP Header", fmt::format("Invalid IP address in X-Forwarded-For header: {}", forwarded));
     }
-    const auto direct_ip = m_req->peerAddr().toIp();
-    if (isValidIP(direct_ip)) {
-        return direct_ip;
-    }
-    LogOrigin::warn("IP Detection Failed", "Unable to determine valid client IP address");
-    return direct_ip;
+    return m_remoteIp.emplace(parseIP(m_req->peerAddr().toIp()));
 }
 
 int MantisRequest::getRemotePort() const { return m_req->peerAddr().toPort(); }
@@ -56,25 +122,43 @@ std::string MantisRequest::getLocalAddr() const { return m_req->localAddr().toIp
 
 int MantisRequest::getLocalPort() const { return m_req->localAddr().toPort(); }
 
-bool MantisRequest::hasHeader(const std::string &key) const {
-    return !m_req->getHeader(key).empty();
+bool MantisRequest::hasHeader(const std::string_view key) const {
+    return !header(key).empty();
 }
 
-std::string MantisRequest::getHeaderValue(const std::string &key,
+std::string_view MantisRequest::header(const std::string_view key) const {
+    const auto &headers = m_req->headers();
+    // Short enough for the small-string buffer of libstdc++ and MSVC, so the key copies
+    // onto the stack; drogon keeps names lower-case
+    constexpr std::size_t inline_chars = 15;
+    if (key.size() <= inline_chars && std::ranges::none_of(key, [](const unsigned char c) { return std::isupper(c); })) {
+        const auto it = headers.find(std::string(key));
+        return it == headers.end() ? std::string_view{} : std::string_view(it->second);
+    }
+    for (const auto &[name, value]: headers)
+        if (name.size() == key.size() && std::ranges::equal(name, key, {}, {}, [](const unsigned char c) {
+                return static_cast<char>(std::tolower(c));
+            }))
+            return value;
+    return {};
+}
+
+std::string MantisRequest::getHeaderValue(const std::string_view key,
                                           const char *def, size_t id) const {
-    auto val = m_req->getHeader(key);
-    return val.empty() ? std::string(def) : val;
+    const auto val = header(key);
+    return val.empty() ? std::string(def) : std::string(val);
 }
 
-size_t MantisRequest::getHeaderValueU64(const std::string &key, size_t def,
+size_t MantisRequest::getHeaderValueU64(const std::string_view key, size_t def,
                                         size_t id) const {
-    auto val = m_req->getHeader(key);
-    if (val.empty()) return def;
-    try { return std::stoull(val); } catch (...) { return def; }
+    const auto val = header(key);
+    size_t out = 0;
+    const auto begin = val.data() + std::min(val.find_first_not_of(' '), val.size());
+    return std::from_chars(begin, val.data() + val.size(), out).ec == std::errc{} ? out : def;
 }
 
-size_t MantisRequest::getHeaderValueCount(const std::string &key) const {
-    return m_req->getHeader(key).empty() ? 0 : 1;
+size_t MantisRequest::getHeaderValueCount(const std::string_view key) const {
+    return header(key).empty() ? 0 : 1;
 }
 
 bool MantisRequest::hasQueryParam(const std::string &key) const {
@@ -95,25 +179,38 @@ size_t MantisRequest::getQueryParamValueCount(const std::string &key) const {
     return hasQueryParam(key) ? 1 : 0;
 }
 
-bool MantisRequest::hasPathParams() const { return !m_pathParams.empty(); }
+bool MantisRequest::hasPathParams() const {
+    return !m_extraParams.empty() || (m_pattern && !m_pattern->params.empty());
+}
 
 bool MantisRequest::hasPathParam(const std::string &key) const {
-    return m_pathParams.contains(key);
+    if (std::ranges::any_of(m_extraParams, [&](const auto &param) { return param.first == key; })) return true;
+    return m_pattern && std::ranges::any_of(m_pattern->params, [&](const auto &param) { return param.name == key; });
+}
+
+std::string_view MantisRequest::pathParam(const std::string_view key) const {
+    for (const auto &[name, value]: m_extraParams)
+        if (name == key) return value;
+    if (!m_pattern) return {};
+    for (std::size_t i = 0; i < m_pattern->params.size(); ++i)
+        if (m_pattern->params[i].name == key) return m_pathValues[i];
+    return {};
+}
+
+std::string_view MantisRequest::pathParam(const std::size_t ordinal) const {
+    return ordinal < m_pathValues.size() ? m_pathValues[ordinal] : std::string_view{};
 }
 
 std::string MantisRequest::getPathParamValue(const std::string &key) const {
-    if (auto it = m_pathParams.find(key); it != m_pathParams.end())
-        return it->second;
-    return "";
+    return std::string(pathParam(key));
 }
 
 size_t MantisRequest::getPathParamValueCount(const std::string &key) const {
-    return m_pathParams.contains(key) ? 1 : 0;
+    return hasPathParam(key) ? 1 : 0;
 }
 
 bool MantisRequest::isMultipartFormData() const {
-    auto ct = m_req->getHeader("Content-Type");
-    return ct.find("multipart/form-data") != std::string::npos;
+    return header("content-type").find("multipart/form-data") != std::string_view::npos;
 }
 
 bool MantisRequest::hasKey(const std::string &key) const {
@@ -121,22 +218,28 @@ bool MantisRequest::hasKey(const std::string &key) const {
 }
 
 std::string MantisRequest::getBearerTokenAuth() const {
-    if (hasHeader("Authorization")) {
-        const auto auth = getHeaderValue("Authorization", "", 0);
-        constexpr size_t bearer_prefix_len = 7; // "Bearer "
-        return auth.size() > bearer_prefix_len ? auth.substr(bearer_prefix_len) : "";
-    }
-    return "";
+    const auto auth = header("authorization");
+    constexpr size_t bearer_prefix_len = 7; // "Bearer "
+    return auth.size() > bearer_prefix_len ? std::string(auth.substr(bearer_prefix_len)) : "";
 }
 
-std::pair<nlohmann::json, std::string> MantisRequest::getBodyAsJson() const {
+const std::pair<nlohmann::json, std::string> &MantisRequest::getBodyAsJson() const {
+    if (m_bodyJsonCache) return *m_bodyJsonCache;
+
+    // Parsed straight from drogon's buffer; MessagePack and CBOR bodies decode to the same JSON
+    const auto b = bodyView();
+    const auto format = WireFormat::fromMediaType(header("content-type"));
     try {
-        const auto b = getBody();
-        auto obj = b.empty() ? nlohmann::json::object() : nlohmann::json::parse(b);
-        return {obj, ""};
+        if (format && *format != WireFormat::Format::Json)
+            m_bodyJsonCache.emplace(b.empty() ? nlohmann::json::object() : WireFormat::decode(*format, b), "");
+        else if (b.find_first_not_of(" \t\r\n") == std::string_view::npos)
+            m_bodyJsonCache.emplace(nlohmann::json::object(), "");
+        else
+            m_bodyJsonCache.emplace(parseJson(b), "");
     } catch (const std::exception &e) {
-        return {nlohmann::json::object(), e.what()};
+        m_bodyJsonCache.emplace(nlohmann::json::object(), e.what());
     }
+    return *m_bodyJsonCache;
 }
 
 #ifdef MB_SCRIPTING_ENABLED
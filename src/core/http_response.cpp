@@ -1,5 +1,8 @@
 #include "../../include/mantisbase/core/http.h"
 #include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/core/server_timing.h"
+#include "../../include/mantisbase/core/tenants.h"
+#include "../../include/mantisbase/utils/json_parse.h"
 #include <fstream>
 
 namespace mb {
@@ -113,6 +116,38 @@ namespace mb {
         setFileContent(path, content_type);
     }
 
+    void MantisResponse::sendFile(const std::string& path, const size_t offset, const size_t length,
+                                  const std::string& content_type, const bool partial) {
+        auto res = drogon::HttpResponse::newFileResponse(path, offset, length, partial, "",
+                                                         drogon::CT_NONE, content_type);
+        for (const auto& [key, value]: m_res->headers()) {
+            res->addHeader(key, value);
+        }
+        for (const auto& [_, cookie]: m_res->cookies()) {
+            res->addCookie(cookie);
+        }
+        m_res = std::move(res);
+    }
+
+    void MantisResponse::sendStream(std::function<std::size_t(char *, std::size_t)> reader,
+                                    const std::string& content_type, const std::string& filename) {
+        // Read on the IO loop after the handler returned; a tenant's database stays open meanwhile
+        if (auto *tenant = Tenants::current()) {
+            reader = [reader = std::move(reader), held = tenant->shared_from_this()](char *buf, const std::size_t n) {
+                const Tenants::Scope scope(held);
+                return reader(buf, n);
+            };
+        }
+        auto res = drogon::HttpResponse::newStreamResponse(reader, filename, drogon::CT_CUSTOM, content_type);
+        for (const auto& [key, value]: m_res->headers()) {
+            res->addHeader(key, value);
+        }
+        for (const auto& [_, cookie]: m_res->cookies()) {
+            res->addCookie(cookie);
+        }
+        m_res = std::move(res);
+    }
+
     void MantisResponse::send(int statusCode, const std::string& data, const std::string& content_type) const {
         m_res->setBody(data);
         m_res->setContentTypeString(content_type);
@@ -124,7 +159,32 @@ namespace mb {
     }
 
     void MantisResponse::sendJSON(const int statusCode, const json& data) const {
-        send(statusCode, data.dump(), "application/json");
+        std::string body;
+        {
+            const ServerTiming::Span span("serialize");
+            body = WireFormat::encode(m_format, data);
+        }
+        m_res->setBody(std::move(body));
+        m_res->setContentTypeString(std::string(WireFormat::mediaType(m_format)));
+        m_res->setStatusCode(static_cast<drogon::HttpStatusCode>(statusCode));
+    }
+
+    void MantisResponse::sendRawJSON(const int statusCode, std::string&& body) const {
+        if (m_format != WireFormat::Format::Json) {
+            // Parsed only to be re-encoded, so the document can go with the request
+            std::string encoded;
+            {
+                const ServerTiming::Span span("serialize");
+                encoded = WireFormat::encode(m_format, parseArenaJson(body));
+            }
+            m_res->setBody(std::move(encoded));
+            m_res->setContentTypeString(std::string(WireFormat::mediaType(m_format)));
+            m_res->setStatusCode(static_cast<drogon::HttpStatusCode>(statusCode));
+            return;
+        }
+        m_res->setBody(std::move(body));
+        m_res->setContentTypeString("application/json");
+        m_res->setStatusCode(static_cast<drogon::HttpStatusCode>(statusCode));
     }
 
     void MantisResponse::sendHtml(const int statusCode, const std::string& data) const {
@@ -0,0 +1,212 @@
+/**
+ * @file index_advisor.cpp
+ * @brief Implementation for @see index_advisor.h
+ */
+
+#include "../../include/mantisbase/core/index_advisor.h"
+#include "../../include/mantisbase/core/database.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/core/models/entity_filter.h"
+#include "../../include/mantisbase/core/router.h"
+#include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <format>
+#include <soci/soci.h>
+#include <vector>
+
+namespace mb {
+    namespace {
+        std::string indexDDL(const std::string &entity, const IndexDefinition &index, const bool concurrently) {
+            std::string columns;
+            for (const auto &col: index.columns) {
+                if (!columns.empty()) columns += ", ";
+                columns += EntityFilter::indexColumnSql(MantisBase::instance().dbType(), col);
+            }
+            return std::format("CREATE INDEX {}IF NOT EXISTS {} ON {} ({})", concurrently ? "CONCURRENTLY " : "",
+                               index.name, sqlIdentifier(entity), columns);
+        }
+
+        double toMs(const std::chrono::nanoseconds d) {
+            return std::chrono::duration<double, std::milli>(d).count();
+        }
+    }
+
+    IndexAdvisor::Options IndexAdvisor::Options::fromEnv() {
+        Options options;
+        options.autoCreate = getEnvOrDefault("MB_INDEX_AUTO", "0") == "1";
+        if (const auto queries = safe_stoi(getEnvOrDefault("MB_INDEX_AUTO_QUERIES", ""), 0); queries > 0)
+            options.minQueries = static_cast<std::size_t>(queries);
+        if (const auto ms = safe_stoi(getEnvOrDefault("MB_INDEX_AUTO_MS", ""), -1); ms >= 0)
+            options.minAvg = std::chrono::milliseconds(ms);
+        return options;
+    }
+
+    IndexAdvisor::IndexAdvisor(const Options options) : m_options(options) {}
+
+    IndexAdvisor::~IndexAdvisor() {
+        stop();
+    }
+
+    void IndexAdvisor::start() {
+        if (!m_options.autoCreate) return;
+        std::lock_guard lock(m_mutex);
+        if (m_thread.joinable()) return;
+        m_stopping = false;
+        m_thread = std::thread(&IndexAdvisor::loop, this);
+    }
+
+    void IndexAdvisor::stop() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+    void IndexAdvisor::record(const std::string &entity, const IndexDefinition &index,
+                              const std::chrono::nanoseconds took) {
+        bool crossed = false;
+        {
+            std::lock_guard lock(m_mutex);
+            auto it = m_patterns.find(index.name);
+            if (it == m_patterns.end()) {
+                if (m_patterns.size() >= m_options.capacity) return;
+                it = m_patterns.emplace(index.name, Pattern{entity, index}).first;
+            }
+
+            auto &p = it->second;
+            ++p.queries;
+            p.total += took;
+            p.max = std::max(p.max, took);
+            crossed = m_options.autoCreate && !p.attempted && p.queries == m_options.minQueries;
+            if (crossed) m_wake = true;
+        }
+        if (crossed) m_cv.notify_all();
+    }
+
+    nlohmann::json IndexAdvisor::suggestions() const {
+        std::vector<Pattern> patterns;
+        {
+            std::lock_guard lock(m_mutex);
+            for (const auto &[_, p]: m_patterns) patterns.push_back(p);
+        }
+        std::ranges::sort(patterns, [](const Pattern &a, const Pattern &b) { return a.total > b.total; });
+
+        const bool pg = MantisBase::instance().dbType() == "postgresql";
+        auto out = nlohmann::json::array();
+        for (const auto &p: patterns) {
+            out.push_back({
+                {"entity", p.entity},
+                {"index", p.index.toJSON()},
+                {"ddl", indexDDL(p.entity, p.index, pg)},
+                {"queries", p.queries},
+                {"avg_ms", toMs(p.total) / static_cast<double>(std::max<std::size_t>(1, p.queries))},
+                {"max_ms", toMs(p.max)},
+                {"total_ms", toMs(p.total)},
+                {"error", p.error.empty() ? nlohmann::json(nullptr) : nlohmann::json(p.error)}
+            });
+        }
+        return out;
+    }
+
+    void IndexAdvisor::forget(const std::string &entity) {
+        std::lock_guard lock(m_mutex);
+        std::erase_if(m_patterns, [&](const auto &kv) { return kv.second.entity == entity; });
+    }
+
+    void IndexAdvisor::createIndex(const std::string &entity, const IndexDefinition &index) {
+        auto &app = MantisBase::instance();
+
+        if (app.dbType() == "postgresql") {
+            // Outside any transaction, as CONCURRENTLY requires. A failed build
+            // leaves an invalid index behind, which would block the next attempt.
+            const auto sql = app.db().session();
+            try {
+                *sql << indexDDL(entity, index, true);
+            } catch (const std::exception &) {
+                try {
+                    *sql << "DROP INDEX CONCURRENTLY IF EXISTS " + index.name;
+                } catch (const std::exception &) {}
+                throw;
+            }
+        }
+
+        nlohmann::json schema;
+        app.db().write([&](soci::session &sql) {
+            if (app.dbType() != "postgresql") sql << indexDDL(entity, index, false);
+
+            std::string id;
+            sql << "SELECT id, schema FROM mb_tables WHERE name = :name",
+                    soci::use(entity), soci::into(id), soci::into(schema);
+            if (!sql.got_data() || !schema.is_object())
+                throw MantisException(404, std::format("No schema for entity `{}`", entity));
+
+            // Kept in the schema so it's rebuilt with the table and known to list()
+            if (!schema.contains("indexes") || !schema["indexes"].is_array())
+                schema["indexes"] = nlohmann::json::array();
+            const auto exists = std::ranges::any_of(schema["indexes"], [&](const nlohmann::json &idx) {
+                return idx.value("name", "") == index.name;
+            });
+            if (!exists) schema["indexes"].push_back(index.toJSON());
+
+            const std::tm updated_tm = toUtcTime(time(nullptr));
+            sql << "UPDATE mb_tables SET schema = :schema, updated = :updated WHERE id = :id",
+                    soci::use(schema), soci::use(updated_tm), soci::use(id);
+        });
+
+        app.router().updateSchemaCache(entity, schema);
+        LogOrigin::entitySchemaInfo("Index Advisor", fmt::format("Created index `{}` on `{}` ({})", index.name, entity,
+                                                                 nlohmann::json(index.columns).dump()));
+    }
+
+    bool IndexAdvisor::step() {
+        Pattern picked;
+        {
+            std::lock_guard lock(m_mutex);
+            const auto it = std::ranges::find_if(m_patterns, [this](const auto &kv) {
+                const auto &p = kv.second;
+                return !p.attempted && p.queries >= m_options.minQueries &&
+                       p.total / p.queries >= m_options.minAvg;
+            });
+            if (it == m_patterns.end()) return false;
+            it->second.attempted = true;
+            picked = it->second;
+        }
+
+        try {
+            createIndex(picked.entity, picked.index);
+            ++m_created;
+        } catch (const std::exception &e) {
+            LogOrigin::entitySchemaWarn("Index Advisor", fmt::format("Could not create index `{}` on `{}`: {}",
+                                                                     picked.index.name, picked.entity, e.what()));
+            std::lock_guard lock(m_mutex);
+            if (const auto it = m_patterns.find(picked.index.name); it != m_patterns.end())
+                it->second.error = e.what();
+        }
+        return true;
+    }
+
+    void IndexAdvisor::loop() {
+        std::unique_lock lock(m_mutex);
+        while (!m_stopping) {
+            m_wake = false;
+            lock.unlock();
+
+            bool more = false;
+            try {
+                more = step();
+            } catch (const std::exception &e) {
+                LogOrigin::warn("Index Advisor", fmt::format("Index advisor step failed: {}", e.what()));
+            }
+
+            lock.lock();
+            // One index at a time; the next right after, as each takes a while anyway
+            if (!more)
+                m_cv.wait_for(lock, m_options.poll, [this] { return m_stopping || m_wake; });
+        }
+    }
+}
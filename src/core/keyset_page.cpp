@@ -0,0 +1,44 @@
+/**
+ * @file keyset_page.cpp
+ * @brief Implementation for @see keyset_page.h
+ */
+
+#include "../../include/mantisbase/core/keyset_page.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/http.h"
+
+#include <format>
+
+namespace mb {
+    KeysetPage KeysetPage::fromQuery(const MantisRequest &req) {
+        KeysetPage page;
+        if (req.hasQueryParam("limit")) {
+            const auto value = req.getQueryParamValue("limit");
+            try {
+                std::size_t used = 0;
+                page.limit = std::stoi(value, &used);
+                if (used != value.size()) page.limit = 0;
+            } catch (...) {
+                page.limit = 0;
+            }
+            if (page.limit < 1 || page.limit > MAX_LIMIT)
+                throw MantisException(400, std::format("`limit` must be a number from 1 to {}", MAX_LIMIT));
+        }
+        if (req.hasQueryParam("after")) page.after = req.getQueryParamValue("after");
+        return page;
+    }
+
+    bool KeysetPage::requested(const MantisRequest &req) {
+        return req.hasQueryParam("limit") || req.hasQueryParam("after");
+    }
+
+    json KeysetPage::envelope(json items) const {
+        std::string cursor;
+        if (items.size() > static_cast<std::size_t>(limit)) {
+            items.erase(items.begin() + limit, items.end());
+            cursor = items.back().value("id", std::string{});
+        }
+        const auto count = items.size();
+        return {{"items", std::move(items)}, {"cursor", cursor}, {"items_count", count}, {"limit", limit}};
+    }
+}
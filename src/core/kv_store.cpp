@@ -7,8 +7,15 @@
 #include "../../include/mantisbase/core/types.h"
 #include "../../include/mantisbase/core/middlewares.h"
 #include "../../include/mantisbase/core/router.h"
+#include "../../include/mantisbase/core/multipart_upload.h"
+#include "../../include/mantisbase/core/listener_options.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/channels.h"
+#include "../../include/mantisbase/core/file_serving.h"
+#include "../../include/mantisbase/core/response_cache.h"
 
 #include <soci/soci.h>
+#include <algorithm>
 
 
 namespace mb
@@ -19,6 +26,7 @@ namespace mb
     {
         try
         {
+            migrate();
             setupConfigRoutes();
         }
         catch (const std::exception& e)
@@ -31,51 +39,86 @@ namespace mb
         return true;
     }
 
-    void KeyValStore::migrate()
+    namespace
     {
-        const auto sql = mApp.db().session();
+        const std::string& settingsId()
+        {
+            static const auto id = std::to_string(std::hash<std::string>{}("configs"));
+            return id;
+        }
+    }
 
-        // Check if we have settings data already, if not so, add base settings
+    json KeyValStore::defaults()
+    {
         json settings;
-        auto id = std::to_string(std::hash<std::string>{}("configs"));
-        *sql << "SELECT value FROM __settings WHERE id = :id LIMIT 1", soci::use(id), soci::into(settings);
-        if (sql->got_data())
+        settings["appName"] = "ACME Project";
+        settings["baseUrl"] = "https://acme.example.com";
+        settings["maintenanceMode"] = false;
+        // in MB; caps each uploaded file below MB_MAX_FILE_SIZE
+        settings["maxFileSize"] = std::max<std::size_t>(MultipartUpload::Limits::fromEnv().maxFile / (1024 * 1024), 1);
+        settings["allowRegistration"] = true;
+        settings["emailVerificationRequired"] = false;
+        settings["sessionTimeout"] = 24 * 60 * 60; // 24 hours
+        settings["adminSessionTimeout"] = 1 * 60 * 60; // 1 hour
+        settings["mode"] = "PROD";
+        // Read once, when the server starts; see ListenerOptions
+        settings["http"] = ListenerOptions{}.toJSON();
+        return settings;
+    }
+
+    json KeyValStore::publicValues(const json& values)
+    {
+        json data = json::object();
+        for (const auto* key : {"appName", "baseUrl", "maintenanceMode", "allowRegistration",
+                                "emailVerificationRequired", "maxFileSize"})
         {
-            // TODO redact any sensitive values ...
-            m_configs = settings;
-            LogOrigin::trace("Config Loaded", fmt::format("Config Values: {}", m_configs.dump()));
+            if (const auto it = values.find(key); it != values.end()) data[key] = *it;
         }
-        // Create base data to config settings
-        else
+        data["mantisVersion"] = MantisBase::appVersion();
+        return data;
+    }
+
+    std::optional<json> KeyValStore::stored() const
+    {
+        json settings;
+        {
+            const auto sql = mApp.db().session();
+            *sql << "SELECT value FROM mb_store WHERE id = :id LIMIT 1", soci::use(settingsId()), soci::into(settings);
+            if (!sql->got_data()) settings = json();
+        }
+        if (!settings.is_object()) return std::nullopt;
+
+        // Keys added since the row was stored start at their defaults
+        auto merged = defaults();
+        merged.update(settings);
+        return merged;
+    }
+
+    void KeyValStore::migrate()
+    {
+        if (auto merged = stored())
         {
-            // Create default time values
-            const std::time_t current_t = time(nullptr);
-            std::tm created_tm = toUtcTime(current_t);
-
-            // Create data since it's missing
-            settings.clear();
-            settings["appName"] = "ACME Project";
-            settings["baseUrl"] = "https://acme.example.com";
-            settings["maintenanceMode"] = false;
-            settings["maxFileSize"] = 10; // in MB
-            settings["allowRegistration"] = true;
-            settings["emailVerificationRequired"] = false;
-            settings["sessionTimeout"] = 24 * 60 * 60; // 24 hours
-            settings["adminSessionTimeout"] = 1 * 60 * 60; // 1 hour
-            settings["mode"] = "PROD";
-
-            *sql <<
-                "INSERT INTO __settings (id, value, created, updated) VALUES (:id, :value, :created, :updated)"
-                ,
-                soci::use(id), soci::use(settings),
-                soci::use(created_tm), soci::use(created_tm);
+            LogOrigin::trace("Config Loaded", fmt::format("Config Values: {}", merged->dump()));
+            publish(std::move(*merged));
+            return;
         }
+
+        // Create base data to config settings
+        auto created = defaults();
+        const std::tm created_tm = toUtcTime(time(nullptr));
+        mApp.db().write([&](soci::session& sql)
+        {
+            sql << "INSERT INTO mb_store (id, value, created, updated) VALUES (:id, :value, :created, :updated) "
+                   "ON CONFLICT(id) DO NOTHING",
+                soci::use(settingsId()), soci::use(created), soci::use(created_tm), soci::use(created_tm);
+        });
+        publish(std::move(created));
     }
 
     HandlerResponse KeyValStore::hasAccess(MantisRequest& req, MantisResponse& res) const
     {
         // Get the auth var from the context, resort to empty object if it's not set.
-        auto& auth = req.getOr<json>("auth", json::object());
+        auto& auth = req.auth();
 
         // Ensure auth object is present in the request's context
         if (auth.empty())
@@ -173,169 +216,192 @@ namespace mb
         return REQUEST_HANDLED;
     }
 
-    json& KeyValStore::configs()
+    json KeyValStore::configs() const
+    {
+        return snapshot()->values;
+    }
+
+    std::shared_ptr<const KeyValStore::Snapshot> KeyValStore::snapshot() const
     {
-        return m_configs;
+        return m_snapshot.load();
     }
 
-    json KeyValStore::initSettingsConfig()
+    std::shared_ptr<const KeyValStore::Snapshot> KeyValStore::update(const json& patch)
     {
-        // Get app session
-        const auto sql = mApp.db().session();
+        if (!patch.is_object())
+            throw MantisException(400, "Settings must be a JSON object.");
 
-        // Fetch settings
-        json settings;
-        auto id = std::to_string(std::hash<std::string>{}("configs"));
-        *sql << "SELECT value FROM _settings WHERE id = :id LIMIT 1", soci::use(id), soci::into(settings);
-        if (sql->got_data())
+        std::lock_guard lock(m_writeMutex);
+        auto values = snapshot()->values;
+        if (values.empty()) values = defaults();
+
+        for (const auto& [key, value] : patch.items())
         {
-            m_configs = settings;
-            return settings;
+            if (key == "appName" || key == "baseUrl")
+            {
+                if (!value.is_string()) throw MantisException(400, fmt::format("`{}` must be a string.", key));
+                values[key] = value;
+            }
+            else if (key == "maintenanceMode" || key == "allowRegistration" || key == "emailVerificationRequired" ||
+                key == "jwtEnableSetIssuer" || key == "jwtEnableSetAudience")
+            {
+                if (!value.is_boolean()) throw MantisException(400, fmt::format("`{}` must be true or false.", key));
+                values[key] = value;
+            }
+            else if (key == "maxFileSize" || key == "sessionTimeout" || key == "adminSessionTimeout")
+            {
+                if (!value.is_number_integer() || value.get<long long>() <= 0)
+                    throw MantisException(400, fmt::format("`{}` must be a positive integer.", key));
+                values[key] = value;
+            }
+            else if (key == "http")
+            {
+                // Validated whole; takes effect on the next start
+                ListenerOptions options;
+                options.merge(values.value("http", json::object()));
+                options.merge(value);
+                values[key] = options.toJSON();
+            }
+            else if (key == "mode") ///> TODO [Deprecated], drop it in v0.3.0
+            {
+                auto mode = value.is_string() ? value.get<std::string>() : "PROD";
+                toUpperCase(mode); // Ensure mode is in upper case
+                values[key] = mode == "TEST" ? "TEST" : "PROD"; // Limit update modes to prod/test only
+            }
+            // Other keys are ignored, as they always were
         }
 
-        return json::object();
+        const std::tm updated_tm = toUtcTime(time(nullptr));
+        mApp.db().write([&](soci::session& sql)
+        {
+            sql << "INSERT INTO mb_store (id, value, created, updated) VALUES (:id, :value, :created, :updated) "
+                   "ON CONFLICT(id) DO UPDATE SET value = excluded.value, updated = excluded.updated",
+                soci::use(settingsId()), soci::use(values), soci::use(updated_tm), soci::use(updated_tm);
+        });
+        return publish(std::move(values));
+    }
+
+    bool KeyValStore::reload()
+    {
+        std::lock_guard lock(m_writeMutex);
+        auto merged = stored();
+        if (!merged || *merged == snapshot()->values) return false;
+        publish(std::move(*merged));
+        return true;
+    }
+
+    std::shared_ptr<const KeyValStore::Snapshot> KeyValStore::publish(json values)
+    {
+        const auto previous = snapshot();
+        Snapshot built{std::move(values), previous->version + 1};
+        built.publicBody = json{{"status", 200}, {"error", ""}, {"data", publicValues(built.values)}}.dump();
+        built.publicEtag = ResponseCache::etag(built.publicBody);
+        const bool public_changed = previous->version > 0 && built.publicEtag != previous->publicEtag;
+
+        auto next = std::make_shared<const Snapshot>(std::move(built));
+        m_snapshot.store(next);
+
+        // Copied, so a listener may unsubscribe while being called
+        std::vector<std::pair<std::size_t, Listener>> listeners;
+        {
+            std::lock_guard lock(m_listenersMutex);
+            listeners = m_listeners;
+        }
+        for (const auto& [id, listener] : listeners)
+        {
+            try
+            {
+                listener(*next);
+            }
+            catch (const std::exception& e)
+            {
+                LogOrigin::warn("Settings", fmt::format("A settings listener failed: {}", e.what()));
+            }
+        }
+        if (public_changed)
+            Channels::instance().announce(Channels::SETTINGS, {{"type", "settings_changed"},
+                                                               {"etag", next->publicEtag}});
+        return next;
+    }
+
+    std::size_t KeyValStore::subscribe(Listener listener)
+    {
+        std::size_t id;
+        {
+            std::lock_guard lock(m_listenersMutex);
+            id = m_nextListener++;
+            m_listeners.emplace_back(id, listener);
+        }
+        listener(*snapshot());
+        return id;
+    }
+
+    void KeyValStore::unsubscribe(const std::size_t id)
+    {
+        std::lock_guard lock(m_listenersMutex);
+        std::erase_if(m_listeners, [id](const auto& entry) { return entry.first == id; });
     }
 
     void KeyValStore::setupConfigRoutes()
     {
-        // TRACE_CLASS_METHOD()
+        const Middlewares adminAuth = {requireAdminAuth()};
 
         // Set up settings get & update endpoints
         mApp.router().Get(
             "/api/v1/sys/settings/config",
-            [this](MantisRequest& req, MantisResponse& res)
+            [this](const MantisRequest&, const MantisResponse& res)
             {
-                // If we have a cached config object ...
-                if (!m_configs.empty())
-                {
-                    // Return cached config object
-                    json response;
-                    response["status"] = 200;
-                    response["error"] = "";
-                    response["data"] = m_configs;
-                    response["data"]["mantisVersion"] = MantisBase::appVersion();
-
-                    res.sendJSON(200, response);
-                    return;
-                }
-
-                // Get app session
-                const auto sql = mApp.db().session();
-                json response; // Response object
-
-                // Fetch settings
-                json settings;
-                auto settings_id = std::to_string(std::hash<std::string>{}("settings"));
-                *sql << "SELECT value FROM __settings WHERE id = :id LIMIT 1", soci::use(
-                    settings_id), soci::into(settings);
-                if (sql->got_data())
+                const auto settings = snapshot();
+                json data = settings->values;
+                data["mantisVersion"] = MantisBase::appVersion();
+                data["version"] = settings->version;
+                res.sendJSON(200, {{"status", 200}, {"error", ""}, {"data", std::move(data)}});
+            }, adminAuth);
+
+        // Public settings for client SDKs; a 304 until they change, announced on `@mb:settings`
+        mApp.router().Get(
+            "/api/v1/settings",
+            [this](const MantisRequest& req, const MantisResponse& res)
+            {
+                const auto settings = snapshot();
+                res.setHeader("ETag", settings->publicEtag);
+                res.setHeader("Cache-Control", "public, no-cache");
+                if (FileServing::ifNoneMatch(req.getHeaderValue("If-None-Match"), settings->publicEtag))
                 {
-                    // Update local cache
-                    m_configs = settings;
-
-                    // Create response object
-                    response["status"] = 200;
-                    response["error"] = "";
-                    response["data"] = settings;
-                    response["data"]["mantisVersion"] = MantisBase::appVersion();
-
-                    res.sendJSON(200, response);
+                    res.sendEmpty(304);
                     return;
                 }
-
-                // We didn't find any data, something is wrong!
-                response["status"] = 404;
-                response["error"] = "Settings object not found!";
-                response["data"] = json::object();
-
-                res.sendJSON(404, response);
-            }, { });
+                res.sendRawJSON(200, std::string(settings->publicBody));
+            }, {noAuthContext()});
 
         // Update settings config
         mApp.router().Patch(
             "/api/v1/sys/settings/config",
-            [this](MantisRequest& req, MantisResponse& res)
+            [this](MantisRequest& req, const MantisResponse& res)
             {
                 // Parse request body
-                json body = json::object();
+                const auto& [body, err] = req.getBodyAsJson();
+                if (!err.empty())
+                {
+                    res.sendJSON(400, {
+                                     {"status", 400}, {"data", json::object()},
+                                     {"error", "Could not parse request body, expected JSON!"}
+                                 });
+                    return;
+                }
+
                 try
                 {
-                    body = json::parse(req.getBody());
+                    const auto settings = update(body);
+                    json data = settings->values;
+                    data["mantisVersion"] = MantisBase::appVersion();
+                    data["version"] = settings->version;
+                    res.sendJSON(200, {{"status", 200}, {"error", ""}, {"data", std::move(data)}});
                 }
-                catch (const std::exception& e)
+                catch (const MantisException& e)
                 {
-                    json response;
-                    response["status"] = 400;
-                    response["error"] = "Could not parse request body, expected JSON!";
-                    response["data"] = json::object();
-
-                    res.sendJSON(400, response);
-                    return;
+                    res.sendJSON(e.code(), {{"status", e.code()}, {"data", json::object()}, {"error", e.what()}});
                 }
-
-                // Get app session
-                const auto sql = mApp.db().session();
-
-                // Create base data before we update.
-                if (m_configs.empty()) migrate();
-
-                m_configs["appName"] = body.contains("appName")
-                                           ? body["appName"]
-                                           : m_configs["appName"];
-                m_configs["baseUrl"] = body.contains("baseUrl")
-                                           ? body["baseUrl"]
-                                           : m_configs["baseUrl"];
-                m_configs["jwtEnableSetIssuer"] = body.contains("jwtEnableSetIssuer")
-                                                      ? body["jwtEnableSetIssuer"]
-                                                      : m_configs["jwtEnableSetIssuer"];
-                m_configs["jwtEnableSetAudience"] = body.contains("jwtEnableSetAudience")
-                                                        ? body["jwtEnableSetAudience"]
-                                                        : m_configs["jwtEnableSetAudience"];
-                m_configs["maintenanceMode"] = body.contains("maintenanceMode")
-                                                   ? body.value("maintenanceMode", false)
-                                                   : m_configs.value("maintenanceMode", false);
-                m_configs["maxFileSize"] = body.contains("maxFileSize")
-                                               ? body.value("maxFileSize", 10)
-                                               : m_configs.value("maxFileSize", 10);
-                m_configs["allowRegistration"] = body.contains("allowRegistration")
-                                                     ? body.value("allowRegistration", false)
-                                                     : m_configs.value("allowRegistration", false);
-                m_configs["emailVerificationRequired"] = body.contains("emailVerificationRequired")
-                                                             ? body.value("emailVerificationRequired", false)
-                                                             : m_configs.value("emailVerificationRequired", false);
-                m_configs["sessionTimeout"] = body.contains("sessionTimeout")
-                                                  ? body.value("sessionTimeout", 24 * 60 * 60)
-                                                  : m_configs.value("sessionTimeout", 24 * 60 * 60);
-                m_configs["adminSessionTimeout"] = body.contains("adminSessionTimeout")
-                                                       ? body.value("adminSessionTimeout", 1 * 60 * 60)
-                                                       : m_configs.value("adminSessionTimeout", 1 * 60 * 60);
-                ///> TODO [Deprecated], drop it in v0.3.0
-                auto mode = body.contains("mode")
-                                ? body.value("mode", "PROD")
-                                : m_configs.value("mode", "PROD");
-
-                toUpperCase(mode); // Ensure mode is in upper case
-                m_configs["mode"] = mode == "TEST" ? "TEST" : "PROD"; // Limit update modes to prod/test only
-
-                // Create default time values
-                const std::time_t updated_t = time(nullptr);
-                std::tm updated_tm = toUtcTime(updated_t);
-
-                // Create config admin
-                auto id = std::to_string(std::hash<std::string>{}("configs"));
-
-                // Update config values
-                *sql << "UPDATE __settings SET value = :value, updated = :updated WHERE id = :id",
-                    soci::use(m_configs), soci::use(updated_tm);
-
-                json response;
-                response["status"] = 200;
-                response["error"] = "";
-                response["data"] = m_configs;
-                response["data"]["mantisVersion"] = MantisBase::appVersion();
-
-                res.sendJSON(200, response);
-            }, {
-            });
+            }, adminAuth, RouteExec::DbWorker);
     }
 } // mantis
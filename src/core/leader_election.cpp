@@ -0,0 +1,161 @@
+/**
+ * @file leader_election.cpp
+ * @brief Implementation for @see leader_election.h
+ */
+
+#include "../../include/mantisbase/core/leader_election.h"
+#include "../../include/mantisbase/core/database.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/core/metrics.h"
+#include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <format>
+#include <soci/soci.h>
+
+namespace mb {
+    namespace {
+        /// Unix seconds on the database's clock
+        const char *epochNow(const bool pg) {
+            return pg ? "CAST(EXTRACT(EPOCH FROM NOW()) AS bigint)" : "CAST(strftime('%s', 'now') AS INTEGER)";
+        }
+    }
+
+    LeaderElection::Options LeaderElection::Options::fromEnv() {
+        Options options;
+        options.enabled = getEnvOrDefault("MB_LEADER_ELECTION", "1") != "0";
+        options.ttl = std::chrono::seconds(
+            std::max(3, safe_stoi(getEnvOrDefault("MB_LEADER_TTL_SECS", ""), static_cast<int>(options.ttl.count()))));
+        options.node = getEnvOrDefault("MB_NODE_ID", "");
+        if (options.node.empty()) options.node = generateShortId();
+        return options;
+    }
+
+    LeaderElection::LeaderElection(Options options, Connect connect)
+        : m_options(std::move(options)),
+          m_connect(connect ? std::move(connect) : Connect([] { return MantisBase::instance().rootDb().writeSession(); })) {}
+
+    LeaderElection::~LeaderElection() {
+        stop();
+    }
+
+    void LeaderElection::start(const bool shared) {
+        if (!m_options.enabled || !shared) {
+            m_always.store(true);
+            return;
+        }
+        std::lock_guard lock(m_mutex);
+        if (m_thread.joinable()) return;
+        m_stopping = false;
+        m_thread = std::thread(&LeaderElection::loop, this);
+    }
+
+    void LeaderElection::stop() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable()) m_thread.join();
+
+        // Stepping down hands over now rather than once the lease runs out
+        if (m_leading.exchange(false)) {
+            ++m_changes;
+            try {
+                release(*m_connect(), m_options.node);
+            } catch (const std::exception &e) {
+                LogOrigin::dbWarn("Leader", std::format("Releasing the leader lease: {}", e.what()));
+            }
+        }
+    }
+
+    bool LeaderElection::isLeader() const {
+        if (m_always.load()) return true;
+        return m_leading.load() && Clock::now().time_since_epoch().count() < m_validUntil.load();
+    }
+
+    bool LeaderElection::renew() {
+        const auto began = Clock::now();
+        std::string holder;
+        try {
+            holder = claim(*m_connect(), m_options.node, m_options.ttl);
+        } catch (const std::exception &e) {
+            // Still leading until the last renewal's window closes
+            ++m_errors;
+            LogOrigin::dbWarn("Leader", std::format("Renewing the leader lease: {}", e.what()));
+            return isLeader();
+        }
+
+        const bool leading = holder == m_options.node;
+        // A renewal late by a whole interval lets go before the row lapses for the others
+        if (leading) m_validUntil.store((began + std::chrono::duration_cast<Clock::duration>(m_options.ttl) -
+                                         interval()).time_since_epoch().count());
+        {
+            std::lock_guard lock(m_mutex);
+            m_holder = holder;
+        }
+        if (m_leading.exchange(leading) != leading) {
+            ++m_changes;
+            LogOrigin::info("Leader", leading
+                                          ? std::format("Node `{}` is now the leader", m_options.node)
+                                          : std::format("Node `{}` is no longer the leader", m_options.node));
+        }
+        return leading;
+    }
+
+    json LeaderElection::status() const {
+        json holder = nullptr;
+        if (m_always.load()) {
+            holder = m_options.node;
+        } else {
+            std::lock_guard lock(m_mutex);
+            if (!m_holder.empty()) holder = m_holder;
+        }
+        return {{"node", m_options.node}, {"leader", isLeader()}, {"holder", std::move(holder)}};
+    }
+
+    void LeaderElection::writeMetrics(MetricsWriter &out) const {
+        out.family("mb_leader", "1 while this node is the cluster leader", "gauge");
+        out.sample("mb_leader", {{"node", m_options.node}}, isLeader() ? 1 : 0);
+        out.family("mb_leader_changes_total", "Times this node took or lost the leadership", "counter");
+        out.sample("mb_leader_changes_total", {}, static_cast<double>(m_changes.load(std::memory_order_relaxed)));
+        out.family("mb_leader_errors_total", "Renewals of the leader lease that failed", "counter");
+        out.sample("mb_leader_errors_total", {}, static_cast<double>(m_errors.load(std::memory_order_relaxed)));
+    }
+
+    std::string LeaderElection::claim(soci::session &sql, const std::string &node, const std::chrono::seconds ttl) {
+        const bool pg = sql.get_backend_name() == "postgresql";
+        const int secs = static_cast<int>(ttl.count());
+        // Taken when it lapsed, extended when it's ours, left alone otherwise; one statement, so no two nodes both win
+        sql << std::format("INSERT INTO mb_leader_lease (name, owner, expires) VALUES ('leader', :owner, {0} + :ttl) "
+                           "ON CONFLICT (name) DO UPDATE SET owner = excluded.owner, expires = excluded.expires "
+                           "WHERE mb_leader_lease.owner = excluded.owner OR mb_leader_lease.expires < {0}",
+                           epochNow(pg)),
+                soci::use(node, "owner"), soci::use(secs, "ttl");
+
+        std::string holder;
+        soci::indicator ind = soci::i_null;
+        sql << std::format("SELECT owner FROM mb_leader_lease WHERE name = 'leader' AND expires >= {}", epochNow(pg)),
+                soci::into(holder, ind);
+        return sql.got_data() && ind == soci::i_ok ? holder : std::string{};
+    }
+
+    void LeaderElection::release(soci::session &sql, const std::string &node) {
+        sql << "UPDATE mb_leader_lease SET expires = 0 WHERE name = 'leader' AND owner = :owner", soci::use(node, "owner");
+    }
+
+    void LeaderElection::loop() {
+        std::unique_lock lock(m_mutex);
+        while (!m_stopping) {
+            lock.unlock();
+            renew();
+            lock.lock();
+            m_cv.wait_for(lock, interval(), [this] { return m_stopping; });
+        }
+    }
+
+    LeaderElection::Clock::duration LeaderElection::interval() const {
+        return std::chrono::duration_cast<Clock::duration>(m_options.ttl) / 3;
+    }
+}
@@ -0,0 +1,77 @@
+/**
+ * @file listener_options.cpp
+ * @brief Implementation for @see listener_options.h
+ */
+
+#include "../../include/mantisbase/core/listener_options.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <format>
+
+namespace mb {
+    namespace {
+        std::size_t count(const json &values, const char *key) {
+            const auto &value = values.at(key);
+            if (!value.is_number_integer() || value.get<long long>() < 0)
+                throw MantisException(400, std::format("`http.{}` must be a whole number, 0 or more.", key));
+            return value.get<std::size_t>();
+        }
+
+        std::string text(const json &values, const char *key) {
+            const auto &value = values.at(key);
+            if (!value.is_string()) throw MantisException(400, std::format("`http.{}` must be a string.", key));
+            return value.get<std::string>();
+        }
+
+        /// Unset or unparsable variables leave `current` as it is
+        std::size_t countFromEnv(const char *name, const std::size_t current) {
+            const auto value = safe_stoi(getEnvOrDefault(name, ""), -1);
+            return value >= 0 ? static_cast<std::size_t>(value) : current;
+        }
+    }
+
+    void ListenerOptions::merge(const json &values) {
+        if (values.is_null()) return;
+        if (!values.is_object()) throw MantisException(400, "`http` must be a JSON object.");
+
+        if (values.contains("idleTimeout")) idleTimeout = std::chrono::seconds(count(values, "idleTimeout"));
+        if (values.contains("keepAliveRequests")) keepAliveRequests = count(values, "keepAliveRequests");
+        if (values.contains("maxConnections")) maxConnections = count(values, "maxConnections");
+        if (values.contains("maxConnectionsPerIp")) maxConnectionsPerIp = count(values, "maxConnectionsPerIp");
+        if (values.contains("tlsCert")) tlsCert = text(values, "tlsCert");
+        if (values.contains("tlsKey")) tlsKey = text(values, "tlsKey");
+        if (values.contains("tlsSessionTickets")) {
+            if (!values["tlsSessionTickets"].is_boolean())
+                throw MantisException(400, "`http.tlsSessionTickets` must be true or false.");
+            tlsSessionTickets = values["tlsSessionTickets"].get<bool>();
+        }
+    }
+
+    void ListenerOptions::mergeEnv() {
+        idleTimeout = std::chrono::seconds(countFromEnv("MB_HTTP_IDLE_TIMEOUT", idleTimeout.count()));
+        keepAliveRequests = countFromEnv("MB_HTTP_KEEPALIVE_REQUESTS", keepAliveRequests);
+        maxConnections = countFromEnv("MB_HTTP_MAX_CONNECTIONS", maxConnections);
+        maxConnectionsPerIp = countFromEnv("MB_HTTP_MAX_CONNECTIONS_PER_IP", maxConnectionsPerIp);
+        tlsCert = getEnvOrDefault("MB_TLS_CERT", tlsCert);
+        tlsKey = getEnvOrDefault("MB_TLS_KEY", tlsKey);
+        if (const auto tickets = getEnvOrDefault("MB_TLS_SESSION_TICKETS", ""); !tickets.empty())
+            tlsSessionTickets = tickets != "0";
+    }
+
+    std::vector<std::pair<std::string, std::string>> ListenerOptions::sslConfCommands() const {
+        // OpenSSL issues tickets (and keeps a server session cache) by default
+        if (tlsSessionTickets) return {};
+        return {{"Options", "-SessionTicket"}};
+    }
+
+    json ListenerOptions::toJSON() const {
+        return {
+            {"idleTimeout", idleTimeout.count()},
+            {"keepAliveRequests", keepAliveRequests},
+            {"maxConnections", maxConnections},
+            {"maxConnectionsPerIp", maxConnectionsPerIp},
+            {"tlsSessionTickets", tlsSessionTickets}
+        };
+    }
+}
@@ -0,0 +1,153 @@
+#include "../../../include/mantisbase/core/logger/access_log.h"
+#include "../../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <thread>
+
+namespace mb {
+    namespace {
+        /// Rate in [0, 1] parsed from `value`, or `fallback` if it isn't a number.
+        double parseRate(const std::string &value, const double fallback) {
+            if (value.empty()) return fallback;
+            char *end = nullptr;
+            const double rate = std::strtod(value.c_str(), &end);
+            if (end == value.c_str() || *end != '\0' || std::isnan(rate)) return fallback;
+            return std::clamp(rate, 0.0, 1.0);
+        }
+
+        /// Uniform in [0, 1), from a per-thread xorshift generator.
+        double nextUniform() {
+            thread_local std::uint64_t state =
+                    (std::hash<std::thread::id>{}(std::this_thread::get_id()) ^
+                     static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count())) | 1;
+            state ^= state >> 12;
+            state ^= state << 25;
+            state ^= state >> 27;
+            return static_cast<double>((state * 0x2545F4914F6CDD1DULL) >> 11) * 0x1.0p-53;
+        }
+    }
+
+    AccessLog::Options AccessLog::Options::fromEnv() {
+        Options options;
+        options.sampleRate = parseRate(getEnvOrDefault("MB_ACCESS_LOG_SAMPLE", ""), options.sampleRate);
+        options.errorSampleRate = parseRate(getEnvOrDefault("MB_ACCESS_LOG_ERROR_SAMPLE", ""),
+                                            options.errorSampleRate);
+        if (const auto ms = safe_stoi(getEnvOrDefault("MB_ACCESS_LOG_SLOW_MS", ""), -1); ms >= 0)
+            options.slow = std::chrono::milliseconds(ms);
+        if (const auto max = safe_stoi(getEnvOrDefault("MB_ACCESS_LOG_MAX_PER_SEC", ""), -1); max >= 0)
+            options.maxPerSecond = static_cast<std::uint32_t>(max);
+        options.routes = parseRoutes(getEnvOrDefault("MB_ACCESS_LOG_ROUTES", ""));
+        return options;
+    }
+
+    std::vector<std::pair<std::string, double>> AccessLog::Options::parseRoutes(const std::string &spec) {
+        std::vector<std::pair<std::string, double>> routes;
+        std::size_t start = 0;
+        while (start < spec.size()) {
+            auto end = spec.find(',', start);
+            if (end == std::string::npos) end = spec.size();
+            const auto pair = spec.substr(start, end - start);
+            start = end + 1;
+
+            const auto eq = pair.rfind('=');
+            if (eq == std::string::npos || eq == 0) continue;
+            const auto rate = parseRate(pair.substr(eq + 1), -1);
+            if (rate < 0) continue;
+            routes.emplace_back(pair.substr(0, eq), rate);
+        }
+        // Longest prefix first, so the first match is the most specific
+        std::ranges::stable_sort(routes, [](const auto &a, const auto &b) { return a.first.size() > b.first.size(); });
+        return routes;
+    }
+
+    AccessLog::AccessLog() : AccessLog(Options{}) {}
+
+    AccessLog::AccessLog(Options options)
+        : m_options(std::move(options)), m_epoch(Clock::now()) {}
+
+    bool AccessLog::record(const std::string_view path, const int status, const std::chrono::microseconds latency,
+                           const Clock::time_point now) {
+        const auto second = std::chrono::duration_cast<std::chrono::seconds>(now - m_epoch).count();
+        const bool slow = m_options.slow.count() > 0 && latency >= m_options.slow;
+        const auto status_class = std::clamp(status / 100, 1, 5) - 1;
+
+        auto outcome = Outcome::SampledOut;
+        if (const auto rate = slow ? 1.0 : rateFor(path, status); rate >= 1.0 || (rate > 0 && nextUniform() < rate))
+            outcome = allowLine(second) ? Outcome::Logged : Outcome::RateLimited;
+
+        m_total.add(status_class, slow, latency, outcome);
+
+        auto &bucket = m_buckets[static_cast<std::size_t>(second) % kWindow];
+        if (auto seen = bucket.second.load(std::memory_order_relaxed);
+            seen != second && bucket.second.compare_exchange_strong(seen, second, std::memory_order_relaxed))
+            bucket.counters.reset();
+        bucket.counters.add(status_class, slow, latency, outcome);
+
+        return outcome == Outcome::Logged;
+    }
+
+    AccessLog::Snapshot AccessLog::snapshot(const Clock::time_point now) const {
+        Snapshot s;
+        m_total.addTo(s.total);
+
+        const auto second = std::chrono::duration_cast<std::chrono::seconds>(now - m_epoch).count();
+        for (const auto &bucket: m_buckets) {
+            const auto at = bucket.second.load(std::memory_order_relaxed);
+            if (at >= 0 && at <= second && second - at < static_cast<std::int64_t>(kWindow))
+                bucket.counters.addTo(s.lastMinute);
+        }
+        return s;
+    }
+
+    double AccessLog::rateFor(const std::string_view path, const int status) const {
+        if (status >= 400) return m_options.errorSampleRate;
+        for (const auto &[prefix, rate]: m_options.routes)
+            if (path.starts_with(prefix)) return rate;
+        return m_options.sampleRate;
+    }
+
+    bool AccessLog::allowLine(const std::int64_t second) {
+        if (m_options.maxPerSecond == 0) return true;
+        if (auto seen = m_limitSecond.load(std::memory_order_relaxed);
+            seen != second && m_limitSecond.compare_exchange_strong(seen, second, std::memory_order_relaxed))
+            m_limitCount.store(0, std::memory_order_relaxed);
+        return m_limitCount.fetch_add(1, std::memory_order_relaxed) < m_options.maxPerSecond;
+    }
+
+    void AccessLog::Counters::add(const int status_class, const bool slow_request,
+                                  const std::chrono::microseconds latency, const Outcome outcome) {
+        requests.fetch_add(1, std::memory_order_relaxed);
+        byClass[status_class].fetch_add(1, std::memory_order_relaxed);
+        if (slow_request) slow.fetch_add(1, std::memory_order_relaxed);
+        totalUs.fetch_add(static_cast<std::uint64_t>(std::max<std::int64_t>(0, latency.count())),
+                          std::memory_order_relaxed);
+        switch (outcome) {
+            case Outcome::Logged: logged.fetch_add(1, std::memory_order_relaxed);
+                break;
+            case Outcome::SampledOut: sampledOut.fetch_add(1, std::memory_order_relaxed);
+                break;
+            case Outcome::RateLimited: rateLimited.fetch_add(1, std::memory_order_relaxed);
+                break;
+        }
+    }
+
+    void AccessLog::Counters::reset() {
+        for (auto *c: {&requests, &logged, &sampledOut, &rateLimited, &slow, &totalUs})
+            c->store(0, std::memory_order_relaxed);
+        for (auto &c: byClass) c.store(0, std::memory_order_relaxed);
+    }
+
+    void AccessLog::Counters::addTo(Counts &counts) const {
+        counts.requests += requests.load(std::memory_order_relaxed);
+        counts.logged += logged.load(std::memory_order_relaxed);
+        counts.sampledOut += sampledOut.load(std::memory_order_relaxed);
+        counts.rateLimited += rateLimited.load(std::memory_order_relaxed);
+        counts.slow += slow.load(std::memory_order_relaxed);
+        for (std::size_t i = 0; i < byClass.size(); ++i)
+            counts.byClass[i] += byClass[i].load(std::memory_order_relaxed);
+        counts.totalMs += static_cast<double>(totalUs.load(std::memory_order_relaxed)) / 1000.0;
+    }
+}
@@ -4,13 +4,24 @@
 
 #include <soci/sqlite3/soci-sqlite3.h>
 #include <soci/soci.h>
+#include <algorithm>
 #include <chrono>
-#include <iomanip>
+#include <cmath>
+#include <map>
+#include <optional>
+#include <tuple>
 #include <sstream>
 
 #include "mantisbase/mantisbase.h"
 
 namespace mb {
+    namespace {
+        constexpr auto kColumns = "id, timestamp, level, origin, message, details, data, created_at";
+
+        /// Points one rollups() answer may hold
+        constexpr long long kMaxBuckets = 10000;
+    }
+
     LogDatabase::LogDatabase() : m_running(false) {
     }
 
@@ -39,9 +50,12 @@ namespace mb {
             // Create table
             createTable();
 
-            // Start cleanup thread
+            // Start the batching writer
+            m_queue = std::make_unique<LogQueue>([this](auto &batch) { writeBatch(batch); },
+                                                 LogQueue::Options::fromEnv());
+            m_queue->start();
+
             m_running.store(true);
-            m_cleanupThread = std::thread(&LogDatabase::cleanupThread, this);
 
             return true;
         } catch (const std::exception &e) {
@@ -53,24 +67,70 @@ namespace mb {
 
     void LogDatabase::shutdown() {
         m_running.store(false);
-        m_cv.notify_all();
 
-        if (m_cleanupThread.joinable()) m_cleanupThread.join();
+        // Writes what is still queued
+        if (m_queue) {
+            m_queue->stop();
+            m_queue.reset();
+        }
+        std::lock_guard lock(m_dbMutexLock);
         if (m_session) {
             m_session->close();
             m_session.reset();
         }
     }
 
-    void LogDatabase::createTable() const {
+    void LogDatabase::createTable() {
         if (!m_session) {
             std::cerr << "LogDatabase::createTable: Session is NULL" << std::endl;
             return;
         }
 
-        // Create new table schema
+        // Each partition gets a full-text index over message and details, if this build has FTS5
+        try {
+            *m_session << "CREATE VIRTUAL TABLE temp.mb_fts_probe USING fts5(x)";
+            *m_session << "DROP TABLE temp.mb_fts_probe";
+            m_hasFts = true;
+        } catch (const std::exception &e) {
+            // Use spdlog directly to avoid recursion
+            spdlog::warn("Log search falls back to LIKE, FTS5 is unavailable: {}", e.what());
+            m_hasFts = false;
+        }
+
+        m_partitions.clear();
+        const soci::rowset<std::string> names = (m_session->prepare <<
+            "SELECT name FROM sqlite_master WHERE type = 'table' "
+            "AND name GLOB 'mb_logs_[0-9][0-9][0-9][0-9][0-9][0-9][0-9][0-9]'");
+        for (const auto &name: names)
+            m_partitions.insert(name);
+
+        migrateLegacyTable();
+        createRollups();
+
+        // Slow queries are few, so they share one table, trimmed by created_at
         *m_session << R"(
-                CREATE TABLE IF NOT EXISTS mb_logs (
+                CREATE TABLE IF NOT EXISTS mb_slow_queries (
+                    id INTEGER PRIMARY KEY,
+                    created_at INTEGER NOT NULL,
+                    fingerprint TEXT NOT NULL,
+                    query TEXT NOT NULL,
+                    sql TEXT NOT NULL,
+                    params TEXT,
+                    duration_ms REAL NOT NULL,
+                    rows INTEGER,
+                    plan TEXT
+                )
+            )";
+        *m_session << "CREATE INDEX IF NOT EXISTS idx_mb_slow_queries_fingerprint "
+                "ON mb_slow_queries(fingerprint, created_at)";
+        *m_session << "CREATE INDEX IF NOT EXISTS idx_mb_slow_queries_created_at ON mb_slow_queries(created_at)";
+    }
+
+    void LogDatabase::ensurePartition(const std::string &name) {
+        if (m_partitions.contains(name)) return;
+
+        *m_session << std::format(R"(
+                CREATE TABLE IF NOT EXISTS {} (
                     id text PRIMARY KEY,
                     timestamp TEXT NOT NULL,
                     level TEXT NOT NULL,
@@ -80,20 +140,78 @@ namespace mb {
                     data TEXT,
                     created_at INTEGER NOT NULL
                 )
-            )";
+            )", name);
+
+        // Create indexes for better query performance; pages are keyed on (created_at, id)
+        *m_session << std::format("CREATE INDEX IF NOT EXISTS idx_{0}_timestamp ON {0}(timestamp)", name);
+        *m_session << std::format("CREATE INDEX IF NOT EXISTS idx_{0}_level ON {0}(level)", name);
+        *m_session << std::format("CREATE INDEX IF NOT EXISTS idx_{0}_origin ON {0}(origin)", name);
+        *m_session << std::format("CREATE INDEX IF NOT EXISTS idx_{0}_created_at_id ON {0}(created_at, id)", name);
 
-        // Create indexes for better query performance
-        *m_session << "CREATE INDEX IF NOT EXISTS idx_mb_logs_timestamp ON mb_logs(timestamp)";
-        *m_session << "CREATE INDEX IF NOT EXISTS idx_mb_logs_level ON mb_logs(level)";
-        *m_session << "CREATE INDEX IF NOT EXISTS idx_mb_logs_origin ON mb_logs(origin)";
-        *m_session << "CREATE INDEX IF NOT EXISTS idx_mb_logs_message ON mb_logs(message)";
-        *m_session << "CREATE INDEX IF NOT EXISTS idx_mb_logs_created_at ON mb_logs(created_at)";
+        if (m_hasFts)
+            *m_session << std::format("CREATE VIRTUAL TABLE IF NOT EXISTS {0}_fts USING fts5("
+                                      "message, details, content='{0}', content_rowid='rowid')", name);
+
+        m_partitions.insert(name);
+    }
+
+    void LogDatabase::migrateLegacyTable() {
+        int exists = 0;
+        *m_session << "SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name = 'mb_logs'",
+                soci::into(exists);
+        if (!exists) return;
+
+        // Move rows of the single pre-partitioning table into their day partitions
+        std::vector<long long> days;
+        const soci::rowset<long long> rs = (m_session->prepare << "SELECT DISTINCT created_at / 86400 FROM mb_logs");
+        for (const auto day: rs) days.push_back(day);
+
+        for (const auto day: days) ensurePartition(partitionName(day * 86400));
+
+        soci::transaction tr(*m_session);
+        for (auto day: days) {
+            const auto name = partitionName(day * 86400);
+            long long from = day * 86400, to = from + 86400;
+            *m_session << std::format("INSERT OR IGNORE INTO {} ({}) SELECT {} FROM mb_logs "
+                                      "WHERE created_at >= :from AND created_at < :to", name, kColumns, kColumns),
+                    soci::use(from), soci::use(to);
+            if (m_hasFts)
+                *m_session << std::format("INSERT INTO {0}_fts({0}_fts) VALUES ('rebuild')", name);
+        }
+        *m_session << "DROP TABLE IF EXISTS mb_logs_fts";
+        *m_session << "DROP TABLE mb_logs";
+        tr.commit();
+    }
+
+    void LogDatabase::createRollups() {
+        int exists = 0;
+        *m_session << "SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name = 'mb_log_rollups'",
+                soci::into(exists);
+        if (exists) return;
+
+        soci::transaction tr(*m_session);
+        *m_session << R"(
+                CREATE TABLE mb_log_rollups (
+                    minute INTEGER NOT NULL,
+                    level TEXT NOT NULL,
+                    origin TEXT NOT NULL,
+                    route TEXT NOT NULL,
+                    count INTEGER NOT NULL,
+                    PRIMARY KEY (minute, level, origin, route)
+                ) WITHOUT ROWID
+            )";
+        // Once, for the days kept from before the rollups; routes weren't recorded then
+        for (const auto &name: m_partitions)
+            *m_session << std::format("INSERT INTO mb_log_rollups (minute, level, origin, route, count) "
+                                      "SELECT created_at / 60 * 60, level, origin, '', COUNT(*) FROM {} "
+                                      "GROUP BY created_at / 60, level, origin", name);
+        tr.commit();
     }
 
     bool LogDatabase::insertLog(const std::string &level, const std::string &origin, const std::string &message,
                                 const std::string &details, const json &data) {
         try {
-            if (!m_session) {
+            if (!m_session || !m_queue) {
                 std::cerr << "LogDatabase::insertLog: Insert error, session is NULL" << std::endl;
                 return false;
             }
@@ -104,34 +222,34 @@ namespace mb {
             const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
                                 now.time_since_epoch()) % 1000;
 
-            // Format timestamp as ISO 8601 (UTC)
-            const std::tm utc = toUtcTime(time_t);
-            std::stringstream ss;
-            ss << std::put_time(&utc, "%Y-%m-%dT%H:%M:%S");
-            ss << "." << std::setfill('0') << std::setw(3) << ms.count() << "Z";
-            std::string timestamp = ss.str();
+            // Format timestamp as ISO 8601 (UTC), `YYYY-MM-DDTHH:MM:SS.mmmZ`
+            char stamp[kIsoDateTimeLength + 5];
+            formatIsoDateTime(toUtcTime(time_t), stamp, 'T');
+            auto millis = static_cast<int>(ms.count());
+            stamp[kIsoDateTimeLength] = '.';
+            for (std::size_t i = kIsoDateTimeLength + 3; i > kIsoDateTimeLength; --i, millis /= 10)
+                stamp[i] = static_cast<char>('0' + millis % 10);
+            stamp[kIsoDateTimeLength + 4] = 'Z';
+            std::string timestamp(stamp, sizeof(stamp));
 
             // Get Unix timestamp for sorting/cleanup
             auto created_at = std::chrono::duration_cast<std::chrono::seconds>(
                 now.time_since_epoch()).count();
 
 
-            {
-                // Local scope
-                // Serialize data JSON
-                std::string data_str = data.empty() ? "" : data.dump();
-                auto id = generate_uuidv7();
-
-                std::lock_guard lock(m_dbMutexLock);
-
-                // Insert log entry
-                *m_session << "INSERT INTO mb_logs (id, timestamp, level, origin, message, details, data, created_at) "
-                        "VALUES (:id, :timestamp, :level, :origin, :message, :details, :data, :created_at)",
-                        soci::use(id), soci::use(timestamp), soci::use(level), soci::use(origin),
-                        soci::use(message), soci::use(details), soci::use(data_str), soci::use(created_at);
-            }
-
-            return true;
+            LogQueue::Entry entry;
+            entry.id = generate_uuidv7();
+            entry.timestamp = std::move(timestamp);
+            entry.level = level;
+            entry.origin = origin;
+            entry.message = message;
+            entry.details = details;
+            entry.data = data.empty() ? "" : data.dump();
+            entry.createdAt = created_at;
+            if (data.is_object())
+                if (const auto it = data.find("route"); it != data.end() && it->is_string())
+                    entry.route = it->get<std::string>();
+            return m_queue->push(std::move(entry));
         } catch (const std::exception &e) {
             // Use spdlog directly to avoid recursion
             spdlog::error("Failed to insert log: {}", e.what());
@@ -164,55 +282,68 @@ namespace mb {
                 "timestamp" || sort_by == "created_at") {
                 valid_sort_by = sort_by;
             }
+            // Time order is keyed on (created_at, id); ids are UUIDv7, so they order within a second
+            const bool by_time = valid_sort_by == "timestamp" || valid_sort_by == "created_at";
+            const std::string sort_column = by_time ? "created_at" : valid_sort_by;
 
             // Validate sort_order
             std::string valid_sort_order = (sort_order == "asc") ? "ASC" : "DESC";
+            const std::string op = valid_sort_order == "ASC" ? ">" : "<";
 
-            std::string query = "SELECT id, timestamp, level, origin, message, details, data, created_at FROM mb_logs";
+            // Per partition; `{0}` is the partition table
+            std::string query = std::format("SELECT {} FROM {{0}}", kColumns);
 
             std::vector<std::string> conditions;
+            soci::values vals;
 
             if (!after.empty()) {
-                if (valid_sort_order == "ASC")
-                    conditions.push_back(valid_sort_by + " > '" + after + "'");
-                else
-                    conditions.push_back(valid_sort_by + " < '" + after + "'");
+                // `<sort value>|<id>`; a bare id (older cursors) pages on id alone
+                if (const auto sep = after.rfind('|'); sep == std::string::npos) {
+                    conditions.push_back("id " + op + " :after_id");
+                    vals.set("after_id", after);
+                } else {
+                    conditions.push_back("(" + sort_column + ", id) " + op + " (:after_value, :after_id)");
+                    if (by_time) {
+                        long long value = 0;
+                        try {
+                            value = std::stoll(after.substr(0, sep));
+                        } catch (const std::exception &) {
+                            throw MantisException(400, "Invalid cursor");
+                        }
+                        vals.set("after_value", value);
+                    } else
+                        vals.set("after_value", after.substr(0, sep));
+                    vals.set("after_id", after.substr(sep + 1));
+                }
             }
 
             if (!level_filter.empty()) {
                 if (level_filter.starts_with('>')) {
                     conditions.push_back(buildMinLogWhereCondition(level_filter.substr(1)));
                 } else {
-                    conditions.push_back(std::string("level = '") + level_filter + "'");
+                    conditions.push_back("level = :level");
+                    vals.set("level", level_filter);
                 }
             }
             if (!search_filter.empty()) {
-                std::string escaped = search_filter;
-                size_t pos = 0;
-                while ((pos = escaped.find('\'', pos)) != std::string::npos) {
-                    escaped.replace(pos, 1, "''");
-                    pos += 2;
+                if (m_hasFts) {
+                    if (const auto match = ftsQuery(search_filter); !match.empty()) {
+                        conditions.push_back("rowid IN (SELECT rowid FROM {0}_fts WHERE {0}_fts MATCH :search)");
+                        vals.set("search", match);
+                    }
+                } else {
+                    conditions.push_back("(message LIKE :search OR details LIKE :search_details)");
+                    vals.set("search", "%" + search_filter + "%");
+                    vals.set("search_details", "%" + search_filter + "%");
                 }
-                conditions.push_back(std::string("(message LIKE '%") + escaped +
-                        "%' OR details LIKE '%" + escaped + "%')");
             }
             if (!start_date.empty()) {
-                std::string escaped = start_date;
-                size_t pos = 0;
-                while ((pos = escaped.find('\'', pos)) != std::string::npos) {
-                    escaped.replace(pos, 1, "''");
-                    pos += 2;
-                }
-                conditions.push_back(std::string("timestamp >= '") + escaped + "'");
+                conditions.push_back("timestamp >= :start_date");
+                vals.set("start_date", start_date);
             }
             if (!end_date.empty()) {
-                std::string escaped = end_date;
-                size_t pos = 0;
-                while ((pos = escaped.find('\'', pos)) != std::string::npos) {
-                    escaped.replace(pos, 1, "''");
-                    pos += 2;
-                }
-                conditions.push_back(std::string("timestamp <= '") + escaped + "'");
+                conditions.push_back("timestamp <= :end_date");
+                vals.set("end_date", end_date);
             }
 
             if (!conditions.empty()) {
@@ -223,38 +354,70 @@ namespace mb {
                 }
             }
 
-            query += " ORDER BY " + valid_sort_by + " " + valid_sort_order;
-            query += " LIMIT " + std::to_string(limit);
+            query += " ORDER BY " + sort_column + " " + valid_sort_order + ", id " + valid_sort_order;
+            query += " LIMIT {1}";
+
+            const auto read_rows = [&](const std::string &partition, const int max_rows) {
+                const auto sql = std::vformat(query, std::make_format_args(partition, max_rows));
+                for (const soci::rowset rs = (m_session->prepare << sql, soci::use(vals)); const auto &r: rs) {
+                    json log_entry = json::object();
+                    log_entry["id"] = r.get<std::string>(0);
+                    log_entry["timestamp"] = r.get<std::string>(1);
+                    log_entry["level"] = r.get<std::string>(2);
+                    log_entry["origin"] = r.get<std::string>(3);
+                    log_entry["message"] = r.get<std::string>(4);
+                    log_entry["details"] = r.get<std::string>(5);
+                    log_entry["data"] = json::object();
+
+                    if (auto data_str = r.get<std::string>(6); !trim(data_str).empty()) {
+                        try {
+                            log_entry["data"] = json::parse(data_str);
+                        } catch (...) {
+                            log_entry["data"] = trim(data_str);
+                        }
+                    }
+
+                    log_entry["created_at"] = r.get<long long>(7);
+                    logs_array.push_back(log_entry);
+                }
+            };
 
             std::lock_guard lock(m_dbMutexLock);
 
-            for (const soci::rowset rs = (m_session->prepare << query); const auto &r: rs) {
-                json log_entry = json::object();
-                log_entry["id"] = r.get<std::string>(0);
-                log_entry["timestamp"] = r.get<std::string>(1);
-                log_entry["level"] = r.get<std::string>(2);
-                log_entry["origin"] = r.get<std::string>(3);
-                log_entry["message"] = r.get<std::string>(4);
-                log_entry["details"] = r.get<std::string>(5);
-                log_entry["data"] = json::object();
-
-                if (auto data_str = r.get<std::string>(6); !trim(data_str).empty()) {
-                    try {
-                        log_entry["data"] = json::parse(data_str);
-                    } catch (...) {
-                        log_entry["data"] = trim(data_str);
-                    }
+            // Partitions outside the date range can't match
+            const auto from = partitionForDate(start_date), to = partitionForDate(end_date);
+            std::vector<std::string> partitions;
+            for (const auto &name: m_partitions)
+                if ((from.empty() || name >= from) && (to.empty() || name <= to))
+                    partitions.push_back(name);
+            if (valid_sort_order == "DESC") std::ranges::reverse(partitions);
+
+            if (by_time) {
+                // Partitions hold disjoint days, so read them in order until the page is full
+                for (const auto &name: partitions) {
+                    if (static_cast<int>(logs_array.size()) >= limit) break;
+                    read_rows(name, limit - static_cast<int>(logs_array.size()));
                 }
-
-                log_entry["created_at"] = r.get<long long>(7);
-                logs_array.push_back(log_entry);
+            } else {
+                // Take each partition's best page, then merge
+                for (const auto &name: partitions) read_rows(name, limit);
+                const bool asc = valid_sort_order == "ASC";
+                std::ranges::stable_sort(logs_array, [&](const json &a, const json &b) {
+                    const auto &x = a[valid_sort_by].get_ref<const std::string &>();
+                    const auto &y = b[valid_sort_by].get_ref<const std::string &>();
+                    if (x != y) return asc ? x < y : x > y;
+                    return asc ? a["id"] < b["id"] : a["id"] > b["id"];
+                });
+                if (static_cast<int>(logs_array.size()) > limit) logs_array.erase(logs_array.begin() + limit, logs_array.end());
             }
 
             std::string cursor;
             if (!logs_array.empty()) {
                 const auto &last = logs_array.back();
-                if (last.contains("id"))
-                    cursor = last["id"].get<std::string>();
+                const auto value = by_time
+                                       ? std::to_string(last["created_at"].get<long long>())
+                                       : last[valid_sort_by].get<std::string>();
+                cursor = value + "|" + last["id"].get<std::string>();
             }
 
             result["data"] = json::object();
@@ -262,6 +425,9 @@ namespace mb {
             result["data"]["cursor"] = cursor;
             result["data"]["items"] = logs_array;
             result["data"]["items_count"] = logs_array.size();
+            result["data"]["pipeline"] = stats();
+        } catch (const MantisException &) {
+            throw;
         } catch (const std::exception &e) {
             throw MantisException(500, std::string("Failed to fetch logs: ") + e.what());
         }
@@ -269,50 +435,293 @@ namespace mb {
         return result;
     }
 
-    void LogDatabase::cleanupThread() {
-        // Run cleanup every hour
-        const auto cleanup_interval = std::chrono::hours(1);
+    void LogDatabase::writeBatch(std::vector<LogQueue::Entry> &batch) {
+        std::lock_guard lock(m_dbMutexLock);
+
+        // Create partitions outside the transaction, so a failed batch can't roll one back
+        for (const auto &entry: batch) ensurePartition(partitionName(entry.createdAt));
+        // Counted before the entries are moved from; stored with them, so a failed batch counts nothing
+        const auto counts = rollup(batch);
+
+        LogQueue::Entry row;
+        std::string partition;
+        std::unique_ptr<soci::statement> st, fts;
+        soci::transaction tr(*m_session);
+        for (auto &entry: batch) {
+            row = std::move(entry);
+            // A batch rarely spans more than one day
+            if (auto name = partitionName(row.createdAt); name != partition) {
+                partition = std::move(name);
+                st = std::make_unique<soci::statement>(m_session->prepare << std::format(
+                                                           "INSERT INTO {} ({}) VALUES (:id, :timestamp, :level, :origin, "
+                                                           ":message, :details, :data, :created_at)", partition, kColumns),
+                                                       soci::use(row.id), soci::use(row.timestamp),
+                                                       soci::use(row.level), soci::use(row.origin),
+                                                       soci::use(row.message), soci::use(row.details),
+                                                       soci::use(row.data), soci::use(row.createdAt));
+                if (m_hasFts)
+                    fts = std::make_unique<soci::statement>(m_session->prepare << std::format(
+                                                                "INSERT INTO {0}_fts(rowid, message, details) "
+                                                                "VALUES (last_insert_rowid(), :message, :details)",
+                                                                partition),
+                                                            soci::use(row.message), soci::use(row.details));
+            }
+            st->execute(true);
+            if (fts) fts->execute(true);
+        }
 
-        while (m_running.load()) {
+        Rollup count;
+        soci::statement add = (m_session->prepare <<
+            "INSERT INTO mb_log_rollups (minute, level, origin, route, count) "
+            "VALUES (:minute, :level, :origin, :route, :count) "
+            "ON CONFLICT (minute, level, origin, route) DO UPDATE SET count = count + excluded.count",
+            soci::use(count.minute), soci::use(count.level), soci::use(count.origin), soci::use(count.route),
+            soci::use(count.count));
+        for (const auto &c: counts) {
+            count = c;
+            add.execute(true);
+        }
+        tr.commit();
+    }
+
+    std::vector<LogDatabase::Rollup> LogDatabase::rollup(const std::vector<LogQueue::Entry> &batch) {
+        std::map<std::tuple<long long, std::string_view, std::string_view, std::string_view>, long long> counts;
+        for (const auto &entry: batch)
+            ++counts[{entry.createdAt - entry.createdAt % 60, entry.level, entry.origin, entry.route}];
+
+        std::vector<Rollup> rows;
+        rows.reserve(counts.size());
+        for (const auto &[key, n]: counts) {
+            const auto &[minute, level, origin, route] = key;
+            rows.push_back({minute, std::string(level), std::string(origin), std::string(route), n});
+        }
+        return rows;
+    }
+
+    json LogDatabase::rollups(const std::string &by, const long long since, const long long until,
+                              const long long bucket, const std::string &level) {
+        if (by != "level" && by != "origin" && by != "route")
+            throw MantisException(400, "`by` must be `level`, `origin` or `route`.");
+        if (bucket < 60 || bucket % 60 != 0) throw MantisException(400, "`bucket` must be a multiple of 60 seconds.");
+        if (until <= since) return json::array();
+        if ((until - since) / bucket > kMaxBuckets)
+            throw MantisException(400, std::format("At most {} buckets per request; widen `bucket`.", kMaxBuckets));
+
+        try {
+            std::lock_guard lock(m_dbMutexLock);
+            if (!m_session) return json::array();
+
+            auto query = std::format("SELECT minute / {0} * {0} AS t, {1}, SUM(count) FROM mb_log_rollups "
+                                     "WHERE minute >= :since AND minute < :until", bucket, by);
+            soci::values vals;
+            vals.set("since", since);
+            vals.set("until", until);
+            if (!level.empty()) {
+                query += " AND level = :level";
+                vals.set("level", level);
+            }
+            query += std::format(" GROUP BY t, {0} ORDER BY t, {0}", by);
+
+            auto items = json::array();
+            long long time = 0, count = 0;
+            std::string key;
+            soci::statement st = (m_session->prepare << query, soci::use(vals), soci::into(time), soci::into(key),
+                                  soci::into(count));
+            st.execute();
+            while (st.fetch()) items.push_back({{"time", time}, {"key", key}, {"count", count}});
+            return items;
+        } catch (const std::exception &e) {
+            throw MantisException(500, std::string("Failed to fetch log rollups: ") + e.what());
+        }
+    }
+
+    json LogDatabase::alerts(const long long window, const double per_minute) {
+        const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        // Whole minutes, the current one included
+        const auto minutes = std::max(1LL, (window + 59) / 60);
+        const long long since = now - now % 60 - (minutes - 1) * 60;
+        const auto min_count = static_cast<long long>(std::ceil(per_minute * static_cast<double>(minutes)));
+
+        try {
+            std::lock_guard lock(m_dbMutexLock);
+            if (!m_session) return json::array();
+
+            auto items = json::array();
+            std::string origin;
+            long long count = 0;
+            const long long at_least = std::max(1LL, min_count);
+            soci::statement st = (m_session->prepare <<
+                "SELECT origin, SUM(count) AS n FROM mb_log_rollups WHERE minute >= :since AND level = 'critical' "
+                "GROUP BY origin HAVING SUM(count) >= :at_least ORDER BY n DESC",
+                soci::use(since), soci::use(at_least), soci::into(origin), soci::into(count));
+            st.execute();
+            while (st.fetch())
+                items.push_back({{"origin", origin}, {"count", count},
+                                 {"per_minute", static_cast<double>(count) / static_cast<double>(minutes)}});
+            return items;
+        } catch (const std::exception &e) {
+            throw MantisException(500, std::string("Failed to fetch log alerts: ") + e.what());
+        }
+    }
+
+    void LogDatabase::insertSlowQuery(const json &entry) {
+        std::lock_guard lock(m_dbMutexLock);
+        if (!m_session) return;
+
+        const auto created_at = entry.value("created_at", 0LL);
+        const auto fingerprint = entry.value("fingerprint", std::string{});
+        const auto query = entry.value("query", std::string{});
+        const auto sql = entry.value("sql", std::string{});
+        const auto params = entry.value("params", json::array()).dump();
+        const auto duration_ms = entry.value("duration_ms", 0.0);
+        long long rows = 0;
+        auto rows_ind = soci::i_null;
+        if (entry.contains("rows") && entry["rows"].is_number_integer()) {
+            rows = entry["rows"].get<long long>();
+            rows_ind = soci::i_ok;
+        }
+        std::string plan;
+        auto plan_ind = soci::i_null;
+        if (entry.contains("plan") && !entry["plan"].is_null()) {
+            plan = entry["plan"].dump();
+            plan_ind = soci::i_ok;
+        }
+
+        *m_session << "INSERT INTO mb_slow_queries (created_at, fingerprint, query, sql, params, duration_ms, rows, plan) "
+                "VALUES (:created_at, :fingerprint, :query, :sql, :params, :duration_ms, :rows, :plan)",
+                soci::use(created_at), soci::use(fingerprint), soci::use(query), soci::use(sql),
+                soci::use(params), soci::use(duration_ms), soci::use(rows, rows_ind), soci::use(plan, plan_ind);
+    }
+
+    json LogDatabase::slowQueries(int limit, const long long since) {
+        limit = std::clamp(limit, 1, 1000);
+        const auto parse = [](const std::string &text, const soci::indicator ind) {
+            return ind == soci::i_ok ? json::parse(text, nullptr, false) : json(nullptr);
+        };
+
+        try {
+            std::lock_guard lock(m_dbMutexLock);
+            if (!m_session) return json::array();
+
+            struct Group {
+                std::string fingerprint;
+                long long count, lastSeen;
+                double totalMs, maxMs;
+            };
+            std::vector<Group> groups;
             {
-                std::unique_lock<std::mutex> lock(m_dbMutexLock);
-                m_cv.wait_for(lock, std::chrono::milliseconds(cleanup_interval));
+                Group g{};
+                soci::statement st = (m_session->prepare <<
+                    "SELECT fingerprint, COUNT(*), SUM(duration_ms), MAX(duration_ms), MAX(created_at) "
+                    "FROM mb_slow_queries WHERE created_at >= :since "
+                    "GROUP BY fingerprint ORDER BY SUM(duration_ms) DESC LIMIT :limit",
+                    soci::into(g.fingerprint), soci::into(g.count), soci::into(g.totalMs),
+                    soci::into(g.maxMs), soci::into(g.lastSeen), soci::use(since), soci::use(limit));
+                st.execute();
+                while (st.fetch()) groups.push_back(g);
             }
 
-            deleteOldLogs(5);
+            auto items = json::array();
+            for (const auto &g: groups) {
+                std::string query, sql, params, plan;
+                soci::indicator params_ind = soci::i_null, plan_ind = soci::i_null;
+                *m_session << "SELECT query, sql, params FROM mb_slow_queries "
+                        "WHERE fingerprint = :fingerprint AND created_at >= :since ORDER BY duration_ms DESC LIMIT 1",
+                        soci::into(query), soci::into(sql), soci::into(params, params_ind),
+                        soci::use(g.fingerprint), soci::use(since);
+                // Plans are captured now and then, so take the latest whenever it was
+                *m_session << "SELECT plan FROM mb_slow_queries WHERE fingerprint = :fingerprint "
+                        "AND plan IS NOT NULL ORDER BY created_at DESC, id DESC LIMIT 1",
+                        soci::into(plan, plan_ind), soci::use(g.fingerprint);
+
+                items.push_back({
+                    {"fingerprint", g.fingerprint}, {"query", query}, {"count", g.count},
+                    {"total_ms", g.totalMs}, {"avg_ms", g.totalMs / static_cast<double>(g.count)},
+                    {"max_ms", g.maxMs}, {"last_seen", g.lastSeen},
+                    {"sql", sql}, {"params", parse(params, params_ind)}, {"plan", parse(plan, plan_ind)}
+                });
+            }
+            return items;
+        } catch (const std::exception &e) {
+            throw MantisException(500, std::string("Failed to fetch slow queries: ") + e.what());
         }
     }
 
+    void LogDatabase::flush() {
+        if (m_queue) m_queue->flush();
+    }
+
+    json LogDatabase::stats() const {
+        if (!m_queue) return json::object();
+        const auto s = m_queue->stats();
+        return {
+            {"queued", s.queued}, {"written", s.written}, {"batches", s.batches},
+            {"dropped", s.dropped}, {"failed", s.failed}, {"capacity", s.capacity}
+        };
+    }
+
     void LogDatabase::deleteOldLogs(const int days) {
         try {
+            // Locked first, as the retention job may run while shutdown() closes the session
+            std::lock_guard lock(m_dbMutexLock);
             if (!m_session) {
                 std::cerr << "LogDatabase::deleteOldLogs: Delete error, session is NULL" << std::endl;
                 return;
             }
 
-            std::lock_guard lock(m_dbMutexLock);
-
-            // Calculate cutoff timestamp (5 days ago)
+            // Drop the partitions of whole days before the cutoff (5 days ago); no rows are deleted
             const auto cutoff = std::chrono::system_clock::now() - std::chrono::hours(24 * days);
-            auto cutoff_seconds = std::chrono::duration_cast<std::chrono::seconds>(
-                cutoff.time_since_epoch()).count();
-
-            // Delete old logs
-            *m_session << "DELETE FROM mb_logs WHERE created_at < :cutoff",
-                    soci::use(cutoff_seconds);
-
-            // Vacuum database periodically to reclaim space
-            static int vacuum_counter = 0;
-            if (++vacuum_counter % 24 == 0) {
-                // Every 24 hours (once per day)
-                *m_session << "VACUUM";
+            const auto keep_from = partitionName(std::chrono::duration_cast<std::chrono::seconds>(
+                cutoff.time_since_epoch()).count());
+
+            for (auto it = m_partitions.begin(); it != m_partitions.end() && *it < keep_from;) {
+                if (m_hasFts) *m_session << std::format("DROP TABLE IF EXISTS {}_fts", *it);
+                *m_session << std::format("DROP TABLE IF EXISTS {}", *it);
+                it = m_partitions.erase(it);
             }
+
+            const auto cutoff_s = std::chrono::duration_cast<std::chrono::seconds>(cutoff.time_since_epoch()).count();
+            *m_session << "DELETE FROM mb_slow_queries WHERE created_at < :cutoff", soci::use(cutoff_s);
+            *m_session << "DELETE FROM mb_log_rollups WHERE minute < :cutoff", soci::use(cutoff_s);
         } catch (const std::exception &e) {
             // Use spdlog directly to avoid recursion
             spdlog::error("Failed to delete old logs: {}", e.what());
         }
     }
 
+    std::string LogDatabase::partitionName(const long long created_at) {
+        using namespace std::chrono;
+        const year_month_day ymd{floor<days>(sys_seconds{seconds{created_at}})};
+        return std::format("mb_logs_{:04}{:02}{:02}", static_cast<int>(ymd.year()),
+                           static_cast<unsigned>(ymd.month()), static_cast<unsigned>(ymd.day()));
+    }
+
+    std::string LogDatabase::partitionForDate(const std::string &date) {
+        // `YYYY-MM-DD...`, as in ISO 8601 timestamps
+        if (date.size() < 10 || date[4] != '-' || date[7] != '-') return "";
+        std::string digits = date.substr(0, 4) + date.substr(5, 2) + date.substr(8, 2);
+        if (!std::ranges::all_of(digits, [](const char c) { return c >= '0' && c <= '9'; })) return "";
+        return "mb_logs_" + digits;
+    }
+
+    std::string LogDatabase::ftsQuery(const std::string &search) {
+        // Each word becomes a quoted prefix term, so FTS5 operators and
+        // punctuation in the input are matched as text, not parsed
+        std::string query;
+        std::istringstream words(search);
+        for (std::string word; words >> word;) {
+            if (!query.empty()) query += ' ';
+            query += '"';
+            for (const char c: word) {
+                if (c == '"') query += '"';
+                query += c;
+            }
+            query += "\"*";
+        }
+        return query;
+    }
+
     std::string LogDatabase::buildMinLogWhereCondition(const std::string &level) {
         std::stringstream ss;
         bool first = true;
@@ -0,0 +1,200 @@
+#include "../../../include/mantisbase/core/logger/log_queue.h"
+#include "../../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <bit>
+#include <spdlog/spdlog.h>
+
+namespace mb {
+    LogQueue::Options LogQueue::Options::fromEnv() {
+        Options options;
+        if (const auto size = safe_stoi(getEnvOrDefault("MB_LOG_QUEUE_SIZE", ""), 0); size > 0)
+            options.capacity = static_cast<std::size_t>(size);
+        if (const auto batch = safe_stoi(getEnvOrDefault("MB_LOG_BATCH_SIZE", ""), 0); batch > 0)
+            options.batch = static_cast<std::size_t>(batch);
+        if (const auto ms = safe_stoi(getEnvOrDefault("MB_LOG_FLUSH_MS", ""), 0); ms > 0)
+            options.flush = std::chrono::milliseconds(ms);
+
+        const auto policy = getEnvOrDefault("MB_LOG_DROP_POLICY", "drop_newest");
+        if (policy == "drop_oldest") options.policy = Policy::DropOldest;
+        else if (policy == "block") options.policy = Policy::Block;
+        return options;
+    }
+
+    LogQueue::LogQueue(Writer writer, const Options options)
+        : m_writer(std::move(writer)), m_options(options),
+          m_mask(std::bit_ceil(std::max<std::size_t>(2, options.capacity)) - 1),
+          m_cells(std::make_unique<Cell[]>(m_mask + 1)) {
+        for (std::size_t i = 0; i <= m_mask; ++i)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    LogQueue::~LogQueue() {
+        stop();
+    }
+
+    void LogQueue::start() {
+        std::lock_guard lock(m_mutex);
+        if (m_thread.joinable()) return;
+        m_stopping = false;
+        m_running.store(true);
+        m_thread = std::thread(&LogQueue::loop, this);
+    }
+
+    void LogQueue::stop() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable()) m_thread.join();
+        m_running.store(false);
+        flush();
+    }
+
+    bool LogQueue::push(Entry entry) {
+        if (tryPush(entry)) return true;
+
+        switch (m_options.policy) {
+            case Policy::DropNewest:
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+
+            case Policy::DropOldest: {
+                // Another producer may take the freed slot first; try a few times
+                for (int attempt = 0; attempt < 4; ++attempt) {
+                    if (Entry oldest; tryPop(oldest)) m_dropped.fetch_add(1, std::memory_order_relaxed);
+                    if (tryPush(entry)) return false;
+                }
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+
+            case Policy::Block:
+                while (!tryPush(entry)) {
+                    if (!m_running.load()) {
+                        // No writer to make room; write a batch here
+                        drain();
+                        continue;
+                    }
+                    {
+                        std::lock_guard lock(m_mutex);
+                        m_wake = true;
+                    }
+                    m_cv.notify_one();
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                }
+                return true;
+        }
+        return false;
+    }
+
+    void LogQueue::flush() {
+        while (drain() > 0) {}
+    }
+
+    std::size_t LogQueue::drain() {
+        std::lock_guard lock(m_drainMutex);
+
+        std::vector<Entry> batch;
+        batch.reserve(std::min(m_options.batch, m_size.load(std::memory_order_relaxed)));
+        for (Entry entry; batch.size() < m_options.batch && tryPop(entry);)
+            batch.push_back(std::move(entry));
+        if (batch.empty()) return 0;
+
+        const auto taken = batch.size();
+        try {
+            m_writer(batch);
+            m_written.fetch_add(taken, std::memory_order_relaxed);
+            m_batches.fetch_add(1, std::memory_order_relaxed);
+        } catch (const std::exception &e) {
+            // Use spdlog directly to avoid recursion
+            m_failed.fetch_add(taken, std::memory_order_relaxed);
+            spdlog::error("Failed to write {} log entries: {}", taken, e.what());
+        }
+        return taken;
+    }
+
+    LogQueue::Stats LogQueue::stats() const {
+        Stats s;
+        s.queued = m_size.load(std::memory_order_relaxed);
+        s.written = m_written.load(std::memory_order_relaxed);
+        s.batches = m_batches.load(std::memory_order_relaxed);
+        s.dropped = m_dropped.load(std::memory_order_relaxed);
+        s.failed = m_failed.load(std::memory_order_relaxed);
+        s.capacity = m_mask + 1;
+        return s;
+    }
+
+    bool LogQueue::tryPush(Entry &entry) {
+        // Bounded MPMC ring (per-cell sequence numbers), as in ChangeJournal
+        auto pos = m_head.load(std::memory_order_relaxed);
+        Cell *cell;
+        for (;;) {
+            cell = &m_cells[pos & m_mask];
+            const auto seq = cell->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->entry = std::move(entry);
+        // Counted before the entry is visible, so a pop never takes m_size below zero
+        const auto size = m_size.fetch_add(1, std::memory_order_relaxed) + 1;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+
+        // Wake the writer once a full batch is waiting, instead of at the next flush tick
+        if (size == m_options.batch) {
+            {
+                std::lock_guard lock(m_mutex);
+                m_wake = true;
+            }
+            m_cv.notify_one();
+        }
+        return true;
+    }
+
+    bool LogQueue::tryPop(Entry &entry) {
+        auto pos = m_tail.load(std::memory_order_relaxed);
+        Cell *cell;
+        for (;;) {
+            cell = &m_cells[pos & m_mask];
+            const auto seq = cell->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0) {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                return false; // empty
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+
+        entry = std::move(cell->entry);
+        cell->entry = Entry{};
+        cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+        m_size.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void LogQueue::loop() {
+        std::unique_lock lock(m_mutex);
+        while (!m_stopping) {
+            m_cv.wait_for(lock, m_options.flush, [this] { return m_stopping || m_wake; });
+            if (m_stopping) return;
+            m_wake = false;
+
+            lock.unlock();
+            // Keep going while full batches are waiting
+            while (drain() == m_options.batch) {}
+            lock.lock();
+        }
+    }
+}
@@ -1,12 +1,52 @@
 #include "../../../include/mantisbase/core/logger/logger.h"
 #include "../../../include/mantisbase/core/logger/log_database.h"
 #include <spdlog/sinks/stdout_color_sinks-inl.h>
+#include <spdlog/async.h>
+#include <spdlog/formatter.h>
 
+#include <algorithm>
+#include <chrono>
+#include <iterator>
 #include <utility>
 
 #include "mantisbase/mantisbase.h"
 #include "spdlog/sinks/ansicolor_sink.h"
 
+namespace {
+    /// Source file of the entries Logger hands over as a JSON object, see Logger::toConsole()
+    constexpr auto STRUCTURED = "mb:structured";
+
+    /// One JSON object per line: `time` and `level`, then Logger's fields or the raw line as `message`
+    class JsonFormatter final : public spdlog::formatter {
+    public:
+        void format(const spdlog::details::log_msg &msg, spdlog::memory_buf_t &dest) override {
+            const auto since = msg.time.time_since_epoch();
+            const auto secs = std::chrono::duration_cast<std::chrono::seconds>(since);
+            const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(since - secs).count();
+            const auto tm = mb::toUtcTime(static_cast<std::time_t>(secs.count()));
+            fmt::format_to(std::back_inserter(dest), R"({{"time":"{:04}-{:02}-{:02}T{:02}:{:02}:{:02}.{:03}Z","level":"{}",)",
+                           tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, ms,
+                           spdlog::level::to_string_view(msg.level));
+
+            const std::string_view payload(msg.payload.data(), msg.payload.size());
+            if (msg.source.filename == STRUCTURED && payload.starts_with('{')) {
+                // The object's fields and closing brace
+                dest.append(payload.data() + 1, payload.data() + payload.size());
+            } else {
+                // Lines logged through spdlog directly
+                const auto message = mb::json(std::string(payload)).dump(-1, ' ', false,
+                                                                          mb::json::error_handler_t::replace);
+                fmt::format_to(std::back_inserter(dest), R"("message":{}}})", message);
+            }
+            dest.push_back('\n');
+        }
+
+        [[nodiscard]] std::unique_ptr<spdlog::formatter> clone() const override {
+            return std::make_unique<JsonFormatter>();
+        }
+    };
+}
+
 void mb::Logger::setLogLevel(const LogLevel &level) {
     const auto set_spdlog_level = [&](const spdlog::level::level_enum lvl) {
         const auto logger = spdlog::get("mantis_logger");
@@ -37,24 +77,97 @@ void mb::Logger::setLogLevel(const LogLevel &level) {
     }
 }
 
-mb::Logger::Logger()
+mb::Logger::ConsoleOptions mb::Logger::ConsoleOptions::fromEnv() {
+    ConsoleOptions options;
+    options.async = getEnvOrDefault("MB_LOG_CONSOLE_ASYNC", "1") != "0";
+    if (const auto size = safe_stoi(getEnvOrDefault("MB_LOG_CONSOLE_QUEUE_SIZE", ""), 0); size > 0)
+        options.queueSize = static_cast<std::size_t>(size);
+
+    // Same names as MB_LOG_DROP_POLICY
+    const auto policy = getEnvOrDefault("MB_LOG_CONSOLE_POLICY", "block");
+    if (policy == "drop_oldest") options.overflow = spdlog::async_overflow_policy::overrun_oldest;
+    else if (policy == "drop_newest") options.overflow = spdlog::async_overflow_policy::discard_new;
+
+    options.json = getEnvOrDefault("MB_LOG_FORMAT", "text") == "json";
+    return options;
+}
+
+mb::Logger::Logger() : Logger(ConsoleOptions::fromEnv()) {}
+
+mb::Logger::Logger(const ConsoleOptions &console)
     : m_logsDb(std::make_unique<LogDatabase>()) {
     // Enable Multi Sinks
     auto console_sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
     console_sink->set_level(spdlog::level::info);
-    console_sink->set_pattern("[%Y-%m-%d %H:%M:%S] [%-8l] %v");
-
-    const auto logger = std::make_shared<spdlog::logger>("mantis_logger", console_sink);
+    if (console.json)
+        console_sink->set_formatter(std::make_unique<JsonFormatter>());
+    else
+        console_sink->set_pattern("[%Y-%m-%d %H:%M:%S] [%-8l] %v");
+    s_jsonConsole.store(console.json);
+
+    std::shared_ptr<spdlog::logger> logger;
+    if (console.async) {
+        // One writer thread keeps the lines in order
+        m_consolePool = std::make_shared<spdlog::details::thread_pool>(std::max<std::size_t>(1, console.queueSize), 1);
+        logger = std::make_shared<spdlog::async_logger>("mantis_logger", console_sink, m_consolePool,
+                                                        console.overflow);
+        // Whatever an error is followed by, it isn't left in the queue
+        logger->flush_on(spdlog::level::err);
+    } else {
+        logger = std::make_shared<spdlog::logger>("mantis_logger", console_sink);
+    }
     logger->set_level(spdlog::level::info);
 
     // Make `logger` the default logger
     spdlog::set_default_logger(logger);
 }
 
+mb::Logger::~Logger() {
+    if (!m_consolePool) return;
+
+    // Lines logged from here on are written in place, on the same sinks, and the writer drains the queue
+    const auto current = spdlog::default_logger();
+    auto logger = std::make_shared<spdlog::logger>("mantis_logger", current->sinks().begin(), current->sinks().end());
+    logger->set_level(current->level());
+    spdlog::set_default_logger(logger);
+    m_consolePool.reset();
+}
+
 mb::LogDatabase &mb::Logger::logsDb() const {
     return *m_logsDb;
 }
 
+std::uint64_t mb::Logger::consoleDropped() const {
+    return m_consolePool ? m_consolePool->overrun_counter() + m_consolePool->discard_counter() : 0;
+}
+
+void mb::Logger::toConsole(const LogLevel level, const std::string &origin, const std::string &message,
+                           const std::string &details, const json &data) {
+    auto *logger = spdlog::default_logger_raw();
+    if (s_jsonConsole.load(std::memory_order_relaxed)) {
+        // JsonFormatter adds `time` and `level` in front of these
+        nlohmann::ordered_json line = {{"origin", origin}, {"message", message}};
+        if (!details.empty()) line["details"] = details;
+        if (!data.empty()) line["data"] = data;
+        logger->log(spdlog::source_loc{STRUCTURED, 1, nullptr}, toSpdlog(level), "{}",
+                    line.dump(-1, ' ', false, nlohmann::ordered_json::error_handler_t::replace));
+        return;
+    }
+
+    // Format message for console output
+    std::string formatted_msg;
+    if (details.empty()) {
+        formatted_msg = data.empty()
+                            ? fmt::format("[{}] {}", origin, message)
+                            : fmt::format("[{}] {}\n\t— {}", origin, message, data.dump());
+    } else {
+        formatted_msg = data.empty()
+                            ? fmt::format("[{}] {} - {}", origin, message, details)
+                            : fmt::format("[{}] {} - {}\n\t— {}", origin, message, details, data.dump());
+    }
+    logger->log(toSpdlog(level), "{}", formatted_msg);
+}
+
 void mb::Logger::initDb(const std::string &data_dir) {
     if (MantisBase::instance().logs().logsDb().init(data_dir))
         isDbInitialized.store(true);
@@ -72,20 +185,9 @@ void mb::Logger::logToDatabase(const std::string &level, const std::string &orig
 
 void mb::Logger::trace(const std::string &origin, const std::string &message, const std::string &details,
                        const json &data) {
-    // Format message for console output
-    std::string formatted_msg;
-    if (details.empty()) {
-        formatted_msg = data.empty()
-                            ? fmt::format("[{}] {}", origin, message)
-                            : fmt::format("[{}] {}\n\t— {}", origin, message, data.dump());
-    } else {
-        formatted_msg = data.empty()
-                            ? fmt::format("[{}] {} - {}", origin, message, details)
-                            : fmt::format("[{}] {} - {}\n\t— {}", origin, message, details, data.dump());
-    }
+    if (!enabled(LogLevel::TRACE)) return;
 
-    // Call private template method for spdlog console logging
-    trace_spdlog("{}", formatted_msg);
+    toConsole(LogLevel::TRACE, origin, message, details, data);
 
     // Log to database with structured format
     logToDatabase("trace", origin, message, details, data);
@@ -93,42 +195,19 @@ void mb::Logger::trace(const std::string &origin, const std::string &message, co
 
 void mb::Logger::info(const std::string &origin, const std::string &message, const std::string &details,
                       const json &data) {
-    // Format message for console output
-    std::string formatted_msg;
-    if (details.empty()) {
-        formatted_msg = data.empty()
-                            ? fmt::format("[{}] {}", origin, message)
-                            : fmt::format("[{}] {}\n\t— {}", origin, message, data.dump());
-    } else {
-        formatted_msg = data.empty()
-                            ? fmt::format("[{}] {} - {}", origin, message, details)
-                            : fmt::format("[{}] {} - {}\n\t— {}", origin, message, details, data.dump());
-    }
+    if (!enabled(LogLevel::INFO)) return;
 
-    // Call private template method for spdlog console logging
-    info_spdlog("{}", formatted_msg);
+    toConsole(LogLevel::INFO, origin, message, details, data);
 
-    // std::cout << "info" << std::endl;
     // Log to database with structured format
     logToDatabase("info", origin, message, details, data);
 }
 
 void mb::Logger::debug(const std::string &origin, const std::string &message, const std::string &details,
                        const json &data) {
-    // Format message for console output
-    std::string formatted_msg;
-    if (details.empty()) {
-        formatted_msg = data.empty()
-                            ? fmt::format("[{}] {}", origin, message)
-                            : fmt::format("[{}] {}\n\t— {}", origin, message, data.dump());
-    } else {
-        formatted_msg = data.empty()
-                            ? fmt::format("[{}] {} - {}", origin, message, details)
-                            : fmt::format("[{}] {} - {}\n\t— {}", origin, message, details, data.dump());
-    }
+    if (!enabled(LogLevel::DEBUG)) return;
 
-    // Call private template method for spdlog console logging
-    debug_spdlog("{}", formatted_msg);
+    toConsole(LogLevel::DEBUG, origin, message, details, data);
 
     // Log to database with structured format
     logToDatabase("debug", origin, message, details, data);
@@ -136,20 +215,9 @@ void mb::Logger::debug(const std::string &origin, const std::string &message, co
 
 void mb::Logger::warn(const std::string &origin, const std::string &message, const std::string &details,
                       const json &data) {
-    // Format message for console output
-    std::string formatted_msg;
-    if (details.empty()) {
-        formatted_msg = data.empty()
-                            ? fmt::format("[{}] {}", origin, message)
-                            : fmt::format("[{}] {}\n\t— {}", origin, message, data.dump());
-    } else {
-        formatted_msg = data.empty()
-                            ? fmt::format("[{}] {} - {}", origin, message, details)
-                            : fmt::format("[{}] {} - {}\n\t— {}", origin, message, details, data.dump());
-    }
+    if (!enabled(LogLevel::WARN)) return;
 
-    // Call private template method for spdlog console logging
-    warn_spdlog("{}", formatted_msg);
+    toConsole(LogLevel::WARN, origin, message, details, data);
 
     // Log to database with structured format
     logToDatabase("warn", origin, message, details, data);
@@ -157,29 +225,26 @@ void mb::Logger::warn(const std::string &origin, const std::string &message, con
 
 void mb::Logger::critical(const std::string &origin, const std::string &message, const std::string &details,
                           const json &data) {
-    // Format message for console output
-    std::string formatted_msg;
-    if (details.empty()) {
-        formatted_msg = data.empty()
-                            ? fmt::format("[{}] {}", origin, message)
-                            : fmt::format("[{}] {}\n\t— {}", origin, message, data.dump());
-    } else {
-        formatted_msg = data.empty()
-                            ? fmt::format("[{}] {} - {}", origin, message, details)
-                            : fmt::format("[{}] {} - {}\n\t— {}", origin, message, details, data.dump());
-    }
+    if (!enabled(LogLevel::CRITICAL)) return;
 
-    // Call private template method for spdlog console logging
-    critical_spdlog("{}", formatted_msg);
+    toConsole(LogLevel::CRITICAL, origin, message, details, data);
 
     // Log to database with structured format
     logToDatabase("critical", origin, message, details, data);
 }
 
-mb::FuncLogger::FuncLogger(std::string msg) : m_msg(std::move(msg)) {
+mb::FuncLogger::FuncLogger(const std::string &msg) : m_enabled(Logger::enabled(LogLevel::TRACE)) {
+    if (m_enabled) {
+        m_msg = msg;
+        enter();
+    }
+}
+
+void mb::FuncLogger::enter() const {
     LogOrigin::trace("Function Entry", fmt::format("Enter: {}", m_msg));
 }
 
 mb::FuncLogger::~FuncLogger() {
-    LogOrigin::trace("Function Exit", fmt::format("Exit:  {}", m_msg));
+    if (m_enabled)
+        LogOrigin::trace("Function Exit", fmt::format("Exit:  {}", m_msg));
 }
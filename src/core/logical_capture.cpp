@@ -0,0 +1,137 @@
+#include "../../include/mantisbase/core/logical_capture.h"
+#include "../../include/mantisbase/core/change_journal.h"
+#include "../../include/mantisbase/core/delta_sync.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <soci/soci.h>
+
+#include <algorithm>
+#include <cctype>
+
+namespace mb {
+    namespace {
+        /// A wal2json `columns`/`identity` array as the row object row_to_json() builds
+        json rowOf(const json &columns) {
+            json row = json::object();
+            for (const auto &column: columns) {
+                const auto type = column.value("type", "");
+                // Blobs are left out of change events, as the triggers leave them out
+                if (type == "bytea") continue;
+                const auto value = column.value("value", json(nullptr));
+                // wal2json sends json(b) as its text
+                if ((type == "json" || type == "jsonb") && value.is_string())
+                    row[column.value("name", "")] = json::parse(value.get<std::string>(), nullptr, false);
+                else
+                    row[column.value("name", "")] = value;
+            }
+            return row;
+        }
+
+        std::string idOf(const json &row) {
+            const auto it = row.find("id");
+            if (it == row.end() || it->is_null()) return {};
+            return it->is_string() ? it->get<std::string>() : it->dump();
+        }
+    }
+
+    LogicalCapture::Options LogicalCapture::Options::fromEnv() {
+        Options options;
+        auto mode = trim(getEnvOrDefault("MB_PG_CAPTURE", "triggers"));
+        toLowerCase(mode);
+        options.logical = mode == "logical";
+        if (auto slot = trim(getEnvOrDefault("MB_PG_SLOT", "")); !slot.empty()) {
+            // Slot names are lowercase letters, digits and underscores
+            toLowerCase(slot);
+            if (std::ranges::all_of(slot, [](const unsigned char c) { return std::isalnum(c) || c == '_'; }))
+                options.slot = slot;
+            else
+                LogOrigin::dbWarn("Logical Capture", fmt::format("Invalid MB_PG_SLOT `{}`, using `{}`", slot,
+                                                                 options.slot));
+        }
+        if (const auto ms = safe_stoi(getEnvOrDefault("MB_PG_CAPTURE_POLL_MS", ""), 0); ms > 0)
+            options.poll = std::chrono::milliseconds(ms);
+        if (const auto batch = safe_stoi(getEnvOrDefault("MB_PG_CAPTURE_BATCH", ""), 0); batch > 0)
+            options.batch = batch;
+        return options;
+    }
+
+    const LogicalCapture::Options &LogicalCapture::Options::current() {
+        static const Options options = fromEnv();
+        return options;
+    }
+
+    bool LogicalCapture::enabled() {
+        static const bool on = [] {
+            if (!Options::current().logical) return false;
+            if (DeltaSync::Options::fromEnv().enabled()) {
+                LogOrigin::dbWarn("Logical Capture", "Delta sync reads mb_change_log; keeping the change triggers");
+                return false;
+            }
+            return true;
+        }();
+        return on;
+    }
+
+    void LogicalCapture::createSlot(soci::session &sql, const std::string &slot) {
+        int present = 0;
+        sql << "SELECT COUNT(*) FROM pg_replication_slots WHERE slot_name = :slot", soci::use(slot), soci::into(present);
+        if (present > 0) return;
+        // Starts at the current WAL position; nothing from before is replayed
+        sql << "SELECT 1 FROM pg_create_logical_replication_slot(:slot, 'wal2json')", soci::use(slot);
+        LogOrigin::dbInfo("Logical Capture", fmt::format("Created logical replication slot `{}`", slot));
+    }
+
+    std::string LogicalCapture::changesSql() {
+        // One object per row, committed transactions only, without begin/commit rows
+        return "SELECT data FROM pg_logical_slot_get_changes($1, NULL, $2::integer, 'format-version', '2', "
+               "'include-types', 'true', 'include-xids', 'true', 'include-transaction', 'false')";
+    }
+
+    void LogicalCapture::mute(soci::session &sql, const std::string &entity) {
+        sql << "SELECT 1 FROM pg_logical_emit_message(true, 'mb_mute', :entity)", soci::use(entity);
+    }
+
+    void LogicalCapture::unmute(soci::session &sql, const std::string &entity) {
+        sql << "SELECT 1 FROM pg_logical_emit_message(true, 'mb_unmute', :entity)", soci::use(entity);
+    }
+
+    std::optional<LogicalCapture::Change> LogicalCapture::decode(const std::string_view data) {
+        const auto change = json::parse(data, nullptr, false);
+        if (!change.is_object()) return std::nullopt;
+
+        const auto action = change.value("action", "");
+        const auto xid = change.value("xid", std::uint64_t{0});
+        if (action == "M") {
+            const auto prefix = change.value("prefix", "");
+            if (prefix != "mb_mute" && prefix != "mb_unmute") return std::nullopt;
+            Change out;
+            out.kind = prefix == "mb_mute" ? Change::Kind::Mute : Change::Kind::Unmute;
+            out.xid = xid;
+            out.table = change.value("content", "");
+            toLowerCase(out.table);
+            return out;
+        }
+
+        const char *type = action == "I" ? "INSERT" : action == "U" ? "UPDATE" : action == "D" ? "DELETE" : nullptr;
+        if (!type) return std::nullopt;
+
+        json old_row = nullptr, new_row = nullptr;
+        if (action != "I") old_row = rowOf(change.value("identity", json::array()));
+        if (action != "D") {
+            new_row = rowOf(change.value("columns", json::array()));
+            // Unchanged TOASTed values aren't in the new tuple; FULL identity has them
+            if (action == "U")
+                for (const auto &column: old_row.items())
+                    if (!new_row.contains(column.key())) new_row[column.key()] = column.value();
+        }
+
+        Change out;
+        out.xid = xid;
+        out.schema = change.value("schema", "");
+        out.table = change.value("table", "");
+        const auto row_id = idOf(action == "D" ? old_row : new_row);
+        out.event = ChangeJournal::makeEvent(type, out.table, row_id, std::move(old_row), std::move(new_row));
+        return out;
+    }
+}
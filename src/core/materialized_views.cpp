@@ -0,0 +1,271 @@
+/**
+ * @file materialized_views.cpp
+ * @brief Implementation for @see materialized_views.h
+ */
+
+#include "../../include/mantisbase/core/materialized_views.h"
+#include "../../include/mantisbase/core/database.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/core/realtime.h"
+#include "../../include/mantisbase/core/response_cache.h"
+#include "../../include/mantisbase/core/router.h"
+#include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <format>
+#include <soci/soci.h>
+#include <vector>
+
+namespace mb {
+    namespace {
+        /// Ids per DELETE/INSERT of an incremental refresh, well under the bound-parameter limits
+        constexpr std::size_t KEYS_PER_STATEMENT = 500;
+
+        /// Before a failed refresh is tried again
+        constexpr std::chrono::seconds RETRY_AFTER{30};
+
+        /// Every identifier-like word of `query`; a change to any entity of that name refreshes the view
+        std::set<std::string> namesIn(const std::string &query) {
+            std::set<std::string> names;
+            std::string word;
+            for (const char c: query + ' ') {
+                if (std::isalnum(static_cast<unsigned char>(c)) || c == '_') {
+                    word += c;
+                } else {
+                    if (!word.empty() && !std::isdigit(static_cast<unsigned char>(word[0]))) names.insert(word);
+                    word.clear();
+                }
+            }
+            return names;
+        }
+    }
+
+    MaterializedViews::Options MaterializedViews::Options::fromEnv() {
+        Options options;
+        if (const auto ms = safe_stoi(getEnvOrDefault("MB_MATVIEW_DEBOUNCE_MS", ""), -1); ms >= 0)
+            options.debounce = std::chrono::milliseconds(ms);
+        if (const auto keys = safe_stoi(getEnvOrDefault("MB_MATVIEW_MAX_KEYS", ""), -1); keys >= 0)
+            options.maxKeys = static_cast<std::size_t>(keys);
+        return options;
+    }
+
+    MaterializedViews::MaterializedViews(const Options options) : m_options(options) {}
+
+    MaterializedViews::~MaterializedViews() {
+        stop();
+    }
+
+    void MaterializedViews::start() {
+        std::lock_guard lock(m_mutex);
+        if (m_thread.joinable()) return;
+
+        // Changes made while the server was down never reach the stream
+        for (auto &[_, view]: m_views) {
+            view.full = true;
+            view.keys.clear();
+            view.due = Clock::now();
+        }
+        m_stopping = false;
+        m_thread = std::thread(&MaterializedViews::loop, this);
+    }
+
+    void MaterializedViews::stop() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+    void MaterializedViews::track(const nlohmann::json &schema) {
+        const auto name = schema.value("name", "");
+        const auto options = ViewMaterialization::fromJSON(schema);
+        if (schema.value("type", "") != "view" || !options.enabled) {
+            untrack(name);
+            return;
+        }
+
+        std::set<std::string> reads(options.sources.begin(), options.sources.end());
+        if (reads.empty()) reads = namesIn(schema.value("view_query", ""));
+        reads.erase(name);
+        reads.erase(ViewMaterialization::sourceOf(name));
+
+        // With per-entity channels, source changes only arrive while someone listens
+        auto &app = MantisBase::instance();
+        for (const auto &entity: reads)
+            if (app.hasEntity(entity)) app.rt().pin(entity);
+
+        std::lock_guard lock(m_mutex);
+        auto &view = m_views[name];
+        view.options = options;
+        view.reads = std::move(reads);
+        view.scheduled = options.refreshInterval > 0
+                             ? Clock::now() + std::chrono::seconds(options.refreshInterval)
+                             : Clock::time_point::max();
+        // The schema change itself rebuilt the table; what's queued still applies to it
+        if (options.refreshKey.empty() && !view.keys.empty()) {
+            view.keys.clear();
+            view.full = true;
+        }
+    }
+
+    void MaterializedViews::untrack(const std::string &view) {
+        std::lock_guard lock(m_mutex);
+        m_views.erase(view);
+    }
+
+    void MaterializedViews::onChanges(const nlohmann::json &events) {
+        if (!events.is_array() || events.empty()) return;
+
+        bool queued = false;
+        {
+            std::lock_guard lock(m_mutex);
+            if (m_views.empty()) return;
+
+            const auto due = Clock::now() + m_options.debounce;
+            for (const auto &event: events) {
+                if (!event.is_object() || !event.contains("entity") || !event["entity"].is_string()) continue;
+                const auto &entity = event["entity"].get_ref<const std::string &>();
+                const auto row_id = event.contains("row_id") && event["row_id"].is_string()
+                                        ? event["row_id"].get<std::string>()
+                                        : "";
+
+                for (auto &[_, view]: m_views) {
+                    if (!view.reads.contains(entity)) continue;
+
+                    if (!view.full && !view.options.refreshKey.empty() && !row_id.empty() &&
+                        view.keys.size() < m_options.maxKeys) {
+                        view.keys.insert(row_id);
+                    } else {
+                        view.full = true;
+                        view.keys.clear();
+                    }
+                    view.due = std::min(view.due, due);
+                    queued = true;
+                }
+            }
+            if (queued) m_wake = true;
+        }
+        if (queued) m_cv.notify_all();
+    }
+
+    void MaterializedViews::refresh(const std::string &view) {
+        {
+            std::lock_guard lock(m_mutex);
+            if (!m_views.contains(view))
+                throw MantisException(404, std::format("`{}` isn't a materialized view", view));
+        }
+        apply(view, "", nullptr);
+        ++m_full;
+    }
+
+    MaterializedViews::Clock::time_point MaterializedViews::step(const Clock::time_point now) {
+        struct Work {
+            std::string view, key;
+            bool full;
+            std::set<std::string> keys;
+        };
+        std::vector<Work> work;
+        {
+            std::lock_guard lock(m_mutex);
+            for (auto &[name, view]: m_views) {
+                const bool scheduled = view.scheduled <= now;
+                if (view.due > now && !scheduled) continue;
+
+                Work w{name, view.options.refreshKey, view.full || scheduled, {}};
+                if (!w.full) w.keys = std::move(view.keys);
+                if (w.full || !w.keys.empty()) work.push_back(std::move(w));
+
+                view.full = false;
+                view.keys.clear();
+                view.due = Clock::time_point::max();
+                if (scheduled) view.scheduled = now + std::chrono::seconds(view.options.refreshInterval);
+            }
+        }
+
+        for (const auto &w: work) {
+            try {
+                apply(w.view, w.key, w.full ? nullptr : &w.keys);
+                ++(w.full ? m_full : m_incremental);
+            } catch (const std::exception &e) {
+                LogOrigin::entitySchemaWarn("Materialized View", fmt::format(
+                                                "Could not refresh `{}`, retrying in {}s: {}",
+                                                w.view, RETRY_AFTER.count(), e.what()));
+                std::lock_guard lock(m_mutex);
+                if (const auto it = m_views.find(w.view); it != m_views.end()) {
+                    it->second.full = true;
+                    it->second.keys.clear();
+                    it->second.due = std::min(it->second.due, Clock::now() + RETRY_AFTER);
+                }
+            }
+        }
+
+        std::lock_guard lock(m_mutex);
+        auto next = Clock::time_point::max();
+        for (const auto &[_, view]: m_views)
+            next = std::min({next, view.due, view.scheduled});
+        return next;
+    }
+
+    void MaterializedViews::apply(const std::string &view, const std::string &key, const std::set<std::string> *keys) {
+        auto &app = MantisBase::instance();
+        const auto table = sqlIdentifier(view);
+        const auto source = sqlIdentifier(ViewMaterialization::sourceOf(view));
+
+        app.db().write([&](soci::session &sql) {
+            if (!keys) {
+                sql << "DELETE FROM " + table;
+                sql << std::format("INSERT INTO {} SELECT * FROM {}", table, source);
+                return;
+            }
+
+            // Each changed source row's view rows, gone or re-selected as they now are
+            const auto column = sqlIdentifier(key);
+            std::vector<std::string> ids(keys->begin(), keys->end());
+            for (std::size_t i = 0; i < ids.size(); i += KEYS_PER_STATEMENT) {
+                soci::values vals;
+                std::string in;
+                for (std::size_t j = i; j < std::min(ids.size(), i + KEYS_PER_STATEMENT); ++j) {
+                    const auto param = std::format("k{}", j - i);
+                    in += (in.empty() ? ":" : ", :") + param;
+                    vals.set(param, ids[j]);
+                }
+                sql << std::format("DELETE FROM {} WHERE {} IN ({})", table, column, in), soci::use(vals);
+                sql << std::format("INSERT INTO {0} SELECT * FROM {1} WHERE {2} IN ({3})", table, source, column, in),
+                        soci::use(vals);
+            }
+        });
+
+        // Nothing on the table sends change events, so cached pages, counts and records go here
+        Entity::countCache().invalidateEntity(view);
+        Entity::recordCache().invalidateEntity(view);
+        app.router().responseCache().invalidateEntity(view);
+    }
+
+    void MaterializedViews::loop() {
+        std::unique_lock lock(m_mutex);
+        while (!m_stopping) {
+            m_wake = false;
+            lock.unlock();
+
+            auto next = Clock::time_point::max();
+            try {
+                next = step();
+            } catch (const std::exception &e) {
+                LogOrigin::warn("Materialized View", fmt::format("Refresh pass failed: {}", e.what()));
+                next = Clock::now() + RETRY_AFTER;
+            }
+
+            lock.lock();
+            const auto woken = [this] { return m_stopping || m_wake; };
+            if (next == Clock::time_point::max())
+                m_cv.wait(lock, woken);
+            else
+                m_cv.wait_until(lock, next, woken);
+        }
+    }
+}
@@ -0,0 +1,170 @@
+#include "../../include/mantisbase/core/metrics.h"
+
+#include <algorithm>
+#include <format>
+
+namespace mb {
+    std::uint64_t ShardedCounter::value() const {
+        std::uint64_t total = 0;
+        for (const auto &s: m_shards) total += s.value.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    std::size_t ShardedCounter::shard() {
+        static std::atomic<std::size_t> next{0};
+        thread_local const std::size_t index = next.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+        return index;
+    }
+
+    void LatencyHistogram::observe(const std::chrono::nanoseconds latency) {
+        auto &shard = m_shards[ShardedCounter::shard()];
+        shard.counts[bucketFor(latency)].fetch_add(1, std::memory_order_relaxed);
+        shard.sumNs.fetch_add(static_cast<std::uint64_t>(std::max<std::int64_t>(0, latency.count())),
+                              std::memory_order_relaxed);
+    }
+
+    LatencyHistogram::Snapshot LatencyHistogram::snapshot() const {
+        Snapshot s;
+        std::uint64_t sum_ns = 0;
+        for (const auto &shard: m_shards) {
+            for (std::size_t i = 0; i < s.counts.size(); ++i)
+                s.counts[i] += shard.counts[i].load(std::memory_order_relaxed);
+            sum_ns += shard.sumNs.load(std::memory_order_relaxed);
+        }
+        for (const auto c: s.counts) s.count += c;
+        s.sum = static_cast<double>(sum_ns) / 1e9;
+        return s;
+    }
+
+    std::size_t LatencyHistogram::bucketFor(const std::chrono::nanoseconds latency) {
+        const auto seconds = std::chrono::duration<double>(latency).count();
+        return static_cast<std::size_t>(std::ranges::lower_bound(BUCKETS, seconds) - BUCKETS.begin());
+    }
+
+    void MetricsWriter::family(const std::string_view name, const std::string_view help, const std::string_view type) {
+        m_out += std::format("# HELP {} {}\n# TYPE {} {}\n", name, help, name, type);
+    }
+
+    void MetricsWriter::sample(const std::string_view name, const Labels &labels, const double value) {
+        m_out += name;
+        writeLabels(labels);
+        m_out += std::format(" {}\n", value);
+    }
+
+    void MetricsWriter::histogram(const std::string_view name, const Labels &labels,
+                                  const std::span<const double> bounds, const std::span<const std::uint64_t> counts,
+                                  const double sum) {
+        std::uint64_t cumulative = 0;
+        for (std::size_t i = 0; i < counts.size(); ++i) {
+            cumulative += counts[i];
+            m_out += std::format("{}_bucket", name);
+            writeLabels(labels, "le", i < bounds.size() ? std::format("{}", bounds[i]) : "+Inf");
+            m_out += std::format(" {}\n", cumulative);
+        }
+        m_out += std::format("{}_sum", name);
+        writeLabels(labels);
+        m_out += std::format(" {}\n{}_count", sum, name);
+        writeLabels(labels);
+        m_out += std::format(" {}\n", cumulative);
+    }
+
+    std::string MetricsWriter::escape(const std::string_view value) {
+        std::string out;
+        out.reserve(value.size());
+        for (const char c: value) {
+            if (c == '\\') out += "\\\\";
+            else if (c == '"') out += "\\\"";
+            else if (c == '\n') out += "\\n";
+            else out += c;
+        }
+        return out;
+    }
+
+    void MetricsWriter::writeLabels(const Labels &labels, const std::string_view extra_key,
+                                    const std::string_view extra_value) {
+        if (labels.empty() && extra_key.empty()) return;
+        m_out += '{';
+        bool first = true;
+        const auto put = [&](const std::string_view key, const std::string_view value) {
+            if (!first) m_out += ',';
+            first = false;
+            m_out += std::format("{}=\"{}\"", key, escape(value));
+        };
+        for (const auto &[key, value]: labels) put(key, value);
+        if (!extra_key.empty()) put(extra_key, extra_value);
+        m_out += '}';
+    }
+
+    Metrics::Metrics() {
+        m_unmatched.route = "unmatched";
+    }
+
+    Metrics::RouteSeries &Metrics::route(const std::string &method, const std::string &route) {
+        std::lock_guard lock(m_mutex);
+        auto &series = m_routeIndex[method + " " + route];
+        if (!series) {
+            m_routes.push_back(std::make_unique<RouteSeries>());
+            series = m_routes.back().get();
+            series->method = method;
+            series->route = route;
+        }
+        return *series;
+    }
+
+    void Metrics::recordRequest(RouteSeries &series, const int status, const std::chrono::nanoseconds latency) {
+        series.latency.observe(latency);
+        series.byClass[std::clamp(status / 100, 1, 5) - 1].add();
+    }
+
+    void Metrics::recordScript(const std::string &hook, const std::chrono::nanoseconds duration) {
+        std::lock_guard lock(m_mutex);
+        auto &histogram = m_scripts[hook];
+        if (!histogram) histogram = std::make_unique<LatencyHistogram>();
+        histogram->observe(duration);
+    }
+
+    void Metrics::recordScriptTimeout(const std::string &hook) {
+        std::lock_guard lock(m_mutex);
+        ++m_scriptTimeouts[hook];
+    }
+
+    void Metrics::writeRequests(MetricsWriter &out) const {
+        std::vector<const RouteSeries *> routes;
+        {
+            std::lock_guard lock(m_mutex);
+            for (const auto &r: m_routes) routes.push_back(r.get());
+        }
+        routes.push_back(&m_unmatched);
+
+        out.family("mb_http_request_duration_seconds", "Time from request arrival to response, per route",
+                   "histogram");
+        for (const auto *r: routes) {
+            const auto s = r->latency.snapshot();
+            if (s.count == 0) continue;
+            out.histogram("mb_http_request_duration_seconds", {{"method", r->method}, {"route", r->route}},
+                          LatencyHistogram::BUCKETS, s.counts, s.sum);
+        }
+
+        static constexpr std::array<std::string_view, 5> classes = {"1xx", "2xx", "3xx", "4xx", "5xx"};
+        out.family("mb_http_requests_total", "Responses sent, per route and status class", "counter");
+        for (const auto *r: routes)
+            for (std::size_t i = 0; i < classes.size(); ++i)
+                if (const auto n = r->byClass[i].value(); n > 0)
+                    out.sample("mb_http_requests_total",
+                               {{"method", r->method}, {"route", r->route}, {"status", classes[i]}},
+                               static_cast<double>(n));
+    }
+
+    void Metrics::writeScripts(MetricsWriter &out) const {
+        out.family("mb_script_duration_seconds", "Time spent running JS scripts and hooks", "histogram");
+        std::lock_guard lock(m_mutex);
+        for (const auto &[hook, histogram]: m_scripts) {
+            const auto s = histogram->snapshot();
+            out.histogram("mb_script_duration_seconds", {{"hook", hook}}, LatencyHistogram::BUCKETS, s.counts, s.sum);
+        }
+
+        out.family("mb_script_timeouts_total", "Scripts stopped for running past their time budget", "counter");
+        for (const auto &[hook, count]: m_scriptTimeouts)
+            out.sample("mb_script_timeouts_total", {{"hook", hook}}, static_cast<double>(count));
+    }
+}
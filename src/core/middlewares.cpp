@@ -3,15 +3,30 @@
 #include "../include/mantisbase/core/models/entity.h"
 #include "../include/mantisbase/core/models/entity_schema.h"
 #include "../include/mantisbase/core/api_keys.h"
+#include "../include/mantisbase/core/server_timing.h"
+#include "../include/mantisbase/core/rate_limiter.h"
+#include "../include/mantisbase/core/usage_quotas.h"
 #include "../include/mantisbase/utils/crypto_utils.h"
+#include <optional>
 #include <unordered_map>
-#include <deque>
 #include <chrono>
-#include <mutex>
 
 namespace mb {
     namespace {
-        json entityRouteNotFoundResponse(const std::string &method, const std::string &path) {
+        /// Read an auth user record through the shared user cache.
+        std::optional<json> readAuthUser(const MantisBase &app, const std::string &entity_name,
+                                         const std::string &user_id) {
+            auto &cache = Auth::userCache();
+            if (auto cached = cache.get(entity_name, user_id); cached.has_value())
+                return cached;
+
+            auto user = app.entitySnapshot(entity_name)->read(user_id);
+            if (user.has_value())
+                cache.put(entity_name, user_id, user.value());
+            return user;
+        }
+
+        json entityRouteNotFoundResponse(const std::string_view method, const std::string_view path) {
             return {
                 {"status", 404},
                 {"error", std::format("{} {} Route Not Found", method, path)},
@@ -19,150 +34,127 @@ namespace mb {
             };
         }
 
-        HandlerResponse checkEntityAccess(MantisRequest &req, MantisResponse &res, const std::string &entity_name,
-                                          const std::string &trace_msg) {
-            TRACE_FUNC(trace_msg);
-            try {
-                const auto entity = req.mApp().entity(entity_name);
-                const auto &auth = req.getOr<json>("auth", json::object());
-                auto method = req.getMethod();
-
-                if (!(method == "GET"
-                      || method == "POST"
-                      || method == "PATCH"
-                      || method == "DELETE")) {
-                    res.sendJSON(400, {
-                        {"status", 400},
-                        {"data", json::object()},
-                        {"error", "Unsupported method `" + method + "`"}
-                    });
-                    return HandlerResponse::Handled;
-                }
+        /// Apply one access rule to the request; the error to send back, or nullopt to let it through.
+        std::optional<json> ruleDenial(MantisRequest &req, const AccessRule &rule) {
+            const ServerTiming::Span span("rules");
+            if (rule.mode() == "public") {
+                LogOrigin::authTrace("Public Access", "Public access, no auth required!");
+                return std::nullopt;
+            }
 
-                AccessRule rule = method == "GET"
-                                      ? (req.hasPathParam("id")
-                                             ? entity.getRule()
-                                             : entity.listRule())
-                                      : method == "POST"
-                                            ? entity.addRule()
-                                            : method == "PATCH"
-                                                  ? entity.updateRule()
-                                                  : entity.deleteRule();
-
-                if (rule.mode() == "public") {
-                    LogOrigin::authTrace("Public Access", "Public access, no auth required!");
-                    return HandlerResponse::Unhandled;
+            // Past a public rule, so the caller's token gets verified now (see hydrateContextData())
+            const auto &auth = req.auth();
+
+            if (rule.mode().empty()) {
+                LogOrigin::authTrace("Admin Access Required", "Restricted access, admin auth required!");
+                const auto &verification = req.verification();
+                if (verification.empty())
+                    return "Admin auth required to access this resource!";
+
+                if (verification.contains("verified") &&
+                    verification["verified"].is_boolean() &&
+                    verification["verified"].get<bool>()) {
+                    if (auth["user"].is_null() || !auth["user"].is_object())
+                        return "Auth user not found!";
+
+                    return std::nullopt;
                 }
 
-                if (rule.mode().empty()) {
-                    LogOrigin::authTrace("Admin Access Required", "Restricted access, admin auth required!");
-                    const auto &verification = req.getOr<json>("verification", json::object());
-                    if (verification.empty()) {
-                        res.sendJSON(403, {
-                            {"data", json::object()},
-                            {"status", 403},
-                            {"error", "Admin auth required to access this resource!"}
-                        });
-                        return HandlerResponse::Handled;
-                    }
+                return verification["error"];
+            }
 
-                    if (verification.contains("verified") &&
-                        verification["verified"].is_boolean() &&
-                        verification["verified"].get<bool>()) {
-                        if (auth["user"].is_null() || !auth["user"].is_object()) {
-                            res.sendJSON(403, {
-                                {"data", json::object()},
-                                {"status", 403},
-                                {"error", "Auth user not found!"}
-                            });
-                            return HandlerResponse::Handled;
-                        }
+            if (rule.mode() == "auth" || (auth["entity"].is_string() && auth["entity"].get<std::string>() == "mb_admins")) {
+                LogOrigin::authTrace("User/Admin Access Required", "Restricted access, admin/user auth required!");
+                const auto &verification = req.verification();
+                if (verification.empty())
+                    return "Auth required to access this resource!";
 
-                        return HandlerResponse::Unhandled;
-                    }
+                if (verification.contains("verified") &&
+                    verification["verified"].is_boolean() &&
+                    verification["verified"].get<bool>()) {
+                    if (auth["user"].is_null() || !auth["user"].is_object())
+                        return "Auth user not found!";
 
-                    res.sendJSON(403, {
-                        {"data", json::object()},
-                        {"status", 403},
-                        {"error", verification["error"]}
-                    });
-                    return HandlerResponse::Handled;
+                    return std::nullopt;
                 }
 
-                if (rule.mode() == "auth" || (auth["entity"].is_string() && auth["entity"].get<std::string>() == "mb_admins")) {
-                    LogOrigin::authTrace("User/Admin Access Required", "Restricted access, admin/user auth required!");
-                    const auto &verification = req.getOr<json>("verification", json::object());
-                    if (verification.empty()) {
-                        res.sendJSON(403, {
-                            {"data", json::object()},
-                            {"status", 403},
-                            {"error", "Auth required to access this resource!"}
-                        });
-                        return HandlerResponse::Handled;
-                    }
+                return verification["error"];
+            }
 
-                    if (verification.contains("verified") &&
-                        verification["verified"].is_boolean() &&
-                        verification["verified"].get<bool>()) {
-                        if (auth["user"].is_null() || !auth["user"].is_object()) {
-                            res.sendJSON(403, {
-                                {"data", json::object()},
-                                {"status", 403},
-                                {"error", "Auth user not found!"}
-                            });
-                            return HandlerResponse::Handled;
-                        }
+            if (rule.mode() == "custom") {
+                MB_LOG_TRACE(LogOrigin::authTrace, "Custom Expression Access", fmt::format("Restricted access, custom expression `{}` to be evaluated", rule.expr()));
+                json vars = json::object();
+                vars["auth"] = auth;
 
-                        return HandlerResponse::Unhandled;
-                    }
+                json req_obj;
+                req_obj["remoteAddr"] = req.getRemoteAddr();
+                req_obj["remotePort"] = req.getRemotePort();
+                req_obj["localAddr"] = req.getLocalAddr();
+                req_obj["localPort"] = req.getLocalPort();
+                req_obj["body"] = json::object();
 
-                    res.sendJSON(403, {
-                        {"data", json::object()},
-                        {"status", 403},
-                        {"error", verification["error"]}
-                    });
-                    return HandlerResponse::Handled;
+                try {
+                    if (req.method() == RequestMethod::Post && !req.bodyView().empty()) {
+                        req_obj["body"] = req.getBodyAsJson();
+                    }
+                } catch (...) {
                 }
 
-                if (rule.mode() == "custom") {
-                    LogOrigin::authTrace("Custom Expression Access", fmt::format("Restricted access, custom expression `{}` to be evaluated", rule.expr()));
-                    const std::string expr = rule.expr();
-                    json vars = json::object();
-                    vars["auth"] = auth;
+                vars["req"] = req_obj;
 
-                    json req_obj;
-                    req_obj["remoteAddr"] = req.getRemoteAddr();
-                    req_obj["remotePort"] = req.getRemotePort();
-                    req_obj["localAddr"] = req.getLocalAddr();
-                    req_obj["localPort"] = req.getLocalPort();
-                    req_obj["body"] = json::object();
+                // Compiled with the cached Entity; only binds `vars` here
+                if (rule.evaluate(vars))
+                    return std::nullopt;
 
-                    try {
-                        if (req.getMethod() == "POST" && !req.getBody().empty()) {
-                            req_obj["body"] = req.getBodyAsJson();
-                        }
-                    } catch (...) {
-                    }
+                return "Access denied!";
+            }
 
-                    vars["req"] = req_obj;
+            return "Access denied, entity access rule unknown.";
+        }
 
-                    if (Expr::eval(expr, vars))
-                        return HandlerResponse::Unhandled;
+        /// Apply one access rule to the request; Unhandled lets it through.
+        HandlerResponse checkRuleAccess(MantisRequest &req, MantisResponse &res, const AccessRule &rule) {
+            const auto denial = ruleDenial(req, rule);
+            if (!denial) return HandlerResponse::Unhandled;
 
-                    res.sendJSON(403, {
-                        {"status", 403},
+            res.sendJSON(403, {
+                {"data", json::object()},
+                {"status", 403},
+                {"error", *denial}
+            });
+            return HandlerResponse::Handled;
+        }
+
+        HandlerResponse checkEntityAccess(MantisRequest &req, MantisResponse &res, const std::string &entity_name,
+                                          const std::string &trace_msg) {
+            TRACE_FUNC(trace_msg);
+            try {
+                const auto entity = requestEntity(req, entity_name);
+                const auto method = req.method();
+
+                if (!(method == RequestMethod::Get
+                      || method == RequestMethod::Post
+                      || method == RequestMethod::Patch
+                      || method == RequestMethod::Delete)) {
+                    res.sendJSON(400, {
+                        {"status", 400},
                         {"data", json::object()},
-                        {"error", "Access denied!"}
+                        {"error", std::format("Unsupported method `{}`", req.methodName())}
                     });
                     return HandlerResponse::Handled;
                 }
 
-                res.sendJSON(403, {
-                    {"status", 403},
-                    {"data", json::object()},
-                    {"error", "Access denied, entity access rule unknown."}
-                });
-                return HandlerResponse::Handled;
+                const AccessRule &rule = method == RequestMethod::Get
+                                             ? (req.hasPathParam("id")
+                                                    ? entity->getRule()
+                                                    : entity->listRule())
+                                             : method == RequestMethod::Post
+                                                   ? entity->addRule()
+                                                   : method == RequestMethod::Patch
+                                                         ? entity->updateRule()
+                                                         : entity->deleteRule();
+
+                return checkRuleAccess(req, res, rule);
             } catch (std::exception &e) {
                 res.sendJSON(500, {
                     {"status", 500},
@@ -174,115 +166,135 @@ namespace mb {
         }
     }
 
-    std::function<HandlerResponse(MantisRequest &, MantisResponse &)> getAuthToken() {
-        std::string msg = MB_FUNC();
-        return [msg](MantisRequest &req, MantisResponse &_) {
-            TRACE_FUNC(msg);
-            try {
-                json auth;
-                auth["type"] = "guest";
-                auth["token"] = nullptr;
-                auth["id"] = nullptr;
-                auth["entity"] = nullptr;
-                auth["user"] = nullptr;
-
-                if (req.hasHeader("Authorization")) {
-                    const auto token = trim(req.getBearerTokenAuth());
-
-                    if (token.starts_with("mb_sk_")) {
-                        // API key authentication
-                        auto key_hash = ApiKeyManager::hashApiKey(token);
-                        auto key_info = ApiKeyManager::lookupByHash(key_hash);
-
-                        if (key_info.has_value()) {
-                            auto &info = key_info.value();
-                            auth["type"] = "user";
-                            auth["id"] = info["user_id"];
-                            auth["entity"] = info["entity_name"];
-                            auth["auth_method"] = "api_key";
-
-                            // Hydrate user record
-                            try {
-                                auto entity_name = info["entity_name"].get<std::string>();
-                                auto user_id = info["user_id"].get<std::string>();
-                                const auto user_entity = MantisBase::instance().entity(entity_name);
-                                if (auto user = user_entity.read(user_id); user.has_value()) {
-                                    auto u = user.value();
-                                    u.erase("password");
-                                    auth["user"] = u;
-                                }
-                            } catch (...) {}
-
-                            req.set("auth", auth);
-                            // Fake a verified verification object for downstream middleware
-                            json verification;
-                            verification["verified"] = true;
-                            verification["claims"] = {{"id", auth["id"]}, {"entity", auth["entity"]}};
-                            verification["error"] = "";
-                            req.set("verification", verification);
-                            return HandlerResponse::Unhandled;
-                        }
-                    }
+    namespace {
+        /// Told the caller's UsageQuotas subject once it is known, before their user is loaded; throws to turn them away
+        using Meter = std::function<void(const std::string &subject)>;
 
-                    // JWT token (starts with eyJ or any other non-api-key format)
-                    auth["token"] = token;
+        /// Who `auth["token"]` belongs to: an API key, else a JWT. Deferred by hydrateContextData().
+        void resolveAuth(const MantisBase &app, json &auth, json &verification, const Meter &meter = {}) {
+            const ServerTiming::Span span("auth");
+            const auto token = auth["token"].get<std::string>();
+
+            if (token.starts_with("mb_sk_")) {
+                std::optional<json> key_info;
+                try {
+                    key_info = ApiKeyManager::lookupByHash(ApiKeyManager::hashApiKey(token));
+                } catch (const std::exception &e) {
+                    LogOrigin::authTrace("API Key Lookup Failed", e.what());
+                    throw MantisException(500, e.what());
                 }
 
-                req.set("auth", auth);
-                req.set("verification", json::object());
-                return HandlerResponse::Unhandled;
-            } catch (const std::exception& e) {
-                std::cout << "Failed to get access token: " << e.what() << std::endl;
-                throw MantisException(500, e.what());
+                if (key_info.has_value()) {
+                    auto &info = key_info.value();
+                    auth["type"] = "user";
+                    auth["token"] = nullptr;
+                    auth["id"] = info["user_id"];
+                    auth["entity"] = info["entity_name"];
+                    auth["auth_method"] = "api_key";
+                    if (meter && info["entity_name"] != "mb_admins") meter(UsageQuotas::keySubject(info["id"].get<std::string>()));
+
+                    // Hydrate user record
+                    try {
+                        auto entity_name = info["entity_name"].get<std::string>();
+                        auto user_id = info["user_id"].get<std::string>();
+                        if (auto user = readAuthUser(app, entity_name, user_id); user.has_value()) {
+                            auto u = user.value();
+                            u.erase("password");
+                            auth["user"] = u;
+                        }
+                    } catch (...) {}
+
+                    // Fake a verified verification object for downstream middleware
+                    verification["verified"] = true;
+                    verification["claims"] = {{"id", auth["id"]}, {"entity", auth["entity"]}};
+                    verification["error"] = "";
+                    return;
+                }
+                // Not a key we know: tried as a JWT, which fails verification below
             }
-        };
-    }
 
-    std::function<HandlerResponse(MantisRequest &, MantisResponse &)> hydrateContextData() {
-        std::string msg = MB_FUNC();
-        return [msg](MantisRequest &req, MantisResponse &res) {
-            TRACE_FUNC(msg);
-            // Get the auth var from the context, resort to empty object if it's not set.
-            auto auth = req.getOr<json>("auth", json::object());
+            // If token validation worked, lets get data from database
+            verification = Auth::verifyToken(token);
+            if (!verification.at("verified").get<bool>()) return;
 
-            // Expand logged user if token is present and query user information if it exists
-            if (auth.contains("token") && !auth["token"].is_null() && !auth["token"].empty()) {
-                const auto token = auth.at("token").get<std::string>();
+            // If token is valid, try getting user record from db and populate context record
+            auto &claims = verification["claims"];
+            const auto user_id = claims["id"].get<std::string>();
+            const auto user_table = claims["entity"].get<std::string>();
 
-                // If token validation worked, lets get data from database
-                const json resp = Auth::verifyToken(token);
-                req.set("verification", resp);
+            // Update auth keys ...
+            auth["id"] = user_id;
+            auth["entity"] = user_table;
 
-                // Update context data and exit from middleware if not verified
-                if (!resp.at("verified").get<bool>()) {
-                    req.set("auth", auth); // Update the `auth` data
-                    return HandlerResponse::Unhandled;
+            // Set type to user since token is valid, but user record may be invalid
+            auth["type"] = "user";
+            if (meter && user_table != "mb_admins") meter(UsageQuotas::userSubject(user_table, user_id));
+
+            try {
+                if (auto user = readAuthUser(app, user_table, user_id); user.has_value()) {
+                    auth["user"] = user.value();
                 }
+            } catch (...) {
+            } // Ignore errors for now
+        }
+    }
 
-                // If token is valid, try getting user record from db and populate context record
-                auto claims = resp["claims"];
-                const auto user_id = claims["id"].get<std::string>();
-                const auto user_table = claims["entity"].get<std::string>();
+    std::function<HandlerResponse(MantisRequest &, MantisResponse &)> getAuthToken() {
+        std::string msg = MB_FUNC();
+        return [msg](MantisRequest &req, MantisResponse &_) {
+            TRACE_FUNC(msg);
+            auto &auth = req.auth();
+            auth["type"] = "guest";
+            auth["token"] = nullptr;
+            auth["id"] = nullptr;
+            auth["entity"] = nullptr;
+            auth["user"] = nullptr;
+            req.verification() = json::object();
+
+            // API key or JWT; hydrateContextData() works out which when `auth` is first read
+            if (req.hasHeader("Authorization")) auth["token"] = trim(req.getBearerTokenAuth());
+            return HandlerResponse::Unhandled;
+        };
+    }
 
-                // Update auth keys ...
-                auth["id"] = user_id;
-                auth["entity"] = user_table;
+    std::function<HandlerResponse(MantisRequest &, MantisResponse &)> hydrateContextData() {
+        std::string msg = MB_FUNC();
+        return [msg](MantisRequest &req, MantisResponse &res) {
+            TRACE_FUNC(msg);
+            // An empty object if getAuthToken() didn't run
+            const auto &auth = req.auth();
 
-                // Set type to user since token is valid, but user record may be invalid
-                auth["type"] = "user";
+            // Verifying the token and loading the user wait until a rule, handler or script reads `auth`
+            if (const auto token = auth.find("token");
+                token == auth.end() || !token->is_string() || token->get_ref<const std::string &>().empty())
+                return HandlerResponse::Unhandled;
 
-                // logEntry::trace("Authenticated on entity {} as user with id {}", user_table, user_id);
+            auto &quotas = req.mApp().router().usageQuotas();
+            if (!quotas.enabled()) {
+                req.deferAuth([&app = req.mApp()](json &a, json &verification) {
+                    resolveAuth(app, a, verification);
+                });
+                return HandlerResponse::Unhandled;
+            }
 
-                try {
-                    const auto user_entity = req.mApp().entity(user_table);
-                    if (auto user = user_entity.read(user_id); user.has_value()) {
-                        auth["user"] = user.value();
+            // Metered: resolved now, so a caller over quota is turned away before the route does any work
+            try {
+                resolveAuth(req.mApp(), req.auth(), req.verification(), [&](const std::string &subject) {
+                    if (const auto decision = quotas.admit(subject); !decision.allowed) {
+                        res.setHeader("Retry-After", std::to_string(decision.retryAfter.count()));
+                        throw MantisException(429, decision.reason);
                     }
-                } catch (...) {
-                } // Ignore errors for now
+                    // Its bandwidth is counted once the response is out, see Router::listen()
+                    req.drogonRequest()->attributes()->insert("mb_quota_subject", subject);
+                });
+            } catch (const MantisException &e) {
+                res.sendJSON(e.code(), {
+                    {"status", e.code()},
+                    {"data", json::object()},
+                    {"error", e.what()}
+                });
+                return HandlerResponse::Handled;
             }
-
-            req.set("auth", auth); // Update the `auth` data
             return HandlerResponse::Unhandled;
         };
     }
@@ -293,7 +305,7 @@ namespace mb {
             TRACE_FUNC(msg);
             const auto schema_id_or_name = trim(req.getPathParamValue("schema_name_or_id"));
             if (schema_id_or_name.empty()) {
-                res.sendJSON(404, entityRouteNotFoundResponse(req.getMethod(), req.getPath()));
+                res.sendJSON(404, entityRouteNotFoundResponse(req.methodName(), req.getPath()));
                 return HandlerResponse::Handled;
             }
 
@@ -313,7 +325,7 @@ namespace mb {
                 return HandlerResponse::Unhandled;
             } catch (const MantisException &e) {
                 if (e.code() == 404 || e.code() == 400) {
-                    res.sendJSON(404, entityRouteNotFoundResponse(req.getMethod(), req.getPath()));
+                    res.sendJSON(404, entityRouteNotFoundResponse(req.methodName(), req.getPath()));
                     return HandlerResponse::Handled;
                 }
 
@@ -333,18 +345,18 @@ namespace mb {
             TRACE_FUNC(msg);
             const auto entity_name = trim(req.getPathParamValue("entity_name"));
             if (entity_name.empty() || !EntitySchema::isValidEntityName(entity_name)) {
-                res.sendJSON(404, entityRouteNotFoundResponse(req.getMethod(), req.getPath()));
+                res.sendJSON(404, entityRouteNotFoundResponse(req.methodName(), req.getPath()));
                 return HandlerResponse::Handled;
             }
 
             if (!req.mApp().hasEntity(entity_name)) {
-                res.sendJSON(404, entityRouteNotFoundResponse(req.getMethod(), req.getPath()));
+                res.sendJSON(404, entityRouteNotFoundResponse(req.methodName(), req.getPath()));
                 return HandlerResponse::Handled;
             }
 
-            const auto entity = req.mApp().entity(entity_name);
-            if (entity.isSystem() || !entity.hasApi() || entity.type() != "auth") {
-                res.sendJSON(404, entityRouteNotFoundResponse(req.getMethod(), req.getPath()));
+            const auto entity = requestEntity(req, entity_name);
+            if (entity->isSystem() || !entity->hasApi() || entity->type() != "auth") {
+                res.sendJSON(404, entityRouteNotFoundResponse(req.methodName(), req.getPath()));
                 return HandlerResponse::Handled;
             }
 
@@ -358,18 +370,18 @@ namespace mb {
             TRACE_FUNC(msg);
             const auto entity_name = trim(req.getPathParamValue("entity_name"));
             if (entity_name.empty() || !EntitySchema::isValidEntityName(entity_name)) {
-                res.sendJSON(404, entityRouteNotFoundResponse(req.getMethod(), req.getPath()));
+                res.sendJSON(404, entityRouteNotFoundResponse(req.methodName(), req.getPath()));
                 return HandlerResponse::Handled;
             }
 
             if (!req.mApp().hasEntity(entity_name)) {
-                res.sendJSON(404, entityRouteNotFoundResponse(req.getMethod(), req.getPath()));
+                res.sendJSON(404, entityRouteNotFoundResponse(req.methodName(), req.getPath()));
                 return HandlerResponse::Handled;
             }
 
-            const auto entity = req.mApp().entity(entity_name);
-            if (entity.isSystem() || !entity.hasApi()) {
-                res.sendJSON(404, entityRouteNotFoundResponse(req.getMethod(), req.getPath()));
+            const auto entity = requestEntity(req, entity_name);
+            if (entity->isSystem() || !entity->hasApi()) {
+                res.sendJSON(404, entityRouteNotFoundResponse(req.methodName(), req.getPath()));
                 return HandlerResponse::Handled;
             }
 
@@ -377,17 +389,23 @@ namespace mb {
         };
     }
 
+    std::shared_ptr<const Entity> requestEntity(MantisRequest &req, const std::string &entity_name) {
+        auto &entity = req.entity();
+        if (!entity || entity->name() != entity_name) entity = req.mApp().entitySnapshot(entity_name);
+        return entity;
+    }
+
     std::function<HandlerResponse(MantisRequest &, MantisResponse &)> rejectViewMutations() {
         std::string msg = MB_FUNC();
         return [msg](MantisRequest &req, MantisResponse &res) {
             TRACE_FUNC(msg);
             const auto entity_name = trim(req.getPathParamValue("entity_name"));
-            const auto entity = req.mApp().entity(entity_name);
-            if (entity.type() == "view") {
+            const auto entity = requestEntity(req, entity_name);
+            if (entity->type() == "view") {
                 res.sendJSON(405, {
                     {"status", 405},
                     {"data", json::object()},
-                    {"error", std::format("Method `{}` is not allowed for view entity `{}`", req.getMethod(), entity_name)}
+                    {"error", std::format("Method `{}` is not allowed for view entity `{}`", req.methodName(), entity_name)}
                 });
                 return HandlerResponse::Handled;
             }
@@ -396,6 +414,24 @@ namespace mb {
         };
     }
 
+    bool hasRuleAccess(MantisRequest &req, const AccessRule &rule) {
+        return !ruleDenial(req, rule).has_value();
+    }
+
+    void setRuleAuth(MantisRequest &req, const AccessRule &rule, json &opts) {
+        if (rule.filter().empty()) return;
+        const auto &auth = req.auth();
+        const auto &verification = req.verification();
+        const bool verified = verification.contains("verified") && verification["verified"].is_boolean() &&
+                              verification["verified"].get<bool>();
+        if (verified && auth["entity"].is_string() && auth["entity"].get<std::string>() == "mb_admins") return;
+
+        // Ids and user fields only; an unverified token binds as a guest
+        opts["auth"] = verified
+                           ? json{{"id", auth["id"]}, {"entity", auth["entity"]}, {"user", auth["user"]}}
+                           : json{{"id", nullptr}, {"entity", nullptr}, {"user", nullptr}};
+    }
+
     std::function<HandlerResponse(MantisRequest &, MantisResponse &)> hasEntityAccess() {
         std::string msg = MB_FUNC();
         return [msg](MantisRequest &req, MantisResponse &res) {
@@ -404,6 +440,50 @@ namespace mb {
         };
     }
 
+    std::function<HandlerResponse(MantisRequest &, MantisResponse &)> hasBatchAccess() {
+        std::string msg = MB_FUNC();
+        return [msg](MantisRequest &req, MantisResponse &res) {
+            TRACE_FUNC(msg);
+            try {
+                const auto entity = requestEntity(req, trim(req.getPathParamValue("entity_name")));
+
+                // Collect the kinds of op in the batch; a body the handler will
+                // reject still has to pass the create rule
+                bool creates = false, updates = false, deletes = false;
+                if (const auto &[body, err] = req.getBodyAsJson();
+                    err.empty() && body.is_object() && body.contains("ops") && body["ops"].is_array()) {
+                    for (const auto &op: body["ops"]) {
+                        const auto kind = op.is_object() && op.contains("op") && op["op"].is_string()
+                                              ? op["op"].get<std::string>()
+                                              : "";
+                        creates |= kind == "create";
+                        updates |= kind == "update";
+                        deletes |= kind == "delete";
+                    }
+                }
+                if (!updates && !deletes) creates = true;
+
+                const std::pair<bool, const AccessRule *> checks[] = {
+                    {creates, &entity->addRule()},
+                    {updates, &entity->updateRule()},
+                    {deletes, &entity->deleteRule()}
+                };
+                for (const auto &[needed, rule]: checks) {
+                    if (needed && checkRuleAccess(req, res, *rule) == HandlerResponse::Handled)
+                        return HandlerResponse::Handled;
+                }
+                return HandlerResponse::Unhandled;
+            } catch (std::exception &e) {
+                res.sendJSON(500, {
+                    {"status", 500},
+                    {"data", json::object()},
+                    {"error", e.what()}
+                });
+                return HandlerResponse::Handled;
+            }
+        };
+    }
+
     std::function<HandlerResponse(MantisRequest &, MantisResponse &)> hasAccess(const std::string &entity_name) {
         std::string msg = MB_FUNC();
         return [entity_name, msg](MantisRequest &req, MantisResponse &res) {
@@ -423,7 +503,7 @@ namespace mb {
         std::string msg = MB_FUNC();
         return [msg](MantisRequest &req, MantisResponse &res) {
             TRACE_FUNC(msg);
-            const auto &auth = req.getOr<json>("auth", json::object());
+            const auto &auth = req.auth();
             if (auth["type"] == "guest")
                 return HandlerResponse::Unhandled;
 
@@ -440,9 +520,10 @@ namespace mb {
         std::string msg = MB_FUNC();
         return [msg](MantisRequest &req, const MantisResponse &res) {
             TRACE_FUNC(msg);
+            const ServerTiming::Span span("auth");
             try {
                 // Require admin authentication
-                const auto &verification = req.getOr<json>("verification", json::object());
+                const auto &verification = req.verification();
                 // logEntry::trace("Verification: {}", verification.dump());
 
                 if (verification.empty()) {
@@ -459,7 +540,7 @@ namespace mb {
                                 verification["verified"].is_boolean() &&
                                 verification["verified"].get<bool>();
                 if (ok) {
-                    const auto &auth = req.getOr<json>("auth", json::object());
+                    const auto &auth = req.auth();
                     // logEntry::trace("Ver User Auth: {}", auth.dump());
 
                     // Check if verified user object is valid, if not throw auth error
@@ -526,39 +607,16 @@ namespace mb {
         };
     }
 
-    // Rate limiting storage structure
-    namespace {
-        struct RateLimitEntry {
-            std::deque<std::chrono::steady_clock::time_point> requests;
-        };
-
-        // In-memory storage for rate limit tracking
-        // Key: identifier (IP address or user ID)
-        // Value: deque of request timestamps within the window
-        std::unordered_map<std::string, RateLimitEntry> rate_limit_store;
-        std::mutex rate_limit_mutex;
-        constexpr auto CLEANUP_INTERVAL = std::chrono::minutes(5);
-
-        // Timestamp of the last full sweep of rate_limit_store (guarded by
-        // rate_limit_mutex). The sweep evicts entries for identifiers that were
-        // seen once and never returned, which the per-identifier cleanup can
-        // never reach.
-        std::chrono::steady_clock::time_point last_global_sweep{};
-
-        // An entry whose most recent request is older than this is stale: all of
-        // its timestamps are outside every rate-limit window, so it can be
-        // evicted. MUST be >= the largest window passed to rateLimit() (the
-        // largest currently in use is 1 hour for admin setup).
-        constexpr auto STALE_ENTRY_TTL = std::chrono::hours(1);
-    }
-
     std::function<HandlerResponse(MantisRequest &, MantisResponse &)> rateLimit(
         int max_requests, 
         int window_seconds, 
-        bool use_user_id) {
+        bool use_user_id,
+        const std::string &scope) {
         std::string msg = MB_FUNC();
-        
-        return [max_requests, window_seconds, use_user_id, msg](
+        // Per route: limits of different routes don't share a budget
+        auto limiter = RateLimiter::create(max_requests, std::chrono::seconds(window_seconds), scope);
+
+        return [max_requests, window_seconds, use_user_id, msg, limiter](
             MantisRequest &req, MantisResponse &res) {
             TRACE_FUNC(msg);
             
@@ -574,16 +632,16 @@ namespace mb {
                 
                 if (use_user_id) {
                     // Try to get user ID from auth context
-                    const auto &auth = req.getOr<json>("auth", json::object());
+                    const auto &auth = req.auth();
                     if (auth.contains("id") && !auth["id"].is_null()) {
                         identifier = auth["id"].get<std::string>();
                     } else {
                         // Fallback to IP if no user ID available
-                        identifier = req.getRemoteAddr();
+                        if (const auto &ip = req.remoteIp()) identifier = ip->toString();
                     }
                 } else {
-                    // Use IP address
-                    identifier = req.getRemoteAddr();
+                    // Canonical form, so every spelling of an address shares its budget
+                    if (const auto &ip = req.remoteIp()) identifier = ip->toString();
                 }
                 
                 if (identifier.empty()) {
@@ -592,55 +650,18 @@ namespace mb {
                     LogOrigin::warn("Rate Limit Client Unknown", "Rate limit: Unable to identify client, allowing request");
                     return HandlerResponse::Unhandled;
                 }
-                
-                const auto now = std::chrono::steady_clock::now();
-                const auto window_duration = std::chrono::seconds(window_seconds);
-                const auto cutoff_time = now - window_duration;
-                
-                // Lock for thread-safe access
-                std::lock_guard<std::mutex> lock(rate_limit_mutex);
-
-                // Periodically sweep the whole store so entries for identifiers
-                // that were seen once and never came back (e.g. IP scans,
-                // spoofed source IPs) don't accumulate without bound. Throttled
-                // to once per CLEANUP_INTERVAL and piggybacked on request
-                // traffic, so it costs nothing when idle.
-                if (now - last_global_sweep > CLEANUP_INTERVAL) {
-                    last_global_sweep = now;
-                    for (auto it = rate_limit_store.begin(); it != rate_limit_store.end();) {
-                        const auto& reqs = it->second.requests;
-                        if (reqs.empty() || now - reqs.back() > STALE_ENTRY_TTL) {
-                            it = rate_limit_store.erase(it);
-                        } else {
-                            ++it;
-                        }
-                    }
-                }
-
-                // Get or create entry for this identifier
-                auto& entry = rate_limit_store[identifier];
 
-                // Cleanup old requests outside the window
-                while (!entry.requests.empty() && entry.requests.front() < cutoff_time) {
-                    entry.requests.pop_front();
-                }
+                const auto decision = limiter->acquire(identifier);
+                // Unix timestamp when the client has its full budget again
+                const auto reset_time = std::chrono::duration_cast<std::chrono::seconds>(
+                    std::chrono::system_clock::now().time_since_epoch() + decision.reset
+                ).count();
+                res.setHeader("X-RateLimit-Limit", std::to_string(max_requests));
+                res.setHeader("X-RateLimit-Remaining", std::to_string(decision.remaining));
+                res.setHeader("X-RateLimit-Reset", std::to_string(reset_time));
 
-                // Check if rate limit exceeded
-                if (entry.requests.size() >= static_cast<size_t>(max_requests)) {
-                    // Calculate retry-after seconds (time until oldest request expires)
-                    const auto oldest_request = entry.requests.front();
-                    const auto retry_after = std::chrono::duration_cast<std::chrono::seconds>(
-                        window_duration - (now - oldest_request)
-                    ).count() + 1; // Add 1 second buffer
-                    
-                    // Set rate limit headers
-                    res.setHeader("X-RateLimit-Limit", std::to_string(max_requests));
-                    res.setHeader("X-RateLimit-Remaining", "0");
-                    // Calculate reset time (Unix timestamp when the window expires)
-                    const auto reset_time = std::chrono::duration_cast<std::chrono::seconds>(
-                        std::chrono::system_clock::now().time_since_epoch()
-                    ).count() + retry_after;
-                    res.setHeader("X-RateLimit-Reset", std::to_string(reset_time));
+                if (!decision.allowed) {
+                    const auto retry_after = decision.retryAfter.count();
                     res.setHeader("Retry-After", std::to_string(retry_after));
                     
                     // Send 429 Too Many Requests response
@@ -654,34 +675,11 @@ namespace mb {
                     });
                     
                     LogOrigin::warn("Rate Limit Exceeded", fmt::format("Rate limit exceeded for identifier: {} ({} requests in {}s window)",
-                                identifier, entry.requests.size(), window_seconds));
+                                identifier, max_requests, window_seconds));
                     
                     return HandlerResponse::Handled;
                 }
                 
-                // Add current request timestamp
-                entry.requests.push_back(now);
-                
-                // Set rate limit headers for successful requests
-                const auto remaining = max_requests - static_cast<int>(entry.requests.size());
-                res.setHeader("X-RateLimit-Limit", std::to_string(max_requests));
-                res.setHeader("X-RateLimit-Remaining", std::to_string(remaining));
-                // Calculate reset time (Unix timestamp when the oldest request in window expires)
-                if (!entry.requests.empty()) {
-                    const auto time_until_reset = std::chrono::duration_cast<std::chrono::seconds>(
-                        window_duration - (now - entry.requests.front())
-                    ).count();
-                    const auto reset_time = std::chrono::duration_cast<std::chrono::seconds>(
-                        std::chrono::system_clock::now().time_since_epoch()
-                    ).count() + time_until_reset;
-                    res.setHeader("X-RateLimit-Reset", std::to_string(reset_time));
-                } else {
-                    const auto reset_time = std::chrono::duration_cast<std::chrono::seconds>(
-                        std::chrono::system_clock::now().time_since_epoch()
-                    ).count() + window_seconds;
-                    res.setHeader("X-RateLimit-Reset", std::to_string(reset_time));
-                }
-                
                 return HandlerResponse::Unhandled;
                 
             } catch (const std::exception &e) {
@@ -691,4 +689,44 @@ namespace mb {
             }
         };
     }
+
+    namespace {
+        /// A type of its own, so the router can tell the marker apart when composing a chain
+        struct NoAuthContext {
+            HandlerResponse operator()(MantisRequest &, MantisResponse &) const { return HandlerResponse::Unhandled; }
+        };
+    }
+
+    std::function<HandlerResponse(MantisRequest &, MantisResponse &)> noAuthContext() {
+        return NoAuthContext{};
+    }
+
+    bool isNoAuthContext(const MiddlewareFn &middleware) {
+        return middleware.target<NoAuthContext>() != nullptr;
+    }
+
+    std::function<HandlerResponse(MantisRequest &, MantisResponse &)> noCompression() {
+        return [](MantisRequest &req, MantisResponse &) {
+            // Read by Router::compressResponse() once the handler is done
+            req.set("mb_no_compression", true);
+            return HandlerResponse::Unhandled;
+        };
+    }
+
+    std::function<HandlerResponse(MantisRequest &, MantisResponse &)> replicaReadOnly(const std::string &primary) {
+        return [primary](MantisRequest &req, MantisResponse &res) {
+            const auto method = req.method();
+            if (method == RequestMethod::Get || method == RequestMethod::Head || method == RequestMethod::Options ||
+                req.getPath() == "/api/v1/realtime")
+                return HandlerResponse::Unhandled;
+
+            res.setHeader("X-Mb-Primary", primary);
+            res.sendJSON(405, {
+                             {"data", json::object()},
+                             {"status", 405},
+                             {"error", std::format("This node is a read replica; send writes to {}", primary)}
+                         });
+            return HandlerResponse::Handled;
+        };
+    }
 }
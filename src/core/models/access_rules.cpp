@@ -1,27 +1,33 @@
 #include "../../../include/mantisbase/core/models/access_rules.h"
 #include "mantisbase/core/exceptions.h"
+#include "mantisbase/core/expr_evaluator.h"
 
 namespace mb {
-    AccessRule::AccessRule(const std::string &mode, const std::string &expr) {
+    AccessRule::AccessRule(const std::string &mode, const std::string &expr, const std::string &filter) {
         if (!(mode == "public" || mode == "auth" || mode == "custom" || mode.empty())) {
             throw MantisException(400, "Expected rule to be `public`, `auth` or `custom` only!");
         }
 
         m_mode = mode;
         m_expr = mode == "custom" ? expr : ""; // Reset `expr` for non-custom mode types
+        m_filter = filter;
+        recompile();
     }
 
     nlohmann::json AccessRule::toJSON() const {
-        return {
+        nlohmann::json j = {
             {"mode", m_mode},
             {"expr", m_mode == "custom" ? m_expr : ""} // Ensure its empty for non-custom types
         };
+        if (!m_filter.empty()) j["filter"] = m_filter;
+        return j;
     }
 
     AccessRule AccessRule::fromJSON(const nlohmann::json &j) {
         const auto mode = j.is_null() ? "" : j.contains("mode") ? j["mode"].get<std::string>() : "";
         const auto expr = j.is_null() ? "" : j.contains("expr") ? j["expr"].get<std::string>() : "";
-        return AccessRule{mode, expr};
+        const auto filter = j.is_null() ? "" : j.contains("filter") && j["filter"].is_string() ? j["filter"].get<std::string>() : "";
+        return AccessRule{mode, expr, filter};
     }
 
     std::string AccessRule::mode() const { return m_mode; }
@@ -32,11 +38,27 @@ namespace mb {
         }
 
         m_mode = _mode;
+        recompile();
     }
 
     std::string AccessRule::expr() const { return m_expr; }
 
     void AccessRule::setExpr(const std::string &_expr) {
         m_expr = _expr;
+        recompile();
+    }
+
+    std::string AccessRule::filter() const { return m_filter; }
+
+    void AccessRule::setFilter(const std::string &_filter) {
+        m_filter = _filter;
+    }
+
+    bool AccessRule::evaluate(const nlohmann::json &vars) const {
+        return m_compiled && m_compiled->eval(vars);
+    }
+
+    void AccessRule::recompile() {
+        m_compiled = m_mode == "custom" ? CompiledExpr::compile(m_expr) : nullptr;
     }
 } // mantis
@@ -1,9 +1,13 @@
 #include "../../../include/mantisbase/core/models/entity.h"
 #include "../../../include/mantisbase/core/models/entity_schema.h"
 #include "../../../include/mantisbase/core/models/entity_schema_field.h"
+#include "../../../include/mantisbase/core/models/validators.h"
+#include "../../../include/mantisbase/utils/utils.h"
 #include "../../../include/mantisbase/utils/uuidv7.h"
 #include "mantisbase/utils/soci_wrappers.h"
 
+#include <algorithm>
+
 namespace mb {
     Entity::Entity(const MantisBase &app, const nlohmann::json &schema) : m_app(app) {
         LogOrigin::entityTrace("Entity Creation", "Creating Entity from JSON Schema", schema);
@@ -59,6 +63,26 @@ namespace mb {
         }
 
         m_schema = std::make_shared<const json>(std::move(s));
+        m_compiled = std::make_shared<Compiled>();
+
+        std::unordered_set<std::string> indexed{"id"};
+        m_sortIndexes = std::make_shared<SortIndexes>();
+        m_sortIndexes->leading.insert("id");
+        m_sortIndexes->columns.push_back({"id"});
+        if (m_schema->contains("indexes") && (*m_schema)["indexes"].is_array()) {
+            for (const auto &idx: (*m_schema)["indexes"]) {
+                if (!idx.contains("columns") || !idx["columns"].is_array()) continue;
+                for (const auto &col: idx["columns"])
+                    if (col.is_string()) indexed.insert(col.get<std::string>());
+                if (!idx["columns"].empty() && idx["columns"][0].is_string())
+                    m_sortIndexes->leading.insert(idx["columns"][0].get<std::string>());
+                std::vector<std::string> columns;
+                for (const auto &col: idx["columns"])
+                    if (col.is_string()) columns.push_back(col.get<std::string>());
+                m_sortIndexes->columns.push_back(std::move(columns));
+            }
+        }
+        m_filterCache = std::make_shared<EntityFilterCache>(std::move(indexed), 256, app.dbType());
     }
 
     Entity::Entity(const MantisBase &app, const std::string &name, const std::string &type)
@@ -97,6 +121,10 @@ namespace mb {
         return m_schema->contains("has_api") ? m_schema->at("has_api").get<bool>() : false;
     }
 
+    int Entity::shards() const {
+        return m_schema->value("shards", 1);
+    }
+
     std::string Entity::viewQuery() const {
         if (type() != "view")
             throw MantisException(500, "View Query only allowed for `view` types!");
@@ -112,51 +140,225 @@ namespace mb {
     }
 
     std::optional<json> Entity::field(const std::string &field_name) const {
-        if (!m_schema->contains("fields")) return std::nullopt;
-        for (auto _field: (*m_schema)["fields"]) {
-            if (_field.contains("name") && _field["name"].get<std::string>() == field_name)
-                return _field;
-        }
+        if (const auto *def = fieldDef(field_name)) return *def;
         return std::nullopt;
     }
 
-    std::optional<json> Entity::hasField(const std::string &field_name) const {
-        return field(field_name).has_value();
+    const json *Entity::fieldDef(const std::string &field_name) const {
+        const auto &index = compiled().fieldIndex;
+        const auto it = index.find(field_name);
+        return it == index.end() ? nullptr : it->second;
+    }
+
+    const Entity::Compiled &Entity::compiled() const {
+        std::call_once(m_compiled->once, [this] {
+            // Views may carry no fields
+            static const std::vector<json> no_fields{};
+            const auto &schema_fields = m_schema->contains("fields") && (*m_schema)["fields"].is_array()
+                                            ? (*m_schema)["fields"].get_ref<const std::vector<json> &>()
+                                            : no_fields;
+            // PostgreSQL compresses large values itself
+            m_compiled->codec = std::make_shared<const RowCodec>(schema_fields, app().dbType() == "sqlite3");
+            m_compiled->validation = std::make_shared<const ValidationPlan>(ValidationPlan::compile(schema_fields));
+
+            // Blobs are streamed on their own, never read with the record
+            std::string columns;
+            bool blobs = false;
+            for (const auto &field: schema_fields) {
+                if (!field.contains("name") || !field["name"].is_string()) continue;
+                // Keys view the names inside the schema, which outlives this index
+                m_compiled->fieldIndex.try_emplace(field["name"].get_ref<const std::string &>(), &field);
+                const auto col = sqlIdentifier(field["name"].get<std::string>());
+                const bool blob = field.value("type", "") == "blob";
+                blobs |= blob;
+                columns += (columns.empty() ? "" : ", ") + (blob ? std::format("length({0}) AS {0}", col) : col);
+            }
+            m_compiled->columns = blobs ? std::move(columns) : "*";
+
+            // Custom expressions compile here, not per request
+            const auto &r = (*m_schema)["rules"];
+            m_compiled->rules = std::make_shared<const Rules>(Rules{
+                AccessRule::fromJSON(r.value("list", json{})),
+                AccessRule::fromJSON(r.value("get", json{})),
+                AccessRule::fromJSON(r.value("add", json{})),
+                AccessRule::fromJSON(r.value("update", json{})),
+                AccessRule::fromJSON(r.value("delete", json{}))
+            });
+
+            // Row filters were checked when the schema was saved; one that no
+            // longer compiles lets no row through rather than all of them
+            const auto row_filter = [this](const AccessRule &rule) -> std::shared_ptr<const CompiledFilter> {
+                if (trim(rule.filter()).empty()) return nullptr;
+                try {
+                    return std::make_shared<const CompiledFilter>(
+                        EntityFilter::compileRule(rule.filter(), *m_compiled->codec, {}, app().dbType()));
+                } catch (const MantisException &e) {
+                    LogOrigin::entityWarn("Rule Filter", std::format("Rule filter `{}` of `{}` matches no rows: {}",
+                                                                     rule.filter(), name(), e.what()));
+                    CompiledFilter none;
+                    none.where = "1 = 0";
+                    return std::make_shared<const CompiledFilter>(std::move(none));
+                }
+            };
+            m_compiled->listFilter = row_filter(m_compiled->rules->list);
+            m_compiled->getFilter = row_filter(m_compiled->rules->get);
+        });
+        return *m_compiled;
+    }
+
+    const std::string &Entity::recordColumns() const {
+        return compiled().columns;
+    }
+
+    const RowCodec &Entity::rowCodec() const {
+        return *compiled().codec;
+    }
+
+    const ValidationPlan &Entity::validationPlan() const {
+        return *compiled().validation;
+    }
+
+    std::shared_ptr<const CompiledFilter> Entity::compileFilter(const std::string &filter) const {
+        return m_filterCache->get(filter, rowCodec());
+    }
+
+    std::shared_ptr<const CompiledFilter> Entity::queryFilter(const json &opts) const {
+        std::shared_ptr<const CompiledFilter> filter;
+        if (opts.contains("filter") && opts["filter"].is_string() && !trim(opts["filter"].get<std::string>()).empty())
+            filter = compileFilter(opts["filter"].get<std::string>());
+
+        const auto &rule = compiled().listFilter;
+        if (!rule || !opts.contains("auth")) return filter;
+        auto bound = EntityFilter::bindVariables(*rule, {{"auth", opts["auth"]}});
+        if (filter) bound = EntityFilter::conjoin(*filter, bound);
+        return std::make_shared<const CompiledFilter>(std::move(bound));
+    }
+
+    void Entity::prewarm(const Entity &previous) const {
+        // Least recently used first, so the cache ends up in the same order
+        const auto filters = previous.m_filterCache->filters();
+        for (auto it = filters.rbegin(); it != filters.rend(); ++it) {
+            try {
+                compileFilter(*it);
+            } catch (const MantisException &) {}
+        }
+    }
+
+    std::vector<std::string> Entity::projection(const std::string &fields) const {
+        std::vector<std::string> columns;
+        for (const auto &part: splitString(fields, ",")) {
+            const auto field = trim(part);
+            if (field.empty()) continue;
+            if (!rowCodec().column(field))
+                throw MantisException(400, std::format("Unknown field `{}` in `fields`", field));
+            if (field == "password" && type() == "auth") continue;
+            if (std::ranges::find(columns, field) == columns.end()) columns.push_back(field);
+        }
+
+        if (columns.empty()) return columns;
+        if (const auto it = std::ranges::find(columns, "id"); it != columns.end()) columns.erase(it);
+        columns.insert(columns.begin(), "id");
+        return columns;
+    }
+
+    bool Entity::isSortable(const std::string &field) const {
+        if (field == "id") return true;
+        const auto *col = rowCodec().column(field);
+        if (!col || col->compress || col->secret) return false;
+        return col->type == "string" || col->type == "date" || col->type == "int" ||
+               col->type == "double" || col->type == "bool";
+    }
+
+    std::vector<std::string> Entity::searchFields() const {
+        std::vector<std::string> names;
+        if (!m_schema->contains("fields") || !(*m_schema)["fields"].is_array()) return names;
+        for (const auto &f: (*m_schema)["fields"])
+            if (f.value("searchable", false) && f.contains("name") && f["name"].is_string())
+                names.push_back(f["name"].get<std::string>());
+        return names;
+    }
+
+    std::optional<IndexDefinition> Entity::sortIndexRecommendation(const std::string &field) const {
+        if (!isSortable(field) || m_sortIndexes->leading.contains(field)) return std::nullopt;
+
+        IndexDefinition idx;
+        idx.name = std::format("idx_{}_{}_id", name(), field);
+        idx.columns = {field, "id"};
+        return idx;
+    }
+
+    std::optional<IndexDefinition> Entity::listIndexRecommendation(const CompiledFilter *filter,
+                                                                   const std::string &sort_field) const {
+        std::vector<std::string> columns;
+        if (filter)
+            columns.assign(filter->seekFields.begin(), filter->seekFields.begin() + filter->seekEquals);
+        if (sort_field != "id" && isSortable(sort_field)) {
+            if (std::ranges::find(columns, sort_field) == columns.end()) columns.push_back(sort_field);
+        } else if (filter && filter->seekFields.size() > filter->seekEquals) {
+            columns.push_back(filter->seekFields[filter->seekEquals]);
+        }
+        if (columns.empty()) return std::nullopt;
+
+        // An index starting with these columns serves the page already
+        for (const auto &existing: m_sortIndexes->columns) {
+            if (existing.size() >= columns.size() && std::equal(columns.begin(), columns.end(), existing.begin()))
+                return std::nullopt;
+        }
+
+        IndexDefinition idx;
+        if (columns.back() != "id") columns.push_back("id");
+        idx.name = "idx_" + name();
+        for (auto col: columns) {
+            std::ranges::replace(col, '.', '_');
+            idx.name += "_" + col;
+        }
+        // Identifiers stop at 63 characters on PostgreSQL
+        if (idx.name.size() > 63)
+            idx.name = std::format("idx_{}_{:08x}", name().substr(0, 50),
+                                   std::hash<std::string>{}(idx.name) & 0xffffffffu);
+        idx.columns = std::move(columns);
+        return idx;
+    }
+
+    bool Entity::hasField(const std::string &field_name) const {
+        return fieldDef(field_name) != nullptr;
     }
 
     const json &Entity::rules() const {
         return (*m_schema)["rules"];
     }
 
-    AccessRule Entity::listRule() const {
-        return AccessRule::fromJSON(rules()["list"]);
+    const AccessRule &Entity::listRule() const {
+        return compiled().rules->list;
     }
 
-    AccessRule Entity::getRule() const {
-        return AccessRule::fromJSON(rules()["get"]);
+    const AccessRule &Entity::getRule() const {
+        return compiled().rules->get;
     }
 
-    AccessRule Entity::addRule() const {
-        return AccessRule::fromJSON(rules()["add"]);
+    const CompiledFilter *Entity::listFilter() const {
+        return compiled().listFilter.get();
     }
 
-    AccessRule Entity::updateRule() const {
-        return AccessRule::fromJSON(rules()["update"]);
+    const CompiledFilter *Entity::getFilter() const {
+        return compiled().getFilter.get();
     }
 
-    AccessRule Entity::deleteRule() const {
-        return AccessRule::fromJSON(rules()["delete"]);
+    const AccessRule &Entity::addRule() const {
+        return compiled().rules->add;
     }
 
-    const json &Entity::schema() const { return *m_schema; }
+    const AccessRule &Entity::updateRule() const {
+        return compiled().rules->update;
+    }
 
-    std::optional<json> Entity::findField(const std::string &field_name) const {
-        if (field_name.empty()) return std::nullopt;
+    const AccessRule &Entity::deleteRule() const {
+        return compiled().rules->del;
+    }
 
-        for (auto field: fields()) {
-            if (field.value("name", "") == field_name) return field;
-        }
+    const json &Entity::schema() const { return *m_schema; }
 
-        return std::nullopt;
+    std::optional<json> Entity::findField(const std::string &field_name) const {
+        return field(field_name);
     }
 } // mantis
@@ -0,0 +1,209 @@
+/**
+ * @file entity_archive.cpp
+ * @brief Implementation for @see entity_archive.h
+ */
+
+#include "../../../include/mantisbase/core/models/entity_archive.h"
+#include "../../../include/mantisbase/core/models/entity.h"
+#include "../../../include/mantisbase/core/models/entity_schema.h"
+#include "../../../include/mantisbase/core/database.h"
+#include "../../../include/mantisbase/core/logger/logger.h"
+#include "../../../include/mantisbase/core/metrics.h"
+#include "../../../include/mantisbase/mantisbase.h"
+#include "../../../include/mantisbase/utils/utils.h"
+
+#include <soci/soci.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <format>
+#include <mutex>
+#include <set>
+#include <unordered_set>
+
+namespace mb {
+    namespace {
+        std::atomic<std::uint64_t> g_rows{0}, g_errors{0};
+
+        /// `entity`'s column names, comma separated
+        std::string columnList(const Entity &entity) {
+            std::string list;
+            for (const auto &field: entity.fields())
+                list += (list.empty() ? "" : ", ") + sqlIdentifier(field["name"].get<std::string>());
+            return list;
+        }
+
+        /// Create the archive of `entity` if missing, and add the columns the entity gained since
+        void ensure(soci::session &sql, const std::string &entity) {
+            const auto table = ArchivePolicy::tableOf(entity);
+            const auto archived = EntityArchive::columns(sql, table);
+            if (archived.empty()) {
+                // Columns and types, without the constraints: archived rows are never written again
+                sql << std::format("CREATE TABLE {} AS SELECT * FROM {} WHERE 1 = 0", table, entity);
+                sql << std::format("CREATE INDEX IF NOT EXISTS {0}_id ON {0} (id)", table);
+                // Compressed and moved out of line from 128 bytes on, rather than about 2 kB
+                if (sql.get_backend_name() == "postgresql")
+                    sql << std::format("ALTER TABLE {} SET (toast_tuple_target = 128)", table);
+                return;
+            }
+
+            std::unordered_set<std::string> have;
+            for (const auto &[name, _]: archived) have.insert(name);
+            for (const auto &[name, type]: EntityArchive::columns(sql, entity))
+                if (!have.contains(name)) sql << std::format("ALTER TABLE {} ADD COLUMN {} {}", table, name, type);
+        }
+    }
+
+    void EntityArchive::sync(const EntitySchema &schema, soci::session &sql) {
+        if (schema.type() == "view") return;
+        const auto entity = sqlIdentifier(schema.name());
+        if (schema.archive().enabled() || !columns(sql, ArchivePolicy::tableOf(entity)).empty())
+            ensure(sql, entity);
+    }
+
+    void EntityArchive::rename(const std::string &from, const std::string &to, soci::session &sql) {
+        const auto table = ArchivePolicy::tableOf(sqlIdentifier(from));
+        if (columns(sql, table).empty()) return;
+        sql << std::format("ALTER TABLE {} RENAME TO {}", table, ArchivePolicy::tableOf(sqlIdentifier(to)));
+    }
+
+    void EntityArchive::renameField(const std::string &entity, const std::string &from, const std::string &to,
+                                    soci::session &sql) {
+        const auto table = ArchivePolicy::tableOf(sqlIdentifier(entity));
+        const auto archived = columns(sql, table);
+        if (std::ranges::none_of(archived, [&](const auto &column) { return column.first == from; })) return;
+        sql << std::format("ALTER TABLE {} RENAME COLUMN {} TO {}", table, sqlIdentifier(from), sqlIdentifier(to));
+    }
+
+    void EntityArchive::drop(const std::string &entity, soci::session &sql) {
+        sql << "DROP TABLE IF EXISTS " + ArchivePolicy::tableOf(sqlIdentifier(entity));
+    }
+
+    std::vector<std::pair<std::string, std::string>> EntityArchive::columns(soci::session &sql,
+                                                                            const std::string &table) {
+        std::vector<std::pair<std::string, std::string>> cols;
+        if (sql.get_backend_name() == "postgresql") {
+            const soci::rowset<soci::row> rows = (sql.prepare
+                << "SELECT attname::text, format_type(atttypid, atttypmod) FROM pg_attribute "
+                   "WHERE attrelid = to_regclass(:t) AND attnum > 0 AND NOT attisdropped ORDER BY attnum",
+                soci::use(table, "t"));
+            for (const auto &row: rows) cols.emplace_back(row.get<std::string>(0), row.get<std::string>(1));
+        } else {
+            const soci::rowset<soci::row> rows = (sql.prepare
+                << std::format("PRAGMA table_info({})", table));
+            for (const auto &row: rows) cols.emplace_back(row.get<std::string>(1), row.get<std::string>(2));
+        }
+        return cols;
+    }
+
+    std::string EntityArchive::source(const Entity &entity, soci::session &sql) {
+        const auto name = sqlIdentifier(entity.name());
+        const auto table = ArchivePolicy::tableOf(name);
+        // Looked up per query; reads asking for archived rows are the rare ones
+        const auto archived = columns(sql, table);
+        if (archived.empty()) return name;
+
+        std::unordered_set<std::string> have;
+        for (const auto &[column, _]: archived) have.insert(column);
+        std::string cold;
+        for (const auto &field: entity.fields()) {
+            const auto column = sqlIdentifier(field["name"].get<std::string>());
+            cold += (cold.empty() ? "" : ", ") + (have.contains(column) ? column : "NULL AS " + column);
+        }
+        return std::format("(SELECT {} FROM {} UNION ALL SELECT {} FROM {}) AS {}", columnList(entity), name, cold,
+                           table, name);
+    }
+
+    std::size_t EntityArchive::move(const Entity &entity, soci::session &sql, const std::tm &cutoff,
+                                    const std::size_t limit) {
+        const auto policy = ArchivePolicy::fromJSON(entity.schema());
+        const auto name = sqlIdentifier(entity.name());
+
+        // No ORDER BY: rows sit about in insertion order, so a scan meets the old ones first
+        std::vector<std::string> ids;
+        {
+            const soci::rowset<std::string> rows = (sql.prepare
+                << std::format("SELECT id FROM {} WHERE {} < :cutoff LIMIT {}", name, sqlIdentifier(policy.field),
+                               limit), soci::use(cutoff, "cutoff"));
+            for (const auto &id: rows) ids.push_back(id);
+        }
+        if (ids.empty()) return 0;
+
+        std::string in;
+        for (std::size_t i = 0; i < ids.size(); ++i) in += std::format("{}:id{}", i == 0 ? "" : ", ", i);
+        const auto bound = [&] {
+            soci::values vals;
+            for (std::size_t i = 0; i < ids.size(); ++i) vals.set("id" + std::to_string(i), ids[i]);
+            return vals;
+        };
+
+        const auto columns = columnList(entity);
+        auto copy = bound();
+        sql << std::format("INSERT INTO {} ({1}) SELECT {1} FROM {2} WHERE id IN ({3})", ArchivePolicy::tableOf(name),
+                           columns, name, in), soci::use(copy);
+        auto remove = bound();
+        sql << std::format("DELETE FROM {} WHERE id IN ({})", name, in), soci::use(remove);
+        return ids.size();
+    }
+
+    std::size_t EntityArchive::run(const std::vector<std::shared_ptr<const Entity>> &entities) {
+        // Entities some foreign key points at, their own included
+        std::set<std::string> referenced;
+        for (const auto &entity: entities) {
+            for (const auto &field: entity->fields()) {
+                if (const auto it = field.find("foreign_key");
+                    it != field.end() && it->is_object() && it->contains("entity") && (*it)["entity"].is_string())
+                    referenced.insert((*it)["entity"].get<std::string>());
+            }
+        }
+
+        static std::mutex warned_mutex;
+        static std::set<std::string> warned;
+
+        std::size_t moved = 0;
+        for (const auto &entity: entities) {
+            if (entity->type() == "view") continue;
+            const auto name = entity->name();
+            try {
+                const auto policy = ArchivePolicy::fromJSON(entity->schema());
+                if (!policy.enabled()) continue;
+                if (referenced.contains(name)) {
+                    std::lock_guard lock(warned_mutex);
+                    if (warned.insert(name).second)
+                        LogOrigin::entityWarn("Archive", std::format(
+                            "Not archiving `{}`: other records reference it by foreign key", name));
+                    continue;
+                }
+
+                const auto cutoff = toUtcTime(std::time(nullptr) - static_cast<std::time_t>(policy.afterDays) * 86400);
+                std::size_t count = 0;
+                for (std::size_t batch = 0; batch < MAX_BATCHES; ++batch) {
+                    std::size_t n = 0;
+                    // A transaction per batch, so writers get in between
+                    MantisBase::instance().db().write([&](soci::session &sql) {
+                        if (batch == 0) ensure(sql, sqlIdentifier(name));
+                        n = move(*entity, sql, cutoff);
+                    });
+                    count += n;
+                    g_rows += n;
+                    if (n < BATCH) break;
+                }
+                if (count > 0)
+                    LogOrigin::entityInfo("Archive", std::format("Archived {} record(s) of `{}`", count, name));
+                moved += count;
+            } catch (const std::exception &e) {
+                ++g_errors;
+                LogOrigin::entityWarn("Archive", std::format("Archiving `{}`: {}", name, e.what()));
+            }
+        }
+        return moved;
+    }
+
+    void EntityArchive::writeMetrics(MetricsWriter &out) {
+        out.family("mb_archived_rows_total", "Rows moved from entity tables to their archives", "counter");
+        out.sample("mb_archived_rows_total", {}, static_cast<double>(g_rows.load(std::memory_order_relaxed)));
+        out.family("mb_archive_errors_total", "Archive runs of an entity that failed", "counter");
+        out.sample("mb_archive_errors_total", {}, static_cast<double>(g_errors.load(std::memory_order_relaxed)));
+    }
+}
@@ -0,0 +1,209 @@
+/**
+ * @file entity_batch_read.cpp
+ * @brief `POST /api/v1/batch`: independent entity reads in one request, run in parallel.
+ */
+
+#include "../../include/mantisbase/core/models/entity_routes.h"
+#include "../../include/mantisbase/core/models/entity.h"
+#include "../../include/mantisbase/core/models/entity_schema.h"
+#include "../../include/mantisbase/core/http.h"
+#include "../../include/mantisbase/core/middlewares.h"
+#include "../../include/mantisbase/core/router.h"
+#include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <coroutine>
+#include <format>
+#include <mutex>
+
+namespace mb {
+    namespace {
+        /// What the handler suspends on: every task offloaded at once, resumed once the last is done
+        class ParallelDbWork {
+        public:
+            ParallelDbWork(MantisRequest &req, std::vector<std::function<void()>> tasks)
+                : m_req(req), m_tasks(std::move(tasks)), m_left(m_tasks.size()) {}
+
+            [[nodiscard]] bool await_ready() const noexcept { return m_tasks.empty(); }
+
+            void await_suspend(const std::coroutine_handle<> handle) {
+                // The last `done` may resume, and so destroy, this awaiter before the loop ends
+                auto tasks = std::move(m_tasks);
+                for (auto &task: tasks) {
+                    m_req.mApp().router().offload(m_req, std::move(task), [this, handle] {
+                        if (--m_left == 0) handle.resume();
+                    });
+                }
+            }
+
+            void await_resume() const noexcept {}
+
+        private:
+            MantisRequest &m_req;
+            std::vector<std::function<void()>> m_tasks;
+            std::size_t m_left; ///> Counted down by the `done`s, which all run on the request's loop
+        };
+
+        /// `params[key]` the way its query parameter reads; arrays join with commas
+        std::string param(const json &params, const char *key) {
+            const auto it = params.find(key);
+            if (it == params.end() || it->is_null()) return "";
+            if (it->is_string()) return it->get<std::string>();
+            if (it->is_array()) {
+                std::string joined;
+                for (const auto &item: *it) {
+                    if (!joined.empty()) joined += ',';
+                    joined += item.is_string() ? item.get<std::string>() : item.dump();
+                }
+                return joined;
+            }
+            return it->dump();
+        }
+
+        json fieldList(const json &params, const char *key) {
+            json fields = json::array();
+            for (const auto &part: splitString(param(params, key), ",")) {
+                if (const auto field = trim(part); !field.empty()) fields.push_back(field);
+            }
+            return fields;
+        }
+
+        /**
+         * One read of the batch, on a DB worker in the request's tenant scope.
+         * `req` is shared by the reads running at once; everything touching it,
+         * the token verification the first rule check may do included, holds `req_mutex`.
+         */
+        json runRead(MantisRequest &req, std::mutex &req_mutex, const std::size_t index, const json &read) {
+            const auto name = read.is_object() && read.contains("entity") && read["entity"].is_string()
+                                  ? trim(read["entity"].get<std::string>())
+                                  : std::string{};
+            const auto op = read.is_object() && read.contains("op") && read["op"].is_string()
+                                ? read["op"].get<std::string>()
+                                : std::string{};
+            const auto &app = req.mApp();
+            if (name.empty() || !EntitySchema::isValidEntityName(name) || !app.hasEntity(name))
+                throw MantisException(404, std::format("requests[{}]: No entity named `{}`.", index, name));
+            const auto entity = app.entitySnapshot(name);
+            if (entity->isSystem() || !entity->hasApi())
+                throw MantisException(404, std::format("requests[{}]: No entity named `{}`.", index, name));
+            if (op != "get" && op != "list" && op != "aggregate")
+                throw MantisException(400, std::format("requests[{}]: `op` must be one of get, list or aggregate.",
+                                                       index));
+
+            const json params = read.contains("params") && read["params"].is_object() ? read["params"] : json::object();
+            const auto &rule = op == "get" ? entity->getRule() : entity->listRule();
+            json opts = json::object();
+            {
+                std::lock_guard lock(req_mutex);
+                if (!hasRuleAccess(req, rule))
+                    throw MantisException(403, std::format("requests[{}]: Access to `{}` was denied.", index, name));
+                setRuleAuth(req, rule, opts);
+            }
+            if (params.contains("include_archived")) opts["include_archived"] = param(params, "include_archived") == "true";
+
+            if (op == "aggregate") {
+                for (const auto *key: {"group", "sum", "avg", "min", "max"}) opts[key] = fieldList(params, key);
+                if (params.contains("filter")) opts["filter"] = param(params, "filter");
+                if (params.contains("sort")) opts["sort"] = param(params, "sort");
+                if (params.contains("limit")) opts["limit"] = safe_stoi(param(params, "limit"), 0);
+                return entity->aggregate(opts);
+            }
+
+            // `fields` plus the relation columns `expand` reads, as for the single routes
+            std::vector<std::string> relations;
+            for (const auto &relation: fieldList(params, "expand")) relations.push_back(relation.get<std::string>());
+            if (params.contains("fields")) {
+                auto fields = param(params, "fields");
+                for (const auto &relation: relations) fields += "," + relation;
+                opts["fields"] = fields;
+            }
+            const auto expand = [&](Records &records) {
+                if (relations.empty()) return;
+                entity->expand(records, relations, [&](const Entity &ref) {
+                    std::lock_guard lock(req_mutex);
+                    return hasRuleAccess(req, ref.listRule());
+                });
+            };
+
+            if (op == "get") {
+                const auto id = read.contains("id") && read["id"].is_string() ? trim(read["id"].get<std::string>()) : "";
+                if (id.empty()) throw MantisException(400, std::format("requests[{}]: `id` is required.", index));
+                auto record = entity->read(id, opts);
+                if (!record) throw MantisException(404, "Resource not found!");
+                Records records{std::move(*record)};
+                expand(records);
+                return std::move(records.front());
+            }
+
+            const auto limit = params.contains("limit") ? safe_stoi(param(params, "limit"), 50) : 50;
+            const auto filter = param(params, "filter");
+            opts["pagination"] = {{"limit", limit}, {"after", param(params, "after")}, {"sort", param(params, "sort")}};
+            opts["filter"] = filter;
+            if (params.contains("search")) opts["search"] = param(params, "search");
+
+            std::optional<int> total;
+            if (param(params, "total") == "true") {
+                json count_opts = {{"filter", filter}, {"search", opts.value("search", "")}};
+                if (opts.contains("auth")) count_opts["auth"] = opts["auth"];
+                if (opts.contains("include_archived")) count_opts["include_archived"] = opts["include_archived"];
+                total = entity->countRecords(count_opts);
+            }
+
+            Entity::ListPage page;
+            auto records = entity->list(opts, page);
+            expand(records);
+            json data = {{"items", std::move(records)}, {"cursor", page.cursor}, {"items_count", page.count},
+                         {"limit", limit}};
+            if (total) data["total"] = *total;
+            return data;
+        }
+    }
+
+    AsyncHandlerFn entityBatchReadHandler() {
+        return [](MantisRequest &req, MantisResponse &res) -> drogon::Task<> {
+            const auto &[body, err] = req.getBodyAsJson();
+            if (!err.empty() || !body.is_object() || !body.contains("requests") || !body["requests"].is_array()
+                || body["requests"].empty()) {
+                res.sendJSON(400, {
+                    {"data", json::object()},
+                    {"error", "Expected a JSON body with a non-empty `requests` array."},
+                    {"status", 400}
+                });
+                co_return;
+            }
+            const auto &reads = body["requests"];
+            if (reads.size() > MAX_BATCH_READS) {
+                res.sendJSON(400, {
+                    {"data", json::object()},
+                    {"error", std::format("A batch is limited to {} requests, got {}.", MAX_BATCH_READS, reads.size())},
+                    {"status", 400}
+                });
+                co_return;
+            }
+
+            // One failed read leaves the others be; each answers with its own status
+            std::vector<json> results(reads.size());
+            std::mutex req_mutex;
+            std::vector<std::function<void()>> tasks;
+            tasks.reserve(reads.size());
+            for (std::size_t i = 0; i < reads.size(); ++i) {
+                tasks.emplace_back([&req, &req_mutex, &reads, &results, i] {
+                    try {
+                        results[i] = {{"status", 200}, {"data", runRead(req, req_mutex, i, reads[i])}, {"error", ""}};
+                    } catch (const MantisException &e) {
+                        results[i] = {{"status", e.code()}, {"data", json::object()}, {"error", e.what()}};
+                    } catch (const std::exception &e) {
+                        results[i] = {{"status", 500}, {"data", json::object()}, {"error", e.what()}};
+                    }
+                });
+            }
+            co_await ParallelDbWork(req, std::move(tasks));
+
+            res.sendJSON(200, {
+                {"data", {{"responses", std::move(results)}}},
+                {"error", ""},
+                {"status", 200}
+            });
+        };
+    }
+}
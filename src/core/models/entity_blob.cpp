@@ -0,0 +1,319 @@
+/**
+ * @file entity_blob.cpp
+ * @brief Streamed reads and writes of `blob` fields, see Entity::readBlob() and Entity::writeBlob().
+ */
+
+#include "../../../include/mantisbase/core/models/entity.h"
+#include "../../../include/mantisbase/core/models/entity_shards.h"
+#include "../../../include/mantisbase/core/auth.h"
+#include "../../../include/mantisbase/core/realtime.h"
+#include "../../../include/mantisbase/mantisbase.h"
+#include "../../../include/mantisbase/utils/utils.h"
+
+#include <soci/soci.h>
+#include <soci/sqlite3/soci-sqlite3.h>
+#if MB_HAS_POSTGRESQL
+#include <soci/postgresql/soci-postgresql.h>
+#endif
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <istream>
+#include <vector>
+
+namespace mb {
+    namespace {
+        /// Bytes copied per sqlite3_blob_write() while writing, and per PostgreSQL slice while reading.
+        constexpr std::size_t kBlobChunk = 256 * 1024;
+
+        /// The column of blob field `field`. @throws MantisException (400) for anything else
+        std::string blobColumn(const Entity &entity, const std::string &field) {
+            const auto *col = entity.type() == "view" ? nullptr : entity.rowCodec().column(field);
+            if (!col || col->type != "blob")
+                throw MantisException(400, std::format("`{}` is not a blob field of `{}`.", field, entity.name()));
+            return sqlIdentifier(field);
+        }
+
+        /// Fill `buf` with the next `n` bytes of `in`. @throws MantisException (400) if it ends first
+        void readExactly(std::istream &in, char *buf, const std::size_t n, const std::int64_t size) {
+            in.read(buf, static_cast<std::streamsize>(n));
+            if (static_cast<std::size_t>(in.gcount()) != n)
+                throw MantisException(400, std::format("The body ended before its {} bytes.", size));
+        }
+
+        Entity::BlobReader sqliteReader(std::shared_ptr<soci::session> sql, const std::string &table,
+                                        const std::string &column, const long long rowid) {
+            auto *conn = dynamic_cast<soci::sqlite3_session_backend *>(sql->get_backend())->conn_;
+            sqlite_api::sqlite3_blob *handle = nullptr;
+            if (sqlite_api::sqlite3_blob_open(conn, "main", table.c_str(), column.c_str(), rowid, 0, &handle)
+                != SQLITE_OK) {
+                const std::string err = sqlite_api::sqlite3_errmsg(conn);
+                sqlite_api::sqlite3_blob_close(handle);
+                throw MantisException(500, err);
+            }
+
+            // An open handle keeps its read transaction, so every chunk comes from the same row
+            struct Blob {
+                std::shared_ptr<soci::session> sql;
+                sqlite_api::sqlite3_blob *handle = nullptr;
+                int size = 0, offset = 0;
+
+                ~Blob() { close(); }
+
+                void close() {
+                    if (handle) sqlite_api::sqlite3_blob_close(handle);
+                    handle = nullptr;
+                    sql.reset();
+                }
+            };
+            auto blob = std::make_shared<Blob>();
+            blob->sql = std::move(sql);
+            blob->handle = handle;
+            blob->size = sqlite_api::sqlite3_blob_bytes(handle);
+
+            const auto size = blob->size;
+            return {
+                size,
+                [blob](char *buf, const std::size_t len) -> std::size_t {
+                    // Called with nullptr once drogon is done with the stream
+                    if (!buf || !blob->handle) {
+                        blob->close();
+                        return 0;
+                    }
+
+                    const auto n = static_cast<int>(std::min<std::size_t>(len, blob->size - blob->offset));
+                    if (n > 0 && sqlite_api::sqlite3_blob_read(blob->handle, buf, n, blob->offset) != SQLITE_OK) {
+                        // Headers are out already; all that's left is to cut the body short
+                        logEntry::warn("Entity Blob", "Blob read failed", sqlite_api::sqlite3_errmsg(
+                                           dynamic_cast<soci::sqlite3_session_backend *>(
+                                               blob->sql->get_backend())->conn_));
+                        blob->close();
+                        return 0;
+                    }
+                    blob->offset += n;
+
+                    // Done reading: give the session back to the pool before the last bytes go out
+                    if (blob->offset == blob->size) blob->close();
+                    return static_cast<std::size_t>(n);
+                }
+            };
+        }
+
+#if MB_HAS_POSTGRESQL
+        using PgResult = std::unique_ptr<PGresult, decltype(&PQclear)>;
+
+        /// Run `query` with text parameters and a binary result.
+        PgResult pgQuery(PGconn *conn, const char *query, const std::vector<std::string> &params) {
+            std::vector<const char *> values;
+            for (const auto &param: params) values.push_back(param.c_str());
+            PgResult res(PQexecParams(conn, query, static_cast<int>(values.size()), nullptr, values.data(), nullptr,
+                                      nullptr, 1), &PQclear);
+            if (const auto status = PQresultStatus(res.get()); status != PGRES_TUPLES_OK && status != PGRES_COMMAND_OK)
+                throw MantisException(500, PQresultErrorMessage(res.get()));
+            return res;
+        }
+
+        std::optional<Entity::BlobReader> pgReader(std::shared_ptr<soci::session> sql, const std::string &table,
+                                                   const std::string &column, const std::string &id) {
+            auto *conn = static_cast<soci::postgresql_session_backend *>(sql->get_backend())->conn_;
+
+            // Slices are read in one snapshot, so a write mid-stream can't tear the body
+            struct Blob {
+                std::shared_ptr<soci::session> sql;
+                PGconn *conn = nullptr;
+                std::string query, id;
+                std::int64_t size = 0, offset = 0;
+                std::string pending; ///> Read, not yet handed out
+                std::size_t taken = 0;
+
+                ~Blob() { close(); }
+
+                void close() {
+                    if (!sql) return;
+                    PQclear(PQexec(conn, offset == size ? "COMMIT" : "ROLLBACK"));
+                    sql.reset();
+                }
+            };
+            auto blob = std::make_shared<Blob>();
+            blob->sql = std::move(sql);
+            blob->conn = conn;
+            blob->id = id;
+            blob->query = std::format("SELECT substring({} FROM $1 FOR $2) FROM {} WHERE id = $3", column, table);
+
+            (void) pgQuery(conn, "BEGIN ISOLATION LEVEL REPEATABLE READ READ ONLY", {});
+            const auto res = pgQuery(conn, std::format("SELECT octet_length({0})::text FROM {1} "
+                                                       "WHERE id = $1 AND {0} IS NOT NULL", column, table).c_str(),
+                                     {id});
+            if (PQntuples(res.get()) == 0) return std::nullopt;
+            // Binary text is the text itself
+            blob->size = std::stoll(std::string(PQgetvalue(res.get(), 0, 0), PQgetlength(res.get(), 0, 0)));
+
+            const auto size = blob->size;
+            return Entity::BlobReader{
+                size,
+                [blob](char *buf, const std::size_t len) -> std::size_t {
+                    if (!buf || !blob->sql) {
+                        blob->close();
+                        return 0;
+                    }
+
+                    if (blob->taken == blob->pending.size() && blob->offset < blob->size) {
+                        const auto n = std::min<std::int64_t>(kBlobChunk, blob->size - blob->offset);
+                        try {
+                            const auto slice = pgQuery(blob->conn, blob->query.c_str(),
+                                                       {std::to_string(blob->offset + 1), std::to_string(n), blob->id});
+                            if (PQntuples(slice.get()) == 0) throw MantisException(404, "The record went away.");
+                            blob->pending.assign(PQgetvalue(slice.get(), 0, 0), PQgetlength(slice.get(), 0, 0));
+                        } catch (const std::exception &e) {
+                            logEntry::warn("Entity Blob", "Blob read failed", e.what());
+                            blob->close();
+                            return 0;
+                        }
+                        blob->taken = 0;
+                        blob->offset += static_cast<std::int64_t>(blob->pending.size());
+                        if (blob->pending.empty()) blob->offset = blob->size;
+                    }
+
+                    const auto n = std::min(len, blob->pending.size() - blob->taken);
+                    std::memcpy(buf, blob->pending.data() + blob->taken, n);
+                    blob->taken += n;
+                    if (blob->offset == blob->size && blob->taken == blob->pending.size()) blob->close();
+                    return n;
+                }
+            };
+        }
+#endif
+    }
+
+    std::optional<Entity::BlobReader> Entity::readBlob(const std::string &id, const std::string &field,
+                                                       const json &opts) const {
+        const auto column = blobColumn(*this, field);
+        const auto table = sqlIdentifier(name());
+        const EntityShards::Scope shard(shardFor(id));
+
+        try {
+            auto sql = app().db().readSession();
+            // Not a byte of a record the caller couldn't get
+            if (!getFilterMatches(*sql, table, id, opts)) return std::nullopt;
+            if (const auto db_type = sql->get_backend_name(); db_type == "sqlite3") {
+                long long rowid = 0;
+                *sql << std::format("SELECT rowid FROM {} WHERE id = :id AND {} IS NOT NULL", table, column),
+                        soci::use(id), soci::into(rowid);
+                if (!sql->got_data()) return std::nullopt;
+                return sqliteReader(std::move(sql), table, column, rowid);
+            }
+#if MB_HAS_POSTGRESQL
+            else if (db_type == "postgresql") {
+                return pgReader(std::move(sql), table, column, id);
+            }
+#endif
+            else {
+                throw MantisException(400, std::format("Blob fields aren't supported on `{}` databases.", db_type));
+            }
+        } catch (const MantisException &) {
+            throw;
+        } catch (const std::exception &e) {
+            throw MantisException(500, e.what());
+        }
+    }
+
+    Record Entity::writeBlob(const std::string &id, const std::string &field, std::istream &in,
+                             const std::int64_t size) const {
+        const auto column = blobColumn(*this, field);
+        const auto table = sqlIdentifier(name());
+        if (size < 0) throw MantisException(400, "A blob's size can't be negative.");
+        const EntityShards::Scope shard(shardFor(id));
+
+        std::tm updated = toUtcTime(time(nullptr));
+        // The record, read back as update() does, with the blob as its length
+        const auto returning = [&](const std::string &set) {
+            return std::format("UPDATE {} SET {}updated = :updated WHERE id = :id RETURNING {}", table, set,
+                               recordColumns());
+        };
+        soci::row r;
+        Record old_record;
+        try {
+            app().db().write([&](soci::session &sql) {
+                // The row as it was, for the event's `old_data`
+                old_record = readForWrite(sql, id);
+                if (const auto db_type = sql.get_backend_name(); db_type == "sqlite3") {
+                    if (size > INT_MAX)
+                        throw MantisException(413, std::format("A blob can't be over {} bytes.", INT_MAX));
+
+                    // Sized up front, then filled in place a chunk at a time
+                    sql << returning(std::format("{} = zeroblob(:size), ", column)), soci::use(size, "size"),
+                            soci::use(updated, "updated"), soci::use(id, "id"), soci::into(r);
+                    if (!sql.got_data())
+                        throw MantisException(404, std::format("Resource not found for given id `{}`", id));
+                    if (size == 0) return;
+
+                    long long rowid = 0;
+                    sql << std::format("SELECT rowid FROM {} WHERE id = :id", table), soci::use(id),
+                            soci::into(rowid);
+
+                    auto *conn = dynamic_cast<soci::sqlite3_session_backend *>(sql.get_backend())->conn_;
+                    sqlite_api::sqlite3_blob *handle = nullptr;
+                    if (sqlite_api::sqlite3_blob_open(conn, "main", table.c_str(), column.c_str(), rowid, 1, &handle)
+                        != SQLITE_OK) {
+                        const std::string err = sqlite_api::sqlite3_errmsg(conn);
+                        sqlite_api::sqlite3_blob_close(handle);
+                        throw std::runtime_error(err);
+                    }
+                    const std::unique_ptr<sqlite_api::sqlite3_blob, decltype(&sqlite_api::sqlite3_blob_close)>
+                            guard(handle, &sqlite_api::sqlite3_blob_close);
+
+                    std::vector<char> buf(std::min<std::size_t>(kBlobChunk, size));
+                    for (std::int64_t offset = 0; offset < size;) {
+                        const auto n = std::min<std::int64_t>(static_cast<std::int64_t>(buf.size()), size - offset);
+                        readExactly(in, buf.data(), n, size);
+                        if (sqlite_api::sqlite3_blob_write(handle, buf.data(), static_cast<int>(n),
+                                                           static_cast<int>(offset)) != SQLITE_OK)
+                            throw std::runtime_error(sqlite_api::sqlite3_errmsg(conn));
+                        offset += n;
+                    }
+                }
+#if MB_HAS_POSTGRESQL
+                else if (db_type == "postgresql") {
+                    // One binary parameter, not the hex text a bytea literal would take
+                    std::string bytes(static_cast<std::size_t>(size), '\0');
+                    readExactly(in, bytes.data(), bytes.size(), size);
+
+                    auto *conn = static_cast<soci::postgresql_session_backend *>(sql.get_backend())->conn_;
+                    const auto query = std::format("UPDATE {} SET {} = $1 WHERE id = $2", table, column);
+                    const char *values[] = {bytes.data(), id.c_str()};
+                    const int lengths[] = {static_cast<int>(bytes.size()), 0};
+                    const int formats[] = {1, 0};
+                    const std::unique_ptr<PGresult, decltype(&PQclear)> res(
+                        PQexecParams(conn, query.c_str(), 2, nullptr, values, lengths, formats, 0), &PQclear);
+                    if (PQresultStatus(res.get()) != PGRES_COMMAND_OK)
+                        throw std::runtime_error(PQresultErrorMessage(res.get()));
+                    if (std::string_view(PQcmdTuples(res.get())) == "0")
+                        throw MantisException(404, std::format("Resource not found for given id `{}`", id));
+
+                    sql << returning(""), soci::use(updated, "updated"), soci::use(id, "id"), soci::into(r);
+                }
+#endif
+                else {
+                    throw MantisException(400, std::format("Blob fields aren't supported on `{}` databases.",
+                                                           db_type));
+                }
+            });
+        } catch (const MantisException &) {
+            throw;
+        } catch (const std::exception &e) {
+            throw MantisException(500, e.what());
+        }
+
+        Record record = sociRow2Json(r, rowCodec());
+
+        // As update(): new readers don't get the old row, and listeners hear of the new one
+        readFlights().forget(name(), id);
+        recordCache().forget(name(), id);
+        app().rt().publish("UPDATE", name(), id, std::move(old_record), record);
+        if (type() == "auth") Auth::userCache().invalidate(name(), id);
+
+        if (type() == "auth") record.erase("password");
+        return record;
+    }
+}
@@ -1,35 +1,349 @@
 #include "../../../include/mantisbase/core/models/entity.h"
+#include "../../../include/mantisbase/core/models/entity_archive.h"
 #include "../../../include/mantisbase/core/models/entity_schema.h"
 #include "../../../include/mantisbase/core/models/entity_schema_field.h"
+#include "../../../include/mantisbase/core/models/entity_field_ops.h"
+#include "../../../include/mantisbase/core/models/entity_shards.h"
 #include "../../../include/mantisbase/utils/utils.h"
 #include "../../../include/mantisbase/utils/uuidv7.h"
 #include "mantisbase/utils/soci_wrappers.h"
 #include "mantisbase/core/realtime.h"
+#include "mantisbase/core/auth.h"
+#include "mantisbase/core/change_journal.h"
+#include "mantisbase/core/file_cleanup.h"
+#include "mantisbase/core/index_advisor.h"
+#include "mantisbase/core/pg_pipeline.h"
+#include "mantisbase/core/tenants.h"
+#include "mantisbase/utils/crypto_utils.h"
+#include "mantisbase/utils/json_parse.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <istream>
+#include <unordered_set>
 
 
 namespace mb {
+    namespace {
+        /// Bound parameters per batch statement, under SQLite's historical 999 limit.
+        constexpr std::size_t kMaxBatchParams = 900;
+
+        /// Inserts attempted with fresh ids before Entity::create() gives up.
+        constexpr int kMaxIdAttempts = 10;
+
+        /// True if `e` is a primary key/unique violation on `table`.id, as
+        /// reported by SQLite (`UNIQUE constraint failed: t.id`) or by
+        /// PostgreSQL, which names the `pk_t_id`/`uniq_t_id` constraint.
+        bool isIdCollision(const std::exception &e, const std::string &table) {
+            const std::string_view msg = e.what();
+            return msg.find(std::format("UNIQUE constraint failed: {}.id", table)) != std::string_view::npos
+                   || msg.find(std::format("pk_{}_id", table)) != std::string_view::npos
+                   || msg.find(std::format("uniq_{}_id", table)) != std::string_view::npos;
+        }
+
+        /// Bind a scalar JSON value (filter operand, cursor value) under `name`.
+        void bindJson(soci::values &vals, const std::string &name, const json &value) {
+            if (value.is_null()) vals.set(name, std::string(), soci::i_null);
+            else if (value.is_string()) vals.set(name, value.get<std::string>());
+            else if (value.is_boolean()) vals.set(name, value.get<bool>() ? 1 : 0);
+            else if (value.is_number_integer()) vals.set(name, value.get<long long>());
+            else vals.set(name, value.get<double>());
+        }
+
+        /// Whether `opts` asks for archived rows too, see EntityArchive.
+        bool includesArchived(const json &opts) {
+            return opts.contains("include_archived") && opts["include_archived"].is_boolean() &&
+                   opts["include_archived"].get<bool>();
+        }
+
+        /// Names of the files referenced by a record's `file`/`files` fields.
+        std::vector<std::string> recordFiles(const std::vector<json> &fields, const json &record) {
+            std::vector<std::string> files;
+            for (const auto &field: fields) {
+                const auto &type = field["type"].get<std::string>();
+                const auto &name = field["name"].get<std::string>();
+                if (!record.contains(name) || record[name].is_null()) continue;
+
+                if (type == "file") {
+                    const auto &file = record.value(name, "");
+                    if (!file.empty()) files.emplace_back(file);
+                }
+                if (type == "files" && record[name].is_array()) {
+                    // Expand the array data out
+                    for (const auto &file: record.value(name, std::vector<std::string>{})) {
+                        if (!file.empty()) files.emplace_back(file);
+                    }
+                }
+            }
+            return files;
+        }
+
+        /// Whether the `If-Match` list `header` names `tag`; `*` matches any record.
+        bool ifMatch(const std::string &header, const std::string &tag) {
+            return std::ranges::any_of(splitString(header, ","), [&](const std::string &part) {
+                const auto candidate = trim(part);
+                return candidate == "*" || candidate == tag;
+            });
+        }
+
+        bool isDigit(const char c) {
+            return std::isdigit(static_cast<unsigned char>(c)) != 0;
+        }
+
+        /// A transaction value `{"$ref": "<op>.<field>"}`, taken from an earlier op's result.
+        bool isRef(const json &value) {
+            return value.is_object() && value.size() == 1 && value.contains("$ref");
+        }
+
+        /// One CSV cell; `quoted` tells `""` (an empty string) from an empty cell (null).
+        struct CsvCell {
+            std::string text;
+            bool quoted = false;
+        };
+
+        /**
+         * Reads the records of an NDJSON or CSV import one at a time, CSV
+         * cells typed by the field their header names. Anything malformed
+         * throws MantisException (400) naming its line.
+         */
+        class ImportSource {
+        public:
+            ImportSource(std::istream &in, const bool csv, const std::vector<json> &fields)
+                : m_in(in), m_csv(csv) {
+                if (!m_csv) return;
+
+                std::vector<CsvCell> header;
+                if (!readCsv(header)) return;
+                for (const auto &cell: header) {
+                    const auto name = trim(cell.text);
+                    const auto it = std::ranges::find_if(fields, [&](const json &f) { return f["name"] == name; });
+                    // System and unknown columns are read past
+                    m_columns.push_back(it == fields.end() || name == "id" || name == "created" || name == "updated"
+                                            ? nullptr
+                                            : &*it);
+                }
+            }
+
+            /// The next record in `record`; false at the end of the input.
+            bool next(json &record) {
+                if (!m_csv) {
+                    std::string text;
+                    while (std::getline(m_in, text)) {
+                        m_line = ++m_read;
+                        if (trim(text).empty()) continue;
+
+                        try {
+                            record = parseJson(text);
+                        } catch (const std::exception &e) {
+                            throw MantisException(400, std::format("line {}: {}", m_line, e.what()));
+                        }
+                        if (!record.is_object())
+                            throw MantisException(400, std::format("line {}: Expected a JSON object.", m_line));
+                        return true;
+                    }
+                    return false;
+                }
+
+                std::vector<CsvCell> cells;
+                if (m_columns.empty() || !readCsv(cells)) return false;
+                if (cells.size() != m_columns.size())
+                    throw MantisException(400, std::format("line {}: Expected {} fields, got {}.", m_line,
+                                                           m_columns.size(), cells.size()));
+
+                record = json::object();
+                for (std::size_t i = 0; i < cells.size(); ++i) {
+                    if (!m_columns[i]) continue;
+                    const auto &field = *m_columns[i];
+                    record[field["name"].get<std::string>()] = csvValue(field, cells[i]);
+                }
+                return true;
+            }
+
+            /// First line of the record next() read last.
+            [[nodiscard]] std::size_t line() const { return m_line; }
+
+        private:
+            /// The next CSV record, quoted fields spanning lines included; blank lines are skipped.
+            bool readCsv(std::vector<CsvCell> &cells) {
+                cells.clear();
+                CsvCell cell;
+                bool in_quotes = false, started = false;
+                for (int c; (c = m_in.get()) != std::char_traits<char>::eof();) {
+                    const auto ch = static_cast<char>(c);
+                    if (!started) {
+                        if (ch == '\n') {
+                            ++m_read;
+                            continue;
+                        }
+                        if (ch == '\r') continue;
+                        started = true;
+                        m_line = m_read + 1;
+                    }
+
+                    if (in_quotes) {
+                        if (ch == '"' && m_in.peek() == '"') {
+                            m_in.get();
+                            cell.text.push_back('"');
+                        } else if (ch == '"') {
+                            in_quotes = false;
+                        } else {
+                            if (ch == '\n') ++m_read;
+                            cell.text.push_back(ch);
+                        }
+                    } else if (ch == '"') {
+                        in_quotes = cell.quoted = true;
+                    } else if (ch == ',') {
+                        cells.push_back(std::move(cell));
+                        cell = {};
+                    } else if (ch == '\n') {
+                        ++m_read;
+                        cells.push_back(std::move(cell));
+                        return true;
+                    } else if (ch != '\r') {
+                        cell.text.push_back(ch);
+                    }
+                }
+
+                if (in_quotes) throw MantisException(400, std::format("line {}: Unterminated quoted field.", m_line));
+                if (!started) return false;
+                cells.push_back(std::move(cell));
+                return true;
+            }
+
+            /// A cell as its field's type; what exportRecords() writes reads back the same.
+            [[nodiscard]] json csvValue(const json &field, const CsvCell &cell) const {
+                if (cell.text.empty() && !cell.quoted) return nullptr;
+
+                const auto &type = field["type"].get_ref<const std::string &>();
+                const auto &text = cell.text;
+                const auto fail = [&](const char *expected) {
+                    return MantisException(400, std::format("line {}: `{}` must be {}.", m_line,
+                                                            field["name"].get<std::string>(), expected));
+                };
+
+                if (type == "int") {
+                    long long value = 0;
+                    const auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+                    if (ec != std::errc{} || end != text.data() + text.size()) throw fail("an integer");
+                    return value;
+                }
+                if (type == "double") {
+                    double value = 0;
+                    const auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+                    if (ec != std::errc{} || end != text.data() + text.size()) throw fail("a number");
+                    return value;
+                }
+                if (type == "bool") {
+                    if (text == "true" || text == "1") return true;
+                    if (text == "false" || text == "0") return false;
+                    throw fail("`true` or `false`");
+                }
+                if (type == "json" || type == "files" || type == "list" || type == "vector" || type == "geo_point") {
+                    try {
+                        return parseJson(text);
+                    } catch (const std::exception &) {
+                        throw fail("valid JSON");
+                    }
+                }
+                return text;
+            }
+
+            std::istream &m_in;
+            const bool m_csv;
+            std::vector<const json *> m_columns; ///> CSV: the field of each header cell, null to skip
+            std::size_t m_read = 0;              ///> Lines consumed
+            std::size_t m_line = 0;
+        };
+
+#if MB_HAS_POSTGRESQL
+        /**
+         * One `COPY <table> (...) FROM STDIN` in CSV, on `sql`'s connection and
+         * so inside its transaction. Left unfinished, it is aborted, so the
+         * connection can roll back.
+         */
+        class CopyIn {
+        public:
+            CopyIn(soci::session &sql, const std::string &table, const std::string &column_list)
+                : m_conn(static_cast<soci::postgresql_session_backend *>(sql.get_backend())->conn_) {
+                PGresult *res = PQexec(m_conn, std::format("COPY {} ({}) FROM STDIN WITH (FORMAT csv)",
+                                                           table, column_list).c_str());
+                const auto status = PQresultStatus(res);
+                PQclear(res);
+                if (status != PGRES_COPY_IN) throw std::runtime_error(PQerrorMessage(m_conn));
+                m_open = true;
+            }
+
+            ~CopyIn() {
+                if (!m_open) return;
+                PQputCopyEnd(m_conn, "import aborted");
+                while (PGresult *res = PQgetResult(m_conn)) PQclear(res);
+            }
+
+            CopyIn(const CopyIn &) = delete;
+            CopyIn &operator=(const CopyIn &) = delete;
+
+            /// Send and clear `data`, whole CSV lines.
+            void put(std::string &data) {
+                if (data.empty()) return;
+                if (PQputCopyData(m_conn, data.data(), static_cast<int>(data.size())) != 1)
+                    throw std::runtime_error(PQerrorMessage(m_conn));
+                data.clear();
+            }
+
+            /// End the COPY. @throw std::runtime_error with the server's error for a rejected row
+            void finish() {
+                m_open = false;
+                if (PQputCopyEnd(m_conn, nullptr) != 1) throw std::runtime_error(PQerrorMessage(m_conn));
+
+                std::string error;
+                while (PGresult *res = PQgetResult(m_conn)) {
+                    if (PQresultStatus(res) != PGRES_COMMAND_OK && error.empty()) error = PQresultErrorMessage(res);
+                    PQclear(res);
+                }
+                if (!error.empty()) throw std::runtime_error(error);
+            }
+
+        private:
+            PGconn *m_conn;
+            bool m_open = false;
+        };
+
+        /// Append `s` to a COPY line as a quoted CSV field, which COPY never reads as NULL.
+        void appendCopyText(std::string &out, const std::string_view s) {
+            out.push_back('"');
+            for (const char ch: s) {
+                if (ch == '"') out.push_back('"');
+                out.push_back(ch);
+            }
+            out.push_back('"');
+        }
+
+        /// Append `value` as the COPY field of a `field` column; null is an empty, unquoted field.
+        void appendCopyValue(std::string &out, const json &field, const json &value) {
+            if (value.is_null()) return;
+            const auto &type = field["type"].get_ref<const std::string &>();
+            if (type == "vector")
+                return appendCopyText(out, VectorIndex::encode(VectorIndex::parse(value, field.value("dim", 0))));
+            if (type == "geo_point")
+                return appendCopyText(out, EntityGeo::encode(EntityGeo::parse(value, field.value("name", ""))));
+            if (value.is_string()) return appendCopyText(out, value.get_ref<const std::string &>());
+            // Booleans are integer columns on PostgreSQL, see EntitySchema::getFieldType()
+            if (value.is_boolean()) return out.push_back(value.get<bool>() ? '1' : '0');
+            if (value.is_number() && (type == "int" || type == "double")) return out.append(value.dump());
+            appendCopyText(out, value.dump());
+        }
+#endif
+    }
+
     // --------------------------------------------------------------------------- //
     // CRUD OPS                                                                    //
     // --------------------------------------------------------------------------- //
 
     Record Entity::create(const json &record, const json &opts) const {
-        // Database session & transaction instance
-        auto sql = app().db().session();
-        soci::transaction tr(*sql);
-
         try {
-            // Create a random ID, then check if it exists already in the DB
-            std::string id = generate_uuidv7();
-            int trials = 1;
-            while (recordExists(id)) {
-                // Try getting a new ID ten times before giving up. Avoid infinite loops
-                if (trials >= 10)
-                    break;
-
-                id = generate_uuidv7();
-                trials++;
-            }
-
             // Create default time values
             std::time_t current_t = time(nullptr);
             std::tm created_tm = toUtcTime(current_t);
@@ -53,7 +367,7 @@ namespace mb {
             // Create the field cols and value cols as concatenated strings
             for (const auto &[field_name, _]: record.items()) {
                 // First, ensure the key exists in our schema fields
-                if (auto field_schema = findField(field_name); !field_schema.has_value()) continue;
+                if (!fieldDef(field_name)) continue;
 
                 new_record[field_name] = record[field_name];
                 const auto col = sqlIdentifier(field_name);
@@ -61,27 +375,48 @@ namespace mb {
                 placeholders += placeholders.empty() ? (":" + col) : (", :" + col);
             }
 
-            // Create the SQL Query. RETURNING * lets us read the freshly stored
+            // Create the SQL Query. RETURNING lets us read the freshly stored
             // row back in the same round-trip instead of issuing a separate
             // SELECT (supported by SQLite >= 3.35 and PostgreSQL).
-            std::string sql_query = std::format("INSERT INTO {} ({}) VALUES ({}) RETURNING *",
-                                                sqlIdentifier(name()), columns, placeholders);
+            std::string sql_query = std::format("INSERT INTO {} ({}) VALUES ({}) RETURNING {}",
+                                                sqlIdentifier(name()), columns, placeholders, recordColumns());
 
             // Bind soci::values to entity values
-            auto vals = json2SociValue(new_record, fields());
-            vals.set("id", id, soci::i_ok);
+            soci::values vals;
+            rowCodec().bind(vals, new_record);
             vals.set("created", created_tm, soci::i_ok);
             vals.set("updated", created_tm, soci::i_ok);
 
-            // Execute the insert and fetch the newly-created row in one go
+            // UUIDv7 ids don't collide in practice, so insert straight away and
+            // let the primary key catch the rare clash instead of checking
+            // first. Only an id collision is retried, with a fresh id.
+            std::string id;
             soci::row r;
-            *sql << sql_query, soci::use(vals), soci::into(r);
-            tr.commit();
+            for (int attempt = 1;; ++attempt) {
+                id = generate_uuidv7();
+                vals.set("id", id, soci::i_ok);
+
+                try {
+                    // Execute the insert and fetch the newly-created row in one go;
+                    // each attempt is its own write, so a clash leaves nothing behind
+                    const EntityShards::Scope shard(shardFor(id));
+                    app().db().write([&](soci::session &sql) {
+                        sql << sql_query, soci::use(vals), soci::into(r);
+                    });
+                    break;
+                } catch (const soci::soci_error &e) {
+                    if (attempt >= kMaxIdAttempts || !isIdCollision(e, name())) throw;
+                    MB_LOG_TRACE(LogOrigin::entityTrace, "Id Collision", std::format("Id `{}` already exists in `{}`, retrying", id,
+                                                                                     name()));
+                }
+            }
 
-            // Wake the realtime worker to deliver the change immediately.
-            app().rt().notifyChange();
+            auto added_row = sociRow2Json(r, rowCodec());
 
-            auto added_row = sociRow2Json(r, fields());
+            // Hand the row to the realtime worker directly and wake it; from
+            // the shard holding it, whose writes no connection hook captures
+            const EntityShards::Scope shard(shardFor(id));
+            app().rt().publish("INSERT", name(), id, nullptr, added_row);
 
             // Remove user password from the response
             if (type() == "auth") added_row.erase("password");
@@ -93,12 +428,54 @@ namespace mb {
         }
     }
 
-    Records Entity::list(const json &opts) const {
-        const auto sql = MantisBase::instance().db().session();
+    std::string ListCursor::encode() const {
+        return base64UrlEncode(json{{"f", field}, {"d", desc ? "desc" : "asc"}, {"v", value}, {"id", id}}.dump());
+    }
+
+    std::optional<ListCursor> ListCursor::decode(const std::string &cursor) {
+        std::vector<uint8_t> raw;
+        try {
+            raw = base64UrlDecode(cursor);
+        } catch (const std::exception &) {
+            return std::nullopt;
+        }
+
+        const auto j = json::parse(raw.begin(), raw.end(), nullptr, false);
+        if (!j.is_object() || !j.contains("f") || !j["f"].is_string() || !j.contains("id") || !j["id"].is_string()
+            || !j.contains("v") || j["v"].is_structured() || !j.contains("d") || (j["d"] != "asc" && j["d"] != "desc"))
+            return std::nullopt;
+
+        ListCursor c;
+        c.field = j["f"].get<std::string>();
+        c.desc = j["d"] == "desc";
+        c.value = j["v"];
+        c.id = j["id"].get<std::string>();
+        return c;
+    }
+
+    std::string Entity::selectList(const json &opts, const std::string &extra) const {
+        if (!opts.contains("fields") || !opts["fields"].is_string()) return recordColumns();
+        auto columns = projection(opts["fields"].get<std::string>());
+        if (columns.empty()) return recordColumns();
+        if (!extra.empty() && std::ranges::find(columns, extra) == columns.end()) columns.push_back(extra);
+
+        std::string list;
+        for (const auto &column: columns) {
+            if (!list.empty()) list += ", ";
+            const auto col = sqlIdentifier(column);
+            const auto *codec_col = rowCodec().column(column);
+            list += codec_col && codec_col->type == "blob" ? std::format("length({0}) AS {0}", col) : col;
+        }
+        return list;
+    }
+
+    ListCursor Entity::listRows(const json &opts, const std::function<void(const soci::row &)> &on_row) const {
+        const auto sql = MantisBase::instance().db().readSession();
         int limit = 50;
         std::string after;
         std::string sort_field = "id";
         std::string sort_dir = "ASC";
+        bool sorted = false;
 
         if (opts.contains("pagination") && opts["pagination"].is_object()) {
             auto &pagination = opts["pagination"];
@@ -106,70 +483,538 @@ namespace mb {
             if (pagination.contains("limit") && pagination["limit"].is_number()) {
                 limit = pagination["limit"].get<int>();
                 if (limit < 1) limit = 1;
-                if (limit > 500) limit = 500;
+                if (limit > MAX_LIST_PAGE_SIZE) limit = MAX_LIST_PAGE_SIZE;
             }
             if (pagination.contains("after") && pagination["after"].is_string())
                 after = pagination["after"].get<std::string>();
             if (pagination.contains("sort") && pagination["sort"].is_string()) {
                 auto sort_str = pagination["sort"].get<std::string>();
+                sorted = !trim(sort_str).empty();
                 if (!sort_str.empty() && sort_str[0] == '-') {
                     sort_dir = "DESC";
                     sort_field = sort_str.substr(1);
                 } else {
                     sort_field = sort_str;
                 }
-                bool valid = false;
-                for (const auto &f : fields()) {
-                    if (f.contains("name") && f["name"].get<std::string>() == sort_field) {
-                        valid = true;
-                        break;
-                    }
-                }
-                if (!valid) {
+                // The order of its hashes says as much as a filter on them, so it isn't quietly dropped
+                if (const auto *col = rowCodec().column(sort_field); col && col->secret)
+                    throw MantisException(400, std::format("`{}` can't be sorted on", sort_field));
+                if (!isSortable(sort_field)) {
                     sort_field = "id";
                     sort_dir = "ASC";
                 }
             }
         }
 
-        std::string query = "SELECT * FROM " + name();
-        if (!after.empty()) {
-            if (sort_dir == "ASC")
-                query += " WHERE " + sort_field + " > :after";
-            else
-                query += " WHERE " + sort_field + " < :after";
+        soci::values vals;
+        std::vector<std::string> conditions;
+
+        // `search` without a `sort` pages through the best matches first, and
+        // `geo` with a `near` point the nearest
+        const auto search = searchQuery(opts, vals);
+        const auto geo = geoQuery(opts, vals);
+        if (search && geo) throw MantisException(400, "`search` doesn't combine with `near`, `radius` or `bbox` points.");
+        // Archived rows are in neither the search table nor the spatial index
+        const bool archived = includesArchived(opts);
+        if (archived && (search || geo || opts.contains("near")))
+            throw MantisException(400, "`include_archived` doesn't combine with `search`, `near` or `bbox`.");
+        const auto join = search ? search->join : geo ? geo->join : "";
+        const auto rank = sorted ? "" : search ? search->rank : geo ? geo->distance : "";
+        const bool ranked = !rank.empty();
+        const auto *rank_field = search ? ListCursor::RANK : ListCursor::DISTANCE;
+        if (search && !search->where.empty()) conditions.push_back(search->where);
+        if (geo && !geo->where.empty()) conditions.push_back(geo->where);
+
+        if (const auto idx = search || geo ? std::nullopt : sortIndexRecommendation(sort_field)) {
+            std::lock_guard lock(m_sortIndexes->mutex);
+            if (m_sortIndexes->reported.insert(sort_field).second)
+                LogOrigin::entityInfo("List Sort", std::format(
+                    "Pages of `{}` sorted by `{}` scan the whole table; consider adding index `{}` on ({})",
+                    name(), sort_field, idx->name, sort_field + ", id"));
         }
-        query += " ORDER BY " + sort_field + " " + sort_dir + " LIMIT :limit";
 
-        soci::rowset<soci::row> rs = after.empty()
-            ? (sql->prepare << query, soci::use(limit))
-            : (sql->prepare << query, soci::use(after), soci::use(limit));
+        // Compiled (and cached) `?filter=` expression and rule filter, bound as named values
+        const auto filter = queryFilter(opts);
 
-        nlohmann::json record_list = nlohmann::json::array();
+        if (filter) {
+            conditions.push_back(filter->where);
+            for (const auto &[param, value]: filter->params)
+                bindJson(vals, param, value);
 
+            if (!filter->indexedFields.empty())
+                MB_LOG_TRACE(LogOrigin::entityTrace, "List Filter", std::format("Filter on `{}` covers indexed field(s): {}",
+                                                                                name(), json(filter->indexedFields).dump()));
+        }
+
+        // `near` is one page of the k nearest records, in distance order. The
+        // index knows nothing of filters, so filtered pages pick from more.
+        std::vector<std::string> near;
+        const bool is_near = opts.contains("near") && opts["near"].is_object();
+        if (is_near) {
+            if (sorted || search || geo || !after.empty())
+                throw MantisException(400, "`near` records come nearest first, without `sort`, `search`, `geo` "
+                                           "or `after`.");
+            limit = std::clamp(opts["near"].value("k", 20), 1, MAX_NEAR_RESULTS);
+            near = nearIds(opts["near"], *sql, filter ? 4 * limit : limit);
+
+            if (near.empty()) {
+                ListCursor none;
+                none.field = ListCursor::NEAR;
+                return none;
+            }
+
+            std::string in;
+            for (std::size_t i = 0; i < near.size(); ++i) {
+                in += std::format("{}:near{}", i == 0 ? "" : ", ", i);
+                vals.set("near" + std::to_string(i), near[i]);
+            }
+            conditions.push_back(std::format("id IN ({})", in));
+        }
+
+        const bool desc = sort_dir == "DESC";
+        const auto col = ranked ? rank : sqlIdentifier(sort_field);
+        if (!after.empty()) {
+            const auto cursor = ListCursor::decode(after);
+            if (cursor && (cursor->field != (ranked ? rank_field : sort_field) || cursor->desc != desc))
+                throw MantisException(400, "The `after` cursor belongs to a different sort order.");
+
+            if (!cursor && ranked) {
+                throw MantisException(400, std::format("{} pages continue from the `cursor` of the page before.",
+                                                       search ? "Search" : "Nearest-first"));
+            } else if (ranked) {
+                // Ranks are never NULL, and nothing indexes them to seek on
+                if (!cursor->value.is_number()) throw MantisException(400, "Invalid `after` cursor.");
+                conditions.push_back(std::format("({0} > :after OR ({0} = :after_bound AND id > :after_id))", col));
+                vals.set("after", cursor->value.get<double>());
+                vals.set("after_bound", cursor->value.get<double>());
+                vals.set("after_id", cursor->id);
+            } else if (!cursor) {
+                // A bare value, as pages before composite cursors returned: only
+                // exact when sorting by the unique `id`
+                conditions.push_back(col + (desc ? " < :after" : " > :after"));
+                vals.set("after", after);
+            } else if (sort_field == "id") {
+                conditions.push_back(desc ? "id < :after_id" : "id > :after_id");
+                vals.set("after_id", cursor->id);
+            } else {
+                // (f, id) > (:v, :id), spelled out because NULL sort values (the
+                // smallest, see ORDER BY) never compare in a row value. The
+                // bound `f >= :v` lets an index on f start the scan at the cursor.
+                // Each placeholder appears once, as not every backend binds a
+                // repeated name.
+                const bool is_null = cursor->value.is_null();
+                if (!desc && is_null)
+                    conditions.push_back(std::format("(({0} IS NULL AND id > :after_id) OR {0} IS NOT NULL)", col));
+                else if (!desc)
+                    conditions.push_back(std::format("{0} >= :after_bound AND ({0} > :after OR id > :after_id)", col));
+                else if (is_null)
+                    conditions.push_back(std::format("{0} IS NULL AND id < :after_id", col));
+                else
+                    conditions.push_back(std::format(
+                        "({0} IS NULL OR ({0} <= :after_bound AND ({0} < :after OR id < :after_id)))", col));
+                if (!is_null) {
+                    bindJson(vals, "after", cursor->value);
+                    bindJson(vals, "after_bound", cursor->value);
+                }
+                vals.set("after_id", cursor->id);
+            }
+        }
+        vals.set("limit", limit);
+
+        // Only the requested columns, plus the sort field the cursor is built from
+        auto columns = selectList(opts, ranked ? "" : sort_field);
+        if (!join.empty() && columns == "*") columns = sqlIdentifier(name()) + ".*";
+        const auto from = archived ? EntityArchive::source(*this, *sql) : sqlIdentifier(name());
+        std::string query = std::format("SELECT {} FROM {}", columns, from) + join;
+        for (std::size_t i = 0; i < conditions.size(); ++i)
+            query += (i == 0 ? " WHERE " : " AND ") + conditions[i];
+
+        // `id` breaks ties, so every position is unique. NULLs sort first
+        // ascending, as SQLite and MySQL do; PostgreSQL is told to match.
+        if (is_near) {
+            // Ids are distinct, so their index order is a total one
+            query += " ORDER BY CASE id";
+            for (std::size_t i = 0; i < near.size(); ++i) {
+                query += std::format(" WHEN :near_at{0} THEN {0}", i);
+                vals.set("near_at" + std::to_string(i), near[i]);
+            }
+            query += " END";
+        } else {
+            query += " ORDER BY " + col + " " + sort_dir;
+            if (ranked) {
+                query += ", id ASC";
+            } else if (sort_field != "id") {
+                if (app().dbType() == "postgresql") query += desc ? " NULLS LAST" : " NULLS FIRST";
+                query += desc ? ", id DESC" : ", id ASC";
+            }
+        }
+        query += " LIMIT :limit";
+
+        const auto started = std::chrono::steady_clock::now();
+        soci::rowset<soci::row> rs = (sql->prepare << query, soci::use(vals));
+
+        // A ranked page's cursor holds the last record's rank, which no column carries
+        std::optional<std::size_t> id_col;
+        std::string last_id;
         for (const auto &row: rs) {
-            auto row_json = sociRow2Json(row, fields());
-            if (type() == "auth") {
-                row_json.erase("password");
+            on_row(row);
+            if (!ranked) continue;
+            if (!id_col) {
+                for (std::size_t i = 0; i < row.size() && !id_col; ++i)
+                    if (row.get_properties(i).get_name() == "id") id_col = i;
             }
-            record_list.push_back(row_json);
+            if (id_col) last_id = row.get<std::string>(*id_col);
         }
 
+        // Pages no index serves are counted toward the index that would; the
+        // advisor builds indexes on the application's database, not a tenant's or a shard's
+        if (const auto idx = search || geo || is_near || archived || Tenants::current() || EntityShards::current()
+                                 ? std::nullopt
+                                 : listIndexRecommendation(filter.get(), sort_field))
+            app().indexAdvisor().record(name(), *idx, std::chrono::steady_clock::now() - started);
+
+        ListCursor sort;
+        sort.field = is_near ? ListCursor::NEAR : ranked ? rank_field : sort_field;
+        sort.desc = desc;
+        if (ranked && !last_id.empty()) {
+            // The distance needs no `where`, whose values all sit in the join
+            soci::values at;
+            const auto where = search ? search->where : "";
+            if (search) (void) searchQuery(opts, at);
+            else (void) geoQuery(opts, at);
+            at.set("id", last_id);
+            double value = 0;
+            *sql << std::format("SELECT {} FROM {}{} WHERE {}{}.id = :id", rank, sqlIdentifier(name()), join,
+                                where.empty() ? "" : where + " AND ", sqlIdentifier(name())),
+                    soci::use(at), soci::into(value);
+            sort.id = last_id;
+            sort.value = value;
+        }
+        return sort;
+    }
+
+    Records Entity::list(const json &opts) const {
+        ListPage page;
+        return list(opts, page);
+    }
+
+    Records Entity::list(const json &opts, ListPage &page) const {
+        if (shards() > 1 && !EntityShards::current()) return listShards(opts, page);
+        Records record_list;
+
+        // Every row in the rowset has the same shape; resolve it once.
+        const auto &codec = rowCodec();
+        std::optional<RowCodec::Plan> plan;
+        const bool is_auth = type() == "auth";
+
+        auto cursor = listRows(opts, [&](const soci::row &row) {
+            if (!plan) plan = codec.plan(row);
+            auto row_json = codec.decode(row, *plan);
+            if (is_auth) {
+                row_json.erase("password");
+            }
+            record_list.push_back(std::move(row_json));
+        });
+
+        page.count = record_list.size();
+        if (!record_list.empty() && cursor.field != ListCursor::NEAR && record_list.back().contains("id") &&
+            record_list.back()["id"].is_string()) {
+            const auto &last = record_list.back();
+            cursor.id = last["id"].get<std::string>();
+            if (!cursor.ranked()) cursor.value = last.value(cursor.field, json());
+            page.cursor = cursor.encode();
+        }
         return record_list;
     }
 
+    void Entity::expand(Records &records, const std::vector<std::string> &relations,
+                        const std::function<std::optional<json>(const Entity &)> &list_opts) const {
+        // Relations grouped by the entity and column they reference
+        struct Target {
+            std::string entity, column;
+            std::vector<std::string> relations;
+        };
+        std::vector<Target> targets;
+        for (const auto &relation: relations) {
+            const auto def = field(relation);
+            const auto fk = def ? def->value("foreign_key", json()) : json();
+            if (!fk.is_object() || !fk.contains("entity") || !fk["entity"].is_string())
+                throw MantisException(400, std::format("`{}` is not a relation of `{}`", relation, name()));
+
+            const auto entity = fk["entity"].get<std::string>();
+            const auto column = fk.contains("field") && fk["field"].is_string() ? fk["field"].get<std::string>() : "id";
+            const auto it = std::ranges::find_if(targets, [&](const Target &t) {
+                return t.entity == entity && t.column == column;
+            });
+            if (it == targets.end()) targets.push_back({entity, column, {relation}});
+            else if (std::ranges::find(it->relations, relation) == it->relations.end()) it->relations.push_back(relation);
+        }
+        if (records.empty() || targets.empty()) return;
+
+        const auto sql = app().db().readSession();
+        for (const auto &target: targets) {
+            const auto ref_ptr = app().entitySnapshot(target.entity);
+            const auto &ref = *ref_ptr;
+            // Related rows the caller couldn't list aren't expanded either
+            std::shared_ptr<const CompiledFilter> filter;
+            if (list_opts) {
+                const auto opts = list_opts(ref);
+                if (!opts) continue;
+                filter = ref.queryFilter(*opts);
+            }
+            const auto batch = kMaxBatchParams - (filter ? filter->params.size() : 0);
+
+            // Distinct references across the page, keyed by their JSON text
+            // so string and numeric keys compare like the decoded column
+            std::vector<json> keys;
+            std::unordered_set<std::string> seen;
+            for (const auto &record: records)
+                for (const auto &relation: target.relations) {
+                    const auto value = record.value(relation, json());
+                    if (!value.is_null() && !value.is_structured() && seen.insert(value.dump()).second)
+                        keys.push_back(value);
+                }
+            if (keys.empty()) continue;
+
+            const auto &codec = ref.rowCodec();
+            const bool is_auth = ref.type() == "auth";
+            std::unordered_map<std::string, json> found;
+            for (std::size_t off = 0; off < keys.size(); off += batch) {
+                const auto end = std::min(keys.size(), off + batch);
+                soci::values vals;
+                std::string in;
+                for (auto i = off; i < end; ++i) {
+                    const auto param = "k" + std::to_string(i - off);
+                    bindJson(vals, param, keys[i]);
+                    in += (in.empty() ? ":" : ", :") + param;
+                }
+                std::string where = std::format("{} IN ({})", sqlIdentifier(target.column), in);
+                if (filter) {
+                    where += std::format(" AND ({})", filter->where);
+                    for (const auto &[param, value]: filter->params) bindJson(vals, param, value);
+                }
+
+                std::optional<RowCodec::Plan> plan;
+                soci::rowset<soci::row> rs = (sql->prepare << std::format(
+                    "SELECT {} FROM {} WHERE {}", ref.recordColumns(), sqlIdentifier(ref.name()), where),
+                    soci::use(vals));
+                for (const auto &row: rs) {
+                    if (!plan) plan = codec.plan(row);
+                    auto related = codec.decode(row, *plan);
+                    if (is_auth) related.erase("password");
+                    auto key = related.value(target.column, json()).dump();
+                    found.emplace(std::move(key), std::move(related));
+                }
+            }
+
+            for (auto &record: records)
+                for (const auto &relation: target.relations) {
+                    const auto value = record.value(relation, json());
+                    if (value.is_null() || value.is_structured()) continue;
+                    if (const auto it = found.find(value.dump()); it != found.end())
+                        record["expand"][relation] = it->second;
+                }
+        }
+    }
+
+    Entity::ListPage Entity::listInto(std::string &out, const json &opts) const {
+        // Pages merged from the shards are whole records already
+        if (shards() > 1 && !EntityShards::current()) {
+            ListPage page;
+            out += json(list(opts, page)).dump();
+            return page;
+        }
+
+        const auto &codec = rowCodec();
+        std::optional<RowCodec::Plan> plan;
+        const std::string_view skip = type() == "auth" ? "password" : "";
+        std::optional<std::size_t> id_col, sort_col;
+        std::string sort_field = "id";
+        if (opts.contains("pagination") && opts["pagination"].is_object()) {
+            const auto sort = opts["pagination"].value("sort", "");
+            sort_field = !sort.empty() && sort[0] == '-' ? sort.substr(1) : sort;
+        }
+        if (!isSortable(sort_field)) sort_field = "id";
+        ListPage page;
+        std::string last_id;
+        json last_value;
+
+        out.push_back('[');
+        auto cursor = listRows(opts, [&](const soci::row &row) {
+            if (!plan) {
+                plan = codec.plan(row);
+                for (std::size_t i = 0; i < plan->size(); ++i) {
+                    if ((*plan)[i]->name == "id") id_col = i;
+                    if ((*plan)[i]->name == sort_field) sort_col = i;
+                }
+            }
+
+            if (page.count > 0) out.push_back(',');
+            codec.encode(row, *plan, out, skip);
+            ++page.count;
+
+            if (id_col && row.get_indicator(*id_col) != soci::i_null)
+                last_id = row.get<std::string>(*id_col);
+            if (sort_col)
+                last_value = row.get_indicator(*sort_col) == soci::i_null
+                                 ? json(nullptr)
+                                 : (*plan)[*sort_col]->decode(row, *sort_col);
+        });
+        out.push_back(']');
+
+        if (!last_id.empty() && cursor.field != ListCursor::NEAR) {
+            cursor.id = last_id;
+            if (!cursor.ranked())
+                cursor.value = cursor.field == "id" ? json(last_id) : std::move(last_value);
+            page.cursor = cursor.encode();
+        }
+        return page;
+    }
+
+    Entity::ExportReader Entity::exportRecords(const ExportFormat format, const json &opts) const {
+        rejectSharded("Exports");
+        // Validated before leasing a session, so a bad filter or field fails with 400
+        const auto columns = selectList(opts);
+        const auto filter = queryFilter(opts);
+
+        struct Cursor {
+            std::shared_ptr<soci::session> sql;
+            soci::values vals;
+            std::optional<soci::rowset<soci::row>> rows;
+            soci::rowset<soci::row>::const_iterator it;
+            std::shared_ptr<const RowCodec> codec;
+            std::optional<RowCodec::Plan> plan;
+            std::string pending; ///> Encoded, not yet handed out
+            std::size_t offset = 0;
+        };
+
+        // The codec is shared rather than borrowed: the reader outlives this Entity copy
+        auto cursor = std::make_shared<Cursor>();
+        cursor->sql = app().db().readSession();
+        cursor->codec = compiled().codec;
+        std::string query = std::format("SELECT {} FROM {}", columns, sqlIdentifier(name()));
+        if (filter) {
+            query += " WHERE " + filter->where;
+            for (const auto &[param, value]: filter->params)
+                bindJson(cursor->vals, param, value);
+        }
+        query += " ORDER BY id ASC";
+
+        // Executed here, so a failing query is an error response rather than a cut-off stream
+        if (filter) cursor->rows.emplace((cursor->sql->prepare << query, soci::use(cursor->vals)));
+        else cursor->rows.emplace((cursor->sql->prepare << query));
+        cursor->it = cursor->rows->begin();
+
+        const std::string skip = type() == "auth" ? "password" : "";
+        return [cursor, format, skip](char *buf, const std::size_t len) -> std::size_t {
+            // Called with nullptr once drogon is done with the stream
+            if (!buf) {
+                cursor->rows.reset();
+                cursor->sql.reset();
+                return 0;
+            }
+
+            // Whole rows until there's a buffer's worth; the tail waits for the next call
+            while (cursor->pending.size() - cursor->offset < len && cursor->rows &&
+                   cursor->it != cursor->rows->end()) {
+                if (cursor->offset > 0) {
+                    cursor->pending.erase(0, cursor->offset);
+                    cursor->offset = 0;
+                }
+
+                const auto &row = *cursor->it;
+                if (!cursor->plan) {
+                    cursor->plan = cursor->codec->plan(row);
+                    if (format == ExportFormat::Csv)
+                        RowCodec::encodeCsvHeader(*cursor->plan, cursor->pending, skip);
+                }
+                if (format == ExportFormat::Csv) {
+                    cursor->codec->encodeCsv(row, *cursor->plan, cursor->pending, skip);
+                } else {
+                    cursor->codec->encode(row, *cursor->plan, cursor->pending, skip);
+                    cursor->pending.push_back('\n');
+                }
+                ++cursor->it;
+            }
+
+            // Done reading: give the session back to the pool before the last bytes go out
+            if (cursor->rows && cursor->it == cursor->rows->end()) {
+                cursor->rows.reset();
+                cursor->sql.reset();
+            }
+
+            const auto n = std::min(len, cursor->pending.size() - cursor->offset);
+            std::memcpy(buf, cursor->pending.data() + cursor->offset, n);
+            cursor->offset += n;
+            return n;
+        };
+    }
+
     std::optional<Record> Entity::read(const std::string &id, const json &opts) const {
-        // Get a soci::session from the pool
-        const auto sql = app().db().session();
+        // Validated before leasing a session, so an unknown field fails with 400
+        const auto columns = selectList(opts);
+        const EntityShards::Scope shard(shardFor(id));
+
+        // Cached records are whole, and projected once looked up
+        auto &cache = recordCache();
+        const bool cached = cache.enabledFor(name()) && !Database::pinnedToPrimary();
+        const auto &query_columns = cached ? recordColumns() : columns;
+
+        const auto fetch = [&]() -> std::optional<Record> {
+            // Get a soci::session from the pool, or a replica's unless this request wrote
+            const auto sql = app().db().readSession();
+
+            // Point read through the per-connection prepared statement cache
+            Record row;
+            const auto found = app().db().queryRowCached(
+                *sql, name(), pointReadSql(query_columns), id,
+                [&](const soci::row &r) { row = sociRow2Json(r, rowCodec()); });
+            if (!found) return std::nullopt;
+            return row;
+        };
+
+        std::optional<Record> result;
+        if (cached) result = cache.get(name(), id);
+        if (!result) {
+            const auto generation = cached ? cache.generation(name()) : 0;
+            // A request that wrote must see its writes, not a read that began before them
+            result = Database::pinnedToPrimary() ? fetch() : readFlights().read(name(), id, query_columns, fetch);
+            if (cached && result) cache.put(name(), id, generation, *result);
+        }
 
-        soci::row r; // To hold read data
-        *sql << std::format("SELECT * FROM {} WHERE id = :id", sqlIdentifier(name())), soci::use(id), soci::into(r);
+        // Archived records are looked up once the table has none; they aren't cached
+        std::string from = sqlIdentifier(name());
+        if (!result && includesArchived(opts)) {
+            const auto sql = app().db().readSession();
+            const auto source = EntityArchive::source(*this, *sql);
+            if (source != from) {
+                soci::row row;
+                *sql << std::format("SELECT {} FROM {} WHERE id = :id LIMIT 1", columns, source), soci::use(id),
+                        soci::into(row);
+                if (sql->got_data()) {
+                    result = sociRow2Json(row, rowCodec());
+                    from = source;
+                }
+            }
+        }
 
         // If no data was found, return a std::nullopt
-        if (!sql->got_data()) return std::nullopt; // 404
+        if (!result) return std::nullopt; // 404
+        auto &record = *result;
+
+        if (cached && opts.contains("fields") && opts["fields"].is_string()) {
+            if (const auto fields = projection(opts["fields"].get<std::string>()); !fields.empty()) {
+                Record projected = json::object();
+                for (const auto &field: fields)
+                    if (const auto it = record.find(field); it != record.end()) projected[field] = std::move(*it);
+                record = std::move(projected);
+            }
+        }
 
-        // Parse returned record to JSON
-        auto record = sociRow2Json(r, fields());
+        // Reads are shared by all requesters, so the get rule's row filter is its own query
+        if (compiled().getFilter && opts.contains("auth") &&
+            !getFilterMatches(*app().db().readSession(), from, id, opts))
+            return std::nullopt; // 404, as if it didn't exist
 
         if (opts.contains("keep_passwords") &&
             opts["keep_passwords"].is_boolean() &&
@@ -183,11 +1028,85 @@ namespace mb {
         return record;
     }
 
-    Record Entity::update(const std::string &id, const json &data, const json &opts) const {
-        // Database session & transaction instance
-        auto sql = app().db().session();
-        soci::transaction tr(*sql);
+    Records Entity::readMany(soci::session &sql, const std::vector<std::string> &ids, const json &opts) const {
+        Records records;
+        if (ids.empty()) return records;
 
+        // The list rule's row filter shares each statement with the ids
+        json rule_opts = json::object();
+        if (opts.contains("auth")) rule_opts["auth"] = opts["auth"];
+        const auto filter = queryFilter(rule_opts);
+        const auto batch = kMaxBatchParams - (filter ? filter->params.size() : 0);
+
+        const auto &codec = rowCodec();
+        const bool is_auth = type() == "auth";
+        try {
+            std::optional<RowCodec::Plan> plan;
+            for (std::size_t off = 0; off < ids.size(); off += batch) {
+                const auto end = std::min(ids.size(), off + batch);
+                soci::values vals;
+                std::string in;
+                for (auto i = off; i < end; ++i) {
+                    const auto param = "k" + std::to_string(i - off);
+                    vals.set(param, ids[i]);
+                    in += (in.empty() ? ":" : ", :") + param;
+                }
+                std::string where = std::format("id IN ({})", in);
+                if (filter) {
+                    where += std::format(" AND ({})", filter->where);
+                    for (const auto &[param, value]: filter->params) bindJson(vals, param, value);
+                }
+
+                soci::rowset<soci::row> rs = (sql.prepare << std::format(
+                    "SELECT {} FROM {} WHERE {}", recordColumns(), sqlIdentifier(name()), where), soci::use(vals));
+                for (const auto &row: rs) {
+                    if (!plan) plan = codec.plan(row);
+                    auto record = codec.decode(row, *plan);
+                    if (is_auth) record.erase("password");
+                    records.push_back(std::move(record));
+                }
+            }
+        } catch (const MantisException &) {
+            throw;
+        } catch (const std::exception &e) {
+            throw MantisException(500, e.what());
+        }
+        return records;
+    }
+
+    Records Entity::readAll(soci::session &sql, const json &opts, const std::size_t limit) const {
+        Records records;
+        soci::values vals;
+        std::string where;
+        if (const auto filter = queryFilter(opts)) {
+            where = std::format(" WHERE {}", filter->where);
+            for (const auto &[param, value]: filter->params) bindJson(vals, param, value);
+        }
+        vals.set("limit", static_cast<int>(limit));
+
+        const auto &codec = rowCodec();
+        const bool is_auth = type() == "auth";
+        try {
+            std::optional<RowCodec::Plan> plan;
+            soci::rowset<soci::row> rs = (sql.prepare << std::format(
+                "SELECT {} FROM {}{} ORDER BY id LIMIT :limit", recordColumns(), sqlIdentifier(name()), where),
+                soci::use(vals));
+            for (const auto &row: rs) {
+                if (!plan) plan = codec.plan(row);
+                auto record = codec.decode(row, *plan);
+                if (is_auth) record.erase("password");
+                records.push_back(std::move(record));
+            }
+        } catch (const MantisException &) {
+            throw;
+        } catch (const std::exception &e) {
+            throw MantisException(500, e.what());
+        }
+        return records;
+    }
+
+    Record Entity::update(const std::string &id, const json &data, const json &opts) const {
+        const EntityShards::Scope shard(shardFor(id));
         try {
             // Create default time values
             std::time_t current_t = time(nullptr);
@@ -204,28 +1123,39 @@ namespace mb {
             std::vector<std::string> updateFields;
             updateFields.reserve(data.size());
 
+            // Operator values (`{"$inc": 1}`) compile to expressions on the stored
+            // value and bind their own operands; the rest are bound as given
+            soci::values vals;
+            json plain = data;
+
+            // The version counts updates; clients don't set it
+            const bool versioned = isVersioned();
+            if (versioned) plain.erase("version");
+
             // Create the field cols and value cols as concatenated strings
             for (const auto &[key, val]: data.items()) {
                 // For system fields, let's ignore them for now.
-                if (key == "id" || key == "created" || key == "updated") continue;
+                if (key == "id" || key == "created" || key == "updated" || (versioned && key == "version")) continue;
 
                 // First, ensure the key exists in our schema fields
-                auto schema = findField(key);
-                if (!schema.has_value()) continue;
+                const auto *schema = fieldDef(key);
+                if (!schema) continue;
 
                 const auto col = sqlIdentifier(key);
-                columns += columns.empty() ? std::format("{0} = :{0}", col) : std::format(", {0} = :{0}", col);
+                const auto value = FieldOps::isOperator(val)
+                                       ? FieldOps::assignment(app().dbType(), name(), *schema, val, col, vals)
+                                       : ":" + col;
+                if (FieldOps::isOperator(val)) plain.erase(key);
+                columns += std::format("{}{} = {}", columns.empty() ? "" : ", ", col, value);
                 updateFields.push_back(key);
 
                 // Track file fields for use later on
-                if (schema.value()["type"] == "file" || schema.value()["type"] == "files") {
+                if (const auto type = schema->value("type", ""); type == "file" || type == "files") {
                     file_fields.push_back(
                         json{
                             {"name", key},
                             {"value", val},
-                            {
-                                "type", schema.value()["type"]
-                            }
+                            {"type", type}
                         });
                 }
             }
@@ -238,40 +1168,55 @@ namespace mb {
                 );
 
             // Add Updated field as an extra field for updates ...
+            if (versioned) columns += ", version = COALESCE(version, 0) + 1";
             columns += columns.empty() ? ("updated = :updated") : (", updated = :updated");
             updateFields.emplace_back("updated");
 
-            // Check for file(s) being saved from the request, determine if there is
-            // need to delete/overwrite existing files
-            if (!file_fields.empty()) {
-                std::string fields_to_query{};
-
-                for (const auto &file: file_fields) {
-                    const auto col = sqlIdentifier(file["name"].get<std::string>());
-                    if (fields_to_query.empty()) fields_to_query = col;
-                    else fields_to_query += ", " + col;
-                }
-
-                const std::string sql_str = std::format("SELECT {} FROM {} WHERE id = :id LIMIT 1",
-                                                        fields_to_query, sqlIdentifier(name()));
-
-                soci::row r;
-                *sql << sql_str, soci::use(id), soci::into(r);
+            const auto if_match = opts.is_object() ? opts.value("if_match", "") : std::string{};
+            const auto table = sqlIdentifier(name());
 
-                if (!sql->got_data()) {
-                    throw std::runtime_error(std::format("Could not find record with id = {}", id));
+            // Create the SQL Query. RETURNING reads the updated row back in
+            // the same round-trip instead of a separate SELECT (supported by
+            // SQLite >= 3.35 and PostgreSQL). On PostgreSQL the row as it was
+            // comes back with it too: a FROM subquery reads it from before the
+            // statement, and its columns follow the record's. SQLite's
+            // RETURNING sees only the new row, so it reads the old one first,
+            // as does an If-Match update, which checks it anyway.
+            const bool prior_returned = if_match.empty() && app().dbType() == "postgresql";
+            const auto &codec_columns = rowCodec().columns();
+            std::string sql_query;
+            if (prior_returned) {
+                std::string prior, returned;
+                for (const auto &col: codec_columns) {
+                    const auto field = sqlIdentifier(col.name);
+                    const auto alias = sqlIdentifier("mb_old_" + col.name);
+                    prior += std::format("{}{} AS {}", prior.empty() ? "" : ", ",
+                                         col.kind == RowCodec::Kind::Blob ? std::format("length({})", field) : field,
+                                         alias);
+                    returned += ", mb_old." + alias;
                 }
+                sql_query = std::format(
+                    "UPDATE {0} SET {1} FROM (SELECT {2} FROM {0} WHERE id = :mb_old_id) AS mb_old "
+                    "WHERE {0}.id = :old_id RETURNING {3}{4}",
+                    table, columns, prior, recordColumns(), returned);
+            } else {
+                sql_query = std::format("UPDATE {} SET {} WHERE id = :old_id RETURNING {}",
+                                        table, columns, recordColumns());
+            }
 
-                // Parse soci::row to JSON object
-                auto record = sociRow2Json(r, fields());
+            // Bind soci::values to entity values, throws an error if it fails
+            rowCodec().bind(vals, plain);
+            vals.set("old_id", id);
+            if (prior_returned) vals.set("mb_old_id", id);
+            vals.set("updated", created_tm);
 
-                // From the record, check for changes in files
-                // Assuming record order is maintained on query ...
+            // From the stored file names, queue those the update drops
+            const auto diff_files = [&](const json &record) {
                 for (const auto &file_field: file_fields) {
                     const auto field_name = file_field["name"].get<std::string>();
 
                     // For null values in db, continue
-                    if (record[field_name].is_null()) continue;
+                    if (!record.contains(field_name) || record[field_name].is_null()) continue;
 
                     const auto files_in_db = file_field["type"] == "files"
                                                  ? record[field_name]
@@ -296,31 +1241,60 @@ namespace mb {
                         }
                     }
                 }
-            }
+            };
 
-            // Create the SQL Query. RETURNING * reads the updated row back in
-            // the same round-trip instead of a separate SELECT (supported by
-            // SQLite >= 3.35 and PostgreSQL).
-            std::string sql_query = std::format("UPDATE {} SET {} WHERE id = :old_id RETURNING *",
-                                                sqlIdentifier(name()), columns);
+            // The prior row and the update commit as one write
+            soci::row r;
+            Record old_record;
+            app().db().write([&](soci::session &sql) {
+                // The row as it was: the event's `old_data`, and the files the update drops. If
+                // the client read it at some version, it must not have changed since
+                files_to_delete.clear();
+                if (!prior_returned) {
+                    old_record = if_match.empty() ? readForWrite(sql, id) : readIfMatch(sql, id, if_match);
+                    diff_files(old_record);
+                }
 
-            // Bind soci::values to entity values, throws an error if it fails
-            auto vals = json2SociValue(data, fields());
-            vals.set("old_id", id);
-            vals.set("updated", created_tm);
+                // Bind values, execute, and fetch the updated row in one go
+                sql << sql_query, soci::use(vals), soci::into(r);
+
+                if (prior_returned) {
+                    if (!sql.got_data())
+                        throw MantisException(404, std::format("Resource not found for given id `{}`", id));
+
+                    // The prior columns trail the record's, in the codec's order
+                    const auto first = r.size() - codec_columns.size();
+                    old_record = json::object();
+                    for (std::size_t i = 0; i < codec_columns.size(); ++i) {
+                        const auto &col = codec_columns[i];
+                        old_record[col.name] = r.get_indicator(first + i) == soci::i_null || !col.decode
+                                                   ? json(nullptr)
+                                                   : col.decode(r, first + i);
+                    }
+                    diff_files(old_record);
+                }
 
-            // Bind values, execute, and fetch the updated row in one go
-            soci::row r;
-            *sql << sql_query, soci::use(vals), soci::into(r);
-            tr.commit();
+                // Files no longer named go only if the update commits
+                FileCleanup::enqueue(sql, name(), files_to_delete);
+            });
+
+            Record new_record = prior_returned
+                                    ? rowCodec().decode(r, rowCodec().plan(r, r.size() - codec_columns.size()))
+                                    : sociRow2Json(r, rowCodec());
 
-            // Wake the realtime worker to deliver the change immediately.
-            app().rt().notifyChange();
+            // Reads begun before the commit no longer answer new readers
+            readFlights().forget(name(), id);
+            recordCache().forget(name(), id);
 
-            // Delete files, if any were removed ...
-            Files::removeFiles(name(), files_to_delete);
+            // Hand both rows to the realtime worker directly and wake it; the trigger copy is
+            // deduplicated, so this one carries OLD for deltas and rows leaving a filter
+            app().rt().publish("UPDATE", name(), id, std::move(old_record), new_record);
 
-            Record new_record = sociRow2Json(r, fields());
+            // Don't wait for the change stream to drop a stale `auth.user`
+            if (type() == "auth") Auth::userCache().invalidate(name(), id);
+
+            // Remove dropped files, if any, off the request thread
+            if (!files_to_delete.empty()) app().fileCleanup().notify();
 
             // Redact passwords
             if (type() == "auth") new_record.erase("password");
@@ -332,72 +1306,1202 @@ namespace mb {
         }
     }
 
-    void Entity::remove(const std::string &id) const {
+    void Entity::remove(const std::string &id, const json &opts) const {
         // Views should not reach here
         if (type() == "view")
             throw std::invalid_argument("Remove is not implemented for Entity of `view` type!");
 
-        const auto sql = app().db().session();
-        soci::transaction tr(*sql);
+        const EntityShards::Scope shard(shardFor(id));
+        const auto &db = app().db();
+        const auto table = sqlIdentifier(name());
+        const auto if_match = opts.is_object() ? opts.value("if_match", "") : std::string{};
+        Record record;
+        db.write([&](soci::session &sql) {
+            // Delete and read back the removed row in one statement, keeping it for the event and its files.
+            // Not a cached statement: SQLite counts a RETURNING statement left unfinished as still writing
+            soci::row row;
+            sql << std::format("DELETE FROM {} WHERE id = :id RETURNING {}", table, recordColumns()),
+                    soci::use(id), soci::into(row);
+            if (!sql.got_data())
+                throw MantisException(404, std::format("Resource not found for given id `{}`", id));
+            record = sociRow2Json(row, rowCodec());
+
+            // The record must not have changed since the client read it; throwing rolls the delete back
+            if (!if_match.empty()) {
+                if (const auto tag = recordTag(record); !tag.has_value() || !ifMatch(if_match, *tag))
+                    throw MantisException(412, std::format("Record `{}` changed since it was read.", id));
+            }
 
-        // Check if item exists of given id
-        soci::row row;
-        const std::string sqlStr = std::format("SELECT * FROM {} WHERE id = :id LIMIT 1", sqlIdentifier(name()));
-        *sql << sqlStr, soci::use(id), soci::into(row);
+            // Queue its files in the same transaction
+            FileCleanup::enqueue(sql, name(), recordFiles(fields(), record));
+        });
 
-        if (!sql->got_data()) {
-            throw MantisException(404, std::format("Resource not found for given id `{}`", id));
+        readFlights().forget(name(), id);
+        recordCache().forget(name(), id);
+
+        // Hand the removed row to the realtime worker directly and wake it.
+        app().rt().publish("DELETE", name(), id, record, nullptr);
+
+        if (type() == "auth") Auth::userCache().invalidate(name(), id);
+
+        // Its files are removed in the background
+        app().fileCleanup().notify();
+    }
+
+    std::optional<std::string> Entity::recordTag(const json &record) const {
+        if (isVersioned()) {
+            if (!record.contains("version")) return std::nullopt;
+            const auto &version = record["version"];
+            return std::format("\"{}\"", version.is_number_integer() ? version.get<long long>() : 0);
         }
 
-        // Remove from DB
-        *sql << std::format("DELETE FROM {} WHERE id = :id", sqlIdentifier(name())), soci::use(id);
-        tr.commit();
+        // A digest of the whole record; `updated` alone can't tell apart two
+        // changes within a second. Only full records have one
+        if (!record.contains("id") || !record.contains("updated")) return std::nullopt;
+        for (const auto &field: fields())
+            if (!record.contains(field["name"].get<std::string>()) && field["name"] != "password") return std::nullopt;
+        auto redacted = record;
+        redacted.erase("password");
+        return std::format("\"{}\"", sha256Hex(redacted.dump()).substr(0, 32));
+    }
 
-        // Wake the realtime worker to deliver the change immediately.
-        app().rt().notifyChange();
+    bool Entity::isVersioned() const {
+        const auto *field = fieldDef("version");
+        return field && field->value("type", "") == "int";
+    }
 
-        // Parse row to JSON
-        const auto record = sociRow2Json(row, fields());
+    std::shared_ptr<Database> Entity::shardFor(const std::string &id) const {
+        if (shards() <= 1 || EntityShards::current()) return nullptr;
+        return app().shards().db(name(), EntityShards::shardOf(id, shards()));
+    }
+
+    void Entity::rejectSharded(const char *what) const {
+        if (shards() > 1)
+            throw MantisException(400, std::format("{} are not supported for sharded entities.", what));
+    }
 
-        // Extract all fields that have file/files as the underlying data
-        std::vector<std::string> files_in_fields;
-        std::ranges::for_each(fields(), [&](const json &field) {
-            const auto &type = field["type"].get<std::string>();
-            const auto &name = field["name"].get<std::string>();
-            if (type == "file" && !record[name].is_null()) {
-                const auto &file = record.value(name, "");
-                if (!file.empty()) files_in_fields.emplace_back(file);
+    Records Entity::listShards(const json &opts, ListPage &page) const {
+        // The page listRows() would resolve, to cut and continue the merge by
+        int limit = 50;
+        std::string sort_field = "id";
+        bool desc = false;
+        if (opts.contains("pagination") && opts["pagination"].is_object()) {
+            const auto &pagination = opts["pagination"];
+            if (pagination.contains("limit") && pagination["limit"].is_number())
+                limit = std::clamp(pagination["limit"].get<int>(), 1, MAX_LIST_PAGE_SIZE);
+            if (pagination.contains("sort") && pagination["sort"].is_string()) {
+                const auto sort = pagination["sort"].get<std::string>();
+                desc = !sort.empty() && sort[0] == '-';
+                sort_field = desc ? sort.substr(1) : sort;
             }
-            if (type == "files" && !record[name].is_null() && record[name].is_array()) {
-                const auto &files = record.value(name, std::vector<std::string>{});
-                // Expand the array data out
-                for (const auto &file: files) {
-                    if (!file.empty()) files_in_fields.emplace_back(file);
-                }
+        }
+        if (!isSortable(sort_field)) {
+            sort_field = "id";
+            desc = false;
+        }
+
+        // Ids break ties across the shards as within one, so they're read even when `fields` leaves them out
+        json shard_opts = opts;
+        bool drop_id = false;
+        if (opts.contains("fields") && opts["fields"].is_string()) {
+            const auto fields = projection(opts["fields"].get<std::string>());
+            if (!fields.empty() && std::ranges::find(fields, "id") == fields.end()) {
+                shard_opts["fields"] = opts["fields"].get<std::string>() + ",id";
+                drop_id = true;
             }
+        }
+
+        // Every shard's page starts past the same cursor; the first `limit` of
+        // their union is the page the one table would have returned
+        Records merged;
+        for (int i = 0; i < shards(); ++i) {
+            const EntityShards::Scope shard(app().shards().db(name(), i));
+            ListPage part;
+            for (auto &record: list(shard_opts, part)) merged.push_back(std::move(record));
+        }
+
+        // In (sort value, id) order, nulls first, as ORDER BY puts them; reversed descending
+        const json none;
+        const auto at = [&none](const Record &record, const std::string &key) -> const json & {
+            const auto it = record.find(key);
+            return it == record.end() ? none : *it;
+        };
+        const auto before = [&](const Record &a, const Record &b) {
+            if (const auto &x = at(a, sort_field), &y = at(b, sort_field); x != y) return x < y;
+            return at(a, "id") < at(b, "id");
+        };
+        const auto end = merged.begin() + static_cast<std::ptrdiff_t>(
+                             std::min(merged.size(), static_cast<std::size_t>(limit)));
+        std::ranges::partial_sort(merged, end, [&](const Record &a, const Record &b) {
+            return desc ? before(b, a) : before(a, b);
         });
+        merged.erase(end, merged.end());
+
+        page.count = merged.size();
+        if (!merged.empty()) {
+            ListCursor cursor;
+            cursor.field = sort_field;
+            cursor.desc = desc;
+            cursor.id = merged.back().value("id", "");
+            cursor.value = at(merged.back(), sort_field);
+            page.cursor = cursor.encode();
+        }
+        if (drop_id)
+            for (auto &record: merged) record.erase("id");
+        return merged;
+    }
+
+    bool Entity::getFilterMatches(soci::session &sql, const std::string &from, const std::string &id,
+                                  const json &opts) const {
+        const auto &rule = compiled().getFilter;
+        if (!rule || !opts.contains("auth")) return true;
+
+        const auto bound = EntityFilter::bindVariables(*rule, {{"auth", opts["auth"]}});
+        soci::values vals;
+        vals.set("id", id);
+        for (const auto &[param, value]: bound.params) bindJson(vals, param, value);
+
+        int matched = 0;
+        sql << std::format("SELECT COUNT(*) FROM {} WHERE id = :id AND {}", from, bound.where),
+                soci::use(vals), soci::into(matched);
+        return matched > 0;
+    }
+
+    Record Entity::readForWrite(soci::session &sql, const std::string &id) const {
+        // Held until the write commits, so no other write slips in between; SQLite has one writer anyway
+        const auto lock = app().dbType() == "sqlite3" ? "" : " FOR UPDATE";
+        soci::row row;
+        sql << std::format("SELECT {} FROM {} WHERE id = :id LIMIT 1{}", recordColumns(), sqlIdentifier(name()), lock),
+                soci::use(id), soci::into(row);
+        if (!sql.got_data())
+            throw MantisException(404, std::format("Resource not found for given id `{}`", id));
+        return sociRow2Json(row, rowCodec());
+    }
+
+    Record Entity::readIfMatch(soci::session &sql, const std::string &id, const std::string &if_match) const {
+        auto record = readForWrite(sql, id);
+        if (const auto tag = recordTag(record); !tag.has_value() || !ifMatch(if_match, *tag))
+            throw MantisException(412, std::format("Record `{}` changed since it was read.", id));
+        return record;
+    }
+
+    std::vector<Entity::PlannedOp> Entity::planOps(const json &ops, const std::size_t base) const {
+        // Check the shape of every op before touching the DB, resolving the
+        // schema columns each create/update writes
+        std::vector<PlannedOp> plan;
+        plan.reserve(ops.size());
+        const bool versioned = isVersioned();
+
+        for (std::size_t k = 0; k < ops.size(); ++k) {
+            const auto &op = ops[k];
+            const auto i = base + k;
+            PlannedOp planned;
+            if (op.is_object() && op.contains("op") && op["op"].is_string())
+                planned.kind = op["op"].get<std::string>();
+            if (planned.kind != "create" && planned.kind != "update" && planned.kind != "delete")
+                throw MantisException(400, std::format("ops[{}]: `op` must be one of create, update or delete.", i));
+
+            if (planned.kind != "create") {
+                if (op.contains("id") && op["id"].is_string()) planned.id = trim(op["id"].get<std::string>());
+                if (planned.id.empty())
+                    throw MantisException(400, std::format("ops[{}]: Entity `id` is required!", i));
+            }
+
+            if (planned.kind != "delete") {
+                if (!op.contains("data") || !op["data"].is_object())
+                    throw MantisException(400, std::format("ops[{}]: `data` must be an object.", i));
+
+                for (const auto &[key, _]: op["data"].items()) {
+                    // System fields are set here, not by the client
+                    if (key == "id" || key == "created" || key == "updated" || (versioned && key == "version"))
+                        continue;
+
+                    const auto *field = fieldDef(key);
+                    if (!field) continue;
+
+                    if (const auto field_type = field->value("type", ""); field_type == "file" || field_type == "files")
+                        throw MantisException(400, std::format(
+                                                  "ops[{}]: File field `{}` can't be set in a batch, upload it "
+                                                  "through the single record endpoints.", i, key));
+                    if (FieldOps::isOperator(op["data"][key])) {
+                        auto err = planned.kind == "create"
+                                       ? std::make_optional<std::string>("Operators only apply to updates.")
+                                       : FieldOps::check(*field, op["data"][key]);
+                        if (err.has_value())
+                            throw MantisException(400, std::format("ops[{}]: {}", i, err.value()));
+                    }
+                    planned.columns.push_back(sqlIdentifier(key));
+                }
+
+                if (planned.kind == "update" && planned.columns.empty())
+                    throw MantisException(400, std::format("ops[{}]: No matching column in schema to update.", i));
+            }
+
+            plan.push_back(std::move(planned));
+        }
+        return plan;
+    }
+
+    void Entity::writeOps(soci::session &sql, const std::vector<PlannedOp> &plan, const json &bound_ops,
+                          const bool hash_in_bind, const std::size_t base, Records &results,
+                          WriteEffects &effects) const {
+        const auto &codec = rowCodec();
+        const auto table = sqlIdentifier(name());
+        const std::tm now_tm = toUtcTime(time(nullptr));
+        std::vector<std::string> files_to_delete;
+
+        // End of the run of plain updates of distinct ids from `k`; on PostgreSQL they share a round trip
+        const bool pipelined = PgPipeline::available(sql);
+        const auto update_run = [&](const std::size_t k) {
+            auto run_end = k;
+            std::unordered_set<std::string> ids;
+            while (run_end < plan.size() && run_end - k < kMaxBatchParams && plan[run_end].kind == "update" &&
+                   std::ranges::none_of(plan[run_end].columns, [&](const std::string &col) {
+                       return FieldOps::isOperator(bound_ops[run_end]["data"][col]);
+                   }) && ids.insert(plan[run_end].id).second)
+                ++run_end;
+            return run_end;
+        };
+
+        for (std::size_t i = 0; i < plan.size();) {
+            std::size_t end = i + 1;
+
+            if (plan[i].kind == "create") {
+                // Consecutive creates writing the same columns share one
+                // multi-row INSERT; ids are bound as `:id_<n>`, fields as `:<field>_<n>`
+                const auto &columns = plan[i].columns;
+                const std::size_t params_per_row = columns.size() + 3;
+                while (end < plan.size() && plan[end].kind == "create" && plan[end].columns == columns &&
+                       (end - i + 1) * params_per_row <= kMaxBatchParams)
+                    ++end;
+
+                std::string column_list = "id, created, updated";
+                for (const auto &col: columns) column_list += ", " + col;
+
+                soci::values vals;
+                std::string rows;
+                std::unordered_map<std::string, std::size_t> op_index;
+                const auto ids = generate_uuidv7_batch(end - i);
+                for (std::size_t k = i; k < end; ++k) {
+                    const auto n = "_" + std::to_string(k - i);
+                    const auto &id = ids[k - i];
+                    op_index.emplace(id, k);
+
+                    rows += rows.empty() ? "(" : ", (";
+                    rows += std::format(":id{0}, :created{0}, :updated{0}", n);
+                    for (const auto &col: columns) rows += std::format(", :{}{}", col, n);
+                    rows += ")";
+
+                    codec.bind(vals, bound_ops[k]["data"], n, hash_in_bind);
+                    vals.set("id" + n, id);
+                    vals.set("created" + n, now_tm);
+                    vals.set("updated" + n, now_tm);
+                }
+
+                soci::rowset<soci::row> rs = (sql.prepare << std::format(
+                                                  "INSERT INTO {} ({}) VALUES {} RETURNING {}",
+                                                  table, column_list, rows, recordColumns()), soci::use(vals));
+                for (const auto &row: rs) {
+                    auto record = sociRow2Json(row, rowCodec());
+                    const auto id = record.value("id", "");
+                    effects.events.push_back(ChangeJournal::makeEvent("INSERT", name(), id, nullptr, record));
+                    if (const auto it = op_index.find(id); it != op_index.end())
+                        results[it->second] = std::move(record);
+                }
+            } else if (const auto run_end = pipelined ? update_run(i) : i; run_end > i + 1) {
+                end = run_end;
+                pipelineUpdates(sql, plan, bound_ops, hash_in_bind, i, end, base, results, effects);
+            } else if (plan[i].kind == "update") {
+                const auto &data = bound_ops[i]["data"];
+                json plain = data;
+                soci::values vals;
+                std::string columns;
+                for (const auto &col: plan[i].columns) {
+                    if (!FieldOps::isOperator(data[col])) {
+                        columns += std::format("{0} = :{0}, ", col);
+                        continue;
+                    }
+                    columns += std::format("{} = {}, ", col, FieldOps::assignment(app().dbType(), name(),
+                                                                                  *fieldDef(col), data[col],
+                                                                                  col, vals));
+                    plain.erase(col);
+                }
+                if (isVersioned()) {
+                    columns += "version = COALESCE(version, 0) + 1, ";
+                    plain.erase("version");
+                }
+                columns += "updated = :updated";
+
+                codec.bind(vals, plain, "", hash_in_bind);
+                vals.set("old_id", plan[i].id);
+                vals.set("updated", now_tm);
+
+                soci::row r;
+                sql << std::format("UPDATE {} SET {} WHERE id = :old_id RETURNING {}", table, columns,
+                                   recordColumns()),
+                        soci::use(vals), soci::into(r);
+                if (!sql.got_data())
+                    throw MantisException(404, std::format("ops[{}]: Resource not found for given id `{}`",
+                                                           base + i, plan[i].id));
+
+                auto record = sociRow2Json(r, rowCodec());
+                effects.events.push_back(ChangeJournal::makeEvent("UPDATE", name(), plan[i].id, nullptr, record));
+                if (type() == "auth") effects.users.emplace_back(name(), plan[i].id);
+                results[i] = std::move(record);
+            } else {
+                // Consecutive deletes of distinct ids share one `DELETE ... IN (...)`;
+                // a repeated id starts a new statement so it is reported as missing
+                std::unordered_set<std::string> ids{plan[i].id};
+                while (end < plan.size() && plan[end].kind == "delete" && end - i < kMaxBatchParams &&
+                       ids.insert(plan[end].id).second)
+                    ++end;
+
+                soci::values vals;
+                std::string placeholders;
+                for (std::size_t k = i; k < end; ++k) {
+                    const auto param = "id_" + std::to_string(k - i);
+                    placeholders += placeholders.empty() ? ":" + param : ", :" + param;
+                    vals.set(param, plan[k].id);
+                }
+
+                std::unordered_set<std::string> deleted;
+                soci::rowset<soci::row> rs = (sql.prepare << std::format(
+                                                  "DELETE FROM {} WHERE id IN ({}) RETURNING {}",
+                                                  table, placeholders, recordColumns()), soci::use(vals));
+                for (const auto &row: rs) {
+                    auto record = sociRow2Json(row, rowCodec());
+                    const auto id = record.value("id", "");
+                    std::ranges::move(recordFiles(fields(), record), std::back_inserter(files_to_delete));
+                    effects.events.push_back(ChangeJournal::makeEvent("DELETE", name(), id, std::move(record), nullptr));
+                    deleted.insert(id);
+                }
+
+                for (std::size_t k = i; k < end; ++k) {
+                    if (!deleted.contains(plan[k].id))
+                        throw MantisException(404, std::format("ops[{}]: Resource not found for given id `{}`",
+                                                               base + k, plan[k].id));
+                    if (type() == "auth") effects.users.emplace_back(name(), plan[k].id);
+                    results[k] = json{{"id", plan[k].id}};
+                }
+            }
+
+            i = end;
+        }
+
+        if (!files_to_delete.empty()) {
+            FileCleanup::enqueue(sql, name(), files_to_delete);
+            effects.filesQueued = true;
+        }
+    }
+
+    void Entity::pipelineUpdates(soci::session &sql, const std::vector<PlannedOp> &plan, const json &bound_ops,
+                                 const bool hash_in_bind, const std::size_t first, const std::size_t end,
+                                 const std::size_t base, Records &results, WriteEffects &effects) const {
+        const auto &codec = rowCodec();
+        const auto table = sqlIdentifier(name());
+        const auto updated = tmToStr(toUtcTime(time(nullptr)));
+
+        std::vector<PgPipeline::Statement> statements;
+        statements.reserve(end - first);
+        for (auto k = first; k < end; ++k) {
+            const auto &data = bound_ops[k]["data"];
+            PgPipeline::Statement stmt;
+            std::string columns;
+            for (const auto &col: plan[k].columns) {
+                stmt.params.push_back(codec.text(col, data[col], hash_in_bind));
+                columns += std::format("{} = ${}, ", col, stmt.params.size());
+            }
+            if (isVersioned()) columns += "version = COALESCE(version, 0) + 1, ";
+            stmt.params.emplace_back(updated);
+            stmt.params.emplace_back(plan[k].id);
+            stmt.sql = std::format("UPDATE {} SET {}updated = ${} WHERE id = ${} RETURNING id", table, columns,
+                                   stmt.params.size() - 1, stmt.params.size());
+            statements.push_back(std::move(stmt));
+        }
+
+        const auto returned = PgPipeline::run(sql, statements);
+        for (auto k = first; k < end; ++k) {
+            if (returned[k - first].empty())
+                throw MantisException(404, std::format("ops[{}]: Resource not found for given id `{}`",
+                                                       base + k, plan[k].id));
+        }
+
+        // The ids are distinct, so each row read is the one its update left
+        soci::values vals;
+        std::string in;
+        for (auto k = first; k < end; ++k) {
+            const auto param = "k" + std::to_string(k - first);
+            vals.set(param, plan[k].id);
+            in += (in.empty() ? ":" : ", :") + param;
+        }
+        std::unordered_map<std::string, json> rows;
+        std::optional<RowCodec::Plan> row_plan;
+        soci::rowset<soci::row> rs = (sql.prepare << std::format("SELECT {} FROM {} WHERE id IN ({})",
+                                                                 recordColumns(), table, in), soci::use(vals));
+        for (const auto &row: rs) {
+            if (!row_plan) row_plan = codec.plan(row);
+            auto record = codec.decode(row, *row_plan);
+            auto id = record.value("id", "");
+            rows.emplace(std::move(id), std::move(record));
+        }
+
+        for (auto k = first; k < end; ++k) {
+            auto &record = rows[plan[k].id];
+            effects.events.push_back(ChangeJournal::makeEvent("UPDATE", name(), plan[k].id, nullptr, record));
+            if (type() == "auth") effects.users.emplace_back(name(), plan[k].id);
+            results[k] = std::move(record);
+        }
+    }
+
+    void Entity::publishEffects(const MantisBase &app, WriteEffects &effects) {
+        // Before the change stream gets to them, so this node's next read sees the write
+        recordCache().onChanges(effects.events);
+
+        // One wake-up for the whole write, so the worker delivers it together
+        app.rt().publishAll(std::move(effects.events));
+        for (const auto &[entity, id]: effects.users) Auth::userCache().invalidate(entity, id);
+
+        // Removed records' files were queued with the rows; have them go now
+        if (effects.filesQueued) app.fileCleanup().notify();
+    }
+
+    Records Entity::batch(const json &ops) const {
+        // Views should not reach here
+        if (type() == "view")
+            throw MantisException(400, "Batch writes are not supported for entities of `view` type!");
+        rejectSharded("Batch writes");
+        if (!ops.is_array() || ops.empty())
+            throw MantisException(400, "Expected a non-empty array of batch ops.");
+        if (ops.size() > MAX_BATCH_OPS)
+            throw MantisException(400, std::format("A batch is limited to {} ops, got {}.", MAX_BATCH_OPS, ops.size()));
+
+        const auto plan = planOps(ops, 0);
+
+        // Hashed before the write opens, not while it holds the transaction
+        json hashed_ops;
+        if (fieldDef("password")) {
+            hashed_ops = ops;
+            bool any = false;
+            for (auto &op: hashed_ops)
+                if (op.contains("data")) any = hashPasswordField(op["data"]) || any;
+            if (!any) hashed_ops = nullptr;
+        }
+        const json &bound_ops = hashed_ops.is_null() ? ops : hashed_ops;
+        const bool hash_in_bind = hashed_ops.is_null();
+
+        Records results(ops.size());
+        WriteEffects effects;
+
+        try {
+            // Every op commits as a single write, or none does
+            app().db().write([&](soci::session &sql) {
+                effects = {};
+                writeOps(sql, plan, bound_ops, hash_in_bind, 0, results, effects);
+            });
+        } catch (const MantisException &) {
+            throw;
+        } catch (const std::exception &e) {
+            throw MantisException(500, e.what());
+        }
+
+        publishEffects(app(), effects);
+
+        if (type() == "auth")
+            for (auto &record: results)
+                if (record.is_object()) record.erase("password");
+        return results;
+    }
+
+    Records Entity::transaction(const MantisBase &app, const std::vector<std::shared_ptr<const Entity>> &entities,
+                                const json &ops, const TransactionCheck &check) {
+        if (!ops.is_array() || ops.empty())
+            throw MantisException(400, "Expected a non-empty array of transaction ops.");
+        if (ops.size() > MAX_BATCH_OPS)
+            throw MantisException(400, std::format("A transaction is limited to {} ops, got {}.",
+                                                   MAX_BATCH_OPS, ops.size()));
+        if (entities.size() != ops.size())
+            throw MantisException(500, "Expected an entity for every transaction op.");
+        for (const auto &entity: entities)
+            if (entity) entity->rejectSharded("Transactions");
+
+        // Op names for `$ref`, and passwords hashed before the write opens, not
+        // while it holds the transaction
+        std::unordered_map<std::string, std::size_t> names;
+        std::vector<std::optional<json>> passwords(ops.size());
+        for (std::size_t i = 0; i < ops.size(); ++i) {
+            const auto &op = ops[i];
+            if (entities[i]->type() == "view")
+                throw MantisException(400, std::format("ops[{}]: Entity `{}` is a view and can't be written.",
+                                                       i, entities[i]->name()));
+            if (!op.is_object())
+                throw MantisException(400, std::format("ops[{}]: Expected an object.", i));
+
+            if (op.contains("ref")) {
+                const auto ref = op["ref"].is_string() ? op["ref"].get<std::string>() : "";
+                if (ref.empty() || ref.find('.') != std::string::npos || std::ranges::all_of(ref, isDigit))
+                    throw MantisException(400, std::format("ops[{}]: `ref` must be a name, not a number, "
+                                                           "without dots.", i));
+                if (!names.emplace(ref, i).second)
+                    throw MantisException(400, std::format("ops[{}]: `ref` `{}` is taken by an earlier op.", i, ref));
+            }
+
+            if (!op.contains("data") || !op["data"].is_object() || !op["data"].contains("password")) continue;
+            if (isRef(op["data"]["password"]))
+                throw MantisException(400, std::format("ops[{}]: `password` can't be a `$ref`.", i));
+            if (auto data = op["data"]; entities[i]->fieldDef("password") && hashPasswordField(data))
+                passwords[i] = std::move(data["password"]);
+        }
+
+        Records results(ops.size());
+        WriteEffects effects;
+
+        // `value` as the `$ref` it may be resolves, from the result of an earlier op than `i`
+        const auto resolve = [&](const std::size_t i, json &value) {
+            if (!isRef(value)) return;
+            const auto path = value["$ref"].is_string() ? value["$ref"].get<std::string>() : "";
+            const auto dot = path.find('.');
+            if (dot == std::string::npos || dot == 0 || dot + 1 == path.size())
+                throw MantisException(400, std::format("ops[{}]: `$ref` must be `<op>.<field>`, got `{}`.", i, path));
+
+            const auto target = path.substr(0, dot), field = path.substr(dot + 1);
+            std::size_t index = ops.size();
+            if (std::ranges::all_of(target, isDigit)) {
+                std::from_chars(target.data(), target.data() + target.size(), index);
+            } else if (const auto it = names.find(target); it != names.end()) {
+                index = it->second;
+            }
+            if (index >= i)
+                throw MantisException(400, std::format("ops[{}]: `$ref` `{}` doesn't name an earlier op.", i, path));
+            // Hashes aren't handed from one record to another
+            if (field == "password" || !results[index].is_object() || !results[index].contains(field))
+                throw MantisException(400, std::format("ops[{}]: `$ref` `{}` names no field of ops[{}].",
+                                                       i, path, index));
+            value = results[index][field];
+        };
+
+        try {
+            // Every op commits as a single write, or none does
+            app.db().write([&](soci::session &sql) {
+                effects = {};
+                for (std::size_t i = 0; i < ops.size(); ++i) {
+                    const auto &entity = *entities[i];
+                    json op = ops[i];
+                    if (op.contains("id")) resolve(i, op["id"]);
+                    if (op.contains("data") && op["data"].is_object())
+                        for (auto &[_, value]: op["data"].items()) resolve(i, value);
+
+                    const auto plan = entity.planOps(json::array({op}), i);
+                    if (check) {
+                        if (const auto err = check(i, entity, op); err.has_value())
+                            throw MantisException(400, std::format("ops[{}]: {}", i, err.value()));
+                    }
+
+                    if (passwords[i].has_value()) op["data"]["password"] = *passwords[i];
+                    Records written(1);
+                    entity.writeOps(sql, plan, json::array({std::move(op)}), !passwords[i].has_value(), i,
+                                    written, effects);
+                    results[i] = std::move(written[0]);
+                }
+            });
+        } catch (const MantisException &) {
+            throw;
+        } catch (const std::exception &e) {
+            throw MantisException(500, e.what());
+        }
+
+        publishEffects(app, effects);
+
+        for (std::size_t i = 0; i < results.size(); ++i)
+            if (entities[i]->type() == "auth" && results[i].is_object()) results[i].erase("password");
+        return results;
+    }
+
+    json Entity::importRecords(const ExportFormat format, std::istream &in, const json &opts,
+                               const ImportCheck &check) const {
+        // Views should not reach here
+        if (type() == "view")
+            throw MantisException(400, "Imports are not supported for entities of `view` type!");
+        rejectSharded("Imports");
+
+        const bool realtime = !opts.contains("realtime") || !opts["realtime"].is_boolean() ||
+                              opts["realtime"].get<bool>();
+        const auto &codec = rowCodec();
+        const auto table = sqlIdentifier(name());
+        const std::tm now_tm = toUtcTime(time(nullptr));
+        std::size_t imported = 0;
+
+        try {
+            // The whole input commits as a single write, or none of it does
+            app().db().write([&](soci::session &sql) {
+                // Not owned: the static hook helpers take a shared session
+                const std::shared_ptr<soci::session> sess(std::shared_ptr<soci::session>{}, &sql);
+                if (!realtime) RealtimeDB::dropDbHooks(name(), sess);
+
+                ImportSource source(in, format == ExportFormat::Csv, fields());
+                [[maybe_unused]] const bool copy = sql.get_backend_name() == "postgresql";
+
+                // Records are written in runs sharing a column set: a COPY each
+                // on PostgreSQL, multi-row INSERTs within kMaxBatchParams otherwise
+                std::vector<const json *> columns; ///> Fields of the current run
+                std::vector<json> rows;            ///> INSERTs: records of the run not yet written
+                std::string column_list;
+#if MB_HAS_POSTGRESQL
+                std::optional<CopyIn> copy_in;
+                std::string copy_data;
+                const auto now_str = tmToStr(now_tm);
+#endif
+
+                const auto insertRows = [&] {
+                    if (rows.empty()) return;
+                    soci::values vals;
+                    std::string values;
+                    const auto ids = generate_uuidv7_batch(rows.size());
+                    for (std::size_t k = 0; k < rows.size(); ++k) {
+                        const auto n = "_" + std::to_string(k);
+                        values += values.empty() ? "(" : ", (";
+                        values += std::format(":id{0}, :created{0}, :updated{0}", n);
+                        for (const auto *field: columns)
+                            values += std::format(", :{}{}", field->at("name").get<std::string>(), n);
+                        values += ")";
+
+                        codec.bind(vals, rows[k], n, false);
+                        vals.set("id" + n, ids[k]);
+                        vals.set("created" + n, now_tm);
+                        vals.set("updated" + n, now_tm);
+                    }
+                    sql << std::format("INSERT INTO {} ({}) VALUES {}", table, column_list, values), soci::use(vals);
+                    rows.clear();
+                };
+
+                const auto endRun = [&] {
+                    insertRows();
+#if MB_HAS_POSTGRESQL
+                    if (copy_in) {
+                        copy_in->put(copy_data);
+                        copy_in->finish();
+                        copy_in.reset();
+                    }
+#endif
+                };
+
+                json record;
+                while (source.next(record)) {
+                    if (check) {
+                        if (const auto err = check(record); err.has_value())
+                            throw MantisException(400, std::format("line {}: {}", source.line(), err.value()));
+                    }
 
-        // For each file field, remove it in the filesystem
-        Files::removeFiles(name(), files_in_fields);
+                    std::vector<const json *> record_columns;
+                    for (const auto &field: fields()) {
+                        const auto &key = field["name"].get_ref<const std::string &>();
+                        const auto &field_type = field["type"].get_ref<const std::string &>();
+                        if (key == "id" || key == "created" || key == "updated" || field_type == "blob" ||
+                            !record.contains(key))
+                            continue;
+
+                        if ((field_type == "file" || field_type == "files") && !record[key].is_null())
+                            throw MantisException(400, std::format(
+                                                      "line {}: File field `{}` can't be set in an import, upload "
+                                                      "it through the single record endpoints.",
+                                                      source.line(), key));
+                        record_columns.push_back(&field);
+                    }
+                    hashPasswordField(record);
+
+                    if (record_columns != columns) {
+                        endRun();
+                        columns = std::move(record_columns);
+                        column_list = "id, created, updated";
+                        for (const auto *field: columns)
+                            column_list += ", " + sqlIdentifier(field->at("name").get<std::string>());
+                    }
+
+#if MB_HAS_POSTGRESQL
+                    if (copy) {
+                        if (!copy_in) copy_in.emplace(sql, table, column_list);
+
+                        copy_data += generate_uuidv7();
+                        copy_data += "," + now_str + "," + now_str;
+                        for (const auto *field: columns) {
+                            copy_data.push_back(',');
+                            const auto &key = field->at("name").get_ref<const std::string &>();
+                            // As RowCodec::bind(): no password is NULL, for OAuth-only users
+                            if (key == "password" && record[key].is_string() &&
+                                record[key].get_ref<const std::string &>().empty())
+                                continue;
+                            appendCopyValue(copy_data, *field, record[key]);
+                        }
+                        copy_data += "\n";
+                        if (copy_data.size() >= 64 * 1024) copy_in->put(copy_data);
+                        ++imported;
+                        continue;
+                    }
+#endif
+                    rows.push_back(std::move(record));
+                    if ((rows.size() + 1) * (columns.size() + 3) > kMaxBatchParams) insertRows();
+                    ++imported;
+                }
+                endRun();
+
+                // Hooks go back before the commit, so no later write is missed
+                if (!realtime) {
+                    RealtimeDB::addDbHooks(*this, sess);
+                    RealtimeDB::logChange(sql, "IMPORT", name(), "", {{"imported", imported}});
+                }
+            });
+        } catch (const MantisException &) {
+            throw;
+        } catch (const std::exception &e) {
+            throw MantisException(500, e.what());
+        }
+
+        // Trigger rows (or the summary) are on `mb_change_log`; have the worker read them now
+        app().rt().notifyChange();
+        return {{"imported", imported}};
     }
 
     // --------------------------------------------------------------------------- //
     // UTILS OPS                                                                   //
     // --------------------------------------------------------------------------- //
 
-    int Entity::countRecords() const {
-        // TODO add record filtering ...
+    std::optional<EntitySearch::Query> Entity::searchQuery(const json &opts, soci::values &vals) const {
+        if (!opts.contains("search") || !opts["search"].is_string()) return std::nullopt;
+        const auto db_type = app().dbType();
+        const auto words = EntitySearch::bindValue(db_type, opts["search"].get<std::string>());
+        if (words.empty()) return std::nullopt;
+
+        const auto fields = searchFields();
+        if (fields.empty()) throw MantisException(400, std::format("`{}` has no searchable fields.", name()));
+        auto query = EntitySearch::query(db_type, name(), fields);
+        vals.set("search", words);
+        return query;
+    }
+
+    std::optional<EntityGeo::Query> Entity::geoQuery(const json &opts, soci::values &vals) const {
+        if (!opts.contains("geo") || !opts["geo"].is_object()) return std::nullopt;
+        const auto &geo = opts["geo"];
+
+        // `field`, or the entity's only geo field; its slot is its place among them
+        const auto wanted = geo.value("field", "");
+        std::optional<std::string> field;
+        std::size_t slot = 0, seen = 0;
+        for (const auto &f: fields()) {
+            if (f.value("type", "") != "geo_point") continue;
+            if (wanted.empty() || f.value("name", "") == wanted) {
+                if (field)
+                    throw MantisException(400, std::format("`{}` has several geo fields; name one in `near_field`.",
+                                                           name()));
+                field = f.value("name", "");
+                slot = seen;
+            }
+            ++seen;
+        }
+        if (!field)
+            throw MantisException(400, wanted.empty()
+                                           ? std::format("`{}` has no geo fields.", name())
+                                           : std::format("`{}` isn't a geo field of `{}`.", wanted, name()));
+
+        EntityGeo::Area area;
+        if (geo.contains("near") && !geo["near"].is_null()) area.near = EntityGeo::parse(geo["near"], "near");
+        if (geo.contains("radius") && geo["radius"].is_number()) area.radiusKm = geo["radius"].get<double>();
+        if (geo.contains("bbox") && !geo["bbox"].is_null()) area.box = EntityGeo::parseBox(geo["bbox"]);
+
+        auto query = EntityGeo::query(app().dbType(), name(), *field, slot, area);
+        for (const auto &[param, value]: query.params) vals.set(param, value);
+        return query;
+    }
+
+    std::vector<std::string> Entity::nearIds(const json &near, soci::session &sql, const std::size_t candidates) const {
+        // `field`, or the entity's only vector field
+        const auto wanted = near.value("field", "");
+        const json *field = nullptr;
+        for (const auto &f: fields()) {
+            if (f.value("type", "") != "vector" || (!wanted.empty() && f.value("name", "") != wanted)) continue;
+            if (field)
+                throw MantisException(400, std::format("`{}` has several vector fields; name one in `near_field`.",
+                                                       name()));
+            field = &f;
+        }
+        if (!field)
+            throw MantisException(400, wanted.empty()
+                                           ? std::format("`{}` has no vector fields.", name())
+                                           : std::format("`{}` is not a vector field of `{}`.", wanted, name()));
+
+        const auto column = field->at("name").get<std::string>();
+        const std::size_t dim = field->value("dim", 0);
+        const auto query = VectorIndex::parse(near.value("vector", json()), dim);
+
+        const auto select = std::format("SELECT id, {0} FROM {1} WHERE {0} IS NOT NULL", sqlIdentifier(column),
+                                        sqlIdentifier(name()));
+        const auto index = vectorIndexes().acquire(name(), column, dim, [&](const std::vector<std::string> *ids) {
+            VectorIndexes::Rows rows;
+            if (!ids) {
+                soci::rowset<soci::row> rs = (sql.prepare << select);
+                for (const auto &row: rs) rows.emplace_back(row.get<std::string>(0), row.get<std::string>(1));
+                return rows;
+            }
+            for (std::size_t off = 0; off < ids->size(); off += kMaxBatchParams) {
+                const auto end = std::min(ids->size(), off + kMaxBatchParams);
+                soci::values vals;
+                std::string in;
+                for (auto i = off; i < end; ++i) {
+                    const auto param = "k" + std::to_string(i - off);
+                    vals.set(param, (*ids)[i]);
+                    in += (in.empty() ? ":" : ", :") + param;
+                }
+                soci::rowset<soci::row> rs = (sql.prepare << std::format("{} AND id IN ({})", select, in),
+                                              soci::use(vals));
+                for (const auto &row: rs) rows.emplace_back(row.get<std::string>(0), row.get<std::string>(1));
+            }
+            return rows;
+        });
+
+        std::vector<std::string> ids;
+        for (auto &hit: index->search(query, candidates)) ids.push_back(std::move(hit.id));
+        return ids;
+    }
+
+    CountCache &Entity::countCache() {
+        if (auto *tenant = Tenants::current()) return tenant->counts;
+        static CountCache cache(std::chrono::seconds(safe_stoi(getEnvOrDefault("MB_COUNT_CACHE_TTL", "60"), 60)));
+        return cache;
+    }
+
+    ReadCoalescer &Entity::readFlights() {
+        if (auto *tenant = Tenants::current()) return tenant->flights;
+        static ReadCoalescer flights(getEnvOrDefault("MB_READ_COALESCING", "1") != "0");
+        return flights;
+    }
+
+    RecordCache &Entity::recordCache() {
+        if (auto *tenant = Tenants::current()) return tenant->records;
+        static RecordCache cache(RecordCache::Options::fromEnv());
+        return cache;
+    }
+
+    VectorIndexes &Entity::vectorIndexes() {
+        if (auto *tenant = Tenants::current()) return tenant->vectors;
+        static VectorIndexes indexes(VectorIndex::Options::fromEnv());
+        return indexes;
+    }
+
+    int Entity::countRecords(const json &opts) const {
+        std::string filter_str;
+        if (opts.contains("filter") && opts["filter"].is_string())
+            filter_str = trim(opts["filter"].get<std::string>());
+        const bool approx = opts.contains("approx") && opts["approx"].is_boolean() && opts["approx"].get<bool>();
+
+        // Compiled before leasing a session, so a bad filter fails with 400
+        const auto filter = queryFilter(opts);
+        // A row filter counts differently per requester, by the values bound for it
+        if (filter && compiled().listFilter && opts.contains("auth"))
+            filter_str += '\x1f' + json(filter->params).dump();
+
+        // Each shard counts its own rows; the count cache keeps their sum
+        const bool in_shard = EntityShards::current() != nullptr;
+        if (shards() > 1 && !in_shard) {
+            auto &cache = countCache();
+            if (const auto cached = cache.get(name(), filter_str))
+                return static_cast<int>(*cached);
+            long long count = 0;
+            for (int i = 0; i < shards(); ++i) {
+                const EntityShards::Scope shard(app().shards().db(name(), i));
+                count += countRecords(opts);
+            }
+            if (!approx) cache.put(name(), filter_str, count);
+            return static_cast<int>(count);
+        }
+
+        // Matches, and points in an area, aren't tracked by the change stream,
+        // so they are counted each time
+        soci::values search_vals;
+        const auto search = searchQuery(opts, search_vals);
+        const auto geo = search ? std::nullopt : geoQuery(opts, search_vals);
+        if (includesArchived(opts)) {
+            if (search || geo)
+                throw MantisException(400, "`include_archived` doesn't combine with `search`, `near` or `bbox`.");
+            // Counted each time; the count cache holds the table's counts alone
+            try {
+                const auto sql = app().db().readSession();
+                const auto from = EntityArchive::source(*this, *sql);
+                long long count = 0;
+                if (filter) {
+                    soci::values vals;
+                    for (const auto &[param, value]: filter->params) bindJson(vals, param, value);
+                    *sql << std::format("SELECT COUNT(id) FROM {} WHERE {}", from, filter->where),
+                            soci::use(vals), soci::into(count);
+                } else {
+                    *sql << std::format("SELECT COUNT(id) FROM {}", from), soci::into(count);
+                }
+                return static_cast<int>(count);
+            } catch (const MantisException &) {
+                throw;
+            } catch (std::exception &e) {
+                throw MantisException(500, e.what());
+            }
+        }
+        if (search || geo) {
+            const auto join = search ? search->join : geo->join;
+            std::string where = search ? search->where : geo->where;
+            if (filter) {
+                where += (where.empty() ? "" : " AND ") + filter->where;
+                for (const auto &[param, value]: filter->params) bindJson(search_vals, param, value);
+            }
+            try {
+                const auto sql = app().db().readSession();
+                long long count = 0;
+                *sql << std::format("SELECT COUNT(*) FROM {}{}{}", sqlIdentifier(name()), join,
+                                    where.empty() ? "" : " WHERE " + where),
+                        soci::use(search_vals), soci::into(count);
+                return static_cast<int>(count);
+            } catch (const MantisException &) {
+                throw;
+            } catch (std::exception &e) {
+                throw MantisException(500, e.what());
+            }
+        }
+
+        auto &cache = countCache();
+        if (const auto cached = in_shard ? std::nullopt : cache.get(name(), filter_str))
+            return static_cast<int>(*cached);
+
         try {
-            const auto sql = app().db().session();
-            int count = 0;
-            *sql << std::format("SELECT COUNT(id) FROM {}", sqlIdentifier(name())), soci::into(count);
-            return count;
+            const auto sql = app().db().readSession();
+            if (approx && !filter) {
+                if (const auto estimate = estimateCount(*sql))
+                    return static_cast<int>(*estimate);
+            }
+
+            long long count = 0;
+            if (!filter) {
+                count = app().db().queryScalarCached(
+                    *sql, name(), std::format("SELECT COUNT(id) FROM {}", sqlIdentifier(name()))).value_or(0);
+            } else {
+                soci::values vals;
+                for (const auto &[param, value]: filter->params)
+                    bindJson(vals, param, value);
+                *sql << std::format("SELECT COUNT(id) FROM {} WHERE {}", sqlIdentifier(name()), filter->where),
+                        soci::use(vals), soci::into(count);
+            }
+
+            if (!in_shard) cache.put(name(), filter_str, count);
+            return static_cast<int>(count);
+        } catch (const MantisException &) {
+            throw;
         } catch (std::exception &e) {
             throw MantisException(500, e.what());
         }
     }
 
+    namespace {
+        /// A SUM/AVG/MIN/MAX result. PostgreSQL's numeric totals may arrive as text
+        json aggregateValue(const soci::row &row, const std::size_t i, const bool numeric) {
+            if (row.get_indicator(i) == soci::i_null) return nullptr;
+            switch (row.get_properties(i).get_db_type()) {
+                case soci::db_double: return row.get<double>(i);
+                case soci::db_int8: return row.get<int8_t>(i);
+                case soci::db_uint8: return row.get<uint8_t>(i);
+                case soci::db_int16: return row.get<int16_t>(i);
+                case soci::db_uint16: return row.get<uint16_t>(i);
+                case soci::db_int32: return row.get<int32_t>(i);
+                case soci::db_uint32: return row.get<uint32_t>(i);
+                case soci::db_int64: return row.get<int64_t>(i);
+                case soci::db_uint64: return row.get<uint64_t>(i);
+                case soci::db_date: return tmToStr(row.get<std::tm>(i));
+                case soci::db_string: {
+                    const auto &text = row.get<std::string>(i);
+                    if (!numeric) return text;
+                    if (text.find_first_of(".eE") == std::string::npos) {
+                        long long whole = 0;
+                        if (std::from_chars(text.data(), text.data() + text.size(), whole).ec == std::errc{})
+                            return whole;
+                    }
+                    try {
+                        return std::stod(text);
+                    } catch (...) {
+                        return text;
+                    }
+                }
+                default: return nullptr;
+            }
+        }
+
+        /// `opts[key]` as field names; at most `room` more of them
+        std::vector<std::string> aggregateFields(const json &opts, const char *key, std::size_t &room) {
+            std::vector<std::string> fields;
+            if (!opts.contains(key) || opts[key].is_null()) return fields;
+            if (!opts[key].is_array()) throw MantisException(400, std::format("`{}` must list field names.", key));
+            for (const auto &field: opts[key]) {
+                if (!field.is_string() || field.get<std::string>().empty())
+                    throw MantisException(400, std::format("`{}` must list field names.", key));
+                if (room == 0)
+                    throw MantisException(400, std::format("At most {} fields can be grouped, and {} aggregated.",
+                                                           Entity::MAX_AGGREGATE_FIELDS,
+                                                           Entity::MAX_AGGREGATE_FIELDS));
+                --room;
+                fields.push_back(field.get<std::string>());
+            }
+            return fields;
+        }
+    }
+
+    json Entity::aggregate(const json &opts) const {
+        rejectSharded("Aggregates");
+        // Every field is checked against the schema before any SQL is built
+        const auto check = [this](const std::string &field, const char *what,
+                                  std::initializer_list<std::string_view> types) {
+            const auto *col = rowCodec().column(field);
+            if (!col) throw MantisException(400, std::format("Unknown field `{}` in `{}`.", field, what));
+            if (col->secret) throw MantisException(400, std::format("Field `{}` can't be used in `{}`.", field, what));
+            if (std::ranges::find(types, std::string_view(col->type)) == types.end())
+                throw MantisException(400, std::format("Field `{}` of type `{}` can't be used in `{}`.", field,
+                                                       col->type, what));
+            return col;
+        };
+
+        std::size_t group_room = MAX_AGGREGATE_FIELDS;
+        std::size_t value_room = MAX_AGGREGATE_FIELDS;
+        const auto group = aggregateFields(opts, "group", group_room);
+        std::vector<const RowCodec::Column *> group_cols;
+        for (const auto &field: group)
+            group_cols.push_back(check(field, "group", {"string", "int", "double", "bool", "date"}));
+
+        // Output order: group fields, COUNT(*), then each aggregate in turn
+        struct Value {
+            const char *fn;
+            std::string field;
+        };
+        std::vector<Value> values;
+        for (const auto *fn: {"sum", "avg", "min", "max"}) {
+            const bool numeric = std::string_view(fn) == "sum" || std::string_view(fn) == "avg";
+            for (auto &field: aggregateFields(opts, fn, value_room)) {
+                if (numeric) check(field, fn, {"int", "double"});
+                else check(field, fn, {"int", "double", "string", "date"});
+                values.push_back({fn, std::move(field)});
+            }
+        }
+
+        const auto limit = opts.value("limit", 100);
+        if (limit < 1 || limit > 1000) throw MantisException(400, "`limit` must be between 1 and 1000.");
+
+        std::string order;
+        if (const auto sort = trim(opts.value("sort", std::string{})); !sort.empty()) {
+            const bool desc = sort.front() == '-';
+            const auto key = desc ? sort.substr(1) : sort;
+            if (key == "count")
+                order = "COUNT(*)";
+            else if (std::ranges::find(group, key) != group.end())
+                order = sqlIdentifier(key);
+            else
+                throw MantisException(400, "`sort` must be `count` or a `group` field.");
+            order += desc ? " DESC" : " ASC";
+        }
+        // Ties (and the default order) follow the group fields, so pages of equal queries match
+        for (const auto &field: group) order += (order.empty() ? "" : ", ") + sqlIdentifier(field) + " ASC";
+
+        const auto filter = queryFilter(opts);
+
+        std::string columns;
+        for (const auto &field: group) columns += sqlIdentifier(field) + ", ";
+        columns += "COUNT(*)";
+        for (const auto &[fn, field]: values) {
+            std::string upper = fn;
+            toUpperCase(upper);
+            columns += std::format(", {}({})", upper, sqlIdentifier(field));
+        }
+
+        auto query = std::format("SELECT {} FROM {}", columns, sqlIdentifier(name()));
+        if (filter) query += " WHERE " + filter->where;
+        if (!group.empty()) {
+            query += " GROUP BY ";
+            for (std::size_t i = 0; i < group.size(); ++i) query += (i ? ", " : "") + sqlIdentifier(group[i]);
+            query += " ORDER BY " + order;
+        }
+        // One more than asked for, to tell whether groups were cut off
+        query += std::format(" LIMIT {}", limit + 1);
+
+        try {
+            const auto sql = app().db().readSession();
+            soci::values vals;
+            if (filter)
+                for (const auto &[param, value]: filter->params) bindJson(vals, param, value);
+            std::optional<soci::rowset<soci::row>> rows;
+            if (filter) rows.emplace((sql->prepare << query, soci::use(vals)));
+            else rows.emplace((sql->prepare << query));
+
+            json groups = json::array();
+            bool truncated = false;
+            for (const auto &row: *rows) {
+                if (groups.size() == static_cast<std::size_t>(limit)) {
+                    truncated = true;
+                    break;
+                }
+
+                json entry = {{"key", json::object()}};
+                std::size_t i = 0;
+                for (; i < group_cols.size(); ++i) {
+                    const auto *col = group_cols[i];
+                    entry["key"][col->name] = row.get_indicator(i) == soci::i_null || !col->decode
+                                                  ? json(nullptr)
+                                                  : col->decode(row, i);
+                }
+                entry["count"] = aggregateValue(row, i++, true);
+                for (const auto &[fn, field]: values) {
+                    const bool numeric = std::string_view(fn) != "min" && std::string_view(fn) != "max";
+                    entry[fn][field] = aggregateValue(row, i++, numeric);
+                }
+                groups.push_back(std::move(entry));
+            }
+            return {{"groups", std::move(groups)}, {"truncated", truncated}};
+        } catch (const MantisException &) {
+            throw;
+        } catch (std::exception &e) {
+            throw MantisException(500, e.what());
+        }
+    }
+
+    std::optional<long long> Entity::estimateCount(soci::session &sql) const {
+        const auto &db_type = app().dbType();
+        const auto table = sqlIdentifier(name());
+        long long rows = -1;
+        soci::indicator ind = soci::i_null;
+
+        try {
+            if (db_type == "postgresql") {
+                // reltuples is only an estimate once VACUUM or ANALYZE has seen the table
+                sql << "SELECT CAST(CASE WHEN relpages > 0 THEN reltuples ELSE -1 END AS BIGINT) "
+                        "FROM pg_class WHERE oid = to_regclass(:t)",
+                        soci::use(table), soci::into(rows, ind);
+            } else if (db_type == "sqlite3") {
+                // Written by ANALYZE (and PRAGMA optimize); each row's stat starts with the table's row count
+                std::string stat;
+                sql << "SELECT stat FROM sqlite_stat1 WHERE tbl = :t LIMIT 1", soci::use(table), soci::into(stat, ind);
+                if (ind == soci::i_ok &&
+                    std::from_chars(stat.data(), stat.data() + stat.size(), rows).ec != std::errc{})
+                    rows = -1;
+            } else if (db_type == "mysql") {
+                sql << "SELECT table_rows FROM information_schema.tables "
+                        "WHERE table_schema = DATABASE() AND table_name = :t",
+                        soci::use(table), soci::into(rows, ind);
+            }
+        } catch (const std::exception &e) {
+            // sqlite_stat1 doesn't exist before the first ANALYZE
+            MB_LOG_TRACE(LogOrigin::entityTrace, "Count Estimate", std::format("No statistics for `{}`: {}", name(), e.what()));
+            return std::nullopt;
+        }
+
+        if (ind != soci::i_ok || rows < 0) return std::nullopt;
+        return rows;
+    }
+
     bool Entity::isEmpty() const {
+        if (shards() > 1 && !EntityShards::current()) {
+            for (int i = 0; i < shards(); ++i) {
+                const EntityShards::Scope shard(app().shards().db(name(), i));
+                if (!isEmpty()) return false;
+            }
+            return true;
+        }
         try {
             const auto &sql = app().db().session();
             int dummy = 0;
@@ -417,7 +2521,7 @@ namespace mb {
         // Validate all column names against entity schema
         std::vector<std::string> valid_columns;
         for (const auto &col_name: columns) {
-            if (hasField(col_name).has_value()) {
+            if (hasField(col_name)) {
                 valid_columns.push_back(col_name);
             } else {
                 LogOrigin::entityWarn("Invalid Column",
@@ -440,28 +2544,42 @@ namespace mb {
             bind_values.set(std::format("{0}{1}", col, i), value);
         }
 
-        const std::string query = std::format("SELECT * FROM {} WHERE {} LIMIT 1", sqlIdentifier(name()), where_clause);
+        const std::string query = std::format("SELECT {} FROM {} WHERE {} LIMIT 1", recordColumns(),
+                                              sqlIdentifier(name()), where_clause);
 
         // Run query
         soci::row r;
         *sql << query, soci::use(bind_values), soci::into(r);
 
         if (sql->got_data())
-            return sociRow2Json(r, fields());
+            return sociRow2Json(r, rowCodec());
 
         return std::nullopt;
     }
 
     bool Entity::recordExists(const std::string &id) const {
+        const EntityShards::Scope shard(shardFor(id));
         try {
-            std::string _nid;
             const auto sql = app().db().session();
-            *sql << std::format("SELECT id FROM {} WHERE id = :id LIMIT 1", sqlIdentifier(name())),
-                    soci::use(id), soci::into(_nid);
-            return sql->got_data();
+            return app().db().queryRowCached(*sql, name(), existsSql(), id, nullptr);
         } catch (soci::soci_error &e) {
             LogOrigin::entityTrace("Record Exists Error", e.what());
             return false;
         }
     }
+
+    void Entity::prepareStatements(soci::session &sql) const {
+        // No id is empty, so both miss
+        const auto &db = app().db();
+        (void) db.queryRowCached(sql, name(), pointReadSql(recordColumns()), std::string{}, nullptr);
+        (void) db.queryRowCached(sql, name(), existsSql(), std::string{}, nullptr);
+    }
+
+    std::string Entity::pointReadSql(const std::string &columns) const {
+        return std::format("SELECT {} FROM {} WHERE id = :p", columns, sqlIdentifier(name()));
+    }
+
+    std::string Entity::existsSql() const {
+        return std::format("SELECT id FROM {} WHERE id = :p LIMIT 1", sqlIdentifier(name()));
+    }
 }
@@ -0,0 +1,91 @@
+/**
+ * @file entity_field_ops.cpp
+ * @brief Implementation for @see entity_field_ops.h
+ */
+
+#include "../../../include/mantisbase/core/models/entity_field_ops.h"
+#include "../../../include/mantisbase/core/exceptions.h"
+#include "../../../include/mantisbase/utils/utils.h"
+
+#include <soci/soci.h>
+
+#include <format>
+
+namespace mb {
+    namespace {
+        /// A `json_each` element as JSON text, so SQLite compares `true` and `1` apart
+        constexpr auto kSqliteElement =
+                "CASE type WHEN 'true' THEN 'true' WHEN 'false' THEN 'false' WHEN 'null' THEN 'null' "
+                "WHEN 'object' THEN value WHEN 'array' THEN value ELSE json_quote(value) END";
+    }
+
+    bool FieldOps::isOperator(const nlohmann::json &value) {
+        // Other `$` keys are left to json fields holding them
+        if (!value.is_object() || value.size() != 1) return false;
+        const auto &op = value.begin().key();
+        return op == "$inc" || op == "$push" || op == "$pull";
+    }
+
+    std::optional<std::string> FieldOps::check(const nlohmann::json &field, const nlohmann::json &value) {
+        const auto name = field.value("name", "");
+        const auto type = field.value("type", "");
+        const auto &op = value.begin().key();
+        const auto &operand = value.begin().value();
+
+        // Rewritten whole, see FieldCompression
+        if (field.value("compress", false))
+            return std::format("`{}` is a compressed field; `{}` can't change it in place.", name, op);
+
+        if (op == "$inc") {
+            if (type != "int" && type != "double")
+                return std::format("`$inc` needs an `int` or `double` field, `{}` is a `{}`.", name, type);
+            if (type == "int" ? !operand.is_number_integer() : !operand.is_number())
+                return std::format("`$inc` on `{}` takes {}.", name, type == "int" ? "an integer" : "a number");
+            return std::nullopt;
+        }
+        // $push and $pull
+        if (type != "json")
+            return std::format("`{}` needs a `json` field, `{}` is a `{}`.", op, name, type);
+        return std::nullopt;
+    }
+
+    std::string FieldOps::assignment(const std::string &db_type, const std::string &table,
+                                     const nlohmann::json &field, const nlohmann::json &value,
+                                     const std::string &param, soci::values &vals) {
+        if (const auto err = check(field, value); err.has_value()) throw MantisException(400, err.value());
+
+        const auto column = std::format("{}.{}", sqlIdentifier(table),
+                                        sqlIdentifier(field.at("name").get<std::string>()));
+        const auto &op = value.begin().key();
+        const auto &operand = value.begin().value();
+
+        if (op == "$inc") {
+            if (operand.is_number_integer()) vals.set(param, operand.get<long long>());
+            else vals.set(param, operand.get<double>());
+            return std::format("COALESCE({}, 0) + :{}", column, param);
+        }
+
+        // `json` fields are stored as text; the operand is bound as its JSON
+        vals.set(param, operand.dump());
+        if (op == "$push") {
+            if (db_type == "postgresql")
+                return std::format("CAST(CAST(COALESCE({}, '[]') AS jsonb) || jsonb_build_array(CAST(:{} AS jsonb)) "
+                                   "AS TEXT)", column, param);
+            if (db_type == "mysql")
+                return std::format("JSON_ARRAY_APPEND(COALESCE({}, '[]'), '$', CAST(:{} AS JSON))", column, param);
+            return std::format("json_insert(COALESCE({}, '[]'), '$[#]', json(:{}))", column, param);
+        }
+
+        // $pull drops every element equal to the operand, keeping the others in order
+        if (db_type == "postgresql")
+            return std::format("CAST(COALESCE((SELECT jsonb_agg(mb_e ORDER BY mb_n) FROM "
+                               "jsonb_array_elements(CAST(COALESCE({}, '[]') AS jsonb)) WITH ORDINALITY "
+                               "AS mb_elements(mb_e, mb_n) WHERE mb_e <> CAST(:{} AS jsonb)), '[]') AS TEXT)",
+                               column, param);
+        if (db_type == "sqlite3")
+            return std::format("(SELECT json_group_array(json(mb_e)) FROM (SELECT {} AS mb_e FROM "
+                               "json_each(COALESCE({}, '[]')) ORDER BY key) WHERE mb_e <> json(:{}))",
+                               kSqliteElement, column, param);
+        throw MantisException(400, std::format("`$pull` isn't supported on `{}`.", db_type));
+    }
+}
@@ -0,0 +1,673 @@
+#include "../../../include/mantisbase/core/models/entity_filter.h"
+#include "../../../include/mantisbase/core/exceptions.h"
+#include "../../../include/mantisbase/utils/soci_wrappers.h"
+#include "../../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <optional>
+
+namespace mb {
+    namespace {
+        enum class TokType { Ident, Var, String, Number, Op, LParen, RParen, LBrack, RBrack, Comma, And, Or, In, Not, True, False, Null, End };
+
+        struct Token {
+            TokType type;
+            std::string text;
+            std::size_t pos;
+        };
+
+        [[noreturn]] void filterError(const std::string &msg, const std::size_t pos) {
+            throw MantisException(400, std::format("Invalid filter: {} (at position {})", msg, pos));
+        }
+
+        std::string upper(std::string s) {
+            for (auto &c: s) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+            return s;
+        }
+
+        std::vector<Token> tokenize(const std::string &src) {
+            std::vector<Token> toks;
+            std::size_t i = 0;
+            const auto n = src.size();
+
+            while (i < n) {
+                const char c = src[i];
+                if (std::isspace(static_cast<unsigned char>(c))) {
+                    ++i;
+                    continue;
+                }
+
+                const auto start = i;
+                if (c == '(') { toks.push_back({TokType::LParen, "(", start}); ++i; continue; }
+                if (c == ')') { toks.push_back({TokType::RParen, ")", start}); ++i; continue; }
+                if (c == '[') { toks.push_back({TokType::LBrack, "[", start}); ++i; continue; }
+                if (c == ']') { toks.push_back({TokType::RBrack, "]", start}); ++i; continue; }
+                if (c == ',') { toks.push_back({TokType::Comma, ",", start}); ++i; continue; }
+
+                if (c == '&' || c == '|') {
+                    if (i + 1 >= n || src[i + 1] != c) filterError(std::format("expected `{0}{0}`", c), start);
+                    toks.push_back({c == '&' ? TokType::And : TokType::Or, std::string(2, c), start});
+                    i += 2;
+                    continue;
+                }
+
+                if (c == '=' || c == '!' || c == '<' || c == '>' || c == '~') {
+                    std::string op(1, c);
+                    if (i + 1 < n && (src[i + 1] == '=' || (c == '!' && src[i + 1] == '~')))
+                        op.push_back(src[i + 1]);
+                    if (op == "!") filterError("expected `!=` or `!~`", start);
+                    i += op.size();
+                    toks.push_back({TokType::Op, op, start});
+                    continue;
+                }
+
+                if (c == '\'' || c == '"') {
+                    std::string val;
+                    ++i;
+                    bool closed = false;
+                    while (i < n) {
+                        if (src[i] == '\\' && i + 1 < n) {
+                            val.push_back(src[i + 1]);
+                            i += 2;
+                            continue;
+                        }
+                        if (src[i] == c) {
+                            closed = true;
+                            ++i;
+                            break;
+                        }
+                        val.push_back(src[i++]);
+                    }
+                    if (!closed) filterError("unterminated string", start);
+                    toks.push_back({TokType::String, std::move(val), start});
+                    continue;
+                }
+
+                if (std::isdigit(static_cast<unsigned char>(c)) ||
+                    (c == '-' && i + 1 < n && std::isdigit(static_cast<unsigned char>(src[i + 1])))) {
+                    ++i;
+                    while (i < n && (std::isdigit(static_cast<unsigned char>(src[i])) || src[i] == '.' ||
+                                     src[i] == 'e' || src[i] == 'E' ||
+                                     ((src[i] == '-' || src[i] == '+') && (src[i - 1] == 'e' || src[i - 1] == 'E'))))
+                        ++i;
+                    toks.push_back({TokType::Number, src.substr(start, i - start), start});
+                    continue;
+                }
+
+                // `@auth.id`: a request variable, for rule filters
+                if (c == '@') {
+                    ++i;
+                    while (i < n && (std::isalnum(static_cast<unsigned char>(src[i])) || src[i] == '_' || src[i] == '.'))
+                        ++i;
+                    toks.push_back({TokType::Var, src.substr(start + 1, i - start - 1), start});
+                    continue;
+                }
+
+                if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+                    const auto word_char = [&](const std::size_t at) {
+                        return at < n && (std::isalnum(static_cast<unsigned char>(src[at])) || src[at] == '_');
+                    };
+                    // `meta.country`: a path into a json field
+                    while (word_char(i) || (i < n && src[i] == '.' && word_char(i + 1))) ++i;
+                    auto word = src.substr(start, i - start);
+                    const auto kw = upper(word);
+                    if (kw == "AND") toks.push_back({TokType::And, word, start});
+                    else if (kw == "OR") toks.push_back({TokType::Or, word, start});
+                    else if (kw == "IN") toks.push_back({TokType::In, word, start});
+                    else if (kw == "NOT") toks.push_back({TokType::Not, word, start});
+                    else if (kw == "TRUE") toks.push_back({TokType::True, word, start});
+                    else if (kw == "FALSE") toks.push_back({TokType::False, word, start});
+                    else if (kw == "NULL") toks.push_back({TokType::Null, word, start});
+                    else toks.push_back({TokType::Ident, std::move(word), start});
+                    continue;
+                }
+
+                filterError(std::format("unexpected character `{}`", c), start);
+            }
+
+            toks.push_back({TokType::End, "", n});
+            return toks;
+        }
+
+        class Parser {
+        public:
+            Parser(std::vector<Token> toks, const RowCodec &codec, const std::unordered_set<std::string> &indexed,
+                   const bool rule, std::string db_type)
+                : m_toks(std::move(toks)), m_codec(codec), m_indexed(indexed), m_rule(rule),
+                  m_dbType(std::move(db_type)) {}
+
+            CompiledFilter run() {
+                m_out.where = parseOr(0);
+                if (peek().type != TokType::End)
+                    filterError(std::format("unexpected `{}`", peek().text), peek().pos);
+                m_out.tree = std::make_shared<const FilterNode>(std::move(m_nodes.back()));
+
+                // Equalities lead an index, a range can only follow them
+                for (const bool eq: {true, false}) {
+                    for (const auto &[field, is_eq]: m_seek)
+                        if (is_eq == eq && std::ranges::find(m_out.seekFields, field) == m_out.seekFields.end())
+                            m_out.seekFields.push_back(field);
+                    if (eq) m_out.seekEquals = m_out.seekFields.size();
+                }
+                return std::move(m_out);
+            }
+
+        private:
+            static constexpr int MAX_DEPTH = 32;
+
+            const Token &peek() const { return m_toks[m_pos]; }
+            const Token &next() { return m_toks[m_pos++]; }
+
+            const Token &expect(const TokType type, const std::string &what) {
+                if (peek().type != type) filterError(std::format("expected {}", what), peek().pos);
+                return next();
+            }
+
+            std::string parseOr(const int depth) {
+                const auto seek_mark = m_seek.size();
+                auto lhs = parseAnd(depth);
+                while (peek().type == TokType::Or) {
+                    next();
+                    lhs = std::format("({} OR {})", lhs, parseAnd(depth));
+                    fold(FilterNode::Kind::Or);
+                    // Either side may match, so neither narrows the scan
+                    m_seek.resize(seek_mark);
+                }
+                return lhs;
+            }
+
+            std::string parseAnd(const int depth) {
+                auto lhs = parseFactor(depth);
+                while (peek().type == TokType::And) {
+                    next();
+                    lhs = std::format("({} AND {})", lhs, parseFactor(depth));
+                    fold(FilterNode::Kind::And);
+                }
+                return lhs;
+            }
+
+            std::string parseFactor(const int depth) {
+                if (depth > MAX_DEPTH) filterError("expression nested too deeply", peek().pos);
+
+                if (peek().type == TokType::LParen) {
+                    next();
+                    auto inner = parseOr(depth + 1);
+                    expect(TokType::RParen, "`)`");
+                    return inner;
+                }
+
+                const auto &field_tok = expect(TokType::Ident, "a field name");
+                const auto dot = field_tok.text.find('.');
+                const auto *col = m_codec.column(field_tok.text.substr(0, dot));
+                if (!col) filterError(std::format("unknown field `{}`", field_tok.text.substr(0, dot)), field_tok.pos);
+                // Prefix matches would read its hash out a character at a time
+                if (col->secret)
+                    filterError(std::format("`{}` can't be filtered on", col->name), field_tok.pos);
+                // Its stored form is no good to compare, see FieldCompression
+                if (col->compress)
+                    filterError(std::format("`{}` is a compressed field, so it can't be filtered on", col->name),
+                                field_tok.pos);
+
+                // Past the dot: a path inside the field's JSON
+                std::string path;
+                if (dot != std::string::npos) {
+                    if (col->type != "json" && col->type != "list" && col->type != "geo_point")
+                        filterError(std::format("`{}` isn't a json field, so `{}` has no value", col->name,
+                                                field_tok.text), field_tok.pos);
+                    path = field_tok.text.substr(dot + 1);
+                }
+                const auto field = path.empty() ? col->name : col->name + "." + path;
+                const auto column = [&](const bool numeric) {
+                    return path.empty() ? sqlIdentifier(col->name)
+                                        : EntityFilter::jsonPathSql(m_dbType, col->name, path, numeric);
+                };
+                // PostgreSQL reads paths as text, and a variable may be bound to anything
+                m_castVariables = !path.empty() && m_dbType == "postgresql";
+
+                if (m_indexed.contains(field) &&
+                    std::ranges::find(m_out.indexedFields, field) == m_out.indexedFields.end())
+                    m_out.indexedFields.push_back(field);
+
+                // [NOT] IN (...)
+                if (peek().type == TokType::Not || peek().type == TokType::In) {
+                    const bool negate = peek().type == TokType::Not;
+                    if (negate) next();
+                    expect(TokType::In, "`IN`");
+                    if (!negate) m_seek.emplace_back(field, true);
+                    const auto first = m_out.params.size();
+                    const auto list = parseList();
+                    if (!path.empty()) {
+                        for (auto i = first + 1; i < m_out.params.size(); ++i)
+                            if (isNumeric(i) != isNumeric(first))
+                                filterError(std::format("values listed for `{}` must all be numbers or all strings",
+                                                        field), field_tok.pos);
+                    }
+                    auto in = std::format("{} {}IN ({})", column(isNumeric(first)), negate ? "NOT " : "", list);
+                    leaf(negate ? FilterNode::Kind::NotIn : FilterNode::Kind::In, field, first);
+                    return in;
+                }
+
+                const auto &op_tok = expect(TokType::Op, "a comparison operator");
+                const auto &op = op_tok.text;
+
+                if (peek().type == TokType::Null) {
+                    next();
+                    if (op == "=") {
+                        m_seek.emplace_back(field, true);
+                        leaf(FilterNode::Kind::IsNull, field, m_out.params.size());
+                        return column(false) + " IS NULL";
+                    }
+                    if (op == "!=") {
+                        leaf(FilterNode::Kind::NotNull, field, m_out.params.size());
+                        return column(false) + " IS NOT NULL";
+                    }
+                    filterError(std::format("operator `{}` cannot compare with null", op), op_tok.pos);
+                }
+
+                if (op == "~" || op == "!~") {
+                    const auto &val_tok = expect(TokType::String, "a string after `~`");
+                    auto pattern = val_tok.text;
+                    if (pattern.find('%') == std::string::npos) pattern = "%" + pattern + "%";
+                    const auto first = m_out.params.size();
+                    auto like = std::format("{} {}LIKE {}", column(false), op == "~" ? "" : "NOT ", bind(pattern));
+                    leaf(op == "~" ? FilterNode::Kind::Like : FilterNode::Kind::NotLike, field, first);
+                    return like;
+                }
+
+                if (op == "=" || op == "==" || op == "<" || op == "<=" || op == ">" || op == ">=")
+                    m_seek.emplace_back(field, op == "=" || op == "==");
+                if (op == "=" || op == "==" || op == "!=" || op == "<" || op == "<=" || op == ">" || op == ">=") {
+                    const auto sql_op = op == "==" ? "=" : op == "!=" ? "<>" : op;
+                    const auto first = m_out.params.size();
+                    const auto value = bindValue();
+                    auto compare = std::format("{} {} {}", column(isNumeric(first)), sql_op, value);
+                    leaf(FilterNode::Kind::Compare, field, first, sql_op);
+                    return compare;
+                }
+
+                filterError(std::format("unsupported operator `{}`", op), op_tok.pos);
+            }
+
+            std::string parseList() {
+                const auto open = peek().type;
+                if (open != TokType::LParen && open != TokType::LBrack)
+                    filterError("expected `(` or `[` after IN", peek().pos);
+                next();
+                const auto close = open == TokType::LParen ? TokType::RParen : TokType::RBrack;
+
+                std::string items;
+                while (true) {
+                    if (!items.empty()) items += ", ";
+                    items += bindValue();
+                    if (peek().type == TokType::Comma) {
+                        next();
+                        continue;
+                    }
+                    expect(close, close == TokType::RParen ? "`)`" : "`]`");
+                    break;
+                }
+                return items;
+            }
+
+            nlohmann::json parseValue() {
+                const auto &tok = next();
+                switch (tok.type) {
+                    case TokType::String: return tok.text;
+                    case TokType::True: return true;
+                    case TokType::False: return false;
+                    case TokType::Number: {
+                        try {
+                            if (tok.text.find_first_of(".eE") == std::string::npos)
+                                return std::stoll(tok.text);
+                            return std::stod(tok.text);
+                        } catch (const std::exception &) {
+                            filterError(std::format("invalid number `{}`", tok.text), tok.pos);
+                        }
+                    }
+                    default:
+                        filterError("expected a value", tok.pos);
+                }
+            }
+
+            /// A value, or in rule filters a variable whose value is bound later
+            std::string bindValue() {
+                if (peek().type != TokType::Var) return bind(parseValue());
+
+                const auto &tok = next();
+                if (!m_rule) filterError("variables such as `@auth.id` are only allowed in rule filters", tok.pos);
+                if (!tok.text.starts_with("auth.") || tok.text.size() == 5 || tok.text.ends_with('.') ||
+                    tok.text.find("..") != std::string::npos)
+                    filterError(std::format("unknown variable `@{}`, expected `@auth.<field>`", tok.text), tok.pos);
+                auto placeholder = bind(nullptr);
+                m_out.variables.emplace_back(placeholder.substr(1), tok.text);
+                return m_castVariables ? std::format("CAST({} AS TEXT)", placeholder) : placeholder;
+            }
+
+            /// Whether parameter `i` is compared as a number; variables are unbound, so compare as text
+            [[nodiscard]] bool isNumeric(const std::size_t i) const {
+                if (i >= m_out.params.size()) return false;
+                const auto &value = m_out.params[i].second;
+                return value.is_number() || value.is_boolean();
+            }
+
+            /// Push a leaf comparing `field` with the values bound since `first`
+            void leaf(const FilterNode::Kind kind, const std::string &field, const std::size_t first,
+                      std::string op = {}) {
+                FilterNode node{kind, field, std::move(op), {}, {}};
+                for (auto i = first; i < m_out.params.size(); ++i) node.params.push_back(i);
+                m_nodes.push_back(std::move(node));
+            }
+
+            /// Join the top two nodes under a `kind` node, extending the left one if it is one already
+            void fold(const FilterNode::Kind kind) {
+                auto rhs = std::move(m_nodes.back());
+                m_nodes.pop_back();
+                auto &lhs = m_nodes.back();
+                if (lhs.kind != kind) {
+                    FilterNode node{kind, {}, {}, {}, {}};
+                    node.children.push_back(std::move(lhs));
+                    lhs = std::move(node);
+                }
+                lhs.children.push_back(std::move(rhs));
+            }
+
+            std::string bind(nlohmann::json value) {
+                if (m_out.params.size() >= EntityFilter::MAX_FILTER_PARAMS)
+                    filterError("too many values", peek().pos);
+                auto name = std::format("{}{}", m_rule ? 'r' : 'f', m_out.params.size());
+                auto placeholder = ":" + name;
+                m_out.params.emplace_back(std::move(name), std::move(value));
+                return placeholder;
+            }
+
+            std::vector<Token> m_toks;
+            std::size_t m_pos = 0;
+            std::vector<std::pair<std::string, bool>> m_seek; ///< (field, compared for equality)
+            const RowCodec &m_codec;
+            const std::unordered_set<std::string> &m_indexed;
+            const bool m_rule; ///< Compiling a rule filter: `:r` placeholders, variables allowed
+            const std::string m_dbType;
+            bool m_castVariables = false; ///< The comparison being parsed wants its variables as text
+            std::vector<FilterNode> m_nodes; ///< Operands of the And/Or being parsed, innermost last
+            CompiledFilter m_out;
+        };
+    }
+
+    namespace {
+        /// Renumber a conjoined right-hand tree's values past the left one's
+        void shiftParams(FilterNode &node, const std::size_t by) {
+            for (auto &param: node.params) param += by;
+            for (auto &child: node.children) shiftParams(child, by);
+        }
+
+        /// -1, 0 or 1 as SQL would order `a` and `b`; std::nullopt if SQL would yield NULL or they don't compare
+        std::optional<int> compareValues(const nlohmann::json &a, const nlohmann::json &b) {
+            if (a.is_null() || b.is_null()) return std::nullopt;
+            const auto numeric = [](const nlohmann::json &v) { return v.is_number() || v.is_boolean(); };
+            if (numeric(a) && numeric(b)) {
+                if (a.is_number_integer() && b.is_number_integer()) {
+                    const auto x = a.get<std::int64_t>(), y = b.get<std::int64_t>();
+                    return x < y ? -1 : x > y ? 1 : 0;
+                }
+                const auto x = a.is_boolean() ? (a.get<bool>() ? 1.0 : 0.0) : a.get<double>();
+                const auto y = b.is_boolean() ? (b.get<bool>() ? 1.0 : 0.0) : b.get<double>();
+                return x < y ? -1 : x > y ? 1 : 0;
+            }
+            if (a.is_string() && b.is_string()) {
+                const auto c = a.get_ref<const std::string &>().compare(b.get_ref<const std::string &>());
+                return c < 0 ? -1 : c > 0 ? 1 : 0;
+            }
+            return std::nullopt;
+        }
+
+        /// SQLite's LIKE: `%` any run, `_` one character, ASCII case folded
+        bool like(const std::string_view text, const std::string_view pattern) {
+            std::size_t t = 0, p = 0, star = std::string_view::npos, mark = 0;
+            const auto fold = [](const char c) { return std::tolower(static_cast<unsigned char>(c)); };
+            while (t < text.size()) {
+                if (p < pattern.size() && (pattern[p] == '_' || fold(pattern[p]) == fold(text[t]))) {
+                    ++t;
+                    ++p;
+                } else if (p < pattern.size() && pattern[p] == '%') {
+                    star = p++;
+                    mark = t;
+                } else if (star != std::string_view::npos) {
+                    p = star + 1;
+                    t = ++mark;
+                } else {
+                    return false;
+                }
+            }
+            while (p < pattern.size() && pattern[p] == '%') ++p;
+            return p == pattern.size();
+        }
+
+        /// `row[field]`, or for `meta.country` the value at that path; null if it isn't there
+        const nlohmann::json &lookup(const nlohmann::json &row, const std::string &field) {
+            static const nlohmann::json null;
+            if (const auto it = row.find(field); it != row.end()) return *it;
+            if (field.find('.') == std::string::npos) return null;
+
+            const nlohmann::json *value = &row;
+            for (const auto &key: splitString(field, ".")) {
+                if (value->is_object()) {
+                    const auto it = value->find(key);
+                    if (it == value->end()) return null;
+                    value = &*it;
+                } else if (value->is_array() && !key.empty() &&
+                           std::ranges::all_of(key, [](const unsigned char c) { return std::isdigit(c); })) {
+                    const auto index = std::stoull(key);
+                    if (index >= value->size()) return null;
+                    value = &(*value)[index];
+                } else {
+                    return null;
+                }
+            }
+            return *value;
+        }
+
+        bool matchNode(const FilterNode &node, const CompiledFilter &filter, const nlohmann::json &row) {
+            using Kind = FilterNode::Kind;
+            if (node.kind == Kind::And)
+                return std::ranges::all_of(node.children, [&](const auto &c) { return matchNode(c, filter, row); });
+            if (node.kind == Kind::Or)
+                return std::ranges::any_of(node.children, [&](const auto &c) { return matchNode(c, filter, row); });
+
+            const auto &value = lookup(row, node.field);
+            const auto param = [&](const std::size_t i) -> const nlohmann::json & {
+                return filter.params[node.params[i]].second;
+            };
+
+            switch (node.kind) {
+                case Kind::IsNull: return value.is_null();
+                case Kind::NotNull: return !value.is_null();
+                case Kind::Like:
+                case Kind::NotLike: {
+                    if (!value.is_string() || !param(0).is_string()) return false;
+                    return like(value.get_ref<const std::string &>(), param(0).get_ref<const std::string &>()) ==
+                           (node.kind == Kind::Like);
+                }
+                case Kind::In:
+                case Kind::NotIn: {
+                    // NOT IN is NULL, so no match, once any value doesn't compare
+                    bool found = false;
+                    for (std::size_t i = 0; i < node.params.size(); ++i) {
+                        const auto c = compareValues(value, param(i));
+                        if (c && *c == 0) found = true;
+                        else if (!c && node.kind == Kind::NotIn) return false;
+                    }
+                    return found == (node.kind == Kind::In);
+                }
+                case Kind::Compare: {
+                    const auto c = compareValues(value, param(0));
+                    if (!c) return false;
+                    if (node.op == "=") return *c == 0;
+                    if (node.op == "<>") return *c != 0;
+                    if (node.op == "<") return *c < 0;
+                    if (node.op == "<=") return *c <= 0;
+                    if (node.op == ">") return *c > 0;
+                    return *c >= 0;
+                }
+                default: return false;
+            }
+        }
+    }
+
+    CompiledFilter EntityFilter::compile(const std::string &filter,
+                                         const RowCodec &codec,
+                                         const std::unordered_set<std::string> &indexed,
+                                         const std::string &db_type) {
+        if (filter.size() > MAX_FILTER_LENGTH)
+            throw MantisException(400, std::format("Invalid filter: longer than {} characters", MAX_FILTER_LENGTH));
+
+        if (trim(filter).empty())
+            throw MantisException(400, "Invalid filter: expression is empty");
+
+        return Parser(tokenize(filter), codec, indexed, false, db_type).run();
+    }
+
+    CompiledFilter EntityFilter::compileRule(const std::string &filter,
+                                             const RowCodec &codec,
+                                             const std::unordered_set<std::string> &indexed,
+                                             const std::string &db_type) {
+        if (filter.size() > MAX_FILTER_LENGTH)
+            throw MantisException(400, std::format("Invalid filter: longer than {} characters", MAX_FILTER_LENGTH));
+
+        if (trim(filter).empty())
+            throw MantisException(400, "Invalid filter: expression is empty");
+
+        return Parser(tokenize(filter), codec, indexed, true, db_type).run();
+    }
+
+    CompiledFilter EntityFilter::bindVariables(const CompiledFilter &filter, const nlohmann::json &vars) {
+        auto bound = filter;
+        for (const auto &[param, path]: filter.variables) {
+            const nlohmann::json *value = &vars;
+            for (const auto &key: splitString(path, ".")) {
+                if (!value->is_object() || !value->contains(key)) {
+                    value = nullptr;
+                    break;
+                }
+                value = &(*value)[key];
+            }
+
+            const auto it = std::ranges::find(bound.params, param, &std::pair<std::string, nlohmann::json>::first);
+            it->second = value && value->is_primitive() ? *value : nlohmann::json(nullptr);
+        }
+        bound.variables.clear();
+        return bound;
+    }
+
+    CompiledFilter EntityFilter::conjoin(const CompiledFilter &a, const CompiledFilter &b) {
+        CompiledFilter both;
+        both.where = std::format("({} AND {})", a.where, b.where);
+        both.params = a.params;
+        both.params.insert(both.params.end(), b.params.begin(), b.params.end());
+        both.variables = a.variables;
+        both.variables.insert(both.variables.end(), b.variables.begin(), b.variables.end());
+        if (a.tree && b.tree) {
+            FilterNode tree{FilterNode::Kind::And, {}, {}, {}, {*a.tree, *b.tree}};
+            shiftParams(tree.children[1], a.params.size());
+            both.tree = std::make_shared<const FilterNode>(std::move(tree));
+        }
+
+        for (const auto *f: {&a, &b})
+            for (const auto &field: f->indexedFields)
+                if (std::ranges::find(both.indexedFields, field) == both.indexedFields.end())
+                    both.indexedFields.push_back(field);
+
+        // Both sides narrow the scan: equalities of either lead, then ranges
+        const auto add = [&both](const CompiledFilter &f, const std::size_t from, const std::size_t to) {
+            for (auto i = from; i < to; ++i)
+                if (std::ranges::find(both.seekFields, f.seekFields[i]) == both.seekFields.end())
+                    both.seekFields.push_back(f.seekFields[i]);
+        };
+        add(a, 0, a.seekEquals);
+        add(b, 0, b.seekEquals);
+        both.seekEquals = both.seekFields.size();
+        add(a, a.seekEquals, a.seekFields.size());
+        add(b, b.seekEquals, b.seekFields.size());
+        return both;
+    }
+
+    bool EntityFilter::matches(const CompiledFilter &filter, const nlohmann::json &row) {
+        return filter.tree && matchNode(*filter.tree, filter, row);
+    }
+
+    std::string EntityFilter::jsonPathSql(const std::string &db_type, const std::string &field,
+                                          const std::string &path, const bool numeric) {
+        const auto keys = splitString(path, ".");
+        std::string json_path = "$", pg_path;
+        for (const auto &key: keys) {
+            if (key.empty() || key.size() > 64 ||
+                !std::ranges::all_of(key, [](const unsigned char c) { return std::isalnum(c) || c == '_'; }))
+                throw MantisException(400, std::format("Invalid JSON path `{}.{}`: keys are letters, digits and `_`",
+                                                       field, path));
+            const bool index = std::ranges::all_of(key, [](const unsigned char c) { return std::isdigit(c); });
+            json_path += index ? std::format("[{}]", key) : "." + key;
+            pg_path += (pg_path.empty() ? "" : ",") + key;
+        }
+        if (keys.empty())
+            throw MantisException(400, std::format("Invalid JSON path `{}.`", field));
+
+        const auto column = sqlIdentifier(field);
+        if (db_type == "postgresql") {
+            const auto text = std::format("(CAST({} AS jsonb) #>> '{{{}}}')", column, pg_path);
+            if (!numeric) return text;
+            // Text that isn't a number shouldn't fail the query, so only numbers and booleans are read as one
+            return std::format("(CASE jsonb_typeof(CAST({0} AS jsonb) #> '{{{1}}}') "
+                               "WHEN 'number' THEN CAST({2} AS double precision) "
+                               "WHEN 'boolean' THEN CASE {2} WHEN 'true' THEN 1 ELSE 0 END END)",
+                               column, pg_path, text);
+        }
+        if (db_type == "mysql") {
+            if (numeric) return std::format("JSON_EXTRACT({}, '{}')", column, json_path);
+            // A functional index can't be on TEXT, so the path is read as a bounded string
+            return std::format("CAST(JSON_UNQUOTE(JSON_EXTRACT({}, '{}')) AS CHAR(255))", column, json_path);
+        }
+        return std::format("json_extract({}, '{}')", column, json_path);
+    }
+
+    std::string EntityFilter::indexColumnSql(const std::string &db_type, const std::string &column) {
+        const auto dot = column.find('.');
+        if (dot == std::string::npos) return sqlIdentifier(column);
+        return "(" + jsonPathSql(db_type, column.substr(0, dot), column.substr(dot + 1)) + ")";
+    }
+
+    EntityFilterCache::EntityFilterCache(std::unordered_set<std::string> indexed, const std::size_t capacity,
+                                         std::string db_type)
+        : m_indexed(std::move(indexed)), m_capacity(capacity == 0 ? 1 : capacity), m_dbType(std::move(db_type)) {}
+
+    std::shared_ptr<const CompiledFilter> EntityFilterCache::get(const std::string &filter, const RowCodec &codec) {
+        {
+            std::lock_guard lock(m_mutex);
+            if (const auto it = m_entries.find(filter); it != m_entries.end()) {
+                m_lru.splice(m_lru.begin(), m_lru, it->second.lruPos);
+                return it->second.compiled;
+            }
+        }
+
+        // Compile outside the lock; a concurrent miss on the same string just
+        // compiles twice and the first insert wins.
+        auto compiled = std::make_shared<const CompiledFilter>(EntityFilter::compile(filter, codec, m_indexed, m_dbType));
+
+        std::lock_guard lock(m_mutex);
+        if (const auto it = m_entries.find(filter); it != m_entries.end())
+            return it->second.compiled;
+
+        if (m_entries.size() >= m_capacity) {
+            m_entries.erase(m_lru.back());
+            m_lru.pop_back();
+        }
+
+        m_lru.push_front(filter);
+        m_entries.emplace(filter, Slot{compiled, m_lru.begin()});
+        return compiled;
+    }
+
+    std::vector<std::string> EntityFilterCache::filters() const {
+        std::lock_guard lock(m_mutex);
+        return {m_lru.begin(), m_lru.end()};
+    }
+}
@@ -0,0 +1,296 @@
+/**
+ * @file entity_geo.cpp
+ * @brief Implementation for @see entity_geo.h
+ */
+
+#include "../../../include/mantisbase/core/models/entity_geo.h"
+#include "../../../include/mantisbase/core/models/entity_schema.h"
+#include "../../../include/mantisbase/core/exceptions.h"
+#include "../../../include/mantisbase/utils/utils.h"
+
+#include <soci/soci.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <format>
+#include <map>
+#include <numbers>
+#include <set>
+
+namespace mb {
+    namespace {
+        std::vector<std::string> geoFields(const EntitySchema &schema) {
+            std::vector<std::string> fields;
+            for (const auto &field: schema.fields())
+                if (field.type() == "geo_point") fields.push_back(sqlIdentifier(field.name()));
+            return fields;
+        }
+
+        /// `key` (`lat` or `lng`) of the point in column `field`, as a double
+        std::string coordinate(const std::string &db_type, const std::string &field, const char *key) {
+            if (db_type == "sqlite3") return std::format("json_extract({}, '$.{}')", field, key);
+            if (db_type == "postgresql")
+                return std::format("CAST(CAST({} AS jsonb) ->> '{}' AS double precision)", field, key);
+            return std::format("CAST(JSON_EXTRACT({}, '$.{}') AS DOUBLE)", field, key);
+        }
+
+        /// What PostgreSQL's GiST index covers, and bounding boxes are matched against
+        std::string pgPoint(const std::string &field) {
+            return std::format("point({}, {})", coordinate("postgresql", field, "lng"),
+                               coordinate("postgresql", field, "lat"));
+        }
+
+        /// Adds the point in `field` of `row` (`NEW.`, or empty with `from`) to the R*Tree, if it has one
+        std::string sqliteAdd(const std::string &geo, const std::string &row, const std::string &field,
+                              const std::size_t slot, const std::string &from = "") {
+            const auto value = row + field;
+            const auto lat = coordinate("sqlite3", value, "lat"), lng = coordinate("sqlite3", value, "lng");
+            return std::format("INSERT INTO {0} SELECT {1}rowid * {2} + {3}, {3}, {3}, {4}, {4}, {5}, {5}{6} "
+                               "WHERE json_valid({7}) AND json_type({7}, '$.lat') IN ('integer', 'real') "
+                               "AND json_type({7}, '$.lng') IN ('integer', 'real'); ",
+                               geo, row, EntityGeo::MAX_FIELDS, slot, lat, lng, from, value);
+        }
+
+        /// The R*Tree and the triggers keeping it current, keyed by name. No
+        /// trailing `;`, so each reads back from sqlite_master as written.
+        std::map<std::string, std::string> sqliteObjects(const std::string &entity,
+                                                         const std::vector<std::string> &fields) {
+            const auto geo = std::format("mb_{}_geo", entity);
+            std::string add, remove, columns;
+            for (std::size_t slot = 0; slot < fields.size(); ++slot) {
+                add += sqliteAdd(geo, "NEW.", fields[slot], slot);
+                remove += std::format("DELETE FROM {} WHERE id = OLD.rowid * {} + {}; ", geo, EntityGeo::MAX_FIELDS,
+                                      slot);
+                columns += (columns.empty() ? "" : ", ") + fields[slot];
+            }
+            return {
+                {
+                    // A point is a box of no size; the slot dimension tells fields apart
+                    geo, std::format("CREATE VIRTUAL TABLE {} USING rtree(id, min_slot, max_slot, min_lat, max_lat, "
+                                     "min_lng, max_lng)", geo)
+                },
+                {geo + "_insert", std::format("CREATE TRIGGER {0}_insert AFTER INSERT ON {1} BEGIN {2}END", geo, entity, add)},
+                {
+                    geo + "_delete", std::format("CREATE TRIGGER {0}_delete AFTER DELETE ON {1} BEGIN {2}END", geo, entity,
+                                                 remove)
+                },
+                {
+                    // Updates leaving the points alone don't touch the index
+                    geo + "_update", std::format("CREATE TRIGGER {0}_update AFTER UPDATE OF {1} ON {2} BEGIN {3}{4}END",
+                                                 geo, columns, entity, remove, add)
+                }
+            };
+        }
+
+        void checkRange(const double lat, const double lng, const std::string &what) {
+            if (!std::isfinite(lat) || lat < -90 || lat > 90)
+                throw MantisException(400, std::format("{}: latitude must be within [-90, 90].", what));
+            if (!std::isfinite(lng) || lng < -180 || lng > 180)
+                throw MantisException(400, std::format("{}: longitude must be within [-180, 180].", what));
+        }
+    }
+
+    EntityGeo::Point EntityGeo::parse(const json &value, const std::string &field) {
+        if (!value.is_object() || !value.contains("lat") || !value.contains("lng") || !value["lat"].is_number() ||
+            !value["lng"].is_number())
+            throw MantisException(400, std::format("Field `{}` expects a point, `{{\"lat\": .., \"lng\": ..}}`.", field));
+        const Point point{value["lat"].get<double>(), value["lng"].get<double>()};
+        checkRange(point.lat, point.lng, std::format("Field `{}`", field));
+        return point;
+    }
+
+    std::string EntityGeo::encode(const Point &point) {
+        return json{{"lat", point.lat}, {"lng", point.lng}}.dump();
+    }
+
+    std::vector<double> EntityGeo::parseNumbers(const std::string_view text, const std::size_t count,
+                                                const std::string &param) {
+        std::vector<double> numbers;
+        std::size_t from = 0;
+        while (from <= text.size()) {
+            const auto comma = std::min(text.find(',', from), text.size());
+            auto part = text.substr(from, comma - from);
+            while (!part.empty() && part.front() == ' ') part.remove_prefix(1);
+            while (!part.empty() && part.back() == ' ') part.remove_suffix(1);
+
+            double value = 0;
+            const auto [end, ec] = std::from_chars(part.data(), part.data() + part.size(), value);
+            if (part.empty() || ec != std::errc{} || end != part.data() + part.size() || !std::isfinite(value))
+                break;
+            numbers.push_back(value);
+            from = comma + 1;
+        }
+        if (numbers.size() != count || from <= text.size())
+            throw MantisException(400, std::format("`{}` must be {} comma-separated numbers.", param, count));
+        return numbers;
+    }
+
+    EntityGeo::Box EntityGeo::parseBox(const json &box) {
+        if (!box.is_array() || box.size() != 4 || !std::ranges::all_of(box, [](const json &v) { return v.is_number(); }))
+            throw MantisException(400, "`bbox` must be `west,south,east,north`.");
+        const Box b{box[0].get<double>(), box[1].get<double>(), box[2].get<double>(), box[3].get<double>()};
+        checkRange(b.south, b.west, "`bbox`");
+        checkRange(b.north, b.east, "`bbox`");
+        if (b.south > b.north) throw MantisException(400, "`bbox`: south is above north.");
+        if (b.west > b.east) throw MantisException(400, "`bbox`: boxes across the antimeridian aren't supported.");
+        return b;
+    }
+
+    void EntityGeo::sync(const EntitySchema &schema, soci::session &sql) {
+        const auto entity = sqlIdentifier(schema.name());
+        const auto fields = schema.type() == "view" ? std::vector<std::string>{} : geoFields(schema);
+
+        if (const auto db_type = sql.get_backend_name(); db_type == "sqlite3") {
+            if (fields.empty()) {
+                drop(entity, sql);
+                return;
+            }
+
+            // Triggers go with the table, so a rebuilt table (online migration,
+            // rename) shows up as missing or rewritten triggers
+            const auto objects = sqliteObjects(entity, fields);
+            const auto geo = std::format("mb_{}_geo", entity);
+            const auto ins = geo + "_insert", del = geo + "_delete", upd = geo + "_update";
+            std::map<std::string, std::string> existing;
+            const soci::rowset<soci::row> rows = (sql.prepare
+                << "SELECT name, sql FROM sqlite_master WHERE name IN (:t, :i, :d, :u)",
+                soci::use(geo, "t"), soci::use(ins, "i"), soci::use(del, "d"), soci::use(upd, "u"));
+            for (const auto &row: rows) existing.emplace(row.get<std::string>(0), row.get<std::string>(1));
+            if (existing == objects) return;
+
+            drop(entity, sql);
+            for (const auto &[name, ddl]: objects) sql << ddl;
+            // Index the rows already there
+            for (std::size_t slot = 0; slot < fields.size(); ++slot)
+                sql << sqliteAdd(geo, "", fields[slot], slot, " FROM " + entity);
+        }
+#if MB_HAS_POSTGRESQL
+        else if (db_type == "postgresql") {
+            // The geo indexes are the ones commented `mb_geo`, whatever the table was called
+            std::set<std::string> want, have;
+            for (const auto &field: fields) want.insert(std::format("mb_{}_geo_{}", entity, field));
+            const soci::rowset<std::string> rows = (sql.prepare
+                << "SELECT c.relname FROM pg_index i JOIN pg_class c ON c.oid = i.indexrelid "
+                   "WHERE i.indrelid = to_regclass(:t) AND obj_description(c.oid, 'pg_class') = 'mb_geo'",
+                soci::use(entity, "t"));
+            for (const auto &name: rows) have.insert(name);
+
+            for (const auto &name: have)
+                if (!want.contains(name)) sql << std::format("DROP INDEX IF EXISTS {}", name);
+            for (const auto &field: fields) {
+                const auto index = std::format("mb_{}_geo_{}", entity, field);
+                if (have.contains(index)) continue;
+                sql << std::format("CREATE INDEX {} ON {} USING GIST (({}))", index, entity, pgPoint(field));
+                sql << std::format("COMMENT ON INDEX {} IS 'mb_geo'", index);
+            }
+        }
+#endif
+    }
+
+    void EntityGeo::drop(const std::string &entity, soci::session &sql) {
+        const auto name = sqlIdentifier(entity);
+        if (sql.get_backend_name() == "sqlite3") {
+            for (const auto *suffix: {"insert", "delete", "update"})
+                sql << std::format("DROP TRIGGER IF EXISTS mb_{}_geo_{}", name, suffix);
+            sql << std::format("DROP TABLE IF EXISTS mb_{}_geo", name);
+        }
+    }
+
+    EntityGeo::Query EntityGeo::query(const std::string &db_type, const std::string &entity, const std::string &field,
+                                      const std::size_t slot, const Area &area) {
+        if (!area.near && !area.box) throw MantisException(400, "A geo query needs `near` or `bbox`.");
+        if (area.radiusKm && !area.near) throw MantisException(400, "`radius` is measured from a `near` point.");
+        if (area.radiusKm && !(*area.radiusKm > 0)) throw MantisException(400, "`radius` must be above 0 km.");
+
+        const auto table = sqlIdentifier(entity);
+        const auto column = sqlIdentifier(field);
+        const auto lat = coordinate(db_type, column, "lat"), lng = coordinate(db_type, column, "lng");
+
+        // The radius as a box, intersected with `box`
+        std::optional<Box> box = area.box;
+        double k2 = 1, r2 = 0;
+        if (area.near) {
+            const auto k = std::cos(area.near->lat * std::numbers::pi / 180);
+            k2 = k * k;
+        }
+        if (area.radiusKm) {
+            const auto r = *area.radiusKm / KM_PER_DEGREE;
+            r2 = r * r;
+            const auto dlng = k2 > 1e-12 ? r / std::sqrt(k2) : 360;
+            Box around{area.near->lng - dlng, area.near->lat - r, area.near->lng + dlng, area.near->lat + r};
+            // Over a pole, or across the antimeridian: every longitude
+            if (around.south < -90 || around.north > 90 || around.west < -180 || around.east > 180) {
+                around.west = -180;
+                around.east = 180;
+            }
+            around.south = std::max(around.south, -90.0);
+            around.north = std::min(around.north, 90.0);
+            if (box) {
+                box->west = std::max(box->west, around.west);
+                box->south = std::max(box->south, around.south);
+                box->east = std::min(box->east, around.east);
+                box->north = std::min(box->north, around.north);
+            } else {
+                box = around;
+            }
+        }
+
+        Query q;
+        // The constants `where` and `distance` repeat, bound once in a one-row
+        // subquery, as not every backend binds a repeated name
+        const auto param = [&](const std::string &name, const double value) {
+            q.params.emplace_back("geo_" + name, value);
+            if (db_type == "postgresql") return std::format("CAST(:geo_{} AS double precision) AS mb_{}", name, name);
+            if (db_type == "mysql") return std::format("CAST(:geo_{} AS DOUBLE) AS mb_{}", name, name);
+            return std::format(":geo_{} AS mb_{}", name, name);
+        };
+        std::vector<std::string> consts, where;
+        // json_extract() fails the statement on text that isn't JSON
+        if (db_type == "sqlite3") where.push_back(std::format("json_valid({})", column));
+
+        if (box && db_type == "sqlite3") {
+            q.join = std::format(" JOIN (SELECT id / {0} AS mb_geo_doc FROM mb_{1}_geo WHERE min_slot <= {2} "
+                                 "AND max_slot >= {2} AND max_lat >= :geo_south AND min_lat <= :geo_north "
+                                 "AND max_lng >= :geo_west AND min_lng <= :geo_east) mb_geo "
+                                 "ON mb_geo.mb_geo_doc = {1}.rowid", MAX_FIELDS, table, slot);
+            q.params.emplace_back("geo_south", box->south);
+            q.params.emplace_back("geo_north", box->north);
+            q.params.emplace_back("geo_west", box->west);
+            q.params.emplace_back("geo_east", box->east);
+        }
+        if (box) {
+            consts.push_back(param("s", box->south));
+            consts.push_back(param("n", box->north));
+            consts.push_back(param("w", box->west));
+            consts.push_back(param("e", box->east));
+            // R*Tree bounds are rounded outward to 32-bit floats, so the exact test follows it
+            where.push_back(db_type == "postgresql"
+                                ? std::format("{} <@ box(point(mb_geo_at.mb_w, mb_geo_at.mb_s), "
+                                              "point(mb_geo_at.mb_e, mb_geo_at.mb_n))", pgPoint(column))
+                                : std::format("{0} BETWEEN mb_geo_at.mb_s AND mb_geo_at.mb_n "
+                                              "AND {1} BETWEEN mb_geo_at.mb_w AND mb_geo_at.mb_e", lat, lng));
+        } else {
+            where.push_back(std::format("{} IS NOT NULL AND {} IS NOT NULL", lat, lng));
+        }
+
+        if (area.near) {
+            consts.push_back(param("lat", area.near->lat));
+            consts.push_back(param("lng", area.near->lng));
+            consts.push_back(param("k2", k2));
+            // Squared degrees of latitude, longitude scaled to them at `near`
+            q.distance = std::format("(({0} - mb_geo_at.mb_lat) * ({0} - mb_geo_at.mb_lat) + "
+                                     "({1} - mb_geo_at.mb_lng) * ({1} - mb_geo_at.mb_lng) * mb_geo_at.mb_k2)", lat, lng);
+        }
+        if (area.radiusKm) {
+            consts.push_back(param("r2", r2));
+            where.push_back(std::format("{} <= mb_geo_at.mb_r2", q.distance));
+        }
+
+        std::string select;
+        for (const auto &c: consts) select += (select.empty() ? "" : ", ") + c;
+        q.join += std::format(", (SELECT {}) mb_geo_at", select);
+        for (const auto &w: where) q.where += (q.where.empty() ? "" : " AND ") + w;
+        return q;
+    }
+}
@@ -0,0 +1,227 @@
+/**
+ * @file entity_query.cpp
+ * @brief Implementation for @see entity_query.h
+ */
+
+#include "../../../include/mantisbase/core/models/entity_query.h"
+#include "../../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <format>
+
+namespace mb {
+    namespace entity_query {
+        std::int64_t readInt(const soci::row &row, const std::size_t i, const int precision) {
+            switch (precision) {
+                case 8: return row.get<int8_t>(i);
+                case 16: return row.get<int16_t>(i);
+                case 64: return row.get<int64_t>(i);
+                default: return row.get<int32_t>(i);
+            }
+        }
+
+        std::int64_t readLength(const soci::row &row, const std::size_t i) {
+            switch (row.get_properties(i).get_db_type()) {
+                case soci::db_int32: return row.get<int32_t>(i);
+                case soci::db_int64: return row.get<int64_t>(i);
+                case soci::db_uint64: return static_cast<std::int64_t>(row.get<uint64_t>(i));
+                default: return 0;
+            }
+        }
+
+        std::string readText(const soci::row &row, const std::size_t i, const RowCodec::Column &col) {
+            switch (col.kind) {
+                case RowCodec::Kind::Date: return dbDateToString(row, static_cast<int>(i));
+                case RowCodec::Kind::Vector: return row.get<std::string>(i, "");
+                default: return col.decode ? col.decode(row, i).dump() : std::string{};
+            }
+        }
+    }
+
+    namespace {
+        bool isAdmin(const json &auth) {
+            return auth.is_object() && auth.value("entity", json()) == "mb_admins" && auth.contains("user") &&
+                   auth["user"].is_object();
+        }
+
+        /// What setRuleAuth() binds a rule's row filter to
+        json ruleAuth(const json &auth) {
+            return {{"id", auth.value("id", json())}, {"entity", auth.value("entity", json())},
+                    {"user", auth.value("user", json())}};
+        }
+    }
+
+    EntityQuery Entity::query() const {
+        rejectSharded("Queries");
+        return EntityQuery(*this);
+    }
+
+    EntityQuery::EntityQuery(Entity entity) : m_entity(std::move(entity)) {}
+
+    EntityQuery &EntityQuery::where(const std::string &filter) {
+        if (!trim(filter).empty()) m_filters.push_back(filter);
+        return *this;
+    }
+
+    EntityQuery &EntityQuery::sort(const std::string &field) {
+        m_sort = field;
+        return *this;
+    }
+
+    EntityQuery &EntityQuery::limit(const int limit) {
+        m_limit = std::clamp(limit, 1, MAX_LIST_PAGE_SIZE);
+        return *this;
+    }
+
+    EntityQuery &EntityQuery::after(const std::string &cursor) {
+        m_after = cursor;
+        return *this;
+    }
+
+    EntityQuery &EntityQuery::search(const std::string &words) {
+        m_search = words;
+        return *this;
+    }
+
+    EntityQuery &EntityQuery::as(const json &auth) {
+        m_auth = auth.is_object() ? auth : json::object();
+        return *this;
+    }
+
+    void EntityQuery::checkFields(const std::span<const std::string_view> names,
+                                  const std::span<const Holds> holds) const {
+        const auto &codec = m_entity.rowCodec();
+        for (std::size_t i = 0; i < names.size(); ++i) {
+            const std::string name(names[i]);
+            const auto *col = codec.column(name);
+            if (!col) throw MantisException(400, std::format("`{}` has no field `{}`", m_entity.name(), name));
+            // list() never returns it either
+            if (name == "password" && m_entity.type() == "auth")
+                throw MantisException(400, std::format("`{}.password` is never read", m_entity.name()));
+            if (!holds[i](col->kind))
+                throw MantisException(500, std::format("`{}.{}` is a `{}` field, which its mapped member can't hold",
+                                                       m_entity.name(), name, col->type));
+        }
+    }
+
+    json EntityQuery::options(const std::span<const std::string_view> names) const {
+        // `id` too, for the next page's cursor
+        std::string fields = "id";
+        for (const auto &name: names)
+            if (name != "id") fields += std::format(",{}", name);
+
+        json pagination = {{"limit", m_limit}};
+        if (!m_sort.empty()) pagination["sort"] = m_sort;
+        if (!m_after.empty()) pagination["after"] = m_after;
+
+        json opts = {{"fields", fields}, {"pagination", pagination}};
+        if (!m_search.empty()) opts["search"] = m_search;
+        if (m_filters.size() == 1) {
+            opts["filter"] = m_filters.front();
+        } else if (!m_filters.empty()) {
+            std::string filter;
+            for (const auto &f: m_filters) filter += std::format("{}({})", filter.empty() ? "" : " && ", f);
+            opts["filter"] = filter;
+        }
+
+        if (m_auth) {
+            const auto &rule = m_entity.listRule();
+            checkRule(rule);
+            if (!rule.filter().empty() && !isAdmin(*m_auth)) opts["auth"] = ruleAuth(*m_auth);
+        }
+        return opts;
+    }
+
+    EntityQuery::RowPlan EntityQuery::planRow(const soci::row &row, const std::span<const std::string_view> names,
+                                              const std::span<std::size_t> at,
+                                              const std::span<const RowCodec::Column *> columns) const {
+        const auto &codec = m_entity.rowCodec();
+        const std::string_view sort_field = m_sort.starts_with('-') ? std::string_view(m_sort).substr(1) : m_sort;
+
+        std::ranges::fill(at, std::string::npos);
+        std::ranges::fill(columns, nullptr);
+        RowPlan plan;
+        for (std::size_t i = 0; i < row.size(); ++i) {
+            const auto &name = row.get_properties(i).get_name();
+            if (name == "id") plan.idAt = i;
+            if (!sort_field.empty() && name == sort_field) {
+                plan.sortAt = i;
+                plan.sortColumn = codec.column(name);
+            }
+            for (std::size_t f = 0; f < names.size(); ++f) {
+                if (names[f] != name) continue;
+                at[f] = i;
+                columns[f] = codec.column(name);
+            }
+        }
+        return plan;
+    }
+
+    void EntityQuery::track(const soci::row &row, RowPlan &plan) {
+        if (plan.idAt != std::string::npos && row.get_indicator(plan.idAt) != soci::i_null)
+            plan.id = row.get<std::string>(plan.idAt);
+        if (plan.sortColumn && plan.sortColumn->decode)
+            plan.value = row.get_indicator(plan.sortAt) == soci::i_null
+                             ? json()
+                             : plan.sortColumn->decode(row, plan.sortAt);
+    }
+
+    std::string EntityQuery::nextCursor(ListCursor sort, const RowPlan &plan) {
+        if (plan.id.empty() || sort.field == ListCursor::NEAR) return {};
+        // A ranked page's cursor comes filled in
+        if (sort.ranked()) return sort.id.empty() ? std::string{} : sort.encode();
+
+        sort.id = plan.id;
+        if (sort.field == "id") sort.value = plan.id;
+        else if (plan.sortColumn && plan.sortColumn->name == sort.field) sort.value = plan.value;
+        return sort.encode();
+    }
+
+    std::optional<json> EntityQuery::readRecord(const std::string &id) const {
+        json opts = json::object();
+        if (m_auth) {
+            const auto &rule = m_entity.getRule();
+            checkRule(rule);
+            if (!rule.filter().empty() && !isAdmin(*m_auth)) opts["auth"] = ruleAuth(*m_auth);
+        }
+        return m_entity.read(id, opts);
+    }
+
+    json EntityQuery::createRecord(const json &record) const {
+        auto data = record;
+        // Generated by the database; an unset `id` gets one too
+        data.erase("created");
+        data.erase("updated");
+        if (data.contains("id") && (data["id"].is_null() || data["id"] == "")) data.erase("id");
+        checkRule(m_entity.addRule(), data);
+        return m_entity.create(data);
+    }
+
+    json EntityQuery::updateRecord(const std::string &id, json record) const {
+        record.erase("id");
+        record.erase("created");
+        record.erase("updated");
+        checkRule(m_entity.updateRule(), record);
+        return m_entity.update(id, record);
+    }
+
+    void EntityQuery::checkRule(const AccessRule &rule, const json &body) const {
+        // The checks ruleDenial() makes of a request, for a caller named by as()
+        if (!m_auth || rule.mode() == "public") return;
+        const auto &auth = *m_auth;
+        const bool has_user = auth.contains("user") && auth["user"].is_object();
+        if (isAdmin(auth)) return;
+
+        if (rule.mode().empty()) throw MantisException(403, "Admin auth required to access this resource!");
+        if (rule.mode() == "auth") {
+            if (has_user) return;
+            throw MantisException(403, "Auth required to access this resource!");
+        }
+        if (rule.mode() == "custom") {
+            const json vars = {{"auth", auth}, {"req", {{"body", body}}}};
+            if (rule.evaluate(vars)) return;
+            throw MantisException(403, "Access denied!");
+        }
+        throw MantisException(403, "Access denied, entity access rule unknown.");
+    }
+}
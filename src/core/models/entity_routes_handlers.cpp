@@ -1,25 +1,151 @@
 #include "../../include/mantisbase/core/models/entity_routes.h"
 #include "../../include/mantisbase/core/models/entity.h"
+#include "../../include/mantisbase/core/models/entity_schema.h"
 #include "../../include/mantisbase/core/auth.h"
+#include "../../include/mantisbase/core/file_serving.h"
 #include "../../include/mantisbase/core/middlewares.h"
+#include "../../include/mantisbase/core/router.h"
+#include "../../include/mantisbase/core/tenants.h"
 #include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/utils/json_parse.h"
+
+#include <fstream>
+#include <sstream>
 
 namespace mb {
     namespace {
-        void handleGetOne(const MantisRequest &req, const MantisResponse &res, const std::string &entity_name) {
+#ifdef MB_SCRIPTING_ENABLED
+        /**
+         * Run the scripts' `before...` hook `name`; a rejected write is answered with 400 and the hook's reason,
+         * one the hook's time budget cut short with 503
+         */
+        template<typename Hook>
+        void checkBeforeHook(const char *name, Hook hook) {
+            auto &app = MantisBase::instance();
+            const auto ctx = app.ctx();
+            if (!ctx || !ScriptingHooks::defines(ctx, name)) return;
+
+            const auto start = std::chrono::steady_clock::now();
+            const ScriptHeaps::Budget budget(ctx, app.scriptBudgets().of(name));
+            const auto veto = hook(ctx);
+            app.router().metrics().recordScript(name, std::chrono::steady_clock::now() - start);
+            if (budget.exceeded()) {
+                app.router().metrics().recordScriptTimeout(name);
+                throw MantisException(503, fmt::format("Script hook `{}` ran past its time budget", name));
+            }
+            if (veto) throw MantisException(400, *veto);
+        }
+#endif
+
+        /// Relations named by `?expand=`.
+        std::vector<std::string> expandParam(const MantisRequest &req) {
+            std::vector<std::string> relations;
+            if (!req.hasQueryParam("expand")) return relations;
+            for (const auto &part: splitString(req.getQueryParamValue("expand"), ",")) {
+                if (const auto relation = trim(part); !relation.empty()) relations.push_back(relation);
+            }
+            return relations;
+        }
+
+        /// `?fields=` plus the relation columns `?expand=` reads.
+        void setFieldsParam(const MantisRequest &req, json &opts, const std::vector<std::string> &relations) {
+            if (!req.hasQueryParam("fields")) return;
+            auto fields = req.getQueryParamValue("fields");
+            for (const auto &relation: relations) fields += "," + relation;
+            opts["fields"] = fields;
+        }
+
+        /// Expand `records` with the referenced records the caller may list.
+        void expandRecords(MantisRequest &req, const Entity &entity, Records &records,
+                           const std::vector<std::string> &relations) {
+            entity.expand(records, relations, [&req](const Entity &ref) -> std::optional<json> {
+                if (!hasRuleAccess(req, ref.listRule())) return std::nullopt;
+                json opts = json::object();
+                setRuleAuth(req, ref.listRule(), opts);
+                return opts;
+            });
+        }
+
+        /// Whether the responses of a route under `rule` may be cached for `entity_name`
+        bool cacheable(const MantisRequest &req, const std::string &entity_name, const AccessRule &rule,
+                       const std::vector<std::string> &relations) {
+            // Expanded records follow other entities' rules and changes; the
+            // cache is keyed by entity name alone, so tenants go without
+            return relations.empty() && rule.mode() == "public" && rule.filter().empty() && !Tenants::current() &&
+                   req.mApp().router().responseCache().enabledFor(entity_name);
+        }
+
+        /// Send `body` under `etag`, or a 304 if the client already holds it.
+        void sendTagged(const MantisRequest &req, const MantisResponse &res, std::string body, const std::string &etag) {
+            res.setHeader("ETag", etag);
+            res.setHeader("Cache-Control", "no-cache");
+            if (FileServing::ifNoneMatch(req.getHeaderValue("If-None-Match"), etag)) {
+                res.sendEmpty(304);
+                return;
+            }
+            res.sendRawJSON(200, std::move(body));
+        }
+
+        /// `{"if_match": ...}` from the `If-Match` header, for Entity::update() and Entity::remove().
+        json ifMatchOpts(const MantisRequest &req) {
+            json opts = json::object();
+            if (const auto header = trim(req.getHeaderValue("If-Match")); !header.empty()) opts["if_match"] = header;
+            return opts;
+        }
+
+        /// Answer from the response cache; false on a miss.
+        bool sendCached(const MantisRequest &req, const MantisResponse &res, const std::string &entity_name,
+                        const std::string &key) {
+            const auto hit = req.mApp().router().responseCache().get(entity_name, key);
+            if (!hit) return false;
+            sendTagged(req, res, *hit->body, hit->etag);
+            return true;
+        }
+
+        void handleGetOne(MantisRequest &req, const MantisResponse &res, const std::string &entity_name) {
             try {
-                const auto entity = req.mApp().entity(entity_name);
+                const auto entity_ptr = requestEntity(req, entity_name);
+                const auto &entity = *entity_ptr;
 
                 const auto entity_id = trim(req.getPathParamValue("id"));
                 if (entity_id.empty())
                     throw MantisException(400, "Entity `id` is required!");
 
-                if (const auto record = entity.read(entity_id); record.has_value()) {
-                    res.sendJSON(200, {
+                const auto relations = expandParam(req);
+                json opts = json::object();
+                setFieldsParam(req, opts, relations);
+                setRuleAuth(req, entity.getRule(), opts);
+                // `include_archived=true` falls back to the rows archived out of the table, see EntityArchive
+                if (req.hasQueryParam("include_archived"))
+                    opts["include_archived"] = req.getQueryParamValue("include_archived") == "true";
+
+                auto &cache = req.mApp().router().responseCache();
+                const bool cached = cacheable(req, entity_name, entity.getRule(), relations);
+                const auto key = cached ? std::format("get:{}:{}", entity_id, opts.dump()) : std::string{};
+                if (cached && sendCached(req, res, entity_name, key)) return;
+                const auto generation = cached ? cache.generation(entity_name) : 0;
+
+                if (auto record = entity.read(entity_id, opts); record.has_value()) {
+                    // What PATCH and DELETE take as `If-Match`; expanded records hold more than it covers
+                    const auto tag = relations.empty() ? entity.recordTag(*record) : std::nullopt;
+                    if (!relations.empty()) {
+                        Records records{std::move(*record)};
+                        expandRecords(req, entity, records, relations);
+                        record = std::move(records.front());
+                    }
+                    const json response = {
                         {"data", record},
                         {"error", ""},
                         {"status", 200}
-                    });
+                    };
+                    if (!cached) {
+                        if (tag.has_value()) sendTagged(req, res, response.dump(), *tag);
+                        else res.sendJSON(200, response);
+                        return;
+                    }
+                    auto body = response.dump();
+                    const auto etag = cache.put(entity_name, key, generation, body, entity_id, tag.value_or(""));
+                    sendTagged(req, res, std::move(body), etag);
                 } else {
                     res.sendJSON(404, {
                         {"data", json::object()},
@@ -42,9 +168,10 @@ namespace mb {
             }
         }
 
-        void handleGetMany(const MantisRequest &req, const MantisResponse &res, const std::string &entity_name) {
+        void handleGetMany(MantisRequest &req, const MantisResponse &res, const std::string &entity_name) {
             try {
-                const auto entity = req.mApp().entity(entity_name);
+                const auto entity_ptr = requestEntity(req, entity_name);
+                const auto &entity = *entity_ptr;
 
                 int limit = req.hasQueryParam("limit")
                                 ? safe_stoi(req.getQueryParamValue("limit"), 50)
@@ -69,25 +196,273 @@ namespace mb {
                     {"sort", sort}
                 };
                 opts["filter"] = filter;
+                if (req.hasQueryParam("search")) opts["search"] = req.getQueryParamValue("search");
+                if (req.hasQueryParam("include_archived"))
+                    opts["include_archived"] = req.getQueryParamValue("include_archived") == "true";
+
+                // `near=lat,lng&radius=5` and `bbox=west,south,east,north`: records
+                // whose geo_point is in the area, nearest `near` first
+                const bool geo_near = req.hasQueryParam("near") && !req.getQueryParamValue("near").starts_with('[');
+                if (geo_near || req.hasQueryParam("bbox")) {
+                    json geo = json::object();
+                    if (geo_near) {
+                        const auto at = EntityGeo::parseNumbers(req.getQueryParamValue("near"), 2, "near");
+                        geo["near"] = {{"lat", at[0]}, {"lng", at[1]}};
+                    }
+                    if (req.hasQueryParam("radius"))
+                        geo["radius"] = EntityGeo::parseNumbers(req.getQueryParamValue("radius"), 1, "radius")[0];
+                    if (req.hasQueryParam("bbox"))
+                        geo["bbox"] = EntityGeo::parseNumbers(req.getQueryParamValue("bbox"), 4, "bbox");
+                    if (req.hasQueryParam("near_field")) geo["field"] = req.getQueryParamValue("near_field");
+                    opts["geo"] = std::move(geo);
+                }
 
-                const auto records = entity.list(opts);
+                // `near=[0.1, ...]&k=20`: the k records nearest the vector, one page
+                if (req.hasQueryParam("near") && !geo_near) {
+                    json near = {{"k", req.hasQueryParam("k") ? safe_stoi(req.getQueryParamValue("k"), 20) : 20}};
+                    try {
+                        near["vector"] = parseJson(req.getQueryParamValue("near"));
+                    } catch (const std::exception &) {
+                        throw MantisException(400, "`near` must be a JSON array of numbers.");
+                    }
+                    if (req.hasQueryParam("near_field")) near["field"] = req.getQueryParamValue("near_field");
+                    limit = std::clamp(near["k"].get<int>(), 1, MAX_NEAR_RESULTS);
+                    opts["near"] = std::move(near);
+                }
+                const auto relations = expandParam(req);
+                setFieldsParam(req, opts, relations);
+                setRuleAuth(req, entity.listRule(), opts);
+
+                // `total=true` adds the matching count, `approx=true` lets it
+                // come from the planner statistics
+                const bool approx = req.hasQueryParam("approx") && req.getQueryParamValue("approx") == "true";
+                const bool with_total = approx || (req.hasQueryParam("total") && req.getQueryParamValue("total") == "true");
+
+                // `opts` dumps with sorted keys, so equal queries get equal keys
+                auto &cache = req.mApp().router().responseCache();
+                const bool cached = cacheable(req, entity_name, entity.listRule(), relations);
+                const auto key = cached
+                                     ? std::format("list:{}:{}", with_total ? (approx ? "approx" : "total") : "",
+                                                   opts.dump())
+                                     : std::string{};
+                if (cached && sendCached(req, res, entity_name, key)) return;
+                const auto generation = cached ? cache.generation(entity_name) : 0;
+
+                std::optional<int> total;
+                if (with_total) {
+                    json count_opts = {{"filter", filter}, {"search", opts.value("search", "")}, {"approx", approx}};
+                    if (opts.contains("geo")) count_opts["geo"] = opts["geo"];
+                    if (opts.contains("auth")) count_opts["auth"] = opts["auth"];
+                    if (opts.contains("include_archived")) count_opts["include_archived"] = opts["include_archived"];
+                    total = entity.countRecords(count_opts);
+                }
 
-                std::string cursor;
-                if (!records.empty()) {
-                    const auto &last = records.back();
-                    if (last.contains("id") && last["id"].is_string())
-                        cursor = last["id"].get<std::string>();
+                // Serialize the page straight from the rowset into the body
+                // buffer instead of building a Records vector and an envelope
+                // DOM and dumping them. Expanded pages are merged as json first.
+                std::string body;
+                body.reserve(8192);
+                body.append(R"({"data":{"items":)");
+                Entity::ListPage page;
+                if (relations.empty()) {
+                    page = entity.listInto(body, opts);
+                } else {
+                    auto records = entity.list(opts, page);
+                    expandRecords(req, entity, records, relations);
+                    body.append(json(records).dump());
+                }
+                body.append(R"(,"cursor":)");
+                RowCodec::appendJsonString(body, page.cursor);
+                body.append(R"(,"items_count":)");
+                body.append(std::to_string(page.count));
+                body.append(R"(,"limit":)");
+                body.append(std::to_string(limit));
+                if (total) {
+                    body.append(R"(,"total":)");
+                    body.append(std::to_string(*total));
+                }
+                body.append(R"(},"error":"","status":200})");
+
+                if (!cached) {
+                    res.sendRawJSON(200, std::move(body));
+                    return;
                 }
+                const auto etag = cache.put(entity_name, key, generation, body);
+                sendTagged(req, res, std::move(body), etag);
+            } catch (const MantisException &e) {
+                res.sendJSON(e.code(), {
+                    {"data", json::object()},
+                    {"error", e.what()},
+                    {"status", e.code()}
+                });
+            } catch (const std::exception &e) {
+                res.sendJSON(500, {
+                    {"data", json::object()},
+                    {"error", e.what()},
+                    {"status", 500}
+                });
+            }
+        }
 
+        /// Comma separated names in `?<key>=`.
+        json fieldListParam(const MantisRequest &req, const char *key) {
+            json fields = json::array();
+            if (!req.hasQueryParam(key)) return fields;
+            for (const auto &part: splitString(req.getQueryParamValue(key), ",")) {
+                if (const auto field = trim(part); !field.empty()) fields.push_back(field);
+            }
+            return fields;
+        }
+
+        void handleAggregate(MantisRequest &req, const MantisResponse &res, const std::string &entity_name) {
+            try {
+                const auto entity_ptr = requestEntity(req, entity_name);
+                const auto &entity = *entity_ptr;
+
+                json opts = json::object();
+                for (const auto *key: {"group", "sum", "avg", "min", "max"}) opts[key] = fieldListParam(req, key);
+                if (req.hasQueryParam("filter")) opts["filter"] = req.getQueryParamValue("filter");
+                if (req.hasQueryParam("sort")) opts["sort"] = req.getQueryParamValue("sort");
+                if (req.hasQueryParam("limit")) opts["limit"] = safe_stoi(req.getQueryParamValue("limit"), 0);
+                setRuleAuth(req, entity.listRule(), opts);
+
+                // Same rule and invalidation as a list of the records being summed
+                auto &cache = req.mApp().router().responseCache();
+                const bool cached = cacheable(req, entity_name, entity.listRule(), {});
+                const auto key = cached ? std::format("aggregate:{}", opts.dump()) : std::string{};
+                if (cached && sendCached(req, res, entity_name, key)) return;
+                const auto generation = cached ? cache.generation(entity_name) : 0;
+
+                const json response = {
+                    {"data", entity.aggregate(opts)},
+                    {"error", ""},
+                    {"status", 200}
+                };
+                if (!cached) {
+                    res.sendJSON(200, response);
+                    return;
+                }
+                auto body = response.dump();
+                const auto etag = cache.put(entity_name, key, generation, body);
+                sendTagged(req, res, std::move(body), etag);
+            } catch (const MantisException &e) {
+                res.sendJSON(e.code(), {
+                    {"data", json::object()},
+                    {"error", e.what()},
+                    {"status", e.code()}
+                });
+            } catch (const std::exception &e) {
+                res.sendJSON(500, {
+                    {"data", json::object()},
+                    {"error", e.what()},
+                    {"status", 500}
+                });
+            }
+        }
+
+        void handleExport(MantisRequest &req, MantisResponse &res, const std::string &entity_name) {
+            try {
+                const auto entity_ptr = requestEntity(req, entity_name);
+                const auto &entity = *entity_ptr;
+
+                const auto format_name = req.hasQueryParam("format") ? req.getQueryParamValue("format") : "ndjson";
+                if (format_name != "ndjson" && format_name != "csv")
+                    throw MantisException(400, "`format` must be `ndjson` or `csv`.");
+                const bool csv = format_name == "csv";
+
+                json opts = json::object();
+                if (req.hasQueryParam("filter")) opts["filter"] = req.getQueryParamValue("filter");
+                setFieldsParam(req, opts, {});
+                setRuleAuth(req, entity.listRule(), opts);
+
+                auto reader = entity.exportRecords(csv ? Entity::ExportFormat::Csv : Entity::ExportFormat::Ndjson,
+                                                   opts);
+                res.sendStream(std::move(reader), csv ? "text/csv; charset=utf-8" : "application/x-ndjson",
+                               entity_name + (csv ? ".csv" : ".ndjson"));
+            } catch (const MantisException &e) {
+                res.sendJSON(e.code(), {
+                    {"data", json::object()},
+                    {"error", e.what()},
+                    {"status", e.code()}
+                });
+            } catch (const std::exception &e) {
+                res.sendJSON(500, {
+                    {"data", json::object()},
+                    {"error", e.what()},
+                    {"status", 500}
+                });
+            }
+        }
+
+        void handleBlobGet(MantisRequest &req, MantisResponse &res, const std::string &entity_name) {
+            try {
+                const auto entity_ptr = requestEntity(req, entity_name);
+                const auto &entity = *entity_ptr;
+
+                const auto entity_id = trim(req.getPathParamValue("id"));
+                if (entity_id.empty())
+                    throw MantisException(400, "Entity `id` is required!");
+
+                json opts = json::object();
+                setRuleAuth(req, entity.getRule(), opts);
+                auto blob = entity.readBlob(entity_id, trim(req.getPathParamValue("field")), opts);
+                if (!blob.has_value()) {
+                    res.sendJSON(404, {
+                        {"data", json::object()},
+                        {"error", "Resource not found!"},
+                        {"status", 404}
+                    });
+                    return;
+                }
+                res.sendStream(std::move(blob->read), "application/octet-stream", "");
+            } catch (const MantisException &e) {
+                res.sendJSON(e.code(), {
+                    {"data", json::object()},
+                    {"error", e.what()},
+                    {"status", e.code()}
+                });
+            } catch (const std::exception &e) {
+                res.sendJSON(500, {
+                    {"data", json::object()},
+                    {"error", e.what()},
+                    {"status", 500}
+                });
+            }
+        }
+
+        void handleBlobPatch(MantisRequest &req, const MantisResponse &res, const MantisContentReader &reader,
+                             const std::string &entity_name) {
+            try {
+                const auto entity_ptr = requestEntity(req, entity_name);
+                const auto &entity = *entity_ptr;
+
+                const auto entity_id = trim(req.getPathParamValue("id"));
+                if (entity_id.empty())
+                    throw MantisException(400, "Entity `id` is required!");
+
+                auto content_type = trim(splitString(req.getHeaderValue("Content-Type", "") + ";", ";")[0]);
+                toLowerCase(content_type);
+                if (content_type != "application/octet-stream")
+                    throw MantisException(415, "Expected an `application/octet-stream` body.");
+
+                // Streamed bodies were spooled to a staging file, see Router::registerDrogonHandlerWithReader()
+                std::ifstream file;
+                std::istringstream buffered;
+                std::istream *in = &buffered;
+                std::int64_t size = 0;
+                if (const auto &parts = reader.formData(); !parts.empty() && !parts.front().staged_path.empty()) {
+                    file.open(parts.front().staged_path, std::ios::binary);
+                    if (!file) throw MantisException(500, "Could not read the spooled request body.");
+                    in = &file;
+                    size = static_cast<std::int64_t>(parts.front().size);
+                } else {
+                    buffered.str(req.getBody());
+                    size = static_cast<std::int64_t>(req.getBody().size());
+                }
+
+                auto record = entity.writeBlob(entity_id, trim(req.getPathParamValue("field")), *in, size);
                 res.sendJSON(200, {
-                    {
-                        "data", {
-                            {"items_count", records.size()},
-                            {"limit", limit},
-                            {"cursor", cursor},
-                            {"items", records}
-                        }
-                    },
+                    {"data", record},
                     {"error", ""},
                     {"status", 200}
                 });
@@ -106,10 +481,11 @@ namespace mb {
             }
         }
 
-        void handlePost(const MantisRequest &req, const MantisResponse &res, MantisContentReader &reader,
+        void handlePost(MantisRequest &req, const MantisResponse &res, MantisContentReader &reader,
                         const std::string &entity_name) {
             try {
-                const auto entity = req.mApp().entity(entity_name);
+                const auto entity_ptr = requestEntity(req, entity_name);
+                const auto &entity = *entity_ptr;
 
                 reader.parseFormDataToEntity(entity);
 
@@ -123,6 +499,12 @@ namespace mb {
                     return;
                 }
 
+#ifdef MB_SCRIPTING_ENABLED
+                checkBeforeHook("beforeRecordCreate", [&](duk_context *ctx) {
+                    return ScriptingHooks::beforeRecordCreate(ctx, entity_name, reader.jsonBody());
+                });
+#endif
+
                 reader.writeFiles(entity_name);
                 auto record = entity.create(reader.jsonBody());
 
@@ -155,7 +537,8 @@ namespace mb {
         void handlePatch(MantisRequest &req, MantisResponse &res, MantisContentReader &reader,
                          const std::string &entity_name) {
             try {
-                const auto entity = req.mApp().entity(entity_name);
+                const auto entity_ptr = requestEntity(req, entity_name);
+                const auto &entity = *entity_ptr;
 
                 const auto entity_id = trim(req.getPathParamValue("id"));
                 if (entity_id.empty())
@@ -173,12 +556,19 @@ namespace mb {
                     return;
                 }
 
+#ifdef MB_SCRIPTING_ENABLED
+                checkBeforeHook("beforeRecordUpdate", [&](duk_context *ctx) {
+                    return ScriptingHooks::beforeRecordUpdate(ctx, entity_name, entity_id, reader.jsonBody());
+                });
+#endif
+
                 reader.writeFiles(entity_name);
-                auto record = entity.update(entity_id, reader.jsonBody());
+                auto record = entity.update(entity_id, reader.jsonBody(), ifMatchOpts(req));
 
                 if (entity.type() == "auth" && record.contains("password")) {
                     record.erase("password");
                 }
+                if (const auto tag = entity.recordTag(record); tag.has_value()) res.setHeader("ETag", *tag);
 
                 res.sendJSON(200, {
                     {"data", record},
@@ -202,15 +592,262 @@ namespace mb {
             }
         }
 
-        void handleDelete(const MantisRequest &req, const MantisResponse &res, const std::string &entity_name) {
+        void handleBatch(MantisRequest &req, const MantisResponse &res, const std::string &entity_name) {
+            try {
+                const auto entity_ptr = requestEntity(req, entity_name);
+                const auto &entity = *entity_ptr;
+
+                const auto &[body, err] = req.getBodyAsJson();
+                if (!err.empty())
+                    throw MantisException(400, err);
+                if (!body.is_object() || !body.contains("ops") || !body["ops"].is_array())
+                    throw MantisException(400, "Expected a JSON body with an `ops` array.");
+
+                const auto &ops = body["ops"];
+                if (ops.size() > MAX_BATCH_OPS)
+                    throw MantisException(400, std::format("A batch is limited to {} ops, got {}.",
+                                                           MAX_BATCH_OPS, ops.size()));
+
+                // Validate every body up front so a bad op fails the batch
+                // before it reaches the DB
+                for (std::size_t i = 0; i < ops.size(); ++i) {
+                    const auto &op = ops[i];
+                    if (!op.is_object() || !op.contains("data") || !op["data"].is_object() ||
+                        !op.contains("op") || !op["op"].is_string())
+                        continue; // Malformed ops are rejected by Entity::batch()
+
+                    std::optional<std::string> val_err;
+                    if (op["op"] == "create")
+                        val_err = Validators::validateRequestBody(entity, op["data"]);
+                    else if (op["op"] == "update")
+                        val_err = Validators::validateUpdateRequestBody(entity, op["data"]);
+
+#ifdef MB_SCRIPTING_ENABLED
+                    if (!val_err.has_value()) {
+                        try {
+                            if (op["op"] == "create")
+                                checkBeforeHook("beforeRecordCreate", [&](duk_context *ctx) {
+                                    return ScriptingHooks::beforeRecordCreate(ctx, entity_name, op["data"]);
+                                });
+                            else if (op["op"] == "update")
+                                checkBeforeHook("beforeRecordUpdate", [&](duk_context *ctx) {
+                                    const auto id = op.contains("id") && op["id"].is_string()
+                                                        ? trim(op["id"].get<std::string>())
+                                                        : std::string{};
+                                    return ScriptingHooks::beforeRecordUpdate(ctx, entity_name, id, op["data"]);
+                                });
+                        } catch (const MantisException &e) {
+                            val_err = e.what();
+                        }
+                    }
+#endif
+
+                    if (val_err.has_value()) {
+                        res.sendJSON(400, {
+                            {"data", {{"index", i}}},
+                            {"error", std::format("ops[{}]: {}", i, val_err.value())},
+                            {"status", 400}
+                        });
+                        return;
+                    }
+                }
+
+                const auto records = entity.batch(ops);
+                res.sendJSON(200, {
+                    {"data", {
+                        {"items", records},
+                        {"items_count", records.size()}
+                    }},
+                    {"error", ""},
+                    {"status", 200}
+                });
+            } catch (const MantisException &e) {
+                res.sendJSON(e.code(), {
+                    {"data", json::object()},
+                    {"error", e.what()},
+                    {"status", e.code()}
+                });
+            } catch (const std::exception &e) {
+                res.sendJSON(500, {
+                    {"data", json::object()},
+                    {"error", e.what()},
+                    {"status", 500}
+                });
+            }
+        }
+
+        void handleTransaction(MantisRequest &req, const MantisResponse &res) {
+            try {
+                const auto &[body, err] = req.getBodyAsJson();
+                if (!err.empty())
+                    throw MantisException(400, err);
+                if (!body.is_object() || !body.contains("ops") || !body["ops"].is_array() || body["ops"].empty())
+                    throw MantisException(400, "Expected a JSON body with a non-empty `ops` array.");
+
+                const auto &ops = body["ops"];
+                if (ops.size() > MAX_BATCH_OPS)
+                    throw MantisException(400, std::format("A transaction is limited to {} ops, got {}.",
+                                                           MAX_BATCH_OPS, ops.size()));
+
+                // Every op passes its own entity's rule before any reaches the DB
+                std::vector<std::shared_ptr<const Entity>> entities;
+                entities.reserve(ops.size());
+                for (std::size_t i = 0; i < ops.size(); ++i) {
+                    const auto &op = ops[i];
+                    const auto name = op.is_object() && op.contains("entity") && op["entity"].is_string()
+                                          ? trim(op["entity"].get<std::string>())
+                                          : std::string{};
+                    const auto kind = op.is_object() && op.contains("op") && op["op"].is_string()
+                                          ? op["op"].get<std::string>()
+                                          : std::string{};
+                    if (name.empty() || !EntitySchema::isValidEntityName(name) || !req.mApp().hasEntity(name))
+                        throw MantisException(404, std::format("ops[{}]: No entity named `{}`.", i, name));
+
+                    auto entity = req.mApp().entitySnapshot(name);
+                    if (entity->isSystem() || !entity->hasApi())
+                        throw MantisException(404, std::format("ops[{}]: No entity named `{}`.", i, name));
+                    if (kind != "create" && kind != "update" && kind != "delete")
+                        throw MantisException(400, std::format(
+                                                  "ops[{}]: `op` must be one of create, update or delete.", i));
+
+                    const auto &rule = kind == "create"
+                                           ? entity->addRule()
+                                           : kind == "update"
+                                                 ? entity->updateRule()
+                                                 : entity->deleteRule();
+                    if (!hasRuleAccess(req, rule))
+                        throw MantisException(403, std::format("ops[{}]: Access to `{}` was denied.", i, name));
+                    entities.push_back(std::move(entity));
+                }
+
+                // Bodies are validated as their refs resolve, inside the transaction
+                const auto records = Entity::transaction(req.mApp(), entities, ops, [](
+                    const std::size_t, const Entity &entity, const json &op) -> std::optional<std::string> {
+                        if (op["op"] == "delete") return std::nullopt;
+                        const auto &data = op["data"];
+                        if (auto val_err = op["op"] == "create"
+                                               ? Validators::validateRequestBody(entity, data)
+                                               : Validators::validateUpdateRequestBody(entity, data);
+                            val_err.has_value())
+                            return val_err;
+#ifdef MB_SCRIPTING_ENABLED
+                        try {
+                            if (op["op"] == "create")
+                                checkBeforeHook("beforeRecordCreate", [&](duk_context *ctx) {
+                                    return ScriptingHooks::beforeRecordCreate(ctx, entity.name(), data);
+                                });
+                            else
+                                checkBeforeHook("beforeRecordUpdate", [&](duk_context *ctx) {
+                                    return ScriptingHooks::beforeRecordUpdate(
+                                        ctx, entity.name(), trim(op["id"].get<std::string>()), data);
+                                });
+                        } catch (const MantisException &e) {
+                            if (e.code() != 400) throw;
+                            return e.what();
+                        }
+#endif
+                        return std::nullopt;
+                    });
+
+                res.sendJSON(200, {
+                    {"data", {
+                        {"items", records},
+                        {"items_count", records.size()}
+                    }},
+                    {"error", ""},
+                    {"status", 200}
+                });
+            } catch (const MantisException &e) {
+                res.sendJSON(e.code(), {
+                    {"data", json::object()},
+                    {"error", e.what()},
+                    {"status", e.code()}
+                });
+            } catch (const std::exception &e) {
+                res.sendJSON(500, {
+                    {"data", json::object()},
+                    {"error", e.what()},
+                    {"status", 500}
+                });
+            }
+        }
+
+        void handleImport(MantisRequest &req, const MantisResponse &res, const MantisContentReader &reader,
+                          const std::string &entity_name) {
             try {
-                const auto entity = req.mApp().entity(entity_name);
+                const auto entity_ptr = requestEntity(req, entity_name);
+                const auto &entity = *entity_ptr;
+
+                auto content_type = trim(splitString(req.getHeaderValue("Content-Type", "") + ";", ";")[0]);
+                toLowerCase(content_type);
+                if (content_type != "application/x-ndjson" && content_type != "application/ndjson" &&
+                    content_type != "text/csv")
+                    throw MantisException(415, "Expected an `application/x-ndjson` or `text/csv` body.");
+                const auto format = content_type == "text/csv" ? Entity::ExportFormat::Csv
+                                                               : Entity::ExportFormat::Ndjson;
+
+                json opts = json::object();
+                if (req.hasQueryParam("realtime")) opts["realtime"] = req.getQueryParamValue("realtime") != "false";
+
+                // Streamed bodies were spooled to a staging file, see Router::registerDrogonHandlerWithReader()
+                std::ifstream file;
+                std::istringstream buffered;
+                std::istream *in = &buffered;
+                if (const auto &parts = reader.formData(); !parts.empty() && !parts.front().staged_path.empty()) {
+                    file.open(parts.front().staged_path, std::ios::binary);
+                    if (!file) throw MantisException(500, "Could not read the spooled request body.");
+                    in = &file;
+                } else {
+                    buffered.str(req.getBody());
+                }
+
+                const auto result = entity.importRecords(format, *in, opts, [&](const json &record)
+                    -> std::optional<std::string> {
+                        if (auto err = Validators::validateRequestBody(entity, record); err.has_value())
+                            return err;
+#ifdef MB_SCRIPTING_ENABLED
+                        try {
+                            checkBeforeHook("beforeRecordCreate", [&](duk_context *ctx) {
+                                return ScriptingHooks::beforeRecordCreate(ctx, entity_name, record);
+                            });
+                        } catch (const MantisException &e) {
+                            if (e.code() != 400) throw;
+                            return e.what();
+                        }
+#endif
+                        return std::nullopt;
+                    });
+
+                res.sendJSON(200, {
+                    {"data", result},
+                    {"error", ""},
+                    {"status", 200}
+                });
+            } catch (const MantisException &e) {
+                res.sendJSON(e.code(), {
+                    {"data", json::object()},
+                    {"error", e.what()},
+                    {"status", e.code()}
+                });
+            } catch (const std::exception &e) {
+                res.sendJSON(500, {
+                    {"data", json::object()},
+                    {"error", e.what()},
+                    {"status", 500}
+                });
+            }
+        }
+
+        void handleDelete(MantisRequest &req, const MantisResponse &res, const std::string &entity_name) {
+            try {
+                const auto entity_ptr = requestEntity(req, entity_name);
+                const auto &entity = *entity_ptr;
 
                 const auto entity_id = trim(req.getPathParamValue("id"));
                 if (entity_id.empty())
                     throw MantisException(400, "Entity `id` is required!");
 
-                entity.remove(entity_id);
+                entity.remove(entity_id, ifMatchOpts(req));
                 res.sendEmpty();
             } catch (const MantisException &e) {
                 res.sendJSON(e.code(), {
@@ -229,19 +866,43 @@ namespace mb {
     }
 
     HandlerFn entityGetOneHandler() {
-        return [](const MantisRequest &req, const MantisResponse &res) {
+        return [](MantisRequest &req, const MantisResponse &res) {
             handleGetOne(req, res, trim(req.getPathParamValue("entity_name")));
         };
     }
 
     HandlerFn entityGetManyHandler() {
-        return [](const MantisRequest &req, const MantisResponse &res) {
+        return [](MantisRequest &req, const MantisResponse &res) {
             handleGetMany(req, res, trim(req.getPathParamValue("entity_name")));
         };
     }
 
+    HandlerFn entityExportHandler() {
+        return [](MantisRequest &req, MantisResponse &res) {
+            handleExport(req, res, trim(req.getPathParamValue("entity_name")));
+        };
+    }
+
+    HandlerFn entityAggregateHandler() {
+        return [](MantisRequest &req, const MantisResponse &res) {
+            handleAggregate(req, res, trim(req.getPathParamValue("entity_name")));
+        };
+    }
+
+    HandlerFn entityBlobGetHandler() {
+        return [](MantisRequest &req, MantisResponse &res) {
+            handleBlobGet(req, res, trim(req.getPathParamValue("entity_name")));
+        };
+    }
+
+    HandlerWithContentReaderFn entityBlobPatchHandler() {
+        return [](MantisRequest &req, const MantisResponse &res, MantisContentReader &reader) {
+            handleBlobPatch(req, res, reader, trim(req.getPathParamValue("entity_name")));
+        };
+    }
+
     HandlerWithContentReaderFn entityPostHandler() {
-        return [](const MantisRequest &req, const MantisResponse &res, MantisContentReader &reader) {
+        return [](MantisRequest &req, const MantisResponse &res, MantisContentReader &reader) {
             handlePost(req, res, reader, trim(req.getPathParamValue("entity_name")));
         };
     }
@@ -253,27 +914,45 @@ namespace mb {
     }
 
     HandlerFn entityDeleteHandler() {
-        return [](const MantisRequest &req, const MantisResponse &res) {
+        return [](MantisRequest &req, const MantisResponse &res) {
             handleDelete(req, res, trim(req.getPathParamValue("entity_name")));
         };
     }
 
+    HandlerWithContentReaderFn entityImportHandler() {
+        return [](MantisRequest &req, const MantisResponse &res, MantisContentReader &reader) {
+            handleImport(req, res, reader, trim(req.getPathParamValue("entity_name")));
+        };
+    }
+
+    HandlerFn entityBatchHandler() {
+        return [](MantisRequest &req, const MantisResponse &res) {
+            handleBatch(req, res, trim(req.getPathParamValue("entity_name")));
+        };
+    }
+
+    HandlerFn entityTransactionHandler() {
+        return [](MantisRequest &req, const MantisResponse &res) {
+            handleTransaction(req, res);
+        };
+    }
+
     void registerAdminEntityRoutes() {
         auto &router = MantisBase::instance().router();
         const std::string admin_entity = "mb_admins";
 
         router.Get("/api/v1/sys/admins",
-                   [admin_entity](const MantisRequest &req, const MantisResponse &res) {
+                   [admin_entity](MantisRequest &req, const MantisResponse &res) {
                        handleGetMany(req, res, admin_entity);
                    },
                    {requireAdminAuth()});
         router.Get("/api/v1/sys/admins/:id",
-                   [admin_entity](const MantisRequest &req, const MantisResponse &res) {
+                   [admin_entity](MantisRequest &req, const MantisResponse &res) {
                        handleGetOne(req, res, admin_entity);
                    },
                    {requireAdminAuth()});
         router.Post("/api/v1/sys/admins",
-                    [admin_entity](const MantisRequest &req, const MantisResponse &res, MantisContentReader &reader) {
+                    [admin_entity](MantisRequest &req, const MantisResponse &res, MantisContentReader &reader) {
                         handlePost(req, res, reader, admin_entity);
                     },
                     {requireAdminAuth()});
@@ -283,7 +962,7 @@ namespace mb {
                      },
                      {requireAdminAuth()});
         router.Delete("/api/v1/sys/admins/:id",
-                      [admin_entity](const MantisRequest &req, const MantisResponse &res) {
+                      [admin_entity](MantisRequest &req, const MantisResponse &res) {
                           handleDelete(req, res, admin_entity);
                       },
                       {requireAdminAuth()});
@@ -1,7 +1,20 @@
 #include "../../../include/mantisbase/core/models/entity_schema.h"
 #include "mantisbase/core/exceptions.h"
+#include "mantisbase/core/models/entity_geo.h"
+#include "mantisbase/core/models/entity_shards.h"
 
 namespace mb {
+    namespace {
+        /// The `shards` key of `j`, `into` if absent
+        int shardsFromJSON(const nlohmann::json &j, const int into) {
+            if (!j.contains("shards")) return into;
+            if (j["shards"].is_null()) return 1;
+            if (!j["shards"].is_number_integer())
+                throw MantisException(400, "Expected `shards` to be a number of databases.");
+            return j["shards"].get<int>();
+        }
+    }
+
     EntitySchema::EntitySchema(const MantisBase &app) : m_app(app) {}
 
     EntitySchema::EntitySchema(const MantisBase &app, const std::string &entity_name, const std::string &entity_type)
@@ -25,6 +38,9 @@ namespace mb {
             m_name = other.m_name;
             m_type = other.m_type;
             m_viewSqlQuery = other.m_viewSqlQuery;
+            m_materialization = other.m_materialization;
+            m_archive = other.m_archive;
+            m_shards = other.m_shards;
             m_isSystem = other.m_isSystem;
             m_hasApi = other.m_hasApi;
             m_fields = other.m_fields;
@@ -117,6 +133,10 @@ namespace mb {
             && !entity_schema.at("view_query").get<std::string>().empty()) {
             eSchema.setViewQuery(entity_schema.at("view_query").get<std::string>());
         }
+        if (_type == "view")
+            eSchema.setMaterialization(ViewMaterialization::fromJSON(entity_schema));
+        else
+            eSchema.setArchive(ArchivePolicy::fromJSON(entity_schema)).setShards(shardsFromJSON(entity_schema, 1));
 
         if (entity_schema.contains("indexes") && entity_schema["indexes"].is_array()) {
             for (const auto &idx : entity_schema["indexes"]) {
@@ -161,6 +181,9 @@ namespace mb {
                 && !schema_json["view_query"].get<std::string>().empty()) {
                 eSchema.setViewQuery(schema_json["view_query"].get<std::string>());
             }
+            eSchema.setMaterialization(ViewMaterialization::fromJSON(schema_json));
+        } else {
+            eSchema.setArchive(ArchivePolicy::fromJSON(entity.schema())).setShards(entity.shards());
         }
 
         // Copy indexes
@@ -219,6 +242,94 @@ namespace mb {
         return *this;
     }
 
+    const ViewMaterialization &EntitySchema::materialization() const {
+        return m_materialization;
+    }
+
+    EntitySchema &EntitySchema::setMaterialization(const ViewMaterialization &materialization) {
+        m_materialization = materialization;
+        return *this;
+    }
+
+    ViewMaterialization ViewMaterialization::fromJSON(const nlohmann::json &j, ViewMaterialization into) {
+        if (j.contains("materialized")) {
+            if (!j["materialized"].is_boolean())
+                throw MantisException(400, "Expected `materialized` to be a bool.");
+            into.enabled = j["materialized"].get<bool>();
+        }
+        if (j.contains("refresh_key")) {
+            if (!j["refresh_key"].is_string() && !j["refresh_key"].is_null())
+                throw MantisException(400, "Expected `refresh_key` to be a column name or null.");
+            into.refreshKey = j["refresh_key"].is_string() ? j["refresh_key"].get<std::string>() : "";
+        }
+        if (j.contains("refresh_interval")) {
+            if (!j["refresh_interval"].is_number_integer())
+                throw MantisException(400, "Expected `refresh_interval` to be a number of seconds.");
+            into.refreshInterval = j["refresh_interval"].get<int>();
+        }
+        if (j.contains("sources")) {
+            if (!j["sources"].is_array())
+                throw MantisException(400, "Expected `sources` to be an array of entity names.");
+            into.sources.clear();
+            for (const auto &s: j["sources"]) {
+                if (!s.is_string())
+                    throw MantisException(400, "Expected `sources` to be an array of entity names.");
+                into.sources.push_back(s.get<std::string>());
+            }
+        }
+        return into;
+    }
+
+    void ViewMaterialization::toJSON(nlohmann::json &j) const {
+        if (!enabled) return;
+        j["materialized"] = true;
+        j["refresh_key"] = refreshKey.empty() ? nlohmann::json(nullptr) : nlohmann::json(refreshKey);
+        j["refresh_interval"] = refreshInterval;
+        j["sources"] = sources;
+    }
+
+    const ArchivePolicy &EntitySchema::archive() const {
+        return m_archive;
+    }
+
+    EntitySchema &EntitySchema::setArchive(const ArchivePolicy &archive) {
+        m_archive = archive;
+        return *this;
+    }
+
+    int EntitySchema::shards() const {
+        return m_shards;
+    }
+
+    EntitySchema &EntitySchema::setShards(const int shards) {
+        m_shards = shards;
+        return *this;
+    }
+
+    ArchivePolicy ArchivePolicy::fromJSON(const nlohmann::json &j, ArchivePolicy into) {
+        if (!j.contains("archive")) return into;
+        const auto &a = j["archive"];
+        if (a.is_null()) return {};
+        if (!a.is_object())
+            throw MantisException(400, "Expected `archive` to be an object or null.");
+        if (a.contains("field")) {
+            if (!a["field"].is_string())
+                throw MantisException(400, "Expected `archive.field` to be a field name.");
+            into.field = a["field"].get<std::string>();
+        }
+        if (a.contains("after_days")) {
+            if (!a["after_days"].is_number_integer())
+                throw MantisException(400, "Expected `archive.after_days` to be a number of days.");
+            into.afterDays = a["after_days"].get<int>();
+        }
+        return into;
+    }
+
+    void ArchivePolicy::toJSON(nlohmann::json &j) const {
+        if (!enabled()) return;
+        j["archive"] = {{"field", field}, {"after_days", afterDays}};
+    }
+
     const std::vector<IndexDefinition> &EntitySchema::indexes() const {
         return m_indexes;
     }
@@ -354,6 +465,13 @@ namespace mb {
             && !new_data.at("view_query").get<std::string>().empty()) {
             setViewQuery(new_data.at("view_query").get<std::string>());
         }
+        if (m_type == "view")
+            setMaterialization(ViewMaterialization::fromJSON(new_data, m_materialization));
+        else
+            setArchive(ArchivePolicy::fromJSON(new_data, m_archive));
+        // The rows already sit in their shards; moving them between files isn't done
+        if (shardsFromJSON(new_data, m_shards) != m_shards)
+            throw MantisException(400, "`shards` can't change once the entity is created.");
 
         if (new_data.contains("indexes") && new_data["indexes"].is_array()) {
             m_indexes.clear();
@@ -482,11 +600,14 @@ namespace mb {
 
         if (m_type == "view") {
             j["view_query"] = m_viewSqlQuery;
+            m_materialization.toJSON(j);
         } else {
             j["fields"] = json::array();
             for (const auto &field: m_fields) {
                 j["fields"].emplace_back(field.toJSON());
             }
+            m_archive.toJSON(j);
+            if (m_shards > 1) j["shards"] = m_shards;
         }
 
         if (!m_indexes.empty()) {
@@ -510,7 +631,8 @@ namespace mb {
         std::ostringstream ddl;
 
         if (m_type == "view") {
-            ddl << "CREATE VIEW IF NOT EXISTS " << m_name << " AS " << m_viewSqlQuery;
+            const auto view = m_materialization.enabled ? ViewMaterialization::sourceOf(m_name) : m_name;
+            ddl << "CREATE VIEW IF NOT EXISTS " << view << " AS " << m_viewSqlQuery;
             return ddl.str();
         }
 
@@ -562,8 +684,21 @@ namespace mb {
         return ddl.str();
     }
 
+    std::vector<std::string> EntitySchema::materializedDDL() const {
+        if (m_type != "view" || !m_materialization.enabled) return {};
+
+        std::vector<std::string> stmts{
+            std::format("CREATE TABLE {} AS SELECT * FROM {}", m_name, ViewMaterialization::sourceOf(m_name))
+        };
+        if (!m_materialization.refreshKey.empty())
+            stmts.push_back(std::format("CREATE INDEX IF NOT EXISTS idx_{0}_mb_key ON {0} ({1})", m_name,
+                                        m_materialization.refreshKey));
+        return stmts;
+    }
+
     std::vector<std::string> EntitySchema::indexDDL() const {
         std::vector<std::string> stmts;
+        const auto db_type = m_indexes.empty() ? std::string() : app().dbType();
         for (const auto &idx : m_indexes) {
             std::ostringstream ddl;
             ddl << "CREATE ";
@@ -571,7 +706,8 @@ namespace mb {
             ddl << "INDEX IF NOT EXISTS " << idx.name << " ON " << m_name << "(";
             for (size_t i = 0; i < idx.columns.size(); ++i) {
                 if (i > 0) ddl << ", ";
-                ddl << idx.columns[i];
+                // `meta.country` indexes that path, as filters on it read it
+                ddl << EntityFilter::indexColumnSql(db_type, idx.columns[i]);
             }
             ddl << ")";
             stmts.push_back(ddl.str());
@@ -668,6 +804,19 @@ namespace mb {
         if (table_schema.type() == "view") {
             if (trim(table_schema.viewQuery()).empty())
                 return "Entity schema view query is empty!";
+
+            if (const auto &m = table_schema.materialization(); m.enabled) {
+                if (m.refreshInterval < 0)
+                    return "Materialized view `refresh_interval` can't be negative!";
+                if (!m.refreshKey.empty() && !isValidEntityName(m.refreshKey))
+                    return "Materialized view `refresh_key` isn't a valid column name!";
+                // Incremental refresh maps changed source ids onto view rows, so there must be one source
+                if (!m.refreshKey.empty() && m.sources.size() != 1)
+                    return "Materialized view `refresh_key` needs `sources` naming the one entity whose ids it holds!";
+                for (const auto &source: m.sources)
+                    if (!isValidEntityName(source))
+                        return "Materialized view `sources` has an invalid entity name: `" + source + "`";
+            }
             // TODO check if query is a valid SQL view query
         } else {
             // First validate each field
@@ -692,6 +841,10 @@ namespace mb {
 
                             EntitySchema refEntitySchema = EntitySchema::fromSchema(table_schema.app(), refEntityData["schema"]);
 
+                            // Its rows are spread over files no constraint reaches across
+                            if (refEntitySchema.shards() > 1)
+                                return "Foreign key references sharded entity `" + refEntity + "`";
+
                             if (!refEntitySchema.hasField(refField)) {
                                 return "Foreign key references non-existent field `" + refField +
                                        "` in entity `" + refEntity + "`";
@@ -728,6 +881,24 @@ namespace mb {
                 }
             }
 
+            if (const auto &a = table_schema.archive(); a.afterDays < 0) {
+                return "Entity schema `archive.after_days` can't be negative!";
+            } else if (a.enabled()) {
+                const auto fields = table_schema.fields();
+                const auto it = std::ranges::find_if(fields, [&](const EntitySchemaField &field) {
+                    return field.name() == a.field;
+                });
+                if (it == fields.end())
+                    return "Entity schema `archive.field` names no field: `" + a.field + "`";
+                if (it->type() != "date")
+                    return "Entity schema `archive.field` must be a `date` field!";
+            }
+
+            if (table_schema.shards() != 1) {
+                if (auto err = EntityShards::validate(table_schema); err.has_value())
+                    return err.value();
+            }
+
             // Check that base fields are present
             if (table_schema.type() == "base") {
                 for (const auto &field_name: EntitySchemaField::defaultBaseFields()) {
@@ -746,6 +917,53 @@ namespace mb {
             }
         }
 
+        // Each geo field has a slot in the entity's R*Tree, see EntityGeo
+        if (table_schema.type() != "view" &&
+            std::ranges::count_if(table_schema.fields(), [](const auto &f) { return f.type() == "geo_point"; }) >
+            static_cast<std::ptrdiff_t>(EntityGeo::MAX_FIELDS))
+            return std::format("An entity can have at most {} `geo_point` fields.", EntityGeo::MAX_FIELDS);
+
+        // An index column `field.key` indexes a path inside a json field
+        if (table_schema.type() != "view") {
+            for (const auto &idx: table_schema.indexes()) {
+                for (const auto &column: idx.columns) {
+                    const auto dot = column.find('.');
+                    if (dot == std::string::npos) continue;
+                    const auto field = column.substr(0, dot);
+                    const auto &fields = table_schema.fields();
+                    const auto it = std::ranges::find_if(fields, [&](const auto &f) { return f.name() == field; });
+                    if (it == fields.end() || (it->type() != "json" && it->type() != "list"))
+                        return std::format("Index `{}` column `{}`: `{}` isn't a json field.", idx.name, column, field);
+                    try {
+                        (void) EntityFilter::jsonPathSql("sqlite3", field, column.substr(dot + 1));
+                    } catch (const MantisException &e) {
+                        return std::format("Index `{}`: {}", idx.name, e.what());
+                    }
+                }
+            }
+        }
+
+        // Row filters narrow reads, and compile against the entity's fields
+        const std::pair<const char *, AccessRule> rules[] = {
+            {"list", table_schema.listRule()}, {"get", table_schema.getRule()}, {"add", table_schema.addRule()},
+            {"update", table_schema.updateRule()}, {"delete", table_schema.deleteRule()}
+        };
+        for (const auto &[rule_name, rule]: rules) {
+            if (trim(rule.filter()).empty()) continue;
+            if (std::string_view(rule_name) != "list" && std::string_view(rule_name) != "get")
+                return std::format("Rule `filter` applies to the `list` and `get` rules only, not `{}`.", rule_name);
+            if (table_schema.type() == "view")
+                return "Rule `filter` isn't supported for `view` types.";
+
+            std::vector<json> fields;
+            for (const auto &field: table_schema.fields()) fields.push_back(field.toJSON());
+            try {
+                (void) EntityFilter::compileRule(rule.filter(), RowCodec(fields));
+            } catch (const MantisException &e) {
+                return std::format("Invalid `{}` rule filter: {}", rule_name, e.what());
+            }
+        }
+
         return std::nullopt;
     }
 
@@ -782,6 +1000,11 @@ namespace mb {
             return sql->get_backend()->create_column_type(soci::db_uint16, 0, 0);
         }
 
+        // In the row, rather than a large object (`oid`) that outlives it
+        if (db_type == "postgresql" && type == "blob") {
+            return "bytea";
+        }
+
         return sql->get_backend()->create_column_type(EntitySchemaField::toSociType(type, precision), 0, 0);
     }
 
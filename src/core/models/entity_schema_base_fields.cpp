@@ -215,7 +215,7 @@ namespace mb {
     const std::vector<std::string> &EntitySchemaField::defaultEntityFieldTypes() {
         static const std::vector<std::string> _fieldTypes = {
             "xml", "string", "double", "date", "int",
-            "blob", "json", "bool", "file", "files"
+            "blob", "json", "bool", "file", "files", "vector", "geo_point"
         };
         return _fieldTypes;
     }
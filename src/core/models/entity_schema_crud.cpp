@@ -5,16 +5,35 @@
 #include "../../../include/mantisbase/core/models/entity_schema.h"
 #include "../../../include/mantisbase/utils/utils.h"
 
+#include <algorithm>
+#include <format>
 #include <soci/soci.h>
 
 #include "mantisbase/core/exceptions.h"
+#include "mantisbase/core/keyset_page.h"
 #include "mantisbase/core/realtime.h"
+#include "mantisbase/core/schema_migrations.h"
+#include "mantisbase/core/models/entity_archive.h"
+#include "mantisbase/core/models/entity_geo.h"
+#include "mantisbase/core/models/entity_search.h"
+#include "mantisbase/core/models/entity_shards.h"
 
 namespace mb {
-    nlohmann::json EntitySchema::listTables(const MantisBase &app, const json &) {
+    nlohmann::json EntitySchema::listTables(const MantisBase &app, const json &opts) {
+        // Unpaged, every table; paged, one KeysetPage by id
+        std::optional<KeysetPage> page;
+        if (const auto it = opts.find("pagination"); it != opts.end() && it->is_object()) {
+            page.emplace();
+            page->limit = std::clamp(it->value("limit", KeysetPage::DEFAULT_LIMIT), 1, KeysetPage::MAX_LIMIT);
+            page->after = it->value("after", std::string{});
+        }
+        const auto after = page ? page->after : std::string{};
+        const auto limit = page ? std::format(" ORDER BY id LIMIT {}", page->fetch()) : std::string{};
+
         const auto sql = app.db().session();
         const soci::rowset rs = (sql->prepare <<
-                                 "SELECT id, schema, created, updated FROM mb_tables");
+                                 "SELECT id, schema, created, updated FROM mb_tables WHERE id > :after" + limit,
+                                 soci::use(after));
 
         auto response = json::array();
         for (const auto &row: rs) {
@@ -31,7 +50,7 @@ namespace mb {
             });
         }
 
-        return response;
+        return page ? page->envelope(std::move(response)) : response;
     }
 
     nlohmann::json EntitySchema::getTable(const MantisBase &app, const std::string &table_id) {
@@ -61,7 +80,7 @@ namespace mb {
 
     nlohmann::json EntitySchema::createTable(const EntitySchema &new_table) {
         // Database session & transaction instance
-        const auto sql = new_table.app().db().session();
+        const auto sql = new_table.app().db().writeSession();
         soci::transaction tr(*sql);
 
         try {
@@ -86,17 +105,27 @@ namespace mb {
 
             // Create actual SQL table or view
             *sql << new_table.toDDL();
+            for (const auto &stmt: new_table.materializedDDL())
+                *sql << stmt;
 
             // Create indexes
             for (const auto &idx_ddl : new_table.indexDDL()) {
                 *sql << idx_ddl;
             }
 
+            // Full-text search over the `searchable` fields, area queries over the `geo_point` ones
+            EntitySearch::sync(new_table, *sql);
+            EntityGeo::sync(new_table, *sql);
+            EntityArchive::sync(new_table, *sql);
+
             // Add hooks for this table (not for views)
             if (new_table.type() != "view") {
                 mb::RealtimeDB::addDbHooks(Entity{new_table.app(), schema}, sql);
             }
 
+            // The table in the other shards, before the schema naming them commits
+            if (new_table.shards() > 1) new_table.app().shards().create(new_table);
+
             // Commit changes
             tr.commit();
 
@@ -134,8 +163,10 @@ namespace mb {
     nlohmann::json EntitySchema::updateTable(const MantisBase &app, const std::string &table_id, const nlohmann::json &new_schema) {
         if (new_schema.empty())
             throw MantisException(400, "Schema body is empty!");
+        if (SchemaMigrations::active(table_id))
+            throw MantisException(409, "This entity is migrating online; wait for it or cancel it first.");
 
-        const auto sql = app.db().session();
+        const auto sql = app.db().writeSession();
         soci::transaction tr(*sql);
 
         try {
@@ -159,6 +190,15 @@ namespace mb {
             if (auto err = new_entity.validate(); err.has_value())
                 throw MantisException(400, err.value());
 
+            // The tables in the other shards take no DDL past their creation
+            if (old_entity.shards() > 1) {
+                const auto was = old_entity.toJSON(), is = new_entity.toJSON();
+                for (const auto *key: {"name", "fields", "indexes"}) {
+                    if (was.value(key, json()) != is.value(key, json()))
+                        throw MantisException(400, "The fields, indexes and name of a sharded entity can't change.");
+                }
+            }
+
             // --------- Handle Field(s) Changes ---------------- //
             if (new_schema.contains("fields")) {
                 for (const auto &field: new_schema["fields"]) {
@@ -219,6 +259,7 @@ namespace mb {
                         // Rename the column
                         *sql << "ALTER TABLE :table_name RENAME COLUMN :old_field_name TO :new_field_name",
                                 soci::use(entity_name), soci::use(old_name), soci::use(new_name);
+                        EntityArchive::renameField(entity_name, old_name, new_name, *sql);
 
                         // Rename constraints to match the new field name
                         // ------------- SQLite ----------------- //
@@ -467,7 +508,8 @@ namespace mb {
                         if (db_type == "sqlite3") {
                             throw MantisException(500,
                                                   "Adding, modifying, or removing foreign key constraints is not supported on SQLite databases. "
-                                                  "SQLite has limited ALTER TABLE support and requires table recreation for foreign key changes.");
+                                                  "SQLite has limited ALTER TABLE support and requires table recreation for foreign key changes; "
+                                                  "send the update with `?online=true` to have the table rebuilt.");
                         }
 
                         auto table = old_entity.name();
@@ -555,9 +597,14 @@ namespace mb {
                     EntitySchemaField new_field(entity_field_schema);
 
                     // Create item
-                    std::string query = sql->get_backend()->add_column(
-                        old_entity.name(), new_field.name(),
-                        new_field.toSociType(), 0, 0);
+                    // Blobs are `bytea` on PostgreSQL, not SOCI's large object `oid`
+                    std::string query = new_field.type() == "blob"
+                                            ? std::format("ALTER TABLE {} ADD COLUMN {} {}", old_entity.name(),
+                                                          new_field.name(),
+                                                          getFieldType(new_field.type(), sql, new_field.precision()))
+                                            : sql->get_backend()->add_column(
+                                                old_entity.name(), new_field.name(),
+                                                new_field.toSociType(), 0, 0);
 
                     if (new_field.isPrimaryKey()) query += " PRIMARY KEY";
                     if (new_field.required()) query += " NOT NULL";
@@ -574,7 +621,8 @@ namespace mb {
                         if (db_type == "sqlite3") {
                             throw MantisException(500,
                                                   "Adding foreign key constraints to existing tables is not supported on SQLite databases. "
-                                                  "SQLite has limited ALTER TABLE support and requires table recreation for foreign key changes.");
+                                                  "SQLite has limited ALTER TABLE support and requires table recreation for foreign key changes; "
+                                                  "send the update with `?online=true` to have the table rebuilt.");
                         }
 
                         auto table = old_entity.name();
@@ -626,7 +674,25 @@ namespace mb {
             }
 
             // --------- Handle View Query Changes -------------- //
-            if (old_entity.type() == "view" && old_entity.viewQuery() != new_entity.viewQuery()) {
+            const auto &old_mat = old_entity.materialization();
+            const auto &new_mat = new_entity.materialization();
+            if (old_entity.type() == "view" && (old_mat.enabled || new_mat.enabled)) {
+                // A materialized view's table is rebuilt from the query, renames included
+                if (old_entity.viewQuery() != new_entity.viewQuery() || old_entity.name() != new_entity.name() ||
+                    old_mat.enabled != new_mat.enabled || old_mat.refreshKey != new_mat.refreshKey) {
+                    if (old_mat.enabled) {
+                        *sql << "DROP TABLE IF EXISTS " + old_entity.name();
+                        *sql << "DROP VIEW IF EXISTS " + ViewMaterialization::sourceOf(old_entity.name());
+                    } else {
+                        *sql << "DROP VIEW IF EXISTS " + old_entity.name();
+                    }
+                    *sql << new_entity.toDDL();
+                    for (const auto &stmt: new_entity.materializedDDL())
+                        *sql << stmt;
+                    for (const auto &idx_ddl: new_entity.indexDDL())
+                        *sql << idx_ddl;
+                }
+            } else if (old_entity.type() == "view" && old_entity.viewQuery() != new_entity.viewQuery()) {
                 *sql << "DROP VIEW IF EXISTS " + old_entity.name();
                 *sql << "CREATE VIEW " + new_entity.name() + " AS " + new_entity.viewQuery();
             }
@@ -637,7 +703,7 @@ namespace mb {
             }
 
             // --------- Handle Name Changes -------------------- //
-            if (old_entity.name() != new_entity.name()) {
+            if (old_entity.name() != new_entity.name() && !(old_mat.enabled || new_mat.enabled)) {
                 std::string old_table_name = old_entity.name();
                 std::string new_table_name = new_entity.name();
 
@@ -693,6 +759,16 @@ namespace mb {
                 // (which follow pattern fk_<referencing_table>_<column>) don't need to change.
             }
 
+            // --------- Handle Searchable, Geo and Archived Fields ------- //
+            if (old_entity.name() != new_entity.name()) {
+                EntitySearch::drop(old_entity.name(), *sql);
+                EntityGeo::drop(old_entity.name(), *sql);
+                if (old_entity.type() != "view") EntityArchive::rename(old_entity.name(), new_entity.name(), *sql);
+            }
+            EntitySearch::sync(new_entity, *sql);
+            EntityGeo::sync(new_entity, *sql);
+            EntityArchive::sync(new_entity, *sql);
+
             // Get updated timestamp
             std::time_t t = time(nullptr);
             std::tm updated_tm = toUtcTime(t);
@@ -758,7 +834,10 @@ namespace mb {
 
     void EntitySchema::dropTable(const MantisBase &app, const std::string &table_id) {
         TRACE_METHOD();
-        const auto sql = app.db().session();
+        if (SchemaMigrations::active(table_id))
+            throw MantisException(409, "This entity is migrating online; cancel the migration first.");
+
+        const auto sql = app.db().writeSession();
         soci::transaction tr(*sql);
 
         try {
@@ -778,10 +857,16 @@ namespace mb {
             // Remove from DB
             *sql << "DELETE FROM mb_tables WHERE id = :id", soci::use(table_id);
 
-            if (entity_type == "view") {
+            if (entity_type == "view" && schema.value("materialized", false)) {
+                *sql << "DROP TABLE IF EXISTS " + entity_name;
+                *sql << "DROP VIEW IF EXISTS " + ViewMaterialization::sourceOf(entity_name);
+            } else if (entity_type == "view") {
                 *sql << "DROP VIEW IF EXISTS " + entity_name;
             } else {
                 *sql << "DROP TABLE IF EXISTS " + entity_name;
+                EntitySearch::drop(entity_name, *sql);
+                EntityGeo::drop(entity_name, *sql);
+                EntityArchive::drop(entity_name, *sql);
 
                 // Drop hooks for this table
                 MantisBase::instance().rt().dropDbHooks(entity_name, sql);
@@ -794,6 +879,9 @@ namespace mb {
             app.router().removeSchemaCache(entity_name);
 
             tr.commit();
+
+            // The other shards go once no schema names them
+            if (const auto shards = schema.value("shards", 1); shards > 1) app.shards().drop(entity_name, shards);
         } catch (const MantisException &e) {
             tr.rollback();
             LogOrigin::entitySchemaCritical("Drop Error", fmt::format("Error dropping table schema: {}", e.what()));
@@ -2,6 +2,9 @@
 #include "../../../include/mantisbase/utils/utils.h"
 #include "../../../include/mantisbase/core/exceptions.h"
 #include "../../../include/mantisbase/utils/soci_wrappers.h"
+#include "../../../include/mantisbase/core/vector_index.h"
+
+#include <format>
 
 namespace mb {
     EntitySchemaField::EntitySchemaField(std::string field_name, std::string field_type)
@@ -56,6 +59,13 @@ namespace mb {
             setPrecision(field_schema["precision"].get<int>());
         }
 
+        if (field_schema.contains("dim")) {
+            if (!field_schema["dim"].is_number_integer())
+                throw MantisException(400, "Expected an integer for field property `dim`.");
+
+            setDim(field_schema["dim"].get<int>());
+        }
+
         if (field_schema.contains("required")) {
             if (!field_schema["required"].is_boolean())
                 throw MantisException(400, "Expected a bool for field property `required`.");
@@ -87,6 +97,22 @@ namespace mb {
             setIsUnique(field_schema["unique"].get<bool>());
         }
 
+        // Full-text Search Flag
+        if (field_schema.contains("searchable")) {
+            if (!field_schema["searchable"].is_boolean())
+                throw MantisException(400, "Expected a bool for field property `searchable`.");
+
+            setIsSearchable(field_schema["searchable"].get<bool>());
+        }
+
+        // Compressed Storage Flag
+        if (field_schema.contains("compress")) {
+            if (!field_schema["compress"].is_boolean())
+                throw MantisException(400, "Expected a bool for field property `compress`.");
+
+            setCompress(field_schema["compress"].get<bool>());
+        }
+
         // Constraints Object
         if (field_schema.contains("constraints")) {
             if (!(field_schema["constraints"].is_object() || field_schema["constraints"].is_null()))
@@ -169,6 +195,17 @@ namespace mb {
         return *this;
     }
 
+    int EntitySchemaField::dim() const {
+        return m_dim;
+    }
+
+    EntitySchemaField &EntitySchemaField::setDim(const int dim) {
+        if (dim < 1 || dim > static_cast<int>(VectorIndex::MAX_DIM))
+            throw MantisException(400, std::format("Invalid dim `{}`. Must be 1 to {}.", dim, VectorIndex::MAX_DIM));
+        m_dim = dim;
+        return *this;
+    }
+
     bool EntitySchemaField::required() const {
         return m_required;
     }
@@ -205,6 +242,24 @@ namespace mb {
         return *this;
     }
 
+    bool EntitySchemaField::isSearchable() const {
+        return m_isSearchable;
+    }
+
+    EntitySchemaField &EntitySchemaField::setIsSearchable(const bool searchable) {
+        m_isSearchable = searchable;
+        return *this;
+    }
+
+    bool EntitySchemaField::compress() const {
+        return m_compress;
+    }
+
+    EntitySchemaField &EntitySchemaField::setCompress(const bool compress) {
+        m_compress = compress;
+        return *this;
+    }
+
     bool EntitySchemaField::isForeignKey() const {
         return !m_foreignKey.empty()
         && m_foreignKey.contains("entity")
@@ -329,10 +384,22 @@ namespace mb {
             json_obj["precision"] = m_precision;
         }
 
+        if (m_type == "vector") {
+            json_obj["dim"] = m_dim;
+        }
+
         if (isForeignKey()) {
             json_obj["foreign_key"] = m_foreignKey;
         }
 
+        if (m_isSearchable) {
+            json_obj["searchable"] = true;
+        }
+
+        if (m_compress) {
+            json_obj["compress"] = true;
+        }
+
         return json_obj;
     }
 
@@ -366,7 +433,9 @@ namespace mb {
             return soci::db_blob;
         if (type == "bool")
             return soci::db_uint16;
-        if (type == "json" || type == "string" || type == "file" || type == "files")
+        // Vectors and points are text, see VectorIndex::encode() and EntityGeo::encode()
+        if (type == "json" || type == "string" || type == "file" || type == "files" || type == "vector" ||
+            type == "geo_point")
             return soci::db_string;
 
         throw MantisException(400, "Unsupported field type `" + type + "`");
@@ -375,6 +444,18 @@ namespace mb {
     std::optional<std::string> EntitySchemaField::validate() const {
         if (m_name.empty()) return "Entity field name is empty";
         if (m_type.empty()) return "Entity field type is empty";
+        if (m_isSearchable && m_type != "string" && m_type != "xml")
+            return std::format("Field `{}` is a `{}`; only `string` and `xml` fields can be searchable", m_name, m_type);
+        if (m_compress && m_type != "string" && m_type != "xml" && m_type != "json")
+            return std::format("Field `{}` is a `{}`; only `string`, `xml` and `json` fields can be compressed",
+                               m_name, m_type);
+        if (m_compress && (m_isUnique || m_primaryKey || m_isSearchable))
+            return std::format("Compressed field `{}` can't be unique, searchable or a primary key", m_name);
+        if (m_type == "vector" && m_dim == 0) return std::format("Vector field `{}` needs a `dim`", m_name);
+        if (m_type == "vector" && (m_isUnique || m_primaryKey))
+            return std::format("Vector field `{}` can't be unique or a primary key", m_name);
+        if (m_type == "geo_point" && (m_isUnique || m_primaryKey))
+            return std::format("Geo field `{}` can't be unique or a primary key", m_name);
         return std::nullopt;
     }
 
@@ -1,5 +1,9 @@
 #include "../../include/mantisbase/core/models/entity_schema_routes.h"
 #include "../../include/mantisbase/core/models/entity_schema.h"
+#include "../../include/mantisbase/core/schema_migrations.h"
+#include "../../include/mantisbase/core/materialized_views.h"
+#include "../../include/mantisbase/core/file_serving.h"
+#include "../../include/mantisbase/core/keyset_page.h"
 #include "../../include/mantisbase/mantisbase.h"
 
 namespace mb {
@@ -49,12 +53,27 @@ namespace mb {
     HandlerFn schemaGetManyHandler() {
         return [](MantisRequest &req, MantisResponse &res) {
             try {
-                const auto tables = EntitySchema::listTables(req.mApp());
-                res.sendJSON(200, {
-                    {"data", tables},
-                    {"error", ""},
-                    {"status", 200}
-                });
+                // A page at a time, read as asked; the whole listing is the cached one below
+                if (KeysetPage::requested(req)) {
+                    const auto page = KeysetPage::fromQuery(req);
+                    res.sendJSON(200, {
+                        {"data", EntitySchema::listTables(req.mApp(), {{"pagination", {
+                                                                  {"limit", page.limit}, {"after", page.after}}}})},
+                        {"error", ""},
+                        {"status", 200}
+                    });
+                    return;
+                }
+
+                // Polled by the admin UI and SDK generators; a 304 while the schemas stay the same
+                const auto listing = req.mApp().router().schemaListing(req.mApp());
+                res.setHeader("ETag", listing->etag);
+                res.setHeader("Cache-Control", "no-cache");
+                if (FileServing::ifNoneMatch(req.getHeaderValue("If-None-Match"), listing->etag)) {
+                    res.sendEmpty(304);
+                    return;
+                }
+                res.sendRawJSON(200, std::string(listing->body));
             } catch (const MantisException &e) {
                 res.sendJSON(e.code(), {
                     {"data", json::object()},
@@ -135,6 +154,16 @@ namespace mb {
                     return;
                 }
 
+                // Rebuilt in the background instead; progress is on .../migration
+                if (const auto online = req.getQueryParamValue("online"); online == "true" || online == "1") {
+                    res.sendJSON(202, {
+                        {"data", req.mApp().schemaMigrations().begin(schema_id, body)},
+                        {"error", ""},
+                        {"status", 202}
+                    });
+                    return;
+                }
+
                 auto _schema = EntitySchema::updateTable(req.mApp(), schema_id, body);
                 res.sendJSON(200, {
                     {"data", _schema},
@@ -182,5 +211,78 @@ namespace mb {
             }
         };
     }
-}
 
+    HandlerFn schemaMigrationGetHandler() {
+        return [](const MantisRequest &req, const MantisResponse &res) {
+            try {
+                const auto schema_id = schemaIdFromPathParam(trim(req.getPathParamValue("schema_name_or_id")));
+                res.sendJSON(200, {
+                    {"data", SchemaMigrations::status(schema_id)},
+                    {"error", ""},
+                    {"status", 200}
+                });
+            } catch (const MantisException &e) {
+                res.sendJSON(e.code(), {
+                    {"data", json::object()},
+                    {"error", e.what()},
+                    {"status", e.code()}
+                });
+            } catch (const std::exception &e) {
+                res.sendJSON(500, {
+                    {"data", json::object()},
+                    {"error", e.what()},
+                    {"status", 500}
+                });
+            }
+        };
+    }
+
+    HandlerFn schemaMigrationDeleteHandler() {
+        return [](const MantisRequest &req, const MantisResponse &res) {
+            try {
+                const auto schema_id = schemaIdFromPathParam(trim(req.getPathParamValue("schema_name_or_id")));
+                req.mApp().schemaMigrations().cancel(schema_id);
+                res.sendEmpty();
+            } catch (const MantisException &e) {
+                res.sendJSON(e.code(), {
+                    {"status", e.code()},
+                    {"error", e.what()},
+                    {"data", json::object()}
+                });
+            } catch (const std::exception &e) {
+                res.sendJSON(500, {
+                    {"status", 500},
+                    {"error", e.what()},
+                    {"data", json::object()}
+                });
+            }
+        };
+    }
+
+    HandlerFn schemaRefreshHandler() {
+        return [](const MantisRequest &req, const MantisResponse &res) {
+            try {
+                const auto schema_id = schemaIdFromPathParam(trim(req.getPathParamValue("schema_name_or_id")));
+                const auto name = EntitySchema::getTable(req.mApp(), schema_id)["schema"]["name"].get<std::string>();
+                req.mApp().materializedViews().refresh(name);
+                res.sendJSON(200, {
+                    {"data", {{"entity", name}, {"refreshed", tmToStr(toUtcTime(std::time(nullptr)))}}},
+                    {"error", ""},
+                    {"status", 200}
+                });
+            } catch (const MantisException &e) {
+                res.sendJSON(e.code(), {
+                    {"data", json::object()},
+                    {"error", e.what()},
+                    {"status", e.code()}
+                });
+            } catch (const std::exception &e) {
+                res.sendJSON(500, {
+                    {"data", json::object()},
+                    {"error", e.what()},
+                    {"status", 500}
+                });
+            }
+        };
+    }
+}
@@ -0,0 +1,173 @@
+/**
+ * @file entity_search.cpp
+ * @brief Implementation for @see entity_search.h
+ */
+
+#include "../../../include/mantisbase/core/models/entity_search.h"
+#include "../../../include/mantisbase/core/models/entity_schema.h"
+#include "../../../include/mantisbase/core/exceptions.h"
+#include "../../../include/mantisbase/utils/utils.h"
+
+#include <soci/soci.h>
+
+#include <algorithm>
+#include <format>
+#include <map>
+#include <sstream>
+
+namespace mb {
+    namespace {
+        std::vector<std::string> searchFields(const EntitySchema &schema) {
+            std::vector<std::string> fields;
+            for (const auto &field: schema.fields())
+                if (field.isSearchable()) fields.push_back(sqlIdentifier(field.name()));
+            return fields;
+        }
+
+        std::string joined(const std::vector<std::string> &fields, const std::string &prefix = "") {
+            std::string list;
+            for (const auto &field: fields) list += (list.empty() ? "" : ", ") + prefix + field;
+            return list;
+        }
+
+        /// The document PostgreSQL indexes, and searches with the same expression
+        std::string pgDocument(const std::vector<std::string> &fields) {
+            std::string text;
+            for (const auto &field: fields)
+                text += std::format("{}coalesce({}::text, '')", text.empty() ? "" : " || ' ' || ", field);
+            return std::format("to_tsvector('simple', {})", text);
+        }
+
+        /// The FTS5 table and the triggers keeping it current, keyed by name. No
+        /// trailing `;`, so each reads back from sqlite_master as written.
+        std::map<std::string, std::string> sqliteObjects(const std::string &entity,
+                                                         const std::vector<std::string> &fields) {
+            const auto fts = std::format("mb_{}_fts", entity);
+            const auto columns = joined(fields);
+            const auto olds = joined(fields, "OLD."), news = joined(fields, "NEW.");
+            const auto remove = std::format("INSERT INTO {0}({0}, rowid, {1}) VALUES ('delete', OLD.rowid, {2}); ",
+                                            fts, columns, olds);
+            const auto add = std::format("INSERT INTO {0}(rowid, {1}) VALUES (NEW.rowid, {2}); ", fts, columns, news);
+            return {
+                {
+                    fts, std::format("CREATE VIRTUAL TABLE {} USING fts5({}, content='{}', "
+                                     "tokenize='unicode61 remove_diacritics 2')", fts, columns, entity)
+                },
+                {
+                    fts + "_insert", std::format("CREATE TRIGGER {0}_insert AFTER INSERT ON {1} BEGIN {2}END",
+                                                 fts, entity, add)
+                },
+                {
+                    fts + "_delete", std::format("CREATE TRIGGER {0}_delete AFTER DELETE ON {1} BEGIN {2}END",
+                                                 fts, entity, remove)
+                },
+                {
+                    // Updates leaving the searched text alone don't touch the index
+                    fts + "_update", std::format("CREATE TRIGGER {0}_update AFTER UPDATE OF {1} ON {2} BEGIN {3}{4}END",
+                                                 fts, columns, entity, remove, add)
+                }
+            };
+        }
+    }
+
+    void EntitySearch::sync(const EntitySchema &schema, soci::session &sql) {
+        const auto entity = sqlIdentifier(schema.name());
+        const auto fields = schema.type() == "view" ? std::vector<std::string>{} : searchFields(schema);
+
+        if (const auto db_type = sql.get_backend_name(); db_type == "sqlite3") {
+            if (fields.empty()) {
+                drop(entity, sql);
+                return;
+            }
+
+            // Triggers go with the table, so a rebuilt table (online migration,
+            // rename) shows up as missing or rewritten triggers
+            const auto objects = sqliteObjects(entity, fields);
+            const auto fts = std::format("mb_{}_fts", entity);
+            const auto ins = fts + "_insert", del = fts + "_delete", upd = fts + "_update";
+            std::map<std::string, std::string> existing;
+            const soci::rowset<soci::row> rows = (sql.prepare
+                << "SELECT name, sql FROM sqlite_master WHERE name IN (:t, :i, :d, :u)",
+                soci::use(fts, "t"), soci::use(ins, "i"), soci::use(del, "d"), soci::use(upd, "u"));
+            for (const auto &row: rows) existing.emplace(row.get<std::string>(0), row.get<std::string>(1));
+            if (existing == objects) return;
+
+            drop(entity, sql);
+            for (const auto &[name, ddl]: objects) sql << ddl;
+            // Index the rows already there
+            sql << std::format("INSERT INTO {0}({0}) VALUES ('rebuild')", fts);
+        }
+#if MB_HAS_POSTGRESQL
+        else if (db_type == "postgresql") {
+            // The fields indexed are kept in the index's comment
+            const auto index = std::format("mb_{}_search", entity);
+            const auto want = joined(fields);
+            std::string have;
+            soci::indicator ind = soci::i_null;
+            sql << "SELECT obj_description(to_regclass(:idx), 'pg_class')", soci::use(index), soci::into(have, ind);
+            if (ind == soci::i_ok && have == want) return;
+            if (ind != soci::i_ok && fields.empty()) return;
+
+            sql << std::format("DROP INDEX IF EXISTS {}", index);
+            if (fields.empty()) return;
+            sql << std::format("CREATE INDEX {} ON {} USING GIN (({}))", index, entity, pgDocument(fields));
+            sql << std::format("COMMENT ON INDEX {} IS '{}'", index, want);
+        }
+#endif
+    }
+
+    void EntitySearch::drop(const std::string &entity, soci::session &sql) {
+        const auto name = sqlIdentifier(entity);
+        if (const auto db_type = sql.get_backend_name(); db_type == "sqlite3") {
+            for (const auto *suffix: {"insert", "delete", "update"})
+                sql << std::format("DROP TRIGGER IF EXISTS mb_{}_fts_{}", name, suffix);
+            sql << std::format("DROP TABLE IF EXISTS mb_{}_fts", name);
+        }
+#if MB_HAS_POSTGRESQL
+        else if (db_type == "postgresql") {
+            sql << std::format("DROP INDEX IF EXISTS mb_{}_search", name);
+        }
+#endif
+    }
+
+    EntitySearch::Query EntitySearch::query(const std::string &db_type, const std::string &entity,
+                                            const std::vector<std::string> &fields) {
+        const auto table = sqlIdentifier(entity);
+        if (db_type == "sqlite3") {
+            // FTS5's `rank` is bm25(), lower for better matches
+            return {
+                std::format(" JOIN (SELECT rowid AS mb_doc, rank AS mb_rank FROM mb_{0}_fts WHERE mb_{0}_fts MATCH "
+                            ":search) mb_hits ON mb_hits.mb_doc = {0}.rowid", table),
+                "",
+                "mb_hits.mb_rank"
+            };
+        }
+        if (db_type == "postgresql") {
+            std::vector<std::string> columns;
+            for (const auto &field: fields) columns.push_back(sqlIdentifier(field));
+            const auto document = pgDocument(columns);
+            return {
+                ", plainto_tsquery('simple', :search) mb_q",
+                std::format("{} @@ mb_q", document),
+                std::format("-ts_rank({}, mb_q)", document)
+            };
+        }
+        throw MantisException(400, std::format("Full-text search isn't supported on `{}` databases.", db_type));
+    }
+
+    std::string EntitySearch::bindValue(const std::string &db_type, const std::string &text) {
+        std::istringstream words(text);
+        std::string value, word;
+        while (words >> word) {
+            if (!value.empty()) value += ' ';
+            if (db_type != "sqlite3") {
+                value += word;
+                continue;
+            }
+            value += '"';
+            for (const char c: word) value += c == '"' ? std::string("\"\"") : std::string(1, c);
+            value += '"';
+        }
+        return value;
+    }
+}
@@ -0,0 +1,172 @@
+/**
+ * @file entity_shards.cpp
+ * @brief Implementation for @see entity_shards.h
+ */
+
+#include "../../../include/mantisbase/core/models/entity_shards.h"
+#include "../../../include/mantisbase/core/models/entity_schema.h"
+#include "../../../include/mantisbase/core/database.h"
+#include "../../../include/mantisbase/core/exceptions.h"
+#include "../../../include/mantisbase/core/logger/logger.h"
+#include "../../../include/mantisbase/core/tenants.h"
+#include "../../../include/mantisbase/mantisbase.h"
+#include "../../../include/mantisbase/utils/utils.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <soci/soci.h>
+
+namespace mb {
+    namespace {
+        thread_local Database *t_current = nullptr;
+
+        /// The tenant whose shards the calling thread reaches; empty for the application's
+        std::string currentTenant() {
+            const auto *tenant = Tenants::current();
+            return tenant ? tenant->id : std::string{};
+        }
+    }
+
+    EntityShards::Options EntityShards::Options::fromEnv() {
+        Options options;
+        if (const auto pool = safe_stoi(getEnvOrDefault("MB_SHARD_POOL_SIZE", ""), 0); pool > 0)
+            options.poolSize = pool;
+        return options;
+    }
+
+    EntityShards::Scope::Scope(std::shared_ptr<Database> db) : m_db(std::move(db)), m_previous(t_current) {
+        if (m_db) t_current = m_db.get();
+    }
+
+    EntityShards::Scope::~Scope() {
+        t_current = m_previous;
+    }
+
+    EntityShards::EntityShards(const MantisBase &app, Options options) : m_app(app), m_options(options) {}
+
+    EntityShards::~EntityShards() {
+        closeAll();
+    }
+
+    int EntityShards::shardOf(const std::string_view id, const int shards) {
+        if (shards <= 1) return 0;
+        std::uint64_t hash = 14695981039346656037ull;
+        for (const auto c: id) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ull;
+        }
+        return static_cast<int>(hash % static_cast<std::uint64_t>(shards));
+    }
+
+    std::string EntityShards::fileOf(const std::string &data_dir, const std::string &tenant, const std::string &entity,
+                                     const int index) {
+        auto dir = joinPaths(data_dir, "shards");
+        if (!tenant.empty()) dir = joinPaths(dir.string(), tenant);
+        return joinPaths(dir.string(), std::format("{}.{}.db", entity, index)).string();
+    }
+
+    std::optional<std::string> EntityShards::validate(const EntitySchema &schema) {
+        if (schema.shards() < 1 || schema.shards() > MAX_SHARDS)
+            return std::format("Entity schema `shards` must be between 1 and {}!", MAX_SHARDS);
+        if (schema.shards() == 1) return std::nullopt;
+        if (schema.app().dbType() != "sqlite3")
+            return "Entity schema `shards` is supported on SQLite only!";
+        if (schema.type() != "base")
+            return "Only `base` entities can be sharded!";
+        if (schema.archive().enabled())
+            return "A sharded entity can't be archived!";
+
+        for (const auto &field: schema.fields()) {
+            const auto name = field.name();
+            if (field.isUnique() && !field.isPrimaryKey())
+                return "Field `" + name + "` of a sharded entity can't be unique";
+            if (field.isForeignKey())
+                return "Field `" + name + "` of a sharded entity can't reference another entity";
+            if (field.isSearchable())
+                return "Field `" + name + "` of a sharded entity can't be searchable";
+            if (const auto type = field.type(); type == "file" || type == "files" || type == "geo_point" ||
+                                                type == "vector")
+                return std::format("Sharded entities don't support `{}` fields, found `{}`", type, name);
+        }
+        for (const auto &index: schema.indexes()) {
+            if (index.unique)
+                return "Index `" + index.name + "` of a sharded entity can't be unique";
+        }
+        return std::nullopt;
+    }
+
+    std::shared_ptr<Database> EntityShards::db(const std::string &entity, const int index) {
+        // Shard 0 lives in the tenant's or application's database; not ours to close
+        if (index == 0) {
+            auto *tenant = Tenants::current();
+            return {std::shared_ptr<Database>{}, tenant ? tenant->db.get() : &m_app.rootDb()};
+        }
+
+        const auto tenant = currentTenant();
+        const auto file = fileOf(m_app.dataDir(), tenant, entity, index);
+        std::lock_guard lock(m_mutex);
+        if (const auto it = m_open.find(file); it != m_open.end()) return it->second;
+
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(file).parent_path(), ec);
+        const auto label = tenant.empty() ? std::format("{}.{}", entity, index)
+                                          : std::format("{}/{}.{}", tenant, entity, index);
+        auto db = std::make_shared<Database>(m_app, label, m_options.poolSize, file);
+        if (!db->connect(""))
+            throw MantisException(500, std::format("Shard {} of `{}` failed to open.", index, entity));
+        LogOrigin::info("Entity Shards", std::format("Opened shard {} of `{}`", index, entity));
+        m_open.emplace(file, db);
+        return db;
+    }
+
+    void EntityShards::create(const EntitySchema &schema) {
+        // Files left by an entity of that name whose creation didn't commit
+        drop(schema.name(), schema.shards());
+        try {
+            for (int i = 1; i < schema.shards(); ++i) {
+                const auto sql = this->db(schema.name(), i)->writeSession();
+                soci::transaction tr(*sql);
+                *sql << schema.toDDL();
+                for (const auto &idx_ddl: schema.indexDDL()) *sql << idx_ddl;
+                tr.commit();
+            }
+        } catch (const MantisException &) {
+            drop(schema.name(), schema.shards());
+            throw;
+        } catch (const std::exception &e) {
+            drop(schema.name(), schema.shards());
+            throw MantisException(500, std::format("Creating the shards of `{}` failed: {}", schema.name(), e.what()));
+        }
+    }
+
+    void EntityShards::drop(const std::string &entity, const int shards) {
+        const auto tenant = currentTenant();
+        for (int i = 1; i < shards; ++i) {
+            const auto file = fileOf(m_app.dataDir(), tenant, entity, i);
+            std::shared_ptr<Database> db;
+            {
+                std::lock_guard lock(m_mutex);
+                if (const auto it = m_open.find(file); it != m_open.end()) {
+                    db = std::move(it->second);
+                    m_open.erase(it);
+                }
+            }
+            // Requests still in a scope on it close it as they end; SQLite drops an unlinked file then
+            db.reset();
+            std::error_code ec;
+            for (const auto *suffix: {"", "-wal", "-shm"})
+                std::filesystem::remove(file + suffix, ec);
+        }
+    }
+
+    void EntityShards::closeAll() {
+        std::unordered_map<std::string, std::shared_ptr<Database>> open;
+        std::lock_guard lock(m_mutex);
+        open.swap(m_open);
+    }
+
+    Database *EntityShards::current() {
+        return t_current;
+    }
+}
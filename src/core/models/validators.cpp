@@ -3,8 +3,8 @@
 //
 
 #include "../../../include/mantisbase/core/models/validators.h"
+#include "../../../include/mantisbase/core/models/entity_field_ops.h"
 
-#include <regex>
 
 #include "../../../include/mantisbase/mantisbase.h"
 #include "../../../include/mantisbase/core/exceptions.h"
@@ -13,38 +13,90 @@
 #include <soci/soci.h>
 
 namespace mb {
-    std::unordered_map<std::string, json> Validators::presets = {
+    namespace {
+        bool isAsciiAlpha(const char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+        bool isAsciiDigit(const char c) { return c >= '0' && c <= '9'; }
+
+        /// `^[a-zA-Z0-9._%+\-]+@[a-zA-Z0-9.\-]+\.[a-zA-Z]{2,}$`
+        bool matchEmail(const std::string_view value) {
+            const auto at = value.find('@');
+            if (at == 0 || at == std::string_view::npos) return false;
+
+            for (const char c: value.substr(0, at)) {
+                if (!isAsciiAlpha(c) && !isAsciiDigit(c) && c != '.' && c != '_' && c != '%' && c != '+' && c != '-')
+                    return false;
+            }
+
+            const auto domain = value.substr(at + 1);
+            for (const char c: domain) {
+                if (!isAsciiAlpha(c) && !isAsciiDigit(c) && c != '.' && c != '-') return false;
+            }
+
+            // The TLD holds no dot, so it starts after the last one
+            const auto dot = domain.rfind('.');
+            if (dot == 0 || dot == std::string_view::npos || domain.size() - dot - 1 < 2) return false;
+            for (const char c: domain.substr(dot + 1)) {
+                if (!isAsciiAlpha(c)) return false;
+            }
+            return true;
+        }
+
+        /// `^\S{8,}$`
+        bool matchPassword(const std::string_view value) {
+            if (value.size() < 8) return false;
+            for (const char c: value) {
+                if (c == ' ' || (c >= '\t' && c <= '\r')) return false;
+            }
+            return true;
+        }
+
+        /// `^(?=.*[a-z])(?=.*[A-Z])(?=.*\d)(?=.*[\W_]).{8,}$`
+        bool matchPasswordLong(const std::string_view value) {
+            if (value.size() < 8) return false;
+            bool lower = false, upper = false, digit = false, special = false;
+            for (const char c: value) {
+                if (c == '\n' || c == '\r') return false;
+                if (c >= 'a' && c <= 'z') lower = true;
+                else if (c >= 'A' && c <= 'Z') upper = true;
+                else if (isAsciiDigit(c)) digit = true;
+                else special = true;
+            }
+            return lower && upper && digit && special;
+        }
+    }
+
+    const std::unordered_map<std::string_view, Validators::Preset> Validators::presets = {
         {
-            "email", json{
-                {"regex", R"(^[a-zA-Z0-9._%+\-]+@[a-zA-Z0-9.\-]+\.[a-zA-Z]{2,}$)"},
-                {"error", "Email format is not valid"}
+            "email", {
+                R"(^[a-zA-Z0-9._%+\-]+@[a-zA-Z0-9.\-]+\.[a-zA-Z]{2,}$)",
+                "Email format is not valid",
+                matchEmail
             }
         },
         {
-            "password", json{
-                {"regex", R"(^\S{8,}$)"},
-                {"error", "Expected 8 chars minimum with no whitespaces."}
+            "password", {
+                R"(^\S{8,}$)",
+                "Expected 8 chars minimum with no whitespaces.",
+                matchPassword
             }
         },
         {
-            "password-long", json{
-                {"regex", R"(^(?=.*[a-z])(?=.*[A-Z])(?=.*\d)(?=.*[\W_]).{8,}$)"},
-                {
-                    "error",
-                    "Expected at least one lowercase, uppercase, digit, special character, and a min 8 chars."
-                }
+            "password-long", {
+                R"(^(?=.*[a-z])(?=.*[A-Z])(?=.*\d)(?=.*[\W_]).{8,}$)",
+                "Expected at least one lowercase, uppercase, digit, special character, and a min 8 chars.",
+                matchPasswordLong
             }
         }
     };
 
-    std::optional<json> Validators::findPreset(const std::string &key) {
-        if (key.empty()) return std::nullopt;
-
-        const auto n_key = key.starts_with("@") ? key.substr(1) : key;
-        if (const auto it = presets.find(n_key); it != presets.end()) {
-            return it->second;
-        }
+    const Validators::Preset *Validators::preset(std::string_view key) {
+        if (key.starts_with("@")) key.remove_prefix(1);
+        if (const auto it = presets.find(key); it != presets.end()) return &it->second;
+        return nullptr;
+    }
 
+    std::optional<json> Validators::findPreset(const std::string &key) {
+        if (const auto *p = preset(key)) return json{{"regex", p->regex}, {"error", p->error}};
         return std::nullopt;
     }
 
@@ -54,16 +106,12 @@ namespace mb {
         if (key.empty())
             throw MantisException(500, "Validator key can't be empty!");
 
-        const auto v = findPreset(key).value_or(json::object());
-        if (v.empty())
+        const auto *p = preset(key);
+        if (!p)
             throw MantisException(500, "Validator key is not available!");
 
-        // Since we have a regex string, lets validate it and return if it fails ...
-        const auto &reg = v["regex"].get<std::string>();
-        const auto &err = v["error"].get<std::string>();
-
-        if (const std::regex r_pattern(reg); !std::regex_match(value, r_pattern)) {
-            throw MantisException(500, err);
+        if (!p->match(value)) {
+            throw MantisException(500, p->error);
         }
 
         // If we reach here, then, all was validated correctly!
@@ -110,7 +158,7 @@ namespace mb {
 
             if (field_type == "string" && body.value(field_name, "").size() > static_cast<size_t>(max_value)) {
                 return
-                        std::format("Minimum Constraint Failed: Char length for `{}` should be >= {}",
+                        std::format("Maximum Constraint Failed: Char length for `{}` should be <= {}",
                                     field_name, static_cast<int>(max_value));
             }
 
@@ -142,7 +190,7 @@ namespace mb {
 
             return std::nullopt;
         } catch (const std::exception &e) {
-            LogOrigin::trace("Validation Exception", fmt::format("Required Constraints Exception: {}", e.what()));
+            MB_LOG_TRACE(LogOrigin::trace, "Validation Exception", fmt::format("Required Constraints Exception: {}", e.what()));
             return std::nullopt;
         }
     }
@@ -154,17 +202,12 @@ namespace mb {
             const auto &field_name = field["name"].get<std::string>();
             const auto &field_type = field["type"].get<std::string>();
 
-            // Check if we have a regex or typed validator from our store
-            const auto opt = Validators::findPreset(pattern);
-            if (opt.has_value() && field_type == "string") {
-                // Since we have a regex string, lets validate it and return if it fails ...
-                const auto &reg = opt.value()["regex"].get<std::string>();
-                const auto &err = opt.value()["error"].get<std::string>();
-
-                auto f = body.at(field_name).get<std::string>();
-                if (const std::regex r_pattern(reg); !std::regex_match(f, r_pattern)) {
-                    return std::nullopt;
-                }
+            // Check if we have a typed validator from our store; a missing value is the required check's call
+            const auto *p = preset(pattern);
+            const auto value = body.find(field_name);
+            if (p && field_type == "string" && value != body.end() && value->is_string() &&
+                !p->match(value->get_ref<const std::string &>())) {
+                return std::format("Field `{}`: {}", field_name, p->error);
             }
         }
 
@@ -284,6 +327,99 @@ namespace mb {
         return std::nullopt;
     }
 
+    ValidationPlan ValidationPlan::compile(const std::vector<json> &fields) {
+        TRACE_MB_FUNC();
+        ValidationPlan plan;
+        for (const auto &field: fields) {
+            if (!field.contains("name") || !field["name"].is_string()) continue;
+            const auto &name = field["name"].get_ref<const std::string &>();
+            // Skip system generated fields
+            if (name == "id" || name == "created" || name == "updated" || plan.index.contains(name)) continue;
+
+            Check check;
+            check.field = &field;
+            check.name = name;
+
+            const auto type = field.value("type", "");
+            if (type == "string") check.type = Check::Type::String;
+            else if (type == "double" || type == "int") check.type = Check::Type::Number;
+
+            static const json no_constraints = json::object();
+            const auto &constraints = field.contains("constraints") && field["constraints"].is_object()
+                                          ? field["constraints"]
+                                          : no_constraints;
+            const auto constraint = [&](const char *key) -> const json * {
+                const auto it = constraints.find(key);
+                return it == constraints.end() || it->is_null() ? nullptr : &*it;
+            };
+
+            // A value the database defaults satisfies `required` when left out
+            check.required = field.value("required", false) && !constraint("default_value");
+            if (const auto *min = constraint("min_value"); min && min->is_number()) check.min = min->get<double>();
+            if (const auto *max = constraint("max_value"); max && max->is_number()) check.max = max->get<double>();
+            if (const auto *v = constraint("validator"); v && v->is_string() && check.type == Check::Type::String)
+                check.preset = Validators::preset(v->get_ref<const std::string &>());
+
+            if (field.contains("foreign_key") && field["foreign_key"].is_object()) {
+                const auto &fk = field["foreign_key"];
+                check.refEntity = fk.contains("entity") && fk["entity"].is_string() ? fk["entity"].get<std::string>() : "";
+                check.refField = fk.contains("field") && fk["field"].is_string() ? fk["field"].get<std::string>() : "id";
+            }
+
+            if (check.required) plan.required.push_back(plan.checks.size());
+            plan.index.emplace(check.name, plan.checks.size());
+            plan.checks.push_back(std::move(check));
+        }
+        return plan;
+    }
+
+    const ValidationPlan::Check *ValidationPlan::find(const std::string_view name) const {
+        const auto it = index.find(name);
+        return it == index.end() ? nullptr : &checks[it->second];
+    }
+
+    std::optional<std::string> ValidationPlan::run(const Check &check, const json &value) {
+        // REQUIRED CONSTRAINT CHECK; the rest only judge values that are there
+        if (value.is_null()) {
+            if (check.required) return std::format("Field `{}` is required", check.name);
+            return std::nullopt;
+        }
+
+        // MINIMUM AND MAXIMUM CONSTRAINT CHECKS
+        if (check.type == Check::Type::String && value.is_string()) {
+            const auto length = value.get_ref<const std::string &>().size();
+            if (check.min && length < static_cast<size_t>(*check.min))
+                return std::format("Minimum Constraint Failed: Char length for `{}` should be >= {}",
+                                   check.name, static_cast<int>(*check.min));
+            if (check.max && length > static_cast<size_t>(*check.max))
+                return std::format("Maximum Constraint Failed: Char length for `{}` should be <= {}",
+                                   check.name, static_cast<int>(*check.max));
+        } else if (check.type == Check::Type::Number && value.is_number()) {
+            const auto number = value.get<double>();
+            if (check.min && number < *check.min)
+                return std::format("Minimum Constraint Failed: Value for `{}` should be >= {}", check.name, *check.min);
+            if (check.max && number > *check.max)
+                return std::format("Maximum Constraint Failed: Value for `{}` should be <= {}", check.name, *check.max);
+        }
+
+        // VALIDATOR CONSTRAINT CHECK
+        if (check.preset && value.is_string() && !check.preset->match(value.get_ref<const std::string &>()))
+            return std::format("Field `{}`: {}", check.name, check.preset->error);
+
+        // FOREIGN KEY CONSTRAINT CHECK; an empty reference is for `required` to judge
+        if (!check.refEntity.empty() && !(value.is_string() && value.get_ref<const std::string &>().empty())) {
+            const auto &app = MantisBase::instance();
+            if (!app.hasEntity(check.refEntity))
+                return std::format("Foreign Key ref table `{}` does not exist!", check.refEntity);
+
+            if (const auto &entity = app.entity(check.refEntity); !entity.hasField(check.refField))
+                return std::format("Foreign key ref column `{}` does not exist in `{}` entity!",
+                                   check.refField, check.refEntity);
+        }
+
+        return std::nullopt;
+    }
+
     std::optional<std::string> Validators::validateRequestBody(const Entity &entity, const json &body) {
         TRACE_MB_FUNC();
         // If the table type is of view type, check that the SQL is passed in ...
@@ -291,27 +427,23 @@ namespace mb {
             if (const auto err = viewTypeSQLCheck(body); err.has_value()) return err;
         } else // For `base` and `auth` types
         {
-            // Create default base object
-            for (const auto &field: entity.fields()) {
-                // Skip system generated fields
-                if (const auto &name = field["name"].get<std::string>();
-                    name == "id" || name == "created" || name == "updated")
-                    continue;
-
-                // REQUIRED CONSTRAINT CHECK
-                if (const auto err = requiredConstraintCheck(field, body); err.has_value()) return err;
+            if (!body.is_object()) return "Request body must be a JSON object.";
 
-                // MINIMUM CONSTRAINT CHECK
-                if (const auto err = minimumConstraintCheck(field, body); err.has_value()) return err;
+            // Only the fields sent, then the required ones that weren't
+            const auto &plan = entity.validationPlan();
+            for (const auto &[key, val]: body.items()) {
+                const auto *check = plan.find(key);
+                if (!check) continue;
 
-                // MAXIMUM CONSTRAINT CHECK
-                if (const auto err = maximumConstraintCheck(field, body); err.has_value()) return err;
+                if (FieldOps::isOperator(val))
+                    return std::format("`{}`: Operators only apply to updates.", key);
 
-                // VALIDATOR CONSTRAINT CHECK
-                if (const auto err = validatorConstraintCheck(field, body); err.has_value()) return err;
+                if (const auto err = ValidationPlan::run(*check, val); err.has_value()) return err;
+            }
 
-                // FOREIGN KEY CONSTRAINT CHECK
-                if (const auto err = foreignKeyConstraintCheck(field, body); err.has_value()) return err;
+            for (const auto i: plan.required) {
+                if (const auto &check = plan.checks[i]; !body.contains(check.name))
+                    return std::format("Field `{}` is required", check.name);
             }
         }
 
@@ -326,34 +458,24 @@ namespace mb {
             if (const auto err = viewTypeSQLCheck(body); err.has_value()) return err;
         } else // For `base` and `auth` types
         {
-            // Create default base object
+            if (!body.is_object()) return "Request body must be a JSON object.";
+
+            const auto &plan = entity.validationPlan();
             for (const auto &[key, val]: body.items()) {
-                if (!entity.hasField(key)) {
+                const auto *check = plan.find(key);
+                if (!check) {
+                    // System generated fields have no check
+                    if (entity.fieldDef(key)) continue;
                     return std::format("Unknown field named `{}`!", key);
                 }
 
-                // Get field data
-                const auto field = entity.field(key).value();
-
-                // Skip system generated fields
-                if (const auto &name = field["name"].get<std::string>();
-                    name == "id" || name == "created" || name == "updated")
+                // Operators change the stored value, which the constraints below can't see
+                if (FieldOps::isOperator(val)) {
+                    if (const auto err = FieldOps::check(*check->field, val); err.has_value()) return err;
                     continue;
+                }
 
-                // REQUIRED CONSTRAINT CHECK
-                if (const auto err = requiredConstraintCheck(field, body); err.has_value()) return err;
-
-                // MINIMUM CONSTRAINT CHECK
-                if (const auto err = minimumConstraintCheck(field, body); err.has_value()) return err;
-
-                // MAXIMUM CONSTRAINT CHECK
-                if (const auto err = maximumConstraintCheck(field, body); err.has_value()) return err;
-
-                // VALIDATOR CONSTRAINT CHECK
-                if (const auto err = validatorConstraintCheck(field, body); err.has_value()) return err;
-
-                // FOREIGN KEY CONSTRAINT CHECK
-                if (const auto err = foreignKeyConstraintCheck(field, body); err.has_value()) return err;
+                if (const auto err = ValidationPlan::run(*check, val); err.has_value()) return err;
             }
         }
 
@@ -0,0 +1,206 @@
+/**
+ * @file multipart_upload.cpp
+ * @brief Implementation for @see multipart_upload.h
+ */
+
+#include "../../include/mantisbase/core/multipart_upload.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/utils/crypto_utils.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <trantor/net/EventLoop.h>
+
+#include <charconv>
+#include <format>
+#include <utility>
+
+namespace mb {
+    namespace fs = std::filesystem;
+
+    namespace {
+        std::size_t sizeFromEnv(const std::string &key, const std::size_t fallback) {
+            const auto value = getEnvOrDefault(key, "");
+            unsigned long long parsed = 0;
+            const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), parsed);
+            if (value.empty() || ec != std::errc{} || end != value.data() + value.size() || parsed == 0)
+                return fallback;
+            return static_cast<std::size_t>(parsed);
+        }
+    }
+
+    MultipartUpload::Limits MultipartUpload::Limits::fromEnv() {
+        Limits limits;
+        limits.maxBody = sizeFromEnv("MB_MAX_BODY_SIZE", limits.maxBody);
+        limits.maxUpload = sizeFromEnv("MB_MAX_UPLOAD_SIZE", limits.maxUpload);
+        limits.maxFile = sizeFromEnv("MB_MAX_FILE_SIZE", limits.maxUpload);
+        return limits;
+    }
+
+    MultipartUpload::MultipartUpload(fs::path staging_dir, const Limits limits, FileIo *io)
+        : m_dir(std::move(staging_dir)), m_limits(limits), m_io(io),
+          m_loop(trantor::EventLoop::getEventLoopOfCurrentThread()) {}
+
+    MultipartUpload::~MultipartUpload() {
+        abort();
+    }
+
+    void MultipartUpload::abort() {
+        if (m_file.is_open()) m_file.close();
+        m_hasher.reset();
+        m_inPart = false;
+        closeWriter();
+
+        {
+            // Files still being written are removed once their writes are done
+            std::lock_guard lock(m_staging->mutex);
+            m_staging->whenWritten = nullptr;
+            if (m_staging->open > 0) {
+                for (auto &item: m_items)
+                    if (!item.staged_path.empty()) m_staging->orphans.push_back(std::exchange(item.staged_path, {}));
+            }
+        }
+        discard(m_items, m_io);
+        m_items.clear();
+    }
+
+    void MultipartUpload::beginPart(std::string name, std::string filename, std::string content_type) {
+        endPart();
+
+        FormDataItem item;
+        item.name = std::move(name);
+        item.filename = std::move(filename);
+        item.content_type = std::move(content_type);
+
+        if (!item.filename.empty()) {
+            item.staged_path = (m_dir / (generateShortId(24) + ".part")).string();
+            if (m_io && m_io->running()) {
+                try {
+                    m_writer = m_io->open(item.staged_path);
+                } catch (const MantisException &) {
+                    throw MantisException(500, "Failed to stage `" + item.filename + "` for writing.");
+                }
+            } else {
+                m_file.open(item.staged_path, std::ios::binary | std::ios::trunc);
+                if (!m_file.is_open())
+                    throw MantisException(500, "Failed to stage `" + item.filename + "` for writing.");
+            }
+            m_hasher = std::make_unique<Sha256Hasher>();
+        }
+
+        m_items.push_back(std::move(item));
+        m_inPart = true;
+    }
+
+    void MultipartUpload::append(const char *data, const std::size_t size) {
+        if (!m_inPart || size == 0) return;
+
+        m_bytes += size;
+        if (m_bytes > m_limits.maxUpload)
+            throw MantisException(413, std::format("Upload is larger than {} bytes.", m_limits.maxUpload));
+
+        auto &item = m_items.back();
+        item.size += size;
+        if (item.staged_path.empty()) {
+            if (item.size > m_limits.maxField)
+                throw MantisException(413, std::format("Field `{}` is larger than {} bytes.",
+                                                       item.name, m_limits.maxField));
+            item.content.append(data, size);
+            return;
+        }
+
+        if (item.size > m_limits.maxFile)
+            throw MantisException(413, std::format("File `{}` is larger than {} bytes.",
+                                                   item.filename, m_limits.maxFile));
+        if (m_writer) {
+            // Queued; an earlier write that failed shows up here
+            m_writer->write(data, size);
+            if (m_writer->error())
+                throw MantisException(500, "Failed to write `" + item.filename + "` to disk.");
+        } else {
+            m_file.write(data, static_cast<std::streamsize>(size));
+            if (!m_file)
+                throw MantisException(500, "Failed to write `" + item.filename + "` to disk.");
+        }
+        m_hasher->update({data, size});
+    }
+
+    std::vector<FormDataItem> MultipartUpload::finish() {
+        endPart();
+        std::unique_lock lock(m_staging->mutex);
+        m_staging->closed.wait(lock, [this] { return m_staging->open == 0; });
+        if (m_staging->error)
+            throw MantisException(500, "Failed to write an uploaded file to disk: " + m_staging->error.message());
+        return std::exchange(m_items, {});
+    }
+
+    void MultipartUpload::whenWritten(std::function<void()> done) {
+        endPart();
+        {
+            std::lock_guard lock(m_staging->mutex);
+            if (m_staging->open > 0) {
+                m_staging->whenWritten = std::move(done);
+                return;
+            }
+        }
+        done();
+    }
+
+    void MultipartUpload::endPart() {
+        if (!m_inPart) return;
+        m_inPart = false;
+
+        if (m_writer) {
+            m_items.back().sha256 = m_hasher->hexDigest();
+            m_hasher.reset();
+            closeWriter();
+            return;
+        }
+
+        if (!m_file.is_open()) return;
+        m_file.close();
+        auto &item = m_items.back();
+        item.sha256 = m_hasher->hexDigest();
+        m_hasher.reset();
+        if (m_file.fail())
+            throw MantisException(500, "Failed to write `" + item.filename + "` to disk.");
+    }
+
+    void MultipartUpload::closeWriter() {
+        if (!m_writer) return;
+        {
+            std::lock_guard lock(m_staging->mutex);
+            ++m_staging->open;
+        }
+        // Holds the staging state, not the upload, which may be gone by the time the writes are
+        std::exchange(m_writer, nullptr)->close([staging = m_staging, io = m_io, loop = m_loop](
+                                                    const std::error_code ec) {
+                std::function<void()> done;
+                std::vector<std::string> orphans;
+                {
+                    std::lock_guard lock(staging->mutex);
+                    if (ec && !staging->error) staging->error = ec;
+                    if (--staging->open == 0) {
+                        done = std::move(staging->whenWritten);
+                        orphans = std::move(staging->orphans);
+                    }
+                }
+                staging->closed.notify_all();
+                if (!orphans.empty()) io->remove(std::move(orphans));
+                if (!done) return;
+                if (loop) loop->queueInLoop(std::move(done));
+                else done();
+            });
+    }
+
+    void MultipartUpload::discard(std::vector<FormDataItem> &items, FileIo *io) {
+        std::vector<std::string> paths;
+        for (auto &item: items) {
+            if (!item.staged_path.empty()) paths.push_back(std::exchange(item.staged_path, {}));
+        }
+        if (io) return io->remove(std::move(paths));
+        for (const auto &path: paths) {
+            std::error_code ec;
+            fs::remove(path, ec);
+        }
+    }
+}
@@ -3,8 +3,9 @@
 #include "mantisbase/utils/crypto_utils.h"
 #include "mantisbase/utils/utils.h"
 #include "mantisbase/core/auth.h"
+#include "mantisbase/core/oauth_client.h"
 
-#include <drogon/HttpClient.h>
+#include <format>
 
 namespace mb {
     std::string OAuthManager::getEncryptionKey() {
@@ -21,7 +22,7 @@ namespace mb {
     json OAuthManager::buildAuthorizeUrl(const std::string &entity_name,
                                           const std::string &provider_name,
                                           const std::string &redirect_uri) {
-        auto sql = MantisBase::instance().db().session();
+        auto sql = MantisBase::instance().db().writeSession();
 
         soci::row provider_row;
         *sql << "SELECT p.id, p.client_id, p.client_secret_encrypted, p.discovery_url, p.scopes "
@@ -94,7 +95,7 @@ namespace mb {
                                        const std::string &provider_name,
                                        const std::string &code,
                                        const std::string &state) {
-        auto sql = MantisBase::instance().db().session();
+        auto sql = MantisBase::instance().db().writeSession();
         auto now = getCurrentTimestampUTC();
 
         // Validate state
@@ -248,7 +249,7 @@ namespace mb {
     bool OAuthManager::unlinkAccount(const std::string &entity_name,
                                      const std::string &user_id,
                                      const std::string &provider_name) {
-        auto sql = MantisBase::instance().db().session();
+        auto sql = MantisBase::instance().db().writeSession();
         *sql << "DELETE FROM mb_oauth_accounts "
                 "WHERE entity_name = :entity AND user_id = :uid "
                 "AND provider_id = (SELECT id FROM mb_oauth_providers WHERE name = :name)",
@@ -260,14 +261,32 @@ namespace mb {
     }
 
     json OAuthManager::getLinkedAccounts(const std::string &entity_name,
-                                         const std::string &user_id) {
+                                         const std::string &user_id, const KeysetPage &page) {
+        return listAccounts(page, {{"entity_name", entity_name}, {"user_id", user_id}});
+    }
+
+    json OAuthManager::listAccounts(const KeysetPage &page, const json &filters) {
+        // One user's links seek idx_oauth_accounts_owner; the others walk the id order
+        std::string where = "oa.id > :after";
+        soci::values vals;
+        vals.set("after", page.after);
+        for (const auto *key: {"entity_name", "user_id"}) {
+            if (const auto value = filters.value(key, std::string{}); !value.empty()) {
+                where += std::format(" AND oa.{0} = :{0}", key);
+                vals.set(key, value);
+            }
+        }
+        if (const auto provider = filters.value("provider", std::string{}); !provider.empty()) {
+            where += " AND p.name = :provider";
+            vals.set("provider", provider);
+        }
+
         auto sql = MantisBase::instance().db().session();
-        soci::rowset<soci::row> rows = (sql->prepare <<
-            "SELECT oa.id, p.name, oa.provider_user_id, oa.linked_at "
+        soci::rowset<soci::row> rows = (sql->prepare << std::format(
+            "SELECT oa.id, p.name, oa.provider_user_id, oa.linked_at, oa.entity_name, oa.user_id "
             "FROM mb_oauth_accounts oa "
             "JOIN mb_oauth_providers p ON p.id = oa.provider_id "
-            "WHERE oa.entity_name = :entity AND oa.user_id = :uid",
-            soci::use(entity_name), soci::use(user_id));
+            "WHERE {} ORDER BY oa.id LIMIT {}", where, page.fetch()), soci::use(vals));
 
         json result = json::array();
         for (const auto &row : rows) {
@@ -275,10 +294,12 @@ namespace mb {
                 {"id", row.get<std::string>(0)},
                 {"provider", row.get<std::string>(1)},
                 {"provider_user_id", row.get<std::string>(2)},
-                {"linked_at", row.get<std::string>(3)}
+                {"linked_at", row.get<std::string>(3)},
+                {"entity_name", row.get<std::string>(4)},
+                {"user_id", row.get<std::string>(5)}
             });
         }
-        return result;
+        return page.envelope(std::move(result));
     }
 
     json OAuthManager::getProviders(const std::string &entity_name) {
@@ -304,7 +325,7 @@ namespace mb {
     }
 
     json OAuthManager::addProvider(const json &provider_data) {
-        auto sql = MantisBase::instance().db().session();
+        auto sql = MantisBase::instance().db().writeSession();
         auto id = generateTimeBasedId();
         auto name = provider_data.at("name").get<std::string>();
         auto client_id = provider_data.at("client_id").get<std::string>();
@@ -332,7 +353,7 @@ namespace mb {
     }
 
     json OAuthManager::updateProvider(const std::string &provider_id, const json &updates) {
-        auto sql = MantisBase::instance().db().session();
+        auto sql = MantisBase::instance().db().writeSession();
 
         if (updates.contains("client_id")) {
             auto val = updates["client_id"].get<std::string>();
@@ -364,7 +385,7 @@ namespace mb {
     }
 
     bool OAuthManager::removeProvider(const std::string &provider_id) {
-        auto sql = MantisBase::instance().db().session();
+        auto sql = MantisBase::instance().db().writeSession();
 
         // Only allow removing non-preset providers
         int is_preset = 0;
@@ -382,11 +403,19 @@ namespace mb {
         return affected > 0;
     }
 
-    json OAuthManager::listProviders() {
+    json OAuthManager::listProviders(const KeysetPage &page, const json &filters) {
+        std::string where = "id > :after";
+        soci::values vals;
+        vals.set("after", page.after);
+        if (filters.contains("enabled")) {
+            where += " AND enabled = :enabled";
+            vals.set("enabled", filters.value("enabled", true) ? 1 : 0);
+        }
+
         auto sql = MantisBase::instance().db().session();
-        soci::rowset<soci::row> rows = (sql->prepare <<
+        soci::rowset<soci::row> rows = (sql->prepare << std::format(
             "SELECT id, name, client_id, discovery_url, scopes, is_preset, enabled "
-            "FROM mb_oauth_providers");
+            "FROM mb_oauth_providers WHERE {} ORDER BY id LIMIT {}", where, page.fetch()), soci::use(vals));
 
         json result = json::array();
         for (const auto &row : rows) {
@@ -400,12 +429,12 @@ namespace mb {
                 {"enabled", row.get<int>(6) == 1}
             });
         }
-        return result;
+        return page.envelope(std::move(result));
     }
 
     json OAuthManager::enableProviderForEntity(const std::string &entity_name,
                                                const std::string &provider_id) {
-        auto sql = MantisBase::instance().db().session();
+        auto sql = MantisBase::instance().db().writeSession();
         auto id = generateTimeBasedId();
 
         // Check if already exists
@@ -429,7 +458,7 @@ namespace mb {
 
     bool OAuthManager::disableProviderForEntity(const std::string &entity_name,
                                                 const std::string &provider_id) {
-        auto sql = MantisBase::instance().db().session();
+        auto sql = MantisBase::instance().db().writeSession();
         *sql << "UPDATE mb_entity_oauth_config SET enabled = 0 "
                 "WHERE entity_name = :entity AND provider_id = :pid",
             soci::use(entity_name), soci::use(provider_id);
@@ -439,18 +468,8 @@ namespace mb {
     }
 
     json OAuthManager::discoverOIDC(const std::string &discovery_url) {
-        // Use Drogon's HttpClient synchronously
-        auto client = drogon::HttpClient::newHttpClient(discovery_url);
-        auto req = drogon::HttpRequest::newHttpRequest();
-        req->setMethod(drogon::Get);
-
-        auto [result, resp] = client->sendRequest(req, 5.0);
-
-        if (result != drogon::ReqResult::Ok || !resp || resp->statusCode() != drogon::k200OK) {
-            throw std::runtime_error("OIDC discovery request failed for " + discovery_url);
-        }
-
-        return json::parse(std::string(resp->body()));
+        // Cached per URL, so only the first flow after the TTL waits on the provider
+        return OAuthClient::instance().document(discovery_url);
     }
 
     json OAuthManager::exchangeCode(const std::string &token_endpoint,
@@ -459,12 +478,6 @@ namespace mb {
                                     const std::string &client_id,
                                     const std::string &client_secret,
                                     const std::string &pkce_verifier) {
-        auto client = drogon::HttpClient::newHttpClient(token_endpoint);
-        auto req = drogon::HttpRequest::newHttpRequest();
-        req->setMethod(drogon::Post);
-        req->setContentTypeString("application/x-www-form-urlencoded");
-        req->addHeader("Accept", "application/json");
-
         std::string body = "grant_type=authorization_code"
             "&code=" + code +
             "&redirect_uri=" + redirect_uri +
@@ -472,16 +485,14 @@ namespace mb {
             "&client_secret=" + client_secret +
             "&code_verifier=" + pkce_verifier;
 
-        req->setBody(body);
-
-        auto [result, resp] = client->sendRequest(req, 10.0);
+        // Over the provider's kept-alive connection, on the OAuth client's loop
+        const auto resp = OAuthClient::instance().postForm(token_endpoint, body);
 
-        if (result != drogon::ReqResult::Ok || !resp) {
-            throw std::runtime_error("Token exchange request failed");
+        auto token_data = json::parse(resp.body, nullptr, false);
+        if (token_data.is_discarded() || !token_data.is_object()) {
+            throw std::runtime_error("Token exchange failed with status " + std::to_string(resp.status));
         }
 
-        auto token_data = json::parse(std::string(resp->body()));
-
         if (token_data.contains("error")) {
             throw std::runtime_error("Token exchange error: " + token_data.value("error_description", token_data.value("error", "unknown")));
         }
@@ -0,0 +1,210 @@
+/**
+ * @file oauth_client.cpp
+ * @brief Implementation for @see oauth_client.h
+ */
+
+#include "../../include/mantisbase/core/oauth_client.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <drogon/HttpClient.h>
+#include <trantor/net/EventLoopThread.h>
+
+#include <algorithm>
+#include <cctype>
+#include <future>
+
+namespace mb {
+    OAuthClient::Options OAuthClient::Options::fromEnv() {
+        Options o;
+        if (const auto ttl = safe_stoi(getEnvOrDefault("MB_OAUTH_CACHE_TTL", ""), -1); ttl >= 0)
+            o.ttl = std::chrono::seconds(ttl);
+        return o;
+    }
+
+    OAuthClient::OAuthClient(Options options)
+        : m_opts(options), m_loop(std::make_unique<trantor::EventLoopThread>("mb-oauth")) {
+        m_loop->run();
+    }
+
+    OAuthClient::~OAuthClient() {
+        // Clients belong to the loop; drop them before it stops
+        std::lock_guard lock(m_mutex);
+        m_clients.clear();
+    }
+
+    OAuthClient &OAuthClient::instance() {
+        static OAuthClient client(Options::fromEnv());
+        return client;
+    }
+
+    std::pair<std::string, std::string> OAuthClient::splitUrl(const std::string &url) {
+        const auto scheme = url.find("://");
+        if (scheme == std::string::npos || (!url.starts_with("http://") && !url.starts_with("https://")) ||
+            scheme + 3 >= url.size())
+            throw MantisException(400, "OAuth provider URLs must be http(s), got `" + url + "`");
+
+        const auto path = url.find_first_of("/?#", scheme + 3);
+        if (path == std::string::npos) return {url, "/"};
+
+        auto rest = url.substr(path, url.find('#', path) - path);
+        if (rest.empty() || rest[0] != '/') rest.insert(0, "/");
+        return {url.substr(0, path), rest};
+    }
+
+    std::optional<std::chrono::seconds> OAuthClient::maxAge(const std::string &cache_control) {
+        std::optional<std::chrono::seconds> age;
+        for (auto directive: splitString(cache_control, ",")) {
+            directive = trim(directive);
+            toLowerCase(directive);
+            if (directive == "no-store" || directive == "no-cache") return std::chrono::seconds(0);
+            if (directive.starts_with("max-age=")) {
+                if (const auto n = safe_stoi(directive.substr(8), -1); n >= 0) age = std::chrono::seconds(n);
+            }
+        }
+        return age;
+    }
+
+    std::shared_ptr<drogon::HttpClient> OAuthClient::clientFor(const std::string &origin) {
+        std::lock_guard lock(m_mutex);
+        auto &client = m_clients[origin];
+        if (!client) client = drogon::HttpClient::newHttpClient(origin, m_loop->getLoop());
+        return client;
+    }
+
+    void OAuthClient::sendAsync(const std::string &url, const std::optional<std::string> &form, const double timeout,
+                                ResponseCallback done) {
+        const auto [origin, path] = splitUrl(url);
+
+        const auto req = drogon::HttpRequest::newHttpRequest();
+        req->setPathEncode(false);
+        req->setPath(path);
+        req->addHeader("Accept", "application/json");
+        if (form) {
+            req->setMethod(drogon::Post);
+            req->setContentTypeString("application/x-www-form-urlencoded");
+            req->setBody(*form);
+        } else {
+            req->setMethod(drogon::Get);
+        }
+
+        clientFor(origin)->sendRequest(req, [done = std::move(done)](const drogon::ReqResult result,
+                                                                     const drogon::HttpResponsePtr &resp) {
+            if (result != drogon::ReqResult::Ok || !resp) return done({});
+            done({static_cast<int>(resp->statusCode()), std::string(resp->body()),
+                  resp->getHeader("cache-control")});
+        }, timeout);
+    }
+
+    void OAuthClient::getAsync(const std::string &url, const double timeout, ResponseCallback done) {
+        sendAsync(url, std::nullopt, timeout, std::move(done));
+    }
+
+    void OAuthClient::postFormAsync(const std::string &url, const std::string &form, const double timeout,
+                                    ResponseCallback done) {
+        sendAsync(url, form, timeout, std::move(done));
+    }
+
+    void OAuthClient::documentAsync(const std::string &url, DocumentCallback done) {
+        {
+            std::unique_lock lock(m_mutex);
+            if (const auto it = m_documents.find(url); it != m_documents.end() && it->second.expires > Clock::now()) {
+                auto doc = it->second.doc;
+                lock.unlock();
+                done({std::move(doc), ""});
+                return;
+            }
+
+            auto &waiting = m_waiting[url];
+            waiting.push_back(std::move(done));
+            if (waiting.size() > 1) return; // Someone's request answers this one too
+        }
+
+        try {
+            getAsync(url, m_opts.documentTimeout, [this, url](const Response &resp) {
+                if (resp.status != 200) {
+                    return settle(url, {std::nullopt, resp.status
+                                                          ? fmt::format("`{}` answered {}", url, resp.status)
+                                                          : fmt::format("`{}` didn't answer", url)});
+                }
+
+                auto doc = nlohmann::json::parse(resp.body, nullptr, false);
+                if (doc.is_discarded() || !doc.is_object())
+                    return settle(url, {std::nullopt, fmt::format("`{}` didn't answer with a JSON object", url)});
+
+                const auto ttl = std::min(maxAge(resp.cacheControl).value_or(m_opts.ttl), m_opts.maxTtl);
+                remember(url, doc, ttl);
+                settle(url, {std::move(doc), ""});
+            });
+        } catch (const std::exception &e) {
+            settle(url, {std::nullopt, e.what()});
+        }
+    }
+
+    void OAuthClient::settle(const std::string &url, const Document &doc) {
+        std::vector<DocumentCallback> waiting;
+        auto answer = doc;
+        {
+            std::lock_guard lock(m_mutex);
+            if (const auto it = m_waiting.find(url); it != m_waiting.end()) {
+                waiting = std::move(it->second);
+                m_waiting.erase(it);
+            }
+            if (!answer.json) {
+                if (const auto it = m_documents.find(url); it != m_documents.end()) {
+                    LogOrigin::authWarn("OAuth", fmt::format("{}; using the copy cached before", doc.error));
+                    answer = {it->second.doc, ""};
+                }
+            }
+        }
+        for (const auto &done: waiting) done(answer);
+    }
+
+    nlohmann::json OAuthClient::document(const std::string &url) {
+        assertNotOnLoop();
+        auto promise = std::make_shared<std::promise<Document>>();
+        auto result = promise->get_future();
+        documentAsync(url, [promise](const Document &doc) { promise->set_value(doc); });
+
+        auto doc = result.get();
+        if (!doc.json) throw MantisException(502, "OAuth provider request failed", doc.error);
+        return std::move(*doc.json);
+    }
+
+    OAuthClient::Response OAuthClient::postForm(const std::string &url, const std::string &form) {
+        assertNotOnLoop();
+        auto promise = std::make_shared<std::promise<Response>>();
+        auto result = promise->get_future();
+        postFormAsync(url, form, m_opts.tokenTimeout, [promise](const Response &resp) { promise->set_value(resp); });
+
+        auto resp = result.get();
+        if (resp.status == 0) throw MantisException(502, fmt::format("`{}` didn't answer", url));
+        return resp;
+    }
+
+    void OAuthClient::remember(const std::string &url, nlohmann::json doc, const std::chrono::seconds ttl) {
+        std::lock_guard lock(m_mutex);
+        m_documents[url] = {std::move(doc), Clock::now() + ttl};
+    }
+
+    void OAuthClient::clear() {
+        std::lock_guard lock(m_mutex);
+        m_documents.clear();
+    }
+
+    std::size_t OAuthClient::cached() const {
+        std::lock_guard lock(m_mutex);
+        return m_documents.size();
+    }
+
+    std::size_t OAuthClient::clients() const {
+        std::lock_guard lock(m_mutex);
+        return m_clients.size();
+    }
+
+    void OAuthClient::assertNotOnLoop() const {
+        if (m_loop->getLoop()->isInLoopThread())
+            throw MantisException(500, "Blocking OAuth request on the OAuth client's own loop");
+    }
+}
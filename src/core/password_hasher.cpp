@@ -0,0 +1,266 @@
+/**
+ * @file password_hasher.cpp
+ * @brief Implementation for @see password_hasher.h
+ */
+
+#include "../../include/mantisbase/core/password_hasher.h"
+#include "../../include/mantisbase/core/auth.h"
+#include "../../include/mantisbase/core/database.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/core/worker_pool.h"
+#include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/utils/crypto_utils.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <format>
+#include <future>
+#include <thread>
+#include <vector>
+#include <bcrypt-cpp/bcrypt.h>
+#include <soci/soci.h>
+
+#ifdef MB_ARGON2_ENABLED
+#include <argon2.h>
+#endif
+
+namespace mb {
+    namespace {
+        constexpr unsigned CALIBRATION_COST = 8;
+        constexpr std::uint32_t ARGON2_HASH_BYTES = 32;
+
+        /// Best of a few runs, so a context switch doesn't inflate the estimate
+        template<typename F>
+        double bestMs(F &&f) {
+            double best = 0;
+            for (int i = 0; i < 3; ++i) {
+                const auto start = std::chrono::steady_clock::now();
+                f();
+                const auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).
+                        count();
+                if (i == 0 || ms < best) best = ms;
+            }
+            return std::max(best, 0.01);
+        }
+
+        /// The cost of a `$2a$NN$...` hash, 0 if it isn't one
+        unsigned bcryptCostOf(const std::string &hash) {
+            if (hash.size() < 7 || hash[0] != '$' || hash[1] != '2' || hash[3] != '$' || hash[6] != '$') return 0;
+            if (!std::isdigit(static_cast<unsigned char>(hash[4])) || !std::isdigit(static_cast<unsigned char>(hash[5])))
+                return 0;
+            return static_cast<unsigned>((hash[4] - '0') * 10 + (hash[5] - '0'));
+        }
+
+        bool isArgon2id(const std::string &hash) {
+            return hash.starts_with("$argon2id$");
+        }
+    }
+
+    PasswordHasher::Options PasswordHasher::Options::fromEnv() {
+        Options o;
+        // Half the cores at most, leaving the rest to requests that aren't logging in
+        o.workers = std::clamp<std::size_t>(std::thread::hardware_concurrency() / 2, 1, 4);
+        if (const auto workers = safe_stoi(getEnvOrDefault("MB_PASSWORD_WORKERS", ""), 0); workers > 0)
+            o.workers = static_cast<std::size_t>(workers);
+        if (const auto queued = safe_stoi(getEnvOrDefault("MB_PASSWORD_QUEUE", ""), -1); queued >= 0)
+            o.maxQueued = static_cast<std::size_t>(queued);
+
+        auto algorithm = trim(getEnvOrDefault("MB_PASSWORD_ALGO", "bcrypt"));
+        toLowerCase(algorithm);
+        if (algorithm == "argon2id" && !argon2Available()) {
+            LogOrigin::warn("Passwords", "MB_PASSWORD_ALGO=argon2id needs a build with MB_ARGON2_ENABLED; using bcrypt");
+            algorithm = "bcrypt";
+        }
+        o.algorithm = algorithm == "argon2id" ? "argon2id" : "bcrypt";
+
+        if (const auto ms = safe_stoi(getEnvOrDefault("MB_PASSWORD_TARGET_MS", ""), 0); ms > 0)
+            o.target = std::chrono::milliseconds(ms);
+        if (const auto cost = safe_stoi(getEnvOrDefault("MB_BCRYPT_COST", ""), 0); cost > 0)
+            o.bcryptCost = static_cast<unsigned>(std::clamp(cost, 4, 31));
+        if (const auto kib = safe_stoi(getEnvOrDefault("MB_ARGON2_MEMORY_KB", ""), 0); kib >= 8)
+            o.argon2MemoryKiB = static_cast<std::uint32_t>(kib);
+        if (const auto t = safe_stoi(getEnvOrDefault("MB_ARGON2_ITERATIONS", ""), 0); t > 0)
+            o.argon2Iterations = static_cast<std::uint32_t>(t);
+        return o;
+    }
+
+    PasswordHasher::PasswordHasher(const Options options)
+        : m_opts(options), m_pool(std::make_unique<WorkerPool>("passwords")),
+          m_bcryptCost(options.bcryptCost ? options.bcryptCost : MIN_BCRYPT_COST),
+          m_argon2Iterations(options.argon2Iterations ? options.argon2Iterations : MIN_ARGON2_ITERATIONS) {}
+
+    PasswordHasher::~PasswordHasher() {
+        stop();
+    }
+
+    PasswordHasher &PasswordHasher::instance() {
+        static PasswordHasher hasher(Options::fromEnv());
+        return hasher;
+    }
+
+    void PasswordHasher::start() {
+        if (m_pool->isRunning()) return;
+        calibrate();
+        m_pool->start(m_opts.workers);
+    }
+
+    void PasswordHasher::stop() {
+        m_pool->stop();
+    }
+
+    void PasswordHasher::calibrate() {
+        const auto target = static_cast<double>(m_opts.target.count());
+
+        if (!useArgon2() && m_opts.bcryptCost == 0) {
+            const auto ms = bestMs([] { (void) bcrypt::generateHash("calibration", CALIBRATION_COST); });
+            const auto steps = std::lround(std::log2(target / ms));
+            m_bcryptCost = static_cast<unsigned>(std::clamp<long>(CALIBRATION_COST + steps, MIN_BCRYPT_COST,
+                                                                  MAX_BCRYPT_COST));
+            LogOrigin::info("Passwords", fmt::format("bcrypt cost {} (cost {} took {:.1f}ms, target {}ms)",
+                                                     m_bcryptCost.load(), CALIBRATION_COST, ms, m_opts.target.count()));
+        }
+
+#ifdef MB_ARGON2_ENABLED
+        if (useArgon2() && m_opts.argon2Iterations == 0) {
+            const auto ms = bestMs([this] {
+                std::vector<std::uint8_t> out(ARGON2_HASH_BYTES);
+                const std::string salt = "calibration-salt";
+                argon2id_hash_raw(1, m_opts.argon2MemoryKiB, m_opts.argon2Parallelism, "calibration", 11,
+                                  salt.data(), salt.size(), out.data(), out.size());
+            });
+            m_argon2Iterations = static_cast<std::uint32_t>(std::clamp<long>(
+                std::lround(target / ms), MIN_ARGON2_ITERATIONS, MAX_ARGON2_ITERATIONS));
+            LogOrigin::info("Passwords", fmt::format("argon2id t={} m={}KiB p={} (t=1 took {:.1f}ms, target {}ms)",
+                                                     m_argon2Iterations.load(), m_opts.argon2MemoryKiB,
+                                                     m_opts.argon2Parallelism, ms, m_opts.target.count()));
+        }
+#endif
+    }
+
+    bool PasswordHasher::argon2Available() {
+#ifdef MB_ARGON2_ENABLED
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool PasswordHasher::useArgon2() const {
+        return argon2Available() && m_opts.algorithm == "argon2id";
+    }
+
+    std::string PasswordHasher::hash(const std::string &password) {
+        return run<std::string>([this, &password] { return hashNow(password); });
+    }
+
+    bool PasswordHasher::verify(const std::string &password, const std::string &stored_hash) {
+        return run<bool>([this, &password, &stored_hash] { return verifyNow(password, stored_hash); });
+    }
+
+    bool PasswordHasher::needsRehash(const std::string &stored_hash) const {
+        if (isArgon2id(stored_hash)) {
+            if (!useArgon2()) return true;
+            unsigned m = 0, t = 0, p = 0;
+            if (std::sscanf(stored_hash.c_str(), "$argon2id$v=%*u$m=%u,t=%u,p=%u", &m, &t, &p) != 3) return false;
+            return m != m_opts.argon2MemoryKiB || t != m_argon2Iterations.load() || p != m_opts.argon2Parallelism;
+        }
+
+        const auto cost = bcryptCostOf(stored_hash);
+        if (cost == 0) return false;  // Not ours to judge
+        return useArgon2() || cost != m_bcryptCost.load();
+    }
+
+    void PasswordHasher::rehashLater(const std::string &entity, const std::string &id, const std::string &password,
+                                     const std::string &stored_hash) {
+        if (!m_pool->isRunning() || !needsRehash(stored_hash) || !admit()) return;
+
+        if (!m_pool->submit([this, entity, id, password, stored_hash] {
+            try {
+                const auto new_hash = hashNow(password);
+                const auto table = sqlIdentifier(entity);
+                MantisBase::instance().db().write([&](soci::session &sql) {
+                    // Only if unchanged since the login read it
+                    sql << std::format("UPDATE {} SET password = :new_hash WHERE id = :id AND password = :old_hash",
+                                       table), soci::use(new_hash, "new_hash"), soci::use(id, "id"),
+                            soci::use(stored_hash, "old_hash");
+                });
+                Auth::userCache().invalidate(entity, id);
+                ++m_rehashed;
+            } catch (const std::exception &e) {
+                LogOrigin::warn("Passwords", fmt::format("Rehashing the password of `{}` in `{}` failed: {}", id,
+                                                         entity, e.what()));
+            }
+            --m_inFlight;
+        })) {
+            --m_inFlight;
+        }
+    }
+
+    bool PasswordHasher::admit() {
+        // Queued plus running; running ones count so a full pool isn't mistaken for an idle queue
+        const auto limit = m_opts.workers + m_opts.maxQueued;
+        auto in_flight = m_inFlight.load();
+        do {
+            if (in_flight >= limit) return false;
+        } while (!m_inFlight.compare_exchange_weak(in_flight, in_flight + 1));
+        return true;
+    }
+
+    std::string PasswordHasher::hashNow(const std::string &password) const {
+#ifdef MB_ARGON2_ENABLED
+        if (useArgon2()) {
+            const auto salt = generateSecureRandom(16);
+            const auto t = m_argon2Iterations.load();
+            std::string encoded(argon2_encodedlen(t, m_opts.argon2MemoryKiB, m_opts.argon2Parallelism,
+                                                  static_cast<std::uint32_t>(salt.size()), ARGON2_HASH_BYTES,
+                                                  Argon2_id), '\0');
+            if (const auto rc = argon2id_hash_encoded(t, m_opts.argon2MemoryKiB, m_opts.argon2Parallelism,
+                                                      password.data(), password.size(), salt.data(), salt.size(),
+                                                      ARGON2_HASH_BYTES, encoded.data(), encoded.size());
+                rc != ARGON2_OK)
+                throw MantisException(500, "Password hashing failed", argon2_error_message(rc));
+            encoded.resize(encoded.find('\0'));
+            return encoded;
+        }
+#endif
+        return bcrypt::generateHash(password, m_bcryptCost.load());
+    }
+
+    bool PasswordHasher::verifyNow(const std::string &password, const std::string &stored_hash) const {
+        if (isArgon2id(stored_hash)) {
+#ifdef MB_ARGON2_ENABLED
+            return argon2id_verify(stored_hash.c_str(), password.data(), password.size()) == ARGON2_OK;
+#else
+            throw MantisException(500, "This password hash needs a build with MB_ARGON2_ENABLED.");
+#endif
+        }
+        return bcrypt::validatePassword(password, stored_hash);
+    }
+
+    template<typename T>
+    T PasswordHasher::run(std::function<T()> work) {
+        if (!m_pool->isRunning()) return work();
+
+        if (!admit()) {
+            ++m_rejected;
+            throw MantisException(429, "Too many password checks in progress, try again shortly.");
+        }
+
+        // The caller waits for the result, so the task may borrow its arguments
+        auto task = std::make_shared<std::packaged_task<T()>>(std::move(work));
+        auto result = task->get_future();
+        if (!m_pool->submit([this, task] {
+            (*task)();
+            --m_inFlight;
+        })) {
+            // Stopped meanwhile
+            --m_inFlight;
+            (*task)();
+        }
+        return result.get();
+    }
+}
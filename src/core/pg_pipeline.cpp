@@ -0,0 +1,181 @@
+/**
+ * @file pg_pipeline.cpp
+ * @brief Implementation for @see pg_pipeline.h
+ */
+
+#include "../../include/mantisbase/core/pg_pipeline.h"
+#include "../../include/mantisbase/core/metrics.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <soci/soci.h>
+#if MB_HAS_POSTGRESQL
+#include <soci/postgresql/soci-postgresql.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace mb {
+    namespace {
+        std::atomic<std::uint64_t> g_pipelines{0}, g_statements{0}, g_prepares{0};
+
+#if MB_HAS_POSTGRESQL && defined(LIBPQ_HAS_PIPELINING)
+        /// Names of the statements prepared on one connection, by SQL text.
+        struct Prepared {
+            int pid = 0; ///> Its backend; a reconnected PGconn at the same address starts over
+            std::unordered_map<std::string, std::string> names;
+            std::size_t next = 0;
+        };
+
+        std::mutex g_preparedMutex;
+        std::unordered_map<const PGconn *, Prepared> g_prepared;
+
+        /// One command written to the pipeline, and what its result answers.
+        struct Sent {
+            std::size_t statement;
+            bool prepare;     ///> A Parse of `name`, not the statement itself
+            std::string name; ///> Empty for an unnamed statement
+        };
+
+        /// Write up to MAX_DEPTH statements from `first` and a sync, then read their results into `rows`.
+        void runChunk(PGconn *conn, const std::vector<PgPipeline::Statement> &statements, const std::size_t first,
+                      const std::size_t end, std::vector<std::vector<std::string>> &rows, std::string &error) {
+            std::vector<Sent> sent;
+            sent.reserve(2 * (end - first));
+            const int pid = PQbackendPID(conn);
+            for (auto i = first; i < end; ++i) {
+                const auto &stmt = statements[i];
+                std::vector<const char *> values;
+                values.reserve(stmt.params.size());
+                for (const auto &p: stmt.params) values.push_back(p ? p->c_str() : nullptr);
+                const auto n = static_cast<int>(values.size());
+
+                std::string name;
+                bool prepare = false;
+                {
+                    std::lock_guard lock(g_preparedMutex);
+                    auto &prepared = g_prepared[conn];
+                    if (prepared.pid != pid) prepared = {pid, {}, 0};
+                    if (const auto it = prepared.names.find(stmt.sql); it != prepared.names.end()) {
+                        name = it->second;
+                    } else if (prepared.names.size() < PgPipeline::MAX_PREPARED) {
+                        // Taken now, so the chunk's other uses of it don't prepare it again
+                        name = std::format("mb_pl_{}", prepared.next++);
+                        prepared.names.emplace(stmt.sql, name);
+                        prepare = true;
+                    }
+                }
+
+                int ok;
+                if (prepare) {
+                    if (!PQsendPrepare(conn, name.c_str(), stmt.sql.c_str(), n, nullptr))
+                        throw std::runtime_error(PQerrorMessage(conn));
+                    sent.push_back({i, true, name});
+                }
+                if (name.empty())
+                    ok = PQsendQueryParams(conn, stmt.sql.c_str(), n, nullptr, values.data(), nullptr, nullptr, 0);
+                else
+                    ok = PQsendQueryPrepared(conn, name.c_str(), n, values.data(), nullptr, nullptr, 0);
+                if (!ok) throw std::runtime_error(PQerrorMessage(conn));
+                sent.push_back({i, false, name});
+            }
+            if (!PQpipelineSync(conn)) throw std::runtime_error(PQerrorMessage(conn));
+
+            // Not prepared after all, or failing on a schema that changed; it gets a new name next time
+            const auto forget = [&](const Sent &command) {
+                std::lock_guard lock(g_preparedMutex);
+                auto &names = g_prepared[conn].names;
+                if (const auto it = names.find(statements[command.statement].sql);
+                    it != names.end() && it->second == command.name)
+                    names.erase(it);
+            };
+
+            // Each command's results end with a null; the sync's doesn't
+            for (const auto &command: sent) {
+                while (PGresult *res = PQgetResult(conn)) {
+                    const std::unique_ptr<PGresult, decltype(&PQclear)> owned(res, &PQclear);
+                    const auto status = PQresultStatus(res);
+                    if (command.prepare) {
+                        if (status == PGRES_COMMAND_OK) ++g_prepares;
+                        else forget(command);
+                        if (status == PGRES_FATAL_ERROR && error.empty()) error = PQresultErrorMessage(res);
+                        continue;
+                    }
+                    if (status == PGRES_PIPELINE_ABORTED) continue;
+                    if (status == PGRES_FATAL_ERROR) {
+                        if (error.empty()) error = PQresultErrorMessage(res);
+                        if (!command.name.empty()) forget(command);
+                        continue;
+                    }
+                    auto &out = rows[command.statement];
+                    for (int r = 0; r < PQntuples(res); ++r)
+                        out.emplace_back(PQgetvalue(res, r, 0), PQgetlength(res, r, 0));
+                }
+            }
+
+            const std::unique_ptr<PGresult, decltype(&PQclear)> sync(PQgetResult(conn), &PQclear);
+            if (!sync || PQresultStatus(sync.get()) != PGRES_PIPELINE_SYNC)
+                throw std::runtime_error("PostgreSQL pipeline lost its sync");
+        }
+#endif
+    }
+
+    bool PgPipeline::available(soci::session &sql) {
+#if MB_HAS_POSTGRESQL && defined(LIBPQ_HAS_PIPELINING)
+        static const bool enabled = getEnvOrDefault("MB_PG_PIPELINE", "1") != "0";
+        return enabled && sql.get_backend_name() == "postgresql";
+#else
+        (void) sql;
+        return false;
+#endif
+    }
+
+    std::vector<std::vector<std::string>> PgPipeline::run(soci::session &sql,
+                                                          const std::vector<Statement> &statements) {
+        std::vector<std::vector<std::string>> rows(statements.size());
+#if MB_HAS_POSTGRESQL && defined(LIBPQ_HAS_PIPELINING)
+        if (statements.empty()) return rows;
+        auto *conn = static_cast<soci::postgresql_session_backend *>(sql.get_backend())->conn_;
+        if (!PQenterPipelineMode(conn)) throw std::runtime_error(PQerrorMessage(conn));
+
+        std::string error;
+        try {
+            // A failure aborts the transaction, so later chunks aren't sent
+            for (std::size_t first = 0; first < statements.size() && error.empty(); first += MAX_DEPTH) {
+                const auto end = std::min(statements.size(), first + MAX_DEPTH);
+                runChunk(conn, statements, first, end, rows, error);
+                ++g_pipelines;
+                g_statements += end - first;
+            }
+        } catch (...) {
+            PQexitPipelineMode(conn);
+            throw;
+        }
+        PQexitPipelineMode(conn);
+        if (!error.empty()) throw std::runtime_error(error);
+#else
+        (void) sql;
+        if (!statements.empty()) throw std::runtime_error("PostgreSQL pipelines are not built in");
+#endif
+        return rows;
+    }
+
+    void PgPipeline::writeMetrics(MetricsWriter &out) {
+        out.family("mb_db_pipeline_round_trips_total", "PostgreSQL pipelines sent, each one round trip", "counter");
+        out.sample("mb_db_pipeline_round_trips_total", {},
+                   static_cast<double>(g_pipelines.load(std::memory_order_relaxed)));
+        out.family("mb_db_pipeline_statements_total", "Statements sent in PostgreSQL pipelines", "counter");
+        out.sample("mb_db_pipeline_statements_total", {},
+                   static_cast<double>(g_statements.load(std::memory_order_relaxed)));
+        out.family("mb_db_pipeline_prepares_total", "Statements prepared on a connection for its pipelines",
+                   "counter");
+        out.sample("mb_db_pipeline_prepares_total", {},
+                   static_cast<double>(g_prepares.load(std::memory_order_relaxed)));
+    }
+}
@@ -0,0 +1,65 @@
+#include "../../include/mantisbase/core/pool_metrics.h"
+
+#include <algorithm>
+
+namespace mb {
+    namespace {
+        void storeMax(std::atomic<std::int64_t> &max, const std::int64_t value) {
+            auto current = max.load(std::memory_order_relaxed);
+            while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {}
+        }
+
+        double toMs(const std::int64_t ns) {
+            return static_cast<double>(ns) / 1e6;
+        }
+    }
+
+    void PoolMetrics::recordAcquire(const Clock::duration wait) {
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count();
+        m_acquired.fetch_add(1, std::memory_order_relaxed);
+        m_totalWaitNs.fetch_add(ns, std::memory_order_relaxed);
+        m_waitBuckets[bucketFor(wait)].fetch_add(1, std::memory_order_relaxed);
+        storeMax(m_maxWaitNs, ns);
+        storeMax(m_maxInUse, m_inUse.fetch_add(1, std::memory_order_relaxed) + 1);
+    }
+
+    void PoolMetrics::recordRelease() {
+        m_inUse.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void PoolMetrics::recordTimeout(const Clock::duration wait) {
+        m_timeouts.fetch_add(1, std::memory_order_relaxed);
+        storeMax(m_maxWaitNs, std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count());
+    }
+
+    void PoolMetrics::recordOpen(const std::size_t count, const bool on_demand) {
+        m_open.fetch_add(static_cast<std::int64_t>(count), std::memory_order_relaxed);
+        if (on_demand) m_opened.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    void PoolMetrics::recordClose() {
+        m_open.fetch_sub(1, std::memory_order_relaxed);
+        m_closed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::size_t PoolMetrics::bucketFor(const Clock::duration wait) {
+        const auto it = std::ranges::find_if(WAIT_BUCKETS, [&](const auto bound) { return wait <= bound; });
+        return static_cast<std::size_t>(it - WAIT_BUCKETS.begin());
+    }
+
+    PoolMetrics::Snapshot PoolMetrics::snapshot() const {
+        Snapshot s;
+        s.acquired = m_acquired.load(std::memory_order_relaxed);
+        s.timeouts = m_timeouts.load(std::memory_order_relaxed);
+        s.inUse = m_inUse.load(std::memory_order_relaxed);
+        s.maxInUse = m_maxInUse.load(std::memory_order_relaxed);
+        s.open = m_open.load(std::memory_order_relaxed);
+        s.opened = m_opened.load(std::memory_order_relaxed);
+        s.closed = m_closed.load(std::memory_order_relaxed);
+        s.totalWaitMs = toMs(m_totalWaitNs.load(std::memory_order_relaxed));
+        s.maxWaitMs = toMs(m_maxWaitNs.load(std::memory_order_relaxed));
+        for (std::size_t i = 0; i < m_waitBuckets.size(); ++i)
+            s.waitBuckets[i] = m_waitBuckets[i].load(std::memory_order_relaxed);
+        return s;
+    }
+}
@@ -1,4 +1,5 @@
 #include "../../include/mantisbase/core/http.h"
+#include "../../include/mantisbase/utils/duk_json.h"
 
 #ifdef MB_SCRIPTING_ENABLED
 #include <iostream>
@@ -51,30 +52,170 @@ namespace mb
         duk_pop(ctx);
     }
 
-    void ScriptingHooks::fireOnRecordCreated(duk_context *ctx, const std::string &entity, const std::string &recordId)
+    namespace
     {
-        duk_get_global_string(ctx, "onRecordCreated");
-        if (duk_is_function(ctx, -1)) {
-            duk_push_string(ctx, entity.c_str());
-            duk_push_string(ctx, recordId.c_str());
-            if (duk_pcall(ctx, 2) != 0) {
-                std::cerr << "[SCRIPT] onRecordCreated error: " << duk_safe_to_string(ctx, -1) << std::endl;
+        /// Call global `name` with the arguments `push` leaves on the stack; false if it threw
+        template<typename Push>
+        bool callHook(duk_context *ctx, const char *name, const duk_idx_t nargs, Push push)
+        {
+            duk_get_global_string(ctx, name);
+            if (!duk_is_function(ctx, -1)) {
+                duk_pop(ctx);
+                return true;
             }
+
+            push();
+            const bool ok = duk_pcall(ctx, nargs) == 0;
+            if (!ok) std::cerr << "[SCRIPT] " << name << " error: " << duk_safe_to_string(ctx, -1) << std::endl;
+            duk_pop(ctx);
+            return ok;
+        }
+
+        /// Call a `before...` hook; its reason to reject the write, if any
+        template<typename Push>
+        std::optional<std::string> vetoHook(duk_context *ctx, const char *name, const duk_idx_t nargs, Push push)
+        {
+            duk_get_global_string(ctx, name);
+            if (!duk_is_function(ctx, -1)) {
+                duk_pop(ctx);
+                return std::nullopt;
+            }
+
+            push();
+            std::optional<std::string> veto;
+            if (duk_pcall(ctx, nargs) != 0)
+                veto = duk_safe_to_string(ctx, -1);
+            else if (duk_is_string(ctx, -1))
+                veto = duk_get_string(ctx, -1);
+            else if (duk_is_boolean(ctx, -1) && !duk_get_boolean(ctx, -1))
+                veto = std::string("Rejected by `") + name + "`";
+            duk_pop(ctx);
+            return veto;
+        }
+
+        bool fireRecordHook(duk_context *ctx, const char *name, const std::string &entity,
+                            const std::string &recordId, const nlohmann::json &record)
+        {
+            return callHook(ctx, name, 3, [&] {
+                duk_push_string(ctx, entity.c_str());
+                duk_push_string(ctx, recordId.c_str());
+                dukPushJson(ctx, record);
+            });
         }
-        duk_pop(ctx);
     }
 
-    void ScriptingHooks::fireOnRecordUpdated(duk_context *ctx, const std::string &entity, const std::string &recordId)
+    bool ScriptingHooks::fireOnRecordCreated(duk_context *ctx, const std::string &entity, const std::string &recordId,
+                                             const nlohmann::json &record)
     {
-        duk_get_global_string(ctx, "onRecordUpdated");
-        if (duk_is_function(ctx, -1)) {
+        return fireRecordHook(ctx, "onRecordCreated", entity, recordId, record);
+    }
+
+    bool ScriptingHooks::fireOnRecordUpdated(duk_context *ctx, const std::string &entity, const std::string &recordId,
+                                             const nlohmann::json &record)
+    {
+        return fireRecordHook(ctx, "onRecordUpdated", entity, recordId, record);
+    }
+
+    bool ScriptingHooks::fireOnRecordDeleted(duk_context *ctx, const std::string &entity, const std::string &recordId,
+                                             const nlohmann::json &record)
+    {
+        return fireRecordHook(ctx, "onRecordDeleted", entity, recordId, record);
+    }
+
+    bool ScriptingHooks::fireOnRecordsChanged(duk_context *ctx, const nlohmann::json &events)
+    {
+        return callHook(ctx, "onRecordsChanged", 1, [&] { dukPushJson(ctx, events); });
+    }
+
+    std::optional<std::string> ScriptingHooks::beforeRecordCreate(duk_context *ctx, const std::string &entity,
+                                                                  const nlohmann::json &record)
+    {
+        return vetoHook(ctx, "beforeRecordCreate", 2, [&] {
+            duk_push_string(ctx, entity.c_str());
+            dukPushJson(ctx, record);
+        });
+    }
+
+    std::optional<std::string> ScriptingHooks::beforeRecordUpdate(duk_context *ctx, const std::string &entity,
+                                                                  const std::string &recordId,
+                                                                  const nlohmann::json &changes)
+    {
+        return vetoHook(ctx, "beforeRecordUpdate", 3, [&] {
             duk_push_string(ctx, entity.c_str());
             duk_push_string(ctx, recordId.c_str());
-            if (duk_pcall(ctx, 2) != 0) {
-                std::cerr << "[SCRIPT] onRecordUpdated error: " << duk_safe_to_string(ctx, -1) << std::endl;
+            dukPushJson(ctx, changes);
+        });
+    }
+
+    bool ScriptingHooks::defines(duk_context *ctx, const char *name)
+    {
+        duk_get_global_string(ctx, name);
+        const bool defined = duk_is_function(ctx, -1);
+        duk_pop(ctx);
+        return defined;
+    }
+
+    bool ScriptingHooks::definesRecordHooks(duk_context *ctx)
+    {
+        for (const auto *name: {"onRecordCreated", "onRecordUpdated", "onRecordDeleted", "onRecordsChanged"}) {
+            if (defines(ctx, name)) return true;
+        }
+        return false;
+    }
+
+    nlohmann::json ScriptingHooks::scheduledJobs(duk_context *ctx)
+    {
+        auto jobs = nlohmann::json::object();
+        duk_get_global_string(ctx, "jobs");
+        if (duk_is_object(ctx, -1)) {
+            duk_enum(ctx, -1, DUK_ENUM_OWN_PROPERTIES_ONLY);
+            while (duk_next(ctx, -1, 1)) {
+                duk_get_prop_string(ctx, -1, "run");
+                const bool runs = duk_is_function(ctx, -1);
+                duk_pop(ctx);
+                if (runs) {
+                    auto &job = jobs[duk_to_string(ctx, -2)];
+                    duk_get_prop_string(ctx, -1, "schedule");
+                    job["schedule"] = duk_is_string(ctx, -1) ? duk_get_string(ctx, -1) : "";
+                    duk_get_prop_string(ctx, -2, "jitter");
+                    job["jitter"] = duk_is_number(ctx, -1) ? static_cast<int>(duk_get_number(ctx, -1)) : 0;
+                    // Scripts run on every node, so their jobs are leased unless they say otherwise
+                    duk_get_prop_string(ctx, -3, "leased");
+                    job["leased"] = !duk_is_boolean(ctx, -1) || duk_get_boolean(ctx, -1);
+                    duk_pop_3(ctx);
+                }
+                duk_pop_2(ctx);
             }
+            duk_pop(ctx);
         }
         duk_pop(ctx);
+        return jobs;
+    }
+
+    bool ScriptingHooks::runJob(duk_context *ctx, const std::string &name)
+    {
+        duk_get_global_string(ctx, "jobs");
+        if (!duk_is_object(ctx, -1)) {
+            duk_pop(ctx);
+            return false;
+        }
+        duk_get_prop_string(ctx, -1, name.c_str());
+        if (!duk_is_object(ctx, -1)) {
+            duk_pop_2(ctx);
+            return false;
+        }
+        duk_get_prop_string(ctx, -1, "run");
+        if (!duk_is_function(ctx, -1)) {
+            duk_pop_3(ctx);
+            return false;
+        }
+
+        // `this` is the job
+        duk_dup(ctx, -2);
+        const bool ok = duk_pcall_method(ctx, 0) == 0;
+        if (!ok) std::cerr << "[SCRIPT] jobs." << name << " error: " << duk_safe_to_string(ctx, -1) << std::endl;
+        duk_pop_3(ctx);
+        return ok;
     }
 } // mb
 #endif // MB_SCRIPTING_ENABLED
\ No newline at end of file
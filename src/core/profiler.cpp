@@ -0,0 +1,249 @@
+/**
+ * @file profiler.cpp
+ * @brief Implementation for @see profiler.h
+ */
+
+#include "../../include/mantisbase/core/profiler.h"
+#include "../../include/mantisbase/core/exceptions.h"
+
+#include <algorithm>
+#include <atomic>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <csignal>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <malloc.h>
+#include <sys/time.h>
+#include <unistd.h>
+#define MB_HAS_PROFILER 1
+#else
+#define MB_HAS_PROFILER 0
+#endif
+
+namespace mb {
+    namespace {
+        /// Frames of the signal handler and the kernel's trampoline, above the interrupted one
+        constexpr int HANDLER_FRAMES = 2;
+
+        struct Slot {
+            std::atomic<int> depth{0}; ///> Set last; 0 until the sample is complete
+            void *frames[Profiler::MAX_DEPTH + HANDLER_FRAMES];
+        };
+
+        std::atomic<bool> g_busy{false};
+        std::atomic<bool> g_recording{false};
+        std::atomic<Slot *> g_slots{nullptr};
+        std::atomic<std::size_t> g_next{0};
+        std::size_t g_capacity = 0;
+
+#if MB_HAS_PROFILER
+        void onSignal(int, siginfo_t *, void *) {
+            if (!g_recording.load(std::memory_order_acquire)) return;
+            const int saved = errno;
+            if (const auto i = g_next.fetch_add(1, std::memory_order_relaxed); i < g_capacity) {
+                auto &slot = g_slots.load(std::memory_order_relaxed)[i];
+                const auto depth = backtrace(slot.frames, Profiler::MAX_DEPTH + HANDLER_FRAMES);
+                slot.depth.store(std::max(depth, 1), std::memory_order_release);
+            }
+            errno = saved;
+        }
+
+        /**
+         * Installed once and kept: a SIGPROF still pending when a profile
+         * ends then finds a handler that ignores it, rather than the default
+         * action, which ends the process.
+         */
+        void installHandler() {
+            static const bool installed = [] {
+                // backtrace() loads the unwinder on first use, which a signal handler must not do
+                void *warm[1];
+                backtrace(warm, 1);
+
+                struct sigaction action{};
+                action.sa_sigaction = onSignal;
+                action.sa_flags = SA_RESTART | SA_SIGINFO;
+                sigemptyset(&action.sa_mask);
+                return sigaction(SIGPROF, &action, nullptr) == 0;
+            }();
+            if (!installed) throw MantisException(500, "Could not install the profiling signal handler.");
+        }
+
+        void setTimer(const std::chrono::microseconds interval) {
+            itimerval timer{};
+            timer.it_interval.tv_sec = static_cast<time_t>(interval.count() / 1000000);
+            timer.it_interval.tv_usec = static_cast<suseconds_t>(interval.count() % 1000000);
+            timer.it_value = timer.it_interval;
+            setitimer(ITIMER_PROF, &timer, nullptr);
+        }
+
+        std::string symbolOf(void *pc) {
+            Dl_info info{};
+            if (!dladdr(pc, &info)) return std::format("{}", pc);
+            if (info.dli_sname) {
+                int status = 0;
+                std::unique_ptr<char, void (*)(void *)> demangled(
+                    abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status), std::free);
+                return status == 0 && demangled ? demangled.get() : info.dli_sname;
+            }
+            std::string module = info.dli_fname ? info.dli_fname : "?";
+            if (const auto slash = module.rfind('/'); slash != std::string::npos) module.erase(0, slash + 1);
+            return std::format("{}+{:#x}", module, reinterpret_cast<std::uintptr_t>(pc) -
+                                                    reinterpret_cast<std::uintptr_t>(info.dli_fbase));
+        }
+#endif
+    }
+
+    bool Profiler::supported() {
+        return MB_HAS_PROFILER;
+    }
+
+    Profiler::Profile Profiler::collect(const std::chrono::milliseconds duration, int hz) {
+#if MB_HAS_PROFILER
+        if (g_busy.exchange(true)) throw MantisException(409, "A profile is already being taken.");
+        struct Release {
+            ~Release() { g_busy.store(false); }
+        } release;
+
+        installHandler();
+
+        hz = std::clamp(hz, 1, MAX_HZ);
+        Profile profile;
+        profile.period = std::chrono::microseconds(1000000 / hz);
+
+        const auto expected = static_cast<std::size_t>(duration.count() * hz / 1000) + 1;
+        const auto slots = std::make_unique<Slot[]>(std::min(expected, MAX_SAMPLES));
+        g_capacity = std::min(expected, MAX_SAMPLES);
+        g_next.store(0, std::memory_order_relaxed);
+        g_slots.store(slots.get(), std::memory_order_relaxed);
+        g_recording.store(true, std::memory_order_release);
+        setTimer(profile.period);
+
+        std::this_thread::sleep_for(duration);
+
+        setTimer(std::chrono::microseconds(0));
+        g_recording.store(false, std::memory_order_release);
+        // A handler that saw g_recording before it was cleared is done after this
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+        const auto taken = g_next.load(std::memory_order_relaxed);
+        for (std::size_t i = 0; i < std::min(taken, g_capacity); ++i) {
+            const auto &slot = slots[i];
+            const auto depth = slot.depth.load(std::memory_order_acquire);
+            if (depth <= HANDLER_FRAMES) continue;
+            std::vector<void *> stack(slot.frames + HANDLER_FRAMES, slot.frames + depth);
+            ++profile.stacks[std::move(stack)];
+            ++profile.samples;
+        }
+        profile.dropped = taken - profile.samples;
+        g_slots.store(nullptr, std::memory_order_relaxed);
+        return profile;
+#else
+        (void) duration;
+        (void) hz;
+        throw MantisException(501, "CPU profiling is only supported on Linux.");
+#endif
+    }
+
+    std::string Profiler::toPprof(const Profile &profile) {
+        std::string out;
+        const auto word = [&](const std::uintptr_t value) {
+            out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+        };
+
+        // Header: header words follow (3), version 0, sampling period in microseconds, padding
+        word(0);
+        word(3);
+        word(0);
+        word(static_cast<std::uintptr_t>(profile.period.count()));
+        word(0);
+        for (const auto &[stack, count]: profile.stacks) {
+            word(static_cast<std::uintptr_t>(count));
+            word(stack.size());
+            for (const auto *pc: stack) word(reinterpret_cast<std::uintptr_t>(pc));
+        }
+        // Trailer, then the mappings pprof needs to resolve the addresses
+        word(0);
+        word(1);
+        word(0);
+
+        std::ifstream maps("/proc/self/maps");
+        std::ostringstream text;
+        text << maps.rdbuf();
+        out += text.str();
+        return out;
+    }
+
+    nlohmann::json Profiler::summary(const Profile &profile, const std::size_t top) {
+        struct Counts {
+            std::uint64_t self = 0, total = 0;
+        };
+        std::unordered_map<std::string, Counts> functions;
+#if MB_HAS_PROFILER
+        std::unordered_map<void *, std::string> names;
+        const auto name = [&](void *pc) -> const std::string & {
+            auto it = names.find(pc);
+            if (it == names.end()) it = names.emplace(pc, symbolOf(pc)).first;
+            return it->second;
+        };
+        for (const auto &[stack, count]: profile.stacks) {
+            functions[name(stack.front())].self += count;
+            // A recursive function counts once per sample
+            std::vector<const std::string *> seen;
+            for (auto *pc: stack) {
+                const auto &fn = name(pc);
+                if (std::ranges::any_of(seen, [&](const auto *other) { return *other == fn; })) continue;
+                seen.push_back(&fn);
+                functions[fn].total += count;
+            }
+        }
+#endif
+
+        std::vector<std::pair<std::string, Counts>> sorted(functions.begin(), functions.end());
+        std::ranges::sort(sorted, [](const auto &a, const auto &b) {
+            return a.second.self != b.second.self ? a.second.self > b.second.self : a.second.total > b.second.total;
+        });
+        if (sorted.size() > top) sorted.resize(top);
+
+        const auto samples = static_cast<double>(std::max<std::uint64_t>(profile.samples, 1));
+        auto items = nlohmann::json::array();
+        for (const auto &[fn, c]: sorted)
+            items.push_back({
+                {"function", fn}, {"self", c.self}, {"total", c.total},
+                {"self_pct", 100.0 * static_cast<double>(c.self) / samples},
+                {"total_pct", 100.0 * static_cast<double>(c.total) / samples}
+            });
+        return {
+            {"samples", profile.samples}, {"dropped", profile.dropped},
+            {"period_us", profile.period.count()}, {"functions", items}
+        };
+    }
+
+    nlohmann::json Profiler::allocatorStats() {
+        auto out = nlohmann::json::object();
+#if MB_HAS_PROFILER
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+        const auto info = mallinfo2();
+        out["allocator"] = "glibc";
+        out["arena"] = info.arena + info.hblkhd;
+        out["in_use"] = info.uordblks + info.hblkhd;
+        out["free"] = info.fordblks;
+        out["mmap"] = info.hblkhd;
+#endif
+        // Pages in total and resident
+        std::ifstream statm("/proc/self/statm");
+        std::size_t pages = 0, resident = 0;
+        if (statm >> pages >> resident)
+            out["rss"] = resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+#endif
+        return out;
+    }
+}
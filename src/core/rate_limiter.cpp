@@ -0,0 +1,168 @@
+/**
+ * @file rate_limiter.cpp
+ * @brief Implementation for @see rate_limiter.h
+ */
+
+#include "../../include/mantisbase/core/rate_limiter.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mb {
+    namespace {
+        constexpr auto SWEEP_INTERVAL = std::chrono::minutes(1);
+
+        std::int64_t nanos(const RateLimiter::Clock::time_point t) {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+        }
+
+        /// Whole seconds, rounded up
+        std::chrono::seconds ceilSeconds(const std::int64_t ns) {
+            return std::chrono::seconds((std::max<std::int64_t>(ns, 0) + 999'999'999) / 1'000'000'000);
+        }
+
+        /// One thread for every limiter in the process; holds them weakly
+        class Sweeper {
+        public:
+            static Sweeper &instance() {
+                static Sweeper sweeper;
+                return sweeper;
+            }
+
+            void add(const std::weak_ptr<RateLimiter> &limiter) {
+                std::lock_guard lock(m_mutex);
+                m_limiters.push_back(limiter);
+                if (!m_thread.joinable()) m_thread = std::jthread([this](const std::stop_token &stop) { run(stop); });
+            }
+
+        private:
+            Sweeper() = default;
+
+            void run(const std::stop_token &stop) {
+                std::unique_lock lock(m_mutex);
+                while (true) {
+                    m_wake.wait_for(lock, stop, SWEEP_INTERVAL, [] { return false; });
+                    if (stop.stop_requested()) return;
+
+                    std::erase_if(m_limiters, [](const auto &weak) { return weak.expired(); });
+                    auto limiters = m_limiters;
+                    lock.unlock();
+                    for (const auto &weak: limiters) {
+                        if (const auto limiter = weak.lock()) limiter->evictIdle();
+                    }
+                    if (const auto store = RateLimiter::store()) store->evictIdle();
+                    lock.lock();
+                }
+            }
+
+            std::mutex m_mutex;
+            std::condition_variable_any m_wake;
+            std::vector<std::weak_ptr<RateLimiter>> m_limiters;
+            std::jthread m_thread;   ///> Last, so it is joined before the rest goes away
+        };
+
+        std::atomic<std::shared_ptr<RateLimitStore>> &sharedStore() {
+            static std::atomic<std::shared_ptr<RateLimitStore>> store;
+            return store;
+        }
+    }
+
+    std::shared_ptr<RateLimiter> RateLimiter::create(const int limit, const std::chrono::seconds window,
+                                                     const std::string &scope) {
+        auto limiter = std::make_shared<RateLimiter>(limit, window, scope);
+        Sweeper::instance().add(limiter);
+        return limiter;
+    }
+
+    RateLimiter::RateLimiter(const int limit, const std::chrono::seconds window, std::string scope)
+        : m_limit(std::max(limit, 1)),
+          m_window(std::max(window, std::chrono::seconds(1))),
+          m_interval(std::chrono::duration_cast<std::chrono::nanoseconds>(m_window).count() / m_limit),
+          m_tolerance(std::chrono::duration_cast<std::chrono::nanoseconds>(m_window).count() - m_interval),
+          m_scope(scope.empty() ? std::to_string(m_limit) + "/" + std::to_string(m_window.count()) : std::move(scope)) {}
+
+    void RateLimiter::setStore(std::shared_ptr<RateLimitStore> store) {
+        sharedStore().store(std::move(store));
+    }
+
+    std::shared_ptr<RateLimitStore> RateLimiter::store() {
+        return sharedStore().load();
+    }
+
+    RateLimiter::Shard &RateLimiter::shardOf(const std::string &key) {
+        return m_shards[std::hash<std::string>{}(key) % SHARDS];
+    }
+
+    RateLimiter::Decision RateLimiter::acquire(const std::string &key, const Clock::time_point now) {
+        if (const auto store = RateLimiter::store()) {
+            if (const auto step = store->step(m_scope + ":" + key, m_interval, m_tolerance))
+                return decide(step->allowed, step->tat, step->now);
+        }
+        return acquireLocal(key, now);
+    }
+
+    RateLimiter::Decision RateLimiter::decide(const bool allowed, const std::int64_t tat, const std::int64_t now) const {
+        Decision decision;
+        decision.allowed = allowed;
+        decision.reset = ceilSeconds(tat - now);
+        if (allowed)
+            decision.remaining = static_cast<int>((m_tolerance + m_interval - (tat - now)) / m_interval);
+        else
+            decision.retryAfter = std::max(ceilSeconds(tat - m_tolerance - now), std::chrono::seconds(1));
+        return decision;
+    }
+
+    RateLimiter::Decision RateLimiter::acquireLocal(const std::string &key, const Clock::time_point now) {
+        const auto t = nanos(now);
+        auto &shard = shardOf(key);
+
+        // Read under the shared lock; eviction takes the exclusive one, so the TAT can't go away under us
+        std::shared_lock lock(shard.mutex);
+        auto it = shard.tats.find(key);
+        while (it == shard.tats.end()) {
+            lock.unlock();
+            {
+                // A key not seen yet starts with a full bucket
+                std::unique_lock write(shard.mutex);
+                shard.tats.try_emplace(key, t);
+            }
+            lock.lock();
+            it = shard.tats.find(key);
+        }
+        auto &tat = it->second;
+
+        auto current = tat.load(std::memory_order_relaxed);
+        while (true) {
+            const auto base = std::max(current, t);
+            if (base - t > m_tolerance) return decide(false, base, t);
+
+            const auto next = base + m_interval;
+            if (tat.compare_exchange_weak(current, next, std::memory_order_relaxed)) return decide(true, next, t);
+        }
+    }
+
+    std::size_t RateLimiter::evictIdle(const Clock::time_point now) {
+        const auto t = nanos(now);
+        std::size_t evicted = 0;
+        for (auto &shard: m_shards) {
+            std::unique_lock lock(shard.mutex);
+            evicted += std::erase_if(shard.tats, [t](const auto &entry) {
+                return entry.second.load(std::memory_order_relaxed) <= t;
+            });
+        }
+        return evicted;
+    }
+
+    std::size_t RateLimiter::size() const {
+        std::size_t total = 0;
+        for (const auto &shard: m_shards) {
+            std::shared_lock lock(shard.mutex);
+            total += shard.tats.size();
+        }
+        return total;
+    }
+}
@@ -0,0 +1,95 @@
+#include "../../include/mantisbase/core/read_coalescer.h"
+
+namespace mb {
+    ReadCoalescer::ReadCoalescer(const bool enabled) : m_enabled(enabled) {}
+
+    ReadCoalescer::Result ReadCoalescer::read(const std::string &entity, const std::string &id,
+                                              const std::string &projection, const std::function<Result()> &fetch) {
+        if (!m_enabled) return fetch();
+
+        // Entity names and projections hold no NUL, so no id makes two keys meet
+        auto key = entity;
+        key.append(1, '\0').append(id).append(1, '\0').append(projection);
+
+        std::promise<Result> promise;
+        auto flight = std::make_shared<Flight>();
+        std::shared_future<Result> running;
+        {
+            std::lock_guard lock(m_mutex);
+            if (const auto it = m_flights.find(key); it != m_flights.end()) {
+                ++m_stats.joined;
+                running = it->second->result;
+            } else {
+                flight->entity = entity;
+                flight->id = id;
+                flight->result = promise.get_future().share();
+                m_flights.emplace(key, flight);
+                ++m_stats.led;
+            }
+        }
+        // Copied: each caller redacts and expands its own record
+        if (running.valid()) return running.get();
+
+        try {
+            promise.set_value(fetch());
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+        }
+
+        {
+            std::lock_guard lock(m_mutex);
+            // Unless a write detached it and a newer read took the key since
+            if (const auto it = m_flights.find(key); it != m_flights.end() && it->second == flight)
+                m_flights.erase(it);
+        }
+        return flight->result.get();
+    }
+
+    void ReadCoalescer::forget(const std::string &entity, const std::string &id) {
+        if (!m_enabled) return;
+        std::lock_guard lock(m_mutex);
+        detachLocked([&](const Flight &f) { return f.id == id && f.entity == entity; });
+    }
+
+    void ReadCoalescer::invalidateEntity(const std::string &entity) {
+        if (!m_enabled) return;
+        std::lock_guard lock(m_mutex);
+        detachLocked([&](const Flight &f) { return f.entity == entity; });
+    }
+
+    void ReadCoalescer::onChanges(const nlohmann::json &events) {
+        if (!m_enabled || !events.is_array()) return;
+
+        std::lock_guard lock(m_mutex);
+        if (m_flights.empty()) return;
+        for (const auto &event: events) {
+            if (!event.is_object()) continue;
+
+            const auto &entity = event.value("entity", nlohmann::json{});
+            if (!entity.is_string()) continue;
+            const auto &row_id = event.value("row_id", nlohmann::json{});
+            const auto &name = entity.get_ref<const std::string &>();
+            if (row_id.is_string() && !row_id.get_ref<const std::string &>().empty()) {
+                const auto &id = row_id.get_ref<const std::string &>();
+                detachLocked([&](const Flight &f) { return f.id == id && f.entity == name; });
+            } else {
+                detachLocked([&](const Flight &f) { return f.entity == name; });
+            }
+        }
+    }
+
+    ReadCoalescer::Stats ReadCoalescer::stats() const {
+        std::lock_guard lock(m_mutex);
+        return m_stats;
+    }
+
+    std::size_t ReadCoalescer::inFlight() const {
+        std::lock_guard lock(m_mutex);
+        return m_flights.size();
+    }
+
+    void ReadCoalescer::detachLocked(const std::function<bool(const Flight &)> &match) {
+        // Only as many entries as reads running right now, so a scan is cheap
+        std::erase_if(m_flights, [&](const auto &entry) { return match(*entry.second); });
+    }
+}
@@ -0,0 +1,189 @@
+/**
+ * @file readiness_probe.cpp
+ * @brief Implementation for @see readiness_probe.h
+ */
+
+#include "../../include/mantisbase/core/readiness_probe.h"
+#include "../../include/mantisbase/core/database.h"
+#include "../../include/mantisbase/core/realtime.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <soci/soci.h>
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <utility>
+
+namespace mb {
+    namespace {
+        /// `SELECT 1` on a session of `lease`, the lease's wait included; -1 if either fails
+        template<typename Lease>
+        double roundTripMs(Lease lease) {
+            try {
+                const auto began = std::chrono::steady_clock::now();
+                int one = 0;
+                const auto sql = lease();
+                *sql << "SELECT 1", soci::into(one);
+                return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - began).count();
+            } catch (const std::exception &) {
+                return -1;
+            }
+        }
+    }
+
+    ReadinessProbe::Options ReadinessProbe::Options::fromEnv() {
+        Options options;
+        if (const auto ms = safe_stoi(getEnvOrDefault("MB_READY_PROBE_MS", ""), 0); ms > 0)
+            options.interval = std::chrono::milliseconds(ms);
+        if (const auto ms = safe_stoi(getEnvOrDefault("MB_READY_DB_MS", ""), 0); ms > 0)
+            options.dbLatency = std::chrono::milliseconds(ms);
+        if (const auto pct = safe_stoi(getEnvOrDefault("MB_READY_POOL_PCT", ""), 0); pct > 0 && pct <= 100)
+            options.poolSaturation = pct / 100.0;
+        if (const auto lag = safe_stoi(getEnvOrDefault("MB_READY_RT_LAG", ""), 0); lag > 0)
+            options.workerLag = lag;
+        if (const auto pct = safe_stoi(getEnvOrDefault("MB_READY_LOG_QUEUE_PCT", ""), 0); pct > 0 && pct <= 100)
+            options.logQueueFill = pct / 100.0;
+        if (const auto mb = safe_stoi(getEnvOrDefault("MB_READY_DISK_MIN_MB", ""), -1); mb >= 0)
+            options.diskMinBytes = static_cast<std::uint64_t>(mb) << 20;
+        return options;
+    }
+
+    ReadinessProbe::ReadinessProbe(const MantisBase &app, const Options options)
+        : mApp(app), m_options(options),
+          m_report(std::make_shared<const Report>(Report{503, R"({"status": "STARTING"})"})) {}
+
+    ReadinessProbe::~ReadinessProbe() {
+        stop();
+    }
+
+    void ReadinessProbe::start() {
+        std::lock_guard lock(m_mutex);
+        if (m_thread.joinable()) return;
+        m_stopping = false;
+        m_thread = std::thread(&ReadinessProbe::loop, this);
+    }
+
+    void ReadinessProbe::stop() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+    std::shared_ptr<const ReadinessProbe::Report> ReadinessProbe::report() const {
+        std::lock_guard lock(m_reportMutex);
+        return m_report;
+    }
+
+    json ReadinessProbe::assess(const Sample &sample, const Options &options) {
+        const auto db_limit = static_cast<double>(options.dbLatency.count());
+        auto pools = json::object();
+        bool db_ok = true;
+        for (const auto &[name, ms]: sample.dbMs) {
+            const bool ok = ms >= 0 && ms <= db_limit;
+            db_ok = db_ok && ok;
+            pools[name] = {{"ok", ok}, {"ms", ms >= 0 ? json(ms) : json(nullptr)}};
+        }
+
+        const bool pool_ok = sample.poolSize <= 0
+                             || static_cast<double>(sample.poolInUse) < options.poolSaturation * sample.poolSize;
+        const bool rt_ok = sample.workerLag < 0 || sample.workerLag <= options.workerLag;
+        const bool log_ok = sample.logQueued < 0 || sample.logCapacity <= 0
+                            || static_cast<double>(sample.logQueued) < options.logQueueFill * sample.logCapacity;
+        const bool disk_ok = sample.diskFree >= 0
+                             && static_cast<std::uint64_t>(sample.diskFree) >= options.diskMinBytes;
+
+        json checks = {
+            {"db", {{"ok", db_ok}, {"pools", pools}}},
+            {"pool", {{"ok", pool_ok}, {"in_use", sample.poolInUse}, {"size", sample.poolSize}}},
+            {"realtime", {
+                {"ok", rt_ok}, {"lag", sample.workerLag >= 0 ? json(sample.workerLag) : json(nullptr)}
+            }},
+            {"log_queue", {
+                {"ok", log_ok}, {"queued", sample.logQueued >= 0 ? json(sample.logQueued) : json(nullptr)},
+                {"capacity", sample.logCapacity}
+            }},
+            {"disk", {
+                {"ok", disk_ok}, {"free_bytes", sample.diskFree >= 0 ? json(sample.diskFree) : json(nullptr)},
+                {"min_bytes", options.diskMinBytes}
+            }}
+        };
+        return {{"ready", db_ok && pool_ok && rt_ok && log_ok && disk_ok}, {"checks", std::move(checks)}};
+    }
+
+    ReadinessProbe::Sample ReadinessProbe::sample() const {
+        Sample s;
+        // Tenants' pools are left out: a tenant's database is its own readiness question
+        const auto &db = mApp.rootDb();
+        // Read ahead of the round trips, which lease a session of their own
+        s.poolInUse = db.poolStats().inUse;
+        s.poolSize = mApp.poolSize();
+
+        s.dbMs["primary"] = roundTripMs([&db] { return db.session(); });
+        if (db.hasReplicas()) s.dbMs["replica"] = roundTripMs([&db] { return db.readSession(); });
+        if (db.singleWriter()) s.dbMs["writer"] = roundTripMs([&db] { return db.writeSession(); });
+
+        if (const auto delivered = mApp.rt().deliveredChangeId(); delivered >= 0) {
+            try {
+                long long newest = 0;
+                const auto sql = db.session();
+                *sql << "SELECT COALESCE(MAX(id), 0) FROM mb_change_log", soci::into(newest);
+                s.workerLag = std::max<long long>(0, newest - delivered);
+            } catch (const std::exception &) {
+                // Left at -1; the primary's round trip already tells of a failing database
+            }
+        }
+
+        if (Logger::isDbInitialized) {
+            const auto logs = mApp.logs().logsDb().stats();
+            s.logQueued = logs.value("queued", std::int64_t{-1});
+            s.logCapacity = logs.value("capacity", std::int64_t{0});
+        }
+
+        std::error_code ec;
+        if (const auto space = std::filesystem::space(mApp.dataDir(), ec); !ec)
+            s.diskFree = static_cast<std::int64_t>(space.available);
+        return s;
+    }
+
+    void ReadinessProbe::refresh() {
+        const auto result = assess(sample(), m_options);
+        const bool ready = result["ready"].get<bool>();
+        const auto checked_at = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+
+        json body = {
+            {"status", ready ? "READY" : "NOT_READY"}, {"checked_at", checked_at}, {"checks", result["checks"]}
+        };
+        auto next = std::make_shared<const Report>(Report{ready ? 200 : 503, body.dump()});
+
+        std::shared_ptr<const Report> previous;
+        {
+            std::lock_guard lock(m_reportMutex);
+            previous = std::exchange(m_report, std::move(next));
+        }
+        // Logged on the change only, not every round
+        if (!ready && previous->status == 200)
+            LogOrigin::warn("Readiness", "Not ready", body["checks"].dump());
+        else if (ready && previous->status != 200)
+            LogOrigin::info("Readiness", "Ready");
+    }
+
+    void ReadinessProbe::loop() {
+        std::unique_lock lock(m_mutex);
+        while (!m_stopping) {
+            lock.unlock();
+            try {
+                refresh();
+            } catch (const std::exception &e) {
+                LogOrigin::warn("Readiness", std::format("Probe round failed: {}", e.what()));
+            }
+            lock.lock();
+            if (m_cv.wait_for(lock, m_options.interval, [this] { return m_stopping; })) break;
+        }
+    }
+}
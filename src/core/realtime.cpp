@@ -1,23 +1,113 @@
 #include "../../include/mantisbase/core/realtime.h"
 #include "../../include/mantisbase/mantisbase.h"
 #include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/field_compression.h"
 #include "../../include/mantisbase/core/database.h"
+#include "../../include/mantisbase/core/router.h"
+#include "../../include/mantisbase/core/delta_sync.h"
+#include "../../include/mantisbase/core/logical_capture.h"
+#include "../../include/mantisbase/core/auth.h"
+#include "../../include/mantisbase/core/channels.h"
+#include "../../include/mantisbase/core/replication.h"
+#include "../../include/mantisbase/core/revocation_filter.h"
+#include "../../include/mantisbase/core/shared_state.h"
+#include "../../include/mantisbase/core/sqlite_change_hooks.h"
+#include "../../include/mantisbase/core/tenants.h"
+#include "../../include/mantisbase/utils/json_parse.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <map>
+#if MB_HAS_POSTGRESQL
+#include <fcntl.h>
+#include <sys/select.h>
+#include <unistd.h>
+#endif
 
 #include <soci/soci.h>
 #include "soci/sqlite3/soci-sqlite3.h"
 
+namespace {
+    /// Tag a journaled event with the span publishing it, so its delivery joins that trace
+    void tagTrace(mb::json &event) {
+        if (const auto *ctx = mb::Tracer::current(); ctx && ctx->sampled)
+            event["_trace"] = {{"traceparent", ctx->traceparent()}, {"at_ns", mb::Tracer::nowNs()}};
+    }
+
+    /// Stamp the commit time (epoch microseconds) subscribers measure delivery latency from
+    void stampCommit(mb::json &event) {
+        if (event.contains("committed_at")) return;
+        event["committed_at"] = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    void dropSqliteTriggers(soci::session &sql, const std::string &entity_name) {
+        // TEMP ones with an attached change log, see RealtimeDB::attachedChangeLog()
+        for (const auto *schema: {"main", "temp"}) {
+            sql << std::format("DROP TRIGGER IF EXISTS {}.mb_{}_insert_trigger", schema, entity_name);
+            sql << std::format("DROP TRIGGER IF EXISTS {}.mb_{}_update_trigger", schema, entity_name);
+            sql << std::format("DROP TRIGGER IF EXISTS {}.mb_{}_delete_trigger", schema, entity_name);
+        }
+    }
+
+#if MB_HAS_POSTGRESQL
+    void dropPgTriggers(soci::session &sql, const std::string &entity_name) {
+        sql << std::format("DROP TRIGGER IF EXISTS mb_{0}_insert_notify ON {0}", entity_name);
+        sql << std::format("DROP TRIGGER IF EXISTS mb_{0}_update_notify ON {0}", entity_name);
+        sql << std::format("DROP TRIGGER IF EXISTS mb_{0}_delete_notify ON {0}", entity_name);
+    }
+#endif
+
+    /// The table's columns as SqliteChangeHooks numbers them, skipping those the triggers leave out
+    mb::SqliteChangeHooks::Layout hookLayout(const mb::Entity &entity, const std::string &entity_name,
+                                            soci::session &sql) {
+        std::unordered_set<std::string> logged;
+        for (const auto &field: entity.fields())
+            if (field.value("type", "") != "blob") logged.insert(field["name"].get<std::string>());
+
+        mb::SqliteChangeHooks::Layout layout;
+        const soci::rowset<soci::row> rows = (sql.prepare << std::format("PRAGMA table_info({})", entity_name));
+        for (const auto &row: rows) {
+            const auto name = row.get<std::string>(1);
+            if (name == "id") layout.id = layout.columns.size();
+            layout.skip.push_back(!logged.contains(name));
+            layout.columns.push_back(name);
+        }
+        return layout;
+    }
+}
+
 mb::RealtimeDB::RealtimeDB(const MantisBase &app)
     : mApp(app) {
+    if (const auto &options = ChangeCapture::Options::current(); options.lazy) {
+        // Leases are per node, so nodes sharing a PostgreSQL database hold theirs apart
+        m_capture = std::make_unique<ChangeCapture>([this, node = generateShortId(16)](
+                                                const std::vector<std::string> &entities,
+                                                const std::chrono::seconds ttl) {
+            mApp.db().write([&](soci::session &sql) { ChangeCapture::lease(sql, node, entities, ttl); });
+        }, options);
+
+        // Followers read the whole stream, as do clients coming back online
+        if (const auto replication = Replication::Options::fromEnv();
+            replication.serving() || replication.follower() || DeltaSync::Options::fromEnv().enabled())
+            m_capture->hold("*", true);
+    }
 }
 
 bool mb::RealtimeDB::init() const {
     try {
-        const auto &sql = mApp.db().session();
+        const auto &sql = mApp.db().writeSession();
+
+        // MB_SQLITE_CHANGE_LOG=attached: in `mb_log`, which Database::connect() attached
+        const bool attached = sql->get_backend_name() == "sqlite3" && attachedChangeLog();
+        const std::string schema = attached ? "mb_log." : "";
 
         // Create rt changelog table in the AUDIT database
         if (sql->get_backend_name() == "sqlite3") {
-            *sql << R"(
-            CREATE TABLE IF NOT EXISTS mb_change_log (
+            *sql << std::format(R"(
+            CREATE TABLE IF NOT EXISTS {}mb_change_log (
                 id          INTEGER PRIMARY KEY AUTOINCREMENT,
                 timestamp   DATETIME DEFAULT CURRENT_TIMESTAMP,
                 type        TEXT NOT NULL,
@@ -26,13 +116,29 @@ bool mb::RealtimeDB::init() const {
                 old_data    TEXT,
                 new_data    TEXT
             )
-            )";
+            )", schema);
+
+            if (attached) {
+                // The triggers on `main` write to the table name as it resolves
+                // from main; those and the old table go, so that from here on
+                // `mb_change_log` is the attached one. syncDbHooks() recreates
+                // the triggers as TEMP ones, which may reach it.
+                std::vector<std::string> stale;
+                const soci::rowset<std::string> rows = (sql->prepare
+                    << "SELECT name FROM main.sqlite_master WHERE type = 'trigger' "
+                       "AND name LIKE 'mb\\_%\\_trigger' ESCAPE '\\'");
+                for (const auto &name: rows) stale.push_back(name);
+                for (const auto &name: stale) *sql << std::format("DROP TRIGGER IF EXISTS main.{}", name);
+                *sql << "DROP TABLE IF EXISTS main.mb_change_log";
+            }
         }
 
 #if MB_HAS_POSTGRESQL
         else {
+            // Unlogged: it only bridges reconnects and oversized payloads, so
+            // it's not worth a WAL write per change
             *sql << R"(
-            CREATE TABLE IF NOT EXISTS mb_change_log (
+            CREATE UNLOGGED TABLE IF NOT EXISTS mb_change_log (
                 id          SERIAL PRIMARY KEY,
                 timestamp   TIMESTAMP DEFAULT CURRENT_TIMESTAMP,
                 type        TEXT NOT NULL,
@@ -42,19 +148,38 @@ bool mb::RealtimeDB::init() const {
                 new_data    TEXT
             )
             )";
+
+            // Tables created by older versions; a cheap rewrite as the log is kept pruned
+            *sql << R"(
+            DO $$
+            BEGIN
+                IF (SELECT relpersistence FROM pg_class WHERE oid = 'mb_change_log'::regclass) = 'p' THEN
+                    ALTER TABLE mb_change_log SET UNLOGGED;
+                END IF;
+            END $$
+            )";
         }
 #endif
 
         // Create indexes on the audit database
-        *sql << "CREATE INDEX IF NOT EXISTS idx_change_log_timestamp ON mb_change_log(timestamp)";
-        *sql << "CREATE INDEX IF NOT EXISTS idx_change_log_type ON mb_change_log(type)";
-        *sql << "CREATE INDEX IF NOT EXISTS idx_change_log_entity ON mb_change_log(entity)";
-        *sql << "CREATE INDEX IF NOT EXISTS idx_change_log_row_id ON mb_change_log(row_id)";
+        *sql << std::format("CREATE INDEX IF NOT EXISTS {}idx_change_log_timestamp ON mb_change_log(timestamp)", schema);
+        *sql << std::format("CREATE INDEX IF NOT EXISTS {}idx_change_log_type ON mb_change_log(type)", schema);
+        *sql << std::format("CREATE INDEX IF NOT EXISTS {}idx_change_log_entity ON mb_change_log(entity)", schema);
+        *sql << std::format("CREATE INDEX IF NOT EXISTS {}idx_change_log_row_id ON mb_change_log(row_id)", schema);
+
+        // The lazy triggers read it, so it comes before any of them
+        if (m_capture) {
+            ChangeCapture::createTable(*sql);
+            m_capture->start();
+        }
 
 #if MB_HAS_POSTGRESQL
         // For PostgreSQL, create the hook function
         if (sql->get_backend_name() == "postgresql") {
             createNotifyFunction(*sql);
+            // Before any trigger makes way for it; needs wal_level=logical
+            if (LogicalCapture::enabled())
+                LogicalCapture::createSlot(*sql, LogicalCapture::Options::current().slot);
         }
 #endif
 
@@ -80,73 +205,163 @@ void mb::RealtimeDB::addDbHooks(const std::string &entity_name) const {
 
 void mb::RealtimeDB::addDbHooks(const Entity &entity) const {
     // Get session instance
-    const auto &sql = mApp.db().session();
+    const auto &sql = mApp.db().writeSession();
     addDbHooks(entity, sql);
 }
 
 void mb::RealtimeDB::addDbHooks(const Entity &entity, const std::shared_ptr<soci::session> &sess) {
+    // Realtime serves the application's own entities only
+    if (Tenants::current()) return;
     logEntry::debug("Realtime Mgr", std::format("Creating Db Hooks on `{}`", entity.name()));
 
     // Validate up front: the entity name is interpolated into trigger DDL below.
     const auto entity_name = sqlIdentifier(entity.name());
 
-    // First drop any existing hooks
-    dropDbHooks(entity_name, sess);
-
     if (const auto db_type = sess->get_backend_name(); db_type == "sqlite3") {
+        // MB_SQLITE_CAPTURE=hooks: the writing connections capture it instead,
+        // and triggers left from before the switch would log it twice
+        if (auto *hooks = MantisBase::instance().db().changeHooks()) {
+            dropSqliteTriggers(*sess, entity_name);
+            hooks->describe(entity_name, hookLayout(entity, entity_name, *sess));
+            SqliteChangeHooks::unmute(*sess, entity_name);
+            return;
+        }
+
         auto old_obj = buildTriggerObject(entity, "OLD");
         auto new_obj = buildTriggerObject(entity, "NEW");
+        // MB_RT_CAPTURE=lazy: log only while some node holds a lease on the entity
+        const auto when = ChangeCapture::Options::current().lazy
+                              ? std::format("WHEN {} ", ChangeCapture::sqliteCondition(entity_name))
+                              : std::string();
+
+        // Only TEMP triggers may write to an attached database; they live on
+        // the writer connection and are recreated each boot by syncDbHooks()
+        const bool attached = RealtimeDB::attachedChangeLog();
+        const auto create = attached ? "CREATE TEMP TRIGGER" : "CREATE TRIGGER";
+        const auto table = attached ? "main." + entity_name : entity_name;
+
+        // No trailing `;`, so each reads back from sqlite_master as written
+        const std::map<std::string, std::string> triggers{
+            {
+                std::format("mb_{}_insert_trigger", entity_name), std::format(
+                    "{3} mb_{0}_insert_trigger AFTER INSERT ON {4} {2}"
+                    "\n\tBEGIN "
+                    "\n\t\tINSERT INTO mb_change_log(type, entity, row_id, new_data) "
+                    "\n\t\tVALUES ('INSERT', '{0}', NEW.id, {1}); "
+                    "\n\tEND", entity_name, new_obj, when, create, table)
+            },
+            {
+                std::format("mb_{}_update_trigger", entity_name), std::format(
+                    "{4} mb_{0}_update_trigger AFTER UPDATE ON {5} {3}"
+                    "\n\tBEGIN "
+                    "\n\t\tINSERT INTO mb_change_log(type, entity, row_id, old_data, new_data) "
+                    "\n\t\tVALUES ('UPDATE', '{0}', NEW.id, {1}, {2}); "
+                    "\n\tEND", entity_name, old_obj, new_obj, when, create, table)
+            },
+            {
+                std::format("mb_{}_delete_trigger", entity_name), std::format(
+                    "{3} mb_{0}_delete_trigger AFTER DELETE ON {4} {2}"
+                    "\n\tBEGIN "
+                    "\n\t\tINSERT INTO mb_change_log(type, entity, row_id, old_data) "
+                    "\n\t\tVALUES ('DELETE', '{0}', OLD.id, {1}); "
+                    "\n\tEND", entity_name, old_obj, when, create, table)
+            }
+        };
+
+        // Schema changes that leave the fields alone (rules, indexes, ...) keep
+        // their triggers; rebuilding them would only reset prepared statements
+        std::map<std::string, std::string> existing;
+        const soci::rowset<soci::row> rows = (sess->prepare
+            << std::format("SELECT name, sql FROM {} WHERE type = 'trigger' AND tbl_name = :tbl",
+                           attached ? "sqlite_temp_master" : "sqlite_master"),
+            soci::use(entity_name));
+        for (const auto &row: rows) {
+            auto ddl = row.get<std::string>(1);
+            // sqlite_temp_master keeps a TEMP trigger's DDL without the TEMP
+            if (attached && ddl.starts_with("CREATE TRIGGER")) ddl.insert(std::string_view("CREATE").size(), " TEMP");
+            existing.emplace(row.get<std::string>(0), std::move(ddl));
+        }
+        if (std::ranges::all_of(triggers, [&](const auto &t) {
+            const auto it = existing.find(t.first);
+            return it != existing.end() && it->second == t.second;
+        })) {
+            logEntry::debug("Realtime Mgr", std::format("Db Hooks on `{}` are current", entity_name));
+            return;
+        }
 
-        // Create INSERT trigger
-        *sess << std::format(
-            "CREATE TRIGGER mb_{0}_insert_trigger AFTER INSERT ON {0} "
-            "\n\tBEGIN "
-            "\n\t\tINSERT INTO mb_change_log(type, entity, row_id, new_data) "
-            "\n\t\tVALUES ('INSERT', '{0}', NEW.id, {1}); "
-            "\n\tEND;", entity_name, new_obj);
-
-        // Create UPDATE trigger
-        *sess << std::format(
-            "CREATE TRIGGER mb_{0}_update_trigger AFTER UPDATE ON {0} "
-            "\n\tBEGIN "
-            "\n\t\tINSERT INTO mb_change_log(type, entity, row_id, old_data, new_data) "
-            "\n\t\tVALUES ('UPDATE', '{0}', NEW.id, {1}, {2}); "
-            "\n\tEND;", entity_name, old_obj, new_obj);
-
-        // Create DELETE trigger
-        *sess << std::format(
-            "CREATE TRIGGER mb_{0}_delete_trigger AFTER DELETE ON {0} "
-            "\n\tBEGIN "
-            "\n\t\tINSERT INTO mb_change_log(type, entity, row_id, old_data) "
-            "\n\t\tVALUES ('DELETE', '{0}', OLD.id, {1}); "
-            "\n\tEND;", entity_name, old_obj);
+        dropDbHooks(entity_name, sess);
+        for (const auto &[_, ddl]: triggers)
+            *sess << ddl;
     }
 
 #if MB_HAS_POSTGRESQL
     else if (db_type == "postgresql") {
+        // MB_PG_CAPTURE=logical: the worker reads the table's changes off the
+        // slot. A FULL replica identity logs the old row whole, as the trigger
+        // sends it, and marks the table as an entity's for the worker.
+        if (LogicalCapture::enabled()) {
+            dropPgTriggers(*sess, entity_name);
+            std::string identity;
+            soci::indicator ind = soci::i_null;
+            *sess << "SELECT relreplident FROM pg_class WHERE oid = to_regclass(:tbl)", soci::use(entity_name),
+                    soci::into(identity, ind);
+            if (ind != soci::i_ok || identity != "f")
+                *sess << std::format("ALTER TABLE {} REPLICA IDENTITY FULL", entity_name);
+            LogicalCapture::unmute(*sess, entity_name);
+            return;
+        }
+
+        // Every trigger calls mb_notify_changes(), passing the blob columns to
+        // leave out; present with those arguments means current
+        // Unquoted in the DDL, so PostgreSQL folds the names to lowercase
+        auto prefix = "mb_" + entity_name;
+        toLowerCase(prefix);
+        const auto ins = prefix + "_insert_notify", upd = prefix + "_update_notify", del = prefix + "_delete_notify";
+        std::string args, tgargs;
+        for (const auto &field: entity.fields()) {
+            if (field.value("type", "") != "blob") continue;
+            // The row's JSON keys, so folded like the column names
+            auto name = sqlIdentifier(field["name"].get<std::string>());
+            toLowerCase(name);
+            args += std::format("{}'{}'", args.empty() ? "" : ", ", name);
+            // pg_trigger.tgargs: each argument NUL terminated, compared as hex
+            for (const unsigned char c: name + '\0') tgargs += std::format("{:02x}", c);
+        }
+        int present = 0;
+        *sess << "SELECT COUNT(*) FROM pg_trigger WHERE tgrelid = to_regclass(:tbl) AND NOT tgisinternal "
+                "AND tgname IN (:ins, :upd, :del) AND encode(tgargs, 'hex') = :args",
+                soci::use(entity_name, "tbl"), soci::use(ins, "ins"), soci::use(upd, "upd"), soci::use(del, "del"),
+                soci::use(tgargs, "args"), soci::into(present);
+        if (present == 3) {
+            logEntry::debug("Realtime Mgr", std::format("Db Hooks on `{}` are current", entity_name));
+            return;
+        }
+
+        dropDbHooks(entity_name, sess);
+
         // Create INSERT trigger
         *sess << std::format(R"(
             CREATE TRIGGER mb_{0}_insert_notify
             AFTER INSERT ON {0}
             FOR EACH ROW
-            EXECUTE FUNCTION mb_notify_changes()
-        )", entity_name);
+            EXECUTE FUNCTION mb_notify_changes({1})
+        )", entity_name, args);
 
         // Create UPDATE trigger
         *sess << std::format(R"(
             CREATE TRIGGER mb_{0}_update_notify
             AFTER UPDATE ON {0}
             FOR EACH ROW
-            EXECUTE FUNCTION mb_notify_changes()
-        )", entity_name);
+            EXECUTE FUNCTION mb_notify_changes({1})
+        )", entity_name, args);
 
         // Create DELETE trigger
         *sess << std::format(R"(
             CREATE TRIGGER mb_{0}_delete_notify
             AFTER DELETE ON {0}
             FOR EACH ROW
-            EXECUTE FUNCTION mb_notify_changes()
-        )", entity_name);
+            EXECUTE FUNCTION mb_notify_changes({1})
+        )", entity_name, args);
     }
 #endif
 
@@ -155,32 +370,37 @@ void mb::RealtimeDB::addDbHooks(const Entity &entity, const std::shared_ptr<soci
                               std::format("Realtime Mgr: Database Hooks not implemented for db type `{}`", db_type));
 }
 
+void mb::RealtimeDB::syncDbHooks(const std::vector<std::shared_ptr<const Entity>> &entities) const {
+    for (const auto &entity: entities) {
+        try {
+            addDbHooks(*entity, mApp.db().writeSession());
+        } catch (const std::exception &e) {
+            logEntry::warn("Realtime Mgr", std::format("Could not sync Db Hooks on `{}`", entity->name()), e.what());
+        }
+    }
+}
+
 void mb::RealtimeDB::dropDbHooks(const std::string &entity_name) const {
-    const auto sql = mApp.db().session();
+    const auto sql = mApp.db().writeSession();
     dropDbHooks(entity_name, sql);
 }
 
 void mb::RealtimeDB::dropDbHooks(const std::string &entity_name, const std::shared_ptr<soci::session> &sess) {
+    if (Tenants::current()) return;
     if (!EntitySchema::isValidEntityName(entity_name)) {
         throw MantisException(400, "Invalid Entity name.");
     }
 
     if (const auto db_type = sess->get_backend_name(); db_type == "sqlite3") {
-        *sess << std::format("DROP TRIGGER IF EXISTS mb_{}_insert_trigger",
-                             entity_name);
-        *sess << std::format("DROP TRIGGER IF EXISTS mb_{}_update_trigger",
-                             entity_name);
-        *sess << std::format("DROP TRIGGER IF EXISTS mb_{}_delete_trigger",
-                             entity_name);
+        dropSqliteTriggers(*sess, entity_name);
+        // Without triggers, the hooks skip it for the rest of the transaction
+        SqliteChangeHooks::mute(*sess, entity_name);
     }
 #if MB_HAS_POSTGRESQL
     else if (db_type == "postgresql") {
-        *sess << std::format("DROP TRIGGER IF EXISTS mb_{0}_insert_notify ON {0}",
-                             entity_name);
-        *sess << std::format("DROP TRIGGER IF EXISTS mb_{0}_update_notify ON {0}",
-                             entity_name);
-        *sess << std::format("DROP TRIGGER IF EXISTS mb_{0}_delete_notify ON {0}",
-                             entity_name);
+        dropPgTriggers(*sess, entity_name);
+        // Without triggers, the worker skips its changes for the rest of the transaction
+        if (LogicalCapture::enabled()) LogicalCapture::mute(*sess, entity_name);
     }
 #endif
 
@@ -191,19 +411,124 @@ void mb::RealtimeDB::dropDbHooks(const std::string &entity_name, const std::shar
 }
 
 void mb::RealtimeDB::runWorker(const RtCallback &callback) {
+    std::lock_guard lock(m_subscribersMutex);
     if (!m_rtDbWorker) {
-        m_rtDbWorker = std::make_unique<RtDbWorker>(mApp);
+        m_rtDbWorker = std::make_unique<RtDbWorker>(mApp, m_capture.get());
         m_rtDbWorker->addCallback(callback);
+        for (const auto &cb: m_subscribers)
+            m_rtDbWorker->addCallback(cb);
+        for (const auto &[entity, _]: m_watched)
+            listenLocked(entity, true);
+        for (const auto &entity: m_pinned)
+            if (!m_watched.contains(entity)) listenLocked(entity, true);
     }
 }
 
+void mb::RealtimeDB::subscribe(const RtCallback &callback) {
+    std::lock_guard lock(m_subscribersMutex);
+    m_subscribers.push_back(callback);
+    if (m_rtDbWorker)
+        m_rtDbWorker->addCallback(callback);
+}
+
+bool mb::RealtimeDB::entityChannels() {
+    static const bool on = [] {
+        auto mode = trim(getEnvOrDefault("MB_RT_CHANNELS", "shared"));
+        toLowerCase(mode);
+        return mode == "entity";
+    }();
+    return on;
+}
+
+bool mb::RealtimeDB::attachedChangeLog() {
+    static const bool on = [] {
+        auto mode = trim(getEnvOrDefault("MB_SQLITE_CHANGE_LOG", "main"));
+        toLowerCase(mode);
+        if (mode != "attached") return false;
+        // Pooled writers would each need the TEMP triggers, and lose them on reconnect
+        if (getEnvOrDefault("MB_SQLITE_SINGLE_WRITER", "0") != "1") {
+            LogOrigin::dbWarn("Realtime Mgr", "MB_SQLITE_CHANGE_LOG=attached needs MB_SQLITE_SINGLE_WRITER=1; "
+                                              "keeping mb_change_log in mantis.db");
+            return false;
+        }
+        // A commit lands in the two WALs one after the other, not atomically
+        if (const auto replication = Replication::Options::fromEnv();
+            replication.serving() || replication.follower() || DeltaSync::Options::fromEnv().enabled()) {
+            LogOrigin::dbWarn("Realtime Mgr", "Replication and delta sync read mb_change_log with the rows; "
+                                              "keeping it in mantis.db");
+            return false;
+        }
+        return true;
+    }();
+    return on;
+}
+
+std::string mb::RealtimeDB::channelOf(const std::string_view entity) {
+    // Left unquoted in LISTEN, so PostgreSQL folds and cuts it to 63 bytes as the trigger does
+    return std::format("mb_db_changes_{}", entity);
+}
+
+std::string_view mb::RealtimeDB::topicEntity(const std::string_view topic) {
+    return topic.substr(0, topic.find_first_of(":?"));
+}
+
+bool mb::RealtimeDB::selective() const {
+    return m_capture || (entityChannels() && mApp.dbType() == "postgresql");
+}
+
+void mb::RealtimeDB::watch(const std::string &entity) {
+    if (!selective()) return;
+    std::lock_guard lock(m_subscribersMutex);
+    if (++m_watched[entity] == 1 && !m_pinned.contains(entity))
+        followLocked(entity, true);
+}
+
+void mb::RealtimeDB::unwatch(const std::string &entity) {
+    if (!selective()) return;
+    std::lock_guard lock(m_subscribersMutex);
+    const auto it = m_watched.find(entity);
+    if (it == m_watched.end() || --it->second > 0) return;
+    m_watched.erase(it);
+    if (!m_pinned.contains(entity))
+        followLocked(entity, false);
+}
+
+void mb::RealtimeDB::pin(const std::string &entity) {
+    if (!selective()) return;
+    std::lock_guard lock(m_subscribersMutex);
+    if (m_pinned.insert(entity).second && !m_watched.contains(entity))
+        followLocked(entity, true);
+}
+
+void mb::RealtimeDB::captureAll() {
+    if (!m_capture) return;
+    std::lock_guard lock(m_subscribersMutex);
+    if (!std::exchange(m_capturingAll, true))
+        m_capture->hold("*", true);
+}
+
+void mb::RealtimeDB::followLocked(const std::string &entity, const bool on) const {
+    // Channels carry only what the triggers capture; the lease is written off this thread
+    if (m_capture) m_capture->hold(entity, on);
+    listenLocked(entity, on);
+}
+
+void mb::RealtimeDB::listenLocked(const std::string &entity, const bool on) const {
+    // Before the worker starts, runWorker() hands it everything watched so far
+    if (m_rtDbWorker && entityChannels() && mApp.dbType() == "postgresql")
+        m_rtDbWorker->listen(entity, on);
+}
+
 void mb::RealtimeDB::stopWorker() const {
     if (m_rtDbWorker) {
         m_rtDbWorker->stopWorker();
     }
+    // Leases left out lapse after the grace period, by which time a restart has renewed its own
+    if (m_capture) m_capture->stop();
 }
 
 void mb::RealtimeDB::notifyChange() const {
+    if (Tenants::current()) return;
     // No-op until the worker is started (e.g. during bootstrap or when the
     // server isn't serving). The worker signals itself; this is the push from
     // the write path.
@@ -212,37 +537,139 @@ void mb::RealtimeDB::notifyChange() const {
     }
 }
 
+long long mb::RealtimeDB::deliveredChangeId() const {
+    return m_rtDbWorker ? m_rtDbWorker->deliveredId() : -1;
+}
+
+void mb::RealtimeDB::pruneChangeLog() const {
+    if (m_rtDbWorker && m_rtDbWorker->isDbRunning())
+        m_rtDbWorker->pruneDelivered();
+}
+
+void mb::RealtimeDB::publish(const std::string &type, const std::string &entity, const std::string &row_id,
+                             json old_data, json new_data) const {
+    // A tenant's writes aren't on the change stream; its own caches hear them here
+    if (auto *tenant = Tenants::current()) {
+        tenant->onChanges(json::array({ChangeJournal::makeEvent(type, entity, row_id, std::move(old_data),
+                                                                std::move(new_data))}));
+        return;
+    }
+    // The connection hooks already captured this write
+    if (mApp.db().changeHooks()) return;
+    if (m_rtDbWorker) {
+        m_rtDbWorker->publish(ChangeJournal::makeEvent(type, entity, row_id,
+                                                       std::move(old_data), std::move(new_data)));
+    }
+}
+
+void mb::RealtimeDB::publishAll(json events) const {
+    if (auto *tenant = Tenants::current()) {
+        tenant->onChanges(events);
+        return;
+    }
+    if (mApp.db().changeHooks()) return;
+    if (m_rtDbWorker && !events.empty())
+        m_rtDbWorker->publishAll(std::move(events));
+}
+
+void mb::RealtimeDB::publishCaptured(json events) const {
+    if (m_rtDbWorker && !events.empty())
+        m_rtDbWorker->publishCaptured(std::move(events));
+}
+
+void mb::RealtimeDB::logChange(soci::session &sql, const std::string &type, const std::string &entity,
+                               const std::string &row_id, const json &new_data) {
+    // Tenant databases have no `mb_change_log`
+    if (auto *tenant = Tenants::current()) {
+        tenant->onChanges(json::array({ChangeJournal::makeEvent(type, entity, row_id, nullptr, new_data)}));
+        return;
+    }
+    const auto data = new_data.dump();
+
+    if (const auto db_type = sql.get_backend_name(); db_type == "sqlite3") {
+        // The poller picks it up off the log like a trigger's row
+        sql << "INSERT INTO mb_change_log(type, entity, row_id, new_data) VALUES (:type, :entity, :row_id, :data)",
+                soci::use(type, "type"), soci::use(entity, "entity"), soci::use(row_id, "row_id"),
+                soci::use(data, "data");
+    }
+#if MB_HAS_POSTGRESQL
+    else if (db_type == "postgresql") {
+        int change_id = 0;
+        sql << "INSERT INTO mb_change_log(type, entity, row_id, new_data) VALUES (:type, :entity, :row_id, :data) "
+                "RETURNING id", soci::use(type, "type"), soci::use(entity, "entity"), soci::use(row_id, "row_id"),
+                soci::use(data, "data"), soci::into(change_id);
+
+        // Same payload and channel as mb_notify_changes(); a summary is small
+        // enough that it never needs the truncated form
+        auto channel = entityChannels() ? channelOf(entity) : std::string("mb_db_changes");
+        toLowerCase(channel);
+        if (channel.size() > 63) channel.resize(63);
+        sql << "SELECT pg_notify(:channel, json_build_object('id', :id, 'timestamp', "
+                "EXTRACT(EPOCH FROM NOW())::bigint, 'type', :type, 'entity', :entity, 'row_id', :row_id, "
+                "'old_data', NULL, 'new_data', CAST(:data AS json))::text)",
+                soci::use(channel, "channel"), soci::use(change_id, "id"), soci::use(type, "type"),
+                soci::use(entity, "entity"), soci::use(row_id, "row_id"), soci::use(data, "data");
+    }
+#endif
+    else
+        throw MantisException(400, std::format("Realtime Mgr: Change log not implemented for db type `{}`", db_type));
+}
+
 #if MB_HAS_POSTGRESQL
 void mb::RealtimeDB::createNotifyFunction(soci::session &sql) {
-    sql << R"(
-            CREATE OR REPLACE FUNCTION mb_notify_changes()
-            RETURNS TRIGGER AS $$
+    // With per-entity channels, nodes only hear about the entities they LISTEN to
+    const auto channel = RealtimeDB::entityChannels() ? "left('mb_db_changes_' || TG_TABLE_NAME, 63)" : "'mb_db_changes'";
+    const auto body = std::format(R"(
             DECLARE
                 notification json;
-            BEGIN
-                -- Build notification payload
+                change_id integer;
+                old_row json;
+                new_row json;
+                changed_id text;
+            BEGIN{}
+                -- The trigger's arguments are the blob columns, left out of the event
                 IF (TG_OP = 'DELETE') THEN
-                    notification = json_build_object(
-                        'timestamp', EXTRACT(EPOCH FROM NOW())::bigint,
-                        'type', TG_OP,
-                        'entity', TG_TABLE_NAME,
-                        'row_id', OLD.id::text,
-                        'old_data', row_to_json(OLD),
-                        'new_data', NULL
-                    );
+                    old_row = CASE WHEN TG_NARGS > 0 THEN (to_jsonb(OLD) - TG_ARGV)::json ELSE row_to_json(OLD) END;
+                    changed_id = OLD.id::text;
                 ELSE
+                    old_row = CASE WHEN TG_OP <> 'UPDATE' THEN NULL
+                                   WHEN TG_NARGS > 0 THEN (to_jsonb(OLD) - TG_ARGV)::json
+                                   ELSE row_to_json(OLD) END;
+                    new_row = CASE WHEN TG_NARGS > 0 THEN (to_jsonb(NEW) - TG_ARGV)::json ELSE row_to_json(NEW) END;
+                    changed_id = NEW.id::text;
+                END IF;
+
+                -- Sequenced copy, so the listener can catch up after a dropped connection
+                INSERT INTO mb_change_log(type, entity, row_id, old_data, new_data)
+                VALUES (TG_OP, TG_TABLE_NAME, changed_id, old_row::text, new_row::text)
+                RETURNING id INTO change_id;
+
+                -- Build notification payload
+                notification = json_build_object(
+                    'id', change_id,
+                    'timestamp', EXTRACT(EPOCH FROM NOW())::bigint,
+                    'type', TG_OP,
+                    'entity', TG_TABLE_NAME,
+                    'row_id', changed_id,
+                    'old_data', old_row,
+                    'new_data', new_row
+                );
+
+                -- pg_notify caps payloads below 8000 bytes; past that, send a
+                -- reference and let the listener read the row from mb_change_log
+                IF octet_length(notification::text) > 7800 THEN
                     notification = json_build_object(
+                        'id', change_id,
                         'timestamp', EXTRACT(EPOCH FROM NOW())::bigint,
                         'type', TG_OP,
                         'entity', TG_TABLE_NAME,
-                        'row_id', NEW.id::text,
-                        'old_data', CASE WHEN TG_OP = 'UPDATE' THEN row_to_json(OLD) ELSE NULL END,
-                        'new_data', row_to_json(NEW)
+                        'row_id', changed_id,
+                        'truncated', true
                     );
                 END IF;
 
                 -- Send notification
-                PERFORM pg_notify('mb_db_changes', notification::text);
+                PERFORM pg_notify({}, notification::text);
 
                 IF TG_OP = 'DELETE' THEN
                     RETURN OLD;
@@ -250,8 +677,25 @@ void mb::RealtimeDB::createNotifyFunction(soci::session &sql) {
                     RETURN NEW;
                 END IF;
             END;
-            $$ LANGUAGE plpgsql;
-        )";
+            )", ChangeCapture::Options::current().lazy ? R"(
+                -- MB_RT_CAPTURE=lazy: nothing to do unless some node holds a lease on the table
+                IF NOT EXISTS (SELECT 1 FROM mb_rt_capture WHERE entity IN (TG_TABLE_NAME, '*')
+                               AND expires >= EXTRACT(EPOCH FROM NOW())) THEN
+                    RETURN NULL;
+                END IF;
+)" : "", channel);
+
+    // Replacing it locks out every trigger calling it; boots that would write
+    // the same body (most of them) leave it be
+    std::string current;
+    soci::indicator ind = soci::i_null;
+    sql << "SELECT prosrc FROM pg_proc WHERE proname = 'mb_notify_changes'", soci::into(current, ind);
+    if (sql.got_data() && ind == soci::i_ok && current == body) {
+        logEntry::debug("PostgreSQL Realtime", "Notification function 'mb_notify_changes' is current");
+        return;
+    }
+
+    sql << "CREATE OR REPLACE FUNCTION mb_notify_changes() RETURNS TRIGGER AS $$" + body + "$$ LANGUAGE plpgsql";
 
     logEntry::info("PostgreSQL Realtime",
                    "Created notification function 'mb_notify_changes'");
@@ -261,29 +705,31 @@ void mb::RealtimeDB::createNotifyFunction(soci::session &sql) {
 std::string mb::RealtimeDB::buildTriggerObject(const Entity &entity, const std::string &action) {
     std::stringstream ss;
     ss << "json_object(";
-    int i = 0;
+    bool first = true;
     for (const auto &field: entity.fields()) {
+        // Blobs are left out of change events; json_object() can't hold them
+        if (field.value("type", "") == "blob") continue;
+
         // Field name is interpolated into trigger DDL, so validate it.
         auto name = sqlIdentifier(field["name"].get<std::string>());
+        if (!first) ss << ", ";
         ss << "'" << name << "', " << action << "." << name;
-        if (i < entity.fields().size() - 1) {
-            ss << ", ";
-        }
-
-        i++;
+        first = false;
     }
     ss << ")";
 
     return ss.str();
 }
 
-mb::RtDbWorker::RtDbWorker(const MantisBase &app)
-    : mApp(app), m_running(true) {
+mb::RtDbWorker::RtDbWorker(const MantisBase &app, const ChangeCapture *capture)
+    : mApp(app), m_capture(capture), m_running(true) {
     m_db_type = mApp.dbType();
     if (m_db_type == "sqlite3") {
         if (!initSQLite())
             throw MantisException(500, "Worker: SQLite db instantiation failed!");
 
+        m_journal = std::make_unique<ChangeJournal>();
+
         logEntry::info("RTDb Worker",
                        "SQLite Database Status",
                        std::format("DB Connection should be active: {}", (isDbRunning() ? "true" : "false")));
@@ -291,6 +737,11 @@ mb::RtDbWorker::RtDbWorker(const MantisBase &app)
 
 #if MB_HAS_POSTGRESQL
     else if (m_db_type == "postgresql") {
+        if (::pipe(m_wakePipe) == 0) {
+            for (const int fd: m_wakePipe) ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+        }
+
+        m_logical = LogicalCapture::enabled();
         if (!initPSQL())
             throw MantisException(500, "Worker: PostgreSQL db instantiation failed!");
 
@@ -309,6 +760,11 @@ mb::RtDbWorker::RtDbWorker(const MantisBase &app)
 
 mb::RtDbWorker::~RtDbWorker() {
     stopWorker();
+
+#if MB_HAS_POSTGRESQL
+    for (const int fd: m_wakePipe)
+        if (fd >= 0) ::close(fd);
+#endif
 }
 
 bool mb::RtDbWorker::isDbRunning() const {
@@ -321,7 +777,65 @@ bool mb::RtDbWorker::isDbRunning() const {
 }
 
 void mb::RtDbWorker::addCallback(const RtCallback &cb) {
-    m_callback = cb;
+    std::lock_guard lock(m_callbacksMutex);
+    m_callbacks.push_back(cb);
+}
+
+void mb::RtDbWorker::listen(const std::string &entity, const bool on) {
+#if MB_HAS_POSTGRESQL
+    {
+        std::lock_guard lock(m_listenMutex);
+        m_pendingListens.emplace_back(entity, on);
+    }
+    if (m_wakePipe[1] >= 0) {
+        constexpr char byte = 1;
+        // A full pipe already has the worker on its way
+        [[maybe_unused]] const auto written = ::write(m_wakePipe[1], &byte, 1);
+    }
+#else
+    (void) entity;
+    (void) on;
+#endif
+}
+
+void mb::RtDbWorker::emit(const json &events, const std::vector<std::pair<TraceContext, std::uint64_t>> &origins) {
+    std::vector<RtCallback> callbacks;
+    {
+        std::lock_guard lock(m_callbacksMutex);
+        callbacks = m_callbacks;
+    }
+
+    // From the first journaled write to the SSE/WS queues; changes read from
+    // mb_change_log carry no context and start a trace of their own
+    auto &tracer = mApp.router().tracer();
+    std::optional<SpanData> span;
+    if (tracer.enabled()) {
+        std::optional<TraceContext> parent;
+        if (!origins.empty()) parent = origins.front().first;
+        SpanData data;
+        data.context = tracer.childOf(parent);
+        if (data.context.sampled) {
+            data.name = "realtime.deliver";
+            data.startNs = Tracer::nowNs();
+            if (parent) data.parentSpanId = parent->spanId;
+            for (const auto &[ctx, at_ns]: origins) {
+                if (at_ns > 0) data.startNs = std::min(data.startNs, at_ns);
+                if (ctx.spanId != parent->spanId) data.links.push_back(ctx);
+            }
+            data.attributes.emplace_back("messaging.batch.message_count", std::to_string(events.size()));
+            span = std::move(data);
+        }
+    }
+
+    for (const auto &cb: callbacks) {
+        if (cb) cb(events);
+    }
+    m_deliveredId.store(last_id, std::memory_order_relaxed);
+
+    if (span) {
+        span->endNs = Tracer::nowNs();
+        tracer.record(std::move(*span));
+    }
 }
 
 void mb::RtDbWorker::stopWorker() {
@@ -335,6 +849,10 @@ void mb::RtDbWorker::stopWorker() {
     if (sql_ro && sql_ro->is_connected()) {
         sql_ro->close();
     }
+    {
+        std::lock_guard lock(m_pruneMutex);
+        m_logWriter.reset();
+    }
 
 #if MB_HAS_POSTGRESQL
     if (psql) {
@@ -371,7 +889,6 @@ void mb::RtDbWorker::runSQlite() {
     // few seconds and app-layer writes are delivered with near-zero latency.
     constexpr auto kFallbackInterval = std::chrono::seconds(2);
     constexpr int kBatchSize = 100;
-    constexpr int kPruneThreshold = 500;
 
     while (m_running.load()) {
         {
@@ -384,6 +901,9 @@ void mb::RtDbWorker::runSQlite() {
 
         if (!m_running.load()) break;
 
+        // App-layer writes first: already JSON, no read-back or parse
+        drainJournal();
+
         // Drain all pending change rows before sleeping again, so a burst of
         // writes is delivered promptly rather than one batch per wake-up.
         try {
@@ -404,46 +924,54 @@ void mb::RtDbWorker::runSQlite() {
                               );
 
                 json res = json::array();
+                int batch_last_id = last_id;
+                std::size_t rows = 0;
 
                 for (const auto &row: row_set) {
+                    ++rows;
+                    batch_last_id = row.get<int>(0);
+
+                    // Rows already delivered from the journal skip the JSON parse
+                    const auto type = row.get<std::string>(2);
+                    const auto entity = row.get<std::string>(3);
+                    const auto row_id = row.get<std::string>(4);
+                    if (!m_dedup.accept(ChangeDeduplicator::Source::Log, type, entity, row_id))
+                        continue;
+
                     auto old_data = row.get_indicator(5) == soci::i_null ? "" : row.get<std::string>(5);
                     auto new_data = row.get_indicator(6) == soci::i_null ? "" : row.get<std::string>(6);
 
                     auto od = tryParseJsonStr(old_data, json::object()).value();
                     auto nd = tryParseJsonStr(new_data, json::object()).value();
+                    // The triggers copy what is stored; subscribers get the values
+                    FieldCompression::inflateMembers(od);
+                    FieldCompression::inflateMembers(nd);
 
                     res.push_back({
-                        {"id", row.get<int>(0)},
+                        {"id", batch_last_id},
                         {"timestamp", tmToStr(row.get<std::tm>(1))},
-                        {"type", row.get<std::string>(2)},
-                        {"entity", row.get<std::string>(3)},
-                        {"row_id", row.get<std::string>(4)},
+                        {"type", type},
+                        {"entity", entity},
+                        {"row_id", row_id},
                         {"old_data", od.empty() ? nullptr : od},
                         {"new_data", nd.empty() ? nullptr : nd},
                     });
                 }
 
-                if (res.empty()) break; // fully drained
+                if (rows == 0) break; // fully drained
 
-                // Get last element's `id`
-                last_id = res.at(res.size() - 1)["id"].get<int>();
+                last_id = batch_last_id;
 
-                if (m_callback)
-                    m_callback(res);
+                if (!res.empty()) emit(res);
 
-                // Prune consumed rows to keep mb_change_log bounded. This worker
-                // is the sole consumer and does not replay history to new
-                // subscribers, so rows with id <= last_id have been broadcast
-                // and are safe to delete. Batch the deletes.
-                if (last_id - m_lastPrunedId >= kPruneThreshold)
-                    pruneChangeLog(last_id);
-
-                if (res.size() < static_cast<size_t>(kBatchSize))
+                if (rows < static_cast<size_t>(kBatchSize))
                     break; // partial batch => nothing more to read for now
             }
         } catch (std::exception &e) {
             logEntry::critical("RTDb Worker", "Realtime Db Worker Error", e.what());
         }
+
+        m_dedup.purge();
     }
 
     // Best-effort final prune of everything consumed before the worker exits.
@@ -459,13 +987,140 @@ void mb::RtDbWorker::notify() {
     cv.notify_one();
 }
 
+void mb::RtDbWorker::publish(json event) {
+    tagTrace(event);
+    stampCommit(event);
+    if (m_journal && !m_journal->publish(std::move(event)))
+        logEntry::debug("RTDb Worker", "Change journal full, falling back to mb_change_log");
+
+    notify();
+}
+
+void mb::RtDbWorker::publishAll(json events) {
+    std::size_t dropped = 0;
+    for (auto &event: events) {
+        tagTrace(event);
+        stampCommit(event);
+        if (m_journal && !m_journal->publish(std::move(event)))
+            ++dropped;
+    }
+    if (dropped > 0)
+        logEntry::debug("RTDb Worker",
+                        std::format("Change journal full, {} change(s) falling back to mb_change_log", dropped));
+
+    notify();
+}
+
+void mb::RtDbWorker::publishCaptured(json events) {
+    {
+        std::lock_guard lock(m_capturedMutex);
+        for (auto &event: events) {
+            tagTrace(event);
+            stampCommit(event);
+            m_captured.push_back(std::move(event));
+        }
+    }
+    notify();
+}
+
+void mb::RtDbWorker::drainJournal() {
+    if (!m_journal) return;
+
+    json batch = json::array();
+    std::vector<std::pair<TraceContext, std::uint64_t>> origins;
+    const auto untag = [&](json &event) {
+        // Subscribers never see the trace tag
+        if (const auto tag = event.find("_trace"); tag != event.end()) {
+            if (const auto ctx = TraceContext::parse(tag->value("traceparent", "")))
+                origins.emplace_back(*ctx, tag->value("at_ns", std::uint64_t{0}));
+            event.erase(tag);
+        }
+    };
+    json event;
+    while (m_journal->consume(event)) {
+        untag(event);
+        // Uncaptured, no trigger copy comes to match it against
+        const auto &entity = event["entity"].get_ref<const std::string &>();
+        if ((m_capture && !m_capture->captured(entity)) ||
+            m_dedup.accept(ChangeDeduplicator::Source::Journal,
+                           event["type"].get<std::string>(),
+                           entity,
+                           event["row_id"].get<std::string>()))
+            batch.push_back(std::move(event));
+    }
+
+    // Captured by the connection hooks, the only copy there is
+    std::vector<json> captured;
+    {
+        std::lock_guard lock(m_capturedMutex);
+        captured.swap(m_captured);
+    }
+    for (auto &c: captured) {
+        untag(c);
+        batch.push_back(std::move(c));
+    }
+
+    if (!batch.empty()) {
+        try {
+            emit(batch, origins);
+        } catch (const std::exception &e) {
+            logEntry::critical("RTDb Worker", "Realtime Db Worker Error", e.what());
+        }
+    }
+}
+
+void mb::RtDbWorker::pruneDelivered() {
+    // This worker is the sole consumer and does not replay history to new
+    // subscribers, so rows up to the last delivered batch are safe to delete
+    if (const auto delivered = static_cast<int>(deliveredId()); delivered > m_lastPrunedId)
+        pruneChangeLog(delivered);
+}
+
 void mb::RtDbWorker::pruneChangeLog(const int up_to_id) {
     // The poller connection (sql_ro) is read-only, so acquire a writable
     // session from the main pool for the delete. The pk index on `id` makes
     // this a cheap range delete, and WAL lets it run alongside the poller.
+    // An attached change log (nothing retains rows there) is pruned on a
+    // connection of its own, so the delete never queues behind entity writes
+    if (m_db_type == "sqlite3" && RealtimeDB::attachedChangeLog()) {
+        try {
+            std::lock_guard lock(m_pruneMutex);
+            if (!m_logWriter)
+                m_logWriter = std::make_unique<soci::session>(soci::sqlite3, std::format(
+                    "db={} timeout=5 synchronous=normal",
+                    joinPaths(mApp.dataDir(), RealtimeDB::CHANGE_LOG_FILE).string()));
+            *m_logWriter << "DELETE FROM mb_change_log WHERE id <= :id", soci::use(up_to_id);
+            // The background checkpointer (MB_SQLITE_CHECKPOINT) only follows mantis.db's WAL
+            *m_logWriter << "PRAGMA wal_checkpoint(PASSIVE)";
+            m_lastPrunedId = up_to_id;
+        } catch (const std::exception &e) {
+            m_logWriter.reset();
+            logEntry::warn("RTDb Worker", "Change log prune failed", e.what());
+        }
+        return;
+    }
+
     try {
-        const auto write_sql = mApp.db().session();
-        *write_sql << "DELETE FROM mb_change_log WHERE id <= :id", soci::use(up_to_id);
+        const auto write_sql = mApp.db().writeSession();
+        // A replication primary keeps consumed rows a while longer, for followers
+        // that are behind (see Replication::changesAfter()), and so does delta
+        // sync, for clients coming back online (see DeltaSync)
+        static const auto replication = Replication::Options::fromEnv();
+        static const auto sync = DeltaSync::Options::fromEnv();
+        const auto retain = std::max(replication.serving() ? replication.retain : std::chrono::seconds(0),
+                                     sync.retain);
+        if (retain.count() > 0 && m_db_type == "postgresql") {
+            const int secs = static_cast<int>(retain.count());
+            *write_sql << "DELETE FROM mb_change_log WHERE id <= :id "
+                    "AND timestamp < LOCALTIMESTAMP - CAST(:secs AS integer) * INTERVAL '1 second'",
+                    soci::use(up_to_id), soci::use(secs);
+        } else if (retain.count() > 0) {
+            const auto age = std::format("-{} seconds", retain.count());
+            *write_sql << "DELETE FROM mb_change_log WHERE id <= :id AND timestamp < datetime('now', :age)",
+                    soci::use(up_to_id), soci::use(age);
+        } else {
+            *write_sql << "DELETE FROM mb_change_log WHERE id <= :id", soci::use(up_to_id);
+        }
         m_lastPrunedId = up_to_id;
     } catch (const std::exception &e) {
         logEntry::warn("RTDb Worker", "Change log prune failed", e.what());
@@ -474,57 +1129,105 @@ void mb::RtDbWorker::pruneChangeLog(const int up_to_id) {
 
 #if MB_HAS_POSTGRESQL
 void mb::RtDbWorker::runPostgreSQL() {
-    const auto sleep_for = std::chrono::milliseconds(500);
+    // Block on the LISTEN socket itself, so a NOTIFY wakes the worker as soon
+    // as it arrives. The timeout only bounds how long stopWorker() waits.
+    constexpr auto kStopCheckUs = 250'000;
+    constexpr auto kMaxBackoff = std::chrono::seconds(30);
+    auto backoff = std::chrono::seconds(1);
+
+    // MB_PG_CAPTURE=logical: the slot is read every poll interval, since no
+    // NOTIFY announces its changes; LISTEN still brings imports and revocations
+    const auto poll = LogicalCapture::Options::current().poll;
+    const auto wait_us = m_logical
+                             ? std::min<long>(kStopCheckUs, std::chrono::duration_cast<std::chrono::microseconds>(poll).count())
+                             : kStopCheckUs;
+    auto next_read = std::chrono::steady_clock::now();
 
     while (m_running.load()) {
-        {
-            std::unique_lock lock(mtx);
-            cv.wait_for(lock, sleep_for);
+        if (!isDbRunning()) {
+            if (!reconnectPSQL()) {
+                std::unique_lock lock(mtx);
+                cv.wait_for(lock, backoff, [this] { return !m_running.load(); });
+                backoff = std::min(backoff * 2, kMaxBackoff);
+                continue;
+            }
+            backoff = std::chrono::seconds(1);
         }
 
         try {
-            // Wait for notifications using select()
-            fd_set input_mask;
-            FD_ZERO(&input_mask);
-            FD_SET(PQsocket(psql.get()), &input_mask);
+            if (m_logical && std::chrono::steady_clock::now() >= next_read) {
+                readSlotPSQL();
+                next_read = std::chrono::steady_clock::now() + poll;
+            }
 
-            struct timeval timeout;
-            timeout.tv_sec = 1; // 1 second timeout
-            timeout.tv_usec = 0;
+            // PQexec() may read notifications off the socket, so after a
+            // LISTEN they are collected below without waiting for it
+            if (!applyListens()) {
+                const int sock = PQsocket(psql.get());
+                fd_set input_mask;
+                FD_ZERO(&input_mask);
+                FD_SET(sock, &input_mask);
+                if (m_wakePipe[0] >= 0) FD_SET(m_wakePipe[0], &input_mask);
+
+                timeval timeout{0, static_cast<suseconds_t>(wait_us)};
+                const int result = select(std::max(sock, m_wakePipe[0]) + 1, &input_mask, nullptr, nullptr, &timeout);
+
+                if (result < 0) {
+                    if (errno == EINTR) continue;
+                    logEntry::warn("[PSQl] RTDb Worker", "PostgreSQL Notify Worker",
+                                   "select() failed, reconnecting");
+                    psql.reset();
+                    continue;
+                }
 
-            const int result = select(PQsocket(psql.get()) + 1, &input_mask,
-                                      nullptr, nullptr, &timeout);
+                if (result == 0) continue;
 
-            if (result < 0) {
-                logEntry::critical("[PSQl] RTDb Worker", "PostgreSQL Notify Worker", "select() failed");
-                break;
+                // listen() woke us: LISTEN first, the next pass reads the socket
+                if (m_wakePipe[0] >= 0 && FD_ISSET(m_wakePipe[0], &input_mask)) {
+                    char drain[64];
+                    while (::read(m_wakePipe[0], drain, sizeof(drain)) > 0) {}
+                    if (!FD_ISSET(sock, &input_mask)) continue;
+                }
             }
 
-            if (result == 0) {
-                // Timeout - check if we should continue
+            // A readable socket with nothing to consume means the server went away
+            if (!PQconsumeInput(psql.get()) || PQstatus(psql.get()) != CONNECTION_OK) {
+                logEntry::warn("[PSQl] RTDb Worker", "PostgreSQL Notify Worker",
+                               std::format("Connection lost, reconnecting: {}", PQerrorMessage(psql.get())));
+                psql.reset();
                 continue;
             }
 
-            // Consume input from the connection
-            PQconsumeInput(psql.get());
-
-            // Process all available notifications
+            // Deliver everything that arrived together as one batch
+            json batch = json::array();
             PGnotify *notify;
-            // TODO add conditional var for disconnecting this inner loop
             while ((notify = PQnotifies(psql.get())) != nullptr) {
-                try {
-                    // Parse the JSON payload
-                    json notification = json::parse(notify->extra);
+                // Another node logged a session out; don't keep accepting it here
+                if (SharedState::REVOCATION_CHANNEL == notify->relname) {
+                    Auth::sessionCache().putRevoked(notify->extra);
+                    Auth::revocations().add(notify->extra);
+                    PQfreemem(notify);
+                    continue;
+                }
+                // A channel message or presence change from another node, delivered here as is
+                if (Channels::NOTIFY_CHANNEL == notify->relname) {
+                    Channels::instance().receive(notify->extra);
+                    PQfreemem(notify);
+                    continue;
+                }
 
-                    logEntry::debug("[PSQl] RTDb Worker", "PostgreSQL Notify Worker",
-                                    std::format("Received notification: {}", notification.dump()));
+                try {
+                    json notification = parseJson(notify->extra);
 
-                    // Call the callback
-                    if (m_callback) {
-                        json arr = json::array();
-                        arr.push_back(notification);
-                        m_callback(arr);
+                    // Already delivered by recoverPSQL() after a reconnect
+                    const auto id = notification.value("id", 0);
+                    if (id > 0 && id <= last_id) {
+                        PQfreemem(notify);
+                        continue;
                     }
+                    if (id > last_id) last_id = id;
+
+                    batch.push_back(std::move(notification));
                 } catch (const std::exception &e) {
                     logEntry::critical("[PSQl] RTDb Worker", "PostgreSQL Notify Worker",
                                        std::format("Error processing notification: {}", e.what()));
@@ -533,30 +1236,278 @@ void mb::RtDbWorker::runPostgreSQL() {
                 PQfreemem(notify);
             }
 
-            // Check connection health
-            if (PQstatus(psql.get()) != CONNECTION_OK) {
-                logEntry::warn("[PSQl] RTDb Worker", "PostgreSQL Notify Worker",
-                               "Connection lost, reconnecting...");
-                PQfinish(psql.get());
-                psql.reset();
-
-                // Try to reconnect
-                if (!isDbRunning()) {
-                    logEntry::critical("[PSQl] RTDb Worker", "PostgreSQL Notify Worker",
-                                       "Reconnection failed, waiting before retry");
-                    std::this_thread::sleep_for(std::chrono::seconds(5));
-                }
+            if (!batch.empty()) {
+                hydratePSQL(batch);
+                emit(batch);
             }
         } catch (std::exception &e) {
             logEntry::critical("[PSQl] RTDb Worker", "Realtime Db Worker Error", e.what());
         }
     }
 }
+
+void mb::RtDbWorker::hydratePSQL(json &batch) {
+    std::string ids;
+    for (const auto &event: batch) {
+        if (!event.value("truncated", false)) continue;
+        if (!ids.empty()) ids += ',';
+        ids += std::to_string(event["id"].get<int>());
+    }
+    if (ids.empty()) return;
+
+    // One round trip for every oversized payload in the batch
+    const auto array = "{" + ids + "}";
+    const char *params[] = {array.c_str()};
+    PGresult *res = PQexecParams(psql.get(),
+                                 "SELECT id, old_data, new_data FROM mb_change_log WHERE id = ANY($1::integer[])",
+                                 1, nullptr, params, nullptr, nullptr, 0);
+
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        logEntry::warn("[PSQl] RTDb Worker", "Could not fetch oversized change payloads", PQerrorMessage(psql.get()));
+        PQclear(res);
+        return;
+    }
+
+    std::unordered_map<int, std::pair<json, json>> rows;
+    for (int i = 0; i < PQntuples(res); ++i) {
+        const auto data = [res, i](const int col) -> json {
+            if (PQgetisnull(res, i, col)) return nullptr;
+            auto parsed = tryParseJsonStr(PQgetvalue(res, i, col), json::object()).value();
+            return parsed.empty() ? json(nullptr) : parsed;
+        };
+        rows.emplace(std::stoi(PQgetvalue(res, i, 0)), std::make_pair(data(1), data(2)));
+    }
+    PQclear(res);
+
+    for (auto &event: batch) {
+        if (!event.value("truncated", false)) continue;
+        if (const auto it = rows.find(event["id"].get<int>()); it != rows.end()) {
+            event["old_data"] = std::move(it->second.first);
+            event["new_data"] = std::move(it->second.second);
+            event.erase("truncated");
+        }
+    }
+
+    // Rows pruned before we got to them stay references; drop them rather than send empty changes
+    std::erase_if(batch.get_ref<json::array_t &>(), [](const json &event) {
+        return event.value("truncated", false);
+    });
+}
+
+bool mb::RtDbWorker::applyListens() {
+    std::vector<std::pair<std::string, bool>> pending;
+    {
+        std::lock_guard lock(m_listenMutex);
+        pending.swap(m_pendingListens);
+    }
+
+    bool executed = false;
+    for (const auto &[entity, on]: pending) {
+        if (on ? !m_listening.insert(entity).second : m_listening.erase(entity) == 0) continue;
+        // While disconnected, initPSQL() issues them on reconnect
+        if (!isDbRunning()) continue;
+        execListen(entity, on);
+        executed = true;
+    }
+    return executed;
+}
+
+bool mb::RtDbWorker::execListen(const std::string &entity, const bool on) {
+    const auto command = std::format("{} {}", on ? "LISTEN" : "UNLISTEN", RealtimeDB::channelOf(entity));
+    PGresult *res = PQexec(psql.get(), command.c_str());
+    const bool ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+    if (!ok)
+        logEntry::warn("[PSQl] RTDb Worker", std::format("{} failed", command), PQerrorMessage(psql.get()));
+    PQclear(res);
+    return ok;
+}
+
+void mb::RtDbWorker::readSlotPSQL() {
+    const auto &options = LogicalCapture::Options::current();
+    const auto query = LogicalCapture::changesSql();
+    const auto limit = std::to_string(options.batch);
+    const char *params[] = {options.slot.c_str(), limit.c_str()};
+
+    // With per-entity channels only the entities listened to are delivered
+    const bool filtered = RealtimeDB::entityChannels();
+    std::unordered_set<std::string> listening;
+    for (auto entity: m_listening) {
+        toLowerCase(entity);
+        listening.insert(std::move(entity));
+    }
+
+    while (m_running.load() && isDbRunning()) {
+        // Taken off the slot by this query; a failed one leaves them there
+        PGresult *res = PQexecParams(psql.get(), query.c_str(), 2, nullptr, params, nullptr, nullptr, 0);
+        if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+            logEntry::warn("[PSQl] RTDb Worker", "Logical slot read failed", PQerrorMessage(psql.get()));
+            PQclear(res);
+            return;
+        }
+
+        const int rows = PQntuples(res);
+        std::vector<LogicalCapture::Change> changes;
+        changes.reserve(rows);
+        for (int i = 0; i < rows; ++i)
+            if (auto change = LogicalCapture::decode(PQgetvalue(res, i, 0))) changes.push_back(std::move(*change));
+        PQclear(res);
+
+        std::vector<std::string> unknown;
+        for (const auto &change: changes) {
+            if (change.kind != LogicalCapture::Change::Kind::Row) continue;
+            if (auto key = change.schema + '.' + change.table; !m_entityTables.contains(key))
+                unknown.push_back(std::move(key));
+        }
+        if (!unknown.empty()) resolveTablesPSQL(unknown);
+
+        json batch = json::array();
+        for (auto &change: changes) {
+            // A transaction's changes are contiguous, so mutes only last until the next one
+            if (change.xid != m_mutedXid) {
+                m_mutedXid = change.xid;
+                m_muted.clear();
+            }
+            if (change.kind == LogicalCapture::Change::Kind::Mute) {
+                m_muted.insert(change.table);
+                continue;
+            }
+            if (change.kind == LogicalCapture::Change::Kind::Unmute) {
+                m_muted.erase(change.table);
+                continue;
+            }
+            if (m_muted.contains(change.table) || (filtered && !listening.contains(change.table))) continue;
+            if (const auto it = m_entityTables.find(change.schema + '.' + change.table);
+                it != m_entityTables.end() && it->second)
+                batch.push_back(std::move(change.event));
+        }
+        if (!batch.empty()) emit(batch);
+
+        if (rows < options.batch) return;
+    }
+}
+
+void mb::RtDbWorker::resolveTablesPSQL(const std::vector<std::string> &tables) {
+    // As a text[] literal, each name quoted
+    std::string array = "{";
+    for (const auto &table: tables) {
+        if (array.size() > 1) array += ',';
+        array += '"';
+        for (const char c: table) {
+            if (c == '"' || c == '\\') array += '\\';
+            array += c;
+        }
+        array += '"';
+    }
+    array += '}';
+
+    const char *params[] = {array.c_str()};
+    PGresult *res = PQexecParams(psql.get(),
+                                 "SELECT n.nspname || '.' || c.relname FROM pg_class c "
+                                 "JOIN pg_namespace n ON n.oid = c.relnamespace "
+                                 "WHERE c.relreplident = 'f' AND n.nspname || '.' || c.relname = ANY($1::text[])",
+                                 1, nullptr, params, nullptr, nullptr, 0);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+        // Left unknown, so looked up again with the next batch
+        logEntry::warn("[PSQl] RTDb Worker", "Could not look up captured tables", PQerrorMessage(psql.get()));
+        PQclear(res);
+        return;
+    }
+
+    for (const auto &table: tables) m_entityTables[table] = false;
+    for (int i = 0; i < PQntuples(res); ++i) m_entityTables[PQgetvalue(res, i, 0)] = true;
+    PQclear(res);
+}
+
+bool mb::RtDbWorker::reconnectPSQL() {
+    psql.reset();
+    if (!initPSQL()) return false;
+
+    // LISTEN is active again; anything logged while we were away is replayed
+    // from mb_change_log before new notifications are read
+    recoverPSQL();
+    // Revocations sent while we were away are gone, so sessions are checked afresh
+    if (SharedState::enabled()) Auth::sessionCache().clear();
+    logEntry::info("[PSQl] RTDb Worker", "PostgreSQL Notify Worker", "Reconnected, LISTEN restored");
+    return true;
+}
+
+void mb::RtDbWorker::recoverPSQL() {
+    constexpr int kBatchSize = 500;
+
+    // With per-entity channels only the entities listened to are replayed;
+    // names are alphanumeric, so they go into the array literal as they are
+    const bool filtered = RealtimeDB::entityChannels();
+    std::string entities = "{";
+    for (const auto &entity: m_listening) {
+        if (entities.size() > 1) entities += ',';
+        auto name = entity;
+        toLowerCase(name);   // As TG_TABLE_NAME has it
+        entities += name;
+    }
+    entities += '}';
+    if (filtered && m_listening.empty()) return;
+
+    while (m_running.load() && isDbRunning()) {
+        const auto after = std::to_string(last_id);
+        const auto limit = std::to_string(kBatchSize);
+        const char *params[] = {after.c_str(), limit.c_str(), entities.c_str()};
+
+        PGresult *res = PQexecParams(psql.get(),
+                                     filtered
+                                         ? "SELECT id, EXTRACT(EPOCH FROM timestamp)::bigint, type, entity, row_id, "
+                                           "old_data, new_data FROM mb_change_log WHERE id > $1::integer "
+                                           "AND entity = ANY($3::text[]) ORDER BY id ASC LIMIT $2::integer"
+                                         : "SELECT id, EXTRACT(EPOCH FROM timestamp)::bigint, type, entity, row_id, "
+                                           "old_data, new_data FROM mb_change_log WHERE id > $1::integer "
+                                           "ORDER BY id ASC LIMIT $2::integer",
+                                     filtered ? 3 : 2, nullptr, params, nullptr, nullptr, 0);
+
+        if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+            logEntry::warn("[PSQl] RTDb Worker", "Change log recovery failed", PQerrorMessage(psql.get()));
+            PQclear(res);
+            return;
+        }
+
+        const auto text = [res](const int row, const int col) -> std::string {
+            return PQgetisnull(res, row, col) ? std::string{} : PQgetvalue(res, row, col);
+        };
+        const auto data = [&](const int row, const int col) -> json {
+            auto parsed = tryParseJsonStr(text(row, col), json::object()).value();
+            return parsed.empty() ? json(nullptr) : parsed;
+        };
+
+        const int rows = PQntuples(res);
+        json batch = json::array();
+        for (int i = 0; i < rows; ++i) {
+            const auto id = std::stoi(text(i, 0));
+            batch.push_back({
+                {"id", id},
+                {"timestamp", std::stoll(text(i, 1))},
+                {"type", text(i, 2)},
+                {"entity", text(i, 3)},
+                {"row_id", text(i, 4)},
+                {"old_data", data(i, 5)},
+                {"new_data", data(i, 6)}
+            });
+            last_id = std::max(last_id, id);
+        }
+        PQclear(res);
+
+        if (!batch.empty()) {
+            logEntry::info("[PSQl] RTDb Worker", "Recovered missed changes",
+                           std::format("{} rows up to id {}", batch.size(), last_id));
+            emit(batch);
+        }
+
+        if (rows < kBatchSize) return;
+    }
+}
 #endif
 
 bool mb::RtDbWorker::initSQLite() {
-    // Connect to main db
-    auto audit_db_path = joinPaths(mApp.dataDir(), "mantis.db").string();
+    // Connect to main db, or to the change log's own file
+    auto audit_db_path = joinPaths(mApp.dataDir(), RealtimeDB::attachedChangeLog() ? RealtimeDB::CHANGE_LOG_FILE
+                                                                                    : "mantis.db").string();
 
     try {
         // Read-only poller connection. Private cache + WAL lets it read the
@@ -596,19 +1547,48 @@ bool mb::RtDbWorker::initPSQL() {
         return false;
     }
 
-    // Subscribe to the notification channel
-    PGresult *res = PQexec(psql.get(), "LISTEN mb_db_changes");
+    // Subscribe to the notification channel, or to the channels of the entities watched
+    if (RealtimeDB::entityChannels()) {
+        for (const auto &entity: m_listening) {
+            if (execListen(entity, true)) continue;
+            psql.reset();
+            return false;
+        }
+    } else {
+        PGresult *res = PQexec(psql.get(), "LISTEN mb_db_changes");
+
+        if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+            logEntry::critical("PostgreSQL Notify Worker",
+                               std::format("LISTEN failed: {}", PQerrorMessage(psql.get())));
+            PQclear(res);
+            // PQfinish(m_pgConn);
+            psql.reset();
+            return false;
+        }
 
-    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-        logEntry::critical("PostgreSQL Notify Worker",
-                           std::format("LISTEN failed: {}", PQerrorMessage(psql.get())));
         PQclear(res);
-        // PQfinish(m_pgConn);
-        psql.reset();
-        return false;
     }
 
-    PQclear(res);
+    if (SharedState::enabled()) {
+        for (const auto channel: {SharedState::REVOCATION_CHANNEL, Channels::NOTIFY_CHANNEL}) {
+            PGresult *res = PQexec(psql.get(), std::format("LISTEN {}", channel).c_str());
+            if (PQresultStatus(res) != PGRES_COMMAND_OK)
+                logEntry::warn("PostgreSQL Notify Worker",
+                               std::format("LISTEN {} failed: {}", channel, PQerrorMessage(psql.get())));
+            PQclear(res);
+        }
+    }
+
+    // First connect: start at the head of the log, history isn't replayed
+    if (last_id < 0) {
+        PGresult *head = PQexec(psql.get(), "SELECT COALESCE(MAX(id), 0) FROM mb_change_log");
+        last_id = PQresultStatus(head) == PGRES_TUPLES_OK && PQntuples(head) == 1
+                      ? std::stoi(PQgetvalue(head, 0, 0))
+                      : 0;
+        m_lastPrunedId = 0;
+        PQclear(head);
+    }
+
     logEntry::info("PostgreSQL Notify Worker",
                    "Connected and listening on channel 'mb_db_changes'");
     return true;
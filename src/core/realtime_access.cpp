@@ -0,0 +1,145 @@
+#include "../../include/mantisbase/core/realtime_access.h"
+#include "../../include/mantisbase/core/models/access_rules.h"
+#include "../../include/mantisbase/core/models/entity_filter.h"
+#include "../../include/mantisbase/core/http.h"
+
+#include <algorithm>
+#include <cctype>
+
+namespace mb {
+    json RealtimeAuth::guestAuth() {
+        return {
+            {"type", "guest"},
+            {"token", nullptr},
+            {"id", nullptr},
+            {"entity", nullptr},
+            {"user", nullptr}
+        };
+    }
+
+    RealtimeAuth RealtimeAuth::fromRequest(MantisRequest &req) {
+        RealtimeAuth who;
+        who.auth = req.getOr<json>("auth", guestAuth());
+
+        const auto &verification = req.verification();
+        who.verified = verification.contains("verified")
+                       && verification["verified"].is_boolean()
+                       && verification["verified"].get<bool>()
+                       && who.auth.contains("user") && who.auth["user"].is_object();
+
+        if (who.verified && who.auth["entity"].is_string() && who.auth["id"].is_string())
+            who.principal = who.auth["entity"].get<std::string>() + ":" + who.auth["id"].get<std::string>();
+
+        who.req = {
+            {"remoteAddr", req.getRemoteAddr()},
+            {"remotePort", req.getRemotePort()},
+            {"localAddr", req.getLocalAddr()},
+            {"localPort", req.getLocalPort()},
+            {"body", json::object()}
+        };
+        return who;
+    }
+
+    RealtimeAccess::RealtimeAccess(const std::size_t capacity, const std::chrono::seconds ttl)
+        : m_capacity(std::max<std::size_t>(1, capacity)), m_ttl(ttl) {}
+
+    RealtimeAccess &RealtimeAccess::instance() {
+        static RealtimeAccess access;
+        return access;
+    }
+
+    bool RealtimeAccess::allows(const AccessRule &rule, const RealtimeAuth &who, const json &record,
+                                const CompiledFilter *row_filter) {
+        // Row-bound, so never memoized
+        if (row_filter && !filterMatches(*row_filter, who, record)) return false;
+
+        // Only custom expressions cost anything; row-bound ones can't be memoized
+        if (rule.mode() != "custom" || m_ttl.count() <= 0 || dependsOnRecord(rule))
+            return evaluate(rule, who, record);
+
+        const auto key = who.principal + '\x1f' + rule.expr();
+        const auto now = Clock::now();
+        {
+            std::lock_guard lock(m_mutex);
+            if (const auto it = m_memo.find(key); it != m_memo.end() && it->second.expiresAt > now)
+                return it->second.allowed;
+        }
+
+        const bool allowed = evaluate(rule, who, record);
+
+        std::lock_guard lock(m_mutex);
+        if (!m_memo.contains(key) && m_memo.size() >= m_capacity) {
+            std::erase_if(m_memo, [now](const auto &kv) { return kv.second.expiresAt <= now; });
+            if (m_memo.size() >= m_capacity)
+                m_memo.erase(m_memo.begin());
+        }
+        m_memo.insert_or_assign(key, Entry{allowed, now + m_ttl});
+        return allowed;
+    }
+
+    bool RealtimeAccess::dependsOnRecord(const AccessRule &rule) {
+        const auto expr = rule.expr();
+        const auto is_ident = [](const char c) {
+            return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+        };
+
+        for (auto pos = expr.find("record"); pos != std::string::npos; pos = expr.find("record", pos + 1)) {
+            const bool starts = pos == 0 || (!is_ident(expr[pos - 1]) && expr[pos - 1] != '.');
+            const bool ends = pos + 6 >= expr.size() || !is_ident(expr[pos + 6]);
+            if (starts && ends) return true;
+        }
+        return false;
+    }
+
+    void RealtimeAccess::clear() {
+        std::lock_guard lock(m_mutex);
+        m_memo.clear();
+    }
+
+    std::size_t RealtimeAccess::size() const {
+        std::lock_guard lock(m_mutex);
+        return m_memo.size();
+    }
+
+    bool RealtimeAccess::evaluate(const AccessRule &rule, const RealtimeAuth &who, const json &record) {
+        const auto mode = rule.mode();
+        if (mode == "public") return true;
+
+        const auto entity = who.auth.value("entity", json{});
+        const bool is_admin = who.verified && entity.is_string() && entity.get<std::string>() == "mb_admins";
+
+        // Same outcome as SSEMgr::validateHasAccess() for empty/auth modes and admins
+        if (mode.empty() || mode == "auth" || is_admin) return who.verified;
+
+        if (mode == "custom") {
+            try {
+                return rule.evaluate({
+                    {"auth", who.auth},
+                    {"req", who.req},
+                    {"record", record.is_object() ? record : json::object()}
+                });
+            } catch (...) {
+                return false;
+            }
+        }
+
+        return false;
+    }
+
+    bool RealtimeAccess::filterMatches(const CompiledFilter &filter, const RealtimeAuth &who, const json &record) {
+        const auto entity = who.auth.value("entity", json{});
+        if (who.verified && entity.is_string() && entity.get<std::string>() == "mb_admins") return true;
+
+        // Bound as setRuleAuth() binds a request's: ids and user fields, or nothing for guests
+        const auto auth = who.verified
+                              ? json{{"id", who.auth.value("id", json{})}, {"entity", entity},
+                                     {"user", who.auth.value("user", json{})}}
+                              : json{{"id", nullptr}, {"entity", nullptr}, {"user", nullptr}};
+        try {
+            return EntityFilter::matches(EntityFilter::bindVariables(filter, {{"auth", auth}}),
+                                         record.is_object() ? record : json::object());
+        } catch (...) {
+            return false;
+        }
+    }
+}
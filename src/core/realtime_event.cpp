@@ -0,0 +1,210 @@
+#include "../../include/mantisbase/core/realtime_event.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+
+namespace mb {
+    namespace {
+        std::string sseFrame(const std::string &event, const std::string &data, const std::uint64_t id) {
+            // `id:` lets EventSource send it back as Last-Event-ID on reconnect
+            std::string frame = id ? "id: " + std::to_string(id) + "\n" : std::string{};
+            frame += "event: ";
+            frame += event;
+            frame += "\ndata: ";
+            frame += data;
+            frame += "\n\n";
+            return frame;
+        }
+    }
+
+    std::shared_ptr<const EncodedEvent> EncodedEvent::encode(const json &change_event, const std::uint64_t id) {
+        return std::make_shared<const EncodedEvent>(change_event, id);
+    }
+
+    EncodedEvent::EncodedEvent(const json &change_event, const std::uint64_t id)
+        : m_id(id),
+          m_entity(change_event["entity"].get<std::string>()),
+          m_rowId(change_event["row_id"].get<std::string>()),
+          m_action(change_event["type"].get<std::string>()) {
+        m_rowTopic = m_entity + ":" + m_rowId;
+        toLowerCase(m_action);
+
+        m_record = json::object();
+        for (const auto *key: {"new_data", "old_data"}) {
+            if (const auto it = change_event.find(key); it != change_event.end() && it->is_object()) {
+                m_record = *it;
+                break;
+            }
+        }
+
+        if (m_action == "update") {
+            if (const auto it = change_event.find("old_data"); it != change_event.end() && it->is_object())
+                m_previous = *it;
+        }
+
+        m_payload = {
+            {"topic", m_entity},
+            {"action", m_action},
+            {"timestamp", change_event["timestamp"]},
+            {"row_id", m_rowId},
+            {"entity", m_entity},
+            // An import summary carries its counts
+            {"data", m_action == "delete" ? json(nullptr) : change_event.value("new_data", json(nullptr))}
+        };
+        if (m_id) m_payload["event_id"] = m_id;
+        if (const auto it = change_event.find("committed_at"); it != change_event.end())
+            m_payload["committed_at"] = *it;
+    }
+
+    std::shared_ptr<const EncodedEvent> EncodedEvent::ephemeral(json payload, std::string key) {
+        return std::shared_ptr<const EncodedEvent>(new EncodedEvent(std::move(payload), std::move(key), EphemeralTag{}));
+    }
+
+    EncodedEvent::EncodedEvent(json payload, std::string key, EphemeralTag)
+        : m_id(0),
+          m_event(payload.value("type", "message")),
+          m_ephemeral(true),
+          m_rowTopic(std::move(key)),
+          m_record(json::object()),
+          m_payload(std::move(payload)) {}
+
+    EncodedEvent::EncodedEvent(const EncodedEvent &base, const FieldSet &fields)
+        : m_id(base.m_id),
+          m_entity(base.m_entity),
+          m_rowId(base.m_rowId),
+          m_rowTopic(base.m_rowTopic),
+          m_action(base.m_action),
+          m_record(base.m_record),
+          m_payload(base.m_payload) {
+        auto &data = m_payload["data"];
+        if (!data.is_object()) return;
+
+        json projected = json::object();
+        for (const auto &[key, value]: data.items()) {
+            if (key == "id" || std::ranges::binary_search(fields, key))
+                projected[key] = value;
+        }
+        data = std::move(projected);
+    }
+
+    EncodedEvent::EncodedEvent(const EncodedEvent &base, DeltaTag)
+        : m_id(base.m_id),
+          m_entity(base.m_entity),
+          m_rowId(base.m_rowId),
+          m_rowTopic(base.m_rowTopic),
+          m_action(base.m_action),
+          m_record(base.m_record),
+          m_payload(base.m_payload) {
+        m_payload["delta"] = true;
+        auto &data = m_payload["data"];
+        if (!data.is_object()) return;
+
+        json changed = json::object();
+        for (const auto &[key, value]: data.items()) {
+            const auto before = base.m_previous.find(key);
+            if (key == "id" || before == base.m_previous.end() || *before != value)
+                changed[key] = value;
+        }
+        for (const auto &[key, value]: base.m_previous.items()) {
+            if (!data.contains(key)) changed[key] = nullptr;
+        }
+        data = std::move(changed);
+    }
+
+    EncodedEvent::FieldSet EncodedEvent::parseFields(const std::string &csv) {
+        FieldSet fields;
+        for (const auto &field: splitString(csv, ",")) {
+            if (auto name = trim(field); !name.empty())
+                fields.push_back(std::move(name));
+        }
+        std::ranges::sort(fields);
+        fields.erase(std::ranges::unique(fields).begin(), fields.end());
+        return fields;
+    }
+
+    std::shared_ptr<const EncodedEvent> EncodedEvent::project(const std::shared_ptr<const EncodedEvent> &event,
+                                                             const FieldSet &fields) {
+        // A channel message has no row to cut down
+        if (fields.empty() || event->m_ephemeral) return event;
+
+        std::string key;
+        for (const auto &field: fields) {
+            key += field;
+            key += ',';
+        }
+
+        std::lock_guard lock(event->m_projectionsMutex);
+        auto &projected = event->m_projections[key];
+        if (!projected)
+            projected = std::shared_ptr<const EncodedEvent>(new EncodedEvent(*event, fields));
+        return projected;
+    }
+
+    std::shared_ptr<const EncodedEvent> EncodedEvent::delta(const std::shared_ptr<const EncodedEvent> &event) {
+        if (!event->m_previous.is_object()) return event;
+
+        std::call_once(event->m_deltaOnce, [&event] {
+            event->m_delta = std::shared_ptr<const EncodedEvent>(new EncodedEvent(*event, DeltaTag{}));
+        });
+        return event->m_delta;
+    }
+
+    const std::string &EncodedEvent::data(const bool row_topic) const {
+        if (!row_topic) {
+            std::call_once(m_dataOnce, [this] { m_data = m_payload.dump(); });
+            return m_data;
+        }
+
+        std::call_once(m_dataRowOnce, [this] { m_dataRow = dataJson(true).dump(); });
+        return m_dataRow;
+    }
+
+    const std::string &EncodedEvent::sse(const bool row_topic) const {
+        if (!row_topic) {
+            std::call_once(m_sseOnce, [this] { m_sse = sseFrame(m_event, data(false), m_id); });
+            return m_sse;
+        }
+
+        std::call_once(m_sseRowOnce, [this] { m_sseRow = sseFrame(m_event, data(true), m_id); });
+        return m_sseRow;
+    }
+
+    const std::string &EncodedEvent::ws() const {
+        std::call_once(m_wsOnce, [this] { m_ws = wsJson().dump(); });
+        return m_ws;
+    }
+
+    json EncodedEvent::dataJson(const bool row_topic) const {
+        if (!row_topic || m_ephemeral) return m_payload;
+        auto payload = m_payload;
+        payload["topic"] = m_rowTopic;
+        return payload;
+    }
+
+    json EncodedEvent::wsJson() const {
+        auto payload = m_payload;
+        payload["type"] = m_event;
+        return payload;
+    }
+
+    const std::string &EncodedEvent::sse(const bool row_topic, const WireFormat::Format format) const {
+        if (format == WireFormat::Format::Json) return sse(row_topic);
+        return binary(row_topic ? Variant::SseRow : Variant::Sse, format);
+    }
+
+    const std::string &EncodedEvent::ws(const WireFormat::Format format) const {
+        if (format == WireFormat::Format::Json) return ws();
+        return binary(Variant::Ws, format);
+    }
+
+    const std::string &EncodedEvent::binary(const Variant variant, const WireFormat::Format format) const {
+        std::lock_guard lock(m_binaryMutex);
+        auto &encoded = m_binary[{variant, format}];
+        if (encoded.empty()) {
+            encoded = variant == Variant::Ws
+                          ? WireFormat::encode(format, wsJson())
+                          : sseFrame(m_event, WireFormat::encodeText(format, dataJson(variant == Variant::SseRow)), m_id);
+        }
+        return encoded;
+    }
+}
@@ -0,0 +1,234 @@
+/**
+ * @file realtime_probe.cpp
+ * @brief Implementation for @see realtime_probe.h
+ */
+
+#include "../../include/mantisbase/core/realtime_probe.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/core/models/entity.h"
+#include "../../include/mantisbase/core/models/entity_schema.h"
+#include "../../include/mantisbase/core/realtime_access.h"
+#include "../../include/mantisbase/core/router.h"
+#include "../../include/mantisbase/core/sse.h"
+#include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <drogon/HttpAppFramework.h>
+#include <drogon/HttpResponse.h>
+#include <trantor/net/AsyncStream.h>
+#include <trantor/net/EventLoop.h>
+#include <algorithm>
+#include <future>
+#include <memory>
+
+namespace mb {
+    namespace {
+        /// The probe session's socket: hands every chunk to the probe instead of a client
+        class ProbeStream final : public trantor::AsyncStream {
+        public:
+            explicit ProbeStream(RealtimeProbe &probe) : m_probe(probe) {}
+
+            bool send(const char *data, const size_t len) override {
+                m_probe.onFrames({data, len});
+                return true;
+            }
+
+            void close() override {}
+
+        private:
+            RealtimeProbe &m_probe;
+        };
+
+        /// Run `fn` on an IO loop once the server runs, so the session drains there like a client's
+        template<typename Fn>
+        auto onIoLoop(Fn fn) {
+            auto *loop = drogon::app().isRunning() ? drogon::app().getIOLoop(0) : nullptr;
+            if (!loop || loop->isInLoopThread()) return fn();
+
+            std::packaged_task<decltype(fn())()> task(std::move(fn));
+            auto result = task.get_future();
+            loop->runInLoop([&task] { task(); });
+            return result.get();
+        }
+    }
+
+    RealtimeProbe::Options RealtimeProbe::Options::fromEnv() {
+        Options options;
+        if (const auto ms = safe_stoi(getEnvOrDefault("MB_RT_PROBE_MS", ""), -1); ms >= 0)
+            options.interval = std::chrono::milliseconds(ms);
+        if (const auto ms = safe_stoi(getEnvOrDefault("MB_RT_PROBE_TIMEOUT_MS", ""), -1); ms > 0)
+            options.timeout = std::chrono::milliseconds(ms);
+        return options;
+    }
+
+    RealtimeProbe::RealtimeProbe(const Options options) : m_options(options) {}
+
+    RealtimeProbe::~RealtimeProbe() {
+        stop();
+    }
+
+    std::int64_t RealtimeProbe::nowUs() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    void RealtimeProbe::start() {
+        if (!enabled()) return;
+        std::lock_guard lock(m_mutex);
+        if (m_thread.joinable()) return;
+
+        auto &app = MantisBase::instance();
+        if (!EntitySchema::tableExists(app, ENTITY)) {
+            EntitySchema schema{app, ENTITY, "base"};
+            schema.setSystem(true);
+            schema.setHasApi(false);
+            schema.addField(EntitySchemaField("seq", "int"));
+            // Admins pass any rule; everyone else is kept out of the probe's changes
+            const AccessRule admins_only{"custom", "@auth.entity == 'mb_admins'"};
+            schema.setListRule(admins_only);
+            schema.setGetRule(admins_only);
+            EntitySchema::createTable(schema);
+        }
+
+        m_stopping = false;
+        m_thread = std::thread(&RealtimeProbe::loop, this);
+    }
+
+    void RealtimeProbe::stop() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable()) m_thread.join();
+
+        if (!m_sessionId.empty()) {
+            MantisBase::instance().router().sseMgr().removeSession(m_sessionId);
+            m_sessionId.clear();
+        }
+    }
+
+    std::size_t RealtimeProbe::onFrames(const std::string_view chunk, const std::int64_t now_us) {
+        std::size_t delivered = 0;
+        for (auto at = chunk.find("data: "); at != std::string_view::npos; at = chunk.find("data: ", at)) {
+            at += 6;
+            const auto end = chunk.find('\n', at);
+            const auto line = chunk.substr(at, end == std::string_view::npos ? std::string_view::npos : end - at);
+
+            const auto payload = json::parse(line, nullptr, false);
+            if (!payload.is_object() || payload.value("entity", "") != ENTITY) continue;
+            const auto data = payload.find("data");
+            if (data == payload.end() || !data->is_object() || !data->contains("seq")) continue;
+            const auto seq = data->value("seq", std::int64_t{0});
+
+            std::int64_t written_us;
+            {
+                std::lock_guard lock(m_pendingMutex);
+                const auto it = m_pending.find(seq);
+                // Already counted lost, or a change not written by this probe
+                if (it == m_pending.end()) continue;
+                written_us = it->second;
+                m_pending.erase(it);
+            }
+
+            // Changes read back from mb_change_log carry no stamp; time those from the write's start
+            const auto from = payload.value("committed_at", written_us);
+            m_latency.observe(std::chrono::microseconds(std::max<std::int64_t>(0, now_us - from)));
+            m_delivered.fetch_add(1);
+            ++delivered;
+        }
+        return delivered;
+    }
+
+    void RealtimeProbe::expect(const std::int64_t seq, const std::int64_t written_us) {
+        std::lock_guard lock(m_pendingMutex);
+        m_pending[seq] = written_us;
+    }
+
+    std::size_t RealtimeProbe::expire(const std::int64_t now_us) {
+        const auto timeout_us = std::chrono::duration_cast<std::chrono::microseconds>(m_options.timeout).count();
+        std::size_t lost = 0;
+        std::lock_guard lock(m_pendingMutex);
+        for (auto it = m_pending.begin(); it != m_pending.end();) {
+            if (now_us - it->second < timeout_us) {
+                ++it;
+                continue;
+            }
+            it = m_pending.erase(it);
+            ++lost;
+        }
+        m_lost.fetch_add(lost);
+        return lost;
+    }
+
+    void RealtimeProbe::writeMetrics(MetricsWriter &out) const {
+        const auto s = m_latency.snapshot();
+        out.family("mb_realtime_probe_latency_seconds", "Commit to SSE delivery time of the realtime probe's writes",
+                   "histogram");
+        out.histogram("mb_realtime_probe_latency_seconds", {}, LatencyHistogram::BUCKETS, s.counts, s.sum);
+
+        out.family("mb_realtime_probe_total", "Realtime probe writes by outcome", "counter");
+        out.sample("mb_realtime_probe_total", {{"result", "sent"}}, static_cast<double>(sent()));
+        out.sample("mb_realtime_probe_total", {{"result", "delivered"}}, static_cast<double>(delivered()));
+        out.sample("mb_realtime_probe_total", {{"result", "lost"}}, static_cast<double>(lost()));
+    }
+
+    void RealtimeProbe::subscribe() {
+        auto &sse = MantisBase::instance().router().sseMgr();
+        if (!m_sessionId.empty() && sse.getSession(m_sessionId)) return;
+
+        // Verified as an admin, so the probe passes the entity's rule like a dashboard would
+        auto who = std::make_shared<RealtimeAuth>();
+        who->auth = {{"id", "realtime-probe"}, {"entity", "mb_admins"}};
+        who->verified = true;
+        who->principal = "mb_admins:realtime-probe";
+
+        m_sessionId = onIoLoop([&] {
+            return sse.createSession({ENTITY},
+                                     std::make_unique<drogon::ResponseStream>(std::make_unique<ProbeStream>(*this)),
+                                     std::move(who));
+        });
+    }
+
+    void RealtimeProbe::write() {
+        const auto entity = MantisBase::instance().entity(ENTITY);
+        if (m_rowId.empty()) {
+            const auto rows = entity.list();
+            m_rowId = rows.empty()
+                          ? entity.create({{"seq", 0}}).at("id").get<std::string>()
+                          : rows.front().at("id").get<std::string>();
+        }
+
+        // Expected before the write, as its change may be delivered before update() returns
+        const auto seq = ++m_seq;
+        expect(seq);
+        try {
+            [[maybe_unused]] auto _ = entity.update(m_rowId, {{"seq", seq}});
+        } catch (...) {
+            std::lock_guard lock(m_pendingMutex);
+            m_pending.erase(seq);
+            throw;
+        }
+        m_sent.fetch_add(1);
+    }
+
+    void RealtimeProbe::loop() {
+        std::unique_lock lock(m_mutex);
+        while (!m_stopping) {
+            if (m_cv.wait_for(lock, m_options.interval, [this] { return m_stopping; })) break;
+            lock.unlock();
+
+            try {
+                subscribe();
+                expire();
+                write();
+            } catch (const std::exception &e) {
+                // The probe row may be gone; it is looked up again on the next write
+                m_rowId.clear();
+                LogOrigin::warn("Realtime Probe", fmt::format("Probe write failed: {}", e.what()));
+            }
+
+            lock.lock();
+        }
+    }
+}
@@ -0,0 +1,77 @@
+/**
+ * @file realtime_snapshot.cpp
+ * @brief Implementation for @see realtime_snapshot.h
+ */
+
+#include "../../include/mantisbase/core/realtime_snapshot.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+
+namespace mb {
+    RealtimeSnapshot::Options RealtimeSnapshot::Options::fromEnv() {
+        Options options;
+        if (const auto rows = safe_stoi(getEnvOrDefault("MB_REALTIME_SNAPSHOT_MAX", ""), 0); rows > 0)
+            options.maxRows = static_cast<std::size_t>(rows);
+        return options;
+    }
+
+    RealtimeSnapshot::RealtimeSnapshot(const std::uint64_t at) : m_at(at) {}
+
+    void RealtimeSnapshot::topic(const std::string &topic) {
+        if (std::ranges::find(m_topics, topic, &std::pair<std::string, json>::first) == m_topics.end())
+            m_topics.emplace_back(topic, json::array());
+    }
+
+    void RealtimeSnapshot::add(const std::string &topic, const std::string &entity, json row) {
+        this->topic(topic);
+        const auto &id = row.contains("id") ? row["id"] : json();
+        m_rows.insert_or_assign(keyOf(entity, id.is_string() ? id.get<std::string>() : id.dump()), row);
+        std::ranges::find(m_topics, topic, &std::pair<std::string, json>::first)->second.push_back(std::move(row));
+        ++m_size;
+    }
+
+    std::vector<bool> RealtimeSnapshot::covered(const std::vector<const EncodedEvent *> &events) const {
+        // Row -> index of its last change that leaves it as read
+        std::unordered_map<std::string, std::size_t> last;
+        for (std::size_t i = 0; i < events.size(); ++i) {
+            const auto &event = *events[i];
+            const auto key = keyOf(event.entity(), event.rowId());
+            const auto it = m_rows.find(key);
+            const bool shown = event.action() == "delete" ? it == m_rows.end()
+                                                          : it != m_rows.end() && it->second == event.record();
+            if (shown) last[key] = i;
+        }
+
+        std::vector<bool> covered(events.size(), false);
+        for (std::size_t i = 0; i < events.size(); ++i) {
+            const auto it = last.find(keyOf(events[i]->entity(), events[i]->rowId()));
+            covered[i] = it != last.end() && i <= it->second;
+        }
+        return covered;
+    }
+
+    std::vector<json> RealtimeSnapshot::frames(const EncodedEvent::FieldSet &fields) const {
+        std::vector<json> frames;
+        frames.reserve(m_topics.size());
+        for (const auto &[topic, rows]: m_topics) {
+            json records = json::array();
+            for (const auto &row: rows) {
+                if (fields.empty() || !row.is_object()) {
+                    records.push_back(row);
+                    continue;
+                }
+                json cut = json::object();
+                for (const auto &[key, value]: row.items())
+                    if (key == "id" || std::ranges::binary_search(fields, key)) cut[key] = value;
+                records.push_back(std::move(cut));
+            }
+            frames.push_back({{"topic", topic}, {"records", std::move(records)}, {"last_event_id", m_at}});
+        }
+        return frames;
+    }
+
+    std::string RealtimeSnapshot::keyOf(const std::string &entity, const std::string &row_id) {
+        return entity + ':' + row_id;
+    }
+}
@@ -1,105 +1,307 @@
 #include "../../include/mantisbase/core/ws.h"
 #include "../../include/mantisbase/mantisbase.h"
 #include "../../include/mantisbase/core/sse.h"
+#include "../../include/mantisbase/core/realtime.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <ranges>
 
 namespace mb {
 
     // --- WSMgr ---
-    WSMgr::WSMgr(const MantisBase& app) : m_app(app) {}
+    WSMgr::WSMgr(const MantisBase& app)
+        : m_queueOptions(SendQueue::Options::fromEnv()),
+          m_queueCounters(std::make_shared<SendQueue::Counters>()),
+          m_app(app) {}
+
+    void WSMgr::addConnection(const drogon::WebSocketConnectionPtr &conn,
+                              std::shared_ptr<const RealtimeAuth> auth,
+                              const bool batch,
+                              EncodedEvent::FieldSet fields,
+                              const WireFormat::Format format,
+                              const bool delta,
+                              std::unique_ptr<StreamLimits::Ticket> ticket) {
+        // Called on the connection's IO loop; its queue drains there too
+        std::weak_ptr<drogon::WebSocketConnection> weak = conn;
+        if (ticket) {
+            ticket->bind([weak] {
+                if (const auto c = weak.lock())
+                    c->shutdown(drogon::CloseCode::kViolation, "Replaced by a newer connection");
+            });
+        }
+        auto options = m_queueOptions;
+        options.batch = batch;
+        options.format = format;
+        const auto type = format == WireFormat::Format::Json ? drogon::WebSocketMessageType::Text
+                                                             : drogon::WebSocketMessageType::Binary;
+        auto queue = std::make_shared<SendQueue>(
+            options,
+            SendQueue::onLoop(trantor::EventLoop::getEventLoopOfCurrentThread()),
+            [weak, type](const std::string &frame) {
+                const auto c = weak.lock();
+                if (!c || !c->connected()) return false;
+                c->send(frame, type);
+                return true;
+            },
+            [weak] {
+                if (const auto c = weak.lock())
+                    c->shutdown(drogon::CloseCode::kViolation, "Slow consumer");
+            },
+            m_queueCounters);
 
-    void WSMgr::addConnection(const drogon::WebSocketConnectionPtr &conn) {
         std::lock_guard lock(m_mutex);
-        m_connTopics[conn] = {};
+        auto &state = m_conns[conn];
+        state.id = "ws_" + generateShortId();
+        state.queue = std::move(queue);
+        state.auth = auth ? std::move(auth) : std::make_shared<const RealtimeAuth>();
+        state.fields = std::make_shared<const EncodedEvent::FieldSet>(std::move(fields));
+        state.delta = delta;
+        state.ticket = std::move(ticket);
     }
 
     void WSMgr::removeConnection(const drogon::WebSocketConnectionPtr &conn) {
-        std::lock_guard lock(m_mutex);
-        if (auto it = m_connTopics.find(conn); it != m_connTopics.end()) {
-            for (const auto &topic : it->second) {
-                if (auto tit = m_topicConns.find(topic); tit != m_topicConns.end()) {
-                    tit->second.erase(conn);
-                    if (tit->second.empty())
-                        m_topicConns.erase(tit);
-                }
-            }
-            m_connTopics.erase(it);
+        std::vector<std::string> left;
+        std::shared_ptr<const RealtimeAuth> auth;
+        std::string conn_id;
+        {
+            std::lock_guard lock(m_mutex);
+            const auto it = m_conns.find(conn);
+            if (it == m_conns.end()) return;
+            for (const auto id : it->second.topics) unindex(it->second, id, left);
+            if (it->second.queue) it->second.queue->close();
+            auth = it->second.auth ? it->second.auth : std::make_shared<const RealtimeAuth>();
+            conn_id = it->second.id;
+            m_conns.erase(it);
         }
+        // Presence frames are delivered under m_mutex again
+        for (const auto &name : left) Channels::instance().left(name, *auth, conn_id);
     }
 
-    void WSMgr::subscribe(const drogon::WebSocketConnectionPtr &conn,
-                           const std::vector<std::string> &topics) {
-        std::lock_guard lock(m_mutex);
-        auto &connTopics = m_connTopics[conn];
+    std::optional<std::uint64_t> WSMgr::subscribe(const drogon::WebSocketConnectionPtr &conn,
+                                                  const std::vector<std::string> &topics,
+                                                  const std::optional<std::uint64_t> resume_from,
+                                                  const RealtimeSnapshot *snapshot) {
+        const auto &sse = m_app.router().sseMgr();
+
+        // Compiled and checked up front, so a bad filter or channel subscribes nothing
+        const auto who = authOf(conn);
+        std::unordered_map<std::string, std::shared_ptr<const CompiledFilter>> filters;
         for (const auto &topic : topics) {
-            connTopics.insert(topic);
-            m_topicConns[topic].insert(conn);
+            if (Channels::isChannel(topic)) {
+                const auto name = Channels::nameOf(topic);
+                if (!name || !Channels::instance().rules(*name))
+                    throw MantisException(400, std::format("Invalid topic `{}`, expected a declared channel.", topic));
+                if (!Channels::instance().canSubscribe(*name, *who))
+                    throw MantisException(403, std::format("Not allowed to subscribe to channel `{}`.", *name));
+                continue;
+            }
+            const auto parsed = TopicFilters::parse(topic);
+            if (!parsed) continue;
+            if (!m_app.hasEntity(parsed->entity))
+                throw MantisException(400, std::format("Invalid topic `{}`, expected valid entity name.", topic));
+            filters[topic] = m_app.entity(parsed->entity).compileFilter(parsed->filter);
         }
+
+        std::vector<std::string> joined;
+        std::string conn_id;
+        std::optional<std::uint64_t> upto;
+        {
+            std::lock_guard lock(m_mutex);
+            auto &state = m_conns[conn];
+            conn_id = state.id;
+            for (const auto &topic : topics) {
+                if (const auto id = m_topics.find(topic);
+                    id && std::ranges::find(state.topics, *id) != state.topics.end()) continue;
+                const auto [id, first] = m_topics.add(topic, &state);
+                state.topics.push_back(id);
+                if (first && !Channels::isChannel(topic)) m_app.rt().watch(std::string(RealtimeDB::topicEntity(topic)));
+                if (filters.contains(topic)) m_filters.add(topic, filters[topic]);
+                if (auto name = Channels::nameOf(topic)) joined.push_back(std::move(*name));
+            }
+
+            upto = [&]() -> std::optional<std::uint64_t> {
+                if (!resume_from && !snapshot) return sse.replay().lastId();
+
+                // Replayed under m_mutex so broadcastChange() can't interleave; anything it
+                // collects afterwards with an id already replayed is skipped via replayedUpTo
+                // Only what fits in the queue as it stands; an overflow here could close the
+                // connection while m_mutex is held
+                const auto depth = state.queue ? state.queue->depth() : 0;
+                const auto room = m_queueOptions.capacity - std::min(depth, m_queueOptions.capacity);
+                const auto auth = state.auth ? state.auth : std::make_shared<const RealtimeAuth>();
+                const std::set<std::string> subscribed(topics.begin(), topics.end());
+                const auto replay = snapshot ? sse.collectAfterSnapshot(*snapshot, subscribed, *auth, room)
+                                             : sse.collectReplay(*resume_from, subscribed, *auth, room);
+                if (!replay) return std::nullopt;
+
+                if (state.queue) {
+                    for (const auto &item: replay->items)
+                        state.queue->push(EncodedEvent::project(state.delta ? EncodedEvent::delta(item.event) : item.event,
+                                                                *state.fields),
+                                          SendQueue::Frame::Ws);
+                }
+                state.replayedUpTo = std::max(state.replayedUpTo, replay->upto);
+                return replay->upto;
+            }();
+        }
+
+        for (const auto &name : joined) Channels::instance().joined(name, *who, conn_id);
+        return upto;
     }
 
     void WSMgr::unsubscribe(const drogon::WebSocketConnectionPtr &conn,
                              const std::vector<std::string> &topics) {
-        std::lock_guard lock(m_mutex);
-        if (auto it = m_connTopics.find(conn); it != m_connTopics.end()) {
+        std::vector<std::string> left;
+        std::shared_ptr<const RealtimeAuth> auth;
+        std::string conn_id;
+        {
+            std::lock_guard lock(m_mutex);
+            const auto it = m_conns.find(conn);
+            if (it == m_conns.end()) return;
+            auto &ids = it->second.topics;
             for (const auto &topic : topics) {
-                it->second.erase(topic);
-                if (auto tit = m_topicConns.find(topic); tit != m_topicConns.end()) {
-                    tit->second.erase(conn);
-                    if (tit->second.empty())
-                        m_topicConns.erase(tit);
-                }
+                const auto id = m_topics.find(topic);
+                if (!id) continue;
+                const auto tit = std::ranges::find(ids, *id);
+                if (tit == ids.end()) continue;
+                *tit = ids.back();
+                ids.pop_back();
+                unindex(it->second, *id, left);
             }
+            auth = it->second.auth ? it->second.auth : std::make_shared<const RealtimeAuth>();
+            conn_id = it->second.id;
         }
+        for (const auto &name : left) Channels::instance().left(name, *auth, conn_id);
     }
 
-    void WSMgr::broadcastChange(const json &change_event) {
+    void WSMgr::unindex(ConnState &state, const TopicId id, std::vector<std::string> &left) {
+        const auto &topic = m_topics.name(id);
+        if (TopicFilters::parse(topic)) m_filters.remove(topic);
+        if (auto name = Channels::nameOf(topic)) left.push_back(std::move(*name));
+        if (const auto last = m_topics.remove(id, &state); last && !Channels::isChannel(*last))
+            m_app.rt().unwatch(std::string(RealtimeDB::topicEntity(*last)));
+    }
+
+    EncodedEvent::FieldSet WSMgr::fieldsOf(const drogon::WebSocketConnectionPtr &conn) {
         std::lock_guard lock(m_mutex);
-        auto formatted = formatEvent(change_event);
-        auto msg = formatted.dump();
+        if (const auto it = m_conns.find(conn); it != m_conns.end()) return *it->second.fields;
+        return {};
+    }
 
-        for (const auto &[conn, topics] : m_connTopics) {
-            if (isInterestedIn(topics, change_event)) {
-                conn->send(msg);
+    std::shared_ptr<const RealtimeAuth> WSMgr::authOf(const drogon::WebSocketConnectionPtr &conn) {
+        std::lock_guard lock(m_mutex);
+        if (const auto it = m_conns.find(conn); it != m_conns.end() && it->second.auth) return it->second.auth;
+        return std::make_shared<const RealtimeAuth>();
+    }
+
+    void WSMgr::broadcastChange(const json &change_event) {
+        broadcastChange(EncodedEvent::encode(change_event));
+    }
+
+    void WSMgr::broadcastChange(const std::shared_ptr<const EncodedEvent> &event) {
+        struct Recipient {
+            std::shared_ptr<SendQueue> queue;
+            std::shared_ptr<const RealtimeAuth> auth;
+            std::shared_ptr<const EncodedEvent::FieldSet> fields;
+            bool delta;
+            bool rowTopic;
+        };
+
+        const auto &entity = event->entity();
+
+        // Only the matching topic buckets are visited; a connection
+        // subscribed to several of them receives the event once, checked
+        // against the `get` rule if it follows the row itself.
+        std::vector<Recipient> recipients;
+        {
+            std::lock_guard lock(m_mutex);
+            const auto route = m_topics.route(entity, event->rowId());
+            std::vector<const std::vector<ConnState *> *> lists{route.row, route.entity, route.wildcard};
+            // Each filter is evaluated once for all of its subscribers
+            for (const auto &topic: m_filters.matching(*event))
+                if (const auto id = m_topics.find(topic)) lists.push_back(&m_topics.subscribers(*id));
+
+            std::unordered_set<const ConnState *> seen;
+            const bool dedup = std::ranges::count_if(lists, [](const auto *list) { return list != nullptr; }) > 1;
+            for (std::size_t i = 0; i < lists.size(); ++i) {
+                if (!lists[i]) continue;
+                for (const auto *state: *lists[i]) {
+                    if (!state->queue) continue;
+                    if (event->id() && event->id() <= state->replayedUpTo) continue;
+                    if (!dedup || seen.insert(state).second)
+                        recipients.push_back({state->queue, state->auth, state->fields, state->delta, i == 0});
+                }
             }
         }
+
+        if (recipients.empty()) return;
+
+        const auto schema = m_app.entity(entity);
+        auto &access = RealtimeAccess::instance();
+        for (const auto &r: recipients) {
+            const auto &rule = r.rowTopic ? schema.getRule() : schema.listRule();
+            const auto *filter = r.rowTopic ? schema.getFilter() : schema.listFilter();
+            if (access.allows(rule, *r.auth, event->record(), filter))
+                r.queue->push(EncodedEvent::project(r.delta ? EncodedEvent::delta(event) : event, *r.fields),
+                              SendQueue::Frame::Ws);
+        }
+    }
+
+    void WSMgr::deliverEphemeral(const std::string &topic, const std::shared_ptr<const EncodedEvent> &event) {
+        std::vector<std::shared_ptr<SendQueue>> queues;
+        {
+            std::lock_guard lock(m_mutex);
+            if (const auto id = m_topics.find(topic)) {
+                for (const auto *state: m_topics.subscribers(*id))
+                    if (state->queue) queues.push_back(state->queue);
+            }
+        }
+        for (const auto &queue: queues) queue->push(event, SendQueue::Frame::Ws);
     }
 
     size_t WSMgr::connectionCount() {
         std::lock_guard lock(m_mutex);
-        return m_connTopics.size();
+        return m_conns.size();
     }
 
-    bool WSMgr::isInterestedIn(const std::set<std::string> &topics,
-                                const json &change_event) const {
-        const auto entity = change_event["entity"].get<std::string>();
-        const auto row_id = change_event["row_id"].get<std::string>();
+    std::size_t WSMgr::sendReconnect(const std::function<std::chrono::milliseconds()> &delay,
+                                     const std::uint64_t last_id) {
+        std::vector<drogon::WebSocketConnectionPtr> conns;
+        {
+            std::lock_guard lock(m_mutex);
+            conns.reserve(m_conns.size());
+            for (const auto &[conn, _]: m_conns) conns.push_back(conn);
+        }
 
-        if (topics.contains(entity))
-            return true;
-        if (topics.contains(entity + ":" + row_id))
-            return true;
-        if (topics.contains(entity + ":*"))
-            return true;
-        return false;
+        for (const auto &conn: conns) {
+            json reconnect = {{"type", "reconnect"}, {"retry_ms", delay().count()}, {"last_event_id", last_id}};
+            conn->send(reconnect.dump());
+            conn->shutdown(drogon::CloseCode::kEndpointGone, "Server restarting");
+        }
+        return conns.size();
     }
 
-    json WSMgr::formatEvent(const json &change_event) const {
-        auto entity = change_event["entity"].get<std::string>();
-        auto row_id = change_event["row_id"].get<std::string>();
-        auto operation = change_event["type"].get<std::string>();
-        toLowerCase(operation);
-
-        json data = (operation == "insert" || operation == "update")
-                        ? change_event["new_data"]
-                        : nullptr;
+    json WSMgr::queueStats() {
+        std::size_t queued = 0, max_depth = 0, subscribers = 0;
+        {
+            std::lock_guard lock(m_mutex);
+            subscribers = m_conns.size();
+            for (const auto &state: m_conns | std::views::values) {
+                const auto depth = state.queue ? state.queue->depth() : 0;
+                queued += depth;
+                max_depth = std::max(max_depth, depth);
+            }
+        }
 
         return {
-            {"type", "change"},
-            {"topic", entity},
-            {"action", operation},
-            {"timestamp", change_event["timestamp"]},
-            {"row_id", row_id},
-            {"entity", entity},
-            {"data", data}
+            {"subscribers", subscribers},
+            {"queued", queued},
+            {"max_depth", max_depth},
+            {"dropped", m_queueCounters->dropped.load()},
+            {"coalesced", m_queueCounters->coalesced.load()},
+            {"evicted", m_queueCounters->evicted.load()}
         };
     }
 
@@ -118,8 +320,34 @@ namespace mb {
         logEntry::info("WebSocket", std::format("New WS connection from {}",
                        conn->peerAddr().toIpPort()));
 
-        auto &wsMgr = m_app.router().sseMgr().wsMgr();
-        wsMgr.addConnection(conn);
+        // Resolve the caller's auth context once; events are filtered against it
+        MantisRequest ma_req{m_app, req};
+        MantisResponse ma_res{};
+        try {
+            for (const auto &mw: m_app.router().preRoutingMiddlewares())
+                mw(ma_req, ma_res);
+            // Resolved here rather than on first read, so a failure leaves a guest connection
+            ma_req.auth();
+        } catch (const std::exception &e) {
+            logEntry::warn("WebSocket", "Could not resolve auth context, continuing as guest", e.what());
+        }
+
+        auto auth = std::make_shared<const RealtimeAuth>(RealtimeAuth::fromRequest(ma_req));
+
+        // Counted with the address's and user's SSE sessions
+        auto &sse = m_app.router().sseMgr();
+        auto ticket = sse.limits().acquire(ma_req.getRemoteAddr(), auth->principal);
+        if (!ticket) {
+            conn->shutdown(drogon::CloseCode::kViolation, "Too many realtime connections");
+            return;
+        }
+
+        sse.wsMgr().addConnection(conn, std::move(auth),
+                            strToBool(req->getParameter("batch")),
+                            EncodedEvent::parseFields(req->getParameter("fields")),
+                            WireFormat::fromName(req->getParameter("format")).value_or(WireFormat::Format::Json),
+                            strToBool(req->getParameter("delta")),
+                            std::move(ticket));
 
         json welcome = {{"type", "connected"}, {"message", "WebSocket connected"}};
         conn->send(welcome.dump());
@@ -140,11 +368,36 @@ namespace mb {
             if (msgType == "subscribe") {
                 auto topics = msg.value("topics", std::vector<std::string>{});
                 if (!topics.empty()) {
-                    auto &wsMgr = m_app.router().sseMgr().wsMgr();
-                    wsMgr.subscribe(conn, topics);
+                    std::optional<std::uint64_t> resumeFrom;
+                    if (const auto it = msg.find("resume_from"); it != msg.end() && it->is_number_unsigned())
+                        resumeFrom = it->get<std::uint64_t>();
+
+                    auto &sse = m_app.router().sseMgr();
+                    auto &wsMgr = sse.wsMgr();
 
-                    json ack = {{"type", "subscribed"}, {"topics", topics}};
+                    // The rows are read before subscribing; a reconnect that can still resume needs none
+                    std::optional<RealtimeSnapshot> snapshot;
+                    if (msg.value("snapshot", false) && !(resumeFrom && sse.replay().retains(*resumeFrom)))
+                        snapshot = sse.takeSnapshot({topics.begin(), topics.end()}, *wsMgr.authOf(conn));
+                    const auto upto = wsMgr.subscribe(conn, topics, snapshot ? std::nullopt : resumeFrom,
+                                                      snapshot ? &*snapshot : nullptr);
+
+                    // Sent inline, so it reaches the client before the queued replay
+                    const auto lastId = upto ? *upto : sse.replay().lastId();
+                    json ack = {{"type", "subscribed"}, {"topics", topics}, {"last_event_id", lastId}};
                     conn->send(ack.dump());
+
+                    if (snapshot && upto) {
+                        for (auto &frame: snapshot->frames(wsMgr.fieldsOf(conn))) {
+                            frame["type"] = "snapshot";
+                            conn->send(frame.dump());
+                        }
+                    } else if (!upto) {
+                        json reset = {{"type", "reset"},
+                                      {"reason", snapshot ? "snapshot_unavailable" : "resume_unavailable"},
+                                      {"last_event_id", lastId}};
+                        conn->send(reset.dump());
+                    }
                 }
             } else if (msgType == "unsubscribe") {
                 auto topics = msg.value("topics", std::vector<std::string>{});
@@ -155,10 +408,32 @@ namespace mb {
                     json ack = {{"type", "unsubscribed"}, {"topics", topics}};
                     conn->send(ack.dump());
                 }
+            } else if (msgType == "publish") {
+                // A message for an ephemeral channel's subscribers; errors answer with `error`
+                const auto topic = msg.value("topic", "");
+                const auto name = Channels::nameOf(topic);
+                if (!name) throw MantisException(400, std::format("Invalid topic `{}`, expected `@<channel>`.", topic));
+                auto &wsMgr = m_app.router().sseMgr().wsMgr();
+                Channels::instance().publish(*name, msg.value("data", json(nullptr)), *wsMgr.authOf(conn));
+            } else if (msgType == "presence") {
+                const auto topic = msg.value("topic", "");
+                const auto name = Channels::nameOf(topic);
+                auto &channels = Channels::instance();
+                const auto rules = name ? channels.rules(*name) : nullptr;
+                if (!rules || !rules->presence)
+                    throw MantisException(404, std::format("No presence channel `{}`.", topic));
+                if (!channels.canSubscribe(*name, *m_app.router().sseMgr().wsMgr().authOf(conn)))
+                    throw MantisException(403, std::format("Not allowed to subscribe to channel `{}`.", *name));
+                json state = {{"type", "presence_state"}, {"topic", topic}, {"members", channels.members(*name)}};
+                conn->send(state.dump());
             } else if (msgType == "ping") {
                 json pong = {{"type", "pong"}};
                 conn->send(pong.dump());
             }
+        } catch (const MantisException &e) {
+            // e.g. a topic filter that doesn't compile
+            json err = {{"type", "error"}, {"message", e.what()}};
+            conn->send(err.dump());
         } catch (const std::exception &e) {
             json err = {{"type", "error"}, {"message", "Invalid message format"}};
             conn->send(err.dump());
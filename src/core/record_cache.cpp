@@ -0,0 +1,200 @@
+/**
+ * @file record_cache.cpp
+ * @brief Implementation for @see record_cache.h
+ */
+
+#include "../../include/mantisbase/core/record_cache.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+namespace mb {
+    RecordCache::Options RecordCache::Options::fromEnv() {
+        Options options;
+        for (const auto &part: splitString(getEnvOrDefault("MB_RECORD_CACHE", ""), ",")) {
+            const auto entity = trim(part);
+            if (entity == "*") options.all = true;
+            else if (!entity.empty()) options.entities.insert(entity);
+        }
+        if (const auto mb = safe_stoi(getEnvOrDefault("MB_RECORD_CACHE_MAX_MB", ""), -1); mb >= 0)
+            options.maxBytes = static_cast<std::size_t>(mb) * 1024 * 1024;
+        options.budget = CacheBudget::fromEnv();
+        return options;
+    }
+
+    RecordCache::RecordCache(Options options) : m_options(std::move(options)) {
+        if (m_options.budget && enabled())
+            m_account = m_options.budget->join("records", [this](const std::size_t bytes) { return shed(bytes); });
+    }
+
+    RecordCache::~RecordCache() {
+        if (m_account) m_options.budget->leave(m_account);
+    }
+
+    bool RecordCache::enabledFor(const std::string &entity) const {
+        return m_options.maxBytes > 0 && (m_options.all || m_options.entities.contains(entity));
+    }
+
+    bool RecordCache::enabled() const {
+        return m_options.maxBytes > 0 && (m_options.all || !m_options.entities.empty());
+    }
+
+    std::optional<nlohmann::json> RecordCache::get(const std::string &entity, const std::string &id) {
+        std::lock_guard lock(m_mutex);
+        const auto state = m_entities.find(entity);
+        if (state == m_entities.end()) {
+            ++m_misses;
+            return std::nullopt;
+        }
+        const auto it = state->second.rows.find(id);
+        if (it == state->second.rows.end()) {
+            ++m_misses;
+            return std::nullopt;
+        }
+
+        state->second.lru.splice(state->second.lru.begin(), state->second.lru, it->second);
+        ++m_hits;
+        return it->second->record;
+    }
+
+    std::uint64_t RecordCache::generation(const std::string &entity) const {
+        std::lock_guard lock(m_mutex);
+        const auto it = m_entities.find(entity);
+        return it == m_entities.end() ? 0 : it->second.generation;
+    }
+
+    void RecordCache::put(const std::string &entity, const std::string &id, const std::uint64_t generation,
+                          const nlohmann::json &record) {
+        if (!enabledFor(entity)) return;
+        const auto bytes = approxBytes(record) + id.size();
+        if (bytes > m_options.maxEntryBytes) return;
+
+        {
+            std::lock_guard lock(m_mutex);
+            auto &state = m_entities[entity];
+            // Read while a change was on its way: what it holds may already be stale
+            if (state.generation != generation) return;
+
+            if (const auto it = state.rows.find(id); it != state.rows.end()) eraseLocked(state, it->second);
+
+            state.bytes += bytes;
+            if (m_account) m_account->charge(bytes);
+            state.lru.push_front({id, record, bytes});
+            state.rows.emplace(id, state.lru.begin());
+
+            while (state.bytes > m_options.maxBytes && !state.lru.empty())
+                eraseLocked(state, std::prev(state.lru.end()));
+        }
+        // Outside the lock: the budget may ask this very cache to shed
+        if (m_account) m_options.budget->enforce();
+    }
+
+    void RecordCache::forget(const std::string &entity, const std::string &id) {
+        if (!enabledFor(entity)) return;
+        std::lock_guard lock(m_mutex);
+        changedLocked(entity, id);
+    }
+
+    void RecordCache::invalidateEntity(const std::string &entity) {
+        if (!enabledFor(entity)) return;
+        std::lock_guard lock(m_mutex);
+        changedLocked(entity, "");
+    }
+
+    void RecordCache::onChanges(const nlohmann::json &events) {
+        if (!enabled() || !events.is_array()) return;
+
+        std::lock_guard lock(m_mutex);
+        for (const auto &event: events) {
+            if (!event.is_object()) continue;
+
+            const auto &entity = event.value("entity", nlohmann::json{});
+            if (!entity.is_string() || !enabledFor(entity.get_ref<const std::string &>())) continue;
+            const auto &row_id = event.value("row_id", nlohmann::json{});
+            changedLocked(entity.get<std::string>(), row_id.is_string() ? row_id.get<std::string>() : "");
+        }
+    }
+
+    void RecordCache::clear() {
+        std::lock_guard lock(m_mutex);
+        // Generations stay, so records read before the clear aren't stored after it
+        for (auto &[_, state]: m_entities) {
+            ++state.generation;
+            state.rows.clear();
+            state.lru.clear();
+            if (m_account) m_account->release(state.bytes);
+            state.bytes = 0;
+        }
+    }
+
+    std::size_t RecordCache::shed(const std::size_t bytes) {
+        std::lock_guard lock(m_mutex);
+        std::size_t freed = 0;
+        while (freed < bytes) {
+            // The entity holding the most gives up its least recently used record
+            Entity *largest = nullptr;
+            for (auto &[_, state]: m_entities)
+                if (!state.lru.empty() && (!largest || state.bytes > largest->bytes)) largest = &state;
+            if (!largest) break;
+
+            const auto oldest = std::prev(largest->lru.end());
+            freed += oldest->bytes;
+            eraseLocked(*largest, oldest);
+        }
+        return freed;
+    }
+
+    std::size_t RecordCache::size() const {
+        std::lock_guard lock(m_mutex);
+        std::size_t n = 0;
+        for (const auto &[_, state]: m_entities) n += state.rows.size();
+        return n;
+    }
+
+    std::size_t RecordCache::bytes() const {
+        std::lock_guard lock(m_mutex);
+        std::size_t n = 0;
+        for (const auto &[_, state]: m_entities) n += state.bytes;
+        return n;
+    }
+
+    std::size_t RecordCache::approxBytes(const nlohmann::json &value) {
+        // Every value is one node; strings, objects and arrays own a block each
+        std::size_t bytes = sizeof(nlohmann::json);
+        switch (value.type()) {
+            case nlohmann::json::value_t::string:
+                return bytes + sizeof(std::string) + value.get_ref<const std::string &>().capacity();
+            case nlohmann::json::value_t::object:
+                bytes += sizeof(nlohmann::json::object_t);
+                // A map node besides each key and value
+                for (const auto &[key, child]: value.items())
+                    bytes += 4 * sizeof(void *) + sizeof(std::string) + key.capacity() + approxBytes(child);
+                return bytes;
+            case nlohmann::json::value_t::array:
+                bytes += sizeof(nlohmann::json::array_t);
+                for (const auto &child: value) bytes += approxBytes(child);
+                return bytes;
+            default:
+                return bytes;
+        }
+    }
+
+    void RecordCache::eraseLocked(Entity &state, const Lru::iterator slot) {
+        state.rows.erase(slot->id);
+        state.bytes -= slot->bytes;
+        if (m_account) m_account->release(slot->bytes);
+        state.lru.erase(slot);
+    }
+
+    void RecordCache::changedLocked(const std::string &entity, const std::string &row_id) {
+        auto &state = m_entities[entity];
+        ++state.generation;
+
+        if (row_id.empty()) {
+            state.rows.clear();
+            state.lru.clear();
+            if (m_account) m_account->release(state.bytes);
+            state.bytes = 0;
+            return;
+        }
+        if (const auto it = state.rows.find(row_id); it != state.rows.end()) eraseLocked(state, it->second);
+    }
+}
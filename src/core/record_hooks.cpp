@@ -0,0 +1,107 @@
+/**
+ * @file record_hooks.cpp
+ * @brief Implementation for @see record_hooks.h
+ */
+
+#include "../../include/mantisbase/core/record_hooks.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/core/metrics.h"
+#include "../../include/mantisbase/core/worker_pool.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace mb {
+    RecordHooks::Options RecordHooks::Options::fromEnv() {
+        Options o;
+        const auto positive = [](const std::string &key, const std::size_t fallback) {
+            return static_cast<std::size_t>(
+                std::max(1, safe_stoi(getEnvOrDefault(key, ""), static_cast<int>(fallback))));
+        };
+        o.workers = positive("MB_HOOK_WORKERS", o.workers);
+        o.batchSize = positive("MB_HOOK_BATCH", o.batchSize);
+        o.maxAttempts = positive("MB_HOOK_ATTEMPTS", o.maxAttempts);
+        return o;
+    }
+
+    RecordHooks::RecordHooks(Options options, Deliver deliver)
+        : m_opts(options), m_deliver(std::move(deliver)), m_pool(std::make_unique<WorkerPool>("hooks")) {}
+
+    RecordHooks::~RecordHooks() {
+        stop();
+    }
+
+    void RecordHooks::start() {
+        m_pool->start(m_opts.workers);
+    }
+
+    void RecordHooks::stop() {
+        m_pool->stop();
+    }
+
+    bool RecordHooks::isRunning() const {
+        return m_pool->isRunning();
+    }
+
+    void RecordHooks::onChanges(const nlohmann::json &events) {
+        if (!events.is_array() || events.empty() || !isRunning()) return;
+
+        for (std::size_t i = 0; i < events.size(); i += m_opts.batchSize) {
+            const auto last = std::min(events.size(), i + m_opts.batchSize);
+            auto chunk = nlohmann::json::array();
+            for (auto j = i; j < last; ++j) chunk.push_back(events[j]);
+            if (const auto count = chunk.size(); !submit(std::move(chunk), 1)) {
+                m_dropped += count;
+                LogOrigin::warn("Record Hooks", fmt::format("Dropped {} change event(s) on shutdown", count));
+            }
+        }
+    }
+
+    bool RecordHooks::submit(nlohmann::json events, const std::size_t attempt) {
+        const auto count = events.size();
+        m_pending += count;
+        const auto queued = m_pool->submit([this, events = std::move(events), attempt] {
+            run(events, attempt);
+            m_pending -= events.size();
+        });
+        if (!queued) m_pending -= count;
+        return queued;
+    }
+
+    void RecordHooks::run(const nlohmann::json &events, const std::size_t attempt) {
+        if (attempt > 1) std::this_thread::sleep_for(m_opts.retryDelay * (attempt - 1));
+
+        nlohmann::json failed;
+        try {
+            failed = m_deliver(events);
+        } catch (const std::exception &e) {
+            LogOrigin::warn("Record Hooks", fmt::format("Hook delivery failed: {}", e.what()));
+            failed = events;
+        }
+        if (!failed.is_array()) failed = nlohmann::json::array();
+
+        m_delivered += events.size() - std::min(events.size(), failed.size());
+        if (failed.empty()) return;
+
+        if (attempt >= m_opts.maxAttempts) {
+            m_dropped += failed.size();
+            LogOrigin::warn("Record Hooks", fmt::format("Gave up on {} change event(s) after {} attempt(s)",
+                                                        failed.size(), attempt));
+            return;
+        }
+
+        m_retried += failed.size();
+        // While stopping, the pool takes no new tasks: retry here instead
+        if (!submit(failed, attempt + 1)) run(failed, attempt + 1);
+    }
+
+    void RecordHooks::writeMetrics(MetricsWriter &out) const {
+        out.family("mb_record_hook_events_total", "Change events handed to after-commit record hooks", "counter");
+        out.sample("mb_record_hook_events_total", {{"result", "delivered"}}, static_cast<double>(delivered()));
+        out.sample("mb_record_hook_events_total", {{"result", "retried"}}, static_cast<double>(retried()));
+        out.sample("mb_record_hook_events_total", {{"result", "dropped"}}, static_cast<double>(dropped()));
+        out.family("mb_record_hook_pending", "Change events queued for or running in record hooks", "gauge");
+        out.sample("mb_record_hook_pending", {}, static_cast<double>(pending()));
+    }
+}
@@ -0,0 +1,134 @@
+#include "../../include/mantisbase/core/replay_buffer.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace mb {
+    namespace {
+        std::int64_t toMillis(const ReplayBuffer::Clock::time_point at) {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(at.time_since_epoch()).count();
+        }
+    }
+
+    ReplayBuffer::Options ReplayBuffer::Options::fromEnv() {
+        Options options;
+        if (const auto size = safe_stoi(getEnvOrDefault("MB_REALTIME_REPLAY_SIZE", ""), -1); size >= 0)
+            options.capacity = static_cast<std::size_t>(size);
+        if (const auto secs = safe_stoi(getEnvOrDefault("MB_REALTIME_REPLAY_SECS", ""), 0); secs > 0)
+            options.retention = std::chrono::seconds(secs);
+        return options;
+    }
+
+    ReplayBuffer::ReplayBuffer() : ReplayBuffer(Options{}) {}
+
+    ReplayBuffer::ReplayBuffer(const Options options) : m_options(options) {
+        // Fresh ids start past anything a previous process could have issued
+        m_lastId = m_floor = static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(Clock::now().time_since_epoch()).count());
+    }
+
+    std::shared_ptr<const EncodedEvent> ReplayBuffer::append(const json &change_event) {
+        const auto now = Clock::now();
+
+        std::lock_guard lock(m_mutex);
+        auto event = EncodedEvent::encode(change_event, ++m_lastId);
+        m_entries.push_back({event, change_event, now});
+        evictLocked(now);
+        return event;
+    }
+
+    std::optional<std::uint64_t> ReplayBuffer::since(const std::uint64_t after, const Visitor &visit) const {
+        std::lock_guard lock(m_mutex);
+        if (after < m_floor || after > m_lastId)
+            return std::nullopt;
+
+        const auto first = std::ranges::upper_bound(m_entries, after, {},
+                                                    [](const Entry &e) { return e.event->id(); });
+        for (auto it = first; it != m_entries.end(); ++it)
+            visit(it->event);
+        return m_lastId;
+    }
+
+    bool ReplayBuffer::retains(const std::uint64_t after) const {
+        std::lock_guard lock(m_mutex);
+        return after >= m_floor && after <= m_lastId;
+    }
+
+    std::uint64_t ReplayBuffer::lastId() const {
+        std::lock_guard lock(m_mutex);
+        return m_lastId;
+    }
+
+    std::size_t ReplayBuffer::size() const {
+        std::lock_guard lock(m_mutex);
+        return m_entries.size();
+    }
+
+    bool ReplayBuffer::save(const std::filesystem::path &path) const {
+        json doc;
+        {
+            std::lock_guard lock(m_mutex);
+            doc = {{"last_id", m_lastId}, {"floor", m_floor}, {"events", json::array()}};
+            for (const auto &e: m_entries)
+                doc["events"].push_back({{"id", e.event->id()}, {"at", toMillis(e.at)}, {"change", e.change}});
+        }
+
+        // Write-then-rename so a partial file is never loaded
+        auto tmp = path;
+        tmp += ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::trunc);
+            if (!out) return false;
+            out << doc.dump();
+            if (!out.good()) return false;
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tmp, path, ec);
+        return !ec;
+    }
+
+    bool ReplayBuffer::load(const std::filesystem::path &path) {
+        json doc;
+        {
+            std::ifstream in(path);
+            if (!in) return false;
+            doc = json::parse(in, nullptr, false);
+        }
+
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+
+        if (doc.is_discarded() || !doc.is_object() || !doc.contains("events") || !doc["events"].is_array())
+            return false;
+
+        std::deque<Entry> entries;
+        try {
+            for (const auto &e: doc["events"]) {
+                const auto at = Clock::time_point(std::chrono::milliseconds(e.at("at").get<std::int64_t>()));
+                entries.push_back({EncodedEvent::encode(e.at("change"), e.at("id").get<std::uint64_t>()),
+                                   e.at("change"), at});
+            }
+            const auto last_id = doc.at("last_id").get<std::uint64_t>();
+            const auto floor = doc.at("floor").get<std::uint64_t>();
+
+            std::lock_guard lock(m_mutex);
+            m_entries = std::move(entries);
+            m_lastId = last_id;
+            m_floor = floor;
+            evictLocked(Clock::now());
+        } catch (const std::exception &) {
+            return false;
+        }
+        return true;
+    }
+
+    void ReplayBuffer::evictLocked(const Clock::time_point now) {
+        const auto cutoff = now - m_options.retention;
+        while (!m_entries.empty() && (m_entries.size() > m_options.capacity || m_entries.front().at < cutoff)) {
+            m_floor = m_entries.front().event->id();
+            m_entries.pop_front();
+        }
+    }
+}
@@ -0,0 +1,437 @@
+#include "../../include/mantisbase/core/replication.h"
+#include "../../include/mantisbase/core/backup.h"
+#include "../../include/mantisbase/core/database.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/core/realtime.h"
+#include "../../include/mantisbase/core/router.h"
+#include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <drogon/HttpClient.h>
+#include <trantor/net/EventLoopThread.h>
+#include <soci/soci.h>
+#include <soci/sqlite3/soci-sqlite3.h>
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace mb {
+    namespace {
+        constexpr std::size_t kSnapshotChunk = 8 << 20;    // Bytes per snapshot download request
+        constexpr auto kSnapshotMaxAge = std::chrono::minutes(15);
+        constexpr int kFailuresBeforeResync = 5;           // Consecutive failed polls that force a snapshot
+    }
+
+    Replication::Options Replication::Options::fromEnv() {
+        Options options;
+        options.primary = getEnvOrDefault("MB_REPLICA_OF", "");
+        while (options.primary.ends_with('/')) options.primary.pop_back();
+        options.key = getEnvOrDefault("MB_REPLICATION_KEY", "");
+        if (const auto ms = safe_stoi(getEnvOrDefault("MB_REPLICA_POLL_MS", ""), 0); ms > 0)
+            options.poll = std::chrono::milliseconds(ms);
+        if (const auto batch = safe_stoi(getEnvOrDefault("MB_REPLICA_BATCH", ""), 0); batch > 0)
+            options.batch = std::min(batch, 5000);
+        if (const auto secs = safe_stoi(getEnvOrDefault("MB_REPLICATION_RETAIN_S", ""), -1); secs >= 0)
+            options.retain = std::chrono::seconds(secs);
+        return options;
+    }
+
+    long long Replication::schemaVersion(soci::session &sql) {
+        long long version = 0;
+        sql << "PRAGMA schema_version", soci::into(version);
+        return version;
+    }
+
+    json Replication::changesAfter(soci::session &sql, const long long after, const int limit) {
+        long long head = 0;
+        soci::indicator ind = soci::i_null;
+        sql << "SELECT seq FROM sqlite_sequence WHERE name = 'mb_change_log'", soci::into(head, ind);
+        if (!sql.got_data() || ind == soci::i_null) head = 0;
+        if (after > head)
+            throw MantisException(410, std::format("Change {} is past the primary's newest ({}); take a new snapshot",
+                                                   after, head));
+
+        const long long from = after;
+        const int count = std::clamp(limit, 1, 5000);
+        const soci::rowset<soci::row> rows = (sql.prepare
+            << "SELECT id, type, entity, row_id, new_data FROM mb_change_log WHERE id > :after ORDER BY id LIMIT :n",
+            soci::use(from), soci::use(count));
+
+        json changes = json::array();
+        long long last = after;
+        for (const auto &row: rows) {
+            const long long id = row.get<int>(0);
+            // Ids are handed out without gaps, so a gap is a pruned change
+            if (id != last + 1)
+                throw MantisException(410, std::format("Changes after {} were pruned; take a new snapshot", last));
+            last = id;
+
+            const auto new_data = row.get_indicator(4) == soci::i_null ? "" : row.get<std::string>(4);
+            changes.push_back({
+                {"id", id},
+                {"type", row.get<std::string>(1)},
+                {"entity", row.get<std::string>(2)},
+                {"row_id", row.get<std::string>(3)},
+                {"new_data", tryParseJsonStr(new_data, json(nullptr)).value()},
+            });
+        }
+        if (changes.empty() && head > after)
+            throw MantisException(410, std::format("Changes after {} were pruned; take a new snapshot", after));
+
+        return {{"changes", std::move(changes)}, {"last_id", last}, {"head", head},
+                {"schema_version", schemaVersion(sql)}};
+    }
+
+    void Replication::apply(soci::session &sql, const json &changes) {
+        for (const auto &change: changes) {
+            const auto type = change.value("type", "");
+            const auto table = sqlIdentifier(change.at("entity").get<std::string>());
+
+            if (type == "DELETE") {
+                const auto row_id = change.at("row_id").get<std::string>();
+                sql << std::format("DELETE FROM {} WHERE id = :id", table), soci::use(row_id);
+                continue;
+            }
+            if (type != "INSERT" && type != "UPDATE") continue;
+
+            const auto &data = change.at("new_data");
+            if (!data.is_object() || !data.contains("id"))
+                throw MantisException(500, std::format("Change {} to `{}` carries no row", change.value("id", 0LL),
+                                                       table));
+
+            // json_extract() gives back what the trigger's json_object() was
+            // given: integers for booleans, text for JSON columns
+            std::string columns, values, updates;
+            for (const auto &[key, _]: data.items()) {
+                const auto column = sqlIdentifier(key);
+                if (!columns.empty()) {
+                    columns += ", ";
+                    values += ", ";
+                }
+                columns += column;
+                values += std::format("json_extract(d, '$.\"{}\"')", column);
+                if (column == "id") continue;
+                if (!updates.empty()) updates += ", ";
+                updates += std::format("{0} = excluded.{0}", column);
+            }
+
+            const auto doc = data.dump();
+            sql << std::format("WITH src(d) AS (SELECT :doc) INSERT INTO {} ({}) SELECT {} FROM src WHERE true "
+                               "ON CONFLICT(id) DO {}", table, columns, values,
+                               updates.empty() ? "NOTHING" : "UPDATE SET " + updates),
+                    soci::use(doc);
+        }
+    }
+
+    std::optional<Replication::Cursor> Replication::loadCursor(soci::session &sql) {
+        int exists = 0;
+        sql << "SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name = 'mb_replica_state'",
+                soci::into(exists);
+        if (exists == 0) return std::nullopt;
+
+        Cursor cursor;
+        sql << "SELECT change_id, schema_version FROM mb_replica_state WHERE id = 1",
+                soci::into(cursor.changeId), soci::into(cursor.schemaVersion);
+        if (!sql.got_data()) return std::nullopt;
+        return cursor;
+    }
+
+    void Replication::saveCursor(soci::session &sql, const Cursor &cursor) {
+        sql << "CREATE TABLE IF NOT EXISTS mb_replica_state (id INTEGER PRIMARY KEY CHECK (id = 1), "
+                "change_id INTEGER NOT NULL, schema_version INTEGER NOT NULL)";
+        sql << "INSERT INTO mb_replica_state (id, change_id, schema_version) VALUES (1, :change, :version) "
+                "ON CONFLICT(id) DO UPDATE SET change_id = excluded.change_id, schema_version = excluded.schema_version",
+                soci::use(cursor.changeId), soci::use(cursor.schemaVersion);
+    }
+
+    Replication::Replication(const MantisBase &app, Options options)
+        : mApp(app), m_options(std::move(options)) {}
+
+    Replication::~Replication() {
+        stop();
+        // The client belongs to the loop; drop it before the loop stops
+        m_client.reset();
+    }
+
+    void Replication::start() {
+        if (!m_options.follower()) return;
+        if (mApp.dbType() != "sqlite3") {
+            LogOrigin::warn("Replication", "MB_REPLICA_OF is for SQLite; use PostgreSQL's own replicas "
+                                           "(--db-replica-url) instead. Ignored.");
+            return;
+        }
+        std::lock_guard lock(m_mutex);
+        if (m_thread.joinable()) return;
+
+        if (!m_loop) {
+            m_loop = std::make_unique<trantor::EventLoopThread>("mb-replica");
+            m_loop->run();
+            m_client = drogon::HttpClient::newHttpClient(m_options.primary, m_loop->getLoop());
+        }
+        {
+            const auto sql = mApp.db().session();
+            std::lock_guard stats(m_statsMutex);
+            m_cursor = loadCursor(*sql);
+        }
+
+        m_stopping = false;
+        m_thread = std::thread(&Replication::loop, this);
+        LogOrigin::info("Replication", std::format("Following {}", m_options.primary));
+    }
+
+    void Replication::stop() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+    void Replication::loop() {
+        int failures = 0;
+        while (true) {
+            bool more = false;
+            try {
+                bool synced;
+                {
+                    std::lock_guard lock(m_statsMutex);
+                    synced = m_cursor.has_value();
+                }
+                if (!synced) resync();
+                more = pull();
+                failures = 0;
+            } catch (const std::exception &e) {
+                const auto *mantis = dynamic_cast<const MantisException *>(&e);
+                std::lock_guard lock(m_statsMutex);
+                m_lastError = e.what();
+                // A stale cursor, or one the primary can't serve, starts over from a snapshot
+                if ((mantis && mantis->code() == 410) || ++failures >= kFailuresBeforeResync) {
+                    m_cursor.reset();
+                    more = mantis && mantis->code() == 410;
+                    failures = 0;
+                }
+                LogOrigin::warn("Replication", std::format("Replication poll failed: {}", e.what()));
+            }
+
+            // Back off while the primary fails, up to 30 s
+            const auto wait = more ? std::chrono::milliseconds(0)
+                                   : std::min<std::chrono::milliseconds>(m_options.poll * (1 << std::min(failures, 7)),
+                                                                        std::chrono::seconds(30));
+            std::unique_lock lock(m_mutex);
+            if (m_cv.wait_for(lock, wait, [this] { return m_stopping; })) return;
+        }
+    }
+
+    bool Replication::pull() {
+        Cursor cursor;
+        {
+            std::lock_guard lock(m_statsMutex);
+            cursor = m_cursor.value_or(Cursor{});
+        }
+
+        const auto body = json::parse(request("GET", std::format("/api/v1/sys/replication/changes?after={}&limit={}",
+                                                                 cursor.changeId, m_options.batch)));
+        const auto &data = body.at("data");
+        if (data.at("schema_version").get<long long>() != cursor.schemaVersion) {
+            // DDL isn't in the change log; a new snapshot brings it, and reloads the entities
+            LogOrigin::info("Replication", "The primary's schema changed, taking a new snapshot");
+            resync();
+            return true;
+        }
+
+        const auto &changes = data.at("changes");
+        const Cursor next{data.at("last_id").get<long long>(), cursor.schemaVersion};
+        if (!changes.empty()) {
+            mApp.db().write([&](soci::session &sql) {
+                apply(sql, changes);
+                saveCursor(sql, next);
+            });
+            mApp.rt().notifyChange();
+        }
+
+        std::lock_guard lock(m_statsMutex);
+        m_cursor = next;
+        m_head = data.at("head").get<long long>();
+        m_applied += changes.size();
+        m_lastSync = getCurrentTimestampUTC();
+        m_lastError.clear();
+        return changes.size() >= static_cast<std::size_t>(m_options.batch);
+    }
+
+    void Replication::resync() {
+        const auto started = std::chrono::steady_clock::now();
+        const auto meta = json::parse(request("POST", "/api/v1/sys/replication/snapshot")).at("data");
+        const auto id = meta.at("id").get<std::string>();
+        const auto size = meta.at("size").get<std::uint64_t>();
+
+        const auto file = fs::path(mApp.dataDir()) / "replica-snapshot.db";
+        auto part = file;
+        part += ".part";
+        {
+            std::ofstream out(part, std::ios::binary | std::ios::trunc);
+            for (std::uint64_t offset = 0; offset < size; offset += kSnapshotChunk) {
+                {
+                    std::lock_guard lock(m_mutex);
+                    if (m_stopping) throw MantisException(503, "Stopped while loading a snapshot");
+                }
+                const auto length = std::min<std::uint64_t>(kSnapshotChunk, size - offset);
+                const auto chunk = request("GET", std::format("/api/v1/sys/replication/snapshot/{}?offset={}&length={}",
+                                                              id, offset, length));
+                if (chunk.size() != length)
+                    throw MantisException(502, std::format("Snapshot `{}` came back short at byte {}", id, offset));
+                out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+            }
+            if (!out) throw MantisException(500, std::format("Could not write `{}`", part.string()));
+        }
+        fs::rename(part, file);
+
+        const Cursor cursor{meta.at("change_id").get<long long>(), meta.at("schema_version").get<long long>()};
+        try {
+            restore(file, cursor);
+        } catch (...) {
+            std::error_code ec;
+            fs::remove(file, ec);
+            throw;
+        }
+        fs::remove(file);
+
+        // Entities, rules and the caches built on them follow the new tables
+        mApp.router().reloadSchemaCache();
+        mApp.rt().notifyChange();
+
+        std::lock_guard lock(m_statsMutex);
+        m_cursor = cursor;
+        ++m_resyncs;
+        m_lastSync = getCurrentTimestampUTC();
+        LogOrigin::info("Replication", std::format("Loaded a {} byte snapshot at change {} in {} ms", size,
+                                                   cursor.changeId,
+                                                   std::chrono::duration_cast<std::chrono::milliseconds>(
+                                                       std::chrono::steady_clock::now() - started).count()));
+    }
+
+    void Replication::restore(const fs::path &file, const Cursor &cursor) const {
+        const auto sql = mApp.db().writeSession();
+        auto *backend = dynamic_cast<soci::sqlite3_session_backend *>(sql->get_backend());
+        if (!backend) throw MantisException(500, "Replication needs SQLite");
+
+        // The local realtime worker reads changes after the ids it has seen
+        // here; new ones must keep counting up from there
+        long long local_seq = 0;
+        *sql << "SELECT COALESCE(MAX(seq), 0) FROM sqlite_sequence WHERE name = 'mb_change_log'",
+                soci::into(local_seq);
+
+        sqlite_api::sqlite3 *source = nullptr;
+        if (sqlite_api::sqlite3_open_v2(file.string().c_str(), &source, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+            const std::string err = source ? sqlite_api::sqlite3_errmsg(source) : "out of memory";
+            sqlite_api::sqlite3_close_v2(source);
+            throw MantisException(500, std::format("Could not open the snapshot: {}", err));
+        }
+
+        // Page by page into the open database; readers see the new content once it completes
+        auto *backup = sqlite_api::sqlite3_backup_init(backend->conn_, "main", source, "main");
+        int rc = backup ? SQLITE_OK : sqlite_api::sqlite3_errcode(backend->conn_);
+        while (backup && (rc = sqlite_api::sqlite3_backup_step(backup, -1)) != SQLITE_DONE) {
+            if (rc != SQLITE_BUSY && rc != SQLITE_LOCKED) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        if (backup) sqlite_api::sqlite3_backup_finish(backup);
+        sqlite_api::sqlite3_close_v2(source);
+        if (rc != SQLITE_DONE)
+            throw MantisException(500, std::format("Could not load the snapshot: {}", sqlite_api::sqlite3_errstr(rc)));
+
+        // The primary's changes are in the snapshot already, and not ours to deliver
+        soci::transaction tr(*sql);
+        *sql << "DELETE FROM mb_change_log";
+        *sql << "UPDATE sqlite_sequence SET seq = MAX(seq, :local) WHERE name = 'mb_change_log'", soci::use(local_seq);
+        *sql << "INSERT INTO sqlite_sequence (name, seq) SELECT 'mb_change_log', :local "
+                "WHERE NOT EXISTS (SELECT 1 FROM sqlite_sequence WHERE name = 'mb_change_log')", soci::use(local_seq);
+        saveCursor(*sql, cursor);
+        tr.commit();
+    }
+
+    std::string Replication::request(const std::string &method, const std::string &path) const {
+        const auto req = drogon::HttpRequest::newHttpRequest();
+        req->setMethod(method == "POST" ? drogon::Post : drogon::Get);
+        const auto query = path.find('?');
+        req->setPath(path.substr(0, query));
+        if (query != std::string::npos) {
+            for (const auto &pair: splitString(path.substr(query + 1), "&")) {
+                const auto eq = pair.find('=');
+                req->setParameter(pair.substr(0, eq), eq == std::string::npos ? "" : pair.substr(eq + 1));
+            }
+        }
+        req->addHeader("X-Replication-Key", m_options.key);
+
+        const auto [result, resp] = m_client->sendRequest(req, 60.0);
+        if (result != drogon::ReqResult::Ok || !resp)
+            throw MantisException(502, std::format("Primary {} unreachable: {}", m_options.primary,
+                                                   drogon::to_string_view(result)));
+
+        const auto status = static_cast<int>(resp->statusCode());
+        if (status < 200 || status >= 300) {
+            const auto err = tryParseJsonStr(std::string(resp->body()), json::object()).value();
+            throw MantisException(status, std::format("Primary answered {} to {}: {}", status, req->path(),
+                                                      err.is_object() ? err.value("error", "") : ""));
+        }
+        return std::string(resp->body());
+    }
+
+    fs::path Replication::snapshotDir() const {
+        return fs::path(mApp.dataDir()) / "replication";
+    }
+
+    json Replication::createSnapshot() const {
+        std::lock_guard lock(m_snapshotMutex);
+        const auto dir = snapshotDir();
+        fs::create_directories(dir);
+
+        // Followers fetch a snapshot within minutes; older ones are abandoned
+        std::error_code ec;
+        const auto cutoff = fs::file_time_type::clock::now() - kSnapshotMaxAge;
+        for (const auto &entry: fs::directory_iterator(dir, ec))
+            if (entry.is_regular_file() && entry.last_write_time() < cutoff) fs::remove(entry.path(), ec);
+
+        const auto id = std::format("snap-{}.db", generateShortId(16));
+        Backup::SnapshotInfo info;
+        Backup::copyDatabase(fs::path(mApp.dataDir()) / "mantis.db", dir / id, Backup::Options::fromEnv(), nullptr,
+                             &info);
+        return {{"id", id}, {"size", fs::file_size(dir / id)},
+                {"change_id", info.changeId}, {"schema_version", info.schemaVersion}};
+    }
+
+    fs::path Replication::snapshotPath(const std::string &id) const {
+        // Only names createSnapshot() makes, so `id` can't reach outside the directory
+        const bool valid = id.starts_with("snap-") && id.ends_with(".db") &&
+                           std::ranges::all_of(id, [](const char c) {
+                               return std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '.';
+                           }) && id.find("..") == std::string::npos;
+        const auto path = snapshotDir() / id;
+        if (!valid || !fs::is_regular_file(path))
+            throw MantisException(404, "No such snapshot");
+        return path;
+    }
+
+    json Replication::status() const {
+        if (m_options.follower()) {
+            std::lock_guard lock(m_statsMutex);
+            return {
+                {"role", "follower"},
+                {"primary", m_options.primary},
+                {"change_id", m_cursor ? json(m_cursor->changeId) : json(nullptr)},
+                {"schema_version", m_cursor ? json(m_cursor->schemaVersion) : json(nullptr)},
+                {"head", m_head},
+                {"lag", m_cursor ? json(std::max(0LL, m_head - m_cursor->changeId)) : json(nullptr)},
+                {"applied", m_applied},
+                {"resyncs", m_resyncs},
+                {"last_sync", m_lastSync.empty() ? json(nullptr) : json(m_lastSync)},
+                {"last_error", m_lastError.empty() ? json(nullptr) : json(m_lastError)},
+            };
+        }
+        return {{"role", m_options.serving() ? "primary" : "off"}, {"retain_s", m_options.retain.count()}};
+    }
+}
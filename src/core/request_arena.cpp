@@ -0,0 +1,22 @@
+#include "../../include/mantisbase/core/request_arena.h"
+
+namespace mb {
+    namespace {
+        thread_local RequestArena *t_current = nullptr;
+    }
+
+    RequestArena::RequestArena()
+        : m_resource(m_inline, sizeof(m_inline), std::pmr::new_delete_resource()) {}
+
+    RequestArena *RequestArena::current() {
+        return t_current;
+    }
+
+    RequestArena::Scope::Scope(RequestArena *arena) : m_previous(t_current) {
+        t_current = arena;
+    }
+
+    RequestArena::Scope::~Scope() {
+        t_current = m_previous;
+    }
+}
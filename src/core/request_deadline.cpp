@@ -0,0 +1,65 @@
+/**
+ * @file request_deadline.cpp
+ * @brief Implementation for @see request_deadline.h
+ */
+
+#include "../../include/mantisbase/core/request_deadline.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+
+namespace mb {
+    namespace {
+        thread_local RequestDeadline *t_current = nullptr;
+    }
+
+    RequestDeadline::Options RequestDeadline::Options::fromEnv() {
+        Options options;
+        if (const auto ms = safe_stoi(getEnvOrDefault("MB_REQUEST_TIMEOUT_MS", ""), 0); ms > 0)
+            options.timeout = std::chrono::milliseconds(ms);
+        options.cancelOnClose = getEnvOrDefault("MB_REQUEST_CANCEL_ON_CLOSE", "1") != "0";
+        return options;
+    }
+
+    std::chrono::milliseconds RequestDeadline::Options::timeoutFor(const std::string &header) const {
+        const auto asked = std::chrono::milliseconds(header.empty() ? 0 : std::max(0, safe_stoi(trim(header), 0)));
+        if (asked.count() == 0) return timeout;
+        if (timeout.count() == 0) return asked;
+        return std::min(asked, timeout);
+    }
+
+    RequestDeadline::RequestDeadline(const Clock::time_point at, std::function<bool()> alive)
+        : m_at(at), m_alive(std::move(alive)) {}
+
+    RequestDeadline *RequestDeadline::current() {
+        return t_current;
+    }
+
+    void RequestDeadline::check() {
+        if (!t_current) return;
+        if (const auto code = t_current->status(); code == 504)
+            throw MantisException(504, "Request took longer than its deadline.");
+        else if (code != 0)
+            throw MantisException(code, "Client closed the connection before the request finished.");
+    }
+
+    int RequestDeadline::status() const {
+        if (bounded() && Clock::now() >= m_at) return 504;
+        if (m_alive && !m_alive()) return CLIENT_CLOSED;
+        return 0;
+    }
+
+    RequestDeadline::Clock::duration RequestDeadline::remaining() const {
+        if (!bounded()) return Clock::duration::max();
+        return std::max(m_at - Clock::now(), Clock::duration::zero());
+    }
+
+    RequestDeadline::Scope::Scope(RequestDeadline *deadline) : m_previous(t_current) {
+        t_current = deadline;
+    }
+
+    RequestDeadline::Scope::~Scope() {
+        t_current = m_previous;
+    }
+}
@@ -0,0 +1,189 @@
+/**
+ * @file response_cache.cpp
+ * @brief Implementation for @see response_cache.h
+ */
+
+#include "../../include/mantisbase/core/response_cache.h"
+#include "../../include/mantisbase/core/file_serving.h"
+#include "../../include/mantisbase/utils/crypto_utils.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <vector>
+
+namespace mb {
+    ResponseCache::Options ResponseCache::Options::fromEnv() {
+        Options options;
+        for (const auto &part: splitString(getEnvOrDefault("MB_RESPONSE_CACHE", ""), ",")) {
+            const auto entity = trim(part);
+            if (entity == "*") options.all = true;
+            else if (!entity.empty()) options.entities.insert(entity);
+        }
+        if (const auto mb = safe_stoi(getEnvOrDefault("MB_RESPONSE_CACHE_MAX_MB", ""), -1); mb >= 0)
+            options.maxBytes = static_cast<std::size_t>(mb) * 1024 * 1024;
+        options.budget = CacheBudget::fromEnv();
+        return options;
+    }
+
+    ResponseCache::ResponseCache(Options options) : m_options(std::move(options)) {
+        if (m_options.budget && m_options.maxBytes > 0 && (m_options.all || !m_options.entities.empty()))
+            m_account = m_options.budget->join("responses", [this](const std::size_t bytes) { return shed(bytes); });
+    }
+
+    ResponseCache::~ResponseCache() {
+        if (m_account) m_options.budget->leave(m_account);
+    }
+
+    bool ResponseCache::enabledFor(const std::string &entity) const {
+        return m_options.maxBytes > 0 && (m_options.all || m_options.entities.contains(entity));
+    }
+
+    std::optional<ResponseCache::Entry> ResponseCache::get(const std::string &entity, const std::string &key) {
+        std::lock_guard lock(m_mutex);
+        const auto state = m_entities.find(entity);
+        if (state == m_entities.end()) {
+            ++m_misses;
+            return std::nullopt;
+        }
+        const auto it = state->second.entries.find(key);
+        if (it == state->second.entries.end()) {
+            ++m_misses;
+            return std::nullopt;
+        }
+
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        ++m_hits;
+        return it->second->entry;
+    }
+
+    std::uint64_t ResponseCache::generation(const std::string &entity) const {
+        std::lock_guard lock(m_mutex);
+        const auto it = m_entities.find(entity);
+        return it == m_entities.end() ? 0 : it->second.generation;
+    }
+
+    std::string ResponseCache::put(const std::string &entity, const std::string &key, const std::uint64_t generation,
+                                   std::string body, const std::string &row_id, const std::string &served_tag) {
+        auto tag = served_tag.empty() ? etag(body) : served_tag;
+        if (!enabledFor(entity) || body.size() > m_options.maxEntryBytes) return tag;
+
+        {
+            std::lock_guard lock(m_mutex);
+            auto &state = m_entities[entity];
+            // Read while a change was on its way: what it holds may already be stale
+            if (state.generation != generation) return tag;
+
+            if (const auto it = state.entries.find(key); it != state.entries.end()) eraseLocked(state, it->second);
+
+            m_bytes += body.size();
+            if (m_account) m_account->charge(body.size());
+            m_lru.push_front({entity, key, row_id, {std::make_shared<const std::string>(std::move(body)), tag}});
+            state.entries.emplace(key, m_lru.begin());
+            if (!row_id.empty()) state.rows.emplace(row_id, key);
+
+            while (m_bytes > m_options.maxBytes && !m_lru.empty()) {
+                const auto oldest = std::prev(m_lru.end());
+                eraseLocked(m_entities[oldest->entity], oldest);
+            }
+        }
+        // Outside the lock: the budget may ask this very cache to shed
+        if (m_account) m_options.budget->enforce();
+        return tag;
+    }
+
+    void ResponseCache::invalidateEntity(const std::string &entity) {
+        if (!enabledFor(entity)) return;
+        std::lock_guard lock(m_mutex);
+        auto &state = m_entities[entity];
+        ++state.generation;
+        while (!state.entries.empty()) eraseLocked(state, state.entries.begin()->second);
+    }
+
+    void ResponseCache::onChanges(const nlohmann::json &events) {
+        if (!events.is_array()) return;
+
+        std::lock_guard lock(m_mutex);
+        for (const auto &event: events) {
+            if (!event.is_object()) continue;
+
+            const auto &entity = event.value("entity", nlohmann::json{});
+            if (!entity.is_string()) continue;
+            const auto &row_id = event.value("row_id", nlohmann::json{});
+            changedLocked(entity.get<std::string>(), row_id.is_string() ? row_id.get<std::string>() : "");
+        }
+    }
+
+    void ResponseCache::clear() {
+        std::lock_guard lock(m_mutex);
+        // Generations stay, so bodies read before the clear aren't stored after it
+        for (auto &[_, state]: m_entities) {
+            ++state.generation;
+            state.entries.clear();
+            state.rows.clear();
+        }
+        m_lru.clear();
+        if (m_account) m_account->release(m_bytes);
+        m_bytes = 0;
+    }
+
+    std::size_t ResponseCache::shed(const std::size_t bytes) {
+        std::lock_guard lock(m_mutex);
+        std::size_t freed = 0;
+        while (freed < bytes && !m_lru.empty()) {
+            const auto oldest = std::prev(m_lru.end());
+            freed += oldest->entry.body->size();
+            eraseLocked(m_entities[oldest->entity], oldest);
+        }
+        return freed;
+    }
+
+    std::size_t ResponseCache::size() const {
+        std::lock_guard lock(m_mutex);
+        return m_lru.size();
+    }
+
+    std::size_t ResponseCache::bytes() const {
+        std::lock_guard lock(m_mutex);
+        return m_bytes;
+    }
+
+    std::string ResponseCache::etag(const std::string_view body) {
+        // Half the digest is plenty to tell two versions of a response apart
+        return FileServing::etag(sha256Hex(std::string(body)).substr(0, 32));
+    }
+
+    void ResponseCache::eraseLocked(Entity &state, const Lru::iterator slot) {
+        if (!slot->rowId.empty()) {
+            auto [first, last] = state.rows.equal_range(slot->rowId);
+            for (; first != last; ++first) {
+                if (first->second == slot->key) {
+                    state.rows.erase(first);
+                    break;
+                }
+            }
+        }
+        state.entries.erase(slot->key);
+        m_bytes -= slot->entry.body->size();
+        if (m_account) m_account->release(slot->entry.body->size());
+        m_lru.erase(slot);
+    }
+
+    void ResponseCache::changedLocked(const std::string &entity, const std::string &row_id) {
+        if (!enabledFor(entity)) return;
+        auto &state = m_entities[entity];
+        ++state.generation;
+
+        // Every list page may hold, or now miss, the row
+        for (auto it = state.entries.begin(); it != state.entries.end();) {
+            const auto slot = (it++)->second;
+            if (slot->rowId.empty()) eraseLocked(state, slot);
+        }
+
+        if (row_id.empty()) return;
+        auto [first, last] = state.rows.equal_range(row_id);
+        std::vector<std::string> keys;
+        for (; first != last; ++first) keys.push_back(first->second);
+        for (const auto &key: keys) {
+            if (const auto it = state.entries.find(key); it != state.entries.end()) eraseLocked(state, it->second);
+        }
+    }
+}
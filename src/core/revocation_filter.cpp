@@ -0,0 +1,109 @@
+/**
+ * @file revocation_filter.cpp
+ * @brief Implementation for @see revocation_filter.h
+ */
+
+#include "../../include/mantisbase/core/revocation_filter.h"
+#include "../../include/mantisbase/utils/crypto_utils.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+
+namespace mb {
+    namespace {
+        std::uint64_t hexWord(const std::string &hex, const std::size_t offset) {
+            return std::stoull(hex.substr(offset, 16), nullptr, 16);
+        }
+    }
+
+    RevocationFilter::Options RevocationFilter::Options::fromEnv() {
+        Options o;
+        if (const auto ttl = safe_stoi(getEnvOrDefault("MB_JWT_ACCESS_TTL", ""), 0); ttl > 0)
+            o.window = std::chrono::seconds(ttl);
+        if (const auto bits = safe_stoi(getEnvOrDefault("MB_JWT_REVOCATION_BITS", ""), 0); bits >= 1024)
+            o.bits = static_cast<std::size_t>(bits);
+        return o;
+    }
+
+    RevocationFilter::RevocationFilter(const Options options)
+        : m_opts(options),
+          m_current((std::max<std::size_t>(options.bits, 8) + 7) / 8, 0),
+          m_previous(m_current.size(), 0),
+          m_started(Clock::now()) {}
+
+    std::pair<std::uint64_t, std::uint64_t> RevocationFilter::hashesOf(const std::string &session_id) {
+        const auto digest = sha256Hex(session_id);
+        // An even step could cycle through half the bits only
+        return {hexWord(digest, 0), hexWord(digest, 16) | 1};
+    }
+
+    void RevocationFilter::add(const std::string &session_id) {
+        const auto [h1, h2] = hashesOf(session_id);
+        const auto bits = m_current.size() * 8;
+
+        std::lock_guard lock(m_mutex);
+        rotateLocked(Clock::now());
+        for (unsigned j = 0; j < m_opts.hashes; ++j) {
+            const auto bit = (h1 + j * h2) % bits;
+            m_current[bit / 8] |= static_cast<std::uint8_t>(1u << (bit % 8));
+        }
+        ++m_version;
+    }
+
+    bool RevocationFilter::mayContain(const std::string &session_id) {
+        const auto [h1, h2] = hashesOf(session_id);
+        const auto bits = m_current.size() * 8;
+
+        std::lock_guard lock(m_mutex);
+        rotateLocked(Clock::now());
+        const auto in = [&](const std::vector<std::uint8_t> &filter) {
+            for (unsigned j = 0; j < m_opts.hashes; ++j) {
+                const auto bit = (h1 + j * h2) % bits;
+                if (!(filter[bit / 8] & (1u << (bit % 8)))) return false;
+            }
+            return true;
+        };
+        return in(m_current) || in(m_previous);
+    }
+
+    std::uint64_t RevocationFilter::version() {
+        std::lock_guard lock(m_mutex);
+        rotateLocked(Clock::now());
+        return m_version;
+    }
+
+    nlohmann::json RevocationFilter::toJSON() {
+        std::string merged(m_current.size(), '\0');
+        std::uint64_t version;
+        {
+            std::lock_guard lock(m_mutex);
+            rotateLocked(Clock::now());
+            for (std::size_t i = 0; i < merged.size(); ++i)
+                merged[i] = static_cast<char>(m_current[i] | m_previous[i]);
+            version = m_version;
+        }
+        return {
+            {"version", version},
+            {"bits", merged.size() * 8},
+            {"hashes", m_opts.hashes},
+            {"window", m_opts.window.count()},
+            {"filter", base64UrlEncode(merged)}
+        };
+    }
+
+    void RevocationFilter::rotate(const Clock::time_point now) {
+        std::lock_guard lock(m_mutex);
+        rotateLocked(now);
+    }
+
+    void RevocationFilter::rotateLocked(const Clock::time_point now) {
+        if (now - m_started < m_opts.window) return;
+
+        // Two windows gone: both generations are past every token they covered
+        if (now - m_started >= 2 * m_opts.window) std::ranges::fill(m_current, 0);
+        m_previous.swap(m_current);
+        std::ranges::fill(m_current, 0);
+        m_started = now;
+        ++m_version;
+    }
+}
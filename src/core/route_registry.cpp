@@ -12,15 +12,25 @@ namespace mb {
     void RouteRegistry::add(const std::string &method,
                             const std::string &path,
                             const HandlerFn &handler,
-                            const Middlewares &middlewares) {
-        routes[{method, path}] = {middlewares, handler};
+                            const Middlewares &middlewares,
+                            const RouteExec exec) {
+        routes[{method, path}] = {middlewares, handler, exec};
     }
 
     void RouteRegistry::add(const std::string &method,
                             const std::string &path,
                             const HandlerWithContentReaderFn &handler,
+                            const Middlewares &middlewares,
+                            const RouteExec exec) {
+        routes[{method, path}] = {middlewares, handler, exec};
+    }
+
+    void RouteRegistry::add(const std::string &method,
+                            const std::string &path,
+                            const AsyncHandlerFn &handler,
                             const Middlewares &middlewares) {
-        routes[{method, path}] = {middlewares, handler};
+        // Suspends on the IO loop; blocking work is offloaded by the handler itself
+        routes[{method, path}] = {middlewares, handler, RouteExec::IoLoop};
     }
 
     const RouteHandler *RouteRegistry::find(const std::string &method, const std::string &path) const {
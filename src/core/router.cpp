@@ -3,22 +3,59 @@
 #include "../../include/mantisbase/mantisbase.h"
 #include "../../include/mantisbase/core/database.h"
 #include "../../include/mantisbase/core/files.h"
+#include "../../include/mantisbase/core/file_serving.h"
+#include "../../include/mantisbase/core/blob_store.h"
+#include "../../include/mantisbase/core/storage.h"
+#include "../../include/mantisbase/core/file_cleanup.h"
+#include "../../include/mantisbase/core/schema_migrations.h"
+#include "../../include/mantisbase/core/index_advisor.h"
+#include "../../include/mantisbase/core/slow_query_log.h"
+#include "../../include/mantisbase/core/profiler.h"
+#include "../../include/mantisbase/core/materialized_views.h"
+#include "../../include/mantisbase/core/realtime_probe.h"
+#include "../../include/mantisbase/core/password_hasher.h"
+#include "../../include/mantisbase/core/pg_pipeline.h"
+#include "../../include/mantisbase/core/field_compression.h"
+#include "../../include/mantisbase/core/admin_assets.h"
+#include "../../include/mantisbase/core/compression.h"
+#include "../../include/mantisbase/core/thumbnails.h"
 #include "../../include/mantisbase/core/http.h"
 #include "../../include/mantisbase/core/kv_store.h"
-
-#include <cmrc/cmrc.hpp>
+#include "../../include/mantisbase/core/shared_state.h"
+#include "../../include/mantisbase/core/record_hooks.h"
+#include "../../include/mantisbase/core/webhooks.h"
+#include "../../include/mantisbase/core/readiness_probe.h"
+#include "../../include/mantisbase/core/thread_placement.h"
+#include "../../include/mantisbase/core/cache_budget.h"
+#include "../../include/mantisbase/core/revocation_filter.h"
+#include "../../include/mantisbase/core/session_store.h"
+#include "../../include/mantisbase/core/app_kv.h"
+#include "../../include/mantisbase/core/token_verifier.h"
+#include "../../include/mantisbase/core/tenants.h"
+#include "../../include/mantisbase/core/scheduler.h"
+#include "../../include/mantisbase/core/channels.h"
+#include "../../include/mantisbase/core/keyset_page.h"
+
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <ctime>
+#include <exception>
+#include <iterator>
+#include <mutex>
 #include <thread>
+#include <unordered_set>
 #include <drogon/drogon.h>
 
 // For thread logger
 #include <memory>
-#include <shared_mutex>
+#include <limits>
 #include <spdlog/sinks/stdout_color_sinks-inl.h>
 #include <spdlog/sinks/ansicolor_sink.h>
 
 #include "../include/mantisbase/core/exceptions.h"
 #include "../include/mantisbase/core/middlewares.h"
+#include "../include/mantisbase/core/models/entity_archive.h"
 #include "../include/mantisbase/core/models/entity_schema.h"
 #include "../include/mantisbase/core/models/entity_routes.h"
 #include "../include/mantisbase/core/models/entity_schema_routes.h"
@@ -28,20 +65,134 @@
 #include "../include/mantisbase/core/ws.h"
 #include "../include/mantisbase/core/oauth.h"
 #include "../include/mantisbase/core/api_keys.h"
-#include "../include/mantisbase/utils/snowflake.hpp"
-
-// Declare a mantis namespace for the embedded FS
-CMRC_DECLARE(mantis);
+#include "../include/mantisbase/core/auth.h"
+#include "../include/mantisbase/core/worker_pool.h"
 
 namespace mb {
+    namespace {
+#ifdef MB_SCRIPTING_ENABLED
+        /// `jobs[name]` of the scripts, run on a job worker's heap within the budget of `jobs.<name>`
+        Scheduler::Job scriptedJob(const MantisBase &app, const std::string &name, const json &spec) {
+            return {
+                name, spec.value("schedule", ""), [&app, name] {
+                    app.scriptsCheckpoint();
+                    const auto ctx = app.ctx();
+                    if (!ctx) throw MantisException(500, "No script heap on this thread");
+                    const auto hook = "jobs." + name;
+                    const auto start = std::chrono::steady_clock::now();
+                    const ScriptHeaps::Budget budget(ctx, app.scriptBudgets().of(hook));
+                    const bool ok = ScriptingHooks::runJob(ctx, name);
+                    app.router().metrics().recordScript(hook, std::chrono::steady_clock::now() - start);
+                    if (budget.exceeded()) {
+                        app.router().metrics().recordScriptTimeout(hook);
+                        throw MantisException(500, "Script job ran over its budget");
+                    }
+                    if (!ok) throw MantisException(500, "Script job threw");
+                },
+                std::chrono::seconds(std::max(0, spec.value("jitter", 0))), spec.value("leased", true)
+            };
+        }
+
+        /// Reloads the scripts once a file under the scripts directory is added, removed or changed
+        std::function<void()> scriptsWatcher(const MantisBase &app) {
+            const auto fingerprint = [&app] {
+                std::vector<std::string> files;
+                std::error_code ec;
+                for (fs::recursive_directory_iterator it(app.scriptsDir(), ec), end; !ec && it != end; it.increment(ec)) {
+                    if (!it->is_regular_file(ec)) continue;
+                    files.push_back(fmt::format("{} {} {}", it->path().string(),
+                                                it->last_write_time(ec).time_since_epoch().count(),
+                                                it->file_size(ec)));
+                }
+                std::ranges::sort(files);
+                return files;
+            };
+            return [&app, fingerprint, last = std::make_shared<std::vector<std::string>>(fingerprint())] {
+                auto files = fingerprint();
+                if (files == *last) return;
+                // Taken as seen either way, so a broken edit is retried once it changes again
+                *last = std::move(files);
+                [[maybe_unused]] auto _ = app.reloadScripts();
+            };
+        }
+#endif
+
+        /// Runs the scripts' after-commit hooks for a chunk of change events, on a hook worker's heap
+        RecordHooks::Deliver scriptedRecordHooks(const MantisBase &app) {
+            return [&app](const json &events) {
+                auto failed = json::array();
+#ifdef MB_SCRIPTING_ENABLED
+                app.scriptsCheckpoint();
+                const auto ctx = app.ctx();
+                if (!ctx) return events;
+
+                // A hook cut short by its budget failed, and is retried like any other
+                const auto timed = [&](const char *hook, const auto &fire) {
+                    if (!ScriptingHooks::defines(ctx, hook)) return true;
+                    const auto start = std::chrono::steady_clock::now();
+                    const ScriptHeaps::Budget budget(ctx, app.scriptBudgets().of(hook));
+                    const bool ok = fire();
+                    app.router().metrics().recordScript(hook, std::chrono::steady_clock::now() - start);
+                    if (budget.exceeded()) app.router().metrics().recordScriptTimeout(hook);
+                    return ok && !budget.exceeded();
+                };
+
+                if (!timed("onRecordsChanged", [&] { return ScriptingHooks::fireOnRecordsChanged(ctx, events); }))
+                    return events;
+
+                for (const auto &event: events) {
+                    const auto type = event.value("type", "");
+                    const auto entity = event.value("entity", "");
+                    const auto row_id = event.value("row_id", "");
+                    bool ok = true;
+                    if (type == "INSERT")
+                        ok = timed("onRecordCreated", [&] {
+                            return ScriptingHooks::fireOnRecordCreated(ctx, entity, row_id, event["new_data"]);
+                        });
+                    else if (type == "UPDATE")
+                        ok = timed("onRecordUpdated", [&] {
+                            return ScriptingHooks::fireOnRecordUpdated(ctx, entity, row_id, event["new_data"]);
+                        });
+                    else if (type == "DELETE")
+                        ok = timed("onRecordDeleted", [&] {
+                            return ScriptingHooks::fireOnRecordDeleted(ctx, entity, row_id, event["old_data"]);
+                        });
+                    if (!ok) failed.push_back(event);
+                }
+#endif
+                return failed;
+            };
+        }
+    }
+
     Router::Router(const MantisBase &app)
         : mApp(app),
-          m_sseMgr(std::make_unique<SSEMgr>(app)) {
+          m_sseMgr(std::make_unique<SSEMgr>(app)),
+          m_dbWorkers(std::make_unique<WorkerPool>("db")),
+          m_accessLog(std::make_unique<AccessLog>(AccessLog::Options::fromEnv())),
+          m_metrics(std::make_unique<Metrics>()),
+          m_admission(std::make_unique<Admission>(Admission::Options::fromEnv())),
+          m_drain(std::make_unique<Drain>(Drain::Options::fromEnv())),
+          m_serverTiming(ServerTiming::modeFromEnv()),
+          m_deadlines(RequestDeadline::Options::fromEnv()),
+          m_tracer(std::make_unique<Tracer>(Tracer::Options::fromEnv())),
+          m_thumbnails(std::make_unique<Thumbnailer>(Thumbnailer::Options::fromEnv())),
+          m_recordHooks(std::make_unique<RecordHooks>(RecordHooks::Options::fromEnv(), scriptedRecordHooks(app))),
+          m_uploadLimits(MultipartUpload::Limits::fromEnv()),
+          m_fileIo(std::make_unique<FileIo>(FileIo::Options::fromEnv())),
+          m_warmup(std::make_unique<ConnectionWarmup>(app, ConnectionWarmup::Options::fromEnv())),
+          m_leader(std::make_unique<LeaderElection>(LeaderElection::Options::fromEnv())),
+          m_webhooks(std::make_unique<Webhooks>(Webhooks::Options::fromEnv())),
+          m_readiness(std::make_unique<ReadinessProbe>(app, ReadinessProbe::Options::fromEnv())),
+          m_compression(Compression::Options::fromEnv()),
+          m_responseCache(std::make_unique<ResponseCache>(ResponseCache::Options::fromEnv())),
+          m_cors(std::make_unique<CorsPolicy>(CorsPolicy::Options::fromEnv())),
+          m_staticCache(std::make_unique<StaticCache>(StaticCache::Options::fromEnv(), &Router::getMimeType)),
+          m_usageQuotas(std::make_unique<UsageQuotas>(UsageQuotas::Options::fromEnv())),
+          m_replication(std::make_unique<Replication>(app, Replication::Options::fromEnv())) {
         // Add global middlewares to work across all routes
         m_preRoutingMiddlewares.push_back(getAuthToken());
         m_preRoutingMiddlewares.push_back(hydrateContextData());
-
-        m_sfId.init(1, 1);
     }
 
     Router::~Router() {
@@ -50,45 +201,83 @@ namespace mb {
     }
 
     bool Router::init() { {
-            // Runs before the server starts listening (single-threaded), but we
-            // take the exclusive lock anyway to keep all m_entityMap access
-            // uniformly synchronized and future-proof.
-            std::unique_lock lock(m_entityMapMutex);
+            // Runs before the server starts listening (single-threaded); built
+            // aside and published at once like every other change to the map
+            std::lock_guard lock(m_entities.mutex);
+            m_entities.publish(loadEntities());
+        }
 
-            const auto sql = mApp.db().session();
-            const soci::rowset rows = (sql->prepare << "SELECT schema FROM mb_tables");
+        // Tables from boots under another change capture mode are brought over;
+        // mb_admins and mb_service_acc are built here, not read from mb_tables
+        std::vector<std::shared_ptr<const Entity>> entities;
+        for (const auto &[_, entity]: *m_entities.map.load())
+            if (!entity->schema().value("system", false)) entities.push_back(entity);
+        mApp.rt().syncDbHooks(entities);
 
-            for (const auto &row: rows) {
-                const auto schema = row.get<nlohmann::json>("schema");
+        // Misc Endpoints [admin, auth, etc]
+        generateMiscEndpoints();
 
-                // Create entity based on the schema, bound to this application
-                // so its CRUD ops can reach db/realtime without the singleton.
-                Entity entity{mApp, schema};
+        return true;
+    }
 
-                // Store this object to keep alive function pointers
-                // if not, possible access violation error
-                m_entityMap.emplace(entity.name(), std::move(entity));
-            }
+    std::shared_ptr<const Router::EntityMap> Router::loadEntities() const {
+        auto map = std::make_shared<EntityMap>();
 
-            // Add admin routes
-            EntitySchema admin_schema{mApp, "mb_admins", "auth"};
-            admin_schema.removeField("name");
-            admin_schema.setSystem(true);
-            auto admin_entity = admin_schema.toEntity();
-            m_entityMap.emplace(admin_entity.name(), std::move(admin_entity));
-
-            // Service Schema [No routes]
-            EntitySchema service_schema{mApp, "mb_service_acc", "base"};
-            service_schema.setHasApi(false);
-            service_schema.setSystem(true);
-            auto service_entity = service_schema.toEntity();
-            m_entityMap.emplace(service_entity.name(), std::move(service_entity));
+        // Read as text; parsing and building the entities is most of the
+        // boot time with many schemas, so it's spread over a few threads
+        std::vector<std::string> texts;
+        {
+            const auto sql = mApp.db().session();
+            const soci::rowset<std::string> rows = (sql->prepare << "SELECT schema FROM mb_tables");
+            std::ranges::copy(rows, std::back_inserter(texts));
         }
 
-        // Misc Endpoints [admin, auth, etc]
-        generateMiscEndpoints();
+        std::vector<std::shared_ptr<const Entity>> entities(texts.size());
+        std::atomic<std::size_t> next{0};
+        std::exception_ptr failed;
+        std::mutex failed_mutex;
+        const auto build = [&] {
+            for (std::size_t i; (i = next++) < texts.size();) {
+                try {
+                    // Bound to this application so its CRUD ops can reach
+                    // db/realtime without the singleton
+                    entities[i] = std::make_shared<const Entity>(mApp, nlohmann::json::parse(texts[i]));
+                } catch (...) {
+                    std::lock_guard failed_lock(failed_mutex);
+                    if (!failed) failed = std::current_exception();
+                }
+            }
+        };
 
-        return true;
+        // Entities are cheap to build now (see Entity::compiled()); threads only pay off in bulk
+        const auto threads = std::min<std::size_t>(std::max(1u, std::thread::hardware_concurrency()),
+                                                   texts.size() / 64 + 1);
+        std::vector<std::thread> workers;
+        for (std::size_t t = 1; t < threads; ++t) workers.emplace_back(build);
+        build();
+        for (auto &w: workers) w.join();
+        if (failed) std::rethrow_exception(failed);
+
+        for (auto &entity: entities) {
+            const auto name = entity->name();
+            map->emplace(name, std::move(entity));
+        }
+
+        // Add admin routes
+        EntitySchema admin_schema{mApp, "mb_admins", "auth"};
+        admin_schema.removeField("name");
+        admin_schema.setSystem(true);
+        auto admin_entity = std::make_shared<const Entity>(admin_schema.toEntity());
+        map->emplace(admin_entity->name(), std::move(admin_entity));
+
+        // Service Schema [No routes]
+        EntitySchema service_schema{mApp, "mb_service_acc", "base"};
+        service_schema.setHasApi(false);
+        service_schema.setSystem(true);
+        auto service_entity = std::make_shared<const Entity>(service_schema.toEntity());
+        map->emplace(service_entity->name(), std::move(service_entity));
+
+        return map;
     }
 
     bool Router::listen() {
@@ -102,12 +291,163 @@ namespace mb {
             // If we don't have admin accounts, spin up admin dashboard
             bool launch_admin_setup = !mApp.skipAdminSetup() && admin_entity.isEmpty();
 
+            // Evict cached auth users and responses and keep cached counts current
+            // when rows change, before the worker starts so no early batch is missed
+            mApp.rt().subscribe([cache = m_responseCache.get()](const json &events) {
+                Auth::userCache().onChanges(events);
+                Entity::countCache().onChanges(events);
+                Entity::readFlights().onChanges(events);
+                Entity::recordCache().onChanges(events);
+                Entity::vectorIndexes().onChanges(events);
+                cache->onChanges(events);
+            });
+            for (const auto &[_, entity]: *m_entities.map.load()) {
+                pinForCaches(*entity);
+                mApp.materializedViews().track(entity->schema());
+            }
+            mApp.rt().subscribe([views = &mApp.materializedViews()](const json &events) { views->onChanges(events); });
+            if (m_webhooks->options().enabled) {
+                // Webhooks can name any entity, and be added at any time
+                mApp.rt().subscribe([hooks = m_webhooks.get()](const json &events) { hooks->onChanges(events); });
+                mApp.rt().captureAll();
+            }
+
+#ifdef MB_SCRIPTING_ENABLED
+            // Same stream, delivered off the request path; only worth a pool if a script listens
+            if (const auto ctx = mApp.ctx(); ctx && ScriptingHooks::definesRecordHooks(ctx)) {
+                m_recordHooks->start();
+                mApp.rt().subscribe([hooks = m_recordHooks.get()](const json &events) { hooks->onChanges(events); });
+                mApp.rt().captureAll();
+            }
+#endif
+
+            // Before any request is counted, so no node starts on a local budget
+            SharedState::init(mApp);
+
             m_sseMgr->start();
 
+            // DB-bound routes run here instead of on the IO loops
+            // Each worker confined to the MB_CPU_DB CPUs of one NUMA node, if set
+            m_dbWorkers->start(mApp.dbWorkers(), [](const size_t i) {
+                ThreadPlacement::instance().pin(ThreadPlacement::Role::Db, i);
+            });
+            m_thumbnails->start();
+            m_fileIo->start();
+            PasswordHasher::instance().start();
+
+            // Prepares the entities' statements on every pooled connection; health reports 503 until done
+            if (m_warmup->enabled()) {
+                std::vector<std::shared_ptr<const Entity>> entities;
+                for (const auto &[_, entity]: *m_entities.map.load()) entities.push_back(entity);
+                m_warmup->start(std::move(entities));
+            }
+            m_readiness->start();
+
+            // Removes files dropped from records, starting with any a crash left queued
+            mApp.fileCleanup().start();
+
+            // Group-commits new sessions and sweeps expired ones
+            mApp.sessionStore().start();
+
+            // Loads the stored key-value pairs and writes changed ones behind
+            mApp.kv().start();
+
+            // Online schema migrations a restart interrupted carry on from their last batch
+            mApp.schemaMigrations().start();
+
+            // With MB_INDEX_AUTO=1, builds the indexes frequent slow list queries lack
+            mApp.indexAdvisor().start();
+
+            // Statements slower than MB_SLOW_QUERY_MS go in the log database, with their plans
+            mApp.slowQueryLog().start();
+
+            // Brings materialized views up to date, then follows their sources
+            mApp.materializedViews().start();
+
+            // With MB_RT_PROBE_MS, times probe writes from commit to SSE delivery
+            mApp.realtimeProbe().start();
+
+            // Housekeeping runs on cron schedules, next to the jobs scripts declare
+            auto &scheduler = mApp.scheduler();
+            scheduler.add({"log-retention", "@hourly", [] {
+                if (Logger::isDbInitialized.load()) MantisBase::instance().logs().logsDb().deleteOldLogs(5);
+            }});
+            scheduler.add({"change-log-prune", "@every 10s", [this] { mApp.rt().pruneChangeLog(); }, {}, false, true});
+            // Moves rows past their entity's `archive` age out of the table, see EntityArchive
+            scheduler.add({"archive", "@hourly", [this] {
+                const auto entities = m_entities.map.load();
+                std::vector<std::shared_ptr<const Entity>> list;
+                for (const auto &[_, entity]: *entities) list.push_back(entity);
+                EntityArchive::run(list);
+            }, {}, false, true});
+            scheduler.add({"api-key-last-used",
+                           fmt::format("@every {}s", static_cast<int>(ApiKeyManager::LAST_USED_FLUSH_INTERVAL_SECS)),
+                           [] { ApiKeyManager::flushLastUsed(); }});
+            if (m_usageQuotas->enabled()) {
+                // Before the first request, so a restart doesn't hand out a fresh quota
+                m_usageQuotas->load();
+                scheduler.add({"usage-flush", fmt::format("@every {}s", UsageQuotas::FLUSH_INTERVAL_SECS),
+                               [this] { m_usageQuotas->flush(); }});
+            }
+#ifdef MB_SCRIPTING_ENABLED
+            scheduleScriptJobs();
+            // Picks up edits to the scripts without a restart
+            if (const auto secs = safe_stoi(getEnvOrDefault("MB_SCRIPTS_WATCH_SECS", ""), 0); secs > 0 && mApp.ctx())
+                scheduler.add({"scripts-watch", fmt::format("@every {}s", secs), scriptsWatcher(mApp)});
+#endif
+            // Leads at once alone on SQLite; on PostgreSQL, one node runs the singleton jobs
+            scheduler.setLeadership([this] { return m_leader->isLeader(); });
+            m_leader->start(mApp.dbType() == "postgresql");
+            scheduler.start();
+            m_webhooks->start([this] { return m_leader->isLeader(); });
+
+            m_tracer->start();
+
+            // On a replica, loads a snapshot if it has none, then follows the primary
+            m_replication->start();
+
             // Configure Drogon
+            const auto threads = mApp.httpThreads();
+            const auto listener = mApp.listenerOptions();
+            if (listener.tls() && !drogon::utils::supportsTls())
+                throw MantisException(500, "TLS was configured, but this build has no TLS library");
             drogon::app()
-                    .addListener(host, port)
-                    .setThreadNum(4);
+                    .addListener(host, port, listener.tls(), listener.tlsCert, listener.tlsKey, false,
+                                 listener.sslConfCommands())
+                    .setThreadNum(threads)
+                    .enableReusePort(mApp.reusePort())
+                    // Keep-alive connections close once idle this long, or after this many requests
+                    .setIdleConnectionTimeout(static_cast<std::size_t>(listener.idleTimeout.count()))
+                    .setKeepaliveRequestsNumber(listener.keepAliveRequests)
+                    .setMaxConnectionNum(listener.maxConnections)
+                    .setMaxConnectionNumPerIP(listener.maxConnectionsPerIp)
+                    // Uploads stream to disk, see registerDrogonHandlerWithReader(); other
+                    // bodies are still buffered and held to maxBody per request
+                    .enableRequestStream()
+                    .setClientMaxBodySize(std::max(m_uploadLimits.maxUpload, m_uploadLimits.maxBody));
+
+            LogOrigin::info("Server", fmt::format("HTTP IO threads: {}{}, DB workers: {}, DB pool: {}",
+                                                  threads, mApp.reusePort() ? " (SO_REUSEPORT)" : "",
+                                                  mApp.dbWorkers(), mApp.poolSize()));
+            LogOrigin::info("Server", fmt::format("Listener: {}, idle timeout {}s, {} requests per connection, "
+                                                  "{} connections ({} per IP)",
+                                                  listener.tls()
+                                                      ? (listener.tlsSessionTickets ? "HTTPS (session tickets)" : "HTTPS")
+                                                      : "HTTP",
+                                                  listener.idleTimeout.count(),
+                                                  listener.keepAliveRequests ? std::to_string(listener.keepAliveRequests) : "unlimited",
+                                                  listener.maxConnections,
+                                                  listener.maxConnectionsPerIp ? std::to_string(listener.maxConnectionsPerIp) : "any"));
+
+            // IO loop `i` pinned to the `i`-th MB_CPU_IO CPU, on its own loop once they run
+            if (ThreadPlacement::instance().enabled()) {
+                drogon::app().registerBeginningAdvice([] {
+                    for (size_t i = 0; i < drogon::app().getThreadNum(); ++i)
+                        drogon::app().getIOLoop(i)->queueInLoop([i] {
+                            ThreadPlacement::instance().pin(ThreadPlacement::Role::Io, i);
+                        });
+                });
+            }
 
             // Register hook to generate request IDs
             drogon::app().registerSyncAdvice(reqIdSyncAdvice());
@@ -118,9 +458,49 @@ namespace mb {
             // Register CORS pre-routing advice
             drogon::app().registerPreRoutingAdvice(corsPreRoutingAdvice());
 
+            // Cached public files are answered before routing, so a request never touches the disk
+            if (m_staticCache->enabled() && fs::exists(mApp.publicDir())) {
+                drogon::app().registerPreRoutingAdvice([cache = m_staticCache.get()](
+                    const drogon::HttpRequestPtr &req, drogon::AdviceCallback &&callback,
+                    drogon::AdviceChainCallback &&chainCallback) {
+                    const auto method = req->method();
+                    if ((method == drogon::Get || method == drogon::Head) && !req->path().starts_with("/api/")) {
+                        if (auto resp = cache->respond(req)) return callback(resp);
+                    }
+                    chainCallback();
+                });
+                m_staticCache->watch(mApp.publicDir());
+            }
+
+            // Bodies both ways count against the caller's bandwidth quota, compressed as sent
+            if (m_usageQuotas->enabled()) {
+                drogon::app().registerPostHandlingAdvice([quotas = m_usageQuotas.get()](
+                    const drogon::HttpRequestPtr &req, const drogon::HttpResponsePtr &resp) {
+                    const auto attrs = req->attributes();
+                    if (!attrs->find("mb_quota_subject")) return;
+                    quotas->addBytes(attrs->get<std::string>("mb_quota_subject"),
+                                     req->getRealContentLength() + resp->body().size());
+                });
+            }
+
             // Register post-routing advice for CORS headers on all responses
             drogon::app().registerPostHandlingAdvice(corsPostHandlingAdvice());
 
+            // While draining, every response closes its connection so clients move to another process
+            drogon::app().registerPostHandlingAdvice([this](const drogon::HttpRequestPtr &,
+                                                            const drogon::HttpResponsePtr &resp) {
+                if (m_drain->draining()) resp->setCloseConnection(true);
+            });
+
+            // SIGTERM drains before quitting; a second one, or SIGINT, quits at once
+            drogon::app().setTermSignalHandler([this] {
+                if (m_drain->draining()) return drogon::app().quit();
+                std::thread([this] {
+                    drain();
+                    drogon::app().quit();
+                }).detach();
+            });
+
             // Register default 404 handler
             drogon::app().setCustom404Page(default404Response());
 
@@ -150,12 +530,43 @@ namespace mb {
             // drogon::app().run() blocks until quit() is called
             drogon::app().run();
 
+            m_replication->stop();
+            m_dbWorkers->stop();
+            m_thumbnails->stop();
+            m_fileIo->stop();
+            m_warmup->stop();
+            m_readiness->stop();
+            m_webhooks->stop();
+            m_leader->stop();
+            m_staticCache->stop();
+            PasswordHasher::instance().stop();
+            m_recordHooks->stop();
+            ApiKeyManager::flushLastUsed();
+            if (m_usageQuotas->enabled()) m_usageQuotas->flush();
             m_running.store(false);
             return true;
         } catch (const std::exception &e) {
+            m_dbWorkers->stop();
+            m_thumbnails->stop();
+            m_fileIo->stop();
+            m_warmup->stop();
+            m_readiness->stop();
+            m_webhooks->stop();
+            m_leader->stop();
+            PasswordHasher::instance().stop();
+            m_recordHooks->stop();
             m_running.store(false);
             LogOrigin::critical("Server", fmt::format("Failed to start server: {}", e.what()));
         } catch (...) {
+            m_dbWorkers->stop();
+            m_thumbnails->stop();
+            m_fileIo->stop();
+            m_warmup->stop();
+            m_readiness->stop();
+            m_webhooks->stop();
+            m_leader->stop();
+            PasswordHasher::instance().stop();
+            m_recordHooks->stop();
             m_running.store(false);
             LogOrigin::critical("Server", "Failed to start server: Unknown Error");
         }
@@ -163,16 +574,79 @@ namespace mb {
         return false;
     }
 
+#ifdef MB_SCRIPTING_ENABLED
+    void Router::scheduleScriptJobs() {
+        auto &scheduler = mApp.scheduler();
+        std::vector<std::string> scheduled;
+        if (const auto ctx = mApp.ctx()) {
+            for (const auto &[name, spec]: ScriptingHooks::scheduledJobs(ctx).items()) {
+                try {
+                    scheduler.add(scriptedJob(mApp, name, spec));
+                    scheduled.push_back(name);
+                } catch (const MantisException &e) {
+                    LogOrigin::warn("Scheduler", fmt::format("Script job `{}` skipped: {}", name, e.what()));
+                }
+            }
+        }
+
+        // Jobs of earlier scripts that aren't declared any more
+        for (const auto &name: m_scriptJobs)
+            if (std::ranges::find(scheduled, name) == scheduled.end()) scheduler.remove(name);
+        m_scriptJobs = std::move(scheduled);
+    }
+
+    void Router::scriptsReloaded() {
+        if (!m_running.load()) return;
+        scheduleScriptJobs();
+
+        if (const auto ctx = mApp.ctx(); ctx && !m_recordHooks->isRunning() && ScriptingHooks::definesRecordHooks(ctx))
+            LogOrigin::warn("Scripts", "Record hooks the scripts now define run after the next restart");
+    }
+#endif
+
+    bool Router::drain() {
+        if (!m_running.load() || !m_drain->begin()) return true;
+
+        LogOrigin::info("Server", fmt::format("Draining {} in-flight requests, up to {}ms",
+                                              m_drain->inflight(), m_drain->options().grace.count()));
+        const auto drained = m_drain->wait();
+        if (!drained)
+            LogOrigin::warn("Server", fmt::format("{} requests still in flight after the grace period",
+                                                  m_drain->inflight()));
+
+        // Writes in flight have been published by now; spread the clients' return over the jitter
+        if (m_sseMgr->isRunning()) {
+            const auto told = m_sseMgr->sendReconnect([this] { return m_drain->reconnectDelay(); });
+            LogOrigin::info("Server", fmt::format("Asked {} realtime clients to reconnect", told));
+        }
+        return drained;
+    }
+
     void Router::close() {
+        // New requests are turned away while those in flight finish
+        drain();
+
         // Stop SSE manager first before the router
         if (m_sseMgr->isRunning())
             m_sseMgr->stop();
 
         // Stop router and clear out objects
         if (m_running.load()) {
+            // Export the last spans while the HTTP client's loop still runs
+            m_tracer->stop();
+            m_replication->stop();
             drogon::app().quit();
+            m_dbWorkers->stop();
+            m_thumbnails->stop();
+            m_fileIo->stop();
+            m_warmup->stop();
+            m_readiness->stop();
+            m_webhooks->stop();
+            m_leader->stop();
+            PasswordHasher::instance().stop();
+            m_recordHooks->stop();
             m_running.store(false);
-            m_entityMap.clear();
+            m_entities.publish(std::make_shared<const EntityMap>());
             LogOrigin::info("Server", "HTTP Server Stopped.");
         }
     }
@@ -185,82 +659,202 @@ namespace mb {
         return *m_sseMgr;
     }
 
-    const json &Router::schemaCache(const std::string &table_name) const {
-        // NOTE: returns a reference into the cache; the caller must not rely on
-        // it remaining valid across a concurrent schema mutation. Currently
-        // unused, kept for API completeness.
-        std::shared_lock lock(m_entityMapMutex);
-        if (!m_entityMap.contains(table_name)) {
-            throw MantisException(404, "Entity schema for " + table_name + " was not found!");
-        }
+    json Router::schemaCache(const std::string &table_name) const {
+        return entitySnapshot(table_name)->schema();
+    }
 
-        return m_entityMap.at(table_name).schema();
+    Router::EntityCache &Router::entityCache() const {
+        if (auto *tenant = Tenants::current()) return tenant->entities;
+        return m_entities;
     }
 
     bool Router::hasSchemaCache(const std::string &table_name) const {
-        std::shared_lock lock(m_entityMapMutex);
-        return m_entityMap.contains(table_name);
+        return entityCache().map.load()->contains(table_name);
     }
 
     Entity Router::schemaCacheEntity(const std::string &table_name) const {
-        std::shared_lock lock(m_entityMapMutex);
-        if (!m_entityMap.contains(table_name)) {
+        return *entitySnapshot(table_name);
+    }
+
+    std::shared_ptr<const Entity> Router::entitySnapshot(const std::string &table_name) const {
+        const auto map = entityCache().map.load();
+        const auto it = map->find(table_name);
+        if (it == map->end()) {
             throw MantisException(404, "Entity schema for `" + table_name + "` was not found!");
         }
-
-        // Returns a copy, so it stays valid after the lock is released.
-        return Entity(m_entityMap.at(table_name));
+        return it->second;
     }
 
     void Router::addSchemaCache(const nlohmann::json &entity_schema) {
-        std::unique_lock lock(m_entityMapMutex);
-        addSchemaCacheLocked(entity_schema);
+        auto entity = std::make_shared<const Entity>(mApp, entity_schema);
+
+        auto &cache = entityCache();
+        std::lock_guard lock(cache.mutex);
+        auto map = std::make_shared<EntityMap>(*cache.map.load());
+        const auto name = entity->name();
+        addSchemaCacheLocked(*map, std::move(entity));
+        publishEntities(cache, std::move(map), {name});
     }
 
     void Router::updateSchemaCache(const std::string &old_entity_name, const json &new_schema) {
-        std::unique_lock lock(m_entityMapMutex);
+        // Build the replacement, codec, rules and hot filters included, before
+        // taking the lock and while readers still get the old one
+        auto entity = std::make_shared<const Entity>(mApp, new_schema);
+        auto &cache = entityCache();
+        if (const auto map = cache.map.load(); map->contains(old_entity_name))
+            entity->prewarm(*map->at(old_entity_name));
 
-        if (!m_entityMap.contains(old_entity_name))
+        std::lock_guard lock(cache.mutex);
+        auto map = std::make_shared<EntityMap>(*cache.map.load());
+
+        if (!map->contains(old_entity_name))
             throw MantisException(404, "Cannot update, schema not found for entity " + old_entity_name);
 
-        // Clean up old entity, then insert the new one, all under a single
-        // exclusive lock so readers never observe the intermediate state.
-        removeSchemaCacheLocked(old_entity_name);
-        addSchemaCacheLocked(new_schema);
+        // Swap the old entity for the new one in a copy, published in one
+        // store so readers never observe the intermediate state.
+        removeSchemaCacheLocked(*map, old_entity_name);
+        std::vector changed{old_entity_name};
+        if (entity->name() != old_entity_name) changed.push_back(entity->name());
+        addSchemaCacheLocked(*map, std::move(entity));
+        publishEntities(cache, std::move(map), changed);
+
+        // Cached statements may carry the old column layout (or table name)
+        mApp.db().invalidateStatements(old_entity_name);
+        if (const auto new_name = new_schema.at("name").get<std::string>(); new_name != old_entity_name)
+            mApp.db().invalidateStatements(new_name);
+
+        // ... and cached users their old fields
+        Auth::userCache().invalidateEntity(old_entity_name);
+        Entity::countCache().invalidateEntity(old_entity_name);
+        Entity::recordCache().invalidateEntity(old_entity_name);
+        Entity::vectorIndexes().invalidateEntity(old_entity_name);
+
+        // The response cache, index advisor and views only serve the application's own entities
+        if (Tenants::current()) return;
+        m_responseCache->invalidateEntity(old_entity_name);
+        mApp.indexAdvisor().forget(old_entity_name);
+        if (new_schema.at("name").get<std::string>() != old_entity_name)
+            mApp.materializedViews().untrack(old_entity_name);
     }
 
     void Router::removeSchemaCache(const std::string &entity_name) const {
-        std::unique_lock lock(m_entityMapMutex);
-        removeSchemaCacheLocked(entity_name);
+        auto &cache = entityCache();
+        std::lock_guard lock(cache.mutex);
+        auto map = std::make_shared<EntityMap>(*cache.map.load());
+        removeSchemaCacheLocked(*map, entity_name);
+        publishEntities(cache, std::move(map), {entity_name});
+
+        mApp.db().invalidateStatements(entity_name);
+        Auth::userCache().invalidateEntity(entity_name);
+        Entity::countCache().invalidateEntity(entity_name);
+        Entity::recordCache().invalidateEntity(entity_name);
+        Entity::vectorIndexes().invalidateEntity(entity_name);
+
+        if (Tenants::current()) return;
+        m_responseCache->invalidateEntity(entity_name);
+        mApp.indexAdvisor().forget(entity_name);
+        mApp.materializedViews().untrack(entity_name);
+    }
+
+    void Router::reloadSchemaCache() {
+        std::vector<json> schemas;
+        {
+            const auto sql = mApp.db().session();
+            const soci::rowset<std::string> rows = (sql->prepare << "SELECT schema FROM mb_tables");
+            for (const auto &text: rows) schemas.push_back(json::parse(text));
+        }
+
+        std::unordered_set<std::string> names;
+        for (const auto &schema: schemas) {
+            const auto name = schema.at("name").get<std::string>();
+            names.insert(name);
+            if (hasSchemaCache(name)) updateSchemaCache(name, schema);
+            else addSchemaCache(schema);
+        }
+
+        // mb_admins and mb_service_acc are built in init(), not read from mb_tables
+        std::vector<std::string> dropped;
+        for (const auto &[name, entity]: *entityCache().map.load())
+            if (!names.contains(name) && !entity->schema().value("system", false)) dropped.push_back(name);
+        for (const auto &name: dropped) removeSchemaCache(name);
+    }
+
+    std::shared_ptr<const Router::EntityCache::Listing> Router::schemaListing(const MantisBase &app) const {
+        auto &cache = entityCache();
+        const auto version = cache.version.load();
+        if (auto listing = cache.listing.load(); listing && listing->version == version) return listing;
+
+        // Read at `version` or later, so a change landing meanwhile only makes the next call read again
+        auto listing = std::make_shared<EntityCache::Listing>();
+        listing->version = version;
+        listing->body = json{
+            {"data", EntitySchema::listTables(app)},
+            {"error", ""},
+            {"status", 200}
+        }.dump();
+        listing->etag = ResponseCache::etag(listing->body);
+        cache.listing.store(listing);
+        return listing;
+    }
+
+    void Router::publishEntities(EntityCache &cache, std::shared_ptr<const EntityMap> map,
+                                 const std::vector<std::string> &changed) const {
+        cache.publish(std::move(map));
+        // Tenants' schemas aren't the application's admins' to watch
+        if (&cache != &m_entities || !m_running.load()) return;
+        Channels::instance().announce(Channels::SCHEMAS, {
+                                          {"type", "schema_changed"},
+                                          {"version", cache.version.load()},
+                                          {"entities", changed}
+                                      });
     }
 
-    void Router::addSchemaCacheLocked(const nlohmann::json &entity_schema) const {
-        auto entity_name = entity_schema.at("name").get<std::string>();
-        if (m_entityMap.contains(entity_name)) {
+    void Router::addSchemaCacheLocked(EntityMap &map, std::shared_ptr<const Entity> entity) const {
+        auto entity_name = entity->name();
+        if (map.contains(entity_name)) {
             throw MantisException(500, "An entity exists with given entity_name");
         }
 
-        // Create entity and cache it, bound to this application. Unified entity
-        // routes resolve entities dynamically.
-        // auto entity = Entity(mApp, entity_schema);
-        m_entityMap.try_emplace(entity_name, Entity(mApp, entity_schema));
+        // Cache the entity, bound to this application. Unified entity routes
+        // resolve entities dynamically.
+        const auto [it, _] = map.try_emplace(entity_name, std::move(entity));
+        // A tenant's own caches hear its writes directly, see RealtimeDB::publish()
+        if (Tenants::current()) return;
+        pinForCaches(*it->second);
+        mApp.materializedViews().track(it->second->schema());
     }
 
-    void Router::removeSchemaCacheLocked(const std::string &entity_name) const {
-        if (!m_entityMap.contains(entity_name)) {
+    void Router::pinForCaches(const Entity &entity) const {
+        // Node-wide caches that aren't bounded by a short TTL have to hear
+        // every change to their entities, subscribers or not
+        const bool has_vectors = std::ranges::any_of(entity.fields(), [](const json &f) {
+            return f.value("type", "") == "vector";
+        });
+        if (entity.type() == "auth" || has_vectors || m_responseCache->enabledFor(entity.name()) ||
+            Entity::recordCache().enabledFor(entity.name()))
+            mApp.rt().pin(entity.name());
+    }
+
+    void Router::removeSchemaCacheLocked(EntityMap &map, const std::string &entity_name) {
+        if (!map.contains(entity_name)) {
             throw MantisException(404, "Could not find EntitySchema for " + entity_name);
         }
 
-        m_entityMap.erase(entity_name);
+        map.erase(entity_name);
     }
 
     void Router::registerAuthRoutes() {
         const Middlewares authEntityMiddleware = {resolveAuthEntity()};
-        const Middlewares authLoginMiddleware = {resolveAuthEntity(), rateLimit(5, 60, false)};
+        const Middlewares authLoginMiddleware = {resolveAuthEntity(), rateLimit(5, 60, false, "auth-login")};
 
-        Post("/api/v1/auth/:entity_name/login", handleAuthLogin(), authLoginMiddleware);
-        Post("/api/v1/auth/:entity_name/refresh", handleAuthRefresh(), authEntityMiddleware);
-        Post("/api/v1/auth/:entity_name/logout", handleAuthLogout(), authEntityMiddleware);
+        Post("/api/v1/auth/:entity_name/login", handleAuthLogin(), authLoginMiddleware, RouteExec::DbWorker);
+        Post("/api/v1/auth/:entity_name/refresh", handleAuthRefresh(), authEntityMiddleware, RouteExec::DbWorker);
+        Post("/api/v1/auth/:entity_name/logout", handleAuthLogout(), authEntityMiddleware, RouteExec::DbWorker);
+
+        // What third parties need to check our tokens themselves
+        Get("/.well-known/jwks.json", handleJwks(), {noAuthContext()});
+        Get("/api/v1/auth/jwks", handleJwks(), {noAuthContext()});
+        Get("/api/v1/auth/revocations", handleRevocations(), {noAuthContext()});
     }
 
     void Router::registerSchemaRoutes() {
@@ -272,130 +866,253 @@ namespace mb {
         Get("/api/v1/schemas/:schema_name_or_id", schemaGetOneHandler(), schemaItemMiddleware);
         Patch("/api/v1/schemas/:schema_name_or_id", schemaPatchHandler(), schemaItemMiddleware);
         Delete("/api/v1/schemas/:schema_name_or_id", schemaDeleteHandler(), schemaItemMiddleware);
+        Get("/api/v1/schemas/:schema_name_or_id/migration", schemaMigrationGetHandler(), schemaItemMiddleware);
+        Delete("/api/v1/schemas/:schema_name_or_id/migration", schemaMigrationDeleteHandler(), schemaItemMiddleware);
+        Post("/api/v1/schemas/:schema_name_or_id/refresh", schemaRefreshHandler(), schemaItemMiddleware,
+             RouteExec::DbWorker);
     }
 
     void Router::registerEntityRoutes() {
         const Middlewares readMiddleware = {resolveEntity(), hasEntityAccess()};
         const Middlewares mutateMiddleware = {resolveEntity(), rejectViewMutations(), hasEntityAccess()};
-
-        Get("/api/v1/entities/:entity_name", entityGetManyHandler(), readMiddleware);
-        Get("/api/v1/entities/:entity_name/:id", entityGetOneHandler(), readMiddleware);
-        Post("/api/v1/entities/:entity_name", entityPostHandler(), mutateMiddleware);
-        Patch("/api/v1/entities/:entity_name/:id", entityPatchHandler(), mutateMiddleware);
-        Delete("/api/v1/entities/:entity_name/:id", entityDeleteHandler(), mutateMiddleware);
+        const Middlewares batchMiddleware = {resolveEntity(), rejectViewMutations(), hasBatchAccess()};
+
+        Get("/api/v1/entities/:entity_name", entityGetManyHandler(), readMiddleware, RouteExec::DbWorker);
+        // Ahead of `/:id`: drogon takes the first pattern that matches
+        Get("/api/v1/entities/:entity_name/export", entityExportHandler(), readMiddleware, RouteExec::DbWorker);
+        Get("/api/v1/entities/:entity_name/aggregate", entityAggregateHandler(), readMiddleware, RouteExec::DbWorker);
+        Get("/api/v1/entities/:entity_name/:id", entityGetOneHandler(), readMiddleware, RouteExec::DbWorker);
+        Get("/api/v1/entities/:entity_name/:id/blobs/:field", entityBlobGetHandler(), readMiddleware,
+            RouteExec::DbWorker);
+        Post("/api/v1/entities/:entity_name", entityPostHandler(), mutateMiddleware, RouteExec::DbWorker);
+        Post("/api/v1/entities/:entity_name/batch", entityBatchHandler(), batchMiddleware, RouteExec::DbWorker);
+        Post("/api/v1/entities/:entity_name/import", entityImportHandler(), batchMiddleware, RouteExec::DbWorker);
+        Patch("/api/v1/entities/:entity_name/:id", entityPatchHandler(), mutateMiddleware, RouteExec::DbWorker);
+        Patch("/api/v1/entities/:entity_name/:id/blobs/:field", entityBlobPatchHandler(), mutateMiddleware,
+              RouteExec::DbWorker);
+        Delete("/api/v1/entities/:entity_name/:id", entityDeleteHandler(), mutateMiddleware, RouteExec::DbWorker);
+        // Ops name their entities; each passes its own rule in the handler
+        Post("/api/v1/transaction", entityTransactionHandler(), {}, RouteExec::DbWorker);
+        // Reads across entities in one request: auth resolved once, each read on its own DB worker
+        PostAsync("/api/v1/batch", entityBatchReadHandler());
     }
 
     void Router::generateMiscEndpoints() {
         auto &router = mApp.router();
 
-        // Admin dashboard route - use Drogon regex handler
-        auto adminHandler = handleAdminDashboardRoute();
+        // Replicas only read; their rows change through the primary. Added
+        // before any route composes its chain
+        if (m_replication->options().follower() && mApp.dbType() == "sqlite3")
+            m_preRoutingMiddlewares.push_back(replicaReadOnly(m_replication->options().primary));
+
+        // Admin dashboard route - use Drogon regex handler. The bundle is indexed
+        // here, once, so a request is a lookup into prepared responses
+        m_adminAssets = std::make_unique<AdminAssets>(&Router::getMimeType);
         drogon::app().registerHandlerViaRegex(
             R"(/mb(/.*)?)",
-            [adminHandler, this](const drogon::HttpRequestPtr &req,
-                                 std::function<void(const drogon::HttpResponsePtr &)> &&callback) {
-                MantisRequest ma_req{mApp, req};
-                MantisResponse ma_res{};
-                adminHandler(ma_req, ma_res);
-                callback(ma_res.drogonResponse());
+            [assets = m_adminAssets.get()](const drogon::HttpRequestPtr &req,
+                                           std::function<void(const drogon::HttpResponsePtr &)> &&callback) {
+                callback(assets->respond(req));
             },
             {drogon::Get});
 
-        router.Get("/api/v1/health", healthCheckHandler());
+        router.Get("/api/v1/health", healthCheckHandler(), {noAuthContext()});
+        // Served from the probe's last round, so polling it never reaches the database
+        router.Get("/api/v1/health/ready", readinessHandler(), {noAuthContext()});
+
+        // Prometheus scrape target; MB_METRICS_PUBLIC=1 lets scrapers in without an admin token
+        router.Get("/api/v1/metrics", handleMetrics(),
+                   getEnvOrDefault("MB_METRICS_PUBLIC", "0") == "1" ? Middlewares{} : Middlewares{requireAdminAuth()},
+                   RouteExec::DbWorker);
 
         // /api/v1/sys/*
         router.Get("/api/v1/sys/logs", handleLogs(), {requireAdminAuth()});
-        router.Post("/api/v1/sys/admins/login", handleAdminLogin(), {rateLimit(5, 60, false)});
-        router.Post("/api/v1/sys/admins/refresh", handleAuthRefresh());
-        router.Post("/api/v1/sys/admins/logout", handleAuthLogout());
-        router.Post("/api/v1/sys/admins/setup", handleSetupAdmin(), {rateLimit(3, 3600, false)});
+        router.Post("/api/v1/sys/admins/login", handleAdminLogin(), {rateLimit(5, 60, false, "admin-login")}, RouteExec::DbWorker);
+        router.Post("/api/v1/sys/admins/refresh", handleAuthRefresh(), {}, RouteExec::DbWorker);
+        router.Post("/api/v1/sys/admins/logout", handleAuthLogout(), {}, RouteExec::DbWorker);
+        router.Post("/api/v1/sys/admins/setup", handleSetupAdmin(), {rateLimit(3, 3600, false, "admin-setup")}, RouteExec::DbWorker);
+        router.Get("/api/v1/sys/sessions", [](const MantisRequest &req, const MantisResponse &res) {
+            try {
+                json filters = json::object();
+                for (const auto *key: {"entity_name", "user_id"}) {
+                    if (req.hasQueryParam(key)) filters[key] = req.getQueryParamValue(key);
+                }
+                res.sendJSON(200, {{"data", Auth::listSessions(KeysetPage::fromQuery(req), filters)},
+                                   {"status", 200}, {"error", nullptr}});
+            } catch (const MantisException &e) {
+                res.sendJSON(e.code(), {{"data", json::object()}, {"status", e.code()}, {"error", e.what()}});
+            } catch (const std::exception &e) {
+                res.sendJSON(500, {{"data", json::object()}, {"status", 500}, {"error", e.what()}});
+            }
+        }, {requireAdminAuth()}, RouteExec::DbWorker);
+        router.Get("/api/v1/sys/database", [this](const MantisRequest &, const MantisResponse &res) {
+            auto data = mApp.db().metrics();
+            if (const auto &tenants = mApp.tenants(); tenants.enabled()) {
+                const auto stats = tenants.stats();
+                data["tenants"] = {{"open", stats.open}, {"opened", stats.opened}, {"evicted", stats.evicted}};
+            }
+            res.sendJSON(200, {{"data", data}, {"status", 200}, {"error", nullptr}});
+        }, {requireAdminAuth()});
+        // Scripts and settings again, keeping connections, sessions and caches
+        router.Post("/api/v1/sys/reload", handleReload(), {requireAdminAuth()}, RouteExec::DbWorker);
+        router.Get("/api/v1/sys/indexes", [this](const MantisRequest &, const MantisResponse &res) {
+            res.sendJSON(200, {{"data", mApp.indexAdvisor().suggestions()}, {"status", 200}, {"error", nullptr}});
+        }, {requireAdminAuth()});
+        router.Get("/api/v1/sys/slow-queries", [this](const MantisRequest &req, const MantisResponse &res) {
+            try {
+                const auto limit = req.hasQueryParam("limit") ? safe_stoi(req.getQueryParamValue("limit"), 50) : 50;
+                const auto since = req.hasQueryParam("since")
+                                       ? std::max(0, safe_stoi(req.getQueryParamValue("since"), 0))
+                                       : 0;
+                json data = {
+                    {"threshold_ms", mApp.slowQueryLog().options().threshold.count()},
+                    {"dropped", mApp.slowQueryLog().dropped()},
+                    {"items", mApp.logs().logsDb().slowQueries(limit, since)}
+                };
+                res.sendJSON(200, {{"data", data}, {"status", 200}, {"error", nullptr}});
+            } catch (const MantisException &e) {
+                res.sendJSON(e.code(), {{"data", json::object()}, {"status", e.code()}, {"error", e.what()}});
+            }
+        }, {requireAdminAuth()}, RouteExec::DbWorker);
+        // Charts for the logs dashboard, read from the per-minute rollups rather than the logs
+        router.Get("/api/v1/sys/logs/rollups", [this](const MantisRequest &req, const MantisResponse &res) {
+            try {
+                if (!Logger::isDbInitialized)
+                    throw MantisException(503, "Log database not initialized");
+
+                const auto number = [&req](const std::string &key, const long long fallback) {
+                    if (!req.hasQueryParam(key)) return fallback;
+                    try {
+                        return std::stoll(req.getQueryParamValue(key));
+                    } catch (const std::exception &) {
+                        throw MantisException(400, std::format("`{}` must be a number.", key));
+                    }
+                };
+                const auto now = static_cast<long long>(std::time(nullptr));
+                const auto by = req.hasQueryParam("by") ? req.getQueryParamValue("by") : std::string("level");
+                const auto until = number("until", now - now % 60 + 60);
+                const auto since = number("since", until - 3600);
+                const auto bucket = number("bucket", 60);
+                const auto level = req.hasQueryParam("level") ? req.getQueryParamValue("level") : std::string{};
+
+                // `critical` entries per minute over the window that raise an alert; 0 for none
+                static const auto alert_window = std::max(60, safe_stoi(getEnvOrDefault("MB_LOG_ALERT_WINDOW_SECS", ""), 300));
+                static const auto alert_rate = std::max(0, safe_stoi(getEnvOrDefault("MB_LOG_ALERT_PER_MIN", ""), 5));
+
+                auto &logs = mApp.logs().logsDb();
+                json data = {
+                    {"by", by}, {"bucket", bucket}, {"since", since}, {"until", until},
+                    {"items", logs.rollups(by, since, until, bucket, level)},
+                    {"alerts", alert_rate > 0 ? logs.alerts(alert_window, alert_rate) : json::array()}
+                };
+                res.sendJSON(200, {{"data", data}, {"status", 200}, {"error", nullptr}});
+            } catch (const MantisException &e) {
+                res.sendJSON(e.code(), {{"data", json::object()}, {"status", e.code()}, {"error", e.what()}});
+            }
+        }, {requireAdminAuth()}, RouteExec::DbWorker);
+        // Blocks a database worker while it samples, and runs ahead of queued requests there
+        router.Get("/api/v1/debug/profile", [](const MantisRequest &req, const MantisResponse &res) {
+            try {
+                const auto seconds = std::clamp(req.hasQueryParam("seconds")
+                                                    ? safe_stoi(req.getQueryParamValue("seconds"), 30)
+                                                    : 30, 1, 120);
+                const auto hz = req.hasQueryParam("hz") ? safe_stoi(req.getQueryParamValue("hz"), 100) : 100;
+                const auto profile = Profiler::collect(std::chrono::seconds(seconds), hz);
+                if (req.getQueryParamValue("format") == "json") {
+                    res.sendJSON(200, {{"data", Profiler::summary(profile)}, {"status", 200}, {"error", nullptr}});
+                    return;
+                }
+                res.setHeader("Content-Disposition", "attachment; filename=\"mantisbase.prof\"");
+                res.send(200, Profiler::toPprof(profile), "application/octet-stream");
+            } catch (const MantisException &e) {
+                res.sendJSON(e.code(), {{"data", json::object()}, {"status", e.code()}, {"error", e.what()}});
+            }
+        }, {requireAdminAuth()}, RouteExec::DbWorker);
+        router.Get("/api/v1/debug/heap", [this](const MantisRequest &, const MantisResponse &res) {
+            auto queues = m_sseMgr->queueStats();
+            json subsystems = {
+                {"entity_cache", {{"entries", Entity::recordCache().size()}, {"bytes", Entity::recordCache().bytes()}}},
+                {"response_cache", {{"entries", m_responseCache->size()}, {"bytes", m_responseCache->bytes()}}},
+                {"sessions", {{"entries", Auth::sessionCache().size()}}},
+                {"realtime_queues", {{"sse", queues["sse"]}, {"ws", queues["ws"]}}},
+                {"log_buffer", Logger::isDbInitialized ? mApp.logs().logsDb().stats() : json::object()}
+            };
+            res.sendJSON(200, {{"data", {{"process", Profiler::allocatorStats()}, {"subsystems", subsystems}}},
+                               {"status", 200}, {"error", nullptr}});
+        }, {requireAdminAuth()});
+        router.Get("/api/v1/sys/settings/sqlite", handleGetSqliteProfile(), {requireAdminAuth()});
+        if (mApp.dbType() == "sqlite3")
+            m_backup = std::make_unique<Backup>(mApp.dataDir(), Backup::rootFromEnv(mApp.dataDir()),
+                                                Backup::Options::fromEnv());
+        router.Get("/api/v1/sys/backup", [this](const MantisRequest &, const MantisResponse &res) {
+            if (!m_backup) {
+                res.sendJSON(400, {{"data", json::object()}, {"status", 400},
+                                   {"error", "Backups are only supported on SQLite; use pg_dump for PostgreSQL"}});
+                return;
+            }
+            res.sendJSON(200, {{"data", m_backup->status()}, {"status", 200}, {"error", nullptr}});
+        }, {requireAdminAuth()});
+        router.Post("/api/v1/sys/backup", [this](const MantisRequest &req, const MantisResponse &res) {
+            if (!m_backup) {
+                res.sendJSON(400, {{"data", json::object()}, {"status", 400},
+                                   {"error", "Backups are only supported on SQLite; use pg_dump for PostgreSQL"}});
+                return;
+            }
+            // An empty body backs up the databases only
+            const auto &[body, err] = req.getBodyAsJson();
+            const bool files = err.empty() && body.is_object() && body.value("files", json(false)) == true;
+            if (!m_backup->start(files)) {
+                res.sendJSON(409, {{"data", m_backup->status()}, {"status", 409},
+                                   {"error", "A backup is already running"}});
+                return;
+            }
+            res.sendJSON(202, {{"data", m_backup->status()}, {"status", 202}, {"error", nullptr}});
+        }, {requireAdminAuth()});
+        router.Patch("/api/v1/sys/settings/sqlite", handlePatchSqliteProfile(), {requireAdminAuth()},
+                     RouteExec::DbWorker);
 
         // /api/v1/auth/<entity>/*
         registerAuthRoutes();
 
         // /api/v1/files/*
-        router.Get("/api/v1/files/:entity/:file", fileServingHandler());
-
-        router.Get("/api/v1/sys/settings/config", [](const MantisRequest &, const MantisResponse &res) {
-            res.sendJSON(200, {{"data", {}}, {"status", 200}, {"error", nullptr}});
-        });
-
-        router.Post("/api/v1/sys/settings/config", [](const MantisRequest &, const MantisResponse &res) {
-            res.sendJSON(200, {{"data", {}}, {"status", 200}, {"error", nullptr}});
+        // Worker pool: hashing a file or waiting on a thumbnail blocks. Left
+        // uncompressed so ETags and byte ranges keep meaning the stored bytes
+        router.Get("/api/v1/files/:entity/:file", fileServingHandler(), {noCompression()}, RouteExec::DbWorker);
+
+        // /api/v1/sys/settings/config, served from the settings snapshot
+        if (!mApp.settings().setupRoutes())
+            throw MantisException(500, "Failed to set up the settings routes");
+        // Uploads are capped by the `maxFileSize` setting, below MB_MAX_FILE_SIZE
+        mApp.settings().subscribe([this](const KeyValStore::Snapshot &settings) {
+            const auto mib = settings.values.value("maxFileSize", 0LL);
+            m_maxFileSetting = mib > 0 ? static_cast<std::size_t>(mib) * 1024 * 1024 : 0;
         });
 
-        router.Patch("/api/v1/sys/settings/config", [](const MantisRequest &, const MantisResponse &res) {
-            res.sendJSON(200, {{"data", {}}, {"status", 200}, {"error", nullptr}});
-        });
-
-
         m_sseMgr->createRoutes();
 
         registerSchemaRoutes();
         registerEntityRoutes();
         registerAdminEntityRoutes();
         registerApiKeyRoutes();
+        registerKvRoutes();
+        registerWebhookRoutes();
         registerOAuthRoutes();
+        registerReplicationRoutes();
+        registerSyncRoutes();
 
         // Static file serving: register a catch-all for the public directory
         const auto publicDir = mApp.publicDir();
         if (fs::exists(publicDir)) {
             drogon::app().setDocumentRoot(publicDir);
+            // Read into memory once; what doesn't fit the budget is still served from the document root
+            if (m_staticCache->enabled()) m_staticCache->load(publicDir);
         }
     }
 
-    std::function<void(const MantisRequest &, MantisResponse &)> Router::handleAdminDashboardRoute() {
-        return [](const MantisRequest &req, MantisResponse &res) {
-            try {
-                const auto fs = cmrc::mantis::get_filesystem();
-
-                // Extract path after /mb
-                std::string full_path = req.getPath();
-                std::string path;
-                if (full_path.size() > 3) {
-                    path = full_path.substr(3); // strip "/mb"
-                }
-
-                // Normalize the path
-                if (path.empty() || path == "/") {
-                    path = "/public/index.html";
-                } else {
-                    path = std::format("/public{}", path);
-                }
-
-                if (!fs.exists(path)) {
-                    LogOrigin::trace("Path Missing", fmt::format("{} path does not exists", path));
-
-                    // fallback to index.html for React routes
-                    path = "/public/index.html";
-                }
-
-                try {
-                    const auto file = fs.open(path);
-                    const auto mime = Router::getMimeType(path);
-                    res.setContent(file.begin(), file.size(), mime);
-                    res.setStatus(200);
-                } catch (const std::exception &e) {
-                    const auto file = fs.open("/public/404.html");
-                    const auto mime = Router::getMimeType("404.html");
-
-                    res.setContent(file.begin(), file.size(), mime);
-                    res.setStatus(404);
-                    LogOrigin::critical("Admin Response Error",
-                                        fmt::format("Error processing /admin response: {}", e.what()));
-                }
-            } catch (const std::exception &e) {
-                res.setStatus(500);
-                res.setReason(e.what());
-                LogOrigin::critical("Admin Request Error",
-                                    fmt::format("Error processing /admin request: {}", e.what()));
-            }
-        };
-    }
-
     std::function<void(const MantisRequest &, MantisResponse &)> Router::fileServingHandler() {
         LogOrigin::trace("Endpoint Registration", "Registering /api/v1/files/:entity/:file GET endpoint ...");
-        return [](const MantisRequest &req, MantisResponse &res) {
+        return [policy = FileServing::CachePolicy::fromEnv(), limits = ThumbSpec::Limits::fromEnv()](
+            const MantisRequest &req, MantisResponse &res) {
             const auto table_name = req.getPathParamValue("entity");
             const auto file_name = req.getPathParamValue("file");
 
@@ -409,7 +1126,7 @@ namespace mb {
                 return;
             }
 
-            if (table_name.empty() || file_name.empty()) {
+            if (table_name.empty() || file_name.empty() || file_name.starts_with('.')) {
                 json response;
                 response["error"] = "Both entity name and file name are required!";
                 response["status"] = 400;
@@ -419,11 +1136,84 @@ namespace mb {
                 return;
             }
 
+            // Remote storage: send the client to the object store, bytes never pass through here
+            if (auto &backend = req.mApp().storage().backend(); !backend.isLocal()) {
+                if (const auto sha256 = BlobStore::hashOf(table_name, file_name); sha256.has_value()) {
+                    if (const auto url = backend.presignGet(*sha256, file_name, Router::getMimeType(file_name))) {
+                        res.setHeader("Cache-Control", "no-store");
+                        res.setRedirect(*url, 302);
+                        return;
+                    }
+                }
+            }
+
             if (const auto path_opt = Files::getFilePath(table_name, file_name);
                 path_opt.has_value()) {
-                // Return requested file
-                res.setStatus(200);
-                res.setFileContent(path_opt.value());
+                fs::path path = path_opt.value();
+                auto sha256 = Files::contentHash(table_name, file_name);
+                auto mime_type = Router::getMimeType(path.string());
+
+                // `?thumb=WxH[&format=webp]`: serve a cached derivative instead, made on first request
+                if (req.hasQueryParam("thumb") && Thumbnailer::enabled()) {
+                    try {
+                        if (const auto spec = ThumbSpec::parse(req.getQueryParamValue("thumb"),
+                                                               req.getQueryParamValue("format"), file_name, limits)) {
+                            path = req.mApp().router().thumbnails().get(path, table_name, file_name, *spec);
+                            if (!sha256.empty()) sha256 += "-" + spec->fileName();
+                            mime_type = spec->mimeType();
+                        }
+                    } catch (const MantisException &e) {
+                        if (e.code() == 503) res.setHeader("Retry-After", "5");
+                        res.sendJSON(e.code(), {{"error", e.what()}, {"status", e.code()}, {"data", json::object()}});
+                        return;
+                    }
+                }
+
+                std::error_code ec;
+                const auto size = fs::file_size(path, ec);
+                const auto mtime = fs::last_write_time(path, ec);
+                if (ec) {
+                    res.sendJSON(500, {{"error", "Failed to read file!"}, {"status", 500}, {"data", json::object()}});
+                    return;
+                }
+
+                const auto modified = std::chrono::duration_cast<std::chrono::seconds>(
+                    std::chrono::file_clock::to_sys(mtime).time_since_epoch()).count();
+                const std::string last_modified = drogon::utils::getHttpFullDate(
+                    trantor::Date(modified * 1000000));
+
+                const auto etag = sha256.empty() ? "" : FileServing::etag(sha256);
+
+                if (!etag.empty()) res.setHeader("ETag", etag);
+                res.setHeader("Last-Modified", last_modified);
+                res.setHeader("Cache-Control", policy.forEntity(table_name));
+                res.setHeader("Accept-Ranges", "bytes");
+
+                const auto if_modified_since = req.hasHeader("If-Modified-Since")
+                    ? drogon::utils::getHttpDate(req.getHeaderValue("If-Modified-Since"))
+                    : trantor::Date(std::numeric_limits<int64_t>::max());
+                const auto ims = if_modified_since.microSecondsSinceEpoch() == std::numeric_limits<int64_t>::max()
+                    ? -1 : if_modified_since.secondsSinceEpoch();
+                if (FileServing::isNotModified(req.getHeaderValue("If-None-Match"), ims, etag, modified)) {
+                    res.sendEmpty(304);
+                    return;
+                }
+
+                auto range = FileServing::Range{FileServing::Range::Full, 0, size};
+                if (req.hasHeader("Range") &&
+                    FileServing::ifRangeAllows(req.getHeaderValue("If-Range"), etag, last_modified)) {
+                    range = FileServing::parseRange(req.getHeaderValue("Range"), size);
+                }
+
+                if (range.kind == FileServing::Range::Unsatisfiable) {
+                    res.setHeader("Content-Range", std::format("bytes */{}", size));
+                    res.sendEmpty(416);
+                    return;
+                }
+
+                // Streamed from disk, sendfile() for the larger ones
+                const auto partial = range.kind == FileServing::Range::Partial;
+                res.sendFile(path.string(), range.offset, partial ? range.length : 0, mime_type, partial);
                 return;
             }
 
@@ -437,9 +1227,143 @@ namespace mb {
     }
 
     std::function<void(const MantisRequest &, MantisResponse &)> Router::healthCheckHandler() {
+        return [](const MantisRequest &req, const MantisResponse &res) {
+            res.setHeader("Cache-Control", "no-cache");
+            // Up, but not ready for traffic until the pooled connections are warm
+            if (!req.mApp().router().warmup().ready()) {
+                res.setHeader("Retry-After", "1");
+                res.send(503, R"({"status": "WARMING"})", "application/json");
+                return;
+            }
+            const auto &leader = req.mApp().router().leader();
+            if (!leader.options().enabled) {
+                res.send(200, R"({"status": "OK"})", "application/json");
+                return;
+            }
+            res.send(200, json{{"status", "OK"}, {"cluster", leader.status()}}.dump(), "application/json");
+        };
+    }
+
+    std::function<void(const MantisRequest &, MantisResponse &)> Router::readinessHandler() {
+        return [](const MantisRequest &req, const MantisResponse &res) {
+            res.setHeader("Cache-Control", "no-cache");
+            if (!req.mApp().router().warmup().ready()) {
+                res.setHeader("Retry-After", "1");
+                res.send(503, R"({"status": "WARMING"})", "application/json");
+                return;
+            }
+            const auto report = req.mApp().router().readiness().report();
+            if (report->status != 200) res.setHeader("Retry-After", "1");
+            res.send(report->status, report->body, "application/json");
+        };
+    }
+
+    std::function<void(const MantisRequest &, MantisResponse &)> Router::handleJwks() {
         return [](const MantisRequest &, const MantisResponse &res) {
+            // A JWK Set as RFC 7517 has it, not our envelope; rotated keys stay listed
+            res.setHeader("Cache-Control", "public, max-age=300");
+            res.send(200, Auth::tokenVerifier().jwks(TokenVerifier::Config::current()).dump(), "application/json");
+        };
+    }
+
+    std::function<void(const MantisRequest &, MantisResponse &)> Router::handleRevocations() {
+        return [](const MantisRequest &req, const MantisResponse &res) {
+            auto filter = Auth::revocations().toJSON();
+            const auto etag = fmt::format("\"{}\"", filter["version"].get<std::uint64_t>());
+
             res.setHeader("Cache-Control", "no-cache");
-            res.send(200, R"({"status": "OK"})", "application/json");
+            res.setHeader("ETag", etag);
+            if (req.getHeaderValue("If-None-Match") == etag) {
+                res.sendEmpty(304);
+                return;
+            }
+            res.sendJSON(200, {{"data", std::move(filter)}, {"status", 200}, {"error", nullptr}});
+        };
+    }
+
+    std::function<void(const MantisRequest &, MantisResponse &)> Router::handleMetrics() {
+        return [](const MantisRequest &req, const MantisResponse &res) {
+            const auto &app = req.mApp();
+            MetricsWriter out;
+            app.router().metrics().writeRequests(out);
+
+            const auto pool = app.db().poolStats();
+            std::array<double, PoolMetrics::WAIT_BUCKETS.size()> wait_bounds{};
+            for (std::size_t i = 0; i < wait_bounds.size(); ++i)
+                wait_bounds[i] = std::chrono::duration<double>(PoolMetrics::WAIT_BUCKETS[i]).count();
+            out.family("mb_db_pool_wait_seconds", "Time spent waiting for a database connection", "histogram");
+            out.histogram("mb_db_pool_wait_seconds", {}, wait_bounds, pool.waitBuckets, pool.totalWaitMs / 1000.0);
+            out.family("mb_db_pool_in_use", "Database connections leased right now", "gauge");
+            out.sample("mb_db_pool_in_use", {}, static_cast<double>(pool.inUse));
+            out.family("mb_db_pool_timeouts_total", "Connection leases given up after the acquire timeout", "counter");
+            out.sample("mb_db_pool_timeouts_total", {}, static_cast<double>(pool.timeouts));
+
+            const auto statements = app.db().statementCacheStats();
+            out.family("mb_db_statement_cache_total", "Prepared statement cache lookups", "counter");
+            out.sample("mb_db_statement_cache_total", {{"result", "hit"}}, static_cast<double>(statements.hits));
+            out.sample("mb_db_statement_cache_total", {{"result", "miss"}}, static_cast<double>(statements.misses));
+            out.family("mb_db_statement_cache_size", "Prepared statements cached across all connections", "gauge");
+            out.sample("mb_db_statement_cache_size", {}, static_cast<double>(statements.size));
+            if (app.dbType() == "postgresql") PgPipeline::writeMetrics(out);
+            if (app.dbType() == "sqlite3" && FieldCompression::available()) FieldCompression::writeMetrics(out);
+            EntityArchive::writeMetrics(out);
+
+            const auto queues = app.router().sseMgr().queueStats();
+            out.family("mb_realtime_sessions", "Open realtime sessions", "gauge");
+            out.family("mb_realtime_queued", "Events waiting in realtime send queues", "gauge");
+            out.family("mb_realtime_queue_max_depth", "Deepest realtime send queue", "gauge");
+            out.family("mb_realtime_dropped_total", "Events dropped by full realtime send queues", "counter");
+            for (const auto transport: {"sse", "ws"}) {
+                const auto &q = queues[transport];
+                out.sample("mb_realtime_sessions", {{"transport", transport}}, q.value("subscribers", 0.0));
+                out.sample("mb_realtime_queued", {{"transport", transport}}, q.value("queued", 0.0));
+                out.sample("mb_realtime_queue_max_depth", {{"transport", transport}}, q.value("max_depth", 0.0));
+                out.sample("mb_realtime_dropped_total", {{"transport", transport}}, q.value("dropped", 0.0));
+            }
+            if (const auto &limits = app.router().sseMgr().limits(); limits.options().enabled())
+                limits.writeMetrics(out);
+
+            // Worker lag: change log rows written but not yet delivered to subscribers
+            if (const auto delivered = app.rt().deliveredChangeId(); delivered >= 0) {
+                try {
+                    long long newest = 0;
+                    const auto sql = app.db().session();
+                    *sql << "SELECT COALESCE(MAX(id), 0) FROM mb_change_log", soci::into(newest);
+                    out.family("mb_realtime_worker_lag", "mb_change_log rows not yet delivered", "gauge");
+                    out.sample("mb_realtime_worker_lag", {},
+                               static_cast<double>(std::max<long long>(0, newest - delivered)));
+                } catch (const std::exception &e) {
+                    LogOrigin::warn("Metrics", std::format("Could not read mb_change_log: {}", e.what()));
+                }
+            }
+
+            if (Logger::isDbInitialized) {
+                const auto logs = app.logs().logsDb().stats();
+                out.family("mb_log_queue_depth", "Log entries waiting to be written", "gauge");
+                out.sample("mb_log_queue_depth", {}, logs.value("queued", 0.0));
+                out.family("mb_log_dropped_total", "Log entries lost to a full queue", "counter");
+                out.sample("mb_log_dropped_total", {}, logs.value("dropped", 0.0));
+            }
+            out.family("mb_log_console_dropped_total", "Console lines lost to a full async queue", "counter");
+            out.sample("mb_log_console_dropped_total", {}, static_cast<double>(app.logs().consoleDropped()));
+
+            app.router().metrics().writeScripts(out);
+            if (app.router().admission().enabled()) app.router().admission().writeMetrics(out);
+            app.router().drainState().writeMetrics(out);
+            if (app.router().staticCache().enabled()) app.router().staticCache().writeMetrics(out);
+            if (app.router().usageQuotas().enabled()) app.router().usageQuotas().writeMetrics(out);
+            if (app.router().fileIo().enabled()) app.router().fileIo().writeMetrics(out);
+            if (app.router().warmup().enabled()) app.router().warmup().writeMetrics(out);
+            if (app.router().leader().options().enabled) app.router().leader().writeMetrics(out);
+            if (app.router().recordHooks().isRunning()) app.router().recordHooks().writeMetrics(out);
+            if (app.router().webhooks().options().enabled) app.router().webhooks().writeMetrics(out);
+            if (app.realtimeProbe().enabled()) app.realtimeProbe().writeMetrics(out);
+            if (ThreadPlacement::instance().enabled()) ThreadPlacement::instance().writeMetrics(out);
+            if (CacheBudget::shared().enabled()) CacheBudget::shared().writeMetrics(out);
+            app.scheduler().writeMetrics(out);
+
+            res.setHeader("Cache-Control", "no-cache");
+            res.send(200, out.str(), MetricsWriter::CONTENT_TYPE);
         };
     }
 
@@ -543,6 +1467,21 @@ namespace mb {
                                              search_filter, start_date, end_date,
                                              sort_by, sort_order);
 
+                // Requests counted by the access log, including those sampled away
+                const auto access = req.mApp().router().accessLog().snapshot();
+                const auto counts = [](const AccessLog::Counts &c) {
+                    return json{
+                        {"requests", c.requests}, {"logged", c.logged}, {"sampled_out", c.sampledOut},
+                        {"rate_limited", c.rateLimited}, {"slow", c.slow},
+                        {"by_class", {
+                            {"1xx", c.byClass[0]}, {"2xx", c.byClass[1]}, {"3xx", c.byClass[2]},
+                            {"4xx", c.byClass[3]}, {"5xx", c.byClass[4]}
+                        }},
+                        {"avg_ms", c.requests ? c.totalMs / static_cast<double>(c.requests) : 0.0}
+                    };
+                };
+                result["data"]["access"] = {{"total", counts(access.total)}, {"last_minute", counts(access.lastMinute)}};
+
                 json response;
                 response["error"] = "";
                 response["status"] = 200;
@@ -551,9 +1490,9 @@ namespace mb {
             } catch (const MantisException &e) {
                 json response;
                 response["error"] = e.what();
-                response["status"] = 500;
+                response["status"] = e.code();
                 response["data"] = json::object();
-                res.sendJSON(500, response);
+                res.sendJSON(e.code(), response);
             } catch (const std::exception &e) {
                 json response;
                 response["error"] = std::string("Failed to fetch logs: ") + e.what();
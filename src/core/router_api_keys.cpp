@@ -1,9 +1,23 @@
 #include "mantisbase/core/router.h"
 #include "mantisbase/core/api_keys.h"
+#include "mantisbase/core/exceptions.h"
 #include "mantisbase/core/http.h"
+#include "mantisbase/core/keyset_page.h"
 #include "mantisbase/mantisbase.h"
 
 namespace mb {
+    namespace {
+        /// `label`, `active` and `user_id` of a key listing's query
+        json keyFilters(const MantisRequest &req) {
+            json filters = json::object();
+            for (const auto *key: {"label", "user_id"}) {
+                if (req.hasQueryParam(key)) filters[key] = req.getQueryParamValue(key);
+            }
+            if (req.hasQueryParam("active")) filters["active"] = req.getQueryParamValue("active") != "false";
+            return filters;
+        }
+    }
+
     void Router::registerApiKeyRoutes() {
         const Middlewares authEntityMiddleware = {resolveAuthEntity()};
 
@@ -51,8 +65,12 @@ namespace mb {
                 auto user_id = auth["id"].get<std::string>();
                 auto entity_name = trim(req.getPathParamValue("entity_name"));
 
-                auto keys = ApiKeyManager::list(entity_name, user_id);
+                auto filters = keyFilters(req);
+                filters.erase("user_id");
+                auto keys = ApiKeyManager::list(entity_name, user_id, KeysetPage::fromQuery(req), filters);
                 res.sendJSON(200, {{"status", 200}, {"data", keys}, {"error", ""}});
+            } catch (const MantisException &e) {
+                res.sendJSON(e.code(), {{"status", e.code()}, {"data", json::object()}, {"error", e.what()}});
             } catch (const std::exception &e) {
                 res.sendJSON(500, {{"status", 500}, {"data", json::object()}, {"error", e.what()}});
             }
@@ -107,14 +125,16 @@ namespace mb {
             }
         }, adminAuth);
 
-        Get("/api/v1/sys/api-keys", [](const MantisRequest &, const MantisResponse &res) {
+        Get("/api/v1/sys/api-keys", [](const MantisRequest &req, const MantisResponse &res) {
             try {
-                auto keys = ApiKeyManager::listAdmin();
+                auto keys = ApiKeyManager::listAdmin(KeysetPage::fromQuery(req), keyFilters(req));
                 res.sendJSON(200, {{"status", 200}, {"data", keys}, {"error", ""}});
+            } catch (const MantisException &e) {
+                res.sendJSON(e.code(), {{"status", e.code()}, {"data", json::object()}, {"error", e.what()}});
             } catch (const std::exception &e) {
                 res.sendJSON(500, {{"status", 500}, {"data", json::object()}, {"error", e.what()}});
             }
-        }, adminAuth);
+        }, adminAuth, RouteExec::DbWorker);
 
         Delete("/api/v1/sys/api-keys/:id", [](const MantisRequest &req, const MantisResponse &res) {
             try {
@@ -131,5 +151,42 @@ namespace mb {
                 res.sendJSON(500, {{"status", 500}, {"data", json::object()}, {"error", e.what()}});
             }
         }, adminAuth);
+
+        // Usage quotas: this window's counts, and limits of single keys or users
+        Get("/api/v1/sys/usage", [this](const MantisRequest &, const MantisResponse &res) {
+            res.sendJSON(200, {{"status", 200}, {"data", m_usageQuotas->usage()}, {"error", ""}});
+        }, adminAuth);
+
+        Post("/api/v1/sys/usage/limits", [this](MantisRequest &req, const MantisResponse &res) {
+            try {
+                const auto &[body, err] = req.getBodyAsJson();
+                if (!err.empty()) {
+                    res.sendJSON(400, {{"status", 400}, {"data", json::object()}, {"error", err}});
+                    return;
+                }
+
+                const auto subject = body.value("subject", "");
+                if (!subject.starts_with("key:") && !subject.starts_with("user:")) {
+                    res.sendJSON(400, {{"status", 400}, {"data", json::object()},
+                                       {"error", "`subject` must be `key:<id>` or `user:<entity>:<id>`"}});
+                    return;
+                }
+
+                // Neither given: back to the defaults
+                std::optional<UsageQuotas::Limits> limits;
+                if (body.contains("requests") || body.contains("bytes"))
+                    limits = UsageQuotas::Limits{body.value("requests", std::uint64_t{0}),
+                                                 body.value("bytes", std::uint64_t{0})};
+                m_usageQuotas->saveLimits(subject, limits);
+
+                const auto applied = m_usageQuotas->limitsOf(subject);
+                res.sendJSON(200, {{"status", 200},
+                                   {"data", {{"subject", subject}, {"requests", applied.requests},
+                                             {"bytes", applied.bytes}}},
+                                   {"error", ""}});
+            } catch (const std::exception &e) {
+                res.sendJSON(500, {{"status", 500}, {"data", json::object()}, {"error", e.what()}});
+            }
+        }, adminAuth, RouteExec::DbWorker);
     }
 } // mb
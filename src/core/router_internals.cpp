@@ -2,17 +2,27 @@
 #include "../../include/mantisbase/mantisbase.h"
 #include "../../include/mantisbase/core/http.h"
 #include "../../include/mantisbase/core/auth.h"
+#include "../../include/mantisbase/core/database.h"
+#include "../../include/mantisbase/core/middlewares.h"
+#include "../../include/mantisbase/core/password_hasher.h"
 #include "../../include/mantisbase/core/models/validators.h"
+#include "../../include/mantisbase/utils/request_id.h"
 #include "drogon/drogon_callbacks.h"
 
 namespace mb {
     const std::function<drogon::HttpResponsePtr(const drogon::HttpRequestPtr &)> Router::reqIdSyncAdvice() {
         return [this](const drogon::HttpRequestPtr &req) {
-            // Generate and store request ID in attributes
-            std::string requestId = fmt::format("req_{}", m_sfId.nextID());
-            req->attributes()->insert("request_id", requestId);
+            if (m_tracer->enabled()) {
+                // Continue the caller's trace; its id doubles as the request ID in logs
+                const auto parent = TraceContext::parse(req->getHeader("traceparent"));
+                const auto span = m_tracer->childOf(parent);
+                req->attributes()->insert("mb_trace", span);
+                req->attributes()->insert("mb_trace_parent", parent ? parent->spanId : decltype(span.spanId){});
+                req->attributes()->insert("request_id", span.traceIdHex());
+                return nullptr;
+            }
 
-            // Return nullptr to continue normal processing
+            // Without tracing the id only names the access log line, see loggerPostHandlingAdvice()
             return nullptr;
         };
     }
@@ -23,21 +33,64 @@ namespace mb {
             const auto start = req->creationDate();
             const auto end = trantor::Date::now();
             const auto duration = end.microSecondsSinceEpoch() - start.microSecondsSinceEpoch();
-            auto seconds = static_cast<double>(duration) / 1000000.0;
+            const auto status = static_cast<int>(resp->getStatusCode());
+
+            // Set by the route's handler; absent for 404s, the dashboard and CORS preflights
+            auto *series = req->attributes()->find("mb_route_series")
+                               ? req->attributes()->get<Metrics::RouteSeries *>("mb_route_series")
+                               : &m_metrics->unmatched();
+            Metrics::recordRequest(*series, status, std::chrono::microseconds(duration));
+
+            if (const auto attrs = req->attributes(); attrs->find("mb_trace")) {
+                const auto &span = attrs->get<TraceContext>("mb_trace");
+                if (span.sampled) {
+                    SpanData data;
+                    data.context = span;
+                    data.parentSpanId = attrs->get<decltype(span.spanId)>("mb_trace_parent");
+                    // Low-cardinality name: the route pattern, not the path
+                    data.name = series->method.empty() ? req->methodString() : series->method + " " + series->route;
+                    data.kind = SpanKind::Server;
+                    data.startNs = static_cast<std::uint64_t>(start.microSecondsSinceEpoch()) * 1000;
+                    data.endNs = static_cast<std::uint64_t>(end.microSecondsSinceEpoch()) * 1000;
+                    data.attributes = {
+                        {"http.request.method", req->methodString()},
+                        {"url.path", req->path()},
+                        {"http.response.status_code", std::to_string(status)},
+                        {"client.address", req->peerAddr().toIp()}
+                    };
+                    if (!series->method.empty()) data.attributes.emplace_back("http.route", series->route);
+                    data.error = status >= 500;
+                    m_tracer->record(std::move(data));
+                }
+            }
+
+            // Counted either way; only sampled requests are formatted and written
+            if (!m_accessLog->record(req->path(), status, std::chrono::microseconds(duration))) return;
+            if (!Logger::enabled(LogLevel::INFO)) return;
+
+            // The trace id when tracing, else a fresh per-thread id formatted on the stack
+            const auto generated = RequestId::next();
+            const auto attrs = req->attributes();
+            const std::string_view request_id = attrs->find("request_id")
+                                                    ? std::string_view(attrs->get<std::string>("request_id"))
+                                                    : generated.view();
 
+            auto seconds = static_cast<double>(duration) / 1000000.0;
             LogOrigin::info(
                 "HTTP",
                 fmt::format("{} {}{} {} {}s {}B {} {} {}",
                             req->methodString(),
                             req->path(),
                             req->query().empty() ? "" : "?" + req->query(),
-                            static_cast<int>(resp->getStatusCode()),
+                            status,
                             seconds,
                             resp->body().length(),
                             req->versionString(),
                             req->peerAddr().toIp(),
-                            req->attributes()->get<std::string>("request_id")
-                )
+                            request_id
+                ),
+                // The route pattern, so the log rollups count per route
+                series->method.empty() ? json() : json{{"route", series->method + " " + series->route}}
             );
         };
     }
@@ -46,33 +99,50 @@ namespace mb {
                        drogon::AdviceCallback &&,
                        drogon::AdviceChainCallback &&
     )>
-    Router::corsPreRoutingAdvice() {
-        return [](const drogon::HttpRequestPtr &req,
-                  drogon::AdviceCallback &&callback,
-                  drogon::AdviceChainCallback &&chainCallback) {
-            // Handle OPTIONS preflight
-            if (req->method() == drogon::Options) {
-                const auto resp = drogon::HttpResponse::newHttpResponse();
-                resp->setStatusCode(drogon::k204NoContent);
-                resp->addHeader("Access-Control-Allow-Origin", "*");
-                resp->addHeader("Access-Control-Allow-Methods", "GET, POST, PUT, PATCH, DELETE, OPTIONS");
-                resp->addHeader("Access-Control-Allow-Headers", "Content-Type, Authorization, X-Requested-With");
-                resp->addHeader("Access-Control-Max-Age", "86400");
-                callback(resp);
+    Router::corsPreRoutingAdvice() const {
+        return [cors = m_cors.get()](const drogon::HttpRequestPtr &req,
+                                     drogon::AdviceCallback &&callback,
+                                     drogon::AdviceChainCallback &&chainCallback) {
+            if (req->method() != drogon::Options) {
+                chainCallback();
                 return;
             }
-            chainCallback();
+
+            // Preflights are answered from responses built once per allowed origin
+            // and IO thread; pre-routing answers skip the post-handling advices, so
+            // nothing writes to them after. An origin not allowed gets one without CORS headers.
+            thread_local std::unordered_map<std::string_view, drogon::HttpResponsePtr> preflights;
+            const auto allow = cors->allowOrigin(req->getHeader("origin"));
+            auto &resp = preflights[allow];
+            if (!resp) {
+                resp = drogon::HttpResponse::newHttpResponse();
+                resp->setStatusCode(drogon::k204NoContent);
+                if (!allow.empty()) {
+                    resp->addHeader("Access-Control-Allow-Origin", std::string(allow));
+                    resp->addHeader("Access-Control-Allow-Methods", std::string(CorsPolicy::allowMethods));
+                    resp->addHeader("Access-Control-Allow-Headers", std::string(CorsPolicy::allowHeaders));
+                    resp->addHeader("Access-Control-Max-Age", cors->maxAge());
+                }
+                if (!cors->anyOrigin()) resp->addHeader("Vary", "Origin");
+            }
+            callback(resp);
         };
     }
 
     std::function<void(const drogon::HttpRequestPtr &,
                        const drogon::HttpResponsePtr &resp)>
-    Router::corsPostHandlingAdvice() {
-        return [](const drogon::HttpRequestPtr &,
-                  const drogon::HttpResponsePtr &resp) {
-            resp->addHeader("Access-Control-Allow-Origin", "*");
-            resp->addHeader("Access-Control-Allow-Methods", "GET, POST, PUT, PATCH, DELETE, OPTIONS");
-            resp->addHeader("Access-Control-Allow-Headers", "Content-Type, Authorization, X-Requested-With");
+    Router::corsPostHandlingAdvice() const {
+        // Only preflights need the allowed methods and headers
+        if (m_cors->anyOrigin()) {
+            return [](const drogon::HttpRequestPtr &, const drogon::HttpResponsePtr &resp) {
+                static const std::string any = "*";
+                resp->addHeader("Access-Control-Allow-Origin", any);
+            };
+        }
+        return [cors = m_cors.get()](const drogon::HttpRequestPtr &req, const drogon::HttpResponsePtr &resp) {
+            resp->addHeader("Vary", "Origin");
+            if (const auto allow = cors->allowOrigin(req->getHeader("origin")); !allow.empty())
+                resp->addHeader("Access-Control-Allow-Origin", std::string(allow));
         };
     }
 
@@ -85,7 +155,7 @@ namespace mb {
     }
 
     std::function<void(MantisRequest &, MantisResponse &)> Router::handleAuthLogin() {
-        return [](const MantisRequest &req, const MantisResponse &res) {
+        return [](MantisRequest &req, const MantisResponse &res) {
             try {
                 const auto &[body, err] = req.getBodyAsJson();
                 if (!err.empty()) {
@@ -109,9 +179,9 @@ namespace mb {
                 }
 
                 const auto entity_name = trim(req.getPathParamValue("entity_name"));
-                const auto entity = req.mApp().entity(entity_name);
+                const auto entity = requestEntity(req, entity_name);
 
-                auto opt_user = entity.queryFromCols(body["identity"].get<std::string>(), {"id", "email"});
+                auto opt_user = entity->queryFromCols(body["identity"].get<std::string>(), {"id", "email"});
                 if (!opt_user.has_value()) {
                     res.sendJSON(404, {
                                      {"status", 404},
@@ -152,7 +222,12 @@ namespace mb {
                     return;
                 }
 
-                auto token = Auth::createToken({{"id", user["id"]}, {"entity", entity.name()}});
+                // Stored with an outdated algorithm or cost; upgraded off this request
+                PasswordHasher::instance().rehashLater(entity->name(), user["id"].get<std::string>(),
+                                                       body["password"].get<std::string>(),
+                                                       user["password"].get<std::string>());
+
+                auto token = Auth::createToken({{"id", user["id"]}, {"entity", entity->name()}});
 
                 user.erase("password");
                 res.sendJSON(200, {
@@ -234,6 +309,10 @@ namespace mb {
                     return;
                 }
 
+                PasswordHasher::instance().rehashLater(entity.name(), user["id"].get<std::string>(),
+                                                       body["password"].get<std::string>(),
+                                                       user["password"].get<std::string>());
+
                 auto token = Auth::createToken({{"id", user["id"]}, {"entity", entity.name()}});
 
                 user.erase("password");
@@ -261,8 +340,8 @@ namespace mb {
     std::function<void(MantisRequest &, MantisResponse &)> Router::handleAuthRefresh() {
         return [](MantisRequest &req, const MantisResponse &res) {
             try {
-                auto auth = req.getOr<json>("auth", json::object());
-                auto verification = req.getOr<json>("verification", json::object());
+                auto &auth = req.auth();
+                auto &verification = req.verification();
 
                 if (!verification.contains("verified") || !verification["verified"].get<bool>()) {
                     res.sendJSON(403, {
@@ -290,8 +369,7 @@ namespace mb {
                 auto result = Auth::refreshSession(session_id, entity_name, user_id);
 
                 // Get user record
-                const auto entity = MantisBase::instance().entity(entity_name);
-                auto user_opt = entity.read(user_id);
+                auto user_opt = MantisBase::instance().entitySnapshot(entity_name)->read(user_id);
                 json user = user_opt.has_value() ? user_opt.value() : json::object();
                 user.erase("password");
 
@@ -319,7 +397,7 @@ namespace mb {
     std::function<void(MantisRequest &, MantisResponse &)> Router::handleAuthLogout() {
         return [](MantisRequest &req, const MantisResponse &res) {
             try {
-                auto verification = req.getOr<json>("verification", json::object());
+                auto &verification = req.verification();
 
                 if (!verification.contains("verified") || !verification["verified"].get<bool>()) {
                     res.sendJSON(403, {
@@ -362,10 +440,10 @@ namespace mb {
         return [](MantisRequest &req, const MantisResponse &res) {
             TRACE_MB_FUNC();
             try {
-                auto auth = req.getOr("auth", json::object());
-                LogOrigin::authTrace("Auth Data", fmt::format("Auth Data: {}", auth.dump()));
+                auto &auth = req.auth();
+                MB_LOG_TRACE(LogOrigin::authTrace, "Auth Data", fmt::format("Auth Data: {}", auth.dump()));
 
-                auto verification = req.getOr<json>("verification", json::object());
+                auto &verification = req.verification();
                 if (verification.empty()) {
                     res.sendJSON(403, {
                                      {"data", json::object()},
@@ -451,4 +529,110 @@ namespace mb {
             }
         };
     }
+
+    std::function<void(const MantisRequest &, MantisResponse &)> Router::handleGetSqliteProfile() {
+        return [](const MantisRequest &, const MantisResponse &res) {
+            json presets = json::object();
+            for (const auto &name: SqliteProfile::presetNames())
+                presets[name] = SqliteProfile::preset(name)->toJson();
+
+            res.sendJSON(200, {
+                             {"status", 200},
+                             {"data", {
+                                 {"profile", MantisBase::instance().db().sqliteProfile().toJson()},
+                                 {"presets", presets}
+                             }},
+                             {"error", ""}
+                         });
+        };
+    }
+
+    std::function<void(const MantisRequest &, MantisResponse &)> Router::handlePatchSqliteProfile() {
+        return [](const MantisRequest &req, const MantisResponse &res) {
+            try {
+                const auto &[body, err] = req.getBodyAsJson();
+                if (!err.empty()) {
+                    res.sendJSON(400, {
+                                     {"status", 400},
+                                     {"data", json::object()},
+                                     {"error", err}
+                                 });
+                    return;
+                }
+
+                // A preset name, or a `preset` plus overrides
+                const auto profile = SqliteProfile::fromJson(body);
+                auto &db = MantisBase::instance().db();
+                db.setSqliteProfile(profile);
+
+                res.sendJSON(200, {
+                                 {"status", 200},
+                                 {"data", {{"profile", profile.toJson()}}},
+                                 {"error", ""}
+                             });
+            } catch (const MantisException &e) {
+                res.sendJSON(e.code(), {
+                                 {"status", e.code()},
+                                 {"data", json::object()},
+                                 {"error", e.what()}
+                             });
+            } catch (const std::exception &e) {
+                res.sendJSON(500, {
+                                 {"status", 500},
+                                 {"data", json::object()},
+                                 {"error", e.what()}
+                             });
+            }
+        };
+    }
+
+    std::function<void(const MantisRequest &, MantisResponse &)> Router::handleReload() {
+        return [](const MantisRequest &req, const MantisResponse &res) {
+            try {
+                // Both unless the body says otherwise
+                auto body = json::object();
+                if (!req.getBody().empty()) {
+                    const auto &[parsed, err] = req.getBodyAsJson();
+                    if (!err.empty() || !parsed.is_object()) {
+                        res.sendJSON(400, {
+                                         {"status", 400},
+                                         {"data", json::object()},
+                                         {"error", err.empty() ? "Expected a JSON object" : err}
+                                     });
+                        return;
+                    }
+                    body = parsed;
+                }
+
+                auto &app = MantisBase::instance();
+                json data = {{"scripts", nullptr}, {"settings", nullptr}};
+                if (body.value("settings", true)) {
+                    const bool changed = app.settings().reload();
+                    data["settings"] = {{"version", app.settings().snapshot()->version}, {"changed", changed}};
+                }
+#ifdef MB_SCRIPTING_ENABLED
+                if (body.value("scripts", true) && app.ctx())
+                    data["scripts"] = app.reloadScripts();
+#endif
+
+                res.sendJSON(200, {
+                                 {"status", 200},
+                                 {"data", data},
+                                 {"error", ""}
+                             });
+            } catch (const MantisException &e) {
+                res.sendJSON(e.code(), {
+                                 {"status", e.code()},
+                                 {"data", json::object()},
+                                 {"error", e.what()}
+                             });
+            } catch (const std::exception &e) {
+                res.sendJSON(500, {
+                                 {"status", 500},
+                                 {"data", json::object()},
+                                 {"error", e.what()}
+                             });
+            }
+        };
+    }
 }
@@ -0,0 +1,108 @@
+#include "mantisbase/core/router.h"
+#include "mantisbase/core/app_kv.h"
+#include "mantisbase/core/exceptions.h"
+#include "mantisbase/core/http.h"
+#include "mantisbase/core/middlewares.h"
+#include "mantisbase/mantisbase.h"
+
+namespace mb {
+    namespace {
+        /// `ttl` of a request body, in seconds; absent or 0 for none
+        std::chrono::milliseconds ttlOf(const json &body) {
+            if (!body.contains("ttl") || body["ttl"].is_null()) return {};
+            if (!body["ttl"].is_number_integer() || body["ttl"].get<long long>() < 0)
+                throw MantisException(400, "`ttl` must be a whole number of seconds.");
+            return std::chrono::seconds(body["ttl"].get<long long>());
+        }
+
+        json entryJson(const std::string &key, const AppKv::Entry &entry) {
+            return {
+                {"key", key}, {"value", entry.value},
+                {"expires_at", entry.expiresAt > 0 ? json(entry.expiresAt) : json(nullptr)}
+            };
+        }
+
+        /// What `key` holds now, for the response to a change
+        json currentJson(const std::string &key) {
+            const auto entry = MantisBase::instance().kv().get(key);
+            return entry ? entryJson(key, *entry) : json{{"key", key}, {"value", nullptr}, {"expires_at", nullptr}};
+        }
+
+        /// The JSON object body of `req`, or a 400
+        const json &objectBody(const MantisRequest &req) {
+            const auto &[body, err] = req.getBodyAsJson();
+            if (!err.empty() || !body.is_object())
+                throw MantisException(400, "Could not parse request body, expected a JSON object!");
+            return body;
+        }
+
+        template<typename Fn>
+        HandlerFn kvHandler(Fn fn) {
+            return [fn](MantisRequest &req, MantisResponse &res) {
+                try {
+                    fn(req, res, req.getPathParamValue("key"));
+                } catch (const MantisException &e) {
+                    res.sendJSON(e.code(), {{"status", e.code()}, {"data", json::object()}, {"error", e.what()}});
+                } catch (const std::exception &e) {
+                    res.sendJSON(500, {{"status", 500}, {"data", json::object()}, {"error", e.what()}});
+                }
+            };
+        }
+    }
+
+    void Router::registerKvRoutes() {
+        // Served from memory, so these stay on the IO threads
+        const Middlewares adminAuth = {requireAdminAuth()};
+
+        Get("/api/v1/kv/:key", kvHandler([](MantisRequest &, MantisResponse &res, const std::string &key) {
+            const auto entry = MantisBase::instance().kv().get(key);
+            if (!entry) {
+                res.sendJSON(404, {{"status", 404}, {"data", json::object()}, {"error", "Key not found"}});
+                return;
+            }
+            res.sendJSON(200, {{"status", 200}, {"data", entryJson(key, *entry)}, {"error", ""}});
+        }), adminAuth);
+
+        // {"value": ..., "ttl": seconds}
+        Post("/api/v1/kv/:key", kvHandler([](MantisRequest &req, MantisResponse &res, const std::string &key) {
+            const auto &body = objectBody(req);
+            if (!body.contains("value")) throw MantisException(400, "Missing `value`.");
+
+            auto &kv = MantisBase::instance().kv();
+            kv.set(key, body["value"], ttlOf(body));
+            res.sendJSON(200, {{"status", 200}, {"data", currentJson(key)}, {"error", ""}});
+        }), adminAuth);
+
+        Delete("/api/v1/kv/:key", kvHandler([](MantisRequest &, MantisResponse &res, const std::string &key) {
+            if (!MantisBase::instance().kv().remove(key)) {
+                res.sendJSON(404, {{"status", 404}, {"data", json::object()}, {"error", "Key not found"}});
+                return;
+            }
+            res.sendJSON(200, {{"status", 200}, {"data", {{"deleted", true}}}, {"error", ""}});
+        }), adminAuth);
+
+        // {"by": 1, "ttl": seconds}
+        Post("/api/v1/kv/:key/incr", kvHandler([](MantisRequest &req, MantisResponse &res, const std::string &key) {
+            const auto &body = objectBody(req);
+            const auto by = body.contains("by") ? body["by"] : json(1);
+            if (!by.is_number_integer()) throw MantisException(400, "`by` must be an integer.");
+
+            const auto value = MantisBase::instance().kv().incr(key, by.get<std::int64_t>(), ttlOf(body));
+            res.sendJSON(200, {{"status", 200}, {"data", {{"key", key}, {"value", value}}}, {"error", ""}});
+        }), adminAuth);
+
+        // {"expected": ..., "value": ..., "ttl": seconds}; `expected: null` creates the key only if unset
+        Post("/api/v1/kv/:key/cas", kvHandler([](MantisRequest &req, MantisResponse &res, const std::string &key) {
+            const auto &body = objectBody(req);
+            if (!body.contains("expected") || !body.contains("value"))
+                throw MantisException(400, "Missing `expected` and/or `value`.");
+
+            auto &kv = MantisBase::instance().kv();
+            if (!kv.cas(key, body["expected"], body["value"], ttlOf(body))) {
+                res.sendJSON(409, {{"status", 409}, {"data", currentJson(key)}, {"error", "The value has changed"}});
+                return;
+            }
+            res.sendJSON(200, {{"status", 200}, {"data", currentJson(key)}, {"error", ""}});
+        }), adminAuth);
+    }
+}
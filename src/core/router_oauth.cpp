@@ -1,12 +1,17 @@
 #include "mantisbase/core/router.h"
 #include "mantisbase/core/oauth.h"
+#include "mantisbase/core/exceptions.h"
 #include "mantisbase/core/http.h"
+#include "mantisbase/core/keyset_page.h"
 #include "mantisbase/mantisbase.h"
 
 namespace mb {
     void Router::registerOAuthRoutes() {
         const Middlewares authEntityMiddleware = {resolveAuthEntity()};
 
+        // All of these block on the database, and some on a provider through
+        // OAuthClient, so none of them run on the IO loop.
+
         // User-facing OAuth routes
         Get("/api/v1/auth/:entity_name/oauth/authorize/:provider", [](const MantisRequest &req, const MantisResponse &res) {
             try {
@@ -24,7 +29,7 @@ namespace mb {
             } catch (const std::exception &e) {
                 res.sendJSON(400, {{"status", 400}, {"data", json::object()}, {"error", e.what()}});
             }
-        }, authEntityMiddleware);
+        }, authEntityMiddleware, RouteExec::DbWorker);
 
         Get("/api/v1/auth/:entity_name/oauth/callback/:provider", [](const MantisRequest &req, const MantisResponse &res) {
             try {
@@ -48,7 +53,7 @@ namespace mb {
             } catch (const std::exception &e) {
                 res.sendJSON(400, {{"status", 400}, {"data", json::object()}, {"error", e.what()}});
             }
-        }, authEntityMiddleware);
+        }, authEntityMiddleware, RouteExec::DbWorker);
 
         Post("/api/v1/auth/:entity_name/oauth/link/:provider", [](MantisRequest &req, const MantisResponse &res) {
             try {
@@ -78,7 +83,7 @@ namespace mb {
             } catch (const std::exception &e) {
                 res.sendJSON(400, {{"status", 400}, {"data", json::object()}, {"error", e.what()}});
             }
-        }, authEntityMiddleware);
+        }, authEntityMiddleware, RouteExec::DbWorker);
 
         Delete("/api/v1/auth/:entity_name/oauth/link/:provider", [](const MantisRequest &req, const MantisResponse &res) {
             try {
@@ -102,7 +107,7 @@ namespace mb {
             } catch (const std::exception &e) {
                 res.sendJSON(500, {{"status", 500}, {"data", json::object()}, {"error", e.what()}});
             }
-        }, authEntityMiddleware);
+        }, authEntityMiddleware, RouteExec::DbWorker);
 
         Get("/api/v1/auth/:entity_name/oauth/accounts", [](const MantisRequest &req, const MantisResponse &res) {
             try {
@@ -117,12 +122,14 @@ namespace mb {
                 auto entity_name = trim(req.getPathParamValue("entity_name"));
                 auto user_id = auth["id"].get<std::string>();
 
-                auto accounts = OAuthManager::getLinkedAccounts(entity_name, user_id);
+                auto accounts = OAuthManager::getLinkedAccounts(entity_name, user_id, KeysetPage::fromQuery(req));
                 res.sendJSON(200, {{"status", 200}, {"data", accounts}, {"error", ""}});
+            } catch (const MantisException &e) {
+                res.sendJSON(e.code(), {{"status", e.code()}, {"data", json::object()}, {"error", e.what()}});
             } catch (const std::exception &e) {
                 res.sendJSON(500, {{"status", 500}, {"data", json::object()}, {"error", e.what()}});
             }
-        }, authEntityMiddleware);
+        }, authEntityMiddleware, RouteExec::DbWorker);
 
         Get("/api/v1/auth/:entity_name/oauth/providers", [](const MantisRequest &req, const MantisResponse &res) {
             try {
@@ -132,7 +139,7 @@ namespace mb {
             } catch (const std::exception &e) {
                 res.sendJSON(500, {{"status", 500}, {"data", json::object()}, {"error", e.what()}});
             }
-        }, authEntityMiddleware);
+        }, authEntityMiddleware, RouteExec::DbWorker);
 
         // Admin OAuth provider management routes
         const Middlewares adminAuth = {requireAdminAuth()};
@@ -160,16 +167,36 @@ namespace mb {
             } catch (const std::exception &e) {
                 res.sendJSON(500, {{"status", 500}, {"data", json::object()}, {"error", e.what()}});
             }
-        }, adminAuth);
+        }, adminAuth, RouteExec::DbWorker);
 
-        Get("/api/v1/sys/oauth/providers", [](const MantisRequest &, const MantisResponse &res) {
+        Get("/api/v1/sys/oauth/providers", [](const MantisRequest &req, const MantisResponse &res) {
             try {
-                auto providers = OAuthManager::listProviders();
+                json filters = json::object();
+                if (req.hasQueryParam("enabled")) filters["enabled"] = req.getQueryParamValue("enabled") != "false";
+                auto providers = OAuthManager::listProviders(KeysetPage::fromQuery(req), filters);
                 res.sendJSON(200, {{"status", 200}, {"data", providers}, {"error", ""}});
+            } catch (const MantisException &e) {
+                res.sendJSON(e.code(), {{"status", e.code()}, {"data", json::object()}, {"error", e.what()}});
+            } catch (const std::exception &e) {
+                res.sendJSON(500, {{"status", 500}, {"data", json::object()}, {"error", e.what()}});
+            }
+        }, adminAuth, RouteExec::DbWorker);
+
+        // Linked accounts of every user, or of the `entity_name`, `user_id` or `provider` asked for
+        Get("/api/v1/sys/oauth/accounts", [](const MantisRequest &req, const MantisResponse &res) {
+            try {
+                json filters = json::object();
+                for (const auto *key: {"entity_name", "user_id", "provider"}) {
+                    if (req.hasQueryParam(key)) filters[key] = req.getQueryParamValue(key);
+                }
+                auto accounts = OAuthManager::listAccounts(KeysetPage::fromQuery(req), filters);
+                res.sendJSON(200, {{"status", 200}, {"data", accounts}, {"error", ""}});
+            } catch (const MantisException &e) {
+                res.sendJSON(e.code(), {{"status", e.code()}, {"data", json::object()}, {"error", e.what()}});
             } catch (const std::exception &e) {
                 res.sendJSON(500, {{"status", 500}, {"data", json::object()}, {"error", e.what()}});
             }
-        }, adminAuth);
+        }, adminAuth, RouteExec::DbWorker);
 
         Patch("/api/v1/sys/oauth/providers/:id", [](MantisRequest &req, const MantisResponse &res) {
             try {
@@ -185,7 +212,7 @@ namespace mb {
             } catch (const std::exception &e) {
                 res.sendJSON(500, {{"status", 500}, {"data", json::object()}, {"error", e.what()}});
             }
-        }, adminAuth);
+        }, adminAuth, RouteExec::DbWorker);
 
         Delete("/api/v1/sys/oauth/providers/:id", [](const MantisRequest &req, const MantisResponse &res) {
             try {
@@ -198,7 +225,7 @@ namespace mb {
             } catch (const std::exception &e) {
                 res.sendJSON(400, {{"status", 400}, {"data", json::object()}, {"error", e.what()}});
             }
-        }, adminAuth);
+        }, adminAuth, RouteExec::DbWorker);
 
         Post("/api/v1/sys/oauth/entity-config", [](MantisRequest &req, const MantisResponse &res) {
             try {
@@ -216,7 +243,7 @@ namespace mb {
             } catch (const std::exception &e) {
                 res.sendJSON(400, {{"status", 400}, {"data", json::object()}, {"error", e.what()}});
             }
-        }, adminAuth);
+        }, adminAuth, RouteExec::DbWorker);
 
         Delete("/api/v1/sys/oauth/entity-config", [](MantisRequest &req, const MantisResponse &res) {
             try {
@@ -237,6 +264,6 @@ namespace mb {
             } catch (const std::exception &e) {
                 res.sendJSON(400, {{"status", 400}, {"data", json::object()}, {"error", e.what()}});
             }
-        }, adminAuth);
+        }, adminAuth, RouteExec::DbWorker);
     }
 } // mb
@@ -0,0 +1,95 @@
+#include "mantisbase/core/router.h"
+#include "mantisbase/core/database.h"
+#include "mantisbase/core/exceptions.h"
+#include "mantisbase/core/http.h"
+#include "mantisbase/core/middlewares.h"
+#include "mantisbase/core/replication.h"
+#include "mantisbase/mantisbase.h"
+
+#include <soci/soci.h>
+
+namespace mb {
+    namespace {
+        /// Followers send the shared MB_REPLICATION_KEY; compared in constant time
+        MiddlewareFn requireReplicationKey(const std::string &key) {
+            return [key](MantisRequest &req, MantisResponse &res) {
+                const auto given = req.getHeaderValue("X-Replication-Key", "");
+                unsigned char diff = given.size() != key.size();
+                for (std::size_t i = 0; i < key.size(); ++i)
+                    diff |= static_cast<unsigned char>(key[i] ^ (i < given.size() ? given[i] : 0));
+                if (diff == 0) return HandlerResponse::Unhandled;
+
+                res.sendJSON(401, {{"status", 401}, {"data", json::object()}, {"error", "Invalid replication key"}});
+                return HandlerResponse::Handled;
+            };
+        }
+
+        template<typename Fn>
+        HandlerFn replicationHandler(Fn fn) {
+            return [fn](MantisRequest &req, MantisResponse &res) {
+                try {
+                    fn(req, res);
+                } catch (const MantisException &e) {
+                    res.sendJSON(e.code(), {{"status", e.code()}, {"data", json::object()}, {"error", e.what()}});
+                } catch (const std::exception &e) {
+                    res.sendJSON(500, {{"status", 500}, {"data", json::object()}, {"error", e.what()}});
+                }
+            };
+        }
+
+        long long queryParam(const MantisRequest &req, const std::string &key, const long long def) {
+            if (!req.hasQueryParam(key)) return def;
+            try {
+                return std::stoll(req.getQueryParamValue(key));
+            } catch (...) {
+                throw MantisException(400, std::format("`{}` must be a whole number", key));
+            }
+        }
+    }
+
+    void Router::registerReplicationRoutes() {
+        auto &replication = *m_replication;
+
+        Get("/api/v1/sys/replication", replicationHandler([this, &replication](MantisRequest &, MantisResponse &res) {
+            auto status = replication.status();
+            if (replication.options().serving() && mApp.dbType() == "sqlite3") {
+                const auto sql = mApp.db().session();
+                long long head = 0;
+                *sql << "SELECT COALESCE(MAX(seq), 0) FROM sqlite_sequence WHERE name = 'mb_change_log'",
+                        soci::into(head);
+                status["head"] = head;
+            }
+            res.sendJSON(200, {{"status", 200}, {"data", status}, {"error", nullptr}});
+        }), {requireAdminAuth()}, RouteExec::DbWorker);
+
+        // The stream is served by a primary with a key; followers and PostgreSQL don't
+        if (!replication.options().serving() || mApp.dbType() != "sqlite3") return;
+
+        const Middlewares keyAuth = {noAuthContext(), requireReplicationKey(replication.options().key)};
+
+        Get("/api/v1/sys/replication/changes", replicationHandler([this](MantisRequest &req, MantisResponse &res) {
+            const auto after = queryParam(req, "after", 0);
+            const auto limit = static_cast<int>(queryParam(req, "limit", 500));
+            const auto sql = mApp.db().session();
+            res.sendJSON(200, {{"status", 200}, {"data", Replication::changesAfter(*sql, after, limit)},
+                               {"error", nullptr}});
+        }), keyAuth, RouteExec::DbWorker);
+
+        // Copying the database takes a while; the worker pool waits on it, not an IO loop
+        Post("/api/v1/sys/replication/snapshot", replicationHandler([&replication](MantisRequest &, MantisResponse &res) {
+            res.sendJSON(201, {{"status", 201}, {"data", replication.createSnapshot()}, {"error", nullptr}});
+        }), keyAuth, RouteExec::DbWorker);
+
+        Get("/api/v1/sys/replication/snapshot/:id", replicationHandler([&replication](MantisRequest &req,
+                                                                                       MantisResponse &res) {
+            const auto path = replication.snapshotPath(req.getPathParamValue("id"));
+            const auto size = static_cast<long long>(std::filesystem::file_size(path));
+            const auto offset = queryParam(req, "offset", 0);
+            const auto length = queryParam(req, "length", size - offset);
+            if (offset < 0 || length <= 0 || offset + length > size)
+                throw MantisException(416, std::format("Snapshot is {} bytes", size));
+            res.sendFile(path.string(), static_cast<std::size_t>(offset), static_cast<std::size_t>(length),
+                         "application/vnd.sqlite3");
+        }), {noAuthContext(), requireReplicationKey(replication.options().key), noCompression()});
+    }
+}
@@ -0,0 +1,81 @@
+#include "mantisbase/core/router.h"
+#include "mantisbase/core/database.h"
+#include "mantisbase/core/delta_sync.h"
+#include "mantisbase/core/exceptions.h"
+#include "mantisbase/core/http.h"
+#include "mantisbase/core/middlewares.h"
+#include "mantisbase/core/models/entity_schema.h"
+#include "mantisbase/core/tenants.h"
+#include "mantisbase/mantisbase.h"
+#include "mantisbase/utils/utils.h"
+
+#include <soci/soci.h>
+
+namespace mb {
+    namespace {
+        template<typename Fn>
+        HandlerFn syncHandler(Fn fn) {
+            return [fn](MantisRequest &req, MantisResponse &res) {
+                try {
+                    fn(req, res);
+                } catch (const MantisException &e) {
+                    res.sendJSON(e.code(), {{"status", e.code()}, {"data", json::object()}, {"error", e.what()}});
+                } catch (const std::exception &e) {
+                    res.sendJSON(500, {{"status", 500}, {"data", json::object()}, {"error", e.what()}});
+                }
+            };
+        }
+    }
+
+    void Router::registerSyncRoutes() {
+        const auto options = DeltaSync::Options::fromEnv();
+        if (!options.enabled()) return;
+
+        // ?since=<cursor>&entities=a,b; without `since`, only a cursor to start from
+        Get("/api/v1/sync", syncHandler([this, options](MantisRequest &req, MantisResponse &res) {
+            // Tenant databases keep no change log
+            if (Tenants::current()) throw MantisException(404, "Delta sync is not available for tenants.");
+
+            std::optional<DeltaSync::Cursor> since;
+            if (const auto cursor = req.hasQueryParam("since") ? req.getQueryParamValue("since") : "";
+                !cursor.empty()) {
+                since = DeltaSync::Cursor::decode(cursor);
+                if (!since) throw MantisException(400, "Invalid `since` cursor.");
+            }
+
+            // Each entity is read as its list endpoint would be, rule and row filter alike
+            std::vector<std::string> names;
+            std::unordered_map<std::string, std::pair<std::shared_ptr<const Entity>, json>> entities;
+            const auto listed = req.hasQueryParam("entities") ? req.getQueryParamValue("entities") : "";
+            for (const auto &part: splitString(listed, ",")) {
+                const auto name = trim(part);
+                if (name.empty() || entities.contains(name)) continue;
+                if (!EntitySchema::isValidEntityName(name) || !mApp.hasEntity(name))
+                    throw MantisException(404, std::format("No entity `{}`.", name));
+
+                const auto entity = mApp.entitySnapshot(name);
+                if (entity->isSystem() || !entity->hasApi())
+                    throw MantisException(404, std::format("No entity `{}`.", name));
+                if (entity->type() == "view")
+                    throw MantisException(400, std::format("View `{}` has no changes to sync.", name));
+                if (!hasRuleAccess(req, entity->listRule()))
+                    throw MantisException(403, std::format("No access to `{}`.", name));
+
+                json opts = json::object();
+                setRuleAuth(req, entity->listRule(), opts);
+                entities.emplace(name, std::make_pair(entity, std::move(opts)));
+                names.push_back(name);
+            }
+            if (names.empty()) throw MantisException(400, "Name the `entities` to sync.");
+
+            // On the primary: the log and the rows it names must agree, which a lagging replica's needn't
+            const auto sql = mApp.db().session();
+            auto data = DeltaSync::changesSince(*sql, since, names, options,
+                                                [&](const std::string &name, const std::vector<std::string> &ids) {
+                                                    const auto &[entity, opts] = entities.at(name);
+                                                    return entity->readMany(*sql, ids, opts);
+                                                });
+            res.sendJSON(200, {{"status", 200}, {"data", std::move(data)}, {"error", nullptr}});
+        }), {}, RouteExec::DbWorker);
+    }
+}
@@ -0,0 +1,50 @@
+#include "mantisbase/core/router.h"
+#include "mantisbase/core/webhooks.h"
+#include "mantisbase/core/exceptions.h"
+#include "mantisbase/core/http.h"
+#include "mantisbase/core/middlewares.h"
+#include "mantisbase/mantisbase.h"
+
+namespace mb {
+    namespace {
+        template<typename Fn>
+        HandlerFn webhookHandler(Fn fn) {
+            return [fn](MantisRequest &req, MantisResponse &res) {
+                try {
+                    fn(req, res, MantisBase::instance().router().webhooks());
+                } catch (const MantisException &e) {
+                    res.sendJSON(e.code(), {{"status", e.code()}, {"data", json::object()}, {"error", e.what()}});
+                } catch (const std::exception &e) {
+                    res.sendJSON(500, {{"status", 500}, {"data", json::object()}, {"error", e.what()}});
+                }
+            };
+        }
+    }
+
+    void Router::registerWebhookRoutes() {
+        const Middlewares adminAuth = {requireAdminAuth()};
+
+        Get("/api/v1/webhooks", webhookHandler([](MantisRequest &, MantisResponse &res, Webhooks &webhooks) {
+            auto list = json::array();
+            for (const auto &hook: webhooks.list()) list.push_back(hook.toJSON());
+            res.sendJSON(200, {{"status", 200}, {"data", list}, {"error", ""}});
+        }), adminAuth, RouteExec::DbWorker);
+
+        // {"url": ..., "topics": [...], "secret": ...}
+        Post("/api/v1/webhooks", webhookHandler([](MantisRequest &req, MantisResponse &res, Webhooks &webhooks) {
+            const auto &[body, err] = req.getBodyAsJson();
+            if (!err.empty() || !body.is_object())
+                throw MantisException(400, "Could not parse request body, expected a JSON object!");
+            const auto hook = webhooks.create(body);
+            res.sendJSON(201, {{"status", 201}, {"data", hook.toJSON()}, {"error", ""}});
+        }), adminAuth, RouteExec::DbWorker);
+
+        Delete("/api/v1/webhooks/:id", webhookHandler([](MantisRequest &req, MantisResponse &res, Webhooks &webhooks) {
+            if (!webhooks.remove(req.getPathParamValue("id"))) {
+                res.sendJSON(404, {{"status", 404}, {"data", json::object()}, {"error", "Webhook not found"}});
+                return;
+            }
+            res.sendJSON(200, {{"status", 200}, {"data", {{"deleted", true}}}, {"error", ""}});
+        }), adminAuth, RouteExec::DbWorker);
+    }
+}
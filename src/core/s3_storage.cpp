@@ -0,0 +1,358 @@
+/**
+ * @file s3_storage.cpp
+ * @brief Implementation for @see s3_storage.h
+ */
+
+#include "../../include/mantisbase/core/s3_storage.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/core/tracing.h"
+#include "../../include/mantisbase/utils/crypto_utils.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <drogon/HttpClient.h>
+#include <trantor/net/EventLoopThread.h>
+
+#include <charconv>
+#include <ctime>
+#include <fstream>
+#include <thread>
+
+namespace mb {
+    namespace fs = std::filesystem;
+
+    namespace {
+        constexpr std::size_t MIN_PART_SIZE = 5 * 1024 * 1024; // S3's floor for all parts but the last
+        constexpr int PART_ATTEMPTS = 3;
+
+        std::size_t sizeFromEnv(const std::string &key, const std::size_t fallback) {
+            const auto value = getEnvOrDefault(key, "");
+            unsigned long long parsed = 0;
+            const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), parsed);
+            if (value.empty() || ec != std::errc{} || end != value.data() + value.size() || parsed == 0)
+                return fallback;
+            return static_cast<std::size_t>(parsed);
+        }
+
+        std::string canonicalQuery(const std::map<std::string, std::string> &query) {
+            std::string out;
+            for (const auto &[key, value]: query) {
+                if (!out.empty()) out.push_back('&');
+                out += S3Storage::uriEncode(key) + "=" + S3Storage::uriEncode(value);
+            }
+            return out;
+        }
+
+        std::string credentialScope(const S3Storage::Options &o, const std::string &amz_date) {
+            return amz_date.substr(0, 8) + "/" + o.region + "/s3/aws4_request";
+        }
+
+        std::string signature(const S3Storage::Options &o, const std::string &amz_date,
+                              const std::string &canonical_request) {
+            const auto string_to_sign = "AWS4-HMAC-SHA256\n" + amz_date + "\n" + credentialScope(o, amz_date) +
+                                        "\n" + sha256Hex(canonical_request);
+            auto key = hmacSha256("AWS4" + o.secretKey, amz_date.substr(0, 8));
+            key = hmacSha256(key, o.region);
+            key = hmacSha256(key, "s3");
+            key = hmacSha256(key, "aws4_request");
+            return toHex(hmacSha256(key, string_to_sign));
+        }
+
+        std::string xmlValue(const std::string &xml, const std::string &tag) {
+            const auto open = "<" + tag + ">";
+            const auto start = xml.find(open);
+            if (start == std::string::npos) return "";
+            const auto end = xml.find("</" + tag + ">", start);
+            if (end == std::string::npos) return "";
+            return xml.substr(start + open.size(), end - start - open.size());
+        }
+
+        drogon::HttpMethod toMethod(const std::string &method) {
+            if (method == "PUT") return drogon::Put;
+            if (method == "POST") return drogon::Post;
+            if (method == "DELETE") return drogon::Delete;
+            if (method == "HEAD") return drogon::Head;
+            return drogon::Get;
+        }
+
+        std::string readPart(const fs::path &file, const std::size_t offset, const std::size_t length) {
+            std::ifstream in(file, std::ios::binary);
+            std::string data(length, '\0');
+            in.seekg(static_cast<std::streamoff>(offset));
+            in.read(data.data(), static_cast<std::streamsize>(length));
+            if (static_cast<std::size_t>(in.gcount()) != length)
+                throw MantisException(500, "Failed to read `" + file.filename().string() + "` for upload.");
+            return data;
+        }
+    }
+
+    // ----------------------------------------------------------------- //
+    // Options                                                           //
+    // ----------------------------------------------------------------- //
+
+    S3Storage::Options S3Storage::Options::fromEnv() {
+        Options o;
+        o.endpoint = getEnvOrDefault("MB_S3_ENDPOINT", "");
+        o.bucket = getEnvOrDefault("MB_S3_BUCKET", "");
+        o.region = getEnvOrDefault("MB_S3_REGION", o.region);
+        o.accessKey = getEnvOrDefault("MB_S3_ACCESS_KEY", "");
+        o.secretKey = getEnvOrDefault("MB_S3_SECRET_KEY", "");
+        o.prefix = getEnvOrDefault("MB_S3_PREFIX", "");
+        o.pathStyle = getEnvOrDefault("MB_S3_PATH_STYLE", "1") != "0";
+        o.partSize = std::max(sizeFromEnv("MB_S3_PART_SIZE", o.partSize), MIN_PART_SIZE);
+        o.concurrency = sizeFromEnv("MB_S3_UPLOAD_CONCURRENCY", o.concurrency);
+        o.presignTtl = std::chrono::seconds(sizeFromEnv("MB_S3_PRESIGN_TTL", o.presignTtl.count()));
+
+        while (o.endpoint.ends_with('/')) o.endpoint.pop_back();
+        if (o.endpoint.empty() || o.bucket.empty() || o.accessKey.empty() || o.secretKey.empty())
+            throw MantisException(500, "S3 storage needs MB_S3_ENDPOINT, MB_S3_BUCKET, MB_S3_ACCESS_KEY and "
+                                       "MB_S3_SECRET_KEY.");
+        return o;
+    }
+
+    std::string S3Storage::Options::host() const {
+        const auto scheme_end = endpoint.find("://");
+        auto host = scheme_end == std::string::npos ? endpoint : endpoint.substr(scheme_end + 3);
+        if (const auto slash = host.find('/'); slash != std::string::npos) host.resize(slash);
+        return pathStyle ? host : bucket + "." + host;
+    }
+
+    std::string S3Storage::Options::baseUrl() const {
+        const auto scheme_end = endpoint.find("://");
+        const auto scheme = scheme_end == std::string::npos ? std::string("https") : endpoint.substr(0, scheme_end);
+        return scheme + "://" + host();
+    }
+
+    std::string S3Storage::Options::objectPath(const std::string &key) const {
+        const auto encoded = uriEncode(key, true);
+        return pathStyle ? "/" + uriEncode(bucket) + "/" + encoded : "/" + encoded;
+    }
+
+    // ----------------------------------------------------------------- //
+    // Signing                                                           //
+    // ----------------------------------------------------------------- //
+
+    std::string S3Storage::uriEncode(const std::string_view s, const bool keep_slash) {
+        constexpr char hex[] = "0123456789ABCDEF";
+        std::string out;
+        out.reserve(s.size());
+        for (const auto ch: s) {
+            const auto c = static_cast<unsigned char>(ch);
+            if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+                c == '-' || c == '_' || c == '.' || c == '~' || (c == '/' && keep_slash)) {
+                out.push_back(ch);
+            } else {
+                out.push_back('%');
+                out.push_back(hex[c >> 4]);
+                out.push_back(hex[c & 0xF]);
+            }
+        }
+        return out;
+    }
+
+    std::string S3Storage::amzDate(const std::chrono::system_clock::time_point tp) {
+        const std::time_t t = std::chrono::system_clock::to_time_t(tp);
+        std::tm tm{};
+#ifdef _WIN32
+        gmtime_s(&tm, &t);
+#else
+        gmtime_r(&t, &tm);
+#endif
+        char buf[17];
+        std::strftime(buf, sizeof(buf), "%Y%m%dT%H%M%SZ", &tm);
+        return buf;
+    }
+
+    std::string S3Storage::sign(const Options &o, const std::string &method, const std::string &canonical_uri,
+                                const std::map<std::string, std::string> &query,
+                                std::map<std::string, std::string> &headers,
+                                const std::string &payload_sha256, const std::string &amz_date) {
+        headers["host"] = o.host();
+        headers["x-amz-content-sha256"] = payload_sha256;
+        headers["x-amz-date"] = amz_date;
+
+        std::string canonical_headers, signed_headers;
+        for (const auto &[key, value]: headers) {
+            canonical_headers += key + ":" + trim(value) + "\n";
+            if (!signed_headers.empty()) signed_headers.push_back(';');
+            signed_headers += key;
+        }
+
+        const auto canonical_request = method + "\n" + canonical_uri + "\n" + canonicalQuery(query) + "\n" +
+                                       canonical_headers + "\n" + signed_headers + "\n" + payload_sha256;
+
+        return "AWS4-HMAC-SHA256 Credential=" + o.accessKey + "/" + credentialScope(o, amz_date) +
+               ",SignedHeaders=" + signed_headers + ",Signature=" + signature(o, amz_date, canonical_request);
+    }
+
+    std::string S3Storage::presign(const Options &o, const std::string &method, const std::string &key,
+                                   std::map<std::string, std::string> query, const std::string &amz_date,
+                                   const std::chrono::seconds expires) {
+        query["X-Amz-Algorithm"] = "AWS4-HMAC-SHA256";
+        query["X-Amz-Credential"] = o.accessKey + "/" + credentialScope(o, amz_date);
+        query["X-Amz-Date"] = amz_date;
+        query["X-Amz-Expires"] = std::to_string(expires.count());
+        query["X-Amz-SignedHeaders"] = "host";
+
+        const auto path = o.objectPath(key);
+        const auto qs = canonicalQuery(query);
+        const auto canonical_request = method + "\n" + path + "\n" + qs + "\nhost:" + o.host() +
+                                       "\n\nhost\nUNSIGNED-PAYLOAD";
+
+        return o.baseUrl() + path + "?" + qs + "&X-Amz-Signature=" + signature(o, amz_date, canonical_request);
+    }
+
+    // ----------------------------------------------------------------- //
+    // Backend                                                           //
+    // ----------------------------------------------------------------- //
+
+    S3Storage::S3Storage(Options options)
+        : m_opts(std::move(options)),
+          m_loop(std::make_unique<trantor::EventLoopThread>("mb-s3")) {
+        m_loop->run();
+        const auto clients = std::max<std::size_t>(1, m_opts.concurrency);
+        for (std::size_t i = 0; i < clients; ++i) {
+            m_clients.push_back(drogon::HttpClient::newHttpClient(m_opts.baseUrl(), m_loop->getLoop()));
+        }
+        LogOrigin::info("Storage", fmt::format("Storing files in S3 bucket `{}` at {}", m_opts.bucket,
+                                               m_opts.endpoint));
+    }
+
+    S3Storage::~S3Storage() {
+        // Clients belong to the loop; drop them before it stops
+        m_clients.clear();
+    }
+
+    const std::shared_ptr<drogon::HttpClient> &S3Storage::nextClient() {
+        return m_clients[m_next.fetch_add(1, std::memory_order_relaxed) % m_clients.size()];
+    }
+
+    std::string S3Storage::objectKey(const std::string &sha256) const {
+        return m_opts.prefix + "blobs/" + sha256.substr(0, 2) + "/" + sha256;
+    }
+
+    S3Storage::Response S3Storage::send(const std::string &method, const std::string &key,
+                                        const std::map<std::string, std::string> &query, std::string body,
+                                        std::map<std::string, std::string> headers) {
+        const auto path = m_opts.objectPath(key);
+        const auto content_type = headers.contains("content-type") ? headers["content-type"]
+                                                                   : std::string("application/octet-stream");
+        headers.erase("content-type");
+        const auto authorization = sign(m_opts, method, path, query, headers, sha256Hex(body),
+                                        amzDate(std::chrono::system_clock::now()));
+
+        const auto req = drogon::HttpRequest::newHttpRequest();
+        req->setMethod(toMethod(method));
+        req->setPathEncode(false);
+        req->setPath(query.empty() ? path : path + "?" + canonicalQuery(query));
+        for (const auto &[name, value]: headers) req->addHeader(name, value);
+        req->addHeader("authorization", authorization);
+        req->setContentTypeString(content_type);
+        if (!body.empty()) req->setBody(std::move(body));
+
+        const auto [result, resp] = nextClient()->sendRequest(req, m_opts.timeout);
+        if (result != drogon::ReqResult::Ok || !resp) return {};
+        return {static_cast<int>(resp->statusCode()), std::string(resp->body()), resp->getHeader("etag")};
+    }
+
+    bool S3Storage::hasBlob(const std::string &sha256) {
+        return send("HEAD", objectKey(sha256), {}, {}).status == 200;
+    }
+
+    void S3Storage::putBlob(const std::string &sha256, const fs::path &file, const std::string &content_type) {
+        const Tracer::Span span("storage.s3.put");
+        const auto size = fs::file_size(file);
+        const auto key = objectKey(sha256);
+        const auto type = content_type.empty() ? std::string("application/octet-stream") : content_type;
+
+        if (size <= m_opts.partSize) putSingle(key, file, type);
+        else putMultipart(key, file, size, type);
+
+        std::error_code ec;
+        fs::remove(file, ec);
+    }
+
+    void S3Storage::putSingle(const std::string &key, const fs::path &file, const std::string &content_type) {
+        const auto res = send("PUT", key, {}, readPart(file, 0, fs::file_size(file)),
+                              {{"content-type", content_type}});
+        if (res.status != 200)
+            throw MantisException(502, fmt::format("Storing `{}` in S3 failed with status {}.", key, res.status));
+    }
+
+    void S3Storage::putMultipart(const std::string &key, const fs::path &file, const std::size_t size,
+                                 const std::string &content_type) {
+        const auto created = send("POST", key, {{"uploads", ""}}, {}, {{"content-type", content_type}});
+        const auto upload_id = xmlValue(created.body, "UploadId");
+        if (created.status != 200 || upload_id.empty())
+            throw MantisException(502, fmt::format("Starting the S3 upload of `{}` failed with status {}.", key,
+                                                   created.status));
+
+        const auto parts = (size + m_opts.partSize - 1) / m_opts.partSize;
+        std::vector<std::string> etags(parts);
+        std::atomic<std::size_t> next{0};
+        std::atomic<bool> failed{false};
+
+        // Each worker sends one part at a time; parts are read as they go out
+        auto worker = [&] {
+            for (auto i = next.fetch_add(1); i < parts && !failed; i = next.fetch_add(1)) {
+                const auto offset = i * m_opts.partSize;
+                const auto length = std::min(m_opts.partSize, size - offset);
+                try {
+                    const auto data = readPart(file, offset, length);
+                    for (int attempt = 0; attempt < PART_ATTEMPTS && etags[i].empty(); ++attempt) {
+                        const auto res = send("PUT", key, {{"partNumber", std::to_string(i + 1)},
+                                                           {"uploadId", upload_id}}, data);
+                        if (res.status == 200) etags[i] = res.etag;
+                        else if (res.status != 0 && res.status < 500) break;
+                    }
+                } catch (const std::exception &e) {
+                    LogOrigin::warn("S3 Upload Error", fmt::format("Part {} of `{}`: {}", i + 1, key, e.what()));
+                }
+                if (etags[i].empty()) failed = true;
+            }
+        };
+
+        std::vector<std::thread> workers;
+        const auto slots = std::min<std::size_t>(std::max<std::size_t>(1, m_opts.concurrency), parts);
+        for (std::size_t i = 0; i < slots; ++i) workers.emplace_back(worker);
+        for (auto &t: workers) t.join();
+
+        if (!failed) {
+            std::string body = "<CompleteMultipartUpload>";
+            for (std::size_t i = 0; i < parts; ++i) {
+                body += fmt::format("<Part><PartNumber>{}</PartNumber><ETag>{}</ETag></Part>", i + 1, etags[i]);
+            }
+            body += "</CompleteMultipartUpload>";
+
+            // A 200 can still carry an error, sent once the parts were checked
+            const auto done = send("POST", key, {{"uploadId", upload_id}}, std::move(body),
+                                   {{"content-type", "application/xml"}});
+            if (done.status == 200 && done.body.find("<Error>") == std::string::npos) return;
+        }
+
+        // Abandoned parts are billed until aborted
+        send("DELETE", key, {{"uploadId", upload_id}}, {});
+        throw MantisException(502, fmt::format("Uploading `{}` to S3 failed.", key));
+    }
+
+    bool S3Storage::removeBlob(const std::string &sha256) {
+        const auto status = send("DELETE", objectKey(sha256), {}, {}).status;
+        return status == 204 || status == 200 || status == 404;
+    }
+
+    std::optional<std::string> S3Storage::presignGet(const std::string &sha256, const std::string &filename,
+                                                     const std::string &content_type) {
+        std::map<std::string, std::string> query;
+        if (!content_type.empty()) query["response-content-type"] = content_type;
+        if (!filename.empty()) {
+            std::string quoted;
+            for (const auto c: filename) {
+                if (c == '"' || c == '\\') quoted.push_back('\\');
+                quoted.push_back(c);
+            }
+            query["response-content-disposition"] = "inline; filename=\"" + quoted + "\"";
+        }
+        return presign(m_opts, "GET", objectKey(sha256), std::move(query),
+                       amzDate(std::chrono::system_clock::now()), m_opts.presignTtl);
+    }
+}
@@ -0,0 +1,374 @@
+/**
+ * @file scheduler.cpp
+ * @brief Implementation for @see scheduler.h
+ */
+
+#include "../../include/mantisbase/core/scheduler.h"
+#include "../../include/mantisbase/core/database.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/core/metrics.h"
+#include "../../include/mantisbase/core/worker_pool.h"
+#include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <random>
+#include <ranges>
+#include <soci/soci.h>
+#include <span>
+
+namespace mb {
+    namespace {
+        constexpr std::array<std::string_view, 12> kMonths = {
+            "jan", "feb", "mar", "apr", "may", "jun", "jul", "aug", "sep", "oct", "nov", "dec"
+        };
+        constexpr std::array<std::string_view, 7> kWeekdays = {"sun", "mon", "tue", "wed", "thu", "fri", "sat"};
+
+        [[noreturn]] void invalid(const std::string &expr, const std::string &why) {
+            throw MantisException(400, fmt::format("Invalid schedule `{}`: {}.", expr, why));
+        }
+
+        /// A field value: a number, or a name from `names` counted from `first`
+        int valueOf(std::string token, const int first, const std::span<const std::string_view> names,
+                    const std::string &expr) {
+            toLowerCase(token);
+            for (std::size_t i = 0; i < names.size(); ++i)
+                if (token == names[i]) return first + static_cast<int>(i);
+            if (token.empty() || !std::ranges::all_of(token, [](const unsigned char c) { return std::isdigit(c); }))
+                invalid(expr, fmt::format("`{}` is not a number", token));
+            return safe_stoi(token, -1);
+        }
+
+        /// Set the bits of `field` (`*`, `a`, `a-b`, each optionally `/step`, comma separated) within [lo, hi]
+        template<std::size_t N>
+        void parseField(const std::string &field, const int lo, const int hi,
+                        const std::span<const std::string_view> names, std::bitset<N> &bits,
+                        const std::string &expr) {
+            for (const auto &item: splitString(field, ",")) {
+                auto range = item;
+                int step = 1;
+                if (const auto slash = item.find('/'); slash != std::string::npos) {
+                    range = item.substr(0, slash);
+                    step = valueOf(item.substr(slash + 1), 0, {}, expr);
+                    if (step < 1) invalid(expr, "a step must be at least 1");
+                }
+
+                int from = lo, to = hi;
+                if (range != "*") {
+                    const auto dash = range.find('-');
+                    from = valueOf(range.substr(0, dash), lo, names, expr);
+                    // `a/n` runs from a to the end, as in Vixie cron
+                    to = dash != std::string::npos
+                             ? valueOf(range.substr(dash + 1), lo, names, expr)
+                             : item.find('/') != std::string::npos ? hi : from;
+                }
+                if (from < lo || to > hi || from > to)
+                    invalid(expr, fmt::format("`{}` is outside {}-{}", item, lo, hi));
+                for (auto v = from; v <= to; v += step) bits.set(static_cast<std::size_t>(v));
+            }
+        }
+    }
+
+    CronSchedule CronSchedule::parse(const std::string &expr) {
+        auto text = trim(expr);
+        toLowerCase(text);
+
+        if (text.starts_with("@every")) {
+            auto interval = trim(text.substr(6));
+            if (interval.size() < 2) invalid(expr, "expected `@every <n>s`, `<n>m` or `<n>h`");
+            const auto unit = interval.back();
+            interval.pop_back();
+            const auto n = valueOf(interval, 0, {}, expr);
+            CronSchedule schedule;
+            switch (unit) {
+                case 's': schedule.m_every = std::chrono::seconds(n); break;
+                case 'm': schedule.m_every = std::chrono::minutes(n); break;
+                case 'h': schedule.m_every = std::chrono::hours(n); break;
+                default: invalid(expr, "the interval's unit is one of s, m or h");
+            }
+            if (schedule.m_every <= std::chrono::seconds(0)) invalid(expr, "the interval must be positive");
+            return schedule;
+        }
+
+        static const std::map<std::string, std::string> macros = {
+            {"@yearly", "0 0 1 1 *"}, {"@annually", "0 0 1 1 *"}, {"@monthly", "0 0 1 * *"},
+            {"@weekly", "0 0 * * 0"}, {"@daily", "0 0 * * *"}, {"@midnight", "0 0 * * *"},
+            {"@hourly", "0 * * * *"},
+        };
+        if (text.starts_with('@')) {
+            const auto macro = macros.find(text);
+            if (macro == macros.end()) invalid(expr, "unknown macro");
+            text = macro->second;
+        }
+
+        std::vector<std::string> fields;
+        for (auto &field: splitString(text, " "))
+            if (!field.empty()) fields.push_back(std::move(field));
+        if (fields.size() != 5) invalid(expr, "expected five fields, `minute hour day month weekday`");
+
+        CronSchedule schedule;
+        parseField(fields[0], 0, 59, {}, schedule.m_minutes, expr);
+        parseField(fields[1], 0, 23, {}, schedule.m_hours, expr);
+        parseField(fields[2], 1, 31, {}, schedule.m_days, expr);
+        parseField(fields[3], 1, 12, kMonths, schedule.m_months, expr);
+
+        // Sunday is 0 or 7
+        std::bitset<8> weekdays;
+        parseField(fields[4], 0, 7, kWeekdays, weekdays, expr);
+        for (std::size_t d = 0; d < 7; ++d) schedule.m_weekdays[d] = weekdays[d] || (d == 0 && weekdays[7]);
+
+        schedule.m_anyDay = fields[2].starts_with('*');
+        schedule.m_anyWeekday = fields[4].starts_with('*');
+        return schedule;
+    }
+
+    CronSchedule::Clock::time_point CronSchedule::next(const Clock::time_point after) const {
+        using namespace std::chrono;
+
+        if (m_every > seconds(0)) {
+            const auto since = duration_cast<seconds>(after.time_since_epoch());
+            return Clock::time_point((since / m_every + 1) * m_every);
+        }
+
+        const auto start = floor<minutes>(after) + minutes(1);
+        auto day = floor<days>(start);
+        auto from = duration_cast<minutes>(start - day).count();
+
+        // Eight years covers every leap day, so no match in that span means none ever
+        for (int i = 0; i < 8 * 366; ++i, day += days(1), from = 0) {
+            const year_month_day date(day);
+            if (!m_months[static_cast<unsigned>(date.month())]) continue;
+
+            const bool dom = m_days[static_cast<unsigned>(date.day())];
+            const bool dow = m_weekdays[weekday(day).c_encoding()];
+            if (!(m_anyDay || m_anyWeekday ? dom && dow : dom || dow)) continue;
+
+            for (auto minute = from; minute < 24 * 60; ++minute)
+                if (m_hours[minute / 60] && m_minutes[minute % 60])
+                    return time_point_cast<Clock::duration>(day + minutes(minute));
+        }
+        return Clock::time_point::max();
+    }
+
+    Scheduler::Options Scheduler::Options::fromEnv() {
+        Options options;
+        options.workers = static_cast<std::size_t>(
+            std::max(1, safe_stoi(getEnvOrDefault("MB_JOB_WORKERS", ""), static_cast<int>(options.workers))));
+        options.node = getEnvOrDefault("MB_NODE_ID", "");
+        if (options.node.empty()) options.node = generateShortId();
+        return options;
+    }
+
+    Scheduler::Scheduler(Options options, Lease lease)
+        : m_options(std::move(options)),
+          m_lease(lease ? std::move(lease) : Lease([node = m_options.node](const std::string &job, const std::int64_t tick) {
+              return takeLease(job, tick, node);
+          })),
+          m_pool(std::make_unique<WorkerPool>("jobs")) {}
+
+    Scheduler::~Scheduler() {
+        stop();
+    }
+
+    void Scheduler::add(Job job) {
+        if (job.name.empty() || !job.run)
+            throw MantisException(400, "A scheduled job needs a name and something to run.");
+        auto cron = CronSchedule::parse(job.schedule);
+        const auto next = cron.next(Clock::now());
+        if (next == Clock::time_point::max())
+            throw MantisException(400, fmt::format("Schedule `{}` of job `{}` never fires.", job.schedule, job.name));
+
+        {
+            std::lock_guard lock(m_mutex);
+            Entry entry{std::move(job), cron, next, {}, ++m_generation, {}};
+            entry.at = jittered(next, entry.job.jitter);
+            entry.stats.name = entry.job.name;
+            entry.stats.schedule = entry.job.schedule;
+            entry.stats.leased = entry.job.leased;
+            entry.stats.singleton = entry.job.singleton;
+            const auto name = entry.job.name;
+            m_jobs.insert_or_assign(name, std::move(entry));
+            m_wake = true;
+        }
+        m_cv.notify_all();
+    }
+
+    bool Scheduler::remove(const std::string &name) {
+        std::lock_guard lock(m_mutex);
+        return m_jobs.erase(name) > 0;
+    }
+
+    void Scheduler::setLeadership(Leadership leadership) {
+        std::lock_guard lock(m_mutex);
+        m_leadership = std::move(leadership);
+    }
+
+    void Scheduler::start() {
+        m_pool->start(std::max<std::size_t>(m_options.workers, 1));
+        std::lock_guard lock(m_mutex);
+        if (m_thread.joinable()) return;
+        m_stopping = false;
+        m_thread = std::thread(&Scheduler::loop, this);
+    }
+
+    void Scheduler::stop() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable()) m_thread.join();
+        // Queued runs see m_stopping and return; running ones finish
+        m_pool->stop();
+    }
+
+    bool Scheduler::isRunning() const {
+        return m_pool->isRunning();
+    }
+
+    std::size_t Scheduler::tick(const Clock::time_point now) {
+        std::lock_guard lock(m_mutex);
+        std::size_t submitted = 0;
+        for (auto &[name, entry]: m_jobs) {
+            if (entry.at > now) continue;
+
+            // Ticks missed meanwhile are skipped, not made up
+            const auto due = entry.tick;
+            entry.tick = entry.cron.next(std::max(now, due));
+            entry.at = jittered(entry.tick, entry.job.jitter);
+
+            if (entry.stats.running) {
+                ++entry.stats.skipped;
+                continue;
+            }
+            entry.stats.running = true;
+            if (m_pool->submit([this, name, generation = entry.generation, due] { run(name, generation, due); }))
+                ++submitted;
+            else
+                entry.stats.running = false;
+        }
+        return submitted;
+    }
+
+    void Scheduler::run(const std::string &name, const std::uint64_t generation, const Clock::time_point tick) {
+        Job job;
+        Leadership leadership;
+        {
+            std::lock_guard lock(m_mutex);
+            const auto it = m_jobs.find(name);
+            if (it == m_jobs.end() || it->second.generation != generation) return;
+            if (m_stopping) {
+                it->second.stats.running = false;
+                return;
+            }
+            job = it->second.job;
+            if (job.singleton) leadership = m_leadership;
+        }
+
+        enum class Outcome { Ok, Failed, Elsewhere } outcome = Outcome::Ok;
+        const auto started = Clock::now();
+        try {
+            if (leadership && !leadership())
+                outcome = Outcome::Elsewhere;
+            // The lease names the tick, not the jittered start, so every node asks for the same one
+            else if (job.leased && !m_lease(name, std::chrono::duration_cast<std::chrono::seconds>(
+                                                    tick.time_since_epoch()).count()))
+                outcome = Outcome::Elsewhere;
+            else
+                job.run();
+        } catch (const std::exception &e) {
+            outcome = Outcome::Failed;
+            LogOrigin::warn("Scheduler", fmt::format("Job `{}` failed: {}", name, e.what()));
+        }
+        const auto ms = std::chrono::duration<double, std::milli>(Clock::now() - started).count();
+
+        std::lock_guard lock(m_mutex);
+        const auto it = m_jobs.find(name);
+        if (it == m_jobs.end() || it->second.generation != generation) return;
+        auto &stats = it->second.stats;
+        stats.running = false;
+        if (outcome == Outcome::Elsewhere) {
+            ++stats.elsewhere;
+            return;
+        }
+        ++stats.runs;
+        if (outcome == Outcome::Failed) ++stats.failures;
+        stats.lastMs = ms;
+        stats.maxMs = std::max(stats.maxMs, ms);
+    }
+
+    void Scheduler::loop() {
+        std::unique_lock lock(m_mutex);
+        while (!m_stopping) {
+            // Woken at least every minute, so a clock stepped backwards costs a minute at most
+            auto until = Clock::now() + std::chrono::minutes(1);
+            for (const auto &entry: m_jobs | std::views::values) until = std::min(until, entry.at);
+
+            m_cv.wait_until(lock, until, [this] { return m_stopping || m_wake; });
+            if (m_stopping) break;
+            m_wake = false;
+
+            lock.unlock();
+            tick(Clock::now());
+            lock.lock();
+        }
+    }
+
+    Scheduler::Clock::time_point Scheduler::jittered(const Clock::time_point tick, const std::chrono::seconds jitter) {
+        if (jitter <= std::chrono::seconds(0)) return tick;
+        thread_local std::mt19937_64 rng{std::random_device{}()};
+        std::uniform_int_distribution<std::int64_t> delay(0, std::chrono::milliseconds(jitter).count());
+        return tick + std::chrono::milliseconds(delay(rng));
+    }
+
+    std::vector<Scheduler::JobStats> Scheduler::stats() const {
+        std::lock_guard lock(m_mutex);
+        std::vector<JobStats> out;
+        out.reserve(m_jobs.size());
+        for (const auto &entry: m_jobs | std::views::values) {
+            out.push_back(entry.stats);
+            out.back().next = entry.at;
+        }
+        return out;
+    }
+
+    void Scheduler::writeMetrics(MetricsWriter &out) const {
+        const auto jobs = stats();
+        out.family("mb_job_runs_total", "Ticks of scheduled jobs, by how they went", "counter");
+        for (const auto &job: jobs) {
+            out.sample("mb_job_runs_total", {{"job", job.name}, {"result", "ok"}},
+                       static_cast<double>(job.runs - job.failures));
+            out.sample("mb_job_runs_total", {{"job", job.name}, {"result", "failed"}},
+                       static_cast<double>(job.failures));
+            out.sample("mb_job_runs_total", {{"job", job.name}, {"result", "skipped"}},
+                       static_cast<double>(job.skipped));
+            out.sample("mb_job_runs_total", {{"job", job.name}, {"result", "elsewhere"}},
+                       static_cast<double>(job.elsewhere));
+        }
+        out.family("mb_job_last_duration_seconds", "How long the last run of a scheduled job took", "gauge");
+        for (const auto &job: jobs)
+            out.sample("mb_job_last_duration_seconds", {{"job", job.name}}, job.lastMs / 1000.0);
+        out.family("mb_job_running", "Scheduled jobs running now", "gauge");
+        for (const auto &job: jobs)
+            out.sample("mb_job_running", {{"job", job.name}}, job.running ? 1 : 0);
+    }
+
+    bool Scheduler::takeLease(const std::string &job, const std::int64_t tick, const std::string &node) {
+        const auto now = getCurrentTimestampUTC();
+        const auto sql = MantisBase::instance().rootDb().writeSession();
+        *sql << "INSERT INTO mb_job_leases (name, tick, owner, updated) VALUES (:n, 0, '', :u) "
+                "ON CONFLICT (name) DO NOTHING", soci::use(job, "n"), soci::use(now, "u");
+
+        // Whoever moves the row to this tick first runs it
+        const long long t = tick;
+        soci::statement st = (sql->prepare << "UPDATE mb_job_leases SET tick = :t, owner = :o, updated = :u "
+                              "WHERE name = :n AND tick < :t2",
+                              soci::use(t, "t"), soci::use(node, "o"), soci::use(now, "u"), soci::use(job, "n"),
+                              soci::use(t, "t2"));
+        st.execute(true);
+        return st.get_affected_rows() == 1;
+    }
+}
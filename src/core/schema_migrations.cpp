@@ -0,0 +1,504 @@
+/**
+ * @file schema_migrations.cpp
+ * @brief Implementation for @see schema_migrations.h
+ */
+
+#include "../../include/mantisbase/core/schema_migrations.h"
+#include "../../include/mantisbase/core/database.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/core/models/entity_archive.h"
+#include "../../include/mantisbase/core/models/entity_schema.h"
+#include "../../include/mantisbase/core/models/entity_geo.h"
+#include "../../include/mantisbase/core/models/entity_search.h"
+#include "../../include/mantisbase/core/realtime.h"
+#include "../../include/mantisbase/core/router.h"
+#include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <format>
+#include <optional>
+#include <soci/soci.h>
+#include <vector>
+
+namespace mb {
+    namespace {
+        constexpr auto SHADOW_SUFFIX = "_mb_shadow";
+
+        /// What one migration copies where; rebuilt from mb_tables and the stored target on every batch
+        struct Plan {
+            EntitySchema target;
+            std::string entity;
+            std::string shadow;
+            std::vector<std::string> to;     ///> Shadow columns...
+            std::vector<std::string> from;   ///> ...and the old columns they are filled from, for now the same
+        };
+
+        Plan planFor(const MantisBase &app, const json &current, const json &target) {
+            const auto old_entity = EntitySchema::fromSchema(app, current);
+            Plan plan{EntitySchema::fromSchema(app, target)};
+            plan.entity = sqlIdentifier(old_entity.name());
+            plan.shadow = plan.entity + SHADOW_SUFFIX;
+
+            for (const auto &field: plan.target.fields()) {
+                if (!old_entity.hasField(field.name())) continue;
+                plan.to.push_back(sqlIdentifier(field.name()));
+                plan.from.push_back(sqlIdentifier(field.name()));
+            }
+            return plan;
+        }
+
+        std::string joined(const std::vector<std::string> &columns, const std::string &prefix = "") {
+            std::string out;
+            for (const auto &column: columns) out += (out.empty() ? "" : ", ") + prefix + column;
+            return out;
+        }
+
+        /// Triggers mirroring every write on the old table into the shadow
+        std::vector<std::string> captureDDL(const std::string &db_type, const Plan &plan) {
+            std::string set;
+            for (const auto &column: plan.to) set += (set.empty() ? "" : ", ") + column + " = excluded." + column;
+            const auto upsert = std::format("INSERT INTO {} ({}) VALUES ({}) ON CONFLICT (id) DO UPDATE SET {}",
+                                            plan.shadow, joined(plan.to), joined(plan.from, "NEW."), set);
+
+            if (db_type == "sqlite3") {
+                return {
+                    std::format("CREATE TRIGGER mb_{0}_mig_insert AFTER INSERT ON {0} BEGIN {1}; END;",
+                                plan.entity, upsert),
+                    std::format("CREATE TRIGGER mb_{0}_mig_update AFTER UPDATE ON {0} "
+                                "BEGIN DELETE FROM {1} WHERE id = OLD.id; {2}; END;", plan.entity, plan.shadow, upsert),
+                    std::format("CREATE TRIGGER mb_{0}_mig_delete AFTER DELETE ON {0} "
+                                "BEGIN DELETE FROM {1} WHERE id = OLD.id; END;", plan.entity, plan.shadow),
+                };
+            }
+
+            return {
+                std::format(R"(
+                    CREATE OR REPLACE FUNCTION mb_{0}_mig_fn() RETURNS trigger AS $$
+                    BEGIN
+                        IF TG_OP <> 'INSERT' THEN
+                            DELETE FROM {1} WHERE id = OLD.id;
+                        END IF;
+                        IF TG_OP <> 'DELETE' THEN
+                            {2};
+                        END IF;
+                        RETURN NULL;
+                    END;
+                    $$ LANGUAGE plpgsql
+                )", plan.entity, plan.shadow, upsert),
+                std::format("CREATE TRIGGER mb_{0}_mig AFTER INSERT OR UPDATE OR DELETE ON {0} "
+                            "FOR EACH ROW EXECUTE FUNCTION mb_{0}_mig_fn()", plan.entity),
+            };
+        }
+
+        std::vector<std::string> dropCaptureDDL(const std::string &db_type, const std::string &entity) {
+            if (db_type == "sqlite3") {
+                return {
+                    std::format("DROP TRIGGER IF EXISTS mb_{}_mig_insert", entity),
+                    std::format("DROP TRIGGER IF EXISTS mb_{}_mig_update", entity),
+                    std::format("DROP TRIGGER IF EXISTS mb_{}_mig_delete", entity),
+                };
+            }
+            return {
+                std::format("DROP TRIGGER IF EXISTS mb_{0}_mig ON {0}", entity),
+                std::format("DROP FUNCTION IF EXISTS mb_{}_mig_fn()", entity),
+            };
+        }
+
+        /**
+         * Copy the rows after `last` (up to `hi` if given) that the triggers haven't written yet.
+         * On PostgreSQL the rows are share-locked, so a delete racing the copy can't leave a stale row behind.
+         */
+        long long copyRange(soci::session &sql, const Plan &plan, const std::string &db_type,
+                            const std::string &last, const std::optional<std::string> &hi) {
+            const auto insert = std::format(
+                "INSERT INTO {} ({}) SELECT {} FROM {} WHERE id > :last{} ORDER BY id{} ON CONFLICT (id) DO NOTHING",
+                plan.shadow, joined(plan.to), joined(plan.from), plan.entity, hi ? " AND id <= :hi" : "",
+                db_type == "postgresql" ? " FOR SHARE" : "");
+
+            if (hi) {
+                soci::statement st = (sql.prepare << insert, soci::use(last, "last"), soci::use(*hi, "hi"));
+                st.execute(true);
+                return st.get_affected_rows();
+            }
+            soci::statement st = (sql.prepare << insert, soci::use(last, "last"));
+            st.execute(true);
+            return st.get_affected_rows();
+        }
+
+        /// Take the batch of migration `id` that starts after `last`; false if another runner (thread, test or node) has
+        bool claim(soci::session &sql, const std::string &id, const std::string &last) {
+            const auto now = getCurrentTimestampUTC();
+            soci::statement st = (sql.prepare << "UPDATE mb_schema_migrations SET updated = :u "
+                                  "WHERE id = :id AND state = 'copying' AND last_id = :last",
+                                  soci::use(now, "u"), soci::use(id, "id"), soci::use(last, "last"));
+            st.execute(true);
+            return st.get_affected_rows() == 1;
+        }
+
+        void dropShadow(soci::session &sql, const std::string &db_type, const std::string &entity) {
+            for (const auto &ddl: dropCaptureDDL(db_type, entity)) sql << ddl;
+            sql << std::format("DROP TABLE IF EXISTS {}{}", entity, SHADOW_SUFFIX);
+        }
+
+        /**
+         * Copy what is left, then drop the old table and rename the shadow into its place, all in one transaction.
+         * False if another runner got there first.
+         */
+        bool swapIn(const MantisBase &app, const std::string &id, const Plan &plan, const std::string &last) {
+            const auto db_type = app.dbType();
+            const bool sqlite = db_type == "sqlite3";
+            const auto sql = app.db().writeSession();
+
+            // SQLite's own recipe for a table rebuild: with foreign keys on, the
+            // DROP would cascade into child rows, and a modern RENAME refuses
+            // while views still name the dropped table
+            if (sqlite) {
+                *sql << "PRAGMA foreign_keys = OFF";
+                *sql << "PRAGMA legacy_alter_table = ON";
+            }
+            const auto restore = [&] {
+                if (!sqlite) return;
+                *sql << "PRAGMA legacy_alter_table = OFF";
+                *sql << "PRAGMA foreign_keys = ON";
+            };
+
+            try {
+                soci::transaction tr(*sql);
+                if (!sqlite) *sql << std::format("LOCK TABLE {} IN ACCESS EXCLUSIVE MODE", plan.entity);
+                if (!claim(*sql, id, last)) {
+                    tr.rollback();
+                    restore();
+                    return false;
+                }
+
+                const auto copied = copyRange(*sql, plan, db_type, last, std::nullopt);
+                for (const auto &ddl: dropCaptureDDL(db_type, plan.entity)) *sql << ddl;
+                *sql << std::format("DROP TABLE {}", plan.entity);
+                *sql << std::format("ALTER TABLE {} RENAME TO {}", plan.shadow, plan.entity);
+
+                // Constraint names carry the table name, see EntitySchema::toDDL()
+                if (!sqlite) {
+                    for (const auto &field: plan.target.fields()) {
+                        for (const auto &[prefix, has]: {
+                                 std::pair{"pk", field.isPrimaryKey()}, std::pair{"uniq", field.isUnique()},
+                                 std::pair{"fk", field.isForeignKey()}
+                             }) {
+                            if (!has) continue;
+                            *sql << std::format("ALTER TABLE {0} RENAME CONSTRAINT {1}_{2}_{3} TO {1}_{0}_{3}",
+                                                plan.entity, prefix, plan.shadow, field.name());
+                        }
+                    }
+                }
+                // Index names are database-wide, so these only fit once the old table is gone
+                for (const auto &ddl: plan.target.indexDDL()) *sql << ddl;
+                // The search and geo triggers went with the old table, and its rowids may not have carried over
+                EntitySearch::sync(plan.target, *sql);
+                EntityGeo::sync(plan.target, *sql);
+                EntityArchive::sync(plan.target, *sql);
+
+                if (sqlite) {
+                    const soci::rowset<soci::row> violations = (sql->prepare << std::format(
+                        "PRAGMA foreign_key_check({})", plan.entity));
+                    if (violations.begin() != violations.end())
+                        throw MantisException(409, "Rows break the new foreign keys; fix them and migrate again.");
+                }
+
+                const auto schema = plan.target.toJSON();
+                const std::tm updated_tm = toUtcTime(time(nullptr));
+                *sql << "UPDATE mb_tables SET schema = :schema, updated = :updated WHERE id = :id",
+                        soci::use(schema), soci::use(updated_tm), soci::use(id);
+
+                // The old table's change-stream triggers went with it
+                RealtimeDB::addDbHooks(plan.target.toEntity(), sql);
+
+                const auto now = getCurrentTimestampUTC();
+                *sql << "UPDATE mb_schema_migrations SET state = 'done', copied = copied + :n, updated = :u "
+                        "WHERE id = :id", soci::use(copied), soci::use(now), soci::use(id);
+                tr.commit();
+            } catch (...) {
+                restore();
+                throw;
+            }
+            restore();
+
+            app.router().updateSchemaCache(plan.entity, plan.target.toJSON());
+            return true;
+        }
+    }
+
+    SchemaMigrations::Options SchemaMigrations::Options::fromEnv() {
+        Options options;
+        if (const auto batch = safe_stoi(getEnvOrDefault("MB_MIGRATION_BATCH", ""), 0); batch > 0)
+            options.batch = static_cast<std::size_t>(batch);
+        if (const auto ms = safe_stoi(getEnvOrDefault("MB_MIGRATION_PAUSE_MS", ""), -1); ms >= 0)
+            options.pause = std::chrono::milliseconds(ms);
+        return options;
+    }
+
+    SchemaMigrations::SchemaMigrations(const Options options) : m_options(options) {}
+
+    SchemaMigrations::~SchemaMigrations() {
+        stop();
+    }
+
+    void SchemaMigrations::start() {
+        std::lock_guard lock(m_mutex);
+        if (m_thread.joinable()) return;
+        m_stopping = false;
+        m_wake = true; // Migrations a restart interrupted go first
+        m_thread = std::thread(&SchemaMigrations::loop, this);
+    }
+
+    void SchemaMigrations::stop() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+    void SchemaMigrations::notify() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_wake = true;
+        }
+        m_cv.notify_one();
+    }
+
+    json SchemaMigrations::begin(const std::string &table_id, const json &new_schema) {
+        const auto &app = MantisBase::instance();
+        const auto db_type = app.dbType();
+        if (db_type != "sqlite3" && db_type != "postgresql")
+            throw MantisException(400, std::format("Online migrations aren't supported on `{}`", db_type));
+        if (new_schema.empty())
+            throw MantisException(400, "Schema body is empty!");
+        if (active(table_id))
+            throw MantisException(409, "This entity is already migrating; wait for it or cancel it first.");
+
+        {
+            const auto sql = app.db().writeSession();
+            soci::transaction tr(*sql);
+
+            json current;
+            *sql << "SELECT schema FROM mb_tables WHERE id = :id", soci::use(table_id), soci::into(current);
+            if (!sql->got_data())
+                throw MantisException(404, "Entity resource for given name/id was not found!");
+
+            auto old_entity = EntitySchema::fromSchema(app, current);
+            EntitySchema new_entity{old_entity};
+            new_entity.updateWith(new_schema);
+            if (const auto err = new_entity.validate(); err.has_value())
+                throw MantisException(400, err.value());
+
+            if (old_entity.type() == "view")
+                throw MantisException(400, "Views hold no rows to migrate; update them directly.");
+            if (old_entity.shards() > 1)
+                throw MantisException(400, "Sharded entities can't be migrated online.");
+            if (old_entity.type() != new_entity.type() || old_entity.name() != new_entity.name())
+                throw MantisException(400, "Renaming an entity or changing its type can't be done online.");
+            // Field ids derive from names, so the copy can't tell a renamed field from a new one
+            for (const auto &field: new_schema.value("fields", json::array())) {
+                if (!field.is_object() || !field.contains("id") || !field.contains("name")) continue;
+                const auto id = field["id"].get<std::string>();
+                if (old_entity.hasFieldById(id) && old_entity.fieldById(id).name() != field["name"].get<std::string>())
+                    throw MantisException(400, "Rename fields with a regular update, not online.");
+            }
+
+            const auto target = new_entity.toJSON();
+            const auto plan = planFor(app, current, target);
+            if (std::ranges::find(plan.to, "id") == plan.to.end())
+                throw MantisException(400, "Online migrations copy rows by `id`, which the entity must keep.");
+            for (const auto &field: plan.target.fields()) {
+                const bool copied = std::ranges::find(plan.to, field.name()) != plan.to.end();
+                if (!copied && field.required() && field.constraint("default_value").is_null())
+                    throw MantisException(400, std::format(
+                                              "New required field `{}` needs a `default_value` to be added online.",
+                                              field.name()));
+            }
+
+            if (db_type == "postgresql") {
+                // Those would follow the old table into the DROP
+                long long dependents = 0;
+                *sql << "SELECT (SELECT COUNT(*) FROM pg_constraint WHERE contype = 'f' "
+                        "AND confrelid = to_regclass(:t) AND conrelid <> confrelid) + "
+                        "(SELECT COUNT(*) FROM pg_depend d JOIN pg_rewrite r ON r.oid = d.objid "
+                        "WHERE d.refobjid = to_regclass(:t2) AND r.ev_class <> d.refobjid)",
+                        soci::use(plan.entity, "t"), soci::use(plan.entity, "t2"), soci::into(dependents);
+                if (dependents > 0)
+                    throw MantisException(409, "Other tables or views depend on this entity; "
+                                          "update it without `online` instead.");
+            }
+
+            // A failed or cancelled attempt may have left its shadow behind
+            dropShadow(*sql, db_type, plan.entity);
+            EntitySchema shadow{plan.target};
+            shadow.setName(plan.shadow);
+            *sql << shadow.toDDL();
+            for (const auto &ddl: captureDDL(db_type, plan)) *sql << ddl;
+
+            long long total = 0;
+            *sql << std::format("SELECT COUNT(*) FROM {}", plan.entity), soci::into(total);
+
+            const auto target_text = target.dump();
+            const auto now = getCurrentTimestampUTC();
+            *sql << "DELETE FROM mb_schema_migrations WHERE id = :id", soci::use(table_id);
+            *sql << "INSERT INTO mb_schema_migrations (id, entity, target, state, last_id, copied, total, created, updated) "
+                    "VALUES (:id, :entity, :target, 'copying', '', 0, :total, :created, :updated)",
+                    soci::use(table_id), soci::use(plan.entity), soci::use(target_text), soci::use(total),
+                    soci::use(now), soci::use(now);
+            tr.commit();
+        }
+
+        LogOrigin::entitySchemaInfo("Online Migration", fmt::format("Migrating `{}` in the background", table_id));
+        notify();
+        return status(table_id);
+    }
+
+    json SchemaMigrations::status(const std::string &table_id) {
+        const auto sql = MantisBase::instance().db().session();
+
+        std::string entity, state, error, created, updated;
+        long long copied = 0, total = 0;
+        soci::indicator error_ind = soci::i_null;
+        *sql << "SELECT entity, state, copied, total, error, created, updated FROM mb_schema_migrations WHERE id = :id",
+                soci::use(table_id), soci::into(entity), soci::into(state), soci::into(copied), soci::into(total),
+                soci::into(error, error_ind), soci::into(created), soci::into(updated);
+        if (!sql->got_data())
+            throw MantisException(404, "No migration on record for this entity.");
+
+        const double progress = state == "done"
+                                    ? 1.0
+                                    : total > 0
+                                          ? std::min(1.0, static_cast<double>(copied) / static_cast<double>(total))
+                                          : 0.0;
+        return {
+            {"entity", entity},
+            {"state", state},
+            {"copied", copied},
+            {"total", total},
+            {"progress", progress},
+            {"error", error_ind == soci::i_ok ? json(error) : json(nullptr)},
+            {"created", created},
+            {"updated", updated}
+        };
+    }
+
+    bool SchemaMigrations::active(const std::string &table_id) {
+        const auto sql = MantisBase::instance().db().session();
+        int found = 0;
+        *sql << "SELECT 1 FROM mb_schema_migrations WHERE id = :id AND state = 'copying'",
+                soci::use(table_id), soci::into(found);
+        return sql->got_data();
+    }
+
+    void SchemaMigrations::cancel(const std::string &table_id) {
+        std::lock_guard step_lock(m_stepMutex);
+        const auto &app = MantisBase::instance();
+
+        std::string entity, state;
+        {
+            const auto sql = app.db().session();
+            *sql << "SELECT entity, state FROM mb_schema_migrations WHERE id = :id",
+                    soci::use(table_id), soci::into(entity), soci::into(state);
+            if (!sql->got_data())
+                throw MantisException(404, "No migration on record for this entity.");
+        }
+
+        app.db().write([&](soci::session &sql) {
+            if (state == "copying") dropShadow(sql, app.dbType(), sqlIdentifier(entity));
+            sql << "DELETE FROM mb_schema_migrations WHERE id = :id", soci::use(table_id);
+        });
+    }
+
+    bool SchemaMigrations::step() {
+        std::lock_guard step_lock(m_stepMutex);
+        const auto &app = MantisBase::instance();
+        const auto db_type = app.dbType();
+
+        std::string id, entity, target_text, last;
+        json current;
+        {
+            const auto sql = app.db().session();
+            *sql << "SELECT id, entity, target, last_id FROM mb_schema_migrations WHERE state = 'copying' "
+                    "ORDER BY created LIMIT 1",
+                    soci::into(id), soci::into(entity), soci::into(target_text), soci::into(last);
+            if (!sql->got_data()) return false;
+
+            *sql << "SELECT schema FROM mb_tables WHERE id = :id", soci::use(id), soci::into(current);
+        }
+
+        try {
+            if (current.is_null())
+                throw MantisException(404, "The entity was dropped.");
+            const auto plan = planFor(app, current, json::parse(target_text));
+
+            // The batch's last id, when there are more rows than one batch after `last`
+            std::optional<std::string> hi;
+            {
+                const auto sql = app.db().session();
+                std::string bound;
+                *sql << std::format("SELECT id FROM {} WHERE id > :last ORDER BY id LIMIT 1 OFFSET {}",
+                                    plan.entity, m_options.batch - 1), soci::use(last), soci::into(bound);
+                if (sql->got_data()) hi = bound;
+            }
+
+            if (!hi) {
+                if (!swapIn(app, id, plan, last)) return true;
+                ++m_completed;
+                LogOrigin::entitySchemaInfo("Online Migration", fmt::format("`{}` now runs on its new schema", entity));
+                return true;
+            }
+
+            app.db().write([&](soci::session &sql) {
+                if (!claim(sql, id, last)) return;
+                const auto copied = copyRange(sql, plan, db_type, last, hi);
+                const auto now = getCurrentTimestampUTC();
+                // With the batch, so a restart resumes right after it
+                sql << "UPDATE mb_schema_migrations SET last_id = :last, copied = copied + :n, updated = :u "
+                        "WHERE id = :id", soci::use(*hi), soci::use(copied), soci::use(now), soci::use(id);
+            });
+        } catch (const MantisException &e) {
+            // No connection to be had: the next round tries again
+            if (e.code() == 503) throw;
+            fail(id, entity, e.what());
+        } catch (const std::exception &e) {
+            fail(id, entity, e.what());
+        }
+        return true;
+    }
+
+    void SchemaMigrations::fail(const std::string &table_id, const std::string &entity, const std::string &error) {
+        // Left in place, the triggers would keep failing writes the new schema rejects
+        LogOrigin::entitySchemaWarn("Online Migration", fmt::format("Migrating `{}` failed: {}", entity, error));
+        const auto &app = MantisBase::instance();
+        app.db().write([&](soci::session &sql) {
+            dropShadow(sql, app.dbType(), sqlIdentifier(entity));
+            const auto now = getCurrentTimestampUTC();
+            sql << "UPDATE mb_schema_migrations SET state = 'failed', error = :e, updated = :u "
+                    "WHERE id = :id AND state = 'copying'",
+                    soci::use(error), soci::use(now), soci::use(table_id);
+        });
+    }
+
+    void SchemaMigrations::loop() {
+        std::unique_lock lock(m_mutex);
+        while (!m_stopping) {
+            m_wake = false;
+            lock.unlock();
+
+            bool more = false;
+            try {
+                more = step();
+            } catch (const std::exception &e) {
+                LogOrigin::warn("Online Migration", fmt::format("Migration step failed, retrying later: {}", e.what()));
+            }
+
+            lock.lock();
+            m_cv.wait_for(lock, more ? m_options.pause : std::chrono::milliseconds(m_options.poll),
+                          [this] { return m_stopping || m_wake; });
+        }
+    }
+}
@@ -0,0 +1,351 @@
+/**
+ * @file script_heaps.cpp
+ * @brief Implementation for @see script_heaps.h
+ */
+
+#ifdef MB_SCRIPTING_ENABLED
+#include "../../include/mantisbase/core/script_heaps.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/utils/crypto_utils.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <utility>
+
+namespace mb {
+    namespace {
+        std::atomic<std::uint64_t> g_nextId{1};
+
+        struct Cached {
+            std::uint64_t pool = 0;
+            void *heap = nullptr;
+        };
+
+        thread_local Cached t_cached;
+
+        /// The ScriptHeaps::Staging of a reload() running on this thread
+        thread_local void *t_staging = nullptr;
+
+        /// A cache file is the bytecode's SHA-256 followed by the bytecode; Duktape doesn't check bytecode itself
+        constexpr std::size_t DIGEST_HEX = 64;
+
+        /// Stack: [bytecode buffer] -> [result]; run under duk_safe_call so a bad buffer can't abort
+        duk_ret_t runBytecode(duk_context *ctx, void *) {
+            duk_load_function(ctx);
+            duk_call(ctx, 0);
+            return 1;
+        }
+
+        /// Run `bytecode` on `ctx`; the JS error if it throws
+        std::optional<std::string> run(duk_context *ctx, const std::string &bytecode) {
+            auto *buffer = duk_push_fixed_buffer(ctx, bytecode.size());
+            std::memcpy(buffer, bytecode.data(), bytecode.size());
+
+            std::optional<std::string> error;
+            if (duk_safe_call(ctx, &runBytecode, nullptr, 1, 1) != DUK_EXEC_SUCCESS)
+                error = duk_safe_to_string(ctx, -1);
+            duk_pop(ctx);
+            return error;
+        }
+    }
+
+    /// Scripts a reload() loads, and the heap they are loaded on, until they replace the old ones
+    struct ScriptHeaps::Staging {
+        std::uint64_t pool;
+        std::unique_ptr<Heap> heap;
+        std::deque<std::shared_ptr<const Script>> scripts;
+        std::optional<std::string> error; ///> Of the first load() that failed
+    };
+
+    std::chrono::milliseconds ScriptHeaps::Budgets::of(const std::string &name) const {
+        const auto it = overrides.find(name);
+        return it != overrides.end() ? it->second : fallback;
+    }
+
+    ScriptHeaps::Budgets ScriptHeaps::Budgets::fromEnv() {
+        Budgets b;
+        b.fallback = std::chrono::milliseconds(
+            std::max(0, safe_stoi(getEnvOrDefault("MB_SCRIPT_BUDGET_MS", ""), static_cast<int>(b.fallback.count()))));
+
+        for (const auto &entry: splitString(getEnvOrDefault("MB_SCRIPT_BUDGETS", ""), ",")) {
+            const auto eq = entry.find('=');
+            if (eq == std::string::npos) continue;
+            const auto name = trim(entry.substr(0, eq));
+            const auto ms = safe_stoi(trim(entry.substr(eq + 1)), -1);
+            if (name.empty() || ms < 0) {
+                LogOrigin::warn("Script Budgets", fmt::format("Ignoring MB_SCRIPT_BUDGETS entry `{}`", entry));
+                continue;
+            }
+            b.overrides[name] = std::chrono::milliseconds(ms);
+        }
+        return b;
+    }
+
+    ScriptHeaps::Budget::Budget(duk_context *ctx, const std::chrono::milliseconds limit) {
+        duk_memory_functions funcs{};
+        duk_get_memory_functions(ctx, &funcs);
+        m_deadline = static_cast<Deadline *>(funcs.udata);
+        if (!m_deadline) return;
+
+        m_outer = *m_deadline;
+        if (limit.count() > 0)
+            m_deadline->at = std::min(m_outer.at, std::chrono::steady_clock::now() + limit);
+    }
+
+    ScriptHeaps::Budget::~Budget() {
+        // Should the outer deadline have passed too, the next check trips it again
+        if (m_deadline) *m_deadline = m_outer;
+    }
+
+    bool ScriptHeaps::Budget::exceeded() const {
+        return m_deadline && m_deadline->expired;
+    }
+
+    ScriptHeaps::ScriptHeaps(Init init, std::filesystem::path cache_dir)
+        : ScriptHeaps(std::move(init), std::move(cache_dir), Budgets{}) {}
+
+    ScriptHeaps::ScriptHeaps(Init init, std::filesystem::path cache_dir, Budgets budgets)
+        : m_init(std::move(init)), m_cacheDir(std::move(cache_dir)), m_budgets(std::move(budgets)),
+          m_id(g_nextId.fetch_add(1)) {}
+
+    ScriptHeaps::~ScriptHeaps() = default;
+
+    ScriptHeaps::Heap::~Heap() {
+        if (ctx) duk_destroy_heap(ctx);
+    }
+
+    std::unique_ptr<ScriptHeaps::Heap> ScriptHeaps::makeHeap() {
+        auto heap = std::make_unique<Heap>();
+        heap->owner = std::this_thread::get_id();
+        heap->ctx = duk_create_heap(nullptr, nullptr, nullptr, &heap->deadline, nullptr);
+        if (!heap->ctx) {
+            LogOrigin::critical("Scripting", "Failed to create Duktape heap");
+            return nullptr;
+        }
+        return heap;
+    }
+
+    duk_context *ScriptHeaps::current() {
+        if (const auto *staging = static_cast<Staging *>(t_staging); staging && staging->pool == m_id)
+            return staging->heap->ctx;
+
+        auto *heap = t_cached.pool == m_id ? static_cast<Heap *>(t_cached.heap) : nullptr;
+
+        if (!heap) {
+            const auto self = std::this_thread::get_id();
+            std::unique_lock lock(m_mutex);
+            for (const auto &h: m_heaps) {
+                if (h->owner == self) {
+                    heap = h.get();
+                    break;
+                }
+            }
+
+            if (!heap) {
+                auto created = makeHeap();
+                if (!created) return nullptr;
+                created->generation = m_generation.load();
+                heap = m_heaps.emplace_back(std::move(created)).get();
+                lock.unlock();
+
+                // Bindings look the heap up through MantisBase::ctx(), which lands back here
+                t_cached = {m_id, heap};
+                heap->busy = true;
+                m_init(heap->ctx);
+                heap->busy = false;
+            }
+            t_cached = {m_id, heap};
+        }
+
+        if (!heap->ctx) return nullptr;
+        // A heap of an older generation keeps its scripts until checkpoint() rebuilds it
+        if (!heap->busy && heap->generation == m_generation.load(std::memory_order_acquire) &&
+            heap->loaded < m_count.load(std::memory_order_acquire))
+            catchUp(*heap);
+        return heap->ctx;
+    }
+
+    void ScriptHeaps::catchUp(Heap &heap) {
+        std::vector<std::shared_ptr<const Script>> pending;
+        {
+            std::lock_guard lock(m_mutex);
+            if (heap.generation != m_generation.load()) return;
+            for (auto i = heap.loaded; i < m_scripts.size(); ++i) pending.push_back(m_scripts[i]);
+        }
+
+        heap.busy = true;
+        for (const auto &script: pending) {
+            ++heap.loaded;
+            if (const auto error = run(heap.ctx, script->bytecode)) {
+                LogOrigin::warn("Script Error",
+                                fmt::format("`{}` failed on a worker heap: {}", script->name, *error));
+            }
+        }
+        heap.busy = false;
+    }
+
+    void ScriptHeaps::load(const std::string &name, const std::string &source) {
+        if (auto *staging = static_cast<Staging *>(t_staging); staging && staging->pool == m_id) {
+            const auto ctx = staging->heap->ctx;
+            try {
+                auto script = std::make_shared<const Script>(Script{name, bytecodeOf(ctx, name, source)});
+                if (const auto error = run(ctx, script->bytecode)) throw MantisException(500, *error);
+                staging->scripts.push_back(std::move(script));
+                ++staging->heap->loaded;
+            } catch (const MantisException &e) {
+                if (!staging->error) staging->error = fmt::format("`{}`: {}", name, e.what());
+                throw;
+            }
+            return;
+        }
+
+        const auto ctx = current();
+        if (!ctx) throw MantisException(500, "No Duktape heap to run the script on");
+        auto *heap = static_cast<Heap *>(t_cached.heap);
+
+        auto script = std::make_shared<const Script>(Script{name, bytecodeOf(ctx, name, source)});
+        if (const auto error = run(ctx, script->bytecode)) throw MantisException(500, *error);
+
+        std::lock_guard lock(m_mutex);
+        m_scripts.push_back(std::move(script));
+        // Ran here already, unless other scripts were loaded meanwhile and this heap is still behind
+        if (heap->loaded + 1 == m_scripts.size()) ++heap->loaded;
+        m_count.store(m_scripts.size(), std::memory_order_release);
+    }
+
+    std::size_t ScriptHeaps::reload(const std::function<void()> &load_all) {
+        std::lock_guard reloading(m_reloadMutex);
+        Staging staging{m_id, makeHeap()};
+        if (!staging.heap) throw MantisException(500, "No Duktape heap to run the scripts on");
+
+        {
+            // The bindings' and load_all's calls into this pool land on the fresh heap meanwhile
+            struct Restore {
+                void *previous;
+                ~Restore() { t_staging = previous; }
+            } restore{std::exchange(t_staging, &staging)};
+
+            staging.heap->busy = true;
+            m_init(staging.heap->ctx);
+            staging.heap->busy = false;
+            load_all();
+        }
+        if (staging.error) throw MantisException(500, *staging.error);
+
+        // Freed once the lock is released; nothing of this thread runs on it now
+        std::unique_ptr<Heap> replaced;
+        std::lock_guard lock(m_mutex);
+        m_scripts = std::move(staging.scripts);
+        const auto generation = m_generation.load() + 1;
+        staging.heap->generation = generation;
+
+        auto *fresh = staging.heap.get();
+        const auto self = std::this_thread::get_id();
+        const auto mine = std::ranges::find_if(m_heaps, [&](const auto &h) { return h->owner == self; });
+        if (mine != m_heaps.end()) {
+            replaced = std::exchange(*mine, std::move(staging.heap));
+        } else {
+            m_heaps.push_back(std::move(staging.heap));
+        }
+        t_cached = {m_id, fresh};
+
+        m_count.store(m_scripts.size(), std::memory_order_release);
+        m_generation.store(generation, std::memory_order_release);
+        return m_scripts.size();
+    }
+
+    void ScriptHeaps::checkpoint() {
+        auto *heap = t_cached.pool == m_id ? static_cast<Heap *>(t_cached.heap) : nullptr;
+        if (!heap || heap->busy || heap->generation == m_generation.load(std::memory_order_acquire)) return;
+
+        if (heap->ctx) duk_destroy_heap(heap->ctx);
+        heap->deadline = {};
+        heap->loaded = 0;
+        heap->ctx = duk_create_heap(nullptr, nullptr, nullptr, &heap->deadline, nullptr);
+        {
+            std::lock_guard lock(m_mutex);
+            heap->generation = m_generation.load();
+        }
+        if (!heap->ctx) {
+            LogOrigin::critical("Scripting", "Failed to create Duktape heap");
+            return;
+        }
+
+        heap->busy = true;
+        m_init(heap->ctx);
+        heap->busy = false;
+        catchUp(*heap);
+    }
+
+    std::string ScriptHeaps::bytecodeOf(duk_context *ctx, const std::string &name, const std::string &source) {
+        // Bytecode embeds the file name and is only readable by the Duktape build that wrote it
+        std::filesystem::path file;
+        if (!m_cacheDir.empty()) {
+            file = m_cacheDir / (sha256Hex(fmt::format("{}\n{}\n{}", DUK_VERSION, name, source)) + ".jsbc");
+
+            std::ifstream in(file, std::ios::binary);
+            std::stringstream buffer;
+            buffer << in.rdbuf();
+            if (auto cached = buffer.str(); cached.size() > DIGEST_HEX) {
+                auto bytecode = cached.substr(DIGEST_HEX);
+                if (sha256Hex(bytecode) == cached.substr(0, DIGEST_HEX)) return bytecode;
+            }
+        }
+
+        duk_push_lstring(ctx, source.data(), source.size());
+        duk_push_lstring(ctx, name.data(), name.size());
+        if (duk_pcompile(ctx, 0) != 0) {
+            std::string error = duk_safe_to_string(ctx, -1);
+            duk_pop(ctx);
+            throw MantisException(500, error);
+        }
+        ++m_compiles;
+
+        duk_dump_function(ctx);
+        duk_size_t size = 0;
+        const auto *data = static_cast<const char *>(duk_get_buffer(ctx, -1, &size));
+        std::string bytecode(data, size);
+        duk_pop(ctx);
+
+        if (!file.empty()) {
+            // Write-then-rename so another node or a crash never leaves half a file behind
+            std::error_code ec;
+            std::filesystem::create_directories(m_cacheDir, ec);
+            auto tmp = file;
+            tmp += fmt::format(".{}.tmp", m_id);
+            {
+                std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+                out << sha256Hex(bytecode) << bytecode;
+            }
+            std::filesystem::rename(tmp, file, ec);
+            if (ec) {
+                std::filesystem::remove(tmp, ec);
+                LogOrigin::warn("Script Cache", fmt::format("Could not cache `{}`: {}", name, ec.message()));
+            }
+        }
+        return bytecode;
+    }
+
+    std::size_t ScriptHeaps::size() const {
+        std::lock_guard lock(m_mutex);
+        return m_heaps.size();
+    }
+
+    std::size_t ScriptHeaps::scripts() const {
+        return m_count.load();
+    }
+}
+
+/// Duktape's DUK_USE_EXEC_TIMEOUT_CHECK (see duk_config.h); once true it must stay true until the error is out of Duktape
+extern "C" int mb_duk_exec_timeout_check(void *udata) {
+    auto *deadline = static_cast<mb::ScriptHeaps::Deadline *>(udata);
+    if (!deadline) return 0;
+    if (!deadline->expired && std::chrono::steady_clock::now() >= deadline->at) deadline->expired = true;
+    return deadline->expired ? 1 : 0;
+}
+#endif // MB_SCRIPTING_ENABLED
@@ -0,0 +1,228 @@
+#include "../../include/mantisbase/core/send_queue.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <trantor/net/EventLoop.h>
+
+namespace mb {
+    SendQueue::Options SendQueue::Options::fromEnv() {
+        Options options;
+        if (const auto size = safe_stoi(getEnvOrDefault("MB_REALTIME_QUEUE_SIZE", ""), 0); size > 0)
+            options.capacity = static_cast<std::size_t>(size);
+        options.overflow = parseOverflow(getEnvOrDefault("MB_REALTIME_OVERFLOW", ""), options.overflow);
+        return options;
+    }
+
+    SendQueue::SendQueue(Options options, Executor executor, Writer writer, Closer closer,
+                         std::shared_ptr<Counters> counters)
+        : m_options(options),
+          m_executor(std::move(executor)),
+          m_writer(std::move(writer)),
+          m_closer(std::move(closer)),
+          m_counters(counters ? std::move(counters) : std::make_shared<Counters>()) {
+        m_options.capacity = std::max<std::size_t>(1, m_options.capacity);
+    }
+
+    bool SendQueue::push(std::shared_ptr<const EncodedEvent> event, const Frame frame) {
+        bool needs_drain = false, evicted = false;
+        {
+            std::lock_guard lock(m_mutex);
+            if (m_closed) return false;
+
+            if (m_items.size() >= m_options.capacity) {
+                if (m_options.overflow == Overflow::Disconnect) {
+                    m_closed = evicted = true;
+                    m_items.clear();
+                    ++m_counters->evicted;
+                } else if (m_options.overflow == Overflow::Coalesce) {
+                    // Latest state of the row wins; the pending slot keeps its place
+                    const auto it = std::ranges::find_if(m_items, [&](const Item &item) {
+                        return item.event->rowTopic() == event->rowTopic();
+                    });
+                    if (it != m_items.end()) {
+                        it->event = std::move(event);
+                        ++m_counters->coalesced;
+                        return true;
+                    }
+                }
+
+                if (!m_closed) {
+                    m_items.pop_front();
+                    ++m_counters->dropped;
+                }
+            }
+
+            if (!m_closed) {
+                m_items.push_back({std::move(event), frame});
+                needs_drain = !m_scheduled;
+                m_scheduled = true;
+            }
+        }
+
+        if (evicted) {
+            if (m_closer) m_closer();
+            return false;
+        }
+
+        if (needs_drain) schedule();
+        return true;
+    }
+
+    void SendQueue::close() {
+        std::lock_guard lock(m_mutex);
+        m_closed = true;
+        m_items.clear();
+    }
+
+    bool SendQueue::isClosed() const {
+        std::lock_guard lock(m_mutex);
+        return m_closed;
+    }
+
+    std::size_t SendQueue::depth() const {
+        std::lock_guard lock(m_mutex);
+        return m_items.size();
+    }
+
+    SendQueue::Executor SendQueue::onLoop(trantor::EventLoop *loop) {
+        if (!loop) return {};
+        return [loop](Task task) { loop->queueInLoop(std::move(task)); };
+    }
+
+    SendQueue::Overflow SendQueue::parseOverflow(const std::string &name, const Overflow fallback) {
+        if (name == "drop-oldest") return Overflow::DropOldest;
+        if (name == "coalesce") return Overflow::Coalesce;
+        if (name == "disconnect") return Overflow::Disconnect;
+        return fallback;
+    }
+
+    std::string SendQueue::overflowName(const Overflow overflow) {
+        switch (overflow) {
+            case Overflow::Coalesce: return "coalesce";
+            case Overflow::Disconnect: return "disconnect";
+            default: return "drop-oldest";
+        }
+    }
+
+    void SendQueue::schedule() {
+        if (!m_executor) {
+            drain();
+            return;
+        }
+
+        m_executor([weak = weak_from_this()] {
+            if (const auto self = weak.lock()) self->drain();
+        });
+    }
+
+    void SendQueue::drain() {
+        if (m_options.batch) {
+            drainBatch();
+            return;
+        }
+
+        for (std::size_t sent = 0; sent < DRAIN_BATCH; ++sent) {
+            Item item;
+            {
+                std::lock_guard lock(m_mutex);
+                if (m_closed || m_items.empty()) {
+                    m_scheduled = false;
+                    return;
+                }
+                item = std::move(m_items.front());
+                m_items.pop_front();
+            }
+
+            if (!m_writer(encode(item))) {
+                close();
+                std::lock_guard lock(m_mutex);
+                m_scheduled = false;
+                return;
+            }
+        }
+
+        // Batch exhausted with events left; yield so other subscribers on the loop get a turn
+        schedule();
+    }
+
+    void SendQueue::drainBatch() {
+        std::vector<Item> items;
+        bool more = false;
+        {
+            std::lock_guard lock(m_mutex);
+            if (m_closed || m_items.empty()) {
+                m_scheduled = false;
+                return;
+            }
+            const auto n = std::min(m_items.size(), DRAIN_BATCH);
+            items.assign(std::make_move_iterator(m_items.begin()), std::make_move_iterator(m_items.begin() + n));
+            m_items.erase(m_items.begin(), m_items.begin() + n);
+            more = !m_items.empty();
+            if (!more) m_scheduled = false;
+        }
+
+        const bool ok = items.size() == 1 ? m_writer(encode(items.front())) : m_writer(encodeBatch(items));
+        if (!ok) {
+            close();
+            std::lock_guard lock(m_mutex);
+            m_scheduled = false;
+            return;
+        }
+
+        if (more) schedule();
+    }
+
+    std::string SendQueue::encodeBatch(const std::vector<Item> &items) const {
+        const auto format = m_options.format;
+        std::string frame;
+        if (items.front().frame == Frame::Ws) {
+            if (format != WireFormat::Format::Json) {
+                json events = json::array();
+                for (const auto &item: items) events.push_back(item.event->wsJson());
+                return WireFormat::encode(format, {{"type", "batch"}, {"events", std::move(events)}});
+            }
+
+            // Joins the cached per-event encodings; nothing is dumped again
+            frame = R"({"type":"batch","events":[)";
+            for (std::size_t i = 0; i < items.size(); ++i) {
+                if (i) frame += ',';
+                frame += items[i].event->ws();
+            }
+            frame += "]}";
+            return frame;
+        }
+
+        std::uint64_t last_id = 0;
+        std::string data;
+        if (format != WireFormat::Format::Json) {
+            json events = json::array();
+            for (const auto &item: items) {
+                events.push_back(item.event->dataJson(item.frame == Frame::SseRow));
+                last_id = std::max(last_id, item.event->id());
+            }
+            data = WireFormat::encodeText(format, events);
+        } else {
+            data = "[";
+            for (std::size_t i = 0; i < items.size(); ++i) {
+                if (i) data += ',';
+                data += items[i].event->data(items[i].frame == Frame::SseRow);
+                last_id = std::max(last_id, items[i].event->id());
+            }
+            data += ']';
+        }
+
+        if (last_id) frame = "id: " + std::to_string(last_id) + "\n";
+        frame += "event: batch\ndata: ";
+        frame += data;
+        frame += "\n\n";
+        return frame;
+    }
+
+    const std::string &SendQueue::encode(const Item &item) const {
+        switch (item.frame) {
+            case Frame::SseRow: return item.event->sse(true, m_options.format);
+            case Frame::Ws: return item.event->ws(m_options.format);
+            default: return item.event->sse(false, m_options.format);
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#include "../../include/mantisbase/core/server_timing.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <format>
+
+namespace mb {
+    namespace {
+        thread_local ServerTiming *t_current = nullptr;
+    }
+
+    ServerTiming::Mode ServerTiming::modeFromEnv() {
+        const auto mode = getEnvOrDefault("MB_SERVER_TIMING", "admin");
+        if (mode == "off" || mode == "0") return Mode::Off;
+        if (mode == "all") return Mode::All;
+        return Mode::Admin;
+    }
+
+    ServerTiming *ServerTiming::current() {
+        return t_current;
+    }
+
+    void ServerTiming::add(const std::string_view name, const Clock::duration duration) {
+        for (auto &entry: m_entries) {
+            if (entry.name == name) {
+                entry.duration += duration;
+                return;
+            }
+        }
+        m_entries.push_back({name, duration});
+    }
+
+    std::string ServerTiming::header(const Clock::duration total) const {
+        const auto ms = [](const Clock::duration d) {
+            return std::chrono::duration<double, std::milli>(d).count();
+        };
+
+        std::string out;
+        for (const auto &[name, duration]: m_entries)
+            out += std::format("{};dur={:.3f}, ", name, ms(duration));
+        out += std::format("total;dur={:.3f}", ms(total));
+        return out;
+    }
+
+    ServerTiming::Scope::Scope(ServerTiming *timing) : m_previous(t_current) {
+        t_current = timing;
+    }
+
+    ServerTiming::Scope::~Scope() {
+        t_current = m_previous;
+    }
+
+    ServerTiming::Span::Span(const std::string_view name)
+        : m_timing(t_current), m_name(name) {
+        if (m_timing) m_start = Clock::now();
+    }
+
+    ServerTiming::Span::~Span() {
+        if (m_timing) m_timing->add(m_name, Clock::now() - m_start);
+    }
+}
@@ -0,0 +1,99 @@
+#include "../../include/mantisbase/core/session_cache.h"
+
+#include <algorithm>
+#include <functional>
+
+namespace mb {
+    SessionCache::SessionCache(const std::size_t capacity, const std::chrono::seconds negative_ttl)
+        : m_shardCapacity(std::max<std::size_t>(1, capacity / SHARD_COUNT)),
+          m_negativeTtl(negative_ttl) {}
+
+    SessionCache::State SessionCache::lookup(const std::string &session_id) {
+        auto &shard = shardFor(session_id);
+        std::lock_guard lock(shard.mutex);
+
+        const auto it = shard.entries.find(session_id);
+        if (it == shard.entries.end())
+            return State::Unknown;
+
+        if (it->second.expiresAt <= Clock::now()) {
+            shard.entries.erase(it);
+            return State::Unknown;
+        }
+
+        return it->second.state;
+    }
+
+    std::uint64_t SessionCache::generation(const std::string &session_id) {
+        auto &shard = shardFor(session_id);
+        std::lock_guard lock(shard.mutex);
+        return shard.generation;
+    }
+
+    void SessionCache::putValid(const std::string &session_id, const Clock::time_point expires_at,
+                                const std::optional<std::uint64_t> since) {
+        const auto now = Clock::now();
+        if (expires_at <= now) return;
+
+        auto &shard = shardFor(session_id);
+        std::lock_guard lock(shard.mutex);
+        // Revoked while it was being checked; the next request checks again
+        if (since && *since != shard.generation) return;
+        if (const auto it = shard.entries.find(session_id);
+            it != shard.entries.end() && it->second.state == State::Revoked && it->second.expiresAt > now)
+            return;
+        insertLocked(shard, session_id, {State::Valid, expires_at});
+    }
+
+    void SessionCache::putRevoked(const std::string &session_id) {
+        auto &shard = shardFor(session_id);
+        std::lock_guard lock(shard.mutex);
+        ++shard.generation;
+        insertLocked(shard, session_id, {State::Revoked, Clock::now() + m_negativeTtl});
+    }
+
+    void SessionCache::erase(const std::string &session_id) {
+        auto &shard = shardFor(session_id);
+        std::lock_guard lock(shard.mutex);
+        ++shard.generation;
+        shard.entries.erase(session_id);
+    }
+
+    void SessionCache::clear() {
+        for (auto &shard: m_shards) {
+            std::lock_guard lock(shard.mutex);
+            shard.entries.clear();
+        }
+    }
+
+    std::size_t SessionCache::size() const {
+        std::size_t total = 0;
+        for (const auto &shard: m_shards) {
+            std::lock_guard lock(shard.mutex);
+            total += shard.entries.size();
+        }
+        return total;
+    }
+
+    SessionCache::Shard &SessionCache::shardFor(const std::string &session_id) {
+        return m_shards[std::hash<std::string>{}(session_id) % SHARD_COUNT];
+    }
+
+    void SessionCache::insertLocked(Shard &shard, const std::string &session_id, const Entry entry) {
+        if (const auto it = shard.entries.find(session_id); it != shard.entries.end()) {
+            it->second = entry;
+            return;
+        }
+
+        if (shard.entries.size() >= m_shardCapacity) {
+            // Purge expired entries first; if the shard is still full, evict
+            // whatever comes first. A dropped entry only costs one DB lookup.
+            const auto now = Clock::now();
+            std::erase_if(shard.entries, [now](const auto &kv) { return kv.second.expiresAt <= now; });
+            if (shard.entries.size() >= m_shardCapacity)
+                shard.entries.erase(shard.entries.begin());
+        }
+
+        shard.entries.emplace(session_id, entry);
+    }
+}
@@ -0,0 +1,201 @@
+/**
+ * @file session_store.cpp
+ * @brief Implementation for @see session_store.h
+ */
+
+#include "../../include/mantisbase/core/session_store.h"
+#include "../../include/mantisbase/core/database.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <format>
+#include <utility>
+
+namespace mb {
+    SessionStore::Options SessionStore::Options::fromEnv() {
+        Options options;
+        if (const auto ms = safe_stoi(getEnvOrDefault("MB_SESSION_FLUSH_MS", ""), -1); ms >= 0)
+            options.flushInterval = std::chrono::milliseconds(ms);
+        if (const auto secs = safe_stoi(getEnvOrDefault("MB_SESSION_SWEEP_INTERVAL", ""), -1); secs >= 0)
+            options.sweepInterval = std::chrono::seconds(secs);
+        if (const auto batch = safe_stoi(getEnvOrDefault("MB_SESSION_SWEEP_BATCH", ""), 0); batch > 0)
+            options.sweepBatch = static_cast<std::size_t>(batch);
+        return options;
+    }
+
+    SessionStore::SessionStore(const Options options) : m_options(options) {}
+
+    SessionStore::~SessionStore() {
+        stop();
+    }
+
+    void SessionStore::start() {
+        std::lock_guard lock(m_mutex);
+        if (m_thread.joinable()) return;
+        m_stopping = false;
+        m_running = true;
+        m_thread = std::thread(&SessionStore::loop, this);
+    }
+
+    void SessionStore::stop() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable()) m_thread.join();
+
+        {
+            std::lock_guard lock(m_mutex);
+            m_running = false;
+        }
+        // Logins answered before the stop keep their sessions
+        flush();
+    }
+
+    void SessionStore::add(Session session) {
+        {
+            std::lock_guard lock(m_mutex);
+            const auto id = session.id;
+            m_queue.insert_or_assign(id, std::move(session));
+            if (m_running) {
+                // The first one opens the group window, a full group closes it
+                if (m_queue.size() == 1 || m_queue.size() >= m_options.maxGroup) m_cv.notify_one();
+                return;
+            }
+        }
+        flush();
+    }
+
+    bool SessionStore::pending(const std::string &session_id) const {
+        std::lock_guard lock(m_mutex);
+        return m_queue.contains(session_id) || m_writing.contains(session_id);
+    }
+
+    bool SessionStore::cancel(const std::string &session_id) {
+        std::unique_lock lock(m_mutex);
+        m_flushed.wait(lock, [&] { return !m_writing.contains(session_id); });
+        return m_queue.erase(session_id) > 0;
+    }
+
+    std::size_t SessionStore::flush() {
+        std::size_t total = 0;
+        while (true) {
+            std::vector<Session> group;
+            {
+                std::unique_lock lock(m_mutex);
+                // One group at a time, so pending() and cancel() see a single one in flight
+                m_flushed.wait(lock, [this] { return m_writing.empty(); });
+                if (m_queue.empty()) return total;
+
+                for (auto it = m_queue.begin(); it != m_queue.end() && group.size() < m_options.maxGroup;) {
+                    group.push_back(it->second);
+                    m_writing.insert(m_queue.extract(it++));
+                }
+            }
+
+            const auto written = writeGroup(group);
+            if (written == 0) return total; // Requeued; the next flush tries again
+            total += written;
+        }
+    }
+
+    std::size_t SessionStore::writeGroup(std::vector<Session> &group) {
+        bool ok = true;
+        try {
+            MantisBase::instance().rootDb().write([&group](soci::session &sql) {
+                Session row;
+                // A retried group may have committed before its error
+                soci::statement st = (sql.prepare <<
+                                      "INSERT INTO mb_sessions (id, entity_name, user_id, token_hash, expires_at, created) "
+                                      "VALUES (:id, :entity, :uid, :hash, :exp, :now) ON CONFLICT (id) DO NOTHING",
+                                      soci::use(row.id), soci::use(row.entityName), soci::use(row.userId),
+                                      soci::use(row.tokenHash), soci::use(row.expiresAt), soci::use(row.created));
+                for (const auto &session: group) {
+                    row = session;
+                    st.execute(true);
+                }
+            });
+        } catch (const std::exception &e) {
+            ok = false;
+            LogOrigin::authWarn("Session Creation Failed",
+                                fmt::format("Failed to write {} session(s), retrying: {}", group.size(), e.what()));
+        }
+
+        {
+            std::lock_guard lock(m_mutex);
+            if (!ok) {
+                // insert() keeps any newer add() of the same id
+                while (!m_writing.empty()) m_queue.insert(m_writing.extract(m_writing.begin()));
+            }
+            m_writing.clear();
+        }
+        m_flushed.notify_all();
+
+        if (!ok) return 0;
+        m_written += group.size();
+        return group.size();
+    }
+
+    std::size_t SessionStore::sweep() {
+        const auto now = getCurrentTimestampUTC();
+        // Bounded, so each chunk is a short write other writers queue behind
+        const auto statement = std::format(
+            "DELETE FROM mb_sessions WHERE id IN (SELECT id FROM mb_sessions WHERE expires_at <= :now LIMIT {})",
+            m_options.sweepBatch);
+
+        std::size_t total = 0;
+        while (true) {
+            long long deleted = 0;
+            MantisBase::instance().rootDb().write([&](soci::session &sql) {
+                soci::statement st = (sql.prepare << statement, soci::use(now));
+                st.execute(true);
+                deleted = st.get_affected_rows();
+            });
+            total += static_cast<std::size_t>(std::max(deleted, 0LL));
+            if (deleted < static_cast<long long>(m_options.sweepBatch)) break;
+
+            std::lock_guard lock(m_mutex);
+            if (m_stopping) break;
+        }
+
+        m_swept += total;
+        if (total > 0) LogOrigin::trace("Sessions", fmt::format("Removed {} expired session(s)", total));
+        return total;
+    }
+
+    void SessionStore::loop() {
+        auto next_sweep = std::chrono::steady_clock::now() + m_options.sweepInterval;
+        std::unique_lock lock(m_mutex);
+        while (!m_stopping) {
+            const auto until = m_options.sweepInterval.count() > 0
+                                   ? next_sweep
+                                   : std::chrono::steady_clock::now() + std::chrono::hours(1);
+            m_cv.wait_until(lock, until, [this] { return m_stopping || !m_queue.empty(); });
+
+            // Let the group gather before writing it
+            if (!m_stopping && !m_queue.empty()) {
+                m_cv.wait_for(lock, m_options.flushInterval, [this] {
+                    return m_stopping || m_queue.size() >= m_options.maxGroup;
+                });
+            }
+            lock.unlock();
+
+            try {
+                flush();
+                if (m_options.sweepInterval.count() > 0 && std::chrono::steady_clock::now() >= next_sweep) {
+                    sweep();
+                    next_sweep = std::chrono::steady_clock::now() + m_options.sweepInterval;
+                }
+            } catch (const std::exception &e) {
+                LogOrigin::warn("Sessions", fmt::format("Session maintenance failed, retrying later: {}", e.what()));
+            }
+
+            lock.lock();
+            // Still queued: the write failed, so give the database a moment
+            if (!m_queue.empty()) m_cv.wait_for(lock, std::chrono::seconds(1), [this] { return m_stopping; });
+        }
+    }
+}
@@ -0,0 +1,123 @@
+/**
+ * @file shared_state.cpp
+ * @brief Implementation for @see shared_state.h
+ */
+
+#include "../../include/mantisbase/core/shared_state.h"
+#include "../../include/mantisbase/core/channels.h"
+#include "../../include/mantisbase/core/database.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <atomic>
+#include <soci/soci.h>
+
+namespace mb {
+    namespace {
+        std::atomic<bool> g_enabled{false};
+
+        /// The database's clock in nanoseconds, so every node reads the same time
+        constexpr auto DB_NOW = "CAST(EXTRACT(EPOCH FROM clock_timestamp()) * 1000000 AS BIGINT) * 1000";
+    }
+
+    DbRateLimitStore::DbRateLimitStore(const MantisBase &app) : mApp(app) {}
+
+    std::optional<RateLimitStore::Step> DbRateLimitStore::step(const std::string &key, const std::int64_t interval,
+                                                               const std::int64_t tolerance) {
+        try {
+            const auto sql = mApp.db().writeSession();
+            long long now = 0, tat = 0;
+            int allowed = 0;
+            long long i = interval, tol = tolerance;
+
+            // A new key starts with a full bucket; an existing one only moves if it has room
+            *sql << fmt::format(
+                        "WITH p AS (SELECT CAST(:key AS TEXT) AS k, CAST(:i AS BIGINT) AS i, "
+                        "CAST(:tol AS BIGINT) AS tol, {} AS t), "
+                        "up AS (INSERT INTO mb_rate_limits AS r (key, tat) SELECT k, t + i FROM p "
+                        "ON CONFLICT (key) DO UPDATE SET tat = GREATEST(r.tat, (SELECT t FROM p)) + (SELECT i FROM p) "
+                        "WHERE GREATEST(r.tat, (SELECT t FROM p)) - (SELECT t FROM p) <= (SELECT tol FROM p) "
+                        "RETURNING r.tat) "
+                        "SELECT p.t, COALESCE((SELECT tat FROM up), "
+                        "(SELECT r.tat FROM mb_rate_limits r WHERE r.key = p.k)), "
+                        "CASE WHEN EXISTS (SELECT 1 FROM up) THEN 1 ELSE 0 END FROM p", DB_NOW),
+                    soci::use(key, "key"), soci::use(i, "i"), soci::use(tol, "tol"),
+                    soci::into(now), soci::into(tat), soci::into(allowed);
+
+            return Step{allowed == 1, tat, now};
+        } catch (const std::exception &e) {
+            LogOrigin::warn("Shared Rate Limit Failed", fmt::format("Counting locally for now: {}", e.what()));
+            return std::nullopt;
+        }
+    }
+
+    void DbRateLimitStore::evictIdle() {
+        try {
+            const auto sql = mApp.db().writeSession();
+            *sql << fmt::format("DELETE FROM mb_rate_limits WHERE tat <= {}", DB_NOW);
+        } catch (const std::exception &e) {
+            LogOrigin::warn("Shared Rate Limit Sweep Failed", e.what());
+        }
+    }
+
+    SharedState::Options SharedState::Options::fromEnv() {
+        Options options;
+        auto backend = trim(getEnvOrDefault("MB_SHARED_STATE", "local"));
+        toLowerCase(backend);
+        options.database = backend == "db";
+        return options;
+    }
+
+    bool SharedState::init(const MantisBase &app, const Options &options) {
+        if (!options.database) return false;
+
+        if (app.dbType() != "postgresql") {
+            LogOrigin::warn("Shared State Unavailable",
+                            "MB_SHARED_STATE=db needs PostgreSQL; rate limits and sessions stay per node.");
+            return false;
+        }
+
+        try {
+            const auto sql = app.db().writeSession();
+            *sql << "CREATE TABLE IF NOT EXISTS mb_rate_limits (key TEXT PRIMARY KEY, tat BIGINT NOT NULL)";
+        } catch (const std::exception &e) {
+            LogOrigin::warn("Shared State Unavailable", fmt::format("Could not create mb_rate_limits: {}", e.what()));
+            return false;
+        }
+
+        RateLimiter::setStore(std::make_shared<DbRateLimitStore>(app));
+        Channels::instance().setForward([&app](const std::string &notification) {
+            try {
+                const auto sql = app.db().writeSession();
+                const std::string channel(Channels::NOTIFY_CHANNEL);
+                *sql << "SELECT pg_notify(:channel, :payload)", soci::use(channel, "channel"),
+                        soci::use(notification, "payload");
+            } catch (const std::exception &e) {
+                // Subscribers on this node already have it
+                LogOrigin::warn("Channel Broadcast Failed", e.what());
+            }
+        });
+        g_enabled.store(true);
+        LogOrigin::info("Shared State",
+                        "Rate limits, session revocations and channel messages are shared through the database.");
+        return true;
+    }
+
+    bool SharedState::enabled() {
+        return g_enabled.load();
+    }
+
+    void SharedState::publishRevocation(const std::string &session_id) {
+        if (!enabled()) return;
+
+        try {
+            const auto sql = MantisBase::instance().db().writeSession();
+            const std::string channel(REVOCATION_CHANNEL);
+            *sql << "SELECT pg_notify(:channel, :id)", soci::use(channel, "channel"), soci::use(session_id, "id");
+        } catch (const std::exception &e) {
+            // Other nodes still notice once their cached entry runs out
+            LogOrigin::warn("Session Revocation Broadcast Failed", e.what());
+        }
+    }
+}
@@ -0,0 +1,285 @@
+/**
+ * @file slow_query_log.cpp
+ * @brief Implementation for @see slow_query_log.h
+ */
+
+#include "../../include/mantisbase/core/slow_query_log.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <regex>
+
+namespace mb {
+    namespace {
+        constexpr std::size_t MAX_PARAMETERS = 64;  ///> Shapes kept per statement
+        constexpr std::size_t MAX_SQL = 4096;       ///> Characters of the statement kept in an entry
+        constexpr std::size_t MAX_EXPLAINED = 1024; ///> Fingerprints remembered as recently explained
+
+        struct OpenStatement {
+            std::string sql;
+            SlowQueryLog::Clock::time_point started;
+        };
+
+        std::atomic<SlowQueryLog *> g_active{nullptr};
+        thread_local std::optional<OpenStatement> t_statement;
+        thread_local std::vector<std::string> t_parameters;
+        thread_local bool t_muted = false; ///> The writer thread; its EXPLAINs are not recorded
+
+        bool isWord(const char c) {
+            return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+        }
+
+        bool isNumber(const std::string_view s, const bool real) {
+            if (s.empty()) return false;
+            char *end = nullptr;
+            const std::string copy(s);
+            if (real) std::strtod(copy.c_str(), &end);
+            else std::strtoll(copy.c_str(), &end, 10);
+            return end == copy.c_str() + copy.size();
+        }
+    }
+
+    SlowQueryLog::Options SlowQueryLog::Options::fromEnv() {
+        Options options;
+        options.threshold = std::chrono::milliseconds(
+            std::max(0, safe_stoi(getEnvOrDefault("MB_SLOW_QUERY_MS", "500"), 500)));
+        options.explain = getEnvOrDefault("MB_SLOW_QUERY_EXPLAIN", "1") != "0";
+        return options;
+    }
+
+    SlowQueryLog::SlowQueryLog(Options options, Explain explain, Store store)
+        : m_options(std::move(options)), m_explain(std::move(explain)), m_store(std::move(store)) {}
+
+    SlowQueryLog::~SlowQueryLog() {
+        stop();
+    }
+
+    void SlowQueryLog::start() {
+        if (m_options.threshold.count() == 0 || !m_store) return;
+        std::lock_guard lock(m_mutex);
+        if (m_thread.joinable()) return;
+        m_stopping = false;
+        m_thread = std::thread(&SlowQueryLog::loop, this);
+        g_active.store(this, std::memory_order_release);
+    }
+
+    void SlowQueryLog::stop() {
+        auto *self = this;
+        g_active.compare_exchange_strong(self, nullptr, std::memory_order_acq_rel);
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+    bool SlowQueryLog::slow(const std::chrono::nanoseconds duration) {
+        const auto *log = g_active.load(std::memory_order_acquire);
+        return log && !t_muted && duration >= log->m_options.threshold;
+    }
+
+    void SlowQueryLog::record(Sample sample) {
+        auto *log = g_active.load(std::memory_order_acquire);
+        if (!log || t_muted) return;
+        log->push(std::move(sample));
+    }
+
+    void SlowQueryLog::statement(const std::string_view sql) {
+        endStatement();
+        if (!g_active.load(std::memory_order_relaxed) || t_muted) return;
+        t_statement.emplace(OpenStatement{std::string(sql), Clock::now()});
+    }
+
+    void SlowQueryLog::endStatement() {
+        if (!t_statement) return;
+        auto open = std::move(*t_statement);
+        t_statement.reset();
+        if (const auto took = Clock::now() - open.started; slow(took))
+            record({std::move(open.sql), t_parameters, took, std::nullopt});
+    }
+
+    void SlowQueryLog::parameter(const std::string_view value) {
+        if (!g_active.load(std::memory_order_relaxed) || t_parameters.size() >= MAX_PARAMETERS) return;
+        t_parameters.push_back(shapeOf(value));
+    }
+
+    void SlowQueryLog::clearParameters() {
+        t_parameters.clear();
+    }
+
+    std::vector<std::string> SlowQueryLog::parameters() {
+        return t_parameters;
+    }
+
+    std::string SlowQueryLog::normalize(const std::string_view sql) {
+        std::string out;
+        out.reserve(sql.size());
+        bool blank = false;
+        const auto put = [&](const char c) {
+            if (blank && !out.empty()) out += ' ';
+            blank = false;
+            out += c;
+        };
+
+        for (std::size_t i = 0; i < sql.size();) {
+            const char c = sql[i];
+            const char next = i + 1 < sql.size() ? sql[i + 1] : '\0';
+            const char prev = i > 0 ? sql[i - 1] : '\0';
+
+            if (std::isspace(static_cast<unsigned char>(c))) {
+                blank = true;
+                ++i;
+            } else if (c == '-' && next == '-') {
+                // A comment counts as a blank
+                i = sql.find('\n', i);
+                if (i == std::string_view::npos) i = sql.size();
+                blank = true;
+            } else if (c == '/' && next == '*') {
+                const auto end = sql.find("*/", i + 2);
+                i = end == std::string_view::npos ? sql.size() : end + 2;
+                blank = true;
+            } else if (c == '\'') {
+                // String literal, '' being a quote inside it
+                for (++i; i < sql.size(); ++i) {
+                    if (sql[i] != '\'') continue;
+                    if (i + 1 < sql.size() && sql[i + 1] == '\'') ++i;
+                    else break;
+                }
+                ++i;
+                put('?');
+            } else if (c == '"' || c == '`') {
+                // Quoted identifier, kept as it is
+                const auto end = sql.find(c, i + 1);
+                const auto stop = end == std::string_view::npos ? sql.size() : end + 1;
+                for (; i < stop; ++i) put(sql[i]);
+            } else if (std::isdigit(static_cast<unsigned char>(c)) && !isWord(prev)) {
+                while (i < sql.size() && (isWord(sql[i]) || sql[i] == '.' ||
+                                          ((sql[i] == '+' || sql[i] == '-') && (sql[i - 1] == 'e' || sql[i - 1] == 'E'))))
+                    ++i;
+                put('?');
+            } else if (c == ':' && next == ':') {
+                // PostgreSQL cast
+                put(':');
+                put(':');
+                i += 2;
+            } else if ((c == ':' || c == '$') && isWord(next) && prev != ':') {
+                for (++i; i < sql.size() && isWord(sql[i]); ++i) {}
+                put('?');
+            } else {
+                put(c);
+                ++i;
+            }
+        }
+
+        // `(?, ?, ?)` is `(?+)`, whatever its length
+        static const std::regex list(R"(\(\s?\?(\s?,\s?\?)*\s?\))");
+        return std::regex_replace(out, list, "(?+)");
+    }
+
+    std::string SlowQueryLog::fingerprint(const std::string_view normalized) {
+        // FNV-1a, the same id on every build and every run
+        std::uint64_t hash = 0xcbf29ce484222325ULL;
+        for (const unsigned char c: normalized) {
+            hash ^= c;
+            hash *= 0x100000001b3ULL;
+        }
+        static constexpr char digits[] = "0123456789abcdef";
+        std::string out(16, '0');
+        for (int i = 15; i >= 0; --i, hash >>= 4) out[i] = digits[hash & 0xf];
+        return out;
+    }
+
+    std::string SlowQueryLog::shapeOf(const std::string_view value) {
+        if (value == "NULL" || value == "null") return "null";
+        if (value.size() >= 2 && (value.front() == '\'' || value.front() == '"') && value.back() == value.front())
+            return "text(" + std::to_string(value.size() - 2) + ")";
+        if (isNumber(value, false)) return "int";
+        if (isNumber(value, true)) return "real";
+        return "text(" + std::to_string(value.size()) + ")";
+    }
+
+    bool SlowQueryLog::explainable(const std::string_view sql) {
+        auto start = sql.find_first_not_of(" \t\r\n(");
+        if (start == std::string_view::npos) return false;
+        std::string verb;
+        for (; start < sql.size() && isWord(sql[start]); ++start)
+            verb += static_cast<char>(std::tolower(static_cast<unsigned char>(sql[start])));
+        return verb == "select" || verb == "with" || verb == "insert" || verb == "update" || verb == "delete";
+    }
+
+    std::size_t SlowQueryLog::dropped() const {
+        std::lock_guard lock(m_mutex);
+        return m_dropped;
+    }
+
+    void SlowQueryLog::push(Sample sample) {
+        {
+            std::lock_guard lock(m_mutex);
+            if (m_stopping || m_queue.size() >= m_options.queue) {
+                ++m_dropped;
+                return;
+            }
+            m_queue.emplace_back(std::move(sample), std::chrono::system_clock::now());
+        }
+        m_cv.notify_one();
+    }
+
+    void SlowQueryLog::loop() {
+        t_muted = true;
+        std::unique_lock lock(m_mutex);
+        while (true) {
+            m_cv.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            if (m_queue.empty()) return; // stopping, and everything is written
+
+            auto [sample, at] = std::move(m_queue.front());
+            m_queue.pop_front();
+            lock.unlock();
+            write(sample, at);
+            lock.lock();
+        }
+    }
+
+    void SlowQueryLog::write(const Sample &sample, const std::chrono::system_clock::time_point at) {
+        const auto normalized = normalize(sample.sql);
+        const auto id = fingerprint(normalized);
+
+        // A fingerprint's plan rarely changes between two slow runs, so explain it now and then
+        nlohmann::json plan = nullptr;
+        if (m_options.explain && m_explain && explainable(sample.sql)) {
+            const auto now = Clock::now();
+            if (const auto it = m_explained.find(id); it == m_explained.end() || now - it->second >= m_options.explainEvery) {
+                if (m_explained.size() >= MAX_EXPLAINED) {
+                    std::erase_if(m_explained, [&](const auto &e) { return now - e.second >= m_options.explainEvery; });
+                    if (m_explained.size() >= MAX_EXPLAINED) m_explained.clear();
+                }
+                try {
+                    plan = m_explain(sample.sql);
+                } catch (const std::exception &e) {
+                    plan = {{"error", e.what()}};
+                }
+                m_explained[id] = now;
+            }
+        }
+
+        nlohmann::json entry = {
+            {"created_at", std::chrono::duration_cast<std::chrono::seconds>(at.time_since_epoch()).count()},
+            {"fingerprint", id},
+            {"query", normalized},
+            {"sql", sample.sql.substr(0, MAX_SQL)},
+            {"params", sample.params},
+            {"duration_ms", std::chrono::duration<double, std::milli>(sample.duration).count()},
+            {"rows", sample.rows ? nlohmann::json(*sample.rows) : nlohmann::json(nullptr)},
+            {"plan", plan}
+        };
+        try {
+            m_store(entry);
+        } catch (const std::exception &e) {
+            LogOrigin::dbWarn("Slow Query Log", fmt::format("Could not store a slow query: {}", e.what()));
+        }
+    }
+}
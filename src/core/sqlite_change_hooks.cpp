@@ -0,0 +1,254 @@
+#include "../../include/mantisbase/core/sqlite_change_hooks.h"
+#include "../../include/mantisbase/core/change_journal.h"
+#include "../../include/mantisbase/core/delta_sync.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/core/replication.h"
+#include "../../include/mantisbase/core/wal_checkpointer.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <soci/soci.h>
+#include <soci/sqlite3/soci-sqlite3.h>
+
+#include <cstring>
+#include <unordered_set>
+
+namespace mb {
+    struct SqliteChangeHooks::Connection {
+        SqliteChangeHooks *owner = nullptr;
+        sqlite_api::sqlite3 *db = nullptr;
+        WalCheckpointer *checkpointer = nullptr;
+        int autoCheckpoint = 0;          ///> wal_autocheckpoint, which the WAL hook takes over without a checkpointer
+        std::vector<RowImage> rows;      ///> Changed in the open transaction
+        std::vector<RowImage> committed; ///> Between the commit hook and the WAL hook
+        std::unordered_set<std::string> muted;
+    };
+
+    namespace {
+        /// Attached connections (a Connection each) by handle, for the static mark()/rewind()/mute()
+        std::mutex g_registryMutex;
+        std::unordered_map<sqlite_api::sqlite3 *, void *> g_registry;
+
+        sqlite_api::sqlite3 *handleOf(soci::session &sql) {
+            const auto *backend = dynamic_cast<soci::sqlite3_session_backend *>(sql.get_backend());
+            return backend ? backend->conn_ : nullptr;
+        }
+
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+        SqliteChangeHooks::Value read(sqlite_api::sqlite3_value *value) {
+            switch (sqlite_api::sqlite3_value_type(value)) {
+                case SQLITE_INTEGER: return static_cast<std::int64_t>(sqlite_api::sqlite3_value_int64(value));
+                case SQLITE_FLOAT: return sqlite_api::sqlite3_value_double(value);
+                case SQLITE_TEXT: {
+                    const auto *text = reinterpret_cast<const char *>(sqlite_api::sqlite3_value_text(value));
+                    return std::string(text ? text : "", static_cast<std::size_t>(sqlite_api::sqlite3_value_bytes(value)));
+                }
+                default: return {};
+            }
+        }
+#endif
+
+        json toJson(const SqliteChangeHooks::Value &value) {
+            return std::visit([]<typename T>(const T &v) -> json {
+                if constexpr (std::is_same_v<T, std::monostate>) return nullptr;
+                else return v;
+            }, value);
+        }
+
+        json rowObject(const SqliteChangeHooks::Layout &layout, const std::vector<SqliteChangeHooks::Value> &values) {
+            json row = json::object();
+            for (std::size_t i = 0; i < layout.columns.size() && i < values.size(); ++i)
+                if (layout.skip.empty() || !layout.skip[i]) row[layout.columns[i]] = toJson(values[i]);
+            return row;
+        }
+    }
+
+    bool SqliteChangeHooks::available() {
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    bool SqliteChangeHooks::enabled() {
+        static const bool on = [] {
+            auto mode = trim(getEnvOrDefault("MB_SQLITE_CAPTURE", "triggers"));
+            toLowerCase(mode);
+            if (mode != "hooks") return false;
+            if (!available()) {
+                LogOrigin::dbWarn("Change Hooks", "MB_SQLITE_CAPTURE=hooks needs SQLite built with "
+                                                  "SQLITE_ENABLE_PREUPDATE_HOOK; keeping the change triggers");
+                return false;
+            }
+            if (const auto replication = Replication::Options::fromEnv();
+                replication.serving() || replication.follower() || DeltaSync::Options::fromEnv().enabled()) {
+                LogOrigin::dbWarn("Change Hooks", "Replication and delta sync read mb_change_log; "
+                                                  "keeping the change triggers");
+                return false;
+            }
+            return true;
+        }();
+        return on;
+    }
+
+    SqliteChangeHooks::SqliteChangeHooks(Publish publish) : m_publish(std::move(publish)) {}
+
+    SqliteChangeHooks::~SqliteChangeHooks() {
+        // The connections are closed by now; only their registry entries are left
+        std::lock_guard lock(g_registryMutex);
+        for (const auto &conn: m_connections) g_registry.erase(conn->db);
+    }
+
+    void SqliteChangeHooks::attach(soci::session &sql, WalCheckpointer *checkpointer) {
+#ifdef SQLITE_ENABLE_PREUPDATE_HOOK
+        auto *db = handleOf(sql);
+        if (!db) return;
+
+        auto conn = std::make_unique<Connection>();
+        conn->owner = this;
+        conn->db = db;
+        conn->checkpointer = checkpointer;
+        if (!checkpointer) sql << "PRAGMA wal_autocheckpoint", soci::into(conn->autoCheckpoint);
+        auto *ctx = conn.get();
+        {
+            std::lock_guard lock(m_connectionsMutex);
+            m_connections.push_back(std::move(conn));
+        }
+        {
+            std::lock_guard lock(g_registryMutex);
+            g_registry[db] = ctx;
+        }
+
+        sqlite_api::sqlite3_preupdate_hook(db, [](void *self, sqlite_api::sqlite3 *handle, const int op,
+                                                  const char *schema, const char *table,
+                                                  sqlite_api::sqlite3_int64, sqlite_api::sqlite3_int64) {
+            auto &c = *static_cast<Connection *>(self);
+            try {
+                if (std::strcmp(schema, "main") != 0) return;
+                const std::string name(table);
+                if (c.muted.contains(name)) return;
+                const auto layout = c.owner->layoutOf(name);
+                if (!layout) return;
+                // Altered since it was described; the next describe() catches up
+                const int count = sqlite_api::sqlite3_preupdate_count(handle);
+                if (count != static_cast<int>(layout->columns.size())) return;
+
+                RowImage row{op, name, layout, {}, {}};
+                const auto image = [&](auto get, std::vector<Value> &values) {
+                    values.resize(static_cast<std::size_t>(count));
+                    for (int i = 0; i < count; ++i) {
+                        if (!layout->skip.empty() && layout->skip[i]) continue;
+                        sqlite_api::sqlite3_value *value = nullptr;
+                        if (get(handle, i, &value) == SQLITE_OK && value) values[i] = read(value);
+                    }
+                };
+                if (op != SQLITE_INSERT) image(sqlite_api::sqlite3_preupdate_old, row.before);
+                if (op != SQLITE_DELETE) image(sqlite_api::sqlite3_preupdate_new, row.after);
+                c.rows.push_back(std::move(row));
+            } catch (const std::exception &e) {
+                LogOrigin::dbWarn("Change Hooks", fmt::format("Change to `{}` not captured: {}", table, e.what()));
+            }
+        }, ctx);
+
+        sqlite_api::sqlite3_commit_hook(db, [](void *self) {
+            auto &c = *static_cast<Connection *>(self);
+            // Not visible to other connections until it is in the WAL
+            std::move(c.rows.begin(), c.rows.end(), std::back_inserter(c.committed));
+            c.rows.clear();
+            c.muted.clear();
+            return 0;
+        }, ctx);
+
+        sqlite_api::sqlite3_rollback_hook(db, [](void *self) {
+            auto &c = *static_cast<Connection *>(self);
+            c.rows.clear();
+            c.committed.clear(); // A commit that failed after its hook ran
+            c.muted.clear();
+        }, ctx);
+
+        // Replaces the checkpointer's hook or SQLite's auto-checkpoint, so both are done here instead
+        sqlite_api::sqlite3_wal_hook(db, [](void *self, sqlite_api::sqlite3 *handle, const char *schema,
+                                            const int wal_frames) {
+            auto &c = *static_cast<Connection *>(self);
+            if (!c.committed.empty()) {
+                try {
+                    json events = json::array();
+                    for (const auto &row: c.committed) events.push_back(toEvent(row));
+                    c.committed.clear();
+                    c.owner->m_publish(std::move(events));
+                } catch (const std::exception &e) {
+                    c.committed.clear();
+                    LogOrigin::dbWarn("Change Hooks", fmt::format("Committed changes not published: {}", e.what()));
+                }
+            }
+            // The checkpointer follows mantis.db's WAL alone, see RealtimeDB::attachedChangeLog()
+            if (c.checkpointer) {
+                if (std::strcmp(schema, "main") == 0) c.checkpointer->noteCommit(wal_frames);
+            }
+            else if (c.autoCheckpoint > 0 && wal_frames >= c.autoCheckpoint)
+                sqlite_api::sqlite3_wal_checkpoint_v2(handle, schema, SQLITE_CHECKPOINT_PASSIVE, nullptr, nullptr);
+            return SQLITE_OK;
+        }, ctx);
+#else
+        (void) sql;
+        (void) checkpointer;
+#endif
+    }
+
+    void SqliteChangeHooks::describe(const std::string &table, Layout layout) {
+        auto described = std::make_shared<const Layout>(std::move(layout));
+        std::unique_lock lock(m_layoutsMutex);
+        m_layouts[table] = std::move(described);
+    }
+
+    void SqliteChangeHooks::forget(const std::string &table) {
+        std::unique_lock lock(m_layoutsMutex);
+        m_layouts.erase(table);
+    }
+
+    std::shared_ptr<const SqliteChangeHooks::Layout> SqliteChangeHooks::layoutOf(const std::string &table) const {
+        std::shared_lock lock(m_layoutsMutex);
+        const auto it = m_layouts.find(table);
+        return it == m_layouts.end() ? nullptr : it->second;
+    }
+
+    SqliteChangeHooks::Connection *SqliteChangeHooks::find(soci::session &sql) {
+        auto *db = handleOf(sql);
+        if (!db) return nullptr;
+        std::lock_guard lock(g_registryMutex);
+        const auto it = g_registry.find(db);
+        return it == g_registry.end() ? nullptr : static_cast<Connection *>(it->second);
+    }
+
+    void SqliteChangeHooks::mute(soci::session &sql, const std::string &table) {
+        if (auto *conn = find(sql)) conn->muted.insert(table);
+    }
+
+    void SqliteChangeHooks::unmute(soci::session &sql, const std::string &table) {
+        if (auto *conn = find(sql)) conn->muted.erase(table);
+    }
+
+    std::size_t SqliteChangeHooks::mark(soci::session &sql) {
+        const auto *conn = find(sql);
+        return conn ? conn->rows.size() : 0;
+    }
+
+    void SqliteChangeHooks::rewind(soci::session &sql, const std::size_t mark) {
+        if (auto *conn = find(sql); conn && conn->rows.size() > mark)
+            conn->rows.resize(mark);
+    }
+
+    json SqliteChangeHooks::toEvent(const RowImage &row) {
+        const char *type = row.op == SQLITE_INSERT ? "INSERT" : row.op == SQLITE_DELETE ? "DELETE" : "UPDATE";
+        const auto &values = row.op == SQLITE_DELETE ? row.before : row.after;
+        std::string row_id;
+        if (row.layout->id < values.size()) {
+            if (const auto *text = std::get_if<std::string>(&values[row.layout->id])) row_id = *text;
+            else if (const auto *number = std::get_if<std::int64_t>(&values[row.layout->id]))
+                row_id = std::to_string(*number);
+        }
+        return ChangeJournal::makeEvent(type, row.entity, row_id,
+                                        row.before.empty() ? json(nullptr) : rowObject(*row.layout, row.before),
+                                        row.after.empty() ? json(nullptr) : rowObject(*row.layout, row.after));
+    }
+}
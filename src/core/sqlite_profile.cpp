@@ -0,0 +1,132 @@
+#include "../../include/mantisbase/core/sqlite_profile.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <format>
+
+namespace mb {
+    namespace {
+        constexpr std::string_view kTempStores[] = {"default", "file", "memory"};
+
+        // Larger than this and it is almost certainly a unit mistake
+        constexpr std::int64_t kMaxMmapSize = std::int64_t{64} << 30;
+
+        template<typename T>
+        T intValue(const json &value, const std::string &key, const std::int64_t min, const std::int64_t max) {
+            if (!value.is_number_integer())
+                throw MantisException(400, std::format("SQLite profile `{}` must be an integer.", key));
+            const auto v = value.get<std::int64_t>();
+            if (v < min || v > max)
+                throw MantisException(400, std::format("SQLite profile `{}` must be within [{}, {}].", key, min, max));
+            return static_cast<T>(v);
+        }
+    }
+
+    const std::vector<std::string> &SqliteProfile::presetNames() {
+        static const std::vector<std::string> names{"default", "read-heavy", "write-heavy"};
+        return names;
+    }
+
+    std::optional<SqliteProfile> SqliteProfile::preset(const std::string_view name) {
+        SqliteProfile p;
+        if (name == "default") return p;
+
+        if (name == "read-heavy") {
+            // Reads come from the shared page cache through mmap; larger pages
+            // mean fewer of them per range scan
+            p.name = "read-heavy";
+            p.mmapSize = std::int64_t{256} << 20;
+            p.cacheSize = -32768;
+            p.tempStore = 2;
+            p.busyTimeoutMs = 5000;
+            p.pageSize = 8192;
+            return p;
+        }
+
+        if (name == "write-heavy") {
+            // Enough cache to hold the hot index pages between commits, and a
+            // longer busy timeout so queued writers wait rather than fail
+            p.name = "write-heavy";
+            p.mmapSize = std::int64_t{64} << 20;
+            p.cacheSize = -16384;
+            p.tempStore = 2;
+            p.busyTimeoutMs = 60000;
+            return p;
+        }
+
+        return std::nullopt;
+    }
+
+    SqliteProfile SqliteProfile::fromJson(const json &value) {
+        const auto preset_of = [](const std::string &name) {
+            auto p = preset(name);
+            if (!p) throw MantisException(400, std::format("Unknown SQLite profile preset `{}`.", name));
+            return *p;
+        };
+
+        if (value.is_string()) return preset_of(value.get<std::string>());
+        if (!value.is_object())
+            throw MantisException(400, "SQLite profile must be a preset name or an object.");
+
+        auto p = preset_of(value.contains("preset") && value["preset"].is_string()
+                               ? value["preset"].get<std::string>()
+                               : "default");
+
+        for (const auto &[key, v]: value.items()) {
+            if (key == "preset") continue;
+
+            if (key == "mmap_size") p.mmapSize = intValue<std::int64_t>(v, key, 0, kMaxMmapSize);
+            else if (key == "cache_size") p.cacheSize = intValue<int>(v, key, -(1 << 30), 1 << 30);
+            else if (key == "busy_timeout") p.busyTimeoutMs = intValue<int>(v, key, 0, 10 * 60 * 1000);
+            else if (key == "page_size") {
+                p.pageSize = intValue<int>(v, key, 512, 65536);
+                if (p.pageSize & (p.pageSize - 1))
+                    throw MantisException(400, "SQLite profile `page_size` must be a power of two.");
+            } else if (key == "temp_store") {
+                const auto found = v.is_string() ? std::ranges::find(kTempStores, v.get<std::string>())
+                                                 : std::ranges::end(kTempStores);
+                if (found == std::ranges::end(kTempStores))
+                    throw MantisException(400, "SQLite profile `temp_store` must be default, file or memory.");
+                p.tempStore = static_cast<int>(found - std::ranges::begin(kTempStores));
+            } else {
+                throw MantisException(400, std::format("Unknown SQLite profile key `{}`.", key));
+            }
+        }
+        return p;
+    }
+
+    std::optional<SqliteProfile> SqliteProfile::fromEnv() {
+        const auto value = trim(getEnvOrDefault("MB_SQLITE_PROFILE", ""));
+        if (value.empty()) return std::nullopt;
+        if (value.front() != '{') return fromJson(json(value));
+
+        const auto parsed = json::parse(value, nullptr, false);
+        if (parsed.is_discarded()) throw MantisException(400, "MB_SQLITE_PROFILE is not valid JSON.");
+        return fromJson(parsed);
+    }
+
+    json SqliteProfile::toJson() const {
+        return {
+            {"preset", name},
+            {"mmap_size", mmapSize},
+            {"cache_size", cacheSize},
+            {"temp_store", std::string(kTempStores[tempStore])},
+            {"busy_timeout", busyTimeoutMs},
+            {"page_size", pageSize}
+        };
+    }
+
+    std::vector<std::string> SqliteProfile::pragmas() const {
+        return {
+            std::format("PRAGMA busy_timeout={}", busyTimeoutMs),
+            std::format("PRAGMA cache_size={}", cacheSize),
+            std::format("PRAGMA temp_store={}", tempStore),
+            std::format("PRAGMA mmap_size={}", mmapSize)
+        };
+    }
+
+    std::string SqliteProfile::pageSizePragma() const {
+        return std::format("PRAGMA page_size={}", pageSize);
+    }
+}
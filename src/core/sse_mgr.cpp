@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <charconv>
+#include <shared_mutex>
 #include <utility>
 #include <vector>
 #include <memory>
@@ -5,14 +8,75 @@
 
 #include "../../include/mantisbase/core/sse.h"
 #include "../../include/mantisbase/core/ws.h"
+#include "../../include/mantisbase/core/middlewares.h"
+#include "../../include/mantisbase/core/realtime.h"
 #include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/utils/utils.h"
 #include "../../include/mantisbase/utils/uuidv7.h"
 
 #include <drogon/drogon.h>
+#include <trantor/utils/TimingWheel.h>
 
 namespace mb {
+    /**
+     * One timing wheel per IO loop, each ticking once a second on its loop. A session's
+     * next tick is one entry in its loop's wheel, so scheduling is O(1) and nothing ever
+     * walks all sessions. Ticks hold this, never the manager, so they are safe to fire
+     * (or be destroyed with their wheel) after stop().
+     */
+    struct SSEMgr::Keepalive {
+        explicit Keepalive(const KeepaliveOptions opts) : options(opts) {}
+
+        const KeepaliveOptions options;
+
+        std::shared_mutex mutex; ///> Shared by ticks, exclusive in stop()
+        SSEMgr *mgr = nullptr;   ///> Null once stopped
+
+        std::mutex wheelsMutex;
+        std::unordered_map<trantor::EventLoop *, trantor::TimingWheel *> wheels;
+
+        trantor::TimingWheel &wheelFor(trantor::EventLoop *loop) {
+            std::lock_guard lock(wheelsMutex);
+            auto &wheel = wheels[loop];
+            if (!wheel) {
+                const auto longest = std::max(options.ping, options.idle).count();
+                wheel = new trantor::TimingWheel(loop, static_cast<std::size_t>(std::max<long long>(longest, 1)) + 1);
+            }
+            return *wheel;
+        }
+
+        static void schedule(const std::shared_ptr<Keepalive> &self, trantor::TimingWheel &wheel,
+                             const std::weak_ptr<SSESession> &session, const std::chrono::seconds delay) {
+            wheel.insertEntry(static_cast<std::size_t>(std::max<long long>(delay.count(), 1)),
+                              std::make_shared<trantor::TimingWheel::CallbackEntry>([self, &wheel, session] {
+                                  std::shared_lock lock(self->mutex);
+                                  if (!self->mgr) return;
+                                  // Removed meanwhile: nothing left to do
+                                  if (const auto s = session.lock()) self->mgr->keepalive(wheel, s);
+                              }));
+        }
+    };
+
+    SSEMgr::KeepaliveOptions SSEMgr::KeepaliveOptions::fromEnv() {
+        KeepaliveOptions options;
+        if (const auto secs = safe_stoi(getEnvOrDefault("MB_REALTIME_PING_SECS", ""), 0); secs > 0)
+            options.ping = std::chrono::seconds(secs);
+        if (const auto secs = safe_stoi(getEnvOrDefault("MB_REALTIME_IDLE_SECS", ""), 0); secs > 0)
+            options.idle = std::chrono::seconds(secs);
+        return options;
+    }
+
     SSEMgr::SSEMgr(const MantisBase &app)
-        : m_wsMgr(std::make_unique<WSMgr>(app)), m_app(app) {
+        : m_replay(ReplayBuffer::Options::fromEnv()),
+          m_coalescer(ChangeCoalescer::windowFromEnv()),
+          m_wsMgr(std::make_unique<WSMgr>(app)),
+          m_queueOptions(SendQueue::Options::fromEnv()),
+          m_queueCounters(std::make_shared<SendQueue::Counters>()),
+          m_snapshotOptions(RealtimeSnapshot::Options::fromEnv()),
+          m_limits(std::make_unique<StreamLimits>(StreamLimits::Options::fromEnv())),
+          m_app(app),
+          m_keepalive(std::make_shared<Keepalive>(KeepaliveOptions::fromEnv())) {
+        m_keepalive->mgr = this;
     }
 
     SSEMgr::~SSEMgr() { stop(); }
@@ -20,6 +84,11 @@ namespace mb {
     void SSEMgr::createRoutes() {
         auto &router = MantisBase::instance().router();
 
+        // Channel messages come from clients, not the change feed
+        Channels::instance().setSink([this](const std::string &topic, const std::shared_ptr<const EncodedEvent> &event) {
+            deliverEphemeral(topic, event);
+        });
+
         // SSE GET endpoint — registers directly with Drogon for async streaming
         auto getMiddlewares = std::vector<MiddlewareFn>{
             validateSubTopics(false),
@@ -68,33 +137,70 @@ namespace mb {
                 auto topics = ma_req.getOr<json>("topics", json::array());
                 std::set<std::string> topicSet;
                 for (const auto &topic: topics) {
+                    if (topic.contains("channel")) {
+                        topicSet.insert(Channels::topicOf(topic["channel"].get<std::string>()));
+                        continue;
+                    }
                     auto entity_name = topic["entity"].get<std::string>();
                     auto record_id = topic["id"].get<std::string>();
-                    if (!record_id.empty())
+                    if (const auto filter = topic.value("filter", ""); !filter.empty())
+                        entity_name = TopicFilters::topicOf(entity_name, filter);
+                    else if (!record_id.empty())
                         entity_name = std::format("{}:{}", entity_name, record_id);
                     topicSet.insert(entity_name);
                 }
 
+                // Events are filtered per row against this subscriber context
+                auto authCtx = std::make_shared<const RealtimeAuth>(RealtimeAuth::fromRequest(ma_req));
+
+                // Refused before the stream opens, so the client sees a status it can back off on
+                StreamLimits::Refusal refusal{};
+                auto ticket = std::shared_ptr(m_limits->acquire(ma_req.getRemoteAddr(), authCtx->principal, &refusal));
+                if (!ticket) {
+                    const auto which = refusal == StreamLimits::Refusal::Ip ? "address" : "user";
+                    ma_res.sendJSON(429, {
+                        {"status", 429},
+                        {"data", json::object()},
+                        {"error", std::format("Too many realtime connections for this {}", which)}
+                    });
+                    callback(ma_res.drogonResponse());
+                    return;
+                }
+
+                // EventSource sends Last-Event-ID on reconnect; the query param covers first connects
+                auto resumeFrom = parseEventId(req->getHeader("Last-Event-ID"));
+                if (!resumeFrom) resumeFrom = parseEventId(req->getParameter("last_event_id"));
+
+                const bool batch = strToBool(req->getParameter("batch"));
+                auto fields = EncodedEvent::parseFields(req->getParameter("fields"));
+                const auto format = WireFormat::fromName(req->getParameter("format")).value_or(WireFormat::Format::Json);
+
+                // Read before the stream opens, so a snapshot that can't be taken fails the request.
+                // A reconnect that can still resume doesn't need one.
+                std::optional<RealtimeSnapshot> snapshot;
+                if (strToBool(req->getParameter("snapshot")) && !(resumeFrom && m_replay.retains(*resumeFrom))) {
+                    try {
+                        snapshot = takeSnapshot(topicSet, *authCtx);
+                        resumeFrom.reset();
+                    } catch (const MantisException &e) {
+                        ma_res.sendJSON(e.code(), {{"error", e.what()}, {"data", json::object()}, {"status", e.code()}});
+                        callback(ma_res.drogonResponse());
+                        return;
+                    }
+                }
+
                 // Create async stream response for SSE
                 auto resp = drogon::HttpResponse::newAsyncStreamResponse(
-                    [this, topicSet](drogon::ResponseStreamPtr stream) {
-                        auto clientId = createSession(topicSet, std::move(stream));
-
-                        // Send the initial connected event through the session
-                        if (auto session = getSession(clientId); session) {
-                            json connected = {
-                                {"client_id", clientId},
-                                {"topics", topicSet}
-                            };
-                            session->sendEvent("connected", connected);
-                        }
+                    [this, topicSet, authCtx, resumeFrom, batch, fields, format, snapshot = std::move(snapshot),
+                        ticket = std::move(ticket)](drogon::ResponseStreamPtr stream) mutable {
+                        createSession(topicSet, std::move(stream), authCtx, resumeFrom, batch, fields, format,
+                                      std::move(snapshot), std::move(ticket));
                     });
 
                 resp->setContentTypeString("text/event-stream");
                 resp->addHeader("Cache-Control", "no-cache");
                 resp->addHeader("Connection", "keep-alive");
                 resp->addHeader("X-Accel-Buffering", "no");
-                resp->addHeader("Access-Control-Allow-Origin", "*");
                 callback(resp);
             },
             {drogon::Get});
@@ -108,19 +214,160 @@ namespace mb {
                         updateAuthTokenForSSE()
                     }
         );
+
+        // POST /api/v1/realtime/publish — message an ephemeral channel; nothing is written
+        router.Post("/api/v1/realtime/publish",
+                    [](MantisRequest &req, const MantisResponse &res) {
+                        const auto &[body, err] = req.getBodyAsJson();
+                        const auto name = body.is_object() && body.contains("channel") && body["channel"].is_string()
+                                              ? Channels::nameOf(Channels::topicOf(body["channel"].get<std::string>()))
+                                              : std::nullopt;
+                        if (!err.empty() || !name) {
+                            res.sendJSON(400, {
+                                             {"error", err.empty() ? "Expected a valid `channel` name." : err},
+                                             {"data", json::object()},
+                                             {"status", 400}
+                                         });
+                            return;
+                        }
+
+                        try {
+                            Channels::instance().publish(*name, body.value("data", json(nullptr)),
+                                                         RealtimeAuth::fromRequest(req));
+                        } catch (const MantisException &e) {
+                            res.sendJSON(e.code(), {{"error", e.what()}, {"data", json::object()}, {"status", e.code()}});
+                            return;
+                        }
+                        res.sendJSON(200, {{"error", ""}, {"data", {{"channel", *name}}}, {"status", 200}});
+                    });
+
+        // GET /api/v1/realtime/presence?channel=... — members of a presence channel
+        router.Get("/api/v1/realtime/presence",
+                   [](MantisRequest &req, const MantisResponse &res) {
+                       const auto name = Channels::nameOf(Channels::topicOf(req.getQueryParamValue("channel")));
+                       const auto rules = name ? Channels::instance().rules(*name) : nullptr;
+                       if (!rules || !rules->presence) {
+                           res.sendJSON(404, {
+                                            {"error", "No such presence channel."},
+                                            {"data", json::object()},
+                                            {"status", 404}
+                                        });
+                           return;
+                       }
+                       auto &channels = Channels::instance();
+                       if (!channels.canSubscribe(*name, RealtimeAuth::fromRequest(req))) {
+                           res.sendJSON(403, {
+                                            {"error", std::format("Not allowed to subscribe to channel `{}`.", *name)},
+                                            {"data", json::object()},
+                                            {"status", 403}
+                                        });
+                           return;
+                       }
+                       res.sendJSON(200, {
+                                        {"error", ""},
+                                        {"data", {{"channel", *name}, {"members", channels.members(*name)}}},
+                                        {"status", 200}
+                                    });
+                   });
+
+        // GET /api/v1/sys/realtime — outbound queue metrics
+        router.Get("/api/v1/sys/realtime",
+                   [this](const MantisRequest &, const MantisResponse &res) {
+                       res.sendJSON(200, {{"data", queueStats()}, {"status", 200}, {"error", nullptr}});
+                   },
+                   {requireAdminAuth()});
     }
 
     std::string SSEMgr::createSession(const std::set<std::string> &initial_topics,
-                                      drogon::ResponseStreamPtr stream) {
-        std::lock_guard lock(m_sessions_mutex);
+                                      drogon::ResponseStreamPtr stream,
+                                      std::shared_ptr<const RealtimeAuth> auth,
+                                      const std::optional<std::uint64_t> resume_from,
+                                      const bool batch,
+                                      EncodedEvent::FieldSet fields,
+                                      const WireFormat::Format format,
+                                      std::optional<RealtimeSnapshot> snapshot,
+                                      std::shared_ptr<StreamLimits::Ticket> ticket) {
+        // Held through the replay below: broadcastChange() issues ids under this lock,
+        // so every change is either replayed here or delivered live, never both
+        std::unique_lock lock(m_sessions_mutex);
 
         std::string client_id = generateClientID();
-        auto session = std::make_shared<SSESession>(client_id, initial_topics, std::move(stream));
+        auto session = std::make_shared<SSESession>(client_id, std::move(stream));
+        if (auth) session->setAuthContext(std::move(auth));
+        session->setFields(fields);
+
+        // Drain on the loop serving this stream so the realtime worker never writes to it
+        std::weak_ptr<SSESession> weak = session;
+        auto options = m_queueOptions;
+        options.batch = batch;
+        options.format = format;
+        session->attachQueue(std::make_shared<SendQueue>(
+            options,
+            SendQueue::onLoop(trantor::EventLoop::getEventLoopOfCurrentThread()),
+            [weak](const std::string &frame) {
+                const auto s = weak.lock();
+                return s && s->sendFrame(frame);
+            },
+            [weak] {
+                if (const auto s = weak.lock()) s->close();
+            },
+            m_queueCounters));
+
+        // Evicted, it closes like a slow consumer and is reaped the same way
+        if (ticket) {
+            ticket->bind([weak] {
+                if (const auto s = weak.lock()) s->close();
+            });
+            session->holdTicket(std::move(ticket));
+        }
+
         m_sessions[client_id] = session;
+        indexTopicsLocked(session, initial_topics);
+
+        std::optional<Replay> replay;
+        if (snapshot)
+            replay = collectAfterSnapshot(*snapshot, initial_topics, *session->authContext(), m_queueOptions.capacity);
+        else if (resume_from)
+            replay = collectReplay(*resume_from, initial_topics, *session->authContext(), m_queueOptions.capacity);
+
+        // The connected frame's id is where a reconnect would resume from
+        const auto from = snapshot ? std::optional(snapshot->at()) : resume_from;
+        const auto last_id = replay ? *from : m_replay.lastId();
+        json connected = {
+            {"client_id", client_id},
+            {"topics", initial_topics},
+            {"last_event_id", last_id}
+        };
+        session->sendFrame(std::format("id: {}\n", last_id) + SSESession::buildFrame("connected", connected));
+
+        // First tick a ping interval from now, on this stream's loop
+        if (const auto loop = trantor::EventLoop::getEventLoopOfCurrentThread())
+            Keepalive::schedule(m_keepalive, m_keepalive->wheelFor(loop), session, m_keepalive->options.ping);
+
+        // Rows as of the snapshot, then the changes after it
+        if (snapshot && replay) {
+            for (const auto &frame: snapshot->frames(fields))
+                session->sendEvent("snapshot", frame);
+        }
+
+        if (replay) {
+            for (const auto &item: replay->items)
+                session->enqueue(item.event, item.rowTopic ? SendQueue::Frame::SseRow : SendQueue::Frame::SseEntity);
+        } else if (snapshot) {
+            // More changed during the read than the replay window holds
+            session->sendEvent("reset", {{"reason", "snapshot_unavailable"}, {"last_event_id", last_id}});
+        } else if (resume_from) {
+            session->sendEvent("reset", {{"reason", "resume_unavailable"}, {"last_event_id", last_id}});
+        }
 
         logEntry::info("SSE Manager",
                        std::format("New SSE session: {} (Total: {})", client_id, m_sessions.size()));
 
+        // Presence frames are delivered under the lock again
+        const auto channels = channelsLocked(*session);
+        lock.unlock();
+        for (const auto &name: channels) Channels::instance().joined(name, *session->authContext(), client_id);
+
         return client_id;
     }
 
@@ -134,15 +381,93 @@ namespace mb {
     }
 
     void SSEMgr::removeSession(const std::string &client_id) {
-        std::lock_guard<std::mutex> lock(m_sessions_mutex);
-        if (const auto it = m_sessions.find(client_id); it != m_sessions.end()) {
-            it->second->close();
+        std::shared_ptr<SSESession> session;
+        std::set<std::string> channels;
+        {
+            std::lock_guard<std::mutex> lock(m_sessions_mutex);
+            const auto it = m_sessions.find(client_id);
+            if (it == m_sessions.end()) return;
+            session = it->second;
+            channels = channelsLocked(*session);
+            unindexTopicsLocked(session);
+            session->close();
             m_sessions.erase(it);
 
             logEntry::info("SSE Manager",
                            std::format("Removed SSE session: {} (Remaining: {})",
                                        client_id, m_sessions.size()));
         }
+        for (const auto &name: channels) Channels::instance().left(name, *session->authContext(), client_id);
+    }
+
+    bool SSEMgr::updateTopics(const std::string &client_id, const std::set<std::string> &topics,
+                              std::shared_ptr<const RealtimeAuth> auth) {
+        std::shared_ptr<const RealtimeAuth> before, after;
+        std::set<std::string> left, joined;
+        {
+            std::lock_guard<std::mutex> lock(m_sessions_mutex);
+            const auto it = m_sessions.find(client_id);
+            if (it == m_sessions.end()) return false;
+
+            before = it->second->authContext();
+            left = channelsLocked(*it->second);
+            if (auth) it->second->setAuthContext(std::move(auth));
+            after = it->second->authContext();
+
+            unindexTopicsLocked(it->second);
+            indexTopicsLocked(it->second, topics);
+            joined = channelsLocked(*it->second);
+        }
+
+        // Still the same member: only the channels that changed
+        if (before->principal == after->principal) {
+            for (auto it = left.begin(); it != left.end();) {
+                if (joined.erase(*it)) it = left.erase(it);
+                else ++it;
+            }
+        }
+        auto &channels = Channels::instance();
+        for (const auto &name: left) channels.left(name, *before, client_id);
+        for (const auto &name: joined) channels.joined(name, *after, client_id);
+        return true;
+    }
+
+    std::set<std::string> SSEMgr::channelsLocked(const SSESession &session) const {
+        std::set<std::string> names;
+        for (const auto id: session.getTopics())
+            if (auto name = Channels::nameOf(m_topics.name(id))) names.insert(std::move(*name));
+        return names;
+    }
+
+    void SSEMgr::indexTopicsLocked(const std::shared_ptr<SSESession> &session,
+                                   const std::set<std::string> &topics) {
+        std::vector<TopicId> ids;
+        ids.reserve(topics.size());
+        for (const auto &topic: topics) {
+            const auto [id, first] = m_topics.add(topic, session);
+            ids.push_back(id);
+            // A topic's first subscriber makes this node listen for its entity
+            if (first && !Channels::isChannel(topic)) m_app.rt().watch(std::string(RealtimeDB::topicEntity(topic)));
+            if (const auto parsed = TopicFilters::parse(topic)) {
+                try {
+                    m_filters.add(topic, m_app.entity(parsed->entity).compileFilter(parsed->filter));
+                } catch (const std::exception &e) {
+                    // Checked when subscribing; the entity changed since
+                    logEntry::warn("SSE Manager", std::format("Topic `{}` matches nothing", topic), e.what());
+                }
+            }
+        }
+        session->setTopics(std::move(ids));
+    }
+
+    void SSEMgr::unindexTopicsLocked(const std::shared_ptr<SSESession> &session) {
+        for (const auto id: session->getTopics()) {
+            const auto &topic = m_topics.name(id);
+            if (TopicFilters::parse(topic)) m_filters.remove(topic);
+            if (const auto last = m_topics.remove(id, session); last && !Channels::isChannel(*last))
+                m_app.rt().unwatch(std::string(RealtimeDB::topicEntity(*last)));
+        }
+        session->setTopics({});
     }
 
     void SSEMgr::updateActivity(const std::string &client_id) {
@@ -163,76 +488,352 @@ namespace mb {
 
     void SSEMgr::broadcastChange(const json &change_event) {
         try {
-            // Broadcast to SSE sessions
+            // Sessions on `entity:<row_id>` get the row-topic frame; those
+            // on `entity` / `entity:*` get the entity-topic frame.
+            std::shared_ptr<const EncodedEvent> event;
+            std::vector<std::shared_ptr<SSESession>> row_sessions, entity_sessions;
             {
                 std::lock_guard lock(m_sessions_mutex);
-                std::vector<std::string> deadSessions;
 
-                for (const auto &[clientId, session]: m_sessions) {
-                    if (!session->isActive()) {
-                        deadSessions.push_back(clientId);
-                        continue;
-                    }
-                    if (session->isInterestedIn(change_event)) {
-                        json formatted = session->formatEvent(change_event);
-                        if (!session->sendEvent("change", formatted)) {
-                            deadSessions.push_back(clientId);
+                // Encoded once with its replay id; every recipient shares the same frames
+                event = m_replay.append(change_event);
+
+                std::vector<const std::vector<std::shared_ptr<SSESession>> *> row_lists, entity_lists;
+                const auto route = m_topics.route(event->entity(), event->rowId());
+                if (route.row) row_lists.push_back(route.row);
+                if (route.entity) entity_lists.push_back(route.entity);
+                if (route.wildcard) entity_lists.push_back(route.wildcard);
+                // Each filter is evaluated once for all of its subscribers
+                for (const auto &topic: m_filters.matching(*event))
+                    if (const auto id = m_topics.find(topic)) entity_lists.push_back(&m_topics.subscribers(*id));
+
+                // A session is in at most one list unless it follows several matching topics
+                std::unordered_set<const SSESession *> seen;
+                const bool dedup = row_lists.size() + entity_lists.size() > 1;
+                const auto collect = [&](const auto &lists, auto &out) {
+                    for (const auto *sessions: lists) {
+                        for (const auto &session: *sessions) {
+                            if (dedup && !seen.insert(session.get()).second) continue;
+                            if (session->isActive()) out.push_back(session);
                         }
                     }
-                }
+                };
+                collect(row_lists, row_sessions);
+                collect(entity_lists, entity_sessions);
+            }
 
-                for (const auto &id: deadSessions) {
-                    if (auto it = m_sessions.find(id); it != m_sessions.end()) {
-                        it->second->close();
-                        m_sessions.erase(it);
-                    }
+            if (!entity_sessions.empty() || !row_sessions.empty()) {
+                // Re-check the entity rules for every recipient against this row
+                const auto schema = m_app.entity(event->entity());
+                const auto &record = event->record();
+                auto &access = RealtimeAccess::instance();
+
+                // Only enqueues; a failed or evicted session is marked inactive and
+                // keepalive() reaps it
+                for (const auto &session: entity_sessions) {
+                    if (access.allows(schema.listRule(), *session->authContext(), record, schema.listFilter()))
+                        session->enqueue(event, SendQueue::Frame::SseEntity);
+                }
+                for (const auto &session: row_sessions) {
+                    if (access.allows(schema.getRule(), *session->authContext(), record, schema.getFilter()))
+                        session->enqueue(event, SendQueue::Frame::SseRow);
                 }
             }
 
             // Broadcast to WebSocket connections
             if (m_wsMgr) {
-                m_wsMgr->broadcastChange(change_event);
+                m_wsMgr->broadcastChange(event);
             }
         } catch (const std::exception &e) {
             logEntry::info("SSE Manager", "Broadcasting message failed!", e.what());
         }
     }
 
+    void SSEMgr::deliverEphemeral(const std::string &topic, const std::shared_ptr<const EncodedEvent> &event) {
+        std::vector<std::shared_ptr<SSESession>> sessions;
+        {
+            std::lock_guard lock(m_sessions_mutex);
+            if (const auto id = m_topics.find(topic)) {
+                for (const auto &session: m_topics.subscribers(*id))
+                    if (session->isActive()) sessions.push_back(session);
+            }
+        }
+        for (const auto &session: sessions) session->enqueue(event, SendQueue::Frame::SseEntity);
+
+        if (m_wsMgr) m_wsMgr->deliverEphemeral(topic, event);
+    }
+
     size_t SSEMgr::getSessionCount() {
         std::lock_guard lock(m_sessions_mutex);
         return m_sessions.size();
     }
 
+    std::size_t SSEMgr::sendReconnect(const std::function<std::chrono::milliseconds()> &delay) {
+        std::vector<std::shared_ptr<SSESession>> sessions;
+        {
+            std::lock_guard lock(m_sessions_mutex);
+            sessions.reserve(m_sessions.size());
+            for (const auto &[_, session]: m_sessions) sessions.push_back(session);
+        }
+
+        // Sent inline like a `reset`; the client still resumes from the last id it received
+        const auto last_id = m_replay.lastId();
+        std::size_t told = 0;
+        for (const auto &session: sessions) {
+            const auto retry = delay().count();
+            if (session->sendFrame(std::format("retry: {}\n", retry) +
+                                   SSESession::buildFrame("reconnect", {{"retry_ms", retry}, {"last_event_id", last_id}})))
+                ++told;
+        }
+        return told + m_wsMgr->sendReconnect(delay, last_id);
+    }
+
+    std::optional<SSEMgr::Replay> SSEMgr::collectReplay(const std::uint64_t after,
+                                                        const std::set<std::string> &topics,
+                                                        const RealtimeAuth &auth,
+                                                        const std::size_t limit) const {
+        Replay replay{after, {}};
+        bool overflow = false;
+
+        // entity -> the filters of its `entity?<filter>` topics
+        std::unordered_map<std::string, std::vector<std::shared_ptr<const CompiledFilter>>> filters;
+        for (const auto &topic: topics) {
+            if (const auto parsed = TopicFilters::parse(topic)) {
+                try {
+                    filters[parsed->entity].push_back(m_app.entity(parsed->entity).compileFilter(parsed->filter));
+                } catch (const std::exception &) {
+                    // Entity or field dropped since; its topic matches nothing
+                }
+            }
+        }
+        const auto filtered = [&](const EncodedEvent &event) {
+            const auto it = filters.find(event.entity());
+            return it != filters.end() && std::ranges::any_of(it->second, [&](const auto &filter) {
+                return TopicFilters::matches(*filter, event);
+            });
+        };
+
+        const auto upto = m_replay.since(after, [&](const std::shared_ptr<const EncodedEvent> &event) {
+            if (overflow) return;
+            const bool row_topic = topics.contains(event->rowTopic());
+            if (!row_topic && !topics.contains(event->entity()) && !topics.contains(event->entity() + ":*") &&
+                !filtered(*event))
+                return;
+            replay.items.push_back({event, row_topic});
+            overflow = replay.items.size() > limit;
+        });
+
+        // A delta bigger than the send queue would be cut short by its overflow policy
+        if (!upto || overflow) return std::nullopt;
+        replay.upto = *upto;
+
+        // Same per-row rule checks as broadcastChange(), against the rules in force now
+        std::unordered_map<std::string, std::optional<Entity>> schemas;
+        auto &access = RealtimeAccess::instance();
+        std::erase_if(replay.items, [&](const ReplayItem &item) {
+            auto it = schemas.find(item.event->entity());
+            if (it == schemas.end()) {
+                std::optional<Entity> schema;
+                try {
+                    schema.emplace(m_app.entity(item.event->entity()));
+                } catch (const std::exception &) {
+                    // Entity dropped since the change; nothing to deliver
+                }
+                it = schemas.emplace(item.event->entity(), std::move(schema)).first;
+            }
+            if (!it->second) return true;
+
+            const auto &rule = item.rowTopic ? it->second->getRule() : it->second->listRule();
+            const auto *filter = item.rowTopic ? it->second->getFilter() : it->second->listFilter();
+            return !access.allows(rule, auth, item.event->record(), filter);
+        });
+
+        return replay;
+    }
+
+    RealtimeSnapshot SSEMgr::takeSnapshot(const std::set<std::string> &topics, const RealtimeAuth &auth) const {
+        // Noted before reading: every change up to it had committed, so the rows show it
+        RealtimeSnapshot snapshot(m_replay.lastId());
+        const auto limit = m_snapshotOptions.maxRows;
+
+        // On the primary: a replica may not have caught up with the ids issued yet
+        const auto sql = m_app.db().session();
+        auto &access = RealtimeAccess::instance();
+        for (const auto &topic: topics) {
+            if (Channels::isChannel(topic)) continue;
+            const auto parsed = TopicFilters::parse(topic);
+            const auto name = parsed ? parsed->entity : std::string(RealtimeDB::topicEntity(topic));
+            if (!m_app.hasEntity(name)) continue;
+            const auto entity = m_app.entity(name);
+            snapshot.topic(topic);
+
+            const auto room = limit - std::min(limit, snapshot.size());
+            const auto colon = topic.find(':');
+            const bool row_topic = !parsed && colon != std::string::npos && topic.substr(colon + 1) != "*";
+            const auto rows = row_topic
+                                  ? entity.readMany(*sql, {topic.substr(colon + 1)})
+                                  : entity.readAll(*sql, parsed ? json{{"filter", parsed->filter}} : json::object(),
+                                                   room + 1);
+            // Past the limit before any rule check, so a rule can't hide that rows were left out
+            if (rows.size() > room)
+                throw MantisException(413, std::format(
+                    "More than {} rows to snapshot; subscribe to fewer rows or list them instead.", limit));
+
+            const auto &rule = row_topic ? entity.getRule() : entity.listRule();
+            const auto *filter = row_topic ? entity.getFilter() : entity.listFilter();
+            for (const auto &row: rows)
+                if (access.allows(rule, auth, row, filter)) snapshot.add(topic, name, row);
+        }
+        return snapshot;
+    }
+
+    std::optional<SSEMgr::Replay> SSEMgr::collectAfterSnapshot(const RealtimeSnapshot &snapshot,
+                                                               const std::set<std::string> &topics,
+                                                               const RealtimeAuth &auth,
+                                                               const std::size_t limit) const {
+        auto replay = collectReplay(snapshot.at(), topics, auth, limit);
+        if (!replay) return replay;
+
+        std::vector<const EncodedEvent *> events;
+        events.reserve(replay->items.size());
+        for (const auto &item: replay->items) events.push_back(item.event.get());
+        const auto covered = snapshot.covered(events);
+
+        std::vector<ReplayItem> items;
+        for (std::size_t i = 0; i < replay->items.size(); ++i)
+            if (!covered[i]) items.push_back(std::move(replay->items[i]));
+        replay->items = std::move(items);
+        return replay;
+    }
+
+    const ReplayBuffer &SSEMgr::replay() const {
+        return m_replay;
+    }
+
+    json SSEMgr::queueStats() {
+        json coalesce;
+        {
+            std::lock_guard lock(m_coalesceMutex);
+            coalesce = {
+                {"window_ms", m_coalescer.window().count()},
+                {"pending", m_coalescer.pending()},
+                {"merged", m_coalescer.merged()}
+            };
+        }
+
+        std::size_t queued = 0, max_depth = 0, subscribers = 0;
+        {
+            std::lock_guard lock(m_sessions_mutex);
+            subscribers = m_sessions.size();
+            for (const auto &session: m_sessions | std::views::values) {
+                const auto depth = session->queueDepth();
+                queued += depth;
+                max_depth = std::max(max_depth, depth);
+            }
+        }
+
+        return {
+            {"sse", {
+                {"subscribers", subscribers},
+                {"queued", queued},
+                {"max_depth", max_depth},
+                {"dropped", m_queueCounters->dropped.load()},
+                {"coalesced", m_queueCounters->coalesced.load()},
+                {"evicted", m_queueCounters->evicted.load()}
+            }},
+            {"ws", m_wsMgr->queueStats()},
+            {"coalesce", coalesce},
+            {"limits", m_limits->stats()},
+            {"capacity", m_queueOptions.capacity},
+            {"overflow", SendQueue::overflowName(m_queueOptions.overflow)}
+        };
+    }
+
     WSMgr &SSEMgr::wsMgr() const {
         return *m_wsMgr;
     }
 
+    StreamLimits &SSEMgr::limits() const {
+        return *m_limits;
+    }
+
     void SSEMgr::start() {
+        // Continue the id sequence and window saved by the previous process
+        if (m_replay.options().capacity > 0 && m_replay.load(replayPath()))
+            logEntry::info("SSE Manager",
+                           std::format("Restored {} realtime events for replay", m_replay.size()));
+
         m_app.rt().runWorker([this](const json &items) {
-            for (const auto &data_item: items) broadcastChange(data_item);
-        });
+            if (!m_coalescer.enabled()) {
+                for (const auto &data_item: items) broadcastChange(data_item);
+                return;
+            }
 
-        // Start cleanup thread for idle connections
-        m_cleanup_thread = std::thread([this] {
-            while (m_running.load()) {
-                {
-                    std::unique_lock lock(m_sessions_mutex);
-                    m_cv.wait_for(lock, std::chrono::minutes(1));
-                }
-                cleanupIdleSessions();
+            {
+                std::lock_guard lock(m_coalesceMutex);
+                for (const auto &data_item: items) m_coalescer.add(data_item);
             }
+            m_coalesceCv.notify_one();
         });
+
+        if (m_coalescer.enabled())
+            m_coalesce_thread = std::thread([this] { runCoalescer(); });
     }
 
     void SSEMgr::stop() {
         m_app.rt().stopWorker();
+        Channels::instance().setSink(nullptr);
 
         m_running.store(false);
-        m_cv.notify_all();
+        {
+            std::lock_guard lock(m_coalesceMutex);
+        }
+        m_coalesceCv.notify_all();
+
+        // Waits out ticks in progress; later ones see no manager
+        {
+            std::unique_lock lock(m_keepalive->mutex);
+            m_keepalive->mgr = nullptr;
+        }
+        {
+            // A wheel must go on its own loop; one whose loop has already quit is left to the process exit
+            std::lock_guard lock(m_keepalive->wheelsMutex);
+            for (const auto &[loop, wheel]: m_keepalive->wheels)
+                loop->runInLoop([wheel] { delete wheel; });
+            m_keepalive->wheels.clear();
+        }
 
-        if (m_cleanup_thread.joinable()) {
-            m_cleanup_thread.join();
+        if (m_coalesce_thread.joinable()) {
+            m_coalesce_thread.join();
         }
+
+        // No more events can be issued; keep the window for clients resuming after a restart
+        if (m_replay.options().capacity > 0 && m_replay.size() > 0 && !m_replay.save(replayPath()))
+            logEntry::warn("SSE Manager", "Could not save realtime replay window",
+                           replayPath().string());
+    }
+
+    void SSEMgr::runCoalescer() {
+        std::unique_lock lock(m_coalesceMutex);
+        while (m_running.load()) {
+            const auto deadline = m_coalescer.nextDeadline();
+            if (!deadline)
+                m_coalesceCv.wait(lock);
+            else if (*deadline > ChangeCoalescer::Clock::now())
+                m_coalesceCv.wait_until(lock, *deadline);
+
+            auto due = m_coalescer.drain();
+            if (due.empty()) continue;
+
+            lock.unlock();
+            for (const auto &change: due) broadcastChange(change);
+            lock.lock();
+        }
+
+        // Deliver what is still held rather than dropping it on shutdown
+        const auto rest = m_coalescer.flush();
+        lock.unlock();
+        for (const auto &change: rest) broadcastChange(change);
     }
 
     bool SSEMgr::isRunning() const { return m_running.load(); }
@@ -241,21 +842,27 @@ namespace mb {
         return [](mb::MantisRequest &req, mb::MantisResponse &res) {
             auto topics = req.getOr<json>("topics", json::array());
             auto client_id = req.getOr<std::string>("client_id", std::string{});
-            auto auth = req.getOr<json>("auth", json::object());
-            auto verification = req.getOr<json>("verification", json::object());
+            auto &auth = req.auth();
+            auto &verification = req.verification();
 
             auto &sse_mgr = req.mApp().router().sseMgr();
 
             std::set<std::string> new_topics;
             for (const auto &topic: topics) {
+                if (topic.contains("channel")) {
+                    new_topics.insert(Channels::topicOf(topic["channel"].get<std::string>()));
+                    continue;
+                }
                 auto entity_name = topic["entity"].get<std::string>();
                 auto record_id = topic["id"].get<std::string>();
-                if (!record_id.empty()) entity_name = std::format("{}:{}", entity_name, record_id);
+                if (const auto filter = topic.value("filter", ""); !filter.empty())
+                    entity_name = TopicFilters::topicOf(entity_name, filter);
+                else if (!record_id.empty()) entity_name = std::format("{}:{}", entity_name, record_id);
                 new_topics.insert(entity_name);
             }
 
-            if (const auto session = sse_mgr.getSession(client_id); session) {
-                session->setTopics(new_topics);
+            if (sse_mgr.updateTopics(client_id, new_topics,
+                                     std::make_shared<const RealtimeAuth>(RealtimeAuth::fromRequest(req)))) {
                 res.sendJSON(200, {
                                  {"error", ""},
                                  {
@@ -349,26 +956,54 @@ namespace mb {
                 // Parse URL Query params otherwise
                 else {
                     if (req.hasQueryParam("topics")) {
-                        const std::string topics_param = req.getQueryParamValue("topics");
-
-                        // Split by comma
-                        std::istringstream ss(topics_param);
-                        std::string topic;
-
-                        while (std::getline(ss, topic, ',')) {
-                            // Trim whitespace
-                            topic = trim(topic);
-
-                            if (!topic.empty()) {
-                                topics.insert(topic);
-                            }
-                        }
+                        // Split by comma, outside a filter's strings and lists
+                        for (auto &topic: TopicFilters::splitTopics(req.getQueryParamValue("topics")))
+                            topics.insert(std::move(topic));
                     }
                 }
 
                 json _topics = json::array();
 
                 for (const auto &topic: topics) {
+                    // `@<channel>`: an ephemeral channel, checked against its subscribe rule
+                    if (Channels::isChannel(topic)) {
+                        const auto name = Channels::nameOf(topic);
+                        if (!name || !Channels::instance().rules(*name)) {
+                            res.sendJSON(400, {
+                                             {"error", std::format("Invalid topic `{}`, expected a declared channel.", topic)},
+                                             {"data", json::object()},
+                                             {"status", 400}
+                                         });
+                            return HandlerResponse::Handled;
+                        }
+                        _topics.push_back({{"channel", *name}});
+                        continue;
+                    }
+
+                    // `entity?<filter>`: the rows of `entity` that match, checked against its list rule
+                    if (const auto parsed = TopicFilters::parse(topic)) {
+                        if (!MantisBase::instance().hasEntity(parsed->entity)) {
+                            res.sendJSON(400, {
+                                             {"error", "Invalid topic name, expected valid entity name."},
+                                             {"data", json::object()},
+                                             {"status", 400}
+                                         });
+                            return HandlerResponse::Handled;
+                        }
+                        try {
+                            (void) MantisBase::instance().entity(parsed->entity).compileFilter(parsed->filter);
+                        } catch (const MantisException &e) {
+                            res.sendJSON(400, {
+                                             {"error", e.what()},
+                                             {"data", json::object()},
+                                             {"status", 400}
+                                         });
+                            return HandlerResponse::Handled;
+                        }
+                        _topics.push_back({{"entity", parsed->entity}, {"id", ""}, {"filter", parsed->filter}});
+                        continue;
+                    }
+
                     auto array = splitString(topic, ":");
                     auto entity_name = array.at(0);
                     auto record_id = array.size() > 1 && array.at(1) != "*" ? array.at(1) : "";
@@ -406,16 +1041,27 @@ namespace mb {
     std::function<mb::HandlerResponse(mb::MantisRequest &, mb::MantisResponse &)> mb::SSEMgr::validateHasAccess() {
         return [](MantisRequest &req, const MantisResponse &res) -> HandlerResponse {
             auto topics = req.getOr<json>("topics", json::array());
-            auto auth = req.getOr<json>("auth", json::object());
-            auto verification = req.getOr<json>("verification", json::object());
+            auto &auth = req.auth();
+            auto &verification = req.verification();
 
             for (const auto &topic: topics) {
+                if (topic.contains("channel")) {
+                    const auto name = topic["channel"].get<std::string>();
+                    if (Channels::instance().canSubscribe(name, RealtimeAuth::fromRequest(req))) continue;
+                    res.sendJSON(403, {
+                                     {"data", json::object()},
+                                     {"status", 403},
+                                     {"error", std::format("Not allowed to subscribe to channel `{}`.", name)}
+                                 });
+                    return HandlerResponse::Handled;
+                }
+
                 auto entity_name = topic["entity"].get<std::string>();
                 auto record_id = topic["id"].get<std::string>();
 
                 auto entity = MantisBase::instance().entity(entity_name);
 
-                auto rule = record_id.empty() ? entity.listRule() : entity.getRule();
+                const auto &rule = record_id.empty() ? entity.listRule() : entity.getRule();
 
                 // For public access, allow access
                 if (rule.mode() == "public") continue;
@@ -494,8 +1140,6 @@ namespace mb {
                 }
 
                 if (rule.mode() == "custom") {
-                    const std::string expr = rule.expr();
-
                     json vars = json::object();
                     vars["auth"] = auth;
 
@@ -507,7 +1151,7 @@ namespace mb {
                     req_obj["body"] = json::object();
 
                     try {
-                        if (req.getMethod() == "POST" && !req.getBody().empty()) {
+                        if (req.method() == RequestMethod::Post && !req.bodyView().empty()) {
                             req_obj["body"] = req.getBodyAsJson();
                         }
                     } catch (...) {
@@ -515,7 +1159,8 @@ namespace mb {
 
                     vars["req"] = req_obj;
 
-                    if (Expr::eval(expr, vars))
+                    // Compiled with the cached Entity; only binds `vars` here
+                    if (rule.evaluate(vars))
                         continue;
 
                     json response;
@@ -552,45 +1197,41 @@ namespace mb {
         return std::format("sse_{}_{}{}", now, counter++, generateShortId(5));
     }
 
-    void mb::SSEMgr::cleanupIdleSessions() {
-        std::lock_guard lock(m_sessions_mutex);
+    std::optional<std::uint64_t> mb::SSEMgr::parseEventId(const std::string &value) {
+        const auto text = trim(value);
+        std::uint64_t id = 0;
+        const auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), id);
+        if (text.empty() || ec != std::errc{} || ptr != text.data() + text.size())
+            return std::nullopt;
+        return id;
+    }
 
-        const auto now = std::chrono::steady_clock::now();
-        std::vector<std::string> stale_sessions;
+    std::filesystem::path mb::SSEMgr::replayPath() const {
+        return std::filesystem::path(m_app.dataDir()) / "mb_realtime_replay.json";
+    }
 
-        for (auto &[sessionId, session]: m_sessions) {
-            if (!session->isActive()) {
-                stale_sessions.push_back(sessionId);
-                continue;
-            }
+    const std::string &mb::SSEMgr::pingFrame() {
+        static const std::string frame = SSESession::buildFrame("ping", {{"type", "keepalive"}});
+        return frame;
+    }
 
-            auto idle_time = std::chrono::duration_cast<std::chrono::minutes>(
-                now - session->getLastActivity()
-            ).count();
+    void mb::SSEMgr::keepalive(trantor::TimingWheel &wheel, const std::shared_ptr<SSESession> &session) {
+        const auto &options = m_keepalive->options;
+        const auto quiet = std::chrono::steady_clock::now() - session->getLastActivity();
 
-            if (idle_time > 10 || session->getTopics().empty()) {
-                stale_sessions.push_back(sessionId);
-            } else {
-                // Send keepalive ping to active sessions
-                json ping = {{"type", "keepalive"}};
-                session->sendEvent("ping", ping);
-            }
+        if (!session->isActive() || quiet > options.idle || !session->hasTopics()) {
+            logEntry::warn("SSE Manager", std::format("Removing stale session: {}", session->getClientID()));
+            removeSession(session->getClientID());
+            return;
         }
 
-        for (const auto &sessionId: stale_sessions) {
-            logEntry::warn("SSE Manager",
-                           std::format("Removing stale session: {}", sessionId));
+        // Frames sent since the last tick kept the stream open; a ping only fills the silence
+        auto next = options.ping;
+        if (quiet < options.ping)
+            next = std::chrono::ceil<std::chrono::seconds>(options.ping - quiet);
+        else if (!session->sendFrame(pingFrame()))
+            next = std::chrono::seconds(1); // Reaped on the next tick
 
-            if (auto it = m_sessions.find(sessionId); it != m_sessions.end()) {
-                it->second->close();
-                m_sessions.erase(it);
-            }
-        }
-
-        if (!stale_sessions.empty()) {
-            logEntry::info("SSE Manager",
-                           std::format("Cleaned up {} stale sessions (Active: {})",
-                                       stale_sessions.size(), m_sessions.size()));
-        }
+        Keepalive::schedule(m_keepalive, wheel, session, next);
     }
 }
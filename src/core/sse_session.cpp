@@ -6,24 +6,31 @@
 
 mb::SSESession::SSESession(
     std::string client_id,
-    const std::set<std::string> &topics,
     drogon::ResponseStreamPtr stream)
     : m_clientID(std::move(client_id)),
-      m_topics(topics),
       m_stream(std::move(stream)),
+      m_authCtx(std::make_shared<const RealtimeAuth>()),
       m_isActive(true),
       m_lastActivity(std::chrono::steady_clock::now()) {
 }
 
 bool mb::SSESession::sendEvent(const std::string &eventType, const json &data) {
-    if (!m_isActive || !m_stream)
-        return false;
+    return sendFrame(buildFrame(eventType, data));
+}
 
+std::string mb::SSESession::buildFrame(const std::string &eventType, const json &data) {
     std::string payload;
     payload += "event: " + eventType + "\n";
     payload += "data: " + data.dump() + "\n\n";
+    return payload;
+}
+
+bool mb::SSESession::sendFrame(const std::string &frame) {
+    std::lock_guard<std::mutex> lock(m_streamMutex);
+    if (!m_isActive || !m_stream)
+        return false;
 
-    if (!m_stream->send(payload)) {
+    if (!m_stream->send(frame)) {
         m_isActive = false;
         return false;
     }
@@ -32,81 +39,73 @@ bool mb::SSESession::sendEvent(const std::string &eventType, const json &data) {
     return true;
 }
 
-bool mb::SSESession::isInterestedIn(const json &change_event) const {
-    const std::string event_table = change_event["entity"].get<std::string>();
-    const std::string event_row_id = change_event["row_id"].get<std::string>();
-
-    if (m_topics.contains(event_table))
-        return true;
-
-    std::string specific_topic = event_table + ":" + event_row_id;
-    if (m_topics.contains(specific_topic))
-        return true;
-
-    std::string wildcard_topic = event_table + ":*";
-    if (m_topics.contains(wildcard_topic))
-        return true;
+void mb::SSESession::attachQueue(std::shared_ptr<SendQueue> queue) {
+    m_queue = std::move(queue);
+}
 
-    return false;
+void mb::SSESession::setFields(EncodedEvent::FieldSet fields) {
+    m_fields = std::move(fields);
 }
 
-mb::json mb::SSESession::formatEvent(const json &change_event) const {
-    auto table = change_event["entity"].get<std::string>();
-    auto row_id = change_event["row_id"].get<std::string>();
-    auto operation = change_event["type"].get<std::string>();
+bool mb::SSESession::enqueue(const std::shared_ptr<const EncodedEvent> &event, const SendQueue::Frame frame) {
+    const auto projected = EncodedEvent::project(event, m_fields);
+    if (!m_queue)
+        return sendFrame(projected->sse(frame == SendQueue::Frame::SseRow));
+    return m_queue->push(projected, frame);
+}
 
-    toLowerCase(operation);
-    std::string matched_topic = table;
+std::size_t mb::SSESession::queueDepth() const {
+    return m_queue ? m_queue->depth() : 0;
+}
 
-    {
-        const std::string specific_topic = format("{}:{}", table, row_id);
-        std::lock_guard<std::mutex> lock(m_topicsMutex);
-        if (m_topics.contains(specific_topic)) {
-            matched_topic = specific_topic;
-        }
-    }
+std::shared_ptr<const mb::RealtimeAuth> mb::SSESession::authContext() const {
+    std::lock_guard<std::mutex> lock(m_authMutex);
+    return m_authCtx;
+}
 
-    json data = operation=="insert" || operation == "update" ? change_event["new_data"] : nullptr;
+void mb::SSESession::setAuthContext(std::shared_ptr<const RealtimeAuth> auth) {
+    std::lock_guard<std::mutex> lock(m_authMutex);
+    m_authCtx = std::move(auth);
+}
 
-    return {
-        {"topic", matched_topic},
-        {"action", operation},
-        {"timestamp", change_event["timestamp"]},
-        {"row_id", row_id},
-        {"entity", table},
-        {"data", data}
-    };
+void mb::SSESession::holdTicket(std::shared_ptr<StreamLimits::Ticket> ticket) {
+    std::lock_guard<std::mutex> lock(m_streamMutex);
+    m_ticket = std::move(ticket);
 }
 
 void mb::SSESession::updateActivity() {
     m_lastActivity = std::chrono::steady_clock::now();
 }
 
-void mb::SSESession::updateTopics(const std::set<std::string> &topics) {
-    std::lock_guard<std::mutex> lock(m_topicsMutex);
-    m_topics = topics;
-}
-
 std::chrono::steady_clock::time_point mb::SSESession::getLastActivity() const { return m_lastActivity; }
 
 void mb::SSESession::close() {
+    if (m_queue) m_queue->close();
+
+    std::lock_guard<std::mutex> lock(m_streamMutex);
     m_isActive = false;
     if (m_stream) {
         m_stream->close();
         m_stream.reset();
     }
+    m_ticket.reset();
 }
 
 bool mb::SSESession::isActive() const { return m_isActive; }
 
 const std::string &mb::SSESession::getClientID() const { return m_clientID; }
 
-std::set<std::string> mb::SSESession::getTopics() const {
+std::vector<mb::TopicId> mb::SSESession::getTopics() const {
     std::lock_guard<std::mutex> lock(m_topicsMutex);
     return m_topics;
 }
 
-void mb::SSESession::setTopics(const std::set<std::string> &topics) {
+void mb::SSESession::setTopics(std::vector<TopicId> topics) {
+    std::lock_guard<std::mutex> lock(m_topicsMutex);
+    m_topics = std::move(topics);
+}
+
+bool mb::SSESession::hasTopics() const {
     std::lock_guard<std::mutex> lock(m_topicsMutex);
-    m_topics = topics;
+    return !m_topics.empty();
 }
@@ -0,0 +1,281 @@
+/**
+ * @file static_cache.cpp
+ * @brief Implementation for @see static_cache.h
+ */
+
+#include "../../include/mantisbase/core/static_cache.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/file_serving.h"
+#include "../../include/mantisbase/core/metrics.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/utils/crypto_utils.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace mb {
+    namespace {
+        std::size_t slot(const Compression::Encoding encoding) {
+            return static_cast<std::size_t>(encoding);
+        }
+
+        std::string readFile(const fs::path &path) {
+            std::ifstream in(path, std::ios::binary);
+            if (!in) throw MantisException(500, std::format("Could not read `{}`", path.string()));
+            return {std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+        }
+
+        fs::path withSuffix(const fs::path &file, const std::string_view suffix) {
+            return fs::path(file.string() + std::string(suffix));
+        }
+
+        /// `app.js.br` next to `app.js` is a variant of it, not a file of its own
+        bool isVariant(const fs::path &file) {
+            std::error_code ec;
+            const auto name = file.string();
+            return std::ranges::any_of(Compression::PREFERENCE, [&](const auto encoding) {
+                const auto suffix = Compression::suffix(encoding);
+                return name.ends_with(suffix) && fs::is_regular_file(name.substr(0, name.size() - suffix.size()), ec);
+            });
+        }
+
+#ifdef __linux__
+        constexpr std::uint32_t WATCHED = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                          IN_DELETE_SELF;
+
+        /// Watch `dir` and every directory under it; already watched ones keep their watch
+        void addWatches(const int fd, const fs::path &dir) {
+            inotify_add_watch(fd, dir.c_str(), WATCHED);
+            std::error_code ec;
+            for (fs::recursive_directory_iterator it(dir, fs::directory_options::skip_permission_denied, ec), end;
+                 !ec && it != end; it.increment(ec)) {
+                if (it->is_directory(ec)) inotify_add_watch(fd, it->path().c_str(), WATCHED);
+            }
+        }
+
+        /// Wait up to `timeout_ms` for events and read them all; whether there were any
+        bool drainEvents(const int fd, const int timeout_ms) {
+            pollfd pfd{fd, POLLIN, 0};
+            if (poll(&pfd, 1, timeout_ms) <= 0) return false;
+            alignas(inotify_event) char buffer[16 * 1024];
+            while (::read(fd, buffer, sizeof buffer) > 0) {}
+            return true;
+        }
+#endif
+    }
+
+    StaticCache::Options StaticCache::Options::fromEnv() {
+        Options options;
+        options.enabled = getEnvOrDefault("MB_PUBLIC_CACHE", "0") == "1";
+        if (const auto mib = safe_stoi(getEnvOrDefault("MB_PUBLIC_CACHE_MAX_MB", ""), -1); mib >= 0)
+            options.maxBytes = static_cast<std::size_t>(mib) * 1024 * 1024;
+        return options;
+    }
+
+    std::size_t StaticCache::Asset::bytes() const {
+        std::size_t total = body.size();
+        for (const auto &variant: encoded) total += variant.size();
+        return total;
+    }
+
+    StaticCache::StaticCache(const Options options, std::function<std::string(const std::string &)> mime_of)
+        : m_options(options), m_mimeOf(std::move(mime_of)) {}
+
+    StaticCache::~StaticCache() {
+        stop();
+    }
+
+    std::size_t StaticCache::load(const fs::path &dir) {
+        std::lock_guard lock(m_loadMutex);
+        const auto previous = m_table.load();
+
+        std::vector<fs::path> paths;
+        std::error_code ec;
+        for (fs::recursive_directory_iterator it(dir, fs::directory_options::skip_permission_denied, ec), end;
+             !ec && it != end; it.increment(ec)) {
+            // Dotfiles (.env, .git) are never served from here
+            if (it->path().filename().string().starts_with('.')) {
+                if (it->is_directory(ec)) it.disable_recursion_pending();
+                continue;
+            }
+            if (it->is_regular_file(ec) && !isVariant(it->path())) paths.push_back(it->path());
+        }
+        // The same files make the budget every time
+        std::ranges::sort(paths);
+
+        auto table = std::make_shared<Table>();
+        std::size_t bytes = 0, skipped = 0;
+        for (const auto &path: paths) {
+            const auto size = fs::file_size(path, ec);
+            const auto mtime = ec ? fs::file_time_type{} : fs::last_write_time(path, ec);
+            if (ec || bytes + size > m_options.maxBytes) {
+                ++skipped;
+                continue;
+            }
+
+            const auto key = "/" + path.lexically_relative(dir).generic_string();
+            const auto it = previous->find(key);
+            std::shared_ptr<const Asset> asset;
+            try {
+                asset = build(path, size, mtime, it != previous->end() ? it->second : nullptr);
+            } catch (const std::exception &e) {
+                LogOrigin::warn("Public Cache", std::format("Left `{}` to disk: {}", key, e.what()));
+            }
+            if (!asset || bytes + asset->bytes() > m_options.maxBytes) {
+                ++skipped;
+                continue;
+            }
+            bytes += asset->bytes();
+            table->emplace(key, std::move(asset));
+        }
+
+        const auto files = table->size();
+        m_table.store(std::move(table));
+        m_bytes.store(bytes);
+        m_skipped.store(skipped);
+        LogOrigin::info("Public Cache", std::format("Cached {} file(s), {} KiB, from `{}`{}", files, bytes / 1024,
+                                                    dir.string(),
+                                                    skipped ? std::format("; {} left to disk", skipped) : ""));
+        return files;
+    }
+
+    std::shared_ptr<const StaticCache::Asset> StaticCache::build(const fs::path &file, const std::uintmax_t size,
+                                                                const fs::file_time_type mtime,
+                                                                const std::shared_ptr<const Asset> &previous) const {
+        if (previous && previous->size == size && previous->mtime == mtime) return previous;
+
+        auto asset = std::make_shared<Asset>();
+        asset->body = readFile(file);
+        asset->size = size;
+        asset->mtime = mtime;
+        asset->mime = m_mimeOf(file.string());
+        // Hashed bundle files never change under their name; the rest is revalidated
+        asset->cacheControl = FileServing::isFingerprinted(file.filename().string())
+                                  ? "public, max-age=31536000, immutable"
+                                  : "no-cache";
+
+        const auto hash = sha256Hex(asset->body);
+        asset->etags[slot(Compression::Encoding::Identity)] = FileServing::etag(hash);
+
+        if (Compression::isCompressible(asset->mime)) {
+            std::error_code ec;
+            for (const auto encoding: Compression::PREFERENCE) {
+                std::string encoded;
+                if (const auto sibling = withSuffix(file, Compression::suffix(encoding)); fs::is_regular_file(sibling, ec))
+                    encoded = readFile(sibling);
+                else if (Compression::available(encoding))
+                    encoded = Compression::compress(encoding, asset->body, true);
+                // Not smaller: the body is sent as is
+                if (encoded.empty() || encoded.size() >= asset->body.size()) continue;
+
+                asset->encoded[slot(encoding)] = std::move(encoded);
+                asset->etags[slot(encoding)] = FileServing::etag(std::format("{}-{}", hash, Compression::token(encoding)));
+            }
+        }
+        return asset;
+    }
+
+    void StaticCache::watch(const fs::path &dir) {
+#ifdef __linux__
+        if (m_watcher.joinable()) return;
+        m_stopping = false;
+        m_watcher = std::thread(&StaticCache::loop, this, dir);
+#else
+        (void) dir;
+#endif
+    }
+
+    void StaticCache::stop() {
+        m_stopping = true;
+        if (m_watcher.joinable()) m_watcher.join();
+    }
+
+    void StaticCache::loop(const fs::path dir) {
+#ifdef __linux__
+        const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0) {
+            LogOrigin::warn("Public Cache", "inotify is unavailable; changes to the public directory need a restart");
+            return;
+        }
+        addWatches(fd, dir);
+
+        while (!m_stopping) {
+            if (!drainEvents(fd, 500)) continue;
+            // A deploy or an editor writes several files in a row; load once they're done
+            while (!m_stopping && drainEvents(fd, 200)) {}
+            if (m_stopping) break;
+
+            try {
+                load(dir);
+                m_reloads.fetch_add(1);
+                // Directories created since
+                addWatches(fd, dir);
+            } catch (const std::exception &e) {
+                LogOrigin::warn("Public Cache", std::format("Reloading `{}` failed: {}", dir.string(), e.what()));
+            }
+        }
+        ::close(fd);
+#else
+        (void) dir;
+#endif
+    }
+
+    std::shared_ptr<const StaticCache::Asset> StaticCache::find(const std::string_view path) const {
+        std::string key(path);
+        if (key.empty() || key.ends_with('/')) key += "index.html";
+        const auto table = m_table.load();
+        const auto it = table->find(key);
+        return it == table->end() ? nullptr : it->second;
+    }
+
+    drogon::HttpResponsePtr StaticCache::respond(const drogon::HttpRequestPtr &req) const {
+        const auto asset = find(req->path());
+        if (!asset) return nullptr;
+
+        auto resp = drogon::HttpResponse::newHttpResponse();
+        auto encoding = Compression::Encoding::Identity;
+        if (std::ranges::any_of(asset->encoded, [](const auto &variant) { return !variant.empty(); })) {
+            resp->addHeader("Vary", "Accept-Encoding");
+            if (const auto chosen = Compression::negotiate(req->getHeader("accept-encoding"));
+                !asset->encoded[slot(chosen)].empty())
+                encoding = chosen;
+        }
+
+        const auto &etag = asset->etags[slot(encoding)];
+        resp->addHeader("ETag", etag);
+        resp->addHeader("Cache-Control", asset->cacheControl);
+        if (FileServing::ifNoneMatch(req->getHeader("if-none-match"), etag)) {
+            resp->setStatusCode(drogon::k304NotModified);
+            return resp;
+        }
+
+        if (encoding != Compression::Encoding::Identity)
+            resp->addHeader("Content-Encoding", std::string(Compression::token(encoding)));
+        resp->setBody(encoding == Compression::Encoding::Identity ? asset->body : asset->encoded[slot(encoding)]);
+        resp->setContentTypeString(asset->mime);
+        resp->setStatusCode(drogon::k200OK);
+        return resp;
+    }
+
+    void StaticCache::writeMetrics(MetricsWriter &out) const {
+        out.family("mb_public_cache_files", "Files of the public directory served from memory", "gauge");
+        out.sample("mb_public_cache_files", {}, static_cast<double>(files()));
+        out.family("mb_public_cache_bytes", "Bytes held for them, compressed variants included", "gauge");
+        out.sample("mb_public_cache_bytes", {}, static_cast<double>(bytes()));
+        out.family("mb_public_cache_skipped", "Files left to disk by the last load, past MB_PUBLIC_CACHE_MAX_MB",
+                   "gauge");
+        out.sample("mb_public_cache_skipped", {}, static_cast<double>(m_skipped.load()));
+        out.family("mb_public_cache_reloads_total", "Reloads after a change in the public directory", "counter");
+        out.sample("mb_public_cache_reloads_total", {}, static_cast<double>(m_reloads.load()));
+    }
+}
@@ -0,0 +1,137 @@
+/**
+ * @file storage.cpp
+ * @brief Implementation for @see storage.h
+ */
+
+#include "../../include/mantisbase/core/storage.h"
+#include "../../include/mantisbase/core/blob_store.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/core/s3_storage.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+
+namespace mb {
+    namespace fs = std::filesystem;
+
+    // ----------------------------------------------------------------- //
+    // LocalStorage                                                      //
+    // ----------------------------------------------------------------- //
+
+    bool LocalStorage::hasBlob(const std::string &sha256) {
+        return fs::exists(BlobStore::blobPath(sha256));
+    }
+
+    void LocalStorage::putBlob(const std::string &sha256, const fs::path &file, const std::string &) {
+        const auto blob = BlobStore::blobPath(sha256);
+        std::error_code ec;
+        fs::create_directories(blob.parent_path(), ec);
+        // Staged on the same filesystem, so this is an atomic rename
+        if (!ec) fs::rename(file, blob, ec);
+        if (ec)
+            throw MantisException(500, "Failed to store blob `" + sha256 + "`: " + ec.message());
+    }
+
+    bool LocalStorage::removeBlob(const std::string &sha256) {
+        std::error_code ec;
+        fs::remove(BlobStore::blobPath(sha256), ec);
+        if (ec)
+            LogOrigin::warn("Blob Removal Error", fmt::format("Error removing blob `{}`: {}", sha256, ec.message()));
+        return !ec;
+    }
+
+    // ----------------------------------------------------------------- //
+    // Storage                                                           //
+    // ----------------------------------------------------------------- //
+
+    Storage::Storage(std::unique_ptr<StorageBackend> backend, Remover remover)
+        : m_backend(std::move(backend)), m_remover(std::move(remover)) {}
+
+    Storage::~Storage() {
+        close();
+    }
+
+    std::unique_ptr<StorageBackend> Storage::backendFromEnv() {
+        auto kind = getEnvOrDefault("MB_STORAGE", "local");
+        toLowerCase(kind);
+        if (kind == "s3") return std::make_unique<S3Storage>(S3Storage::Options::fromEnv());
+        if (kind != "local")
+            LogOrigin::warn("Storage", fmt::format("Unknown MB_STORAGE `{}`, using local storage.", kind));
+        return std::make_unique<LocalStorage>();
+    }
+
+    void Storage::scheduleRemoval(const std::string &sha256) {
+        if (m_backend->isLocal()) {
+            [[maybe_unused]] auto _ = m_remover(sha256);
+            return;
+        }
+
+        std::lock_guard lock(m_mutex);
+        if (m_stopping) {
+            // Shutting down; the blob stays, as it would after a crash
+            LogOrigin::warn("Storage", fmt::format("Not removing blob `{}` during shutdown.", sha256));
+            return;
+        }
+        m_queue.push_back({sha256, 0, std::chrono::steady_clock::now()});
+        if (!m_worker.joinable()) m_worker = std::thread([this] { run(); });
+        m_cv.notify_one();
+    }
+
+    std::size_t Storage::pendingRemovals() const {
+        std::lock_guard lock(m_mutex);
+        return m_queue.size();
+    }
+
+    void Storage::close() {
+        {
+            std::lock_guard lock(m_mutex);
+            if (m_stopping) return;
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        if (m_worker.joinable()) m_worker.join();
+    }
+
+    void Storage::run() {
+        std::unique_lock lock(m_mutex);
+        while (true) {
+            if (m_queue.empty()) {
+                if (m_stopping) return;
+                m_cv.wait(lock);
+                continue;
+            }
+
+            // Take whatever is due; a blob backing off doesn't hold up the others
+            const auto now = std::chrono::steady_clock::now();
+            auto it = m_stopping ? m_queue.begin()
+                                 : std::ranges::find_if(m_queue, [now](const Pending &p) { return p.due <= now; });
+            if (it == m_queue.end()) {
+                m_cv.wait_until(lock, std::ranges::min_element(m_queue, {}, &Pending::due)->due);
+                continue;
+            }
+
+            auto job = std::move(*it);
+            m_queue.erase(it);
+            const bool last_chance = m_stopping;
+            lock.unlock();
+
+            bool done = false;
+            try {
+                done = m_remover(job.sha256);
+            } catch (const std::exception &e) {
+                LogOrigin::warn("Storage", fmt::format("Removing blob `{}` failed: {}", job.sha256, e.what()));
+            }
+
+            lock.lock();
+            if (done) continue;
+            if (++job.attempts >= MAX_REMOVAL_ATTEMPTS || last_chance) {
+                LogOrigin::warn("Storage", fmt::format("Giving up on removing blob `{}` after {} attempts.",
+                                                       job.sha256, job.attempts));
+                continue;
+            }
+            job.due = std::chrono::steady_clock::now() + std::chrono::seconds(1 << job.attempts);
+            m_queue.push_back(std::move(job));
+        }
+    }
+}
@@ -0,0 +1,166 @@
+/**
+ * @file stream_limits.cpp
+ * @brief Implementation for @see stream_limits.h
+ */
+
+#include "../../include/mantisbase/core/stream_limits.h"
+#include "../../include/mantisbase/core/metrics.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <format>
+#include <vector>
+
+namespace mb {
+    struct StreamLimits::State {
+        std::mutex mutex;
+        std::unordered_map<std::string, std::list<Ticket *>> byIp, byUser; ///> Oldest first
+        std::size_t active = 0;
+        std::atomic<std::uint64_t> rejectedIp{0}, rejectedUser{0}, evicted{0};
+
+        /// Take `ticket` out of the counts; under the mutex.
+        void unlink(Ticket &ticket) {
+            if (!ticket.m_counted) return;
+            ticket.m_counted = false;
+            --active;
+            if (!ticket.m_ip.empty()) erase(byIp, ticket.m_ip, ticket.m_ipPos);
+            if (!ticket.m_user.empty()) erase(byUser, ticket.m_user, ticket.m_userPos);
+        }
+
+        static void erase(std::unordered_map<std::string, std::list<Ticket *>> &map, const std::string &key,
+                          const std::list<Ticket *>::iterator pos) {
+            const auto it = map.find(key);
+            if (it == map.end()) return;
+            it->second.erase(pos);
+            if (it->second.empty()) map.erase(it);
+        }
+    };
+
+    StreamLimits::Options StreamLimits::Options::fromEnv() {
+        Options options;
+        if (const auto n = safe_stoi(getEnvOrDefault("MB_REALTIME_MAX_PER_IP", ""), -1); n > 0)
+            options.perIp = static_cast<std::size_t>(n);
+        if (const auto n = safe_stoi(getEnvOrDefault("MB_REALTIME_MAX_PER_USER", ""), -1); n > 0)
+            options.perUser = static_cast<std::size_t>(n);
+        const auto policy = getEnvOrDefault("MB_REALTIME_LIMIT_POLICY", "reject");
+        if (policy == "evict_oldest") {
+            options.policy = Policy::EvictOldest;
+        } else if (policy != "reject") {
+            LogOrigin::warn("Realtime", std::format("Unknown MB_REALTIME_LIMIT_POLICY `{}`, using `reject`", policy));
+        }
+        return options;
+    }
+
+    StreamLimits::Ticket::Ticket(std::shared_ptr<State> state, std::string ip, std::string user)
+        : m_state(std::move(state)), m_ip(std::move(ip)), m_user(std::move(user)) {}
+
+    StreamLimits::Ticket::~Ticket() {
+        std::lock_guard lock(m_state->mutex);
+        m_state->unlink(*this);
+    }
+
+    void StreamLimits::Ticket::bind(std::function<void()> close) {
+        {
+            std::lock_guard lock(m_state->mutex);
+            if (!m_evicted) {
+                m_close = std::move(close);
+                return;
+            }
+        }
+        if (close) close();
+    }
+
+    StreamLimits::StreamLimits(const Options options)
+        : m_options(options), m_state(std::make_shared<State>()) {}
+
+    StreamLimits::~StreamLimits() = default;
+
+    std::unique_ptr<StreamLimits::Ticket> StreamLimits::acquire(const std::string &ip, const std::string &principal,
+                                                                Refusal *refusal) {
+        const bool cap_ip = m_options.perIp > 0 && !ip.empty();
+        const bool cap_user = m_options.perUser > 0 && !principal.empty() && principal != "guest";
+        if (!cap_ip && !cap_user) return std::make_unique<Ticket>(m_state, "", "");
+
+        auto &state = *m_state;
+        std::vector<std::function<void()>> evicted;
+        auto ticket = std::make_unique<Ticket>(m_state, cap_ip ? ip : "", cap_user ? principal : "");
+        {
+            std::lock_guard lock(state.mutex);
+            const auto full = [](const auto &map, const std::string &key, const std::size_t cap) {
+                const auto it = map.find(key);
+                return it != map.end() && it->second.size() >= cap;
+            };
+            const bool ip_full = cap_ip && full(state.byIp, ip, m_options.perIp);
+            const bool user_full = cap_user && full(state.byUser, principal, m_options.perUser);
+
+            if ((ip_full || user_full) && m_options.policy == Policy::Reject) {
+                ++(ip_full ? state.rejectedIp : state.rejectedUser);
+                if (refusal) *refusal = ip_full ? Refusal::Ip : Refusal::User;
+                return nullptr;
+            }
+
+            // Oldest first, until both keys have room; their closers run below, unlocked
+            const auto evict = [&](auto &map, const std::string &key, const std::size_t cap) {
+                for (auto it = map.find(key); it != map.end() && it->second.size() >= cap; it = map.find(key)) {
+                    auto &victim = *it->second.front();
+                    state.unlink(victim);
+                    victim.m_evicted = true;
+                    ++state.evicted;
+                    if (victim.m_close) evicted.push_back(std::move(victim.m_close));
+                }
+            };
+            if (ip_full) evict(state.byIp, ip, m_options.perIp);
+            if (user_full) evict(state.byUser, principal, m_options.perUser);
+
+            if (cap_ip) {
+                auto &streams = state.byIp[ip];
+                ticket->m_ipPos = streams.insert(streams.end(), ticket.get());
+            }
+            if (cap_user) {
+                auto &streams = state.byUser[principal];
+                ticket->m_userPos = streams.insert(streams.end(), ticket.get());
+            }
+            ticket->m_counted = true;
+            ++state.active;
+        }
+
+        for (const auto &close: evicted) close();
+        return ticket;
+    }
+
+    json StreamLimits::stats() const {
+        std::size_t active;
+        {
+            std::lock_guard lock(m_state->mutex);
+            active = m_state->active;
+        }
+        return {
+            {"active", active},
+            {"rejected_ip", m_state->rejectedIp.load()},
+            {"rejected_user", m_state->rejectedUser.load()},
+            {"evicted", m_state->evicted.load()},
+            {"per_ip", m_options.perIp},
+            {"per_user", m_options.perUser},
+            {"policy", m_options.policy == Policy::EvictOldest ? "evict_oldest" : "reject"}
+        };
+    }
+
+    void StreamLimits::writeMetrics(MetricsWriter &out) const {
+        std::size_t active;
+        {
+            std::lock_guard lock(m_state->mutex);
+            active = m_state->active;
+        }
+        out.family("mb_realtime_capped_streams", "Realtime streams counted against a per-IP or per-user cap", "gauge");
+        out.sample("mb_realtime_capped_streams", {}, static_cast<double>(active));
+        out.family("mb_realtime_stream_rejected_total", "Realtime streams refused for being over a cap", "counter");
+        out.sample("mb_realtime_stream_rejected_total", {{"limit", "ip"}},
+                   static_cast<double>(m_state->rejectedIp.load(std::memory_order_relaxed)));
+        out.sample("mb_realtime_stream_rejected_total", {{"limit", "user"}},
+                   static_cast<double>(m_state->rejectedUser.load(std::memory_order_relaxed)));
+        out.family("mb_realtime_stream_evicted_total", "Oldest realtime streams closed to admit a newer one",
+                   "counter");
+        out.sample("mb_realtime_stream_evicted_total", {},
+                   static_cast<double>(m_state->evicted.load(std::memory_order_relaxed)));
+    }
+}
@@ -0,0 +1,230 @@
+#include "../../include/mantisbase/core/tenants.h"
+#include "../../include/mantisbase/core/database.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <format>
+#include <soci/soci.h>
+#include <utility>
+#include <vector>
+
+namespace mb {
+    namespace {
+        thread_local Tenants::Tenant *t_current = nullptr;
+
+        /// `path` is `prefix` or below it
+        bool under(const std::string_view path, const std::string_view prefix) {
+            return path.starts_with(prefix) && (path.size() == prefix.size() || path[prefix.size()] == '/');
+        }
+    }
+
+    Tenants::Options Tenants::Options::fromEnv() {
+        Options options;
+        if (const auto mode = getEnvOrDefault("MB_TENANTS", ""); mode == "host") options.mode = Mode::Host;
+        else if (mode == "header") options.mode = Mode::Header;
+        else if (!mode.empty() && mode != "off")
+            LogOrigin::warn("Tenants", std::format("Unknown MB_TENANTS mode `{}`; tenants are off.", mode));
+
+        if (const auto header = getEnvOrDefault("MB_TENANT_HEADER", ""); !header.empty()) options.header = header;
+        options.domain = getEnvOrDefault("MB_TENANT_DOMAIN", "");
+        toLowerCase(options.domain);
+        if (options.mode == Mode::Host && options.domain.empty()) {
+            LogOrigin::warn("Tenants", "MB_TENANTS=host needs MB_TENANT_DOMAIN; tenants are off.");
+            options.mode = Mode::Off;
+        }
+        if (const auto max = safe_stoi(getEnvOrDefault("MB_TENANT_MAX_OPEN", ""), 0); max > 0)
+            options.maxOpen = static_cast<std::size_t>(max);
+        if (const auto pool = safe_stoi(getEnvOrDefault("MB_TENANT_POOL_SIZE", ""), 0); pool > 0)
+            options.poolSize = pool;
+        options.autoCreate = getEnvOrDefault("MB_TENANT_AUTO_CREATE", "0") == "1";
+        return options;
+    }
+
+    Tenants::Tenant::Tenant(std::string tenant_id)
+        : id(std::move(tenant_id)),
+          // Configured like the application's caches, see Entity::countCache() and friends
+          counts(std::chrono::seconds(safe_stoi(getEnvOrDefault("MB_COUNT_CACHE_TTL", "60"), 60))),
+          flights(getEnvOrDefault("MB_READ_COALESCING", "1") != "0"),
+          records(RecordCache::Options::fromEnv()),
+          vectors(VectorIndex::Options::fromEnv()) {
+    }
+
+    Tenants::Tenant::~Tenant() = default;
+
+    void Tenants::Tenant::onChanges(const nlohmann::json &events) {
+        counts.onChanges(events);
+        flights.onChanges(events);
+        records.onChanges(events);
+        vectors.onChanges(events);
+        users.onChanges(events);
+    }
+
+    Tenants::Scope::Scope(std::shared_ptr<Tenant> tenant) : m_tenant(std::move(tenant)), m_previous(t_current) {
+        t_current = m_tenant.get();
+    }
+
+    Tenants::Scope::~Scope() {
+        t_current = m_previous;
+    }
+
+    Tenants::Tenants(const MantisBase &app, Options options) : m_app(app), m_options(std::move(options)) {
+        if (!enabled()) return;
+        if (const auto db_type = app.dbType(); db_type != "sqlite3" && db_type != "postgresql") {
+            LogOrigin::warn("Tenants", std::format("Tenants need SQLite or PostgreSQL, not `{}`; tenants are off.",
+                                                   db_type));
+            m_options.mode = Mode::Off;
+            return;
+        }
+        LogOrigin::info("Tenants", std::format("Tenant databases by {}, up to {} open with {} connections each",
+                                               m_options.mode == Mode::Host
+                                                   ? "subdomain of " + m_options.domain
+                                                   : "header " + m_options.header,
+                                               m_options.maxOpen, m_options.poolSize));
+    }
+
+    Tenants::~Tenants() {
+        closeAll();
+    }
+
+    std::optional<std::string> Tenants::resolve(const std::string_view host, const std::string_view header) const {
+        std::optional<std::string> id;
+        if (m_options.mode == Mode::Header && !header.empty()) id = std::string(header);
+        else if (m_options.mode == Mode::Host) id = subdomainOf(host, m_options.domain);
+        if (!id) return std::nullopt;
+
+        if (!isValidId(*id))
+            throw MantisException(400, "Invalid tenant id.");
+        return id;
+    }
+
+    std::optional<std::string> Tenants::subdomainOf(std::string_view host, const std::string_view domain) {
+        if (domain.empty()) return std::nullopt;
+        // `[::1]:8080` and the like aren't names
+        if (host.starts_with('[')) return std::nullopt;
+        if (const auto colon = host.rfind(':'); colon != std::string_view::npos) host = host.substr(0, colon);
+        if (host.ends_with('.')) host.remove_suffix(1);
+
+        std::string name(host);
+        toLowerCase(name);
+        if (name.size() <= domain.size() + 1 || !name.ends_with(domain) ||
+            name[name.size() - domain.size() - 1] != '.')
+            return std::nullopt;
+        return name.substr(0, name.size() - domain.size() - 1);
+    }
+
+    bool Tenants::isValidId(const std::string_view id) {
+        if (id.empty() || id.size() > 63 || id.front() == '-' || id.back() == '-') return false;
+        return std::ranges::all_of(id, [](const char c) {
+            return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-';
+        });
+    }
+
+    bool Tenants::servesPath(const std::string_view path) {
+        if (under(path, "/api/v1/entities") || under(path, "/api/v1/transaction") || under(path, "/api/v1/auth") ||
+            under(path, "/api/v1/sys/admins"))
+            return true;
+        // Online migrations and view refreshes run on the application's own threads and database
+        return under(path, "/api/v1/schemas") && !path.ends_with("/migration") && !path.ends_with("/refresh");
+    }
+
+    std::shared_ptr<Tenants::Tenant> Tenants::acquire(const std::string &id) {
+        {
+            std::lock_guard lock(m_mutex);
+            if (const auto it = m_open.find(id); it != m_open.end()) {
+                m_lru.splice(m_lru.begin(), m_lru, it->second.second);
+                return it->second.first;
+            }
+        }
+
+        // Opened unlocked, so one slow open doesn't hold up the open tenants
+        auto tenant = open(id);
+
+        std::vector<std::shared_ptr<Tenant>> evicted;
+        {
+            std::lock_guard lock(m_mutex);
+            if (const auto it = m_open.find(id); it != m_open.end()) {
+                // Another request opened it meanwhile; ours closes below
+                m_lru.splice(m_lru.begin(), m_lru, it->second.second);
+                evicted.push_back(std::exchange(tenant, it->second.first));
+            } else {
+                m_lru.push_front(id);
+                m_open.emplace(id, std::pair{tenant, m_lru.begin()});
+                ++m_opened;
+                while (m_open.size() > std::max<std::size_t>(m_options.maxOpen, 1)) {
+                    const auto node = m_open.find(m_lru.back());
+                    evicted.push_back(std::move(node->second.first));
+                    m_open.erase(node);
+                    m_lru.pop_back();
+                    ++m_evicted;
+                }
+            }
+        }
+        // Databases released here close once no request holds them
+        evicted.clear();
+        return tenant;
+    }
+
+    std::shared_ptr<Tenants::Tenant> Tenants::open(const std::string &id) const {
+        namespace fs = std::filesystem;
+
+        // The application's database places a tenant's, whatever the caller's scope
+        auto &root = m_app.rootDb();
+        if (m_app.dbType() == "sqlite3") {
+            const auto dir = joinPaths(m_app.dataDir(), "tenants");
+            if (!m_options.autoCreate && !fs::exists(joinPaths(dir.string(), id + ".db")))
+                throw MantisException(404, std::format("Tenant `{}` was not found.", id));
+            std::error_code ec;
+            fs::create_directories(dir, ec);
+        } else {
+            const auto schema = Database::tenantSchema(id);
+            const auto sql = root.writeSession();
+            int found = 0;
+            *sql << "SELECT COUNT(*) FROM information_schema.schemata WHERE schema_name = :schema",
+                    soci::use(schema), soci::into(found);
+            if (!found && !m_options.autoCreate)
+                throw MantisException(404, std::format("Tenant `{}` was not found.", id));
+            // Validated ids make valid identifiers
+            if (!found) *sql << std::format("CREATE SCHEMA IF NOT EXISTS {}", schema);
+        }
+
+        auto tenant = std::make_shared<Tenant>(id);
+        tenant->db = std::make_unique<Database>(m_app, id, m_options.poolSize);
+
+        // Tables and entities of the tenant's own database
+        const Scope scope(tenant);
+        const auto failed = std::format("The database of tenant `{}` failed to open.", id);
+        if (!tenant->db->connect(root.connectionStr()) || !tenant->db->createSysTables())
+            throw MantisException(500, failed);
+        try {
+            tenant->entities.publish(m_app.router().loadEntities());
+        } catch (const std::exception &e) {
+            LogOrigin::warn("Tenants", std::format("{} {}", failed, e.what()));
+            throw MantisException(500, failed);
+        }
+
+        LogOrigin::info("Tenants", std::format("Opened the database of tenant `{}`", id));
+        return tenant;
+    }
+
+    void Tenants::closeAll() {
+        std::unordered_map<std::string, std::pair<std::shared_ptr<Tenant>, std::list<std::string>::iterator>> open;
+        {
+            std::lock_guard lock(m_mutex);
+            open.swap(m_open);
+            m_lru.clear();
+        }
+    }
+
+    Tenants::Stats Tenants::stats() const {
+        std::lock_guard lock(m_mutex);
+        return {m_open.size(), m_opened, m_evicted};
+    }
+
+    Tenants::Tenant *Tenants::current() {
+        return t_current;
+    }
+}
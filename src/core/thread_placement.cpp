@@ -0,0 +1,223 @@
+/**
+ * @file thread_placement.cpp
+ * @brief Implementation for @see thread_placement.h
+ */
+
+#include "../../include/mantisbase/core/thread_placement.h"
+#include "../../include/mantisbase/core/metrics.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace mb {
+    namespace {
+        ThreadPlacement::CpuSet envCpuSet(const char *name) {
+            const auto value = getEnvOrDefault(name, "");
+            if (value.empty()) return {};
+            try {
+                return ThreadPlacement::parseCpuList(value);
+            } catch (const std::invalid_argument &) {
+                LogOrigin::warn("Thread Placement", std::format("Ignoring {}: `{}` is not a CPU list", name, value));
+                return {};
+            }
+        }
+    }
+
+    ThreadPlacement::Options ThreadPlacement::Options::fromEnv() {
+        Options options;
+        options.io = envCpuSet("MB_CPU_IO");
+        options.db = envCpuSet("MB_CPU_DB");
+        options.background = envCpuSet("MB_CPU_BACKGROUND");
+        return options;
+    }
+
+    ThreadPlacement::ThreadPlacement(Options options, std::vector<CpuSet> nodes)
+        : m_options(std::move(options)), m_nodes(std::move(nodes)) {}
+
+    ThreadPlacement &ThreadPlacement::instance() {
+        static ThreadPlacement placement(Options::fromEnv(), numaNodes());
+        return placement;
+    }
+
+    bool ThreadPlacement::enabled() const {
+        return !m_options.io.empty() || !m_options.db.empty() || !m_options.background.empty();
+    }
+
+    const char *ThreadPlacement::roleName(const Role role) {
+        switch (role) {
+            case Role::Io: return "io";
+            case Role::Db: return "db";
+            case Role::Background: return "background";
+        }
+        return "";
+    }
+
+    ThreadPlacement::CpuSet ThreadPlacement::parseCpuList(const std::string &list) {
+        CpuSet cpus;
+        std::size_t at = 0;
+        const auto number = [&] {
+            const auto begin = at;
+            while (at < list.size() && std::isdigit(static_cast<unsigned char>(list[at]))) ++at;
+            if (at == begin || at - begin > 5) throw std::invalid_argument("Bad CPU list: " + list);
+            return std::stoi(list.substr(begin, at - begin));
+        };
+        while (at < list.size()) {
+            const auto first = number();
+            auto last = first;
+            if (at < list.size() && list[at] == '-') {
+                ++at;
+                last = number();
+                if (last < first) throw std::invalid_argument("Bad CPU list: " + list);
+            }
+            for (auto cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+            if (at < list.size() && list[at] != ',') throw std::invalid_argument("Bad CPU list: " + list);
+            if (at < list.size() && ++at == list.size()) throw std::invalid_argument("Bad CPU list: " + list);
+        }
+        if (cpus.empty()) throw std::invalid_argument("Empty CPU list");
+        std::ranges::sort(cpus);
+        cpus.erase(std::ranges::unique(cpus).begin(), cpus.end());
+        return cpus;
+    }
+
+    std::string ThreadPlacement::formatCpuList(const CpuSet &cpus) {
+        std::string out;
+        for (std::size_t i = 0; i < cpus.size();) {
+            auto j = i;
+            while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) ++j;
+            if (!out.empty()) out += ',';
+            out += j > i ? std::format("{}-{}", cpus[i], cpus[j]) : std::to_string(cpus[i]);
+            i = j + 1;
+        }
+        return out;
+    }
+
+    std::vector<ThreadPlacement::CpuSet> ThreadPlacement::numaNodes(const std::string &sysfs) {
+        namespace fs = std::filesystem;
+        std::map<int, CpuSet> nodes;
+        std::error_code ec;
+        for (fs::directory_iterator it(sysfs, ec), end; !ec && it != end; it.increment(ec)) {
+            const auto name = it->path().filename().string();
+            if (!name.starts_with("node") || name.size() == 4
+                || !std::all_of(name.begin() + 4, name.end(), [](const unsigned char c) { return std::isdigit(c); }))
+                continue;
+            std::ifstream file(it->path() / "cpulist");
+            std::string list;
+            if (!std::getline(file, list) || list.empty()) continue;
+            try {
+                nodes[std::stoi(name.substr(4))] = parseCpuList(list);
+            } catch (const std::exception &) {
+                // A node without CPUs (memory only) has an empty list
+            }
+        }
+
+        std::vector<CpuSet> out;
+        for (auto &[_, cpus]: nodes) out.push_back(std::move(cpus));
+        if (out.empty()) {
+            CpuSet all(std::max(1u, std::thread::hardware_concurrency()));
+            for (std::size_t i = 0; i < all.size(); ++i) all[i] = static_cast<int>(i);
+            out.push_back(std::move(all));
+        }
+        return out;
+    }
+
+    ThreadPlacement::CpuSet ThreadPlacement::unconfined() const {
+        // Started by the thread confined to MB_CPU_BACKGROUND, they'd inherit its set
+        if (m_options.background.empty()) return {};
+        CpuSet all;
+        for (const auto &node: m_nodes) all.insert(all.end(), node.begin(), node.end());
+        std::ranges::sort(all);
+        return all;
+    }
+
+    int ThreadPlacement::nodeOf(const CpuSet &cpus) const {
+        if (cpus.empty()) return -1;
+        for (std::size_t n = 0; n < m_nodes.size(); ++n) {
+            if (std::ranges::includes(m_nodes[n], cpus)) return static_cast<int>(n);
+        }
+        return -1;
+    }
+
+    ThreadPlacement::CpuSet ThreadPlacement::cpusFor(const Role role, const std::size_t index) const {
+        switch (role) {
+            case Role::Io:
+                if (m_options.io.empty()) return unconfined();
+                return {m_options.io[index % m_options.io.size()]};
+            case Role::Db: {
+                if (m_options.db.empty()) return unconfined();
+                // The set's CPUs on each node; workers take the nodes in turn
+                std::vector<CpuSet> groups;
+                for (const auto &node: m_nodes) {
+                    CpuSet group;
+                    std::ranges::set_intersection(m_options.db, node, std::back_inserter(group));
+                    if (!group.empty()) groups.push_back(std::move(group));
+                }
+                if (groups.empty()) return m_options.db;
+                return groups[index % groups.size()];
+            }
+            case Role::Background:
+                return m_options.background;
+        }
+        return {};
+    }
+
+    bool ThreadPlacement::pin(const Role role, const std::size_t index) {
+        const auto cpus = cpusFor(role, index);
+        if (cpus.empty()) return false;
+
+        bool pinned = false;
+#ifdef __linux__
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (const auto cpu: cpus)
+            if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+        pinned = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+        if (!pinned) {
+            if (m_failures.fetch_add(1) == 0)
+                LogOrigin::warn("Thread Placement", std::format("Could not pin the {} thread {} to CPUs {}",
+                                                                roleName(role), index, formatCpuList(cpus)));
+            return false;
+        }
+
+        std::lock_guard lock(m_mutex);
+        Placement placement{role, index, cpus, nodeOf(cpus)};
+        const auto it = std::ranges::find_if(m_placements, [&](const Placement &p) {
+            return p.role == role && p.index == index;
+        });
+        if (it != m_placements.end()) *it = std::move(placement);
+        else m_placements.push_back(std::move(placement));
+        return true;
+    }
+
+    std::vector<ThreadPlacement::Placement> ThreadPlacement::placements() const {
+        std::lock_guard lock(m_mutex);
+        return m_placements;
+    }
+
+    void ThreadPlacement::writeMetrics(MetricsWriter &out) const {
+        out.family("mb_thread_placement", "Threads pinned to CPUs, by role and index", "gauge");
+        for (const auto &p: placements()) {
+            const auto index = std::to_string(p.index);
+            const auto cpus = formatCpuList(p.cpus);
+            const auto node = std::to_string(p.node);
+            out.sample("mb_thread_placement",
+                       {{"role", roleName(p.role)}, {"index", index}, {"cpus", cpus}, {"node", node}}, 1);
+        }
+        out.family("mb_thread_pin_failures_total", "Threads the kernel refused to pin", "counter");
+        out.sample("mb_thread_pin_failures_total", {}, static_cast<double>(m_failures.load()));
+    }
+}
@@ -0,0 +1,272 @@
+/**
+ * @file thumbnails.cpp
+ * @brief Implementation for @see thumbnails.h
+ */
+
+#include "../../include/mantisbase/core/thumbnails.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/files.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/core/worker_pool.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <format>
+
+#ifdef MB_THUMBNAILS_ENABLED
+#include <vips/vips.h>
+#endif
+
+namespace mb {
+    namespace fs = std::filesystem;
+
+    namespace {
+        std::size_t countFromEnv(const std::string &key, const std::size_t fallback) {
+            const auto value = getEnvOrDefault(key, "");
+            unsigned long long parsed = 0;
+            const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), parsed);
+            if (value.empty() || ec != std::errc{} || end != value.data() + value.size() || parsed == 0)
+                return fallback;
+            return static_cast<std::size_t>(parsed);
+        }
+
+        bool parseDimension(const std::string_view s, int &out) {
+            const auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), out);
+            return !s.empty() && ec == std::errc{} && end == s.data() + s.size() && out >= 0;
+        }
+
+        /// Output format for an input extension; empty if we don't decode it
+        std::string defaultFormat(std::string ext) {
+            toLowerCase(ext);
+            if (ext == ".jpg" || ext == ".jpeg" || ext == ".tif" || ext == ".tiff" || ext == ".heic") return "jpg";
+            if (ext == ".png" || ext == ".gif") return "png";
+            if (ext == ".webp") return "webp";
+            if (ext == ".avif") return "avif";
+            return "";
+        }
+
+        bool isFresh(const fs::path &derivative, const fs::path &original) {
+            std::error_code ec;
+            const auto derived = fs::last_write_time(derivative, ec);
+            if (ec) return false;
+            const auto source = fs::last_write_time(original, ec);
+            return !ec && derived >= source;
+        }
+    }
+
+    // ----------------------------------------------------------------- //
+    // ThumbSpec                                                         //
+    // ----------------------------------------------------------------- //
+
+    ThumbSpec::Limits ThumbSpec::Limits::fromEnv() {
+        Limits limits;
+        limits.maxDimension = static_cast<int>(countFromEnv("MB_THUMB_MAX_DIM", limits.maxDimension));
+        for (const auto &size: splitString(getEnvOrDefault("MB_THUMB_SIZES", ""), ",")) {
+            if (auto s = trim(size); !s.empty()) limits.sizes.push_back(std::move(s));
+        }
+        return limits;
+    }
+
+    std::optional<ThumbSpec> ThumbSpec::parse(const std::string &thumb, const std::string &format,
+                                              const std::string &filename, const Limits &limits) {
+        auto fallback = defaultFormat(fs::path(filename).extension().string());
+        if (fallback.empty()) return std::nullopt;
+
+        ThumbSpec spec;
+        std::string_view s = thumb;
+        if (s.ends_with('f')) {
+            spec.mode = Mode::Fit;
+            s.remove_suffix(1);
+        }
+
+        const auto x = s.find('x');
+        if (x == std::string_view::npos || !parseDimension(s.substr(0, x), spec.width) ||
+            !parseDimension(s.substr(x + 1), spec.height) || (spec.width == 0 && spec.height == 0))
+            throw MantisException(400, std::format("Invalid thumb `{}`, expected WxH, WxHf, Wx0 or 0xH.", thumb));
+
+        if (spec.width > limits.maxDimension || spec.height > limits.maxDimension)
+            throw MantisException(400, std::format("Thumb `{}` exceeds the {}px limit.", thumb, limits.maxDimension));
+
+        if (!limits.sizes.empty() && std::ranges::find(limits.sizes, thumb) == limits.sizes.end())
+            throw MantisException(400, std::format("Thumb size `{}` is not allowed.", thumb));
+
+        auto fmt = format;
+        toLowerCase(fmt);
+        if (fmt.empty()) spec.format = std::move(fallback);
+        else if (fmt == "jpg" || fmt == "jpeg") spec.format = "jpg";
+        else if (fmt == "png" || fmt == "webp" || fmt == "avif") spec.format = fmt;
+        else throw MantisException(400, std::format("Unsupported thumb format `{}`.", format));
+
+        return spec;
+    }
+
+    std::string ThumbSpec::fileName() const {
+        return std::format("{}x{}{}.{}", width, height, mode == Mode::Fit ? "f" : "", format);
+    }
+
+    std::string ThumbSpec::mimeType() const {
+        if (format == "jpg") return "image/jpeg";
+        return "image/" + format;
+    }
+
+    // ----------------------------------------------------------------- //
+    // Thumbnailer                                                       //
+    // ----------------------------------------------------------------- //
+
+    Thumbnailer::Options Thumbnailer::Options::fromEnv() {
+        Options o;
+        o.workers = countFromEnv("MB_THUMB_WORKERS", o.workers);
+        o.maxQueued = countFromEnv("MB_THUMB_QUEUE", o.maxQueued);
+        o.wait = std::chrono::seconds(countFromEnv("MB_THUMB_WAIT", o.wait.count()));
+        return o;
+    }
+
+    Thumbnailer::Thumbnailer(Options options)
+        : m_opts(options), m_pool(std::make_unique<WorkerPool>("thumbs")) {}
+
+    Thumbnailer::~Thumbnailer() {
+        stop();
+    }
+
+    void Thumbnailer::start() {
+        if (!enabled()) return;
+#ifdef MB_THUMBNAILS_ENABLED
+        static const bool vips_ready = [] {
+            if (vips_init("mantisbase") != 0) {
+                LogOrigin::critical("Thumbnails", fmt::format("Failed to initialise libvips: {}", vips_error_buffer()));
+                vips_error_clear();
+                return false;
+            }
+            // Workers run one image at a time each; keep vips from fanning out on top of that
+            vips_concurrency_set(1);
+            return true;
+        }();
+        if (!vips_ready) return;
+#endif
+        m_pool->start(m_opts.workers);
+    }
+
+    void Thumbnailer::stop() {
+        m_pool->stop();
+    }
+
+    bool Thumbnailer::enabled() {
+#ifdef MB_THUMBNAILS_ENABLED
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    fs::path Thumbnailer::cacheDir(const std::string &entity_name, const std::string &filename) {
+        return fs::path(Files::dirPath(entity_name)) / ("." + filename + ".thumbs");
+    }
+
+    fs::path Thumbnailer::get(const fs::path &original, const std::string &entity_name,
+                              const std::string &filename, const ThumbSpec &spec) {
+        const auto derivative = cacheDir(entity_name, filename) / spec.fileName();
+        if (isFresh(derivative, original)) return derivative;
+
+        std::shared_future<std::string> result;
+        {
+            std::lock_guard lock(m_mutex);
+            const auto key = derivative.string();
+            if (const auto it = m_inFlight.find(key); it != m_inFlight.end()) {
+                result = it->second;
+            } else {
+                // A job may have finished since the first check
+                if (isFresh(derivative, original)) return derivative;
+                if (m_inFlight.size() >= m_opts.maxQueued)
+                    throw MantisException(503, "Too many thumbnails being generated, try again shortly.");
+
+                auto promise = std::make_shared<std::promise<std::string>>();
+                result = promise->get_future().share();
+                m_inFlight.emplace(key, result);
+
+                const bool queued = m_pool->submit([this, promise, original, derivative, spec, key] {
+                    std::string error;
+                    try {
+                        error = render(original, derivative, spec);
+                    } catch (const std::exception &e) {
+                        error = e.what();
+                    }
+                    if (!error.empty())
+                        LogOrigin::warn("Thumbnails", fmt::format("Failed to create `{}`: {}", key, error));
+
+                    // Erase first: the file is in place, so later requests find it without waiting
+                    {
+                        std::lock_guard done_lock(m_mutex);
+                        m_inFlight.erase(key);
+                    }
+                    promise->set_value(error);
+                });
+
+                if (!queued) {
+                    m_inFlight.erase(key);
+                    throw MantisException(503, "Thumbnails are not available right now.");
+                }
+            }
+        }
+
+        if (result.wait_for(m_opts.wait) != std::future_status::ready)
+            throw MantisException(503, "Thumbnail is still being generated, try again shortly.");
+        if (const auto &error = result.get(); !error.empty())
+            throw MantisException(422, "Could not create a thumbnail of this file.", error);
+        return derivative;
+    }
+
+    std::size_t Thumbnailer::inFlight() const {
+        std::lock_guard lock(m_mutex);
+        return m_inFlight.size();
+    }
+
+    std::string Thumbnailer::render(const fs::path &src, const fs::path &dst, const ThumbSpec &spec) {
+#ifdef MB_THUMBNAILS_ENABLED
+        std::error_code ec;
+        fs::create_directories(dst.parent_path(), ec);
+        if (ec) return ec.message();
+
+        // Written beside the target and renamed over it, so readers never see half a file.
+        // The saver is picked by extension, so that stays last.
+        static std::atomic<unsigned> counter{0};
+        const auto tmp = dst.parent_path() / std::format(".{}-{}", counter.fetch_add(1), dst.filename().string());
+
+        // Decodes at a reduced size where the format allows (JPEG shrink-on-load),
+        // applies EXIF orientation, and never upscales
+        VipsImage *out = nullptr;
+        const int width = spec.width ? spec.width : VIPS_MAX_COORD;
+        const int height = spec.height ? spec.height : VIPS_MAX_COORD;
+        const bool crop = spec.mode == ThumbSpec::Mode::Crop && spec.width && spec.height;
+        int rc = vips_thumbnail(src.string().c_str(), &out, width,
+                                "height", height,
+                                "size", VIPS_SIZE_DOWN,
+                                "crop", crop ? VIPS_INTERESTING_CENTRE : VIPS_INTERESTING_NONE,
+                                nullptr);
+        if (rc == 0) {
+            rc = vips_image_write_to_file(out, tmp.string().c_str(), nullptr);
+            g_object_unref(out);
+        }
+        if (rc != 0) {
+            std::string error = vips_error_buffer();
+            vips_error_clear();
+            fs::remove(tmp, ec);
+            return error.empty() ? "libvips failed" : error;
+        }
+
+        fs::rename(tmp, dst, ec);
+        if (ec) {
+            std::error_code ignored;
+            fs::remove(tmp, ignored);
+            return ec.message();
+        }
+        return "";
+#else
+        (void) src;
+        (void) dst;
+        (void) spec;
+        return "thumbnails are not enabled in this build";
+#endif
+    }
+}
@@ -0,0 +1,242 @@
+/**
+ * @file token_verifier.cpp
+ * @brief Implementation for @see token_verifier.h
+ */
+
+#include "../../include/mantisbase/core/token_verifier.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/utils/crypto_utils.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <jwt-cpp/traits/nlohmann-json/defaults.h>
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+
+namespace mb {
+    namespace {
+        using Verifier = jwt::verifier<jwt::default_clock, jwt::traits::nlohmann_json>;
+
+        std::string readKeyFile(const std::string &path) {
+            std::ifstream in(path, std::ios::binary);
+            if (!in) throw MantisException(500, fmt::format("Could not read the JWT key file `{}`", path));
+            std::ostringstream out;
+            out << in.rdbuf();
+            return out.str();
+        }
+
+        std::string rawSha256(const std::string &data) {
+            const auto hex = sha256Hex(data);
+            std::string raw(hex.size() / 2, '\0');
+            for (std::size_t i = 0; i < raw.size(); ++i)
+                raw[i] = static_cast<char>(std::stoi(hex.substr(i * 2, 2), nullptr, 16));
+            return raw;
+        }
+
+        Verifier withClaims(Verifier verifier, const TokenVerifier::Config &config) {
+            if (!config.issuer.empty()) verifier.with_issuer(config.issuer);
+            if (!config.audience.empty()) verifier.with_audience(config.audience);
+            return verifier;
+        }
+    }
+
+    std::string KeyedHs256::sign(const std::string &data, std::error_code &ec) const {
+        ec.clear();
+        try {
+            return key->sign(data);
+        } catch (const std::exception &) {
+            ec = jwt::error::signature_generation_error::hmac_failed;
+            return {};
+        }
+    }
+
+    void KeyedHs256::verify(const std::string &data, const std::string &signature, std::error_code &ec) const {
+        ec.clear();
+        try {
+            if (!key->verify(data, signature)) ec = jwt::error::signature_verification_error::invalid_signature;
+        } catch (const std::exception &) {
+            ec = jwt::error::signature_generation_error::hmac_failed;
+        }
+    }
+
+    nlohmann::json TokenClaims::toJSON() const {
+        nlohmann::json claims = {{"id", id}, {"entity", entity}};
+        if (!sessionId.empty()) claims["session_id"] = sessionId;
+        return claims;
+    }
+
+    TokenVerifier::Config TokenVerifier::Config::current() {
+        auto algorithm = trim(getEnvOrDefault("MB_JWT_ALGORITHM", "HS256"));
+        for (auto &c: algorithm) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        if (algorithm != "HS256" && algorithm != "ES256")
+            throw MantisException(500, fmt::format("MB_JWT_ALGORITHM must be HS256 or ES256, got `{}`", algorithm));
+
+        const auto private_file = getEnvOrDefault("MB_JWT_PRIVATE_KEY_FILE", "");
+        const auto public_files = getEnvOrDefault("MB_JWT_PUBLIC_KEY_FILES", "");
+        const auto stateless = getEnvOrDefault("MB_JWT_STATELESS", "0");
+        const auto ttl = getEnvOrDefault("MB_JWT_ACCESS_TTL", "");
+
+        // Key files are read once per setting; a request only compares strings
+        struct Loaded {
+            std::string env;
+            Config config;
+        };
+        static std::atomic<std::shared_ptr<const Loaded>> loaded;
+
+        const auto env = algorithm + '\n' + private_file + '\n' + public_files + '\n' + stateless + '\n' + ttl;
+        auto held = loaded.load();
+        if (!held || held->env != env) {
+            Config config;
+            config.algorithm = algorithm;
+            config.stateless = stateless == "1" || stateless == "true";
+            if (const auto seconds = safe_stoi(ttl, 0); seconds > 0) config.accessTtl = std::chrono::seconds(seconds);
+            if (algorithm == "ES256") {
+                if (private_file.empty())
+                    throw MantisException(500, "MB_JWT_ALGORITHM=ES256 needs MB_JWT_PRIVATE_KEY_FILE");
+                config.privateKey = readKeyFile(private_file);
+                for (auto path: splitString(public_files, ",")) {
+                    path = trim(path);
+                    if (!path.empty()) config.publicKeys.push_back(readKeyFile(path));
+                }
+            }
+            held = std::make_shared<const Loaded>(Loaded{env, std::move(config)});
+            loaded.store(held);
+        }
+
+        auto config = held->config;
+        // Tokens are issued without `iss`/`aud` for now, see Auth::createToken()
+        if (config.algorithm == "HS256") config.secret = MantisBase::jwtSecretKey();
+        return config;
+    }
+
+    struct TokenVerifier::State {
+        struct Key {
+            std::string kid;
+            Verifier verifier;
+        };
+
+        Config config;
+        TokenSigner signer;
+        std::vector<Key> keys; ///> The current one first
+        nlohmann::json jwks;
+    };
+
+    nlohmann::json TokenVerifier::ecJwk(const std::string &pem) {
+        const auto pkey = pem.find("PRIVATE KEY") != std::string::npos
+                              ? jwt::helper::load_private_ec_key_from_string(pem)
+                              : jwt::helper::load_public_ec_key_from_string(pem);
+
+        const std::unique_ptr<EC_KEY, decltype(&EC_KEY_free)> ec(EVP_PKEY_get1_EC_KEY(pkey.get()), EC_KEY_free);
+        if (!ec || EC_GROUP_get_curve_name(EC_KEY_get0_group(ec.get())) != NID_X9_62_prime256v1)
+            throw MantisException(500, "ES256 keys must be EC keys on the P-256 curve");
+
+        unsigned char point[65];
+        if (EC_POINT_point2oct(EC_KEY_get0_group(ec.get()), EC_KEY_get0_public_key(ec.get()),
+                               POINT_CONVERSION_UNCOMPRESSED, point, sizeof(point), nullptr) != sizeof(point))
+            throw MantisException(500, "Could not read the public part of an ES256 key");
+
+        const auto x = base64UrlEncode(std::string(reinterpret_cast<const char *>(point) + 1, 32));
+        const auto y = base64UrlEncode(std::string(reinterpret_cast<const char *>(point) + 33, 32));
+        // RFC 7638: the required members, sorted, no whitespace
+        const auto thumbprint = base64UrlEncode(rawSha256(
+            R"({"crv":"P-256","kty":"EC","x":")" + x + R"(","y":")" + y + R"("})"));
+
+        return {
+            {"kty", "EC"}, {"crv", "P-256"}, {"x", x}, {"y", y},
+            {"kid", thumbprint}, {"alg", "ES256"}, {"use", "sig"}
+        };
+    }
+
+    std::shared_ptr<const TokenVerifier::State> TokenVerifier::build(const Config &config) {
+        auto state = std::make_shared<State>();
+        state->config = config;
+        state->jwks = {{"keys", nlohmann::json::array()}};
+
+        if (config.algorithm == "ES256") {
+            const jwt::algorithm::es256 current("", config.privateKey);
+            auto jwk = ecJwk(config.privateKey);
+            const auto kid = jwk["kid"].get<std::string>();
+            state->signer = {"ES256", kid, [current](const std::string &data, std::error_code &ec) {
+                return current.sign(data, ec);
+            }};
+            state->keys.push_back({kid, withClaims(jwt::verify().allow_algorithm(current), config)});
+            state->jwks["keys"].push_back(std::move(jwk));
+
+            for (const auto &pem: config.publicKeys) {
+                auto earlier = ecJwk(pem);
+                const auto earlier_kid = earlier["kid"].get<std::string>();
+                if (earlier_kid == kid) continue;
+                state->keys.push_back({earlier_kid, withClaims(jwt::verify().allow_algorithm(
+                                                                   jwt::algorithm::es256(pem)), config)});
+                state->jwks["keys"].push_back(std::move(earlier));
+            }
+            return state;
+        }
+
+        const KeyedHs256 hs256{std::make_shared<const HmacSha256Key>(config.secret)};
+        state->signer = {"HS256", "", [hs256](const std::string &data, std::error_code &ec) {
+            return hs256.sign(data, ec);
+        }};
+        state->keys.push_back({"", withClaims(jwt::verify().allow_algorithm(hs256), config)});
+        return state;
+    }
+
+    std::shared_ptr<const TokenVerifier::State> TokenVerifier::state(const Config &config) {
+        if (auto held = m_state.load(); held && held->config == config) return held;
+
+        std::lock_guard lock(m_buildMutex);
+        if (auto held = m_state.load(); held && held->config == config) return held;
+
+        auto built = build(config);
+        m_state.store(built);
+        ++m_builds;
+        return built;
+    }
+
+    TokenSigner TokenVerifier::signer(const Config &config) {
+        return state(config)->signer;
+    }
+
+    nlohmann::json TokenVerifier::jwks(const Config &config) {
+        return state(config)->jwks;
+    }
+
+    TokenVerifier::Result TokenVerifier::verify(const std::string &token, const Config &config) {
+        const auto st = state(config);
+
+        try {
+            const auto decoded = jwt::decode(token);
+
+            // The key named by `kid`; tokens without one predate rotation
+            const State::Key *key = &st->keys.front();
+            if (decoded.has_key_id()) {
+                const auto kid = decoded.get_key_id();
+                const auto it = std::ranges::find(st->keys, kid, &State::Key::kid);
+                if (it == st->keys.end()) return {std::nullopt, "Token signed with an unknown key"};
+                key = &*it;
+            }
+
+            std::error_code ec;
+            key->verifier.verify(decoded, ec);
+            if (ec) return {std::nullopt, ec.message()};
+
+            const auto text = [&decoded](const std::string &name) -> std::string {
+                if (!decoded.has_payload_claim(name)) return "";
+                const auto claim = decoded.get_payload_claim(name);
+                return claim.get_type() == jwt::json::type::string ? claim.as_string() : "";
+            };
+
+            TokenClaims claims{text("id"), text("entity"), text("session_id"), std::nullopt};
+            if (claims.id.empty() || claims.entity.empty())
+                return {std::nullopt, "Malformed token: Missing `id` or `entity` claim field."};
+            if (decoded.has_expires_at()) claims.expiresAt = decoded.get_expires_at();
+            return {std::move(claims), ""};
+        } catch (const std::exception &e) {
+            return {std::nullopt, e.what()};
+        }
+    }
+}
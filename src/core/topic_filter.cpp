@@ -0,0 +1,77 @@
+#include "../../include/mantisbase/core/topic_filter.h"
+#include "../../include/mantisbase/core/realtime_event.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+namespace mb {
+    std::optional<TopicFilters::Parsed> TopicFilters::parse(const std::string_view topic) {
+        const auto mark = topic.find('?');
+        if (mark == std::string_view::npos) return std::nullopt;
+        return Parsed{trim(std::string(topic.substr(0, mark))), trim(std::string(topic.substr(mark + 1)))};
+    }
+
+    std::string TopicFilters::topicOf(const std::string_view entity, const std::string_view filter) {
+        return std::format("{}?{}", entity, trim(std::string(filter)));
+    }
+
+    std::vector<std::string> TopicFilters::splitTopics(const std::string_view csv) {
+        std::vector<std::string> topics;
+        std::string current;
+        char quote = 0;
+        int depth = 0;
+        for (std::size_t i = 0; i < csv.size(); ++i) {
+            const char c = csv[i];
+            if (quote) {
+                // The filter tokenizer's escapes, so `\'` doesn't end the string
+                if (c == '\\' && i + 1 < csv.size()) current.push_back(csv[i++]);
+                else if (c == quote) quote = 0;
+            } else if (c == '\'' || c == '"') {
+                quote = c;
+            } else if (c == '(' || c == '[') {
+                ++depth;
+            } else if ((c == ')' || c == ']') && depth > 0) {
+                --depth;
+            } else if (c == ',' && depth == 0) {
+                if (auto topic = trim(current); !topic.empty()) topics.push_back(std::move(topic));
+                current.clear();
+                continue;
+            }
+            current.push_back(csv[i]);
+        }
+        if (auto topic = trim(current); !topic.empty()) topics.push_back(std::move(topic));
+        return topics;
+    }
+
+    bool TopicFilters::matches(const CompiledFilter &filter, const EncodedEvent &event) {
+        // A row updated out of the filter is still sent, so the subscriber can drop it
+        return EntityFilter::matches(filter, event.record()) ||
+               (event.previous().is_object() && EntityFilter::matches(filter, event.previous()));
+    }
+
+    void TopicFilters::add(const std::string &topic, std::shared_ptr<const CompiledFilter> filter) {
+        const auto parsed = parse(topic);
+        if (!parsed || !filter) return;
+        auto &group = m_entities[parsed->entity][topic];
+        if (!group.filter) group.filter = std::move(filter);
+        ++group.subscribers;
+    }
+
+    void TopicFilters::remove(const std::string &topic) {
+        const auto parsed = parse(topic);
+        if (!parsed) return;
+        const auto eit = m_entities.find(parsed->entity);
+        if (eit == m_entities.end()) return;
+        const auto it = eit->second.find(topic);
+        if (it == eit->second.end() || --it->second.subscribers > 0) return;
+        eit->second.erase(it);
+        if (eit->second.empty()) m_entities.erase(eit);
+    }
+
+    std::vector<std::string> TopicFilters::matching(const EncodedEvent &event) const {
+        std::vector<std::string> topics;
+        const auto eit = m_entities.find(event.entity());
+        if (eit == m_entities.end()) return topics;
+        for (const auto &[topic, group]: eit->second)
+            if (matches(*group.filter, event)) topics.push_back(topic);
+        return topics;
+    }
+}
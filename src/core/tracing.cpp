@@ -0,0 +1,339 @@
+#include "../../include/mantisbase/core/tracing.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <nlohmann/json.hpp>
+#include <random>
+
+namespace mb {
+    namespace {
+        struct ThreadTrace {
+            Tracer *tracer = nullptr;
+            TraceContext context;
+            bool active = false;
+        };
+
+        struct OpenStatement {
+            Tracer *tracer;
+            SpanData data;
+        };
+
+        thread_local ThreadTrace t_trace;
+        thread_local std::optional<OpenStatement> t_statement;
+
+        template<std::size_t N>
+        std::string toHex(const std::array<std::uint8_t, N> &bytes) {
+            static constexpr char digits[] = "0123456789abcdef";
+            std::string out(N * 2, '0');
+            for (std::size_t i = 0; i < N; ++i) {
+                out[2 * i] = digits[bytes[i] >> 4];
+                out[2 * i + 1] = digits[bytes[i] & 0xf];
+            }
+            return out;
+        }
+
+        template<std::size_t N>
+        bool fromHex(const std::string_view hex, std::array<std::uint8_t, N> &out) {
+            if (hex.size() != N * 2) return false;
+            const auto nibble = [](const char c) -> int {
+                if (c >= '0' && c <= '9') return c - '0';
+                if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+                return -1; // the spec only allows lowercase
+            };
+            for (std::size_t i = 0; i < N; ++i) {
+                const auto hi = nibble(hex[2 * i]), lo = nibble(hex[2 * i + 1]);
+                if (hi < 0 || lo < 0) return false;
+                out[i] = static_cast<std::uint8_t>(hi << 4 | lo);
+            }
+            return std::ranges::any_of(out, [](const auto b) { return b != 0; });
+        }
+
+        template<std::size_t N>
+        void randomId(std::array<std::uint8_t, N> &out) {
+            thread_local std::mt19937_64 rng{std::random_device{}()};
+            do {
+                for (std::size_t i = 0; i < N; i += 8) {
+                    const auto bits = rng();
+                    for (std::size_t j = 0; j < 8 && i + j < N; ++j)
+                        out[i + j] = static_cast<std::uint8_t>(bits >> (8 * j));
+                }
+            } while (std::ranges::all_of(out, [](const auto b) { return b == 0; }));
+        }
+
+        double parseRatio(const std::string &value, const double fallback) {
+            if (value.empty()) return fallback;
+            char *end = nullptr;
+            const double ratio = std::strtod(value.c_str(), &end);
+            if (end == value.c_str() || *end != '\0' || std::isnan(ratio)) return fallback;
+            return std::clamp(ratio, 0.0, 1.0);
+        }
+
+        nlohmann::json otlpAttributes(const std::vector<std::pair<std::string, std::string>> &attributes) {
+            auto out = nlohmann::json::array();
+            for (const auto &[key, value]: attributes)
+                out.push_back({{"key", key}, {"value", {{"stringValue", value}}}});
+            return out;
+        }
+    }
+
+    std::optional<TraceContext> TraceContext::parse(const std::string_view traceparent) {
+        // 00-<trace id>-<span id>-<flags>; later versions may append fields
+        if (traceparent.size() < 55 || traceparent[2] != '-' || traceparent[35] != '-' || traceparent[52] != '-')
+            return std::nullopt;
+        if (traceparent.substr(0, 2) == "ff" || (traceparent.substr(0, 2) == "00" && traceparent.size() != 55))
+            return std::nullopt;
+
+        TraceContext ctx;
+        std::array<std::uint8_t, 1> flags{};
+        if (!fromHex(traceparent.substr(3, 32), ctx.traceId) || !fromHex(traceparent.substr(36, 16), ctx.spanId))
+            return std::nullopt;
+        // fromHex() rejects all-zero, which is valid for flags
+        if (traceparent.substr(53, 2) != "00" && !fromHex(traceparent.substr(53, 2), flags))
+            return std::nullopt;
+        ctx.sampled = flags[0] & 0x01;
+        return ctx;
+    }
+
+    std::string TraceContext::traceparent() const {
+        return "00-" + traceIdHex() + "-" + spanIdHex() + (sampled ? "-01" : "-00");
+    }
+
+    std::string TraceContext::traceIdHex() const {
+        return toHex(traceId);
+    }
+
+    std::string TraceContext::spanIdHex() const {
+        return toHex(spanId);
+    }
+
+    Tracer::Options Tracer::Options::fromEnv() {
+        Options options;
+        options.endpoint = getEnvOrDefault("MB_OTLP_ENDPOINT", getEnvOrDefault("OTEL_EXPORTER_OTLP_ENDPOINT", ""));
+        options.sampleRatio = parseRatio(getEnvOrDefault("MB_TRACE_SAMPLE", ""), options.sampleRatio);
+        options.serviceName = getEnvOrDefault("MB_SERVICE_NAME",
+                                              getEnvOrDefault("OTEL_SERVICE_NAME", options.serviceName));
+        return options;
+    }
+
+    Tracer::Tracer(Options options, Exporter exporter)
+        : m_options(std::move(options)),
+          m_exporter(exporter ? std::move(exporter)
+                              : m_options.endpoint.empty() ? Exporter{} : otlpHttpExporter(m_options.endpoint)) {}
+
+    Tracer::~Tracer() {
+        stop();
+    }
+
+    void Tracer::start() {
+        if (!enabled()) return;
+        std::lock_guard lock(m_mutex);
+        if (m_thread.joinable()) return;
+        m_stopping = false;
+        m_thread = std::thread(&Tracer::loop, this);
+    }
+
+    void Tracer::stop() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable()) m_thread.join();
+        if (enabled()) flush();
+    }
+
+    TraceContext Tracer::childOf(const std::optional<TraceContext> &parent) const {
+        TraceContext ctx;
+        randomId(ctx.spanId);
+        if (parent) {
+            ctx.traceId = parent->traceId;
+            ctx.sampled = parent->sampled;
+            return ctx;
+        }
+
+        randomId(ctx.traceId);
+        // The last 8 bytes of a trace id are random, so they double as the sampling draw
+        std::uint64_t draw = 0;
+        for (std::size_t i = 8; i < 16; ++i) draw = draw << 8 | ctx.traceId[i];
+        ctx.sampled = m_options.sampleRatio >= 1.0 ||
+                      static_cast<double>(draw >> 11) * 0x1.0p-53 < m_options.sampleRatio;
+        return ctx;
+    }
+
+    void Tracer::record(SpanData span) {
+        if (!span.context.sampled || !enabled()) return;
+        bool wake = false;
+        {
+            std::lock_guard lock(m_mutex);
+            if (m_queue.size() >= m_options.maxQueue) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            m_queue.push_back(std::move(span));
+            wake = m_queue.size() == m_options.batch;
+        }
+        if (wake) m_cv.notify_one();
+    }
+
+    void Tracer::flush() {
+        while (exportBatch() > 0) {}
+    }
+
+    Tracer::Stats Tracer::stats() const {
+        Stats s;
+        s.exported = m_exported.load(std::memory_order_relaxed);
+        s.dropped = m_dropped.load(std::memory_order_relaxed);
+        s.failed = m_failed.load(std::memory_order_relaxed);
+        std::lock_guard lock(m_mutex);
+        s.queued = m_queue.size();
+        return s;
+    }
+
+    std::string Tracer::toOtlpJson(const std::vector<SpanData> &spans, const std::string &service_name) {
+        auto out = nlohmann::json::array();
+        for (const auto &span: spans) {
+            nlohmann::json s = {
+                {"traceId", span.context.traceIdHex()},
+                {"spanId", span.context.spanIdHex()},
+                {"name", span.name},
+                {"kind", static_cast<int>(span.kind)},
+                // 64-bit integers are strings in OTLP JSON
+                {"startTimeUnixNano", std::to_string(span.startNs)},
+                {"endTimeUnixNano", std::to_string(span.endNs)},
+                {"attributes", otlpAttributes(span.attributes)},
+                {"status", {{"code", span.error ? 2 : 0}}}
+            };
+            if (std::ranges::any_of(span.parentSpanId, [](const auto b) { return b != 0; }))
+                s["parentSpanId"] = toHex(span.parentSpanId);
+            if (!span.links.empty()) {
+                auto links = nlohmann::json::array();
+                for (const auto &link: span.links)
+                    links.push_back({{"traceId", link.traceIdHex()}, {"spanId", link.spanIdHex()}});
+                s["links"] = std::move(links);
+            }
+            out.push_back(std::move(s));
+        }
+
+        return nlohmann::json{
+            {"resourceSpans", {{
+                {"resource", {{"attributes", otlpAttributes({{"service.name", service_name}})}}},
+                {"scopeSpans", {{
+                    {"scope", {{"name", "mantisbase"}}},
+                    {"spans", std::move(out)}
+                }}}
+            }}}
+        }.dump();
+    }
+
+    std::uint64_t Tracer::nowNs() {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+    const TraceContext *Tracer::current() {
+        return t_trace.active ? &t_trace.context : nullptr;
+    }
+
+    Tracer::Scope::Scope(Tracer *tracer, const TraceContext &context)
+        : m_prevTracer(t_trace.tracer), m_prevContext(t_trace.context), m_prevActive(t_trace.active) {
+        t_trace = {tracer, context, true};
+    }
+
+    Tracer::Scope::~Scope() {
+        endStatement();
+        t_trace = {m_prevTracer, m_prevContext, m_prevActive};
+    }
+
+    Tracer::Span::Span(std::string name, const SpanKind kind) {
+        if (!t_trace.active || !t_trace.context.sampled || !t_trace.tracer) return;
+
+        m_tracer = t_trace.tracer;
+        m_prevContext = t_trace.context;
+        m_data.context = m_tracer->childOf(t_trace.context);
+        m_data.parentSpanId = t_trace.context.spanId;
+        m_data.name = std::move(name);
+        m_data.kind = kind;
+        m_data.startNs = nowNs();
+        t_trace.context = m_data.context;
+    }
+
+    Tracer::Span::~Span() {
+        if (!m_tracer) return;
+        // Statements started inside this span end with it
+        if (t_statement && t_statement->data.parentSpanId == m_data.context.spanId) endStatement();
+        t_trace.context = m_prevContext;
+        m_data.endNs = nowNs();
+        m_tracer->record(std::move(m_data));
+    }
+
+    void Tracer::Span::setAttribute(std::string key, std::string value) {
+        if (m_tracer) m_data.attributes.emplace_back(std::move(key), std::move(value));
+    }
+
+    void Tracer::statement(const std::string_view statement) {
+        endStatement();
+        if (!t_trace.active || !t_trace.context.sampled || !t_trace.tracer) return;
+
+        // Span named after the SQL verb, as OpenTelemetry's database conventions suggest
+        const auto verb_end = statement.find_first_of(" \t\r\n(");
+        std::string verb(statement.substr(0, verb_end));
+        std::ranges::transform(verb, verb.begin(), [](const unsigned char c) { return std::toupper(c); });
+
+        SpanData data;
+        data.context = t_trace.tracer->childOf(t_trace.context);
+        data.parentSpanId = t_trace.context.spanId;
+        data.name = verb.empty() ? "SQL" : verb;
+        data.kind = SpanKind::Client;
+        data.startNs = nowNs();
+        data.attributes.emplace_back("db.query.text", std::string(statement.substr(0, 2048)));
+        t_statement.emplace(OpenStatement{t_trace.tracer, std::move(data)});
+    }
+
+    void Tracer::endStatement() {
+        if (!t_statement) return;
+        auto open = std::move(*t_statement);
+        t_statement.reset();
+        open.data.endNs = nowNs();
+        open.tracer->record(std::move(open.data));
+    }
+
+    void Tracer::loop() {
+        std::unique_lock lock(m_mutex);
+        while (!m_stopping) {
+            m_cv.wait_for(lock, m_options.flush, [this] {
+                return m_stopping || m_queue.size() >= m_options.batch;
+            });
+            if (m_stopping) return;
+
+            lock.unlock();
+            // Keep going while full batches are waiting
+            while (exportBatch() == m_options.batch) {}
+            lock.lock();
+        }
+    }
+
+    std::size_t Tracer::exportBatch() {
+        std::lock_guard export_lock(m_exportMutex);
+
+        std::vector<SpanData> batch;
+        {
+            std::lock_guard lock(m_mutex);
+            const auto n = std::min(m_options.batch, m_queue.size());
+            batch.assign(std::make_move_iterator(m_queue.begin()), std::make_move_iterator(m_queue.begin() + n));
+            m_queue.erase(m_queue.begin(), m_queue.begin() + n);
+        }
+        if (batch.empty()) return 0;
+
+        bool ok = false;
+        try {
+            ok = m_exporter(toOtlpJson(batch, m_options.serviceName));
+        } catch (const std::exception &) {
+            ok = false;
+        }
+        (ok ? m_exported : m_failed).fetch_add(batch.size(), std::memory_order_relaxed);
+        return batch.size();
+    }
+}
@@ -0,0 +1,28 @@
+#include "../../include/mantisbase/core/tracing.h"
+
+#include <drogon/HttpClient.h>
+
+namespace mb {
+    Tracer::Exporter Tracer::otlpHttpExporter(const std::string &endpoint) {
+        // `http://host:4318` or `http://host:4318/prefix`, with or without the signal path
+        const auto scheme_end = endpoint.find("://");
+        const auto path_start = endpoint.find('/', scheme_end == std::string::npos ? 0 : scheme_end + 3);
+        const auto host = endpoint.substr(0, path_start);
+        auto path = path_start == std::string::npos ? std::string{} : endpoint.substr(path_start);
+        while (path.ends_with('/')) path.pop_back();
+        if (!path.ends_with("/v1/traces")) path += "/v1/traces";
+
+        // Runs on the export thread, never an IO loop, so the blocking send is fine
+        auto client = drogon::HttpClient::newHttpClient(host);
+        return [client, path](const std::string &body) {
+            auto req = drogon::HttpRequest::newHttpRequest();
+            req->setMethod(drogon::Post);
+            req->setPath(path);
+            req->setContentTypeString("application/json");
+            req->setBody(body);
+
+            const auto [result, resp] = client->sendRequest(req, 10.0);
+            return result == drogon::ReqResult::Ok && resp && static_cast<int>(resp->statusCode()) / 100 == 2;
+        };
+    }
+}
@@ -0,0 +1,266 @@
+/**
+ * @file usage_quotas.cpp
+ * @brief Implementation for @see usage_quotas.h
+ */
+
+#include "../../include/mantisbase/core/usage_quotas.h"
+#include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/core/database.h"
+#include "../../include/mantisbase/core/metrics.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <format>
+#include <functional>
+#include <iterator>
+
+namespace mb {
+    UsageQuotas::Options UsageQuotas::Options::fromEnv() {
+        Options options;
+        if (const auto requests = safe_stoi(getEnvOrDefault("MB_QUOTA_REQUESTS", ""), -1); requests > 0)
+            options.requests = static_cast<std::uint64_t>(requests);
+        if (const auto mib = safe_stoi(getEnvOrDefault("MB_QUOTA_MB", ""), -1); mib > 0)
+            options.bytes = static_cast<std::uint64_t>(mib) * 1024 * 1024;
+        if (const auto secs = safe_stoi(getEnvOrDefault("MB_QUOTA_WINDOW_SECS", ""), -1); secs > 0)
+            options.window = std::chrono::seconds(secs);
+        return options;
+    }
+
+    UsageQuotas::UsageQuotas(const Options options) : m_options(options) {}
+
+    std::string UsageQuotas::keySubject(const std::string &key_id) {
+        return "key:" + key_id;
+    }
+
+    std::string UsageQuotas::userSubject(const std::string &entity, const std::string &user_id) {
+        return std::format("user:{}:{}", entity, user_id);
+    }
+
+    UsageQuotas::Shard &UsageQuotas::shardOf(const std::string &subject) {
+        return m_shards[std::hash<std::string>{}(subject) % SHARDS];
+    }
+
+    const UsageQuotas::Shard &UsageQuotas::shardOf(const std::string &subject) const {
+        return m_shards[std::hash<std::string>{}(subject) % SHARDS];
+    }
+
+    std::int64_t UsageQuotas::windowOf(const Clock::time_point now) const {
+        const auto secs = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
+        return secs - secs % m_options.window.count();
+    }
+
+    void UsageQuotas::roll(Shard &shard, const std::string &subject, Counter &counter, const std::int64_t window) {
+        if (counter.window == window) return;
+        if (counter.pendingRequests || counter.pendingBytes)
+            shard.carried.push_back({subject, counter.window, counter.pendingRequests, counter.pendingBytes});
+        counter.window = window;
+        counter.requests = counter.bytes = 0;
+        counter.pendingRequests = counter.pendingBytes = 0;
+    }
+
+    UsageQuotas::Limits UsageQuotas::limitsOf(const Counter &counter) const {
+        return counter.limits.value_or(Limits{m_options.requests, m_options.bytes});
+    }
+
+    UsageQuotas::Decision UsageQuotas::admit(const std::string &subject, const Clock::time_point now) {
+        const auto window = windowOf(now);
+        auto &shard = shardOf(subject);
+        std::lock_guard lock(shard.mutex);
+        auto &counter = shard.counters[subject];
+        roll(shard, subject, counter, window);
+
+        const auto limits = limitsOf(counter);
+        Decision decision;
+        if (limits.requests && counter.requests >= limits.requests) {
+            decision.reason = std::format("Request quota of {} per {}s used up.", limits.requests,
+                                          m_options.window.count());
+            m_deniedRequests.fetch_add(1, std::memory_order_relaxed);
+        } else if (limits.bytes && counter.bytes >= limits.bytes) {
+            decision.reason = std::format("Bandwidth quota of {} MiB per {}s used up.", limits.bytes / (1024 * 1024),
+                                          m_options.window.count());
+            m_deniedBytes.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            ++counter.requests;
+            ++counter.pendingRequests;
+            return decision;
+        }
+
+        decision.allowed = false;
+        const auto secs = std::chrono::duration_cast<std::chrono::seconds>(now.time_since_epoch()).count();
+        decision.retryAfter = std::chrono::seconds(window + m_options.window.count() - secs);
+        return decision;
+    }
+
+    void UsageQuotas::addBytes(const std::string &subject, const std::uint64_t bytes, const Clock::time_point now) {
+        if (bytes == 0) return;
+        auto &shard = shardOf(subject);
+        std::lock_guard lock(shard.mutex);
+        auto &counter = shard.counters[subject];
+        roll(shard, subject, counter, windowOf(now));
+        counter.bytes += bytes;
+        counter.pendingBytes += bytes;
+    }
+
+    void UsageQuotas::setLimits(const std::string &subject, const std::optional<Limits> limits) {
+        auto &shard = shardOf(subject);
+        std::lock_guard lock(shard.mutex);
+        if (limits) shard.counters[subject].limits = limits;
+        else if (const auto it = shard.counters.find(subject); it != shard.counters.end()) it->second.limits.reset();
+    }
+
+    UsageQuotas::Limits UsageQuotas::limitsOf(const std::string &subject) const {
+        const auto &shard = shardOf(subject);
+        std::lock_guard lock(shard.mutex);
+        const auto it = shard.counters.find(subject);
+        return it == shard.counters.end() ? Limits{m_options.requests, m_options.bytes} : limitsOf(it->second);
+    }
+
+    void UsageQuotas::saveLimits(const std::string &subject, const std::optional<Limits> limits) {
+        auto sql = MantisBase::instance().db().writeSession();
+        if (limits) {
+            const auto requests = static_cast<long long>(limits->requests);
+            const auto bytes = static_cast<long long>(limits->bytes);
+            *sql << "INSERT INTO mb_usage_limits (subject, requests, bytes) VALUES (:subject, :requests, :bytes) "
+                    "ON CONFLICT(subject) DO UPDATE SET requests = excluded.requests, bytes = excluded.bytes",
+                soci::use(subject), soci::use(requests), soci::use(bytes);
+        } else {
+            *sql << "DELETE FROM mb_usage_limits WHERE subject = :subject", soci::use(subject);
+        }
+        setLimits(subject, limits);
+    }
+
+    void UsageQuotas::load(const Clock::time_point now) {
+        const long long window = windowOf(now);
+        auto sql = MantisBase::instance().db().session();
+
+        std::string subject;
+        long long requests = 0, bytes = 0;
+
+        std::size_t subjects = 0;
+        soci::statement usage = (sql->prepare <<
+                                 "SELECT subject, requests, bytes FROM mb_usage WHERE window_start = :window",
+                                 soci::use(window), soci::into(subject), soci::into(requests), soci::into(bytes));
+        usage.execute();
+        while (usage.fetch()) {
+            auto &shard = shardOf(subject);
+            std::lock_guard lock(shard.mutex);
+            auto &counter = shard.counters[subject];
+            roll(shard, subject, counter, window);
+            counter.requests += static_cast<std::uint64_t>(requests);
+            counter.bytes += static_cast<std::uint64_t>(bytes);
+            ++subjects;
+        }
+
+        std::size_t limited = 0;
+        soci::statement limits = (sql->prepare << "SELECT subject, requests, bytes FROM mb_usage_limits",
+                                  soci::into(subject), soci::into(requests), soci::into(bytes));
+        limits.execute();
+        while (limits.fetch()) {
+            setLimits(subject, Limits{static_cast<std::uint64_t>(requests), static_cast<std::uint64_t>(bytes)});
+            ++limited;
+        }
+        LogOrigin::info("Usage Quotas", std::format("{} subject(s) metered this window, {} with their own limits",
+                                                    subjects, limited));
+    }
+
+    std::size_t UsageQuotas::flush() {
+        std::vector<Carried> batch;
+        const auto window = windowOf(Clock::now());
+        for (auto &shard: m_shards) {
+            std::lock_guard lock(shard.mutex);
+            std::ranges::move(shard.carried, std::back_inserter(batch));
+            shard.carried.clear();
+            for (auto it = shard.counters.begin(); it != shard.counters.end();) {
+                auto &counter = it->second;
+                if (counter.pendingRequests || counter.pendingBytes) {
+                    batch.push_back({it->first, counter.window, counter.pendingRequests, counter.pendingBytes});
+                    counter.pendingRequests = counter.pendingBytes = 0;
+                }
+                // Not heard from this window: nothing to hold but its own limits
+                if (counter.window < window && !counter.limits) it = shard.counters.erase(it);
+                else ++it;
+            }
+        }
+        if (batch.empty()) return 0;
+
+        try {
+            auto sql = MantisBase::instance().db().writeSession();
+            soci::transaction tr(*sql);
+
+            std::string subject;
+            long long window_start = 0, requests = 0, bytes = 0;
+            const auto now = getCurrentTimestampUTC();
+            soci::statement st = (sql->prepare <<
+                "INSERT INTO mb_usage (subject, window_start, requests, bytes, updated) "
+                "VALUES (:subject, :window, :requests, :bytes, :updated) "
+                "ON CONFLICT(subject, window_start) DO UPDATE SET requests = mb_usage.requests + excluded.requests, "
+                "bytes = mb_usage.bytes + excluded.bytes, updated = excluded.updated",
+                soci::use(subject), soci::use(window_start), soci::use(requests), soci::use(bytes), soci::use(now));
+            for (const auto &row: batch) {
+                subject = row.subject;
+                window_start = row.window;
+                requests = static_cast<long long>(row.requests);
+                bytes = static_cast<long long>(row.bytes);
+                st.execute(true);
+            }
+
+            tr.commit();
+            return batch.size();
+        } catch (const std::exception &e) {
+            m_flushFailures.fetch_add(1, std::memory_order_relaxed);
+            LogOrigin::warn("Usage Quotas", std::format("Failed to flush usage of {} subject(s): {}", batch.size(),
+                                                        e.what()));
+            // Kept for the next flush, which adds them to whatever came in meanwhile
+            for (auto &row: batch) {
+                auto &shard = shardOf(row.subject);
+                std::lock_guard lock(shard.mutex);
+                shard.carried.push_back(std::move(row));
+            }
+            return 0;
+        }
+    }
+
+    json UsageQuotas::usage(const Clock::time_point now) const {
+        const auto window = windowOf(now);
+        json out = json::array();
+        for (const auto &shard: m_shards) {
+            std::lock_guard lock(shard.mutex);
+            for (const auto &[subject, counter]: shard.counters) {
+                const auto limits = limitsOf(counter);
+                const bool current = counter.window == window;
+                out.push_back({
+                    {"subject", subject},
+                    {"window_start", window},
+                    {"requests", current ? counter.requests : 0},
+                    {"bytes", current ? counter.bytes : 0},
+                    {"limits", {{"requests", limits.requests}, {"bytes", limits.bytes}}},
+                    {"custom_limits", counter.limits.has_value()}
+                });
+            }
+        }
+        return out;
+    }
+
+    std::size_t UsageQuotas::size() const {
+        std::size_t total = 0;
+        for (const auto &shard: m_shards) {
+            std::lock_guard lock(shard.mutex);
+            total += shard.counters.size();
+        }
+        return total;
+    }
+
+    void UsageQuotas::writeMetrics(MetricsWriter &out) const {
+        out.family("mb_usage_subjects", "API keys and users metered in memory", "gauge");
+        out.sample("mb_usage_subjects", {}, static_cast<double>(size()));
+        out.family("mb_usage_rejected_total", "Requests turned away over a usage quota", "counter");
+        out.sample("mb_usage_rejected_total", {{"quota", "requests"}},
+                   static_cast<double>(m_deniedRequests.load(std::memory_order_relaxed)));
+        out.sample("mb_usage_rejected_total", {{"quota", "bytes"}},
+                   static_cast<double>(m_deniedBytes.load(std::memory_order_relaxed)));
+        out.family("mb_usage_flush_failures_total", "Flushes to mb_usage that failed and were retried", "counter");
+        out.sample("mb_usage_flush_failures_total", {},
+                   static_cast<double>(m_flushFailures.load(std::memory_order_relaxed)));
+    }
+}
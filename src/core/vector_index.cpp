@@ -0,0 +1,457 @@
+/**
+ * @file vector_index.cpp
+ * @brief Implementation for @see vector_index.h
+ */
+
+#include "../../include/mantisbase/core/vector_index.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/utils/crypto_utils.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <queue>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define MB_VECTOR_AVX2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MB_VECTOR_NEON 1
+#endif
+
+namespace mb {
+    namespace {
+        float dotPortable(const float *a, const float *b, const std::size_t n) {
+            // Independent sums, so the compiler can keep them in one vector register
+            float acc[8] = {};
+            std::size_t i = 0;
+            for (; i + 8 <= n; i += 8)
+                for (std::size_t j = 0; j < 8; ++j) acc[j] += a[i + j] * b[i + j];
+            float sum = ((acc[0] + acc[1]) + (acc[2] + acc[3])) + ((acc[4] + acc[5]) + (acc[6] + acc[7]));
+            for (; i < n; ++i) sum += a[i] * b[i];
+            return sum;
+        }
+
+#if MB_VECTOR_AVX2
+        // Compiled for AVX2 whatever the build targets, and only called where the CPU has it
+        __attribute__((target("avx2,fma"))) float dotAvx2(const float *a, const float *b, const std::size_t n) {
+            __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+            std::size_t i = 0;
+            for (; i + 16 <= n; i += 16) {
+                s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+                s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), s1);
+            }
+            if (i + 8 <= n) {
+                s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+                i += 8;
+            }
+            s0 = _mm256_add_ps(s0, s1);
+            __m128 s = _mm_add_ps(_mm256_castps256_ps128(s0), _mm256_extractf128_ps(s0, 1));
+            s = _mm_hadd_ps(s, s);
+            s = _mm_hadd_ps(s, s);
+            float sum = _mm_cvtss_f32(s);
+            for (; i < n; ++i) sum += a[i] * b[i];
+            return sum;
+        }
+
+        const bool kHasAvx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+
+        /// Normalized copy of `v`; empty for a zero vector
+        std::vector<float> unit(const std::span<const float> v) {
+            const float norm = std::sqrt(VectorIndex::dot(v.data(), v.data(), v.size()));
+            if (!(norm > 0.f) || !std::isfinite(norm)) return {};
+            std::vector<float> out(v.begin(), v.end());
+            for (auto &x: out) x /= norm;
+            return out;
+        }
+
+        /// Visit marks of the searches on this thread, an epoch per search
+        struct Visited {
+            std::vector<std::uint32_t> marks;
+            std::uint32_t epoch = 0;
+
+            void reset(const std::size_t nodes) {
+                if (marks.size() < nodes) marks.resize(nodes, 0);
+                if (++epoch == 0) {
+                    std::ranges::fill(marks, 0);
+                    epoch = 1;
+                }
+            }
+
+            /// True the first time `node` is seen since reset()
+            bool visit(const std::uint32_t node) {
+                if (marks[node] == epoch) return false;
+                marks[node] = epoch;
+                return true;
+            }
+        };
+
+        thread_local Visited visited;
+    }
+
+    VectorIndex::Options VectorIndex::Options::fromEnv() {
+        Options options;
+        options.m = std::clamp(safe_stoi(getEnvOrDefault("MB_VECTOR_M", ""), static_cast<int>(options.m)), 4, 64);
+        options.efConstruction = std::clamp(
+            safe_stoi(getEnvOrDefault("MB_VECTOR_EF_CONSTRUCTION", ""), static_cast<int>(options.efConstruction)),
+            16, 2000);
+        options.efSearch = std::clamp(
+            safe_stoi(getEnvOrDefault("MB_VECTOR_EF_SEARCH", ""), static_cast<int>(options.efSearch)), 8, 2000);
+        return options;
+    }
+
+    VectorIndex::VectorIndex(const std::size_t dim) : VectorIndex(dim, Options{}) {}
+
+    VectorIndex::VectorIndex(const std::size_t dim, const Options &options)
+        : m_dim(dim), m_options(options), m_levelFactor(1.0 / std::log(static_cast<double>(std::max<std::size_t>(
+              options.m, 2)))) {}
+
+    void VectorIndex::upsert(const std::string &id, const std::span<const float> vector) {
+        if (vector.size() != m_dim) throw MantisException(400, std::format("Expected a vector of {} numbers.", m_dim));
+        const auto v = unit(vector);
+
+        std::unique_lock lock(m_mutex);
+        if (const auto it = m_live.find(id); it != m_live.end()) {
+            if (!v.empty() && std::memcmp(vectorOf(it->second), v.data(), m_dim * sizeof(float)) == 0) return;
+            m_dead[it->second] = 1;
+            m_live.erase(it);
+        }
+        if (v.empty()) return;
+
+        const auto node = static_cast<Node>(m_ids.size());
+        m_data.insert(m_data.end(), v.begin(), v.end());
+        m_ids.push_back(id);
+        m_dead.push_back(0);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        const int level = static_cast<int>(-std::log(1.0 - uniform(m_rng)) * m_levelFactor);
+        m_links.emplace_back(level + 1);
+        m_live.emplace(id, node);
+        insertLocked(node, level);
+
+        if (m_ids.size() - m_live.size() > std::max<std::size_t>(m_live.size(), 64)) rebuildLocked();
+    }
+
+    bool VectorIndex::remove(const std::string &id) {
+        std::unique_lock lock(m_mutex);
+        const auto it = m_live.find(id);
+        if (it == m_live.end()) return false;
+        m_dead[it->second] = 1;
+        m_live.erase(it);
+        if (m_ids.size() - m_live.size() > std::max<std::size_t>(m_live.size(), 64)) rebuildLocked();
+        return true;
+    }
+
+    std::vector<VectorIndex::Hit> VectorIndex::search(const std::span<const float> query, const std::size_t k) const {
+        if (query.size() != m_dim) throw MantisException(400, std::format("Expected a vector of {} numbers.", m_dim));
+        const auto q = unit(query);
+        std::vector<Hit> hits;
+        if (q.empty() || k == 0) return hits;
+
+        std::shared_lock lock(m_mutex);
+        if (m_top < 0 || m_live.empty()) return hits;
+
+        Node entry = m_entry;
+        for (int level = m_top; level > 0; --level) entry = greedyLocked(q.data(), entry, level);
+
+        // Tombstones take candidate slots; widen the search by their share
+        auto ef = std::max(m_options.efSearch, k);
+        ef += ef * (m_ids.size() - m_live.size()) / m_live.size();
+        for (const auto &[d, node]: searchLayerLocked(q.data(), entry, ef, 0)) {
+            if (m_dead[node]) continue;
+            hits.push_back({m_ids[node], std::max(0.f, d)});
+            if (hits.size() == k) break;
+        }
+        return hits;
+    }
+
+    std::size_t VectorIndex::size() const {
+        std::shared_lock lock(m_mutex);
+        return m_live.size();
+    }
+
+    void VectorIndex::insertLocked(const Node node, const int level) {
+        if (m_top < 0) {
+            m_entry = node;
+            m_top = level;
+            return;
+        }
+
+        const float *q = vectorOf(node);
+        Node entry = m_entry;
+        for (int l = m_top; l > level; --l) entry = greedyLocked(q, entry, l);
+
+        for (int l = std::min(level, m_top); l >= 0; --l) {
+            const auto candidates = searchLayerLocked(q, entry, m_options.efConstruction, l);
+            const auto max_links = l == 0 ? 2 * m_options.m : m_options.m;
+            m_links[node][l] = selectLocked(candidates, m_options.m);
+
+            for (const auto neighbour: m_links[node][l]) {
+                auto &links = m_links[neighbour][l];
+                links.push_back(node);
+                if (links.size() <= max_links) continue;
+
+                // Over budget: keep the neighbour's most diverse links
+                std::vector<Scored> scored;
+                scored.reserve(links.size());
+                for (const auto other: links) scored.emplace_back(distance(vectorOf(neighbour), vectorOf(other)), other);
+                std::ranges::sort(scored);
+                links = selectLocked(scored, max_links);
+            }
+            if (!candidates.empty()) entry = candidates.front().second;
+        }
+
+        if (level > m_top) {
+            m_top = level;
+            m_entry = node;
+        }
+    }
+
+    VectorIndex::Node VectorIndex::greedyLocked(const float *q, Node entry, const int level) const {
+        float best = distance(q, vectorOf(entry));
+        for (bool moved = true; moved;) {
+            moved = false;
+            for (const auto next: m_links[entry][level]) {
+                if (const float d = distance(q, vectorOf(next)); d < best) {
+                    best = d;
+                    entry = next;
+                    moved = true;
+                }
+            }
+        }
+        return entry;
+    }
+
+    std::vector<VectorIndex::Scored> VectorIndex::searchLayerLocked(const float *q, const Node entry,
+                                                                    const std::size_t ef, const int level) const {
+        visited.reset(m_ids.size());
+        visited.visit(entry);
+
+        // Nearest unexpanded candidate first; the worst of the best `ef` on top
+        std::priority_queue<Scored, std::vector<Scored>, std::greater<>> candidates;
+        std::priority_queue<Scored> best;
+        const float d = distance(q, vectorOf(entry));
+        candidates.emplace(d, entry);
+        best.emplace(d, entry);
+
+        while (!candidates.empty()) {
+            const auto [dist, node] = candidates.top();
+            if (dist > best.top().first && best.size() >= ef) break;
+            candidates.pop();
+
+            for (const auto next: m_links[node][level]) {
+                if (!visited.visit(next)) continue;
+                const float dn = distance(q, vectorOf(next));
+                if (best.size() >= ef && dn >= best.top().first) continue;
+                candidates.emplace(dn, next);
+                best.emplace(dn, next);
+                if (best.size() > ef) best.pop();
+            }
+        }
+
+        std::vector<Scored> out(best.size());
+        for (auto i = out.size(); i-- > 0; best.pop()) out[i] = best.top();
+        return out;
+    }
+
+    std::vector<VectorIndex::Node> VectorIndex::selectLocked(const std::vector<Scored> &candidates,
+                                                             const std::size_t m) const {
+        // HNSW's heuristic: a candidate closer to a chosen neighbour than to the
+        // base is reached through it, so links spread out instead of clustering
+        std::vector<Node> chosen, skipped;
+        for (const auto &[d, node]: candidates) {
+            if (chosen.size() >= m) break;
+            const bool diverse = std::ranges::none_of(chosen, [&](const Node c) {
+                return distance(vectorOf(node), vectorOf(c)) < d;
+            });
+            (diverse ? chosen : skipped).push_back(node);
+        }
+        for (const auto node: skipped) {
+            if (chosen.size() >= m) break;
+            chosen.push_back(node);
+        }
+        return chosen;
+    }
+
+    void VectorIndex::rebuildLocked() {
+        std::vector<std::pair<std::string, Node>> live(m_live.begin(), m_live.end());
+        // Node order is insertion order; keep it, so rebuilds are deterministic
+        std::ranges::sort(live, {}, &std::pair<std::string, Node>::second);
+
+        std::vector<float> data;
+        data.reserve(live.size() * m_dim);
+        for (const auto &[id, node]: live) data.insert(data.end(), vectorOf(node), vectorOf(node) + m_dim);
+
+        m_data = std::move(data);
+        m_ids.clear();
+        m_dead.assign(live.size(), 0);
+        m_links.clear();
+        m_live.clear();
+        m_top = -1;
+
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        for (Node node = 0; node < live.size(); ++node) {
+            m_ids.push_back(live[node].first);
+            const int level = static_cast<int>(-std::log(1.0 - uniform(m_rng)) * m_levelFactor);
+            m_links.emplace_back(level + 1);
+            m_live.emplace(live[node].first, node);
+            insertLocked(node, level);
+        }
+    }
+
+    std::vector<float> VectorIndex::parse(const nlohmann::json &value, const std::size_t dim) {
+        if (!value.is_array() || value.size() != dim)
+            throw MantisException(400, std::format("Expected a vector of {} numbers.", dim));
+        std::vector<float> out;
+        out.reserve(dim);
+        for (const auto &x: value) {
+            if (!x.is_number()) throw MantisException(400, std::format("Expected a vector of {} numbers.", dim));
+            const auto f = static_cast<float>(x.get<double>());
+            if (!std::isfinite(f)) throw MantisException(400, "Vector components must be finite numbers.");
+            out.push_back(f);
+        }
+        return out;
+    }
+
+    std::string VectorIndex::encode(const std::span<const float> vector) {
+        std::vector<std::uint8_t> bytes(vector.size() * sizeof(float));
+        for (std::size_t i = 0; i < vector.size(); ++i) {
+            auto bits = std::bit_cast<std::uint32_t>(vector[i]);
+            for (int b = 0; b < 4; ++b, bits >>= 8) bytes[i * 4 + b] = static_cast<std::uint8_t>(bits);
+        }
+        return base64UrlEncode(bytes);
+    }
+
+    std::vector<float> VectorIndex::decode(const std::string_view text) {
+        std::vector<std::uint8_t> bytes;
+        try {
+            bytes = base64UrlDecode(std::string(text));
+        } catch (const std::exception &) {
+            return {};
+        }
+        if (bytes.empty() || bytes.size() % sizeof(float) != 0) return {};
+
+        std::vector<float> out(bytes.size() / sizeof(float));
+        for (std::size_t i = 0; i < out.size(); ++i) {
+            std::uint32_t bits = 0;
+            for (int b = 3; b >= 0; --b) bits = bits << 8 | bytes[i * 4 + b];
+            out[i] = std::bit_cast<float>(bits);
+        }
+        return out;
+    }
+
+    nlohmann::json VectorIndex::toJSON(const std::string_view text) {
+        const auto v = decode(text);
+        return v.empty() ? nlohmann::json(nullptr) : nlohmann::json(v);
+    }
+
+    float VectorIndex::dot(const float *a, const float *b, const std::size_t n) {
+#if MB_VECTOR_AVX2
+        if (kHasAvx2) return dotAvx2(a, b, n);
+#elif MB_VECTOR_NEON
+        float32x4_t s0 = vdupq_n_f32(0.f), s1 = vdupq_n_f32(0.f);
+        std::size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            s0 = vfmaq_f32(s0, vld1q_f32(a + i), vld1q_f32(b + i));
+            s1 = vfmaq_f32(s1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+        }
+        float sum = vaddvq_f32(vaddq_f32(s0, s1));
+        for (; i < n; ++i) sum += a[i] * b[i];
+        return sum;
+#endif
+        return dotPortable(a, b, n);
+    }
+
+    VectorIndexes::VectorIndexes(const VectorIndex::Options &options) : m_options(options) {}
+
+    std::shared_ptr<const VectorIndex> VectorIndexes::acquire(const std::string &entity, const std::string &field,
+                                                              const std::size_t dim, const Loader &load) {
+        auto key = entity;
+        key.append(1, '\0').append(field);
+
+        std::shared_ptr<Slot> slot;
+        {
+            std::lock_guard lock(m_mutex);
+            auto &entry = m_slots[key];
+            if (!entry || entry->dim != dim) {
+                entry = std::make_shared<Slot>();
+                entry->entity = entity;
+                entry->dim = dim;
+            }
+            slot = entry;
+        }
+
+        // One reader brings the index up to date; the others wait for it
+        std::lock_guard load_lock(slot->load);
+        bool stale;
+        std::unordered_set<std::string> dirty;
+        {
+            std::lock_guard lock(m_mutex);
+            stale = slot->stale || !slot->index;
+            slot->stale = false;
+            dirty.swap(slot->dirty);
+        }
+
+        try {
+            if (stale) {
+                auto index = std::make_shared<VectorIndex>(dim, m_options);
+                for (const auto &[id, text]: load(nullptr))
+                    if (const auto v = VectorIndex::decode(text); v.size() == dim) index->upsert(id, v);
+                slot->index = std::move(index);
+            } else if (!dirty.empty()) {
+                const std::vector<std::string> ids(dirty.begin(), dirty.end());
+                for (const auto &[id, text]: load(&ids)) {
+                    dirty.erase(id);
+                    if (const auto v = VectorIndex::decode(text); v.size() == dim) slot->index->upsert(id, v);
+                    else slot->index->remove(id);
+                }
+                // Not found: deleted
+                for (const auto &id: dirty) slot->index->remove(id);
+            }
+        } catch (...) {
+            std::lock_guard lock(m_mutex);
+            if (stale) slot->stale = true;
+            else slot->dirty.merge(dirty);
+            throw;
+        }
+        return slot->index;
+    }
+
+    void VectorIndexes::invalidateEntity(const std::string &entity) {
+        std::lock_guard lock(m_mutex);
+        std::erase_if(m_slots, [&](const auto &entry) { return entry.second->entity == entity; });
+    }
+
+    void VectorIndexes::onChanges(const nlohmann::json &events) {
+        if (!events.is_array()) return;
+
+        std::lock_guard lock(m_mutex);
+        if (m_slots.empty()) return;
+        for (const auto &event: events) {
+            if (!event.is_object()) continue;
+
+            const auto &entity = event.value("entity", nlohmann::json{});
+            if (!entity.is_string()) continue;
+            const auto &row_id = event.value("row_id", nlohmann::json{});
+            const bool whole = !row_id.is_string() || row_id.get_ref<const std::string &>().empty();
+            for (auto &[key, slot]: m_slots) {
+                if (slot->entity != entity.get_ref<const std::string &>() || slot->stale) continue;
+                if (!whole) slot->dirty.insert(row_id.get<std::string>());
+                // Past a point, one full read beats re-reading rows one by one
+                if (whole || slot->dirty.size() > MAX_DIRTY) {
+                    slot->stale = true;
+                    slot->dirty.clear();
+                }
+            }
+        }
+    }
+
+    std::size_t VectorIndexes::loaded() const {
+        std::lock_guard lock(m_mutex);
+        return std::ranges::count_if(m_slots, [](const auto &entry) { return !entry.second->stale; });
+    }
+}
@@ -0,0 +1,143 @@
+#include "../../include/mantisbase/core/wal_checkpointer.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+
+namespace mb {
+    WalCheckpointer::Options WalCheckpointer::Options::fromEnv() {
+        Options options;
+        if (const auto ms = safe_stoi(getEnvOrDefault("MB_SQLITE_CHECKPOINT_IDLE_MS", ""), 0); ms > 0)
+            options.idle = std::chrono::milliseconds(ms);
+        if (const auto size_mb = safe_stoi(getEnvOrDefault("MB_SQLITE_WAL_RESTART_MB", ""), 0); size_mb > 0)
+            options.restartBytes = static_cast<std::int64_t>(size_mb) << 20;
+        if (const auto size_mb = safe_stoi(getEnvOrDefault("MB_SQLITE_WAL_TRUNCATE_MB", ""), 0); size_mb > 0)
+            options.truncateBytes = static_cast<std::int64_t>(size_mb) << 20;
+        options.truncateBytes = std::max(options.truncateBytes, options.restartBytes);
+        return options;
+    }
+
+    bool WalCheckpointer::Options::enabledFromEnv() {
+        return getEnvOrDefault("MB_SQLITE_CHECKPOINT", "1") != "0";
+    }
+
+    WalCheckpointer::WalCheckpointer(Checkpoint checkpoint, const int page_size, const Options options)
+        : m_checkpoint(std::move(checkpoint)), m_pageSize(std::max(page_size, 512)), m_options(options) {}
+
+    WalCheckpointer::~WalCheckpointer() {
+        stop();
+    }
+
+    void WalCheckpointer::start() {
+        std::lock_guard lock(m_mutex);
+        if (m_thread.joinable()) return;
+        m_stopping = false;
+        m_thread = std::thread(&WalCheckpointer::loop, this);
+    }
+
+    void WalCheckpointer::stop() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+    void WalCheckpointer::noteCommit(const int wal_frames, const Clock::time_point now) {
+        // A smaller WAL than last time means a writer started it over
+        if (m_walFrames.exchange(wal_frames, std::memory_order_relaxed) > wal_frames)
+            m_backfilled.store(0, std::memory_order_relaxed);
+        m_lastCommit.store(now.time_since_epoch().count(), std::memory_order_relaxed);
+
+        // Wake the thread early for an oversized WAL, unless the last escalation
+        // found readers in the way; then it waits for the next poll
+        if (static_cast<std::int64_t>(wal_frames) * m_pageSize >= m_options.restartBytes &&
+            !m_escalationBusy.load(std::memory_order_relaxed)) {
+            {
+                std::lock_guard lock(m_mutex);
+                if (m_wake) return;
+                m_wake = true;
+            }
+            m_cv.notify_one();
+        }
+    }
+
+    std::optional<WalCheckpointer::Mode> WalCheckpointer::due(const Options &options, const std::int64_t wal_bytes,
+                                                              const std::int64_t pending_bytes,
+                                                              const std::chrono::milliseconds since_commit) {
+        if (wal_bytes >= options.truncateBytes) return Mode::Truncate;
+        if (wal_bytes >= options.restartBytes) return Mode::Restart;
+        if (pending_bytes > 0 && since_commit >= options.idle) return Mode::Passive;
+        return std::nullopt;
+    }
+
+    std::optional<WalCheckpointer::Mode> WalCheckpointer::tick(const Clock::time_point now) {
+        const auto frames = m_walFrames.load(std::memory_order_relaxed);
+        const auto backfilled = std::min(m_backfilled.load(std::memory_order_relaxed), frames);
+        const auto since_commit = std::chrono::duration_cast<std::chrono::milliseconds>(
+            now - Clock::time_point(Clock::duration(m_lastCommit.load(std::memory_order_relaxed))));
+
+        const auto mode = due(m_options, frames * m_pageSize, (frames - backfilled) * m_pageSize, since_commit);
+        if (!mode) return std::nullopt;
+
+        const auto started = Clock::now();
+        std::optional<Result> result;
+        try {
+            result = m_checkpoint(*mode);
+        } catch (const std::exception &e) {
+            LogOrigin::dbWarn("WAL Checkpoint", fmt::format("Background checkpoint failed: {}", e.what()));
+        }
+        const auto ms = std::chrono::duration<double, std::milli>(Clock::now() - started).count();
+
+        if (*mode != Mode::Passive)
+            m_escalationBusy.store(!result || result->busy, std::memory_order_relaxed);
+
+        if (result && !result->busy) {
+            if (*mode == Mode::Passive) {
+                m_backfilled.store(result->checkpointed, std::memory_order_relaxed);
+            } else {
+                // Every frame is in the database and the next writer starts the WAL over;
+                // unless a commit landed meanwhile, which its hook already recorded
+                auto expected = frames;
+                m_walFrames.compare_exchange_strong(expected, 0, std::memory_order_relaxed);
+                m_backfilled.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        std::lock_guard lock(m_mutex);
+        switch (*mode) {
+            case Mode::Passive: ++m_stats.passive; break;
+            case Mode::Restart: ++m_stats.restart; break;
+            case Mode::Truncate: ++m_stats.truncate; break;
+        }
+        if (!result) ++m_stats.failed;
+        else {
+            if (result->busy) ++m_stats.busy;
+            m_stats.frames += static_cast<std::uint64_t>(std::max(0, result->checkpointed - backfilled));
+        }
+        m_stats.lastMs = ms;
+        m_stats.maxMs = std::max(m_stats.maxMs, ms);
+        return mode;
+    }
+
+    WalCheckpointer::Stats WalCheckpointer::stats() const {
+        std::lock_guard lock(m_mutex);
+        auto stats = m_stats;
+        stats.walBytes = m_walFrames.load(std::memory_order_relaxed) * m_pageSize;
+        return stats;
+    }
+
+    void WalCheckpointer::loop() {
+        std::unique_lock lock(m_mutex);
+        while (!m_stopping) {
+            m_cv.wait_for(lock, m_options.poll, [this] { return m_stopping || m_wake; });
+            if (m_stopping) return;
+            m_wake = false;
+
+            lock.unlock();
+            tick();
+            lock.lock();
+        }
+    }
+}
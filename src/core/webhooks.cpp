@@ -0,0 +1,485 @@
+/**
+ * @file webhooks.cpp
+ * @brief Implementation for @see webhooks.h
+ */
+
+#include "../../include/mantisbase/core/webhooks.h"
+#include "../../include/mantisbase/core/database.h"
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+#include "../../include/mantisbase/core/metrics.h"
+#include "../../include/mantisbase/mantisbase.h"
+#include "../../include/mantisbase/utils/crypto_utils.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <soci/soci.h>
+
+#include <algorithm>
+#include <format>
+#include <tuple>
+
+namespace mb {
+    namespace {
+        /// How long the webhooks read from `mb_webhooks` are used before they are read again
+        constexpr auto HOOKS_TTL = std::chrono::seconds(5);
+
+        /// How often the thread looks for deliveries whose retry came due
+        constexpr auto TICK = std::chrono::seconds(1);
+
+        long long nowMs() {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+
+        /// Orders the outbox: microseconds, made unique within the process
+        long long nextSeq() {
+            static std::atomic<long long> last{0};
+            const long long now = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            auto prev = last.load();
+            while (!last.compare_exchange_weak(prev, std::max(prev + 1, now))) {}
+            return std::max(prev + 1, now);
+        }
+
+        /// `:n0, :n1, ...` for `count` values
+        std::string placeholders(const std::size_t count) {
+            std::string in;
+            for (std::size_t i = 0; i < count; ++i) in += std::format("{}:n{}", i == 0 ? "" : ", ", i);
+            return in;
+        }
+
+        soci::values bound(const std::vector<std::string> &ids) {
+            soci::values vals;
+            for (std::size_t i = 0; i < ids.size(); ++i) vals.set("n" + std::to_string(i), ids[i]);
+            return vals;
+        }
+
+        /// A change as subscribers get it, without the stored password hash
+        json payloadOf(const json &change) {
+            auto action = change.value("type", "");
+            toLowerCase(action);
+            auto data = action == "delete" ? json(nullptr) : change.value("new_data", json(nullptr));
+            if (data.is_object()) data.erase("password");
+            json event = {
+                {"action", action},
+                {"entity", change["entity"]},
+                {"row_id", change["row_id"]},
+                {"timestamp", change.value("timestamp", json(nullptr))},
+                {"data", std::move(data)}
+            };
+            if (const auto it = change.find("id"); it != change.end() && !it->is_null()) event["event_id"] = *it;
+            return event;
+        }
+
+        bool isChange(const json &change) {
+            return change.is_object() && change.contains("entity") && change["entity"].is_string() &&
+                   change.contains("row_id") && change["row_id"].is_string();
+        }
+    }
+
+    Webhooks::Options Webhooks::Options::fromEnv() {
+        Options o;
+        const auto positive = [](const std::string &key, const std::size_t fallback) {
+            return static_cast<std::size_t>(
+                std::max(1, safe_stoi(getEnvOrDefault(key, ""), static_cast<int>(fallback))));
+        };
+        o.enabled = getEnvOrDefault("MB_WEBHOOKS", "1") != "0";
+        o.batch = positive("MB_WEBHOOK_BATCH", o.batch);
+        o.concurrency = positive("MB_WEBHOOK_CONCURRENCY", o.concurrency);
+        o.maxAttempts = positive("MB_WEBHOOK_ATTEMPTS", o.maxAttempts);
+        return o;
+    }
+
+    bool Webhooks::Hook::matches(const std::string &entity, const std::string &row_id) const {
+        return std::ranges::any_of(topics, [&](const std::string &topic) {
+            // `*` leaves the system tables out; name one to get it
+            if (topic == "*") return !entity.starts_with("mb_");
+            return topic == entity || topic == entity + ":*" || topic == entity + ":" + row_id;
+        });
+    }
+
+    json Webhooks::Hook::toJSON() const {
+        return {{"id", id}, {"url", url}, {"topics", topics}, {"signed", !secret.empty()}};
+    }
+
+    Webhooks::Webhooks(Options options, Send send, Connect connect)
+        : m_options(std::move(options)),
+          m_send(send ? std::move(send) : httpSender(m_options.timeout)),
+          m_connect(connect ? std::move(connect) : Connect([] { return MantisBase::instance().rootDb().writeSession(); })) {}
+
+    Webhooks::~Webhooks() {
+        stop();
+    }
+
+    void Webhooks::start(Leadership leads) {
+        if (!m_options.enabled) return;
+        std::lock_guard lock(m_mutex);
+        if (m_thread.joinable()) return;
+        m_leads = std::move(leads);
+        m_stopping = false;
+        m_thread = std::thread(&Webhooks::loop, this);
+    }
+
+    void Webhooks::stop() {
+        {
+            std::lock_guard lock(m_mutex);
+            if (!m_thread.joinable()) return;
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        m_thread.join();
+
+        {
+            // Answers settle their rows; what isn't answered by the timeout is sent again later
+            std::unique_lock lock(m_mutex);
+            const auto answered = [this] {
+                std::size_t flying = 0;
+                for (const auto &[_, n]: m_inFlight) flying += n;
+                return m_answers.size() >= flying;
+            };
+            if (!m_cv.wait_for(lock, std::chrono::duration<double>(m_options.timeout + 1), answered))
+                LogOrigin::warn("Webhooks", "Stopped with deliveries still in flight; they will be sent again");
+        }
+
+        try {
+            const auto sql = m_connect();
+            std::deque<Answer> answers;
+            {
+                std::lock_guard lock(m_mutex);
+                answers.swap(m_answers);
+            }
+            for (const auto &answer: answers) settle(*sql, answer);
+            flush(*sql);
+        } catch (const std::exception &e) {
+            LogOrigin::dbWarn("Webhooks", std::format("Saving deliveries on shutdown: {}", e.what()));
+        }
+    }
+
+    Webhooks::Hook Webhooks::create(const json &body) {
+        if (!body.is_object()) throw MantisException(400, "Expected a JSON object.");
+
+        Hook hook;
+        if (const auto it = body.find("url"); it != body.end() && it->is_string()) hook.url = it->get<std::string>();
+        if (const auto scheme = hook.url.find("://");
+            (!hook.url.starts_with("http://") && !hook.url.starts_with("https://")) || scheme + 3 >= hook.url.size())
+            throw MantisException(400, "`url` must be an http(s) URL.");
+
+        if (const auto it = body.find("topics"); it == body.end() || it->is_null()) {
+            hook.topics = {"*"};
+        } else {
+            if (!it->is_array() || it->empty())
+                throw MantisException(400, "`topics` must be a non-empty list of strings.");
+            for (const auto &topic: *it) {
+                if (!topic.is_string() || topic.get<std::string>().empty())
+                    throw MantisException(400, "`topics` must be a non-empty list of strings.");
+                if (topic.get<std::string>().find('?') != std::string::npos)
+                    throw MantisException(400, "Webhook topics take no filter.",
+                                          "Use `<entity>`, `<entity>:*`, `<entity>:<row_id>` or `*`.");
+                hook.topics.push_back(topic.get<std::string>());
+            }
+        }
+
+        if (const auto it = body.find("secret"); it != body.end() && !it->is_null()) {
+            if (!it->is_string()) throw MantisException(400, "`secret` must be a string.");
+            hook.secret = it->get<std::string>();
+        }
+
+        hook.id = generateShortId();
+        const auto topics = json(hook.topics).dump();
+        const long long created = nowMs();
+        const auto sql = m_connect();
+        *sql << "INSERT INTO mb_webhooks (id, url, topics, secret, created) "
+                "VALUES (:id, :url, :topics, :secret, :created)",
+                soci::use(hook.id, "id"), soci::use(hook.url, "url"), soci::use(topics, "topics"),
+                soci::use(hook.secret, "secret"), soci::use(created, "created");
+
+        std::lock_guard lock(m_hooksMutex);
+        m_hooks.reset();
+        return hook;
+    }
+
+    std::vector<Webhooks::Hook> Webhooks::list() const {
+        std::vector<Hook> hooks;
+        const auto sql = m_connect();
+        const soci::rowset<soci::row> rows = (sql->prepare
+            << "SELECT id, url, topics, secret FROM mb_webhooks ORDER BY created, id");
+        for (const auto &row: rows) {
+            Hook hook{row.get<std::string>(0), row.get<std::string>(1), {}, {}};
+            if (row.get_indicator(3) == soci::i_ok) hook.secret = row.get<std::string>(3);
+            try {
+                const auto topics = json::parse(row.get<std::string>(2));
+                for (const auto &topic: topics)
+                    if (topic.is_string()) hook.topics.push_back(topic.get<std::string>());
+            } catch (const json::parse_error &) {
+                LogOrigin::warn("Webhooks", std::format("Webhook `{}` has unreadable topics", hook.id));
+            }
+            hooks.push_back(std::move(hook));
+        }
+        return hooks;
+    }
+
+    bool Webhooks::remove(const std::string &id) {
+        const auto sql = m_connect();
+        {
+            soci::transaction tr(*sql);
+            *sql << "DELETE FROM mb_webhook_outbox WHERE hook = :id", soci::use(id, "id");
+            soci::statement st = (sql->prepare << "DELETE FROM mb_webhooks WHERE id = :id", soci::use(id, "id"));
+            st.execute(true);
+            if (st.get_affected_rows() == 0) return false;
+            tr.commit();
+        }
+        std::lock_guard lock(m_hooksMutex);
+        m_hooks.reset();
+        return true;
+    }
+
+    void Webhooks::onChanges(const json &events) {
+        if (!m_options.enabled || !events.is_array() || events.empty()) return;
+        {
+            std::lock_guard lock(m_mutex);
+            // Every node sees the stream; only the one delivering keeps it
+            if (m_leads && !m_leads()) return;
+            m_incoming.push_back(events);
+            m_wake = true;
+        }
+        m_cv.notify_all();
+    }
+
+    std::size_t Webhooks::step() {
+        const auto sql = m_connect();
+
+        std::deque<Answer> answers;
+        {
+            std::lock_guard lock(m_mutex);
+            answers.swap(m_answers);
+            if (m_leads && !m_leads()) {
+                // Led elsewhere now; the new leader writes the outbox from here on
+                m_incoming.clear();
+            }
+        }
+        for (const auto &answer: answers) settle(*sql, answer);
+        flush(*sql);
+
+        {
+            std::lock_guard lock(m_mutex);
+            if (m_leads && !m_leads()) return 0;
+        }
+
+        const long long now = nowMs();
+        std::size_t sent = 0;
+        for (const auto &hook: *hooks()) {
+            while (true) {
+                std::size_t skip = 0;
+                {
+                    std::lock_guard lock(m_mutex);
+                    if (m_inFlight[hook.id] >= m_options.concurrency) break;
+                    skip = m_sending.size();
+                }
+
+                // Oldest first, as many rows as fit in a POST; in flight ones are passed over
+                std::vector<std::string> rows;
+                auto events = json::array();
+                {
+                    const int limit = static_cast<int>(m_options.batch + skip);
+                    std::vector<std::tuple<std::string, std::string, std::size_t>> due;
+                    const soci::rowset<soci::row> found = (sql->prepare
+                        << "SELECT id, events, n FROM mb_webhook_outbox WHERE hook = :hook AND due <= :now "
+                           "ORDER BY seq LIMIT :limit",
+                        soci::use(hook.id, "hook"), soci::use(now, "now"), soci::use(limit, "limit"));
+                    for (const auto &row: found)
+                        due.emplace_back(row.get<std::string>(0), row.get<std::string>(1),
+                                         static_cast<std::size_t>(row.get<int>(2)));
+
+                    std::lock_guard lock(m_mutex);
+                    for (const auto &[id, stored, n]: due) {
+                        if (m_sending.contains(id)) continue;
+                        if (!rows.empty() && events.size() + n > m_options.batch) break;
+                        try {
+                            for (auto &event: json::parse(stored)) events.push_back(std::move(event));
+                        } catch (const json::parse_error &) {
+                            // Sent as nothing, so its row goes once the POST is answered
+                            LogOrigin::warn("Webhooks", std::format("Outbox row `{}` is unreadable", id));
+                        }
+                        rows.push_back(id);
+                    }
+                    if (rows.empty()) break;
+                    m_sending.insert(rows.begin(), rows.end());
+                    ++m_inFlight[hook.id];
+                }
+
+                Request request;
+                request.url = hook.url;
+                request.body = json{{"webhook", hook.id}, {"events", std::move(events)}}.dump();
+                request.headers = {{"Content-Type", "application/json"},
+                                   {"X-Mantis-Webhook", hook.id},
+                                   {"X-Mantis-Delivery", generateShortId()}};
+                if (!hook.secret.empty())
+                    request.headers.emplace_back("X-Mantis-Signature", signature(hook.secret, request.body));
+
+                const auto answered = [this, id = hook.id, rows](const int status) {
+                    {
+                        std::lock_guard lock(m_mutex);
+                        m_answers.push_back({id, rows, status});
+                        m_wake = true;
+                    }
+                    m_cv.notify_all();
+                };
+                try {
+                    m_send(request, answered);
+                } catch (const std::exception &e) {
+                    LogOrigin::warn("Webhooks", std::format("Sending to `{}`: {}", hook.url, e.what()));
+                    answered(0);
+                }
+                ++sent;
+            }
+        }
+        return sent;
+    }
+
+    std::size_t Webhooks::pending() const {
+        int count = 0;
+        *m_connect() << "SELECT COUNT(*) FROM mb_webhook_outbox", soci::into(count);
+        return static_cast<std::size_t>(count);
+    }
+
+    std::string Webhooks::signature(const std::string &secret, const std::string &body) {
+        return "sha256=" + toHex(hmacSha256(secret, body));
+    }
+
+    std::chrono::seconds Webhooks::backoff(const std::size_t attempt, const std::chrono::seconds base,
+                                           const std::chrono::seconds max) {
+        if (attempt < 2) return std::chrono::seconds(0);
+        // Past 2^20 times anything, the cap has long won
+        const auto shift = std::min<std::size_t>(attempt - 2, 20);
+        return std::min<std::chrono::seconds>(base * (1LL << shift), max);
+    }
+
+    void Webhooks::writeMetrics(MetricsWriter &out) const {
+        out.family("mb_webhook_deliveries_total", "Webhook outbox rows by how their delivery ended", "counter");
+        out.sample("mb_webhook_deliveries_total", {{"result", "delivered"}},
+                   static_cast<double>(m_delivered.load(std::memory_order_relaxed)));
+        out.sample("mb_webhook_deliveries_total", {{"result", "retried"}},
+                   static_cast<double>(m_failed.load(std::memory_order_relaxed)));
+        out.sample("mb_webhook_deliveries_total", {{"result", "dropped"}},
+                   static_cast<double>(m_dropped.load(std::memory_order_relaxed)));
+        out.family("mb_webhook_events_total", "Change events written to the webhook outbox", "counter");
+        out.sample("mb_webhook_events_total", {}, static_cast<double>(m_events.load(std::memory_order_relaxed)));
+        try {
+            const auto count = pending();
+            out.family("mb_webhook_pending", "Webhook outbox rows waiting for delivery", "gauge");
+            out.sample("mb_webhook_pending", {}, static_cast<double>(count));
+        } catch (const std::exception &) {
+            // No gauge rather than a failed scrape
+        }
+    }
+
+    void Webhooks::loop() {
+        std::unique_lock lock(m_mutex);
+        while (!m_stopping) {
+            lock.unlock();
+            try {
+                step();
+            } catch (const std::exception &e) {
+                LogOrigin::dbWarn("Webhooks", std::format("Delivering webhooks: {}", e.what()));
+            }
+            lock.lock();
+            m_cv.wait_for(lock, TICK, [this] { return m_stopping || m_wake; });
+            m_wake = false;
+        }
+    }
+
+    std::shared_ptr<const std::vector<Webhooks::Hook>> Webhooks::hooks() const {
+        std::lock_guard lock(m_hooksMutex);
+        const auto now = std::chrono::steady_clock::now();
+        if (!m_hooks || now - m_hooksLoaded >= HOOKS_TTL) {
+            m_hooks = std::make_shared<const std::vector<Hook>>(list());
+            m_hooksLoaded = now;
+        }
+        return m_hooks;
+    }
+
+    void Webhooks::flush(soci::session &sql) {
+        std::vector<json> incoming;
+        {
+            std::lock_guard lock(m_mutex);
+            incoming.swap(m_incoming);
+        }
+        if (incoming.empty()) return;
+
+        const auto hooks = this->hooks();
+        if (hooks->empty()) return;
+
+        const long long now = nowMs();
+        std::size_t written = 0;
+        soci::transaction tr(sql);
+        for (const auto &hook: *hooks) {
+            auto chunk = json::array();
+            const auto write = [&] {
+                if (chunk.empty()) return;
+                const auto id = generateShortId();
+                const auto events = chunk.dump();
+                const int n = static_cast<int>(chunk.size());
+                const long long seq = nextSeq();
+                sql << "INSERT INTO mb_webhook_outbox (id, hook, events, n, attempts, due, seq) "
+                       "VALUES (:id, :hook, :events, :n, 0, :due, :seq)",
+                        soci::use(id, "id"), soci::use(hook.id, "hook"), soci::use(events, "events"),
+                        soci::use(n, "n"), soci::use(now, "due"), soci::use(seq, "seq");
+                written += chunk.size();
+                chunk = json::array();
+            };
+            for (const auto &events: incoming) {
+                for (const auto &change: events) {
+                    if (!isChange(change) ||
+                        !hook.matches(change["entity"].get<std::string>(), change["row_id"].get<std::string>()))
+                        continue;
+                    chunk.push_back(payloadOf(change));
+                    if (chunk.size() >= m_options.batch) write();
+                }
+            }
+            write();
+        }
+        tr.commit();
+        m_events += written;
+    }
+
+    void Webhooks::settle(soci::session &sql, const Answer &answer) {
+        {
+            std::lock_guard lock(m_mutex);
+            for (const auto &row: answer.rows) m_sending.erase(row);
+            if (const auto it = m_inFlight.find(answer.hook); it != m_inFlight.end() && --it->second == 0)
+                m_inFlight.erase(it);
+        }
+        if (answer.rows.empty()) return;
+
+        if (answer.status / 100 == 2) {
+            auto ids = bound(answer.rows);
+            sql << std::format("DELETE FROM mb_webhook_outbox WHERE id IN ({})", placeholders(answer.rows.size())),
+                    soci::use(ids);
+            m_delivered += answer.rows.size();
+            return;
+        }
+
+        const long long now = nowMs();
+        soci::transaction tr(sql);
+        for (const auto &id: answer.rows) {
+            int attempts = 0;
+            sql << "SELECT attempts FROM mb_webhook_outbox WHERE id = :id", soci::use(id, "id"), soci::into(attempts);
+            if (!sql.got_data()) continue; // Its webhook was removed meanwhile
+
+            if (const auto made = static_cast<std::size_t>(attempts) + 1; made >= m_options.maxAttempts) {
+                sql << "DELETE FROM mb_webhook_outbox WHERE id = :id", soci::use(id, "id");
+                ++m_dropped;
+                LogOrigin::warn("Webhooks", std::format("Gave up on a delivery to webhook `{}` after {} attempt(s)",
+                                                        answer.hook, made));
+            } else {
+                const long long due = now + std::chrono::duration_cast<std::chrono::milliseconds>(
+                                          backoff(made + 1, m_options.retryBase, m_options.retryMax)).count();
+                const int next = static_cast<int>(made);
+                sql << "UPDATE mb_webhook_outbox SET attempts = :attempts, due = :due WHERE id = :id",
+                        soci::use(next, "attempts"), soci::use(due, "due"), soci::use(id, "id");
+                ++m_failed;
+            }
+        }
+        tr.commit();
+    }
+}
@@ -0,0 +1,55 @@
+#include "../../include/mantisbase/core/webhooks.h"
+#include "../../include/mantisbase/core/oauth_client.h"
+
+#include <drogon/HttpClient.h>
+#include <trantor/net/EventLoopThread.h>
+
+#include <unordered_map>
+
+namespace mb {
+    namespace {
+        /// An event loop of the webhooks' own, and a client per endpoint origin on it
+        struct ClientPool {
+            std::unique_ptr<trantor::EventLoopThread> loop = std::make_unique<trantor::EventLoopThread>("mb-webhooks");
+            std::mutex mutex;
+            std::unordered_map<std::string, drogon::HttpClientPtr> clients; ///> Guarded by mutex
+
+            ClientPool() { loop->run(); }
+
+            ~ClientPool() {
+                // Clients belong to the loop; drop them before it stops
+                std::lock_guard lock(mutex);
+                clients.clear();
+            }
+
+            drogon::HttpClientPtr clientFor(const std::string &origin) {
+                std::lock_guard lock(mutex);
+                auto &client = clients[origin];
+                if (!client) client = drogon::HttpClient::newHttpClient(origin, loop->getLoop());
+                return client;
+            }
+        };
+    }
+
+    Webhooks::Send Webhooks::httpSender(const double timeout) {
+        auto pool = std::make_shared<ClientPool>();
+        return [pool, timeout](const Request &request, Done done) {
+            // Validated when the webhook was made; keep-alive on the origin's client carries the next POST too
+            const auto [origin, path] = OAuthClient::splitUrl(request.url);
+
+            const auto req = drogon::HttpRequest::newHttpRequest();
+            req->setMethod(drogon::Post);
+            req->setPathEncode(false);
+            req->setPath(path);
+            req->setContentTypeString("application/json");
+            for (const auto &[name, value]: request.headers)
+                if (name != "Content-Type") req->addHeader(name, value);
+            req->setBody(request.body);
+
+            pool->clientFor(origin)->sendRequest(req, [done = std::move(done)](const drogon::ReqResult result,
+                                                                               const drogon::HttpResponsePtr &resp) {
+                done(result == drogon::ReqResult::Ok && resp ? static_cast<int>(resp->statusCode()) : 0);
+            }, timeout);
+        };
+    }
+}
@@ -0,0 +1,172 @@
+/**
+ * @file wire_format.cpp
+ * @brief Implementation for @see wire_format.h
+ */
+
+#include "../../include/mantisbase/core/wire_format.h"
+#include "../../include/mantisbase/utils/json_parse.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+
+namespace mb {
+    namespace {
+        std::string_view trimmed(std::string_view s) {
+            while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front()))) s.remove_prefix(1);
+            while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back()))) s.remove_suffix(1);
+            return s;
+        }
+
+        bool equalsIgnoreCase(const std::string_view a, const std::string_view b) {
+            return std::ranges::equal(a, b, [](const char x, const char y) {
+                return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+            });
+        }
+
+        /// The media type of a header item, without its parameters
+        std::string_view bareType(const std::string_view item) {
+            return trimmed(item.substr(0, item.find(';')));
+        }
+
+        std::optional<WireFormat::Format> formatOf(const std::string_view type) {
+            if (equalsIgnoreCase(type, "application/json")) return WireFormat::Format::Json;
+            if (equalsIgnoreCase(type, "application/msgpack") || equalsIgnoreCase(type, "application/x-msgpack"))
+                return WireFormat::Format::MsgPack;
+            if (equalsIgnoreCase(type, "application/cbor")) return WireFormat::Format::Cbor;
+            return std::nullopt;
+        }
+
+        /// `q` of an Accept item in thousandths; 1000 if absent
+        int qualityOf(const std::string_view item) {
+            auto params = item;
+            while (true) {
+                const auto semi = params.find(';');
+                if (semi == std::string_view::npos) return 1000;
+                params.remove_prefix(semi + 1);
+                const auto param = trimmed(params.substr(0, params.find(';')));
+                if (param.size() < 2 || std::tolower(static_cast<unsigned char>(param[0])) != 'q' || param[1] != '=')
+                    continue;
+
+                double q = 1.0;
+                const auto value = param.substr(2);
+                if (std::from_chars(value.data(), value.data() + value.size(), q).ec != std::errc{}) return 1000;
+                return static_cast<int>(std::clamp(q, 0.0, 1.0) * 1000);
+            }
+        }
+
+        std::string base64(const std::string_view bytes) {
+            static constexpr char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            std::string out;
+            out.reserve((bytes.size() + 2) / 3 * 4);
+
+            std::size_t i = 0;
+            for (; i + 2 < bytes.size(); i += 3) {
+                const auto n = static_cast<unsigned char>(bytes[i]) << 16 |
+                               static_cast<unsigned char>(bytes[i + 1]) << 8 |
+                               static_cast<unsigned char>(bytes[i + 2]);
+                out += ALPHABET[n >> 18 & 63];
+                out += ALPHABET[n >> 12 & 63];
+                out += ALPHABET[n >> 6 & 63];
+                out += ALPHABET[n & 63];
+            }
+            if (const auto rest = bytes.size() - i; rest > 0) {
+                auto n = static_cast<unsigned char>(bytes[i]) << 16;
+                if (rest == 2) n |= static_cast<unsigned char>(bytes[i + 1]) << 8;
+                out += ALPHABET[n >> 18 & 63];
+                out += ALPHABET[n >> 12 & 63];
+                out += rest == 2 ? ALPHABET[n >> 6 & 63] : '=';
+                out += '=';
+            }
+            return out;
+        }
+    }
+
+    WireFormat::Format WireFormat::negotiate(const std::string_view accept) {
+        auto best = Format::Json;
+        int best_q = -1;
+
+        std::size_t start = 0;
+        while (start <= accept.size()) {
+            const auto comma = accept.find(',', start);
+            const auto item = accept.substr(start, comma == std::string_view::npos ? std::string_view::npos
+                                                                                     : comma - start);
+            if (const auto format = formatOf(bareType(item))) {
+                // Strictly greater: ties go to the first listed
+                if (const auto q = qualityOf(item); q > 0 && q > best_q) {
+                    best = *format;
+                    best_q = q;
+                }
+            }
+            if (comma == std::string_view::npos) break;
+            start = comma + 1;
+        }
+        return best;
+    }
+
+    std::optional<WireFormat::Format> WireFormat::fromName(const std::string_view name) {
+        const auto n = trimmed(name);
+        if (equalsIgnoreCase(n, "json")) return Format::Json;
+        if (equalsIgnoreCase(n, "msgpack")) return Format::MsgPack;
+        if (equalsIgnoreCase(n, "cbor")) return Format::Cbor;
+        return std::nullopt;
+    }
+
+    std::optional<WireFormat::Format> WireFormat::fromMediaType(const std::string_view content_type) {
+        return formatOf(bareType(content_type));
+    }
+
+    std::string_view WireFormat::mediaType(const Format format) {
+        switch (format) {
+            case Format::MsgPack: return "application/msgpack";
+            case Format::Cbor: return "application/cbor";
+            default: return "application/json";
+        }
+    }
+
+    std::string_view WireFormat::name(const Format format) {
+        switch (format) {
+            case Format::MsgPack: return "msgpack";
+            case Format::Cbor: return "cbor";
+            default: return "json";
+        }
+    }
+
+    namespace {
+        template<typename Json>
+        std::string encodeAs(const WireFormat::Format format, const Json &value) {
+            std::string out;
+            switch (format) {
+                case WireFormat::Format::MsgPack:
+                    Json::to_msgpack(value, nlohmann::detail::output_adapter<char>(out));
+                    return out;
+                case WireFormat::Format::Cbor:
+                    Json::to_cbor(value, nlohmann::detail::output_adapter<char>(out));
+                    return out;
+                default:
+                    return value.dump();
+            }
+        }
+    }
+
+    std::string WireFormat::encode(const Format format, const nlohmann::json &value) {
+        return encodeAs(format, value);
+    }
+
+    std::string WireFormat::encode(const Format format, const ArenaJson &value) {
+        return encodeAs(format, value);
+    }
+
+    std::string WireFormat::encodeText(const Format format, const nlohmann::json &value) {
+        if (format == Format::Json) return value.dump();
+        return base64(encode(format, value));
+    }
+
+    nlohmann::json WireFormat::decode(const Format format, const std::string_view bytes) {
+        switch (format) {
+            case Format::MsgPack: return nlohmann::json::from_msgpack(bytes.begin(), bytes.end());
+            case Format::Cbor: return nlohmann::json::from_cbor(bytes.begin(), bytes.end());
+            default: return parseJson(bytes);
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#include "../../include/mantisbase/core/worker_pool.h"
+#include "../../include/mantisbase/core/logger/logger.h"
+
+namespace mb {
+    WorkerPool::WorkerPool(std::string name) : m_name(std::move(name)) {}
+
+    WorkerPool::~WorkerPool() {
+        stop();
+    }
+
+    void WorkerPool::start(const size_t threads, const ThreadInit &init) {
+        std::lock_guard lock(m_mutex);
+        if (m_running.load()) return;
+
+        m_running.store(true);
+        const auto count = threads == 0 ? 1 : threads;
+        m_threads.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+            m_threads.emplace_back([this, init, i] {
+                if (init) init(i);
+                workerLoop();
+            });
+
+        LogOrigin::info("Worker Pool", fmt::format("Started `{}` worker pool with {} thread(s)", m_name, count));
+    }
+
+    void WorkerPool::stop() {
+        {
+            std::lock_guard lock(m_mutex);
+            if (!m_running.load()) return;
+            m_running.store(false);
+        }
+        m_cv.notify_all();
+
+        for (auto &t: m_threads)
+            if (t.joinable()) t.join();
+        m_threads.clear();
+    }
+
+    bool WorkerPool::submit(std::function<void()> task, const bool urgent) {
+        {
+            std::lock_guard lock(m_mutex);
+            if (!m_running.load()) return false;
+            if (urgent) m_tasks.push_front(std::move(task));
+            else m_tasks.push_back(std::move(task));
+        }
+        m_cv.notify_one();
+        return true;
+    }
+
+    size_t WorkerPool::size() const {
+        std::lock_guard lock(m_mutex);
+        return m_threads.size();
+    }
+
+    size_t WorkerPool::pending() const {
+        std::lock_guard lock(m_mutex);
+        return m_tasks.size();
+    }
+
+    void WorkerPool::workerLoop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(m_mutex);
+                m_cv.wait(lock, [this] { return !m_tasks.empty() || !m_running.load(); });
+
+                // Drain the queue before exiting so no accepted request is dropped
+                if (m_tasks.empty()) return;
+
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+
+            try {
+                task();
+            } catch (const std::exception &e) {
+                LogOrigin::critical("Worker Pool", fmt::format("Unhandled error in `{}` worker: {}", m_name, e.what()));
+            } catch (...) {
+                LogOrigin::critical("Worker Pool", fmt::format("Unhandled unknown error in `{}` worker", m_name));
+            }
+        }
+    }
+}
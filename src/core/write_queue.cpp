@@ -0,0 +1,166 @@
+#include "../../include/mantisbase/core/write_queue.h"
+#include "../../include/mantisbase/core/sqlite_change_hooks.h"
+#include "../../include/mantisbase/core/request_deadline.h"
+#include "../../include/mantisbase/utils/utils.h"
+
+#include <algorithm>
+#include <vector>
+#include <soci/soci.h>
+
+namespace mb {
+    WriteQueue::Options WriteQueue::Options::fromEnv() {
+        Options options;
+        if (const auto ms = safe_stoi(getEnvOrDefault("MB_SQLITE_GROUP_COMMIT_MS", ""), -1); ms >= 0)
+            options.window = std::chrono::milliseconds(ms);
+        if (const auto max = safe_stoi(getEnvOrDefault("MB_SQLITE_GROUP_COMMIT_MAX", ""), 0); max > 0)
+            options.maxGroup = static_cast<std::size_t>(max);
+        return options;
+    }
+
+    WriteQueue::WriteQueue(Lease lease, const Options options)
+        : m_lease(std::move(lease)), m_options(options) {
+        m_options.maxGroup = std::max<std::size_t>(m_options.maxGroup, 1);
+    }
+
+    WriteQueue::~WriteQueue() {
+        stop();
+    }
+
+    void WriteQueue::start() {
+        std::lock_guard lock(m_mutex);
+        if (m_thread.joinable()) return;
+        m_stopping = false;
+        m_thread = std::thread(&WriteQueue::loop, this);
+    }
+
+    void WriteQueue::stop() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable() && !onWriterThread()) m_thread.join();
+    }
+
+    void WriteQueue::run(Job job) {
+        // A job that writes again, or a write with no writer thread to hand it
+        // to, runs right here on the (recursively leased) writer session
+        bool inline_run = onWriterThread();
+        std::future<void> done;
+        if (!inline_run) {
+            std::lock_guard lock(m_mutex);
+            if (m_stopping || !m_thread.joinable()) {
+                inline_run = true;
+            } else {
+                m_queue.push_back({std::move(job), {}});
+                done = m_queue.back().done.get_future();
+            }
+        }
+
+        if (inline_run) {
+            runNested(*m_lease(), job);
+            return;
+        }
+
+        m_cv.notify_one();
+        done.get();
+    }
+
+    void WriteQueue::runNested(soci::session &sql, const Job &job) {
+        // Change hooks buffer rows outside SQLite; a rolled back job's are dropped
+        const auto captured = SqliteChangeHooks::mark(sql);
+        sql << "SAVEPOINT mb_write_nested";
+        try {
+            job(sql);
+            sql << "RELEASE mb_write_nested";
+        } catch (...) {
+            // Undone even when the request's deadline is what failed the job
+            const RequestDeadline::Scope unbounded(nullptr);
+            sql << "ROLLBACK TO mb_write_nested";
+            sql << "RELEASE mb_write_nested";
+            SqliteChangeHooks::rewind(sql, captured);
+            throw;
+        }
+    }
+
+    bool WriteQueue::onWriterThread() const {
+        return m_thread.get_id() == std::this_thread::get_id();
+    }
+
+    WriteQueue::Stats WriteQueue::stats() const {
+        std::lock_guard lock(m_mutex);
+        return {m_jobs, m_failed, m_groups, m_queue.size()};
+    }
+
+    void WriteQueue::loop() {
+        while (true) {
+            std::deque<Pending> group;
+            {
+                std::unique_lock lock(m_mutex);
+                m_cv.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+                if (m_queue.empty()) return; // Stopping, and everything queued has run
+
+                // Give concurrent writers a moment to join this commit
+                if (m_options.window.count() > 0 && !m_stopping)
+                    m_cv.wait_until(lock, std::chrono::steady_clock::now() + m_options.window, [this] {
+                        return m_stopping || m_queue.size() >= m_options.maxGroup;
+                    });
+
+                const auto take = static_cast<std::ptrdiff_t>(std::min(m_queue.size(), m_options.maxGroup));
+                std::move(m_queue.begin(), m_queue.begin() + take, std::back_inserter(group));
+                m_queue.erase(m_queue.begin(), m_queue.begin() + take);
+            }
+            commitGroup(group);
+        }
+    }
+
+    void WriteQueue::commitGroup(std::deque<Pending> &group) {
+        std::vector<std::exception_ptr> errors(group.size());
+        bool committed = false;
+
+        std::shared_ptr<soci::session> sql;
+        try {
+            sql = m_lease();
+            sql->begin();
+            for (std::size_t i = 0; i < group.size(); ++i) {
+                const auto captured = SqliteChangeHooks::mark(*sql);
+                *sql << "SAVEPOINT mb_write";
+                try {
+                    group[i].job(*sql);
+                    *sql << "RELEASE mb_write";
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                    *sql << "ROLLBACK TO mb_write";
+                    *sql << "RELEASE mb_write";
+                    SqliteChangeHooks::rewind(*sql, captured);
+                }
+            }
+            sql->commit();
+            committed = true;
+        } catch (...) {
+            // The group's transaction itself failed; none of it was written
+            const auto error = std::current_exception();
+            if (sql) {
+                try { sql->rollback(); } catch (...) {}
+            }
+            for (auto &e: errors)
+                if (!e) e = error;
+        }
+        sql.reset(); // Release the writer before waking the callers
+
+        const auto failed = static_cast<std::uint64_t>(std::ranges::count_if(errors, [](const auto &e) {
+            return e != nullptr;
+        }));
+        {
+            std::lock_guard lock(m_mutex);
+            m_jobs += group.size();
+            m_failed += failed;
+            if (committed) ++m_groups;
+        }
+
+        for (std::size_t i = 0; i < group.size(); ++i) {
+            if (errors[i]) group[i].done.set_exception(errors[i]);
+            else group[i].done.set_value();
+        }
+    }
+}
@@ -1,12 +1,28 @@
 #include "../include/mantisbase/mantis.h"
 #include "../include/mantisbase/config.hpp"
 #include "../include/mantisbase/core/models/entity.h"
+#include "../include/mantisbase/core/models/entity_shards.h"
 #include "../include/mantisbase/core/kv_store.h"
 #include "../include/mantisbase/core/realtime.h"
+#include "../include/mantisbase/core/blob_store.h"
+#include "../include/mantisbase/core/storage.h"
+#include "../include/mantisbase/core/file_cleanup.h"
+#include "../include/mantisbase/core/session_store.h"
+#include "../include/mantisbase/core/app_kv.h"
+#include "../include/mantisbase/core/schema_migrations.h"
+#include "../include/mantisbase/core/index_advisor.h"
+#include "../include/mantisbase/core/slow_query_log.h"
+#include "../include/mantisbase/core/materialized_views.h"
+#include "../include/mantisbase/core/realtime_probe.h"
+#include "../include/mantisbase/core/tenants.h"
+#include "../include/mantisbase/core/scheduler.h"
+#include "../include/mantisbase/core/thread_placement.h"
 
 #include <cmrc/cmrc.hpp>
+#include <chrono>
 #include <fstream>
 #include <memory>
+#include <thread>
 
 namespace mb {
     MantisBase::MantisBase()
@@ -23,10 +39,7 @@ namespace mb {
         // }
 
 #ifdef MB_SCRIPTING_ENABLED
-        if (m_dukCtx) {
-            duk_destroy_heap(m_dukCtx);
-            m_dukCtx = nullptr;
-        }
+        m_scripts.reset();
 #endif
 
         // std::cout << "Exiting ~MantisBase()" << std::endl;
@@ -45,6 +58,9 @@ namespace mb {
             }
         }
 
+        // Ahead of any thread of ours, so the housekeeping threads inherit MB_CPU_BACKGROUND
+        ThreadPlacement::instance().pin(ThreadPlacement::Role::Background);
+
         parseArgs(); // Parse args & start units
 
 #ifdef MB_SCRIPTING_ENABLED
@@ -99,6 +115,13 @@ namespace mb {
                                         : config.at("connection").get<std::string>());
         }
 
+        if (config.contains("db_replica_urls") && config.at("db_replica_urls").is_array()) {
+            for (const auto &url: config.at("db_replica_urls")) {
+                app.m_cmdArgs.emplace_back("--db-replica-url");
+                app.m_cmdArgs.push_back(url.get<std::string>());
+            }
+        }
+
         if (config.contains("dataDir") || config.contains("data-dir")) {
             app.m_cmdArgs.emplace_back("--data-dir");
             app.m_cmdArgs.push_back(config.contains("data-dir")
@@ -150,6 +173,34 @@ namespace mb {
                     app.m_cmdArgs.emplace_back("--skip-admin-setup");
                 }
 
+                if (serve.contains("db-workers")) {
+                    app.m_cmdArgs.emplace_back("--db-workers");
+                    app.m_cmdArgs.push_back(std::to_string(serve.at("db-workers").get<int>()));
+                }
+
+                if (serve.contains("threads")) {
+                    app.m_cmdArgs.emplace_back("--threads");
+                    app.m_cmdArgs.push_back(std::to_string(serve.at("threads").get<int>()));
+                }
+
+                if (serve.contains("reuse-port") && serve.at("reuse-port").get<bool>()) {
+                    app.m_cmdArgs.emplace_back("--reuse-port");
+                }
+
+                for (const auto *key: {"idle-timeout", "keepalive-requests", "max-connections", "max-connections-per-ip"}) {
+                    if (serve.contains(key)) {
+                        app.m_cmdArgs.push_back(std::string("--") + key);
+                        app.m_cmdArgs.push_back(std::to_string(serve.at(key).get<int>()));
+                    }
+                }
+
+                for (const auto *key: {"tls-cert", "tls-key"}) {
+                    if (serve.contains(key)) {
+                        app.m_cmdArgs.push_back(std::string("--") + key);
+                        app.m_cmdArgs.push_back(serve.at(key).get<std::string>());
+                    }
+                }
+
                 if (serve.contains("pool-size") || serve.contains("poolSize")) {
                     app.m_cmdArgs.emplace_back("--pool-size");
                     app.m_cmdArgs.push_back(std::to_string(serve.contains("pool-size")
@@ -232,6 +283,25 @@ namespace mb {
         m_realtime = std::make_unique<RealtimeDB>(*this); // depends on db()
         m_router = std::make_unique<Router>(*this); // depends on db() & http()
         m_kvStore = std::make_unique<KeyValStore>(*this); // depends on db(), router() & http()
+        m_storage = std::make_unique<Storage>(Storage::backendFromEnv(), // removals depend on db()
+                                              [](const std::string &sha256) {
+                                                  return BlobStore::dropIfUnreferenced(sha256);
+                                              });
+        m_fileCleanup = std::make_unique<FileCleanup>(FileCleanup::Options::fromEnv()); // depends on db() & storage()
+        m_sessionStore = std::make_unique<SessionStore>(SessionStore::Options::fromEnv()); // depends on db()
+        m_appKv = std::make_unique<AppKv>(AppKv::Options::fromEnv()); // depends on db()
+        m_schemaMigrations = std::make_unique<SchemaMigrations>(SchemaMigrations::Options::fromEnv()); // depends on db() & router()
+        m_indexAdvisor = std::make_unique<IndexAdvisor>(IndexAdvisor::Options::fromEnv()); // depends on db() & router()
+        m_slowQueryLog = std::make_unique<SlowQueryLog>(SlowQueryLog::Options::fromEnv(), // depends on db() & logs()
+                                                        [this](const std::string &sql) { return db().explain(sql); },
+                                                        [this](const json &entry) {
+                                                            logs().logsDb().insertSlowQuery(entry);
+                                                        });
+        m_materializedViews = std::make_unique<MaterializedViews>(MaterializedViews::Options::fromEnv()); // depends on db(), rt() & router()
+        m_realtimeProbe = std::make_unique<RealtimeProbe>(RealtimeProbe::Options::fromEnv()); // depends on db(), rt() & router()
+        m_tenants = std::make_unique<Tenants>(*this, Tenants::Options::fromEnv()); // depends on db() & router()
+        m_shards = std::make_unique<EntityShards>(*this, EntityShards::Options::fromEnv()); // depends on db()
+        m_scheduler = std::make_unique<Scheduler>(Scheduler::Options::fromEnv()); // leases depend on db()
         m_opts = std::make_unique<argparse::ArgumentParser>();
     }
 
@@ -254,6 +324,16 @@ namespace mb {
 
         LogOrigin::trace("MantisBase", "Closing units");
         try {
+            if (m_scheduler) {
+                // Running jobs finish while the units they use are still up
+                m_scheduler->stop();
+            }
+
+            if (m_realtimeProbe) {
+                // Its session goes while the realtime managers are still up
+                m_realtimeProbe->stop();
+            }
+
             if (m_router && m_router->isRunning()) {
                 m_router->close();
                 LogOrigin::trace("Router", "Router stopped");
@@ -264,6 +344,56 @@ namespace mb {
                 // LogOrigin::trace("KV Store Shutdown", "[MB] Finished KV Store closing ...");
             }
 
+            if (m_fileCleanup) {
+                // Whatever is still queued is drained on the next start
+                m_fileCleanup->stop();
+            }
+
+            if (m_sessionStore) {
+                // Writes the sessions still queued
+                m_sessionStore->stop();
+            }
+
+            if (m_appKv) {
+                // Writes the pairs changed since the last flush
+                m_appKv->stop();
+            }
+
+            if (m_schemaMigrations) {
+                // A migration in progress resumes after its last batch on the next start
+                m_schemaMigrations->stop();
+            }
+
+            if (m_indexAdvisor) {
+                // An index being built CONCURRENTLY finishes first
+                m_indexAdvisor->stop();
+            }
+
+            if (m_slowQueryLog) {
+                // Writes the slow queries still queued
+                m_slowQueryLog->stop();
+            }
+
+            if (m_materializedViews) {
+                // Every view is refreshed in full on the next start
+                m_materializedViews->stop();
+            }
+
+            if (m_tenants) {
+                // Requests still running hold on to their tenant's database
+                m_tenants->closeAll();
+            }
+
+            if (m_shards) {
+                // Like the tenants', held by the requests still on them
+                m_shards->closeAll();
+            }
+
+            if (m_storage) {
+                // Finish queued blob removals while the database is still up
+                m_storage->close();
+            }
+
             if (m_database && m_database->isConnected()) {
                 m_database->disconnect();
                 LogOrigin::trace("Db Shutdown", "Completed Successfully!");
@@ -320,6 +450,12 @@ namespace mb {
     }
 
     Database &MantisBase::db() const {
+        if (auto *shard = EntityShards::current()) return *shard;
+        if (const auto *tenant = Tenants::current()) return *tenant->db;
+        return *m_database;
+    }
+
+    Database &MantisBase::rootDb() const {
         return *m_database;
     }
 
@@ -342,6 +478,54 @@ namespace mb {
         return *m_realtime;
     }
 
+    Storage &MantisBase::storage() const {
+        return *m_storage;
+    }
+
+    FileCleanup &MantisBase::fileCleanup() const {
+        return *m_fileCleanup;
+    }
+
+    SessionStore &MantisBase::sessionStore() const {
+        return *m_sessionStore;
+    }
+
+    AppKv &MantisBase::kv() const {
+        return *m_appKv;
+    }
+
+    SchemaMigrations &MantisBase::schemaMigrations() const {
+        return *m_schemaMigrations;
+    }
+
+    IndexAdvisor &MantisBase::indexAdvisor() const {
+        return *m_indexAdvisor;
+    }
+
+    SlowQueryLog &MantisBase::slowQueryLog() const {
+        return *m_slowQueryLog;
+    }
+
+    MaterializedViews &MantisBase::materializedViews() const {
+        return *m_materializedViews;
+    }
+
+    RealtimeProbe &MantisBase::realtimeProbe() const {
+        return *m_realtimeProbe;
+    }
+
+    Tenants &MantisBase::tenants() const {
+        return *m_tenants;
+    }
+
+    EntityShards &MantisBase::shards() const {
+        return *m_shards;
+    }
+
+    Scheduler &MantisBase::scheduler() const {
+        return *m_scheduler;
+    }
+
     Entity MantisBase::entity(const std::string &entity_name) const {
         if (!EntitySchema::isValidEntityName(entity_name))
             throw MantisException(400,
@@ -352,13 +536,42 @@ namespace mb {
         return entity_obj;
     }
 
+    std::shared_ptr<const Entity> MantisBase::entitySnapshot(const std::string &entity_name) const {
+        if (!EntitySchema::isValidEntityName(entity_name))
+            throw MantisException(400,
+                                  std::format("Invalid entity name `{}` provided.", entity_name));
+
+        return m_router->entitySnapshot(entity_name);
+    }
+
     bool MantisBase::hasEntity(const std::string &entity_name) const {
         return m_router->hasSchemaCache(entity_name);
     }
 
 #ifdef MB_SCRIPTING_ENABLED
     duk_context *MantisBase::ctx() const {
-        return m_dukCtx;
+        return m_scripts ? m_scripts->current() : nullptr;
+    }
+
+    const ScriptHeaps::Budgets &MantisBase::scriptBudgets() const {
+        static const ScriptHeaps::Budgets none;
+        return m_scripts ? m_scripts->budgets() : none;
+    }
+
+    std::size_t MantisBase::reloadScripts() const {
+        if (!m_scripts) throw MantisException(404, "Scripting is not available");
+
+        const auto start = std::chrono::steady_clock::now();
+        const auto loaded = m_scripts->reload([this] { loadStartScript(); });
+        m_router->scriptsReloaded();
+        LogOrigin::info("Scripts", fmt::format("Reloaded {} scripts in {}ms", loaded,
+                                               std::chrono::duration_cast<std::chrono::milliseconds>(
+                                                   std::chrono::steady_clock::now() - start).count()));
+        return loaded;
+    }
+
+    void MantisBase::scriptsCheckpoint() const {
+        if (m_scripts) m_scripts->checkpoint();
     }
 #endif
 
@@ -496,6 +709,81 @@ namespace mb {
         m_poolSize = pool_size;
     }
 
+    int MantisBase::dbWorkers() const {
+        if (const auto env = safe_stoi(getEnvOrDefault("MB_DB_WORKERS", ""), 0); env > 0)
+            return env;
+        return m_dbWorkers > 0 ? m_dbWorkers : m_poolSize;
+    }
+
+    void MantisBase::setDbWorkers(const int &workers) {
+        if (workers <= 0)
+            return;
+
+        m_dbWorkers = workers;
+    }
+
+    std::vector<std::string> MantisBase::dbReplicaUrls() const {
+        if (const auto env = getEnvOrDefault("MB_DATABASE_REPLICA_URLS", ""); !env.empty()) {
+            std::vector<std::string> urls;
+            for (const auto &part: splitString(env, ";"))
+                if (auto url = trim(part); !url.empty()) urls.push_back(std::move(url));
+            return urls;
+        }
+        return m_dbReplicaUrls;
+    }
+
+    void MantisBase::setDbReplicaUrls(const std::vector<std::string> &urls) {
+        m_dbReplicaUrls = urls;
+    }
+
+    int MantisBase::httpThreads() const {
+        int threads = m_httpThreads;
+        if (const auto env = getEnvOrDefault("MB_HTTP_THREADS", ""); !env.empty())
+            threads = safe_stoi(env, threads);
+
+        if (threads <= 0)
+            threads = static_cast<int>(std::thread::hardware_concurrency());
+
+        return threads > 0 ? threads : 1;
+    }
+
+    void MantisBase::setHttpThreads(const int &threads) {
+        if (threads < 0)
+            return;
+
+        m_httpThreads = threads;
+    }
+
+    bool MantisBase::reusePort() const {
+        if (m_reusePort)
+            return true;
+
+        return getEnvOrDefault("MB_HTTP_REUSE_PORT", "0") == "1";
+    }
+
+    void MantisBase::setReusePort(const bool reuse) {
+        m_reusePort = reuse;
+    }
+
+    ListenerOptions MantisBase::listenerOptions() const {
+        ListenerOptions options;
+        if (m_kvStore) {
+            // A bad stored value must not keep the server from starting
+            try {
+                options.merge(m_kvStore->snapshot()->values.value("http", json::object()));
+            } catch (const MantisException &e) {
+                LogOrigin::warn("HTTP Listener", fmt::format("Ignoring the `http` setting: {}", e.what()));
+            }
+        }
+        options.merge(m_listenerFlags);
+        options.mergeEnv();
+        return options;
+    }
+
+    void MantisBase::setListenerFlags(const json &flags) {
+        m_listenerFlags = flags;
+    }
+
     std::string MantisBase::publicDir() const {
         return m_publicDir;
     }
@@ -570,33 +858,37 @@ namespace mb {
 
 #ifdef MB_SCRIPTING_ENABLED
     void MantisBase::initJSEngine() {
-        m_dukCtx = duk_create_heap_default();
-        if (!m_dukCtx) {
-            LogOrigin::critical("Scripting", "Failed to create Duktape heap");
-            return;
-        }
+        // Heaps are made per thread on first use; this one runs the start script
+        m_scripts = std::make_unique<ScriptHeaps>([this](duk_context *ctx) { registerJSBindings(ctx); },
+                                                  fs::path(resolvePath(m_dataDir)) / "scripts-cache",
+                                                  ScriptHeaps::Budgets::fromEnv());
+        if (!m_scripts->current()) m_scripts.reset();
+    }
 
-        dukglue_register_global(m_dukCtx, this, "app");
+    void MantisBase::registerJSBindings(duk_context *ctx) {
+        dukglue_register_global(ctx, this, "app");
 
         // Properties
-        dukglue_register_property(m_dukCtx, &MantisBase::host, &MantisBase::setHost, "host");
-        dukglue_register_property(m_dukCtx, &MantisBase::port, &MantisBase::setPort, "port");
-        dukglue_register_property(m_dukCtx, &MantisBase::poolSize, &MantisBase::setPoolSize, "poolSize");
-        dukglue_register_property(m_dukCtx, &MantisBase::publicDir, &MantisBase::setPublicDir, "publicDir");
-        dukglue_register_property(m_dukCtx, &MantisBase::dataDir, &MantisBase::setDataDir, "dataDir");
-        dukglue_register_property(m_dukCtx, &MantisBase::isDevMode, nullptr, "devMode");
-        dukglue_register_property(m_dukCtx, &MantisBase::dbType, nullptr, "dbType");
-        dukglue_register_property(m_dukCtx, &MantisBase::jwtSecretKey_JSWrapper, nullptr, "secretKey");
-        dukglue_register_property(m_dukCtx, &MantisBase::version_JSWrapper, nullptr, "version");
+        dukglue_register_property(ctx, &MantisBase::host, &MantisBase::setHost, "host");
+        dukglue_register_property(ctx, &MantisBase::port, &MantisBase::setPort, "port");
+        dukglue_register_property(ctx, &MantisBase::poolSize, &MantisBase::setPoolSize, "poolSize");
+        dukglue_register_property(ctx, &MantisBase::publicDir, &MantisBase::setPublicDir, "publicDir");
+        dukglue_register_property(ctx, &MantisBase::dataDir, &MantisBase::setDataDir, "dataDir");
+        dukglue_register_property(ctx, &MantisBase::isDevMode, nullptr, "devMode");
+        dukglue_register_property(ctx, &MantisBase::dbType, nullptr, "dbType");
+        dukglue_register_property(ctx, &MantisBase::jwtSecretKey_JSWrapper, nullptr, "secretKey");
+        dukglue_register_property(ctx, &MantisBase::version_JSWrapper, nullptr, "version");
 
         // `app.close()`
-        dukglue_register_method(m_dukCtx, &MantisBase::close, "close");
+        dukglue_register_method(ctx, &MantisBase::close, "close");
         // `app.quit(1, "Just crashed?")`
-        dukglue_register_method(m_dukCtx, &MantisBase::quit_JSWrapper, "quit");
+        dukglue_register_method(ctx, &MantisBase::quit_JSWrapper, "quit");
         // `app.db()`
-        dukglue_register_method(m_dukCtx, &MantisBase::duk_db, "db");
+        dukglue_register_method(ctx, &MantisBase::duk_db, "db");
         // `app.router()`
-        dukglue_register_method(m_dukCtx, &MantisBase::duk_router, "router");
+        dukglue_register_method(ctx, &MantisBase::duk_router, "router");
+        // `app.kv()`
+        dukglue_register_method(ctx, &MantisBase::duk_kv, "kv");
 
         MantisRequest::registerDuktapeMethods();
         MantisResponse::registerDuktapeMethods();
@@ -605,18 +897,18 @@ namespace mb {
         // Register `console` object
         // ---------------------------------------------- //
         // Create console object and register methods
-        duk_push_object(m_dukCtx);
+        duk_push_object(ctx);
 
-        duk_push_c_function(m_dukCtx, &DuktapeImpl::nativeConsoleInfo, DUK_VARARGS);
-        duk_put_prop_string(m_dukCtx, -2, "info");
+        duk_push_c_function(ctx, &DuktapeImpl::nativeConsoleInfo, DUK_VARARGS);
+        duk_put_prop_string(ctx, -2, "info");
 
-        duk_push_c_function(m_dukCtx, &DuktapeImpl::nativeConsoleTrace, DUK_VARARGS);
-        duk_put_prop_string(m_dukCtx, -2, "trace");
+        duk_push_c_function(ctx, &DuktapeImpl::nativeConsoleTrace, DUK_VARARGS);
+        duk_put_prop_string(ctx, -2, "trace");
 
-        duk_push_c_function(m_dukCtx, &DuktapeImpl::nativeConsoleInfo, DUK_VARARGS);
-        duk_put_prop_string(m_dukCtx, -2, "log");
+        duk_push_c_function(ctx, &DuktapeImpl::nativeConsoleInfo, DUK_VARARGS);
+        duk_put_prop_string(ctx, -2, "log");
 
-        duk_put_global_string(m_dukCtx, "console");
+        duk_put_global_string(ctx, "console");
 
         // UTILS methods
         registerUtilsToDuktapeEngine();
@@ -624,6 +916,9 @@ namespace mb {
         // DATABASE methods
         Database::registerDuktapeMethods();
 
+        // KEY-VALUE methods
+        AppKv::registerDuktapeMethods();
+
         // TODO: Router::registerDuktapeMethods() — not yet ported to Drogon
     }
 
@@ -634,6 +929,8 @@ namespace mb {
     }
 
     void MantisBase::loadAndExecuteScript(const std::string &filePath) const {
+        if (!m_scripts) return;
+
         if (!fs::exists(fs::path(filePath))) {
             LogOrigin::trace("File Execution",
                              fmt::format("Executing a file that does not exist, path `{}`", filePath));
@@ -646,12 +943,16 @@ namespace mb {
         buffer << file.rdbuf();
         std::string scriptContent = buffer.str();
 
+        const auto start = std::chrono::steady_clock::now();
         try {
-            dukglue_peval<void>(m_dukCtx, scriptContent.c_str());
-        } catch (const DukErrorException &e) {
+            m_scripts->load(filePath, scriptContent);
+        } catch (const MantisException &e) {
             LogOrigin::critical("File Load Error",
                                 fmt::format("Error loading file at {} \n\tError: {}", filePath, e.what()));
         }
+        // Includes scripts this one loads; each is also recorded under its own name
+        m_router->metrics().recordScript(fs::path(filePath).filename().string(),
+                                         std::chrono::steady_clock::now() - start);
     }
 
     void MantisBase::loadScript(const std::string &relativePath) const {
@@ -671,5 +972,9 @@ namespace mb {
     Router *MantisBase::duk_router() const {
         return m_router.get();
     }
+
+    AppKv *MantisBase::duk_kv() const {
+        return m_appKv.get();
+    }
 #endif
 }
@@ -12,6 +12,7 @@
 #include <iostream>
 #include <iomanip>
 
+#include "mantisbase/core/backup.h"
 #include "mantisbase/core/realtime.h"
 #include "mantisbase/core/models/entity_schema.h"
 #include "mantisbase/core/models/validators.h"
@@ -287,6 +288,11 @@ namespace mb {
                 .nargs(1)
                 .metavar("URL")
                 .help("Database connection URL (overridden by MB_DATABASE_URL)");
+        program.add_argument("--db-replica-url")
+                .append()
+                .nargs(1)
+                .metavar("URL")
+                .help("PostgreSQL read replica connection URL, repeatable (overridden by MB_DATABASE_REPLICA_URLS)");
 
         argparse::ArgumentParser serve_command("serve");
         serve_command.add_description("Start the HTTP server");
@@ -302,7 +308,34 @@ namespace mb {
                 .help("Skip first-boot admin browser setup (also MB_SKIP_ADMIN_SETUP=1)");
         serve_command.add_argument("--pool-size", "--poolSize")
                 .scan<'i', int>()
-                .help("Database connection pool size (default: 4 for sqlite3, 10 for postgresql)");
+                .help("Database connection pool size (default: scaled to --threads; at least 4 for sqlite3, 10 for postgresql)");
+        serve_command.add_argument("--db-workers")
+                .scan<'i', int>()
+                .help("Worker threads for database-bound routes (default: pool size, overridden by MB_DB_WORKERS)");
+        serve_command.add_argument("--threads")
+                .scan<'i', int>()
+                .help("HTTP IO threads, 0 = all cores (default: 4, overridden by MB_HTTP_THREADS)");
+        serve_command.add_argument("--reuse-port")
+                .flag()
+                .help("Give each IO thread its own SO_REUSEPORT listener (also MB_HTTP_REUSE_PORT=1)");
+        serve_command.add_argument("--idle-timeout")
+                .scan<'i', int>()
+                .help("Seconds an idle (keep-alive) connection stays open, 0 = no limit (default: 60, overridden by MB_HTTP_IDLE_TIMEOUT)");
+        serve_command.add_argument("--keepalive-requests")
+                .scan<'i', int>()
+                .help("Requests per connection before it is closed, 0 = no limit (default: 0, overridden by MB_HTTP_KEEPALIVE_REQUESTS)");
+        serve_command.add_argument("--max-connections")
+                .scan<'i', int>()
+                .help("Open connections at most (default: 100000, overridden by MB_HTTP_MAX_CONNECTIONS)");
+        serve_command.add_argument("--max-connections-per-ip")
+                .scan<'i', int>()
+                .help("Open connections per client address, 0 = no limit (default: 0, overridden by MB_HTTP_MAX_CONNECTIONS_PER_IP)");
+        serve_command.add_argument("--tls-cert")
+                .metavar("PEM")
+                .help("Certificate chain; with --tls-key, serve HTTPS (overridden by MB_TLS_CERT)");
+        serve_command.add_argument("--tls-key")
+                .metavar("PEM")
+                .help("Private key of --tls-cert (overridden by MB_TLS_KEY)");
 
         argparse::ArgumentParser admins_command("admins");
         admins_command.add_description("Manage admin accounts");
@@ -356,11 +389,21 @@ namespace mb {
                 .metavar("FILE")
                 .help("Restore entity schemas from a JSON dump file");
 
+        argparse::ArgumentParser backup_command("backup");
+        backup_command.add_description("Write an online backup of the SQLite databases");
+        backup_command.add_argument("--files")
+                .flag()
+                .help("Also snapshot the files directory, hard-linking files unchanged since the last snapshot");
+        backup_command.add_argument("--dir")
+                .metavar("PATH")
+                .help("Directory to write snapshots under (default: MB_BACKUP_DIR, or <data-dir>/backups)");
+
         program.add_subparser(serve_command);
         program.add_subparser(admins_command);
         program.add_subparser(migrations_command);
         program.add_subparser(schema_command);
         program.add_subparser(migrate_command);
+        program.add_subparser(backup_command);
 
         try {
             std::vector<const char *> argv;
@@ -413,12 +456,51 @@ namespace mb {
 
         setDbType(db_type);
 
-        int pool_size = m_dbType == "sqlite3" ? 4 : 10;
+        if (program.is_subcommand_used("serve") && serve_command.is_used("--threads")) {
+            setHttpThreads(serve_command.get<int>("--threads"));
+        }
+
+        if (program.is_subcommand_used("serve") && serve_command.get<bool>("--reuse-port")) {
+            setReusePort(true);
+        }
+
+        if (program.is_subcommand_used("serve")) {
+            json listener = json::object();
+            const std::pair<const char *, const char *> counts[] = {
+                {"--idle-timeout", "idleTimeout"}, {"--keepalive-requests", "keepAliveRequests"},
+                {"--max-connections", "maxConnections"}, {"--max-connections-per-ip", "maxConnectionsPerIp"}
+            };
+            for (const auto &[flag, key]: counts)
+                if (serve_command.is_used(flag)) listener[key] = serve_command.get<int>(flag);
+            if (const auto cert = serve_command.present("--tls-cert")) listener["tlsCert"] = *cert;
+            if (const auto key = serve_command.present("--tls-key")) listener["tlsKey"] = *key;
+            // Checked here, so a bad flag stops the start instead of the listener
+            try {
+                ListenerOptions{}.merge(listener);
+            } catch (const MantisException &e) {
+                quit(400, e.what());
+            }
+            setListenerFlags(listener);
+        }
+
+        // Default pool grows with the IO thread count. SQLite serializes writers,
+        // so its pool is capped lower than PostgreSQL's.
+        const int http_threads = httpThreads();
+        int pool_size = m_dbType == "sqlite3"
+                            ? std::clamp(http_threads, 4, 16)
+                            : std::clamp(http_threads * 2, 10, 64);
         if (program.is_subcommand_used("serve") && serve_command.is_used("--pool-size")) {
             pool_size = serve_command.get<int>("--pool-size");
         }
         setPoolSize(pool_size);
 
+        if (program.is_subcommand_used("serve") && serve_command.is_used("--db-workers")) {
+            setDbWorkers(serve_command.get<int>("--db-workers"));
+        }
+
+        if (const auto replicas = program.present<std::vector<std::string>>("--db-replica-url"))
+            setDbReplicaUrls(*replicas);
+
         if (!m_database->connect(conn_string)) {
             quit(500, "Database connection failed, exiting!");
         }
@@ -622,7 +704,25 @@ namespace mb {
             }
         }
 
-        std::cout << "Unknown command. Available subcommands: serve, admins, migrations, schema, migrate\n\n"
+        if (program.is_subcommand_used("backup")) {
+            if (m_dbType != "sqlite3")
+                quit(400, "backup only supports sqlite3; use pg_dump for postgresql.");
+
+            try {
+                const auto dir = backup_command.present<std::string>("--dir");
+                const auto root = dir ? fs::path(*dir) : Backup::rootFromEnv(dataDir());
+                const auto summary = Backup::run(dataDir(), root, backup_command.get<bool>("--files"),
+                                                 Backup::Options::fromEnv());
+                std::cout << summary.dump(2) << std::endl;
+                quit(0, "");
+            } catch (const MantisException &e) {
+                quit(e.code(), e.what());
+            } catch (const std::exception &e) {
+                quit(500, e.what());
+            }
+        }
+
+        std::cout << "Unknown command. Available subcommands: serve, admins, migrations, schema, migrate, backup\n\n"
                   << program;
         quit(400, "No subcommand specified.");
     }
@@ -2,6 +2,7 @@
 #include "mantisbase/core/logger/logger.h"
 
 #include <wolfssl/wolfcrypt/sha256.h>
+#include <wolfssl/wolfcrypt/hmac.h>
 #include <wolfssl/wolfcrypt/aes.h>
 #include <wolfssl/wolfcrypt/random.h>
 #include <wolfssl/wolfcrypt/coding.h>
@@ -53,6 +54,131 @@ namespace mb {
         return oss.str();
     }
 
+    struct Sha256Hasher::State {
+        Sha256 sha{};
+    };
+
+    Sha256Hasher::Sha256Hasher() : m_state(std::make_unique<State>()) {
+        if (wc_InitSha256(&m_state->sha) != 0) {
+            throw std::runtime_error("Failed to initialize SHA-256");
+        }
+    }
+
+    Sha256Hasher::~Sha256Hasher() {
+        wc_Sha256Free(&m_state->sha);
+    }
+
+    void Sha256Hasher::update(const std::string_view data) {
+        wc_Sha256Update(&m_state->sha,
+                        reinterpret_cast<const byte*>(data.data()),
+                        static_cast<word32>(data.size()));
+    }
+
+    std::string Sha256Hasher::hexDigest() {
+        byte hash[SHA256_DIGEST_SIZE];
+        wc_Sha256Final(&m_state->sha, hash);
+
+        std::ostringstream oss;
+        for (int i = 0; i < SHA256_DIGEST_SIZE; i++) {
+            oss << std::hex << std::setfill('0') << std::setw(2) << static_cast<int>(hash[i]);
+        }
+        return oss.str();
+    }
+
+    std::string hmacSha256(const std::string_view key, const std::string_view data) {
+        Hmac hmac;
+        if (wc_HmacInit(&hmac, nullptr, INVALID_DEVID) != 0) {
+            throw std::runtime_error("Failed to initialize HMAC-SHA256");
+        }
+
+        byte mac[WC_SHA256_DIGEST_SIZE];
+        const bool ok = wc_HmacSetKey(&hmac, WC_SHA256, reinterpret_cast<const byte*>(key.data()),
+                                      static_cast<word32>(key.size())) == 0 &&
+                        wc_HmacUpdate(&hmac, reinterpret_cast<const byte*>(data.data()),
+                                      static_cast<word32>(data.size())) == 0 &&
+                        wc_HmacFinal(&hmac, mac) == 0;
+        wc_HmacFree(&hmac);
+        if (!ok) {
+            throw std::runtime_error("Failed to compute HMAC-SHA256");
+        }
+        return {reinterpret_cast<const char*>(mac), sizeof(mac)};
+    }
+
+    struct HmacSha256Key::State {
+        Sha256 inner{}; ///> After the key XOR ipad block
+        Sha256 outer{}; ///> After the key XOR opad block
+    };
+
+    HmacSha256Key::HmacSha256Key(const std::string_view key) : m_state(std::make_unique<State>()) {
+        // Keys longer than a block are hashed first, as RFC 2104 says
+        byte block[WC_SHA256_BLOCK_SIZE] = {};
+        if (key.size() > sizeof(block)) {
+            Sha256 sha;
+            if (wc_InitSha256(&sha) != 0) throw std::runtime_error("Failed to initialize SHA-256");
+            wc_Sha256Update(&sha, reinterpret_cast<const byte*>(key.data()), static_cast<word32>(key.size()));
+            wc_Sha256Final(&sha, block);
+            wc_Sha256Free(&sha);
+        } else {
+            std::memcpy(block, key.data(), key.size());
+        }
+
+        byte ipad[WC_SHA256_BLOCK_SIZE], opad[WC_SHA256_BLOCK_SIZE];
+        for (std::size_t i = 0; i < sizeof(block); ++i) {
+            ipad[i] = block[i] ^ 0x36;
+            opad[i] = block[i] ^ 0x5c;
+        }
+
+        const bool ok = wc_InitSha256(&m_state->inner) == 0 && wc_InitSha256(&m_state->outer) == 0 &&
+                        wc_Sha256Update(&m_state->inner, ipad, sizeof(ipad)) == 0 &&
+                        wc_Sha256Update(&m_state->outer, opad, sizeof(opad)) == 0;
+        std::memset(block, 0, sizeof(block));
+        std::memset(ipad, 0, sizeof(ipad));
+        std::memset(opad, 0, sizeof(opad));
+        if (!ok) throw std::runtime_error("Failed to initialize HMAC-SHA256");
+    }
+
+    HmacSha256Key::~HmacSha256Key() {
+        wc_Sha256Free(&m_state->inner);
+        wc_Sha256Free(&m_state->outer);
+    }
+
+    std::string HmacSha256Key::sign(const std::string_view data) const {
+        byte digest[WC_SHA256_DIGEST_SIZE], mac[WC_SHA256_DIGEST_SIZE];
+
+        Sha256 sha;
+        bool ok = wc_Sha256Copy(&m_state->inner, &sha) == 0 &&
+                  wc_Sha256Update(&sha, reinterpret_cast<const byte*>(data.data()),
+                                  static_cast<word32>(data.size())) == 0 &&
+                  wc_Sha256Final(&sha, digest) == 0;
+        wc_Sha256Free(&sha);
+
+        ok = ok && wc_Sha256Copy(&m_state->outer, &sha) == 0 &&
+             wc_Sha256Update(&sha, digest, sizeof(digest)) == 0 &&
+             wc_Sha256Final(&sha, mac) == 0;
+        wc_Sha256Free(&sha);
+        if (!ok) {
+            throw std::runtime_error("Failed to compute HMAC-SHA256");
+        }
+        return {reinterpret_cast<const char*>(mac), sizeof(mac)};
+    }
+
+    bool HmacSha256Key::verify(const std::string_view data, const std::string_view mac) const {
+        const auto expected = sign(data);
+        if (mac.size() != expected.size()) return false;
+        unsigned char diff = 0;
+        for (std::size_t i = 0; i < expected.size(); ++i)
+            diff |= static_cast<unsigned char>(expected[i] ^ mac[i]);
+        return diff == 0;
+    }
+
+    std::string toHex(const std::string_view bytes) {
+        std::ostringstream oss;
+        for (const auto c : bytes) {
+            oss << std::hex << std::setfill('0') << std::setw(2) << static_cast<int>(static_cast<unsigned char>(c));
+        }
+        return oss.str();
+    }
+
     std::string base64UrlEncode(const std::vector<uint8_t> &data) {
         word32 outLen = static_cast<word32>(data.size() * 2 + 4);
         std::vector<byte> encoded(outLen);
@@ -1,6 +1,7 @@
 #include "../../include/mantisbase/utils/utils.h"
 #include <private/soci-mktime.h>
 
+#include <chrono>
 #include <ctime>
 #include <mutex>
 
@@ -10,12 +11,22 @@ namespace mb
 {
     std::tm toUtcTime(const std::time_t t)
     {
-        // std::gmtime writes into a shared static buffer, so concurrent calls
-        // from request threads race on it. Serialize the call and copy the
-        // result out while holding the lock.
-        static std::mutex mtx;
-        std::lock_guard lock(mtx);
-        return *std::gmtime(&t);
+        using namespace std::chrono;
+        const auto secs = sys_seconds{seconds{t}};
+        const auto day = floor<days>(secs);
+        const year_month_day ymd{day};
+        const hh_mm_ss hms{secs - day};
+
+        std::tm out{};
+        out.tm_year = static_cast<int>(ymd.year()) - 1900;
+        out.tm_mon = static_cast<int>(static_cast<unsigned>(ymd.month())) - 1;
+        out.tm_mday = static_cast<int>(static_cast<unsigned>(ymd.day()));
+        out.tm_hour = static_cast<int>(hms.hours().count());
+        out.tm_min = static_cast<int>(hms.minutes().count());
+        out.tm_sec = static_cast<int>(hms.seconds().count());
+        out.tm_wday = static_cast<int>(weekday{day}.c_encoding());
+        out.tm_yday = static_cast<int>((day - sys_days{ymd.year() / January / 1}).count());
+        return out;
     }
 
     std::tm toLocalTime(const std::time_t t)
@@ -28,12 +39,50 @@ namespace mb
         return *std::localtime(&t);
     }
 
+    std::size_t formatIsoDateTime(const std::tm& t, char* out, const char separator)
+    {
+        const auto put = [&out](int value, const int width)
+        {
+            for (int i = width - 1; i >= 0; --i)
+            {
+                out[i] = static_cast<char>('0' + value % 10);
+                value /= 10;
+            }
+            out += width;
+        };
+
+        // Years 0-9999 only, which is all a date column holds
+        put(t.tm_year + 1900, 4);
+        *out++ = '-';
+        put(t.tm_mon + 1, 2);
+        *out++ = '-';
+        put(t.tm_mday, 2);
+        *out++ = separator;
+        put(t.tm_hour, 2);
+        *out++ = ':';
+        put(t.tm_min, 2);
+        *out++ = ':';
+        put(t.tm_sec, 2);
+        return kIsoDateTimeLength;
+    }
+
+    std::string_view currentTimestampUTC()
+    {
+        thread_local std::time_t formatted = -1;
+        thread_local char buffer[kIsoDateTimeLength];
+
+        if (const auto now = std::time(nullptr); now != formatted)
+        {
+            formatIsoDateTime(toUtcTime(now), buffer);
+            formatted = now;
+        }
+        return {buffer, kIsoDateTimeLength};
+    }
+
     std::string tmToStr(const std::tm& t)
     {
-        char buffer[80];
-        const int length = soci::details::format_std_tm(t, buffer, sizeof(buffer));
-        std::string iso_string(buffer, length);
-        return iso_string;
+        char buffer[kIsoDateTimeLength];
+        return {buffer, formatIsoDateTime(t, buffer)};
     }
 
     std::tm strToTM(const std::string& value)
@@ -48,6 +97,47 @@ namespace mb
         return t;
     }
 
+    bool parseIsoDateTime(const std::string_view value, std::tm& out)
+    {
+        // Reads `n` digits at `pos`
+        const auto digits = [&](const std::size_t pos, const std::size_t n, int& into)
+        {
+            if (pos + n > value.size()) return false;
+            into = 0;
+            for (std::size_t i = pos; i < pos + n; ++i)
+            {
+                if (value[i] < '0' || value[i] > '9') return false;
+                into = into * 10 + (value[i] - '0');
+            }
+            return true;
+        };
+
+        int year, month, day, hour = 0, minute = 0, second = 0;
+        if (!digits(0, 4, year) || value.size() < 10 || value[4] != '-' || !digits(5, 2, month) ||
+            value[7] != '-' || !digits(8, 2, day))
+            return false;
+
+        if (value.size() > 10 && (value[10] == 'T' || value[10] == ' '))
+        {
+            if (!digits(11, 2, hour) || value.size() < 14 || value[13] != ':' || !digits(14, 2, minute))
+                return false;
+            if (value.size() > 16 && value[16] == ':' && !digits(17, 2, second))
+                return false;
+        }
+
+        if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60)
+            return false;
+
+        out = std::tm{};
+        out.tm_year = year - 1900;
+        out.tm_mon = month - 1;
+        out.tm_mday = day;
+        out.tm_hour = hour;
+        out.tm_min = minute;
+        out.tm_sec = second;
+        return true;
+    }
+
     std::string dbDateToString(const soci::row& row, const int index)
     {
         if (const std::string& db_type = MantisBase::instance().dbType(); db_type == "sqlite3")
@@ -0,0 +1,213 @@
+/**
+ * @file duk_json.cpp
+ * @brief Implementation for @see duk_json.h
+ */
+
+#include "../../include/mantisbase/utils/duk_json.h"
+
+#ifdef MB_SCRIPTING_ENABLED
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace mb {
+    namespace {
+        /// Deeper values go through JSON text, which also catches cycles
+        constexpr int MAX_DEPTH = 64;
+
+        using json = nlohmann::json;
+
+        void pushText(duk_context *ctx, const json &value) {
+            const auto text = value.dump();
+            duk_push_lstring(ctx, text.data(), text.size());
+            duk_json_decode(ctx, -1);
+        }
+
+        /// duk_json_encode() threw; its error is on top of the stack
+        struct EncodeFailed {};
+
+        json readText(duk_context *ctx, const duk_idx_t idx) {
+            duk_dup(ctx, idx);
+            // Caught here, so the error unwinds the C++ frames above before dukToJson() raises it
+            if (duk_safe_call(ctx, [](duk_context *c, void *) -> duk_ret_t {
+                duk_json_encode(c, -1);
+                return 1;
+            }, nullptr, 1, 1) != DUK_EXEC_SUCCESS)
+                throw EncodeFailed{};
+            const char *text = duk_get_string(ctx, -1);
+            auto value = text ? json::parse(text) : json();
+            duk_pop(ctx);
+            return value;
+        }
+
+        /**
+         * A JS string as UTF-8. Duktape keeps a character past U+FFFF given
+         * as a surrogate pair as two 3-byte halves (CESU-8); they are joined
+         * here, where the JSON text round trip failed to parse them.
+         */
+        std::string utf8(const char *text, const duk_size_t len) {
+            const std::string_view in(text, len);
+            if (in.find('\xED') == std::string_view::npos) return std::string(in);
+
+            std::string out;
+            out.reserve(len);
+            for (std::size_t i = 0; i < len; ++i) {
+                const auto byte = [&](const std::size_t at) { return static_cast<unsigned char>(in[at]); };
+                if (byte(i) == 0xED && i + 5 < len && (byte(i + 1) & 0xF0) == 0xA0 && byte(i + 3) == 0xED &&
+                    (byte(i + 4) & 0xF0) == 0xB0) {
+                    const std::uint32_t high = 0xD000 | (byte(i + 1) & 0x3F) << 6 | (byte(i + 2) & 0x3F);
+                    const std::uint32_t low = 0xD000 | (byte(i + 4) & 0x3F) << 6 | (byte(i + 5) & 0x3F);
+                    const std::uint32_t cp = 0x10000 + ((high - 0xD800) << 10) + (low - 0xDC00);
+                    out += static_cast<char>(0xF0 | cp >> 18);
+                    out += static_cast<char>(0x80 | (cp >> 12 & 0x3F));
+                    out += static_cast<char>(0x80 | (cp >> 6 & 0x3F));
+                    out += static_cast<char>(0x80 | (cp & 0x3F));
+                    i += 5;
+                    continue;
+                }
+                out += in[i];
+            }
+            return out;
+        }
+
+        /// As JSON.parse(JSON.stringify(d)) reads it
+        json number(const double d) {
+            if (!std::isfinite(d)) return nullptr;
+            if (std::trunc(d) == d && d >= -9223372036854775808.0 && d < 9223372036854775808.0)
+                return static_cast<std::int64_t>(d);
+            return d;
+        }
+
+        /// Scalars without a call, so a flat record costs one call per field at most
+        bool pushScalar(duk_context *ctx, const json &value) {
+            switch (value.type()) {
+                case json::value_t::null: duk_push_null(ctx); return true;
+                case json::value_t::boolean: duk_push_boolean(ctx, value.get<bool>()); return true;
+                case json::value_t::number_integer:
+                    duk_push_number(ctx, static_cast<double>(value.get<std::int64_t>()));
+                    return true;
+                case json::value_t::number_unsigned:
+                    duk_push_number(ctx, static_cast<double>(value.get<std::uint64_t>()));
+                    return true;
+                case json::value_t::number_float: {
+                    // dump() writes these as null
+                    const auto d = value.get<double>();
+                    if (std::isfinite(d)) duk_push_number(ctx, d);
+                    else duk_push_null(ctx);
+                    return true;
+                }
+                case json::value_t::string: {
+                    const auto &text = value.get_ref<const std::string &>();
+                    duk_push_lstring(ctx, text.data(), text.size());
+                    return true;
+                }
+                default: return false;
+            }
+        }
+
+        void push(duk_context *ctx, const json &value, const int depth) {
+            if (pushScalar(ctx, value)) return;
+            if (depth >= MAX_DEPTH || value.is_binary() || value.is_discarded()) {
+                pushText(ctx, value);
+                return;
+            }
+
+            duk_require_stack(ctx, 2);
+            if (value.is_array()) {
+                duk_push_array(ctx);
+                duk_uarridx_t i = 0;
+                for (const auto &item: value) {
+                    if (!pushScalar(ctx, item)) push(ctx, item, depth + 1);
+                    duk_put_prop_index(ctx, -2, i++);
+                }
+                return;
+            }
+
+            duk_push_object(ctx);
+            for (const auto &[key, item]: value.items()) {
+                if (!pushScalar(ctx, item)) push(ctx, item, depth + 1);
+                duk_put_prop_lstring(ctx, -2, key.data(), key.size());
+            }
+        }
+
+        /// What JSON.stringify() leaves out of an object, and writes as null in an array
+        bool skipped(duk_context *ctx, const duk_idx_t idx) {
+            return duk_is_undefined(ctx, idx) || duk_is_function(ctx, idx) || duk_is_lightfunc(ctx, idx);
+        }
+
+        /// Whether JSON.stringify() would only walk its properties: no toJSON(), not a buffer
+        bool plain(duk_context *ctx, const duk_idx_t idx) {
+            if (duk_is_buffer_data(ctx, idx)) return false;
+            duk_get_prop_string(ctx, idx, "toJSON");
+            const bool custom = duk_is_callable(ctx, -1);
+            duk_pop(ctx);
+            return !custom;
+        }
+
+        json read(duk_context *ctx, duk_idx_t idx, const int depth) {
+            idx = duk_normalize_index(ctx, idx);
+            switch (duk_get_type(ctx, idx)) {
+                case DUK_TYPE_BOOLEAN: return static_cast<bool>(duk_get_boolean(ctx, idx));
+                case DUK_TYPE_NUMBER: return number(duk_get_number(ctx, idx));
+                case DUK_TYPE_STRING: {
+                    duk_size_t len = 0;
+                    const char *text = duk_get_lstring(ctx, idx, &len);
+                    return utf8(text, len);
+                }
+                case DUK_TYPE_OBJECT: break;
+                case DUK_TYPE_BUFFER:
+                case DUK_TYPE_POINTER: return readText(ctx, idx);
+                default: return nullptr; // undefined, null, lightfuncs
+            }
+            if (skipped(ctx, idx)) return nullptr;
+            if (depth >= MAX_DEPTH || !plain(ctx, idx)) return readText(ctx, idx);
+
+            duk_require_stack(ctx, 4);
+            if (duk_is_array(ctx, idx)) {
+                auto out = json::array();
+                const auto size = duk_get_length(ctx, idx);
+                for (duk_size_t i = 0; i < size; ++i) {
+                    duk_get_prop_index(ctx, idx, static_cast<duk_uarridx_t>(i));
+                    out.push_back(skipped(ctx, -1) ? json() : read(ctx, -1, depth + 1));
+                    duk_pop(ctx);
+                }
+                return out;
+            }
+
+            auto out = json::object();
+            duk_enum(ctx, idx, DUK_ENUM_OWN_PROPERTIES_ONLY);
+            while (duk_next(ctx, -1, 1)) {
+                if (!skipped(ctx, -1)) {
+                    duk_size_t len = 0;
+                    const char *key = duk_get_lstring(ctx, -2, &len);
+                    out[utf8(key, len)] = read(ctx, -1, depth + 1);
+                }
+                duk_pop_2(ctx);
+            }
+            duk_pop(ctx);
+            return out;
+        }
+    }
+
+    void dukPushJson(duk_context *ctx, const nlohmann::json &value) {
+        push(ctx, value, 0);
+    }
+
+    nlohmann::json dukToJson(duk_context *ctx, const duk_idx_t idx) {
+        try {
+            return read(ctx, idx, 0);
+        } catch (const EncodeFailed &) {}
+        duk_throw(ctx);
+    }
+
+    nlohmann::json dukToJson(const DukValue &value) {
+        duk_context *ctx = value.context();
+        if (!ctx) return nullptr;
+        value.push();
+        auto out = dukToJson(ctx, -1);
+        duk_pop(ctx);
+        return out;
+    }
+}
+#endif
@@ -0,0 +1,83 @@
+/**
+ * @file json_parse.cpp
+ * @brief Implementation for @see json_parse.h
+ */
+
+#include "../../include/mantisbase/utils/json_parse.h"
+
+#ifdef MB_HAVE_SIMDJSON
+#include <simdjson.h>
+#endif
+
+namespace mb {
+#ifdef MB_HAVE_SIMDJSON
+    namespace {
+        /// Larger documents get a parser of their own, so no worker thread keeps their capacity around
+        constexpr std::size_t REUSED_PARSER_MAX = 1024 * 1024;
+
+        template<typename Json>
+        Json convert(const simdjson::dom::element &element) {
+            using simdjson::dom::element_type;
+            switch (element.type()) {
+                case element_type::OBJECT: {
+                    auto out = Json::object();
+                    const simdjson::dom::object object = element.get_object().value_unsafe();
+                    for (const auto field: object)
+                        out[std::string(field.key)] = convert<Json>(field.value);
+                    return out;
+                }
+                case element_type::ARRAY: {
+                    auto out = Json::array();
+                    const simdjson::dom::array array = element.get_array().value_unsafe();
+                    for (const auto child: array) out.push_back(convert<Json>(child));
+                    return out;
+                }
+                case element_type::STRING:
+                    return std::string(element.get_string().value_unsafe());
+                case element_type::INT64:
+                    return element.get_int64().value_unsafe();
+                case element_type::UINT64:
+                    return element.get_uint64().value_unsafe();
+                case element_type::DOUBLE:
+                    return element.get_double().value_unsafe();
+                case element_type::BOOL:
+                    return element.get_bool().value_unsafe();
+                default:
+                    return nullptr;
+            }
+        }
+    }
+#endif
+
+    namespace {
+        template<typename Json>
+        Json parseAs(const std::string_view text) {
+#ifdef MB_HAVE_SIMDJSON
+            thread_local simdjson::dom::parser reused;
+            simdjson::dom::parser own;
+            auto &parser = text.size() > REUSED_PARSER_MAX ? own : reused;
+
+            simdjson::dom::element doc;
+            if (parser.parse(text.data(), text.size()).get(doc) == simdjson::SUCCESS) return convert<Json>(doc);
+            // Invalid, or valid beyond what simdjson takes (e.g. integers past 64 bits): nlohmann decides
+#endif
+            return Json::parse(text.begin(), text.end());
+        }
+    }
+
+    nlohmann::json parseJson(const std::string_view text) {
+        return parseAs<nlohmann::json>(text);
+    }
+
+    ArenaJson parseArenaJson(const std::string_view text) {
+        return parseAs<ArenaJson>(text);
+    }
+
+    bool simdJsonEnabled() {
+#ifdef MB_HAVE_SIMDJSON
+        return true;
+#else
+        return false;
+#endif
+    }
+}
@@ -1,8 +1,9 @@
 #include "../../include/mantisbase/utils/utils.h"
 #include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/utils/json_parse.h"
 
 #include <algorithm>
-#include <regex>
+#include <charconv>
 
 namespace mb {
     std::string sqlIdentifier(const std::string &ident) {
@@ -19,7 +20,7 @@ namespace mb {
         try {
             if (trim(json_str).empty())
                 return default_value.has_value() ? default_value.value() : json::object();
-            return json::parse(json_str);
+            return parseJson(json_str);
         } catch (const std::exception &e) {
             LogOrigin::critical("JSON Parse Error",
                                 fmt::format("JSON parse error: {}", e.what())
@@ -207,31 +208,165 @@ namespace mb {
         }
     }
 
-    bool isValidIPv4(const std::string &ip) {
-        if (ip.empty() || ip.length() > 15) {
-            return false;
+    namespace {
+        /// Four parts of 0-255 into `out`; no leading zeros, nothing around them
+        bool parseQuad(const std::string_view text, std::uint8_t *out) {
+            std::size_t pos = 0;
+            for (int part = 0; part < 4; ++part) {
+                if (part > 0) {
+                    if (pos >= text.size() || text[pos] != '.') return false;
+                    ++pos;
+                }
+
+                const auto start = pos;
+                unsigned value = 0;
+                while (pos < text.size() && pos - start < 3 && text[pos] >= '0' && text[pos] <= '9')
+                    value = value * 10 + (text[pos++] - '0');
+
+                const auto digits = pos - start;
+                if (digits == 0 || value > 255 || (digits > 1 && text[start] == '0')) return false;
+                out[part] = static_cast<std::uint8_t>(value);
+            }
+            return pos == text.size();
         }
 
-        // Regex pattern for IPv4: 0-255.0-255.0-255.0-255
-        std::regex ipv4_pattern(
-            R"(^((25[0-5]|2[0-4][0-9]|[01]?[0-9][0-9]?)\.){3}(25[0-5]|2[0-4][0-9]|[01]?[0-9][0-9]?)$)"
-        );
+        int hexValue(const char c) {
+            if (c >= '0' && c <= '9') return c - '0';
+            if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+            if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+            return -1;
+        }
 
-        return std::regex_match(ip, ipv4_pattern);
+        constexpr std::array<std::uint8_t, 12> V4_MAPPED_PREFIX = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
     }
 
-    bool isValidIPv6(const std::string &ip) {
-        if (ip.empty() || ip.length() > 45) {
-            return false;
+    bool IpAddress::isV4() const {
+        return std::equal(V4_MAPPED_PREFIX.begin(), V4_MAPPED_PREFIX.end(), bytes.begin());
+    }
+
+    std::string IpAddress::toString() const {
+        if (isV4()) return std::format("{}.{}.{}.{}", bytes[12], bytes[13], bytes[14], bytes[15]);
+
+        std::array<unsigned, 8> groups{};
+        for (std::size_t g = 0; g < 8; ++g) groups[g] = bytes[2 * g] << 8 | bytes[2 * g + 1];
+
+        // The longest run of two or more zero groups, the first one on a tie
+        int best = -1, best_len = 1;
+        for (int g = 0; g < 8;) {
+            if (groups[g] != 0) {
+                ++g;
+                continue;
+            }
+            int end = g;
+            while (end < 8 && groups[end] == 0) ++end;
+            if (end - g > best_len) {
+                best = g;
+                best_len = end - g;
+            }
+            g = end;
         }
 
-        // Simplified IPv6 validation - supports compressed notation
-        // Full validation is complex, this covers common cases
-        std::regex ipv6_pattern(
-            R"(^(([0-9a-fA-F]{1,4}:){7}[0-9a-fA-F]{1,4}|([0-9a-fA-F]{1,4}:){1,7}:|([0-9a-fA-F]{1,4}:){1,6}:[0-9a-fA-F]{1,4}|([0-9a-fA-F]{1,4}:){1,5}(:[0-9a-fA-F]{1,4}){1,2}|([0-9a-fA-F]{1,4}:){1,4}(:[0-9a-fA-F]{1,4}){1,3}|([0-9a-fA-F]{1,4}:){1,3}(:[0-9a-fA-F]{1,4}){1,4}|([0-9a-fA-F]{1,4}:){1,2}(:[0-9a-fA-F]{1,4}){1,5}|[0-9a-fA-F]{1,4}:((:[0-9a-fA-F]{1,4}){1,6})|:((:[0-9a-fA-F]{1,4}){1,7}|:)|fe80:(:[0-9a-fA-F]{0,4}){0,4}%[0-9a-zA-Z]+|::(ffff(:0{1,4}){0,1}:){0,1}((25[0-5]|(2[0-4]|1{0,1}[0-9]){0,1}[0-9])\.){3}(25[0-5]|(2[0-4]|1{0,1}[0-9]){0,1}[0-9])|([0-9a-fA-F]{1,4}:){1,4}:((25[0-5]|(2[0-4]|1{0,1}[0-9]){0,1}[0-9])\.){3}(25[0-5]|(2[0-4]|1{0,1}[0-9]){0,1}[0-9]))$)"
-        );
+        std::string out;
+        out.reserve(39);
+        for (int g = 0; g < 8; ++g) {
+            if (g == best) {
+                out += "::";
+                g += best_len - 1;
+                continue;
+            }
+            if (!out.empty() && !out.ends_with(':')) out += ':';
+            char hex[4];
+            const auto [end, ec] = std::to_chars(hex, hex + sizeof(hex), groups[g], 16);
+            out.append(hex, end);
+        }
+        return out;
+    }
 
-        return std::regex_match(ip, ipv6_pattern);
+    std::optional<IpAddress> parseIPv4(const std::string_view text) {
+        IpAddress ip;
+        std::copy(V4_MAPPED_PREFIX.begin(), V4_MAPPED_PREFIX.end(), ip.bytes.begin());
+        if (!parseQuad(text, ip.bytes.data() + 12)) return std::nullopt;
+        return ip;
+    }
+
+    std::optional<IpAddress> parseIPv6(std::string_view text) {
+        if (const auto pct = text.find('%'); pct != std::string_view::npos) {
+            const auto zone = text.substr(pct + 1);
+            if (zone.empty() || !std::ranges::all_of(zone, [](const unsigned char c) { return std::isalnum(c); }))
+                return std::nullopt;
+            text = text.substr(0, pct);
+        }
+        if (text.size() < 2) return std::nullopt;
+
+        std::array<unsigned, 8> groups{};
+        int count = 0, gap = -1;
+        std::size_t pos = 0;
+        if (text.starts_with("::")) {
+            gap = 0;
+            pos = 2;
+        } else if (text[0] == ':') {
+            return std::nullopt;
+        }
+
+        while (pos < text.size()) {
+            if (count == 8) return std::nullopt;
+
+            auto end = pos;
+            unsigned value = 0;
+            while (end < text.size() && hexValue(text[end]) >= 0 && end - pos < 5)
+                value = value << 4 | hexValue(text[end++]);
+
+            // An IPv4 tail fills the last two groups
+            if (end < text.size() && text[end] == '.') {
+                std::uint8_t quad[4];
+                if (count > 6 || !parseQuad(text.substr(pos), quad)) return std::nullopt;
+                groups[count++] = quad[0] << 8 | quad[1];
+                groups[count++] = quad[2] << 8 | quad[3];
+                pos = text.size();
+                break;
+            }
+
+            if (end == pos || end - pos > 4) return std::nullopt;
+            groups[count++] = value;
+            pos = end;
+            if (pos == text.size()) break;
+
+            if (text[pos++] != ':' || pos == text.size()) return std::nullopt;
+            if (text[pos] == ':') {
+                if (gap >= 0) return std::nullopt;
+                gap = count;
+                ++pos;
+            }
+        }
+
+        if (gap >= 0) {
+            // `::` stands for at least one zero group
+            if (count == 8) return std::nullopt;
+            std::copy_backward(groups.begin() + gap, groups.begin() + count, groups.end());
+            std::fill(groups.begin() + gap, groups.begin() + gap + (8 - count), 0u);
+        } else if (count != 8) {
+            return std::nullopt;
+        }
+
+        IpAddress ip;
+        for (std::size_t g = 0; g < 8; ++g) {
+            ip.bytes[2 * g] = static_cast<std::uint8_t>(groups[g] >> 8);
+            ip.bytes[2 * g + 1] = static_cast<std::uint8_t>(groups[g]);
+        }
+        return ip;
+    }
+
+    std::optional<IpAddress> parseIP(const std::string_view text) {
+        if (auto ip = parseIPv4(text)) return ip;
+        return parseIPv6(text);
+    }
+
+    bool isValidIPv4(const std::string &ip) {
+        return parseIPv4(ip).has_value();
+    }
+
+    bool isValidIPv6(const std::string &ip) {
+        return parseIPv6(ip).has_value();
     }
 
     bool isValidIP(const std::string &ip) {
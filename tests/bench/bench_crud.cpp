@@ -10,11 +10,21 @@
 extern std::atomic<bool> server_ready;
 extern int bench_port;
 
+// Compare the SQLite tuning presets by running the suite once per profile:
+//   for p in default read-heavy write-heavy; do
+//     MB_SQLITE_PROFILE=$p ./mantisbase_bench --benchmark_filter='BM_(Sequential|Concurrent|Mixed)'
+//   done
+// Each result is labelled with the profile the server ran with.
+static std::string sqliteProfileLabel() {
+    return "sqlite:" + mb::MantisBase::instance().db().sqliteProfile().name;
+}
+
 static void BM_SequentialInserts(benchmark::State& state) {
     if (!server_ready.load()) {
         state.SkipWithError("Server not ready");
         return;
     }
+    state.SetLabel(sqliteProfileLabel());
 
     TestHttp::Client cli("127.0.0.1", bench_port);
     int counter = 0;
@@ -39,6 +49,7 @@ static void BM_SequentialReads(benchmark::State& state) {
         state.SkipWithError("Server not ready");
         return;
     }
+    state.SetLabel(sqliteProfileLabel());
 
     TestHttp::Client cli("127.0.0.1", bench_port);
 
@@ -54,6 +65,7 @@ static void BM_ConcurrentInserts(benchmark::State& state) {
         state.SkipWithError("Server not ready");
         return;
     }
+    state.SetLabel(sqliteProfileLabel());
 
     const int concurrency = state.range(0);
 
@@ -93,6 +105,7 @@ static void BM_ConcurrentReads(benchmark::State& state) {
         state.SkipWithError("Server not ready");
         return;
     }
+    state.SetLabel(sqliteProfileLabel());
 
     const int concurrency = state.range(0);
 
@@ -125,6 +138,7 @@ static void BM_MixedCRUD(benchmark::State& state) {
         state.SkipWithError("Server not ready");
         return;
     }
+    state.SetLabel(sqliteProfileLabel());
 
     const int concurrency = state.range(0);
 
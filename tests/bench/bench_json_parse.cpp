@@ -0,0 +1,54 @@
+#include <benchmark/benchmark.h>
+#include <nlohmann/json.hpp>
+#include <string>
+
+#include "mantisbase/utils/json_parse.h"
+
+// Parses record-shaped documents of growing size, comparing nlohmann's own
+// parser with mb::parseJson (simdjson front end when built with it).
+
+namespace {
+    /// A record like a realtime change payload carries: strings, numbers, a flag and a nested object
+    nlohmann::json makeRecord(const int i) {
+        return {
+            {"id", "01JABCDEF" + std::to_string(i)},
+            {"title", "A moderately long title for record " + std::to_string(i)},
+            {"body", std::string(120, 'x')},
+            {"views", i * 17},
+            {"score", i * 0.25},
+            {"published", i % 2 == 0},
+            {"tags", {"alpha", "beta", "gamma"}},
+            {"author", {{"id", "u" + std::to_string(i % 50)}, {"name", "Author"}}},
+            {"created", "2025-01-01T00:00:00Z"},
+        };
+    }
+
+    /// One record for state.range(0) == 1, otherwise a list page of that many
+    std::string makeDoc(const int64_t records) {
+        if (records == 1) return makeRecord(0).dump();
+        auto items = nlohmann::json::array();
+        for (int i = 0; i < records; ++i) items.push_back(makeRecord(i));
+        return nlohmann::json{{"items", items}, {"total", records}}.dump();
+    }
+}
+
+static void BM_JsonParse_Nlohmann(benchmark::State &state) {
+    const auto doc = makeDoc(state.range(0));
+    for (auto _: state) {
+        auto parsed = nlohmann::json::parse(doc);
+        benchmark::DoNotOptimize(parsed);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * doc.size()));
+}
+BENCHMARK(BM_JsonParse_Nlohmann)->Arg(1)->Arg(50)->Arg(1000);
+
+static void BM_JsonParse_ParseJson(benchmark::State &state) {
+    const auto doc = makeDoc(state.range(0));
+    state.SetLabel(mb::simdJsonEnabled() ? "simdjson" : "nlohmann fallback");
+    for (auto _: state) {
+        auto parsed = mb::parseJson(doc);
+        benchmark::DoNotOptimize(parsed);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * doc.size()));
+}
+BENCHMARK(BM_JsonParse_ParseJson)->Arg(1)->Arg(50)->Arg(1000);
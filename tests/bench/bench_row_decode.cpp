@@ -0,0 +1,114 @@
+#include <benchmark/benchmark.h>
+#include <nlohmann/json.hpp>
+#include <soci/soci.h>
+#include <vector>
+
+#include "mantisbase/utils/soci_wrappers.h"
+
+// Decodes a 30-column x 500-row page entirely in-process (in-memory SQLite),
+// comparing the old per-column linear schema scan against the precompiled
+// RowCodec used by Entity CRUD.
+
+namespace {
+    constexpr int kColumns = 30;
+    constexpr int kRows = 500;
+
+    std::vector<nlohmann::json> makeFields() {
+        std::vector<nlohmann::json> fields;
+        fields.push_back({{"name", "id"}, {"type", "string"}});
+        for (int c = 1; c < kColumns; ++c) {
+            switch (c % 3) {
+                case 0: fields.push_back({{"name", "s" + std::to_string(c)}, {"type", "string"}}); break;
+                case 1: fields.push_back({{"name", "i" + std::to_string(c)}, {"type", "int"}, {"precision", 64}}); break;
+                default: fields.push_back({{"name", "d" + std::to_string(c)}, {"type", "double"}}); break;
+            }
+        }
+        return fields;
+    }
+
+    void seed(soci::session &sql, const std::vector<nlohmann::json> &fields) {
+        std::string cols, vals;
+        for (const auto &f: fields) {
+            const auto name = f["name"].get<std::string>();
+            const auto type = f["type"].get<std::string>();
+            cols += (cols.empty() ? "" : ", ") + name +
+                    (type == "int" ? " INTEGER" : type == "double" ? " REAL" : " TEXT");
+        }
+        sql << "CREATE TABLE bench_rows (" + cols + ")";
+
+        soci::transaction tr(sql);
+        for (int r = 0; r < kRows; ++r) {
+            vals.clear();
+            for (const auto &f: fields) {
+                const auto type = f["type"].get<std::string>();
+                vals += vals.empty() ? "" : ", ";
+                vals += type == "string" ? "'row_" + std::to_string(r) + "'" : std::to_string(r);
+            }
+            sql << "INSERT INTO bench_rows VALUES (" + vals + ")";
+        }
+        tr.commit();
+    }
+
+    // Pre-RowCodec decoder: two linear schema scans per column per row.
+    nlohmann::json legacyDecode(const soci::row &row, const std::vector<nlohmann::json> &fields) {
+        nlohmann::json res;
+        for (size_t i = 0; i < row.size(); i++) {
+            const auto colName = row.get_properties(i).get_name();
+            const auto colType = mb::getColumnType(colName, fields);
+            if (row.get_indicator(i) == soci::i_null) {
+                res[colName] = nullptr;
+                continue;
+            }
+            if (colType == "string") res[colName] = row.get<std::string>(i, "");
+            else if (colType == "double") res[colName] = row.get<double>(i);
+            else if (colType == "int") {
+                switch (mb::getColumnPrecision(colName, fields)) {
+                    case 64: res[colName] = row.get<int64_t>(i); break;
+                    default: res[colName] = row.get<int32_t>(i); break;
+                }
+            }
+        }
+        return res;
+    }
+}
+
+static void BM_RowDecodeLinear(benchmark::State &state) {
+    soci::session sql("sqlite3", ":memory:");
+    const auto fields = makeFields();
+    seed(sql, fields);
+
+    int64_t rows = 0;
+    for (auto _: state) {
+        soci::rowset<soci::row> rs = sql.prepare << "SELECT * FROM bench_rows";
+        for (const auto &row: rs) {
+            benchmark::DoNotOptimize(legacyDecode(row, fields));
+            ++rows;
+        }
+    }
+
+    state.counters["rows_per_sec"] = benchmark::Counter(
+        static_cast<double>(rows), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_RowDecodeLinear);
+
+static void BM_RowDecodeCodec(benchmark::State &state) {
+    soci::session sql("sqlite3", ":memory:");
+    const auto fields = makeFields();
+    seed(sql, fields);
+    const mb::RowCodec codec(fields);
+
+    int64_t rows = 0;
+    for (auto _: state) {
+        soci::rowset<soci::row> rs = sql.prepare << "SELECT * FROM bench_rows";
+        std::optional<mb::RowCodec::Plan> plan;
+        for (const auto &row: rs) {
+            if (!plan) plan = codec.plan(row);
+            benchmark::DoNotOptimize(codec.decode(row, *plan));
+            ++rows;
+        }
+    }
+
+    state.counters["rows_per_sec"] = benchmark::Counter(
+        static_cast<double>(rows), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_RowDecodeCodec);
@@ -0,0 +1,745 @@
+/**
+ * @file load_test.cpp
+ * @brief Open-loop load generator for an embedded MantisBase server.
+ *
+ * Unlike the google-benchmark suites next to it, which time one client
+ * looping on a request, this sends requests at a fixed rate whether or not
+ * earlier ones have finished, and times each from when it was *due*. A
+ * stalled server therefore shows up in the tail instead of quietly lowering
+ * the request rate (coordinated omission).
+ *
+ * Scenarios:
+ *  - `mixed`: list, get, create and login requests, per `--mix`.
+ *  - `list`: first, deep (cursor) and unindexed-sort pages of a large table.
+ *  - `fanout`: `--subscribers` SSE clients on one topic while records are
+ *    written at `--fanout-rps`; latency is write-to-delivery, and
+ *    commit-to-delivery from each change's `committed_at`.
+ *  - `sweep`: `fanout` for every pair of `--sweep-subscribers` and
+ *    `--sweep-rps`, `--sweep-duration` seconds each. Not part of `all`.
+ *
+ * @code
+ * mantisbase_load --db sqlite --scenario all --rps 2000 --duration 30 --out sqlite.json
+ * mantisbase_load --scenario sweep --sweep-subscribers 1,100,1000 --sweep-rps 10,100,1000
+ * MB_BENCH_PG_URL="dbname=bench user=postgres" mantisbase_load --db psql --out psql.json
+ * @endcode
+ *
+ * Results are written as JSON (to stdout without `--out`) with p50/p90/p99/
+ * p99.9 latencies per scenario and per request kind, for regression tracking
+ * in CI. 10k subscribers need a matching open file limit (`ulimit -n 20000`).
+ */
+
+#include <nlohmann/json.hpp>
+#include <drogon/HttpClient.h>
+#include <drogon/utils/Utilities.h>
+#include <trantor/net/EventLoopThread.h>
+#include <trantor/net/TcpClient.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mantisbase/mantis.h"
+#include "../common/test_http_client.h"
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+using json = nlohmann::json;
+
+namespace {
+    constexpr auto kItems = "bench_items";
+    constexpr auto kUsers = "bench_users";
+    constexpr auto kPassword = "bench_password_123";
+    constexpr auto kFanoutTag = "fanout:";
+
+    struct Config {
+        std::string db = "sqlite";
+        std::string dbUrl;
+        std::string scenario = "all";
+        int port = 7091;
+        double rps = 1000;
+        int duration = 20;        ///> Seconds per scenario
+        int threads = static_cast<int>(std::max(2u, std::thread::hardware_concurrency() / 2));
+        int connections = 64;     ///> HTTP connections, spread over the threads
+        std::array<double, 3> mix{70, 20, 10}; ///> read:write:auth weights
+        int rows = 100000;        ///> Seeded rows for `list`
+        int subscribers = 10000;
+        double fanoutRps = 10;
+        std::vector<int> sweepSubscribers{1, 100, 1000};
+        std::vector<double> sweepRps{10, 100, 1000};
+        int sweepDuration = 5;    ///> Seconds per sweep run
+        std::string out;
+    };
+
+    /**
+     * @brief Latency histogram with ~0.1% resolution and fixed memory.
+     *
+     * Microsecond values below 1024 get a bucket each; above, every power of
+     * two is split into 512 linear buckets.
+     */
+    class Histogram {
+    public:
+        Histogram() : m_counts(index(kMax) + 1, 0) {}
+
+        void record(const Clock::duration d) {
+            const auto us = std::clamp<std::int64_t>(
+                std::chrono::duration_cast<std::chrono::microseconds>(d).count(), 0, kMax);
+            ++m_counts[index(static_cast<std::uint64_t>(us))];
+            ++m_total;
+            m_sumUs += static_cast<double>(us);
+            m_maxUs = std::max<std::uint64_t>(m_maxUs, us);
+        }
+
+        void merge(const Histogram &other) {
+            for (std::size_t i = 0; i < m_counts.size(); ++i) m_counts[i] += other.m_counts[i];
+            m_total += other.m_total;
+            m_sumUs += other.m_sumUs;
+            m_maxUs = std::max(m_maxUs, other.m_maxUs);
+        }
+
+        [[nodiscard]] std::uint64_t count() const { return m_total; }
+
+        /// @brief Value at quantile `q` in milliseconds, as its bucket's upper bound.
+        [[nodiscard]] double quantileMs(const double q) const {
+            if (m_total == 0) return 0;
+            const auto rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(
+                                                          std::ceil(q * static_cast<double>(m_total))));
+            std::uint64_t seen = 0;
+            for (std::size_t i = 0; i < m_counts.size(); ++i) {
+                seen += m_counts[i];
+                if (seen >= rank) return std::min<double>(upper(i), m_maxUs) / 1000.0;
+            }
+            return m_maxUs / 1000.0;
+        }
+
+        [[nodiscard]] json toJson() const {
+            return {
+                {"count", m_total},
+                {"mean", m_total ? m_sumUs / m_total / 1000.0 : 0.0},
+                {"p50", quantileMs(0.50)},
+                {"p90", quantileMs(0.90)},
+                {"p99", quantileMs(0.99)},
+                {"p999", quantileMs(0.999)},
+                {"max", m_maxUs / 1000.0}
+            };
+        }
+
+    private:
+        static constexpr std::int64_t kMax = std::int64_t{1} << 36; ///> ~19h, far beyond any timeout
+
+        static std::size_t index(const std::uint64_t us) {
+            if (us < 1024) return us;
+            const auto shift = std::bit_width(us) - 10; // us >> shift is in [512, 1024)
+            return 1024 + (shift - 1) * 512 + ((us >> shift) - 512);
+        }
+
+        static std::uint64_t upper(const std::size_t i) {
+            if (i < 1024) return i;
+            const auto shift = (i - 1024) / 512 + 1;
+            return (((i - 1024) % 512 + 512 + 1) << shift) - 1;
+        }
+
+        std::vector<std::uint64_t> m_counts;
+        std::uint64_t m_total = 0, m_maxUs = 0;
+        double m_sumUs = 0;
+    };
+
+    /// @brief One kind of request in a scenario, picked with probability proportional to `weight`.
+    struct Op {
+        std::string name;
+        double weight;
+        std::function<drogon::HttpRequestPtr(std::mt19937_64 &)> make;
+    };
+
+    /// @brief An event loop with its own connections and results; only its loop thread touches them.
+    struct Worker {
+        std::unique_ptr<trantor::EventLoopThread> loop;
+        std::vector<drogon::HttpClientPtr> clients;
+        std::vector<Histogram> latency;        ///> Per op
+        std::vector<std::uint64_t> errors;     ///> Per op
+        std::mt19937_64 rng;
+        std::size_t next = 0;
+
+        /// @brief Run `fn` on the loop and wait for it.
+        template<typename Fn>
+        auto sync(Fn fn) {
+            std::packaged_task<decltype(fn())()> task(std::move(fn));
+            auto result = task.get_future();
+            loop->getLoop()->runInLoop([&task] { task(); });
+            return result.get();
+        }
+    };
+
+    void setEnv(const char *key, const char *value) {
+#ifdef _WIN32
+        _putenv_s(key, value);
+#else
+        setenv(key, value, 1);
+#endif
+    }
+
+    drogon::HttpRequestPtr request(const drogon::HttpMethod method, const std::string &path,
+                                   const json &body = nullptr) {
+        auto req = drogon::HttpRequest::newHttpRequest();
+        req->setMethod(method);
+        req->setPath(path);
+        if (!body.is_null()) {
+            req->setContentTypeString("application/json");
+            req->setBody(body.dump());
+        }
+        return req;
+    }
+
+    class LoadTest {
+    public:
+        explicit LoadTest(Config config) : m_cfg(std::move(config)) {}
+
+        ~LoadTest() {
+            if (m_serverThread.joinable()) {
+                mb::MantisBase::instance().close();
+                m_serverThread.join();
+            }
+        }
+
+        bool startServer() {
+            m_dir = fs::temp_directory_path() / "mantisbase_load" / mb::generateShortId();
+            fs::create_directories(m_dir);
+
+            setEnv("MB_DISABLE_RATE_LIMIT", "1");
+            setEnv("MB_DISABLE_ADMIN_ON_FIRST_BOOT", "1");
+
+            json args;
+            args["dev"] = false;
+            args["database"] = m_cfg.db == "psql" ? "PSQL" : "SQLITE";
+            if (!m_cfg.dbUrl.empty()) args["connection"] = m_cfg.dbUrl;
+            args["dataDir"] = (m_dir / "data").string();
+            args["publicDir"] = (m_dir / "www").string();
+            args["serve"] = {{"port", m_cfg.port}, {"host", "127.0.0.1"}};
+
+            mb::MantisBase::create(args);
+            m_serverThread = std::thread([] { mb::MantisBase::instance().run(); });
+
+            TestHttp::Client cli("127.0.0.1", m_cfg.port);
+            for (int i = 0; i < 50; ++i) {
+                if (const auto res = cli.Get("/api/v1/health"); res && res->status == 200) return true;
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            }
+            return false;
+        }
+
+        /// @brief Admin, schemas, users and an initial set of items.
+        void seed() {
+            auto &app = mb::MantisBase::instance();
+            app.entity("mb_admins").create({{"email", "loadadmin@test.com"}, {"password", kPassword}});
+
+            TestHttp::Client cli("127.0.0.1", m_cfg.port);
+            const auto login = cli.Post("/api/v1/sys/admins/login",
+                                        json{{"identity", "loadadmin@test.com"}, {"password", kPassword}}.dump(),
+                                        "application/json");
+            m_token = json::parse(login->body)["data"]["token"].get<std::string>();
+            const TestHttp::Headers auth = {{"Authorization", "Bearer " + m_token}};
+
+            const json pub = {{"mode", "public"}};
+            cli.Post("/api/v1/schemas", auth, json{
+                         {"name", kItems}, {"type", "base"},
+                         {"list", pub}, {"get", pub}, {"add", pub}, {"update", pub}, {"delete", pub},
+                         {"fields", json::array({
+                             {{"name", "title"}, {"type", "string"}, {"required", true}},
+                             {{"name", "value"}, {"type", "int"}}
+                         })}
+                     }.dump(), "application/json");
+            cli.Post("/api/v1/schemas", auth, json{
+                         {"name", kUsers}, {"type", "auth"},
+                         {"list", {{"mode", "auth"}}}, {"get", {{"mode", "auth"}}}, {"add", pub},
+                         {"fields", json::array({
+                             {{"name", "name"}, {"type", "string"}, {"required", true}},
+                             {{"name", "email"}, {"type", "string"}, {"required", true}, {"unique", true}},
+                             {{"name", "password"}, {"type", "string"}, {"required", true}}
+                         })}
+                     }.dump(), "application/json");
+
+            for (int i = 0; i < 32; ++i) {
+                m_users.push_back("load" + std::to_string(i) + "@test.com");
+                cli.Post("/api/v1/entities/" + std::string(kUsers), auth, json{
+                             {"name", "Load " + std::to_string(i)}, {"email", m_users.back()}, {"password", kPassword}
+                         }.dump(), "application/json");
+            }
+
+            insertItems(1000);
+            m_ids = collectIds();
+        }
+
+        json runMixed() {
+            std::vector<Op> ops;
+            const auto read = m_cfg.mix[0], write = m_cfg.mix[1], auth = m_cfg.mix[2];
+            ops.push_back({"list", read * 0.5, [](std::mt19937_64 &) {
+                return request(drogon::Get, std::string("/api/v1/entities/") + kItems + "?limit=20");
+            }});
+            ops.push_back({"get", read * 0.5, [this](std::mt19937_64 &rng) {
+                return request(drogon::Get, std::string("/api/v1/entities/") + kItems + "/" + m_ids[rng() % m_ids.size()]);
+            }});
+            ops.push_back({"create", write, [this](std::mt19937_64 &) {
+                const auto n = m_written.fetch_add(1);
+                return request(drogon::Post, std::string("/api/v1/entities/") + kItems,
+                               {{"title", "load_" + std::to_string(n)}, {"value", static_cast<int>(n % 1000000)}});
+            }});
+            ops.push_back({"login", auth, [this](std::mt19937_64 &rng) {
+                return request(drogon::Post, std::string("/api/v1/auth/") + kUsers + "/login",
+                               {{"identity", m_users[rng() % m_users.size()]}, {"password", kPassword}});
+            }});
+            return openLoop("mixed", ops, m_cfg.rps);
+        }
+
+        json runList() {
+            const auto existing = static_cast<int>(m_ids.size());
+            if (m_cfg.rows > existing) insertItems(m_cfg.rows - existing);
+            auto cursors = collectCursors();
+            if (cursors.empty()) cursors.emplace_back();
+
+            std::vector<Op> ops;
+            ops.push_back({"first_page", 1, [](std::mt19937_64 &) {
+                return request(drogon::Get, std::string("/api/v1/entities/") + kItems + "?limit=50&approx=true");
+            }});
+            ops.push_back({"deep_page", 1, [cursors](std::mt19937_64 &rng) {
+                return request(drogon::Get, std::string("/api/v1/entities/") + kItems + "?limit=50&after=" +
+                                            cursors[rng() % cursors.size()]);
+            }});
+            ops.push_back({"sorted_page", 1, [](std::mt19937_64 &) {
+                return request(drogon::Get, std::string("/api/v1/entities/") + kItems + "?limit=50&sort=-value");
+            }});
+
+            auto result = openLoop("list", ops, m_cfg.rps);
+            result["rows"] = std::max(existing, m_cfg.rows);
+            return result;
+        }
+
+        json runFanout(int subscribers, double rps, int duration);
+
+        json runSweep() {
+            json runs = json::array();
+            for (const auto subscribers: m_cfg.sweepSubscribers)
+                for (const auto rps: m_cfg.sweepRps)
+                    runs.push_back(runFanout(subscribers, rps, m_cfg.sweepDuration));
+            return {{"name", "sweep"}, {"runs", runs}};
+        }
+
+    private:
+        void insertItems(const int count) {
+            TestHttp::Client cli("127.0.0.1", m_cfg.port);
+            const TestHttp::Headers auth = {{"Authorization", "Bearer " + m_token}};
+            for (int done = 0; done < count;) {
+                const auto n = std::min(1000, count - done);
+                json ops = json::array();
+                for (int i = 0; i < n; ++i) {
+                    const auto v = done + i;
+                    ops.push_back({{"op", "create"}, {"data", {{"title", "seed_" + std::to_string(v)},
+                                                               {"value", (v * 7919) % 1000003}}}});
+                }
+                cli.Post(std::string("/api/v1/entities/") + kItems + "/batch", auth,
+                         json{{"ops", ops}}.dump(), "application/json");
+                done += n;
+            }
+        }
+
+        /// @brief Walk the table, calling `page` on each page body.
+        void walk(const std::function<void(const json &)> &page) const {
+            TestHttp::Client cli("127.0.0.1", m_cfg.port);
+            std::string after;
+            do {
+                auto path = std::string("/api/v1/entities/") + kItems + "?limit=500";
+                if (!after.empty()) path += "&after=" + drogon::utils::urlEncodeComponent(after);
+                const auto res = cli.Get(path);
+                if (!res || res->status != 200) return;
+                const auto body = json::parse(res->body);
+                page(body["data"]);
+                after = body["data"].value("cursor", "");
+            } while (!after.empty());
+        }
+
+        std::vector<std::string> collectIds() const {
+            std::vector<std::string> ids;
+            walk([&](const json &data) {
+                for (const auto &item: data["items"]) ids.push_back(item["id"].get<std::string>());
+            });
+            return ids;
+        }
+
+        std::vector<std::string> collectCursors() const {
+            std::vector<std::string> cursors;
+            walk([&](const json &data) {
+                if (const auto c = data.value("cursor", ""); !c.empty())
+                    cursors.push_back(drogon::utils::urlEncodeComponent(c));
+            });
+            return cursors;
+        }
+
+        std::vector<std::unique_ptr<Worker>> makeWorkers(const std::size_t op_count) const {
+            std::vector<std::unique_ptr<Worker>> workers;
+            const auto url = "http://127.0.0.1:" + std::to_string(m_cfg.port);
+            for (int t = 0; t < m_cfg.threads; ++t) {
+                auto w = std::make_unique<Worker>();
+                w->loop = std::make_unique<trantor::EventLoopThread>();
+                w->loop->run();
+                const auto conns = std::max(1, m_cfg.connections / m_cfg.threads);
+                for (int c = 0; c < conns; ++c)
+                    w->clients.push_back(drogon::HttpClient::newHttpClient(url, w->loop->getLoop()));
+                w->latency.resize(op_count);
+                w->errors.resize(op_count, 0);
+                w->rng.seed(t + 1);
+                workers.push_back(std::move(w));
+            }
+            return workers;
+        }
+
+        /**
+         * @brief Send `ops` at `rps` for the configured duration.
+         *
+         * Requests go out when they're due regardless of earlier responses;
+         * each is timed from its due time.
+         */
+        json openLoop(const std::string &name, const std::vector<Op> &ops, const double rps) {
+            auto workers = makeWorkers(ops.size());
+            std::vector<double> weights;
+            for (const auto &op: ops) weights.push_back(op.weight);
+            std::discrete_distribution<std::size_t> pick(weights.begin(), weights.end());
+            std::mt19937_64 rng(42);
+
+            std::atomic<std::int64_t> inflight{0};
+            std::uint64_t sent = 0;
+            const auto start = Clock::now();
+            const auto end = start + std::chrono::seconds(duration);
+            for (std::uint64_t i = 0;; ++i) {
+                const auto due = start + std::chrono::nanoseconds(
+                                     static_cast<std::int64_t>(static_cast<double>(i) * 1e9 / rps));
+                if (due >= end) break;
+                std::this_thread::sleep_until(due);
+
+                auto *w = workers[i % workers.size()].get();
+                const auto op = pick(rng);
+                inflight.fetch_add(1);
+                ++sent;
+                w->loop->getLoop()->queueInLoop([w, op, due, &ops, &inflight] {
+                    auto req = ops[op].make(w->rng);
+                    const auto &client = w->clients[w->next++ % w->clients.size()];
+                    client->sendRequest(req, [w, op, due, &inflight](const drogon::ReqResult result,
+                                                                     const drogon::HttpResponsePtr &resp) {
+                        w->latency[op].record(Clock::now() - due);
+                        if (result != drogon::ReqResult::Ok || !resp || static_cast<int>(resp->statusCode()) >= 400)
+                            ++w->errors[op];
+                        inflight.fetch_sub(1);
+                    }, 10.0);
+                });
+            }
+            const auto sent_for = Clock::now() - start;
+
+            const auto drain_deadline = Clock::now() + std::chrono::seconds(15);
+            while (inflight.load() > 0 && Clock::now() < drain_deadline)
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+            Histogram total;
+            std::uint64_t errors = 0;
+            json by_op = json::object();
+            for (std::size_t op = 0; op < ops.size(); ++op) {
+                Histogram h;
+                std::uint64_t e = 0;
+                for (const auto &w: workers) {
+                    const auto [lat, err] = w->sync([&] { return std::make_pair(w->latency[op], w->errors[op]); });
+                    h.merge(lat);
+                    e += err;
+                }
+                total.merge(h);
+                errors += e;
+                by_op[ops[op].name] = {{"latency_ms", h.toJson()}, {"errors", e}};
+            }
+
+            const auto completed = total.count();
+            return {
+                {"name", name},
+                {"target_rps", rps},
+                {"achieved_rps", completed / std::chrono::duration<double>(sent_for).count()},
+                {"sent", sent},
+                {"completed", completed},
+                {"timed_out", static_cast<std::uint64_t>(std::max<std::int64_t>(0, inflight.load()))},
+                {"errors", errors},
+                {"latency_ms", total.toJson()},
+                {"ops", by_op}
+            };
+        }
+
+        Config m_cfg;
+        fs::path m_dir;
+        std::thread m_serverThread;
+        std::string m_token;
+        std::vector<std::string> m_users, m_ids;
+        std::atomic<std::uint64_t> m_written{0};
+    };
+
+    /// @brief SSE subscribers sharing a loop, with the delivery latencies they saw.
+    struct SubscriberGroup {
+        std::unique_ptr<trantor::EventLoopThread> loop;
+        std::vector<std::shared_ptr<trantor::TcpClient>> clients;
+        std::vector<std::string> buffers;
+        Histogram latency;
+        Histogram commitLatency; ///> From the change's `committed_at`
+        std::uint64_t connected = 0, events = 0;
+    };
+
+    /// @brief Record the latency of every tagged change in `buf`, keeping a partial frame for next time.
+    void scanFrames(std::string &buf, SubscriberGroup &group) {
+        std::size_t pos = 0;
+        while (true) {
+            const auto frame_end = buf.find("\n\n", pos);
+            if (frame_end == std::string::npos) break;
+            for (auto tag = buf.find(kFanoutTag, pos); tag != std::string::npos && tag < frame_end;
+                 tag = buf.find(kFanoutTag, tag + 1)) {
+                const auto sent = std::strtoll(buf.c_str() + tag + std::strlen(kFanoutTag), nullptr, 10);
+                group.latency.record(Clock::now().time_since_epoch() - std::chrono::nanoseconds(sent));
+                ++group.events;
+            }
+            // Stamped by the server in epoch microseconds, so against the wall clock
+            if (const auto at = buf.find("\"committed_at\":", pos); at != std::string::npos && at < frame_end) {
+                const auto committed = std::strtoll(buf.c_str() + at + std::strlen("\"committed_at\":"), nullptr, 10);
+                group.commitLatency.record(std::chrono::system_clock::now().time_since_epoch() -
+                                           std::chrono::microseconds(committed));
+            }
+            pos = frame_end + 2;
+        }
+        buf.erase(0, pos);
+    }
+
+    json LoadTest::runFanout(const int subscribers, const double rps, const int duration) {
+        const auto groups_n = std::max(1, m_cfg.threads);
+        std::vector<std::unique_ptr<SubscriberGroup>> groups;
+        const trantor::InetAddress addr("127.0.0.1", static_cast<uint16_t>(m_cfg.port));
+        const auto handshake = "GET /api/v1/realtime?topics=" + std::string(kItems) +
+                               " HTTP/1.1\r\nHost: 127.0.0.1\r\nAccept: text/event-stream\r\n\r\n";
+
+        for (int g = 0; g < groups_n; ++g) {
+            auto group = std::make_unique<SubscriberGroup>();
+            group->loop = std::make_unique<trantor::EventLoopThread>();
+            group->loop->run();
+            groups.push_back(std::move(group));
+        }
+
+        const auto connect_start = Clock::now();
+        for (int i = 0; i < subscribers; ++i) {
+            auto *group = groups[i % groups_n].get();
+            group->loop->getLoop()->runInLoop([group, addr, handshake, i] {
+                const auto index = group->buffers.size();
+                group->buffers.emplace_back();
+                auto client = std::make_shared<trantor::TcpClient>(group->loop->getLoop(), addr,
+                                                                   "sub" + std::to_string(i));
+                client->setConnectionCallback([group, handshake](const trantor::TcpConnectionPtr &conn) {
+                    if (conn->connected()) {
+                        ++group->connected;
+                        conn->send(handshake);
+                    }
+                });
+                client->setMessageCallback([group, index](const trantor::TcpConnectionPtr &,
+                                                          trantor::MsgBuffer *msg) {
+                    auto &buf = group->buffers[index];
+                    buf.append(msg->peek(), msg->readableBytes());
+                    msg->retrieveAll();
+                    scanFrames(buf, *group);
+                });
+                client->connect();
+                group->clients.push_back(std::move(client));
+            });
+        }
+
+        // Wait for the sessions to be registered before writing
+        std::uint64_t connected = 0;
+        for (int tries = 0; tries < 300; ++tries) {
+            connected = 0;
+            for (const auto &g: groups) {
+                std::promise<std::uint64_t> p;
+                g->loop->getLoop()->runInLoop([&] { p.set_value(g->connected); });
+                connected += p.get_future().get();
+            }
+            if (connected >= static_cast<std::uint64_t>(subscribers)) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        const auto connect_time = Clock::now() - connect_start;
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        // Writes carry their send time; subscribers diff it against their receive time
+        TestHttp::Client writer("127.0.0.1", m_cfg.port);
+        std::uint64_t writes = 0;
+        const auto start = Clock::now();
+        const auto end = start + std::chrono::seconds(m_cfg.duration);
+        for (std::uint64_t i = 0;; ++i) {
+            const auto due = start + std::chrono::nanoseconds(
+                                 static_cast<std::int64_t>(static_cast<double>(i) * 1e9 / rps));
+            if (due >= end) break;
+            std::this_thread::sleep_until(due);
+            const auto tag = kFanoutTag + std::to_string(Clock::now().time_since_epoch().count());
+            if (const auto res = writer.Post(std::string("/api/v1/entities/") + kItems,
+                                             json{{"title", tag}, {"value", static_cast<int>(i)}}.dump(),
+                                             "application/json"); res && res->status < 400)
+                ++writes;
+        }
+        // A single writer falls behind rates its round trip can't keep up with
+        const auto write_time = std::chrono::duration<double>(Clock::now() - start).count();
+        std::this_thread::sleep_for(std::chrono::seconds(2));
+
+        Histogram total, commit;
+        std::uint64_t events = 0;
+        for (const auto &g: groups) {
+            std::promise<void> done;
+            g->loop->getLoop()->runInLoop([&] {
+                total.merge(g->latency);
+                commit.merge(g->commitLatency);
+                events += g->events;
+                for (const auto &c: g->clients) c->disconnect();
+                done.set_value();
+            });
+            done.get_future().get();
+        }
+        // Connections close on their loops before the clients and loops go away
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        for (const auto &g: groups) {
+            std::promise<void> done;
+            g->loop->getLoop()->runInLoop([&] {
+                g->clients.clear();
+                done.set_value();
+            });
+            done.get_future().get();
+        }
+
+        const auto expected = writes * connected;
+        return {
+            {"name", "fanout"},
+            {"subscribers", subscribers},
+            {"connected", connected},
+            {"connect_s", std::chrono::duration<double>(connect_time).count()},
+            {"writes", writes},
+            {"target_rps", rps},
+            {"achieved_rps", write_time > 0 ? static_cast<double>(writes) / write_time : 0.0},
+            {"delivered", events},
+            {"delivery_ratio", expected ? static_cast<double>(events) / static_cast<double>(expected) : 0.0},
+            {"latency_ms", total.toJson()},
+            {"commit_latency_ms", commit.toJson()}
+        };
+    }
+
+    /// @brief Comma-separated list of numbers, e.g. `1,100,1000`.
+    template<typename T>
+    std::vector<T> parseList(const std::string &value) {
+        std::vector<T> out;
+        std::size_t at = 0;
+        while (at <= value.size()) {
+            const auto next = std::min(value.find(',', at), value.size());
+            if (next > at) out.push_back(static_cast<T>(std::stod(value.substr(at, next - at))));
+            at = next + 1;
+        }
+        return out;
+    }
+
+    [[noreturn]] void usage(const int code) {
+        std::cerr <<
+                "Usage: mantisbase_load [options]\n"
+                "  --db sqlite|psql        Database (psql reads --db-url or MB_BENCH_PG_URL)\n"
+                "  --db-url <conn>         Connection string for psql\n"
+                "  --scenario <name>       mixed, list, fanout, sweep or all (default all)\n"
+                "  --rps <n>               Request rate for mixed/list (default 1000)\n"
+                "  --duration <s>          Seconds per scenario (default 20)\n"
+                "  --threads <n>           Client event loops\n"
+                "  --connections <n>       HTTP connections in total (default 64)\n"
+                "  --mix r:w:a             Read:write:auth weights for mixed (default 70:20:10)\n"
+                "  --rows <n>              Table size for list (default 100000)\n"
+                "  --subscribers <n>       SSE clients for fanout (default 10000)\n"
+                "  --fanout-rps <n>        Writes per second for fanout (default 10)\n"
+                "  --sweep-subscribers <l> SSE client counts for sweep (default 1,100,1000)\n"
+                "  --sweep-rps <l>         Write rates for sweep (default 10,100,1000)\n"
+                "  --sweep-duration <s>    Seconds per sweep run (default 5)\n"
+                "  --port <n>              Server port (default 7091)\n"
+                "  --out <file>            Write the JSON report here instead of stdout\n";
+        std::exit(code);
+    }
+
+    Config parseArgs(const int argc, char **argv) {
+        Config cfg;
+        if (const char *url = std::getenv("MB_BENCH_PG_URL")) cfg.dbUrl = url;
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            if (arg == "-h" || arg == "--help") usage(0);
+            if (i + 1 >= argc) usage(1);
+            const std::string value = argv[++i];
+            if (arg == "--db") cfg.db = value;
+            else if (arg == "--db-url") cfg.dbUrl = value;
+            else if (arg == "--scenario") cfg.scenario = value;
+            else if (arg == "--rps") cfg.rps = std::stod(value);
+            else if (arg == "--duration") cfg.duration = std::stoi(value);
+            else if (arg == "--threads") cfg.threads = std::max(1, std::stoi(value));
+            else if (arg == "--connections") cfg.connections = std::max(1, std::stoi(value));
+            else if (arg == "--rows") cfg.rows = std::stoi(value);
+            else if (arg == "--subscribers") cfg.subscribers = std::stoi(value);
+            else if (arg == "--fanout-rps") cfg.fanoutRps = std::stod(value);
+            else if (arg == "--sweep-subscribers") cfg.sweepSubscribers = parseList<int>(value);
+            else if (arg == "--sweep-rps") cfg.sweepRps = parseList<double>(value);
+            else if (arg == "--sweep-duration") cfg.sweepDuration = std::stoi(value);
+            else if (arg == "--port") cfg.port = std::stoi(value);
+            else if (arg == "--out") cfg.out = value;
+            else if (arg == "--mix") {
+                std::size_t a = value.find(':'), b = value.find(':', a + 1);
+                if (a == std::string::npos || b == std::string::npos) usage(1);
+                cfg.mix = {std::stod(value.substr(0, a)), std::stod(value.substr(a + 1, b - a - 1)),
+                           std::stod(value.substr(b + 1))};
+            } else usage(1);
+        }
+        if (cfg.db != "sqlite" && cfg.db != "psql") usage(1);
+        if (cfg.db == "psql" && cfg.dbUrl.empty()) {
+            std::cerr << "psql needs --db-url or MB_BENCH_PG_URL\n";
+            std::exit(1);
+        }
+        if (cfg.rps <= 0 || cfg.fanoutRps <= 0 || cfg.duration <= 0 || cfg.sweepDuration <= 0) usage(1);
+        if (std::ranges::any_of(cfg.sweepRps, [](const double rps) { return rps <= 0; })) usage(1);
+        return cfg;
+    }
+}
+
+int main(const int argc, char **argv) {
+    const auto cfg = parseArgs(argc, argv);
+    const auto wants = [&](const std::string &name) { return cfg.scenario == "all" || cfg.scenario == name; };
+
+    LoadTest test(cfg);
+    if (!test.startServer()) {
+        std::cerr << "Server did not become healthy\n";
+        return 1;
+    }
+    test.seed();
+
+    json report = {
+        {"database", cfg.db},
+        {"duration_s", cfg.duration},
+        {"threads", cfg.threads},
+        {"connections", cfg.connections},
+        {"scenarios", json::array()}
+    };
+    if (wants("mixed")) report["scenarios"].push_back(test.runMixed());
+    if (wants("list")) report["scenarios"].push_back(test.runList());
+    if (wants("fanout")) report["scenarios"].push_back(test.runFanout(cfg.subscribers, cfg.fanoutRps, cfg.duration));
+    if (cfg.scenario == "sweep") report["scenarios"].push_back(test.runSweep());
+
+    if (cfg.out.empty()) {
+        std::cout << report.dump(2) << std::endl;
+    } else {
+        std::ofstream(cfg.out) << report.dump(2) << std::endl;
+    }
+    return 0;
+}
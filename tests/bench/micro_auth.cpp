@@ -0,0 +1,30 @@
+#include "micro_common.h"
+#include "mantisbase/core/auth.h"
+#include "mantisbase/core/session_cache.h"
+
+// Token verification with the session already in the session cache (0),
+// and with the cache entry dropped before every call (1), so the session is
+// looked up in the session store each time.
+
+static void BM_VerifyToken(benchmark::State &state) {
+    const bool cached = state.range(0) == 0;
+    micro::app();
+    const auto token = mb::Auth::createToken({{"id", "u_123"}, {"entity", "users"}}, 3600);
+
+    const auto first = mb::Auth::verifyToken(token);
+    if (!first.value("verified", false)) {
+        state.SkipWithError(first.value("error", std::string("Token not verified")).c_str());
+        return;
+    }
+    const auto session_id = first["claims"].value("session_id", std::string());
+    state.SetLabel(cached ? "session cached" : "session store");
+
+    auto &cache = mb::Auth::sessionCache();
+    const auto before = micro::allocated();
+    for (auto _: state) {
+        if (!cached) cache.erase(session_id);
+        benchmark::DoNotOptimize(mb::Auth::verifyToken(token));
+    }
+    micro::report(state, state.iterations(), before);
+}
+BENCHMARK(BM_VerifyToken)->Arg(0)->Arg(1);
@@ -0,0 +1,67 @@
+#include <soci/soci.h>
+#include <vector>
+
+#include "micro_common.h"
+#include "mantisbase/utils/soci_wrappers.h"
+
+// Row <-> JSON conversion of one record of state.range(0) columns, as the
+// entity CRUD paths call it with the raw field list (a codec per call).
+
+namespace {
+    std::vector<nlohmann::json> fieldList(const int columns) {
+        const auto fields = micro::wideFields(columns);
+        return {fields.begin(), fields.end()};
+    }
+
+    void seed(soci::session &sql, const int columns) {
+        std::string cols, names, vals;
+        for (const auto &f: micro::wideFields(columns)) {
+            const auto name = f["name"].get<std::string>();
+            const auto type = f["type"].get<std::string>();
+            cols += (cols.empty() ? "" : ", ") + name +
+                    (type == "int" || type == "bool" ? " INTEGER" : type == "double" ? " REAL" : " TEXT");
+        }
+        sql << "CREATE TABLE micro_rows (" + cols + ")";
+
+        const auto record = micro::wideRecord(columns, 7);
+        for (const auto &[key, value]: record.items()) {
+            vals += vals.empty() ? "" : ", ";
+            vals += value.is_string() ? "'" + value.get<std::string>() + "'"
+                                      : value.is_boolean() ? (value.get<bool>() ? "1" : "0") : value.dump();
+            names += (names.empty() ? "" : ", ") + key;
+        }
+        sql << "INSERT INTO micro_rows (" + names + ") VALUES (" + vals + ")";
+    }
+}
+
+static void BM_SociRow2Json(benchmark::State &state) {
+    const auto columns = static_cast<int>(state.range(0));
+    soci::session sql("sqlite3", ":memory:");
+    seed(sql, columns);
+    const auto fields = fieldList(columns);
+
+    soci::row row;
+    sql << "SELECT * FROM micro_rows", soci::into(row);
+
+    const auto before = micro::allocated();
+    for (auto _: state) {
+        auto record = mb::sociRow2Json(row, fields);
+        benchmark::DoNotOptimize(record);
+    }
+    micro::report(state, state.iterations(), before);
+}
+BENCHMARK(BM_SociRow2Json)->Arg(8)->Arg(32)->Arg(128);
+
+static void BM_Json2SociValue(benchmark::State &state) {
+    const auto columns = static_cast<int>(state.range(0));
+    const auto fields = micro::wideFields(columns);
+    const auto record = micro::wideRecord(columns, 7);
+
+    const auto before = micro::allocated();
+    for (auto _: state) {
+        auto vals = mb::json2SociValue(record, fields);
+        benchmark::DoNotOptimize(vals);
+    }
+    micro::report(state, state.iterations(), before);
+}
+BENCHMARK(BM_Json2SociValue)->Arg(8)->Arg(32)->Arg(128);
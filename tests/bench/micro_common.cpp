@@ -0,0 +1,129 @@
+#include "micro_common.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+namespace {
+    thread_local std::uint64_t t_bytes = 0;
+    thread_local std::uint64_t t_count = 0;
+
+    void *allocate(const std::size_t size) noexcept {
+        t_bytes += size;
+        ++t_count;
+        return std::malloc(size ? size : 1);
+    }
+
+    void *allocateOrThrow(const std::size_t size) {
+        if (auto *p = allocate(size)) return p;
+        throw std::bad_alloc();
+    }
+}
+
+// Every plain allocation of the binary, the library's included, comes through here.
+// Over-aligned ones keep the default operators and aren't counted.
+void *operator new(const std::size_t size) { return allocateOrThrow(size); }
+void *operator new[](const std::size_t size) { return allocateOrThrow(size); }
+void *operator new(const std::size_t size, const std::nothrow_t &) noexcept { return allocate(size); }
+void *operator new[](const std::size_t size, const std::nothrow_t &) noexcept { return allocate(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { std::free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { std::free(p); }
+
+namespace micro {
+    namespace fs = std::filesystem;
+
+    Allocs allocated() {
+        return {t_bytes, t_count};
+    }
+
+    void report(benchmark::State &state, const std::int64_t items, const Allocs &before) {
+        const auto now = allocated();
+        const auto per = static_cast<double>(std::max<std::int64_t>(items, 1));
+        state.SetItemsProcessed(items);
+        state.counters["bytes_per_item"] = static_cast<double>(now.bytes - before.bytes) / per;
+        state.counters["allocs_per_item"] = static_cast<double>(now.count - before.count) / per;
+    }
+
+    const fs::path &workDir() {
+        static const fs::path dir = [] {
+            auto path = fs::temp_directory_path() / "mantisbase_microbench" / mb::generateShortId();
+            fs::create_directories(path);
+            return path;
+        }();
+        return dir;
+    }
+
+    mb::MantisBase &app() {
+        static mb::MantisBase &instance = []() -> mb::MantisBase & {
+#ifdef _WIN32
+            _putenv_s("MB_DISABLE_ADMIN_ON_FIRST_BOOT", "1");
+#else
+            setenv("MB_DISABLE_ADMIN_ON_FIRST_BOOT", "1", 1);
+#endif
+            mb::json args;
+            args["dev"] = true;
+            args["database"] = "SQLITE";
+            args["dataDir"] = (workDir() / "data").string();
+            args["publicDir"] = (workDir() / "www").string();
+            return mb::MantisBase::create(args);
+        }();
+        return instance;
+    }
+
+    mb::Entity ensureEntity(const std::string &name, const nlohmann::json &fields) {
+        auto &a = app();
+        if (!a.hasEntity(name)) {
+            const nlohmann::json public_rule = {{"mode", "public"}};
+            const nlohmann::json schema = {
+                {"name", name},
+                {"type", "base"},
+                {"rules", {
+                    {"list", public_rule}, {"get", public_rule}, {"add", public_rule},
+                    {"update", public_rule}, {"delete", public_rule}
+                }},
+                {"fields", fields}
+            };
+            mb::EntitySchema::createTable(mb::EntitySchema::fromSchema(a, schema));
+        }
+        return a.entity(name);
+    }
+
+    nlohmann::json wideFields(const int count) {
+        auto fields = nlohmann::json::array();
+        fields.push_back({
+            {"name", "email"}, {"type", "string"}, {"required", true},
+            {"constraints", {{"validator", "@email"}}}
+        });
+        for (int i = 1; i < count; ++i) {
+            const auto n = std::to_string(i);
+            switch (i % 4) {
+                case 0: fields.push_back({{"name", "s" + n}, {"type", "string"},
+                                          {"constraints", {{"max_value", 64}}}}); break;
+                case 1: fields.push_back({{"name", "i" + n}, {"type", "int"},
+                                          {"constraints", {{"min_value", 0}}}}); break;
+                case 2: fields.push_back({{"name", "d" + n}, {"type", "double"},
+                                          {"constraints", {{"max_value", 1e9}}}}); break;
+                default: fields.push_back({{"name", "b" + n}, {"type", "bool"}}); break;
+            }
+        }
+        return fields;
+    }
+
+    nlohmann::json wideRecord(const int count, const int seed) {
+        nlohmann::json record = {{"email", "user" + std::to_string(seed) + "@example.com"}};
+        for (int i = 1; i < count; ++i) {
+            const auto n = std::to_string(i);
+            switch (i % 4) {
+                case 0: record["s" + n] = "value_" + std::to_string(seed * count + i); break;
+                case 1: record["i" + n] = seed + i; break;
+                case 2: record["d" + n] = seed * 0.5 + i; break;
+                default: record["b" + n] = (seed + i) % 2 == 0; break;
+            }
+        }
+        return record;
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef MANTISBASE_MICRO_COMMON_H
+#define MANTISBASE_MICRO_COMMON_H
+
+#include <benchmark/benchmark.h>
+#include <nlohmann/json.hpp>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+#include "mantisbase/mantis.h"
+
+// Shared pieces of the in-process component benchmarks (mantisbase_microbench):
+// no server runs, each benchmark calls the component it measures directly.
+
+namespace micro {
+    /// Heap use of the calling thread since it started, counted by the global operator new
+    struct Allocs {
+        std::uint64_t bytes = 0;
+        std::uint64_t count = 0;
+    };
+
+    Allocs allocated();
+
+    /**
+     * Report `items` processed between `before` and now: `items_per_second`,
+     * plus `bytes_per_item` and `allocs_per_item` made by this thread.
+     * Work handed to other threads (e.g. the log writer) isn't counted.
+     */
+    void report(benchmark::State &state, std::int64_t items, const Allocs &before);
+
+    /// The one application of the process, created on first use over a temporary data dir, never served.
+    mb::MantisBase &app();
+
+    /// Per-run directory under the system temp dir, for the app and benchmarks that open their own files
+    const std::filesystem::path &workDir();
+
+    /**
+     * Create `name` with `fields` and public rules, if it doesn't exist.
+     * @return The entity as the routes see it
+     */
+    mb::Entity ensureEntity(const std::string &name, const nlohmann::json &fields);
+
+    /// `count` fields cycling through string, int, double and bool, named after their type
+    nlohmann::json wideFields(int count);
+
+    /// A record for wideFields(count), its values varying with `seed`
+    nlohmann::json wideRecord(int count, int seed);
+}
+
+#endif // MANTISBASE_MICRO_COMMON_H
@@ -0,0 +1,31 @@
+#include "micro_common.h"
+#include "mantisbase/core/logger/log_database.h"
+
+// Log entries queued in bursts of state.range(0), each burst flushed before
+// the next, so items/s is entries written. flush() writes on the calling
+// thread what the batching writer hasn't taken yet; the allocation figures
+// only include that part of the writes.
+
+static void BM_LogDatabaseInsert(benchmark::State &state) {
+    const auto burst = state.range(0);
+    const auto dir = micro::workDir() / ("logs_" + std::to_string(burst));
+    std::filesystem::create_directories(dir);
+
+    mb::LogDatabase logs;
+    if (!logs.init(dir.string())) {
+        state.SkipWithError("Could not open the log database");
+        return;
+    }
+    const nlohmann::json data = {{"request_id", "r_123"}, {"status", 200}, {"path", "/api/v1/entities/posts"}};
+
+    std::int64_t queued = 0;
+    const auto before = micro::allocated();
+    for (auto _: state) {
+        for (std::int64_t i = 0; i < burst; ++i)
+            queued += logs.insertLog("info", "Entity", "Record Created", "Created a record in `posts`", data) ? 1 : 0;
+        logs.flush();
+    }
+    micro::report(state, queued, before);
+    state.counters["dropped"] = static_cast<double>(state.iterations() * burst - queued);
+}
+BENCHMARK(BM_LogDatabaseInsert)->Arg(1)->Arg(64)->Arg(1024)->UseRealTime();
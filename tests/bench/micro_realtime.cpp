@@ -0,0 +1,135 @@
+#include <drogon/HttpResponse.h>
+#include <drogon/WebSocketConnection.h>
+#include <trantor/net/AsyncStream.h>
+#include <trantor/net/InetAddress.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "micro_common.h"
+#include "mantisbase/core/router.h"
+#include "mantisbase/core/sse.h"
+#include "mantisbase/core/ws.h"
+
+// One change fanned out to state.range(0) subscribers of its entity. There is
+// no IO loop on the benchmark thread, so each send queue drains inline into a
+// sink that only counts bytes: the figures cover routing, rule checks, framing
+// and queueing, not the sockets.
+
+namespace {
+    std::atomic<std::int64_t> g_sent{0};
+
+    class NullStream final : public trantor::AsyncStream {
+    public:
+        bool send(const char *, const size_t len) override {
+            g_sent.fetch_add(static_cast<std::int64_t>(len), std::memory_order_relaxed);
+            return true;
+        }
+
+        void close() override {}
+    };
+
+    class NullConnection final : public drogon::WebSocketConnection {
+    public:
+        void send(const char *, const uint64_t len, const drogon::WebSocketMessageType) override {
+            g_sent.fetch_add(static_cast<std::int64_t>(len), std::memory_order_relaxed);
+        }
+
+        void send(const std::string_view msg, const drogon::WebSocketMessageType type) override {
+            send(msg.data(), msg.size(), type);
+        }
+
+        void sendJson(const Json::Value &, const drogon::WebSocketMessageType) override {}
+        const trantor::InetAddress &localAddr() const override { return m_addr; }
+        const trantor::InetAddress &peerAddr() const override { return m_addr; }
+        bool connected() const override { return true; }
+        bool disconnected() const override { return false; }
+        void shutdown(const drogon::CloseCode, const std::string &) override {}
+        void forceClose() override {}
+        void setPingMessage(const std::string &, const std::chrono::duration<double> &) override {}
+        void disablePing() override {}
+
+    private:
+        trantor::InetAddress m_addr;
+    };
+
+    constexpr auto kEntity = "micro_posts";
+
+    void ensurePosts() {
+        micro::ensureEntity(kEntity, nlohmann::json::array({
+            {{"name", "title"}, {"type", "string"}},
+            {{"name", "body"}, {"type", "string"}},
+            {{"name", "views"}, {"type", "int"}}
+        }));
+    }
+
+    /// Updates to a few rows, built ahead so the loop only measures the fan-out
+    const std::vector<nlohmann::json> &changes() {
+        static const auto list = [] {
+            std::vector<nlohmann::json> out;
+            for (int i = 0; i < 64; ++i) {
+                const auto id = "p" + std::to_string(i);
+                out.push_back({
+                    {"type", "UPDATE"},
+                    {"entity", kEntity},
+                    {"row_id", id},
+                    {"timestamp", 1700000000 + i},
+                    {"new_data", {{"id", id}, {"title", "Post " + id}, {"body", std::string(200, 'x')}, {"views", i}}}
+                });
+            }
+            return out;
+        }();
+        return list;
+    }
+}
+
+static void BM_SSEBroadcastChange(benchmark::State &state) {
+    ensurePosts();
+    auto &sse = micro::app().router().sseMgr();
+    const auto sessions = state.range(0);
+
+    std::vector<std::string> ids;
+    for (std::int64_t i = 0; i < sessions; ++i)
+        ids.push_back(sse.createSession({kEntity},
+                                        std::make_unique<drogon::ResponseStream>(std::make_unique<NullStream>())));
+
+    const auto &events = changes();
+    std::size_t i = 0;
+    const auto sent = g_sent.load();
+    const auto before = micro::allocated();
+    for (auto _: state) {
+        sse.broadcastChange(events[i++ % events.size()]);
+    }
+    micro::report(state, state.iterations() * sessions, before);
+    state.SetBytesProcessed(g_sent.load() - sent);
+
+    for (const auto &id: ids) sse.removeSession(id);
+}
+BENCHMARK(BM_SSEBroadcastChange)->Arg(1)->Arg(64)->Arg(1024);
+
+static void BM_WSBroadcastChange(benchmark::State &state) {
+    ensurePosts();
+    auto &ws = micro::app().router().sseMgr().wsMgr();
+    const auto connections = state.range(0);
+
+    std::vector<drogon::WebSocketConnectionPtr> conns;
+    for (std::int64_t i = 0; i < connections; ++i) {
+        const auto &conn = conns.emplace_back(std::make_shared<NullConnection>());
+        ws.addConnection(conn);
+        ws.subscribe(conn, {kEntity});
+    }
+
+    const auto &events = changes();
+    std::size_t i = 0;
+    const auto sent = g_sent.load();
+    const auto before = micro::allocated();
+    for (auto _: state) {
+        ws.broadcastChange(events[i++ % events.size()]);
+    }
+    micro::report(state, state.iterations() * connections, before);
+    state.SetBytesProcessed(g_sent.load() - sent);
+
+    for (const auto &conn: conns) ws.removeConnection(conn);
+}
+BENCHMARK(BM_WSBroadcastChange)->Arg(1)->Arg(64)->Arg(1024);
@@ -0,0 +1,71 @@
+#include <string>
+#include <vector>
+
+#include "micro_common.h"
+#include "mantisbase/core/expr_evaluator.h"
+#include "mantisbase/core/models/validators.h"
+
+// Access rules as the entity routes evaluate them, through the script
+// engine (Expr::eval) and precompiled (CompiledExpr), and create-body
+// validation against a wide entity.
+
+namespace {
+    const std::vector<std::string> &rules() {
+        static const std::vector<std::string> list = {
+            "@auth.id != null",
+            "@auth.id == @req.body.owner",
+            "@auth.entity == 'users' && (@req.body.status == 'draft' || @auth.type == 'admin')",
+        };
+        return list;
+    }
+
+    nlohmann::json vars() {
+        return {
+            {"auth", {{"id", "u_123"}, {"entity", "users"}, {"type", "user"}}},
+            {"req", {{"remoteAddr", "127.0.0.1"}, {"body", {{"owner", "u_123"}, {"status", "draft"}}}}}
+        };
+    }
+}
+
+static void BM_ExprEval(benchmark::State &state) {
+    const auto &rule = rules()[state.range(0)];
+    const auto context = vars();
+    state.SetLabel(rule);
+
+    const auto before = micro::allocated();
+    for (auto _: state) {
+        benchmark::DoNotOptimize(mb::Expr::eval(rule, context));
+    }
+    micro::report(state, state.iterations(), before);
+}
+BENCHMARK(BM_ExprEval)->DenseRange(0, 2);
+
+static void BM_CompiledExprEval(benchmark::State &state) {
+    const auto compiled = mb::CompiledExpr::compile(rules()[state.range(0)]);
+    const auto context = vars();
+    state.SetLabel(compiled->isNative() ? "native" : "script");
+
+    const auto before = micro::allocated();
+    for (auto _: state) {
+        benchmark::DoNotOptimize(compiled->eval(context));
+    }
+    micro::report(state, state.iterations(), before);
+}
+BENCHMARK(BM_CompiledExprEval)->DenseRange(0, 2);
+
+static void BM_ValidateRequestBody(benchmark::State &state) {
+    const auto columns = static_cast<int>(state.range(0));
+    const auto entity = micro::ensureEntity("micro_wide_" + std::to_string(columns), micro::wideFields(columns));
+    const auto body = micro::wideRecord(columns, 7);
+    if (const auto error = mb::Validators::validateRequestBody(entity, body)) {
+        state.SkipWithError(error->c_str());
+        return;
+    }
+
+    const auto before = micro::allocated();
+    for (auto _: state) {
+        benchmark::DoNotOptimize(mb::Validators::validateRequestBody(entity, body));
+    }
+    micro::report(state, state.iterations(), before);
+}
+BENCHMARK(BM_ValidateRequestBody)->Arg(8)->Arg(32)->Arg(128);
@@ -220,3 +220,22 @@ TEST_F(IntegrationAuthTest, UseTokenForAuthenticatedRequest) {
     ASSERT_TRUE(res != nullptr);
     EXPECT_EQ(res->status, 200);
 }
+
+TEST_F(IntegrationAuthTest, PasswordHashesCantBeFilteredOrSortedOn) {
+    TestHttp::Headers headers = {{"Authorization", "Bearer " + adminToken}};
+
+    // password ~ '$2b$10$a%'
+    auto res = client->Get("/api/v1/entities/test_users?filter=password%20~%20%27%242b%2410%24a%25%27", headers);
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 400);
+
+    for (const auto *sort: {"password", "-password"}) {
+        res = client->Get(std::string("/api/v1/entities/test_users?sort=") + sort, headers);
+        ASSERT_TRUE(res != nullptr);
+        EXPECT_EQ(res->status, 400) << sort;
+    }
+
+    res = client->Get("/api/v1/entities/test_users?sort=email", headers);
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 200);
+}
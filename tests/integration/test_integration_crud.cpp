@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include <nlohmann/json.hpp>
+#include <sstream>
 #include "../common/test_environment.h"
 #include "../common/test_helpers.h"
 #include "../common/test_config.h"
@@ -17,6 +18,7 @@ protected:
     }
 
     void TearDown() override {
+        TestHelpers::cleanupTestEntity(*client, "test_reviews", adminToken);
         TestHelpers::cleanupTestEntity(*client, "test_products", adminToken);
         TestHelpers::cleanupTestEntity(*client, "test_users", adminToken);
     }
@@ -172,6 +174,101 @@ TEST_F(IntegrationCRUDTest, GetRecord) {
     EXPECT_EQ(getResponse["data"]["name"], "Get Test Product");
 }
 
+TEST_F(IntegrationCRUDTest, ProjectedFields) {
+    const TestHttp::Headers headers{{"Authorization", "Bearer " + adminToken}};
+    nlohmann::json record = {
+        {"name", "Projected Product"},
+        {"price", 9.99},
+        {"description", "Not requested"}
+    };
+    auto createRes = client->Post("/api/v1/entities/test_products", headers, record.dump(), "application/json");
+    ASSERT_TRUE(createRes != nullptr);
+    ASSERT_EQ(createRes->status, 201);
+    const std::string recordId = nlohmann::json::parse(createRes->body)["data"]["id"];
+
+    auto getRes = client->Get("/api/v1/entities/test_products/" + recordId + "?fields=name,price", headers);
+    ASSERT_TRUE(getRes != nullptr);
+    ASSERT_EQ(getRes->status, 200);
+    auto data = nlohmann::json::parse(getRes->body)["data"];
+    EXPECT_EQ(data["id"], recordId);
+    EXPECT_EQ(data["name"], "Projected Product");
+    EXPECT_TRUE(data.contains("price"));
+    EXPECT_FALSE(data.contains("description"));
+    EXPECT_FALSE(data.contains("created"));
+
+    auto listRes = client->Get("/api/v1/entities/test_products?fields=name&sort=-price", headers);
+    ASSERT_TRUE(listRes != nullptr);
+    ASSERT_EQ(listRes->status, 200);
+    for (const auto &item: nlohmann::json::parse(listRes->body)["data"]["items"]) {
+        EXPECT_TRUE(item.contains("id"));
+        EXPECT_TRUE(item.contains("name"));
+        EXPECT_TRUE(item.contains("price")); // the sort field
+        EXPECT_FALSE(item.contains("description"));
+    }
+
+    auto badRes = client->Get("/api/v1/entities/test_products?fields=name,no_such_field", headers);
+    ASSERT_TRUE(badRes != nullptr);
+    EXPECT_EQ(badRes->status, 400);
+}
+
+TEST_F(IntegrationCRUDTest, ExpandRelations) {
+    const TestHttp::Headers headers{{"Authorization", "Bearer " + adminToken}};
+    const nlohmann::json schema = {
+        {"name", "test_reviews"},
+        {"type", "base"},
+        {"list", {{"mode", "public"}}},
+        {"get", {{"mode", "public"}}},
+        {"add", {{"mode", "auth"}}},
+        {"update", {{"mode", "auth"}}},
+        {"delete", {{"mode", ""}}},
+        {
+            "fields", nlohmann::json::array({
+                {{"name", "body"}, {"type", "string"}},
+                {{"name", "product"}, {"type", "string"}, {"foreign_key", {{"entity", "test_products"}}}}
+            })
+        }
+    };
+    auto schemaRes = client->Post("/api/v1/schemas", headers, schema.dump(), "application/json");
+    ASSERT_TRUE(schemaRes != nullptr);
+    ASSERT_EQ(schemaRes->status, 201);
+
+    auto productRes = client->Post("/api/v1/entities/test_products", headers,
+                                   nlohmann::json{{"name", "Reviewed"}, {"price", 5.0}}.dump(), "application/json");
+    ASSERT_TRUE(productRes != nullptr);
+    ASSERT_EQ(productRes->status, 201);
+    const std::string productId = nlohmann::json::parse(productRes->body)["data"]["id"];
+
+    std::string reviewId;
+    for (int i = 0; i < 3; ++i) {
+        auto res = client->Post("/api/v1/entities/test_reviews", headers,
+                                nlohmann::json{{"body", "Review " + std::to_string(i)}, {"product", productId}}.dump(),
+                                "application/json");
+        ASSERT_TRUE(res != nullptr);
+        ASSERT_EQ(res->status, 201);
+        reviewId = nlohmann::json::parse(res->body)["data"]["id"];
+    }
+
+    auto listRes = client->Get("/api/v1/entities/test_reviews?expand=product&fields=body", headers);
+    ASSERT_TRUE(listRes != nullptr);
+    ASSERT_EQ(listRes->status, 200);
+    const auto list = nlohmann::json::parse(listRes->body)["data"];
+    ASSERT_EQ(list["items"].size(), 3u);
+    EXPECT_FALSE(list["cursor"].get<std::string>().empty());
+    for (const auto &item: list["items"]) {
+        EXPECT_EQ(item["product"], productId);
+        EXPECT_EQ(item["expand"]["product"]["name"], "Reviewed");
+    }
+
+    auto getRes = client->Get("/api/v1/entities/test_reviews/" + reviewId + "?expand=product", headers);
+    ASSERT_TRUE(getRes != nullptr);
+    ASSERT_EQ(getRes->status, 200);
+    EXPECT_EQ(nlohmann::json::parse(getRes->body)["data"]["expand"]["product"]["id"], productId);
+
+    auto badRes = client->Get("/api/v1/entities/test_reviews?expand=body", headers);
+    ASSERT_TRUE(badRes != nullptr);
+    EXPECT_EQ(badRes->status, 400);
+}
+
 TEST_F(IntegrationCRUDTest, UpdateRecord) {
     std::string userToken = createUserAndGetToken();
     ASSERT_FALSE(userToken.empty());
@@ -232,3 +329,192 @@ TEST_F(IntegrationCRUDTest, DeleteRecord) {
     auto getRes = client->Get("/api/v1/entities/test_products/" + recordId, headers);
     EXPECT_EQ(getRes->status, 404);
 }
+
+TEST_F(IntegrationCRUDTest, BatchWrites) {
+    const TestHttp::Headers headers = {{"Authorization", "Bearer " + adminToken}};
+
+    auto createRes = client->Post("/api/v1/entities/test_products", headers,
+                                  nlohmann::json{{"name", "Batch Victim"}, {"price", 5.0}}.dump(),
+                                  "application/json");
+    ASSERT_TRUE(createRes != nullptr);
+    ASSERT_EQ(createRes->status, 201);
+    const std::string victimId = nlohmann::json::parse(createRes->body)["data"]["id"];
+
+    const nlohmann::json batch = {
+        {
+            "ops", nlohmann::json::array({
+                {{"op", "create"}, {"data", {{"name", "Batch A"}, {"price", 1.5}}}},
+                {{"op", "create"}, {"data", {{"name", "Batch B"}, {"price", 2.5}}}},
+                {{"op", "update"}, {"id", victimId}, {"data", {{"price", 6.0}}}},
+                {{"op", "delete"}, {"id", victimId}}
+            })
+        }
+    };
+
+    auto res = client->Post("/api/v1/entities/test_products/batch", headers, batch.dump(), "application/json");
+    ASSERT_TRUE(res != nullptr);
+    ASSERT_EQ(res->status, 200);
+
+    auto items = nlohmann::json::parse(res->body)["data"]["items"];
+    ASSERT_EQ(items.size(), 4u);
+    EXPECT_EQ(items[0]["name"], "Batch A");
+    EXPECT_EQ(items[1]["name"], "Batch B");
+    EXPECT_NE(items[0]["id"], items[1]["id"]);
+    EXPECT_EQ(items[2]["price"], 6.0);
+    EXPECT_EQ(items[3]["id"], victimId);
+
+    auto getRes = client->Get("/api/v1/entities/test_products/" + items[1]["id"].get<std::string>(), headers);
+    ASSERT_TRUE(getRes != nullptr);
+    EXPECT_EQ(getRes->status, 200);
+    getRes = client->Get("/api/v1/entities/test_products/" + victimId, headers);
+    EXPECT_EQ(getRes->status, 404);
+}
+
+TEST_F(IntegrationCRUDTest, BatchRollsBackOnFailure) {
+    const TestHttp::Headers headers = {{"Authorization", "Bearer " + adminToken}};
+
+    // Second create fails validation; nothing is written
+    nlohmann::json batch = {
+        {
+            "ops", nlohmann::json::array({
+                {{"op", "create"}, {"data", {{"name", "Never Written"}, {"price", 1.0}}}},
+                {{"op", "create"}, {"data", {{"name", "Missing price"}}}}
+            })
+        }
+    };
+    auto res = client->Post("/api/v1/entities/test_products/batch", headers, batch.dump(), "application/json");
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 400);
+    EXPECT_EQ(nlohmann::json::parse(res->body)["data"]["index"], 1);
+
+    // A missing record fails the batch in the DB, after the insert ran
+    batch["ops"] = nlohmann::json::array({
+        {{"op", "create"}, {"data", {{"name", "Never Written"}, {"price", 1.0}}}},
+        {{"op", "delete"}, {"id", "does-not-exist"}}
+    });
+    res = client->Post("/api/v1/entities/test_products/batch", headers, batch.dump(), "application/json");
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 404);
+
+    auto listRes = client->Get("/api/v1/entities/test_products?limit=500", headers);
+    ASSERT_TRUE(listRes != nullptr);
+    for (const auto &item: nlohmann::json::parse(listRes->body)["data"]["items"])
+        EXPECT_NE(item["name"], "Never Written");
+}
+
+TEST_F(IntegrationCRUDTest, BatchReads) {
+    const TestHttp::Headers headers = {{"Authorization", "Bearer " + adminToken}};
+
+    auto createRes = client->Post("/api/v1/entities/test_products", headers,
+                                  nlohmann::json{{"name", "Batch Read"}, {"price", 7.0}}.dump(),
+                                  "application/json");
+    ASSERT_TRUE(createRes != nullptr);
+    ASSERT_EQ(createRes->status, 201);
+    const std::string recordId = nlohmann::json::parse(createRes->body)["data"]["id"];
+
+    const nlohmann::json batch = {
+        {
+            "requests", nlohmann::json::array({
+                {{"entity", "test_products"}, {"op", "get"}, {"id", recordId}, {"params", {{"fields", "name"}}}},
+                {{"entity", "test_products"}, {"op", "list"}, {"params", {{"limit", 5}, {"total", true}}}},
+                {{"entity", "test_products"}, {"op", "get"}, {"id", "does-not-exist"}},
+                {{"entity", "no_such_entity"}, {"op", "list"}}
+            })
+        }
+    };
+
+    auto res = client->Post("/api/v1/batch", headers, batch.dump(), "application/json");
+    ASSERT_TRUE(res != nullptr);
+    ASSERT_EQ(res->status, 200);
+
+    // Each read answers on its own, in request order
+    auto responses = nlohmann::json::parse(res->body)["data"]["responses"];
+    ASSERT_EQ(responses.size(), 4u);
+    EXPECT_EQ(responses[0]["status"], 200);
+    EXPECT_EQ(responses[0]["data"]["name"], "Batch Read");
+    EXPECT_FALSE(responses[0]["data"].contains("price"));
+    EXPECT_EQ(responses[1]["status"], 200);
+    EXPECT_GE(responses[1]["data"]["total"].get<int>(), 1);
+    EXPECT_EQ(responses[2]["status"], 404);
+    EXPECT_EQ(responses[3]["status"], 404);
+
+    res = client->Post("/api/v1/batch", headers, nlohmann::json{{"requests", nlohmann::json::array()}}.dump(),
+                       "application/json");
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 400);
+}
+
+TEST_F(IntegrationCRUDTest, ExportRecords) {
+    const TestHttp::Headers headers = {{"Authorization", "Bearer " + adminToken}};
+
+    for (const auto &[name, price]: {std::pair{"Export, \"quoted\"", 150.0}, {"Export cheap", 1.0}, {"Export dear", 200.0}}) {
+        auto res = client->Post("/api/v1/entities/test_products", headers,
+                                nlohmann::json{{"name", name}, {"price", price}}.dump(), "application/json");
+        ASSERT_TRUE(res != nullptr);
+        ASSERT_EQ(res->status, 201);
+    }
+
+    // price >= 100, one record per line in id order
+    auto res = client->Get("/api/v1/entities/test_products/export?filter=price%20%3E%3D%20100", headers);
+    ASSERT_TRUE(res != nullptr);
+    ASSERT_EQ(res->status, 200);
+    std::vector<nlohmann::json> lines;
+    std::istringstream ndjson(res->body);
+    for (std::string line; std::getline(ndjson, line);) lines.push_back(nlohmann::json::parse(line));
+    ASSERT_EQ(lines.size(), 2u);
+    EXPECT_EQ(lines[0]["name"], "Export, \"quoted\"");
+    EXPECT_EQ(lines[1]["name"], "Export dear");
+    EXPECT_LT(lines[0]["id"].get<std::string>(), lines[1]["id"].get<std::string>());
+
+    res = client->Get("/api/v1/entities/test_products/export?format=csv&fields=name,price"
+                      "&filter=price%20%3E%3D%20100", headers);
+    ASSERT_TRUE(res != nullptr);
+    ASSERT_EQ(res->status, 200);
+    EXPECT_EQ(res->body, "id,name,price\r\n" +
+                         lines[0]["id"].get<std::string>() + ",\"Export, \"\"quoted\"\"\",150.0\r\n" +
+                         lines[1]["id"].get<std::string>() + ",Export dear,200.0\r\n");
+
+    res = client->Get("/api/v1/entities/test_products/export?format=xml", headers);
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 400);
+}
+
+TEST_F(IntegrationCRUDTest, ImportRecords) {
+    const TestHttp::Headers headers = {{"Authorization", "Bearer " + adminToken}};
+    const auto imported = [&](const std::string &name) {
+        auto res = client->Get("/api/v1/entities/test_products?filter=name%20%3D%20%27" + name + "%27", headers);
+        EXPECT_TRUE(res != nullptr);
+        return res ? nlohmann::json::parse(res->body)["data"]["items"].size() : 0u;
+    };
+
+    // System fields and unknown keys are ignored
+    auto res = client->Post("/api/v1/entities/test_products/import", headers,
+                            "{\"name\": \"Imported\", \"price\": 3.5, \"id\": \"mine\"}\n\n"
+                            "{\"name\": \"Imported\", \"price\": 4, \"colour\": \"red\"}\n",
+                            "application/x-ndjson");
+    ASSERT_TRUE(res != nullptr);
+    ASSERT_EQ(res->status, 200);
+    EXPECT_EQ(nlohmann::json::parse(res->body)["data"]["imported"], 2);
+    EXPECT_EQ(imported("Imported"), 2u);
+
+    res = client->Post("/api/v1/entities/test_products/import?realtime=false", headers,
+                       "name,price,description\r\n\"CSV, import\",10,\r\n\"CSV, import\",11.5,\"\"\r\n",
+                       "text/csv");
+    ASSERT_TRUE(res != nullptr);
+    ASSERT_EQ(res->status, 200);
+    EXPECT_EQ(nlohmann::json::parse(res->body)["data"]["imported"], 2);
+    EXPECT_EQ(imported("CSV,%20import"), 2u);
+
+    // A record failing validation rolls back the lines before it
+    res = client->Post("/api/v1/entities/test_products/import", headers,
+                       "{\"name\": \"Rolled back\", \"price\": 1}\n{\"name\": \"No price\"}\n",
+                       "application/x-ndjson");
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 400);
+    EXPECT_EQ(nlohmann::json::parse(res->body)["error"].get<std::string>().rfind("line 2:", 0), 0u);
+    EXPECT_EQ(imported("Rolled%20back"), 0u);
+
+    res = client->Post("/api/v1/entities/test_products/import", headers, "{}", "application/json");
+    ASSERT_TRUE(res != nullptr);
+    EXPECT_EQ(res->status, 415);
+}
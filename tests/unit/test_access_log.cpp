@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/logger/access_log.h"
+
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+using mb::AccessLog;
+
+namespace {
+    AccessLog::Options sampled(const double rate) {
+        AccessLog::Options options;
+        options.sampleRate = rate;
+        return options;
+    }
+}
+
+TEST(AccessLog, LogsEverythingByDefault) {
+    AccessLog log;
+    for (int i = 0; i < 100; ++i)
+        EXPECT_TRUE(log.record("/api/v1/entities/posts", 200, 1ms));
+    const auto s = log.snapshot();
+    EXPECT_EQ(s.total.requests, 100u);
+    EXPECT_EQ(s.total.logged, 100u);
+    EXPECT_EQ(s.total.byClass[1], 100u);
+}
+
+TEST(AccessLog, SamplesSuccessesButKeepsErrorsAndSlowRequests) {
+    AccessLog log(sampled(0.0));
+    EXPECT_FALSE(log.record("/a", 200, 1ms));
+    EXPECT_FALSE(log.record("/a", 304, 1ms));
+    EXPECT_TRUE(log.record("/a", 404, 1ms));
+    EXPECT_TRUE(log.record("/a", 503, 1ms));
+    EXPECT_TRUE(log.record("/a", 200, 1500ms));
+
+    const auto s = log.snapshot();
+    EXPECT_EQ(s.total.requests, 5u);
+    EXPECT_EQ(s.total.logged, 3u);
+    EXPECT_EQ(s.total.sampledOut, 2u);
+    EXPECT_EQ(s.total.slow, 1u);
+    EXPECT_EQ(s.total.byClass[3], 1u);
+    EXPECT_EQ(s.total.byClass[4], 1u);
+    EXPECT_NEAR(s.total.totalMs, 1504.0, 1e-6);
+}
+
+TEST(AccessLog, SampleRateIsApproximatelyHonoured) {
+    AccessLog log(sampled(0.1));
+    int logged = 0;
+    for (int i = 0; i < 20000; ++i) logged += log.record("/a", 200, 1ms);
+    EXPECT_GT(logged, 1500);
+    EXPECT_LT(logged, 2500);
+}
+
+TEST(AccessLog, LongestRoutePrefixWins) {
+    auto options = sampled(1.0);
+    options.routes = AccessLog::Options::parseRoutes("/api/v1=1,/api/v1/health=0,bogus,/x=nan");
+    ASSERT_EQ(options.routes.size(), 2u);
+    EXPECT_EQ(options.routes[0].first, "/api/v1/health");
+
+    AccessLog log(options);
+    EXPECT_FALSE(log.record("/api/v1/health", 200, 1ms));
+    EXPECT_TRUE(log.record("/api/v1/health", 500, 1ms));
+    EXPECT_TRUE(log.record("/api/v1/entities", 200, 1ms));
+}
+
+TEST(AccessLog, CapsLinesPerSecond) {
+    auto options = sampled(1.0);
+    options.maxPerSecond = 3;
+    AccessLog log(options);
+
+    const auto now = AccessLog::Clock::now();
+    int logged = 0;
+    for (int i = 0; i < 10; ++i) logged += log.record("/a", 200, 1ms, now);
+    EXPECT_EQ(logged, 3);
+    EXPECT_TRUE(log.record("/a", 200, 1ms, now + 1s));
+    EXPECT_EQ(log.snapshot(now + 1s).total.rateLimited, 7u);
+}
+
+TEST(AccessLog, LastMinuteForgetsOlderSeconds) {
+    AccessLog log;
+    const auto now = AccessLog::Clock::now();
+    log.record("/a", 200, 1ms, now);
+    log.record("/a", 200, 1ms, now + 30s);
+    EXPECT_EQ(log.snapshot(now + 30s).lastMinute.requests, 2u);
+    EXPECT_EQ(log.snapshot(now + 70s).lastMinute.requests, 1u);
+
+    log.record("/a", 200, 1ms, now + 90s);
+    EXPECT_EQ(log.snapshot(now + 90s).lastMinute.requests, 1u);
+    EXPECT_EQ(log.snapshot(now + 90s).total.requests, 3u);
+}
+
+TEST(AccessLog, ConcurrentRecordsAreCounted) {
+    AccessLog log(sampled(0.5));
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t)
+        threads.emplace_back([&] {
+            for (int i = 0; i < 1000; ++i) log.record("/a", 200, 1ms);
+        });
+    for (auto &t: threads) t.join();
+
+    const auto s = log.snapshot();
+    EXPECT_EQ(s.total.requests, 8000u);
+    EXPECT_EQ(s.total.logged + s.total.sampledOut, 8000u);
+}
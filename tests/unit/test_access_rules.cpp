@@ -1,5 +1,8 @@
 #include <gtest/gtest.h>
 #include "mantisbase/core/models/access_rules.h"
+#include "mantisbase/core/models/entity_filter.h"
+#include "mantisbase/core/realtime_access.h"
+#include "mantisbase/utils/soci_wrappers.h"
 #include <nlohmann/json.hpp>
 
 TEST(AccessRule, DefaultConstructor) {
@@ -73,6 +76,19 @@ TEST(AccessRule, RoundTripJSON) {
     EXPECT_EQ(restored.expr(), original.expr());
 }
 
+TEST(AccessRule, RowFilterRoundTrip) {
+    const mb::AccessRule rule("auth", "", "owner = @auth.id");
+    EXPECT_EQ(rule.filter(), "owner = @auth.id");
+
+    const auto restored = mb::AccessRule::fromJSON(rule.toJSON());
+    EXPECT_EQ(restored.mode(), "auth");
+    EXPECT_EQ(restored.filter(), "owner = @auth.id");
+
+    // Rules without one keep their old shape
+    EXPECT_FALSE(mb::AccessRule("public", "").toJSON().contains("filter"));
+    EXPECT_EQ(mb::AccessRule::fromJSON({{"mode", "public"}}).filter(), "");
+}
+
 TEST(AccessRule, DifferentModes) {
     // Public mode
     mb::AccessRule publicRule("public", "");
@@ -93,3 +109,100 @@ TEST(AccessRule, DifferentModes) {
     EXPECT_EQ(adminRule.expr(), "");
 }
 
+
+TEST(AccessRule, EvaluateCustomRule) {
+    const mb::AccessRule rule("custom", "@auth.id == @req.body.owner");
+
+    nlohmann::json vars;
+    vars["auth"] = {{"id", "u1"}};
+    vars["req"] = {{"body", {{"owner", "u1"}}}};
+    EXPECT_TRUE(rule.evaluate(vars));
+
+    vars["req"]["body"]["owner"] = "u2";
+    EXPECT_FALSE(rule.evaluate(vars));
+
+    // Only custom rules carry an expression
+    EXPECT_FALSE(mb::AccessRule("public", "@auth.id == 'u1'").evaluate(vars));
+}
+
+TEST(RealtimeAccess, ModesMirrorSubscriptionChecks) {
+    mb::RealtimeAccess access;
+    const mb::RealtimeAuth guest;
+
+    mb::RealtimeAuth user;
+    user.auth = {{"type", "user"}, {"id", "u1"}, {"entity", "users"}, {"user", {{"id", "u1"}}}};
+    user.verified = true;
+    user.principal = "users:u1";
+
+    const nlohmann::json row = {{"id", "r1"}};
+    EXPECT_TRUE(access.allows(mb::AccessRule("public", ""), guest, row));
+    EXPECT_FALSE(access.allows(mb::AccessRule("auth", ""), guest, row));
+    EXPECT_TRUE(access.allows(mb::AccessRule("auth", ""), user, row));
+    EXPECT_FALSE(access.allows(mb::AccessRule("", ""), guest, row));
+}
+
+TEST(RealtimeAccess, FiltersRowsByRecord) {
+    mb::RealtimeAccess access;
+    const mb::AccessRule rule("custom", "@record.owner == @auth.id");
+
+    mb::RealtimeAuth user;
+    user.auth = {{"type", "user"}, {"id", "u1"}, {"entity", "users"}, {"user", {{"id", "u1"}}}};
+    user.verified = true;
+    user.principal = "users:u1";
+
+    EXPECT_TRUE(mb::RealtimeAccess::dependsOnRecord(rule));
+    EXPECT_TRUE(access.allows(rule, user, {{"owner", "u1"}}));
+    EXPECT_FALSE(access.allows(rule, user, {{"owner", "u2"}}));
+    EXPECT_EQ(access.size(), 0u); // row-bound results are never memoized
+}
+
+TEST(RealtimeAccess, AppliesTheRuleRowFilter) {
+    mb::RealtimeAccess access;
+    const mb::AccessRule rule("auth", "", "owner = @auth.id");
+    const mb::RowCodec codec({
+        {{"name", "id"}, {"type", "string"}},
+        {{"name", "owner"}, {"type", "string"}}
+    });
+    const auto filter = mb::EntityFilter::compileRule(rule.filter(), codec);
+
+    mb::RealtimeAuth user;
+    user.auth = {{"type", "user"}, {"id", "u1"}, {"entity", "users"}, {"user", {{"id", "u1"}}}};
+    user.verified = true;
+    user.principal = "users:u1";
+
+    EXPECT_TRUE(access.allows(rule, user, {{"id", "r1"}, {"owner", "u1"}}, &filter));
+    EXPECT_FALSE(access.allows(rule, user, {{"id", "r2"}, {"owner", "u2"}}, &filter));
+    // Without it, only the mode decides
+    EXPECT_TRUE(access.allows(rule, user, {{"id", "r2"}, {"owner", "u2"}}));
+
+    // Guests match no row, even under a public rule; admins see every one
+    EXPECT_FALSE(access.allows(mb::AccessRule("public", "", rule.filter()), mb::RealtimeAuth{},
+                               {{"id", "r1"}, {"owner", nullptr}}, &filter));
+    mb::RealtimeAuth admin;
+    admin.auth = {{"type", "user"}, {"id", "a1"}, {"entity", "mb_admins"}, {"user", {{"id", "a1"}}}};
+    admin.verified = true;
+    admin.principal = "mb_admins:a1";
+    EXPECT_TRUE(access.allows(rule, admin, {{"id", "r2"}, {"owner", "u2"}}, &filter));
+    EXPECT_EQ(access.size(), 0u);
+}
+
+TEST(RealtimeAccess, MemoizesPerPrincipal) {
+    mb::RealtimeAccess access;
+    const mb::AccessRule rule("custom", "@auth.id == 'u1'");
+    EXPECT_FALSE(mb::RealtimeAccess::dependsOnRecord(rule));
+    EXPECT_FALSE(mb::RealtimeAccess::dependsOnRecord(mb::AccessRule("custom", "@auth.user.records > 1")));
+
+    mb::RealtimeAuth u1, u2;
+    u1.auth = {{"id", "u1"}, {"entity", "users"}};
+    u1.principal = "users:u1";
+    u2.auth = {{"id", "u2"}, {"entity", "users"}};
+    u2.principal = "users:u2";
+
+    EXPECT_TRUE(access.allows(rule, u1, nlohmann::json::object()));
+    EXPECT_FALSE(access.allows(rule, u2, nlohmann::json::object()));
+    EXPECT_TRUE(access.allows(rule, u1, nlohmann::json::object()));
+    EXPECT_EQ(access.size(), 2u);
+
+    access.clear();
+    EXPECT_EQ(access.size(), 0u);
+}
@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/admin_assets.h"
+
+#include <drogon/HttpRequest.h>
+
+using mb::AdminAssets;
+
+namespace {
+    const AdminAssets &assets() {
+        static const AdminAssets instance([](const std::string &path) {
+            return path.ends_with(".html") ? std::string("text/html") : std::string("application/octet-stream");
+        });
+        return instance;
+    }
+
+    drogon::HttpRequestPtr get(const std::string &path, const std::string &accept_encoding = "") {
+        auto req = drogon::HttpRequest::newHttpRequest();
+        req->setMethod(drogon::Get);
+        req->setPath(path);
+        if (!accept_encoding.empty()) req->addHeader("Accept-Encoding", accept_encoding);
+        return req;
+    }
+}
+
+TEST(AdminAssets, UnknownPathsResolveToIndex) {
+    const auto *index = assets().find("/index.html");
+    ASSERT_NE(index, nullptr);
+    EXPECT_EQ(index->mime, "text/html");
+    EXPECT_EQ(index->cacheControl, "no-cache");
+
+    EXPECT_EQ(assets().find(""), index);
+    EXPECT_EQ(assets().find("/"), index);
+    EXPECT_EQ(assets().find("/entities/posts"), index);
+}
+
+TEST(AdminAssets, AnswersRevalidationWith304) {
+    const auto *index = assets().find("/");
+    ASSERT_NE(index, nullptr);
+
+    const auto first = assets().respond(get("/mb"));
+    EXPECT_EQ(first->statusCode(), drogon::k200OK);
+    EXPECT_EQ(first->body(), index->body);
+    const auto etag = first->getHeader("etag");
+    EXPECT_EQ(etag, index->etags[0]);
+
+    auto req = get("/mb/");
+    req->addHeader("If-None-Match", etag);
+    const auto again = assets().respond(req);
+    EXPECT_EQ(again->statusCode(), drogon::k304NotModified);
+    EXPECT_TRUE(again->body().empty());
+}
+
+TEST(AdminAssets, ServesPreparedVariants) {
+    const auto *index = assets().find("/");
+    ASSERT_NE(index, nullptr);
+    const auto gzip = static_cast<std::size_t>(mb::Compression::Encoding::Gzip);
+    if (index->encoded[gzip].empty()) GTEST_SKIP() << "index.html too small to compress";
+
+    const auto resp = assets().respond(get("/mb/settings", "gzip"));
+    EXPECT_EQ(resp->getHeader("content-encoding"), "gzip");
+    EXPECT_EQ(resp->getHeader("vary"), "Accept-Encoding");
+    EXPECT_EQ(resp->body(), index->encoded[gzip]);
+    EXPECT_NE(resp->getHeader("etag"), index->etags[0]);
+
+    EXPECT_TRUE(assets().respond(get("/mb/settings", "gzip;q=0"))->getHeader("content-encoding").empty());
+}
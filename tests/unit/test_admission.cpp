@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/admission.h"
+
+#include <cstdlib>
+
+using namespace std::chrono_literals;
+using mb::Admission;
+using mb::ConcurrencyLimit;
+
+TEST(Admission, AdmitsUpToTheLimit) {
+    ConcurrencyLimit limit({.min = 2, .max = 8, .initial = 2});
+    auto first = limit.acquire();
+    auto second = limit.acquire();
+    ASSERT_TRUE(first && second);
+    EXPECT_FALSE(limit.acquire());
+    EXPECT_EQ(limit.rejected(), 1u);
+    EXPECT_EQ(limit.inflight(), 2u);
+
+    first.reset();
+    EXPECT_EQ(limit.inflight(), 1u);
+    EXPECT_TRUE(limit.acquire());
+}
+
+TEST(Admission, FollowsLatency) {
+    ConcurrencyLimit limit({.min = 2, .max = 100, .initial = 10});
+    for (int i = 0; i < 200; ++i) limit.sample(10ms, limit.limit());
+    EXPECT_EQ(limit.limit(), 100u);
+
+    // The database slows down tenfold
+    for (int i = 0; i < 50; ++i) limit.sample(100ms, limit.limit());
+    EXPECT_LT(limit.limit(), 20u);
+
+    // A quiet route isn't pushing against its limit, so it says nothing about it
+    const auto quiet = limit.limit();
+    for (int i = 0; i < 50; ++i) limit.sample(1ms, 1);
+    EXPECT_EQ(limit.limit(), quiet);
+}
+
+TEST(Admission, RoutesAndPriority) {
+    setenv("MB_ADMISSION", "1", 1);
+    setenv("MB_ADMISSION_MAX", "64", 1);
+    const auto options = Admission::Options::fromEnv();
+    unsetenv("MB_ADMISSION");
+    unsetenv("MB_ADMISSION_MAX");
+    EXPECT_TRUE(options.enabled);
+    EXPECT_EQ(options.limit.max, 64u);
+    EXPECT_FALSE(Admission::Options::fromEnv().enabled);
+
+    Admission admission(options);
+    auto &posts = admission.route("GET", "/api/v1/entities/:entity_name");
+    EXPECT_EQ(&admission.route("GET", "/api/v1/entities/:entity_name"), &posts);
+    EXPECT_NE(&admission.route("POST", "/api/v1/entities/:entity_name"), &posts);
+
+    EXPECT_TRUE(Admission::isPriority("/api/v1/health"));
+    EXPECT_TRUE(Admission::isPriority("/api/v1/sys/logs"));
+    EXPECT_TRUE(Admission::isPriority("/api/v1/debug/profile"));
+    EXPECT_TRUE(Admission::isPriority("/mb/:path"));
+    EXPECT_FALSE(Admission::isPriority("/api/v1/system"));
+    EXPECT_FALSE(Admission::isPriority("/api/v1/entities/:entity_name"));
+}
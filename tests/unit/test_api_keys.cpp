@@ -5,6 +5,8 @@
 #include "../common/test_environment.h"
 #include "../common/test_config.h"
 
+#include <algorithm>
+
 class ApiKeyTestFixture : public ::testing::Test {
 protected:
     void SetUp() override {
@@ -78,7 +80,7 @@ TEST_F(ApiKeyTestFixture, CreateListAndRevokeApiKey) {
     auto key_id = created["id"].get<std::string>();
 
     // List keys for this user
-    auto keys = mb::ApiKeyManager::list("mb_admins", "list_test_user");
+    auto keys = mb::ApiKeyManager::list("mb_admins", "list_test_user")["items"];
     EXPECT_GE(keys.size(), 1u);
 
     bool found = false;
@@ -100,6 +102,30 @@ TEST_F(ApiKeyTestFixture, CreateListAndRevokeApiKey) {
     EXPECT_FALSE(lookup.has_value());
 }
 
+TEST_F(ApiKeyTestFixture, ListsPageByIdWithFilters) {
+    std::vector<std::string> ids;
+    for (int i = 0; i < 5; ++i)
+        ids.push_back(mb::ApiKeyManager::create("mb_admins", "paged_user", i % 2 ? "odd" : "even")["id"]);
+
+    // Pages of two in id order, the last one without a cursor
+    std::vector<std::string> seen;
+    mb::KeysetPage page{.limit = 2};
+    for (int pages = 0; pages < 5; ++pages) {
+        const auto result = mb::ApiKeyManager::list("mb_admins", "paged_user", page);
+        for (const auto &key: result["items"]) seen.push_back(key["id"]);
+        page.after = result["cursor"];
+        if (page.after.empty()) break;
+    }
+    std::ranges::sort(ids);
+    EXPECT_EQ(seen, ids);
+
+    const auto odd = mb::ApiKeyManager::listAdmin({}, {{"user_id", "paged_user"}, {"label", "odd"}});
+    EXPECT_EQ(odd["items_count"], 2);
+    EXPECT_EQ(odd["cursor"], "");
+
+    for (const auto &id: ids) mb::ApiKeyManager::revoke(id, "mb_admins", "paged_user");
+}
+
 TEST_F(ApiKeyTestFixture, RevokeNonExistentKey) {
     bool revoked = mb::ApiKeyManager::revoke("nonexistent_id", "mb_admins", "no_user");
     EXPECT_FALSE(revoked);
@@ -114,7 +140,7 @@ TEST_F(ApiKeyTestFixture, ShownOnceVerification) {
     EXPECT_TRUE(raw_key.starts_with("mb_sk_"));
 
     // Listing keys does NOT return the raw key
-    auto keys = mb::ApiKeyManager::list("mb_admins", "shown_once_user");
+    auto keys = mb::ApiKeyManager::list("mb_admins", "shown_once_user")["items"];
     for (const auto& k : keys) {
         EXPECT_FALSE(k.contains("key"));
     }
@@ -122,3 +148,28 @@ TEST_F(ApiKeyTestFixture, ShownOnceVerification) {
     // Clean up
     mb::ApiKeyManager::revoke(result["id"].get<std::string>(), "mb_admins", "shown_once_user");
 }
+
+TEST_F(ApiKeyTestFixture, LastUsedIsCoalescedAndFlushed) {
+    auto created = mb::ApiKeyManager::create("mb_admins", "last_used_user", "Last Used Key");
+    auto key_id = created["id"].get<std::string>();
+    auto key_hash = mb::ApiKeyManager::hashApiKey(created["key"].get<std::string>());
+
+    // Repeated lookups only touch memory; list() already reflects the touch
+    for (int i = 0; i < 5; ++i)
+        ASSERT_TRUE(mb::ApiKeyManager::lookupByHash(key_hash).has_value());
+
+    auto keys = mb::ApiKeyManager::list("mb_admins", "last_used_user")["items"];
+    ASSERT_EQ(keys.size(), 1u);
+    EXPECT_TRUE(keys[0]["last_used"].is_string());
+
+    // One pending row per key, however many lookups
+    EXPECT_GE(mb::ApiKeyManager::flushLastUsed(), 1u);
+    EXPECT_EQ(mb::ApiKeyManager::flushLastUsed(), 0u);
+
+    keys = mb::ApiKeyManager::list("mb_admins", "last_used_user")["items"];
+    EXPECT_TRUE(keys[0]["last_used"].is_string());
+
+    // Revocation evicts the cached lookup
+    EXPECT_TRUE(mb::ApiKeyManager::revoke(key_id, "mb_admins", "last_used_user"));
+    EXPECT_FALSE(mb::ApiKeyManager::lookupByHash(key_hash).has_value());
+}
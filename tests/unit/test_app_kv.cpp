@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/app_kv.h"
+#include "mantisbase/core/exceptions.h"
+#include "mantisbase/mantisbase.h"
+#include "../common/test_environment.h"
+
+#include <limits>
+#include <thread>
+#include <vector>
+
+using mb::AppKv;
+using namespace std::chrono_literals;
+
+TEST(AppKv, SetsGetsAndRemovesValues) {
+    AppKv kv({});
+    kv.set("kv_test:flag", true);
+    kv.set("kv_test:doc", {{"a", 1}, {"b", {1, 2}}});
+
+    ASSERT_TRUE(kv.get("kv_test:flag"));
+    EXPECT_EQ(kv.get("kv_test:flag")->value, true);
+    EXPECT_EQ(kv.get("kv_test:doc")->value["b"][1], 2);
+    EXPECT_EQ(kv.get("kv_test:doc")->expiresAt, 0);
+
+    EXPECT_TRUE(kv.remove("kv_test:flag"));
+    EXPECT_FALSE(kv.remove("kv_test:flag"));
+    EXPECT_FALSE(kv.get("kv_test:flag"));
+    EXPECT_THROW(kv.get(""), mb::MantisException);
+    kv.remove("kv_test:doc");
+}
+
+TEST(AppKv, ExpiresValuesAfterTheirTtl) {
+    AppKv kv({});
+    kv.set("kv_test:short", "soon gone", 50ms);
+    kv.set("kv_test:long", "stays", 1h);
+    EXPECT_TRUE(kv.get("kv_test:short"));
+
+    std::this_thread::sleep_for(80ms);
+    EXPECT_FALSE(kv.get("kv_test:short"));
+    EXPECT_TRUE(kv.get("kv_test:long"));
+    // Like set(), a swap replaces the TTL
+    EXPECT_TRUE(kv.cas("kv_test:long", "stays", "changed"));
+    EXPECT_EQ(kv.get("kv_test:long")->expiresAt, 0);
+    kv.remove("kv_test:long");
+}
+
+TEST(AppKv, IncrementsIntegersOnly) {
+    AppKv kv({});
+    EXPECT_EQ(kv.incr("kv_test:hits"), 1);
+    EXPECT_EQ(kv.incr("kv_test:hits", 41), 42);
+    EXPECT_EQ(kv.incr("kv_test:hits", -2), 40);
+
+    // A TTL given once is kept by later increments
+    kv.incr("kv_test:hits", 1, 1h);
+    const auto expires = kv.get("kv_test:hits")->expiresAt;
+    EXPECT_GT(expires, 0);
+    kv.incr("kv_test:hits");
+    EXPECT_EQ(kv.get("kv_test:hits")->expiresAt, expires);
+
+    kv.set("kv_test:name", "text");
+    EXPECT_THROW(kv.incr("kv_test:name"), mb::MantisException);
+    kv.set("kv_test:max", std::numeric_limits<std::int64_t>::max());
+    EXPECT_THROW(kv.incr("kv_test:max"), mb::MantisException);
+    for (const auto *key: {"kv_test:hits", "kv_test:name", "kv_test:max"}) kv.remove(key);
+}
+
+TEST(AppKv, ComparesBeforeSetting) {
+    AppKv kv({});
+    EXPECT_TRUE(kv.cas("kv_test:leader", nullptr, "node-a"));
+    EXPECT_FALSE(kv.cas("kv_test:leader", nullptr, "node-b"));
+    EXPECT_FALSE(kv.cas("kv_test:leader", "node-b", "node-c"));
+    EXPECT_TRUE(kv.cas("kv_test:leader", "node-a", "node-c"));
+    EXPECT_EQ(kv.get("kv_test:leader")->value, "node-c");
+    kv.remove("kv_test:leader");
+}
+
+TEST(AppKv, EnforcesKeyAndValueLimits) {
+    AppKv kv({.maxKeys = 2, .maxValueBytes = 16});
+    kv.set("kv_test:a", 1);
+    kv.set("kv_test:b", 2);
+    EXPECT_THROW(kv.set("kv_test:c", 3), mb::MantisException);
+    kv.set("kv_test:a", 3); // Replacing doesn't add a key
+    EXPECT_THROW(kv.set("kv_test:a", std::string(32, 'x')), mb::MantisException);
+    EXPECT_EQ(kv.get("kv_test:a")->value, 3);
+    EXPECT_EQ(kv.size(), 2u);
+    kv.remove("kv_test:a");
+    kv.remove("kv_test:b");
+}
+
+TEST(AppKv, ConcurrentIncrementsAreNotLost) {
+    AppKv kv({.flushInterval = 10ms});
+    kv.start();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t)
+        threads.emplace_back([&kv] { for (int i = 0; i < 1000; ++i) kv.incr("kv_test:counter"); });
+    for (auto &thread: threads) thread.join();
+
+    EXPECT_EQ(kv.get("kv_test:counter")->value, 8000);
+    kv.remove("kv_test:counter");
+    kv.stop();
+}
+
+TEST(AppKv, WritesBehindAndLoadsBack) {
+    {
+        AppKv kv({.flushInterval = 10ms});
+        kv.start();
+        kv.set("kv_test:persisted", {{"on", true}});
+        kv.set("kv_test:expired", 1, 20ms);
+        kv.stop(); // Writes what is still unflushed
+    }
+
+    std::this_thread::sleep_for(40ms);
+    AppKv reloaded({});
+    EXPECT_GE(reloaded.load(), 1u);
+    ASSERT_TRUE(reloaded.get("kv_test:persisted"));
+    EXPECT_EQ(reloaded.get("kv_test:persisted")->value["on"], true);
+    EXPECT_FALSE(reloaded.get("kv_test:expired"));
+    reloaded.remove("kv_test:persisted");
+}
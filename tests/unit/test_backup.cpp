@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+#include <soci/sqlite3/soci-sqlite3.h>
+#include "mantisbase/core/backup.h"
+#include "mantisbase/core/exceptions.h"
+
+#include <fstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+using mb::Backup;
+
+namespace {
+    sqlite_api::sqlite3 *openDb(const fs::path &path) {
+        sqlite_api::sqlite3 *db = nullptr;
+        sqlite_api::sqlite3_open(path.string().c_str(), &db);
+        sqlite_api::sqlite3_busy_timeout(db, 5000);
+        return db;
+    }
+
+    void exec(sqlite_api::sqlite3 *db, const std::string &sql) {
+        ASSERT_EQ(sqlite_api::sqlite3_exec(db, sql.c_str(), nullptr, nullptr, nullptr), SQLITE_OK)
+            << sqlite_api::sqlite3_errmsg(db);
+    }
+
+    std::string scalar(const fs::path &path, const std::string &sql) {
+        auto *db = openDb(path);
+        sqlite_api::sqlite3_stmt *stmt = nullptr;
+        sqlite_api::sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr);
+        std::string value;
+        if (sqlite_api::sqlite3_step(stmt) == SQLITE_ROW)
+            value = reinterpret_cast<const char *>(sqlite_api::sqlite3_column_text(stmt, 0));
+        sqlite_api::sqlite3_finalize(stmt);
+        sqlite_api::sqlite3_close(db);
+        return value;
+    }
+
+    void write(const fs::path &path, const std::string &content) {
+        fs::create_directories(path.parent_path());
+        std::ofstream(path, std::ios::binary) << content;
+    }
+}
+
+class BackupTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        dir = fs::temp_directory_path() / ("mb_backup_" + std::to_string(::testing::UnitTest::GetInstance()->random_seed())
+                                           + "_" + ::testing::UnitTest::GetInstance()->current_test_info()->name());
+        fs::remove_all(dir);
+        fs::create_directories(dir / "data");
+    }
+
+    void TearDown() override {
+        fs::remove_all(dir);
+    }
+
+    void seed(const fs::path &path, const int rows) const {
+        auto *db = openDb(path);
+        exec(db, "PRAGMA journal_mode=WAL; CREATE TABLE t (id INTEGER PRIMARY KEY, v TEXT);");
+        exec(db, "BEGIN;");
+        for (int i = 0; i < rows; ++i)
+            exec(db, "INSERT INTO t (v) VALUES (hex(randomblob(64)));");
+        exec(db, "COMMIT;");
+        sqlite_api::sqlite3_close(db);
+    }
+
+    fs::path dir;
+};
+
+TEST_F(BackupTest, CopiesOneSnapshotWhileWritesContinue) {
+    const auto src = dir / "data" / "mantis.db";
+    seed(src, 2000);
+
+    std::atomic<bool> done{false};
+    std::thread writer([&] {
+        auto *db = openDb(src);
+        while (!done) sqlite_api::sqlite3_exec(db, "INSERT INTO t (v) VALUES ('late');", nullptr, nullptr, nullptr);
+        sqlite_api::sqlite3_close(db);
+    });
+
+    const auto dest = dir / "copy.db";
+    const auto pages = Backup::copyDatabase(src, dest, {.pagesPerStep = 4, .pause = std::chrono::milliseconds(1)});
+    done = true;
+    writer.join();
+
+    EXPECT_GT(pages, 4);
+    EXPECT_FALSE(fs::exists(dir / "copy.db.part"));
+    EXPECT_EQ(scalar(dest, "PRAGMA integrity_check;"), "ok");
+    EXPECT_GE(std::stoi(scalar(dest, "SELECT count(*) FROM t;")), 2000);
+}
+
+TEST_F(BackupTest, CancelLeavesNoPartialCopy) {
+    const auto src = dir / "data" / "mantis.db";
+    seed(src, 500);
+
+    const std::atomic<bool> cancel{true};
+    EXPECT_THROW(Backup::copyDatabase(src, dir / "copy.db", {.pagesPerStep = 1}, &cancel), mb::MantisException);
+    EXPECT_FALSE(fs::exists(dir / "copy.db"));
+    EXPECT_FALSE(fs::exists(dir / "copy.db.part"));
+}
+
+TEST_F(BackupTest, FileSnapshotsLinkUnchangedFiles) {
+    const auto files = dir / "data" / "files";
+    write(files / "posts" / "a.txt", "alpha");
+    write(files / "posts" / "b.txt", "beta");
+    write(files / ".uploads" / "partial", "staged");
+
+    const auto first = Backup::snapshotFiles(files, dir / "s1");
+    EXPECT_EQ(first.copied, 2u);
+    EXPECT_EQ(first.linked, 0u);
+    EXPECT_FALSE(fs::exists(dir / "s1" / ".uploads"));
+
+    write(files / "posts" / "b.txt", "beta, edited");
+    const auto second = Backup::snapshotFiles(files, dir / "s2", dir / "s1");
+    EXPECT_EQ(second.copied, 1u);
+    EXPECT_EQ(second.linked, 1u);
+    EXPECT_EQ(second.bytes, 12u);
+    EXPECT_EQ(fs::hard_link_count(dir / "s2" / "posts" / "a.txt"), 2u);
+    EXPECT_EQ(fs::hard_link_count(dir / "s2" / "posts" / "b.txt"), 1u);
+}
+
+TEST_F(BackupTest, RunWritesTimestampedSnapshots) {
+    seed(dir / "data" / "mantis.db", 10);
+    write(dir / "data" / "files" / "posts" / "a.txt", "alpha");
+    const auto root = dir / "backups";
+
+    const auto first = Backup::run(dir / "data", root, true, {.pause = std::chrono::milliseconds(0)});
+    ASSERT_TRUE(first["databases"].contains("mantis.db"));
+    EXPECT_FALSE(first["databases"].contains("mantis_logs.db"));
+    EXPECT_TRUE(fs::exists(fs::path(first["path"].get<std::string>()) / "mantis.db"));
+    EXPECT_EQ(first["files"]["copied"], 1);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    const auto second = Backup::run(dir / "data", root, true, {.pause = std::chrono::milliseconds(0)});
+    EXPECT_NE(first["path"], second["path"]);
+    EXPECT_EQ(second["files"]["linked"], 1);
+}
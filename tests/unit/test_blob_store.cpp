@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/blob_store.h"
+#include "mantisbase/core/files.h"
+#include "mantisbase/mantisbase.h"
+#include "mantisbase/utils/crypto_utils.h"
+#include "mantisbase/utils/utils.h"
+#include "../common/test_environment.h"
+
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+using mb::BlobStore;
+using mb::Files;
+
+class BlobStoreTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        mb::MantisBase::instance();
+        Files::createDir(entity);
+    }
+
+    void TearDown() override {
+        Files::deleteDir(entity);
+    }
+
+    /// Stage `content` the way an upload would and store it as `filename`
+    std::string put(const std::string &filename, const std::string &content) {
+        const auto staged = Files::stagingDir() / (mb::generateShortId(24) + ".part");
+        std::ofstream(staged, std::ios::binary) << content;
+        const auto sha256 = mb::sha256Hex(content);
+        BlobStore::put(entity, filename, staged, sha256);
+        EXPECT_FALSE(fs::exists(staged));
+        return sha256;
+    }
+
+    static std::string read(const fs::path &path) {
+        std::ifstream in(path, std::ios::binary);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        return ss.str();
+    }
+
+    const std::string entity = "blob_store_test";
+};
+
+TEST_F(BlobStoreTest, StoresIdenticalUploadsOnce) {
+    const auto sha256 = put("a_doc.txt", "same bytes");
+    EXPECT_EQ(put("b_doc.txt", "same bytes"), sha256);
+
+    EXPECT_EQ(BlobStore::refCount(sha256), 2u);
+    EXPECT_EQ(BlobStore::hashOf(entity, "b_doc.txt"), sha256);
+    EXPECT_TRUE(fs::exists(BlobStore::blobPath(sha256)));
+    EXPECT_EQ(read(Files::filePath(entity, "a_doc.txt")), "same bytes");
+    EXPECT_EQ(read(Files::filePath(entity, "b_doc.txt")), "same bytes");
+}
+
+TEST_F(BlobStoreTest, KeepsBlobUntilLastReferenceGoes) {
+    const auto sha256 = put("a_doc.txt", "shared");
+    BlobStore::link(entity, "a_doc.txt", entity, "c_doc.txt");
+    EXPECT_EQ(BlobStore::refCount(sha256), 2u);
+
+    EXPECT_TRUE(Files::removeFile(entity, "a_doc.txt"));
+    EXPECT_EQ(BlobStore::refCount(sha256), 1u);
+    EXPECT_TRUE(fs::exists(BlobStore::blobPath(sha256)));
+    EXPECT_EQ(read(Files::filePath(entity, "c_doc.txt")), "shared");
+
+    EXPECT_TRUE(Files::removeFile(entity, "c_doc.txt"));
+    EXPECT_EQ(BlobStore::refCount(sha256), 0u);
+    EXPECT_FALSE(fs::exists(BlobStore::blobPath(sha256)));
+    EXPECT_FALSE(BlobStore::release(entity, "c_doc.txt").has_value());
+}
+
+TEST_F(BlobStoreTest, ReleasesEntityFilesOnDrop) {
+    const auto sha256 = put("a_doc.txt", "dropped with the entity");
+    put("b_doc.txt", "dropped with the entity");
+
+    Files::deleteDir(entity);
+    EXPECT_EQ(BlobStore::refCount(sha256), 0u);
+    EXPECT_FALSE(fs::exists(BlobStore::blobPath(sha256)));
+}
@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/cache_budget.h"
+#include "mantisbase/core/record_cache.h"
+#include "mantisbase/core/response_cache.h"
+#include "mantisbase/core/metrics.h"
+
+#include <format>
+#include <string>
+
+using mb::CacheBudget;
+using mb::RecordCache;
+using mb::ResponseCache;
+using nlohmann::json;
+
+namespace {
+    RecordCache::Options records(CacheBudget &budget) {
+        RecordCache::Options options;
+        options.all = true;
+        options.budget = &budget;
+        return options;
+    }
+
+    json record(const std::string &id) {
+        return {{"id", id}, {"body", std::string(1000, 'x')}};
+    }
+}
+
+TEST(CacheBudgetTest, SumsEveryCacheJoinedToIt) {
+    CacheBudget budget({.maxBytes = 1 << 20});
+    RecordCache app(records(budget)), tenant(records(budget));
+
+    app.put("posts", "r1", 0, record("r1"));
+    tenant.put("posts", "r1", 0, record("r1"));
+    EXPECT_EQ(budget.bytes(), app.bytes() + tenant.bytes());
+
+    app.forget("posts", "r1");
+    EXPECT_EQ(budget.bytes(), tenant.bytes());
+    app.put("posts", "r2", app.generation("posts"), record("r2"));
+    app.clear();
+    EXPECT_EQ(budget.bytes(), tenant.bytes());
+    EXPECT_EQ(budget.shedBytes(), 0u);
+}
+
+TEST(CacheBudgetTest, ShedsFromTheLargestCacheOldestFirst) {
+    const auto one = RecordCache::approxBytes(record("r00")) + 3;
+    CacheBudget budget({.maxBytes = 10 * one});
+    RecordCache idle(records(budget)), busy(records(budget));
+
+    for (int i = 0; i < 8; ++i) {
+        const auto id = std::format("r{:02}", i);
+        idle.put("posts", id, 0, record(id));
+    }
+    // The busy cache fills the rest, takes from the idle one until both hold as much, then from itself
+    for (int i = 0; i < 8; ++i) {
+        const auto id = std::format("r{:02}", i);
+        busy.put("posts", id, 0, record(id));
+        EXPECT_LE(budget.bytes(), budget.maxBytes());
+    }
+    EXPECT_EQ(idle.size(), 5u);
+    EXPECT_EQ(busy.size(), 5u);
+    for (auto *cache: {&idle, &busy}) {
+        EXPECT_FALSE(cache->get("posts", "r02").has_value());
+        EXPECT_TRUE(cache->get("posts", "r03").has_value());
+    }
+    EXPECT_EQ(budget.shedBytes(), 6 * one);
+}
+
+TEST(CacheBudgetTest, ResponsesShareItWithRecords) {
+    CacheBudget budget({.maxBytes = 4000});
+    RecordCache entity(records(budget));
+    ResponseCache::Options options;
+    options.all = true;
+    options.budget = &budget;
+    ResponseCache responses(options);
+
+    entity.put("posts", "r1", 0, record("r1"));
+    for (const auto *key: {"a", "b", "c"}) responses.put("posts", key, 0, std::string(1000, 'y'));
+    EXPECT_LE(budget.bytes(), 4000u);
+    EXPECT_EQ(budget.bytes(), entity.bytes() + responses.bytes());
+    EXPECT_GT(budget.shedBytes(), 0u);
+
+    mb::MetricsWriter out;
+    budget.writeMetrics(out);
+    EXPECT_NE(out.str().find(R"(mb_cache_budget_bytes{cache="responses"})"), std::string::npos) << out.str();
+    EXPECT_NE(out.str().find("mb_cache_budget_limit_bytes 4000"), std::string::npos) << out.str();
+}
+
+TEST(CacheBudgetTest, ACacheGoingAwayGivesItsBytesBack) {
+    CacheBudget budget({.maxBytes = 1 << 20});
+    {
+        RecordCache tenant(records(budget));
+        tenant.put("posts", "r1", 0, record("r1"));
+        EXPECT_GT(budget.bytes(), 0u);
+    }
+    EXPECT_EQ(budget.bytes(), 0u);
+
+    // Without a budget a cache keeps to its own cap only
+    EXPECT_FALSE(CacheBudget({}).enabled());
+}
@@ -0,0 +1,145 @@
+#include <gtest/gtest.h>
+#include <soci/soci.h>
+#include <soci/sqlite3/soci-sqlite3.h>
+#include "mantisbase/core/change_capture.h"
+
+#include <format>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    using namespace std::chrono_literals;
+    using mb::ChangeCapture;
+
+    ChangeCapture::Options lazy() {
+        ChangeCapture::Options o;
+        o.lazy = true;
+        o.grace = 30s;
+        return o;
+    }
+
+    struct Renewals {
+        std::vector<std::vector<std::string>> calls;
+        std::chrono::seconds ttl{0};
+        bool fail = false;
+
+        ChangeCapture::Renew fn() {
+            return [this](const std::vector<std::string> &entities, const std::chrono::seconds t) {
+                if (fail) throw std::runtime_error("database is locked");
+                calls.push_back(entities);
+                ttl = t;
+            };
+        }
+    };
+
+    int logged(soci::session &sql) {
+        int n = 0;
+        sql << "SELECT COUNT(*) FROM mb_change_log", soci::into(n);
+        return n;
+    }
+
+    /// A table whose insert trigger is gated the way RealtimeDB builds them
+    void createGated(soci::session &sql, const std::string &entity) {
+        sql << std::format("CREATE TABLE {} (id TEXT PRIMARY KEY)", entity);
+        sql << std::format("CREATE TRIGGER mb_{0}_insert_trigger AFTER INSERT ON {0} WHEN {1} BEGIN "
+                           "INSERT INTO mb_change_log(entity, row_id) VALUES ('{0}', NEW.id); END",
+                           entity, ChangeCapture::sqliteCondition(entity));
+    }
+}
+
+TEST(ChangeCapture, LeasesHeldEntitiesAndRenewsThem) {
+    Renewals renewals;
+    ChangeCapture capture(renewals.fn(), lazy());
+    const auto t0 = ChangeCapture::Clock::now();
+
+    EXPECT_FALSE(capture.captured("posts", t0));
+    capture.hold("posts", true);
+    capture.hold("posts", true);
+    EXPECT_TRUE(capture.captured("posts", t0));
+    EXPECT_FALSE(capture.captured("notes", t0));
+
+    capture.tick(t0);
+    ASSERT_EQ(renewals.calls.size(), 1u);
+    EXPECT_EQ(renewals.calls[0], std::vector<std::string>{"posts"});
+    EXPECT_EQ(renewals.ttl, 40s); // The grace period, plus one renewal interval
+
+    capture.tick(t0 + 5s);
+    EXPECT_EQ(renewals.calls.size(), 1u); // Still fresh
+    capture.tick(t0 + 11s);
+    EXPECT_EQ(renewals.calls.size(), 2u);
+}
+
+TEST(ChangeCapture, LeasesOutliveTheLastHolderByTheGracePeriod) {
+    Renewals renewals;
+    ChangeCapture capture(renewals.fn(), lazy());
+    const auto t0 = ChangeCapture::Clock::now();
+
+    capture.hold("posts", true);
+    capture.tick(t0);
+    capture.hold("posts", false);
+
+    capture.tick(t0 + 20s);
+    EXPECT_EQ(renewals.calls.size(), 1u); // Nobody to renew it for
+    EXPECT_TRUE(capture.captured("posts", t0 + 39s));
+    EXPECT_FALSE(capture.captured("posts", t0 + 41s));
+
+    // Dropping a hold that was never taken changes nothing
+    capture.hold("notes", false);
+    EXPECT_FALSE(capture.captured("notes", t0));
+}
+
+TEST(ChangeCapture, StarCoversEveryEntity) {
+    Renewals renewals;
+    ChangeCapture capture(renewals.fn(), lazy());
+    capture.hold("*", true);
+    EXPECT_TRUE(capture.captured("posts"));
+    EXPECT_TRUE(capture.captured("notes"));
+}
+
+TEST(ChangeCapture, FailedRenewalsAreRetried) {
+    Renewals renewals;
+    renewals.fail = true;
+    ChangeCapture capture(renewals.fn(), lazy());
+    const auto t0 = ChangeCapture::Clock::now();
+
+    capture.hold("posts", true);
+    capture.tick(t0);
+    EXPECT_TRUE(renewals.calls.empty());
+
+    renewals.fail = false;
+    capture.tick(t0 + 1s);
+    ASSERT_EQ(renewals.calls.size(), 1u);
+}
+
+TEST(ChangeCapture, TriggersLogOnlyUnderALease) {
+    soci::session sql{soci::sqlite3, ":memory:"};
+    sql << "CREATE TABLE mb_change_log (id INTEGER PRIMARY KEY AUTOINCREMENT, entity TEXT, row_id TEXT)";
+    ChangeCapture::createTable(sql);
+    ChangeCapture::createTable(sql); // Idempotent
+    createGated(sql, "posts");
+    createGated(sql, "notes");
+
+    sql << "INSERT INTO posts (id) VALUES ('a')";
+    EXPECT_EQ(logged(sql), 0);
+
+    ChangeCapture::lease(sql, "node-1", {"posts"}, 60s);
+    sql << "INSERT INTO posts (id) VALUES ('b')";
+    sql << "INSERT INTO notes (id) VALUES ('a')";
+    EXPECT_EQ(logged(sql), 1);
+
+    // Another node's lease on everything
+    ChangeCapture::lease(sql, "node-2", {"*"}, 60s);
+    sql << "INSERT INTO notes (id) VALUES ('b')";
+    EXPECT_EQ(logged(sql), 2);
+
+    // Renewing upserts; lapsed leases gate nothing and are cleared
+    ChangeCapture::lease(sql, "node-1", {"posts"}, 60s);
+    sql << "UPDATE mb_rt_capture SET expires = expires - 3600";
+    sql << "INSERT INTO posts (id) VALUES ('c')";
+    EXPECT_EQ(logged(sql), 2);
+
+    ChangeCapture::lease(sql, "node-1", {"notes"}, 60s);
+    int leases = 0;
+    sql << "SELECT COUNT(*) FROM mb_rt_capture", soci::into(leases);
+    EXPECT_EQ(leases, 1);
+}
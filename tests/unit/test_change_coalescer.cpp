@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/change_coalescer.h"
+
+namespace {
+    using namespace std::chrono_literals;
+    using Clock = mb::ChangeCoalescer::Clock;
+
+    mb::json change(const std::string &type, const std::string &row_id, const int title) {
+        return {
+            {"type", type},
+            {"entity", "posts"},
+            {"row_id", row_id},
+            {"old_data", type == "INSERT" ? mb::json(nullptr) : mb::json{{"title", title - 1}}},
+            {"new_data", type == "DELETE" ? mb::json(nullptr) : mb::json{{"title", title}}}
+        };
+    }
+}
+
+TEST(ChangeCoalescer, DisabledByDefault) {
+    EXPECT_FALSE(mb::ChangeCoalescer().enabled());
+    EXPECT_TRUE(mb::ChangeCoalescer(50ms).enabled());
+}
+
+TEST(ChangeCoalescer, MergesUpdatesToLatestState) {
+    mb::ChangeCoalescer c(50ms);
+    const auto t0 = Clock::now();
+
+    for (int i = 1; i <= 1000; ++i)
+        c.add(change("UPDATE", "1", i), t0 + std::chrono::microseconds(i));
+
+    EXPECT_TRUE(c.drain(t0 + 10ms).empty());
+    EXPECT_EQ(c.nextDeadline(), t0 + std::chrono::microseconds(1) + 50ms);
+
+    const auto due = c.drain(t0 + 60ms);
+    ASSERT_EQ(due.size(), 1u);
+    EXPECT_EQ(due[0]["type"], "UPDATE");
+    EXPECT_EQ(due[0]["new_data"]["title"], 1000);
+    EXPECT_EQ(due[0]["old_data"]["title"], 0); // before the first update
+    EXPECT_EQ(c.merged(), 999u);
+    EXPECT_EQ(c.pending(), 0u);
+}
+
+TEST(ChangeCoalescer, KeepsRowsApartAndInFirstSeenOrder) {
+    mb::ChangeCoalescer c(50ms);
+    const auto t0 = Clock::now();
+
+    c.add(change("UPDATE", "a", 1), t0);
+    c.add(change("UPDATE", "b", 1), t0 + 1ms);
+    c.add(change("UPDATE", "a", 2), t0 + 2ms);
+
+    const auto due = c.drain(t0 + 100ms);
+    ASSERT_EQ(due.size(), 2u);
+    EXPECT_EQ(due[0]["row_id"], "a");
+    EXPECT_EQ(due[0]["new_data"]["title"], 2);
+    EXPECT_EQ(due[1]["row_id"], "b");
+}
+
+TEST(ChangeCoalescer, InsertThenUpdatesStaysInsert) {
+    mb::ChangeCoalescer c(50ms);
+    c.add(change("INSERT", "1", 1));
+    c.add(change("UPDATE", "1", 2));
+
+    const auto due = c.flush();
+    ASSERT_EQ(due.size(), 1u);
+    EXPECT_EQ(due[0]["type"], "INSERT");
+    EXPECT_EQ(due[0]["new_data"]["title"], 2);
+}
+
+TEST(ChangeCoalescer, DeleteRules) {
+    mb::ChangeCoalescer c(50ms);
+
+    // Created and removed inside the window: nothing to deliver
+    c.add(change("INSERT", "1", 1));
+    c.add(change("DELETE", "1", 1));
+    EXPECT_TRUE(c.flush().empty());
+
+    // Updated then removed: only the delete
+    c.add(change("UPDATE", "2", 1));
+    c.add(change("DELETE", "2", 1));
+    auto due = c.flush();
+    ASSERT_EQ(due.size(), 1u);
+    EXPECT_EQ(due[0]["type"], "DELETE");
+
+    // Removed then re-created: both, delete released first
+    const auto t0 = Clock::now();
+    c.add(change("DELETE", "3", 1), t0);
+    c.add(change("INSERT", "3", 2), t0);
+    EXPECT_EQ(c.nextDeadline(), Clock::time_point::min());
+    due = c.drain(t0);
+    ASSERT_EQ(due.size(), 1u);
+    EXPECT_EQ(due[0]["type"], "DELETE");
+    due = c.flush();
+    ASSERT_EQ(due.size(), 1u);
+    EXPECT_EQ(due[0]["type"], "INSERT");
+}
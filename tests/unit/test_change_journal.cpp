@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/change_journal.h"
+#include <thread>
+#include <set>
+#include <vector>
+
+TEST(ChangeJournal, PublishConsumeFifo) {
+    mb::ChangeJournal journal(4);
+    EXPECT_EQ(journal.capacity(), 4u);
+
+    for (int i = 0; i < 4; ++i)
+        EXPECT_TRUE(journal.publish({{"n", i}}));
+    EXPECT_FALSE(journal.publish({{"n", 4}})); // full: caller falls back to the trigger path
+
+    mb::json ev;
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_TRUE(journal.consume(ev));
+        EXPECT_EQ(ev["n"], i);
+    }
+    EXPECT_FALSE(journal.consume(ev));
+
+    // Slots are reusable after wrap-around
+    EXPECT_TRUE(journal.publish({{"n", 5}}));
+    ASSERT_TRUE(journal.consume(ev));
+    EXPECT_EQ(ev["n"], 5);
+}
+
+TEST(ChangeJournal, ConcurrentProducers) {
+    mb::ChangeJournal journal(1 << 14);
+    constexpr int producers = 4, per_producer = 2000;
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p] {
+            for (int i = 0; i < per_producer; ++i)
+                while (!journal.publish({{"v", p * per_producer + i}})) std::this_thread::yield();
+        });
+    }
+
+    std::set<int> seen;
+    mb::json ev;
+    while (seen.size() < producers * per_producer) {
+        if (journal.consume(ev)) seen.insert(ev["v"].get<int>());
+        else std::this_thread::yield();
+    }
+    for (auto &t: threads) t.join();
+
+    EXPECT_EQ(seen.size(), static_cast<std::size_t>(producers * per_producer));
+    EXPECT_FALSE(journal.consume(ev));
+}
+
+TEST(ChangeJournal, MakeEventMatchesTriggerShape) {
+    const auto ev = mb::ChangeJournal::makeEvent("DELETE", "posts", "42", {{"id", "42"}}, nullptr);
+
+    EXPECT_EQ(ev["type"], "DELETE");
+    EXPECT_EQ(ev["entity"], "posts");
+    EXPECT_EQ(ev["row_id"], "42");
+    EXPECT_EQ(ev["old_data"]["id"], "42");
+    EXPECT_TRUE(ev["new_data"].is_null());
+    EXPECT_TRUE(ev["timestamp"].is_string());
+}
+
+TEST(ChangeDeduplicator, DeliversFirstCopyOnly) {
+    using S = mb::ChangeDeduplicator::Source;
+    mb::ChangeDeduplicator dedup;
+
+    // Journal first, trigger copy dropped
+    EXPECT_TRUE(dedup.accept(S::Journal, "INSERT", "posts", "1"));
+    EXPECT_FALSE(dedup.accept(S::Log, "INSERT", "posts", "1"));
+
+    // Trigger row read before the journal entry landed
+    EXPECT_TRUE(dedup.accept(S::Log, "UPDATE", "posts", "1"));
+    EXPECT_FALSE(dedup.accept(S::Journal, "UPDATE", "posts", "1"));
+
+    // Two journaled updates of one row pair with two trigger rows
+    EXPECT_TRUE(dedup.accept(S::Journal, "UPDATE", "posts", "2"));
+    EXPECT_TRUE(dedup.accept(S::Journal, "UPDATE", "posts", "2"));
+    EXPECT_FALSE(dedup.accept(S::Log, "UPDATE", "posts", "2"));
+    EXPECT_FALSE(dedup.accept(S::Log, "UPDATE", "posts", "2"));
+
+    // Writes from outside the CRUD layer only ever arrive on the log
+    EXPECT_TRUE(dedup.accept(S::Log, "DELETE", "comments", "9"));
+
+    dedup.purge(); // settled pairs are dropped, the external write waits for its TTL
+    EXPECT_EQ(dedup.size(), 1u);
+}
+
+TEST(ChangeDeduplicator, ExpiresUnmatchedEntries) {
+    using S = mb::ChangeDeduplicator::Source;
+    mb::ChangeDeduplicator dedup(std::chrono::seconds(0));
+
+    EXPECT_TRUE(dedup.accept(S::Log, "INSERT", "posts", "1"));
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    dedup.purge();
+    EXPECT_EQ(dedup.size(), 0u);
+
+    // A late journal copy of an expired entry is delivered again rather than lost
+    EXPECT_TRUE(dedup.accept(S::Journal, "INSERT", "posts", "1"));
+}
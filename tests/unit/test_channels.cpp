@@ -0,0 +1,179 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/channels.h"
+#include "mantisbase/core/exceptions.h"
+#include "mantisbase/core/realtime_access.h"
+#include "mantisbase/core/realtime_event.h"
+
+#include <cstdlib>
+
+using mb::Channels;
+using mb::AccessRule;
+
+namespace {
+    struct Captured {
+        std::vector<std::pair<std::string, std::shared_ptr<const mb::EncodedEvent>>> delivered;
+        std::vector<mb::json> forwarded;
+    };
+
+    std::shared_ptr<Captured> capture(Channels &channels) {
+        auto captured = std::make_shared<Captured>();
+        channels.setSink([captured](const std::string &topic, const std::shared_ptr<const mb::EncodedEvent> &event) {
+            captured->delivered.emplace_back(topic, event);
+        });
+        channels.setForward([captured](const std::string &notification) {
+            captured->forwarded.push_back(mb::json::parse(notification));
+        });
+        return captured;
+    }
+
+    mb::RealtimeAuth user(const std::string &id) {
+        mb::RealtimeAuth who;
+        who.verified = true;
+        who.principal = "users:" + id;
+        who.auth = {{"id", id}, {"entity", "users"}, {"user", {{"id", id}}}};
+        return who;
+    }
+
+    int codeOf(const std::function<void()> &call) {
+        try {
+            call();
+        } catch (const mb::MantisException &e) {
+            return e.code();
+        }
+        return 0;
+    }
+}
+
+TEST(Channels, ReadsNamesAndDeclarations) {
+    EXPECT_EQ(Channels::nameOf("@room:42"), "room:42");
+    EXPECT_FALSE(Channels::nameOf("@"));
+    EXPECT_FALSE(Channels::nameOf("room"));
+    EXPECT_FALSE(Channels::nameOf("@room 42"));
+
+    setenv("MB_REALTIME_CHANNELS", "room:*=auth+presence, room:lobby=public/admin, bad=nobody", 1);
+    Channels channels;
+    unsetenv("MB_REALTIME_CHANNELS");
+
+    const auto room = channels.rules("room:42");
+    ASSERT_TRUE(room);
+    EXPECT_TRUE(room->presence);
+    EXPECT_EQ(room->subscribe.mode(), "auth");
+    // The exact name wins over the prefix
+    const auto lobby = channels.rules("room:lobby");
+    ASSERT_TRUE(lobby);
+    EXPECT_FALSE(lobby->presence);
+    EXPECT_EQ(lobby->subscribe.mode(), "public");
+    EXPECT_EQ(lobby->publish.mode(), "custom");
+    EXPECT_FALSE(channels.rules("bad"));
+    EXPECT_FALSE(channels.rules("cursors"));
+}
+
+TEST(Channels, PublishesToSubscribersAndOtherNodes) {
+    Channels channels;
+    channels.define("chat", {AccessRule("public"), AccessRule("auth")});
+    const auto captured = capture(channels);
+
+    EXPECT_EQ(codeOf([&] { channels.publish("chat", {{"text", "hi"}}, mb::RealtimeAuth{}); }), 403);
+    EXPECT_EQ(codeOf([&] { channels.publish("nope", nullptr, user("1")); }), 404);
+    EXPECT_EQ(codeOf([&] { channels.publish("chat", std::string(channels.maxBytes(), 'x'), user("1")); }), 413);
+    EXPECT_TRUE(captured->delivered.empty());
+
+    channels.publish("chat", {{"text", "hi"}}, user("1"));
+    ASSERT_EQ(captured->delivered.size(), 1u);
+    const auto &[topic, event] = captured->delivered.front();
+    EXPECT_EQ(topic, "@chat");
+    EXPECT_TRUE(event->isEphemeral());
+    EXPECT_TRUE(event->sse().starts_with("event: message\ndata: "));
+    const auto ws = mb::json::parse(event->ws());
+    EXPECT_EQ(ws["type"], "message");
+    EXPECT_EQ(ws["data"]["text"], "hi");
+    EXPECT_EQ(ws["from"]["id"], "1");
+    // Never cut down to a subscriber's fields
+    EXPECT_EQ(mb::EncodedEvent::project(event, {"other"}), event);
+
+    ASSERT_EQ(captured->forwarded.size(), 1u);
+    EXPECT_EQ(captured->forwarded[0]["node"], channels.node());
+
+    // What another node forwards is delivered here only
+    channels.receive(captured->forwarded[0].dump());
+    auto remote = captured->forwarded[0];
+    remote["node"] = "other";
+    channels.receive(remote.dump());
+    EXPECT_EQ(captured->delivered.size(), 2u);
+    EXPECT_EQ(captured->forwarded.size(), 1u);
+}
+
+TEST(Channels, TracksPresenceAcrossConnectionsAndNodes) {
+    Channels channels;
+    channels.define("room:*", {AccessRule("public"), AccessRule("public"), true});
+    const auto captured = capture(channels);
+    const auto action = [&](const std::size_t i) {
+        return mb::json::parse(captured->delivered.at(i).second->ws()).value("action", "");
+    };
+
+    // Two tabs of one user are one member
+    channels.joined("room:1", user("1"), "a");
+    channels.joined("room:1", user("1"), "b");
+    ASSERT_EQ(captured->delivered.size(), 1u);
+    EXPECT_EQ(action(0), "join");
+    EXPECT_EQ(channels.members("room:1").size(), 1u);
+    channels.left("room:1", user("1"), "a");
+    EXPECT_EQ(captured->delivered.size(), 1u);
+    channels.left("room:1", user("1"), "b");
+    ASSERT_EQ(captured->delivered.size(), 2u);
+    EXPECT_EQ(action(1), "leave");
+    EXPECT_EQ(captured->forwarded.size(), 2u);
+    EXPECT_TRUE(channels.members("room:1").empty());
+
+    // Guests can't be told apart, so each connection counts
+    channels.joined("room:1", mb::RealtimeAuth{}, "g1");
+    channels.joined("room:1", mb::RealtimeAuth{}, "g2");
+    EXPECT_EQ(channels.members("room:1").size(), 2u);
+
+    const auto remote = [&](const std::string &what) {
+        channels.receive(mb::json{{"node", "other"}, {"event", {
+            {"type", "presence"}, {"channel", "room:2"}, {"action", what}, {"member", {{"key", "users:2"}}}
+        }}}.dump());
+    };
+    captured->delivered.clear();
+    remote("join");
+    channels.joined("room:2", user("2"), "c");
+    EXPECT_EQ(channels.members("room:2").size(), 1u);
+    remote("leave");
+    // Still here through connection `c`
+    EXPECT_EQ(captured->delivered.size(), 1u);
+    channels.left("room:2", user("2"), "c");
+    ASSERT_EQ(captured->delivered.size(), 2u);
+    EXPECT_EQ(action(1), "leave");
+}
+
+TEST(Channels, SystemChannelsAreForAdminsAndTheServer) {
+    Channels channels;
+    const auto captured = capture(channels);
+    const auto schemas = std::string(Channels::SCHEMAS);
+
+    auto admin = user("a1");
+    admin.auth["entity"] = "mb_admins";
+    EXPECT_TRUE(channels.canSubscribe(schemas, admin));
+    EXPECT_FALSE(channels.canSubscribe(schemas, user("1")));
+    EXPECT_EQ(codeOf([&] { channels.publish(schemas, {{"x", 1}}, admin); }), 403);
+
+    channels.announce(Channels::SCHEMAS, {{"type", "schema_changed"}, {"version", 3}, {"entities", {"posts"}}});
+    ASSERT_EQ(captured->delivered.size(), 1u);
+    EXPECT_EQ(captured->delivered[0].first, "@mb:schemas");
+    EXPECT_TRUE(captured->delivered[0].second->sse().starts_with("event: schema_changed\ndata: "));
+    const auto ws = mb::json::parse(captured->delivered[0].second->ws());
+    EXPECT_EQ(ws["channel"], "mb:schemas");
+    EXPECT_EQ(ws["version"], 3);
+    // Every node announces its own changes
+    EXPECT_TRUE(captured->forwarded.empty());
+}
+
+TEST(Channels, GuestsMaySubscribeToSettings) {
+    Channels channels;
+    const auto settings = std::string(Channels::SETTINGS);
+
+    EXPECT_TRUE(channels.canSubscribe(settings, mb::RealtimeAuth{}));
+    EXPECT_FALSE(channels.canSubscribe(std::string(Channels::SCHEMAS), mb::RealtimeAuth{}));
+    EXPECT_EQ(codeOf([&] { channels.publish(settings, {{"x", 1}}, user("1")); }), 403);
+}
@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/compression.h"
+
+#include <zlib.h>
+
+using mb::Compression;
+using Encoding = Compression::Encoding;
+
+TEST(Compression, NegotiatesByQualityThenPreference) {
+    EXPECT_EQ(Compression::negotiate(""), Encoding::Identity);
+    EXPECT_EQ(Compression::negotiate("identity"), Encoding::Identity);
+    EXPECT_EQ(Compression::negotiate("gzip"), Encoding::Gzip);
+    EXPECT_EQ(Compression::negotiate("x-gzip"), Encoding::Gzip);
+    EXPECT_EQ(Compression::negotiate("GZIP;q=0.5"), Encoding::Gzip);
+
+    // Ruled out by q=0, including through `*`
+    EXPECT_EQ(Compression::negotiate("gzip;q=0"), Encoding::Identity);
+    EXPECT_EQ(Compression::negotiate("*;q=0"), Encoding::Identity);
+    EXPECT_EQ(Compression::negotiate("*, gzip;q=0"),
+              Compression::available(Encoding::Zstd) ? Encoding::Zstd
+              : Compression::available(Encoding::Brotli) ? Encoding::Brotli : Encoding::Identity);
+
+    if (Compression::available(Encoding::Brotli)) {
+        EXPECT_EQ(Compression::negotiate("gzip, deflate, br"), Encoding::Brotli);
+        EXPECT_EQ(Compression::negotiate("br;q=0.4, gzip;q=0.8"), Encoding::Gzip);
+    } else {
+        EXPECT_EQ(Compression::negotiate("br"), Encoding::Identity);
+        EXPECT_EQ(Compression::negotiate("gzip, br"), Encoding::Gzip);
+    }
+}
+
+TEST(Compression, OnlyTextLikeTypesAreCompressible) {
+    EXPECT_TRUE(Compression::isCompressible("application/json; charset=utf-8"));
+    EXPECT_TRUE(Compression::isCompressible("text/html"));
+    EXPECT_TRUE(Compression::isCompressible("image/svg+xml"));
+    EXPECT_TRUE(Compression::isCompressible("application/problem+json"));
+    EXPECT_FALSE(Compression::isCompressible("image/png"));
+    EXPECT_FALSE(Compression::isCompressible("application/octet-stream"));
+    EXPECT_FALSE(Compression::isCompressible(""));
+}
+
+TEST(Compression, GzipRoundTrips) {
+    std::string body;
+    for (int i = 0; i < 500; ++i) body += R"({"id":")" + std::to_string(i) + R"(","title":"hello"},)";
+
+    const auto encoded = Compression::compress(Encoding::Gzip, body);
+    ASSERT_FALSE(encoded.empty());
+    EXPECT_LT(encoded.size(), body.size() / 4);
+    EXPECT_EQ(encoded.substr(0, 2), std::string("\x1f\x8b", 2));
+
+    z_stream zs{};
+    ASSERT_EQ(inflateInit2(&zs, 15 + 16), Z_OK);
+    std::string decoded(body.size(), '\0');
+    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(encoded.data()));
+    zs.avail_in = static_cast<uInt>(encoded.size());
+    zs.next_out = reinterpret_cast<Bytef *>(decoded.data());
+    zs.avail_out = static_cast<uInt>(decoded.size());
+    EXPECT_EQ(inflate(&zs, Z_FINISH), Z_STREAM_END);
+    inflateEnd(&zs);
+    EXPECT_EQ(decoded, body);
+
+    EXPECT_TRUE(Compression::compress(Encoding::Identity, body).empty());
+}
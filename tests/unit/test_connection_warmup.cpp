@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/connection_warmup.h"
+#include "mantisbase/core/database.h"
+#include "mantisbase/core/models/entity.h"
+#include "mantisbase/core/models/entity_schema.h"
+#include "mantisbase/core/models/entity_schema_field.h"
+#include "mantisbase/mantisbase.h"
+#include "../common/test_environment.h"
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using mb::ConnectionWarmup;
+
+class ConnectionWarmupTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        schema = std::make_unique<mb::EntitySchema>(mb::MantisBase::instance(), "warm_notes", "base");
+        schema->addField(mb::EntitySchemaField("title", "string"));
+        if (!mb::EntitySchema::tableExists(*schema)) mb::EntitySchema::createTable(*schema);
+    }
+
+    void TearDown() override {
+        mb::EntitySchema::dropTable(*schema);
+    }
+
+    static bool waitReady(const ConnectionWarmup &warmup) {
+        for (int i = 0; i < 500 && !warmup.ready(); ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return warmup.ready();
+    }
+
+    std::unique_ptr<mb::EntitySchema> schema;
+};
+
+TEST_F(ConnectionWarmupTest, PreparesReadsOnEveryPooledConnection) {
+    const auto notes = std::make_shared<const mb::Entity>(schema->toEntity());
+    const auto &db = mb::MantisBase::instance().db();
+    db.invalidateStatements(notes->name());
+
+    ConnectionWarmup::Options options;
+    options.enabled = true;
+    ConnectionWarmup warmup(mb::MantisBase::instance(), options);
+    warmup.start({notes});
+    ASSERT_TRUE(waitReady(warmup));
+
+    // Held at once, so each is a different connection; all are prepared already
+    const auto before = db.statementCacheStats();
+    std::vector<std::shared_ptr<soci::session>> sessions;
+    for (std::size_t i = 0; i < db.poolMin(); ++i) sessions.push_back(db.session());
+    for (const auto &sql: sessions) notes->prepareStatements(*sql);
+    const auto after = db.statementCacheStats();
+    EXPECT_EQ(after.misses, before.misses);
+    EXPECT_EQ(after.hits, before.hits + 2 * db.poolMin());
+
+    sessions.clear();
+    EXPECT_FALSE(notes->read("missing").has_value());
+    EXPECT_EQ(db.statementCacheStats().misses, before.misses);
+}
+
+TEST(ConnectionWarmup, ReadyWhenDisabled) {
+    ConnectionWarmup warmup(mb::MantisBase::instance(), {});
+    warmup.start({});
+    EXPECT_TRUE(warmup.ready());
+    warmup.stop();
+    EXPECT_TRUE(warmup.ready());
+}
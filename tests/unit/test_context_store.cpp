@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include "mantisbase/core/context_store.h"
 #include <string>
+#include <utility>
 
 TEST(ContextStore, BasicOperations) {
     mb::ContextStore ctx;
@@ -82,3 +83,72 @@ TEST(ContextStore, GetNonexistentKey) {
     EXPECT_FALSE(val.has_value());
 }
 
+
+TEST(ContextStore, AuthAndVerificationSlots) {
+    mb::ContextStore ctx;
+
+    EXPECT_FALSE(ctx.hasKey("auth"));
+    EXPECT_TRUE(std::as_const(ctx).auth().is_object());
+    EXPECT_TRUE(std::as_const(ctx).auth().empty());
+
+    ctx.auth()["type"] = "user";
+    EXPECT_TRUE(ctx.hasKey("auth"));
+
+    // The keyed API reaches the same slot
+    auto &auth = ctx.getOr<mb::json>("auth", mb::json::object());
+    EXPECT_EQ(&auth, &ctx.auth());
+    EXPECT_EQ(auth["type"], "user");
+
+    ctx.set<mb::json>("verification", {{"verified", true}});
+    EXPECT_TRUE(ctx.verification()["verified"].get<bool>());
+    EXPECT_EQ(*ctx.get<mb::json>("verification").value(), ctx.verification());
+}
+
+TEST(ContextStore, GetOrFillsAnUnsetSlot) {
+    mb::ContextStore ctx;
+
+    auto &auth = ctx.getOr<mb::json>("auth", {{"type", "guest"}});
+    EXPECT_EQ(auth["type"], "guest");
+    EXPECT_EQ(ctx.auth()["type"], "guest");
+    EXPECT_FALSE(ctx.get<mb::json>("verification").has_value());
+}
+
+TEST(ContextStore, EntitySlotStartsEmpty) {
+    mb::ContextStore ctx;
+    EXPECT_EQ(ctx.entity(), nullptr);
+    EXPECT_FALSE(ctx.hasKey("mb_entity"));
+}
+
+TEST(ContextStore, DeferredAuthRunsOnceOnFirstRead) {
+    mb::ContextStore ctx;
+    ctx.auth()["token"] = "abc";
+
+    int runs = 0;
+    ctx.deferAuth([&runs](mb::json &auth, mb::json &verification) {
+        ++runs;
+        EXPECT_EQ(auth["token"], "abc");
+        auth["type"] = "user";
+        verification["verified"] = true;
+    });
+
+    // Other keys don't need to know who is asking
+    ctx.set<int>("other", 1);
+    EXPECT_TRUE(ctx.hasKey("other"));
+    EXPECT_TRUE(ctx.authPending());
+    EXPECT_EQ(runs, 0);
+
+    EXPECT_TRUE(ctx.verification()["verified"].get<bool>());
+    EXPECT_EQ(ctx.auth()["type"], "user");
+    EXPECT_EQ(ctx.getOr<mb::json>("auth", mb::json::object())["type"], "user");
+    EXPECT_FALSE(ctx.authPending());
+    EXPECT_EQ(runs, 1);
+}
+
+TEST(ContextStore, DeferredAuthResolvesForKeyedReads) {
+    mb::ContextStore ctx;
+    ctx.deferAuth([](mb::json &auth, mb::json &) { auth = {{"type", "user"}}; });
+
+    const auto auth = ctx.get<mb::json>("auth");
+    ASSERT_TRUE(auth.has_value());
+    EXPECT_EQ((*auth.value())["type"], "user");
+}
@@ -0,0 +1,35 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/cors.h"
+
+using mb::CorsPolicy;
+
+TEST(CorsPolicy, AnyOriginByDefault) {
+    const CorsPolicy cors(CorsPolicy::Options{});
+    EXPECT_TRUE(cors.anyOrigin());
+    EXPECT_EQ(cors.allowOrigin("https://app.example.com"), "*");
+    EXPECT_EQ(cors.allowOrigin(""), "*");
+    EXPECT_EQ(cors.maxAge(), "86400");
+}
+
+TEST(CorsPolicy, AllowlistEchoesListedOriginsOnly) {
+    CorsPolicy::Options options;
+    options.origins = {" https://App.Example.com/ ", "http://localhost:5173", ""};
+    options.maxAge = 600;
+    const CorsPolicy cors(options);
+
+    EXPECT_FALSE(cors.anyOrigin());
+    EXPECT_EQ(cors.allowOrigin("https://app.example.com"), "https://app.example.com");
+    EXPECT_EQ(cors.allowOrigin("http://localhost:5173"), "http://localhost:5173");
+    EXPECT_TRUE(cors.allowOrigin("http://localhost:3000").empty());
+    EXPECT_TRUE(cors.allowOrigin("https://app.example.com.evil.test").empty());
+    EXPECT_TRUE(cors.allowOrigin("").empty());
+    EXPECT_EQ(cors.maxAge(), "600");
+}
+
+TEST(CorsPolicy, WildcardInTheListAllowsAll) {
+    CorsPolicy::Options options;
+    options.origins = {"https://app.example.com", "*"};
+    const CorsPolicy cors(options);
+    EXPECT_TRUE(cors.anyOrigin());
+    EXPECT_EQ(cors.allowOrigin("https://other.example.com"), "*");
+}
@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/count_cache.h"
+
+using namespace std::chrono_literals;
+using mb::CountCache;
+using nlohmann::json;
+
+namespace {
+    json event(const std::string &type, const std::string &entity, const std::string &row_id = "r1") {
+        return {{"type", type}, {"entity", entity}, {"row_id", row_id}};
+    }
+}
+
+TEST(CountCache, ServesFreshCountsPerFilter) {
+    CountCache cache;
+    const auto now = CountCache::Clock::now();
+    cache.put("posts", "", 100, now);
+    cache.put("posts", "status = 'done'", 7, now);
+
+    EXPECT_EQ(cache.get("posts", "", now), 100);
+    EXPECT_EQ(cache.get("posts", "status = 'done'", now), 7);
+    EXPECT_FALSE(cache.get("posts", "status = 'open'", now).has_value());
+    EXPECT_FALSE(cache.get("users", "", now).has_value());
+    EXPECT_EQ(cache.size(), 2u);
+}
+
+TEST(CountCache, EntriesExpireAfterTtl) {
+    CountCache cache(10s);
+    const auto now = CountCache::Clock::now();
+    cache.put("posts", "", 100, now);
+    cache.put("posts", "x = 1", 5, now);
+
+    EXPECT_TRUE(cache.get("posts", "", now + 9s).has_value());
+    EXPECT_FALSE(cache.get("posts", "", now + 10s).has_value());
+    EXPECT_FALSE(cache.get("posts", "x = 1", now + 11s).has_value());
+    EXPECT_EQ(cache.size(), 0u);
+}
+
+TEST(CountCache, ZeroTtlDisablesCaching) {
+    CountCache cache(0s);
+    cache.put("posts", "", 100);
+    EXPECT_FALSE(cache.get("posts").has_value());
+}
+
+TEST(CountCache, ChangesAdjustTotalAndDropFilteredCounts) {
+    CountCache cache;
+    cache.put("posts", "", 10);
+    cache.put("posts", "x = 1", 3);
+    cache.put("users", "", 4);
+
+    cache.onChanges(json::array({event("INSERT", "posts", "a"), event("INSERT", "posts", "b"),
+                                 event("DELETE", "posts", "c")}));
+    EXPECT_EQ(cache.get("posts"), 11);
+    EXPECT_FALSE(cache.get("posts", "x = 1").has_value());
+    EXPECT_EQ(cache.get("users"), 4);
+
+    cache.put("posts", "x = 1", 3);
+    cache.onChanges(json::array({event("UPDATE", "posts")}));
+    EXPECT_EQ(cache.get("posts"), 11);
+    EXPECT_FALSE(cache.get("posts", "x = 1").has_value());
+}
+
+TEST(CountCache, TotalNeverGoesNegative) {
+    CountCache cache;
+    cache.put("posts", "", 1);
+    cache.onChanges(json::array({event("DELETE", "posts", "a"), event("DELETE", "posts", "b")}));
+    EXPECT_EQ(cache.get("posts"), 0);
+}
+
+TEST(CountCache, ImportDropsTotal) {
+    CountCache cache;
+    cache.put("posts", "", 10);
+    cache.put("users", "", 4);
+    cache.onChanges(json::array({event("IMPORT", "posts", "")}));
+    EXPECT_FALSE(cache.get("posts").has_value());
+    EXPECT_EQ(cache.get("users"), 4);
+}
+
+TEST(CountCache, IgnoresMalformedEventsAndUncachedEntities) {
+    CountCache cache;
+    cache.put("posts", "", 2);
+    cache.onChanges(json::object());
+    cache.onChanges(json::array({42, json{{"type", "INSERT"}}, event("INSERT", "users")}));
+    EXPECT_EQ(cache.get("posts"), 2);
+    EXPECT_FALSE(cache.get("users").has_value());
+}
+
+TEST(CountCache, BoundsFilteredCountsPerEntity) {
+    CountCache cache(60s, 2);
+    cache.put("posts", "a = 1", 1);
+    cache.put("posts", "a = 2", 2);
+    cache.put("posts", "a = 3", 3);
+    cache.put("posts", "", 10);
+
+    EXPECT_EQ(cache.size(), 3u);
+    EXPECT_EQ(cache.get("posts", "a = 3"), 3);
+    EXPECT_EQ(cache.get("posts"), 10);
+
+    cache.invalidateEntity("posts");
+    EXPECT_EQ(cache.size(), 0u);
+}
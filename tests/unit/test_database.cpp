@@ -4,6 +4,7 @@
 
 #include <gtest/gtest.h>
 #include <mantisbase/mantis.h>
+#include <mantisbase/core/realtime.h>
 #include "../common/test_environment.h"
 
 TEST(DatabaseTest, TestDatabaseConnected) {
@@ -62,4 +63,118 @@ TEST(DatabaseTest, EntityOperations) {
     EXPECT_TRUE(admin_entity.hasField("created"));
     EXPECT_TRUE(admin_entity.hasField("updated"));
     // EXPECT_TRUE(admin_entity.isEmpty()); // When created, the table is empty
-}
\ No newline at end of file
+}
+TEST(DatabaseTest, PreparedStatementCacheReusesStatements) {
+    const auto& mApp = mb::MantisBase::instance();
+    const auto& db = mApp.db();
+    const auto admin_entity = mApp.entity("mb_admins");
+
+    // Warm the statement on whichever connections the reads land on
+    for (int i = 0; i < 8; ++i) EXPECT_FALSE(admin_entity.read("no-such-id").has_value());
+
+    const auto before = db.statementCacheStats();
+    EXPECT_GT(before.size, 0u);
+
+    for (int i = 0; i < 8; ++i) EXPECT_FALSE(admin_entity.read("no-such-id").has_value());
+
+    const auto after = db.statementCacheStats();
+    EXPECT_GE(after.hits, before.hits + 8);
+
+    // Invalidation drops the statements on next use, forcing a re-prepare
+    db.invalidateStatements("mb_admins");
+    EXPECT_FALSE(admin_entity.read("no-such-id").has_value());
+    EXPECT_GT(db.statementCacheStats().misses, after.misses);
+}
+
+TEST(DatabaseTest, WritesPinRequestReadsToPrimary) {
+    auto &db = mb::MantisBase::instance().db();
+    const bool outside = mb::Database::pinnedToPrimary();
+    {
+        const mb::Database::RequestScope scope;
+        EXPECT_FALSE(mb::Database::pinnedToPrimary());
+
+        db.write([](soci::session &) {});
+        EXPECT_TRUE(mb::Database::pinnedToPrimary());
+        {
+            const mb::Database::RequestScope nested;
+            EXPECT_FALSE(mb::Database::pinnedToPrimary());
+        }
+        EXPECT_TRUE(mb::Database::pinnedToPrimary());
+
+        // Without replicas every read is served by the primary pool
+        EXPECT_TRUE(db.readSession()->is_connected());
+        EXPECT_TRUE(db.metrics()["replicas"].empty());
+    }
+    EXPECT_EQ(mb::Database::pinnedToPrimary(), outside);
+}
+
+TEST(DatabaseTest, RequestDeadlinesStopStatements) {
+    using namespace std::chrono_literals;
+    auto &app = mb::MantisBase::instance();
+    if (app.dbType() != "sqlite3") GTEST_SKIP() << "Interrupts running statements on SQLite only";
+    const auto sql = app.db().session();
+    int one = 0;
+
+    mb::RequestDeadline past(mb::RequestDeadline::Clock::now() - 1ms);
+    {
+        const mb::RequestDeadline::Scope scope(&past);
+        try {
+            *sql << "SELECT 1", soci::into(one);
+            ADD_FAILURE() << "Ran past the deadline";
+        } catch (const mb::MantisException &e) {
+            EXPECT_EQ(e.code(), 504);
+        }
+    }
+
+    // Endless unless interrupted once the deadline passes mid-statement
+    mb::RequestDeadline soon(mb::RequestDeadline::Clock::now() + 50ms);
+    {
+        const mb::RequestDeadline::Scope scope(&soon);
+        long long rows = 0;
+        EXPECT_ANY_THROW(*sql << "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c) "
+                                 "SELECT COUNT(*) FROM c", soci::into(rows));
+    }
+
+    // The connection is fine for the next request
+    *sql << "SELECT 1", soci::into(one);
+    EXPECT_EQ(one, 1);
+}
+
+TEST(DatabaseTest, RealtimeHooksAreRebuiltOnlyWhenStale) {
+    auto &app = mb::MantisBase::instance();
+    if (app.dbType() != "sqlite3") GTEST_SKIP() << "Compares trigger text in sqlite_master";
+
+    mb::EntitySchema schema{app, "rt_hooks_test", "base"};
+    schema.addField(mb::EntitySchemaField("title", "string"));
+    if (!mb::EntitySchema::tableExists(schema)) mb::EntitySchema::createTable(schema);
+
+    const auto triggers = [&] {
+        std::vector<std::string> out;
+        const auto sql = app.db().session();
+        const soci::rowset<std::string> rows = (sql->prepare
+            << "SELECT sql FROM sqlite_master WHERE type = 'trigger' AND tbl_name = 'rt_hooks_test' ORDER BY name");
+        std::ranges::copy(rows, std::back_inserter(out));
+        return out;
+    };
+    const auto created = triggers();
+    ASSERT_EQ(created.size(), 3u);
+
+    // Current: left as they are
+    app.rt().addDbHooks(schema.toEntity());
+    EXPECT_EQ(triggers(), created);
+
+    // One missing: all three rebuilt
+    *app.db().writeSession() << "DROP TRIGGER mb_rt_hooks_test_update_trigger";
+    app.rt().addDbHooks(schema.toEntity());
+    EXPECT_EQ(triggers(), created);
+
+    // A new field goes into the change log rows
+    schema.addField(mb::EntitySchemaField("body", "string"));
+    app.rt().addDbHooks(schema.toEntity());
+    const auto updated = triggers();
+    ASSERT_EQ(updated.size(), 3u);
+    EXPECT_NE(updated, created);
+    EXPECT_NE(updated[0].find("body"), std::string::npos);
+
+    mb::EntitySchema::dropTable(schema);
+}
@@ -0,0 +1,166 @@
+#include <gtest/gtest.h>
+#include <soci/soci.h>
+#include <soci/sqlite3/soci-sqlite3.h>
+#include "mantisbase/core/delta_sync.h"
+#include "mantisbase/core/exceptions.h"
+
+#include <map>
+
+using mb::DeltaSync;
+using nlohmann::json;
+
+namespace {
+    void createChangeLog(soci::session &sql) {
+        sql << "CREATE TABLE mb_change_log (id INTEGER PRIMARY KEY AUTOINCREMENT, "
+                "timestamp DATETIME DEFAULT CURRENT_TIMESTAMP, type TEXT NOT NULL, entity TEXT NOT NULL, "
+                "row_id TEXT NOT NULL, old_data TEXT, new_data TEXT)";
+    }
+
+    void logChange(soci::session &sql, const std::string &type, const std::string &entity, const std::string &row_id,
+                   const std::string &age = "0 seconds") {
+        sql << "INSERT INTO mb_change_log (timestamp, type, entity, row_id) "
+                "VALUES (datetime('now', '-' || :age), :type, :entity, :row_id)",
+                soci::use(age), soci::use(type), soci::use(entity), soci::use(row_id);
+    }
+
+    int statusOf(const std::function<void()> &fn) {
+        try {
+            fn();
+        } catch (const mb::MantisException &e) {
+            return e.code();
+        }
+        return 0;
+    }
+
+    /// Stands in for Entity::readMany(): the rows of `visible` that are asked for
+    auto reader(const std::map<std::string, json> &visible) {
+        return [visible](const std::string &entity, const std::vector<std::string> &ids) {
+            std::vector<json> rows;
+            for (const auto &id: ids)
+                if (const auto it = visible.find(entity + "/" + id); it != visible.end()) rows.push_back(it->second);
+            return rows;
+        };
+    }
+
+    DeltaSync::Options retaining(const int seconds, const int batch = 1000) {
+        DeltaSync::Options options;
+        options.retain = std::chrono::seconds(seconds);
+        options.batch = batch;
+        return options;
+    }
+}
+
+TEST(DeltaSync, CursorsRoundTrip) {
+    const DeltaSync::Cursor cursor{42, 1700000000};
+    const auto decoded = DeltaSync::Cursor::decode(cursor.encode());
+    ASSERT_TRUE(decoded.has_value());
+    EXPECT_EQ(decoded->changeId, 42);
+    EXPECT_EQ(decoded->at, 1700000000);
+
+    for (const auto *bad: {"", "42", "42.", ".5", "a.5", "42.5x", "-1.5"})
+        EXPECT_FALSE(DeltaSync::Cursor::decode(bad).has_value()) << bad;
+}
+
+TEST(DeltaSync, CompactsToOneChangePerRow) {
+    std::set<std::string> resync;
+    const auto rows = DeltaSync::compact({
+                                             {"UPDATE", "posts", "a"},
+                                             {"INSERT", "posts", "b"},
+                                             {"UPDATE", "posts", "a"},
+                                             {"INSERT", "posts", "c"},
+                                             {"DELETE", "posts", "c"},
+                                             {"DELETE", "posts", "b"},
+                                             {"UPDATE", "notes", "a"},
+                                             {"DELETE", "notes", "a"},
+                                             {"IMPORT", "posts", ""},
+                                         }, resync);
+
+    // `b` and `c` came and went; `a` of two entities are two rows
+    ASSERT_EQ(rows.size(), 2u);
+    EXPECT_EQ(rows[0].entity, "posts");
+    EXPECT_EQ(rows[0].rowId, "a");
+    EXPECT_FALSE(rows[0].inserted);
+    EXPECT_FALSE(rows[0].deleted);
+    EXPECT_EQ(rows[1].entity, "notes");
+    EXPECT_TRUE(rows[1].deleted);
+    EXPECT_EQ(resync, std::set<std::string>{"posts"});
+}
+
+TEST(DeltaSync, ServesUpsertsAndTombstonesSinceTheCursor) {
+    soci::session sql{soci::sqlite3, ":memory:"};
+    createChangeLog(sql);
+    logChange(sql, "INSERT", "posts", "old");
+
+    const auto options = retaining(3600);
+    const auto start = DeltaSync::changesSince(sql, std::nullopt, {"posts"}, options, reader({}));
+    EXPECT_TRUE(start["upserts"].empty());
+    const auto cursor = DeltaSync::Cursor::decode(start["cursor"].get<std::string>());
+    ASSERT_TRUE(cursor.has_value());
+    EXPECT_EQ(cursor->changeId, 1);
+
+    logChange(sql, "UPDATE", "posts", "old");
+    logChange(sql, "INSERT", "posts", "new");
+    logChange(sql, "UPDATE", "posts", "new");
+    logChange(sql, "INSERT", "posts", "hidden");
+    logChange(sql, "INSERT", "notes", "elsewhere");
+    logChange(sql, "UPDATE", "posts", "gone");
+    logChange(sql, "DELETE", "posts", "gone");
+
+    // `old` left the caller's view; `hidden` was never in it
+    const auto read = reader({{"posts/new", {{"id", "new"}, {"title", "B"}}}});
+    const auto changes = DeltaSync::changesSince(sql, cursor, {"posts"}, options, read);
+    ASSERT_EQ(changes["upserts"]["posts"].size(), 1u);
+    EXPECT_EQ(changes["upserts"]["posts"][0]["title"], "B");
+    EXPECT_EQ(changes["deletes"]["posts"], json::array({"old", "gone"}));
+    EXPECT_FALSE(changes["upserts"].contains("notes"));
+    EXPECT_FALSE(changes["more"].get<bool>());
+    EXPECT_EQ(DeltaSync::Cursor::decode(changes["cursor"].get<std::string>())->changeId, 8);
+
+    // Caught up
+    const auto none = DeltaSync::changesSince(sql, DeltaSync::Cursor::decode(changes["cursor"].get<std::string>()),
+                                              {"posts"}, options, read);
+    EXPECT_TRUE(none["upserts"].empty());
+    EXPECT_TRUE(none["deletes"].empty());
+}
+
+TEST(DeltaSync, PagesThroughLongLogs) {
+    soci::session sql{soci::sqlite3, ":memory:"};
+    createChangeLog(sql);
+    for (int i = 0; i < 5; ++i) logChange(sql, "UPDATE", "posts", std::to_string(i));
+
+    const auto options = retaining(3600, 3);
+    auto cursor = DeltaSync::Cursor::decode(
+        DeltaSync::changesSince(sql, std::nullopt, {"posts"}, options, reader({}))["cursor"].get<std::string>());
+    cursor->changeId = 0;
+
+    const auto first = DeltaSync::changesSince(sql, cursor, {"posts"}, options, reader({}));
+    EXPECT_TRUE(first["more"].get<bool>());
+    EXPECT_EQ(first["deletes"]["posts"].size(), 3u);
+
+    const auto rest = DeltaSync::changesSince(sql, DeltaSync::Cursor::decode(first["cursor"].get<std::string>()),
+                                              {"posts"}, options, reader({}));
+    EXPECT_FALSE(rest["more"].get<bool>());
+    EXPECT_EQ(rest["deletes"]["posts"], json::array({"3", "4"}));
+}
+
+TEST(DeltaSync, CursorsPastTheRetentionAreGone) {
+    soci::session sql{soci::sqlite3, ":memory:"};
+    createChangeLog(sql);
+    logChange(sql, "INSERT", "posts", "a", "2 hours");
+
+    const auto options = retaining(3600);
+    const auto now = DeltaSync::Cursor::decode(
+        DeltaSync::changesSince(sql, std::nullopt, {"posts"}, options, reader({}))["cursor"].get<std::string>());
+    ASSERT_TRUE(now.has_value());
+
+    EXPECT_EQ(statusOf([&] {
+        (void) DeltaSync::changesSince(sql, DeltaSync::Cursor{0, now->at - 7200}, {"posts"}, options, reader({}));
+    }), 410);
+    // Ids the log never handed out
+    EXPECT_EQ(statusOf([&] {
+        (void) DeltaSync::changesSince(sql, DeltaSync::Cursor{99, now->at}, {"posts"}, options, reader({}));
+    }), 410);
+    EXPECT_EQ(statusOf([&] {
+        (void) DeltaSync::changesSince(sql, DeltaSync::Cursor{1, now->at}, {"posts"}, options, reader({}));
+    }), 0);
+}
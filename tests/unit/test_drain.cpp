@@ -0,0 +1,81 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/drain.h"
+#include "mantisbase/core/metrics.h"
+
+#include <cstdlib>
+#include <thread>
+
+using namespace std::chrono_literals;
+using mb::Drain;
+
+TEST(Drain, RefusesNewRequestsOnceDraining) {
+    Drain drain({});
+    auto first = drain.enter();
+    ASSERT_TRUE(first);
+    EXPECT_EQ(drain.inflight(), 1u);
+
+    EXPECT_TRUE(drain.begin());
+    EXPECT_FALSE(drain.begin());
+    EXPECT_TRUE(drain.draining());
+    EXPECT_FALSE(drain.enter());
+    EXPECT_EQ(drain.refused(), 1u);
+    EXPECT_EQ(drain.inflight(), 1u);
+
+    first.reset();
+    EXPECT_EQ(drain.inflight(), 0u);
+}
+
+TEST(Drain, WaitsForInFlightRequests) {
+    Drain::Options options;
+    options.grace = 5s;
+    Drain drain(options);
+    auto ticket = drain.enter();
+    drain.begin();
+
+    std::thread finish([&ticket] {
+        std::this_thread::sleep_for(20ms);
+        ticket.reset();
+    });
+    EXPECT_TRUE(drain.wait());
+    EXPECT_EQ(drain.inflight(), 0u);
+    finish.join();
+}
+
+TEST(Drain, GivesUpAfterTheGracePeriod) {
+    Drain::Options options;
+    options.grace = 20ms;
+    Drain drain(options);
+    const auto ticket = drain.enter();
+    drain.begin();
+
+    const auto started = std::chrono::steady_clock::now();
+    EXPECT_FALSE(drain.wait());
+    EXPECT_GE(std::chrono::steady_clock::now() - started, 20ms);
+    EXPECT_EQ(drain.inflight(), 1u);
+}
+
+TEST(Drain, OptionsAndMetrics) {
+    setenv("MB_SHUTDOWN_GRACE_MS", "2500", 1);
+    setenv("MB_SHUTDOWN_RECONNECT_JITTER_MS", "0", 1);
+    const auto options = Drain::Options::fromEnv();
+    unsetenv("MB_SHUTDOWN_GRACE_MS");
+    unsetenv("MB_SHUTDOWN_RECONNECT_JITTER_MS");
+    EXPECT_EQ(options.grace, 2500ms);
+    EXPECT_EQ(options.reconnectJitter, 0ms);
+    EXPECT_EQ(Drain::Options::fromEnv().grace, 10000ms);
+
+    Drain drain(options);
+    EXPECT_EQ(drain.reconnectDelay(), 0ms);
+    EXPECT_LE(Drain({}).reconnectDelay(), 5000ms);
+
+    const auto ticket = drain.enter();
+    drain.begin();
+    EXPECT_FALSE(drain.enter());
+
+    mb::MetricsWriter out;
+    drain.writeMetrics(out);
+    const auto &text = out.str();
+    EXPECT_NE(text.find("mb_http_inflight 1"), std::string::npos);
+    EXPECT_NE(text.find("mb_http_draining 1"), std::string::npos);
+    EXPECT_NE(text.find("mb_http_drain_refused_total 1"), std::string::npos);
+}
@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+
+#include "../../include/mantisbase/utils/duk_json.h"
+
+using namespace mb;
+using nlohmann::json;
+
+namespace {
+    struct Heap {
+        duk_context *ctx = duk_create_heap_default();
+        ~Heap() { duk_destroy_heap(ctx); }
+    };
+
+    /// What the JSON text round trip gave before
+    json viaText(duk_context *ctx, const char *code) {
+        duk_eval_string(ctx, code);
+        const char *text = duk_json_encode(ctx, -1);
+        auto value = text ? json::parse(text) : json();
+        duk_pop(ctx);
+        return value;
+    }
+
+    json direct(duk_context *ctx, const char *code) {
+        duk_eval_string(ctx, code);
+        auto value = dukToJson(ctx, -1);
+        duk_pop(ctx);
+        return value;
+    }
+}
+
+TEST(DukJsonTest, ReadsValuesAsJsonStringifyWould) {
+    Heap heap;
+    for (const auto *code: {
+             "({id: 'r1', n: 3, f: 1.5, ok: true, none: null, tags: ['a', 2], nested: {deep: [{x: -0}]}})",
+             "({skip: undefined, fn: function () {}, list: [undefined, function () {}, NaN, Infinity]})",
+             "({when: new Date(0), big: 9007199254740993, neg: -42, text: 'h\\u00e9'})",
+             "[1, [2, [3, []]], {}]",
+             "'plain'", "12", "null"
+         }) {
+        EXPECT_EQ(direct(heap.ctx, code), viaText(heap.ctx, code)) << code;
+    }
+
+    // Whole numbers stay integers, as parsing their text gives
+    EXPECT_TRUE(direct(heap.ctx, "({n: 3})")["n"].is_number_integer());
+    EXPECT_TRUE(direct(heap.ctx, "(undefined)").is_null());
+    // Surrogate pairs, which the text round trip failed to parse, come back as UTF-8
+    EXPECT_EQ(direct(heap.ctx, "'\\ud83d\\ude00!'"), "\U0001F600!");
+    EXPECT_EQ(duk_get_top(heap.ctx), 0);
+}
+
+TEST(DukJsonTest, PushesValuesAsJsonParseWould) {
+    Heap heap;
+    const json record = {
+        {"id", "r1"}, {"n", 3}, {"u", 18446744073709551615ull}, {"f", 0.25}, {"ok", false}, {"none", nullptr},
+        {"tags", {"a", 1, {{"k", "v"}}}}, {"text", "hé \U0001F600"}
+    };
+    dukPushJson(heap.ctx, record);
+    duk_put_global_string(heap.ctx, "record");
+
+    EXPECT_EQ(viaText(heap.ctx, "record"), json::parse(record.dump()));
+    duk_eval_string(heap.ctx, "record.tags[2].k + typeof record.none + typeof record.n");
+    EXPECT_STREQ(duk_get_string(heap.ctx, -1), "vobjectnumber");
+    duk_pop(heap.ctx);
+
+    // And back again unchanged
+    duk_get_global_string(heap.ctx, "record");
+    const auto back = dukToJson(heap.ctx, -1);
+    duk_pop(heap.ctx);
+    EXPECT_EQ(back["tags"], record["tags"]);
+    EXPECT_EQ(back["text"], record["text"]);
+    EXPECT_EQ(back["n"], 3);
+}
+
+TEST(DukJsonTest, DeepAndCyclicValuesFallBackToText) {
+    Heap heap;
+    json deep = 1;
+    for (int i = 0; i < 100; ++i) deep = json::array({deep});
+    dukPushJson(heap.ctx, deep);
+    EXPECT_EQ(dukToJson(heap.ctx, -1), deep);
+    duk_pop(heap.ctx);
+
+    // JSON.stringify's own TypeError, as before
+    duk_eval_string(heap.ctx, "var o = {}; o.self = o; o");
+    EXPECT_NE(duk_safe_call(heap.ctx, [](duk_context *ctx, void *) -> duk_ret_t {
+        [[maybe_unused]] auto _ = dukToJson(ctx, -1);
+        return 0;
+    }, nullptr, 1, 1), DUK_EXEC_SUCCESS);
+}
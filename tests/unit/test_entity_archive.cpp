@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/models/entity.h"
+#include "mantisbase/core/models/entity_archive.h"
+#include "mantisbase/core/models/entity_schema.h"
+#include "mantisbase/core/models/entity_schema_field.h"
+#include "mantisbase/core/database.h"
+#include "mantisbase/mantisbase.h"
+#include "mantisbase/utils/utils.h"
+#include "../common/test_environment.h"
+
+#include <soci/soci.h>
+
+using mb::EntityArchive;
+using nlohmann::json;
+
+class EntityArchiveTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        schema = std::make_unique<mb::EntitySchema>(mb::MantisBase::instance(), "archive_events", "base");
+        schema->addField(mb::EntitySchemaField("title", "string"));
+        schema->setArchive({"created", 30});
+        if (!mb::EntitySchema::tableExists(*schema)) mb::EntitySchema::createTable(*schema);
+    }
+
+    void TearDown() override {
+        mb::EntitySchema::dropTable(*schema);
+    }
+
+    /// Backdate `id`'s `created` by `days`
+    static void age(const std::string &id, const int days) {
+        const auto created = mb::toUtcTime(std::time(nullptr) - static_cast<std::time_t>(days) * 86400);
+        const auto sql = mb::MantisBase::instance().db().writeSession();
+        *sql << "UPDATE archive_events SET created = :c WHERE id = :id", soci::use(created), soci::use(id);
+    }
+
+    std::unique_ptr<mb::EntitySchema> schema;
+};
+
+TEST_F(EntityArchiveTest, MovesOldRowsAndReadsThemBackOnRequest) {
+    const auto events = schema->toEntity();
+    const auto old_id = events.create({{"title", "old"}})["id"].get<std::string>();
+    const auto new_id = events.create({{"title", "new"}})["id"].get<std::string>();
+    age(old_id, 45);
+
+    EXPECT_EQ(EntityArchive::run({std::make_shared<const mb::Entity>(events)}), 1u);
+    EXPECT_EQ(EntityArchive::run({std::make_shared<const mb::Entity>(events)}), 0u);
+
+    const auto live = events.list(json::object());
+    ASSERT_EQ(live.size(), 1u);
+    EXPECT_EQ(live[0]["id"], new_id);
+    EXPECT_FALSE(events.read(old_id).has_value());
+
+    EXPECT_EQ(events.list({{"include_archived", true}}).size(), 2u);
+    EXPECT_EQ(events.list({{"include_archived", true}, {"filter", "title = \"old\""}}).size(), 1u);
+    EXPECT_EQ(events.countRecords({{"include_archived", true}}), 2);
+    const auto archived = events.read(old_id, {{"include_archived", true}});
+    ASSERT_TRUE(archived.has_value());
+    EXPECT_EQ((*archived)["title"], "old");
+
+    EXPECT_THROW((void) events.list({{"include_archived", true}, {"search", "old"}}), mb::MantisException);
+}
+
+TEST_F(EntityArchiveTest, ArchiveFollowsNewColumns) {
+    const auto events = schema->toEntity();
+    age(events.create({{"title", "first"}})["id"].get<std::string>(), 60);
+    (void) EntityArchive::run({std::make_shared<const mb::Entity>(events)});
+
+    // Added to the live table and, in the same change, to the archive
+    (void) mb::EntitySchema::updateTable(mb::MantisBase::instance(), schema->id(), {
+        {"fields", json::array({{{"name", "venue"}, {"type", "string"}}})}});
+    const auto sql = mb::MantisBase::instance().db().session();
+    bool found = false;
+    for (const auto &[name, _]: EntityArchive::columns(*sql, mb::ArchivePolicy::tableOf("archive_events")))
+        found = found || name == "venue";
+    EXPECT_TRUE(found);
+}
+
+TEST(ArchivePolicy, ParsesAndValidates) {
+    const auto policy = mb::ArchivePolicy::fromJSON({{"archive", {{"after_days", 90}}}});
+    EXPECT_TRUE(policy.enabled());
+    EXPECT_EQ(policy.field, "created");
+    EXPECT_FALSE(mb::ArchivePolicy::fromJSON({{"archive", nullptr}}, policy).enabled());
+    EXPECT_EQ(mb::ArchivePolicy::fromJSON(json::object(), policy).afterDays, 90);
+    EXPECT_THROW((void) mb::ArchivePolicy::fromJSON({{"archive", {{"after_days", "90"}}}}), mb::MantisException);
+
+    mb::EntitySchema schema(mb::MantisBase::instance(), "archive_checks", "base");
+    schema.addField(mb::EntitySchemaField("title", "string"));
+    schema.setArchive({"title", 10});
+    EXPECT_TRUE(mb::EntitySchema::validate(schema).has_value());
+    schema.setArchive({"updated", 10});
+    EXPECT_FALSE(mb::EntitySchema::validate(schema).has_value());
+
+    json j;
+    schema.archive().toJSON(j);
+    EXPECT_EQ(j["archive"]["field"], "updated");
+    EXPECT_EQ(j["archive"]["after_days"], 10);
+}
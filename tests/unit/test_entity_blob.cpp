@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/models/entity.h"
+#include "mantisbase/core/models/entity_schema.h"
+#include "mantisbase/core/models/entity_schema_field.h"
+#include "mantisbase/mantisbase.h"
+#include "../common/test_environment.h"
+
+#include <sstream>
+
+using nlohmann::json;
+
+class EntityBlobTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        schema = std::make_unique<mb::EntitySchema>(mb::MantisBase::instance(), "blob_docs", "base");
+        schema->addField(mb::EntitySchemaField("title", "string"));
+        schema->addField(mb::EntitySchemaField("data", "blob"));
+        if (!mb::EntitySchema::tableExists(*schema)) mb::EntitySchema::createTable(*schema);
+    }
+
+    void TearDown() override {
+        mb::EntitySchema::dropTable(*schema);
+    }
+
+    /// Everything `reader` hands out, in buffers of `chunk` bytes
+    static std::string drain(const mb::Entity::ExportReader &reader, const std::size_t chunk) {
+        std::string out, buf(chunk, '\0');
+        while (const auto n = reader(buf.data(), buf.size())) out.append(buf.data(), n);
+        reader(nullptr, 0);
+        return out;
+    }
+
+    std::unique_ptr<mb::EntitySchema> schema;
+};
+
+TEST_F(EntityBlobTest, StreamsBytesInAndOut) {
+    const auto docs = schema->toEntity();
+    const auto doc = docs.create({{"title", "a"}});
+    const auto id = doc["id"].get<std::string>();
+    EXPECT_TRUE(doc["data"].is_null());
+    EXPECT_FALSE(docs.readBlob(id, "data").has_value());
+
+    // Past a write chunk, with every byte value
+    std::string bytes(700 * 1024 + 3, '\0');
+    for (std::size_t i = 0; i < bytes.size(); ++i) bytes[i] = static_cast<char>(i * 31 % 256);
+    std::istringstream in(bytes);
+    const auto written = docs.writeBlob(id, "data", in, static_cast<std::int64_t>(bytes.size()));
+    EXPECT_EQ(written["data"], bytes.size());
+    EXPECT_EQ(written["title"], "a");
+
+    const auto blob = docs.readBlob(id, "data");
+    ASSERT_TRUE(blob.has_value());
+    EXPECT_EQ(blob->size, static_cast<std::int64_t>(bytes.size()));
+    EXPECT_EQ(drain(blob->read, 4096), bytes);
+
+    // Records carry the length, never the bytes
+    EXPECT_EQ(docs.read(id)->at("data"), bytes.size());
+    EXPECT_EQ(docs.list()[0]["data"], bytes.size());
+    EXPECT_EQ(docs.read(id, {{"fields", "data"}})->at("data"), bytes.size());
+
+    std::istringstream empty;
+    (void) docs.writeBlob(id, "data", empty, 0);
+    EXPECT_EQ(drain(docs.readBlob(id, "data")->read, 16), "");
+
+    // Cleared through the record
+    (void) docs.update(id, {{"data", nullptr}});
+    EXPECT_FALSE(docs.readBlob(id, "data").has_value());
+}
+
+TEST_F(EntityBlobTest, RejectsOtherWrites) {
+    const auto docs = schema->toEntity();
+    const auto id = docs.create({{"title", "a"}})["id"].get<std::string>();
+
+    EXPECT_THROW((void) docs.create({{"title", "b"}, {"data", "aGVsbG8="}}), mb::MantisException);
+    EXPECT_THROW((void) docs.update(id, {{"data", "hello"}}), mb::MantisException);
+
+    std::istringstream short_body("abc");
+    try {
+        (void) docs.writeBlob(id, "data", short_body, 10);
+        FAIL() << "A short body was written";
+    } catch (const mb::MantisException &e) {
+        EXPECT_EQ(e.code(), 400);
+    }
+    EXPECT_FALSE(docs.readBlob(id, "data").has_value());
+
+    std::istringstream body("abc");
+    try {
+        (void) docs.writeBlob("missing", "data", body, 3);
+        FAIL() << "A missing record was written";
+    } catch (const mb::MantisException &e) {
+        EXPECT_EQ(e.code(), 404);
+    }
+    EXPECT_THROW((void) docs.readBlob(id, "title"), mb::MantisException);
+}
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/models/entity.h"
+#include "mantisbase/core/models/entity_field_ops.h"
+#include "mantisbase/core/models/entity_schema.h"
+#include "mantisbase/core/models/entity_schema_field.h"
+#include "mantisbase/core/models/validators.h"
+#include "mantisbase/mantisbase.h"
+#include "../common/test_environment.h"
+
+using nlohmann::json;
+
+class EntityFieldOpsTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        schema = std::make_unique<mb::EntitySchema>(mb::MantisBase::instance(), "field_ops_posts", "base");
+        schema->addField(mb::EntitySchemaField("title", "string"));
+        schema->addField(mb::EntitySchemaField("views", "int"));
+        schema->addField(mb::EntitySchemaField("score", "double"));
+        schema->addField(mb::EntitySchemaField("tags", "json"));
+        if (!mb::EntitySchema::tableExists(*schema)) mb::EntitySchema::createTable(*schema);
+    }
+
+    void TearDown() override {
+        mb::EntitySchema::dropTable(*schema);
+    }
+
+    std::unique_ptr<mb::EntitySchema> schema;
+};
+
+TEST_F(EntityFieldOpsTest, ChecksOperatorsAgainstFieldTypes) {
+    EXPECT_TRUE(mb::FieldOps::isOperator({{"$inc", 1}}));
+    EXPECT_FALSE(mb::FieldOps::isOperator({{"$ref", 1}}));
+    EXPECT_FALSE(mb::FieldOps::isOperator({{"$inc", 1}, {"$push", 2}}));
+    EXPECT_FALSE(mb::FieldOps::isOperator(1));
+
+    const json views = {{"name", "views"}, {"type", "int"}};
+    const json score = {{"name", "score"}, {"type", "double"}};
+    const json tags = {{"name", "tags"}, {"type", "json"}};
+    EXPECT_FALSE(mb::FieldOps::check(views, {{"$inc", -2}}).has_value());
+    EXPECT_TRUE(mb::FieldOps::check(views, {{"$inc", 1.5}}).has_value());
+    EXPECT_FALSE(mb::FieldOps::check(score, {{"$inc", 1.5}}).has_value());
+    EXPECT_TRUE(mb::FieldOps::check(score, {{"$inc", "1"}}).has_value());
+    EXPECT_TRUE(mb::FieldOps::check(views, {{"$push", 1}}).has_value());
+    EXPECT_FALSE(mb::FieldOps::check(tags, {{"$pull", {{"a", 1}}}}).has_value());
+    EXPECT_TRUE(mb::FieldOps::check(tags, {{"$inc", 1}}).has_value());
+
+    const auto posts = schema->toEntity();
+    EXPECT_FALSE(mb::Validators::validateUpdateRequestBody(posts, {{"views", {{"$inc", 1}}}}).has_value());
+    EXPECT_TRUE(mb::Validators::validateUpdateRequestBody(posts, {{"title", {{"$inc", 1}}}}).has_value());
+    EXPECT_TRUE(mb::Validators::validateRequestBody(posts, {{"views", {{"$inc", 1}}}}).has_value());
+}
+
+TEST_F(EntityFieldOpsTest, UpdatesFromTheStoredValue) {
+    const auto posts = schema->toEntity();
+    const auto id = posts.create({{"title", "a"}, {"tags", json::array({"x", 1, true})}})["id"].get<std::string>();
+
+    // A null counter starts from 0
+    auto record = posts.update(id, {{"views", {{"$inc", 5}}}, {"score", {{"$inc", 0.5}}}});
+    EXPECT_EQ(record["views"], 5);
+    EXPECT_DOUBLE_EQ(record["score"].get<double>(), 0.5);
+    record = posts.update(id, {{"views", {{"$inc", -2}}}, {"title", "b"}});
+    EXPECT_EQ(record["views"], 3);
+    EXPECT_EQ(record["title"], "b");
+
+    record = posts.update(id, {{"tags", {{"$push", {{"k", "v"}}}}}});
+    EXPECT_EQ(record["tags"], json::parse(R"(["x", 1, true, {"k": "v"}])"));
+    record = posts.update(id, {{"tags", {{"$pull", true}}}});
+    EXPECT_EQ(record["tags"], json::parse(R"(["x", 1, {"k": "v"}])"));
+    record = posts.update(id, {{"tags", {{"$pull", {{"k", "v"}}}}}});
+    EXPECT_EQ(record["tags"], json::parse(R"(["x", 1])"));
+
+    // Batch updates take them as well
+    const auto results = posts.batch(json::array({
+        {{"op", "update"}, {"id", id}, {"data", {{"views", {{"$inc", 1}}}}}},
+        {{"op", "update"}, {"id", id}, {"data", {{"views", {{"$inc", 1}}}}}}
+    }));
+    EXPECT_EQ(results[1]["views"], 5);
+
+    EXPECT_THROW((void) posts.update(id, {{"title", {{"$inc", 1}}}}), mb::MantisException);
+    EXPECT_THROW((void) posts.batch(json::array({{{"op", "create"}, {"data", {{"views", {{"$inc", 1}}}}}}})),
+                 mb::MantisException);
+}
@@ -0,0 +1,256 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/models/entity_filter.h"
+#include "mantisbase/core/exceptions.h"
+#include "mantisbase/utils/soci_wrappers.h"
+#include <nlohmann/json.hpp>
+
+namespace {
+    mb::RowCodec makeCodec() {
+        return mb::RowCodec({
+            {{"name", "id"}, {"type", "string"}},
+            {{"name", "title"}, {"type", "string"}},
+            {{"name", "status"}, {"type", "string"}},
+            {{"name", "views"}, {"type", "int"}},
+            {{"name", "score"}, {"type", "double"}},
+            {{"name", "published"}, {"type", "bool"}},
+            {{"name", "meta"}, {"type", "json"}}
+        });
+    }
+}
+
+TEST(EntityFilter, SimpleComparison) {
+    const auto codec = makeCodec();
+    const auto f = mb::EntityFilter::compile("views >= 10", codec);
+
+    EXPECT_EQ(f.where, "views >= :f0");
+    ASSERT_EQ(f.params.size(), 1);
+    EXPECT_EQ(f.params[0].first, "f0");
+    EXPECT_EQ(f.params[0].second, 10);
+}
+
+TEST(EntityFilter, AndOrPrecedenceAndGrouping) {
+    const auto codec = makeCodec();
+    const auto f = mb::EntityFilter::compile(
+        "status = 'draft' && (views > 10 || title ~ 'intro')", codec);
+
+    EXPECT_EQ(f.where, "(status = :f0 AND (views > :f1 OR title LIKE :f2))");
+    ASSERT_EQ(f.params.size(), 3);
+    EXPECT_EQ(f.params[0].second, "draft");
+    EXPECT_EQ(f.params[2].second, "%intro%");
+
+    const auto g = mb::EntityFilter::compile("status = 'a' OR status = 'b' AND views < 3", codec);
+    EXPECT_EQ(g.where, "(status = :f0 OR (status = :f1 AND views < :f2))");
+}
+
+TEST(EntityFilter, InListAndNull) {
+    const auto codec = makeCodec();
+
+    const auto f = mb::EntityFilter::compile("status in ['a', 'b'] && title != null", codec);
+    EXPECT_EQ(f.where, "(status IN (:f0, :f1) AND title IS NOT NULL)");
+
+    const auto g = mb::EntityFilter::compile("views NOT IN (1, 2, 3)", codec);
+    EXPECT_EQ(g.where, "views NOT IN (:f0, :f1, :f2)");
+    EXPECT_EQ(g.params.size(), 3);
+}
+
+TEST(EntityFilter, ValueTypes) {
+    const auto codec = makeCodec();
+    const auto f = mb::EntityFilter::compile("published = true && score < 2.5 && title !~ 'x%'", codec);
+
+    ASSERT_EQ(f.params.size(), 3);
+    EXPECT_TRUE(f.params[0].second.is_boolean());
+    EXPECT_TRUE(f.params[1].second.is_number_float());
+    EXPECT_EQ(f.params[2].second, "x%"); // explicit wildcard kept as-is
+    EXPECT_NE(f.where.find("NOT LIKE"), std::string::npos);
+}
+
+TEST(EntityFilter, ValuesAreNeverInlined) {
+    const auto codec = makeCodec();
+    const auto f = mb::EntityFilter::compile("title = 'x\\' OR 1=1 --'", codec);
+
+    EXPECT_EQ(f.where, "title = :f0");
+    EXPECT_EQ(f.params[0].second, "x' OR 1=1 --");
+}
+
+TEST(EntityFilter, RejectsUnknownFieldsAndBadSyntax) {
+    const auto codec = makeCodec();
+
+    EXPECT_THROW(mb::EntityFilter::compile("password = 'x'", codec), mb::MantisException);
+    EXPECT_THROW(mb::EntityFilter::compile("views >", codec), mb::MantisException);
+    EXPECT_THROW(mb::EntityFilter::compile("(views > 1", codec), mb::MantisException);
+    EXPECT_THROW(mb::EntityFilter::compile("views > 1 views", codec), mb::MantisException);
+    EXPECT_THROW(mb::EntityFilter::compile("title = 'open", codec), mb::MantisException);
+    EXPECT_THROW(mb::EntityFilter::compile("views > null", codec), mb::MantisException);
+    EXPECT_THROW(mb::EntityFilter::compile("", codec), mb::MantisException);
+}
+
+TEST(EntityFilter, RejectsPasswordHashes) {
+    const mb::RowCodec codec({
+        {{"name", "id"}, {"type", "string"}},
+        {{"name", "email"}, {"type", "string"}},
+        {{"name", "password"}, {"type", "string"}}
+    });
+
+    try {
+        (void) mb::EntityFilter::compile("password ~ '$2b$10$a%'", codec);
+        FAIL() << "a filter on `password` compiled";
+    } catch (const mb::MantisException &e) {
+        EXPECT_EQ(e.code(), 400);
+    }
+    EXPECT_THROW(mb::EntityFilter::compile("email = 'x' || password != null", codec), mb::MantisException);
+    EXPECT_NO_THROW(mb::EntityFilter::compile("email = 'x'", codec));
+}
+
+TEST(EntityFilter, ReportsIndexedFields) {
+    const auto codec = makeCodec();
+    const auto f = mb::EntityFilter::compile("status = 'a' && views > 1 && status != 'b'", codec, {"status"});
+
+    ASSERT_EQ(f.indexedFields.size(), 1);
+    EXPECT_EQ(f.indexedFields[0], "status");
+}
+
+TEST(EntityFilter, ReportsSeekableFields) {
+    const auto codec = makeCodec();
+
+    // Equalities first, then ranges; negations and LIKE can't seek
+    const auto f = mb::EntityFilter::compile(
+        "views > 10 && status = 'draft' && title ~ 'intro' && published != true && score in [1, 2]", codec);
+    EXPECT_EQ(f.seekFields, (std::vector<std::string>{"status", "score", "views"}));
+    EXPECT_EQ(f.seekEquals, 2);
+
+    // Only what every match satisfies
+    const auto g = mb::EntityFilter::compile("status = 'a' && (views < 3 || score > 1)", codec);
+    EXPECT_EQ(g.seekFields, (std::vector<std::string>{"status"}));
+    EXPECT_TRUE(mb::EntityFilter::compile("status = 'a' || status = 'b'", codec).seekFields.empty());
+}
+
+TEST(EntityFilter, RuleFiltersBindAuthVariables) {
+    const auto codec = makeCodec();
+
+    const auto rule = mb::EntityFilter::compileRule("status = @auth.id || published = true", codec);
+    EXPECT_EQ(rule.where, "(status = :r0 OR published = :r1)");
+    ASSERT_EQ(rule.variables.size(), 1);
+    EXPECT_EQ(rule.variables[0], (std::pair<std::string, std::string>{"r0", "auth.id"}));
+
+    const auto user = mb::EntityFilter::bindVariables(rule, {{"auth", {{"id", "u1"}}}});
+    EXPECT_EQ(user.params[0].second, "u1");
+    EXPECT_TRUE(user.variables.empty());
+
+    // A guest's id, or a nested value that isn't there, binds as NULL
+    EXPECT_TRUE(mb::EntityFilter::bindVariables(rule, {{"auth", {{"id", nullptr}}}}).params[0].second.is_null());
+    const auto nested = mb::EntityFilter::compileRule("views >= @auth.user.level", codec);
+    EXPECT_EQ(mb::EntityFilter::bindVariables(nested, {{"auth", {{"user", {{"level", 3}}}}}}).params[0].second, 3);
+    EXPECT_TRUE(mb::EntityFilter::bindVariables(nested, {{"auth", {{"user", nullptr}}}}).params[0].second.is_null());
+
+    // Variables are for rules, and only `@auth.<field>` ones
+    EXPECT_THROW(mb::EntityFilter::compile("status = @auth.id", codec), mb::MantisException);
+    EXPECT_THROW(mb::EntityFilter::compileRule("status = @req.id", codec), mb::MantisException);
+    EXPECT_THROW(mb::EntityFilter::compileRule("status = @auth", codec), mb::MantisException);
+    EXPECT_THROW(mb::EntityFilter::compileRule("title ~ @auth.id", codec), mb::MantisException);
+}
+
+TEST(EntityFilter, ConjoinsQueryAndRuleFilters) {
+    const auto codec = makeCodec();
+    const auto query = mb::EntityFilter::compile("views > 10 || score < 1", codec);
+    const auto rule = mb::EntityFilter::bindVariables(
+        mb::EntityFilter::compileRule("status = @auth.id", codec), {{"auth", {{"id", "u1"}}}});
+
+    const auto both = mb::EntityFilter::conjoin(query, rule);
+    EXPECT_EQ(both.where, "((views > :f0 OR score < :f1) AND status = :r0)");
+    ASSERT_EQ(both.params.size(), 3);
+    EXPECT_EQ(both.params[2].first, "r0");
+
+    // The rule's equality narrows the scan like one of the query's own
+    EXPECT_EQ(both.seekFields, (std::vector<std::string>{"status"}));
+    EXPECT_EQ(both.seekEquals, 1);
+}
+
+TEST(EntityFilter, MatchesRowsInMemoryAsTheWhereWould) {
+    const auto codec = makeCodec();
+    const auto f = mb::EntityFilter::compile(
+        "status IN ['open', 'held'] && (views >= 10 || title ~ 'INTRO') && published = true", codec);
+    const nlohmann::json row = {{"status", "open"}, {"views", 3}, {"title", "An intro to C++"}, {"published", 1}};
+    EXPECT_TRUE(mb::EntityFilter::matches(f, row));
+
+    auto other = row;
+    other["status"] = "closed";
+    EXPECT_FALSE(mb::EntityFilter::matches(f, other));
+    other = row;
+    other["title"] = "Outro";
+    EXPECT_FALSE(mb::EntityFilter::matches(f, other));
+    other["views"] = 10.0;
+    EXPECT_TRUE(mb::EntityFilter::matches(f, other));
+
+    // NULL compares with nothing, as in SQL
+    const auto g = mb::EntityFilter::compile("title != 'x' || score = null", codec);
+    EXPECT_FALSE(mb::EntityFilter::matches(g, {{"title", nullptr}, {"score", 1.5}}));
+    EXPECT_TRUE(mb::EntityFilter::matches(g, {{"title", nullptr}}));
+    EXPECT_FALSE(mb::EntityFilter::matches(mb::EntityFilter::compile("views NOT IN (1, 2)", codec), {{"views", nullptr}}));
+    EXPECT_TRUE(mb::EntityFilter::matches(mb::EntityFilter::compile("title !~ 'a_c'", codec), {{"title", "abd"}}));
+    EXPECT_FALSE(mb::EntityFilter::matches(mb::EntityFilter::compile("views > '3'", codec), {{"views", 4}}));
+}
+
+TEST(EntityFilter, MatchesConjoinedAndBoundRuleFilters) {
+    const auto codec = makeCodec();
+    const auto rule = mb::EntityFilter::bindVariables(mb::EntityFilter::compileRule("title = @auth.id", codec),
+                                                      {{"auth", {{"id", "u1"}}}});
+    const auto both = mb::EntityFilter::conjoin(mb::EntityFilter::compile("views > 1", codec), rule);
+    EXPECT_TRUE(mb::EntityFilter::matches(both, {{"views", 2}, {"title", "u1"}}));
+    EXPECT_FALSE(mb::EntityFilter::matches(both, {{"views", 2}, {"title", "u2"}}));
+    EXPECT_FALSE(mb::EntityFilter::matches(both, {{"views", 1}, {"title", "u1"}}));
+}
+
+TEST(EntityFilter, JsonPathsCompileToTheBackendsExtraction) {
+    const auto codec = makeCodec();
+    const auto f = mb::EntityFilter::compile("meta.country = 'KE' && meta.tags.0 != null", codec, {"meta.country"});
+    EXPECT_EQ(f.where, "(json_extract(meta, '$.country') = :f0 AND json_extract(meta, '$.tags[0]') IS NOT NULL)");
+    EXPECT_EQ(f.indexedFields, (std::vector<std::string>{"meta.country"}));
+    EXPECT_EQ(f.seekFields, (std::vector<std::string>{"meta.country"}));
+
+    const auto pg = mb::EntityFilter::compile("meta.country = 'KE' || meta.rank > 2", codec, {}, "postgresql");
+    EXPECT_EQ(pg.where.substr(0, pg.where.find(" OR ")), "((CAST(meta AS jsonb) #>> '{country}') = :f0");
+    EXPECT_NE(pg.where.find("jsonb_typeof(CAST(meta AS jsonb) #> '{rank}')"), std::string::npos);
+
+    // The index on the path is spelled as the filter reads it
+    EXPECT_EQ(mb::EntityFilter::indexColumnSql("sqlite3", "meta.country"), "(json_extract(meta, '$.country'))");
+    EXPECT_EQ(mb::EntityFilter::indexColumnSql("postgresql", "meta.country"), "((CAST(meta AS jsonb) #>> '{country}'))");
+    EXPECT_EQ(mb::EntityFilter::indexColumnSql("sqlite3", "status"), "status");
+
+    EXPECT_THROW(mb::EntityFilter::compile("title.x = 1", codec), mb::MantisException);
+    EXPECT_THROW(mb::EntityFilter::compile("meta.rank IN (1, 'a')", codec), mb::MantisException);
+}
+
+TEST(EntityFilter, MatchesJsonPaths) {
+    const auto codec = makeCodec();
+    const nlohmann::json row = {{"meta", {{"country", "KE"}, {"rank", 3}, {"tags", {"a", "b"}}}}};
+    EXPECT_TRUE(mb::EntityFilter::matches(mb::EntityFilter::compile("meta.country = 'KE' && meta.rank >= 3", codec), row));
+    EXPECT_TRUE(mb::EntityFilter::matches(mb::EntityFilter::compile("meta.tags.1 = 'b'", codec), row));
+    EXPECT_TRUE(mb::EntityFilter::matches(mb::EntityFilter::compile("meta.city = null", codec), row));
+    EXPECT_FALSE(mb::EntityFilter::matches(mb::EntityFilter::compile("meta.tags.5 = 'b'", codec), row));
+    EXPECT_FALSE(mb::EntityFilter::matches(mb::EntityFilter::compile("meta.country = 'UG'", codec), row));
+}
+
+TEST(EntityFilterCache, ReusesCompiledFilters) {
+    const auto codec = makeCodec();
+    mb::EntityFilterCache cache({}, 2);
+
+    const auto a = cache.get("views > 1", codec);
+    EXPECT_EQ(a.get(), cache.get("views > 1", codec).get());
+
+    // Filling past capacity evicts the least recently used entry
+    cache.get("views > 2", codec);
+    cache.get("views > 3", codec);
+    EXPECT_NE(a.get(), cache.get("views > 1", codec).get());
+
+    EXPECT_THROW(cache.get("nope = 1", codec), mb::MantisException);
+}
+
+TEST(EntityFilterCache, ListsFiltersMostRecentFirst) {
+    const auto codec = makeCodec();
+    mb::EntityFilterCache cache;
+
+    cache.get("views > 1", codec);
+    cache.get("views > 2", codec);
+    cache.get("views > 1", codec);
+    EXPECT_EQ(cache.filters(), (std::vector<std::string>{"views > 1", "views > 2"}));
+}
@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/models/entity.h"
+#include "mantisbase/core/models/entity_geo.h"
+#include "mantisbase/core/models/entity_schema.h"
+#include "mantisbase/core/models/entity_schema_field.h"
+#include "mantisbase/mantisbase.h"
+#include "../common/test_environment.h"
+
+#include <algorithm>
+
+using mb::EntityGeo;
+using nlohmann::json;
+
+class EntityGeoTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        schema = std::make_unique<mb::EntitySchema>(mb::MantisBase::instance(), "geo_shops", "base");
+        schema->addField(mb::EntitySchemaField("name", "string"));
+        schema->addField(mb::EntitySchemaField("location", "geo_point"));
+        if (!mb::EntitySchema::tableExists(*schema)) mb::EntitySchema::createTable(*schema);
+    }
+
+    void TearDown() override {
+        mb::EntitySchema::dropTable(*schema);
+    }
+
+    static std::vector<std::string> names(const mb::Records &records) {
+        std::vector<std::string> out;
+        for (const auto &record: records) out.push_back(record["name"].get<std::string>());
+        return out;
+    }
+
+    static json at(const double lat, const double lng) { return {{"lat", lat}, {"lng", lng}}; }
+
+    std::unique_ptr<mb::EntitySchema> schema;
+};
+
+TEST_F(EntityGeoTest, KeepsRecordsWithinTheRadiusNearestFirst) {
+    const auto shops = schema->toEntity();
+    // About 1.1 km apart, north of the centre of Nairobi
+    for (int i = 0; i < 6; ++i)
+        (void) shops.create({{"name", "shop" + std::to_string(i)}, {"location", at(-1.286 + 0.01 * i, 36.817)}});
+    (void) shops.create({{"name", "nowhere"}});
+
+    const json geo = {{"near", at(-1.286, 36.817)}, {"radius", 3.5}};
+    EXPECT_EQ(names(shops.list({{"geo", geo}})), (std::vector<std::string>{"shop0", "shop1", "shop2", "shop3"}));
+    EXPECT_EQ(shops.countRecords({{"geo", geo}}), 4);
+    // The other way round from the far end
+    EXPECT_EQ(names(shops.list({{"geo", {{"near", at(-1.236, 36.817)}, {"radius", 1.2}}}})),
+              (std::vector<std::string>{"shop5", "shop4"}));
+    // `sort` keeps the area, not the order
+    EXPECT_EQ(names(shops.list({{"geo", geo}, {"pagination", {{"sort", "-name"}}}})).front(), "shop3");
+
+    // Pages continue by distance
+    mb::Entity::ListPage page;
+    std::vector<std::string> seen;
+    json opts = {{"geo", {{"near", at(-1.286, 36.817)}}}, {"pagination", {{"limit", 4}}}};
+    do {
+        for (const auto &name: names(shops.list(opts, page))) seen.push_back(name);
+        opts["pagination"]["after"] = page.cursor;
+    } while (page.count == 4);
+    EXPECT_EQ(seen, (std::vector<std::string>{"shop0", "shop1", "shop2", "shop3", "shop4", "shop5"}));
+}
+
+TEST_F(EntityGeoTest, BoxesFollowWrites) {
+    const auto shops = schema->toEntity();
+    const auto a = shops.create({{"name", "a"}, {"location", at(1, 1)}});
+    (void) shops.create({{"name", "b"}, {"location", at(2, 2)}});
+
+    const json box = {{"bbox", {0, 0, 3, 3}}};
+    EXPECT_EQ(names(shops.list({{"geo", box}, {"pagination", {{"sort", "name"}}}})),
+              (std::vector<std::string>{"a", "b"}));
+
+    (void) shops.update(a["id"].get<std::string>(), {{"location", at(10, 10)}});
+    EXPECT_EQ(names(shops.list({{"geo", box}})), std::vector<std::string>{"b"});
+    (void) shops.update(a["id"].get<std::string>(), {{"location", nullptr}});
+    EXPECT_EQ(names(shops.list({{"geo", {{"bbox", {-180, -90, 180, 90}}}}})), std::vector<std::string>{"b"});
+    shops.remove(a["id"].get<std::string>());
+    EXPECT_EQ(shops.countRecords({{"geo", box}}), 1);
+}
+
+TEST_F(EntityGeoTest, RejectsInvalidPointsAndQueries) {
+    const auto shops = schema->toEntity();
+    EXPECT_THROW((void) shops.create({{"name", "x"}, {"location", at(91, 0)}}), mb::MantisException);
+    EXPECT_THROW((void) shops.create({{"name", "x"}, {"location", "1,2"}}), mb::MantisException);
+    EXPECT_THROW((void) shops.list({{"geo", {{"radius", 5}}}}), mb::MantisException);
+    EXPECT_THROW((void) shops.list({{"geo", {{"bbox", {10, 0, -10, 5}}}}}), mb::MantisException);
+    EXPECT_THROW((void) shops.list({{"geo", {{"bbox", {0, 0, 1, 1}}, {"field", "name"}}}}), mb::MantisException);
+    EXPECT_THROW((void) shops.list({{"geo", {{"bbox", {0, 0, 1, 1}}}}, {"search", "x"}}), mb::MantisException);
+
+    EXPECT_TRUE(mb::EntitySchemaField("p", "geo_point").setIsUnique(true).validate().has_value());
+}
+
+TEST(EntityGeo, ParsesQueryNumbers) {
+    EXPECT_EQ(EntityGeo::parseNumbers(" -1.29, 36.82", 2, "near"), (std::vector<double>{-1.29, 36.82}));
+    EXPECT_THROW((void) EntityGeo::parseNumbers("1,2,", 2, "near"), mb::MantisException);
+    EXPECT_THROW((void) EntityGeo::parseNumbers("nan", 1, "radius"), mb::MantisException);
+    EXPECT_EQ(EntityGeo::encode(EntityGeo::parse(json{{"lng", 36.82}, {"lat", -1.29}}, "p")),
+              R"({"lat":-1.29,"lng":36.82})");
+}
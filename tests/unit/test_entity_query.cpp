@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/models/entity_query.h"
+#include "mantisbase/core/models/entity_schema.h"
+#include "mantisbase/core/models/entity_schema_field.h"
+#include "mantisbase/mantisbase.h"
+#include "../common/test_environment.h"
+
+using nlohmann::json;
+
+namespace {
+    struct Note {
+        std::string id;
+        std::string title;
+        int views = 0;
+        std::optional<std::string> summary;
+        bool pinned = false;
+    };
+
+    struct Mismatch {
+        int title = 0;
+    };
+
+    template<typename Call>
+    int failureOf(Call call) {
+        try {
+            call();
+        } catch (const mb::MantisException &e) {
+            return e.code();
+        }
+        return 0;
+    }
+}
+
+template<>
+struct mb::RecordFields<Note> {
+    static constexpr auto fields = std::make_tuple(
+        recordField("id", &Note::id), recordField("title", &Note::title), recordField("views", &Note::views),
+        recordField("summary", &Note::summary), recordField("pinned", &Note::pinned));
+};
+
+template<>
+struct mb::RecordFields<Mismatch> {
+    static constexpr auto fields = std::make_tuple(recordField("title", &Mismatch::title));
+};
+
+class EntityQueryTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        auto &app = mb::MantisBase::instance();
+        schema = std::make_unique<mb::EntitySchema>(app, "typed_notes", "base");
+        schema->addField(mb::EntitySchemaField("title", "string"));
+        schema->addField(mb::EntitySchemaField("views", "int"));
+        schema->addField(mb::EntitySchemaField("summary", "string"));
+        schema->addField(mb::EntitySchemaField("pinned", "bool"));
+        schema->setListRule(mb::AccessRule("auth", ""));
+        if (!mb::EntitySchema::tableExists(*schema)) mb::EntitySchema::createTable(*schema);
+    }
+
+    void TearDown() override {
+        mb::EntitySchema::dropTable(*schema);
+    }
+
+    std::unique_ptr<mb::EntitySchema> schema;
+};
+
+TEST_F(EntityQueryTest, ReadsRowsIntoStructs) {
+    const auto notes = schema->toEntity();
+    for (int i = 0; i < 5; ++i)
+        (void) notes.create({{"title", "n" + std::to_string(i)}, {"views", i * 10}, {"pinned", i % 2 == 0}});
+    (void) notes.update(notes.list({{"filter", "title = 'n1'"}}).front()["id"].get<std::string>(),
+                        {{"summary", "first"}});
+
+    const auto top = notes.query().where("views >= 20").sort("-views").fetch<Note>();
+    ASSERT_EQ(top.size(), 3u);
+    EXPECT_EQ(top[0].title, "n4");
+    EXPECT_EQ(top[0].views, 40);
+    EXPECT_TRUE(top[0].pinned);
+    EXPECT_FALSE(top[0].summary.has_value());
+    EXPECT_FALSE(top[0].id.empty());
+
+    const auto one = notes.query().where("title = 'n1'").first<Note>();
+    ASSERT_TRUE(one.has_value());
+    EXPECT_EQ(one->summary, "first");
+    EXPECT_EQ(notes.query().get<Note>(one->id)->title, "n1");
+    EXPECT_FALSE(notes.query().where("title = 'none'").first<Note>().has_value());
+}
+
+TEST_F(EntityQueryTest, PagesContinueFromTheirCursor) {
+    const auto notes = schema->toEntity();
+    for (int i = 0; i < 5; ++i) (void) notes.create({{"title", "p"}, {"views", i}});
+
+    auto query = notes.query().sort("views").limit(2);
+    std::vector<int> seen;
+    std::string cursor;
+    do {
+        auto page = mb::EntityQuery(query).after(cursor).page<Note>();
+        for (const auto &note: page.records) seen.push_back(note.views);
+        cursor = page.records.empty() ? std::string{} : page.cursor;
+    } while (!cursor.empty());
+    EXPECT_EQ(seen, (std::vector<int>{0, 1, 2, 3, 4}));
+}
+
+TEST_F(EntityQueryTest, WritesThroughTheEntity) {
+    const auto notes = schema->toEntity();
+    Note note;
+    note.title = "typed";
+    note.views = 3;
+    const auto created = notes.query().create(note);
+    EXPECT_FALSE(created.id.empty());
+    EXPECT_EQ(notes.read(created.id)->at("views"), 3);
+
+    note.views = 4;
+    note.summary = "now";
+    const auto updated = notes.query().update(created.id, note);
+    EXPECT_EQ(updated.views, 4);
+    EXPECT_EQ(notes.read(created.id)->at("summary"), "now");
+}
+
+TEST_F(EntityQueryTest, ChecksMappingsAndRules) {
+    const auto notes = schema->toEntity();
+    (void) notes.create({{"title", "r"}});
+
+    // A string field doesn't go into an int
+    EXPECT_EQ(failureOf([&] { (void) notes.query().fetch<Mismatch>(); }), 500);
+
+    // Host code isn't held to the rules unless it asks to be
+    EXPECT_EQ(notes.query().fetch<Note>().size(), 1u);
+    const json guest = {{"id", nullptr}, {"entity", nullptr}, {"user", nullptr}};
+    EXPECT_EQ(failureOf([&] { (void) notes.query().as(guest).fetch<Note>(); }), 403);
+    const json user = {{"id", "u1"}, {"entity", "users"}, {"user", {{"id", "u1"}}}};
+    EXPECT_EQ(notes.query().as(user).fetch<Note>().size(), 1u);
+}
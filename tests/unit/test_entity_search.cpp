@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/models/entity.h"
+#include "mantisbase/core/models/entity_schema.h"
+#include "mantisbase/core/models/entity_schema_field.h"
+#include "mantisbase/core/models/entity_search.h"
+#include "mantisbase/mantisbase.h"
+#include "../common/test_environment.h"
+
+#include <algorithm>
+
+using mb::EntitySearch;
+using nlohmann::json;
+
+class EntitySearchTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        schema = std::make_unique<mb::EntitySchema>(mb::MantisBase::instance(), "search_posts", "base");
+        schema->addField(mb::EntitySchemaField("title", "string").setIsSearchable(true));
+        schema->addField(mb::EntitySchemaField("body", "string").setIsSearchable(true));
+        schema->addField(mb::EntitySchemaField("views", "int"));
+        if (!mb::EntitySchema::tableExists(*schema)) mb::EntitySchema::createTable(*schema);
+    }
+
+    void TearDown() override {
+        mb::EntitySchema::dropTable(*schema);
+    }
+
+    static std::vector<std::string> titles(const mb::Records &records) {
+        std::vector<std::string> out;
+        for (const auto &record: records) out.push_back(record["title"].get<std::string>());
+        return out;
+    }
+
+    std::unique_ptr<mb::EntitySchema> schema;
+};
+
+TEST_F(EntitySearchTest, MatchesEveryWordAndFollowsWrites) {
+    const auto posts = schema->toEntity();
+    const auto a = posts.create({{"title", "Rust ownership"}, {"body", "borrow checker basics"}, {"views", 1}});
+    (void) posts.create({{"title", "C++ lifetimes"}, {"body", "the borrow checker, by hand"}, {"views", 2}});
+    (void) posts.create({{"title", "Gardening"}, {"body", "tomatoes"}, {"views", 3}});
+
+    EXPECT_EQ(posts.list({{"search", "borrow checker"}}).size(), 2u);
+    EXPECT_EQ(titles(posts.list({{"search", "ownership BORROW"}})), std::vector<std::string>{"Rust ownership"});
+    EXPECT_EQ(posts.countRecords({{"search", "borrow"}, {"filter", "views > 1"}}), 1);
+    // Query syntax is just text
+    EXPECT_TRUE(posts.list({{"search", "\"borrow OR NOT* -tomatoes"}}).empty());
+
+    (void) posts.update(a["id"].get<std::string>(), {{"title", "Rust traits"}});
+    EXPECT_TRUE(posts.list({{"search", "ownership"}}).empty());
+    EXPECT_EQ(posts.list({{"search", "traits"}}).size(), 1u);
+    (void) posts.update(a["id"].get<std::string>(), {{"views", 10}});
+    EXPECT_EQ(posts.list({{"search", "traits"}}).size(), 1u);
+
+    posts.remove(a["id"].get<std::string>());
+    EXPECT_TRUE(posts.list({{"search", "traits"}}).empty());
+}
+
+TEST_F(EntitySearchTest, PagesThroughRankedMatches) {
+    const auto posts = schema->toEntity();
+    for (int i = 0; i < 7; ++i) {
+        std::string title = "search";
+        for (int j = 0; j < i % 3; ++j) title += " search";
+        (void) posts.create({{"title", title + " " + std::to_string(i)}, {"body", "text"}});
+    }
+
+    mb::Entity::ListPage page;
+    std::vector<std::string> seen;
+    json opts = {{"search", "search"}, {"pagination", {{"limit", 3}}}};
+    do {
+        const auto records = posts.list(opts, page);
+        for (const auto &record: records) seen.push_back(record["id"].get<std::string>());
+        opts["pagination"]["after"] = page.cursor;
+    } while (page.count == 3);
+
+    EXPECT_EQ(seen.size(), 7u);
+    std::ranges::sort(seen);
+    EXPECT_EQ(std::ranges::unique(seen).begin(), seen.end());
+
+    // A rank cursor doesn't continue a sorted page
+    (void) posts.list({{"search", "search"}, {"pagination", {{"limit", 1}}}}, page);
+    EXPECT_THROW((void) posts.list({{"search", "search"}, {"pagination", {{"sort", "title"}, {"after", page.cursor}}}}),
+                 mb::MantisException);
+}
+
+TEST_F(EntitySearchTest, RejectsEntitiesWithoutSearchableFields) {
+    EXPECT_TRUE(mb::EntitySchemaField("n", "int").setIsSearchable(true).validate().has_value());
+    EXPECT_FALSE(mb::EntitySchemaField("t", "xml").setIsSearchable(true).validate().has_value());
+
+    mb::EntitySchema plain(mb::MantisBase::instance(), "search_plain", "base");
+    plain.addField(mb::EntitySchemaField("title", "string"));
+    mb::EntitySchema::createTable(plain);
+    EXPECT_THROW((void) plain.toEntity().list({{"search", "x"}}), mb::MantisException);
+    // Blank searches list everything
+    EXPECT_NO_THROW((void) plain.toEntity().list({{"search", "  "}}));
+    mb::EntitySchema::dropTable(plain);
+}
+
+TEST(EntitySearch, QuotesEveryWordForFts5) {
+    EXPECT_EQ(EntitySearch::bindValue("sqlite3", "  hello   \"world\" a-b "), R"("hello" """world""" "a-b")");
+    EXPECT_EQ(EntitySearch::bindValue("postgresql", " hello  world "), "hello world");
+    EXPECT_EQ(EntitySearch::bindValue("sqlite3", " \t "), "");
+    EXPECT_THROW((void) EntitySearch::query("mysql", "posts", {"title"}), mb::MantisException);
+}
@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/models/entity.h"
+#include "mantisbase/core/models/entity_schema.h"
+#include "mantisbase/core/models/entity_schema_field.h"
+#include "mantisbase/core/models/entity_shards.h"
+#include "mantisbase/mantisbase.h"
+#include "../common/test_environment.h"
+
+#include <filesystem>
+#include <set>
+
+using mb::EntityShards;
+using nlohmann::json;
+
+class EntityShardsTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        schema = std::make_unique<mb::EntitySchema>(mb::MantisBase::instance(), "shard_events", "base");
+        schema->addField(mb::EntitySchemaField("title", "string"));
+        schema->addField(mb::EntitySchemaField("rank", "int"));
+        schema->setShards(4);
+        if (!mb::EntitySchema::tableExists(*schema)) mb::EntitySchema::createTable(*schema);
+    }
+
+    void TearDown() override {
+        mb::EntitySchema::dropTable(*schema);
+    }
+
+    /// Rows of `events` in shard `index` alone
+    static int rowsIn(const mb::Entity &events, const int index) {
+        const EntityShards::Scope scope(mb::MantisBase::instance().shards().db("shard_events", index));
+        return events.countRecords();
+    }
+
+    std::unique_ptr<mb::EntitySchema> schema;
+};
+
+TEST(EntityShardsRoutingTest, HashesIdsAndPlacesFiles) {
+    EXPECT_EQ(EntityShards::shardOf("0192f5e0-7a1b-7c3d-8e4f-a1b2c3d4e5f6", 1), 0);
+    std::set<int> seen;
+    for (int i = 0; i < 64; ++i) {
+        const auto shard = EntityShards::shardOf("id-" + std::to_string(i), 4);
+        EXPECT_EQ(shard, EntityShards::shardOf("id-" + std::to_string(i), 4));
+        seen.insert(shard);
+    }
+    EXPECT_EQ(seen, (std::set<int>{0, 1, 2, 3}));
+
+    EXPECT_EQ(EntityShards::fileOf("/data", "", "events", 2), "/data/shards/events.2.db");
+    EXPECT_EQ(EntityShards::fileOf("/data", "acme", "events", 1), "/data/shards/acme/events.1.db");
+}
+
+TEST_F(EntityShardsTest, RoutesRecordsToTheirShard) {
+    const auto events = schema->toEntity();
+    std::vector<std::string> ids;
+    for (int i = 0; i < 40; ++i) ids.push_back(events.create({{"title", "e"}, {"rank", i % 7}})["id"]);
+
+    int total = 0;
+    for (int i = 0; i < 4; ++i) total += rowsIn(events, i);
+    EXPECT_EQ(total, 40);
+    EXPECT_EQ(events.countRecords(), 40);
+    EXPECT_FALSE(events.isEmpty());
+
+    const auto &id = ids[5];
+    ASSERT_TRUE(events.read(id).has_value());
+    EXPECT_TRUE(events.recordExists(id));
+    EXPECT_EQ(events.update(id, {{"title", "moved"}})["title"], "moved");
+    events.remove(id);
+    EXPECT_FALSE(events.read(id).has_value());
+    EXPECT_EQ(events.countRecords(), 39);
+}
+
+TEST_F(EntityShardsTest, ListsMergeTheShardsInSortOrder) {
+    const auto events = schema->toEntity();
+    for (int i = 0; i < 30; ++i) (void) events.create({{"title", "e"}, {"rank", i % 5}});
+
+    // Pages through every shard once, in rank order descending; ids stay out with `fields`
+    std::size_t seen = 0;
+    int previous = 5;
+    std::string after;
+    for (int pages = 0; pages < 10; ++pages) {
+        mb::Entity::ListPage page;
+        const auto records = events.list({{"pagination", {{"limit", 7}, {"sort", "-rank"}, {"after", after}}},
+                                          {"fields", "title,rank"}}, page);
+        if (records.empty()) break;
+        for (const auto &record: records) {
+            EXPECT_FALSE(record.contains("id"));
+            EXPECT_LE(record["rank"].get<int>(), previous);
+            previous = record["rank"].get<int>();
+        }
+        seen += records.size();
+        after = page.cursor;
+    }
+    EXPECT_EQ(seen, 30u);
+
+    std::string out;
+    const auto page = events.listInto(out, {{"pagination", {{"limit", 100}}}});
+    EXPECT_EQ(page.count, 30u);
+    EXPECT_EQ(json::parse(out).size(), 30u);
+}
+
+TEST_F(EntityShardsTest, RefusesWhatCantSpanShards) {
+    const auto events = schema->toEntity();
+    EXPECT_THROW((void) events.batch(json::array({{{"op", "create"}, {"data", {{"title", "x"}}}}})),
+                 mb::MantisException);
+    EXPECT_THROW((void) events.aggregate({{"group", {"rank"}}}), mb::MantisException);
+
+    mb::EntitySchema unique(mb::MantisBase::instance(), "shard_unique", "base");
+    unique.addField(mb::EntitySchemaField("code", "string").setIsUnique(true));
+    unique.setShards(2);
+    EXPECT_TRUE(unique.validate().has_value());
+    unique.setShards(EntityShards::MAX_SHARDS + 1);
+    EXPECT_TRUE(unique.validate().has_value());
+}
+
+TEST_F(EntityShardsTest, DroppingTheEntityDeletesItsShards) {
+    const auto file = EntityShards::fileOf(mb::MantisBase::instance().dataDir(), "", "shard_events", 3);
+    EXPECT_TRUE(std::filesystem::exists(file));
+    mb::EntitySchema::dropTable(*schema);
+    EXPECT_FALSE(std::filesystem::exists(file));
+    mb::EntitySchema::createTable(*schema);
+}
@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/models/entity.h"
+#include "mantisbase/core/models/entity_schema.h"
+#include "mantisbase/core/models/entity_schema_field.h"
+#include "mantisbase/mantisbase.h"
+#include "../common/test_environment.h"
+
+using nlohmann::json;
+
+class EntityTransactionTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        auto &app = mb::MantisBase::instance();
+        orders = std::make_unique<mb::EntitySchema>(app, "tx_orders", "base");
+        orders->addField(mb::EntitySchemaField("total", "int"));
+        if (!mb::EntitySchema::tableExists(*orders)) mb::EntitySchema::createTable(*orders);
+
+        items = std::make_unique<mb::EntitySchema>(app, "tx_items", "base");
+        items->addField(mb::EntitySchemaField("order_id", "string"));
+        items->addField(mb::EntitySchemaField("sku", "string"));
+        if (!mb::EntitySchema::tableExists(*items)) mb::EntitySchema::createTable(*items);
+    }
+
+    void TearDown() override {
+        mb::EntitySchema::dropTable(*items);
+        mb::EntitySchema::dropTable(*orders);
+    }
+
+    /// The entity of each op, by its `entity`
+    static std::vector<std::shared_ptr<const mb::Entity>> entitiesOf(const json &ops) {
+        std::vector<std::shared_ptr<const mb::Entity>> entities;
+        for (const auto &op: ops)
+            entities.push_back(mb::MantisBase::instance().entitySnapshot(op["entity"].get<std::string>()));
+        return entities;
+    }
+
+    std::unique_ptr<mb::EntitySchema> orders, items;
+};
+
+TEST_F(EntityTransactionTest, ResolvesRefsToEarlierResults) {
+    auto &app = mb::MantisBase::instance();
+    const json ops = json::array({
+        {{"entity", "tx_orders"}, {"op", "create"}, {"ref", "order"}, {"data", {{"total", 42}}}},
+        {{"entity", "tx_items"}, {"op", "create"}, {"data", {{"order_id", {{"$ref", "order.id"}}}, {"sku", "A-1"}}}},
+        {{"entity", "tx_orders"}, {"op", "update"}, {"id", {{"$ref", "0.id"}}}, {"data", {{"total", 40}}}}
+    });
+
+    std::vector<std::size_t> checked;
+    const auto results = mb::Entity::transaction(app, entitiesOf(ops), ops,
+                                                 [&](const std::size_t i, const mb::Entity &, const json &op)
+                                                 -> std::optional<std::string> {
+                                                     checked.push_back(i);
+                                                     EXPECT_FALSE(op.dump().contains("$ref"));
+                                                     return std::nullopt;
+                                                 });
+    ASSERT_EQ(results.size(), 3);
+    EXPECT_EQ(checked, (std::vector<std::size_t>{0, 1, 2}));
+
+    const auto order_id = results[0]["id"].get<std::string>();
+    EXPECT_EQ(results[1]["order_id"], order_id);
+    EXPECT_EQ(results[2]["id"], order_id);
+    EXPECT_EQ(app.entity("tx_orders").read(order_id)->at("total"), 40);
+}
+
+TEST_F(EntityTransactionTest, RollsBackEveryOpOnFailure) {
+    auto &app = mb::MantisBase::instance();
+    const auto expectRejected = [&](const json &ops, const int code, const char *error,
+                                    const mb::Entity::TransactionCheck &check = {}) {
+        try {
+            (void) mb::Entity::transaction(app, entitiesOf(ops), ops, check);
+            FAIL() << "Applied " << ops.dump();
+        } catch (const mb::MantisException &e) {
+            EXPECT_EQ(e.code(), code);
+            EXPECT_TRUE(std::string(e.what()).starts_with(error)) << e.what();
+        }
+        EXPECT_TRUE(app.entity("tx_orders").isEmpty());
+        EXPECT_TRUE(app.entity("tx_items").isEmpty());
+    };
+
+    const json create_order = {{"entity", "tx_orders"}, {"op", "create"}, {"data", {{"total", 1}}}};
+    expectRejected(json::array({
+                       create_order,
+                       {{"entity", "tx_items"}, {"op", "update"}, {"id", "missing"}, {"data", {{"sku", "B"}}}}
+                   }), 404, "ops[1]");
+
+    // Refs only reach back
+    expectRejected(json::array({
+                       create_order,
+                       {{"entity", "tx_items"}, {"op", "create"}, {"data", {{"order_id", {{"$ref", "1.id"}}}}}}
+                   }), 400, "ops[1]");
+    expectRejected(json::array({
+                       create_order,
+                       {{"entity", "tx_items"}, {"op", "create"}, {"data", {{"order_id", {{"$ref", "nope.id"}}}}}}
+                   }), 400, "ops[1]");
+
+    expectRejected(json::array({create_order, create_order}), 400, "ops[1]: too many",
+                   [](const std::size_t i, const mb::Entity &, const json &) -> std::optional<std::string> {
+                       if (i == 1) return "too many";
+                       return std::nullopt;
+                   });
+}
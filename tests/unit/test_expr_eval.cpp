@@ -58,4 +58,41 @@ TEST(ExprEval, InvalidExpressions) {
     EXPECT_FALSE(mb::Expr::eval("@auth.id ===", v));
     EXPECT_FALSE(mb::Expr::eval("@auth.nonexistent.field", v));
     EXPECT_FALSE(mb::Expr::eval("invalid javascript syntax {", v));
-}
\ No newline at end of file
+}
+TEST(CompiledExpr, MatchesInterpretedEval) {
+    mb::json v;
+    v["auth"] = {{"id", "123"}, {"entity", "users"}, {"type", "user"}, {"level", 3}};
+    v["req"] = {{"remoteAddr", "127.0.0.1"}, {"body", {{"user_id", "123"}}}};
+
+    mb::json guest;
+    guest["auth"] = nullptr;
+
+    const std::vector<std::string> exprs = {
+        "@auth.id == '123'",
+        "@auth.id != null",
+        "@auth.id == '456' || @auth.entity == 'admins'",
+        "@auth.id == @req.body.user_id",
+        "@auth != null && @auth.id != null",
+        "!(@auth.level < 2) && @auth.level <= 3",
+        "@req.remoteAddr == '127.0.0.1'",
+        "@auth.nonexistent.field",
+        "@auth.id ===",
+        ""
+    };
+
+    for (const auto &expr: exprs) {
+        const auto compiled = mb::CompiledExpr::compile(expr);
+        EXPECT_EQ(compiled->eval(v), mb::Expr::eval(expr, v)) << expr;
+        EXPECT_EQ(compiled->eval(guest), mb::Expr::eval(expr, guest)) << expr;
+    }
+}
+
+TEST(CompiledExpr, NativeSubset) {
+    EXPECT_TRUE(mb::CompiledExpr::compile("@auth.id == @req.body.owner")->isNative());
+    EXPECT_TRUE(mb::CompiledExpr::compile("(@a.x > 1 || @a.y == \"z\") && !@a.flag")->isNative());
+
+    // Outside the native grammar; evaluated by the script engine instead
+    EXPECT_FALSE(mb::CompiledExpr::compile("@auth.id ===")->isNative());
+    EXPECT_FALSE(mb::CompiledExpr::compile("invalid javascript syntax {")->isNative());
+    EXPECT_FALSE(mb::CompiledExpr::compile("")->isNative());
+}
@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/field_compression.h"
+#include "mantisbase/core/exceptions.h"
+
+#include <format>
+#include <string>
+
+using mb::FieldCompression;
+
+namespace {
+    /// Repetitive JSON, the kind of value `compress` is for
+    std::string document(const int items) {
+        std::string out = "[";
+        for (int i = 0; i < items; ++i)
+            out += std::format(R"({}{{"name": "item {}", "tags": ["red", "green"], "done": false}})", i ? "," : "", i);
+        return out + "]";
+    }
+}
+
+TEST(FieldCompression, StoresLargeValuesCompressed) {
+    if (!FieldCompression::available()) GTEST_SKIP() << "Built without zstd";
+
+    const auto value = document(200);
+    const auto stored = FieldCompression::deflate(value);
+    EXPECT_TRUE(FieldCompression::compressed(stored));
+    EXPECT_LT(stored.size(), value.size() / 4);
+    EXPECT_EQ(FieldCompression::inflate(stored), value);
+}
+
+TEST(FieldCompression, LeavesSmallAndPlainValuesAlone) {
+    EXPECT_EQ(FieldCompression::deflate("short"), "short");
+    EXPECT_EQ(FieldCompression::inflate("plain"), "plain");
+    EXPECT_EQ(FieldCompression::inflate(""), "");
+
+    // What doesn't shrink is stored as it is
+    std::string noise;
+    unsigned x = 1;
+    for (int i = 0; i < 2000; ++i) {
+        x = x * 1103515245 + 12345;
+        noise.push_back(static_cast<char>(33 + (x >> 16) % 90));
+    }
+    EXPECT_EQ(FieldCompression::deflate(noise), noise);
+}
+
+TEST(FieldCompression, InflatesChangeRows) {
+    if (!FieldCompression::available()) GTEST_SKIP() << "Built without zstd";
+
+    const auto value = document(50);
+    const auto corrupt = std::string(FieldCompression::PREFIX) + "AAAA";
+    EXPECT_THROW((void) FieldCompression::inflate(corrupt), mb::MantisException);
+
+    nlohmann::json row = {{"id", "r1"}, {"body", FieldCompression::deflate(value)}, {"n", 2}, {"bad", corrupt}};
+    FieldCompression::inflateMembers(row);
+    EXPECT_EQ(row["body"], value);
+    EXPECT_EQ(row["n"], 2);
+    EXPECT_EQ(row["bad"], corrupt);
+}
@@ -0,0 +1,90 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/database.h"
+#include "mantisbase/core/file_cleanup.h"
+#include "mantisbase/core/files.h"
+#include "mantisbase/core/models/entity.h"
+#include "mantisbase/core/models/entity_schema.h"
+#include "mantisbase/core/models/entity_schema_field.h"
+#include "mantisbase/mantisbase.h"
+#include "../common/test_environment.h"
+
+#include <fstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+using mb::FileCleanup;
+using mb::Files;
+
+class FileCleanupTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        auto &app = mb::MantisBase::instance();
+        schema = std::make_unique<mb::EntitySchema>(app, entity, "base");
+        schema->addField(mb::EntitySchemaField("doc", "file"));
+        if (!mb::EntitySchema::tableExists(*schema)) mb::EntitySchema::createTable(*schema);
+        Files::createDir(entity);
+    }
+
+    void TearDown() override {
+        mb::EntitySchema::dropTable(*schema);
+    }
+
+    fs::path touch(const std::string &filename) const {
+        const auto path = Files::filePath(entity, filename);
+        std::ofstream(path) << "bytes";
+        return path;
+    }
+
+    /// The background thread removes files shortly after a notify()
+    static bool eventuallyGone(const fs::path &path) {
+        for (int i = 0; i < 100 && fs::exists(path); ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        return !fs::exists(path);
+    }
+
+    const std::string entity = "file_cleanup_test";
+    std::unique_ptr<mb::EntitySchema> schema;
+};
+
+TEST_F(FileCleanupTest, RemovesFilesOfDeletedRecordsInTheBackground) {
+    const auto path = touch("abc_report.txt");
+    const auto records = schema->toEntity();
+    const auto record = records.create({{"doc", "abc_report.txt"}});
+
+    records.remove(record["id"].get<std::string>());
+    EXPECT_TRUE(eventuallyGone(path));
+}
+
+TEST_F(FileCleanupTest, RemovesFilesAnUpdateReplaces) {
+    const auto old_path = touch("jkl_old.txt");
+    const auto new_path = touch("mno_new.txt");
+    const auto records = schema->toEntity();
+    const auto id = records.create({{"doc", "jkl_old.txt"}})["id"].get<std::string>();
+
+    const auto record = records.update(id, {{"doc", "mno_new.txt"}});
+    EXPECT_EQ(record["doc"], "mno_new.txt");
+    EXPECT_FALSE(record.contains("mb_old_doc"));
+    EXPECT_TRUE(eventuallyGone(old_path));
+    EXPECT_TRUE(fs::exists(new_path));
+}
+
+TEST_F(FileCleanupTest, QueuedFilesGoOnlyOnceTheWriteCommits) {
+    auto &app = mb::MantisBase::instance();
+    const auto kept = touch("def_kept.txt");
+    const auto dropped = touch("ghi_dropped.txt");
+
+    // A rolled back write takes its queue entries with it
+    EXPECT_THROW(app.db().write([&](soci::session &sql) {
+        FileCleanup::enqueue(sql, entity, {"def_kept.txt"});
+        throw std::runtime_error("rolled back");
+    }), std::exception);
+
+    // Queueing twice is harmless
+    app.db().write([&](soci::session &sql) {
+        FileCleanup::enqueue(sql, entity, {"ghi_dropped.txt", "ghi_dropped.txt"});
+    });
+    app.fileCleanup().notify();
+
+    EXPECT_TRUE(eventuallyGone(dropped));
+    EXPECT_TRUE(fs::exists(kept));
+}
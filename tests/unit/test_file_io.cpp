@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/file_io.h"
+#include "mantisbase/core/multipart_upload.h"
+
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <sstream>
+
+namespace fs = std::filesystem;
+using mb::FileIo;
+using mb::MultipartUpload;
+
+namespace {
+    struct ScratchDir {
+        fs::path path = fs::temp_directory_path() /
+                        (std::string("mb_file_io_") + ::testing::UnitTest::GetInstance()->current_test_info()->name());
+
+        ScratchDir() { fs::create_directories(path); }
+        ~ScratchDir() { fs::remove_all(path); }
+
+        [[nodiscard]] std::size_t files() const {
+            return static_cast<std::size_t>(std::distance(fs::directory_iterator(path), fs::directory_iterator{}));
+        }
+    };
+
+    std::string readFile(const fs::path &path) {
+        std::ifstream in(path, std::ios::binary);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        return ss.str();
+    }
+
+    /// Small budget, so writers have to wait on the disk now and then
+    FileIo::Options threads() {
+        FileIo::Options options;
+        options.uring = false;
+        options.maxPending = 64 * 1024;
+        return options;
+    }
+
+    std::error_code closeAndWait(const std::shared_ptr<FileIo::Writer> &writer) {
+        std::promise<std::error_code> closed;
+        writer->close([&](const std::error_code ec) { closed.set_value(ec); });
+        return closed.get_future().get();
+    }
+}
+
+TEST(FileIo, WritesLandInOrder) {
+    ScratchDir dir;
+    FileIo io(threads());
+    io.start();
+    EXPECT_TRUE(io.running());
+
+    std::string expected;
+    const auto writer = io.open(dir.path / "ordered.bin");
+    for (int i = 0; i < 2000; ++i) {
+        const auto chunk = std::string(97, static_cast<char>('a' + i % 26)) + std::to_string(i);
+        writer->write(chunk.data(), chunk.size());
+        expected += chunk;
+    }
+    EXPECT_FALSE(closeAndWait(writer));
+    EXPECT_EQ(readFile(dir.path / "ordered.bin"), expected);
+    io.stop();
+}
+
+TEST(FileIo, RunsInlineWhenNotStarted) {
+    ScratchDir dir;
+    FileIo io(threads());
+    EXPECT_STREQ(io.engineName(), "inline");
+
+    const auto writer = io.open(dir.path / "inline.txt");
+    writer->write("abc", 3);
+    bool closed = false;
+    writer->close([&](const std::error_code ec) { closed = !ec; });
+    // Before close() returns
+    EXPECT_TRUE(closed);
+    EXPECT_EQ(readFile(dir.path / "inline.txt"), "abc");
+
+    io.remove({(dir.path / "inline.txt").string(), (dir.path / "missing.txt").string()});
+    EXPECT_EQ(dir.files(), 0u);
+}
+
+TEST(FileIo, UploadsStagedThroughItMatchInlineOnes) {
+    ScratchDir dir;
+    FileIo io(threads());
+    io.start();
+    const std::string data(300 * 1024, 'x');
+
+    auto stage = [&](FileIo *through) {
+        MultipartUpload upload(dir.path, {}, through);
+        upload.beginPart("doc", "a.bin", "application/octet-stream");
+        for (std::size_t i = 0; i < data.size(); i += 1000)
+            upload.append(data.data() + i, std::min<std::size_t>(1000, data.size() - i));
+        auto parts = upload.finish();
+        EXPECT_EQ(parts.size(), 1u);
+        return parts;
+    };
+
+    auto inline_parts = stage(nullptr);
+    auto async_parts = stage(&io);
+    EXPECT_EQ(async_parts[0].sha256, inline_parts[0].sha256);
+    EXPECT_EQ(readFile(async_parts[0].staged_path), data);
+
+    MultipartUpload::discard(inline_parts, &io);
+    MultipartUpload::discard(async_parts, &io);
+    io.stop();
+    EXPECT_EQ(dir.files(), 0u);
+}
+
+TEST(FileIo, AbortedUploadsLeaveNothingStaged) {
+    ScratchDir dir;
+    FileIo io(threads());
+    io.start();
+    {
+        MultipartUpload upload(dir.path, {}, &io);
+        upload.beginPart("doc", "a.bin", "application/octet-stream");
+        const std::string data(128 * 1024, 'y');
+        upload.append(data.data(), data.size());
+    }
+    // The writes still in flight finish before the file goes
+    io.stop();
+    EXPECT_EQ(dir.files(), 0u);
+}
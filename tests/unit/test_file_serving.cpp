@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/file_serving.h"
+
+using mb::FileServing;
+using Range = FileServing::Range;
+
+TEST(FileServing, ParsesSingleByteRanges) {
+    auto r = FileServing::parseRange("bytes=0-99", 1000);
+    EXPECT_EQ(r.kind, Range::Partial);
+    EXPECT_EQ(r.offset, 0u);
+    EXPECT_EQ(r.length, 100u);
+
+    r = FileServing::parseRange("bytes=900-", 1000);
+    EXPECT_EQ(r.kind, Range::Partial);
+    EXPECT_EQ(r.offset, 900u);
+    EXPECT_EQ(r.length, 100u);
+
+    r = FileServing::parseRange("bytes=-10", 1000);
+    EXPECT_EQ(r.kind, Range::Partial);
+    EXPECT_EQ(r.offset, 990u);
+    EXPECT_EQ(r.length, 10u);
+
+    // End past the file is clamped, a suffix longer than the file is all of it
+    r = FileServing::parseRange("bytes=500-5000", 1000);
+    EXPECT_EQ(r.length, 500u);
+    EXPECT_EQ(FileServing::parseRange("bytes=-5000", 1000).kind, Range::Full);
+}
+
+TEST(FileServing, FallsBackToFullOrRejectsRanges) {
+    EXPECT_EQ(FileServing::parseRange("", 1000).kind, Range::Full);
+    EXPECT_EQ(FileServing::parseRange("items=0-1", 1000).kind, Range::Full);
+    EXPECT_EQ(FileServing::parseRange("bytes=0-1,5-6", 1000).kind, Range::Full);
+    EXPECT_EQ(FileServing::parseRange("bytes=9-3", 1000).kind, Range::Full);
+    EXPECT_EQ(FileServing::parseRange("bytes=x-3", 1000).kind, Range::Full);
+    EXPECT_EQ(FileServing::parseRange("bytes=0-999", 1000).kind, Range::Full);
+
+    EXPECT_EQ(FileServing::parseRange("bytes=1000-", 1000).kind, Range::Unsatisfiable);
+    EXPECT_EQ(FileServing::parseRange("bytes=-0", 1000).kind, Range::Unsatisfiable);
+    EXPECT_EQ(FileServing::parseRange("bytes=0-", 0).kind, Range::Unsatisfiable);
+}
+
+TEST(FileServing, AnswersConditionalRequests) {
+    const auto tag = FileServing::etag("abc");
+    EXPECT_EQ(tag, "\"abc\"");
+
+    EXPECT_TRUE(FileServing::ifNoneMatch("\"x\", W/\"abc\"", tag));
+    EXPECT_TRUE(FileServing::ifNoneMatch("*", tag));
+    EXPECT_FALSE(FileServing::ifNoneMatch("\"abcd\"", tag));
+
+    // If-None-Match takes precedence over If-Modified-Since
+    EXPECT_FALSE(FileServing::isNotModified("\"other\"", 2000, tag, 1000));
+    EXPECT_TRUE(FileServing::isNotModified("", 1000, tag, 1000));
+    EXPECT_FALSE(FileServing::isNotModified("", 999, tag, 1000));
+    EXPECT_FALSE(FileServing::isNotModified("", -1, tag, 1000));
+
+    const std::string date = "Wed, 12 Sep 2018 09:22:40 GMT";
+    EXPECT_TRUE(FileServing::ifRangeAllows("", tag, date));
+    EXPECT_TRUE(FileServing::ifRangeAllows(tag, tag, date));
+    EXPECT_FALSE(FileServing::ifRangeAllows("W/\"abc\"", tag, date));
+    EXPECT_TRUE(FileServing::ifRangeAllows(date, tag, date));
+    EXPECT_FALSE(FileServing::ifRangeAllows("Thu, 13 Sep 2018 09:22:40 GMT", tag, date));
+}
+
+TEST(FileServing, ResolvesCachePolicyPerEntity) {
+    const auto policy = FileServing::CachePolicy::parse("posts = public, max-age=86400; *=private;broken;=x");
+    EXPECT_EQ(policy.forEntity("posts"), "public, max-age=86400");
+    EXPECT_EQ(policy.forEntity("users"), "private");
+    EXPECT_EQ(FileServing::CachePolicy::parse("").forEntity("posts"), "no-cache");
+}
+
+TEST(FileServing, RecognisesFingerprintedAssets) {
+    EXPECT_TRUE(FileServing::isFingerprinted("/public/assets/index-B3x9kQ1z.js"));
+    EXPECT_TRUE(FileServing::isFingerprinted("main.8f3a2c91.css"));
+    EXPECT_FALSE(FileServing::isFingerprinted("/public/index.html"));
+    EXPECT_FALSE(FileServing::isFingerprinted("favicon.ico"));
+    EXPECT_FALSE(FileServing::isFingerprinted("page-settings.js"));
+    EXPECT_FALSE(FileServing::isFingerprinted("noext-1234567890"));
+}
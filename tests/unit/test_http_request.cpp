@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/http.h"
+#include "mantisbase/mantisbase.h"
+#include "../common/test_environment.h"
+
+#include <drogon/HttpRequest.h>
+
+using mb::MantisRequest;
+using mb::PathPattern;
+using mb::RequestMethod;
+
+namespace {
+    drogon::HttpRequestPtr request(const drogon::HttpMethod method, const std::string &path) {
+        auto req = drogon::HttpRequest::newHttpRequest();
+        req->setMethod(method);
+        req->setPath(path);
+        return req;
+    }
+}
+
+TEST(PathPattern, FindsParamSegments) {
+    const PathPattern pattern("/api/v1/entities/:entity_name/:id");
+    ASSERT_EQ(pattern.params.size(), 2u);
+    EXPECT_EQ(pattern.params[0].name, "entity_name");
+    EXPECT_EQ(pattern.params[0].segment, 4u);
+    EXPECT_EQ(pattern.params[1].name, "id");
+    EXPECT_EQ(pattern.params[1].segment, 5u);
+
+    EXPECT_TRUE(PathPattern("/api/v1/health").params.empty());
+    EXPECT_THROW(PathPattern("/:a/:b/:c/:d/:e/:f/:g/:h/:i"), mb::MantisException);
+}
+
+TEST(MantisRequest, ReadsPathParamsInPlace) {
+    MantisRequest req(mb::MantisBase::instance(), request(drogon::Patch, "/api/v1/entities/posts/abc123"));
+    req.setPathParams(std::make_shared<const PathPattern>("/api/v1/entities/:entity_name/:id"));
+
+    EXPECT_EQ(req.pathParam("entity_name"), "posts");
+    EXPECT_EQ(req.pathParam(1), "abc123");
+    EXPECT_EQ(req.pathParam(2), "");
+    EXPECT_EQ(req.getPathParamValue("id"), "abc123");
+    EXPECT_TRUE(req.hasPathParam("id"));
+    EXPECT_FALSE(req.hasPathParam("field"));
+    // A view into the path drogon holds, not a copy
+    EXPECT_GE(req.pathParam("id").data(), req.getPath().data());
+
+    // Set ones come first
+    req.setPathParam("id", "other");
+    EXPECT_EQ(req.pathParam("id"), "other");
+
+    EXPECT_EQ(req.method(), RequestMethod::Patch);
+    EXPECT_EQ(req.methodName(), "PATCH");
+    EXPECT_EQ(req.getMethod(), "PATCH");
+}
+
+TEST(MantisRequest, LooksUpHeadersInAnyCase) {
+    auto drogon_req = request(drogon::Get, "/api/v1/health");
+    drogon_req->addHeader("Accept", "application/cbor");
+    drogon_req->addHeader("X-Request-Timeout", "250");
+    drogon_req->addHeader("X-Forwarded-For", "203.0.113.7, 10.0.0.1");
+    const MantisRequest req(mb::MantisBase::instance(), drogon_req);
+
+    EXPECT_EQ(req.header("accept"), "application/cbor");
+    EXPECT_EQ(req.header("Accept"), "application/cbor");
+    EXPECT_EQ(req.header("x-request-timeout"), "250");
+    EXPECT_EQ(req.header("X-REQUEST-TIMEOUT"), "250");
+    EXPECT_EQ(req.header("x-missing-header-name"), "");
+    EXPECT_EQ(req.getHeaderValueU64("X-Request-Timeout"), 250u);
+    EXPECT_EQ(req.getHeaderValue("Missing", "none"), "none");
+
+    // Parsed once, and the same address after
+    EXPECT_EQ(req.getRemoteAddr(), "203.0.113.7");
+    EXPECT_EQ(&req.getRemoteAddr(), &req.getRemoteAddr());
+}
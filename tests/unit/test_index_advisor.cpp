@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/index_advisor.h"
+#include "mantisbase/core/models/entity.h"
+#include "mantisbase/core/models/entity_schema.h"
+#include "mantisbase/core/models/entity_schema_field.h"
+#include "mantisbase/mantisbase.h"
+#include "../common/test_environment.h"
+
+using mb::IndexAdvisor;
+using namespace std::chrono_literals;
+
+class IndexAdvisorTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        auto &app = mb::MantisBase::instance();
+        schema = std::make_unique<mb::EntitySchema>(app, entity, "base");
+        schema->addField(mb::EntitySchemaField("status", "string"));
+        schema->addField(mb::EntitySchemaField("views", "int"));
+        if (!mb::EntitySchema::tableExists(*schema)) mb::EntitySchema::createTable(*schema);
+    }
+
+    void TearDown() override {
+        mb::EntitySchema::dropTable(*schema);
+    }
+
+    static mb::IndexDefinition index(const std::string &name, std::vector<std::string> columns) {
+        return {name, false, std::move(columns)};
+    }
+
+    const std::string entity = "index_advisor_test";
+    std::unique_ptr<mb::EntitySchema> schema;
+};
+
+TEST_F(IndexAdvisorTest, RanksPatternsByTotalTime) {
+    IndexAdvisor advisor({.capacity = 2});
+    advisor.record(entity, index("idx_a", {"status", "id"}), 2ms);
+    advisor.record(entity, index("idx_b", {"views", "id"}), 1ms);
+    advisor.record(entity, index("idx_b", {"views", "id"}), 5ms);
+    advisor.record(entity, index("idx_c", {"status", "views", "id"}), 9ms); // past capacity
+
+    const auto top = advisor.suggestions();
+    ASSERT_EQ(top.size(), 2u);
+    EXPECT_EQ(top[0]["index"]["name"], "idx_b");
+    EXPECT_EQ(top[0]["queries"], 2);
+    EXPECT_DOUBLE_EQ(top[0]["avg_ms"].get<double>(), 3.0);
+    EXPECT_DOUBLE_EQ(top[0]["max_ms"].get<double>(), 5.0);
+    EXPECT_EQ(top[1]["index"]["name"], "idx_a");
+
+    advisor.forget(entity);
+    EXPECT_TRUE(advisor.suggestions().empty());
+}
+
+TEST_F(IndexAdvisorTest, ListPagesAreRecordedUnderTheMissingIndex) {
+    auto &app = mb::MantisBase::instance();
+    app.indexAdvisor().forget(entity);
+
+    const auto records = app.entity(entity);
+    (void) records.list({{"filter", "status = 'draft'"}, {"pagination", {{"sort", "-views"}}}});
+    (void) records.list();   // by id, unfiltered: nothing to index
+
+    const auto top = app.indexAdvisor().suggestions();
+    const auto it = std::ranges::find_if(top, [&](const nlohmann::json &s) { return s["entity"] == entity; });
+    ASSERT_NE(it, top.end());
+    EXPECT_EQ((*it)["index"]["columns"], (std::vector<std::string>{"status", "views", "id"}));
+    EXPECT_EQ((*it)["queries"], 1);
+}
+
+TEST_F(IndexAdvisorTest, BuildsIndexesOverBothThresholds) {
+    auto &app = mb::MantisBase::instance();
+    IndexAdvisor advisor({.autoCreate = true, .minQueries = 3, .minAvg = 1ms});
+    const auto idx = index("idx_index_advisor_test_status_id", {"status", "id"});
+
+    // Frequent but fast, then slow as well
+    for (int i = 0; i < 3; ++i) advisor.record(entity, idx, 100us);
+    EXPECT_FALSE(advisor.step());
+    for (int i = 0; i < 3; ++i) advisor.record(entity, idx, 10ms);
+    EXPECT_TRUE(advisor.step());
+    EXPECT_EQ(advisor.created(), 1u);
+    EXPECT_FALSE(advisor.step());
+
+    // In the schema, so list() stops asking for it
+    const auto updated = app.entity(entity);
+    const auto indexes = updated.schema()["indexes"];
+    ASSERT_EQ(indexes.size(), 1u);
+    EXPECT_EQ(indexes[0]["name"], idx.name);
+    const auto filter = updated.compileFilter("status = 'draft'");
+    EXPECT_FALSE(updated.listIndexRecommendation(filter.get(), "id").has_value());
+
+    // Unknown entities fail the pattern, once
+    advisor.forget(entity);
+    for (int i = 0; i < 3; ++i) advisor.record("no_such_entity", index("idx_no_such_entity_x_id", {"x", "id"}), 10ms);
+    EXPECT_TRUE(advisor.step());
+    EXPECT_FALSE(advisor.step());
+    EXPECT_FALSE(advisor.suggestions()[0]["error"].is_null());
+}
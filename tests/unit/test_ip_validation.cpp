@@ -84,3 +84,38 @@ TEST(IPValidation, IPv6CompressedNotation) {
     EXPECT_TRUE(mb::isValidIPv6("2001:db8:85a3::8a2e:370:7334")); // Middle compression
 }
 
+
+TEST(IPValidation, ParsesToTheSameBinaryAddress) {
+    const auto v4 = mb::parseIP("192.168.1.1");
+    ASSERT_TRUE(v4.has_value());
+    EXPECT_TRUE(v4->isV4());
+    EXPECT_EQ(v4, mb::parseIP("::ffff:192.168.1.1"));
+    EXPECT_EQ(v4->toString(), "192.168.1.1");
+
+    // One address, however it is spelled
+    const auto v6 = mb::parseIP("2001:0DB8:0000:0000:0000:0000:0000:0001");
+    ASSERT_TRUE(v6.has_value());
+    EXPECT_FALSE(v6->isV4());
+    EXPECT_EQ(v6, mb::parseIP("2001:db8::1"));
+    EXPECT_EQ(v6->toString(), "2001:db8::1");
+    EXPECT_EQ(mb::parseIP("fe80::1%eth0"), mb::parseIP("fe80::1"));
+}
+
+TEST(IPValidation, CanonicalIPv6Text) {
+    EXPECT_EQ(mb::parseIPv6("::")->toString(), "::");
+    EXPECT_EQ(mb::parseIPv6("::1")->toString(), "::1");
+    EXPECT_EQ(mb::parseIPv6("1:0:0:2:0:0:0:3")->toString(), "1:0:0:2::3");   // Longest run
+    EXPECT_EQ(mb::parseIPv6("1:0:0:2:0:0:3:4")->toString(), "1::2:0:0:3:4"); // First on a tie
+    EXPECT_EQ(mb::parseIPv6("1:2:3:4:5:6:0:8")->toString(), "1:2:3:4:5:6:0:8"); // A lone zero stays
+}
+
+TEST(IPValidation, RejectsWhatInetPtonRejects) {
+    EXPECT_FALSE(mb::parseIPv4("01.2.3.4").has_value());       // Leading zero
+    EXPECT_FALSE(mb::parseIPv4("1.2.3.4\n").has_value());
+    EXPECT_FALSE(mb::parseIPv6("1:2:3:4::5:6:7:8").has_value()); // `::` for no group
+    EXPECT_FALSE(mb::parseIPv6("1::2:").has_value());
+    EXPECT_FALSE(mb::parseIPv6(":1::2").has_value());
+    EXPECT_FALSE(mb::parseIPv6("12345::").has_value());
+    EXPECT_FALSE(mb::parseIPv6("1:2:3:4:5:6:7:1.2.3.4").has_value()); // IPv4 tail past the last group
+    EXPECT_FALSE(mb::parseIPv6("fe80::1%").has_value());
+}
@@ -0,0 +1,49 @@
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+
+#include "mantisbase/utils/json_parse.h"
+
+using json = nlohmann::json;
+
+TEST(JsonParse, MatchesNlohmann) {
+    const std::vector<std::string> docs = {
+        R"({})",
+        R"([])",
+        R"({"id":"01J","title":"Hello é\n","tags":["a","b"],"meta":{"views":12,"score":-3.5}})",
+        R"([1, -1, 18446744073709551615, 9223372036854775807, -9223372036854775808, 1e300, 0.1])",
+        R"({"ok":true,"none":null,"nested":[[[{"deep":[false]}]]]})",
+        "  \n\t{\"spaced\" : [ 1 , 2 ] }\n",
+        R"("scalar")",
+        R"(42)",
+    };
+    for (const auto &doc: docs) {
+        EXPECT_EQ(mb::parseJson(doc), json::parse(doc)) << doc;
+    }
+}
+
+TEST(JsonParse, KeepsNumberKinds) {
+    const auto parsed = mb::parseJson(R"({"i":-5,"u":18446744073709551615,"d":2.5})");
+    EXPECT_TRUE(parsed["i"].is_number_integer());
+    EXPECT_EQ(parsed["i"].get<int64_t>(), -5);
+    EXPECT_TRUE(parsed["u"].is_number_unsigned());
+    EXPECT_TRUE(parsed["d"].is_number_float());
+}
+
+TEST(JsonParse, IntegersPastSixtyFourBitsFallBack) {
+    // simdjson refuses these; nlohmann reads them as doubles
+    const std::string doc = R"({"big":123456789012345678901234567890})";
+    EXPECT_EQ(mb::parseJson(doc), json::parse(doc));
+}
+
+TEST(JsonParse, ThrowsNlohmannErrors) {
+    EXPECT_THROW(mb::parseJson(R"({"a":)"), json::parse_error);
+    EXPECT_THROW(mb::parseJson(""), json::parse_error);
+    EXPECT_THROW(mb::parseJson("{} trailing"), json::parse_error);
+}
+
+TEST(JsonParse, ParsesFromAView) {
+    const std::string buffer = R"({"a":1}{"b":2})";
+    EXPECT_EQ(mb::parseJson(std::string_view(buffer).substr(0, 7)), json({{"a", 1}}));
+}
@@ -0,0 +1,85 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/kv_store.h"
+#include "mantisbase/core/exceptions.h"
+#include "mantisbase/mantisbase.h"
+#include "../common/test_environment.h"
+
+using mb::KeyValStore;
+
+TEST(KeyValStore, UpdatesPublishNewSnapshots) {
+    KeyValStore store(mb::MantisBase::instance());
+    store.migrate();
+
+    const auto before = store.snapshot();
+    ASSERT_GT(before->version, 0u);
+    EXPECT_TRUE(before->values.contains("sessionTimeout"));
+
+    const auto after = store.update({{"appName", "KV Test"}, {"sessionTimeout", 600}, {"unknownKey", 1}});
+    EXPECT_EQ(after->version, before->version + 1);
+    EXPECT_EQ(after->values["appName"], "KV Test");
+    EXPECT_EQ(after->values["sessionTimeout"], 600);
+    EXPECT_FALSE(after->values.contains("unknownKey"));
+    // Held snapshots never change
+    EXPECT_NE(before->values["appName"], "KV Test");
+
+    // Reloading reads back what was stored
+    KeyValStore reloaded(mb::MantisBase::instance());
+    reloaded.migrate();
+    EXPECT_EQ(reloaded.snapshot()->values["sessionTimeout"], 600);
+
+    store.update({{"appName", before->values["appName"]}, {"sessionTimeout", before->values["sessionTimeout"]}});
+}
+
+TEST(KeyValStore, RejectsValuesOfTheWrongType) {
+    KeyValStore store(mb::MantisBase::instance());
+    store.migrate();
+    const auto version = store.snapshot()->version;
+
+    EXPECT_THROW(store.update(nlohmann::json::array()), mb::MantisException);
+    EXPECT_THROW(store.update({{"maxFileSize", "big"}}), mb::MantisException);
+    EXPECT_THROW(store.update({{"allowRegistration", 1}}), mb::MantisException);
+    EXPECT_EQ(store.snapshot()->version, version);
+}
+
+TEST(KeyValStore, SubscribersSeeEveryChangeUntilUnsubscribed) {
+    KeyValStore store(mb::MantisBase::instance());
+    store.migrate();
+
+    std::vector<std::uint64_t> seen;
+    const auto id = store.subscribe([&seen](const KeyValStore::Snapshot &s) { seen.push_back(s.version); });
+    ASSERT_EQ(seen.size(), 1u); // The current snapshot, straight away
+
+    const auto mode = store.snapshot()->values.value("mode", "PROD");
+    store.update({{"mode", "test"}});
+    ASSERT_EQ(seen.size(), 2u);
+    EXPECT_EQ(seen[1], seen[0] + 1);
+    EXPECT_EQ(store.snapshot()->values["mode"], "TEST");
+
+    store.unsubscribe(id);
+    store.update({{"mode", mode}});
+    EXPECT_EQ(seen.size(), 2u);
+}
+
+TEST(KeyValStore, PublicSettingsKeepTheirETagUntilTheyChange) {
+    KeyValStore store(mb::MantisBase::instance());
+    store.migrate();
+
+    const auto before = store.snapshot();
+    const auto body = nlohmann::json::parse(before->publicBody);
+    EXPECT_TRUE(body["data"].contains("appName"));
+    EXPECT_FALSE(body["data"].contains("sessionTimeout"));
+    EXPECT_FALSE(body["data"].contains("http"));
+    ASSERT_FALSE(before->publicEtag.empty());
+
+    // A private key changing leaves clients' copies valid
+    const auto timeout = before->values["sessionTimeout"].get<int>();
+    const auto private_change = store.update({{"sessionTimeout", timeout + 1}});
+    EXPECT_EQ(private_change->publicEtag, before->publicEtag);
+
+    const auto public_change = store.update({{"appName", "Public Test"}});
+    EXPECT_NE(public_change->publicEtag, before->publicEtag);
+    EXPECT_EQ(nlohmann::json::parse(public_change->publicBody)["data"]["appName"], "Public Test");
+
+    store.update({{"appName", before->values["appName"]}, {"sessionTimeout", timeout}});
+    EXPECT_EQ(store.snapshot()->publicEtag, before->publicEtag);
+}
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include <soci/soci.h>
+#include <soci/sqlite3/soci-sqlite3.h>
+#include "mantisbase/core/leader_election.h"
+
+#include <memory>
+#include <stdexcept>
+
+namespace {
+    using namespace std::chrono_literals;
+    using mb::LeaderElection;
+
+    /// A lease table in memory, the way Database::createSysTables() makes it
+    std::shared_ptr<soci::session> cluster() {
+        auto sql = std::make_shared<soci::session>(soci::sqlite3, ":memory:");
+        *sql << "CREATE TABLE mb_leader_lease (name TEXT PRIMARY KEY, owner TEXT NOT NULL, expires BIGINT NOT NULL)";
+        return sql;
+    }
+
+    LeaderElection::Options node(const std::string &name) {
+        LeaderElection::Options options;
+        options.node = name;
+        options.ttl = 15s;
+        return options;
+    }
+}
+
+TEST(LeaderElection, OneNodeHoldsTheLease) {
+    auto sql = cluster();
+    EXPECT_EQ(LeaderElection::claim(*sql, "a", 15s), "a");
+    EXPECT_EQ(LeaderElection::claim(*sql, "b", 15s), "a");
+    EXPECT_EQ(LeaderElection::claim(*sql, "a", 15s), "a");
+
+    // Released, or lapsed, it goes to whoever asks next
+    LeaderElection::release(*sql, "b");
+    EXPECT_EQ(LeaderElection::claim(*sql, "b", 15s), "a");
+    LeaderElection::release(*sql, "a");
+    EXPECT_EQ(LeaderElection::claim(*sql, "b", 15s), "b");
+    *sql << "UPDATE mb_leader_lease SET expires = expires - 60";
+    EXPECT_EQ(LeaderElection::claim(*sql, "a", 15s), "a");
+}
+
+TEST(LeaderElection, HandsOverWhenTheLeaderStops) {
+    const auto sql = cluster();
+    const LeaderElection::Connect connect = [sql] { return sql; };
+    LeaderElection a(node("a"), connect), b(node("b"), connect);
+
+    EXPECT_TRUE(a.renew());
+    EXPECT_FALSE(b.renew());
+    EXPECT_TRUE(a.isLeader());
+    EXPECT_FALSE(b.isLeader());
+    EXPECT_EQ(b.status()["holder"], "a");
+
+    a.stop();
+    EXPECT_FALSE(a.isLeader());
+    EXPECT_TRUE(b.renew());
+    EXPECT_TRUE(b.isLeader());
+    EXPECT_EQ(a.status()["leader"], false);
+}
+
+TEST(LeaderElection, LeadsAloneWithoutElecting) {
+    LeaderElection alone(node("a"), [] () -> std::shared_ptr<soci::session> { throw std::runtime_error("unused"); });
+    alone.start(false);
+    EXPECT_TRUE(alone.isLeader());
+    EXPECT_EQ(alone.status()["holder"], "a");
+    alone.stop();
+
+    auto options = node("b");
+    options.enabled = false;
+    LeaderElection off(options, [] () -> std::shared_ptr<soci::session> { throw std::runtime_error("unused"); });
+    off.start(true);
+    EXPECT_TRUE(off.isLeader());
+}
@@ -0,0 +1,56 @@
+#include <gtest/gtest.h>
+#include <cstdlib>
+#include "mantisbase/core/listener_options.h"
+#include "mantisbase/core/exceptions.h"
+
+using mb::ListenerOptions;
+using nlohmann::json;
+
+TEST(ListenerOptions, LaterLayersOverrideEarlierOnes) {
+    ListenerOptions options;
+    options.merge({{"idleTimeout", 120}, {"keepAliveRequests", 1000}, {"maxConnections", 5000}});
+    options.merge({{"idleTimeout", 300}, {"tlsCert", "cert.pem"}});
+
+    EXPECT_EQ(options.idleTimeout.count(), 300);
+    EXPECT_EQ(options.keepAliveRequests, 1000u);
+    EXPECT_EQ(options.maxConnections, 5000u);
+    EXPECT_EQ(options.maxConnectionsPerIp, 0u);
+    EXPECT_FALSE(options.tls());
+
+    ::setenv("MB_HTTP_MAX_CONNECTIONS_PER_IP", "32", 1);
+    ::setenv("MB_TLS_KEY", "key.pem", 1);
+    ::setenv("MB_HTTP_IDLE_TIMEOUT", "not a number", 1);
+    options.mergeEnv();
+    ::unsetenv("MB_HTTP_MAX_CONNECTIONS_PER_IP");
+    ::unsetenv("MB_TLS_KEY");
+    ::unsetenv("MB_HTTP_IDLE_TIMEOUT");
+
+    EXPECT_EQ(options.maxConnectionsPerIp, 32u);
+    EXPECT_EQ(options.idleTimeout.count(), 300);
+    EXPECT_TRUE(options.tls());
+}
+
+TEST(ListenerOptions, RejectsBadValues) {
+    ListenerOptions options;
+    EXPECT_THROW(options.merge({{"idleTimeout", -1}}), mb::MantisException);
+    EXPECT_THROW(options.merge({{"maxConnections", "lots"}}), mb::MantisException);
+    EXPECT_THROW(options.merge({{"tlsSessionTickets", 1}}), mb::MantisException);
+    EXPECT_THROW(options.merge(json::array()), mb::MantisException);
+    EXPECT_NO_THROW(options.merge(nullptr));
+    EXPECT_EQ(options.idleTimeout.count(), 60);
+}
+
+TEST(ListenerOptions, SessionTicketsAreOnUnlessTurnedOff) {
+    ListenerOptions options;
+    EXPECT_TRUE(options.sslConfCommands().empty());
+
+    options.merge({{"tlsSessionTickets", false}});
+    const auto commands = options.sslConfCommands();
+    ASSERT_EQ(commands.size(), 1u);
+    EXPECT_EQ(commands[0].first, "Options");
+    EXPECT_EQ(commands[0].second, "-SessionTicket");
+
+    const auto stored = options.toJSON();
+    EXPECT_FALSE(stored["tlsSessionTickets"].get<bool>());
+    EXPECT_FALSE(stored.contains("tlsCert"));
+}
@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/logger/log_database.h"
+
+#include <map>
+#include <tuple>
+
+using mb::LogDatabase;
+
+TEST(LogDatabase, SearchWordsBecomePrefixTerms) {
+    EXPECT_EQ(LogDatabase::ftsQuery("database"), "\"database\"*");
+    EXPECT_EQ(LogDatabase::ftsQuery("  auth   failed "), "\"auth\"* \"failed\"*");
+}
+
+TEST(LogDatabase, SearchOperatorsAreQuoted) {
+    EXPECT_EQ(LogDatabase::ftsQuery("a\"b"), "\"a\"\"b\"*");
+    EXPECT_EQ(LogDatabase::ftsQuery("NOT user-42"), "\"NOT\"* \"user-42\"*");
+    EXPECT_EQ(LogDatabase::ftsQuery("message:x*"), "\"message:x*\"*");
+}
+
+TEST(LogDatabase, BlankSearchHasNoTerms) {
+    EXPECT_EQ(LogDatabase::ftsQuery(""), "");
+    EXPECT_EQ(LogDatabase::ftsQuery(" \t "), "");
+}
+
+TEST(LogDatabase, PartitionsAreUtcDays) {
+    EXPECT_EQ(LogDatabase::partitionName(0), "mb_logs_19700101");
+    EXPECT_EQ(LogDatabase::partitionName(1760400000), "mb_logs_20251014");
+    EXPECT_EQ(LogDatabase::partitionName(1760486399), "mb_logs_20251014");
+    EXPECT_EQ(LogDatabase::partitionName(1760486400), "mb_logs_20251015");
+}
+
+TEST(LogDatabase, DateFiltersMapToPartitions) {
+    EXPECT_EQ(LogDatabase::partitionForDate("2025-10-14T10:30:45Z"), "mb_logs_20251014");
+    EXPECT_EQ(LogDatabase::partitionForDate("2025-10-14"), "mb_logs_20251014");
+    EXPECT_EQ(LogDatabase::partitionForDate(""), "");
+    EXPECT_EQ(LogDatabase::partitionForDate("yesterday"), "");
+    EXPECT_EQ(LogDatabase::partitionForDate("2025-1x-14"), "");
+}
+
+TEST(LogDatabase, RollupsCountPerMinuteLevelOriginAndRoute) {
+    std::vector<mb::LogQueue::Entry> batch(5);
+    batch[0].level = batch[1].level = batch[2].level = "info";
+    batch[0].origin = batch[1].origin = batch[2].origin = "System";
+    batch[0].route = batch[1].route = batch[2].route = "GET /api/v1/entities/:entity";
+    batch[0].createdAt = 1760400000;
+    batch[1].createdAt = 1760400059;
+    batch[2].createdAt = 1760400060;
+    batch[3].level = batch[4].level = "critical";
+    batch[3].origin = batch[4].origin = "Database";
+    batch[3].createdAt = batch[4].createdAt = 1760400030;
+
+    const auto rows = LogDatabase::rollup(batch);
+    ASSERT_EQ(rows.size(), 3u);
+    std::map<std::tuple<long long, std::string, std::string>, long long> counts;
+    for (const auto &row: rows) counts[{row.minute, row.level, row.route}] = row.count;
+    EXPECT_EQ((counts[{1760400000, "info", "GET /api/v1/entities/:entity"}]), 2);
+    EXPECT_EQ((counts[{1760400060, "info", "GET /api/v1/entities/:entity"}]), 1);
+    EXPECT_EQ((counts[{1760400000, "critical", ""}]), 2);
+}
@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/logger/log_queue.h"
+
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+using mb::LogQueue;
+
+namespace {
+    LogQueue::Entry entry(const std::string &message) {
+        LogQueue::Entry e;
+        e.level = "info";
+        e.origin = "Test";
+        e.message = message;
+        return e;
+    }
+
+    LogQueue::Options options(const std::size_t capacity, const std::size_t batch,
+                              const LogQueue::Policy policy = LogQueue::Policy::DropNewest) {
+        LogQueue::Options o;
+        o.capacity = capacity;
+        o.batch = batch;
+        o.flush = 10ms;
+        o.policy = policy;
+        return o;
+    }
+
+    /// Records every batch it is handed.
+    struct Sink {
+        std::mutex mutex;
+        std::vector<std::vector<std::string>> batches;
+
+        LogQueue::Writer writer() {
+            return [this](std::vector<LogQueue::Entry> &batch) {
+                std::vector<std::string> messages;
+                for (const auto &e: batch) messages.push_back(e.message);
+                std::lock_guard lock(mutex);
+                batches.push_back(std::move(messages));
+            };
+        }
+
+        std::vector<std::string> messages() {
+            std::lock_guard lock(mutex);
+            std::vector<std::string> all;
+            for (const auto &b: batches) all.insert(all.end(), b.begin(), b.end());
+            return all;
+        }
+    };
+}
+
+TEST(LogQueue, DrainWritesInBatchesInOrder) {
+    Sink sink;
+    LogQueue queue(sink.writer(), options(16, 3));
+    for (int i = 0; i < 7; ++i) EXPECT_TRUE(queue.push(entry(std::to_string(i))));
+
+    EXPECT_EQ(queue.drain(), 3u);
+    EXPECT_EQ(queue.drain(), 3u);
+    EXPECT_EQ(queue.drain(), 1u);
+    EXPECT_EQ(queue.drain(), 0u);
+
+    ASSERT_EQ(sink.batches.size(), 3u);
+    EXPECT_EQ(sink.messages(), (std::vector<std::string>{"0", "1", "2", "3", "4", "5", "6"}));
+    const auto s = queue.stats();
+    EXPECT_EQ(s.written, 7u);
+    EXPECT_EQ(s.batches, 3u);
+    EXPECT_EQ(s.queued, 0u);
+}
+
+TEST(LogQueue, DropNewestKeepsQueuedEntries) {
+    Sink sink;
+    LogQueue queue(sink.writer(), options(4, 10));
+    for (int i = 0; i < 6; ++i) queue.push(entry(std::to_string(i)));
+
+    EXPECT_EQ(queue.stats().dropped, 2u);
+    queue.flush();
+    EXPECT_EQ(sink.messages(), (std::vector<std::string>{"0", "1", "2", "3"}));
+}
+
+TEST(LogQueue, DropOldestKeepsLatestEntries) {
+    Sink sink;
+    LogQueue queue(sink.writer(), options(4, 10, LogQueue::Policy::DropOldest));
+    for (int i = 0; i < 6; ++i) queue.push(entry(std::to_string(i)));
+
+    EXPECT_EQ(queue.stats().dropped, 2u);
+    queue.flush();
+    EXPECT_EQ(sink.messages(), (std::vector<std::string>{"2", "3", "4", "5"}));
+}
+
+TEST(LogQueue, BlockWithoutWriterThreadDrainsInline) {
+    Sink sink;
+    LogQueue queue(sink.writer(), options(2, 2, LogQueue::Policy::Block));
+    for (int i = 0; i < 5; ++i) EXPECT_TRUE(queue.push(entry(std::to_string(i))));
+    queue.flush();
+
+    EXPECT_EQ(queue.stats().dropped, 0u);
+    EXPECT_EQ(sink.messages().size(), 5u);
+}
+
+TEST(LogQueue, FailedBatchesAreCounted) {
+    LogQueue queue([](auto &) { throw std::runtime_error("disk full"); }, options(8, 4));
+    for (int i = 0; i < 3; ++i) queue.push(entry("x"));
+    queue.flush();
+
+    const auto s = queue.stats();
+    EXPECT_EQ(s.failed, 3u);
+    EXPECT_EQ(s.written, 0u);
+}
+
+TEST(LogQueue, WriterThreadFlushesAndStopWritesTheRest) {
+    Sink sink;
+    {
+        LogQueue queue(sink.writer(), options(1024, 64, LogQueue::Policy::Block));
+        queue.start();
+
+        std::vector<std::thread> producers;
+        for (int t = 0; t < 4; ++t)
+            producers.emplace_back([&queue, t] {
+                for (int i = 0; i < 500; ++i) queue.push(entry(std::to_string(t)));
+            });
+        for (auto &p: producers) p.join();
+        queue.stop();
+
+        EXPECT_EQ(queue.stats().written, 2000u);
+        EXPECT_EQ(queue.stats().dropped, 0u);
+    }
+    EXPECT_EQ(sink.messages().size(), 2000u);
+    for (const auto &batch: sink.batches) EXPECT_LE(batch.size(), 64u);
+}
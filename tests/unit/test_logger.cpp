@@ -0,0 +1,31 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/logger/logger.h"
+
+#include <cstdlib>
+
+using mb::Logger;
+
+TEST(Logger, ConsoleOptionsFromEnv) {
+    const auto defaults = Logger::ConsoleOptions::fromEnv();
+    EXPECT_TRUE(defaults.async);
+    EXPECT_EQ(defaults.queueSize, 8192u);
+    EXPECT_EQ(defaults.overflow, spdlog::async_overflow_policy::block);
+    EXPECT_FALSE(defaults.json);
+
+    setenv("MB_LOG_CONSOLE_QUEUE_SIZE", "1024", 1);
+    setenv("MB_LOG_CONSOLE_POLICY", "drop_oldest", 1);
+    setenv("MB_LOG_FORMAT", "json", 1);
+    const auto options = Logger::ConsoleOptions::fromEnv();
+    EXPECT_EQ(options.queueSize, 1024u);
+    EXPECT_EQ(options.overflow, spdlog::async_overflow_policy::overrun_oldest);
+    EXPECT_TRUE(options.json);
+
+    setenv("MB_LOG_CONSOLE_ASYNC", "0", 1);
+    setenv("MB_LOG_CONSOLE_POLICY", "drop_newest", 1);
+    const auto sync = Logger::ConsoleOptions::fromEnv();
+    EXPECT_FALSE(sync.async);
+    EXPECT_EQ(sync.overflow, spdlog::async_overflow_policy::discard_new);
+
+    for (const auto *name: {"MB_LOG_CONSOLE_ASYNC", "MB_LOG_CONSOLE_QUEUE_SIZE", "MB_LOG_CONSOLE_POLICY", "MB_LOG_FORMAT"})
+        unsetenv(name);
+}
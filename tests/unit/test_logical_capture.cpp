@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/logical_capture.h"
+
+#include <cstdlib>
+
+using mb::LogicalCapture;
+using Kind = LogicalCapture::Change::Kind;
+
+TEST(LogicalCapture, OptionsFromEnv) {
+    unsetenv("MB_PG_CAPTURE");
+    unsetenv("MB_PG_SLOT");
+    unsetenv("MB_PG_CAPTURE_POLL_MS");
+    auto options = LogicalCapture::Options::fromEnv();
+    EXPECT_FALSE(options.logical);
+    EXPECT_EQ(options.slot, "mb_rt");
+    EXPECT_EQ(options.poll, std::chrono::milliseconds(200));
+
+    setenv("MB_PG_CAPTURE", "Logical", 1);
+    setenv("MB_PG_SLOT", "Node_2", 1);
+    setenv("MB_PG_CAPTURE_POLL_MS", "50", 1);
+    options = LogicalCapture::Options::fromEnv();
+    EXPECT_TRUE(options.logical);
+    EXPECT_EQ(options.slot, "node_2");
+    EXPECT_EQ(options.poll, std::chrono::milliseconds(50));
+
+    // PostgreSQL would refuse to create it
+    setenv("MB_PG_SLOT", "node-2", 1);
+    EXPECT_EQ(LogicalCapture::Options::fromEnv().slot, "mb_rt");
+
+    unsetenv("MB_PG_CAPTURE");
+    unsetenv("MB_PG_SLOT");
+    unsetenv("MB_PG_CAPTURE_POLL_MS");
+}
+
+TEST(LogicalCapture, DecodesInsertsAsTheTriggerSendsThem) {
+    const auto change = LogicalCapture::decode(R"({"action":"I","xid":7,"schema":"public","table":"posts",
+        "columns":[{"name":"id","type":"text","value":"a"},{"name":"views","type":"integer","value":3},
+                   {"name":"meta","type":"jsonb","value":"{\"k\": [1, 2]}"},
+                   {"name":"cover","type":"bytea","value":"\\x00ff"}]})");
+    ASSERT_TRUE(change);
+    EXPECT_EQ(change->kind, Kind::Row);
+    EXPECT_EQ(change->xid, 7u);
+    EXPECT_EQ(change->schema, "public");
+    EXPECT_EQ(change->table, "posts");
+
+    const auto &event = change->event;
+    EXPECT_EQ(event["type"], "INSERT");
+    EXPECT_EQ(event["entity"], "posts");
+    EXPECT_EQ(event["row_id"], "a");
+    EXPECT_TRUE(event["old_data"].is_null());
+    EXPECT_EQ(event["new_data"], (mb::json{{"id", "a"}, {"views", 3}, {"meta", {{"k", {1, 2}}}}}));
+}
+
+TEST(LogicalCapture, UpdatesFillUnchangedToastedColumnsFromTheOldRow) {
+    const auto change = LogicalCapture::decode(R"({"action":"U","xid":8,"schema":"public","table":"posts",
+        "columns":[{"name":"id","type":"text","value":"a"},{"name":"views","type":"integer","value":4}],
+        "identity":[{"name":"id","type":"text","value":"a"},{"name":"views","type":"integer","value":3},
+                    {"name":"body","type":"text","value":"long"}]})");
+    ASSERT_TRUE(change);
+    const auto &event = change->event;
+    EXPECT_EQ(event["type"], "UPDATE");
+    EXPECT_EQ(event["old_data"]["views"], 3);
+    EXPECT_EQ(event["new_data"]["views"], 4);
+    EXPECT_EQ(event["new_data"]["body"], "long");
+}
+
+TEST(LogicalCapture, DeletesCarryTheOldRowAndItsId) {
+    const auto change = LogicalCapture::decode(R"({"action":"D","xid":9,"schema":"public","table":"notes",
+        "identity":[{"name":"id","type":"bigint","value":42},{"name":"title","type":"text","value":null}]})");
+    ASSERT_TRUE(change);
+    const auto &event = change->event;
+    EXPECT_EQ(event["type"], "DELETE");
+    EXPECT_EQ(event["row_id"], "42");
+    EXPECT_TRUE(event["new_data"].is_null());
+    EXPECT_TRUE(event["old_data"]["title"].is_null());
+}
+
+TEST(LogicalCapture, ReadsMuteMessagesAndSkipsEverythingElse) {
+    const auto mute = LogicalCapture::decode(
+        R"({"action":"M","xid":10,"transactional":true,"prefix":"mb_mute","content":"Posts"})");
+    ASSERT_TRUE(mute);
+    EXPECT_EQ(mute->kind, Kind::Mute);
+    EXPECT_EQ(mute->xid, 10u);
+    EXPECT_EQ(mute->table, "posts");
+    EXPECT_TRUE(mute->event.is_null());
+
+    const auto unmute = LogicalCapture::decode(
+        R"({"action":"M","xid":10,"transactional":true,"prefix":"mb_unmute","content":"posts"})");
+    ASSERT_TRUE(unmute);
+    EXPECT_EQ(unmute->kind, Kind::Unmute);
+
+    EXPECT_FALSE(LogicalCapture::decode(R"({"action":"M","transactional":false,"prefix":"other","content":"x"})"));
+    EXPECT_FALSE(LogicalCapture::decode(R"({"action":"B","xid":11})"));
+    EXPECT_FALSE(LogicalCapture::decode(R"({"action":"C","xid":11})"));
+    EXPECT_FALSE(LogicalCapture::decode(R"({"action":"T","xid":12,"schema":"public","table":"posts"})"));
+    EXPECT_FALSE(LogicalCapture::decode("not json"));
+}
@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/database.h"
+#include "mantisbase/core/materialized_views.h"
+#include "mantisbase/core/models/entity.h"
+#include "mantisbase/core/models/entity_schema.h"
+#include "mantisbase/core/models/entity_schema_field.h"
+#include "mantisbase/mantisbase.h"
+#include "../common/test_environment.h"
+
+#include <soci/soci.h>
+
+using mb::MaterializedViews;
+using namespace std::chrono_literals;
+
+class MaterializedViewsTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        auto &app = mb::MantisBase::instance();
+        source = std::make_unique<mb::EntitySchema>(app, "mv_source", "base");
+        source->addField(mb::EntitySchemaField("title", "string"));
+        source->addField(mb::EntitySchemaField("status", "string"));
+        if (!mb::EntitySchema::tableExists(*source)) mb::EntitySchema::createTable(*source);
+    }
+
+    void TearDown() override {
+        if (published && mb::EntitySchema::tableExists(*published)) mb::EntitySchema::dropTable(*published);
+        if (totals && mb::EntitySchema::tableExists(*totals)) mb::EntitySchema::dropTable(*totals);
+        mb::EntitySchema::dropTable(*source);
+    }
+
+    /// Published rows, one per source row, refreshed by id
+    void createPublished() {
+        published = std::make_unique<mb::EntitySchema>(mb::MantisBase::instance(), "mv_published", "view");
+        published->setViewQuery("SELECT id, title FROM mv_source WHERE status = 'published'");
+        published->setMaterialization({.enabled = true, .refreshKey = "id", .sources = {"mv_source"}});
+        mb::EntitySchema::createTable(*published);
+    }
+
+    /// Rows per status, rebuilt in full
+    void createTotals() {
+        totals = std::make_unique<mb::EntitySchema>(mb::MantisBase::instance(), "mv_totals", "view");
+        totals->setViewQuery("SELECT status, COUNT(*) AS total FROM mv_source GROUP BY status");
+        totals->setMaterialization({.enabled = true});
+        mb::EntitySchema::createTable(*totals);
+    }
+
+    static nlohmann::json changed(const std::string &id) {
+        return {{"type", "update"}, {"entity", "mv_source"}, {"row_id", id}};
+    }
+
+    static int rows(const std::string &sql_query) {
+        const auto sql = mb::MantisBase::instance().db().session();
+        int n = 0;
+        *sql << sql_query, soci::into(n);
+        return n;
+    }
+
+    std::unique_ptr<mb::EntitySchema> source, published, totals;
+};
+
+TEST_F(MaterializedViewsTest, RefreshesChangedIdsOnly) {
+    const auto records = source->toEntity();
+    const auto a = records.create({{"title", "a"}, {"status", "published"}});
+    const auto b = records.create({{"title", "b"}, {"status", "published"}});
+    createPublished();
+    EXPECT_EQ(rows("SELECT COUNT(*) FROM mv_published"), 2);
+
+    MaterializedViews views({.debounce = 0ms});
+    views.track(published->toJSON());
+
+    // Unpublished, retitled, and a new one: none of it visible until a refresh
+    (void) records.update(a["id"].get<std::string>(), {{"status", "draft"}});
+    (void) records.update(b["id"].get<std::string>(), {{"title", "b2"}});
+    const auto c = records.create({{"title", "c"}, {"status", "published"}});
+    EXPECT_EQ(rows("SELECT COUNT(*) FROM mv_published"), 2);
+
+    views.onChanges(nlohmann::json::array({changed(a["id"]), changed(b["id"]), changed(c["id"])}));
+    views.step();
+    EXPECT_EQ(views.incrementalRefreshes(), 1u);
+    EXPECT_EQ(views.fullRefreshes(), 0u);
+    EXPECT_EQ(rows("SELECT COUNT(*) FROM mv_published"), 2);
+    EXPECT_EQ(rows("SELECT COUNT(*) FROM mv_published WHERE title = 'b2'"), 1);
+
+    // Other entities' changes and an empty queue refresh nothing
+    views.onChanges(nlohmann::json::array({{{"type", "insert"}, {"entity", "mv_other"}, {"row_id", "x"}}}));
+    EXPECT_EQ(views.step(), MaterializedViews::Clock::time_point::max());
+    EXPECT_EQ(views.incrementalRefreshes() + views.fullRefreshes(), 1u);
+}
+
+TEST_F(MaterializedViewsTest, RebuildsUnkeyedViewsInFull) {
+    const auto records = source->toEntity();
+    (void) records.create({{"title", "a"}, {"status", "published"}});
+    createTotals();
+
+    MaterializedViews views({.debounce = 0ms});
+    views.track(totals->toJSON());
+
+    const auto b = records.create({{"title", "b"}, {"status", "draft"}});
+    views.onChanges(nlohmann::json::array({changed(b["id"])}));
+    views.step();
+    EXPECT_EQ(views.fullRefreshes(), 1u);
+    EXPECT_EQ(rows("SELECT COUNT(*) FROM mv_totals"), 2);
+    EXPECT_EQ(rows("SELECT total FROM mv_totals WHERE status = 'draft'"), 1);
+}
+
+TEST_F(MaterializedViewsTest, RefreshesOnDemandAndAfterTheDebounce) {
+    createPublished();
+    MaterializedViews views({.debounce = 1h});
+    EXPECT_THROW(views.refresh("mv_published"), mb::MantisException);
+    views.track(published->toJSON());
+
+    const auto records = source->toEntity();
+    const auto a = records.create({{"title", "a"}, {"status", "published"}});
+    views.onChanges(nlohmann::json::array({changed(a["id"])}));
+
+    // Queued, not due yet
+    const auto next = views.step();
+    EXPECT_GT(next, MaterializedViews::Clock::now() + 30min);
+    EXPECT_EQ(rows("SELECT COUNT(*) FROM mv_published"), 0);
+
+    views.refresh("mv_published");
+    EXPECT_EQ(views.fullRefreshes(), 1u);
+    EXPECT_EQ(rows("SELECT COUNT(*) FROM mv_published"), 1);
+
+    views.untrack("mv_published");
+    EXPECT_THROW(views.refresh("mv_published"), mb::MantisException);
+}
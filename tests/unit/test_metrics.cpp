@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/metrics.h"
+
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+using mb::LatencyHistogram;
+using mb::Metrics;
+using mb::MetricsWriter;
+using mb::ShardedCounter;
+
+TEST(Metrics, CounterSumsAcrossThreads) {
+    ShardedCounter counter;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t)
+        threads.emplace_back([&] { for (int i = 0; i < 10000; ++i) counter.add(); });
+    for (auto &t: threads) t.join();
+    EXPECT_EQ(counter.value(), 80000u);
+}
+
+TEST(Metrics, HistogramBucketsAreUpperBounds) {
+    EXPECT_EQ(LatencyHistogram::bucketFor(0ns), 0u);
+    EXPECT_EQ(LatencyHistogram::bucketFor(1ms), 0u);
+    EXPECT_EQ(LatencyHistogram::bucketFor(1001us), 1u);
+    EXPECT_EQ(LatencyHistogram::bucketFor(5s), LatencyHistogram::BUCKETS.size() - 1);
+    EXPECT_EQ(LatencyHistogram::bucketFor(6s), LatencyHistogram::BUCKETS.size());
+
+    LatencyHistogram h;
+    h.observe(500us);
+    h.observe(20ms);
+    h.observe(10s);
+    const auto s = h.snapshot();
+    EXPECT_EQ(s.count, 3u);
+    EXPECT_EQ(s.counts[0], 1u);
+    EXPECT_EQ(s.counts[4], 1u);
+    EXPECT_EQ(s.counts.back(), 1u);
+    EXPECT_NEAR(s.sum, 10.0205, 1e-9);
+}
+
+TEST(Metrics, WritesCumulativeHistogram) {
+    MetricsWriter out;
+    const std::array<double, 2> bounds = {0.1, 1};
+    const std::array<std::uint64_t, 3> counts = {2, 0, 1};
+    out.family("x_seconds", "Example", "histogram");
+    out.histogram("x_seconds", {{"route", "/a"}}, bounds, counts, 3.5);
+    EXPECT_EQ(out.str(),
+              "# HELP x_seconds Example\n"
+              "# TYPE x_seconds histogram\n"
+              "x_seconds_bucket{route=\"/a\",le=\"0.1\"} 2\n"
+              "x_seconds_bucket{route=\"/a\",le=\"1\"} 2\n"
+              "x_seconds_bucket{route=\"/a\",le=\"+Inf\"} 3\n"
+              "x_seconds_sum{route=\"/a\"} 3.5\n"
+              "x_seconds_count{route=\"/a\"} 3\n");
+}
+
+TEST(Metrics, EscapesLabelValues) {
+    EXPECT_EQ(MetricsWriter::escape("a\"b\\c\nd"), "a\\\"b\\\\c\\nd");
+
+    MetricsWriter out;
+    out.sample("up", {}, 1);
+    EXPECT_EQ(out.str(), "up 1\n");
+}
+
+TEST(Metrics, RoutesAreRegisteredOnce) {
+    Metrics metrics;
+    auto &a = metrics.route("GET", "/api/v1/entities/:entity_name");
+    auto &b = metrics.route("GET", "/api/v1/entities/:entity_name");
+    auto &c = metrics.route("POST", "/api/v1/entities/:entity_name");
+    EXPECT_EQ(&a, &b);
+    EXPECT_NE(&a, &c);
+
+    Metrics::recordRequest(a, 200, 2ms);
+    Metrics::recordRequest(a, 404, 2ms);
+    Metrics::recordRequest(metrics.unmatched(), 404, 2ms);
+
+    MetricsWriter out;
+    metrics.writeRequests(out);
+    const auto &text = out.str();
+    EXPECT_NE(text.find("mb_http_requests_total{method=\"GET\",route=\"/api/v1/entities/:entity_name\",status=\"2xx\"} 1"),
+              std::string::npos);
+    EXPECT_NE(text.find("mb_http_requests_total{method=\"\",route=\"unmatched\",status=\"4xx\"} 1"),
+              std::string::npos);
+    // Routes without traffic are left out
+    EXPECT_EQ(text.find("method=\"POST\""), std::string::npos);
+}
+
+TEST(Metrics, RecordsScriptDurations) {
+    Metrics metrics;
+    metrics.recordScript("index.mantis.js", 3ms);
+    metrics.recordScript("index.mantis.js", 30ms);
+    metrics.recordScriptTimeout("beforeRecordCreate");
+
+    MetricsWriter out;
+    metrics.writeScripts(out);
+    EXPECT_NE(out.str().find("mb_script_duration_seconds_count{hook=\"index.mantis.js\"} 2"), std::string::npos);
+    EXPECT_NE(out.str().find("mb_script_timeouts_total{hook=\"beforeRecordCreate\"} 1"), std::string::npos);
+}
@@ -239,6 +239,41 @@ TEST(EntitySchema, ViewEntityType) {
     EXPECT_FALSE(j.contains("fields"));
 }
 
+TEST(EntitySchema, MaterializedViewOptions) {
+    auto schema = mb::EntitySchema::fromSchema({
+        {"name", "post_totals"},
+        {"type", "view"},
+        {"view_query", "SELECT id, title FROM posts"},
+        {"materialized", true},
+        {"refresh_key", "id"},
+        {"sources", {"posts"}}
+    });
+    EXPECT_TRUE(schema.materialization().enabled);
+    EXPECT_FALSE(schema.validate().has_value());
+
+    const auto j = schema.toJSON();
+    EXPECT_EQ(j["refresh_key"], "id");
+    EXPECT_EQ(j["refresh_interval"], 0);
+    EXPECT_EQ(j["sources"], (std::vector<std::string>{"posts"}));
+
+    // The table is filled from `<name>_mb_source`, and indexed on the key
+    const auto ddl = schema.materializedDDL();
+    ASSERT_EQ(ddl.size(), 2u);
+    EXPECT_NE(ddl[0].find("post_totals_mb_source"), std::string::npos);
+    EXPECT_NE(ddl[1].find("(id)"), std::string::npos);
+
+    // A key needs the one entity its ids come from
+    auto m = schema.materialization();
+    m.sources = {"posts", "users"};
+    schema.setMaterialization(m);
+    EXPECT_TRUE(schema.validate().has_value());
+
+    // Plain views stay plain
+    const auto plain = mb::EntitySchema::fromSchema({{"name", "v"}, {"type", "view"}, {"view_query", "SELECT 1"}});
+    EXPECT_FALSE(plain.toJSON().contains("materialized"));
+    EXPECT_TRUE(plain.materializedDDL().empty());
+}
+
 TEST(EntitySchema, ViewEntityRejectsFields) {
     const mb::EntitySchema view{"test_view", "view"};
     EXPECT_TRUE(view.fields().empty());
@@ -340,4 +375,222 @@ TEST(CursorPagination, PaginationOptsRoundTrip) {
     EXPECT_EQ(p["limit"].get<int>(), 25);
     EXPECT_EQ(p["after"].get<std::string>(), "uuid-abc-123");
     EXPECT_EQ(p["sort"].get<std::string>(), "-created");
-}
\ No newline at end of file
+}
+TEST(CursorPagination, CompositeCursorRoundTrip) {
+    mb::ListCursor cursor{"created", true, "2026-01-02T03:04:05Z", "abc-003"};
+    const auto encoded = cursor.encode();
+    EXPECT_EQ(encoded.find_first_of("+/="), std::string::npos);
+
+    const auto decoded = mb::ListCursor::decode(encoded);
+    ASSERT_TRUE(decoded.has_value());
+    EXPECT_EQ(decoded->field, "created");
+    EXPECT_TRUE(decoded->desc);
+    EXPECT_EQ(decoded->value, "2026-01-02T03:04:05Z");
+    EXPECT_EQ(decoded->id, "abc-003");
+
+    mb::ListCursor nulls{"score", false, nullptr, "abc-004"};
+    const auto decoded_nulls = mb::ListCursor::decode(nulls.encode());
+    ASSERT_TRUE(decoded_nulls.has_value());
+    EXPECT_TRUE(decoded_nulls->value.is_null());
+    EXPECT_FALSE(decoded_nulls->desc);
+}
+
+TEST(CursorPagination, BareIdIsNotACompositeCursor) {
+    EXPECT_FALSE(mb::ListCursor::decode("abc-003").has_value());
+    EXPECT_FALSE(mb::ListCursor::decode("").has_value());
+    // Valid base64url, but not a cursor object
+    EXPECT_FALSE(mb::ListCursor::decode("eyJmIjoxfQ").has_value());
+}
+
+TEST(EntityCache, SnapshotsAreSharedAndOutliveSchemaChanges) {
+    auto &app = mb::MantisBase::instance();
+    auto &router = app.router();
+    mb::EntitySchema schema{app, "snapshot_test", "base"};
+    router.addSchemaCache(schema.toJSON());
+
+    // Every lookup hands out the same cached object, not a copy
+    const auto first = app.entitySnapshot("snapshot_test");
+    EXPECT_EQ(first, app.entitySnapshot("snapshot_test"));
+
+    schema.addField(mb::EntitySchemaField("title", "string"));
+    router.updateSchemaCache("snapshot_test", schema.toJSON());
+    const auto second = app.entitySnapshot("snapshot_test");
+    EXPECT_NE(first, second);
+    EXPECT_TRUE(second->hasField("title"));
+
+    // A request holding the old snapshot keeps its schema
+    EXPECT_FALSE(first->hasField("title"));
+    EXPECT_EQ(first->name(), "snapshot_test");
+
+    router.removeSchemaCache("snapshot_test");
+    EXPECT_FALSE(app.hasEntity("snapshot_test"));
+    EXPECT_THROW((void) app.entitySnapshot("snapshot_test"), mb::MantisException);
+}
+
+TEST(EntityCache, SchemaChangesKeepCompiledFilters) {
+    auto &app = mb::MantisBase::instance();
+    auto &router = app.router();
+    mb::EntitySchema schema{app, "prewarm_test", "base"};
+    schema.addField(mb::EntitySchemaField("title", "string"));
+    schema.addField(mb::EntitySchemaField("views", "int"));
+    router.addSchemaCache(schema.toJSON());
+    (void) app.entitySnapshot("prewarm_test")->compileFilter("views > 10");
+    (void) app.entitySnapshot("prewarm_test")->compileFilter("title = 'a'");
+
+    // The replacement is warmed before the swap; filters on removed fields are dropped
+    schema.removeField("title");
+    router.updateSchemaCache("prewarm_test", schema.toJSON());
+    const auto entity = app.entitySnapshot("prewarm_test");
+    const auto compiled = entity->compileFilter("views > 10");
+    EXPECT_EQ(compiled.get(), entity->compileFilter("views > 10").get());
+    EXPECT_THROW((void) entity->compileFilter("title = 'a'"), mb::MantisException);
+
+    router.removeSchemaCache("prewarm_test");
+}
+
+TEST(EntityCache, FieldLookupsShareTheSchema) {
+    auto &app = mb::MantisBase::instance();
+    auto &router = app.router();
+    mb::EntitySchema schema{app, "lookup_test", "base"};
+    schema.addField(mb::EntitySchemaField("title", "string"));
+    schema.addField(mb::EntitySchemaField("score", "int").setPrecision(64));
+    router.addSchemaCache(schema.toJSON());
+    const auto entity = app.entitySnapshot("lookup_test");
+
+    // Looked up in place, not copied
+    const auto *title = entity->fieldDef("title");
+    ASSERT_NE(title, nullptr);
+    EXPECT_EQ(title, entity->fieldDef("title"));
+    EXPECT_EQ(title->at("type"), "string");
+    EXPECT_EQ(entity->fieldDef("missing"), nullptr);
+    EXPECT_TRUE(entity->hasField("score"));
+    EXPECT_FALSE(entity->hasField("missing"));
+    EXPECT_EQ(entity->findField("title"), *title);
+
+    // The codec holds the same fields, typed and in schema order
+    const auto &columns = entity->rowCodec().columns();
+    ASSERT_EQ(columns.size(), entity->fields().size());
+    EXPECT_EQ(columns.front().name, "id");
+    EXPECT_TRUE(columns.front().system);
+    const auto *score = entity->rowCodec().column("score");
+    ASSERT_NE(score, nullptr);
+    EXPECT_EQ(score->kind, mb::RowCodec::Kind::Int);
+    EXPECT_EQ(score->precision, 64);
+    EXPECT_FALSE(score->system);
+
+    router.removeSchemaCache("lookup_test");
+}
+
+TEST(EntityCache, RecommendsIndexesForFilteredPages) {
+    mb::EntitySchema schema{mb::MantisBase::instance(), "advice_test", "base"};
+    schema.addField(mb::EntitySchemaField("status", "string"));
+    schema.addField(mb::EntitySchemaField("views", "int"));
+    schema.addIndex({"idx_advice_test_status", false, {"status"}});
+    const auto entity = schema.toEntity();
+
+    const auto by_status = entity.compileFilter("status = 'draft'");
+    const auto by_views = entity.compileFilter("views > 10");
+
+    // Sorted by id, an index leading with `status` already serves the filter
+    EXPECT_FALSE(entity.listIndexRecommendation(by_status.get(), "id").has_value());
+    EXPECT_FALSE(entity.listIndexRecommendation(nullptr, "id").has_value());
+
+    const auto filtered = entity.listIndexRecommendation(by_status.get(), "views");
+    ASSERT_TRUE(filtered.has_value());
+    EXPECT_EQ(filtered->name, "idx_advice_test_status_views_id");
+    EXPECT_EQ(filtered->columns, (std::vector<std::string>{"status", "views", "id"}));
+
+    const auto ranged = entity.listIndexRecommendation(by_views.get(), "id");
+    ASSERT_TRUE(ranged.has_value());
+    EXPECT_EQ(ranged->columns, (std::vector<std::string>{"views", "id"}));
+}
+
+TEST(RowCodec, ParsesIsoDatesForBinding) {
+    std::tm tm{};
+    ASSERT_TRUE(mb::parseIsoDateTime("2026-03-14T10:07:09.123Z", tm));
+    EXPECT_EQ(tm.tm_year, 126);
+    EXPECT_EQ(tm.tm_mon, 2);
+    EXPECT_EQ(tm.tm_mday, 14);
+    EXPECT_EQ(tm.tm_hour, 10);
+    EXPECT_EQ(tm.tm_min, 7);
+    EXPECT_EQ(tm.tm_sec, 9);
+
+    ASSERT_TRUE(mb::parseIsoDateTime("2026-03-14 10:07", tm));
+    EXPECT_EQ(tm.tm_sec, 0);
+    ASSERT_TRUE(mb::parseIsoDateTime("2026-03-14", tm));
+    EXPECT_EQ(tm.tm_hour, 0);
+
+    for (const auto *bad: {"", "2026-3-14", "2026-13-01", "2026-03-14T1:00", "2026-03-14T10:07:x", "yesterday"})
+        EXPECT_FALSE(mb::parseIsoDateTime(bad, tm)) << bad;
+}
+
+TEST(RowCodec, FormatsPostgresTextParams) {
+    const mb::RowCodec codec({
+        {{"name", "title"}, {"type", "string"}},
+        {{"name", "score"}, {"type", "int"}, {"precision", 8}},
+        {{"name", "ratio"}, {"type", "double"}},
+        {{"name", "done"}, {"type", "bool"}},
+        {{"name", "meta"}, {"type", "json"}},
+        {{"name", "due"}, {"type", "date"}},
+        {{"name", "password"}, {"type", "string"}}
+    });
+
+    EXPECT_EQ(codec.text("title", "hello"), "hello");
+    EXPECT_EQ(codec.text("score", 300), "44");
+    EXPECT_EQ(codec.text("ratio", 0.5), "0.5");
+    EXPECT_EQ(codec.text("done", true), "1");
+    EXPECT_EQ(codec.text("meta", nlohmann::json{{"a", 1}}), R"({"a":1})");
+    EXPECT_EQ(codec.text("due", "2026-03-14T10:07:09Z"), "2026-03-14 10:07:09");
+    EXPECT_EQ(codec.text("password", "hash", false), "hash");
+
+    EXPECT_EQ(codec.text("title", nullptr), std::nullopt);
+    EXPECT_EQ(codec.text("due", ""), std::nullopt);
+    EXPECT_EQ(codec.text("missing", "x"), std::nullopt);
+    EXPECT_THROW((void) codec.text("due", "yesterday"), mb::MantisException);
+    EXPECT_THROW((void) codec.text("score", "ten"), nlohmann::json::type_error);
+}
+
+TEST(RowCodec, CompressesMarkedFieldsWhenAsked) {
+    const std::vector<nlohmann::json> fields = {
+        {{"name", "body"}, {"type", "string"}, {"compress", true}},
+        {{"name", "note"}, {"type", "string"}}
+    };
+    const std::string text(4096, 'a');
+    const nlohmann::json record = {{"body", text}, {"note", text}};
+
+    soci::values sqlite, postgres;
+    mb::RowCodec(fields, true).bind(sqlite, record);
+    mb::RowCodec(fields).bind(postgres, record);
+    EXPECT_EQ(mb::FieldCompression::compressed(sqlite.get<std::string>("body")), mb::FieldCompression::available());
+    EXPECT_EQ(mb::FieldCompression::inflate(sqlite.get<std::string>("body")), text);
+    EXPECT_EQ(sqlite.get<std::string>("note"), text);
+    EXPECT_EQ(postgres.get<std::string>("body"), text);
+    EXPECT_TRUE(mb::RowCodec(fields).column("body")->compress);
+}
+
+TEST(EntitySchema, CompressedFields) {
+    mb::EntitySchemaField field({{"name", "body"}, {"type", "json"}, {"compress", true}});
+    EXPECT_TRUE(field.compress());
+    EXPECT_EQ(field.toJSON()["compress"], true);
+    EXPECT_FALSE(field.validate().has_value());
+
+    EXPECT_TRUE(mb::EntitySchemaField({{"name", "n"}, {"type", "int"}, {"compress", true}}).validate().has_value());
+    EXPECT_TRUE(mb::EntitySchemaField({{"name", "s"}, {"type", "string"}, {"compress", true}, {"unique", true}})
+                    .validate().has_value());
+    EXPECT_THROW(mb::EntitySchemaField({{"name", "s"}, {"type", "string"}, {"compress", "yes"}}), mb::MantisException);
+}
+
+TEST(DateUtils, FormatsUtcTimestamps) {
+    // 2026-03-14T10:07:09Z, a Saturday
+    const auto tm = mb::toUtcTime(1773482829);
+    EXPECT_EQ(tm.tm_wday, 6);
+    EXPECT_EQ(tm.tm_yday, 72);
+    EXPECT_EQ(mb::tmToStr(tm), "2026-03-14 10:07:09");
+
+    char buffer[mb::kIsoDateTimeLength];
+    EXPECT_EQ(std::string_view(buffer, mb::formatIsoDateTime(tm, buffer, 'T')), "2026-03-14T10:07:09");
+
+    std::tm parsed{};
+    ASSERT_TRUE(mb::parseIsoDateTime(mb::currentTimestampUTC(), parsed));
+    EXPECT_EQ(mb::getCurrentTimestampUTC().size(), mb::kIsoDateTimeLength);
+}
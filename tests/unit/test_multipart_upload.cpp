@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/multipart_upload.h"
+#include "mantisbase/core/exceptions.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+using mb::MultipartUpload;
+
+namespace {
+    struct StagingDir {
+        fs::path path = fs::temp_directory_path() /
+                        (std::string("mb_upload_") + ::testing::UnitTest::GetInstance()->current_test_info()->name());
+
+        StagingDir() { fs::create_directories(path); }
+        ~StagingDir() { fs::remove_all(path); }
+
+        [[nodiscard]] std::size_t files() const {
+            return static_cast<std::size_t>(std::distance(fs::directory_iterator(path), fs::directory_iterator{}));
+        }
+    };
+
+    std::string readFile(const std::string &path) {
+        std::ifstream in(path, std::ios::binary);
+        std::stringstream ss;
+        ss << in.rdbuf();
+        return ss.str();
+    }
+
+    MultipartUpload::Limits limits(const std::size_t upload, const std::size_t file) {
+        MultipartUpload::Limits l;
+        l.maxUpload = upload;
+        l.maxFile = file;
+        return l;
+    }
+}
+
+TEST(MultipartUpload, StagesFilePartsAndKeepsFieldsInMemory) {
+    StagingDir dir;
+    std::vector<mb::FormDataItem> parts;
+    {
+        MultipartUpload upload(dir.path, {});
+        upload.beginPart("title", "", "");
+        upload.append("hello", 5);
+        upload.beginPart("doc", "a.txt", "text/plain");
+        upload.append("ab", 2);
+        upload.append("c", 1);
+        parts = upload.finish();
+        EXPECT_EQ(upload.bytes(), 8u);
+    }
+
+    ASSERT_EQ(parts.size(), 2u);
+    EXPECT_EQ(parts[0].content, "hello");
+    EXPECT_TRUE(parts[0].staged_path.empty());
+
+    const auto &doc = parts[1];
+    EXPECT_TRUE(doc.content.empty());
+    EXPECT_EQ(doc.size, 3u);
+    EXPECT_EQ(readFile(doc.staged_path), "abc");
+    EXPECT_EQ(doc.sha256, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+
+    // Handed over by finish(): the upload going away leaves the file
+    EXPECT_EQ(dir.files(), 1u);
+    MultipartUpload::discard(parts);
+    EXPECT_EQ(dir.files(), 0u);
+}
+
+TEST(MultipartUpload, EnforcesLimitsWhileStreaming) {
+    StagingDir dir;
+    {
+        MultipartUpload upload(dir.path, limits(100, 4));
+        upload.beginPart("doc", "a.bin", "");
+        upload.append("abcd", 4);
+        try {
+            upload.append("e", 1);
+            FAIL() << "file limit not enforced";
+        } catch (const mb::MantisException &e) {
+            EXPECT_EQ(e.code(), 413);
+        }
+    }
+    EXPECT_EQ(dir.files(), 0u);
+
+    MultipartUpload upload(dir.path, limits(6, 100));
+    upload.beginPart("a", "a.bin", "");
+    upload.append("abcd", 4);
+    upload.beginPart("b", "b.bin", "");
+    EXPECT_THROW(upload.append("xyz", 3), mb::MantisException);
+}
+
+TEST(MultipartUpload, RemovesStagedFilesNotHandedOver) {
+    StagingDir dir;
+    {
+        MultipartUpload upload(dir.path, {});
+        upload.beginPart("a", "a.bin", "");
+        upload.append("data", 4);
+        upload.beginPart("b", "b.bin", "");
+        EXPECT_EQ(dir.files(), 2u);
+    }
+    EXPECT_EQ(dir.files(), 0u);
+
+    MultipartUpload upload(dir.path, {});
+    upload.beginPart("a", "a.bin", "");
+    upload.abort();
+    EXPECT_EQ(dir.files(), 0u);
+    EXPECT_TRUE(upload.finish().empty());
+}
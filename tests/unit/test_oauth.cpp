@@ -2,6 +2,8 @@
 #include <soci/soci.h>
 #include "mantisbase/utils/crypto_utils.h"
 #include "mantisbase/core/oauth.h"
+#include "mantisbase/core/oauth_client.h"
+#include "mantisbase/core/exceptions.h"
 #include "mantisbase/mantisbase.h"
 #include "../common/test_environment.h"
 #include "../common/test_config.h"
@@ -154,3 +156,40 @@ TEST_F(OAuthTestFixture, AES256GCMDifferentCiphertexts) {
     EXPECT_EQ(mb::aes256GcmDecrypt(encrypted1, key), plaintext);
     EXPECT_EQ(mb::aes256GcmDecrypt(encrypted2, key), plaintext);
 }
+
+TEST(OAuthClient, SplitsProviderUrls) {
+    using mb::OAuthClient;
+    EXPECT_EQ(OAuthClient::splitUrl("https://accounts.google.com/.well-known/openid-configuration"),
+              std::make_pair(std::string("https://accounts.google.com"),
+                             std::string("/.well-known/openid-configuration")));
+    EXPECT_EQ(OAuthClient::splitUrl("http://localhost:8080"),
+              std::make_pair(std::string("http://localhost:8080"), std::string("/")));
+    EXPECT_EQ(OAuthClient::splitUrl("https://idp.test?tenant=a#frag").second, "/?tenant=a");
+    EXPECT_THROW(OAuthClient::splitUrl("ftp://idp.test/x"), mb::MantisException);
+    EXPECT_THROW(OAuthClient::splitUrl("https://"), mb::MantisException);
+}
+
+TEST(OAuthClient, ReadsCacheControlMaxAge) {
+    using mb::OAuthClient;
+    EXPECT_EQ(OAuthClient::maxAge("public, max-age=3600, must-revalidate"), std::chrono::seconds(3600));
+    EXPECT_EQ(OAuthClient::maxAge("no-store"), std::chrono::seconds(0));
+    EXPECT_FALSE(OAuthClient::maxAge("public").has_value());
+    EXPECT_FALSE(OAuthClient::maxAge("").has_value());
+}
+
+TEST(OAuthClient, ServesCachedDocumentsAndStaleOnesWhenTheProviderIsDown) {
+    mb::OAuthClient http({.documentTimeout = 2.0});
+    // Nothing listens on port 1, so any request made fails right away
+    const std::string fresh = "http://127.0.0.1:1/fresh", stale = "http://127.0.0.1:1/stale";
+
+    http.remember(fresh, {{"token_endpoint", "https://idp.test/token"}}, std::chrono::seconds(60));
+    EXPECT_EQ(http.document(fresh)["token_endpoint"], "https://idp.test/token");
+    EXPECT_EQ(http.clients(), 0u);
+
+    http.remember(stale, {{"issuer", "old"}}, std::chrono::seconds(0));
+    EXPECT_EQ(http.document(stale)["issuer"], "old");
+    EXPECT_EQ(http.clients(), 1u);
+
+    EXPECT_THROW(http.document("http://127.0.0.1:1/missing"), mb::MantisException);
+    EXPECT_EQ(http.clients(), 1u); // Same origin, same client
+}
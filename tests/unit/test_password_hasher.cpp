@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/exceptions.h"
+#include "mantisbase/core/password_hasher.h"
+#include "mantisbase/utils/utils.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using mb::PasswordHasher;
+
+TEST(PasswordHasher, RunsInlineWhileStopped) {
+    PasswordHasher hasher({.workers = 1, .maxQueued = 0});
+    const auto hash = hasher.hash("s3cret!");
+    EXPECT_TRUE(hasher.verify("s3cret!", hash));
+    EXPECT_FALSE(hasher.verify("wrong", hash));
+    EXPECT_EQ(hasher.inFlight(), 0u);
+}
+
+TEST(PasswordHasher, HashesOnItsWorkers) {
+    PasswordHasher hasher({.workers = 2, .maxQueued = 8});
+    hasher.start();
+
+    std::vector<std::thread> callers;
+    std::atomic<int> verified{0};
+    for (int i = 0; i < 4; ++i) {
+        callers.emplace_back([&, i] {
+            const auto password = "password-" + std::to_string(i);
+            if (hasher.verify(password, hasher.hash(password))) ++verified;
+        });
+    }
+    for (auto &t: callers) t.join();
+    hasher.stop();
+
+    EXPECT_EQ(verified.load(), 4);
+    EXPECT_EQ(hasher.inFlight(), 0u);
+    EXPECT_EQ(hasher.rejected(), 0u);
+}
+
+TEST(PasswordHasher, RefusesPastTheQueueLimit) {
+    PasswordHasher hasher({.workers = 1, .maxQueued = 0});
+    hasher.start();
+
+    std::thread busy([&] { (void) hasher.hash("keeps the only worker busy"); });
+    while (hasher.inFlight() == 0) std::this_thread::yield();
+
+    try {
+        (void) hasher.hash("one too many");
+        ADD_FAILURE() << "Expected a 429";
+    } catch (const mb::MantisException &e) {
+        EXPECT_EQ(e.code(), 429);
+    }
+    busy.join();
+    hasher.stop();
+    EXPECT_EQ(hasher.rejected(), 1u);
+}
+
+TEST(PasswordHasher, BacksThePasswordUtils) {
+    // The shared pool isn't started outside the server: same results, inline
+    const auto hash = mb::hashPassword("s3cret!");
+    EXPECT_TRUE(mb::verifyPassword("s3cret!", hash));
+}
+
+TEST(PasswordHasher, CalibratesWithinBounds) {
+    // Any machine hashes faster than this allows; the floor holds
+    PasswordHasher fast({.target = std::chrono::milliseconds(1)});
+    fast.calibrate();
+    EXPECT_EQ(fast.bcryptCost(), PasswordHasher::MIN_BCRYPT_COST);
+
+    // A fixed cost is left alone
+    PasswordHasher fixed({.bcryptCost = 11});
+    fixed.calibrate();
+    EXPECT_EQ(fixed.bcryptCost(), 11u);
+}
+
+TEST(PasswordHasher, FlagsHashesWithOtherParameters) {
+    PasswordHasher current({.bcryptCost = 10});
+    PasswordHasher stronger({.bcryptCost = 11});
+
+    const auto hash = current.hash("s3cret!");
+    EXPECT_TRUE(hash.starts_with("$2b$10$"));
+    EXPECT_FALSE(current.needsRehash(hash));
+    EXPECT_TRUE(stronger.needsRehash(hash));
+    EXPECT_TRUE(stronger.verify("s3cret!", hash));   // still verifies meanwhile
+
+    EXPECT_FALSE(current.needsRehash("not a hash"));
+    EXPECT_TRUE(current.needsRehash("$argon2id$v=19$m=19456,t=2,p=1$c2FsdA$aGFzaA"));  // back to bcrypt
+
+    // Nothing queued while stopped
+    stronger.rehashLater("users", "id", "s3cret!", hash);
+    EXPECT_EQ(stronger.inFlight(), 0u);
+    EXPECT_EQ(stronger.rehashed(), 0u);
+}
@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/pool_metrics.h"
+
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+using mb::PoolMetrics;
+
+TEST(PoolMetrics, WaitsLandInTheirBucket) {
+    EXPECT_EQ(PoolMetrics::bucketFor(0ns), 0u);
+    EXPECT_EQ(PoolMetrics::bucketFor(100us), 0u);
+    EXPECT_EQ(PoolMetrics::bucketFor(101us), 1u);
+    EXPECT_EQ(PoolMetrics::bucketFor(3ms), 2u);
+    EXPECT_EQ(PoolMetrics::bucketFor(1s), PoolMetrics::WAIT_BUCKETS.size() - 1);
+    EXPECT_EQ(PoolMetrics::bucketFor(5s), PoolMetrics::WAIT_BUCKETS.size());
+}
+
+TEST(PoolMetrics, TracksLeasesInUseAndWaits) {
+    PoolMetrics m;
+    m.recordAcquire(50us);
+    m.recordAcquire(20ms);
+    m.recordAcquire(2s);
+    m.recordRelease();
+
+    auto s = m.snapshot();
+    EXPECT_EQ(s.acquired, 3u);
+    EXPECT_EQ(s.inUse, 2);
+    EXPECT_EQ(s.maxInUse, 3);
+    EXPECT_DOUBLE_EQ(s.maxWaitMs, 2000.0);
+    EXPECT_NEAR(s.totalWaitMs, 2020.05, 1e-6);
+    EXPECT_EQ(s.waitBuckets[0], 1u);
+    EXPECT_EQ(s.waitBuckets[4], 1u);
+    EXPECT_EQ(s.waitBuckets.back(), 1u);
+
+    m.recordRelease();
+    m.recordRelease();
+    EXPECT_EQ(m.snapshot().inUse, 0);
+    EXPECT_EQ(m.snapshot().maxInUse, 3);
+}
+
+TEST(PoolMetrics, TimeoutsCountTowardMaxWaitOnly) {
+    PoolMetrics m;
+    m.recordAcquire(1ms);
+    m.recordTimeout(5s);
+
+    const auto s = m.snapshot();
+    EXPECT_EQ(s.acquired, 1u);
+    EXPECT_EQ(s.timeouts, 1u);
+    EXPECT_EQ(s.inUse, 1);
+    EXPECT_DOUBLE_EQ(s.maxWaitMs, 5000.0);
+    EXPECT_DOUBLE_EQ(s.totalWaitMs, 1.0);
+    EXPECT_EQ(s.waitBuckets.back(), 0u);
+}
+
+TEST(PoolMetrics, OpenGaugeSeparatesStartupFromGrowth) {
+    PoolMetrics m;
+    m.recordOpen(4, false);
+    m.recordOpen();
+    m.recordOpen();
+    m.recordClose();
+
+    const auto s = m.snapshot();
+    EXPECT_EQ(s.open, 5);
+    EXPECT_EQ(s.opened, 2u);
+    EXPECT_EQ(s.closed, 1u);
+}
+
+TEST(PoolMetrics, ConcurrentLeasesBalance) {
+    PoolMetrics m;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t)
+        threads.emplace_back([&] {
+            for (int i = 0; i < 1000; ++i) {
+                m.recordAcquire(std::chrono::microseconds(i));
+                m.recordRelease();
+            }
+        });
+    for (auto &t: threads) t.join();
+
+    const auto s = m.snapshot();
+    EXPECT_EQ(s.acquired, 8000u);
+    EXPECT_EQ(s.inUse, 0);
+    EXPECT_LE(s.maxInUse, 8);
+    EXPECT_GE(s.maxInUse, 1);
+}
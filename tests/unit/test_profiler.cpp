@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/profiler.h"
+#include "mantisbase/core/exceptions.h"
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+using namespace std::chrono_literals;
+using mb::Profiler;
+
+TEST(Profiler, SamplesBusyThreads) {
+    if (!Profiler::supported()) GTEST_SKIP() << "No profiler on this platform";
+
+    std::atomic<bool> done{false};
+    std::thread busy([&] {
+        volatile double x = 0;
+        while (!done.load(std::memory_order_relaxed)) x = x + 1.5;
+    });
+    const auto profile = Profiler::collect(500ms, 200);
+    done = true;
+    busy.join();
+
+    EXPECT_GT(profile.samples, 20u);
+    EXPECT_EQ(profile.period, 5000us);
+    EXPECT_FALSE(profile.stacks.empty());
+
+    const auto summary = Profiler::summary(profile, 5);
+    EXPECT_EQ(summary["samples"], profile.samples);
+    EXPECT_LE(summary["functions"].size(), 5u);
+}
+
+TEST(Profiler, WritesThePprofFormat) {
+    Profiler::Profile profile;
+    profile.period = 10000us;
+    int a = 0, b = 0;
+    profile.stacks[{&a, &b}] = 3;
+    profile.samples = 3;
+
+    const auto out = Profiler::toPprof(profile);
+    std::vector<std::uintptr_t> words(11);
+    ASSERT_GE(out.size(), words.size() * sizeof(std::uintptr_t));
+    std::memcpy(words.data(), out.data(), words.size() * sizeof(std::uintptr_t));
+    const std::vector<std::uintptr_t> expected = {
+        0, 3, 0, 10000, 0,                                                                    // header
+        3, 2, reinterpret_cast<std::uintptr_t>(&a), reinterpret_cast<std::uintptr_t>(&b), // one stack
+        0, 1                                                                                  // trailer
+    };
+    EXPECT_EQ(words, expected);
+}
+
+TEST(Profiler, OneProfileAtATime) {
+    if (!Profiler::supported()) GTEST_SKIP() << "No profiler on this platform";
+
+    std::thread first([] { (void) Profiler::collect(300ms); });
+    std::this_thread::sleep_for(50ms);
+    EXPECT_THROW((void) Profiler::collect(10ms), mb::MantisException);
+    first.join();
+
+    EXPECT_TRUE(Profiler::allocatorStats().contains("rss"));
+}
@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <map>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "mantisbase/core/rate_limiter.h"
+
+using namespace std::chrono_literals;
+using Clock = mb::RateLimiter::Clock;
+
+TEST(RateLimiter, AllowsTheBurstThenDenies) {
+    mb::RateLimiter limiter(5, 60s);
+    const auto now = Clock::now();
+
+    for (int i = 0; i < 5; ++i) {
+        const auto d = limiter.acquire("1.2.3.4", now);
+        EXPECT_TRUE(d.allowed);
+        EXPECT_EQ(d.remaining, 4 - i);
+    }
+
+    const auto denied = limiter.acquire("1.2.3.4", now);
+    EXPECT_FALSE(denied.allowed);
+    EXPECT_EQ(denied.remaining, 0);
+    EXPECT_EQ(denied.retryAfter, 12s);   // One request's worth of the window
+    EXPECT_EQ(denied.reset, 60s);
+}
+
+TEST(RateLimiter, RefillsEvenlyOverTheWindow) {
+    mb::RateLimiter limiter(5, 60s);
+    const auto now = Clock::now();
+    for (int i = 0; i < 5; ++i) ASSERT_TRUE(limiter.acquire("k", now).allowed);
+
+    EXPECT_FALSE(limiter.acquire("k", now + 11s).allowed);
+    EXPECT_TRUE(limiter.acquire("k", now + 12s).allowed);
+    EXPECT_FALSE(limiter.acquire("k", now + 12s).allowed);
+
+    // A full window later the whole burst is back
+    EXPECT_EQ(limiter.acquire("k", now + 120s).remaining, 4);
+}
+
+TEST(RateLimiter, KeysHaveTheirOwnBudget) {
+    mb::RateLimiter limiter(1, 10s);
+    const auto now = Clock::now();
+    EXPECT_TRUE(limiter.acquire("a", now).allowed);
+    EXPECT_FALSE(limiter.acquire("a", now).allowed);
+    EXPECT_TRUE(limiter.acquire("b", now).allowed);
+}
+
+TEST(RateLimiter, EvictsKeysWithAFullBucket) {
+    mb::RateLimiter limiter(2, 10s);
+    const auto now = Clock::now();
+    limiter.acquire("a", now);
+    limiter.acquire("b", now);
+    limiter.acquire("b", now + 4s);
+    EXPECT_EQ(limiter.size(), 2u);
+
+    // "a" is full again after 5s, "b" after 14s
+    EXPECT_EQ(limiter.evictIdle(now + 6s), 1u);
+    EXPECT_EQ(limiter.size(), 1u);
+    EXPECT_EQ(limiter.evictIdle(now + 14s), 1u);
+    EXPECT_EQ(limiter.size(), 0u);
+}
+
+TEST(RateLimiter, ConcurrentRequestsNeverExceedTheLimit) {
+    mb::RateLimiter limiter(100, 3600s);
+    const auto now = Clock::now();
+    std::atomic<int> allowed{0};
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 50; ++i)
+                if (limiter.acquire("shared", now).allowed) ++allowed;
+        });
+    }
+    for (auto &thread: threads) thread.join();
+
+    EXPECT_EQ(allowed.load(), 100);
+}
+
+TEST(RateLimiter, CreateRegistersWithTheSweep) {
+    const auto limiter = mb::RateLimiter::create(3, 60s);
+    EXPECT_EQ(limiter->limit(), 3);
+    EXPECT_EQ(limiter->window(), 60s);
+    EXPECT_TRUE(limiter->acquire("x").allowed);
+}
+
+namespace {
+    /// What the database does, in memory, on a fixed clock
+    class FakeStore : public mb::RateLimitStore {
+    public:
+        std::optional<Step> step(const std::string &key, const std::int64_t interval,
+                                 const std::int64_t tolerance) override {
+            if (down) return std::nullopt;
+            keys.insert(key);
+            auto &tat = tats.try_emplace(key, now).first->second;
+            const auto base = std::max(tat, now);
+            if (base - now > tolerance) return Step{false, base, now};
+            tat = base + interval;
+            return Step{true, tat, now};
+        }
+
+        bool down = false;
+        std::int64_t now = 1'000'000'000;
+        std::map<std::string, std::int64_t> tats;
+        std::set<std::string> keys;
+    };
+
+    /// Installs a store for one test only
+    struct ScopedStore {
+        explicit ScopedStore(std::shared_ptr<mb::RateLimitStore> store) { mb::RateLimiter::setStore(std::move(store)); }
+        ~ScopedStore() { mb::RateLimiter::setStore(nullptr); }
+    };
+}
+
+TEST(RateLimiter, NodesShareABudgetThroughTheStore) {
+    const auto store = std::make_shared<FakeStore>();
+    ScopedStore scoped(store);
+
+    // Two nodes, each with its own limiter for the same route
+    mb::RateLimiter node_a(5, 60s, "login"), node_b(5, 60s, "login");
+    for (int i = 0; i < 3; ++i) ASSERT_TRUE(node_a.acquire("ip").allowed);
+    EXPECT_EQ(node_b.acquire("ip").remaining, 1);
+    EXPECT_TRUE(node_a.acquire("ip").allowed);
+
+    const auto denied = node_b.acquire("ip");
+    EXPECT_FALSE(denied.allowed);
+    EXPECT_EQ(denied.retryAfter, 12s);
+    EXPECT_EQ(node_a.size(), 0u);   // Nothing counted locally
+
+    mb::RateLimiter other(5, 60s, "setup");
+    EXPECT_TRUE(other.acquire("ip").allowed);
+    EXPECT_EQ(store->keys, (std::set<std::string>{"login:ip", "setup:ip"}));
+}
+
+TEST(RateLimiter, CountsLocallyWhileTheStoreIsDown) {
+    const auto store = std::make_shared<FakeStore>();
+    store->down = true;
+    ScopedStore scoped(store);
+
+    mb::RateLimiter limiter(2, 60s);
+    const auto now = Clock::now();
+    EXPECT_TRUE(limiter.acquire("ip", now).allowed);
+    EXPECT_TRUE(limiter.acquire("ip", now).allowed);
+    EXPECT_FALSE(limiter.acquire("ip", now).allowed);
+    EXPECT_EQ(limiter.size(), 1u);
+}
@@ -0,0 +1,174 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/read_coalescer.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+using mb::ReadCoalescer;
+using nlohmann::json;
+
+namespace {
+    /// A fetch that holds its read open until release()
+    struct Gate {
+        std::promise<void> open;
+        std::shared_future<void> opened = open.get_future().share();
+
+        void release() { open.set_value(); }
+    };
+
+    template<typename Pred>
+    void waitFor(Pred pred) {
+        for (int i = 0; i < 500 && !pred(); ++i) std::this_thread::sleep_for(2ms);
+        ASSERT_TRUE(pred());
+    }
+}
+
+TEST(ReadCoalescer, ConcurrentReadsShareOneFetch) {
+    ReadCoalescer flights;
+    Gate gate;
+    std::atomic<int> fetches{0};
+    const auto fetch = [&]() -> ReadCoalescer::Result {
+        ++fetches;
+        gate.opened.wait();
+        return json{{"id", "a"}, {"title", "hot"}};
+    };
+
+    std::vector<ReadCoalescer::Result> results(9);
+    std::vector<std::thread> readers;
+    readers.emplace_back([&] { results[0] = flights.read("posts", "a", "*", fetch); });
+    waitFor([&] { return flights.inFlight() == 1; });
+    for (int i = 1; i < 9; ++i)
+        readers.emplace_back([&, i] { results[i] = flights.read("posts", "a", "*", fetch); });
+    waitFor([&] { return flights.stats().joined == 8; });
+
+    gate.release();
+    for (auto &t: readers) t.join();
+
+    EXPECT_EQ(fetches, 1);
+    for (const auto &r: results) {
+        ASSERT_TRUE(r.has_value());
+        EXPECT_EQ((*r)["title"], "hot");
+    }
+    EXPECT_EQ(flights.stats().led, 1u);
+    EXPECT_EQ(flights.inFlight(), 0u);
+}
+
+TEST(ReadCoalescer, OtherRowsAndProjectionsFetchOnTheirOwn) {
+    ReadCoalescer flights;
+    Gate gate;
+    std::thread leader([&] {
+        (void) flights.read("posts", "a", "*", [&]() -> ReadCoalescer::Result {
+            gate.opened.wait();
+            return json::object();
+        });
+    });
+    waitFor([&] { return flights.inFlight() == 1; });
+
+    int fetches = 0;
+    const auto fetch = [&]() -> ReadCoalescer::Result {
+        ++fetches;
+        return std::nullopt;
+    };
+    EXPECT_FALSE(flights.read("posts", "b", "*", fetch).has_value());
+    EXPECT_FALSE(flights.read("posts", "a", "\"id\"", fetch).has_value());
+    EXPECT_FALSE(flights.read("tags", "a", "*", fetch).has_value());
+    EXPECT_EQ(fetches, 3);
+
+    gate.release();
+    leader.join();
+    EXPECT_EQ(flights.stats().joined, 0u);
+}
+
+TEST(ReadCoalescer, ReadsAfterAChangeDontJoinOlderOnes) {
+    ReadCoalescer flights;
+    Gate gate;
+    ReadCoalescer::Result stale;
+    std::thread leader([&] {
+        stale = flights.read("posts", "a", "*", [&]() -> ReadCoalescer::Result {
+            gate.opened.wait();
+            return json{{"title", "old"}};
+        });
+    });
+    waitFor([&] { return flights.inFlight() == 1; });
+
+    flights.forget("posts", "a");
+    EXPECT_EQ(flights.inFlight(), 0u);
+    const auto fresh = flights.read("posts", "a", "*", [] { return ReadCoalescer::Result(json{{"title", "new"}}); });
+    EXPECT_EQ((*fresh)["title"], "new");
+
+    gate.release();
+    leader.join();
+    EXPECT_EQ((*stale)["title"], "old");
+    EXPECT_EQ(flights.stats().joined, 0u);
+}
+
+TEST(ReadCoalescer, ChangeEventsDetachTheirRowsOrEntity) {
+    ReadCoalescer flights;
+    Gate gate;
+    std::vector<std::thread> readers;
+    for (const auto *id: {"a", "b"}) {
+        readers.emplace_back([&, id] {
+            (void) flights.read("posts", id, "*", [&]() -> ReadCoalescer::Result {
+                gate.opened.wait();
+                return json::object();
+            });
+        });
+    }
+    readers.emplace_back([&] {
+        (void) flights.read("tags", "a", "*", [&]() -> ReadCoalescer::Result {
+            gate.opened.wait();
+            return json::object();
+        });
+    });
+    waitFor([&] { return flights.inFlight() == 3; });
+
+    flights.onChanges(json::array({{{"type", "UPDATE"}, {"entity", "posts"}, {"row_id", "a"}}}));
+    EXPECT_EQ(flights.inFlight(), 2u);
+    flights.onChanges(json::array({{{"type", "IMPORT"}, {"entity", "tags"}, {"row_id", ""}}}));
+    EXPECT_EQ(flights.inFlight(), 1u);
+    flights.invalidateEntity("posts");
+    EXPECT_EQ(flights.inFlight(), 0u);
+
+    gate.release();
+    for (auto &t: readers) t.join();
+}
+
+TEST(ReadCoalescer, ErrorsReachEveryWaiter) {
+    ReadCoalescer flights;
+    Gate gate;
+    std::atomic<int> failures{0};
+    const auto fetch = [&]() -> ReadCoalescer::Result {
+        gate.opened.wait();
+        throw std::runtime_error("database is busy");
+    };
+    const auto reader = [&] {
+        try {
+            (void) flights.read("posts", "a", "*", fetch);
+        } catch (const std::runtime_error &) {
+            ++failures;
+        }
+    };
+
+    std::thread leader(reader);
+    waitFor([&] { return flights.inFlight() == 1; });
+    std::thread joiner(reader);
+    waitFor([&] { return flights.stats().joined == 1; });
+
+    gate.release();
+    leader.join();
+    joiner.join();
+    EXPECT_EQ(failures, 2);
+    EXPECT_EQ(flights.inFlight(), 0u);
+}
+
+TEST(ReadCoalescer, DisabledRunsEveryFetch) {
+    ReadCoalescer flights(false);
+    int fetches = 0;
+    for (int i = 0; i < 3; ++i)
+        (void) flights.read("posts", "a", "*", [&] { ++fetches; return ReadCoalescer::Result(json::object()); });
+    EXPECT_EQ(fetches, 3);
+    EXPECT_EQ(flights.stats().led, 0u);
+}
@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/readiness_probe.h"
+#include "mantisbase/mantisbase.h"
+#include "../common/test_environment.h"
+
+#include <string>
+#include <vector>
+
+using mb::ReadinessProbe;
+using json = nlohmann::json;
+
+namespace {
+    /// Readings well inside the default thresholds
+    ReadinessProbe::Sample healthy() {
+        ReadinessProbe::Sample s;
+        s.dbMs = {{"primary", 1.5}};
+        s.poolInUse = 1;
+        s.poolSize = 8;
+        s.workerLag = 0;
+        s.logQueued = 10;
+        s.logCapacity = 8192;
+        s.diskFree = std::int64_t{10} << 30;
+        return s;
+    }
+}
+
+TEST(ReadinessProbeTest, HealthyReadingsAreReady) {
+    const auto result = ReadinessProbe::assess(healthy(), {});
+    EXPECT_TRUE(result["ready"].get<bool>());
+    for (const auto &[name, check]: result["checks"].items())
+        EXPECT_TRUE(check["ok"].get<bool>()) << name;
+    EXPECT_DOUBLE_EQ(result["checks"]["db"]["pools"]["primary"]["ms"].get<double>(), 1.5);
+}
+
+TEST(ReadinessProbeTest, EachThresholdFailsItsOwnCheck) {
+    const ReadinessProbe::Options options;
+    const auto failing = [&](auto change) {
+        auto s = healthy();
+        change(s);
+        const auto result = ReadinessProbe::assess(s, options);
+        EXPECT_FALSE(result["ready"].get<bool>());
+        std::vector<std::string> failed;
+        for (const auto &[name, check]: result["checks"].items())
+            if (!check.value("ok", true)) failed.push_back(name);
+        return failed;
+    };
+
+    using Names = std::vector<std::string>;
+    EXPECT_EQ(failing([](auto &s) { s.dbMs["replica"] = 900; }), Names{"db"});
+    EXPECT_EQ(failing([](auto &s) { s.dbMs["primary"] = -1; }), Names{"db"});
+    EXPECT_EQ(failing([](auto &s) { s.poolInUse = 8; }), Names{"pool"});
+    EXPECT_EQ(failing([&](auto &s) { s.workerLag = options.workerLag + 1; }), Names{"realtime"});
+    EXPECT_EQ(failing([](auto &s) { s.logQueued = 8000; }), Names{"log_queue"});
+    EXPECT_EQ(failing([](auto &s) { s.diskFree = 1 << 20; }), Names{"disk"});
+    EXPECT_EQ(failing([](auto &s) { s.diskFree = -1; }), Names{"disk"});
+}
+
+TEST(ReadinessProbeTest, MissingReadingsAreNotFailures) {
+    auto s = healthy();
+    s.workerLag = -1;  // no realtime worker
+    s.logQueued = -1;  // no logs database
+    s.poolSize = 0;
+    const auto result = ReadinessProbe::assess(s, {});
+    EXPECT_TRUE(result["ready"].get<bool>());
+    EXPECT_TRUE(result["checks"]["realtime"]["lag"].is_null());
+    EXPECT_TRUE(result["checks"]["log_queue"]["queued"].is_null());
+}
+
+TEST(ReadinessProbeTest, RefreshReplacesTheCachedReport) {
+    ReadinessProbe::Options options;
+    options.diskMinBytes = 0;
+    ReadinessProbe probe(mb::MantisBase::instance(), options);
+    EXPECT_EQ(probe.report()->status, 503);
+    EXPECT_EQ(json::parse(probe.report()->body)["status"], "STARTING");
+
+    probe.refresh();
+    const auto report = probe.report();
+    const auto body = json::parse(report->body);
+    EXPECT_EQ(report->status, 200) << report->body;
+    EXPECT_EQ(body["status"], "READY");
+    EXPECT_GT(body["checked_at"].get<long long>(), 0);
+    EXPECT_TRUE(body["checks"]["db"]["pools"].contains("primary"));
+
+    // The report is taken, not computed, on each call
+    EXPECT_EQ(probe.report(), report);
+}
@@ -0,0 +1,349 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/realtime_event.h"
+#include "mantisbase/core/send_queue.h"
+#include <thread>
+#include <vector>
+
+namespace {
+    mb::json makeChange(const std::string &type, const std::string &row_id = "42") {
+        return {
+            {"type", type},
+            {"entity", "posts"},
+            {"row_id", row_id},
+            {"timestamp", 1700000000},
+            {"new_data", {{"id", "42"}, {"title", "hello"}}}
+        };
+    }
+
+    mb::json ssePayload(const std::string &frame) {
+        const std::string prefix = "event: change\ndata: ";
+        EXPECT_EQ(frame.rfind(prefix, 0), 0u);
+        EXPECT_TRUE(frame.ends_with("\n\n"));
+        return mb::json::parse(frame.substr(prefix.size(), frame.size() - prefix.size() - 2));
+    }
+}
+
+TEST(EncodedEvent, NormalizesChangeRecord) {
+    const auto ev = mb::EncodedEvent::encode(makeChange("UPDATE"));
+
+    EXPECT_EQ(ev->entity(), "posts");
+    EXPECT_EQ(ev->rowId(), "42");
+    EXPECT_EQ(ev->rowTopic(), "posts:42");
+    EXPECT_EQ(ev->action(), "update");
+}
+
+TEST(EncodedEvent, SseFramesCarryMatchingTopic) {
+    const auto ev = mb::EncodedEvent::encode(makeChange("INSERT"));
+
+    const auto entity = ssePayload(ev->sse(false));
+    EXPECT_EQ(entity["topic"], "posts");
+    EXPECT_EQ(entity["action"], "insert");
+    EXPECT_EQ(entity["data"]["title"], "hello");
+
+    const auto row = ssePayload(ev->sse(true));
+    EXPECT_EQ(row["topic"], "posts:42");
+    EXPECT_EQ(row["row_id"], "42");
+}
+
+TEST(EncodedEvent, WsFrameAndDeletePayload) {
+    const auto ev = mb::EncodedEvent::encode(makeChange("DELETE"));
+
+    const auto ws = mb::json::parse(ev->ws());
+    EXPECT_EQ(ws["type"], "change");
+    EXPECT_EQ(ws["topic"], "posts");
+    EXPECT_TRUE(ws["data"].is_null());
+}
+
+TEST(EncodedEvent, ImportSummaryCarriesItsCounts) {
+    auto change = makeChange("IMPORT", "");
+    change["new_data"] = {{"imported", 1000}};
+    const auto ev = mb::EncodedEvent::encode(change);
+
+    const auto ws = mb::json::parse(ev->ws());
+    EXPECT_EQ(ws["action"], "import");
+    EXPECT_EQ(ws["data"]["imported"], 1000);
+}
+
+TEST(EncodedEvent, PassesTheCommitStampOn) {
+    auto change = makeChange("UPDATE");
+    EXPECT_FALSE(ssePayload(mb::EncodedEvent::encode(change)->sse(false)).contains("committed_at"));
+
+    change["committed_at"] = 1700000000123456;
+    const auto ev = mb::EncodedEvent::encode(change);
+    EXPECT_EQ(ssePayload(ev->sse(false))["committed_at"], 1700000000123456);
+    EXPECT_EQ(mb::json::parse(ev->ws())["committed_at"], 1700000000123456);
+}
+
+TEST(EncodedEvent, EncodesOncePerVariant) {
+    const auto ev = mb::EncodedEvent::encode(makeChange("UPDATE"));
+
+    std::vector<const std::string *> seen(8);
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < seen.size(); ++i)
+        threads.emplace_back([&, i] { seen[i] = &ev->sse(true); });
+    for (auto &t: threads) t.join();
+
+    for (const auto *p: seen) EXPECT_EQ(p, seen.front());
+    EXPECT_EQ(&ev->ws(), &ev->ws());
+}
+
+namespace {
+    // Collects drain tasks so the test decides when the "loop" runs
+    struct ManualLoop {
+        std::vector<mb::SendQueue::Task> tasks;
+
+        mb::SendQueue::Executor executor() {
+            return [this](mb::SendQueue::Task task) { tasks.push_back(std::move(task)); };
+        }
+
+        void run() {
+            while (!tasks.empty()) {
+                auto pending = std::move(tasks);
+                tasks.clear();
+                for (auto &task: pending) task();
+            }
+        }
+    };
+
+    std::shared_ptr<mb::SendQueue> makeQueue(ManualLoop &loop, std::vector<std::string> &sent,
+                                             mb::SendQueue::Overflow overflow, bool *closed = nullptr,
+                                             std::shared_ptr<mb::SendQueue::Counters> counters = nullptr) {
+        return std::make_shared<mb::SendQueue>(
+            mb::SendQueue::Options{3, overflow},
+            loop.executor(),
+            [&sent](const std::string &frame) { sent.push_back(frame); return true; },
+            [closed] { if (closed) *closed = true; },
+            std::move(counters));
+    }
+}
+
+TEST(SendQueue, DeliversInOrderOnExecutor) {
+    ManualLoop loop;
+    std::vector<std::string> sent;
+    const auto q = makeQueue(loop, sent, mb::SendQueue::Overflow::DropOldest);
+
+    EXPECT_TRUE(q->push(mb::EncodedEvent::encode(makeChange("INSERT", "1")), mb::SendQueue::Frame::Ws));
+    EXPECT_TRUE(q->push(mb::EncodedEvent::encode(makeChange("INSERT", "2")), mb::SendQueue::Frame::Ws));
+    EXPECT_EQ(loop.tasks.size(), 1u); // one drain scheduled for the burst
+    EXPECT_TRUE(sent.empty());
+    EXPECT_EQ(q->depth(), 2u);
+
+    loop.run();
+    ASSERT_EQ(sent.size(), 2u);
+    EXPECT_EQ(mb::json::parse(sent[0])["row_id"], "1");
+    EXPECT_EQ(mb::json::parse(sent[1])["row_id"], "2");
+    EXPECT_EQ(q->depth(), 0u);
+}
+
+TEST(SendQueue, DropOldestOnOverflow) {
+    ManualLoop loop;
+    std::vector<std::string> sent;
+    auto counters = std::make_shared<mb::SendQueue::Counters>();
+    const auto q = makeQueue(loop, sent, mb::SendQueue::Overflow::DropOldest, nullptr, counters);
+
+    for (const auto id: {"1", "2", "3", "4"})
+        q->push(mb::EncodedEvent::encode(makeChange("INSERT", id)), mb::SendQueue::Frame::Ws);
+
+    EXPECT_EQ(q->depth(), 3u);
+    EXPECT_EQ(counters->dropped.load(), 1u);
+
+    loop.run();
+    ASSERT_EQ(sent.size(), 3u);
+    EXPECT_EQ(mb::json::parse(sent[0])["row_id"], "2");
+}
+
+TEST(SendQueue, CoalescesSameRowOnOverflow) {
+    ManualLoop loop;
+    std::vector<std::string> sent;
+    auto counters = std::make_shared<mb::SendQueue::Counters>();
+    const auto q = makeQueue(loop, sent, mb::SendQueue::Overflow::Coalesce, nullptr, counters);
+
+    q->push(mb::EncodedEvent::encode(makeChange("INSERT", "1")), mb::SendQueue::Frame::Ws);
+    q->push(mb::EncodedEvent::encode(makeChange("INSERT", "2")), mb::SendQueue::Frame::Ws);
+    q->push(mb::EncodedEvent::encode(makeChange("INSERT", "3")), mb::SendQueue::Frame::Ws);
+    q->push(mb::EncodedEvent::encode(makeChange("DELETE", "1")), mb::SendQueue::Frame::Ws);
+
+    EXPECT_EQ(counters->coalesced.load(), 1u);
+    EXPECT_EQ(counters->dropped.load(), 0u);
+
+    loop.run();
+    ASSERT_EQ(sent.size(), 3u);
+    const auto first = mb::json::parse(sent[0]);
+    EXPECT_EQ(first["row_id"], "1");
+    EXPECT_EQ(first["action"], "delete"); // latest state, original position
+}
+
+TEST(SendQueue, DisconnectEvictsSlowConsumer) {
+    ManualLoop loop;
+    std::vector<std::string> sent;
+    bool closed = false;
+    auto counters = std::make_shared<mb::SendQueue::Counters>();
+    const auto q = makeQueue(loop, sent, mb::SendQueue::Overflow::Disconnect, &closed, counters);
+
+    for (const auto id: {"1", "2", "3"})
+        EXPECT_TRUE(q->push(mb::EncodedEvent::encode(makeChange("INSERT", id)), mb::SendQueue::Frame::Ws));
+    EXPECT_FALSE(q->push(mb::EncodedEvent::encode(makeChange("INSERT", "4")), mb::SendQueue::Frame::Ws));
+
+    EXPECT_TRUE(closed);
+    EXPECT_TRUE(q->isClosed());
+    EXPECT_EQ(q->depth(), 0u);
+    EXPECT_EQ(counters->evicted.load(), 1u);
+
+    loop.run();
+    EXPECT_TRUE(sent.empty());
+}
+
+TEST(SendQueue, ClosesWhenWriterFails) {
+    int writes = 0;
+    const auto q = std::make_shared<mb::SendQueue>(
+        mb::SendQueue::Options{}, mb::SendQueue::Executor{},
+        [&writes](const std::string &) { ++writes; return false; }, nullptr);
+
+    EXPECT_TRUE(q->push(mb::EncodedEvent::encode(makeChange("INSERT")), mb::SendQueue::Frame::SseEntity));
+    EXPECT_EQ(writes, 1); // no executor: written inline
+    EXPECT_TRUE(q->isClosed());
+    EXPECT_FALSE(q->push(mb::EncodedEvent::encode(makeChange("INSERT")), mb::SendQueue::Frame::SseEntity));
+}
+
+TEST(SendQueue, ParsesOverflowPolicy) {
+    using O = mb::SendQueue::Overflow;
+    EXPECT_EQ(mb::SendQueue::parseOverflow("coalesce"), O::Coalesce);
+    EXPECT_EQ(mb::SendQueue::parseOverflow("disconnect"), O::Disconnect);
+    EXPECT_EQ(mb::SendQueue::parseOverflow("bogus", O::Coalesce), O::Coalesce);
+    EXPECT_EQ(mb::SendQueue::overflowName(O::DropOldest), "drop-oldest");
+}
+
+TEST(SendQueue, BatchesPendingEventsIntoOneFrame) {
+    ManualLoop loop;
+    std::vector<std::string> sent;
+    const auto q = std::make_shared<mb::SendQueue>(
+        mb::SendQueue::Options{8, mb::SendQueue::Overflow::DropOldest, true},
+        loop.executor(),
+        [&sent](const std::string &frame) { sent.push_back(frame); return true; },
+        nullptr);
+
+    q->push(mb::EncodedEvent::encode(makeChange("INSERT", "1"), 7), mb::SendQueue::Frame::SseEntity);
+    q->push(mb::EncodedEvent::encode(makeChange("UPDATE", "2"), 8), mb::SendQueue::Frame::SseRow);
+    loop.run();
+
+    ASSERT_EQ(sent.size(), 1u);
+    const std::string prefix = "id: 8\nevent: batch\ndata: ";
+    ASSERT_EQ(sent[0].rfind(prefix, 0), 0u);
+    const auto events = mb::json::parse(sent[0].substr(prefix.size(), sent[0].size() - prefix.size() - 2));
+    ASSERT_EQ(events.size(), 2u);
+    EXPECT_EQ(events[0]["topic"], "posts");
+    EXPECT_EQ(events[1]["topic"], "posts:2");
+
+    // A lone event keeps the plain change frame
+    q->push(mb::EncodedEvent::encode(makeChange("INSERT", "3"), 9), mb::SendQueue::Frame::Ws);
+    loop.run();
+    ASSERT_EQ(sent.size(), 2u);
+    EXPECT_EQ(mb::json::parse(sent[1])["type"], "change");
+}
+
+TEST(SendQueue, BatchesWebSocketFrames) {
+    ManualLoop loop;
+    std::vector<std::string> sent;
+    const auto q = std::make_shared<mb::SendQueue>(
+        mb::SendQueue::Options{8, mb::SendQueue::Overflow::DropOldest, true},
+        loop.executor(),
+        [&sent](const std::string &frame) { sent.push_back(frame); return true; },
+        nullptr);
+
+    for (const auto id: {"1", "2", "3"})
+        q->push(mb::EncodedEvent::encode(makeChange("INSERT", id)), mb::SendQueue::Frame::Ws);
+    loop.run();
+
+    ASSERT_EQ(sent.size(), 1u);
+    const auto batch = mb::json::parse(sent[0]);
+    EXPECT_EQ(batch["type"], "batch");
+    ASSERT_EQ(batch["events"].size(), 3u);
+    EXPECT_EQ(batch["events"][2]["row_id"], "3");
+}
+
+TEST(EncodedEvent, ProjectsSubscribedFields) {
+    auto change = makeChange("UPDATE");
+    change["new_data"]["body"] = std::string(10000, 'x');
+    const auto ev = mb::EncodedEvent::encode(change, 5);
+
+    const auto fields = mb::EncodedEvent::parseFields(" title, title ,");
+    ASSERT_EQ(fields, (mb::EncodedEvent::FieldSet{"title"}));
+
+    const auto projected = mb::EncodedEvent::project(ev, fields);
+    const auto data = mb::json::parse(projected->ws())["data"];
+    EXPECT_EQ(data, (mb::json{{"id", "42"}, {"title", "hello"}}));
+    EXPECT_EQ(projected->id(), 5u);
+    EXPECT_TRUE(projected->record().contains("body")); // rules still see the whole row
+
+    // Shared per field set; no projection returns the event itself
+    EXPECT_EQ(mb::EncodedEvent::project(ev, fields), projected);
+    EXPECT_EQ(mb::EncodedEvent::project(ev, {}), ev);
+}
+
+TEST(EncodedEvent, EncodesBinaryFormatsOnce) {
+    const auto ev = mb::EncodedEvent::encode(makeChange("INSERT"), 5);
+    using Format = mb::WireFormat::Format;
+
+    EXPECT_EQ(&ev->ws(Format::Json), &ev->ws());
+    const auto &ws = ev->ws(Format::MsgPack);
+    EXPECT_EQ(&ws, &ev->ws(Format::MsgPack));
+    EXPECT_EQ(mb::WireFormat::decode(Format::MsgPack, ws), mb::json::parse(ev->ws()));
+    EXPECT_EQ(mb::WireFormat::decode(Format::Cbor, ev->ws(Format::Cbor)), mb::json::parse(ev->ws()));
+
+    // SSE stays text: the payload goes base64 encoded in `data:`
+    const auto &sse = ev->sse(true, Format::Cbor);
+    const std::string prefix = "id: 5\nevent: change\ndata: ";
+    ASSERT_EQ(sse.rfind(prefix, 0), 0u);
+    EXPECT_EQ(sse.substr(prefix.size(), sse.size() - prefix.size() - 2),
+              mb::WireFormat::encodeText(Format::Cbor, mb::json::parse(ev->data(true))));
+}
+
+TEST(SendQueue, WritesInTheSubscribersFormat) {
+    ManualLoop loop;
+    std::vector<std::string> sent;
+    mb::SendQueue::Options options{8, mb::SendQueue::Overflow::DropOldest, true};
+    options.format = mb::WireFormat::Format::MsgPack;
+    const auto q = std::make_shared<mb::SendQueue>(
+        options, loop.executor(),
+        [&sent](const std::string &frame) { sent.push_back(frame); return true; },
+        nullptr);
+
+    q->push(mb::EncodedEvent::encode(makeChange("INSERT", "1")), mb::SendQueue::Frame::Ws);
+    loop.run();
+    ASSERT_EQ(sent.size(), 1u);
+    EXPECT_EQ(mb::WireFormat::decode(mb::WireFormat::Format::MsgPack, sent[0])["type"], "change");
+
+    for (const auto id: {"2", "3"})
+        q->push(mb::EncodedEvent::encode(makeChange("INSERT", id)), mb::SendQueue::Frame::Ws);
+    loop.run();
+    ASSERT_EQ(sent.size(), 2u);
+    const auto batch = mb::WireFormat::decode(mb::WireFormat::Format::MsgPack, sent[1]);
+    EXPECT_EQ(batch["type"], "batch");
+    ASSERT_EQ(batch["events"].size(), 2u);
+    EXPECT_EQ(batch["events"][1]["row_id"], "3");
+}
+
+TEST(EncodedEvent, DeltaKeepsOnlyChangedFields) {
+    auto change = makeChange("UPDATE");
+    change["new_data"] = {{"id", "42"}, {"title", "hello"}, {"body", "long text"}, {"views", 2}};
+    change["old_data"] = {{"id", "42"}, {"title", "hello"}, {"body", "long text"}, {"views", 1}, {"gone", 1}};
+    const auto ev = mb::EncodedEvent::encode(change);
+
+    const auto delta = mb::EncodedEvent::delta(ev);
+    EXPECT_EQ(delta, mb::EncodedEvent::delta(ev));
+    const auto payload = mb::json::parse(delta->ws());
+    EXPECT_EQ(payload["delta"], true);
+    EXPECT_EQ(payload["data"], (mb::json{{"id", "42"}, {"views", 2}, {"gone", nullptr}}));
+    // Access rules still see the whole row
+    EXPECT_EQ(delta->record()["body"], "long text");
+
+    // Field projection applies on top of the delta
+    const auto projected = mb::EncodedEvent::project(delta, mb::EncodedEvent::parseFields("title,views"));
+    EXPECT_EQ(mb::json::parse(projected->ws())["data"], (mb::json{{"id", "42"}, {"views", 2}}));
+
+    // Nothing to diff against: the full event
+    const auto insert = mb::EncodedEvent::encode(makeChange("INSERT"));
+    EXPECT_EQ(mb::EncodedEvent::delta(insert), insert);
+    const auto update = mb::EncodedEvent::encode(makeChange("UPDATE"));
+    EXPECT_EQ(mb::EncodedEvent::delta(update), update);
+}
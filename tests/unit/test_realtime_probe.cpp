@@ -0,0 +1,100 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/realtime_probe.h"
+#include "mantisbase/core/realtime_event.h"
+
+#include <format>
+#include <optional>
+#include <string>
+
+using namespace std::chrono_literals;
+using mb::RealtimeProbe;
+using nlohmann::json;
+
+namespace {
+    json probeChange(const std::int64_t seq, const std::optional<std::int64_t> committed_at) {
+        json change = {
+            {"type", "UPDATE"},
+            {"entity", RealtimeProbe::ENTITY},
+            {"row_id", "p1"},
+            {"timestamp", "2026-01-01T00:00:00Z"},
+            {"new_data", {{"id", "p1"}, {"seq", seq}}}
+        };
+        if (committed_at) change["committed_at"] = *committed_at;
+        return change;
+    }
+
+    /// The frame as the probe's session sends it, chunked like a drogon::ResponseStream
+    std::string chunk(const std::string &frame) {
+        return std::format("{:x}\r\n{}\r\n", frame.size(), frame);
+    }
+}
+
+TEST(RealtimeProbe, TimesDeliveryFromTheCommitStamp) {
+    RealtimeProbe probe({});
+    probe.expect(1, 1'000'000);
+    probe.expect(2, 1'000'000);
+
+    const auto first = mb::EncodedEvent::encode(probeChange(1, 1'000'500));
+    EXPECT_EQ(probe.onFrames(chunk(first->sse(false)), 1'003'500), 1u);
+
+    const auto latency = probe.latency();
+    EXPECT_EQ(latency.count, 1u);
+    EXPECT_NEAR(latency.sum, 0.003, 1e-9);
+    EXPECT_EQ(latency.counts[mb::LatencyHistogram::bucketFor(3ms)], 1u);
+
+    // Delivered twice, say from the trigger copy: counted once
+    EXPECT_EQ(probe.onFrames(chunk(first->sse(false)), 1'004'000), 0u);
+    EXPECT_EQ(probe.delivered(), 1u);
+
+    // Without a stamp, timed from the write
+    const auto second = mb::EncodedEvent::encode(probeChange(2, std::nullopt));
+    EXPECT_EQ(probe.onFrames(chunk(second->sse(false)), 1'020'000), 1u);
+    EXPECT_NEAR(probe.latency().sum, 0.003 + 0.020, 1e-9);
+}
+
+TEST(RealtimeProbe, IgnoresOtherFrames) {
+    RealtimeProbe probe({});
+    probe.expect(1, 0);
+
+    EXPECT_EQ(probe.onFrames(chunk("event: connected\ndata: {\"client_id\":\"c1\",\"topics\":[\"mb_rt_probe\"]}\n\n"),
+                             10),
+              0u);
+    EXPECT_EQ(probe.onFrames(chunk("event: ping\ndata: {\"timestamp\":1769988043}\n\n"), 10), 0u);
+
+    auto other = probeChange(1, 5);
+    other["entity"] = "posts";
+    EXPECT_EQ(probe.onFrames(chunk(mb::EncodedEvent::encode(other)->sse(false)), 10), 0u);
+    EXPECT_EQ(probe.onFrames("data: not json\n\n", 10), 0u);
+    EXPECT_EQ(probe.delivered(), 0u);
+}
+
+TEST(RealtimeProbe, CountsUndeliveredProbesAsLost) {
+    RealtimeProbe::Options options;
+    options.timeout = 100ms;
+    RealtimeProbe probe(options);
+    probe.expect(1, 0);
+    probe.expect(2, 50'000);
+
+    EXPECT_EQ(probe.expire(99'999), 0u);
+    EXPECT_EQ(probe.expire(100'000), 1u);
+    EXPECT_EQ(probe.lost(), 1u);
+
+    // A late delivery of a lost probe isn't timed
+    EXPECT_EQ(probe.onFrames(chunk(mb::EncodedEvent::encode(probeChange(1, 0))->sse(false)), 200'000), 0u);
+    EXPECT_EQ(probe.onFrames(chunk(mb::EncodedEvent::encode(probeChange(2, 60'000))->sse(false)), 200'000), 1u);
+    EXPECT_EQ(probe.latency().count, 1u);
+}
+
+TEST(RealtimeProbe, ExportsLatencyAndOutcomes) {
+    RealtimeProbe probe({});
+    probe.expect(1, 0);
+    probe.onFrames(chunk(mb::EncodedEvent::encode(probeChange(1, 0))->sse(false)), 2'000);
+
+    mb::MetricsWriter out;
+    probe.writeMetrics(out);
+    const auto &text = out.str();
+    EXPECT_NE(text.find("# TYPE mb_realtime_probe_latency_seconds histogram"), std::string::npos);
+    EXPECT_NE(text.find("mb_realtime_probe_latency_seconds_count 1"), std::string::npos);
+    EXPECT_NE(text.find("mb_realtime_probe_total{result=\"delivered\"} 1"), std::string::npos);
+    EXPECT_NE(text.find("mb_realtime_probe_total{result=\"lost\"} 0"), std::string::npos);
+}
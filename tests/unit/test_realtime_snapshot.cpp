@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/realtime_snapshot.h"
+#include "mantisbase/core/replay_buffer.h"
+
+using mb::RealtimeSnapshot;
+
+namespace {
+    std::shared_ptr<const mb::EncodedEvent> change(const std::string &type, const std::string &row_id,
+                                                   const mb::json &row) {
+        mb::json event = {{"type", type}, {"entity", "posts"}, {"row_id", row_id}, {"timestamp", 0}};
+        event[type == "DELETE" ? "old_data" : "new_data"] = row;
+        return mb::EncodedEvent::encode(event);
+    }
+
+    std::vector<bool> covered(const RealtimeSnapshot &snapshot,
+                              const std::vector<std::shared_ptr<const mb::EncodedEvent>> &events) {
+        std::vector<const mb::EncodedEvent *> raw;
+        for (const auto &event: events) raw.push_back(event.get());
+        return snapshot.covered(raw);
+    }
+}
+
+TEST(RealtimeSnapshot, SkipsChangesTheRowsAlreadyShow) {
+    RealtimeSnapshot snapshot(41);
+    snapshot.add("posts", "posts", {{"id", "1"}, {"title", "b"}});
+    snapshot.add("posts", "posts", {{"id", "2"}, {"title", "x"}});
+
+    const std::vector events = {
+        change("UPDATE", "1", {{"id", "1"}, {"title", "a"}}),
+        change("UPDATE", "1", {{"id", "1"}, {"title", "b"}}), // What was read
+        change("UPDATE", "1", {{"id", "1"}, {"title", "c"}}), // After the read
+        change("UPDATE", "2", {{"id", "2"}, {"title", "y"}}), // Committed after the read
+        change("INSERT", "3", {{"id", "3"}}),
+        change("DELETE", "3", {{"id", "3"}}),                 // Gone by the read
+        change("DELETE", "2", {{"id", "2"}, {"title", "y"}})
+    };
+    EXPECT_EQ(covered(snapshot, events), (std::vector<bool>{true, true, false, false, true, true, false}));
+}
+
+TEST(RealtimeSnapshot, FramesEachTopicWithItsRows) {
+    RealtimeSnapshot snapshot(7);
+    snapshot.topic("posts:9");
+    snapshot.add("posts?views > 1", "posts", {{"id", "1"}, {"title", "a"}, {"views", 2}});
+    EXPECT_EQ(snapshot.size(), 1u);
+
+    const auto frames = snapshot.frames(mb::EncodedEvent::parseFields("views"));
+    ASSERT_EQ(frames.size(), 2u);
+    EXPECT_EQ(frames[0]["topic"], "posts:9");
+    EXPECT_TRUE(frames[0]["records"].empty());
+    EXPECT_EQ(frames[1]["records"][0], (mb::json{{"id", "1"}, {"views", 2}}));
+    EXPECT_EQ(frames[1]["last_event_id"], 7);
+
+    // Retained from the snapshot position on, nothing past the newest id
+    mb::ReplayBuffer replay;
+    const auto at = replay.lastId();
+    EXPECT_TRUE(replay.retains(at));
+    EXPECT_FALSE(replay.retains(at + 1));
+    EXPECT_FALSE(replay.retains(at - 1));
+}
@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/record_cache.h"
+
+using mb::RecordCache;
+using nlohmann::json;
+
+namespace {
+    json event(const std::string &type, const std::string &entity, const std::string &row_id = "r1") {
+        return {{"type", type}, {"entity", entity}, {"row_id", row_id}};
+    }
+
+    RecordCache::Options only(const std::string &entity) {
+        RecordCache::Options options;
+        options.entities = {entity};
+        return options;
+    }
+}
+
+TEST(RecordCache, ServesRecordsOfOptedInEntities) {
+    RecordCache cache(only("posts"));
+    EXPECT_TRUE(cache.enabled());
+    EXPECT_TRUE(cache.enabledFor("posts"));
+    EXPECT_FALSE(cache.enabledFor("users"));
+    EXPECT_FALSE(RecordCache(RecordCache::Options{}).enabled());
+
+    cache.put("posts", "r1", cache.generation("posts"), {{"id", "r1"}, {"title", "hello"}});
+    const auto hit = cache.get("posts", "r1");
+    ASSERT_TRUE(hit.has_value());
+    EXPECT_EQ((*hit)["title"], "hello");
+    EXPECT_FALSE(cache.get("posts", "r2").has_value());
+
+    cache.put("users", "r1", 0, {{"id", "r1"}});
+    EXPECT_FALSE(cache.get("users", "r1").has_value());
+    EXPECT_EQ(cache.size(), 1u);
+    EXPECT_EQ(cache.hits(), 1u);
+    EXPECT_EQ(cache.misses(), 2u);
+}
+
+TEST(RecordCache, WritesAndChangesDropTheirRows) {
+    RecordCache cache(only("posts"));
+    for (const auto *id: {"r1", "r2", "r3"})
+        cache.put("posts", id, cache.generation("posts"), {{"id", id}});
+
+    cache.forget("posts", "r1");
+    cache.onChanges(json::array({event("UPDATE", "posts", "r2"), event("DELETE", "users", "r3")}));
+    EXPECT_FALSE(cache.get("posts", "r1").has_value());
+    EXPECT_FALSE(cache.get("posts", "r2").has_value());
+    EXPECT_TRUE(cache.get("posts", "r3").has_value());
+
+    // No row: an import, everything goes
+    cache.onChanges(json::array({event("IMPORT", "posts", "")}));
+    EXPECT_EQ(cache.size(), 0u);
+    EXPECT_EQ(cache.bytes(), 0u);
+}
+
+TEST(RecordCache, RecordsReadAcrossAChangeAreNotStored) {
+    RecordCache cache(only("posts"));
+    const auto before = cache.generation("posts");
+    cache.forget("posts", "r1");
+
+    cache.put("posts", "r1", before, {{"title", "stale"}});
+    EXPECT_FALSE(cache.get("posts", "r1").has_value());
+
+    cache.put("posts", "r1", cache.generation("posts"), {{"title", "fresh"}});
+    EXPECT_EQ((*cache.get("posts", "r1"))["title"], "fresh");
+}
+
+TEST(RecordCache, EvictsLeastRecentlyUsedPastTheBudget) {
+    const json record = {{"id", "r"}, {"body", std::string(100, 'x')}};
+    const auto bytes = RecordCache::approxBytes(record) + 2;
+    EXPECT_GT(bytes, 100u);
+
+    auto options = only("posts");
+    options.maxBytes = 2 * bytes;
+    options.maxEntryBytes = 2 * bytes;
+    RecordCache cache(options);
+
+    cache.put("posts", "ra", 0, record);
+    cache.put("posts", "rb", 0, record);
+    ASSERT_TRUE(cache.get("posts", "ra").has_value()); // rb is now the oldest
+    cache.put("posts", "rc", 0, record);
+    EXPECT_TRUE(cache.get("posts", "ra").has_value());
+    EXPECT_FALSE(cache.get("posts", "rb").has_value());
+    EXPECT_TRUE(cache.get("posts", "rc").has_value());
+    EXPECT_EQ(cache.bytes(), 2 * bytes);
+
+    cache.put("posts", "big", 0, {{"body", std::string(3 * bytes, 'x')}});
+    EXPECT_FALSE(cache.get("posts", "big").has_value());
+}
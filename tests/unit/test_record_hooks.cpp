@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/metrics.h"
+#include "mantisbase/core/record_hooks.h"
+
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+
+namespace {
+    using namespace std::chrono_literals;
+    using mb::RecordHooks;
+    using json = nlohmann::json;
+
+    json events(const int count, const int first = 0) {
+        auto batch = json::array();
+        for (int i = first; i < first + count; ++i)
+            batch.push_back({{"id", i}, {"type", "INSERT"}, {"entity", "posts"}, {"row_id", std::to_string(i)}});
+        return batch;
+    }
+
+    RecordHooks::Options fast() {
+        RecordHooks::Options options;
+        options.workers = 2;
+        options.batchSize = 10;
+        options.maxAttempts = 3;
+        options.retryDelay = 1ms;
+        return options;
+    }
+}
+
+TEST(RecordHooks, DeliversEveryEventInChunks) {
+    std::mutex mutex;
+    std::set<int> seen;
+    std::atomic<std::size_t> largest{0};
+
+    RecordHooks hooks(fast(), [&](const json &batch) {
+        std::lock_guard lock(mutex);
+        largest = std::max(largest.load(), batch.size());
+        for (const auto &event: batch) seen.insert(event["id"].get<int>());
+        return json::array();
+    });
+    hooks.start();
+    hooks.onChanges(events(25));
+    hooks.onChanges(events(5, 25));
+    hooks.stop();
+
+    EXPECT_EQ(seen.size(), 30u);
+    EXPECT_EQ(largest.load(), 10u);
+    EXPECT_EQ(hooks.delivered(), 30u);
+    EXPECT_EQ(hooks.pending(), 0u);
+}
+
+TEST(RecordHooks, FailedEventsAreRetriedUntilTheyGoThrough) {
+    std::mutex mutex;
+    std::map<int, int> attempts;
+
+    RecordHooks hooks(fast(), [&](const json &batch) {
+        std::lock_guard lock(mutex);
+        auto failed = json::array();
+        for (const auto &event: batch) {
+            const auto id = event["id"].get<int>();
+            // Odd rows fail their first delivery
+            if (++attempts[id] == 1 && id % 2 == 1) failed.push_back(event);
+        }
+        return failed;
+    });
+    hooks.start();
+    hooks.onChanges(events(6));
+    hooks.stop();
+
+    EXPECT_EQ(attempts[0], 1);
+    EXPECT_EQ(attempts[1], 2);
+    EXPECT_EQ(hooks.delivered(), 6u);
+    EXPECT_EQ(hooks.retried(), 3u);
+    EXPECT_EQ(hooks.dropped(), 0u);
+}
+
+TEST(RecordHooks, GivesUpAfterMaxAttempts) {
+    std::atomic<int> calls{0};
+    RecordHooks hooks(fast(), [&](const json &) -> json {
+        ++calls;
+        throw std::runtime_error("hook is down");
+    });
+    hooks.start();
+    hooks.onChanges(events(4));
+    hooks.stop();
+
+    EXPECT_EQ(calls.load(), 3);
+    EXPECT_EQ(hooks.delivered(), 0u);
+    EXPECT_EQ(hooks.retried(), 8u);
+    EXPECT_EQ(hooks.dropped(), 4u);
+
+    mb::MetricsWriter out;
+    hooks.writeMetrics(out);
+    EXPECT_NE(out.str().find("mb_record_hook_events_total{result=\"dropped\"} 4"), std::string::npos);
+}
+
+TEST(RecordHooks, IgnoresChangesWhileStopped) {
+    std::atomic<int> calls{0};
+    RecordHooks hooks(fast(), [&](const json &) {
+        ++calls;
+        return json::array();
+    });
+    hooks.onChanges(events(3));
+    EXPECT_EQ(calls.load(), 0);
+    EXPECT_EQ(hooks.dropped(), 0u);
+}
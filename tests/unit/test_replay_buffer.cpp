@@ -0,0 +1,86 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/replay_buffer.h"
+#include <filesystem>
+#include <vector>
+
+namespace {
+    mb::json makeChange(const std::string &row_id) {
+        return {
+            {"type", "UPDATE"},
+            {"entity", "posts"},
+            {"row_id", row_id},
+            {"timestamp", 1700000000},
+            {"new_data", {{"id", row_id}}}
+        };
+    }
+
+    std::vector<std::string> rowsSince(const mb::ReplayBuffer &replay, const std::uint64_t after) {
+        std::vector<std::string> rows;
+        replay.since(after, [&](const auto &ev) { rows.push_back(ev->rowId()); });
+        return rows;
+    }
+}
+
+TEST(ReplayBuffer, AssignsIncreasingIdsAndTagsFrames) {
+    mb::ReplayBuffer replay;
+    const auto a = replay.append(makeChange("1"));
+    const auto b = replay.append(makeChange("2"));
+
+    EXPECT_GT(a->id(), 0u);
+    EXPECT_EQ(b->id(), a->id() + 1);
+    EXPECT_EQ(replay.lastId(), b->id());
+
+    EXPECT_EQ(a->sse().rfind("id: " + std::to_string(a->id()) + "\nevent: change\n", 0), 0u);
+    EXPECT_EQ(mb::json::parse(a->ws())["event_id"], a->id());
+}
+
+TEST(ReplayBuffer, ReplaysOnlyTheDelta) {
+    mb::ReplayBuffer replay;
+    const auto first = replay.append(makeChange("1"));
+    replay.append(makeChange("2"));
+    replay.append(makeChange("3"));
+
+    EXPECT_EQ(rowsSince(replay, first->id()), (std::vector<std::string>{"2", "3"}));
+    EXPECT_TRUE(rowsSince(replay, replay.lastId()).empty());
+    EXPECT_EQ(replay.since(replay.lastId(), [](const auto &) {}), replay.lastId());
+}
+
+TEST(ReplayBuffer, ReportsGapOnceEvicted) {
+    mb::ReplayBuffer replay({2, std::chrono::seconds(300)});
+    const auto first = replay.append(makeChange("1"));
+    const auto second = replay.append(makeChange("2"));
+    replay.append(makeChange("3"));
+
+    EXPECT_EQ(replay.size(), 2u);
+    EXPECT_FALSE(replay.since(first->id() - 1, [](const auto &) {}).has_value());
+    EXPECT_EQ(rowsSince(replay, first->id()), (std::vector<std::string>{"2", "3"}));
+    EXPECT_EQ(rowsSince(replay, second->id()), (std::vector<std::string>{"3"}));
+
+    // Ids this server never issued can't be resumed from either
+    EXPECT_FALSE(replay.since(replay.lastId() + 10, [](const auto &) {}).has_value());
+}
+
+TEST(ReplayBuffer, SurvivesRestartThroughDisk) {
+    const auto path = std::filesystem::temp_directory_path() / "mb_test_replay.json";
+    std::filesystem::remove(path);
+
+    std::uint64_t first_id = 0, last_id = 0;
+    {
+        mb::ReplayBuffer replay;
+        first_id = replay.append(makeChange("1"))->id();
+        replay.append(makeChange("2"));
+        last_id = replay.lastId();
+        ASSERT_TRUE(replay.save(path));
+    }
+
+    mb::ReplayBuffer restored;
+    ASSERT_TRUE(restored.load(path));
+    EXPECT_FALSE(std::filesystem::exists(path));
+    EXPECT_EQ(restored.lastId(), last_id);
+    EXPECT_EQ(rowsSince(restored, first_id), (std::vector<std::string>{"2"}));
+    EXPECT_EQ(restored.append(makeChange("3"))->id(), last_id + 1);
+
+    // Consumed on load; a second process start begins a fresh window
+    mb::ReplayBuffer fresh;
+    EXPECT_FALSE(fresh.load(path));
+}
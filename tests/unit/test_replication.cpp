@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+#include <soci/soci.h>
+#include <soci/sqlite3/soci-sqlite3.h>
+#include "mantisbase/core/replication.h"
+#include "mantisbase/core/exceptions.h"
+
+using mb::Replication;
+using nlohmann::json;
+
+namespace {
+    void createChangeLog(soci::session &sql) {
+        sql << "CREATE TABLE mb_change_log (id INTEGER PRIMARY KEY AUTOINCREMENT, "
+                "timestamp DATETIME DEFAULT CURRENT_TIMESTAMP, type TEXT NOT NULL, entity TEXT NOT NULL, "
+                "row_id TEXT NOT NULL, old_data TEXT, new_data TEXT)";
+    }
+
+    void logChange(soci::session &sql, const std::string &type, const std::string &row_id, const json &row) {
+        const auto data = row.dump();
+        sql << "INSERT INTO mb_change_log (type, entity, row_id, new_data) VALUES (:type, 'posts', :row_id, :data)",
+                soci::use(type), soci::use(row_id), soci::use(data);
+    }
+
+    int statusOf(const std::function<void()> &fn) {
+        try {
+            fn();
+        } catch (const mb::MantisException &e) {
+            return e.code();
+        }
+        return 0;
+    }
+}
+
+TEST(Replication, ServesChangesInOrderFromTheCursor) {
+    soci::session sql{soci::sqlite3, ":memory:"};
+    createChangeLog(sql);
+    logChange(sql, "INSERT", "a", {{"id", "a"}});
+    logChange(sql, "INSERT", "b", {{"id", "b"}});
+    logChange(sql, "DELETE", "a", nullptr);
+
+    const auto first = Replication::changesAfter(sql, 0, 2);
+    ASSERT_EQ(first["changes"].size(), 2u);
+    EXPECT_EQ(first["changes"][0]["row_id"], "a");
+    EXPECT_EQ(first["changes"][1]["new_data"]["id"], "b");
+    EXPECT_EQ(first["last_id"], 2);
+    EXPECT_EQ(first["head"], 3);
+    EXPECT_EQ(first["schema_version"], Replication::schemaVersion(sql));
+
+    const auto rest = Replication::changesAfter(sql, 2, 100);
+    ASSERT_EQ(rest["changes"].size(), 1u);
+    EXPECT_EQ(rest["changes"][0]["type"], "DELETE");
+    EXPECT_TRUE(rest["changes"][0]["new_data"].is_null());
+
+    const auto none = Replication::changesAfter(sql, 3, 100);
+    EXPECT_TRUE(none["changes"].empty());
+    EXPECT_EQ(none["last_id"], 3);
+}
+
+TEST(Replication, PrunedOrUnknownCursorsAreGone) {
+    soci::session sql{soci::sqlite3, ":memory:"};
+    createChangeLog(sql);
+    for (const auto *id: {"a", "b", "c"}) logChange(sql, "INSERT", id, {{"id", id}});
+    sql << "DELETE FROM mb_change_log WHERE id <= 2";
+
+    EXPECT_EQ(statusOf([&] { (void) Replication::changesAfter(sql, 0, 10); }), 410);
+    EXPECT_EQ(statusOf([&] { (void) Replication::changesAfter(sql, 9, 10); }), 410);
+    EXPECT_EQ(Replication::changesAfter(sql, 2, 10)["changes"].size(), 1u);
+
+    sql << "DELETE FROM mb_change_log";
+    EXPECT_EQ(statusOf([&] { (void) Replication::changesAfter(sql, 1, 10); }), 410);
+    EXPECT_TRUE(Replication::changesAfter(sql, 3, 10)["changes"].empty());
+}
+
+TEST(Replication, AppliesUpsertsAndDeletes) {
+    soci::session sql{soci::sqlite3, ":memory:"};
+    sql << "CREATE TABLE posts (id TEXT PRIMARY KEY, title TEXT, done INTEGER, meta TEXT)";
+
+    Replication::apply(sql, json::array({
+        {{"type", "INSERT"}, {"entity", "posts"}, {"row_id", "a"},
+         {"new_data", {{"id", "a"}, {"title", "first"}, {"done", 1}, {"meta", R"({"k":1})"}}}},
+        {{"type", "INSERT"}, {"entity", "posts"}, {"row_id", "b"}, {"new_data", {{"id", "b"}, {"title", "second"}}}},
+        {{"type", "UPDATE"}, {"entity", "posts"}, {"row_id", "a"},
+         {"new_data", {{"id", "a"}, {"title", "edited"}, {"done", 0}, {"meta", nullptr}}}},
+        {{"type", "DELETE"}, {"entity", "posts"}, {"row_id", "b"}, {"new_data", nullptr}},
+        {{"type", "IMPORT"}, {"entity", "posts"}, {"row_id", ""}, {"new_data", {{"imported", 2}}}},
+    }));
+
+    int rows = 0;
+    sql << "SELECT COUNT(*) FROM posts", soci::into(rows);
+    EXPECT_EQ(rows, 1);
+
+    std::string title;
+    int done = -1;
+    soci::indicator meta_ind;
+    std::string meta;
+    sql << "SELECT title, done, meta FROM posts WHERE id = 'a'", soci::into(title), soci::into(done),
+            soci::into(meta, meta_ind);
+    EXPECT_EQ(title, "edited");
+    EXPECT_EQ(done, 0);
+    EXPECT_EQ(meta_ind, soci::i_null);
+
+    EXPECT_THROW(Replication::apply(sql, json::array({
+                     {{"type", "INSERT"}, {"entity", "posts; DROP TABLE posts"}, {"row_id", "x"},
+                      {"new_data", {{"id", "x"}}}}})), std::exception);
+}
+
+TEST(Replication, CursorRoundTrips) {
+    soci::session sql{soci::sqlite3, ":memory:"};
+    EXPECT_FALSE(Replication::loadCursor(sql).has_value());
+
+    Replication::saveCursor(sql, {42, 7});
+    Replication::saveCursor(sql, {43, 7});
+    const auto cursor = Replication::loadCursor(sql);
+    ASSERT_TRUE(cursor.has_value());
+    EXPECT_EQ(cursor->changeId, 43);
+    EXPECT_EQ(cursor->schemaVersion, 7);
+}
@@ -0,0 +1,41 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/request_arena.h"
+#include "mantisbase/core/wire_format.h"
+#include "mantisbase/utils/json_parse.h"
+
+using mb::ArenaJson;
+using mb::RequestArena;
+
+TEST(RequestArena, ScopeSetsAndRestoresTheCurrentArena) {
+    EXPECT_EQ(RequestArena::current(), nullptr);
+    RequestArena outer, inner;
+    {
+        const RequestArena::Scope a(&outer);
+        EXPECT_EQ(RequestArena::current(), &outer);
+        {
+            const RequestArena::Scope b(&inner);
+            EXPECT_EQ(RequestArena::current(), &inner);
+        }
+        EXPECT_EQ(RequestArena::current(), &outer);
+    }
+    EXPECT_EQ(RequestArena::current(), nullptr);
+}
+
+TEST(RequestArena, DocumentsMatchTheirHeapTwins) {
+    const std::string text = R"({"data":{"items":[{"id":"a","n":1},{"id":"b","n":2.5}],"cursor":null},"status":200})";
+
+    // Built on the heap, destroyed inside a request: freed to the heap
+    auto heap = mb::parseArenaJson(text);
+    RequestArena arena;
+    {
+        const RequestArena::Scope scope(&arena);
+        const auto doc = mb::parseArenaJson(text);
+        EXPECT_EQ(doc["data"]["items"][1]["n"], 2.5);
+        EXPECT_EQ(doc.dump(), nlohmann::json::parse(text).dump());
+
+        for (const auto format: {mb::WireFormat::Format::MsgPack, mb::WireFormat::Format::Cbor})
+            EXPECT_EQ(mb::WireFormat::encode(format, doc), mb::WireFormat::encode(format, nlohmann::json::parse(text)));
+
+        heap = nullptr;
+    }
+}
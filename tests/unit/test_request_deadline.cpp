@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/request_deadline.h"
+#include "mantisbase/core/exceptions.h"
+
+#include <cstdlib>
+
+using namespace std::chrono_literals;
+using mb::RequestDeadline;
+
+namespace {
+    int codeOf(const std::function<void()> &call) {
+        try {
+            call();
+        } catch (const mb::MantisException &e) {
+            return e.code();
+        }
+        return 0;
+    }
+}
+
+TEST(RequestDeadline, ClientsMayOnlyShortenTheTimeout) {
+    setenv("MB_REQUEST_TIMEOUT_MS", "5000", 1);
+    const auto options = RequestDeadline::Options::fromEnv();
+    unsetenv("MB_REQUEST_TIMEOUT_MS");
+    EXPECT_TRUE(options.cancelOnClose);
+
+    EXPECT_EQ(options.timeoutFor(""), 5000ms);
+    EXPECT_EQ(options.timeoutFor("200"), 200ms);
+    EXPECT_EQ(options.timeoutFor("60000"), 5000ms);
+    EXPECT_EQ(options.timeoutFor("soon"), 5000ms);
+    // Without a server timeout the client's stands
+    EXPECT_EQ(RequestDeadline::Options{}.timeoutFor("200"), 200ms);
+    EXPECT_EQ(RequestDeadline::Options{}.timeoutFor(""), 0ms);
+}
+
+TEST(RequestDeadline, ChecksTheCurrentRequest) {
+    EXPECT_EQ(RequestDeadline::current(), nullptr);
+    EXPECT_EQ(codeOf(RequestDeadline::check), 0);
+
+    bool connected = true;
+    RequestDeadline open(RequestDeadline::Clock::time_point::max(), [&] { return connected; });
+    RequestDeadline past(RequestDeadline::Clock::now() - 1ms);
+    EXPECT_FALSE(open.bounded());
+    EXPECT_EQ(past.remaining(), RequestDeadline::Clock::duration::zero());
+    {
+        const RequestDeadline::Scope scope(&open);
+        EXPECT_EQ(codeOf(RequestDeadline::check), 0);
+        connected = false;
+        EXPECT_EQ(codeOf(RequestDeadline::check), RequestDeadline::CLIENT_CLOSED);
+        {
+            const RequestDeadline::Scope inner(&past);
+            EXPECT_EQ(codeOf(RequestDeadline::check), 504);
+            const RequestDeadline::Scope lifted(nullptr);
+            EXPECT_EQ(codeOf(RequestDeadline::check), 0);
+        }
+        EXPECT_EQ(RequestDeadline::current(), &open);
+    }
+    EXPECT_EQ(RequestDeadline::current(), nullptr);
+}
@@ -0,0 +1,37 @@
+#include <gtest/gtest.h>
+#include "mantisbase/utils/request_id.h"
+
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using mb::RequestId;
+
+TEST(RequestId, FormatsAsReqAndSixteenHexDigits) {
+    const auto id = RequestId::next();
+    const auto text = id.view();
+    ASSERT_EQ(text.size(), RequestId::LENGTH);
+    EXPECT_TRUE(text.starts_with("req_"));
+    EXPECT_EQ(std::stoull(std::string(text.substr(4)), nullptr, 16), id.value());
+
+    // Consecutive on one thread
+    EXPECT_EQ(RequestId::next().value(), id.value() + 1);
+}
+
+TEST(RequestId, UniqueAcrossThreads) {
+    std::mutex mutex;
+    std::set<std::uint64_t> seen;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&] {
+            std::vector<std::uint64_t> mine;
+            for (int i = 0; i < 1000; ++i) mine.push_back(RequestId::next().value());
+            std::lock_guard lock(mutex);
+            seen.insert(mine.begin(), mine.end());
+        });
+    }
+    for (auto &thread: threads) thread.join();
+    EXPECT_EQ(seen.size(), 8000u);
+}
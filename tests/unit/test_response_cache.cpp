@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/response_cache.h"
+
+using mb::ResponseCache;
+using nlohmann::json;
+
+namespace {
+    json event(const std::string &type, const std::string &entity, const std::string &row_id = "r1") {
+        return {{"type", type}, {"entity", entity}, {"row_id", row_id}};
+    }
+
+    ResponseCache::Options only(const std::string &entity) {
+        ResponseCache::Options options;
+        options.entities = {entity};
+        return options;
+    }
+}
+
+TEST(ResponseCache, ServesStoredBodiesOfOptedInEntities) {
+    ResponseCache cache(only("posts"));
+    EXPECT_TRUE(cache.enabledFor("posts"));
+    EXPECT_FALSE(cache.enabledFor("users"));
+
+    const auto etag = cache.put("posts", "list:a", cache.generation("posts"), R"({"data":[]})");
+    EXPECT_EQ(etag, ResponseCache::etag(R"({"data":[]})"));
+    EXPECT_EQ(etag.front(), '"');
+
+    const auto hit = cache.get("posts", "list:a");
+    ASSERT_TRUE(hit.has_value());
+    EXPECT_EQ(*hit->body, R"({"data":[]})");
+    EXPECT_EQ(hit->etag, etag);
+    EXPECT_FALSE(cache.get("posts", "list:b").has_value());
+
+    // Not opted in: tagged, never stored
+    cache.put("users", "list:a", 0, "{}");
+    EXPECT_FALSE(cache.get("users", "list:a").has_value());
+    EXPECT_EQ(cache.size(), 1u);
+    EXPECT_EQ(cache.hits(), 1u);
+}
+
+TEST(ResponseCache, ChangesDropListsAndTheChangedRow) {
+    ResponseCache cache(only("posts"));
+    const auto gen = cache.generation("posts");
+    cache.put("posts", "list:a", gen, "page");
+    cache.put("posts", "get:r1", gen, "one", "r1");
+    cache.put("posts", "get:r1:fields", gen, "one-fields", "r1");
+    cache.put("posts", "get:r2", gen, "two", "r2");
+
+    cache.onChanges(json::array({event("UPDATE", "posts", "r1"), event("DELETE", "users", "r2")}));
+    EXPECT_FALSE(cache.get("posts", "list:a").has_value());
+    EXPECT_FALSE(cache.get("posts", "get:r1").has_value());
+    EXPECT_FALSE(cache.get("posts", "get:r1:fields").has_value());
+    EXPECT_TRUE(cache.get("posts", "get:r2").has_value());
+
+    cache.invalidateEntity("posts");
+    EXPECT_EQ(cache.size(), 0u);
+    EXPECT_EQ(cache.bytes(), 0u);
+}
+
+TEST(ResponseCache, BodiesReadAcrossAChangeAreNotStored) {
+    ResponseCache cache(only("posts"));
+    const auto before = cache.generation("posts");
+    cache.onChanges(json::array({event("INSERT", "posts")}));
+
+    cache.put("posts", "list:a", before, "stale");
+    EXPECT_FALSE(cache.get("posts", "list:a").has_value());
+
+    cache.put("posts", "list:a", cache.generation("posts"), "fresh");
+    EXPECT_EQ(*cache.get("posts", "list:a")->body, "fresh");
+}
+
+TEST(ResponseCache, EvictsLeastRecentlyUsedPastTheBudget) {
+    auto options = only("posts");
+    options.maxBytes = 10;
+    options.maxEntryBytes = 6;
+    ResponseCache cache(options);
+
+    cache.put("posts", "a", 0, "aaaa");
+    cache.put("posts", "b", 0, "bbbb");
+    ASSERT_TRUE(cache.get("posts", "a").has_value());   // b is now the oldest
+    cache.put("posts", "c", 0, "cccc");
+    EXPECT_TRUE(cache.get("posts", "a").has_value());
+    EXPECT_FALSE(cache.get("posts", "b").has_value());
+    EXPECT_TRUE(cache.get("posts", "c").has_value());
+    EXPECT_EQ(cache.bytes(), 8u);
+
+    cache.put("posts", "big", 0, "0123456789");
+    EXPECT_FALSE(cache.get("posts", "big").has_value());
+}
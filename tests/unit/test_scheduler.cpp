@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/scheduler.h"
+#include "mantisbase/core/exceptions.h"
+
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <thread>
+
+namespace {
+    using namespace std::chrono;
+    using mb::CronSchedule;
+    using mb::Scheduler;
+
+    Scheduler::Clock::time_point at(const int y, const unsigned m, const unsigned d, const int h = 0, const int min = 0) {
+        return time_point_cast<Scheduler::Clock::duration>(
+            sys_days(year_month_day(year(y), month(m), day(d))) + hours(h) + minutes(min));
+    }
+
+    /// Wait for `job` to finish `runs` runs (or be handed elsewhere) and stop running
+    Scheduler::JobStats settled(const Scheduler &scheduler, const std::string &job, const std::uint64_t runs) {
+        for (int i = 0; i < 500; ++i) {
+            for (const auto &stats: scheduler.stats())
+                if (stats.name == job && !stats.running && stats.runs + stats.elsewhere >= runs) return stats;
+            std::this_thread::sleep_for(milliseconds(5));
+        }
+        ADD_FAILURE() << "Job " << job << " never settled";
+        return {};
+    }
+}
+
+TEST(CronSchedule, ParsesFieldsAndMacros) {
+    const auto start = at(2026, 3, 14, 10, 7); // a Saturday
+
+    EXPECT_EQ(CronSchedule::parse("* * * * *").next(start), at(2026, 3, 14, 10, 8));
+    EXPECT_EQ(CronSchedule::parse("*/15 * * * *").next(start), at(2026, 3, 14, 10, 15));
+    EXPECT_EQ(CronSchedule::parse("5,40 9-11 * * *").next(start), at(2026, 3, 14, 10, 40));
+    EXPECT_EQ(CronSchedule::parse("30 2 * * *").next(start), at(2026, 3, 15, 2, 30));
+    EXPECT_EQ(CronSchedule::parse("0 8 * * mon-fri").next(start), at(2026, 3, 16, 8, 0));
+    EXPECT_EQ(CronSchedule::parse("0 0 * * 7").next(start), at(2026, 3, 15));
+    EXPECT_EQ(CronSchedule::parse("0 0 29 feb *").next(start), at(2028, 2, 29));
+    EXPECT_EQ(CronSchedule::parse("@hourly").next(start), at(2026, 3, 14, 11, 0));
+    EXPECT_EQ(CronSchedule::parse("@monthly").next(start), at(2026, 4, 1));
+    EXPECT_EQ(CronSchedule::parse("@yearly").next(start), at(2027, 1, 1));
+
+    // Both day fields restricted: either one matches
+    EXPECT_EQ(CronSchedule::parse("0 0 1 * mon").next(start), at(2026, 3, 16));
+
+    // A tick is strictly after `after`
+    EXPECT_EQ(CronSchedule::parse("7 10 * * *").next(start), at(2026, 3, 15, 10, 7));
+
+    // `@every` ticks are multiples of the interval, alike on every node
+    const auto every = CronSchedule::parse("@every 10s");
+    EXPECT_EQ(every.next(start + seconds(3)), start + seconds(10));
+    EXPECT_EQ(every.next(start + seconds(10)), start + seconds(20));
+
+    EXPECT_EQ(CronSchedule::parse("0 0 31 2 *").next(start), Scheduler::Clock::time_point::max());
+
+    for (const auto *bad: {"", "* * * *", "60 * * * *", "* 24 * * *", "* * 0 * *", "*/0 * * * *", "5-1 * * * *",
+                           "x * * * *", "@fortnightly", "@every", "@every 10", "@every 0s", "@every 5d"})
+        EXPECT_THROW((void) CronSchedule::parse(bad), mb::MantisException) << bad;
+}
+
+TEST(Scheduler, RunsDueJobsOnceAndSkipsOverlaps) {
+    Scheduler scheduler({1, "test"});
+    EXPECT_THROW(scheduler.add({"never", "0 0 31 2 *", [] {}}), mb::MantisException);
+    EXPECT_THROW(scheduler.add({"", "@hourly", [] {}}), mb::MantisException);
+
+    std::atomic<int> runs{0};
+    std::atomic<bool> release{false};
+    scheduler.add({"slow", "@every 1h", [&] {
+        ++runs;
+        while (!release) std::this_thread::sleep_for(milliseconds(1));
+    }});
+    scheduler.add({"broken", "@every 1h", [] { throw std::runtime_error("boom"); }});
+    scheduler.start();
+
+    const auto later = Scheduler::Clock::now() + hours(2);
+    EXPECT_EQ(scheduler.tick(later), 2);
+    // Not due again until the next tick
+    EXPECT_EQ(scheduler.tick(later), 0);
+
+    // Due again while the first run goes on: skipped, not queued behind it
+    (void) settled(scheduler, "broken", 1);
+    EXPECT_EQ(scheduler.tick(later + hours(1)), 1);
+    release = true;
+    const auto slow = settled(scheduler, "slow", 1);
+    EXPECT_EQ(runs, 1);
+    EXPECT_EQ(slow.skipped, 1);
+    EXPECT_EQ(slow.failures, 0);
+
+    const auto broken = settled(scheduler, "broken", 2);
+    EXPECT_EQ(broken.runs, 2);
+    EXPECT_EQ(broken.failures, 2);
+
+    EXPECT_TRUE(scheduler.remove("slow"));
+    EXPECT_FALSE(scheduler.remove("slow"));
+    scheduler.stop();
+    EXPECT_FALSE(scheduler.isRunning());
+}
+
+TEST(Scheduler, LeasedJobsRunOncePerTickAcrossNodes) {
+    // Two nodes sharing one lease table
+    std::mutex mutex;
+    std::map<std::string, std::int64_t> leases;
+    const Scheduler::Lease lease = [&](const std::string &job, const std::int64_t tick) {
+        std::lock_guard lock(mutex);
+        auto &held = leases[job];
+        if (held >= tick) return false;
+        held = tick;
+        return true;
+    };
+
+    std::atomic<int> runs{0};
+    Scheduler a({1, "a"}, lease), b({1, "b"}, lease);
+    for (auto *node: {&a, &b}) {
+        node->add({"digest", "@every 1h", [&] { ++runs; }, seconds(0), true});
+        node->start();
+    }
+
+    const auto later = Scheduler::Clock::now() + hours(2);
+    EXPECT_EQ(a.tick(later), 1);
+    EXPECT_EQ(b.tick(later), 1);
+    const auto on_a = settled(a, "digest", 1), on_b = settled(b, "digest", 1);
+    EXPECT_EQ(runs, 1);
+    EXPECT_EQ(on_a.runs + on_b.runs, 1);
+    EXPECT_EQ(on_a.elsewhere + on_b.elsewhere, 1);
+
+    // The next tick is up for grabs again
+    (void) a.tick(later + hours(1));
+    (void) settled(a, "digest", 2);
+    EXPECT_EQ(runs, 2);
+}
+
+TEST(Scheduler, SingletonJobsRunOnTheLeaderOnly) {
+    std::atomic<bool> leading{false};
+    std::atomic<int> runs{0};
+    Scheduler scheduler({1, "a"});
+    scheduler.setLeadership([&] { return leading.load(); });
+    scheduler.add({"prune", "@every 1h", [&] { ++runs; }, seconds(0), false, true});
+    scheduler.add({"flush", "@every 1h", [&] { ++runs; }});
+    scheduler.start();
+
+    const auto later = Scheduler::Clock::now() + hours(2);
+    EXPECT_EQ(scheduler.tick(later), 2);
+    const auto followed = settled(scheduler, "prune", 1);
+    (void) settled(scheduler, "flush", 1);
+    EXPECT_TRUE(followed.singleton);
+    EXPECT_EQ(followed.elsewhere, 1);
+    EXPECT_EQ(runs, 1);
+
+    // Every tick asks again, so a node that takes over runs the next one
+    leading = true;
+    (void) scheduler.tick(later + hours(1));
+    EXPECT_EQ(settled(scheduler, "prune", 2).runs, 1);
+    (void) settled(scheduler, "flush", 2);
+    EXPECT_EQ(runs, 3);
+}
@@ -0,0 +1,210 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include "../../include/mantisbase/core/exceptions.h"
+#include "../../include/mantisbase/core/script_heaps.h"
+
+using namespace mb;
+
+namespace {
+    int evalInt(duk_context *ctx, const char *code) {
+        duk_eval_string(ctx, code);
+        const int value = duk_get_int(ctx, -1);
+        duk_pop(ctx);
+        return value;
+    }
+}
+
+TEST(ScriptHeapsTest, InitRunsOncePerHeap) {
+    int inits = 0;
+    ScriptHeaps heaps([&](duk_context *ctx) {
+        ++inits;
+        duk_push_int(ctx, 7);
+        duk_put_global_string(ctx, "seven");
+    });
+
+    const auto ctx = heaps.current();
+    ASSERT_NE(ctx, nullptr);
+    EXPECT_EQ(heaps.current(), ctx);
+    EXPECT_EQ(inits, 1);
+    EXPECT_EQ(evalInt(ctx, "seven"), 7);
+}
+
+TEST(ScriptHeapsTest, EachThreadGetsItsOwnHeapRunningTheScripts) {
+    ScriptHeaps heaps([](duk_context *) {});
+    heaps.load("index.mantis.js", "var counter = 0; function bump() { return ++counter; }");
+
+    const auto mine = heaps.current();
+    EXPECT_EQ(evalInt(mine, "bump()"), 1);
+
+    std::vector<duk_context *> theirs(4);
+    std::vector<int> bumps(4);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&, i] {
+            theirs[i] = heaps.current();
+            for (int n = 0; n < 1000; ++n) bumps[i] = evalInt(theirs[i], "bump()");
+        });
+    }
+    for (auto &t: threads) t.join();
+
+    for (int i = 0; i < 4; ++i) {
+        EXPECT_NE(theirs[i], mine);
+        EXPECT_EQ(bumps[i], 1000); // globals are per heap
+    }
+    EXPECT_EQ(heaps.size(), 5u);
+    EXPECT_EQ(evalInt(mine, "counter"), 1);
+}
+
+TEST(ScriptHeapsTest, LateScriptsReachExistingHeaps) {
+    ScriptHeaps heaps([](duk_context *) {});
+
+    duk_context *other = nullptr;
+    std::thread([&] { other = heaps.current(); }).join();
+
+    heaps.load("a.js", "var a = 1;");
+    heaps.load("b.js", "var b = a + 1;");
+    EXPECT_EQ(heaps.scripts(), 2u);
+
+    int b = 0;
+    std::thread([&] {
+        // A recycled thread id would find the old heap; either way it must be caught up
+        b = evalInt(heaps.current(), "typeof b === 'number' ? b : -1");
+    }).join();
+    EXPECT_EQ(b, 2);
+    EXPECT_NE(other, nullptr);
+}
+
+TEST(ScriptHeapsTest, FailingScriptsThrowAndAreNotShared) {
+    ScriptHeaps heaps([](duk_context *) {});
+
+    EXPECT_THROW(heaps.load("syntax.js", "var = ;"), MantisException);
+    EXPECT_THROW(heaps.load("throws.js", "var half = 1; throw new Error('boom');"), MantisException);
+    EXPECT_EQ(heaps.scripts(), 0u);
+
+    int half = 0;
+    std::thread([&] { half = evalInt(heaps.current(), "typeof half === 'undefined' ? 0 : 1"); }).join();
+    EXPECT_EQ(half, 0);
+}
+
+TEST(ScriptHeapsTest, CachedBytecodeSkipsTheCompile) {
+    const auto dir = std::filesystem::temp_directory_path() / "mb_test_script_cache";
+    std::filesystem::remove_all(dir);
+
+    {
+        ScriptHeaps heaps([](duk_context *) {}, dir);
+        heaps.load("index.mantis.js", "var answer = 42;");
+        EXPECT_EQ(heaps.compiles(), 1u);
+    }
+
+    {
+        ScriptHeaps heaps([](duk_context *) {}, dir);
+        heaps.load("index.mantis.js", "var answer = 42;");
+        EXPECT_EQ(heaps.compiles(), 0u);
+        EXPECT_EQ(evalInt(heaps.current(), "answer"), 42);
+
+        // An edited script is compiled again
+        heaps.load("index.mantis.js", "var answer = 43;");
+        EXPECT_EQ(heaps.compiles(), 1u);
+        EXPECT_EQ(evalInt(heaps.current(), "answer"), 43);
+    }
+
+    // A damaged entry is compiled over, never handed to Duktape
+    for (const auto &entry: std::filesystem::directory_iterator(dir)) {
+        std::ofstream out(entry.path(), std::ios::binary | std::ios::app);
+        out << "garbage";
+    }
+    {
+        ScriptHeaps heaps([](duk_context *) {}, dir);
+        heaps.load("index.mantis.js", "var answer = 42;");
+        EXPECT_EQ(heaps.compiles(), 1u);
+        EXPECT_EQ(evalInt(heaps.current(), "answer"), 42);
+    }
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST(ScriptHeapsTest, BudgetStopsRunawayScripts) {
+    using namespace std::chrono_literals;
+    ScriptHeaps heaps([](duk_context *) {});
+    heaps.load("spin.js", "function spin() { for (;;) { try { while (true) {} } catch (e) {} } }"
+                          "function quick() { return 1; }");
+    const auto ctx = heaps.current();
+
+    {
+        const ScriptHeaps::Budget budget(ctx, 50ms);
+        duk_get_global_string(ctx, "spin");
+        EXPECT_NE(duk_pcall(ctx, 0), DUK_EXEC_SUCCESS); // the script's own catch doesn't keep it going
+        duk_pop(ctx);
+        EXPECT_TRUE(budget.exceeded());
+    }
+
+    // The heap is usable again once the budget is gone
+    {
+        const ScriptHeaps::Budget budget(ctx, 50ms);
+        EXPECT_EQ(evalInt(ctx, "quick()"), 1);
+        EXPECT_FALSE(budget.exceeded());
+    }
+
+    ScriptHeaps::Budgets budgets;
+    budgets.overrides["beforeRecordCreate"] = 200ms;
+    EXPECT_EQ(budgets.of("beforeRecordCreate"), 200ms);
+    EXPECT_EQ(budgets.of("onRecordCreated"), 1000ms);
+}
+
+TEST(ScriptHeapsTest, ReloadSwapsTheScriptsAtCheckpoints) {
+    int inits = 0;
+    ScriptHeaps heaps([&](duk_context *) { ++inits; });
+    heaps.load("index.mantis.js", "function version() { return 1; }");
+    const auto before = heaps.current();
+
+    // A worker heap made before the reload
+    std::atomic<int> seen{0};
+    std::atomic<bool> reloaded{false};
+    std::thread worker([&] {
+        seen = evalInt(heaps.current(), "version()");
+        while (!reloaded) std::this_thread::yield();
+        // Mid-request: still the old scripts
+        seen = seen * 10 + evalInt(heaps.current(), "version()");
+        heaps.checkpoint();
+        seen = seen * 10 + evalInt(heaps.current(), "typeof extra === 'number' ? version() + extra : -1");
+    });
+    while (seen == 0) std::this_thread::yield();
+
+    EXPECT_EQ(heaps.reload([&] {
+        heaps.load("index.mantis.js", "function version() { return 2; }");
+        heaps.load("extra.js", "var extra = 1;");
+    }), 2u);
+    EXPECT_EQ(heaps.generation(), 1u);
+    EXPECT_EQ(heaps.scripts(), 2u);
+    reloaded = true;
+    worker.join();
+
+    EXPECT_EQ(seen, 113);
+    EXPECT_NE(heaps.current(), before);
+    EXPECT_EQ(evalInt(heaps.current(), "version()"), 2);
+    EXPECT_EQ(inits, 4); // two heaps, each made again for the new scripts
+}
+
+TEST(ScriptHeapsTest, FailedReloadKeepsTheOldScripts) {
+    ScriptHeaps heaps([](duk_context *) {});
+    heaps.load("index.mantis.js", "function version() { return 1; }");
+    const auto ctx = heaps.current();
+
+    EXPECT_THROW(heaps.reload([&] {
+        heaps.load("index.mantis.js", "function version() { return 2; }");
+        // Swallowed like MantisBase::loadAndExecuteScript() does; the reload still fails
+        try { heaps.load("broken.js", "var = ;"); } catch (const MantisException &) {}
+    }), MantisException);
+
+    EXPECT_EQ(heaps.generation(), 0u);
+    EXPECT_EQ(heaps.scripts(), 1u);
+    EXPECT_EQ(heaps.current(), ctx);
+    heaps.checkpoint();
+    EXPECT_EQ(evalInt(heaps.current(), "version()"), 1);
+}
@@ -0,0 +1,42 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/server_timing.h"
+
+using namespace std::chrono_literals;
+using mb::ServerTiming;
+
+TEST(ServerTiming, SpansRecordNothingWithoutATiming) {
+    EXPECT_EQ(ServerTiming::current(), nullptr);
+    {
+        const ServerTiming::Span span("auth");
+    }
+    EXPECT_EQ(ServerTiming::current(), nullptr);
+}
+
+TEST(ServerTiming, SumsSpansByNameInFirstSeenOrder) {
+    ServerTiming timing;
+    timing.add("auth", 1ms);
+    timing.add("db", 2500us);
+    timing.add("auth", 500us);
+    EXPECT_EQ(timing.header(5ms), "auth;dur=1.500, db;dur=2.500, total;dur=5.000");
+}
+
+TEST(ServerTiming, ScopeSetsAndRestoresTheCurrentTiming) {
+    ServerTiming outer, inner;
+    {
+        const ServerTiming::Scope a(&outer);
+        EXPECT_EQ(ServerTiming::current(), &outer);
+        {
+            const ServerTiming::Scope b(&inner);
+            EXPECT_EQ(ServerTiming::current(), &inner);
+            const ServerTiming::Span span("rules");
+        }
+        EXPECT_EQ(ServerTiming::current(), &outer);
+        {
+            const ServerTiming::Scope none(nullptr);
+            const ServerTiming::Span span("ignored");
+        }
+    }
+    EXPECT_EQ(ServerTiming::current(), nullptr);
+    EXPECT_EQ(outer.header(0ns), "total;dur=0.000");
+    EXPECT_TRUE(inner.header(0ns).starts_with("rules;dur="));
+}
@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/database.h"
+#include "mantisbase/core/session_store.h"
+#include "mantisbase/mantisbase.h"
+#include "mantisbase/utils/utils.h"
+#include "../common/test_environment.h"
+
+#include <soci/soci.h>
+#include <thread>
+
+using mb::SessionStore;
+
+namespace {
+    int sessionRows(const std::string &like) {
+        int count = 0;
+        auto sql = mb::MantisBase::instance().db().session();
+        *sql << "SELECT COUNT(*) FROM mb_sessions WHERE id LIKE :p", soci::use(like), soci::into(count);
+        return count;
+    }
+
+    SessionStore::Session session(const std::string &id, const std::string &expires_at) {
+        return {id, "users", "u1", "hash", expires_at, mb::getCurrentTimestampUTC()};
+    }
+}
+
+TEST(SessionStore, WritesQueuedSessionsInGroups) {
+    SessionStore store({.flushInterval = std::chrono::milliseconds(50), .sweepInterval = std::chrono::seconds(0)});
+    store.start();
+
+    for (int i = 0; i < 10; ++i) store.add(session("ss_group_" + std::to_string(i), "2999-01-01 00:00:00"));
+    EXPECT_TRUE(store.pending("ss_group_0"));
+
+    for (int i = 0; i < 100 && store.written() < 10; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_EQ(store.written(), 10u);
+    EXPECT_FALSE(store.pending("ss_group_0"));
+    EXPECT_EQ(sessionRows("ss_group_%"), 10);
+    store.stop();
+}
+
+TEST(SessionStore, CancelledSessionsAreNeverWritten) {
+    SessionStore store({.flushInterval = std::chrono::seconds(10), .sweepInterval = std::chrono::seconds(0)});
+    store.start();
+
+    store.add(session("ss_cancel_1", "2999-01-01 00:00:00"));
+    EXPECT_TRUE(store.cancel("ss_cancel_1"));
+    EXPECT_FALSE(store.cancel("ss_cancel_1"));
+    store.stop();
+    EXPECT_EQ(sessionRows("ss_cancel_%"), 0);
+
+    // Stopped, it writes straight away
+    store.add(session("ss_cancel_2", "2999-01-01 00:00:00"));
+    EXPECT_FALSE(store.pending("ss_cancel_2"));
+    EXPECT_EQ(sessionRows("ss_cancel_%"), 1);
+}
+
+TEST(SessionStore, SweepsExpiredSessionsInChunks) {
+    SessionStore store({.sweepInterval = std::chrono::seconds(0), .sweepBatch = 2});
+    for (int i = 0; i < 5; ++i) store.add(session("ss_sweep_old_" + std::to_string(i), "2000-01-01 00:00:00"));
+    store.add(session("ss_sweep_live", "2999-01-01 00:00:00"));
+    ASSERT_EQ(sessionRows("ss_sweep_%"), 6);
+
+    EXPECT_GE(store.sweep(), 5u);
+    EXPECT_EQ(sessionRows("ss_sweep_old_%"), 0);
+    EXPECT_EQ(sessionRows("ss_sweep_live"), 1);
+}
@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/slow_query_log.h"
+
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+
+using namespace std::chrono_literals;
+using mb::SlowQueryLog;
+using nlohmann::json;
+
+TEST(SlowQueryLog, NormalizesLiteralsAndPlaceholders) {
+    EXPECT_EQ(SlowQueryLog::normalize("SELECT *  FROM posts\n WHERE id = :id AND n > 42 -- latest\n LIMIT 10"),
+              "SELECT * FROM posts WHERE id = ? AND n > ? LIMIT ?");
+    EXPECT_EQ(SlowQueryLog::normalize("SELECT 'it''s', \"col 1\", t2.x FROM t2 WHERE y = $1::text"),
+              "SELECT ?, \"col 1\", t2.x FROM t2 WHERE y = ?::text");
+    EXPECT_EQ(SlowQueryLog::normalize("DELETE FROM a WHERE id IN (1, 2, 3)"),
+              SlowQueryLog::normalize("DELETE FROM a WHERE id IN (:a,:b)"));
+    EXPECT_EQ(SlowQueryLog::normalize("SELECT /* hint */ 1.5e-3"), "SELECT ?");
+
+    const auto id = SlowQueryLog::fingerprint("SELECT ?");
+    EXPECT_EQ(id.size(), 16u);
+    EXPECT_EQ(id, SlowQueryLog::fingerprint("SELECT ?"));
+    EXPECT_NE(id, SlowQueryLog::fingerprint("SELECT ?, ?"));
+}
+
+TEST(SlowQueryLog, ShapesAndExplainable) {
+    EXPECT_EQ(SlowQueryLog::shapeOf("NULL"), "null");
+    EXPECT_EQ(SlowQueryLog::shapeOf("-12"), "int");
+    EXPECT_EQ(SlowQueryLog::shapeOf("0.25"), "real");
+    EXPECT_EQ(SlowQueryLog::shapeOf("'hello'"), "text(5)");
+
+    EXPECT_TRUE(SlowQueryLog::explainable("  select 1"));
+    EXPECT_TRUE(SlowQueryLog::explainable("WITH x AS (SELECT 1) SELECT * FROM x"));
+    EXPECT_FALSE(SlowQueryLog::explainable("PRAGMA journal_mode=WAL"));
+    EXPECT_FALSE(SlowQueryLog::explainable("COMMIT"));
+}
+
+TEST(SlowQueryLog, RecordsSlowStatementsWithPlans) {
+    setenv("MB_SLOW_QUERY_MS", "0", 1);
+    EXPECT_EQ(SlowQueryLog::Options::fromEnv().threshold, 0ms);
+    unsetenv("MB_SLOW_QUERY_MS");
+    EXPECT_EQ(SlowQueryLog::Options::fromEnv().threshold, 500ms);
+
+    std::mutex mutex;
+    std::vector<json> stored;
+    int explained = 0;
+    SlowQueryLog log({.threshold = 5ms},
+                     [&](const std::string &) {
+                         ++explained;
+                         return json::array({"SCAN posts"});
+                     },
+                     [&](const json &entry) {
+                         std::lock_guard lock(mutex);
+                         stored.push_back(entry);
+                     });
+    EXPECT_FALSE(SlowQueryLog::slow(1s)); // not started
+    log.start();
+    EXPECT_TRUE(SlowQueryLog::slow(5ms));
+    EXPECT_FALSE(SlowQueryLog::slow(4ms));
+
+    SlowQueryLog::clearParameters();
+    SlowQueryLog::parameter("'abc'");
+    SlowQueryLog::statement("SELECT * FROM posts WHERE title = :title");
+    std::this_thread::sleep_for(10ms);
+    SlowQueryLog::endStatement();
+
+    SlowQueryLog::statement("SELECT 1"); // fast, not recorded
+    SlowQueryLog::endStatement();
+    SlowQueryLog::record({"SELECT * FROM posts WHERE title = 'x'", {}, 20ms, std::nullopt});
+    log.stop();
+    EXPECT_FALSE(SlowQueryLog::slow(1s));
+
+    ASSERT_EQ(stored.size(), 2u);
+    EXPECT_EQ(stored[0]["query"], "SELECT * FROM posts WHERE title = ?");
+    EXPECT_EQ(stored[0]["params"], json::array({"text(3)"}));
+    EXPECT_GE(stored[0]["duration_ms"].get<double>(), 10.0);
+    EXPECT_EQ(stored[0]["plan"], json::array({"SCAN posts"}));
+
+    // Same fingerprint: its plan was captured moments ago
+    EXPECT_EQ(stored[1]["fingerprint"], stored[0]["fingerprint"]);
+    EXPECT_TRUE(stored[1]["plan"].is_null());
+    EXPECT_EQ(explained, 1);
+}
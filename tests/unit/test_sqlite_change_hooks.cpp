@@ -0,0 +1,130 @@
+#include <gtest/gtest.h>
+#include <soci/soci.h>
+#include <soci/sqlite3/soci-sqlite3.h>
+#include "mantisbase/core/sqlite_change_hooks.h"
+
+#include <filesystem>
+
+namespace fs = std::filesystem;
+using mb::SqliteChangeHooks;
+
+class SqliteChangeHooksTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        if (!SqliteChangeHooks::available()) GTEST_SKIP() << "SQLite built without the preupdate hook";
+        dir = fs::temp_directory_path() / ("mb_change_hooks_" + std::to_string(::testing::UnitTest::GetInstance()->random_seed())
+                                           + "_" + ::testing::UnitTest::GetInstance()->current_test_info()->name());
+        fs::remove_all(dir);
+        fs::create_directories(dir);
+
+        sql = std::make_unique<soci::session>(soci::sqlite3, (dir / "data.db").string());
+        *sql << "PRAGMA journal_mode=WAL";
+        *sql << "CREATE TABLE posts (id TEXT PRIMARY KEY, title TEXT, views INTEGER, score REAL, cover BLOB)";
+        *sql << "CREATE TABLE notes (id TEXT PRIMARY KEY)";
+
+        hooks = std::make_unique<SqliteChangeHooks>([this](mb::json events) {
+            for (auto &event: events) published.push_back(std::move(event));
+        });
+        hooks->attach(*sql);
+        hooks->describe("posts", {{"id", "title", "views", "score", "cover"}, {false, false, false, false, true}, 0});
+        hooks->describe("notes", {{"id"}, {}, 0});
+    }
+
+    void TearDown() override {
+        hooks.reset();
+        sql.reset();
+        fs::remove_all(dir);
+    }
+
+    fs::path dir;
+    std::unique_ptr<soci::session> sql;
+    std::unique_ptr<SqliteChangeHooks> hooks;
+    std::vector<mb::json> published;
+};
+
+TEST_F(SqliteChangeHooksTest, PublishesRowImagesOnCommit) {
+    *sql << "INSERT INTO posts VALUES ('a', 'Hi', 3, 1.5, x'00ff')";
+    ASSERT_EQ(published.size(), 1u);
+    EXPECT_EQ(published[0]["type"], "INSERT");
+    EXPECT_EQ(published[0]["entity"], "posts");
+    EXPECT_EQ(published[0]["row_id"], "a");
+    EXPECT_TRUE(published[0]["old_data"].is_null());
+    EXPECT_EQ(published[0]["new_data"], (mb::json{{"id", "a"}, {"title", "Hi"}, {"views", 3}, {"score", 1.5}}));
+
+    *sql << "UPDATE posts SET title = NULL, views = views + 1 WHERE id = 'a'";
+    ASSERT_EQ(published.size(), 2u);
+    EXPECT_EQ(published[1]["type"], "UPDATE");
+    EXPECT_EQ(published[1]["old_data"]["title"], "Hi");
+    EXPECT_TRUE(published[1]["new_data"]["title"].is_null());
+    EXPECT_EQ(published[1]["new_data"]["views"], 4);
+
+    *sql << "DELETE FROM posts WHERE id = 'a'";
+    ASSERT_EQ(published.size(), 3u);
+    EXPECT_EQ(published[2]["type"], "DELETE");
+    EXPECT_EQ(published[2]["row_id"], "a");
+    EXPECT_TRUE(published[2]["new_data"].is_null());
+}
+
+TEST_F(SqliteChangeHooksTest, HoldsChangesUntilTheTransactionCommits) {
+    *sql << "BEGIN";
+    *sql << "INSERT INTO notes VALUES ('a')";
+    *sql << "INSERT INTO notes VALUES ('b')";
+    EXPECT_TRUE(published.empty());
+    *sql << "COMMIT";
+    ASSERT_EQ(published.size(), 2u);
+    EXPECT_EQ(published[1]["row_id"], "b");
+
+    *sql << "BEGIN";
+    *sql << "INSERT INTO notes VALUES ('c')";
+    *sql << "ROLLBACK";
+    *sql << "INSERT INTO notes VALUES ('d')";
+    ASSERT_EQ(published.size(), 3u);
+    EXPECT_EQ(published[2]["row_id"], "d");
+}
+
+TEST_F(SqliteChangeHooksTest, RewindDropsRowsOfARolledBackSavepoint) {
+    *sql << "BEGIN";
+    *sql << "INSERT INTO notes VALUES ('a')";
+    const auto mark = SqliteChangeHooks::mark(*sql);
+    *sql << "SAVEPOINT job";
+    *sql << "INSERT INTO notes VALUES ('b')";
+    *sql << "ROLLBACK TO job";
+    SqliteChangeHooks::rewind(*sql, mark);
+    *sql << "RELEASE job";
+    *sql << "COMMIT";
+    ASSERT_EQ(published.size(), 1u);
+    EXPECT_EQ(published[0]["row_id"], "a");
+}
+
+TEST_F(SqliteChangeHooksTest, MutedAndUndescribedTablesAreNotCaptured) {
+    *sql << "CREATE TABLE other (id TEXT)";
+    *sql << "INSERT INTO other VALUES ('a')";
+    EXPECT_TRUE(published.empty());
+
+    // Muted for the transaction only
+    *sql << "BEGIN";
+    SqliteChangeHooks::mute(*sql, "notes");
+    *sql << "INSERT INTO notes VALUES ('a')";
+    *sql << "INSERT INTO posts (id) VALUES ('a')";
+    *sql << "COMMIT";
+    ASSERT_EQ(published.size(), 1u);
+    EXPECT_EQ(published[0]["entity"], "posts");
+
+    *sql << "INSERT INTO notes VALUES ('b')";
+    EXPECT_EQ(published.size(), 2u);
+
+    hooks->forget("notes");
+    *sql << "INSERT INTO notes VALUES ('c')";
+    EXPECT_EQ(published.size(), 2u);
+}
+
+TEST_F(SqliteChangeHooksTest, StaleLayoutsAreSkipped) {
+    *sql << "ALTER TABLE notes ADD COLUMN body TEXT";
+    *sql << "INSERT INTO notes VALUES ('a', 'x')";
+    EXPECT_TRUE(published.empty());
+
+    hooks->describe("notes", {{"id", "body"}, {}, 0});
+    *sql << "INSERT INTO notes VALUES ('b', 'y')";
+    ASSERT_EQ(published.size(), 1u);
+    EXPECT_EQ(published[0]["new_data"]["body"], "y");
+}
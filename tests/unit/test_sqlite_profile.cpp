@@ -0,0 +1,60 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/sqlite_profile.h"
+#include "mantisbase/core/exceptions.h"
+
+using mb::SqliteProfile;
+
+TEST(SqliteProfile, PresetsDifferFromDefault) {
+    for (const auto &name: SqliteProfile::presetNames())
+        ASSERT_TRUE(SqliteProfile::preset(name).has_value()) << name;
+    EXPECT_FALSE(SqliteProfile::preset("fast").has_value());
+
+    const auto defaults = *SqliteProfile::preset("default");
+    EXPECT_EQ(defaults, SqliteProfile{});
+    EXPECT_EQ(defaults.busyTimeoutMs, 30000); // the connection string's old timeout=30
+
+    const auto read = *SqliteProfile::preset("read-heavy");
+    EXPECT_GT(read.mmapSize, 0);
+    EXPECT_EQ(read.tempStore, 2);
+    EXPECT_NE(read, defaults);
+    EXPECT_NE(read, *SqliteProfile::preset("write-heavy"));
+}
+
+TEST(SqliteProfile, OverridesApplyOnTopOfPreset) {
+    const auto p = SqliteProfile::fromJson({{"preset", "write-heavy"}, {"cache_size", -4096},
+                                            {"temp_store", "file"}});
+    EXPECT_EQ(p.name, "write-heavy");
+    EXPECT_EQ(p.cacheSize, -4096);
+    EXPECT_EQ(p.tempStore, 1);
+    EXPECT_EQ(p.mmapSize, SqliteProfile::preset("write-heavy")->mmapSize);
+
+    EXPECT_EQ(SqliteProfile::fromJson("read-heavy"), *SqliteProfile::preset("read-heavy"));
+    EXPECT_EQ(SqliteProfile::fromJson(mb::json::object()), SqliteProfile{});
+}
+
+TEST(SqliteProfile, RoundTripsThroughJson) {
+    const auto p = SqliteProfile::fromJson({{"preset", "read-heavy"}, {"busy_timeout", 1234}});
+    EXPECT_EQ(SqliteProfile::fromJson(p.toJson()), p);
+    EXPECT_EQ(p.toJson()["temp_store"], "memory");
+}
+
+TEST(SqliteProfile, RejectsInvalidValues) {
+    EXPECT_THROW(SqliteProfile::fromJson("fast"), mb::MantisException);
+    EXPECT_THROW(SqliteProfile::fromJson(42), mb::MantisException);
+    EXPECT_THROW(SqliteProfile::fromJson({{"mmap_size", -1}}), mb::MantisException);
+    EXPECT_THROW(SqliteProfile::fromJson({{"page_size", 3000}}), mb::MantisException);
+    EXPECT_THROW(SqliteProfile::fromJson({{"page_size", "4096"}}), mb::MantisException);
+    EXPECT_THROW(SqliteProfile::fromJson({{"temp_store", "disk"}}), mb::MantisException);
+    EXPECT_THROW(SqliteProfile::fromJson({{"journal_mode", "delete"}}), mb::MantisException);
+}
+
+TEST(SqliteProfile, PragmasCarryEveryValue) {
+    const auto p = *SqliteProfile::preset("read-heavy");
+    const auto pragmas = p.pragmas();
+    ASSERT_EQ(pragmas.size(), 4u);
+    EXPECT_EQ(pragmas[0], "PRAGMA busy_timeout=5000");
+    EXPECT_EQ(pragmas[1], "PRAGMA cache_size=-32768");
+    EXPECT_EQ(pragmas[2], "PRAGMA temp_store=2");
+    EXPECT_EQ(pragmas[3], "PRAGMA mmap_size=268435456");
+    EXPECT_EQ(p.pageSizePragma(), "PRAGMA page_size=8192");
+}
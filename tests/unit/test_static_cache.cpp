@@ -0,0 +1,124 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/static_cache.h"
+
+#include <drogon/HttpRequest.h>
+
+#include <filesystem>
+#include <fstream>
+
+using mb::StaticCache;
+namespace fs = std::filesystem;
+
+namespace {
+    std::string mimeOf(const std::string &path) {
+        if (path.ends_with(".html")) return "text/html";
+        if (path.ends_with(".js")) return "application/javascript";
+        return "application/octet-stream";
+    }
+
+    struct PublicDir {
+        fs::path root = fs::temp_directory_path() /
+                       (std::string("mb_static_cache_") +
+                        ::testing::UnitTest::GetInstance()->current_test_info()->name());
+
+        PublicDir() { fs::create_directories(root); }
+        ~PublicDir() {
+            std::error_code ec;
+            fs::remove_all(root, ec);
+        }
+
+        void write(const std::string &name, const std::string &body) const {
+            fs::create_directories((root / name).parent_path());
+            std::ofstream(root / name, std::ios::binary) << body;
+        }
+    };
+
+    StaticCache::Options enabled(const std::size_t max_bytes = 64 * 1024 * 1024) {
+        StaticCache::Options options;
+        options.enabled = true;
+        options.maxBytes = max_bytes;
+        return options;
+    }
+
+    drogon::HttpRequestPtr get(const std::string &path) {
+        auto req = drogon::HttpRequest::newHttpRequest();
+        req->setMethod(drogon::Get);
+        req->setPath(path);
+        return req;
+    }
+}
+
+TEST(StaticCache, LoadsFilesAndSkipsDotfiles) {
+    PublicDir dir;
+    dir.write("index.html", "<h1>home</h1>");
+    dir.write("docs/index.html", "<h1>docs</h1>");
+    dir.write("assets/app.3f9a1c2b.js", "console.log(1)");
+    dir.write(".env", "SECRET=1");
+    dir.write(".git/config", "[core]");
+
+    StaticCache cache(enabled(), mimeOf);
+    EXPECT_EQ(cache.load(dir.root), 3u);
+
+    ASSERT_NE(cache.find("/"), nullptr);
+    EXPECT_EQ(cache.find("/")->body, "<h1>home</h1>");
+    EXPECT_EQ(cache.find("/docs/")->body, "<h1>docs</h1>");
+    EXPECT_EQ(cache.find("/index.html")->mime, "text/html");
+    EXPECT_EQ(cache.find("/assets/app.3f9a1c2b.js")->cacheControl, "public, max-age=31536000, immutable");
+    EXPECT_EQ(cache.find("/index.html")->cacheControl, "no-cache");
+    EXPECT_EQ(cache.find("/.env"), nullptr);
+    EXPECT_EQ(cache.find("/.git/config"), nullptr);
+    EXPECT_EQ(cache.find("/missing.html"), nullptr);
+}
+
+TEST(StaticCache, LeavesFilesPastTheBudgetToDisk) {
+    PublicDir dir;
+    dir.write("a.bin", std::string(600, 'a'));
+    dir.write("b.bin", std::string(600, 'b'));
+
+    StaticCache cache(enabled(1000), mimeOf);
+    EXPECT_EQ(cache.load(dir.root), 1u);
+    EXPECT_NE(cache.find("/a.bin"), nullptr);
+    EXPECT_EQ(cache.find("/b.bin"), nullptr);
+    EXPECT_LE(cache.bytes(), 1000u);
+}
+
+TEST(StaticCache, ReloadKeepsUnchangedFiles) {
+    PublicDir dir;
+    dir.write("index.html", "one");
+    dir.write("other.html", "same");
+
+    StaticCache cache(enabled(), mimeOf);
+    cache.load(dir.root);
+    const auto index = cache.find("/index.html");
+    const auto other = cache.find("/other.html");
+
+    dir.write("index.html", "two, longer");
+    dir.write("new.html", "new");
+    EXPECT_EQ(cache.load(dir.root), 3u);
+
+    EXPECT_EQ(cache.find("/other.html"), other);
+    EXPECT_EQ(cache.find("/index.html")->body, "two, longer");
+    EXPECT_NE(cache.find("/index.html")->etags[0], index->etags[0]);
+    // Whoever still holds the old entry keeps it intact
+    EXPECT_EQ(index->body, "one");
+}
+
+TEST(StaticCache, AnswersRevalidationWith304) {
+    PublicDir dir;
+    dir.write("index.html", "<h1>home</h1>");
+
+    StaticCache cache(enabled(), mimeOf);
+    cache.load(dir.root);
+    EXPECT_EQ(cache.respond(get("/missing.js")), nullptr);
+
+    const auto first = cache.respond(get("/"));
+    ASSERT_NE(first, nullptr);
+    EXPECT_EQ(first->statusCode(), drogon::k200OK);
+    EXPECT_EQ(first->body(), "<h1>home</h1>");
+
+    auto req = get("/index.html");
+    req->addHeader("If-None-Match", first->getHeader("etag"));
+    const auto again = cache.respond(req);
+    EXPECT_EQ(again->statusCode(), drogon::k304NotModified);
+    EXPECT_TRUE(again->body().empty());
+}
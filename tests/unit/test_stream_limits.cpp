@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/stream_limits.h"
+#include "../common/test_environment.h"
+
+using mb::StreamLimits;
+
+namespace {
+    StreamLimits::Options caps(const std::size_t per_ip, const std::size_t per_user,
+                               const StreamLimits::Policy policy = StreamLimits::Policy::Reject) {
+        StreamLimits::Options options;
+        options.perIp = per_ip;
+        options.perUser = per_user;
+        options.policy = policy;
+        return options;
+    }
+}
+
+TEST(StreamLimits, RejectsOverEitherCap) {
+    StreamLimits limits(caps(2, 1));
+
+    auto a = limits.acquire("10.0.0.1", "users:1");
+    ASSERT_TRUE(a);
+    StreamLimits::Refusal refusal{};
+    EXPECT_FALSE(limits.acquire("10.0.0.2", "users:1", &refusal));
+    EXPECT_EQ(refusal, StreamLimits::Refusal::User);
+
+    auto b = limits.acquire("10.0.0.1", "users:2");
+    ASSERT_TRUE(b);
+    EXPECT_FALSE(limits.acquire("10.0.0.1", "users:3", &refusal));
+    EXPECT_EQ(refusal, StreamLimits::Refusal::Ip);
+
+    // A closed stream gives its place back
+    a.reset();
+    EXPECT_TRUE(limits.acquire("10.0.0.1", "users:1"));
+
+    const auto stats = limits.stats();
+    EXPECT_EQ(stats["active"], 1);
+    EXPECT_EQ(stats["rejected_ip"], 1);
+    EXPECT_EQ(stats["rejected_user"], 1);
+}
+
+TEST(StreamLimits, GuestsAreCappedByAddressOnly) {
+    StreamLimits limits(caps(0, 1));
+    auto a = limits.acquire("10.0.0.1", "guest");
+    auto b = limits.acquire("10.0.0.1", "guest");
+    EXPECT_TRUE(a && b);
+    EXPECT_EQ(limits.stats()["active"], 0);
+    EXPECT_FALSE(limits.options().perIp);
+
+    StreamLimits off(caps(0, 0));
+    EXPECT_FALSE(off.options().enabled());
+    EXPECT_TRUE(off.acquire("10.0.0.1", "users:1"));
+}
+
+TEST(StreamLimits, EvictsOldestStream) {
+    StreamLimits limits(caps(2, 0, StreamLimits::Policy::EvictOldest));
+
+    int closed_a = 0, closed_b = 0;
+    auto a = limits.acquire("10.0.0.1", "guest");
+    a->bind([&] { ++closed_a; });
+    auto b = limits.acquire("10.0.0.1", "guest");
+    b->bind([&] { ++closed_b; });
+
+    auto c = limits.acquire("10.0.0.1", "guest");
+    ASSERT_TRUE(c);
+    EXPECT_EQ(closed_a, 1);
+    EXPECT_EQ(closed_b, 0);
+
+    auto d = limits.acquire("10.0.0.1", "guest");
+    EXPECT_EQ(closed_b, 1);
+
+    // Evicted before it was bound, it closes on bind()
+    auto e = limits.acquire("10.0.0.1", "guest");
+    int closed_c = 0;
+    c->bind([&] { ++closed_c; });
+    EXPECT_EQ(closed_c, 1);
+
+    // The evicted ones no longer count
+    a.reset();
+    b.reset();
+    c.reset();
+    const auto stats = limits.stats();
+    EXPECT_EQ(stats["active"], 2);
+    EXPECT_EQ(stats["evicted"], 3);
+    EXPECT_EQ(stats["policy"], "evict_oldest");
+}
+
+TEST(StreamLimits, TicketsOutliveTheLimits) {
+    std::unique_ptr<StreamLimits::Ticket> ticket;
+    {
+        StreamLimits limits(caps(1, 0));
+        ticket = limits.acquire("10.0.0.1", "guest");
+    }
+    EXPECT_NO_FATAL_FAILURE(ticket.reset());
+}
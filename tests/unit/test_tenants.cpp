@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/tenants.h"
+#include "mantisbase/core/database.h"
+#include "mantisbase/core/models/entity_schema.h"
+#include "mantisbase/core/models/entity_schema_field.h"
+#include "mantisbase/mantisbase.h"
+#include "../common/test_environment.h"
+
+#include <filesystem>
+
+TEST(TenantsTest, ValidatesIds) {
+    EXPECT_TRUE(mb::Tenants::isValidId("acme"));
+    EXPECT_TRUE(mb::Tenants::isValidId("acme-2"));
+    EXPECT_TRUE(mb::Tenants::isValidId(std::string(63, 'a')));
+
+    EXPECT_FALSE(mb::Tenants::isValidId(""));
+    EXPECT_FALSE(mb::Tenants::isValidId(std::string(64, 'a')));
+    EXPECT_FALSE(mb::Tenants::isValidId("-acme"));
+    EXPECT_FALSE(mb::Tenants::isValidId("acme-"));
+    EXPECT_FALSE(mb::Tenants::isValidId("Acme"));
+    EXPECT_FALSE(mb::Tenants::isValidId("ac_me"));
+    EXPECT_FALSE(mb::Tenants::isValidId("../acme"));
+}
+
+TEST(TenantsTest, ResolvesSubdomainsAndHeaders) {
+    EXPECT_EQ(mb::Tenants::subdomainOf("acme.example.com", "example.com"), "acme");
+    EXPECT_EQ(mb::Tenants::subdomainOf("ACME.Example.com:8080", "example.com"), "acme");
+    EXPECT_EQ(mb::Tenants::subdomainOf("a.b.example.com", "example.com"), "a.b");
+    EXPECT_FALSE(mb::Tenants::subdomainOf("example.com", "example.com").has_value());
+    EXPECT_FALSE(mb::Tenants::subdomainOf("acmeexample.com", "example.com").has_value());
+    EXPECT_FALSE(mb::Tenants::subdomainOf("[::1]:8080", "example.com").has_value());
+
+    auto &app = mb::MantisBase::instance();
+    mb::Tenants::Options host;
+    host.mode = mb::Tenants::Mode::Host;
+    host.domain = "example.com";
+    const mb::Tenants by_host(app, host);
+    EXPECT_EQ(by_host.resolve("acme.example.com", "other"), "acme");
+    EXPECT_FALSE(by_host.resolve("example.com", "acme").has_value());
+    EXPECT_THROW((void) by_host.resolve("a.b.example.com", ""), mb::MantisException);
+
+    mb::Tenants::Options header;
+    header.mode = mb::Tenants::Mode::Header;
+    const mb::Tenants by_header(app, header);
+    EXPECT_EQ(by_header.resolve("acme.example.com", "globex"), "globex");
+    EXPECT_FALSE(by_header.resolve("acme.example.com", "").has_value());
+    EXPECT_THROW((void) by_header.resolve("", "Globex"), mb::MantisException);
+
+    EXPECT_TRUE(mb::Tenants::servesPath("/api/v1/entities/posts/1"));
+    EXPECT_TRUE(mb::Tenants::servesPath("/api/v1/schemas"));
+    EXPECT_TRUE(mb::Tenants::servesPath("/api/v1/transaction"));
+    EXPECT_TRUE(mb::Tenants::servesPath("/api/v1/sys/admins/login"));
+    EXPECT_FALSE(mb::Tenants::servesPath("/api/v1/schemas/posts/migration"));
+    EXPECT_FALSE(mb::Tenants::servesPath("/api/v1/sys/backup"));
+    EXPECT_FALSE(mb::Tenants::servesPath("/api/v1/entitiesx"));
+    EXPECT_FALSE(mb::Tenants::servesPath("/api/v1/realtime"));
+}
+
+TEST(TenantsTest, KeepsTenantDataApartAndEvicts) {
+    auto &app = mb::MantisBase::instance();
+    mb::Tenants::Options options;
+    options.mode = mb::Tenants::Mode::Header;
+    options.maxOpen = 1;
+    mb::Tenants tenants(app, options);
+
+    // Not provisioned, and not created on demand
+    try {
+        (void) tenants.acquire("t-missing");
+        FAIL() << "A missing tenant was opened";
+    } catch (const mb::MantisException &e) {
+        EXPECT_EQ(e.code(), 404);
+    }
+
+    options.autoCreate = true;
+    mb::Tenants creating(app, options);
+    auto acme = creating.acquire("t-acme");
+    EXPECT_EQ(creating.acquire("t-acme"), acme);
+    {
+        const mb::Tenants::Scope scope(acme);
+        EXPECT_NE(&app.db(), &app.rootDb());
+        mb::EntitySchema schema(app, "tenant_notes", "base");
+        schema.addField(mb::EntitySchemaField("title", "string"));
+        mb::EntitySchema::createTable(schema);
+        (void) app.entity("tenant_notes").create({{"title", "only acme"}});
+        EXPECT_EQ(app.entity("tenant_notes").list().size(), 1);
+    }
+    EXPECT_EQ(&app.db(), &app.rootDb());
+    EXPECT_FALSE(app.hasEntity("tenant_notes"));
+
+    // Past maxOpen, acme is closed; it reopens from its file
+    auto globex = creating.acquire("t-globex");
+    {
+        const mb::Tenants::Scope scope(globex);
+        EXPECT_FALSE(app.hasEntity("tenant_notes"));
+    }
+    EXPECT_EQ(creating.stats().open, 1);
+    EXPECT_EQ(creating.stats().evicted, 1);
+
+    auto reopened = creating.acquire("t-acme");
+    EXPECT_NE(reopened, acme);
+    {
+        const mb::Tenants::Scope scope(reopened);
+        EXPECT_EQ(app.entity("tenant_notes").list()[0]["title"], "only acme");
+    }
+
+    acme.reset();
+    globex.reset();
+    reopened.reset();
+    creating.closeAll();
+    std::error_code ec;
+    for (const auto *id: {"t-acme", "t-globex"})
+        for (const auto *suffix: {".db", ".db-wal", ".db-shm"})
+            std::filesystem::remove(mb::joinPaths(mb::joinPaths(app.dataDir(), "tenants").string(),
+                                                  std::string(id) + suffix), ec);
+}
@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/thread_placement.h"
+#include "mantisbase/core/metrics.h"
+
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+using mb::ThreadPlacement;
+using Role = ThreadPlacement::Role;
+using CpuSet = ThreadPlacement::CpuSet;
+
+namespace {
+    /// Two nodes of four CPUs, hyperthreads numbered after the cores as on most x86 hosts
+    const std::vector<CpuSet> TWO_NODES = {{0, 1, 2, 3, 8, 9, 10, 11}, {4, 5, 6, 7, 12, 13, 14, 15}};
+}
+
+TEST(ThreadPlacementTest, ParsesAndFormatsCpuLists) {
+    EXPECT_EQ(ThreadPlacement::parseCpuList("0-3,8"), (CpuSet{0, 1, 2, 3, 8}));
+    EXPECT_EQ(ThreadPlacement::parseCpuList("5,1-2,2"), (CpuSet{1, 2, 5}));
+    EXPECT_EQ(ThreadPlacement::formatCpuList({0, 1, 2, 3, 8, 10, 11}), "0-3,8,10-11");
+    EXPECT_EQ(ThreadPlacement::formatCpuList({}), "");
+
+    for (const auto *bad: {"", "a", "1-", "3-1", "1,,2", "1,", "1 2"})
+        EXPECT_THROW(ThreadPlacement::parseCpuList(bad), std::invalid_argument) << bad;
+}
+
+TEST(ThreadPlacementTest, PinsIoLoopsPerCoreAndGroupsDbWorkersPerNode) {
+    const ThreadPlacement placement({.io = {0, 1}, .db = {2, 3, 6, 7}, .background = {8, 12}}, TWO_NODES);
+
+    EXPECT_EQ(placement.cpusFor(Role::Io, 0), CpuSet{0});
+    EXPECT_EQ(placement.cpusFor(Role::Io, 1), CpuSet{1});
+    EXPECT_EQ(placement.cpusFor(Role::Io, 2), CpuSet{0});
+
+    // Workers alternate between the nodes, each kept to the set's CPUs on its node
+    EXPECT_EQ(placement.cpusFor(Role::Db, 0), (CpuSet{2, 3}));
+    EXPECT_EQ(placement.cpusFor(Role::Db, 1), (CpuSet{6, 7}));
+    EXPECT_EQ(placement.cpusFor(Role::Db, 2), (CpuSet{2, 3}));
+    EXPECT_EQ(placement.nodeOf({6, 7}), 1);
+
+    EXPECT_EQ(placement.cpusFor(Role::Background, 0), (CpuSet{8, 12}));
+    EXPECT_EQ(placement.nodeOf({8, 12}), -1);
+}
+
+TEST(ThreadPlacementTest, UnsetRolesAreLeftAloneUnlessBackgroundIsConfined) {
+    const ThreadPlacement off({}, TWO_NODES);
+    EXPECT_FALSE(off.enabled());
+    EXPECT_TRUE(off.cpusFor(Role::Io, 0).empty());
+    EXPECT_TRUE(off.cpusFor(Role::Db, 0).empty());
+
+    // The IO and db threads would inherit the background set from the thread starting them
+    const ThreadPlacement background({.background = {0}}, TWO_NODES);
+    EXPECT_TRUE(background.enabled());
+    EXPECT_EQ(background.cpusFor(Role::Io, 3).size(), 16u);
+    EXPECT_EQ(background.cpusFor(Role::Db, 0).size(), 16u);
+}
+
+TEST(ThreadPlacementTest, ReadsNodesFromSysfs) {
+    const auto dir = std::filesystem::temp_directory_path() / "mb_test_numa_nodes";
+    std::filesystem::remove_all(dir);
+    for (const auto &[node, cpus]: std::vector<std::pair<std::string, std::string>>{
+             {"node1", "4-7"}, {"node0", "0-3"}, {"node2", ""}}) {
+        std::filesystem::create_directories(dir / node);
+        std::ofstream(dir / node / "cpulist") << cpus << "\n";
+    }
+    std::filesystem::create_directories(dir / "power");
+
+    const auto nodes = ThreadPlacement::numaNodes(dir.string());
+    ASSERT_EQ(nodes.size(), 2u);
+    EXPECT_EQ(nodes[0], (CpuSet{0, 1, 2, 3}));
+    EXPECT_EQ(nodes[1], (CpuSet{4, 5, 6, 7}));
+
+    EXPECT_EQ(ThreadPlacement::numaNodes((dir / "missing").string()).size(), 1u);
+    std::filesystem::remove_all(dir);
+}
+
+#ifdef __linux__
+TEST(ThreadPlacementTest, PinsTheCallingThreadAndExportsIt) {
+    ThreadPlacement placement({.io = {0}}, ThreadPlacement::numaNodes());
+    bool pinned = false;
+    std::thread([&] { pinned = placement.pin(Role::Io, 0); }).join();
+    ASSERT_TRUE(pinned);
+    EXPECT_FALSE(placement.pin(Role::Db, 0));
+
+    const auto placements = placement.placements();
+    ASSERT_EQ(placements.size(), 1u);
+    EXPECT_EQ(placements[0].cpus, CpuSet{0});
+
+    mb::MetricsWriter out;
+    placement.writeMetrics(out);
+    EXPECT_NE(out.str().find(R"(mb_thread_placement{role="io",index="0",cpus="0",node="0"} 1)"), std::string::npos)
+        << out.str();
+}
+#endif
@@ -0,0 +1,49 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/thumbnails.h"
+#include "mantisbase/core/exceptions.h"
+
+using mb::ThumbSpec;
+
+TEST(Thumbnails, ParsesSizesAndModes) {
+    const ThumbSpec::Limits limits;
+
+    auto spec = ThumbSpec::parse("100x80", "", "abc_photo.JPG", limits);
+    ASSERT_TRUE(spec.has_value());
+    EXPECT_EQ(spec->width, 100);
+    EXPECT_EQ(spec->height, 80);
+    EXPECT_EQ(spec->mode, ThumbSpec::Mode::Crop);
+    EXPECT_EQ(spec->fileName(), "100x80.jpg");
+    EXPECT_EQ(spec->mimeType(), "image/jpeg");
+
+    spec = ThumbSpec::parse("640x480f", "webp", "abc_photo.png", limits);
+    ASSERT_TRUE(spec.has_value());
+    EXPECT_EQ(spec->mode, ThumbSpec::Mode::Fit);
+    EXPECT_EQ(spec->fileName(), "640x480f.webp");
+    EXPECT_EQ(spec->mimeType(), "image/webp");
+
+    spec = ThumbSpec::parse("0x200", "AVIF", "anim.gif", limits);
+    ASSERT_TRUE(spec.has_value());
+    EXPECT_EQ(spec->width, 0);
+    EXPECT_EQ(spec->fileName(), "0x200.avif");
+
+    // A GIF keeps no animation once resized, PNG is the lossless stand-in
+    EXPECT_EQ(ThumbSpec::parse("50x0", "", "anim.gif", limits)->format, "png");
+}
+
+TEST(Thumbnails, IgnoresFilesThatAreNotImages) {
+    EXPECT_FALSE(ThumbSpec::parse("100x100", "", "report.pdf", {}).has_value());
+    EXPECT_FALSE(ThumbSpec::parse("100x100", "webp", "noext", {}).has_value());
+}
+
+TEST(Thumbnails, RejectsMalformedOrDisallowedRequests) {
+    ThumbSpec::Limits limits;
+    EXPECT_THROW(ThumbSpec::parse("100", "", "a.png", limits), mb::MantisException);
+    EXPECT_THROW(ThumbSpec::parse("0x0", "", "a.png", limits), mb::MantisException);
+    EXPECT_THROW(ThumbSpec::parse("-5x10", "", "a.png", limits), mb::MantisException);
+    EXPECT_THROW(ThumbSpec::parse("10x10", "bmp", "a.png", limits), mb::MantisException);
+    EXPECT_THROW(ThumbSpec::parse("4096x10", "", "a.png", limits), mb::MantisException);
+
+    limits.sizes = {"100x100", "640x0"};
+    EXPECT_NO_THROW(ThumbSpec::parse("640x0", "", "a.png", limits));
+    EXPECT_THROW(ThumbSpec::parse("101x100", "", "a.png", limits), mb::MantisException);
+}
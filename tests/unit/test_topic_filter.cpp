@@ -0,0 +1,71 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/topic_filter.h"
+#include "mantisbase/core/realtime_event.h"
+#include "mantisbase/utils/soci_wrappers.h"
+
+using mb::TopicFilters;
+
+namespace {
+    mb::RowCodec makeCodec() {
+        return mb::RowCodec({
+            {{"name", "id"}, {"type", "string"}},
+            {{"name", "status"}, {"type", "string"}},
+            {{"name", "region"}, {"type", "string"}}
+        });
+    }
+
+    std::shared_ptr<const mb::CompiledFilter> compile(const std::string &filter) {
+        return std::make_shared<const mb::CompiledFilter>(mb::EntityFilter::compile(filter, makeCodec()));
+    }
+
+    std::shared_ptr<const mb::EncodedEvent> change(const std::string &type, const mb::json &row,
+                                                   const mb::json &old_row = nullptr) {
+        return mb::EncodedEvent::encode({{"type", type}, {"entity", "orders"}, {"row_id", "1"},
+                                         {"timestamp", 0}, {"new_data", row}, {"old_data", old_row}});
+    }
+}
+
+TEST(TopicFilters, ParsesAndSplitsFilterTopics) {
+    const auto parsed = TopicFilters::parse("orders? status = 'open' ");
+    ASSERT_TRUE(parsed);
+    EXPECT_EQ(parsed->entity, "orders");
+    EXPECT_EQ(parsed->filter, "status = 'open'");
+    EXPECT_FALSE(TopicFilters::parse("orders:*"));
+    EXPECT_EQ(TopicFilters::topicOf("orders", " status = 'open' "), "orders?status = 'open'");
+
+    EXPECT_EQ(TopicFilters::splitTopics("posts, orders?status IN ['a', 'b'] && region = 'x,y',users:1,"),
+              (std::vector<std::string>{"posts", "orders?status IN ['a', 'b'] && region = 'x,y'", "users:1"}));
+    EXPECT_EQ(TopicFilters::splitTopics(R"(orders?status = 'it\'s, open')"),
+              (std::vector<std::string>{R"(orders?status = 'it\'s, open')"}));
+}
+
+TEST(TopicFilters, EvaluatesEachFilterOncePerEvent) {
+    TopicFilters filters;
+    const std::string open = "orders?status = 'open'", eu = "orders?region = 'eu'";
+    filters.add(open, compile("status = 'open'"));
+    filters.add(open, compile("status = 'open'"));
+    filters.add(eu, compile("region = 'eu'"));
+
+    auto topics = filters.matching(*change("INSERT", {{"id", "1"}, {"status", "open"}, {"region", "us"}}));
+    EXPECT_EQ(topics, std::vector<std::string>{open});
+    EXPECT_TRUE(filters.matching(*mb::EncodedEvent::encode({{"type", "INSERT"}, {"entity", "posts"},
+                                                            {"row_id", "1"}, {"timestamp", 0},
+                                                            {"new_data", {{"status", "open"}}}})).empty());
+
+    // Counted per subscriber
+    filters.remove(open);
+    EXPECT_EQ(filters.matching(*change("INSERT", {{"status", "open"}})).size(), 1u);
+    filters.remove(open);
+    filters.remove(eu);
+    EXPECT_TRUE(filters.empty());
+}
+
+TEST(TopicFilters, SendsUpdatesThatMoveARowOutOfTheFilter) {
+    const auto filter = compile("status = 'open'");
+    EXPECT_TRUE(TopicFilters::matches(*filter, *change("UPDATE", {{"status", "closed"}}, {{"status", "open"}})));
+    EXPECT_FALSE(TopicFilters::matches(*filter, *change("UPDATE", {{"status", "closed"}}, {{"status", "held"}})));
+    // A delete carries the row it removed
+    EXPECT_TRUE(TopicFilters::matches(*filter, *mb::EncodedEvent::encode(
+        {{"type", "DELETE"}, {"entity", "orders"}, {"row_id", "1"}, {"timestamp", 0},
+         {"old_data", {{"status", "open"}}}})));
+}
@@ -0,0 +1,45 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/topic_index.h"
+
+using Index = mb::TopicIndex<int>;
+
+TEST(TopicIndex, RoutesRowsAndEntitiesWithoutTopicStrings) {
+    Index index;
+    EXPECT_TRUE(index.add("posts", 1).first);
+    EXPECT_FALSE(index.add("posts", 2).first);
+    index.add("posts:*", 3);
+    index.add("posts:42", 4);
+    index.add("posts?views > 1", 5);
+
+    auto route = index.route("posts", "42");
+    ASSERT_TRUE(route.row && route.entity && route.wildcard);
+    EXPECT_EQ(*route.row, std::vector<int>{4});
+    EXPECT_EQ(*route.entity, (std::vector<int>{1, 2}));
+    EXPECT_EQ(*route.wildcard, std::vector<int>{3});
+
+    route = index.route("posts", "7");
+    EXPECT_FALSE(route.row);
+    EXPECT_FALSE(index.route("users", "42").entity);
+
+    // Filter topics are only found by name
+    const auto filter = index.find("posts?views > 1");
+    ASSERT_TRUE(filter);
+    EXPECT_EQ(index.subscribers(*filter), std::vector<int>{5});
+    EXPECT_EQ(index.name(*filter), "posts?views > 1");
+}
+
+TEST(TopicIndex, ReleasesAndReusesIdsAfterTheLastSubscriber) {
+    Index index;
+    const auto [id, first] = index.add("posts:42", 1);
+    index.add("posts:42", 2);
+
+    EXPECT_FALSE(index.remove(id, 1));
+    EXPECT_FALSE(index.remove(id, 9)); // Not subscribed
+    EXPECT_EQ(index.remove(id, 2), "posts:42");
+    EXPECT_FALSE(index.find("posts:42"));
+    EXPECT_FALSE(index.route("posts", "42").row);
+    EXPECT_EQ(index.size(), 0u);
+
+    EXPECT_EQ(index.add("users", 3).id, id);
+    EXPECT_EQ(index.route("users", "").entity->front(), 3);
+}
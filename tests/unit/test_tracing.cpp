@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/tracing.h"
+
+#include <nlohmann/json.hpp>
+
+using mb::SpanData;
+using mb::TraceContext;
+using mb::Tracer;
+
+namespace {
+    constexpr auto kParent = "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01";
+
+    /// Tracer that keeps every exported span
+    struct Capture {
+        std::vector<nlohmann::json> spans;
+
+        Tracer::Exporter exporter() {
+            return [this](const std::string &body) {
+                const auto doc = nlohmann::json::parse(body);
+                for (const auto &s: doc["resourceSpans"][0]["scopeSpans"][0]["spans"])
+                    spans.push_back(s);
+                return true;
+            };
+        }
+    };
+
+    Tracer::Options sampled(const double ratio) {
+        Tracer::Options options;
+        options.sampleRatio = ratio;
+        return options;
+    }
+}
+
+TEST(Tracing, ParsesTraceparent) {
+    const auto ctx = TraceContext::parse(kParent);
+    ASSERT_TRUE(ctx.has_value());
+    EXPECT_EQ(ctx->traceIdHex(), "4bf92f3577b34da6a3ce929d0e0e4736");
+    EXPECT_EQ(ctx->spanIdHex(), "00f067aa0ba902b7");
+    EXPECT_TRUE(ctx->sampled);
+    EXPECT_EQ(ctx->traceparent(), kParent);
+
+    EXPECT_FALSE(TraceContext::parse("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-00")->sampled);
+    EXPECT_FALSE(TraceContext::parse(""));
+    EXPECT_FALSE(TraceContext::parse("00-00000000000000000000000000000000-00f067aa0ba902b7-01"));
+    EXPECT_FALSE(TraceContext::parse("00-4bf92f3577b34da6a3ce929d0e0e4736-0000000000000000-01"));
+    EXPECT_FALSE(TraceContext::parse("00-4BF92F3577B34DA6A3CE929D0E0E4736-00f067aa0ba902b7-01"));
+    EXPECT_FALSE(TraceContext::parse("ff-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01"));
+    // Version 00 has no further fields; later versions may
+    EXPECT_FALSE(TraceContext::parse(std::string(kParent) + "-x"));
+    EXPECT_TRUE(TraceContext::parse("01-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01-x"));
+}
+
+TEST(Tracing, SamplingFollowsTheParent) {
+    const Tracer none(sampled(0.0), [](const std::string &) { return true; });
+    const auto parent = TraceContext::parse(kParent);
+    const auto child = none.childOf(parent);
+    EXPECT_TRUE(child.sampled);
+    EXPECT_EQ(child.traceId, parent->traceId);
+    EXPECT_NE(child.spanId, parent->spanId);
+
+    for (int i = 0; i < 100; ++i)
+        EXPECT_FALSE(none.childOf(std::nullopt).sampled);
+
+    const Tracer all(sampled(1.0), [](const std::string &) { return true; });
+    EXPECT_TRUE(all.childOf(std::nullopt).sampled);
+}
+
+TEST(Tracing, DisabledWithoutAnEndpoint) {
+    Tracer tracer(Tracer::Options{});
+    EXPECT_FALSE(tracer.enabled());
+}
+
+TEST(Tracing, NestsSpansUnderTheScope) {
+    Capture capture;
+    Tracer tracer(sampled(1.0), capture.exporter());
+    const auto request = tracer.childOf(TraceContext::parse(kParent));
+    {
+        const Tracer::Scope scope(&tracer, request);
+        Tracer::Span outer("middleware");
+        outer.setAttribute("k", "v");
+        {
+            const Tracer::Span inner("handler");
+            Tracer::statement("select * from posts");
+            Tracer::statement("UPDATE posts SET a = 1");
+        }
+    }
+    EXPECT_EQ(Tracer::current(), nullptr);
+    tracer.flush();
+
+    // Finished inner-first: SELECT, UPDATE, handler, middleware
+    ASSERT_EQ(capture.spans.size(), 4u);
+    const auto &select = capture.spans[0], &update = capture.spans[1];
+    const auto &handler = capture.spans[2], &middleware = capture.spans[3];
+    EXPECT_EQ(select["name"], "SELECT");
+    EXPECT_EQ(select["kind"], 3);
+    EXPECT_EQ(update["name"], "UPDATE");
+    EXPECT_EQ(select["parentSpanId"], handler["spanId"]);
+    EXPECT_EQ(handler["parentSpanId"], middleware["spanId"]);
+    EXPECT_EQ(middleware["parentSpanId"], request.spanIdHex());
+    EXPECT_EQ(middleware["traceId"], "4bf92f3577b34da6a3ce929d0e0e4736");
+    EXPECT_EQ(middleware["attributes"][0]["value"]["stringValue"], "v");
+}
+
+TEST(Tracing, UnsampledScopesRecordNothing) {
+    Capture capture;
+    Tracer tracer(sampled(1.0), capture.exporter());
+    {
+        const Tracer::Scope scope(&tracer, *TraceContext::parse(
+                                      "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-00"));
+        const Tracer::Span span("middleware");
+        EXPECT_FALSE(span.recording());
+        Tracer::statement("SELECT 1");
+    }
+    {
+        const Tracer::Span outside("no scope");
+        EXPECT_FALSE(outside.recording());
+    }
+    tracer.flush();
+    EXPECT_TRUE(capture.spans.empty());
+}
+
+TEST(Tracing, DropsSpansOverTheQueueLimit) {
+    auto options = sampled(1.0);
+    options.maxQueue = 2;
+    int exports = 0;
+    Tracer tracer(options, [&](const std::string &) {
+        ++exports;
+        return false;
+    });
+
+    SpanData span;
+    span.context = tracer.childOf(std::nullopt);
+    for (int i = 0; i < 5; ++i) tracer.record(span);
+    tracer.flush();
+
+    const auto s = tracer.stats();
+    EXPECT_EQ(s.dropped, 3u);
+    EXPECT_EQ(s.failed, 2u);
+    EXPECT_EQ(s.exported, 0u);
+    EXPECT_EQ(exports, 1);
+}
+
+TEST(Tracing, ExportsFromTheBackgroundThread) {
+    Capture capture;
+    auto options = sampled(1.0);
+    options.batch = 1;
+    Tracer tracer(options, capture.exporter());
+    tracer.start();
+
+    SpanData span;
+    span.context = tracer.childOf(std::nullopt);
+    span.name = "realtime.deliver";
+    span.links.push_back(*TraceContext::parse(kParent));
+    tracer.record(span);
+    tracer.stop();
+
+    ASSERT_EQ(capture.spans.size(), 1u);
+    EXPECT_EQ(capture.spans[0]["links"][0]["spanId"], "00f067aa0ba902b7");
+    EXPECT_FALSE(capture.spans[0].contains("parentSpanId"));
+}
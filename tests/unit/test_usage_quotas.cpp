@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/usage_quotas.h"
+#include "mantisbase/core/database.h"
+#include "mantisbase/mantisbase.h"
+#include "../common/test_environment.h"
+
+#include <algorithm>
+
+using mb::UsageQuotas;
+using namespace std::chrono_literals;
+
+namespace {
+    UsageQuotas::Options quota(const std::uint64_t requests, const std::uint64_t bytes = 0) {
+        UsageQuotas::Options options;
+        options.requests = requests;
+        options.bytes = bytes;
+        options.window = 3600s;
+        return options;
+    }
+
+    /// 10 minutes into a window
+    UsageQuotas::Clock::time_point inWindow() {
+        return UsageQuotas::Clock::time_point(std::chrono::hours(480000) + 10min);
+    }
+}
+
+TEST(UsageQuotas, DeniesPastTheRequestQuotaUntilTheWindowTurns) {
+    UsageQuotas quotas(quota(3));
+    const auto now = inWindow();
+    const auto key = UsageQuotas::keySubject("k1");
+
+    for (int i = 0; i < 3; ++i) EXPECT_TRUE(quotas.admit(key, now).allowed);
+    const auto denied = quotas.admit(key, now);
+    EXPECT_FALSE(denied.allowed);
+    EXPECT_EQ(denied.retryAfter, 50min);
+
+    // Counted per subject
+    EXPECT_TRUE(quotas.admit(UsageQuotas::keySubject("k2"), now).allowed);
+    EXPECT_TRUE(quotas.admit(key, now + 50min).allowed);
+}
+
+TEST(UsageQuotas, DeniesOnceTheBandwidthIsUsedUp) {
+    UsageQuotas quotas(quota(0, 1000));
+    const auto now = inWindow();
+    const auto user = UsageQuotas::userSubject("users", "u1");
+
+    EXPECT_TRUE(quotas.admit(user, now).allowed);
+    quotas.addBytes(user, 600, now);
+    EXPECT_TRUE(quotas.admit(user, now).allowed);
+    quotas.addBytes(user, 600, now);
+    const auto denied = quotas.admit(user, now);
+    EXPECT_FALSE(denied.allowed);
+    EXPECT_NE(denied.reason.find("Bandwidth"), std::string::npos);
+}
+
+TEST(UsageQuotas, SubjectLimitsReplaceTheDefaults) {
+    UsageQuotas quotas(quota(1));
+    const auto now = inWindow();
+    const auto key = UsageQuotas::keySubject("plan-pro");
+
+    quotas.setLimits(key, UsageQuotas::Limits{3, 0});
+    EXPECT_EQ(quotas.limitsOf(key).requests, 3u);
+    for (int i = 0; i < 3; ++i) EXPECT_TRUE(quotas.admit(key, now).allowed);
+    EXPECT_FALSE(quotas.admit(key, now).allowed);
+
+    // Back to the default, which this window is already past
+    quotas.setLimits(key, std::nullopt);
+    EXPECT_EQ(quotas.limitsOf(key).requests, 1u);
+    EXPECT_FALSE(quotas.admit(key, now).allowed);
+}
+
+TEST(UsageQuotas, FlushedCountsSurviveARestart) {
+    const auto subject = UsageQuotas::keySubject("usage_quotas_test");
+    const auto now = UsageQuotas::Clock::now();
+    {
+        UsageQuotas quotas(quota(5));
+        for (int i = 0; i < 4; ++i) ASSERT_TRUE(quotas.admit(subject, now).allowed);
+        quotas.addBytes(subject, 42, now);
+        EXPECT_GE(quotas.flush(), 1u);
+        // Nothing new since
+        EXPECT_EQ(quotas.flush(), 0u);
+    }
+
+    UsageQuotas restarted(quota(5));
+    restarted.load(now);
+    EXPECT_TRUE(restarted.admit(subject, now).allowed);
+    EXPECT_FALSE(restarted.admit(subject, now).allowed);
+
+    const auto usage = restarted.usage(now);
+    const auto it = std::ranges::find_if(usage, [&](const auto &row) { return row["subject"] == subject; });
+    ASSERT_NE(it, usage.end());
+    EXPECT_EQ((*it)["bytes"], 42);
+
+    auto sql = mb::MantisBase::instance().db().writeSession();
+    *sql << "DELETE FROM mb_usage WHERE subject = :subject", soci::use(subject);
+}
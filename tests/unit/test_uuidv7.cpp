@@ -0,0 +1,34 @@
+#include <gtest/gtest.h>
+#include "mantisbase/utils/uuidv7.h"
+
+#include <algorithm>
+#include <set>
+
+TEST(Uuidv7, BatchesAreStrictlyIncreasing) {
+    const auto ids = mb::generate_uuidv7_batch(10000);
+    ASSERT_EQ(ids.size(), 10000u);
+    EXPECT_TRUE(std::ranges::is_sorted(ids));
+    EXPECT_EQ(std::set(ids.begin(), ids.end()).size(), ids.size());
+
+    // Later single ids sort after the batch
+    EXPECT_GT(mb::generate_uuidv7(), ids.back());
+    for (const auto &id: {ids.front(), ids.back()}) {
+        EXPECT_EQ(id.size(), 36u);
+        EXPECT_EQ(id[14], '7');
+        EXPECT_NE(std::string("89ab").find(id[19]), std::string::npos);
+    }
+}
+
+TEST(Uuidv7, TextAndBinaryFormsRoundTrip) {
+    const auto bytes = mb::generate_uuidv7_bytes();
+    const auto text = mb::to_hex_lower(bytes);
+    EXPECT_EQ(mb::uuid_from_string(text), bytes);
+
+    auto upper = text;
+    std::ranges::transform(upper, upper.begin(), [](const char c) { return static_cast<char>(std::toupper(c)); });
+    EXPECT_EQ(mb::uuid_from_string(upper), bytes);
+
+    EXPECT_FALSE(mb::uuid_from_string("not-a-uuid").has_value());
+    EXPECT_FALSE(mb::uuid_from_string(text.substr(0, 8) + "x" + text.substr(9)).has_value());
+    EXPECT_FALSE(mb::uuid_from_string(text.substr(0, 8) + "0" + text.substr(9)).has_value());
+}
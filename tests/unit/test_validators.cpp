@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+#include <string>
+
+#include "mantisbase/core/models/validators.h"
+#include "mantisbase/core/exceptions.h"
+
+namespace {
+    bool matches(const std::string &key, const std::string &value) {
+        const auto *preset = mb::Validators::preset(key);
+        EXPECT_NE(preset, nullptr) << key;
+        return preset && preset->match(value);
+    }
+}
+
+TEST(Validators, PresetsResolveWithOrWithoutTheAt) {
+    EXPECT_NE(mb::Validators::preset("@email"), nullptr);
+    EXPECT_EQ(mb::Validators::preset("email"), mb::Validators::preset("@email"));
+    EXPECT_EQ(mb::Validators::preset("@unknown"), nullptr);
+    EXPECT_EQ(mb::Validators::preset(""), nullptr);
+
+    const auto preset = mb::Validators::findPreset("@password");
+    ASSERT_TRUE(preset.has_value());
+    EXPECT_EQ((*preset)["regex"], R"(^\S{8,}$)");
+}
+
+TEST(Validators, Email) {
+    EXPECT_TRUE(matches("@email", "jane.doe+tag@mail.example.com"));
+    EXPECT_TRUE(matches("@email", "a@b.io"));
+    EXPECT_FALSE(matches("@email", "@b.io"));
+    EXPECT_FALSE(matches("@email", "a@.io"));
+    EXPECT_FALSE(matches("@email", "a@b.c"));
+    EXPECT_FALSE(matches("@email", "a@b.c0m"));
+    EXPECT_FALSE(matches("@email", "a@b@c.io"));
+    EXPECT_FALSE(matches("@email", "a b@c.io"));
+    EXPECT_FALSE(matches("@email", "a@bio"));
+}
+
+TEST(Validators, Passwords) {
+    EXPECT_TRUE(matches("@password", "12345678"));
+    EXPECT_FALSE(matches("@password", "1234567"));
+    EXPECT_FALSE(matches("@password", "1234 5678"));
+    EXPECT_FALSE(matches("@password", "12345678\n"));
+
+    EXPECT_TRUE(matches("@password-long", "Abcdef1!"));
+    EXPECT_TRUE(matches("@password-long", "Abcdef1_"));
+    EXPECT_FALSE(matches("@password-long", "Abcdefg1"));
+    EXPECT_FALSE(matches("@password-long", "abcdef1!"));
+    EXPECT_FALSE(matches("@password-long", "Abc1!"));
+    EXPECT_FALSE(matches("@password-long", "Abcdef1!\n"));
+}
+
+TEST(Validators, HostileInputIsCheckedInOnePass) {
+    // Backtracks badly under std::regex; a single scan here
+    const std::string value = std::string(1 << 20, 'a') + "@" + std::string(1 << 20, 'b');
+    EXPECT_FALSE(matches("@email", value));
+    EXPECT_TRUE(matches("@password", value));
+}
+
+TEST(Validators, ValidatorConstraintRejectsMismatches) {
+    const nlohmann::json field = {
+        {"name", "email"}, {"type", "string"}, {"constraints", {{"validator", "@email"}}}
+    };
+    EXPECT_FALSE(mb::Validators::validatorConstraintCheck(field, {{"email", "a@b.io"}}).has_value());
+    EXPECT_TRUE(mb::Validators::validatorConstraintCheck(field, {{"email", "nope"}}).has_value());
+    // Missing or null is for the required check to judge
+    EXPECT_FALSE(mb::Validators::validatorConstraintCheck(field, nlohmann::json::object()).has_value());
+    EXPECT_FALSE(mb::Validators::validatorConstraintCheck(field, {{"email", nullptr}}).has_value());
+}
+
+TEST(Validators, ValidatePresetThrowsItsError) {
+    EXPECT_FALSE(mb::Validators::validatePreset("email", "a@b.io").has_value());
+    EXPECT_THROW(mb::Validators::validatePreset("email", "nope"), mb::MantisException);
+    EXPECT_THROW(mb::Validators::validatePreset("@unknown", "x"), mb::MantisException);
+}
+
+TEST(Validators, PlanReadsConstraintsOnce) {
+    const std::vector<nlohmann::json> fields = {
+        {{"name", "id"}, {"type", "string"}, {"required", true}},
+        {{"name", "title"}, {"type", "string"}, {"required", true}, {"constraints", {{"min_value", 3}, {"max_value", 5}}}},
+        {{"name", "email"}, {"type", "string"}, {"constraints", {{"validator", "@email"}}}},
+        {{"name", "age"}, {"type", "int"}, {"constraints", {{"min_value", 18}}}},
+        {{"name", "kind"}, {"type", "string"}, {"required", true}, {"constraints", {{"default_value", "a"}}}},
+    };
+    const auto plan = mb::ValidationPlan::compile(fields);
+
+    // System fields aren't checked; a database default satisfies `required`
+    ASSERT_EQ(plan.checks.size(), 4);
+    EXPECT_EQ(plan.find("id"), nullptr);
+    ASSERT_EQ(plan.required.size(), 1);
+    EXPECT_EQ(plan.checks[plan.required[0]].name, "title");
+
+    const auto &title = *plan.find("title");
+    EXPECT_FALSE(mb::ValidationPlan::run(title, "abcd").has_value());
+    EXPECT_TRUE(mb::ValidationPlan::run(title, "ab").has_value());
+    EXPECT_TRUE(mb::ValidationPlan::run(title, "abcdef").has_value());
+    EXPECT_TRUE(mb::ValidationPlan::run(title, nullptr).has_value());
+
+    const auto &email = *plan.find("email");
+    EXPECT_EQ(email.preset, mb::Validators::preset("@email"));
+    EXPECT_TRUE(mb::ValidationPlan::run(email, "nope").has_value());
+    EXPECT_FALSE(mb::ValidationPlan::run(email, nullptr).has_value());
+
+    EXPECT_TRUE(mb::ValidationPlan::run(*plan.find("age"), 17).has_value());
+    EXPECT_FALSE(mb::ValidationPlan::run(*plan.find("age"), 18.5).has_value());
+}
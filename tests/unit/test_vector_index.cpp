@@ -0,0 +1,194 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/vector_index.h"
+#include "mantisbase/core/models/entity.h"
+#include "mantisbase/core/models/entity_schema.h"
+#include "mantisbase/core/models/entity_schema_field.h"
+#include "mantisbase/mantisbase.h"
+#include "../common/test_environment.h"
+
+#include <algorithm>
+#include <random>
+
+using mb::VectorIndex;
+using mb::VectorIndexes;
+using nlohmann::json;
+
+namespace {
+    std::vector<std::vector<float>> randomVectors(const std::size_t n, const std::size_t dim, const unsigned seed) {
+        std::mt19937 rng(seed);
+        std::normal_distribution<float> normal;
+        std::vector<std::vector<float>> out(n, std::vector<float>(dim));
+        for (auto &v: out) std::ranges::generate(v, [&] { return normal(rng); });
+        return out;
+    }
+
+    float cosineDistance(const std::vector<float> &a, const std::vector<float> &b) {
+        const auto n = a.size();
+        return 1.f - VectorIndex::dot(a.data(), b.data(), n) /
+                     std::sqrt(VectorIndex::dot(a.data(), a.data(), n) * VectorIndex::dot(b.data(), b.data(), n));
+    }
+}
+
+TEST(VectorIndex, FindsMostTrueNeighbours) {
+    constexpr std::size_t n = 2000, dim = 32, k = 10;
+    const auto vectors = randomVectors(n, dim, 1);
+    VectorIndex index(dim);
+    for (std::size_t i = 0; i < n; ++i) index.upsert(std::to_string(i), vectors[i]);
+    EXPECT_EQ(index.size(), n);
+
+    std::size_t found = 0;
+    for (const auto &query: randomVectors(50, dim, 2)) {
+        std::vector<std::pair<float, std::size_t>> exact;
+        for (std::size_t i = 0; i < n; ++i) exact.emplace_back(cosineDistance(query, vectors[i]), i);
+        std::ranges::partial_sort(exact, exact.begin() + k);
+
+        const auto hits = index.search(query, k);
+        ASSERT_EQ(hits.size(), k);
+        EXPECT_TRUE(std::ranges::is_sorted(hits, {}, &VectorIndex::Hit::distance));
+        for (std::size_t j = 0; j < k; ++j)
+            found += std::ranges::count(hits, std::to_string(exact[j].second), &VectorIndex::Hit::id);
+    }
+    EXPECT_GE(found, 50 * k * 9 / 10);
+}
+
+TEST(VectorIndex, ForgetsRemovedAndReplacedVectors) {
+    constexpr std::size_t dim = 8;
+    const auto vectors = randomVectors(500, dim, 3);
+    VectorIndex index(dim);
+    for (std::size_t i = 0; i < vectors.size(); ++i) index.upsert(std::to_string(i), vectors[i]);
+
+    // Enough removals to rebuild the graph
+    for (std::size_t i = 0; i < 450; ++i) ASSERT_TRUE(index.remove(std::to_string(i)));
+    EXPECT_FALSE(index.remove("0"));
+    EXPECT_EQ(index.size(), 50u);
+    for (const auto &hit: index.search(vectors[0], 50)) EXPECT_GE(std::stoi(hit.id), 450);
+    EXPECT_EQ(index.search(vectors[499], 1).front().id, "499");
+
+    index.upsert("499", vectors[0]);
+    EXPECT_EQ(index.search(vectors[0], 1).front().id, "499");
+    EXPECT_EQ(index.size(), 50u);
+
+    // No direction, so never a neighbour
+    index.upsert("498", std::vector<float>(dim, 0.f));
+    EXPECT_EQ(index.size(), 49u);
+    EXPECT_THROW(index.upsert("x", std::vector<float>{1, 2}), mb::MantisException);
+}
+
+TEST(VectorIndex, EncodesLittleEndianFloats) {
+    const std::vector<float> v{1.5f, -2.25f, 0.f, 3e-7f};
+    const auto text = VectorIndex::encode(v);
+    EXPECT_EQ(text.size(), 22u); // 16 bytes, unpadded base64url
+    EXPECT_EQ(VectorIndex::decode(text), v);
+    EXPECT_EQ(VectorIndex::toJSON(text), json(v));
+    EXPECT_TRUE(VectorIndex::toJSON("AAA").is_null()); // Two bytes, no float
+
+    EXPECT_EQ(VectorIndex::parse(json{1, 2.5, -3}, 3), (std::vector<float>{1, 2.5f, -3}));
+    EXPECT_THROW((void) VectorIndex::parse(json{1, 2}, 3), mb::MantisException);
+    EXPECT_THROW((void) VectorIndex::parse(json{1, "2", 3}, 3), mb::MantisException);
+
+    // Lengths around the kernels' strides
+    for (const std::size_t n: {1u, 7u, 8u, 15u, 16u, 17u, 33u}) {
+        const std::vector<float> a(n, 1.f), b(n, 2.f);
+        EXPECT_FLOAT_EQ(VectorIndex::dot(a.data(), b.data(), n), 2.f * static_cast<float>(n));
+    }
+}
+
+TEST(VectorIndexes, RereadsChangedRowsOnAcquire) {
+    VectorIndexes indexes;
+    VectorIndexes::Rows rows{{"a", VectorIndex::encode(std::vector<float>{1, 0})},
+                             {"b", VectorIndex::encode(std::vector<float>{0, 1})}};
+    int full = 0, partial = 0;
+    const auto load = [&](const std::vector<std::string> *ids) {
+        if (!ids) {
+            ++full;
+            return rows;
+        }
+        ++partial;
+        VectorIndexes::Rows out;
+        for (const auto &row: rows)
+            if (std::ranges::find(*ids, row.first) != ids->end()) out.push_back(row);
+        return out;
+    };
+
+    EXPECT_EQ(indexes.acquire("e", "v", 2, load)->size(), 2u);
+    (void) indexes.acquire("e", "v", 2, load);
+    EXPECT_EQ(full, 1);
+    EXPECT_EQ(partial, 0);
+
+    rows.erase(rows.begin());
+    rows.emplace_back("c", VectorIndex::encode(std::vector<float>{1, 1}));
+    indexes.onChanges(json::array({{{"entity", "e"}, {"row_id", "a"}, {"type", "DELETE"}},
+                                   {{"entity", "e"}, {"row_id", "c"}, {"type", "INSERT"}},
+                                   {{"entity", "other"}, {"row_id", "x"}, {"type", "INSERT"}}}));
+    const auto index = indexes.acquire("e", "v", 2, load);
+    EXPECT_EQ(partial, 1);
+    EXPECT_EQ(index->size(), 2u);
+    EXPECT_EQ(index->search(std::vector<float>{1, 0.1f}, 1).front().id, "c");
+
+    // A change without a row reloads everything
+    indexes.onChanges(json::array({{{"entity", "e"}, {"row_id", ""}, {"type", "IMPORT"}}}));
+    (void) indexes.acquire("e", "v", 2, load);
+    EXPECT_EQ(full, 2);
+
+    indexes.invalidateEntity("e");
+    EXPECT_EQ(indexes.loaded(), 0u);
+}
+
+class VectorFieldTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        schema = std::make_unique<mb::EntitySchema>(mb::MantisBase::instance(), "vector_docs", "base");
+        schema->addField(mb::EntitySchemaField("title", "string"));
+        schema->addField(mb::EntitySchemaField("embedding", "vector").setDim(3));
+        if (!mb::EntitySchema::tableExists(*schema)) mb::EntitySchema::createTable(*schema);
+    }
+
+    void TearDown() override {
+        mb::EntitySchema::dropTable(*schema);
+        mb::Entity::vectorIndexes().invalidateEntity("vector_docs");
+    }
+
+    std::unique_ptr<mb::EntitySchema> schema;
+};
+
+TEST_F(VectorFieldTest, ListsNearestRecordsFirst) {
+    const auto docs = schema->toEntity();
+    const auto x = docs.create({{"title", "x"}, {"embedding", {1, 0, 0}}});
+    (void) docs.create({{"title", "y"}, {"embedding", {0, 1, 0}}});
+    (void) docs.create({{"title", "xy"}, {"embedding", {1, 1, 0}}});
+    (void) docs.create({{"title", "none"}, {"embedding", nullptr}});
+    EXPECT_EQ(x["embedding"], json({1.0, 0.0, 0.0}));
+
+    mb::Entity::ListPage page;
+    const auto near = docs.list({{"near", {{"vector", {0.9, 0.2, 0}}, {"k", 2}}}}, page);
+    ASSERT_EQ(near.size(), 2u);
+    EXPECT_EQ(near[0]["title"], "x");
+    EXPECT_EQ(near[1]["title"], "xy");
+    EXPECT_TRUE(page.cursor.empty());
+
+    // Filtered pages pick from more candidates
+    const auto filtered = docs.list({{"near", {{"vector", {1, 0, 0}}, {"k", 1}}}, {"filter", "title != 'x'"}});
+    ASSERT_EQ(filtered.size(), 1u);
+    EXPECT_EQ(filtered[0]["title"], "xy");
+
+    // New rows are indexed once their change is heard
+    const auto z = docs.create({{"title", "z"}, {"embedding", {0.95, 0.05, 0}}});
+    mb::Entity::vectorIndexes().onChanges(json::array({{{"entity", "vector_docs"}, {"row_id", z["id"]},
+                                                        {"type", "INSERT"}}}));
+    EXPECT_EQ(docs.list({{"near", {{"vector", {1, 0, 0}}, {"k", 1}}}})[0]["title"], "z");
+}
+
+TEST_F(VectorFieldTest, RejectsBadVectorsAndQueries) {
+    const auto docs = schema->toEntity();
+    EXPECT_THROW((void) docs.create({{"title", "short"}, {"embedding", {1, 0}}}), mb::MantisException);
+    EXPECT_THROW((void) docs.create({{"title", "text"}, {"embedding", "1,0,0"}}), mb::MantisException);
+
+    EXPECT_THROW((void) docs.list({{"near", {{"vector", {1, 0}}}}}), mb::MantisException);
+    EXPECT_THROW((void) docs.list({{"near", {{"vector", {1, 0, 0}}, {"field", "title"}}}}), mb::MantisException);
+    EXPECT_THROW((void) docs.list({{"near", {{"vector", {1, 0, 0}}}}, {"pagination", {{"sort", "title"}}}}),
+                 mb::MantisException);
+
+    EXPECT_TRUE(mb::EntitySchemaField("v", "vector").validate().has_value());
+    EXPECT_THROW(mb::EntitySchemaField("v", "vector").setDim(0), mb::MantisException);
+    EXPECT_EQ(mb::EntitySchemaField("v", "vector").setDim(8).toJSON()["dim"], 8);
+}
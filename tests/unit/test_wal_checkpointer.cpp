@@ -0,0 +1,127 @@
+#include <gtest/gtest.h>
+#include "mantisbase/core/wal_checkpointer.h"
+
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    using namespace std::chrono_literals;
+    using mb::WalCheckpointer;
+    using Mode = WalCheckpointer::Mode;
+
+    constexpr int kPage = 4096;
+
+    WalCheckpointer::Options options() {
+        WalCheckpointer::Options o;
+        o.idle = 1000ms;
+        o.restartBytes = 100 * kPage;
+        o.truncateBytes = 400 * kPage;
+        return o;
+    }
+
+    /// Records the modes asked for and replies with `result`.
+    struct FakeCheckpoint {
+        std::vector<Mode> modes;
+        WalCheckpointer::Result result;
+        bool fail = false;
+
+        WalCheckpointer::Checkpoint fn() {
+            return [this](const Mode mode) {
+                modes.push_back(mode);
+                if (fail) throw std::runtime_error("database is locked");
+                return result;
+            };
+        }
+    };
+}
+
+TEST(WalCheckpointer, DueEscalatesWithWalSize) {
+    const auto o = options();
+    EXPECT_EQ(WalCheckpointer::due(o, 0, 0, 10s), std::nullopt);
+    EXPECT_EQ(WalCheckpointer::due(o, 10 * kPage, 10 * kPage, 10ms), std::nullopt); // still writing
+    EXPECT_EQ(WalCheckpointer::due(o, 10 * kPage, 10 * kPage, 2s), Mode::Passive);
+    EXPECT_EQ(WalCheckpointer::due(o, 10 * kPage, 0, 2s), std::nullopt);             // already copied back
+    EXPECT_EQ(WalCheckpointer::due(o, 150 * kPage, 0, 0ms), Mode::Restart);
+    EXPECT_EQ(WalCheckpointer::due(o, 500 * kPage, 0, 0ms), Mode::Truncate);
+}
+
+TEST(WalCheckpointer, PassiveOnlyOnceIdle) {
+    FakeCheckpoint fake;
+    fake.result = {false, 20, 20};
+    WalCheckpointer ckpt(fake.fn(), kPage, options());
+
+    const auto t0 = WalCheckpointer::Clock::now();
+    ckpt.noteCommit(20, t0);
+    EXPECT_EQ(ckpt.tick(t0 + 100ms), std::nullopt);
+    EXPECT_EQ(ckpt.tick(t0 + 1500ms), Mode::Passive);
+
+    // Everything is back in the database; nothing more to do until the next write
+    EXPECT_EQ(ckpt.tick(t0 + 3s), std::nullopt);
+    ASSERT_EQ(fake.modes.size(), 1u);
+
+    const auto stats = ckpt.stats();
+    EXPECT_EQ(stats.passive, 1u);
+    EXPECT_EQ(stats.frames, 20u);
+    EXPECT_EQ(stats.walBytes, 20 * kPage);
+}
+
+TEST(WalCheckpointer, WalRestartResetsBackfill) {
+    FakeCheckpoint fake;
+    fake.result = {false, 20, 20};
+    WalCheckpointer ckpt(fake.fn(), kPage, options());
+
+    const auto t0 = WalCheckpointer::Clock::now();
+    ckpt.noteCommit(20, t0);
+    ASSERT_EQ(ckpt.tick(t0 + 2s), Mode::Passive);
+
+    // A writer started the WAL over: those 5 frames are new
+    ckpt.noteCommit(5, t0 + 3s);
+    fake.result = {false, 5, 5};
+    EXPECT_EQ(ckpt.tick(t0 + 5s), Mode::Passive);
+    EXPECT_EQ(ckpt.stats().frames, 25u);
+}
+
+TEST(WalCheckpointer, LargeWalEscalatesWithoutWaitingForIdle) {
+    FakeCheckpoint fake;
+    fake.result = {false, 500, 500};
+    WalCheckpointer ckpt(fake.fn(), kPage, options());
+
+    const auto t0 = WalCheckpointer::Clock::now();
+    ckpt.noteCommit(500, t0);
+    EXPECT_EQ(ckpt.tick(t0), Mode::Truncate);
+    EXPECT_EQ(ckpt.stats().walBytes, 0);
+    EXPECT_EQ(ckpt.tick(t0 + 2s), std::nullopt);
+}
+
+TEST(WalCheckpointer, BusyAndFailedCheckpointsAreRetried) {
+    FakeCheckpoint fake;
+    fake.result = {true, 150, 40};
+    WalCheckpointer ckpt(fake.fn(), kPage, options());
+
+    const auto t0 = WalCheckpointer::Clock::now();
+    ckpt.noteCommit(150, t0);
+    EXPECT_EQ(ckpt.tick(t0), Mode::Restart);
+
+    fake.fail = true;
+    EXPECT_EQ(ckpt.tick(t0 + 1s), Mode::Restart);
+
+    const auto stats = ckpt.stats();
+    EXPECT_EQ(stats.restart, 2u);
+    EXPECT_EQ(stats.busy, 1u);
+    EXPECT_EQ(stats.failed, 1u);
+    EXPECT_EQ(stats.walBytes, 150 * kPage); // still pending
+}
+
+TEST(WalCheckpointer, ThreadRunsCheckpointInBackground) {
+    std::atomic<int> runs{0};
+    auto o = options();
+    o.poll = 10ms;
+    o.idle = 20ms;
+    WalCheckpointer ckpt([&](Mode) { ++runs; return WalCheckpointer::Result{false, 3, 3}; }, kPage, o);
+    ckpt.start();
+    ckpt.noteCommit(3);
+
+    for (int i = 0; i < 200 && runs.load() == 0; ++i) std::this_thread::sleep_for(5ms);
+    ckpt.stop();
+    EXPECT_EQ(runs.load(), 1);
+}
@@ -0,0 +1,184 @@
+#include <gtest/gtest.h>
+#include <soci/soci.h>
+#include <soci/sqlite3/soci-sqlite3.h>
+#include "mantisbase/core/webhooks.h"
+#include "mantisbase/core/exceptions.h"
+
+#include <memory>
+#include <vector>
+
+namespace {
+    using namespace std::chrono_literals;
+    using mb::Webhooks;
+    using json = nlohmann::json;
+
+    /// The webhook tables in memory, the way Database::createSysTables() makes them
+    std::shared_ptr<soci::session> database() {
+        auto sql = std::make_shared<soci::session>(soci::sqlite3, ":memory:");
+        *sql << "CREATE TABLE mb_webhooks (id TEXT PRIMARY KEY, url TEXT NOT NULL, topics TEXT NOT NULL, "
+                "secret TEXT, created BIGINT NOT NULL)";
+        *sql << "CREATE TABLE mb_webhook_outbox (id TEXT PRIMARY KEY, hook TEXT NOT NULL, events TEXT NOT NULL, "
+                "n INTEGER NOT NULL, attempts INTEGER NOT NULL DEFAULT 0, due BIGINT NOT NULL, seq BIGINT NOT NULL)";
+        return sql;
+    }
+
+    /// Records each POST; answers with `status` right away, or holds the answer back when 0
+    struct Endpoint {
+        int status = 200;
+        std::vector<Webhooks::Request> requests;
+        std::vector<Webhooks::Done> held;
+
+        Webhooks::Send send() {
+            return [this](const Webhooks::Request &request, Webhooks::Done done) {
+                requests.push_back(request);
+                if (status) done(status);
+                else held.push_back(std::move(done));
+            };
+        }
+
+        json events(const std::size_t i) const { return json::parse(requests.at(i).body)["events"]; }
+    };
+
+    json change(const std::string &entity, const std::string &row_id, const std::string &type = "INSERT",
+                const int id = 1) {
+        return {{"id", id}, {"type", type}, {"entity", entity}, {"row_id", row_id}, {"timestamp", "2026-01-01"},
+                {"new_data", {{"id", row_id}, {"name", "x"}, {"password", "$argon2id$..."}}}};
+    }
+
+    Webhooks::Options options() {
+        Webhooks::Options o;
+        o.retryBase = 0s;
+        return o;
+    }
+}
+
+TEST(Webhooks, PostsMatchingChangesInBatches) {
+    const auto sql = database();
+    Endpoint endpoint;
+    auto o = options();
+    o.batch = 2;
+    Webhooks hooks(o, endpoint.send(), [sql] { return sql; });
+
+    const auto all = hooks.create({{"url", "https://example.com/in"}, {"topics", {"posts"}}});
+    const auto one = hooks.create({{"url", "https://example.com/one"}, {"topics", {"users:u1"}}});
+    EXPECT_EQ(hooks.list().size(), 2u);
+
+    hooks.onChanges(json::array({change("posts", "p1"), change("posts", "p2"), change("posts", "p3"),
+                                 change("users", "u1"), change("users", "u2")}));
+    // Up to two events per POST; two POSTs at most in flight per webhook
+    EXPECT_EQ(hooks.step(), 3u);
+    ASSERT_EQ(endpoint.requests.size(), 3u);
+
+    std::size_t posts = 0;
+    for (std::size_t i = 0; i < endpoint.requests.size(); ++i) {
+        const auto &request = endpoint.requests[i];
+        const auto events = endpoint.events(i);
+        EXPECT_LE(events.size(), 2u);
+        if (request.url == one.url) {
+            ASSERT_EQ(events.size(), 1u);
+            EXPECT_EQ(events[0]["row_id"], "u1");
+            EXPECT_EQ(events[0]["action"], "insert");
+            EXPECT_FALSE(events[0]["data"].contains("password"));
+        } else {
+            EXPECT_EQ(request.url, all.url);
+            posts += events.size();
+        }
+    }
+    EXPECT_EQ(posts, 3u);
+
+    // Answered with 200 each; settled on the next step
+    EXPECT_EQ(hooks.step(), 0u);
+    EXPECT_EQ(hooks.pending(), 0u);
+}
+
+TEST(Webhooks, RetriesFailuresThenDropsThem) {
+    const auto sql = database();
+    Endpoint endpoint;
+    endpoint.status = 503;
+    auto o = options();
+    o.maxAttempts = 3;
+    Webhooks hooks(o, endpoint.send(), [sql] { return sql; });
+    hooks.create({{"url", "http://localhost:9000/hook"}});
+
+    hooks.onChanges(json::array({change("posts", "p1")}));
+    EXPECT_EQ(hooks.step(), 1u);
+    EXPECT_EQ(hooks.step(), 1u);
+    EXPECT_EQ(hooks.step(), 1u);
+    EXPECT_EQ(hooks.pending(), 1u);
+
+    // The third failure used the last attempt
+    EXPECT_EQ(hooks.step(), 0u);
+    EXPECT_EQ(hooks.pending(), 0u);
+    EXPECT_EQ(endpoint.requests.size(), 3u);
+}
+
+TEST(Webhooks, CapsPostsInFlightPerWebhook) {
+    const auto sql = database();
+    Endpoint endpoint;
+    endpoint.status = 0;
+    auto o = options();
+    o.batch = 1;
+    o.concurrency = 2;
+    Webhooks hooks(o, endpoint.send(), [sql] { return sql; });
+    hooks.create({{"url", "http://localhost:9000/hook"}, {"topics", {"posts:*"}}});
+
+    hooks.onChanges(json::array({change("posts", "p1", "INSERT", 1), change("posts", "p2", "INSERT", 2),
+                                 change("posts", "p3", "INSERT", 3)}));
+    EXPECT_EQ(hooks.step(), 2u);
+    EXPECT_EQ(hooks.step(), 0u);
+    EXPECT_EQ(endpoint.events(0)[0]["event_id"], 1);
+    EXPECT_EQ(endpoint.events(1)[0]["event_id"], 2);
+
+    endpoint.held[0](204);
+    EXPECT_EQ(hooks.step(), 1u);
+    EXPECT_EQ(endpoint.events(2)[0]["event_id"], 3);
+    EXPECT_EQ(hooks.pending(), 2u);
+}
+
+TEST(Webhooks, SignsBodiesWithTheSecret) {
+    const auto sql = database();
+    Endpoint endpoint;
+    Webhooks hooks(options(), endpoint.send(), [sql] { return sql; });
+    const auto hook = hooks.create({{"url", "https://example.com/in"}, {"secret", "s3cret"}});
+    EXPECT_TRUE(hook.toJSON()["signed"].get<bool>());
+    EXPECT_FALSE(hook.toJSON().contains("secret"));
+
+    hooks.onChanges(json::array({change("posts", "p1", "DELETE")}));
+    ASSERT_EQ(hooks.step(), 1u);
+    const auto &request = endpoint.requests[0];
+    EXPECT_TRUE(endpoint.events(0)[0]["data"].is_null());
+
+    std::string signature;
+    for (const auto &[name, value]: request.headers)
+        if (name == "X-Mantis-Signature") signature = value;
+    EXPECT_EQ(signature, Webhooks::signature("s3cret", request.body));
+    EXPECT_TRUE(signature.starts_with("sha256="));
+}
+
+TEST(Webhooks, ValidatesAndRemoves) {
+    const auto sql = database();
+    Endpoint endpoint;
+    Webhooks hooks(options(), endpoint.send(), [sql] { return sql; });
+
+    EXPECT_THROW(hooks.create({{"url", "ftp://example.com"}}), mb::MantisException);
+    EXPECT_THROW(hooks.create({{"url", "https://example.com"}, {"topics", "posts"}}), mb::MantisException);
+    EXPECT_THROW(hooks.create({{"url", "https://example.com"}, {"topics", {"posts?status=1"}}}), mb::MantisException);
+
+    // `*` leaves system tables out
+    const auto hook = hooks.create({{"url", "https://example.com"}});
+    hooks.onChanges(json::array({change("mb_admins", "a1")}));
+    EXPECT_EQ(hooks.step(), 0u);
+
+    hooks.onChanges(json::array({change("posts", "p1")}));
+    endpoint.status = 500;
+    EXPECT_TRUE(hooks.remove(hook.id));
+    EXPECT_FALSE(hooks.remove(hook.id));
+    EXPECT_EQ(hooks.pending(), 0u);
+}
+
+TEST(Webhooks, BacksOffExponentially) {
+    EXPECT_EQ(Webhooks::backoff(2, 2s, 600s), 2s);
+    EXPECT_EQ(Webhooks::backoff(3, 2s, 600s), 4s);
+    EXPECT_EQ(Webhooks::backoff(6, 2s, 600s), 32s);
+    EXPECT_EQ(Webhooks::backoff(40, 2s, 600s), 600s);
+}
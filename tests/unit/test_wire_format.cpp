@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+#include <string>
+
+#include "mantisbase/core/wire_format.h"
+
+using json = nlohmann::json;
+using Format = mb::WireFormat::Format;
+
+TEST(WireFormat, NegotiatesFromAccept) {
+    EXPECT_EQ(mb::WireFormat::negotiate(""), Format::Json);
+    EXPECT_EQ(mb::WireFormat::negotiate("*/*"), Format::Json);
+    EXPECT_EQ(mb::WireFormat::negotiate("application/json"), Format::Json);
+    EXPECT_EQ(mb::WireFormat::negotiate("application/msgpack"), Format::MsgPack);
+    EXPECT_EQ(mb::WireFormat::negotiate("application/x-msgpack"), Format::MsgPack);
+    EXPECT_EQ(mb::WireFormat::negotiate("Application/CBOR"), Format::Cbor);
+    EXPECT_EQ(mb::WireFormat::negotiate("text/html, application/cbor;q=0.5, */*;q=0.1"), Format::Cbor);
+}
+
+TEST(WireFormat, HighestQualityWinsAndTiesGoFirst) {
+    EXPECT_EQ(mb::WireFormat::negotiate("application/json;q=0.9, application/msgpack"), Format::MsgPack);
+    EXPECT_EQ(mb::WireFormat::negotiate("application/msgpack;q=0.5, application/json"), Format::Json);
+    EXPECT_EQ(mb::WireFormat::negotiate("application/cbor, application/msgpack"), Format::Cbor);
+    EXPECT_EQ(mb::WireFormat::negotiate("application/json, application/cbor"), Format::Json);
+    // q=0 refuses a format outright
+    EXPECT_EQ(mb::WireFormat::negotiate("application/msgpack;q=0"), Format::Json);
+}
+
+TEST(WireFormat, ParsesNamesAndMediaTypes) {
+    EXPECT_EQ(mb::WireFormat::fromName("msgpack"), Format::MsgPack);
+    EXPECT_EQ(mb::WireFormat::fromName("CBOR"), Format::Cbor);
+    EXPECT_EQ(mb::WireFormat::fromName("json"), Format::Json);
+    EXPECT_FALSE(mb::WireFormat::fromName("").has_value());
+    EXPECT_FALSE(mb::WireFormat::fromName("xml").has_value());
+
+    EXPECT_EQ(mb::WireFormat::fromMediaType("application/json; charset=utf-8"), Format::Json);
+    EXPECT_EQ(mb::WireFormat::fromMediaType("application/msgpack"), Format::MsgPack);
+    EXPECT_FALSE(mb::WireFormat::fromMediaType("multipart/form-data; boundary=x").has_value());
+
+    for (const auto format: {Format::Json, Format::MsgPack, Format::Cbor}) {
+        EXPECT_EQ(mb::WireFormat::fromName(mb::WireFormat::name(format)), format);
+        EXPECT_EQ(mb::WireFormat::fromMediaType(mb::WireFormat::mediaType(format)), format);
+    }
+}
+
+TEST(WireFormat, RoundTripsEveryFormat) {
+    const json value = {
+        {"id", "01J"}, {"count", 42}, {"big", 18446744073709551615ull}, {"neg", -7}, {"score", 2.5},
+        {"ok", true}, {"none", nullptr}, {"tags", {"a", "b"}}, {"nested", {{"deep", json::array()}}}
+    };
+
+    for (const auto format: {Format::Json, Format::MsgPack, Format::Cbor}) {
+        const auto bytes = mb::WireFormat::encode(format, value);
+        EXPECT_EQ(mb::WireFormat::decode(format, bytes), value) << mb::WireFormat::name(format);
+    }
+
+    EXPECT_EQ(mb::WireFormat::encode(Format::Json, value), value.dump());
+    EXPECT_LT(mb::WireFormat::encode(Format::MsgPack, value).size(), value.dump().size());
+}
+
+TEST(WireFormat, EncodesBinaryAsBase64ForText) {
+    EXPECT_EQ(mb::WireFormat::encodeText(Format::Json, {{"a", 1}}), R"({"a":1})");
+
+    // msgpack of {"a": 1} is 81 a1 61 01
+    EXPECT_EQ(mb::WireFormat::encodeText(Format::MsgPack, {{"a", 1}}), "gaFhAQ==");
+    // ...and of "ab", a2 61 62; of "abc", a3 61 62 63
+    EXPECT_EQ(mb::WireFormat::encodeText(Format::MsgPack, "ab"), "omFi");
+    EXPECT_EQ(mb::WireFormat::encodeText(Format::MsgPack, "abc"), "o2FiYw==");
+}
+
+TEST(WireFormat, RejectsMalformedBytes) {
+    EXPECT_THROW((void) mb::WireFormat::decode(Format::MsgPack, "\xc1"), json::exception);
+    EXPECT_THROW((void) mb::WireFormat::decode(Format::Cbor, "\xa1"), json::exception);
+}
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <soci/soci.h>
+#include <soci/sqlite3/soci-sqlite3.h>
+#include "mantisbase/core/write_queue.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+    using namespace std::chrono_literals;
+    using mb::WriteQueue;
+
+    struct WriteQueueFixture : ::testing::Test {
+        soci::session sql{soci::sqlite3, ":memory:"};
+        std::mutex lease_mutex;
+
+        void SetUp() override {
+            sql << "CREATE TABLE items (id INTEGER PRIMARY KEY, name TEXT NOT NULL)";
+        }
+
+        WriteQueue::Lease lease() {
+            return [this] {
+                lease_mutex.lock();
+                return std::shared_ptr<soci::session>(&sql, [this](soci::session *) { lease_mutex.unlock(); });
+            };
+        }
+
+        int count() {
+            int n = 0;
+            sql << "SELECT COUNT(*) FROM items", soci::into(n);
+            return n;
+        }
+    };
+}
+
+TEST_F(WriteQueueFixture, GroupsConcurrentWrites) {
+    WriteQueue queue(lease(), {20ms, 64});
+    queue.start();
+
+    std::vector<std::thread> writers;
+    for (int i = 0; i < 32; ++i)
+        writers.emplace_back([&, i] {
+            queue.run([i](soci::session &s) { s << "INSERT INTO items (id, name) VALUES (:id, 'x')", soci::use(i); });
+        });
+    for (auto &t: writers) t.join();
+    queue.stop();
+
+    EXPECT_EQ(count(), 32);
+    const auto stats = queue.stats();
+    EXPECT_EQ(stats.jobs, 32u);
+    EXPECT_EQ(stats.failed, 0u);
+    EXPECT_LT(stats.groups, 32u); // at least some writes shared a commit
+    EXPECT_EQ(stats.pending, 0u);
+}
+
+TEST_F(WriteQueueFixture, FailedJobRollsBackAlone) {
+    WriteQueue queue(lease(), {20ms, 64});
+    queue.start();
+
+    std::atomic<int> failures{0};
+    std::vector<std::thread> writers;
+    for (int i = 0; i < 8; ++i)
+        writers.emplace_back([&, i] {
+            try {
+                queue.run([i](soci::session &s) {
+                    s << "INSERT INTO items (id, name) VALUES (:id, 'x')", soci::use(i);
+                    if (i % 2) throw std::runtime_error("rejected");
+                });
+            } catch (const std::runtime_error &) {
+                ++failures;
+            }
+        });
+    for (auto &t: writers) t.join();
+    queue.stop();
+
+    EXPECT_EQ(failures.load(), 4);
+    EXPECT_EQ(count(), 4);
+    EXPECT_EQ(queue.stats().failed, 4u);
+}
+
+TEST_F(WriteQueueFixture, NestedWriteRunsInline) {
+    WriteQueue queue([this] { return std::shared_ptr<soci::session>(&sql, [](soci::session *) {}); }, {0ms, 8});
+    queue.start();
+
+    queue.run([&](soci::session &s) {
+        s << "INSERT INTO items (id, name) VALUES (1, 'outer')";
+        EXPECT_TRUE(queue.onWriterThread());
+        EXPECT_THROW(queue.run([](soci::session &inner) {
+            inner << "INSERT INTO items (id, name) VALUES (2, 'inner')";
+            throw std::runtime_error("undo inner");
+        }), std::runtime_error);
+        queue.run([](soci::session &inner) { inner << "INSERT INTO items (id, name) VALUES (3, 'inner')"; });
+    });
+    queue.stop();
+
+    EXPECT_EQ(count(), 2); // outer and the second inner write
+}
+
+TEST_F(WriteQueueFixture, RunsInlineWhenStopped) {
+    WriteQueue queue(lease(), {});
+    queue.run([](soci::session &s) { s << "INSERT INTO items (id, name) VALUES (1, 'x')"; });
+    EXPECT_EQ(count(), 1);
+    EXPECT_EQ(queue.stats().jobs, 0u); // never went through the writer thread
+}